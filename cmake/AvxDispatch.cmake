@@ -0,0 +1,11 @@
+option (ENABLE_AVX_DISPATCH "Runtime-dispatched AVX2/AVX-512 QEngineCPU kernels (x86, GCC or Clang)" ON)
+
+if (MSVC OR EMSCRIPTEN OR NOT (CMAKE_SYSTEM_PROCESSOR MATCHES "^(x86_64|AMD64|amd64|i.86)$"))
+    set(ENABLE_AVX_DISPATCH OFF)
+endif ()
+
+if (ENABLE_AVX_DISPATCH)
+    target_sources (qrack PRIVATE
+        src/common/simd_dispatch.cpp
+        )
+endif (ENABLE_AVX_DISPATCH)
@@ -0,0 +1 @@
+option (ENABLE_INSTRUMENTATION "Count calls and wall-clock time of hot-path operations, and buffer Chrome traces" OFF)
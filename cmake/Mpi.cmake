@@ -0,0 +1,24 @@
+option (ENABLE_MPI "Build QPagerMpi, to distribute one register over the ranks of an MPI job" OFF)
+
+if (MSVC OR EMSCRIPTEN)
+    set(ENABLE_MPI OFF)
+endif ()
+
+if (ENABLE_MPI)
+    find_package (MPI COMPONENTS CXX)
+    if (MPI_CXX_FOUND)
+        target_sources (qrack PRIVATE src/qpager_mpi.cpp)
+        target_link_libraries (qrack MPI::MPI_CXX)
+        target_link_libraries (qrack_pinvoke MPI::MPI_CXX)
+        if (NOT ENABLE_EMIT_LLVM)
+            # Single rank smoke test: every qubit is rank-local, but the collectives and MPI setup still run.
+            add_test (NAME qrack_tests_mpi
+                COMMAND ${MPIEXEC_EXECUTABLE} ${MPIEXEC_NUMPROC_FLAG} 1 ${MPIEXEC_PREFLAGS} $<TARGET_FILE:unittest>
+                    ${MPIEXEC_POSTFLAGS} test_qpager_mpi
+                )
+        endif (NOT ENABLE_EMIT_LLVM)
+    else ()
+        message (WARNING "MPI was not found; disabling ENABLE_MPI")
+        set(ENABLE_MPI OFF)
+    endif ()
+endif (ENABLE_MPI)
@@ -0,0 +1,18 @@
+option (ENABLE_NUMA "NUMA-aware CPU thread pinning and state vector placement (requires libnuma)" OFF)
+
+if (NOT ENABLE_PTHREAD OR MSVC OR APPLE OR EMSCRIPTEN)
+    set(ENABLE_NUMA OFF)
+endif ()
+
+if (ENABLE_NUMA)
+    find_path (NUMA_INCLUDE_DIR numa.h)
+    find_library (NUMA_LIBRARY numa)
+    if (NUMA_INCLUDE_DIR AND NUMA_LIBRARY)
+        target_include_directories (qrack PUBLIC ${NUMA_INCLUDE_DIR})
+        target_link_libraries (qrack ${NUMA_LIBRARY})
+        target_link_libraries (qrack_pinvoke ${NUMA_LIBRARY})
+    else ()
+        message (WARNING "libnuma was not found; disabling ENABLE_NUMA")
+        set(ENABLE_NUMA OFF)
+    endif ()
+endif (ENABLE_NUMA)
@@ -50,6 +50,7 @@ if (ENABLE_OPENCL)
             target_link_directories (unittest PRIVATE ${QRACK_OpenCL_LINK_DIRS})
             target_link_directories (benchmarks PRIVATE ${QRACK_OpenCL_LINK_DIRS})
             target_link_directories (qrack_cl_precompile PRIVATE ${QRACK_OpenCL_LINK_DIRS})
+            target_link_directories (qrack_profile PRIVATE ${QRACK_OpenCL_LINK_DIRS})
             target_link_directories (quantum_associative_memory PRIVATE ${QRACK_OpenCL_LINK_DIRS})
             target_link_directories (teleport PRIVATE ${QRACK_OpenCL_LINK_DIRS})
             target_link_directories (qneuron_classification PRIVATE ${QRACK_OpenCL_LINK_DIRS})
@@ -82,6 +83,7 @@ if (ENABLE_OPENCL)
         target_link_libraries (unittest ${QRACK_OpenCL_LIBRARIES})
         target_link_libraries (benchmarks ${QRACK_OpenCL_LIBRARIES})
         target_link_libraries (qrack_cl_precompile ${QRACK_OpenCL_LIBRARIES})
+        target_link_libraries (qrack_profile ${QRACK_OpenCL_LIBRARIES})
         target_link_libraries (quantum_associative_memory ${QRACK_OpenCL_LIBRARIES})
         target_link_libraries (teleport ${QRACK_OpenCL_LIBRARIES})
         target_link_libraries (qneuron_classification ${QRACK_OpenCL_LIBRARIES})
@@ -120,8 +122,10 @@ if (ENABLE_OPENCL)
     target_sources (qrack PRIVATE
         ${COMPILED_RESOURCES}
         src/common/oclengine.cpp
+        src/qbatch_opencl.cpp
         src/qengine/opencl.cpp
         src/qhybrid.cpp
+        src/qstabilizer_opencl.cpp
         src/qunitmulti.cpp
         )
 endif (ENABLE_OPENCL)
@@ -1 +1 @@
-option (ENABLE_QUNIT_CPU_PARALLEL "Make QEngineCPU partially async, so QUnit can parallelize over it (may exceed shell threading limits)" ON)
+option (ENABLE_QUNIT_CPU_PARALLEL "Make QEngineCPU gates async, on the shared worker pool, so QUnit can parallelize over it" ON)
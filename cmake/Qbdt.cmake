@@ -4,7 +4,9 @@ if (ENABLE_QBDT)
     target_sources (qrack PRIVATE
         src/qbdt/node_interface.cpp
         src/qbdt/node.cpp
+        src/qbdt/node_arena.cpp
         src/qbdt/qengine_node.cpp
         src/qbdt/tree.cpp
+        src/qbdt/unique_table.cpp
         )
 endif (ENABLE_QBDT)
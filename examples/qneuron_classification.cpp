@@ -15,6 +15,7 @@
 // "qneuron.hpp" defines the QNeuron class.
 #include "qneuron.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream> // For cout
 #include <string>
@@ -23,6 +24,8 @@ using namespace Qrack;
 
 const bitLenInt OUTPUT_INDEX = 0;
 const bitLenInt INPUT_START = 1;
+// Training rows per gradient step
+const size_t BATCH_SIZE = 16U;
 
 enum BoolH { BOOLH_F = 0, BOOLH_T = 1, BOOLH_H = 2 };
 
@@ -133,6 +136,12 @@ void train(std::vector<std::vector<BoolH>>& rawYX, std::vector<real1>& etas, QIn
 
     std::cout << "Learning..." << std::endl;
 
+    // Each mini-batch accumulates one analytic gradient per neuron, then takes one step.
+    std::vector<std::vector<real1>> gradients(outputLayer.size());
+    for (i = 0; i < outputLayer.size(); i++) {
+        gradients[i].resize((bitCapIntOcl)outputLayer[i]->GetInputPower());
+    }
+
     for (size_t rowIndex = 0; rowIndex < rowCount; rowIndex++) {
         std::cout << "Epoch " << (rowIndex + 1U) << " out of " << rowCount << std::endl;
 
@@ -153,13 +162,14 @@ void train(std::vector<std::vector<BoolH>>& rawYX, std::vector<real1>& etas, QIn
             qReg->H(permH[i]);
         }
 
-        if (permH.size() == 0) {
-            for (i = 0; i < outputLayer.size(); i++) {
-                outputLayer[i]->LearnPermutation(row[0], (real1_f)(etas[i] / rowCount));
-            }
-        } else {
+        for (i = 0; i < outputLayer.size(); i++) {
+            outputLayer[i]->AccumulateGradient(row[0] == BOOLH_T, &(gradients[i][0]));
+        }
+
+        if ((((rowIndex + 1U) % BATCH_SIZE) == 0U) || ((rowIndex + 1U) == rowCount)) {
             for (i = 0; i < outputLayer.size(); i++) {
-                outputLayer[i]->Learn(row[0], (real1_f)(etas[i] / (rowCount * pow2Ocl(permH.size()))));
+                outputLayer[i]->ApplyGradient(&(gradients[i][0]), (real1_f)(etas[i] / rowCount));
+                std::fill(gradients[i].begin(), gradients[i].end(), ZERO_R1);
             }
         }
     }
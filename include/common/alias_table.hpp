@@ -0,0 +1,41 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qrack_types.hpp"
+
+#include <vector>
+
+namespace Qrack {
+
+/**
+ * Walker (Vose) alias table over the outcomes [0, n) of a discrete distribution, with unnormalized weights. Building
+ * costs O(n), and each sample afterward costs O(1), from one uniform bucket index and one uniform real.
+ */
+class AliasTable {
+protected:
+    std::vector<real1> threshold;
+    std::vector<bitCapIntOcl> alias;
+
+public:
+    AliasTable(real1 const* weights, bitCapIntOcl n);
+
+    bitCapIntOcl Size() const { return (bitCapIntOcl)threshold.size(); }
+
+    /** Map "bucket," uniform on [0, n), with "u," uniform on [0, 1), to an outcome. */
+    bitCapIntOcl Sample(bitCapIntOcl bucket, real1_f u) const
+    {
+        return (u < (real1_f)threshold[bucket]) ? bucket : alias[bucket];
+    }
+};
+} // namespace Qrack
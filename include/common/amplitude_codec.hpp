@@ -0,0 +1,32 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qrack_types.hpp"
+
+#include <vector>
+
+namespace Qrack {
+
+/**
+ * Losslessly compress "length" amplitudes, (bit for bit, so -0 stays -0,) for cold storage. The codec works in whole
+ * amplitudes: runs of zero amplitudes become a count, and any run of at least two amplitudes that repeats an earlier
+ * one, (found by a hash of amplitude pairs, as in LZ4,) becomes a back-reference. Everything else is copied verbatim.
+ * Sparse and highly symmetric states, (like uniform superpositions,) shrink by orders of magnitude, while a generic
+ * state costs about one byte per literal run over its raw size.
+ */
+std::vector<unsigned char> CompressAmplitudes(complex const* amps, bitCapIntOcl length);
+
+/** Inflate the output of CompressAmplitudes() back into "length" amplitudes at "amps." */
+void DecompressAmplitudes(const std::vector<unsigned char>& blob, complex* amps, bitCapIntOcl length);
+} // namespace Qrack
@@ -0,0 +1,522 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2021. All rights reserved.
+//
+// BigInteger is a fixed-width, unsigned, two's complement integer over an array of 64 bit words, as a drop-in
+// "bitCapInt" for QBCAPPOW > 6. Mask arithmetic (shift, and, or, xor, compare, popcount, ctz) is unrolled over a
+// compile-time word count, with compiler intrinsics where available, rather than going through arbitrary-precision
+// library code.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Qrack {
+
+inline unsigned bi_popcount64(const uint64_t& w)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_popcountll(w);
+#else
+    uint64_t v = w - ((w >> 1U) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2U) & 0x3333333333333333ULL);
+    v = (v + (v >> 4U)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (unsigned)((v * 0x0101010101010101ULL) >> 56U);
+#endif
+}
+
+// (Undefined for w == 0.)
+inline unsigned bi_ctz64(const uint64_t& w)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(w);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanForward64(&i, w);
+    return (unsigned)i;
+#else
+    unsigned i = 0U;
+    uint64_t v = w;
+    while (!(v & 1U)) {
+        v >>= 1U;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+// (Undefined for w == 0.)
+inline unsigned bi_log2_64(const uint64_t& w)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63U - (unsigned)__builtin_clzll(w);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanReverse64(&i, w);
+    return (unsigned)i;
+#else
+    unsigned i = 0U;
+    uint64_t v = w >> 1U;
+    while (v) {
+        v >>= 1U;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+// Full 64x64 -> 128 bit product, as (high word, return value low word)
+inline uint64_t bi_mul64(const uint64_t& a, const uint64_t& b, uint64_t* hi)
+{
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 p = (unsigned __int128)a * b;
+    *hi = (uint64_t)(p >> 64U);
+    return (uint64_t)p;
+#else
+    const uint64_t aLo = a & 0xFFFFFFFFULL, aHi = a >> 32U;
+    const uint64_t bLo = b & 0xFFFFFFFFULL, bHi = b >> 32U;
+    const uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+    const uint64_t mid = (ll >> 32U) + (lh & 0xFFFFFFFFULL) + (hl & 0xFFFFFFFFULL);
+    *hi = hh + (lh >> 32U) + (hl >> 32U) + (mid >> 32U);
+    return (mid << 32U) | (ll & 0xFFFFFFFFULL);
+#endif
+}
+
+template <size_t N> struct BigInteger {
+    static_assert(N > 0U, "BigInteger must have at least one word!");
+
+    static constexpr size_t wordCount = N;
+    static constexpr size_t bitCount = 64U * N;
+
+    uint64_t bits[N];
+
+    constexpr BigInteger()
+        : bits()
+    {
+    }
+
+    // Integral conversion wraps (or sign-extends) exactly as for built-in unsigned integers.
+    template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    BigInteger(const T& v)
+        : bits()
+    {
+        bits[0U] = (uint64_t)v;
+        if (std::is_signed<T>::value && (v < 0)) {
+            for (size_t i = 1U; i < N; ++i) {
+                bits[i] = ~(uint64_t)0U;
+            }
+        }
+    }
+
+    // Floating point conversion truncates toward zero, (and negative values convert to 0).
+    template <typename T, typename std::enable_if<std::is_floating_point<T>::value, int>::type = 0>
+    explicit BigInteger(const T& v)
+        : bits()
+    {
+        long double r = std::floor((long double)v);
+        for (size_t i = 0U; (i < N) && (r >= 1); ++i) {
+            bits[i] = (uint64_t)std::fmod(r, 18446744073709551616.0L);
+            r = std::floor(r / 18446744073709551616.0L);
+        }
+    }
+
+    explicit operator bool() const
+    {
+        for (size_t i = 0U; i < N; ++i) {
+            if (bits[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename T,
+        typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+    explicit operator T() const
+    {
+        return (T)bits[0U];
+    }
+
+    template <typename T, typename std::enable_if<std::is_floating_point<T>::value, int>::type = 0>
+    explicit operator T() const
+    {
+        T r = 0;
+        for (size_t i = N; i > 0U; --i) {
+            r = r * (T)18446744073709551616.0L + (T)bits[i - 1U];
+        }
+        return r;
+    }
+
+    bool IsWord() const
+    {
+        for (size_t i = 1U; i < N; ++i) {
+            if (bits[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    BigInteger& operator&=(const BigInteger& o)
+    {
+        for (size_t i = 0U; i < N; ++i) {
+            bits[i] &= o.bits[i];
+        }
+        return *this;
+    }
+    BigInteger& operator|=(const BigInteger& o)
+    {
+        for (size_t i = 0U; i < N; ++i) {
+            bits[i] |= o.bits[i];
+        }
+        return *this;
+    }
+    BigInteger& operator^=(const BigInteger& o)
+    {
+        for (size_t i = 0U; i < N; ++i) {
+            bits[i] ^= o.bits[i];
+        }
+        return *this;
+    }
+
+    BigInteger& operator+=(const BigInteger& o)
+    {
+        uint64_t carry = 0U;
+        for (size_t i = 0U; i < N; ++i) {
+            const uint64_t a = bits[i];
+            const uint64_t s = a + o.bits[i];
+            const uint64_t t = s + carry;
+            carry = (uint64_t)((s < a) | (t < s));
+            bits[i] = t;
+        }
+        return *this;
+    }
+    BigInteger& operator-=(const BigInteger& o)
+    {
+        uint64_t borrow = 0U;
+        for (size_t i = 0U; i < N; ++i) {
+            const uint64_t a = bits[i];
+            const uint64_t d = a - o.bits[i];
+            const uint64_t t = d - borrow;
+            borrow = (uint64_t)((d > a) | (t > d));
+            bits[i] = t;
+        }
+        return *this;
+    }
+    BigInteger& operator*=(const BigInteger& o)
+    {
+        *this = *this * o;
+        return *this;
+    }
+    BigInteger& operator/=(const BigInteger& o)
+    {
+        BigInteger r;
+        DivMod(*this, o, this, &r);
+        return *this;
+    }
+    BigInteger& operator%=(const BigInteger& o)
+    {
+        BigInteger q;
+        DivMod(*this, o, &q, this);
+        return *this;
+    }
+
+    BigInteger& operator<<=(const size_t& s)
+    {
+        if (s >= bitCount) {
+            for (size_t i = 0U; i < N; ++i) {
+                bits[i] = 0U;
+            }
+            return *this;
+        }
+        const size_t w = s >> 6U;
+        const unsigned b = (unsigned)(s & 63U);
+        if (b) {
+            for (size_t i = N - 1U; i > w; --i) {
+                bits[i] = (bits[i - w] << b) | (bits[i - w - 1U] >> (64U - b));
+            }
+        } else {
+            for (size_t i = N - 1U; i > w; --i) {
+                bits[i] = bits[i - w];
+            }
+        }
+        bits[w] = bits[0U] << b;
+        for (size_t i = 0U; i < w; ++i) {
+            bits[i] = 0U;
+        }
+        return *this;
+    }
+    BigInteger& operator>>=(const size_t& s)
+    {
+        if (s >= bitCount) {
+            for (size_t i = 0U; i < N; ++i) {
+                bits[i] = 0U;
+            }
+            return *this;
+        }
+        const size_t w = s >> 6U;
+        const unsigned b = (unsigned)(s & 63U);
+        const size_t last = N - 1U - w;
+        if (b) {
+            for (size_t i = 0U; i < last; ++i) {
+                bits[i] = (bits[i + w] >> b) | (bits[i + w + 1U] << (64U - b));
+            }
+        } else {
+            for (size_t i = 0U; i < last; ++i) {
+                bits[i] = bits[i + w];
+            }
+        }
+        bits[last] = bits[N - 1U] >> b;
+        for (size_t i = last + 1U; i < N; ++i) {
+            bits[i] = 0U;
+        }
+        return *this;
+    }
+
+    BigInteger& operator++()
+    {
+        for (size_t i = 0U; i < N; ++i) {
+            if (++bits[i]) {
+                break;
+            }
+        }
+        return *this;
+    }
+    BigInteger operator++(int)
+    {
+        BigInteger t = *this;
+        ++(*this);
+        return t;
+    }
+    BigInteger& operator--()
+    {
+        for (size_t i = 0U; i < N; ++i) {
+            if (bits[i]--) {
+                break;
+            }
+        }
+        return *this;
+    }
+    BigInteger operator--(int)
+    {
+        BigInteger t = *this;
+        --(*this);
+        return t;
+    }
+
+    BigInteger operator~() const
+    {
+        BigInteger r;
+        for (size_t i = 0U; i < N; ++i) {
+            r.bits[i] = ~bits[i];
+        }
+        return r;
+    }
+    BigInteger operator-() const
+    {
+        BigInteger r = ~(*this);
+        return ++r;
+    }
+    bool operator!() const { return !(bool)(*this); }
+
+    friend BigInteger operator&(BigInteger a, const BigInteger& b) { return a &= b; }
+    friend BigInteger operator|(BigInteger a, const BigInteger& b) { return a |= b; }
+    friend BigInteger operator^(BigInteger a, const BigInteger& b) { return a ^= b; }
+    friend BigInteger operator+(BigInteger a, const BigInteger& b) { return a += b; }
+    friend BigInteger operator-(BigInteger a, const BigInteger& b) { return a -= b; }
+    friend BigInteger operator/(BigInteger a, const BigInteger& b) { return a /= b; }
+    friend BigInteger operator%(BigInteger a, const BigInteger& b) { return a %= b; }
+    friend BigInteger operator*(const BigInteger& a, const BigInteger& b)
+    {
+        BigInteger r;
+        for (size_t i = 0U; i < N; ++i) {
+            if (!a.bits[i]) {
+                continue;
+            }
+            uint64_t carry = 0U;
+            for (size_t j = 0U; (i + j) < N; ++j) {
+                uint64_t hi;
+                const uint64_t lo = bi_mul64(a.bits[i], b.bits[j], &hi);
+                uint64_t t = r.bits[i + j] + lo;
+                hi += (uint64_t)(t < lo);
+                const uint64_t u = t + carry;
+                hi += (uint64_t)(u < t);
+                r.bits[i + j] = u;
+                carry = hi;
+            }
+        }
+        return r;
+    }
+
+    template <typename S, typename std::enable_if<std::is_integral<S>::value, int>::type = 0>
+    friend BigInteger operator<<(BigInteger a, const S& s)
+    {
+        return a <<= (size_t)s;
+    }
+    template <typename S, typename std::enable_if<std::is_integral<S>::value, int>::type = 0>
+    friend BigInteger operator>>(BigInteger a, const S& s)
+    {
+        return a >>= (size_t)s;
+    }
+    friend BigInteger operator<<(BigInteger a, const BigInteger& s) { return a <<= (size_t)s.bits[0U]; }
+    friend BigInteger operator>>(BigInteger a, const BigInteger& s) { return a >>= (size_t)s.bits[0U]; }
+
+    friend bool operator==(const BigInteger& a, const BigInteger& b)
+    {
+        for (size_t i = 0U; i < N; ++i) {
+            if (a.bits[i] != b.bits[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    friend bool operator!=(const BigInteger& a, const BigInteger& b) { return !(a == b); }
+    friend bool operator<(const BigInteger& a, const BigInteger& b)
+    {
+        for (size_t i = N; i > 0U; --i) {
+            if (a.bits[i - 1U] != b.bits[i - 1U]) {
+                return a.bits[i - 1U] < b.bits[i - 1U];
+            }
+        }
+        return false;
+    }
+    friend bool operator>(const BigInteger& a, const BigInteger& b) { return b < a; }
+    friend bool operator<=(const BigInteger& a, const BigInteger& b) { return !(b < a); }
+    friend bool operator>=(const BigInteger& a, const BigInteger& b) { return !(a < b); }
+
+    // Quotient and remainder, (both optional). Division by 0 leaves a quotient of all 1 bits and a remainder of "n".
+    static void DivMod(const BigInteger& n, const BigInteger& d, BigInteger* quo, BigInteger* rem)
+    {
+        if (d.IsWord() && n.IsWord()) {
+            const uint64_t dw = d.bits[0U];
+            const uint64_t nw = n.bits[0U];
+            *quo = dw ? BigInteger(nw / dw) : ~BigInteger();
+            *rem = dw ? BigInteger(nw % dw) : BigInteger(nw);
+            return;
+        }
+
+#if defined(__SIZEOF_INT128__)
+        if (d.IsWord() && d.bits[0U]) {
+            // Short division, one word at a time
+            const uint64_t dw = d.bits[0U];
+            BigInteger q;
+            unsigned __int128 r = 0U;
+            for (size_t i = N; i > 0U; --i) {
+                r = (r << 64U) | n.bits[i - 1U];
+                q.bits[i - 1U] = (uint64_t)(r / dw);
+                r %= dw;
+            }
+            *quo = q;
+            *rem = BigInteger((uint64_t)r);
+            return;
+        }
+#endif
+
+        if (!d) {
+            *rem = n;
+            *quo = ~BigInteger();
+            return;
+        }
+
+        // Binary long division, from the highest set bit of "n" down
+        BigInteger q, r;
+        for (size_t i = (size_t)bi_log2(n) + 1U; i > 0U; --i) {
+            const size_t b = i - 1U;
+            r <<= 1U;
+            r.bits[0U] |= (n.bits[b >> 6U] >> (b & 63U)) & 1U;
+            if (r >= d) {
+                r -= d;
+                q.bits[b >> 6U] |= (uint64_t)1U << (b & 63U);
+            }
+        }
+        *quo = q;
+        *rem = r;
+    }
+
+    friend unsigned bi_popcount(const BigInteger& a)
+    {
+        unsigned c = 0U;
+        for (size_t i = 0U; i < N; ++i) {
+            c += bi_popcount64(a.bits[i]);
+        }
+        return c;
+    }
+
+    // Index of the lowest set bit, (or bitCount, for 0)
+    friend size_t bi_ctz(const BigInteger& a)
+    {
+        for (size_t i = 0U; i < N; ++i) {
+            if (a.bits[i]) {
+                return (i << 6U) + bi_ctz64(a.bits[i]);
+            }
+        }
+        return bitCount;
+    }
+
+    // Index of the highest set bit, (or 0, for 0)
+    friend size_t bi_log2(const BigInteger& a)
+    {
+        for (size_t i = N; i > 0U; --i) {
+            if (a.bits[i - 1U]) {
+                return ((i - 1U) << 6U) + bi_log2_64(a.bits[i - 1U]);
+            }
+        }
+        return 0U;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const BigInteger& b)
+    {
+        if (!b) {
+            return os << "0";
+        }
+
+        // Peel off 19 decimal digits per (short) division.
+        const BigInteger tenTo19((uint64_t)10000000000000000000ULL);
+        std::vector<uint64_t> chunks;
+        BigInteger q = b, r;
+        while (q) {
+            DivMod(q, tenTo19, &q, &r);
+            chunks.push_back(r.bits[0U]);
+        }
+
+        os << std::to_string(chunks.back());
+        for (size_t i = chunks.size() - 1U; i > 0U; --i) {
+            const std::string s = std::to_string(chunks[i - 1U]);
+            os << std::string(19U - s.size(), '0') << s;
+        }
+
+        return os;
+    }
+
+    friend std::istream& operator>>(std::istream& is, BigInteger& b)
+    {
+        std::string s;
+        is >> s;
+        b = BigInteger();
+        for (size_t i = 0U; i < s.size(); ++i) {
+            if ((s[i] < '0') || (s[i] > '9')) {
+                is.setstate(std::ios::failbit);
+                break;
+            }
+            b = b * BigInteger(10U) + BigInteger((unsigned)(s[i] - '0'));
+        }
+        return is;
+    }
+};
+
+} // namespace Qrack
@@ -0,0 +1,90 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qrack_types.hpp"
+
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// Amplitudes per checkpoint chunk, as a power of 2
+#define QRACK_CHECKPOINT_CHUNK_POW 16U
+
+namespace Qrack {
+
+/**
+ * Writes the streaming, chunked checkpoint format read by CheckpointReader.
+ *
+ * A checkpoint opens with a header, ("QRCK," the format version, and the widths of real1 and bitCapInt,) followed
+ * by nested sections, one per simulator layer, each of which is a four-character tag and that layer's own fields.
+ * State vector amplitudes are written as chunks of at most 2^QRACK_CHECKPOINT_CHUNK_POW amplitudes, keyed by their
+ * offset, so a writer never needs more than one chunk of host memory. With "compress," each chunk is stored with its
+ * runs of exact 0 amplitudes elided, whenever that is smaller, (which is lossless).
+ */
+class CheckpointWriter {
+protected:
+    std::ostream& os;
+    bool doCompress;
+
+    void WriteBytes(const void* data, size_t size);
+
+public:
+    CheckpointWriter(std::ostream& o, bool compress = true);
+
+    template <typename T> void Write(const T& v) { WriteBytes(&v, sizeof(T)); }
+    /** Open a layer section, with a four-character tag */
+    void BeginSection(const char* tag);
+    void WriteRow(const std::vector<uint64_t>& row);
+    /** Write one chunk of "count" amplitudes, starting at state vector "offset" */
+    void WriteAmplitudes(bitCapIntOcl offset, complex const* amps, bitCapIntOcl count);
+    /** Close a run of WriteAmplitudes() chunks */
+    void EndAmplitudes();
+};
+
+/**
+ * Reads the checkpoint format written by CheckpointWriter. Throws std::runtime_error on a malformed, truncated, or
+ * incompatible stream.
+ */
+class CheckpointReader {
+protected:
+    std::istream& is;
+
+    void ReadBytes(void* data, size_t size);
+
+public:
+    /** Maps a chunk offset to the "lane," (such as a page,) that it is restored into */
+    typedef std::function<size_t(bitCapIntOcl offset)> LaneFn;
+    /** Restores one decoded chunk */
+    typedef std::function<void(bitCapIntOcl offset, complex const* amps, bitCapIntOcl count)> ApplyFn;
+
+    CheckpointReader(std::istream& i);
+
+    template <typename T> T Read()
+    {
+        T v;
+        ReadBytes(&v, sizeof(T));
+        return v;
+    }
+    /** Expect a layer section, with a four-character tag */
+    void ExpectSection(const char* tag);
+    std::vector<uint64_t> ReadRow();
+    /**
+     * Read every chunk up to the closing EndAmplitudes(), for a state vector of "maxPower" amplitudes. The stream is
+     * read serially, but chunks are decoded and applied in parallel, with one chunk in flight per lane, so chunks of
+     * distinct lanes restore concurrently and chunks of the same lane restore in stream order.
+     */
+    void ReadAmplitudes(bitCapIntOcl maxPower, LaneFn lane, ApplyFn apply);
+};
+} // namespace Qrack
@@ -111,9 +111,9 @@ inline Complex8x2Simd matrixMul(
     const __m128 dupeLo = _mm_shuffle_ps(qubit._val2, qubit._val2, 68);
     const __m128 dupeHi = _mm_shuffle_ps(qubit._val2, qubit._val2, 238);
     return _mm_mul_ps(_mm_set1_ps(nrm),
-        _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(col1, col2, 177),
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(col1, col1, 177),
                                   _mm_xor_ps(SIGNMASK, _mm_shuffle_ps(dupeLo, dupeLo, 245))),
-                       _mm_mul_ps(mtrxCol1._val2, _mm_shuffle_ps(dupeLo, dupeLo, 160))),
+                       _mm_mul_ps(col1, _mm_shuffle_ps(dupeLo, dupeLo, 160))),
             _mm_add_ps(
                 _mm_mul_ps(_mm_shuffle_ps(col2, col2, 177), _mm_xor_ps(SIGNMASK, _mm_shuffle_ps(dupeHi, dupeHi, 245))),
                 _mm_mul_ps(col2, _mm_shuffle_ps(dupeHi, dupeHi, 160)))));
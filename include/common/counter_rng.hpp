@@ -0,0 +1,119 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qrack_types.hpp"
+
+#include <limits>
+
+namespace Qrack {
+
+/**
+ * The Philox4x32-10 counter-based block function, (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3,"
+ * SC '11,) which maps a 128-bit counter and a 64-bit key to 128 random bits, in place. The OpenCL kernels carry an
+ * identical copy, so host and device draws agree bit-for-bit.
+ */
+inline void Philox4x32(uint32_t ctr[4U], const uint32_t key[2U])
+{
+    uint32_t k0 = key[0U];
+    uint32_t k1 = key[1U];
+    for (unsigned round = 0U; round < 10U; ++round) {
+        const uint64_t p0 = (uint64_t)0xD2511F53U * ctr[0U];
+        const uint64_t p1 = (uint64_t)0xCD9E8D57U * ctr[2U];
+        const uint32_t c1 = ctr[1U];
+        const uint32_t c3 = ctr[3U];
+        ctr[0U] = (uint32_t)(p1 >> 32U) ^ c1 ^ k0;
+        ctr[1U] = (uint32_t)p1;
+        ctr[2U] = (uint32_t)(p0 >> 32U) ^ c3 ^ k1;
+        ctr[3U] = (uint32_t)p0;
+        k0 += 0x9E3779B9U;
+        k1 += 0xBB67AE85U;
+    }
+}
+
+/**
+ * A counter-based pseudo-random generator: draw "i" of stream "s" under seed "k" is a pure function of (k, s, i), so
+ * any number of independent streams, (one per thread, block, or work item,) can be derived from one seed, with no
+ * shared state, no locks, and results that don't depend on how work is scheduled. For example, within par_for(),
+ * "CounterRng gen(seed, lcv)" gives each work item its own stream.
+ *
+ * This is a C++11 UniformRandomBitGenerator, but NextReal(), unlike std::uniform_real_distribution, is the same on
+ * every standard library.
+ */
+class CounterRng {
+protected:
+    uint32_t key[2U];
+    uint64_t stream;
+    uint64_t counter;
+    uint32_t block[4U];
+    unsigned blockPos;
+
+public:
+    typedef uint64_t result_type;
+
+    CounterRng(uint64_t seed, uint64_t s = 0U, uint64_t c = 0U)
+        : key{ (uint32_t)seed, (uint32_t)(seed >> 32U) }
+        , stream(s)
+        , counter(c)
+        , blockPos(4U)
+    {
+    }
+
+    static constexpr result_type min() { return 0U; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    /** Skip to 64-bit draw "c" of this stream, (each counter value yields two draws) */
+    void Seek(uint64_t c)
+    {
+        counter = c >> 1U;
+        blockPos = 4U;
+        if (c & 1U) {
+            Refill();
+            blockPos = 2U;
+        }
+    }
+
+    result_type operator()()
+    {
+        if (blockPos >= 4U) {
+            Refill();
+        }
+        const result_type toRet = ((result_type)block[blockPos + 1U] << 32U) | (result_type)block[blockPos];
+        blockPos += 2U;
+
+        return toRet;
+    }
+
+    /** Uniform on [0, 1) */
+    real1_f NextReal()
+    {
+#if FPPOW < 6
+        return (real1_f)((*this)() >> 40U) * (ONE_R1_F / 16777216);
+#else
+        return (real1_f)((*this)() >> 11U) * (ONE_R1_F / 9007199254740992.0);
+#endif
+    }
+
+protected:
+    void Refill()
+    {
+        block[0U] = (uint32_t)counter;
+        block[1U] = (uint32_t)(counter >> 32U);
+        block[2U] = (uint32_t)stream;
+        block[3U] = (uint32_t)(stream >> 32U);
+        Philox4x32(block, key);
+        ++counter;
+        blockPos = 0U;
+    }
+};
+} // namespace Qrack
@@ -23,8 +23,9 @@
 #define _USE_MATH_DEFINES
 
 #include <condition_variable>
+#include <exception>
 #include <functional>
-#include <future>
+#include <memory>
 #include <mutex>
 #include <queue>
 
@@ -32,12 +33,18 @@ namespace Qrack {
 
 typedef std::function<void(void)> DispatchFn;
 
+/**
+ * An in-order queue of one engine's pending work, drained asynchronously by the shared ParallelPool workers.
+ *
+ * No queue owns a thread: while a queue has work, one "drain" task for it is posted to the pool, which runs its
+ * operations in order, so many engines' queues, (like the engines of a QUnit,) overlap on a bounded set of threads.
+ * finish() drains the remaining work on the calling thread if no worker has picked it up yet, so synchronizing never
+ * waits on a busy pool. An exception thrown by a queued operation is rethrown by the next finish().
+ */
 class DispatchQueue {
 public:
     DispatchQueue()
-        : quit_(false)
-        , isFinished_(true)
-        , isStarted_(false)
+        : state_(std::make_shared<State>())
     {
         // Intentionally left blank.
     }
@@ -50,7 +57,7 @@ public:
     // dump queue
     void dump();
     // check if queue is finished
-    bool isFinished() { return isFinished_; }
+    bool isFinished();
 
     // Deleted operations
     DispatchQueue(const DispatchQueue& rhs) = delete;
@@ -59,16 +66,30 @@ public:
     DispatchQueue& operator=(DispatchQueue&& rhs) = delete;
 
 private:
-    std::mutex lock_;
-    std::future<void> thread_;
-    std::queue<DispatchFn> q_;
-    std::condition_variable cv_;
-    std::condition_variable cvFinished_;
-    bool quit_;
-    bool isFinished_;
-    bool isStarted_;
-
-    void dispatch_thread_handler(void);
+    // (Shared with posted drain tasks, which can outlive the queue.)
+    struct State {
+        std::mutex lock;
+        std::queue<DispatchFn> q;
+        std::condition_variable cvIdle;
+        std::exception_ptr error;
+        // A thread is running operations from "q"
+        bool isRunning;
+        // A drain task is posted to the pool, but hasn't started
+        bool isPosted;
+        bool quit;
+
+        State()
+            : isRunning(false)
+            , isPosted(false)
+            , quit(false)
+        {
+        }
+    };
+
+    std::shared_ptr<State> state_;
+
+    // Run operations until "q" is empty, as the one running thread. (The caller holds "lock," and sets "isRunning.")
+    static void drain(State& state, std::unique_lock<std::mutex>& lock);
 };
 
 } // namespace Qrack
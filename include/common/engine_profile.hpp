@@ -0,0 +1,99 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qrack_types.hpp"
+
+#include <map>
+#include <string>
+
+namespace Qrack {
+
+/** Measured costs of one simulation device, (the CPU, or one OpenCL device) */
+struct DeviceProfile {
+    /** Wall-clock seconds for the smallest gate dispatch, (launch and synchronization overhead) */
+    double launchLatency;
+    /** Host-to-device and device-to-host state vector copy rate, in bytes per second */
+    double bandwidth;
+    /** The widest state vector, in qubits, that one engine of this device can allocate */
+    bitLenInt maxQubits;
+    /** Seconds per Apply2x2() gate, keyed by engine qubit count */
+    std::map<bitLenInt, double> apply2x2;
+
+    DeviceProfile()
+        : launchLatency(0.0)
+        , bandwidth(0.0)
+        , maxQubits(0U)
+    {
+    }
+
+    bool IsEmpty() const { return apply2x2.empty(); }
+
+    /**
+     * Estimated seconds per Apply2x2() gate at "qb" qubits: the measurement itself, if there is one; otherwise the
+     * next narrower measurement scaled by the work ratio, or the launch latency below the measured range.
+     */
+    double Apply2x2Time(bitLenInt qb) const;
+
+    /** Estimated seconds to move a "qb" qubit state vector across the device boundary, one way */
+    double TransferTime(bitLenInt qb) const;
+};
+
+/**
+ * A per-host "engine profile," produced once by the "qrack_profile" microbenchmark utility and consulted at engine
+ * construction to decide engine cutovers, (such as QHybrid CPU/GPU switching,) instead of fixed heuristics.
+ *
+ * The profile file is plain text, one measurement per line, as "<device> <key> <values...>", where "<device>" is
+ * "cpu" or an OpenCL device ID. It is read from QRACK_ENGINE_PROFILE, if set, or else "engine_profile.txt" in
+ * ~/.qrack/. Without a profile, every decision returns its caller's fallback.
+ */
+class EngineProfile {
+protected:
+    DeviceProfile cpu;
+    std::map<int64_t, DeviceProfile> devices;
+
+public:
+    EngineProfile() {}
+
+    /** The process-wide profile, loaded on first use from GetDefaultPath() */
+    static EngineProfile& Instance();
+    static std::string GetDefaultPath();
+
+    /** Replace this profile with the contents of "path". Returns false, (leaving this profile empty,) on failure. */
+    bool Load(const std::string& path);
+    /** Write this profile to "path". Throws std::runtime_error if the file cannot be written. */
+    void Save(const std::string& path) const;
+
+    /** Microbenchmark the CPU engine, from "minQb" to "maxQb" qubits. */
+    void MeasureCpu(bitLenInt minQb, bitLenInt maxQb);
+    /** Microbenchmark OpenCL device "devID," from "minQb" to "maxQb" qubits, (a no-op without OpenCL). */
+    void MeasureDevice(int64_t devID, bitLenInt minQb, bitLenInt maxQb);
+
+    DeviceProfile& GetCpu() { return cpu; }
+    DeviceProfile& GetDevice(int64_t devID) { return devices[devID]; }
+    bool HasDevice(int64_t devID) const
+    {
+        const auto it = devices.find(devID);
+        return (it != devices.end()) && !it->second.IsEmpty();
+    }
+
+    /**
+     * The qubit count at and above which OpenCL device "devID" beats the CPU, for every measured width. If either
+     * device is unmeasured, or the CPU still wins at the widest shared measurement, return "fallback."
+     */
+    bitLenInt GetGpuThresholdQubits(int64_t devID, bitLenInt fallback) const;
+
+    /** The widest engine the CPU, (for "devID" < 0,) or OpenCL device "devID" can hold, or else "fallback" */
+    bitLenInt GetMaxQubits(int64_t devID, bitLenInt fallback) const;
+};
+} // namespace Qrack
@@ -0,0 +1,124 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qrack_types.hpp"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Default cap on buffered Chrome-trace events, (beyond which further events are dropped, but still counted)
+#define QRACK_TRACE_DEFAULT_MAX_EVENTS 1048576U
+
+namespace Qrack {
+
+/** Call count and total wall-clock time of one instrumented operation */
+struct InstrumentationStat {
+    uint64_t calls;
+    double seconds;
+
+    InstrumentationStat()
+        : calls(0U)
+        , seconds(0.0)
+    {
+    }
+};
+
+/**
+ * Process-wide hot-path statistics, keyed by "<layer>::<operation>," (for example, "QUnit::Mtrx").
+ *
+ * Recording only happens in builds configured with ENABLE_INSTRUMENTATION, through the QRACK_INSTRUMENT() scope
+ * macro, which otherwise compiles to nothing; the API itself is always present, and simply reports no statistics in
+ * uninstrumented builds. Nested layers each record their own scope, so the time of an outer layer includes the time
+ * of the layers beneath it.
+ */
+class Instrumentation {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+protected:
+    struct TraceEvent {
+        std::string name;
+        Clock::time_point start;
+        double seconds;
+        size_t thread;
+    };
+
+    std::mutex mtx;
+    std::map<std::string, InstrumentationStat> stats;
+    std::vector<TraceEvent> trace;
+    std::map<std::thread::id, size_t> threadIds;
+    bool isTracing;
+    size_t maxTraceEvents;
+    Clock::time_point epoch;
+
+    InstrumentationStat& GetStat(const char* layer, const char* op);
+
+public:
+    Instrumentation()
+        : isTracing(false)
+        , maxTraceEvents(QRACK_TRACE_DEFAULT_MAX_EVENTS)
+        , epoch(Clock::now())
+    {
+    }
+
+    static Instrumentation& Instance();
+
+    /** Whether this build records statistics, (ENABLE_INSTRUMENTATION) */
+    static bool IsEnabled();
+
+    /** Count one call of "layer::op," lasting "seconds," which has no host-side start time, (like a device kernel) */
+    void Record(const char* layer, const char* op, double seconds);
+    /** Count one call of "layer::op," from "start" to "end," and buffer a trace event for it, if tracing */
+    void Record(const char* layer, const char* op, Clock::time_point start, Clock::time_point end);
+
+    /** A snapshot of every statistic recorded since the last Reset() */
+    std::map<std::string, InstrumentationStat> GetStats();
+    /** Clear all statistics and buffered trace events */
+    void Reset();
+
+    /** Start or stop buffering trace events, keeping at most "maxEvents" of them */
+    void SetTracing(bool enable, size_t maxEvents = QRACK_TRACE_DEFAULT_MAX_EVENTS);
+    /** Write the buffered trace events to "os" as Chrome trace-event JSON, (for chrome://tracing or Perfetto) */
+    void WriteChromeTrace(std::ostream& os);
+};
+
+/** Records the lifetime of one instrumented scope, (see QRACK_INSTRUMENT) */
+class InstrumentationScope {
+protected:
+    const char* layer;
+    const char* op;
+    Instrumentation::Clock::time_point start;
+
+public:
+    InstrumentationScope(const char* l, const char* o)
+        : layer(l)
+        , op(o)
+        , start(Instrumentation::Clock::now())
+    {
+    }
+
+    ~InstrumentationScope() { Instrumentation::Instance().Record(layer, op, start, Instrumentation::Clock::now()); }
+};
+} // namespace Qrack
+
+#if ENABLE_INSTRUMENTATION
+#define QRACK_INSTRUMENT(layer, op) Qrack::InstrumentationScope qrackInstrumentationScope(layer, op)
+#else
+#define QRACK_INSTRUMENT(layer, op)
+#endif
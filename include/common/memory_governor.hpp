@@ -0,0 +1,113 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qrack_types.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+/** The memory pool of host RAM, (as opposed to an OpenCL device, by its nonnegative device ID) */
+#define QRACK_HOST_MEMORY ((int64_t)-1)
+/** Default percent of a budget past which a pool is under pressure, and engines should spill what they can */
+#define QRACK_MEMORY_SPILL_PERCENT 90U
+
+namespace Qrack {
+
+/**
+ * Process-wide memory budget, for host RAM and for each OpenCL device, shared by every QInterface.
+ *
+ * Host state vectors, (through StateVecPool,) and QEngineOCL buffers reserve their bytes here before they allocate. A
+ * reservation that would exceed its pool's budget waits, (up to QRACK_MEMORY_WAIT_MS,) for other simulators to release
+ * memory, and is refused if none is released, so an oversized request fails cleanly at its start, rather than with the
+ * allocator failing partway through an operation. While a request waits, or usage is past the spill threshold, the
+ * pool is "under pressure," and engines fall back at their own safe points: QPager compresses or spills more of its
+ * cold pages, StateVecPool drops its idle buffers, and QUnitMulti moves units off of a full device, (to the host, if
+ * no device has room). Engines only ever spill their own memory, (never another simulator's, from another thread).
+ *
+ * Budgets are unlimited by default. QRACK_MEMORY_BUDGET_MB sets the host budget, and QRACK_DEVICE_BUDGET_MB sets the
+ * budget of each OpenCL device, in addition to QRACK_MAX_ALLOC_MB.
+ */
+class MemoryGovernor {
+protected:
+    struct Pool {
+        size_t used;
+        size_t peak;
+        size_t budget;
+        // Reservations currently waiting for memory to be released
+        size_t waiting;
+
+        Pool(size_t b = (size_t)-1)
+            : used(0U)
+            , peak(0U)
+            , budget(b)
+            , waiting(0U)
+        {
+        }
+    };
+
+    std::mutex mtx;
+    std::condition_variable releasedCv;
+    std::map<int64_t, Pool> pools;
+    size_t deviceBudget;
+    unsigned spillPercent;
+    unsigned waitMs;
+    size_t refusedCount;
+    bool isLimited;
+
+    MemoryGovernor();
+
+    // (The caller holds "mtx.")
+    Pool& GetPool(int64_t pool);
+    bool IsAdmissible(const Pool& p, size_t bytes) { return bytes <= (p.budget - std::min(p.used, p.budget)); }
+
+public:
+    static MemoryGovernor& Instance();
+
+    /**
+     * Reserve "bytes" from "pool," waiting up to the configured wait for them to fit its budget. Returns false, (and
+     * reserves nothing,) if they don't.
+     */
+    bool TryReserve(int64_t pool, size_t bytes);
+    /** TryReserve(), which throws std::bad_alloc if the reservation is refused */
+    void Reserve(int64_t pool, size_t bytes);
+    /** Reserve "bytes" from "pool" unconditionally, (for memory that already exists) */
+    void ForceReserve(int64_t pool, size_t bytes);
+    /** Return "bytes" to "pool," (waking any reservation that waits for them) */
+    void Release(int64_t pool, size_t bytes);
+    /**
+     * Check whether "bytes" more would fit the budget of "pool," waiting as TryReserve() would, but without reserving
+     * them, (for admission control before an operation that allocates along the way)
+     */
+    bool Admit(int64_t pool, size_t bytes);
+    /** Whether "bytes" more would fit the budget of "pool" right now */
+    bool CanAdmit(int64_t pool, size_t bytes);
+    /** Whether engines should spill what they can from "pool" */
+    bool IsUnderPressure(int64_t pool);
+    /** Whether any pool has a finite budget, (and so, whether admission control is worth its overhead) */
+    bool IsLimited();
+
+    /** Set the budget of "pool," or (size_t)-1 for no limit */
+    void SetBudget(int64_t pool, size_t bytes);
+    size_t GetBudget(int64_t pool);
+    size_t GetUsed(int64_t pool);
+    size_t GetPeak(int64_t pool);
+    /** Set how long a reservation waits for memory, in milliseconds, before it is refused */
+    void SetWaitMs(unsigned ms) { waitMs = ms; }
+    unsigned GetWaitMs() { return waitMs; }
+    /** Reservations and admissions refused so far */
+    size_t GetRefusedCount() { return refusedCount; }
+};
+} // namespace Qrack
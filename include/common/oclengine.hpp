@@ -15,6 +15,7 @@
 #define _USE_MATH_DEFINES
 
 #include "config.h"
+#include "statevec_pool.hpp"
 
 #if !ENABLE_OPENCL
 #error OpenCL has not been enabled
@@ -24,6 +25,9 @@
 #include <direct.h>
 #endif
 
+#include <atomic>
+#include <functional>
+#include <future>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -42,6 +46,13 @@
 #include <CL/cl2.hpp>
 #endif
 
+/** While autotuning, each candidate launch shape is timed this many times, (and its best time is kept) */
+#define QRACK_OCL_TUNE_TRIALS 3U
+/** The most work items per thread that autotuning tries, (for grid-stride kernels) */
+#define QRACK_OCL_TUNE_MAX_ITEMS 8U
+/** Extension of the autotuned launch shape file, kept next to the compiled binary cache */
+#define QRACK_OCL_TUNE_EXT ".tune"
+
 namespace Qrack {
 
 class OCLDeviceCall;
@@ -67,12 +78,15 @@ enum OCLAPI {
     OCL_API_INVERT_SINGLE,
     OCL_API_INVERT_SINGLE_WIDE,
     OCL_API_UNIFORMLYCONTROLLED,
+    OCL_API_APPLYNXN,
+    OCL_API_FFT_STAGE,
     OCL_API_UNIFORMPARITYRZ,
     OCL_API_UNIFORMPARITYRZ_NORM,
     OCL_API_CUNIFORMPARITYRZ,
     OCL_API_COMPOSE,
     OCL_API_COMPOSE_WIDE,
     OCL_API_COMPOSE_MID,
+    OCL_API_COMPOSE_MULTI,
     OCL_API_DECOMPOSEPROB,
     OCL_API_DECOMPOSEAMP,
     OCL_API_DISPOSEPROB,
@@ -83,15 +97,22 @@ enum OCLAPI {
     OCL_API_PROBREGALL,
     OCL_API_PROBMASK,
     OCL_API_PROBMASKALL,
+    OCL_API_CDFCHUNKS,
+    OCL_API_SAMPLECDF,
     OCL_API_PROBPARITY,
     OCL_API_FORCEMPARITY,
     OCL_API_EXPPERM,
+    OCL_API_EXPPAULI,
     OCL_API_X_SINGLE,
     OCL_API_X_SINGLE_WIDE,
     OCL_API_X_MASK,
     OCL_API_Z_SINGLE,
     OCL_API_Z_SINGLE_WIDE,
     OCL_API_PHASE_PARITY,
+    OCL_API_PHASEFLIPIFLOOKUP,
+    OCL_API_GROVERLOOKUP,
+    OCL_API_SCATTER_AMPS,
+    OCL_API_GATE_LIST,
     OCL_API_ROL,
 #if ENABLE_ALU
     OCL_API_INC,
@@ -130,7 +151,12 @@ enum OCLAPI {
     OCL_API_APPLYM,
     OCL_API_APPLYMREG,
     OCL_API_CLEARBUFFER,
-    OCL_API_SHUFFLEBUFFERS
+    OCL_API_SHUFFLEBUFFERS,
+    OCL_API_STABILIZER_GATE,
+    OCL_API_STABILIZER_PIVOTS,
+    OCL_API_STABILIZER_MEASURE,
+    OCL_API_STABILIZER_SCRATCH,
+    OCL_API_BATCH_2X2
 };
 
 struct OCLKernelHandle {
@@ -175,12 +201,59 @@ public:
     const int64_t context_id;
     const int64_t device_id;
     cl::CommandQueue queue;
+    /** In-order queue for host<->device page transfers, so they can overlap kernels on "queue." */
+    cl::CommandQueue transfer_queue;
     EventVecPtr wait_events;
 
 protected:
+    // Kernels are built on first use, (or in the background,) by "programBuilder," under "buildMutex."
+    std::atomic<bool> isProgramBuilt;
+    std::mutex buildMutex;
+    std::function<void(OCLDeviceContext&)> programBuilder;
+    std::future<void> backgroundBuild;
     std::mutex waitEventsMutex;
     std::map<OCLAPI, cl::Kernel> calls;
     std::map<OCLAPI, std::unique_ptr<std::mutex>> mutexes;
+    std::mutex bufferPoolMutex;
+    // Idle device-only state buffers, by size in bytes
+    std::multimap<size_t, cl::Buffer> bufferPool;
+    size_t bufferPoolBytes;
+    size_t maxBufferPoolBytes;
+
+    // Launch shapes, (work items per thread, and local group size,) by kernel and qubit width
+    struct LaunchTuning {
+        std::vector<std::pair<size_t, size_t>> candidates;
+        // The best time seen for each candidate
+        std::vector<double> times;
+        size_t trials;
+        // The winner, once every candidate has been timed, (or as loaded from the tuning file)
+        size_t itemsPerThread;
+        size_t groupSize;
+        bool isTuned;
+    };
+    bool isAutotune;
+    std::atomic<bool> hasLaunchTunings;
+    std::string tuneFilePath;
+    std::mutex tuneMutex;
+    std::map<std::pair<OCLAPI, bitLenInt>, LaunchTuning> launchTunings;
+
+    static bool IsGridStride(OCLAPI api_call);
+    bool ApplyLaunchShape(size_t itemsPerThread, size_t groupSize, size_t& workItemCount, size_t& localGroupSize);
+    void SaveLaunchTunings();
+
+    void ReleaseBuffer(cl::Buffer* buffer, size_t size)
+    {
+        if (size <= maxBufferPoolBytes) {
+            std::lock_guard<std::mutex> guard(bufferPoolMutex);
+            while (bufferPool.size() && ((bufferPoolBytes + size) > maxBufferPoolBytes)) {
+                bufferPoolBytes -= std::prev(bufferPool.end())->first;
+                bufferPool.erase(std::prev(bufferPool.end()));
+            }
+            bufferPool.emplace(size, *buffer);
+            bufferPoolBytes += size;
+        }
+        delete buffer;
+    }
 
 private:
     const size_t procElemCount = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
@@ -188,6 +261,7 @@ private:
     const size_t maxWorkGroupSize = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
     const size_t maxAlloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
     const size_t globalSize = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+    const size_t localSize = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
     size_t globalLimit;
     size_t preferredSizeMultiple;
     size_t preferredConcurrency;
@@ -201,6 +275,11 @@ public:
         , context_id(cntxt_id)
         , device_id(dev_id)
         , wait_events(new EventVec())
+        , isProgramBuilt(false)
+        , bufferPoolBytes(0U)
+        , maxBufferPoolBytes(256U << 20U)
+        , isAutotune(false)
+        , hasLaunchTunings(false)
 #if ENABLE_OCL_MEM_GUARDS
         , globalLimit((maxAlloc >= 0) ? maxAlloc : ((3U * globalSize) >> 2U))
 #else
@@ -209,17 +288,65 @@ public:
         , preferredSizeMultiple(0U)
         , preferredConcurrency(0U)
     {
+#if ENABLE_ENV_VARS
+        if (getenv("QRACK_SV_POOL_MB")) {
+            maxBufferPoolBytes = ((size_t)std::stoi(std::string(getenv("QRACK_SV_POOL_MB")))) << 20U;
+        }
+        isAutotune = (bool)getenv("QRACK_OCL_AUTOTUNE");
+#endif
         cl_int error;
-        queue = cl::CommandQueue(context, d, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &error);
+#if ENABLE_INSTRUMENTATION
+        // Kernel event profiling feeds the "QEngineOCL::Kernel" statistic.
+        const cl_command_queue_properties profiling = CL_QUEUE_PROFILING_ENABLE;
+#else
+        // Autotuning times kernels by event profiling.
+        const cl_command_queue_properties profiling = isAutotune ? CL_QUEUE_PROFILING_ENABLE : 0;
+#endif
+        queue = cl::CommandQueue(context, d, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE | profiling, &error);
         if (error != CL_SUCCESS) {
-            queue = cl::CommandQueue(context, d, 0, &error);
+            queue = cl::CommandQueue(context, d, profiling, &error);
             if (error != CL_SUCCESS) {
                 throw std::runtime_error("Failed to create OpenCL command queue!");
             }
         }
+
+        transfer_queue = cl::CommandQueue(context, d, 0, &error);
+        if (error != CL_SUCCESS) {
+            // Transfers will serialize with kernels, but still work.
+            transfer_queue = queue;
+        }
     }
 
-    OCLDeviceCall Reserve(OCLAPI call) { return OCLDeviceCall(*(mutexes[call]), calls[call]); }
+    ~OCLDeviceContext()
+    {
+        // A background build holds this context, so it has to finish before we're torn down.
+        if (backgroundBuild.valid()) {
+            backgroundBuild.wait();
+        }
+    }
+
+    /**
+     * Build this device's kernels, (or load them from the binary cache,) if that hasn't happened yet. Safe to call
+     * from any thread; concurrent callers wait on the one build. Throws std::runtime_error if the device can't build.
+     */
+    void EnsureProgram()
+    {
+        if (isProgramBuilt.load(std::memory_order_acquire)) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(buildMutex);
+        if (isProgramBuilt.load(std::memory_order_relaxed)) {
+            return;
+        }
+        programBuilder(*this);
+        isProgramBuilt.store(true, std::memory_order_release);
+    }
+
+    OCLDeviceCall Reserve(OCLAPI call)
+    {
+        EnsureProgram();
+        return OCLDeviceCall(*(mutexes[call]), calls[call]);
+    }
 
     EventVecPtr ResetWaitEvents()
     {
@@ -242,8 +369,23 @@ public:
         }
     }
 
+    /** The number of commands this device has queued, but not completed */
+    size_t GetQueueDepth()
+    {
+        std::lock_guard<std::mutex> guard(waitEventsMutex);
+        size_t depth = 0U;
+        for (const cl::Event& e : *(wait_events.get())) {
+            if (e.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() != CL_COMPLETE) {
+                ++depth;
+            }
+        }
+
+        return depth;
+    }
+
     size_t GetPreferredSizeMultiple()
     {
+        EnsureProgram();
         return preferredSizeMultiple
             ? preferredSizeMultiple
             : preferredSizeMultiple =
@@ -251,6 +393,22 @@ public:
                       device);
     }
 
+    /** Whether kernel launch shapes are being autotuned, or have been loaded from a previous run's tuning */
+    bool IsLaunchTuned() { return isAutotune || hasLaunchTunings.load(std::memory_order_relaxed); }
+
+    /**
+     * Change the launch shape of "kernel," (for "api_call," at "qubitCount" width,) to the tuned one, or, while
+     * autotuning, to the next candidate. Only the local group size, (and, for grid-stride kernels, the number of work
+     * items,) ever changes, so the result is the same for any shape. Returns the index of a candidate that should be
+     * timed, by RecordLaunch(), or -1.
+     */
+    int TuneLaunch(OCLAPI api_call, bitLenInt qubitCount, const cl::Kernel& kernel, size_t& workItemCount,
+        size_t& localGroupSize);
+    /** Record the device time of a TuneLaunch() candidate, (and save the winners, once every candidate is timed) */
+    void RecordLaunch(OCLAPI api_call, bitLenInt qubitCount, int candidate, double seconds);
+    /** Load tuned launch shapes saved by an earlier process, and save new ones to the same "path" */
+    void LoadLaunchTunings(const std::string& path);
+
     size_t GetPreferredConcurrency()
     {
         if (preferredConcurrency) {
@@ -278,11 +436,55 @@ public:
         return preferredConcurrency;
     }
 
+    /**
+     * An idle pooled state buffer of at least "size" bytes, (and at most 2^QRACK_SV_POOL_SLACK times as big,) or NULL.
+     * Work still queued on it, from its last owner, finishes first.
+     */
+    std::shared_ptr<cl::Buffer> AcquireBuffer(size_t size)
+    {
+        cl::Buffer buffer;
+        size_t capacity;
+        {
+            std::lock_guard<std::mutex> guard(bufferPoolMutex);
+            auto it = bufferPool.lower_bound(size);
+            if ((it == bufferPool.end()) || (it->first > (size << QRACK_SV_POOL_SLACK))) {
+                return NULL;
+            }
+            buffer = it->second;
+            capacity = it->first;
+            bufferPoolBytes -= capacity;
+            bufferPool.erase(it);
+        }
+        queue.finish();
+
+        return PoolBuffer(std::make_shared<cl::Buffer>(buffer), capacity);
+    }
+
+    /** Share "buffer," of "size" bytes, such that it goes back to the pool when its last owner releases it */
+    std::shared_ptr<cl::Buffer> PoolBuffer(std::shared_ptr<cl::Buffer> buffer, size_t size)
+    {
+        if (!buffer || !maxBufferPoolBytes) {
+            return buffer;
+        }
+
+        return std::shared_ptr<cl::Buffer>(
+            new cl::Buffer(*buffer), [this, size](cl::Buffer* b) { ReleaseBuffer(b, size); });
+    }
+
+    /** Free every idle pooled buffer */
+    void ClearBufferPool()
+    {
+        std::lock_guard<std::mutex> guard(bufferPoolMutex);
+        bufferPool.clear();
+        bufferPoolBytes = 0U;
+    }
+
     size_t GetProcElementCount() { return procElemCount; }
     size_t GetMaxWorkItems() { return maxWorkItems; }
     size_t GetMaxWorkGroupSize() { return maxWorkGroupSize; }
     size_t GetMaxAlloc() { return maxAlloc; }
     size_t GetGlobalSize() { return globalSize; }
+    size_t GetLocalSize() { return localSize; }
     size_t GetGlobalAllocLimit() { return globalLimit; }
 
     friend class OCLEngine;
@@ -340,13 +542,22 @@ public:
         return std::string(getenv("HOME") ? getenv("HOME") : "") + "/.qrack/";
 #endif
     }
+    /// Get the file name that a device's program binary is cached under, (in GetDefaultBinaryPath(), by default)
+    static std::string GetBinaryFileName(DeviceContextPtr devCntxt)
+    {
+        cl::Platform platform = devCntxt->platform;
+        cl::Device device = devCntxt->device;
+        return GetBinaryFileName(platform, device);
+    }
     /// Initialize the OCL environment, with the option to save the generated binaries. Binaries will be saved/loaded
     /// from the folder path "home". This returns a Qrack::OCLInitResult object which should be passed to
-    /// SetDeviceContextPtrVector().
+    /// SetDeviceContextPtrVector(). Only the default device's kernels are built before this returns, (unless
+    /// "saveBinaries" is set); every other device builds in the background, or on its first use.
     static InitOClResult InitOCL(bool buildFromSource = false, bool saveBinaries = false, std::string home = "*",
         std::vector<int64_t> maxAllocVec = { -1 });
 
-    /// Get a pointer one of the available OpenCL contexts, by its index in the list of all contexts.
+    /// Get a pointer one of the available OpenCL contexts, by its index in the list of all contexts. (Its kernels are
+    /// built, if they haven't been yet.)
     DeviceContextPtr GetDeviceContextPtr(const int64_t& dev = -1);
     /// Get the list of all available devices (and their supporting objects).
     std::vector<DeviceContextPtr> GetDeviceContextPtrVector();
@@ -419,9 +630,17 @@ private:
 
     OCLEngine(); // Private so that it can  not be called
 
+    /// Get the embedded OpenCL sources, for this build's FPPOW, UINTPOW, and ALU options
+    static std::vector<std::pair<const unsigned char*, size_t>> GetKernelSources();
+    /// Get the binary cache file name for a device, keyed by device, driver, type widths, sources, and build options
+    static std::string GetBinaryFileName(cl::Platform& platform, cl::Device& device);
     /// Make the program, from either source or binary
-    static cl::Program MakeProgram(bool buildFromSource, std::string path, std::shared_ptr<OCLDeviceContext> devCntxt);
-    /// Save the program binary:
+    static cl::Program MakeProgram(
+        bool buildFromSource, std::string path, OCLDeviceContext& devCntxt, bool* isFromBinary = NULL);
+    /// Make and build the program for one device, fill its kernel table, and cache its binary if needed
+    static void BuildProgram(
+        OCLDeviceContext& devCntxt, bool buildFromSource, bool saveBinaries, bool useCache, std::string home);
+    /// Save the program binary, atomically (via a temporary file and rename)
     static void SaveBinary(cl::Program program, std::string path, std::string fileName);
 };
 
@@ -44,6 +44,12 @@ public:
     /** Call fn once for every numerical value between begin and end. */
     void par_for(const bitCapIntOcl begin, const bitCapIntOcl end, ParallelFunc fn);
 
+    /**
+     * Call fn once per stride of the values between begin and end, (on the same threads as par_for(),) so that the
+     * caller's loop over each range can be inlined and vectorized, rather than called once per value.
+     */
+    void par_for_range(const bitCapIntOcl begin, const bitCapIntOcl end, RangeFunc fn);
+
     /**
      * Skip over the skipPower bits.
      *
@@ -69,6 +75,12 @@ public:
     void par_for_sparse_compose(const std::vector<bitCapIntOcl>& lowSet, const std::vector<bitCapIntOcl>& highSet,
         const bitLenInt& highStart, ParallelFunc fn);
 
+    /**
+     * Zero a freshly allocated array, in the same strides and on the same pool slots that par_for() would use over
+     * it, so that (NUMA) first-touch places each stride near the threads that will work on it.
+     */
+    void par_zero(complex* amps, const bitCapIntOcl itemCount);
+
     /** Calculate the normal for the array, (with flooring). */
     real1_f par_norm(const bitCapIntOcl maxQPower, const StateVectorPtr stateArray, real1_f norm_thresh = ZERO_R1_F);
 
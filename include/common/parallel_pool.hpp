@@ -0,0 +1,114 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2021. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qrack_types.hpp"
+
+#if !ENABLE_PTHREAD
+#error PTHREAD has not been enabled
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Qrack {
+
+/**
+ * Process-wide pool of persistent worker threads, shared by every ParallelFor (and so every QInterface) instance.
+ *
+ * A job is a count of work chunks split into one contiguous range ("deque") per slot. Each participating thread
+ * holds exactly one slot, works its own range from the front, and then steals single chunks from the back of the
+ * other slots' ranges. The calling thread always participates, so a job completes even if every worker is busy.
+ *
+ * With ENABLE_NUMA on a multi-node host, workers are pinned to nodes in contiguous bands, and a worker prefers the
+ * slots (and so the contiguous index ranges) in its node's band. ParallelFor::par_zero() uses this to first-touch
+ * state vector memory from the node that will work on it.
+ */
+class ParallelPool {
+protected:
+    struct WorkRange {
+        std::mutex lock;
+        bitCapIntOcl front;
+        bitCapIntOcl back;
+    };
+
+    struct Job {
+        ParallelFunc fn;
+        std::unique_ptr<WorkRange[]> ranges;
+        unsigned slotCount;
+        unsigned claimedCount;
+        std::vector<bool> isClaimed;
+        std::atomic<bitCapIntOcl> pending;
+        std::mutex doneLock;
+        std::condition_variable doneCv;
+        std::exception_ptr error;
+    };
+
+    std::mutex lock_;
+    std::condition_variable cv_;
+    std::list<std::shared_ptr<Job>> jobs_;
+    std::vector<std::thread> workers_;
+    unsigned nodeCount_;
+
+    ParallelPool(unsigned workerCount, unsigned nodeCount);
+
+    void WorkerLoop(unsigned node);
+    unsigned ClaimSlot(Job& job, const unsigned& node);
+    bool PopChunk(Job& job, const unsigned& slot, bitCapIntOcl& chunk);
+    void Participate(Job& job, const unsigned& slot);
+
+public:
+    /**
+     * Get the shared pool, starting it on first use. Worker count defaults to one less than the hardware thread
+     * count, (since the calling thread also works,) and can be overridden with the QRACK_POOL_THREADS environment
+     * variable.
+     */
+    static ParallelPool& Instance();
+
+    unsigned GetWorkerCount() { return (unsigned)workers_.size(); }
+
+    /**
+     * Number of NUMA nodes that workers are spread across. This is 1 unless built with ENABLE_NUMA on a multi-node
+     * host, (and not disabled with the QRACK_DISABLE_NUMA environment variable).
+     */
+    unsigned GetNumaNodeCount() { return nodeCount_; }
+
+    /** Bind (not yet touched) memory to a NUMA node, so it is placed there on first touch, if NUMA is in use. */
+    void BindToNumaNode(void* ptr, size_t size, int node);
+
+    /**
+     * Call fn(chunk, slot) once for every chunk in [0, chunkCount), on up to "slots" threads including the caller.
+     * A slot index is held by only one thread at a time, so "slot" can safely index per-thread accumulators sized to
+     * "slots." Blocks until every chunk is done, and rethrows the first exception thrown by fn.
+     */
+    void Run(const bitCapIntOcl chunkCount, const unsigned slots, ParallelFunc fn);
+
+    /**
+     * Run "task" once, on the next free worker, without waiting for it, (as DispatchQueue drains its gates). With no
+     * workers, "task" runs on the calling thread, before this returns. An exception thrown by "task" is dropped, so
+     * it should catch its own.
+     */
+    void Post(std::function<void()> task);
+
+    // Deleted operations
+    ParallelPool(const ParallelPool& rhs) = delete;
+    ParallelPool& operator=(const ParallelPool& rhs) = delete;
+};
+
+} // namespace Qrack
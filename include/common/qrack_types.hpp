@@ -62,26 +62,23 @@
 #elif QBCAPPOW < 7
 #define bitsInCap 64
 #define bitCapInt uint64_t
-#elif QBCAPPOW < 8
+#elif QBCAPPOW < 8 && defined(__SIZEOF_INT128__)
 #define bitsInCap 128
-#ifdef BOOST_AVAILABLE
-#include <boost/multiprecision/cpp_int.hpp>
-#define bitCapInt boost::multiprecision::uint128_t
-#else
 #define bitCapInt __uint128_t
-#endif
 #else
-#define bitsInCap (8U * (((bitLenInt)1U) << QBCAPPOW))
-#include <boost/multiprecision/cpp_int.hpp>
-#define bitCapInt                                                                                                      \
-    boost::multiprecision::number<boost::multiprecision::cpp_int_backend<1ULL << QBCAPPOW, 1ULL << QBCAPPOW,           \
-        boost::multiprecision::unsigned_magnitude, boost::multiprecision::unchecked, void>>
+#define bitsInCap (((bitLenInt)1U) << QBCAPPOW)
+#define QRACK_BIG_INTEGER 1
+#include "common/big_integer.hpp"
+#define bitCapInt Qrack::BigInteger<(((size_t)1U) << QBCAPPOW) / 64U>
 #endif
 
 #define bitsInByte 8U
 #define qrack_rand_gen std::mt19937_64
 #define qrack_rand_gen_ptr std::shared_ptr<qrack_rand_gen>
 #define QRACK_ALIGN_SIZE 64U
+#define QRACK_MAX_MTRXN_QB 5U
+// Register bits of each cache-resident block of a state vector engine FFT, (for QFT() and IQFT())
+#define QRACK_FFT_BLOCK_QB 10U
 
 #if FPPOW < 5
 #if !defined(__arm__)
@@ -190,6 +187,8 @@ typedef std::shared_ptr<complex> BitOp;
 /** Called once per value between begin and end. */
 typedef std::function<void(const bitCapIntOcl&, const unsigned& cpu)> ParallelFunc;
 typedef std::function<bitCapIntOcl(const bitCapIntOcl&, const unsigned& cpu)> IncrementFunc;
+/** Called once per contiguous range, [begin, end), of values. */
+typedef std::function<void(const bitCapIntOcl& begin, const bitCapIntOcl& end, const unsigned& cpu)> RangeFunc;
 typedef std::function<bitCapInt(const bitCapInt&)> BdtFunc;
 typedef std::function<void(const bitCapInt&, const unsigned& cpu)> ParallelFuncBdt;
 
@@ -251,7 +250,9 @@ inline bitCapInt pow2Mask(const bitLenInt& p) { return ((bitCapInt)ONE_BCI << p)
 inline bitCapIntOcl pow2MaskOcl(const bitLenInt& p) { return ((bitCapIntOcl)ONE_BCI << p) - ONE_BCI; }
 inline bitLenInt log2(bitCapInt n)
 {
-#if __GNUC__ && QBCAPPOW < 7
+#if QRACK_BIG_INTEGER
+    return (bitLenInt)bi_log2(n);
+#elif __GNUC__ && QBCAPPOW < 7
 // Source: https://stackoverflow.com/questions/11376288/fast-computing-of-log2-for-64-bit-integers#answer-11376759
 #if QBCAPPOW < 6
     return (bitLenInt)(bitsInByte * sizeof(unsigned int) - __builtin_clz((unsigned int)n) - 1U);
@@ -323,7 +324,7 @@ bool isOverflowSub(bitCapInt inOutInt, bitCapInt inInt, const bitCapInt& signMas
 bitCapInt pushApartBits(const bitCapInt& perm, const std::vector<bitCapInt>& skipPowers);
 bitCapInt intPow(bitCapInt base, bitCapInt power);
 bitCapIntOcl intPowOcl(bitCapIntOcl base, bitCapIntOcl power);
-#if QBCAPPOW == 7U
+#if QBCAPPOW == 7U && !QRACK_BIG_INTEGER
 std::ostream& operator<<(std::ostream& os, bitCapInt b);
 std::istream& operator>>(std::istream& is, bitCapInt& b);
 #endif
@@ -0,0 +1,54 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// Runtime-dispatched AVX2 and AVX-512 kernels for the hot QEngineCPU loops. The widest
+// instruction set that the host supports is selected once, at startup.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qrack_types.hpp"
+
+namespace Qrack {
+
+enum SimdIsa { SIMD_ISA_NONE = 0, SIMD_ISA_AVX2, SIMD_ISA_AVX512 };
+
+#if ENABLE_AVX_DISPATCH && ((FPPOW == 5) || (FPPOW == 6))
+/** The widest supported instruction set, (optionally capped by the QRACK_SIMD_ISA environment variable) */
+SimdIsa GetSimdIsa();
+/** Number of complex amplitudes per vector register for GetSimdIsa(), or 0 if there is no dispatched kernel */
+bitCapIntOcl GetSimdWidth();
+/**
+ * Apply the 2x2 operator "mtrx" to "length" pairs of amplitudes, where pair "j" is ("lo[j]", "hi[j]"). "length" must
+ * be a multiple of GetSimdWidth().
+ */
+void SimdApply2x2(complex* lo, complex* hi, complex const* mtrx, bitCapIntOcl length);
+/** Sum the norms of "length" contiguous amplitudes, skipping those with norm below "norm_thresh" */
+real1_f SimdNorm(complex const* amps, bitCapIntOcl length, real1_f norm_thresh);
+/**
+ * Sum the norms of those of "length" contiguous amplitudes whose index bits under "mask" equal "perm". "amps" must
+ * start at an index that is a multiple of GetSimdWidth(), "length" must be a multiple of it, and "mask" must be less
+ * than it.
+ */
+real1_f SimdProbMask(complex const* amps, bitCapIntOcl mask, bitCapIntOcl perm, bitCapIntOcl length);
+/**
+ * Multiply those of "length" contiguous amplitudes whose index bits under "mask" equal "result" by "nrm", and zero the
+ * rest. (The same alignment conditions hold as for SimdProbMask().)
+ */
+void SimdApplyM(complex* amps, bitCapIntOcl mask, bitCapIntOcl result, complex nrm, bitCapIntOcl length);
+#else
+inline SimdIsa GetSimdIsa() { return SIMD_ISA_NONE; }
+inline bitCapIntOcl GetSimdWidth() { return 0U; }
+inline void SimdApply2x2(complex* lo, complex* hi, complex const* mtrx, bitCapIntOcl length) {}
+inline real1_f SimdNorm(complex const* amps, bitCapIntOcl length, real1_f norm_thresh) { return ZERO_R1_F; }
+inline real1_f SimdProbMask(complex const* amps, bitCapIntOcl mask, bitCapIntOcl perm, bitCapIntOcl length)
+{
+    return ZERO_R1_F;
+}
+inline void SimdApplyM(complex* amps, bitCapIntOcl mask, bitCapIntOcl result, complex nrm, bitCapIntOcl length) {}
+#endif
+} // namespace Qrack
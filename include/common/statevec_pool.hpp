@@ -0,0 +1,72 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qrack_types.hpp"
+
+#include <map>
+#include <mutex>
+
+/** A pooled buffer serves a request of down to 1 / 2^QRACK_SV_POOL_SLACK of its size. */
+#define QRACK_SV_POOL_SLACK 2U
+
+namespace Qrack {
+
+/**
+ * Process-wide pool of aligned host state vector buffers, by size.
+ *
+ * QUnit constantly composes and decomposes its engines, and every resize used to round-trip a full state vector
+ * through the allocator, (and the operating system, with the page faults of first touch). Released buffers are kept
+ * idle, up to QRACK_SV_POOL_MB in total, and a request takes the smallest idle buffer that is big enough, (and at
+ * most 2^QRACK_SV_POOL_SLACK times as big,) so that, for example, a register that shrinks and grows back by a qubit
+ * or two reuses its old allocation.
+ */
+class StateVecPool {
+protected:
+    std::mutex mtx;
+    size_t maxIdleBytes;
+    size_t idleBytes;
+    size_t hitCount;
+    size_t missCount;
+    // Idle buffers, by capacity
+    std::multimap<size_t, void*> idle;
+    // The capacity of every buffer handed out
+    std::map<void*, size_t> capacities;
+
+    StateVecPool();
+
+    void* AlignedAlloc(size_t bytes);
+    void AlignedFree(void* ptr);
+    void EvictIdle(size_t bytes);
+    void FreeIdle(std::multimap<size_t, void*>::iterator it);
+
+public:
+    static StateVecPool& Instance();
+
+    /** An aligned buffer of at least "bytes," (a power of two,) which throws std::bad_alloc on failure */
+    void* Acquire(size_t bytes);
+    /** Return a buffer from Acquire(), to keep idle, or to free, if that would exceed the idle limit */
+    void Release(void* ptr);
+    /** Free every idle buffer */
+    void Clear();
+
+    /** Set the maximum total size of idle buffers, or 0 to disable pooling */
+    void SetMaxIdleBytes(size_t bytes);
+    size_t GetMaxIdleBytes() { return maxIdleBytes; }
+    size_t GetIdleBytes();
+    /** Requests served from idle buffers */
+    size_t GetHitCount() { return hitCount; }
+    /** Requests that allocated */
+    size_t GetMissCount() { return missCount; }
+};
+} // namespace Qrack
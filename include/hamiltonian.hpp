@@ -15,6 +15,9 @@
 
 #include <vector>
 
+// Maximum qubits in one merged diagonal phase pass of a CompiledHamiltonian
+#define QRACK_TROTTER_PHASE_QB 8U
+
 struct _QrackTimeEvolveOpHeader {
     unsigned target;
     unsigned controlLen;
@@ -23,6 +26,8 @@ struct _QrackTimeEvolveOpHeader {
 
 namespace Qrack {
 
+class ParallelFor;
+
 /**
  * A Hamiltonian can be specified in terms of arbitrary controlled single bit gates, each one an "HamiltonianOp."
  */
@@ -121,4 +126,91 @@ struct UniformHamiltonianOp : HamiltonianOp {
  */
 typedef std::shared_ptr<HamiltonianOp> HamiltonianOpPtr;
 typedef std::vector<HamiltonianOpPtr> Hamiltonian;
+
+/** Product formula for each CompiledHamiltonian time step */
+enum TrotterOrder {
+    /** e^(-i * H_(N - 1) * t) * ... * e^(-i * H_0 * t), (as QInterface::TimeEvolve() applies a Hamiltonian) */
+    TROTTER_FIRST_ORDER = 1,
+    /** The symmetric (Strang) product, of a first order sweep at t/2, then its reverse at t/2 */
+    TROTTER_SECOND_ORDER = 2,
+    /** Suzuki's fourth order product of five second order sweeps */
+    TROTTER_FOURTH_ORDER = 4
+};
+
+/** One exponentiated (and possibly fused) term of a CompiledHamiltonian, applied as a controlled single bit gate */
+struct CompiledHamiltonianOp {
+    bitLenInt targetBit;
+    bool anti;
+    bool uniform;
+    std::vector<bitLenInt> controls;
+    std::vector<bool> toggles;
+    // The gate, or (if "uniform") one gate per control permutation, in the order of UniformlyControlledSingleBit()
+    std::vector<complex> mtrx;
+};
+
+/**
+ * A Hamiltonian compiled for repeated evolution by a fixed time step, "timeDiff," with QInterface::TimeEvolve().
+ *
+ * Every term's matrix exponential for one step of the chosen TrotterOrder is computed once, at construction. Terms
+ * that commute, (because they act on disjoint qubits, or because both are diagonal,) are then moved together, where
+ * that lets them fuse: successive gates on the same single qubit become one gate, and, with "mergeDiagonals,"
+ * diagonal terms on up to QRACK_TROTTER_PHASE_QB qubits in all become one uniformly controlled phase pass. (Merging
+ * diagonals entangles their qubits, in QUnit, so turn it off to favor separability.) None of these rearrangements
+ * change the product that is applied.
+ */
+class CompiledHamiltonian {
+protected:
+    real1_f timeDiff;
+    TrotterOrder order;
+    std::vector<CompiledHamiltonianOp> ops;
+
+public:
+    CompiledHamiltonian(
+        const Hamiltonian& h, real1_f dt, TrotterOrder o = TROTTER_FIRST_ORDER, bool mergeDiagonals = true);
+
+    real1_f GetTimeDiff() const { return timeDiff; }
+    TrotterOrder GetOrder() const { return order; }
+    /** The gates of one time step, in order of application */
+    const std::vector<CompiledHamiltonianOp>& GetOps() const { return ops; }
+};
+
+/** One term of a KrylovHamiltonian, as masks over the state vector index */
+struct KrylovHamiltonianTerm {
+    bitCapIntOcl targetPow;
+    bitCapIntOcl controlMask;
+    bitCapIntOcl toggleMask;
+    bool anti;
+    bool uniform;
+    std::vector<bitCapIntOcl> controlPowers;
+    // The term's generator, -i * H, (or -H, if "uniform,") with one 2x2 block per control permutation, if "uniform"
+    std::vector<complex> generator;
+};
+
+/**
+ * A Hamiltonian prepared for Krylov subspace time evolution, with QInterface::TimeEvolve().
+ *
+ * Rather than a product of exponentiated terms, this evolves by the exponential of their sum, (with each term as
+ * TimeEvolve(h, dt) exponentiates it,) applied to the state vector as a matrix-free operator. Each step builds an
+ * Arnoldi basis of at most "krylovDim" vectors from the state, exponentiates the small projected matrix, and takes
+ * as long a timestep as keeps the estimated error within "tolerance," (over the whole evolution time,) so there is no
+ * splitting error, and a long evolution takes few steps.
+ */
+class KrylovHamiltonian {
+protected:
+    real1_f tolerance;
+    unsigned krylovDim;
+    std::vector<KrylovHamiltonianTerm> terms;
+
+public:
+    KrylovHamiltonian(const Hamiltonian& h, real1_f tol = 64 * FP_NORM_EPSILON_F, unsigned dim = 24U);
+
+    real1_f GetTolerance() const { return tolerance; }
+    unsigned GetKrylovDim() const { return krylovDim; }
+
+    /** Write the sum of the term generators, applied to "in," to "out," (which must not alias "in") */
+    void Apply(ParallelFor& pf, const complex* in, complex* out, bitCapIntOcl maxQPower) const;
+
+    /** Evolve "state" in place for time "t," and return the number of times the operator was applied */
+    unsigned Evolve(ParallelFor& pf, complex* state, bitCapIntOcl maxQPower, real1_f t) const;
+};
 } // namespace Qrack
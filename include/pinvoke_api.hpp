@@ -23,11 +23,40 @@
 typedef unsigned long long uintq;
 typedef void (*IdCallback)(uintq);
 typedef bool (*ProbAmpCallback)(size_t, double, double);
+typedef bool (*StatCallback)(const char*, uintq, double);
+typedef void (*AsyncCallback)(uintq, double);
 
 #if !(FPPOW < 6 && !ENABLE_COMPLEX_X2)
 struct _QrackTimeEvolveOpHeader;
 #endif
 
+/**
+ * Op codes for RunProgram(). Each op in the program stream is the op code, the control count "k," the "k" control
+ * qubit IDs, and then the target qubit ID, (or two, for QPROG_SWAP). Rotations take their angle, QPROG_U its (theta,
+ * phi, lambda), and QPROG_MTRX its 8 (real, imaginary) matrix components from the parameter array, in program order.
+ * OR an op code with QPROG_ANTI to (anti-)control on |0> instead of |1>. QPROG_M takes no controls, and writes its
+ * result to the next entry of the results array.
+ */
+enum QrackProgramOpType {
+    QPROG_X = 0,
+    QPROG_Y = 1,
+    QPROG_Z = 2,
+    QPROG_H = 3,
+    QPROG_S = 4,
+    QPROG_IS = 5,
+    QPROG_T = 6,
+    QPROG_IT = 7,
+    QPROG_RX = 8,
+    QPROG_RY = 9,
+    QPROG_RZ = 10,
+    QPROG_R1 = 11,
+    QPROG_U = 12,
+    QPROG_MTRX = 13,
+    QPROG_SWAP = 14,
+    QPROG_M = 15,
+    QPROG_ANTI = 256
+};
+
 extern "C" {
 // non-quantum
 MICROSOFT_QUANTUM_DECL int get_error(_In_ uintq sid);
@@ -43,6 +72,7 @@ MICROSOFT_QUANTUM_DECL void set_concurrency(_In_ uintq sid, _In_ uintq p);
 
 // pseudo-quantum
 MICROSOFT_QUANTUM_DECL double Prob(_In_ uintq sid, _In_ uintq q);
+MICROSOFT_QUANTUM_DECL void ProbBits(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* q, double* p);
 MICROSOFT_QUANTUM_DECL double PermutationExpectation(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* c);
 
 MICROSOFT_QUANTUM_DECL void DumpIds(_In_ uintq sid, _In_ IdCallback callback);
@@ -50,12 +80,56 @@ MICROSOFT_QUANTUM_DECL void Dump(_In_ uintq sid, _In_ ProbAmpCallback callback);
 
 MICROSOFT_QUANTUM_DECL void InKet(_In_ uintq sid, _In_ Qrack::real1_f* ket);
 MICROSOFT_QUANTUM_DECL void OutKet(_In_ uintq sid, _In_ Qrack::real1_f* ket);
+MICROSOFT_QUANTUM_DECL void OutProbs(_In_ uintq sid, _In_ Qrack::real1_f* p);
+MICROSOFT_QUANTUM_DECL const Qrack::real1_f* MapKet(_In_ uintq sid);
+MICROSOFT_QUANTUM_DECL void UnmapKet(_In_ uintq sid);
+
+// Run a packed program of "n" words, (see QrackProgramOpType,) under one lock, returning its measurement count
+MICROSOFT_QUANTUM_DECL uintq RunProgram(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* ops, _In_ uintq pn,
+    _In_reads_(pn) double* params, uintq* m);
+
+#if ENABLE_PTHREAD && ENABLE_QUNIT_CPU_PARALLEL
+// Non-blocking calls, queued in order on the simulator's own worker queue, each returning a ticket, (with the callback,
+// if not NULL, receiving the ticket and its result on whichever thread drains the queue)
+MICROSOFT_QUANTUM_DECL uintq ProbAsync(_In_ uintq sid, _In_ uintq q, _In_ AsyncCallback callback);
+MICROSOFT_QUANTUM_DECL uintq MAsync(_In_ uintq sid, _In_ uintq q, _In_ AsyncCallback callback);
+MICROSOFT_QUANTUM_DECL uintq MeasureShotsAsync(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* q, _In_ uintq s,
+    _In_reads_(s) uintq* m, _In_ AsyncCallback callback);
+MICROSOFT_QUANTUM_DECL uintq PermutationExpectationAsync(
+    _In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* c, _In_ AsyncCallback callback);
+MICROSOFT_QUANTUM_DECL uintq RunProgramAsync(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* ops, _In_ uintq pn,
+    _In_reads_(pn) double* params, uintq* m, _In_ AsyncCallback callback);
+MICROSOFT_QUANTUM_DECL bool PollAsync(_In_ uintq ticket);
+MICROSOFT_QUANTUM_DECL double WaitAsync(_In_ uintq ticket);
+MICROSOFT_QUANTUM_DECL void FinishAsync(_In_ uintq sid);
+#endif
+
+MICROSOFT_QUANTUM_DECL void SaveCheckpoint(_In_ uintq sid, _In_ const char* path, _In_ bool compress);
+MICROSOFT_QUANTUM_DECL void LoadCheckpoint(_In_ uintq sid, _In_ const char* path);
+
+// Resume each ResetAll() gate stream from the longest cached prefix, (with stats of hits, misses, bytes, and entries)
+MICROSOFT_QUANTUM_DECL void SetPrefixCache(
+    _In_ uintq sid, _In_ uintq maxBytes, _In_ uintq interval, _In_ bool useCheckpoints);
+MICROSOFT_QUANTUM_DECL void GetPrefixCacheStats(_In_ uintq sid, uintq* stats);
+
+// Hot-path statistics are process-wide, (and empty unless built with ENABLE_INSTRUMENTATION)
+MICROSOFT_QUANTUM_DECL void GetStats(_In_ uintq sid, _In_ StatCallback callback);
+MICROSOFT_QUANTUM_DECL void ResetStats(_In_ uintq sid);
+MICROSOFT_QUANTUM_DECL void SetTracing(_In_ uintq sid, _In_ bool enable);
+MICROSOFT_QUANTUM_DECL void WriteChromeTrace(_In_ uintq sid, _In_ const char* path);
 
 MICROSOFT_QUANTUM_DECL size_t random_choice(_In_ uintq sid, _In_ size_t n, _In_reads_(n) double* p);
 
 MICROSOFT_QUANTUM_DECL void PhaseParity(_In_ uintq sid, _In_ double lambda, _In_ uintq n, _In_reads_(n) uintq* q);
 MICROSOFT_QUANTUM_DECL double JointEnsembleProbability(
     _In_ uintq sid, _In_ uintq n, _In_reads_(n) int* b, _In_reads_(n) uintq* q);
+// Term "i" of "t" Pauli strings is the next "n[i]" entries of "b" and "q"; its expectation value is written to "e[i]"
+MICROSOFT_QUANTUM_DECL void PauliExpectationAll(_In_ uintq sid, _In_ uintq t, _In_reads_(t) uintq* n, _In_ int* b,
+    _In_ uintq* q, double* e);
+// Expectation value of the sum of "c[i]" times Pauli string term "i," after a packed program, with its gradient in "g"
+MICROSOFT_QUANTUM_DECL double ProgramGradient(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* ops, _In_ uintq pn,
+    _In_reads_(pn) double* params, _In_ uintq t, _In_reads_(t) uintq* tn, _In_ int* b, _In_ uintq* q,
+    _In_reads_(t) double* c, double* g);
 
 MICROSOFT_QUANTUM_DECL void ResetAll(_In_ uintq sid);
 
@@ -75,6 +149,7 @@ MICROSOFT_QUANTUM_DECL void AdjS(_In_ uintq sid, _In_ uintq q);
 MICROSOFT_QUANTUM_DECL void AdjT(_In_ uintq sid, _In_ uintq q);
 MICROSOFT_QUANTUM_DECL void U(_In_ uintq sid, _In_ uintq q, _In_ double theta, _In_ double phi, _In_ double lambda);
 MICROSOFT_QUANTUM_DECL void Mtrx(_In_ uintq sid, _In_reads_(8) double* m, _In_ uintq q);
+MICROSOFT_QUANTUM_DECL uintq KrausChannel(_In_ uintq sid, _In_ uintq n, _In_reads_(8 * n) double* k, _In_ uintq q);
 
 // multi-controlled single-qubit gates
 
@@ -215,6 +290,24 @@ MICROSOFT_QUANTUM_DECL bool TrySeparateTol(_In_ uintq sid, _In_ uintq n, _In_rea
 MICROSOFT_QUANTUM_DECL void SetReactiveSeparate(_In_ uintq sid, _In_ bool irs);
 MICROSOFT_QUANTUM_DECL void SetTInjection(_In_ uintq sid, _In_ bool iti);
 
+// batched execution of many small registers with identical circuit structure
+MICROSOFT_QUANTUM_DECL uintq init_batch(_In_ uintq n, _In_ uintq q);
+MICROSOFT_QUANTUM_DECL void destroy_batch(_In_ uintq bid);
+MICROSOFT_QUANTUM_DECL int get_batch_error(_In_ uintq bid);
+MICROSOFT_QUANTUM_DECL void MtrxBatch(_In_ uintq bid, _In_ double* m, _In_ uintq q);
+MICROSOFT_QUANTUM_DECL void MCMtrxBatch(
+    _In_ uintq bid, _In_ uintq n, _In_reads_(n) uintq* c, _In_ double* m, _In_ uintq q);
+MICROSOFT_QUANTUM_DECL void MeasureShotsBatch(
+    _In_ uintq bid, _In_ uintq n, _In_reads_(n) uintq* q, _In_ uintq s, uintq* m);
+
+// Pauli-frame sampling of noisy Clifford circuits, (see Qrack::FrameOpType for "op" codes)
+MICROSOFT_QUANTUM_DECL uintq init_frames(_In_ uintq q, _In_ uintq w);
+MICROSOFT_QUANTUM_DECL void destroy_frames(_In_ uintq fid);
+MICROSOFT_QUANTUM_DECL int get_frames_error(_In_ uintq fid);
+MICROSOFT_QUANTUM_DECL void FramesAppend(_In_ uintq fid, _In_ uintq op, _In_ uintq q1, _In_ uintq q2, _In_ double p);
+MICROSOFT_QUANTUM_DECL uintq FramesMeasurementCount(_In_ uintq fid);
+MICROSOFT_QUANTUM_DECL void MeasureShotsFrames(_In_ uintq fid, _In_ uintq s, uintq* m);
+
 #if !(FPPOW < 6 && !ENABLE_COMPLEX_X2)
 MICROSOFT_QUANTUM_DECL void TimeEvolve(_In_ uintq sid, _In_ double t, _In_ uintq n,
     _In_reads_(n) _QrackTimeEvolveOpHeader* teos, uintq mn, _In_reads_(mn) double* mtrx);
@@ -0,0 +1,142 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "common/parallel_for.hpp"
+#include "common/rdrandwrapper.hpp"
+
+#include <random>
+
+namespace Qrack {
+
+class QBatch;
+typedef std::shared_ptr<QBatch> QBatchPtr;
+
+/**
+ * A "Qrack::QBatch" holds many independent, equally sized (small) registers in one strided state vector buffer, so
+ * circuits of identical structure, (like the members of a VQE or QAOA parameter sweep,) can be run together.
+ *
+ * Register "b" occupies amplitudes [b * 2^n, (b + 1) * 2^n). Every gate is a single parallel dispatch over all
+ * registers. The "...Batch" gate variants take one matrix per register, consecutively, so each register can get its own
+ * parameters; the other variants apply the same matrix to every register.
+ */
+class QBatch : public ParallelFor {
+protected:
+    bitLenInt qubitCount;
+    bitCapIntOcl batchCount;
+    bitCapIntOcl maxQPowerOcl;
+    std::unique_ptr<complex[]> stateVec;
+    qrack_rand_gen_ptr rand_generator;
+    std::uniform_real_distribution<real1_s> rand_distribution;
+    std::shared_ptr<RdRandom> hardware_rand_generator;
+
+    real1_f Rand()
+    {
+        if (hardware_rand_generator) {
+            return hardware_rand_generator->Next();
+        }
+        return rand_distribution(*rand_generator);
+    }
+
+    uint64_t RandSeed()
+    {
+        if (hardware_rand_generator) {
+            return ((uint64_t)hardware_rand_generator->NextRaw() << 32U) | (uint64_t)hardware_rand_generator->NextRaw();
+        }
+        return (uint64_t)(*rand_generator)();
+    }
+
+    void ThrowIfBadBatch(bitCapIntOcl batch, std::string methodName)
+    {
+        if (batch >= batchCount) {
+            throw std::invalid_argument(methodName + " batch index parameter must be within allocated batch bounds!");
+        }
+    }
+
+    complex* GetBatchPtr(bitCapIntOcl batch) { return stateVec.get() + batch * maxQPowerOcl; }
+
+    /** Make "stateVec" current, before the host reads it, (for engines that keep the state elsewhere). */
+    virtual void SyncToHost()
+    {
+        // Intentionally left blank.
+    }
+    /** "stateVec" was just written on the host, and is now the authoritative copy of the state. */
+    virtual void InvalidateDevice()
+    {
+        // Intentionally left blank.
+    }
+
+    /**
+     * Check a controlled gate's qubits, returning its control and target powers in ascending order, and setting
+     * "controlMask" to the control powers that "controlPerm" sets.
+     */
+    std::vector<bitCapIntOcl> SortGatePowers(const std::vector<bitLenInt>& controls, bitCapIntOcl controlPerm,
+        bitLenInt target, bitCapIntOcl& controlMask);
+
+    /** Apply a controlled 2x2 gate to every register, using matrix (mtrxs + 4 * b * mtrxStride) for register "b". */
+    virtual void ApplyControlled2x2(const std::vector<bitLenInt>& controls, bitCapIntOcl controlPerm,
+        complex const* mtrxs, bitCapIntOcl mtrxStride, bitLenInt target);
+
+public:
+    QBatch(bitLenInt qBitCount, bitCapIntOcl batches, bitCapInt initState = 0U, qrack_rand_gen_ptr rgp = nullptr,
+        bool useHardwareRNG = true);
+
+    virtual ~QBatch()
+    {
+        // Virtual destructor for inheritance
+    }
+
+    bitLenInt GetQubitCount() { return qubitCount; }
+    bitCapIntOcl GetBatchCount() { return batchCount; }
+    bitCapInt GetMaxQPower() { return pow2(qubitCount); }
+
+    /** Set every register to the same permutation basis eigenstate. */
+    void SetPermutation(bitCapInt perm);
+
+    void SetQuantumState(bitCapIntOcl batch, complex const* inputState);
+    void GetQuantumState(bitCapIntOcl batch, complex* outputState);
+    void GetProbs(bitCapIntOcl batch, real1* outputProbs);
+    complex GetAmplitude(bitCapIntOcl batch, bitCapInt perm);
+    void SetAmplitude(bitCapIntOcl batch, bitCapInt perm, complex amp);
+
+    /** Apply the same single-qubit matrix, on "target," to every register. */
+    void Mtrx(complex const* mtrx, bitLenInt target) { ApplyControlled2x2({}, 0U, mtrx, 0U, target); }
+    /** Apply a (4 * batch count)-long array of single-qubit matrices, on "target," one per register. */
+    void MtrxBatch(complex const* mtrxs, bitLenInt target) { ApplyControlled2x2({}, 0U, mtrxs, 1U, target); }
+    void MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target);
+    void MCMtrxBatch(const std::vector<bitLenInt>& controls, complex const* mtrxs, bitLenInt target);
+    void MACMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+    {
+        ApplyControlled2x2(controls, 0U, mtrx, 0U, target);
+    }
+
+    void H(bitLenInt target);
+    void X(bitLenInt target);
+    void CNOT(bitLenInt control, bitLenInt target);
+    void CZ(bitLenInt control, bitLenInt target);
+    /** Z-axis rotation by a different angle for each register, ("angles" has one entry per register). */
+    void RZBatch(real1_f const* angles, bitLenInt target);
+    /** Y-axis rotation by a different angle for each register, ("angles" has one entry per register). */
+    void RYBatch(real1_f const* angles, bitLenInt target);
+
+    /** Probability of "qubit" being |1> in register "batch." */
+    real1_f Prob(bitCapIntOcl batch, bitLenInt qubit);
+
+    /**
+     * Sample "shots" measurements of the qubits with powers "qPowers," in every register, without collapsing any state.
+     * "shotsArray" has (batch count * shots) entries, with register "b" in [b * shots, (b + 1) * shots), and each
+     * result is a permutation over the qPowers ordering, as in QInterface::MultiShotMeasureMask().
+     */
+    void MultiShotMeasureMask(const std::vector<bitCapInt>& qPowers, unsigned shots, unsigned long long* shotsArray);
+};
+} // namespace Qrack
@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "common/qrack_types.hpp"
+
+#if !ENABLE_OPENCL
+#error OpenCL has not been enabled
+#endif
+
+#include "common/oclengine.hpp"
+#include "qbatch.hpp"
+
+namespace Qrack {
+
+class QBatchOCL;
+typedef std::shared_ptr<QBatchOCL> QBatchOCLPtr;
+
+/**
+ * A "Qrack::QBatchOCL" is a QBatch that keeps its strided state vector buffer resident on an OpenCL device, so every
+ * gate, (with one matrix for all registers, or one per register,) is a single kernel launch over the whole batch.
+ *
+ * Readout, (amplitudes, probabilities, and shot sampling,) runs on the inherited host state vector: the first read
+ * after a gate pulls the device buffer back to the host, and the next gate after a host write pushes it back up.
+ */
+class QBatchOCL : public QBatch {
+protected:
+    typedef std::shared_ptr<cl::Buffer> BufferPtr;
+
+    int64_t devID;
+    DeviceContextPtr device_context;
+    // Our own in-order queue, on the shared OCLEngine device context
+    cl::CommandQueue queue;
+    BufferPtr stateBuffer;
+    // The device state vector has changes that the host state vector does not
+    bool isHostStale;
+    // The host state vector has changes that the device state vector does not
+    bool isDeviceStale;
+
+    size_t StateBytes() { return sizeof(complex) * batchCount * maxQPowerOcl; }
+
+    /** Push the host state vector to the device, if the device copy is out of date. */
+    void SyncToDevice();
+    /** Pull the device state vector to the host, if the host copy is out of date. */
+    void SyncToHost();
+    void InvalidateDevice()
+    {
+        isHostStale = false;
+        isDeviceStale = true;
+    }
+
+    void ApplyControlled2x2(const std::vector<bitLenInt>& controls, bitCapIntOcl controlPerm, complex const* mtrxs,
+        bitCapIntOcl mtrxStride, bitLenInt target);
+
+public:
+    QBatchOCL(bitLenInt qBitCount, bitCapIntOcl batches, bitCapInt initState = 0U, qrack_rand_gen_ptr rgp = nullptr,
+        bool useHardwareRNG = true, int64_t deviceId = -1);
+
+    int64_t GetDevice() { return devID; }
+};
+} // namespace Qrack
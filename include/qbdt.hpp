@@ -19,6 +19,9 @@
 #include "qbdt_qengine_node.hpp"
 #include "qengine.hpp"
 
+#include <map>
+#include <unordered_map>
+
 #define NODE_TO_QENGINE(leaf) (std::dynamic_pointer_cast<QBdtQEngineNode>(leaf)->qReg)
 #define QINTERFACE_TO_QALU(qReg) std::dynamic_pointer_cast<QAlu>(qReg)
 #define QINTERFACE_TO_QPARITY(qReg) std::dynamic_pointer_cast<QParity>(qReg)
@@ -37,12 +40,17 @@ protected:
     bitLenInt attachedQubitCount;
     bitLenInt bdtQubitCount;
     bitLenInt maxPageQubits;
-    bitLenInt bdtStride;
+    bitCapIntOcl bdtStride;
     int64_t devID;
     QBdtNodeInterfacePtr root;
     bitCapInt bdtMaxQPower;
     std::vector<int64_t> deviceIDs;
     std::vector<QInterfaceEngine> engines;
+    real1_f truncationThreshold;
+    real1_f mergeEpsilon;
+    real1_f unitaryFidelity;
+    real1_f attachSaturation;
+    bitLenInt maxAttachedQubits;
 
     void SetQubitCount(bitLenInt qb, bitLenInt aqb)
     {
@@ -96,9 +104,82 @@ protected:
         return toRet;
     }
 
-    void par_for_qbdt(const bitCapInt& end, bitLenInt maxQubit, BdtFunc fn);
+    /**
+     * DD "compute tables," for one gate or query: the result for each distinct subtree already visited, by depth, so
+     * shared subtrees are transformed, (or summed,) only once.
+     */
+    typedef std::vector<std::unordered_map<QBdtNodeInterface*, QBdtNodeInterfacePtr>> QBdtComputeTable;
+    typedef std::vector<std::unordered_map<QBdtNodeInterface*, real1>> QBdtProbTable;
+    typedef std::vector<std::map<std::pair<QBdtNodeInterface*, QBdtNodeInterface*>, complex>> QBdtInnerTable;
+
     void _par_for(const bitCapInt& end, ParallelFuncBdt fn);
 
+    /**
+     * Copy-on-write "n" down to "maxQubit" depth, following only the branches that satisfy "controlPerms," (-1 for
+     * no control at a depth,) and collect the distinct nodes at "maxQubit" in "targets."
+     */
+    QBdtNodeInterfacePtr CopyToTargets(const QBdtNodeInterfacePtr& n, bitLenInt depth, bitLenInt maxQubit,
+        const std::vector<int8_t>& controlPerms, QBdtComputeTable& memo, std::vector<QBdtNodeInterfacePtr>& targets);
+    void ApplyUnderControls(complex const* mtrx, const std::vector<int8_t>& controlPerms, bitLenInt target,
+        const std::vector<bitLenInt>& ketControls, bool isAnti);
+    real1 ProbUnder(
+        const QBdtNodeInterfacePtr& n, bitLenInt depth, bitLenInt maxQubit, bitLenInt qubit, QBdtProbTable& memo);
+
+    /**
+     * Prune the tree to "depth" after a gate, then apply the approximation options, if any, and charge their cost to
+     * the unitary fidelity.
+     */
+    void PruneRoot(bitLenInt depth);
+    /** Copy-on-write "n," with subtrees that agree to within the merge epsilon combined */
+    QBdtNodeInterfacePtr MergeUnder(
+        const QBdtNodeInterfacePtr& n, bitLenInt depth, QBdtUniqueTable& table, QBdtComputeTable& memo);
+    /** Copy-on-write "n," with every branch that carries less than the truncation threshold of probability zeroed */
+    QBdtNodeInterfacePtr TruncateUnder(
+        const QBdtNodeInterfacePtr& n, bitLenInt depth, const QBdtProbTable& mass, QBdtComputeTable& memo);
+    real1 NormUnder(const QBdtNodeInterfacePtr& n, bitLenInt depth, QBdtProbTable& memo);
+    /**
+     * Copy-on-write "n," with the branches of every node above "maxDepth" normalized, and the norm they carried
+     * moved into the node's own scale
+     */
+    QBdtNodeInterfacePtr RenormalizeUnder(
+        const QBdtNodeInterfacePtr& n, bitLenInt depth, bitLenInt maxDepth, QBdtComputeTable& memo);
+    /** Inner product of the (unnormalized) states under "a" and "b" */
+    complex InnerUnder(
+        const QBdtNodeInterfacePtr& a, const QBdtNodeInterfacePtr& b, bitLenInt depth, QBdtInnerTable& memo);
+
+    /** The distinct subtrees under a new attachment boundary, each bound for one shared QEngine leaf */
+    struct QBdtAttachTable {
+        std::map<std::pair<QBdtNodeInterface*, QBdtNodeInterface*>, size_t> index;
+        std::vector<QBdtNodeInterfacePtr> subtrees;
+        std::vector<std::vector<QBdtQEngineNodePtr>> leaves;
+    };
+
+    /**
+     * Copy-on-write "n" down to the "boundary" depth, replacing every node there with a QEngine leaf placeholder,
+     * registered in "table" by the subtree it stands for.
+     */
+    QBdtNodeInterfacePtr AttachUnder(const QBdtNodeInterfacePtr& n, bitLenInt depth, bitLenInt boundary,
+        QBdtComputeTable& memo, QBdtAttachTable& table);
+    /** Write the amplitudes under "n," (from "depth" down, relative to "boundary,") into "amps" */
+    void FillUnder(const QBdtNodeInterfacePtr& n, bitLenInt depth, bitLenInt boundary, complex scale,
+        bitCapIntOcl offset, complex* amps);
+    /**
+     * Copy-on-write "n," expanding every QEngine leaf into a subtree of "length" tree levels over QEngine leaves of
+     * "aqb" qubits, (or over terminal nodes, for 0,) once per distinct leaf engine
+     */
+    QBdtNodeInterfacePtr DetachUnder(const QBdtNodeInterfacePtr& n, bitLenInt depth, bitLenInt length, bitLenInt aqb,
+        QBdtComputeTable& memo, std::map<QEngine*, QBdtNodeInterfacePtr>& subtrees);
+    /** Build an unnormalized subtree over the amplitudes in "amps," (See DetachUnder().) */
+    QBdtNodeInterfacePtr MakeSubtree(
+        complex const* amps, bitLenInt depth, bitLenInt length, bitLenInt aqb, bitCapIntOcl offset);
+    /**
+     * The attached qubit count the hybrid leaf policy prefers for the current tree: the longest suffix of tree levels
+     * whose distinct node count reaches the saturation fraction of the amplitudes that dense leaves would hold
+     */
+    bitLenInt SaturatedQubitCount();
+    /** Apply the hybrid leaf policy, first returning every attached qubit to the tree, if "isReset" */
+    void BalanceAttachedQubits(bool isReset);
+
     void DecomposeDispose(bitLenInt start, bitLenInt length, QBdtPtr dest);
 
     void ApplyControlledSingle(
@@ -152,7 +233,41 @@ public:
 
     bool isBinaryDecisionTree() { return true; };
 
+    /**
+     * Trade exactness for a smaller tree: after every gate, zero any branch that carries less than "truncThresh" of
+     * the total probability, and merge subtrees whose scales agree to within about "mergeEps." (Both default to 0,
+     * which is exact simulation.) The fidelity this costs accumulates in GetUnitaryFidelity().
+     */
+    void SetApproximation(real1_f truncThresh, real1_f mergeEps = ZERO_R1_F)
+    {
+        truncationThreshold = truncThresh;
+        mergeEpsilon = mergeEps;
+    }
+    /**
+     * Fidelity to the exact state, since the last SetPermutation() or ResetUnitaryFidelity(): the product of the
+     * fidelities of every approximation step, each measured against the exact state it replaced.
+     */
+    real1_f GetUnitaryFidelity() { return unitaryFidelity; }
+    void ResetUnitaryFidelity() { unitaryFidelity = ONE_R1_F; }
+
+    /**
+     * Let the boundary between tree qubits and dense "attached" QEngine leaf qubits follow the entanglement of the
+     * state: after a gate, the deepest tree levels move into state vector leaves once their distinct node count reaches
+     * "saturation" times the amplitude count of the leaves that would replace them, (up to "maxLeafQb" leaf qubits, or
+     * without limit, for 0,) and measurement returns leaf qubits to the tree, to choose the boundary again. Identical
+     * subtrees share one leaf engine. A saturation of 0, (the default,) disables the policy.
+     */
+    void SetHybridLeaves(real1_f saturation, bitLenInt maxLeafQb = 0U)
+    {
+        attachSaturation = saturation;
+        maxAttachedQubits = maxLeafQb;
+    }
+    /** Count of the deepest qubits that are currently held in QEngine leaves */
+    bitLenInt GetAttachedQubitCount() { return attachedQubitCount; }
+
     void SetStateVector();
+    /** Move the deepest qubits into QEngine leaves, or out of them, until exactly "aqb" qubits are attached. */
+    void AttachStateVector(bitLenInt aqb);
     void ResetStateVector(bitLenInt aqb = 0U);
 
     void SetDevice(int64_t dID);
@@ -174,6 +289,8 @@ public:
     void SetPermutation(bitCapInt initState, complex phaseFac = CMPLX_DEFAULT_ARG);
 
     QInterfacePtr Clone();
+    void SaveCheckpoint(CheckpointWriter& writer);
+    void LoadCheckpoint(CheckpointReader& reader);
 
     void GetQuantumState(complex* state);
     void GetQuantumState(QInterfacePtr eng);
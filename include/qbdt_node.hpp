@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "qbdt_node_arena.hpp"
 #include "qbdt_node_interface.hpp"
 
 namespace Qrack {
@@ -57,7 +58,13 @@ public:
         // Virtual destructor for inheritance
     }
 
-    virtual QBdtNodeInterfacePtr ShallowClone() { return std::make_shared<QBdtNode>(scale, branches); }
+    /** Allocate a node from the QBdtNodeArena (in place of std::make_shared<QBdtNode>()) */
+    template <typename... Ts> static QBdtNodePtr Make(Ts&&... args)
+    {
+        return std::allocate_shared<QBdtNode>(QBdtNodeAllocator<QBdtNode>(), std::forward<Ts>(args)...);
+    }
+
+    virtual QBdtNodeInterfacePtr ShallowClone() { return Make(scale, branches); }
 
     virtual void InsertAtDepth(QBdtNodeInterfacePtr b, bitLenInt depth, const bitLenInt& size, bitLenInt parDepth = 1U);
 
@@ -67,6 +74,8 @@ public:
 
     virtual void Prune(bitLenInt depth = 1U, bitLenInt parDepth = 1U);
 
+    virtual void PruneUnique(bitLenInt depth, QBdtUniqueTable& table, bitLenInt parDepth = 1U);
+
     virtual void Normalize(bitLenInt depth = 1U);
 
 #if ENABLE_COMPLEX_X2
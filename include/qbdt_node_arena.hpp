@@ -0,0 +1,54 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// QBinaryDecision tree is an alternative approach to quantum state representation, as
+// opposed to state vector representation. This is a compressed form that can be
+// operated directly on while compressed. Inspiration for the Qrack implementation was
+// taken from JKQ DDSIM, maintained by the Institute for Integrated Circuits at the
+// Johannes Kepler University Linz:
+//
+// https://github.com/iic-jku/ddsim
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include <cstddef>
+
+namespace Qrack {
+
+/**
+ * Fixed-size slot allocation for QBdt nodes, (and their co-allocated reference counts,) carved out of large chunks.
+ *
+ * Every thread keeps a small cache of free slots, and refills or spills it in batches against a shared free list, so
+ * the common case takes no lock. Chunks are retained for the life of the process and recycled for new nodes.
+ */
+class QBdtNodeArena {
+public:
+    static void* Allocate(size_t size);
+    static void Deallocate(void* p, size_t size);
+};
+
+/** A std::allocator-compatible front end to QBdtNodeArena, for std::allocate_shared() */
+template <typename T> struct QBdtNodeAllocator {
+    typedef T value_type;
+
+    QBdtNodeAllocator() {}
+    template <typename U> QBdtNodeAllocator(const QBdtNodeAllocator<U>&) {}
+
+    T* allocate(size_t n) { return (T*)QBdtNodeArena::Allocate(n * sizeof(T)); }
+    void deallocate(T* p, size_t n) { QBdtNodeArena::Deallocate(p, n * sizeof(T)); }
+};
+
+template <typename T, typename U> bool operator==(const QBdtNodeAllocator<T>&, const QBdtNodeAllocator<U>&)
+{
+    return true;
+}
+template <typename T, typename U> bool operator!=(const QBdtNodeAllocator<T>&, const QBdtNodeAllocator<U>&)
+{
+    return false;
+}
+} // namespace Qrack
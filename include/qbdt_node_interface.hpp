@@ -32,11 +32,19 @@ namespace Qrack {
 
 class QBdtNodeInterface;
 typedef std::shared_ptr<QBdtNodeInterface> QBdtNodeInterfacePtr;
+class QBdtUniqueTable;
 
 class QBdtNodeInterface {
 protected:
     static size_t SelectBit(bitCapInt perm, bitLenInt bit) { return (size_t)((perm >> bit) & 1U); }
     static void _par_for_qbdt(const bitCapInt end, BdtFunc fn);
+    /**
+     * Whether a traversal should fork its two branches, with "depth" levels left under them and "parDepth" forks
+     * already above them.
+     */
+    static bool IsParallelFork(bitLenInt depth, bitLenInt parDepth);
+    /** Run fn0() and fn1() as a fork/join pair on the shared ParallelPool, with the calling thread taking part. */
+    static void _par_pair(std::function<void()> fn0, std::function<void()> fn1);
 
 public:
 #if ENABLE_COMPLEX_X2
@@ -139,6 +147,12 @@ public:
                                 "QRACK_QBDT_SEPARABILITY_THRESHOLD too high.)");
     }
 
+    /** Prune(), as one step of a larger pass that shares "table" (See QBdtUniqueTable.) */
+    virtual void PruneUnique(bitLenInt depth, QBdtUniqueTable& table, bitLenInt parDepth = 1U)
+    {
+        Prune(depth, parDepth);
+    }
+
     virtual void Normalize(bitLenInt depth = 1U)
     {
         throw std::out_of_range("QBdtNodeInterface::Normalize() not implemented! (You probably set "
@@ -0,0 +1,90 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// QBinaryDecision tree is an alternative approach to quantum state representation, as
+// opposed to state vector representation. This is a compressed form that can be
+// operated directly on while compressed. Inspiration for the Qrack implementation was
+// taken from JKQ DDSIM, maintained by the Institute for Integrated Circuits at the
+// Johannes Kepler University Linz:
+//
+// https://github.com/iic-jku/ddsim
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qbdt_node_interface.hpp"
+
+#include <unordered_map>
+
+namespace Qrack {
+
+/**
+ * A decision diagram "unique table," for one QBdtNode::Prune() pass.
+ *
+ * Pruning proceeds bottom-up, and every node is entered here once its children are canonical, keyed by its depth,
+ * its scale, and the identity of its two branches. Structurally equal subtrees therefore resolve to the same
+ * canonical node, by one hash lookup per node, instead of by pairwise comparison. Lookups are sharded, for the
+ * parallel recursion.
+ *
+ * With a nonzero "merge epsilon," scales are keyed on a grid of that spacing, so subtrees that agree to within about
+ * epsilon are combined, (approximately,) and scales that round to 0 become 0 branches.
+ */
+class QBdtUniqueTable {
+protected:
+    struct Key {
+        complex scale;
+        QBdtNodeInterface* b0;
+        QBdtNodeInterface* b1;
+        bitLenInt depth;
+
+        bool operator==(const Key& r) const
+        {
+            return (scale == r.scale) && (b0 == r.b0) && (b1 == r.b1) && (depth == r.depth);
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& k) const;
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<Key, QBdtNodeInterfacePtr, KeyHash> nodes;
+    };
+
+    real1_f mergeEpsilon;
+    std::unique_ptr<Shard[]> shards;
+
+    Key MakeKey(QBdtNodeInterface* n, bitLenInt depth)
+    {
+        Key k;
+        k.scale = (mergeEpsilon > ZERO_R1_F)
+            ? complex((real1)(std::round(real(n->scale) / mergeEpsilon) * mergeEpsilon),
+                  (real1)(std::round(imag(n->scale) / mergeEpsilon) * mergeEpsilon))
+            : n->scale;
+        k.b0 = n->branches[0U].get();
+        k.b1 = n->branches[1U].get();
+        k.depth = depth;
+
+        return k;
+    }
+
+    Shard& GetShard(const Key& k);
+
+public:
+    QBdtUniqueTable(real1_f mergeEps = ZERO_R1_F);
+
+    /**
+     * Return the canonical node equal to "n," (with its children already canonical,) at tree "depth," entering "n"
+     * itself if it is the first of its kind. Hybrid QEngine leaves pass through unchanged.
+     */
+    QBdtNodeInterfacePtr Emplace(const QBdtNodeInterfacePtr& n, bitLenInt depth);
+
+    /** Is "n" the canonical node for its contents, (and therefore already pruned in this pass)? */
+    bool IsCanonical(QBdtNodeInterface* n, bitLenInt depth);
+};
+} // namespace Qrack
@@ -0,0 +1,142 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qinterface.hpp"
+
+#include <list>
+#include <map>
+
+namespace Qrack {
+
+class QCircuit;
+typedef std::shared_ptr<QCircuit> QCircuitPtr;
+
+struct QCircuitGate;
+typedef std::shared_ptr<QCircuitGate> QCircuitGatePtr;
+
+/** The QInterface call that replays a QCircuitGate, chosen once, when the gate's payloads last changed */
+enum QCircuitDispatch {
+    QCIRCUIT_MTRX = 0,
+    QCIRCUIT_PHASE = 1,
+    QCIRCUIT_INVERT = 2,
+    QCIRCUIT_ANTI_MTRX = 3,
+    QCIRCUIT_ANTI_PHASE = 4,
+    QCIRCUIT_ANTI_INVERT = 5,
+    QCIRCUIT_UNIFORM = 6
+};
+
+/**
+ * One (uniformly) controlled single bit gate of a QCircuit
+ *
+ * Each payload is the 2x2 matrix applied to "target" for one permutation of "controls," with bit "i" of the key the
+ * value of "controls[i];" any permutation without a payload is the identity. A parameterized gate is a Pauli rotation,
+ * e^(-i * params[param] / 2 * axis), with one (empty) payload, for its control permutation, until its circuit is bound.
+ */
+struct QCircuitGate {
+    bitLenInt target;
+    // Sorted low to high
+    std::vector<bitLenInt> controls;
+    std::map<bitCapIntOcl, std::vector<complex>> payloads;
+    // PauliI for a fixed gate
+    Pauli axis;
+    size_t param;
+    QCircuitDispatch dispatch;
+    // The full table of 2^controls.size() matrices, padded with identities, for QCIRCUIT_UNIFORM
+    std::vector<complex> uniformMtrxs;
+
+    QCircuitGate(bitLenInt trgt, const complex* mtrx, const std::vector<bitLenInt>& ctrls = std::vector<bitLenInt>(),
+        bitCapIntOcl perm = 0U);
+    QCircuitGate(Pauli ax, size_t prm, bitLenInt trgt, const std::vector<bitLenInt>& ctrls = std::vector<bitLenInt>(),
+        bitCapIntOcl perm = 0U);
+
+    bool IsParameterized() const { return axis != PauliI; }
+    /** True if every payload is exactly the identity, (so the gate can be removed) */
+    bool IsIdentity() const;
+    /** True if the gate is diagonal in the Z basis of its target */
+    bool IsDiagonal() const;
+    /** True if "other" applies to the same target with the same controls, so the two can become one gate */
+    bool CanFuse(const QCircuitGate& other) const;
+    /** Replace this gate with its product with "other," applied after it */
+    void Fuse(const QCircuitGate& other);
+    /** True if this gate commutes with "other," because both act diagonally on every qubit they share */
+    bool CommutesWith(const QCircuitGate& other) const;
+    /** Choose "dispatch" for the current payloads */
+    void Classify();
+
+    /** The fixed gate this one becomes, with "params" bound */
+    QCircuitGatePtr Bind(const std::vector<real1_f>& params) const;
+    void Run(QInterfacePtr sim, const std::vector<real1_f>& params) const;
+};
+
+/**
+ * A "Qrack::QCircuit" records a circuit of (uniformly) controlled single bit gates, to optimize once and replay many
+ * times, against any QInterface.
+ *
+ * Each appended gate is moved back, past the gates it commutes with, to the nearest gate it can fuse with. Gates on the
+ * same target, with the same controls, multiply into one gate, and a product that is exactly the identity cancels
+ * away. Parameterized rotations commute, (as their axes allow,) but only fuse once Bind() fixes their parameters.
+ * Every gate's QInterface call is chosen when it's fused, so Run() dispatches with no further inspection.
+ */
+class QCircuit {
+protected:
+    bitLenInt qubitCount;
+    size_t paramCount;
+    std::list<QCircuitGatePtr> gates;
+
+public:
+    QCircuit()
+        : qubitCount(0U)
+        , paramCount(0U)
+        , gates()
+    {
+    }
+
+    /** The highest qubit index used by any gate, plus one */
+    bitLenInt GetQubitCount() const { return qubitCount; }
+    /** The highest parameter index used by any gate, plus one */
+    size_t GetParamCount() const { return paramCount; }
+    const std::list<QCircuitGatePtr>& GetGates() const { return gates; }
+
+    /** Append a gate, fusing and cancelling it with earlier gates where possible */
+    void AppendGate(QCircuitGatePtr gate);
+
+    void Mtrx(const complex* mtrx, bitLenInt target) { AppendGate(std::make_shared<QCircuitGate>(target, mtrx)); }
+    void MCMtrx(const std::vector<bitLenInt>& controls, const complex* mtrx, bitLenInt target)
+    {
+        AppendGate(std::make_shared<QCircuitGate>(target, mtrx, controls, pow2Ocl(controls.size()) - 1U));
+    }
+    void MACMtrx(const std::vector<bitLenInt>& controls, const complex* mtrx, bitLenInt target)
+    {
+        AppendGate(std::make_shared<QCircuitGate>(target, mtrx, controls, 0U));
+    }
+    void H(bitLenInt target);
+    void X(bitLenInt target);
+    void Z(bitLenInt target);
+    void CNOT(bitLenInt control, bitLenInt target);
+    void CZ(bitLenInt control, bitLenInt target);
+    void Swap(bitLenInt qubit1, bitLenInt qubit2);
+    /** Append e^(-i * params[param] / 2 * axis), controlled by all of "controls," if any */
+    void R(Pauli axis, size_t param, bitLenInt target, const std::vector<bitLenInt>& controls = std::vector<bitLenInt>())
+    {
+        AppendGate(
+            std::make_shared<QCircuitGate>(axis, param, target, controls, pow2Ocl(controls.size()) - 1U));
+    }
+
+    /** Get a copy of this circuit with "params" bound, (so that its parameterized gates can fuse, as well) */
+    QCircuitPtr Bind(const std::vector<real1_f>& params) const;
+
+    /** Apply the circuit to "sim," (binding "params" gate by gate, if the circuit has any parameterized gates) */
+    void Run(QInterfacePtr sim, const std::vector<real1_f>& params = std::vector<real1_f>()) const;
+};
+} // namespace Qrack
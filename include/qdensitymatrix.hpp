@@ -0,0 +1,191 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qengine.hpp"
+
+namespace Qrack {
+
+class QDensityMatrix;
+typedef std::shared_ptr<QDensityMatrix> QDensityMatrixPtr;
+
+/**
+ * A "Qrack::QDensityMatrix" holds the exact (mixed) state of "n" qubits as a density matrix, "rho," vectorized into the
+ * state vector of a 2n qubit QEngine, of the configured "engines" stack. The row index of rho is held in qubits 0 to
+ * n - 1, and the column index in qubits n to 2n - 1, so rho_ij is the amplitude of permutation (i | (j << n)).
+ *
+ * A gate "U" on rho is U rho U^+, which is "U" on the row qubits and "U*" on the column qubits, so every gate is a pair
+ * of ordinary gates of the underlying engine. A noise channel is one dense (non-unitary) superoperator, sum_k K_k (x)
+ * K_k*, on each row and column qubit pair, so KrausChannel1Qb() applies the whole channel, deterministically, instead
+ * of sampling one trajectory of it. Probabilities come from the diagonal of rho, (not from squared amplitudes,) and
+ * measurement projects both the row and the column qubit.
+ *
+ * Memory is O(4^n), so this is meant for small noisy registers, (up to about 14 qubits). State vector queries, like
+ * GetQuantumState() and GetAmplitude(), are only defined while rho is pure, and throw std::domain_error otherwise.
+ */
+class QDensityMatrix : public QInterface {
+protected:
+    bool useHostRam;
+    bool isSparse;
+    bitLenInt thresholdQubits;
+    real1_f separabilityThreshold;
+    int64_t devID;
+    // The vectorized density matrix, on 2 * qubitCount qubits
+    QEnginePtr engine;
+    std::vector<int64_t> deviceIDs;
+    std::vector<QInterfaceEngine> engines;
+
+    QEnginePtr MakeEngine(bitLenInt qubits, bitCapInt perm = 0U);
+
+    /// 2^n, the dimension of rho
+    bitCapIntOcl Dim() { return pow2Ocl(qubitCount); }
+    /// Index of the underlying engine that holds rho_ij
+    bitCapIntOcl RowCol(bitCapIntOcl row, bitCapIntOcl col) { return row | (col << (bitCapIntOcl)qubitCount); }
+    /// Real part of the diagonal element rho_ii, (the probability of permutation "i")
+    real1 Diagonal(bitCapIntOcl i) { return real(engine->GetAmplitude(RowCol(i, i))); }
+    /// Trace of rho
+    real1_f Trace();
+    /// The reduced density matrix of one qubit, (2x2, row-major,) with every other qubit traced out
+    void ReducedDensityMatrix1Qb(bitLenInt qubit, complex* rho2);
+    /// Apply a 4x4 superoperator, (row-major,) to the row and column qubit pair of "qubit"
+    void SuperOp1Qb(complex const* sop, bitLenInt qubit)
+    {
+        engine->MtrxN(sop, std::vector<bitLenInt>{ qubit, (bitLenInt)(qubit + qubitCount) });
+    }
+    /// Multiply rho by a real scalar, (as to restore unit trace)
+    void Scale(real1_f s)
+    {
+        const bitCapInt allPerms = 0U;
+        engine->ApplyM(allPerms, allPerms, complex((real1)s, ZERO_R1));
+    }
+    /**
+     * If rho is pure, load its column "k" with the largest diagonal element into "column," (of length 2^n,) along with
+     * rho_kk in "pivot" and the trace of rho in "trace," and return "k." Otherwise, throw std::domain_error.
+     */
+    bitCapIntOcl PureColumn(complex* column, real1_f& pivot, real1_f& trace);
+    /// "q" itself, if it's a QDensityMatrix of the same "engines," or otherwise, a new one with the same (pure) state
+    QDensityMatrixPtr MakePeer(QInterfacePtr q);
+
+public:
+    QDensityMatrix(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState = 0U,
+        qrack_rand_gen_ptr rgp = nullptr, complex phaseFac = CMPLX_DEFAULT_ARG, bool doNorm = false,
+        bool randomGlobalPhase = true, bool useHostMem = false, int64_t deviceId = -1, bool useHardwareRNG = true,
+        bool useSparseStateVec = false, real1_f norm_thresh = REAL1_EPSILON, std::vector<int64_t> devList = {},
+        bitLenInt qubitThreshold = 0U, real1_f separation_thresh = FP_NORM_EPSILON_F);
+
+    QDensityMatrix(bitLenInt qBitCount, bitCapInt initState = 0U, qrack_rand_gen_ptr rgp = nullptr,
+        complex phaseFac = CMPLX_DEFAULT_ARG, bool doNorm = false, bool randomGlobalPhase = true,
+        bool useHostMem = false, int64_t deviceId = -1, bool useHardwareRNG = true, bool useSparseStateVec = false,
+        real1_f norm_thresh = REAL1_EPSILON, std::vector<int64_t> devList = {}, bitLenInt qubitThreshold = 0U,
+        real1_f separation_thresh = FP_NORM_EPSILON_F)
+        : QDensityMatrix({ QINTERFACE_OPTIMAL_BASE }, qBitCount, initState, rgp, phaseFac, doNorm, randomGlobalPhase,
+              useHostMem, deviceId, useHardwareRNG, useSparseStateVec, norm_thresh, devList, qubitThreshold,
+              separation_thresh)
+    {
+    }
+
+    /// Copy out rho, as a row-major 2^n x 2^n matrix
+    void GetDensityMatrix(complex* outputRho);
+    /// Set rho from a row-major 2^n x 2^n matrix, (which should be Hermitian and positive, with unit trace)
+    void SetDensityMatrix(complex const* inputRho);
+    /// Tr(rho^2), which is 1 for a pure state and 1/2^n for the maximally mixed state
+    real1_f Purity();
+
+    void SetConcurrency(uint32_t threadCount)
+    {
+        QInterface::SetConcurrency(threadCount);
+        engine->SetConcurrency(threadCount);
+    }
+
+    void SetPermutation(bitCapInt perm, complex phaseFac = CMPLX_DEFAULT_ARG)
+    {
+        engine->SetPermutation(perm | (perm << qubitCount));
+    }
+
+    /// Set rho to the pure state |psi><psi|
+    void SetQuantumState(complex const* inputState);
+    /// Get the state vector of a pure rho, (with its largest amplitude real and positive)
+    void GetQuantumState(complex* outputState);
+    void GetProbs(real1* outputProbs);
+    /// Get one amplitude of a pure rho, (with the same phase convention as GetQuantumState())
+    complex GetAmplitude(bitCapInt perm);
+    /// Set one amplitude of a pure rho, (by way of its state vector)
+    void SetAmplitude(bitCapInt perm, complex amp);
+
+    using QInterface::Compose;
+    bitLenInt Compose(QInterfacePtr toCopy, bitLenInt start);
+    /// Trace out the qubits of "dest" into "dest," (which is exact only if they're in a product state with the rest)
+    void Decompose(bitLenInt start, QInterfacePtr dest);
+    QInterfacePtr Decompose(bitLenInt start, bitLenInt length);
+    /// Trace out the qubits from "start" to "start + length"
+    void Dispose(bitLenInt start, bitLenInt length);
+    void Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm);
+    using QInterface::Allocate;
+    bitLenInt Allocate(bitLenInt start, bitLenInt length);
+
+    void Mtrx(complex const* mtrx, bitLenInt target);
+    void MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target);
+    void MACMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target);
+    using QInterface::Swap;
+    void Swap(bitLenInt qubit1, bitLenInt qubit2)
+    {
+        engine->Swap(qubit1, qubit2);
+        engine->Swap(qubit1 + qubitCount, qubit2 + qubitCount);
+    }
+    void FSim(real1_f theta, real1_f phi, bitLenInt qubit1, bitLenInt qubit2)
+    {
+        // FSim(theta, phi)* is FSim(-theta, -phi).
+        engine->FSim(theta, phi, qubit1, qubit2);
+        engine->FSim(-theta, -phi, qubit1 + qubitCount, qubit2 + qubitCount);
+    }
+
+    bool ForceM(bitLenInt qubit, bool result, bool doForce = true, bool doApply = true);
+    real1_f Prob(bitLenInt qubit);
+    real1_f ProbAll(bitCapInt fullRegister) { return clampProb((real1_f)Diagonal((bitCapIntOcl)fullRegister)); }
+    real1_f ProbMask(bitCapInt mask, bitCapInt permutation);
+    real1_f ProbReg(bitLenInt start, bitLenInt length, bitCapInt permutation)
+    {
+        const bitCapInt mask = (pow2(length) - 1U) << start;
+        return ProbMask(mask, permutation << start);
+    }
+
+    /// Tr(K rho K^+) for each Kraus operator, (from the reduced density matrix of "qubit")
+    void KrausProbs1Qb(const std::vector<complex>& kraus, bitLenInt qubit, real1_f* probs);
+    /// K rho K^+ / Tr(K rho K^+), as for a trajectory that took the branch of "kraus"
+    void ApplyKraus1Qb(complex const* kraus, bitLenInt qubit);
+    /**
+     * Apply the whole channel, sum_k K_k rho K_k^+, exactly and without randomness, as one superoperator. Since no
+     * single operator is chosen, this always returns 0.
+     */
+    size_t KrausChannel1Qb(const std::vector<complex>& kraus, bitLenInt qubit);
+
+    /// One half of the squared Frobenius distance between density matrices, (which is 1 - |<a|b>|^2 for pure states)
+    real1_f SumSqrDiff(QInterfacePtr toCompare);
+    void UpdateRunningNorm(real1_f norm_thresh = REAL1_DEFAULT_ARG) {}
+    /// Restore unit trace, (dividing by "nrm," if it's given, or else by the trace)
+    void NormalizeState(
+        real1_f nrm = REAL1_DEFAULT_ARG, real1_f norm_thresh = REAL1_DEFAULT_ARG, real1_f phaseArg = ZERO_R1_F);
+
+    void Finish() { engine->Finish(); }
+    bool isFinished() { return engine->isFinished(); }
+    void Dump() { engine->Dump(); }
+
+    QInterfacePtr Clone();
+    void SetDevice(int64_t dID)
+    {
+        devID = dID;
+        engine->SetDevice(dID);
+    }
+    int64_t GetDevice() { return devID; }
+};
+} // namespace Qrack
@@ -0,0 +1,96 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qcircuit.hpp"
+
+#include <map>
+#include <mutex>
+
+namespace Qrack {
+
+class QDynamicCircuit;
+typedef std::shared_ptr<QDynamicCircuit> QDynamicCircuitPtr;
+
+/** One step of a QDynamicCircuit: a (classically conditioned) QCircuit block, or a measurement into a classical bit */
+struct QDynamicOp {
+    // NULL for a measurement
+    QCircuitPtr circuit;
+    // The block runs only if the classical bits of "conditionMask" equal those of "conditionValue."
+    bitCapInt conditionMask;
+    bitCapInt conditionValue;
+    bitLenInt qubit;
+    bitLenInt cbit;
+
+    bool IsMeasurement() const { return !circuit; }
+};
+
+/**
+ * A "Qrack::QDynamicCircuit" is a circuit with mid-circuit measurement and feed-forward: unitary QCircuit blocks,
+ * measurements of qubits into classical bits, and blocks that only run for given values of earlier classical bits.
+ *
+ * RunShots() doesn't run the circuit once per shot. Every shot starts in one branch, and at each measurement, the shots
+ * of a branch are split between the two outcomes, binomially, by the probability of |1>. The larger group continues in
+ * place, and the other continues on a (copy-on-write) Clone(), so N shots cost one execution per distinct sequence of
+ * measurement outcomes, rather than N. Split branches run in parallel. Measurements after the last gate, (the terminal
+ * readout,) don't branch at all: each branch samples them for its share of the shots, as by MultiShotMeasureMask().
+ */
+class QDynamicCircuit {
+protected:
+    bitLenInt qubitCount;
+    bitLenInt cbitCount;
+    std::vector<QDynamicOp> ops;
+    qrack_rand_gen_ptr rand_generator;
+    size_t branchCount;
+
+    struct ShotContext {
+        std::vector<real1_f> params;
+        // The first op of the terminal readout
+        size_t tailStart;
+        // The distinct qubits of the terminal readout, and for each of its ops, the index of its qubit among them
+        std::vector<bitCapInt> tailPowers;
+        std::vector<size_t> tailIndices;
+        std::map<bitCapInt, int> results;
+        std::mutex resultsMutex;
+        size_t branches;
+        uint64_t seed;
+    };
+
+    void RunBranch(ShotContext& ctx, QInterfacePtr sim, size_t op, bitCapInt cbits, unsigned shots, uint64_t stream);
+    void SampleTail(ShotContext& ctx, QInterfacePtr sim, bitCapInt cbits, unsigned shots);
+
+public:
+    QDynamicCircuit(qrack_rand_gen_ptr rgp = nullptr);
+
+    /** The highest qubit index used by any op, plus one */
+    bitLenInt GetQubitCount() const { return qubitCount; }
+    /** The highest classical bit index used by any op, plus one */
+    bitLenInt GetClassicalBitCount() const { return cbitCount; }
+    const std::vector<QDynamicOp>& GetOps() const { return ops; }
+
+    /** Append a unitary block, which runs only if the classical bits of "mask" equal those of "value" */
+    void AppendCircuit(QCircuitPtr circuit, bitCapInt mask = 0U, bitCapInt value = 0U);
+    /** Append a measurement of "qubit" in the Z basis, with the result written to classical bit "cbit" */
+    void M(bitLenInt qubit, bitLenInt cbit);
+
+    /**
+     * Sample "shots" runs of the circuit, from the initial state "sim," which isn't changed. The returned histogram
+     * maps the final value of the classical bits, (with bit "i" holding classical bit "i,") to its number of shots.
+     */
+    std::map<bitCapInt, int> RunShots(
+        QInterfacePtr sim, unsigned shots, const std::vector<real1_f>& params = std::vector<real1_f>());
+
+    /** The number of distinct branches the last RunShots() simulated, (at most one per distinct outcome history) */
+    size_t GetBranchCount() const { return branchCount; }
+};
+} // namespace Qrack
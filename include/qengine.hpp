@@ -67,6 +67,29 @@ protected:
 
     void EitherMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target, bool isAnti);
 
+    /// A 2x2 operator that has been buffered by FuseApply2x2(), but not yet applied to the state vector
+    struct Fused2x2 {
+        bitCapIntOcl offset1;
+        bitCapIntOcl offset2;
+        std::vector<bitCapIntOcl> qPowersSorted;
+        complex mtrx[4U];
+        bool doCalcNorm;
+        real1_f norm_thresh;
+    };
+    std::unique_ptr<Fused2x2> fused2x2;
+
+    /** Throw if Apply2x2() arguments fall outside the register, or repeat a qubit */
+    void ValidateApply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, bitLenInt bitCount,
+        bitCapIntOcl const* qPowersSorted);
+    /**
+     * Buffer a 2x2 operator, multiplying it into the pending fused operator if both act on the same amplitude pairs.
+     * Returns false, without buffering, if a different operator is already pending, (which must be flushed first).
+     */
+    bool FuseApply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* mtrx, bitLenInt bitCount,
+        bitCapIntOcl const* qPowersSorted, bool doCalcNorm, real1_f norm_thresh);
+    /** Discard the pending fused 2x2 operator, without applying it */
+    void DumpFused2x2() { fused2x2 = NULL; }
+
 public:
     QEngine(bitLenInt qBitCount, qrack_rand_gen_ptr rgp = nullptr, bool doNorm = false, bool randomGlobalPhase = true,
         bool useHostMem = false, bool useHardwareRNG = true, real1_f norm_thresh = REAL1_EPSILON)
@@ -116,18 +139,29 @@ public:
     virtual bool IsZeroAmplitude() = 0;
     /** Copy a "page" of amplitudes from this QEngine's internal state, into `pagePtr`. */
     virtual void GetAmplitudePage(complex* pagePtr, bitCapIntOcl offset, bitCapIntOcl length) = 0;
+    /** Stream amplitudes by GetAmplitudePage(), fetching each chunk while "fn" handles the last */
+    virtual void ForEachAmplitudeChunk(
+        bitCapInt offset, bitCapInt length, AmplitudeChunkFn fn, bitCapIntOcl chunkLength = 0U);
     /** Copy a "page" of amplitudes from `pagePtr` into this QEngine's internal state. */
     virtual void SetAmplitudePage(complex const* pagePtr, bitCapIntOcl offset, bitCapIntOcl length) = 0;
     /** Copy a "page" of amplitudes from another QEngine, pointed to by `pageEnginePtr`, into this QEngine's internal
      * state. */
     virtual void SetAmplitudePage(
         QEnginePtr pageEnginePtr, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length) = 0;
+    /**
+     * Set the amplitude of each of "count" (distinct) permutations "perms[i]" to "amps[i]," leaving all others as they
+     * are. (This is for writing a sparse set of amplitudes in bulk, as when converting from a stabilizer state.)
+     */
+    virtual void ScatterAmplitudes(bitCapIntOcl const* perms, complex const* amps, bitCapIntOcl count);
     /** Swap the high half of this engine with the low half of another. This is necessary for gates which cross
      * sub-engine  boundaries. */
     virtual void ShuffleBuffers(QEnginePtr engine) = 0;
     /** Clone this QEngine's settings, with a zeroed state vector */
     virtual QEnginePtr CloneEmpty() = 0;
 
+    virtual void SaveCheckpoint(CheckpointWriter& writer);
+    virtual void LoadCheckpoint(CheckpointReader& reader);
+
     /** Add an operation to the (OpenCL) queue, to set the value of `doNormalize`, which controls whether to
      * automatically normalize the state. */
     virtual void QueueSetDoNormalize(bool doNorm) = 0;
@@ -158,6 +192,13 @@ public:
     {
         EitherMtrx(controls, mtrx, target, true);
     }
+    /**
+     * Apply an arbitrary dense 2^k x 2^k operator to the (ordered) "targets," in a single pass over the state vector
+     *
+     * "mtrx" is row-major, and bit "i" of its row and column indices corresponds to "targets[i]." Up to
+     * QRACK_MAX_MTRXN_QB targets are supported.
+     */
+    virtual void MtrxN(complex const* mtrx, const std::vector<bitLenInt>& targets) = 0;
     virtual void CSwap(const std::vector<bitLenInt>& controls, bitLenInt qubit1, bitLenInt qubit2);
     virtual void AntiCSwap(const std::vector<bitLenInt>& controls, bitLenInt qubit1, bitLenInt qubit2);
     virtual void CSqrtSwap(const std::vector<bitLenInt>& controls, bitLenInt qubit1, bitLenInt qubit2);
@@ -222,6 +263,11 @@ public:
 
     using QInterface::Swap;
     virtual void Swap(bitLenInt qubit1, bitLenInt qubit2);
+    /**
+     * Relabel every qubit at once, moving the qubit at index "i" to index "dest[i]," ("dest" being a permutation of
+     * all qubit indices). This defaults to one SWAP per displaced qubit, but an engine can do it in a single pass.
+     */
+    virtual void PermuteQubits(const std::vector<bitLenInt>& dest);
     using QInterface::ISwap;
     virtual void ISwap(bitLenInt qubit1, bitLenInt qubit2);
     using QInterface::IISwap;
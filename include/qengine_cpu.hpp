@@ -35,15 +35,81 @@ void rotate(BidirectionalIterator first, BidirectionalIterator middle, Bidirecti
 class QEngineCPU : public QEngine {
 protected:
     bool isSparse;
+    bool isInPlaceArithmetic;
     bitLenInt maxQubits;
+    int64_t maxAllocBytes;
+    int numaNode;
+    std::string mappedDir;
+    bool isCompressEvicted;
+    StateVecStorage storage;
     StateVectorPtr stateVec;
+    /// Cached Z basis marginals, (the probability of |1>,) by qubit, where negative means stale
+    std::vector<real1> probCache;
+    /// Prob() misses since the state last changed, (after the first, one pass fills every marginal)
+    bitLenInt probCacheMisses;
+    /// The amplitude floor "runningNorm" was last summed with, or negative, if the state has changed since
+    real1_f runningNormThresh;
+    /// Diagonal gates buffered by FuseDiagonal(), not yet applied, as one phase factor per permutation of "qPowers"
+    struct FusedDiagonal {
+        bitCapIntOcl mask;
+        std::vector<bitCapIntOcl> qPowers;
+        std::vector<complex> phases;
+    };
+    std::unique_ptr<FusedDiagonal> fusedDiagonal;
+    /// The most qubits a buffered diagonal can span, (its table holds 2^n phase factors,) where 0 disables buffering
+    bitLenInt maxDiagonalQubits;
 #if ENABLE_QUNIT_CPU_PARALLEL && ENABLE_PTHREAD
     DispatchQueue dispatchQueue;
     bitLenInt dispatchThreshold;
+    /// Whether gates at or above the parallel stride also queue, (as set for the units of a QUnit,) or else run inline
+    bool isDispatchWide;
 #endif
 
     StateVectorSparsePtr CastStateVecSparse() { return std::dynamic_pointer_cast<StateVectorSparse>(stateVec); }
 
+    /**
+     * Mark the cached marginals of the qubits in "mask" stale, (all of them, by default,) along with the cached norm.
+     * A unitary gate only moves probability between the basis states it pairs, so a controlled gate only dirties its
+     * target, and a diagonal gate passes a "mask" of 0, (which still drops the norm, since rounding can move it).
+     */
+    void DirtyProbCache(bitCapIntOcl mask = (bitCapIntOcl)-1)
+    {
+        runningNormThresh = -ONE_R1_F;
+        if (probCache.size() != qubitCount) {
+            probCache.assign(qubitCount, -ONE_R1);
+            probCacheMisses = 0U;
+            return;
+        }
+        if (!mask) {
+            return;
+        }
+        for (bitLenInt i = 0U; i < qubitCount; ++i) {
+            if ((mask >> i) & 1U) {
+                probCache[i] = -ONE_R1;
+            }
+        }
+        probCacheMisses = 0U;
+    }
+    /** After inverting the qubits in "mask," (X gates,) their cached marginals are just complemented */
+    void FlipProbCache(bitCapIntOcl mask)
+    {
+        runningNormThresh = -ONE_R1_F;
+        if (probCache.size() != qubitCount) {
+            DirtyProbCache();
+            return;
+        }
+        for (bitLenInt i = 0U; i < qubitCount; ++i) {
+            if (((mask >> i) & 1U) && (probCache[i] >= ZERO_R1)) {
+                probCache[i] = ONE_R1 - probCache[i];
+            }
+        }
+    }
+    /** Fill the stale entries of "probCache" for "qubits," in a single pass over the state vector */
+    void FillProbCache(const std::vector<bitLenInt>& qubits);
+    /** Dirty just the cached probabilities that Apply2x2() with these arguments can change */
+    void DirtyProbCache2x2(
+        bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* mtrx, bitLenInt bitCount, bool isRescaled);
+
 public:
     QEngineCPU(bitLenInt qBitCount, bitCapInt initState, qrack_rand_gen_ptr rgp = nullptr,
         complex phaseFac = CMPLX_DEFAULT_ARG, bool doNorm = false, bool randomGlobalPhase = true, bool ignored = false,
@@ -55,6 +121,8 @@ public:
 
     void Finish()
     {
+        FlushFused2x2();
+        FlushFusedDiagonal();
 #if ENABLE_QUNIT_CPU_PARALLEL && ENABLE_PTHREAD
         dispatchQueue.finish();
 #endif
@@ -63,14 +131,16 @@ public:
     bool isFinished()
     {
 #if ENABLE_QUNIT_CPU_PARALLEL && ENABLE_PTHREAD
-        return dispatchQueue.isFinished();
+        return !fused2x2 && !fusedDiagonal && dispatchQueue.isFinished();
 #else
-        return true;
+        return !fused2x2 && !fusedDiagonal;
 #endif
     }
 
     void Dump()
     {
+        DumpFused2x2();
+        fusedDiagonal = NULL;
 #if ENABLE_QUNIT_CPU_PARALLEL && ENABLE_PTHREAD
         dispatchQueue.dump();
 #endif
@@ -78,6 +148,49 @@ public:
 
     void SetDevice(int64_t dID) {}
 
+#if ENABLE_QUNIT_CPU_PARALLEL && ENABLE_PTHREAD
+    void SetDispatchWide(bool isWide) { isDispatchWide = isWide; }
+#endif
+
+    /**
+     * Bind future state vector allocations to one NUMA node, (as QPager does per page,) or pass -1 to spread them
+     * across the node bands of the shared ParallelPool. This has no effect unless built with ENABLE_NUMA.
+     */
+    void SetNumaNode(int node) { numaNode = node; }
+
+    /**
+     * Back future dense state vector allocations with memory-mapped files in this directory, (as QPager does for
+     * out-of-core pages,) or pass an empty string for RAM. This has no effect where memory maps are unsupported.
+     */
+    void SetMappedDir(const std::string& dir) { mappedDir = dir; }
+    /**
+     * Store dense amplitudes at native precision, or as fp16 or bf16 pairs, (halving memory and bandwidth, while gates
+     * still compute at real1 precision,) or in blocks of real parts and imaginary parts, (for shuffle-free vector
+     * kernels,) converting the current state. QRACK_STATE_VEC_STORAGE sets the default.
+     */
+    void SetStateVecStorage(StateVecStorage s);
+    StateVecStorage GetStateVecStorage() { return storage; }
+    /**
+     * Apply permutation arithmetic, (ROL, INC, MUL, DIV, ModNOut, IndexedLDA, and the like,) in place by following
+     * cycles, rather than by scattering into a second state vector, trading speed for half the peak memory. This is
+     * automatic if the second state vector would exceed QRACK_MAX_ALLOC_MB, or can't be allocated.
+     * QRACK_INPLACE_ARITHMETIC=1 sets the default.
+     */
+    void SetInPlaceArithmetic(bool inPlace) { isInPlaceArithmetic = inPlace; }
+    bool GetInPlaceArithmetic() { return isInPlaceArithmetic; }
+    /**
+     * Let EvictStateVec() losslessly compress a dense state vector in RAM, (as QPager does for cold pages, with
+     * QRACK_QPAGER_COMPRESS,) which is inflated again on its next access.
+     */
+    void SetCompressEvicted(bool compress) { isCompressEvicted = compress; }
+    /**
+     * If the state vector is memory-mapped, flush it to its file and let the operating system reclaim its RAM, or if
+     * SetCompressEvicted() is on, compress it in RAM.
+     */
+    void EvictStateVec();
+    /** Start reading a memory-mapped state vector back into RAM ahead of use, or inflate a compressed one. */
+    void PrefetchStateVec();
+
     real1_f FirstNonzeroPhase()
     {
         if (!stateVec) {
@@ -94,13 +207,18 @@ public:
         runningNorm = ZERO_R1;
     }
 
-    void FreeStateVec(complex* sv = NULL) { stateVec = NULL; }
+    void FreeStateVec(complex* sv = NULL)
+    {
+        stateVec = NULL;
+        DirtyProbCache();
+    }
 
     bool IsZeroAmplitude() { return !stateVec; }
     void GetAmplitudePage(complex* pagePtr, bitCapIntOcl offset, bitCapIntOcl length);
     void SetAmplitudePage(complex const* pagePtr, bitCapIntOcl offset, bitCapIntOcl length);
     void SetAmplitudePage(
         QEnginePtr pageEnginePtr, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length);
+    void ScatterAmplitudes(bitCapIntOcl const* perms, complex const* amps, bitCapIntOcl count);
     void ShuffleBuffers(QEnginePtr engine);
     void CopyStateVec(QEnginePtr src);
 
@@ -112,12 +230,22 @@ public:
     }
     void QueueSetRunningNorm(real1_f runningNrm)
     {
+        runningNormThresh = -ONE_R1_F;
         Dispatch(1U, [this, runningNrm] { runningNorm = runningNrm; });
     }
 
     void SetQuantumState(complex const* inputState);
     void GetQuantumState(complex* outputState);
     void GetProbs(real1* outputProbs);
+    complex const* MapStateVector()
+    {
+        // (This also inflates a compressed state vector.)
+        PrefetchStateVec();
+        Finish();
+        // (Sparse, reduced precision, blocked, and all 0 state vectors have no amplitude array.)
+        StateVectorArray* sv = dynamic_cast<StateVectorArray*>(stateVec.get());
+        return sv ? sv->amplitudes.get() : NULL;
+    }
     complex GetAmplitude(bitCapInt perm);
     void SetAmplitude(bitCapInt perm, complex amp);
 
@@ -133,6 +261,7 @@ public:
 
     using QEngine::Decompose;
     void Decompose(bitLenInt start, QInterfacePtr dest);
+    bool TryDecompose(bitLenInt start, QInterfacePtr dest, real1_f error_tol = TRYDECOMPOSE_EPSILON);
 
     void Dispose(bitLenInt start, bitLenInt length);
     void Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm);
@@ -144,6 +273,10 @@ public:
 
     void XMask(bitCapInt mask);
     void PhaseParity(real1_f radians, bitCapInt mask);
+    void PhaseFlipIfLookup(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+        const unsigned char* values, bitCapInt target);
+    void GroverLookupIteration(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+        const unsigned char* values, bitCapInt target);
 
     /**
      * \defgroup ArithGate Arithmetic and other opcode-like gate implemenations.
@@ -152,6 +285,7 @@ public:
      */
 
     void ROL(bitLenInt shift, bitLenInt start, bitLenInt length);
+    void PermuteQubits(const std::vector<bitLenInt>& dest);
 #if ENABLE_ALU
     void INC(bitCapInt toAdd, bitLenInt start, bitLenInt length);
     void CINC(bitCapInt toAdd, bitLenInt inOutStart, bitLenInt length, const std::vector<bitLenInt>& controls);
@@ -199,9 +333,16 @@ public:
     using QEngine::UniformlyControlledSingleBit;
     void UniformlyControlledSingleBit(const std::vector<bitLenInt>& controls, bitLenInt qubitIndex,
         complex const* mtrxs, const std::vector<bitCapInt>& mtrxSkipPowers, bitCapInt mtrxSkipValueMask);
+    void MtrxN(complex const* mtrx, const std::vector<bitLenInt>& targets);
     void UniformParityRZ(bitCapInt mask, real1_f angle);
     void CUniformParityRZ(const std::vector<bitLenInt>& controls, bitCapInt mask, real1_f angle);
 
+    /** The (inverse) quantum Fourier transform, as one in-place radix-2 FFT, instead of O(length^2) gates */
+    void QFT(bitLenInt start, bitLenInt length, bool trySeparate = false);
+    void QFTR(const std::vector<bitLenInt>& qubits, bool trySeparate = false);
+    void IQFT(bitLenInt start, bitLenInt length, bool trySeparate = false);
+    void IQFTR(const std::vector<bitLenInt>& qubits, bool trySeparate = false);
+
     /** @} */
 
     /**
@@ -214,6 +355,7 @@ public:
     real1_f CtrlOrAntiProb(bool controlState, bitLenInt control, bitLenInt target);
     real1_f ProbReg(bitLenInt start, bitLenInt length, bitCapInt permutation);
     real1_f ProbMask(bitCapInt mask, bitCapInt permutation);
+    void ProbBits(const std::vector<bitLenInt>& bits, real1* probsArray);
     real1_f ProbParity(bitCapInt mask);
     bool ForceMParity(bitCapInt mask, bool result, bool doForce = true);
     void NormalizeState(
@@ -227,13 +369,53 @@ public:
 protected:
     real1_f GetExpectation(bitLenInt valueStart, bitLenInt valueLength);
 
+    /** SetAmplitudePage() from an engine of another type, (such as a QEngineOCL page,) through its own interface */
+    void SetAmplitudePageFromDevice(
+        QEnginePtr pageEnginePtr, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length);
+    /** ShuffleBuffers() with an engine of another type, like SetAmplitudePageFromDevice() */
+    void ShuffleBuffersWithDevice(QEnginePtr engine);
+
     StateVectorPtr AllocStateVec(bitCapIntOcl elemCount);
-    void ResetStateVec(StateVectorPtr sv) { stateVec = sv; }
+    void ResetStateVec(StateVectorPtr sv)
+    {
+        stateVec = sv;
+        DirtyProbCache();
+    }
+    /**
+     * Clone() shares its state vector, until either engine writes to it. Call this ahead of any write in place, to
+     * give this engine its own copy, (or only its own allocation, if "doCopy" is false, for a complete overwrite).
+     * This also marks every cached probability stale, unless "doDirty" is false, (for gates that have already called
+     * DirtyProbCache() or FlipProbCache() for just what they change).
+     */
+    void EnsureUniqueStateVec(bool doCopy = true, bool doDirty = true)
+    {
+        if (doDirty) {
+            DirtyProbCache();
+        }
+
+        if (!stateVec || (stateVec.use_count() < 2)) {
+            return;
+        }
+
+        Finish();
+        StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
+        if (doCopy) {
+            nStateVec->copy(stateVec);
+        }
+        // (The contents are the same, so the cache stays valid.)
+        stateVec = nStateVec;
+    }
 
     void Dispatch(bitCapInt workItemCount, DispatchFn fn)
     {
+        // Any operation that reaches the state vector must not commute past a pending fused gate.
+        FlushFused2x2();
+        FlushFusedDiagonal();
 #if ENABLE_QUNIT_CPU_PARALLEL && ENABLE_PTHREAD
-        if ((workItemCount >= pow2Ocl(dispatchThreshold)) && (workItemCount < GetStride())) {
+        // Every engine's queue runs in order, on the shared worker pool, so gates on the separate engines of a QUnit
+        // overlap with each other and with the caller, until something reads or joins the state and calls Finish().
+        // A standalone engine has nothing to overlap with, so its wide gates run inline, on the pool, as before.
+        if ((workItemCount >= pow2Ocl(dispatchThreshold)) && (isDispatchWide || (workItemCount < GetStride()))) {
             dispatchQueue.dispatch(fn);
         } else {
             Finish();
@@ -246,8 +428,64 @@ protected:
 
     void DecomposeDispose(bitLenInt start, bitLenInt length, QEngineCPUPtr dest);
     void Apply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* mtrx, bitLenInt bitCount,
+        const bitCapIntOcl* qPowersSorted, bool doCalcNorm, real1_f norm_thresh = REAL1_DEFAULT_ARG)
+    {
+        if (!stateVec) {
+            return;
+        }
+
+        if (!doCalcNorm && IsPhase(mtrx) &&
+            FuseDiagonal2x2(offset1, offset2, mtrx, bitCount, qPowersSorted, norm_thresh)) {
+            return;
+        }
+
+        FlushFusedDiagonal();
+        if (!FuseApply2x2(offset1, offset2, mtrx, bitCount, qPowersSorted, doCalcNorm, norm_thresh)) {
+            FlushFused2x2();
+            FuseApply2x2(offset1, offset2, mtrx, bitCount, qPowersSorted, doCalcNorm, norm_thresh);
+        }
+    }
+    void Apply2x2Unfused(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* mtrx, bitLenInt bitCount,
         const bitCapIntOcl* qPowersSorted, bool doCalcNorm, real1_f norm_thresh = REAL1_DEFAULT_ARG);
+    void FlushFused2x2()
+    {
+        if (!fused2x2) {
+            return;
+        }
+
+        // Release the buffer before applying it, so that the dispatch below does not flush it again.
+        std::unique_ptr<Fused2x2> toApply = std::move(fused2x2);
+        Apply2x2Unfused(toApply->offset1, toApply->offset2, toApply->mtrx, (bitLenInt)toApply->qPowersSorted.size(),
+            &(toApply->qPowersSorted[0U]), toApply->doCalcNorm, toApply->norm_thresh);
+    }
+    typedef std::function<complex(const bitCapIntOcl&)> DiagonalFn;
+    /**
+     * Buffer a diagonal gate on the qubits in "mask," where "phaseFn" gives the factor for each permutation of just
+     * those bits, by multiplying it into the pending table. A run of diagonal gates, (Z, S, T, RZ, CZ, CPhase,
+     * PhaseParity, UniformParityRZ,) then costs one pass over the state vector, instead of one per gate. This flushes
+     * the pending table first, if the union would span more than "maxDiagonalQubits," and returns false, without
+     * buffering, if "mask" alone does, (in which case the caller applies the gate directly).
+     */
+    bool FuseDiagonal(bitCapIntOcl mask, const DiagonalFn& phaseFn);
+    /** Buffer a unitary phase Apply2x2() as a diagonal, (or fuse it into a pending 2x2 on the same pairs,) if it can */
+    bool FuseDiagonal2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* mtrx, bitLenInt bitCount,
+        const bitCapIntOcl* qPowersSorted, real1_f norm_thresh);
+    /** Apply the pending diagonal table, if any, in one table-driven pass */
+    void FlushFusedDiagonal();
+    /** Runtime-dispatched AVX2/AVX-512 path for Apply2x2Unfused(), which returns false if it does not apply */
+    bool Apply2x2Simd(complex const* mtrx, const std::vector<bitCapIntOcl>& qPowersSorted, bitCapIntOcl offset1,
+        bitCapIntOcl offset2);
+    /**
+     * Apply2x2Unfused() through a kernel compiled for its skipped bit count, (up to 3 controls,) matrix shape, norm
+     * mode, and lowest skipped power, from a dispatch table, which returns false if none applies, (or else the norm
+     * sum in "nrmSqr," if "doCalcNorm")
+     */
+    bool Apply2x2Kernel(complex const* mtrx, const std::vector<bitCapIntOcl>& qPowersSorted, bitCapIntOcl offset1,
+        bitCapIntOcl offset2, bool doCalcNorm, real1 nrm, real1 norm_thresh, real1& nrmSqr);
     void UpdateRunningNorm(real1_f norm_thresh = REAL1_DEFAULT_ARG);
+    /** The second state vector of out-of-place permutation arithmetic, or nullptr to permute in place */
+    StateVectorPtr AllocPermutationStateVec();
+    void FourierTransform(const std::vector<bitLenInt>& qubits, bool isInverse);
     using QEngine::ApplyM;
     void ApplyM(bitCapInt mask, bitCapInt result, complex nrm);
 
@@ -262,9 +500,10 @@ protected:
 
     typedef std::function<bitCapIntOcl(const bitCapIntOcl&, const bitCapIntOcl&)> IOFn;
     void MULDIV(const IOFn& inFn, const IOFn& outFn, const bitCapInt& toMul, const bitLenInt& inOutStart,
-        const bitLenInt& carryStart, const bitLenInt& length);
+        const bitLenInt& carryStart, const bitLenInt& length, const bool& inverse = false);
     void CMULDIV(const IOFn& inFn, const IOFn& outFn, const bitCapInt& toMul, const bitLenInt& inOutStart,
-        const bitLenInt& carryStart, const bitLenInt& length, const std::vector<bitLenInt>& controls);
+        const bitLenInt& carryStart, const bitLenInt& length, const std::vector<bitLenInt>& controls,
+        const bool& inverse = false);
 
     typedef std::function<bitCapIntOcl(const bitCapIntOcl&)> MFn;
     void ModNOut(const MFn& kernelFn, const bitCapInt& modN, const bitLenInt& inStart, const bitLenInt& outStart,
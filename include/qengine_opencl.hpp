@@ -18,6 +18,7 @@
 #error OpenCL has not been enabled
 #endif
 
+#include "common/memory_governor.hpp"
 #include "common/oclengine.hpp"
 #include "qengine.hpp"
 
@@ -27,6 +28,12 @@
 #define BCI_ARG_LEN 10
 #define CMPLX_NORM_LEN 6
 #define REAL_ARG_LEN 2
+// Gate list batches flush at this many operations, (to stay well within minimum constant memory)
+#define QRACK_GATE_LIST_MAX_OPS 128U
+// (No device has anywhere near 2^20 amplitudes of local memory.)
+#define QRACK_GATE_LIST_MAX_QB 20U
+// At most this many classical lookup tables stay resident on the device, per engine
+#define QRACK_OCL_LOOKUP_TABLES 8U
 
 namespace Qrack {
 
@@ -188,6 +195,10 @@ protected:
     bool usingHostRam;
     bool unlockHostMem;
     cl_int callbackError;
+    // The autotuning candidate of the kernel in flight, (or -1,) and its kernel and qubit width
+    int tuneCandidate;
+    OCLAPI tuneApiCall;
+    bitLenInt tuneQubitCount;
     size_t nrmGroupCount;
     size_t nrmGroupSize;
     size_t totalOclAllocSize;
@@ -197,10 +208,13 @@ protected:
     std::shared_ptr<complex> stateVec;
     std::mutex queue_mutex;
     cl::CommandQueue queue;
+    cl::CommandQueue transferQueue;
     cl::Context context;
     // stateBuffer is allocated as a shared_ptr, because it's the only buffer that will be acted on outside of
     // QEngineOCL itself, specifically by QEngineOCLMulti.
     BufferPtr stateBuffer;
+    // Copy-on-write Clone() results share stateBuffer, (and stateVec,) and this count, which nothing else holds.
+    std::shared_ptr<cl::Buffer*> stateBufferOwners;
     BufferPtr nrmBuffer;
     BufferPtr powersBuffer;
     DeviceContextPtr device_context;
@@ -208,6 +222,20 @@ protected:
     std::list<QueueItem> wait_queue_items;
     std::vector<PoolItemPtr> poolItems;
     std::unique_ptr<real1, void (*)(real1*)> nrmArray;
+    // Single qubit gates waiting to be batched into one "gatelist" kernel, as (op code, qubit power or mask) pairs
+    std::vector<bitCapIntOcl> gateListOps;
+    std::vector<complex> gateListMtrxs;
+    bool gateListDoNorm;
+    real1 gateListLoadNrm;
+    real1_f gateListNormThresh;
+    bitLenInt gateListMaxQb;
+    // Device-resident classical lookup tables, (as for PhaseFlipIfLookup(),) most recently used first
+    struct LookupTable {
+        uint64_t checksum;
+        bitCapIntOcl size;
+        BufferPtr buffer;
+    };
+    std::list<LookupTable> lookupTables;
 
 #if defined(__APPLE__)
     real1* _aligned_nrm_array_alloc(bitCapIntOcl allocSize)
@@ -329,6 +357,7 @@ public:
     void SetAmplitudePage(complex const* pagePtr, bitCapIntOcl offset, bitCapIntOcl length);
     void SetAmplitudePage(
         QEnginePtr pageEnginePtr, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length);
+    void ScatterAmplitudes(bitCapIntOcl const* perms, complex const* amps, bitCapIntOcl count);
     void ShuffleBuffers(QEnginePtr engine);
     QEnginePtr CloneEmpty();
 
@@ -336,6 +365,10 @@ public:
     void QueueSetRunningNorm(real1_f runningNrm) { AddQueueItem(QueueItem(runningNrm)); }
     void AddQueueItem(const QueueItem& item)
     {
+        // Any kernel that reaches the state buffer must not commute past a pending fused gate or gate list.
+        FlushFused2x2();
+        FlushGateList();
+
         bool isBase;
         // For lock_guard:
         if (true) {
@@ -352,6 +385,9 @@ public:
     void QueueCall(OCLAPI api_call, size_t workItemCount, size_t localGroupSize, std::vector<BufferPtr> args,
         size_t localBuffSize = 0U, size_t deallocSize = 0U)
     {
+        if (stateBufferOwners) {
+            CopyOnWrite(api_call, args);
+        }
         AddQueueItem(QueueItem(api_call, workItemCount, localGroupSize, deallocSize, args, localBuffSize));
     }
 
@@ -362,9 +398,16 @@ public:
     using QEngine::UniformlyControlledSingleBit;
     void UniformlyControlledSingleBit(const std::vector<bitLenInt>& controls, bitLenInt qubitIndex,
         complex const* mtrxs, const std::vector<bitCapInt>& mtrxSkipPowers, bitCapInt mtrxSkipValueMask);
+    void MtrxN(complex const* mtrx, const std::vector<bitLenInt>& targets);
     void UniformParityRZ(bitCapInt mask, real1_f angle);
     void CUniformParityRZ(const std::vector<bitLenInt>& controls, bitCapInt mask, real1_f angle);
 
+    /** The (inverse) quantum Fourier transform, as one in-place radix-2 FFT, instead of O(length^2) gates */
+    void QFT(bitLenInt start, bitLenInt length, bool trySeparate = false);
+    void QFTR(const std::vector<bitLenInt>& qubits, bool trySeparate = false);
+    void IQFT(bitLenInt start, bitLenInt length, bool trySeparate = false);
+    void IQFTR(const std::vector<bitLenInt>& qubits, bool trySeparate = false);
+
     /* Operations that have an improved implementation. */
     using QEngine::X;
     void X(bitLenInt target);
@@ -376,10 +419,15 @@ public:
     void Phase(complex topLeft, complex bottomRight, bitLenInt qubitIndex);
     void XMask(bitCapInt mask);
     void PhaseParity(real1_f radians, bitCapInt mask);
+    void PhaseFlipIfLookup(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+        const unsigned char* values, bitCapInt target);
+    void GroverLookupIteration(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+        const unsigned char* values, bitCapInt target);
 
     using QEngine::Compose;
     bitLenInt Compose(QEngineOCLPtr toCopy);
     bitLenInt Compose(QInterfacePtr toCopy) { return Compose(std::dynamic_pointer_cast<QEngineOCL>(toCopy)); }
+    std::map<QInterfacePtr, bitLenInt> Compose(std::vector<QInterfacePtr> toCopy);
     bitLenInt Compose(QEngineOCLPtr toCopy, bitLenInt start);
     bitLenInt Compose(QInterfacePtr toCopy, bitLenInt start)
     {
@@ -437,9 +485,12 @@ public:
     void ProbRegAll(bitLenInt start, bitLenInt length, real1* probsArray);
     real1_f ProbMask(bitCapInt mask, bitCapInt permutation);
     void ProbMaskAll(bitCapInt mask, real1* probsArray);
+    using QEngine::MultiShotMeasureMask;
+    void MultiShotMeasureMask(const std::vector<bitCapInt>& qPowers, unsigned shots, unsigned long long* shotsArray);
     real1_f ProbParity(bitCapInt mask);
     bool ForceMParity(bitCapInt mask, bool result, bool doForce = true);
     real1_f ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCapInt offset = 0);
+    std::vector<real1_f> ExpectationPauliAll(const std::vector<PauliString>& terms);
 
     void SetDevice(int64_t dID);
     int64_t GetDevice() { return deviceID; }
@@ -447,6 +498,13 @@ public:
     void SetQuantumState(complex const* inputState);
     void GetQuantumState(complex* outputState);
     void GetProbs(real1* outputProbs);
+    /** With host memory, this maps the state buffer itself; otherwise, it reads the buffer back once. */
+    complex const* MapStateVector()
+    {
+        LockSync(CL_MAP_READ);
+        return stateVec.get();
+    }
+    void UnmapStateVector() { UnlockSync(); }
     complex GetAmplitude(bitCapInt perm);
     void SetAmplitude(bitCapInt perm, complex amp);
 
@@ -458,19 +516,28 @@ public:
     ;
     void UpdateRunningNorm(real1_f norm_thresh = REAL1_DEFAULT_ARG);
     void Finish() { clFinish(); };
-    bool isFinished() { return !wait_queue_items.size(); };
+    bool isFinished() { return !fused2x2 && gateListOps.empty() && !wait_queue_items.size(); };
 
     QInterfacePtr Clone();
 
     void PopQueue(bool isDispatch);
+    /** Record the device time of the completed kernel "event," if it was an autotuning candidate */
+    void RecordLaunch(cl_event event);
     void DispatchQueue();
 
 protected:
+    void FourierTransform(bitLenInt start, bitLenInt length, bool isInverse);
+
+    int64_t GovernorPool() { return (deviceID < 0) ? (int64_t)OCLEngine::Instance().GetDefaultDeviceID() : deviceID; }
     void AddAlloc(size_t size)
     {
+        if (!MemoryGovernor::Instance().TryReserve(GovernorPool(), size)) {
+            throw bad_alloc("Device memory budget exceeded in QEngineOCL::AddAlloc()");
+        }
         size_t currentAlloc = OCLEngine::Instance().AddToActiveAllocSize(deviceID, size);
         if (device_context && (currentAlloc > device_context->GetGlobalAllocLimit())) {
             OCLEngine::Instance().SubtractFromActiveAllocSize(deviceID, size);
+            MemoryGovernor::Instance().Release(GovernorPool(), size);
             throw bad_alloc("VRAM limits exceeded in QEngineOCL::AddAlloc()");
         }
         totalOclAllocSize += size;
@@ -478,6 +545,7 @@ protected:
     void SubtractAlloc(size_t size)
     {
         OCLEngine::Instance().SubtractFromActiveAllocSize(deviceID, size);
+        MemoryGovernor::Instance().Release(GovernorPool(), size);
         totalOclAllocSize -= size;
     }
 
@@ -501,8 +569,9 @@ protected:
             return toRet;
         }
 
-        // Hard finish (for the unique OpenCL device)
+        // Hard finish (for the unique OpenCL device), and free idle pooled buffers
         clFinish(true);
+        device_context->ClearBufferPool();
 
         toRet = std::make_shared<cl::Buffer>(context, flags, size, host_ptr, &error);
         if (error != CL_SUCCESS) {
@@ -528,12 +597,40 @@ protected:
     void ResetStateBuffer(BufferPtr nStateBuffer);
     BufferPtr MakeStateVecBuffer(std::shared_ptr<complex> nStateVec);
     void ReinitBuffer();
+    /**
+     * If a copy-on-write clone still shares the state buffer, give this engine its own, (copying the amplitudes,
+     * unless "doCopy" is false, for a complete overwrite).
+     */
+    void EnsureUniqueStateBuffer(bool doCopy = true);
+    /** Ahead of queueing "api_call," on "args," make the state buffer unique if the kernel writes to it in place. */
+    void CopyOnWrite(OCLAPI api_call, std::vector<BufferPtr>& args);
 
     void Compose(OCLAPI apiCall, const bitCapIntOcl* bciArgs, QEngineOCLPtr toCopy);
 
     void InitOCL(int64_t devID);
     PoolItemPtr GetFreePoolItem();
 
+    /** Queue the "probmaskall" kernel, leaving the mask outcome probabilities in "probsBuffer," on the device. */
+    void QueueProbMaskAll(bitCapIntOcl mask, BufferPtr probsBuffer);
+
+    /**
+     * Copy amplitudes from an engine in another OpenCL context, staged through double-buffered host memory on both
+     * devices' transfer queues, so reading one chunk overlaps writing the last.
+     */
+    void StagedCopyFrom(QEngineOCLPtr src, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length);
+    /** ShuffleBuffers() with an engine in another OpenCL context, staged like StagedCopyFrom(). */
+    void StagedShuffle(QEngineOCLPtr engine);
+    /** ShuffleBuffers() with an engine on another device of our context, by device-to-device buffer copies */
+    void PeerShuffle(QEngineOCLPtr engine);
+    /**
+     * SetAmplitudePage() from an engine of another type, (such as a QEngineCPU page,) through its own interface. With
+     * host RAM, the other engine writes straight into the mapped buffer.
+     */
+    void SetAmplitudePageFromHost(
+        QEnginePtr pageEnginePtr, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length);
+    /** ShuffleBuffers() with an engine of another type, like SetAmplitudePageFromHost() */
+    void ShuffleBuffersWithHost(QEnginePtr engine);
+
     real1_f ParSum(real1* toSum, bitCapIntOcl maxI);
 
     /**
@@ -598,11 +695,47 @@ protected:
     void Apply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* mtrx, bitLenInt bitCount,
         const bitCapIntOcl* qPowersSorted, bool doCalcNorm, real1_f norm_thresh = REAL1_DEFAULT_ARG)
     {
-        Apply2x2(offset1, offset2, mtrx, bitCount, qPowersSorted, doCalcNorm, SPECIAL_2X2::NONE, norm_thresh);
+        if (!stateBuffer) {
+            return;
+        }
+
+        if (!FuseApply2x2(offset1, offset2, mtrx, bitCount, qPowersSorted, doCalcNorm, norm_thresh)) {
+            FlushFused2x2();
+            FuseApply2x2(offset1, offset2, mtrx, bitCount, qPowersSorted, doCalcNorm, norm_thresh);
+        }
     }
     void Apply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* mtrx, bitLenInt bitCount,
         const bitCapIntOcl* qPowersSorted, bool doCalcNorm, SPECIAL_2X2 special,
         real1_f norm_thresh = REAL1_DEFAULT_ARG);
+    void FlushFused2x2()
+    {
+        if (!fused2x2) {
+            return;
+        }
+
+        // Release the buffer before applying it, so that the queue call below does not flush it again.
+        std::unique_ptr<Fused2x2> toApply = std::move(fused2x2);
+        Apply2x2(toApply->offset1, toApply->offset2, toApply->mtrx, (bitLenInt)toApply->qPowersSorted.size(),
+            &(toApply->qPowersSorted[0U]), toApply->doCalcNorm, SPECIAL_2X2::NONE, toApply->norm_thresh);
+    }
+
+    /**
+     * Batch a single qubit gate, (or an X mask,) instead of launching its own kernel, if it acts only on qubits below
+     * the local memory tile, (or the state vector fits in one tile,) scaling by "nrm" first. Returns false otherwise.
+     */
+    bool AppendGateList(bitCapIntOcl opCode, bitCapIntOcl mask, complex const* mtrx, bool doCalcNorm, real1 nrm,
+        real1_f norm_thresh);
+    /** Queue all batched gates as one "gatelist" kernel launch */
+    void FlushGateList();
+    /** Discard all batched gates, without applying them */
+    void DumpGateList()
+    {
+        gateListOps.clear();
+        gateListMtrxs.clear();
+        gateListDoNorm = false;
+        gateListLoadNrm = ONE_R1;
+        gateListNormThresh = ZERO_R1_F;
+    }
 
     void BitMask(bitCapIntOcl mask, OCLAPI api_call, real1_f phase = (real1_f)PI_R1);
 
@@ -660,6 +793,16 @@ protected:
 #endif
 
     void ClearBuffer(BufferPtr buff, bitCapIntOcl offset, bitCapIntOcl size);
+
+    /**
+     * Get a read-only device buffer holding the "size" bytes of "values." Tables are cached by content, so a table that
+     * is reused across calls, (like a Grover oracle over many iterations,) is only uploaded once.
+     */
+    BufferPtr GetLookupTableBuffer(const unsigned char* values, bitCapIntOcl size);
+    /** Free all cached lookup table buffers */
+    void ClearLookupTables();
+    /** Queue "api_call" on the state buffer, with "bciArgs" and the device copy of the lookup table "values" */
+    void LookupCall(OCLAPI api_call, const bitCapIntOcl* bciArgs, const unsigned char* values, bitCapIntOcl size);
 };
 
 } // namespace Qrack
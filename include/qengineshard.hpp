@@ -21,6 +21,9 @@
 
 #include "qinterface.hpp"
 
+#include <algorithm>
+#include <functional>
+
 #define IS_ARG_0(c) IS_SAME(c, ONE_CMPLX)
 #define IS_ARG_PI(c) IS_OPPOSITE(c, ONE_CMPLX)
 
@@ -44,7 +47,137 @@ struct PhaseShard {
 class QEngineShard;
 typedef QEngineShard* QEngineShardPtr;
 typedef std::shared_ptr<PhaseShard> PhaseShardPtr;
-typedef std::map<QEngineShardPtr, PhaseShardPtr> ShardToPhaseMap;
+
+/**
+ * Recycles PhaseShard blocks, (co-allocated with their reference counts, by std::allocate_shared()), through a small
+ * per-thread free list, since controlled gates create and retire buffers constantly.
+ */
+template <typename T> struct PhaseShardAllocator {
+    typedef T value_type;
+
+    PhaseShardAllocator() {}
+    template <typename U> PhaseShardAllocator(const PhaseShardAllocator<U>&) {}
+
+    struct FreeList {
+        std::vector<void*> blocks;
+        bool* isDead;
+
+        FreeList(bool* d)
+            : isDead(d)
+        {
+        }
+
+        ~FreeList()
+        {
+            for (size_t i = 0U; i < blocks.size(); ++i) {
+                ::operator delete(blocks[i]);
+            }
+            *isDead = true;
+        }
+    };
+
+    static FreeList* GetFreeList()
+    {
+        // (Trivially destructible, so it can still be read after the list is gone, in thread teardown.)
+        static thread_local bool isDead = false;
+        if (isDead) {
+            return NULL;
+        }
+        static thread_local FreeList freeList(&isDead);
+
+        return &freeList;
+    }
+
+    T* allocate(size_t n)
+    {
+        FreeList* fl = (n == 1U) ? GetFreeList() : NULL;
+        if (fl && fl->blocks.size()) {
+            T* p = (T*)fl->blocks.back();
+            fl->blocks.pop_back();
+            return p;
+        }
+
+        return (T*)::operator new(n * sizeof(T));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        FreeList* fl = (n == 1U) ? GetFreeList() : NULL;
+        if (fl && (fl->blocks.size() < 1024U)) {
+            fl->blocks.push_back(p);
+            return;
+        }
+
+        ::operator delete(p);
+    }
+};
+
+template <typename T, typename U> bool operator==(const PhaseShardAllocator<T>&, const PhaseShardAllocator<U>&)
+{
+    return true;
+}
+template <typename T, typename U> bool operator!=(const PhaseShardAllocator<T>&, const PhaseShardAllocator<U>&)
+{
+    return false;
+}
+
+/**
+ * Buffers between a shard and its partner shards, as a flat map, sorted by partner, (so in the same order as a
+ * std::map would iterate). A shard rarely has more than a few partners, so one contiguous vector is cheaper to
+ * search and to copy than a tree. Unlike a std::map, insertion and erasure invalidate iterators.
+ */
+class ShardToPhaseMap {
+public:
+    typedef std::pair<QEngineShardPtr, PhaseShardPtr> value_type;
+    typedef std::vector<value_type>::iterator iterator;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+
+protected:
+    std::vector<value_type> entries;
+
+    iterator LowerBound(QEngineShardPtr key)
+    {
+        return std::lower_bound(entries.begin(), entries.end(), key,
+            [](const value_type& e, QEngineShardPtr k) { return std::less<QEngineShardPtr>()(e.first, k); });
+    }
+
+public:
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    iterator find(QEngineShardPtr key)
+    {
+        const iterator it = LowerBound(key);
+        return ((it != entries.end()) && (it->first == key)) ? it : entries.end();
+    }
+
+    PhaseShardPtr& operator[](QEngineShardPtr key)
+    {
+        iterator it = LowerBound(key);
+        if ((it == entries.end()) || (it->first != key)) {
+            it = entries.insert(it, value_type(key, PhaseShardPtr()));
+        }
+
+        return it->second;
+    }
+
+    iterator erase(iterator it) { return entries.erase(it); }
+    size_t erase(QEngineShardPtr key)
+    {
+        const iterator it = find(key);
+        if (it == entries.end()) {
+            return 0U;
+        }
+        entries.erase(it);
+
+        return 1U;
+    }
+};
 
 /** Associates a QInterface object with a set of bits. */
 class QEngineShard {
@@ -62,6 +195,10 @@ public:
     complex amp0;
     complex amp1;
     Pauli pauliBasis;
+    // Pending single-qubit operator, (not yet applied to "unit,") which acts on the engine's qubit before everything
+    // else in this shard, including "pauliBasis"
+    complex frame[4U];
+    bool isFramed;
     // Shards which this shard controls
     ShardToPhaseMap controlsShards;
     // Shards which this shard (anti-)controls
@@ -89,6 +226,8 @@ public:
         , amp0(ONE_CMPLX)
         , amp1(ZERO_CMPLX)
         , pauliBasis(PauliZ)
+        , frame{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX }
+        , isFramed(false)
         , controlsShards()
         , antiControlsShards()
         , targetOfShards()
@@ -103,6 +242,8 @@ public:
         , isProbDirty(false)
         , isPhaseDirty(false)
         , pauliBasis(PauliZ)
+        , frame{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX }
+        , isFramed(false)
         , controlsShards()
         , antiControlsShards()
         , targetOfShards()
@@ -122,6 +263,8 @@ public:
         , amp0(ONE_CMPLX)
         , amp1(ZERO_CMPLX)
         , pauliBasis(PauliZ)
+        , frame{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX }
+        , isFramed(false)
         , controlsShards()
         , antiControlsShards()
         , targetOfShards()
@@ -139,6 +282,13 @@ public:
     bool ClampAmps();
     void DumpMultiBit();
 
+    /// Left-multiply "mtrx" into the pending local frame, (without touching the engine)
+    void ComposeFrame(complex const* mtrx);
+    /// Apply the pending local frame to the engine, and clear it
+    void FlushFrame();
+    /// A diagonal frame commutes with Z basis probabilities and with use as a control
+    bool IsFrameDiagonal() { return !isFramed || ((frame[1U] == ZERO_CMPLX) && (frame[2U] == ZERO_CMPLX)); }
+
 protected:
     void RemoveBuffer(QEngineShardPtr p, ShardToPhaseMap& localMap, GetBufferFn remoteMapGet);
 
@@ -299,11 +449,15 @@ public:
             return (real1_f)norm(amp1);
         }
 
+        if (!IsFrameDiagonal()) {
+            FlushFrame();
+        }
+
         return unit->Prob(mapped);
     }
     bool isClifford()
     {
-        return (unit && unit->isClifford(mapped)) ||
+        return (unit && !isFramed && unit->isClifford(mapped)) ||
             (!unit &&
                 ((norm(amp0) <= FP_NORM_EPSILON) || (norm(amp1) <= FP_NORM_EPSILON) ||
                     (norm(amp0 - amp1) <= FP_NORM_EPSILON) || (norm(amp0 + amp1) <= FP_NORM_EPSILON) ||
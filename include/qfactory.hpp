@@ -12,13 +12,18 @@
 
 #pragma once
 
+#include "qdensitymatrix.hpp"
 #include "qengine_cpu.hpp"
+#include "qmps.hpp"
 #include "qpager.hpp"
+#include "qprefixcache.hpp"
 #include "qstabilizerhybrid.hpp"
+#include "qtensornetwork.hpp"
 
 #if ENABLE_OPENCL
 #include "qengine_opencl.hpp"
 #include "qhybrid.hpp"
+#include "qstabilizer_opencl.hpp"
 #include "qunitmulti.hpp"
 #else
 #include "qunit.hpp"
@@ -28,8 +33,32 @@
 #include "qbdt.hpp"
 #endif
 
+#if ENABLE_MPI
+#include "qpager_mpi.hpp"
+#endif
+
 namespace Qrack {
 
+/**
+ * QINTERFACE_STABILIZER construction: an explicit (non-negative) OpenCL device ID selects the device-resident tableau
+ * of QStabilizerOCL, while the default device ID of -1 keeps the CPU QStabilizer.
+ */
+inline QInterfacePtr CreateStabilizer(bitLenInt n, bitCapInt perm = 0U, qrack_rand_gen_ptr rgp = nullptr,
+    complex phaseFac = CMPLX_DEFAULT_ARG, bool doNorm = false, bool randomGlobalPhase = true, bool useHostMem = false,
+    int64_t deviceId = -1, bool useHardwareRNG = true, bool useSparseStateVec = false,
+    real1_f norm_thresh = REAL1_EPSILON, std::vector<int64_t> devList = {}, bitLenInt qubitThreshold = 0U,
+    real1_f separation_thresh = FP_NORM_EPSILON_F)
+{
+#if ENABLE_OPENCL
+    if (deviceId >= 0) {
+        return std::make_shared<QStabilizerOCL>(n, perm, rgp, phaseFac, doNorm, randomGlobalPhase, useHostMem, deviceId,
+            useHardwareRNG, useSparseStateVec, norm_thresh, devList, qubitThreshold, separation_thresh);
+    }
+#endif
+    return std::make_shared<QStabilizer>(n, perm, rgp, phaseFac, doNorm, randomGlobalPhase, useHostMem, deviceId,
+        useHardwareRNG, useSparseStateVec, norm_thresh, devList, qubitThreshold, separation_thresh);
+}
+
 /** Factory method to create specific engine implementations. */
 template <typename... Ts>
 QInterfacePtr CreateQuantumInterface(
@@ -42,7 +71,7 @@ QInterfacePtr CreateQuantumInterface(
     case QINTERFACE_CPU:
         return std::make_shared<QEngineCPU>(args...);
     case QINTERFACE_STABILIZER:
-        return std::make_shared<QStabilizer>(args...);
+        return CreateStabilizer(args...);
 #if ENABLE_QBDT
     case QINTERFACE_BDT:
         return std::make_shared<QBdt>(engines, args...);
@@ -53,6 +82,18 @@ QInterfacePtr CreateQuantumInterface(
         return std::make_shared<QStabilizerHybrid>(engines, args...);
     case QINTERFACE_QUNIT:
         return std::make_shared<QUnit>(engines, args...);
+    case QINTERFACE_TENSOR_NETWORK:
+        return std::make_shared<QTensorNetwork>(engines, args...);
+    case QINTERFACE_MPS:
+        return std::make_shared<QMps>(engines, args...);
+    case QINTERFACE_DENSITY_MATRIX:
+        return std::make_shared<QDensityMatrix>(engines, args...);
+    case QINTERFACE_PREFIX_CACHE:
+        return std::make_shared<QPrefixCache>(engines, args...);
+#if ENABLE_MPI
+    case QINTERFACE_QPAGER_MPI:
+        return std::make_shared<QPagerMpi>(engines, args...);
+#endif
 #if ENABLE_OPENCL
     case QINTERFACE_OPENCL:
         return std::make_shared<QEngineOCL>(args...);
@@ -76,7 +117,7 @@ QInterfacePtr CreateQuantumInterface(QInterfaceEngine engine1, QInterfaceEngine
     case QINTERFACE_CPU:
         return std::make_shared<QEngineCPU>(args...);
     case QINTERFACE_STABILIZER:
-        return std::make_shared<QStabilizer>(args...);
+        return CreateStabilizer(args...);
 #if ENABLE_QBDT
     case QINTERFACE_BDT:
         return std::make_shared<QBdt>(engines, args...);
@@ -87,6 +128,18 @@ QInterfacePtr CreateQuantumInterface(QInterfaceEngine engine1, QInterfaceEngine
         return std::make_shared<QStabilizerHybrid>(engines, args...);
     case QINTERFACE_QUNIT:
         return std::make_shared<QUnit>(engines, args...);
+    case QINTERFACE_TENSOR_NETWORK:
+        return std::make_shared<QTensorNetwork>(engines, args...);
+    case QINTERFACE_MPS:
+        return std::make_shared<QMps>(engines, args...);
+    case QINTERFACE_DENSITY_MATRIX:
+        return std::make_shared<QDensityMatrix>(engines, args...);
+    case QINTERFACE_PREFIX_CACHE:
+        return std::make_shared<QPrefixCache>(engines, args...);
+#if ENABLE_MPI
+    case QINTERFACE_QPAGER_MPI:
+        return std::make_shared<QPagerMpi>(engines, args...);
+#endif
 #if ENABLE_OPENCL
     case QINTERFACE_OPENCL:
         return std::make_shared<QEngineOCL>(args...);
@@ -106,7 +159,7 @@ template <typename... Ts> QInterfacePtr CreateQuantumInterface(QInterfaceEngine
     case QINTERFACE_CPU:
         return std::make_shared<QEngineCPU>(args...);
     case QINTERFACE_STABILIZER:
-        return std::make_shared<QStabilizer>(args...);
+        return CreateStabilizer(args...);
 #if ENABLE_QBDT
     case QINTERFACE_BDT:
         return std::make_shared<QBdt>(args...);
@@ -117,6 +170,18 @@ template <typename... Ts> QInterfacePtr CreateQuantumInterface(QInterfaceEngine
         return std::make_shared<QStabilizerHybrid>(args...);
     case QINTERFACE_QUNIT:
         return std::make_shared<QUnit>(args...);
+    case QINTERFACE_TENSOR_NETWORK:
+        return std::make_shared<QTensorNetwork>(args...);
+    case QINTERFACE_MPS:
+        return std::make_shared<QMps>(args...);
+    case QINTERFACE_DENSITY_MATRIX:
+        return std::make_shared<QDensityMatrix>(args...);
+    case QINTERFACE_PREFIX_CACHE:
+        return std::make_shared<QPrefixCache>(args...);
+#if ENABLE_MPI
+    case QINTERFACE_QPAGER_MPI:
+        return std::make_shared<QPagerMpi>(args...);
+#endif
 #if ENABLE_OPENCL
     case QINTERFACE_OPENCL:
         return std::make_shared<QEngineOCL>(args...);
@@ -139,7 +204,7 @@ template <typename... Ts> QInterfacePtr CreateQuantumInterface(std::vector<QInte
     case QINTERFACE_CPU:
         return std::make_shared<QEngineCPU>(args...);
     case QINTERFACE_STABILIZER:
-        return std::make_shared<QStabilizer>(args...);
+        return CreateStabilizer(args...);
 #if ENABLE_QBDT
     case QINTERFACE_BDT:
         if (engines.size()) {
@@ -162,6 +227,33 @@ template <typename... Ts> QInterfacePtr CreateQuantumInterface(std::vector<QInte
             return std::make_shared<QUnit>(engines, args...);
         }
         return std::make_shared<QUnit>(args...);
+    case QINTERFACE_TENSOR_NETWORK:
+        if (engines.size()) {
+            return std::make_shared<QTensorNetwork>(engines, args...);
+        }
+        return std::make_shared<QTensorNetwork>(args...);
+    case QINTERFACE_MPS:
+        if (engines.size()) {
+            return std::make_shared<QMps>(engines, args...);
+        }
+        return std::make_shared<QMps>(args...);
+    case QINTERFACE_DENSITY_MATRIX:
+        if (engines.size()) {
+            return std::make_shared<QDensityMatrix>(engines, args...);
+        }
+        return std::make_shared<QDensityMatrix>(args...);
+    case QINTERFACE_PREFIX_CACHE:
+        if (engines.size()) {
+            return std::make_shared<QPrefixCache>(engines, args...);
+        }
+        return std::make_shared<QPrefixCache>(args...);
+#if ENABLE_MPI
+    case QINTERFACE_QPAGER_MPI:
+        if (engines.size()) {
+            return std::make_shared<QPagerMpi>(engines, args...);
+        }
+        return std::make_shared<QPagerMpi>(args...);
+#endif
 #if ENABLE_OPENCL
     case QINTERFACE_OPENCL:
         return std::make_shared<QEngineOCL>(args...);
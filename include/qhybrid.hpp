@@ -32,6 +32,7 @@ protected:
     bool isPager;
     bool useRDRAND;
     bool isSparse;
+    bool isDispatchWide;
     bitLenInt gpuThresholdQubits;
     bitLenInt pagerThresholdQubits;
     real1_f separabilityThreshold;
@@ -73,6 +74,12 @@ public:
         engine->SetConcurrency(GetConcurrencyLevel());
     }
 
+    void SetDispatchWide(bool isWide)
+    {
+        isDispatchWide = isWide;
+        engine->SetDispatchWide(isWide);
+    }
+
     /**
      * Switches between CPU and GPU modes. (This will not incur a performance penalty, if the chosen mode matches
      * the current mode.) Mode switching happens automatically when qubit counts change, but Compose() and Decompose()
@@ -153,9 +160,27 @@ public:
     }
     void SetAmplitudePage(QEnginePtr pageEnginePtr, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length)
     {
-        SetAmplitudePage(std::dynamic_pointer_cast<QHybrid>(pageEnginePtr), srcOffset, dstOffset, length);
+        QHybridPtr pageHybridPtr = std::dynamic_pointer_cast<QHybrid>(pageEnginePtr);
+        if (!pageHybridPtr) {
+            // (A host page of a heterogeneous QPager is a plain engine.)
+            engine->SetAmplitudePage(pageEnginePtr, srcOffset, dstOffset, length);
+            return;
+        }
+        SetAmplitudePage(pageHybridPtr, srcOffset, dstOffset, length);
+    }
+    void ScatterAmplitudes(bitCapIntOcl const* perms, complex const* amps, bitCapIntOcl count)
+    {
+        engine->ScatterAmplitudes(perms, amps, count);
+    }
+    void ShuffleBuffers(QEnginePtr oEngine)
+    {
+        QHybridPtr oHybrid = std::dynamic_pointer_cast<QHybrid>(oEngine);
+        if (!oHybrid) {
+            engine->ShuffleBuffers(oEngine);
+            return;
+        }
+        ShuffleBuffers(oHybrid);
     }
-    void ShuffleBuffers(QEnginePtr oEngine) { ShuffleBuffers(std::dynamic_pointer_cast<QHybrid>(oEngine)); }
     void ShuffleBuffers(QHybridPtr oEngine)
     {
         oEngine->SwitchModes(isGpu, isPager);
@@ -180,6 +205,21 @@ public:
         return engine->Compose(toCopy->engine);
     }
     bitLenInt Compose(QInterfacePtr toCopy) { return Compose(std::dynamic_pointer_cast<QHybrid>(toCopy)); }
+    std::map<QInterfacePtr, bitLenInt> Compose(std::vector<QInterfacePtr> toCopy)
+    {
+        std::map<QInterfacePtr, bitLenInt> ret;
+        std::vector<QInterfacePtr> engines;
+        for (const QInterfacePtr& q : toCopy) {
+            QHybridPtr src = std::dynamic_pointer_cast<QHybrid>(q);
+            ret[q] = qubitCount;
+            SetQubitCount(qubitCount + src->qubitCount);
+            src->SwitchModes(isGpu, isPager);
+            engines.push_back(src->engine);
+        }
+        engine->Compose(engines);
+
+        return ret;
+    }
     bitLenInt Compose(QHybridPtr toCopy, bitLenInt start)
     {
         SetQubitCount(qubitCount + toCopy->qubitCount);
@@ -255,6 +295,8 @@ public:
     void SetQuantumState(complex const* inputState) { engine->SetQuantumState(inputState); }
     void GetQuantumState(complex* outputState) { engine->GetQuantumState(outputState); }
     void GetProbs(real1* outputProbs) { engine->GetProbs(outputProbs); }
+    complex const* MapStateVector() { return engine->MapStateVector(); }
+    void UnmapStateVector() { engine->UnmapStateVector(); }
     complex GetAmplitude(bitCapInt perm) { return engine->GetAmplitude(perm); }
     void SetAmplitude(bitCapInt perm, complex amp) { engine->SetAmplitude(perm, amp); }
     void SetPermutation(bitCapInt perm, complex phaseFac = CMPLX_DEFAULT_ARG)
@@ -286,9 +328,20 @@ public:
     {
         engine->UniformlyControlledSingleBit(controls, qubitIndex, mtrxs, mtrxSkipPowers, mtrxSkipValueMask);
     }
+    void MtrxN(complex const* mtrx, const std::vector<bitLenInt>& targets) { engine->MtrxN(mtrx, targets); }
 
     void XMask(bitCapInt mask) { engine->XMask(mask); }
     void PhaseParity(real1_f radians, bitCapInt mask) { engine->PhaseParity(radians, mask); }
+    void PhaseFlipIfLookup(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+        const unsigned char* values, bitCapInt target)
+    {
+        engine->PhaseFlipIfLookup(indexStart, indexLength, valueLength, values, target);
+    }
+    void GroverLookupIteration(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+        const unsigned char* values, bitCapInt target)
+    {
+        engine->GroverLookupIteration(indexStart, indexLength, valueLength, values, target);
+    }
 
     real1_f CProb(bitLenInt control, bitLenInt target) { return engine->CProb(control, target); }
     real1_f ACProb(bitLenInt control, bitLenInt target) { return engine->ACProb(control, target); }
@@ -448,6 +501,7 @@ public:
 #endif
 
     void Swap(bitLenInt qubitIndex1, bitLenInt qubitIndex2) { engine->Swap(qubitIndex1, qubitIndex2); }
+    void PermuteQubits(const std::vector<bitLenInt>& dest) { engine->PermuteQubits(dest); }
     void ISwap(bitLenInt qubitIndex1, bitLenInt qubitIndex2) { engine->ISwap(qubitIndex1, qubitIndex2); }
     void IISwap(bitLenInt qubitIndex1, bitLenInt qubitIndex2) { engine->IISwap(qubitIndex1, qubitIndex2); }
     void SqrtSwap(bitLenInt qubitIndex1, bitLenInt qubitIndex2) { engine->SqrtSwap(qubitIndex1, qubitIndex2); }
@@ -488,6 +542,7 @@ public:
     {
         return engine->ExpectationBitsAll(bits, offset);
     }
+    void ProbBits(const std::vector<bitLenInt>& bits, real1* probsArray) { engine->ProbBits(bits, probsArray); }
 
     void Finish() { engine->Finish(); }
 
@@ -502,6 +557,7 @@ public:
             gpuThresholdQubits, separabilityThreshold);
         c->runningNorm = runningNorm;
         c->SetConcurrency(GetConcurrencyLevel());
+        c->SetDispatchWide(isDispatchWide);
         c->engine->CopyStateVec(engine);
         return c;
     }
@@ -12,6 +12,8 @@
 
 #pragma once
 
+#include "common/checkpoint.hpp"
+#include "common/instrumentation.hpp"
 #include "common/parallel_for.hpp"
 #include "common/rdrandwrapper.hpp"
 #include "hamiltonian.hpp"
@@ -32,6 +34,12 @@ namespace Qrack {
 class QInterface;
 typedef std::shared_ptr<QInterface> QInterfacePtr;
 
+/** Called once per chunk of QInterface::ForEachAmplitudeChunk(), with the amplitudes of [offset, offset + length) */
+typedef std::function<void(const bitCapInt& offset, const bitCapIntOcl& length, complex const* amps)>
+    AmplitudeChunkFn;
+/** Called once per chunk of QInterface::ForEachProbChunk(), with the probabilities of [offset, offset + length) */
+typedef std::function<void(const bitCapInt& offset, const bitCapIntOcl& length, real1 const* probs)> ProbChunkFn;
+
 /**
  * Enumerated list of Pauli bases
  */
@@ -46,6 +54,14 @@ enum Pauli {
     PauliZ = 2
 };
 
+/**
+ * A Pauli string observable: "paulis[i]" acts on qubit "qubits[i]," and identity acts on every other qubit.
+ */
+struct PauliString {
+    std::vector<bitLenInt> qubits;
+    std::vector<Pauli> paulis;
+};
+
 /**
  * Enumerated list of supported engines.
  *
@@ -103,6 +119,36 @@ enum QInterfaceEngine {
      */
     QINTERFACE_QUNIT_MULTI,
 
+    /**
+     * Create a QPagerMpi, which spreads a single register across the ranks of an MPI job, (only if built with
+     * ENABLE_MPI).
+     */
+    QINTERFACE_QPAGER_MPI,
+
+    /**
+     * Create a QTensorNetwork, which records gates as a tensor network, contracting only what amplitude and probability
+     * queries need, on top of other QInterface classes for any full-state operation.
+     */
+    QINTERFACE_TENSOR_NETWORK,
+
+    /**
+     * Create a QMps, which holds the state as a matrix product state of bounded bond dimension, on top of other
+     * QInterface classes for a dense fallback.
+     */
+    QINTERFACE_MPS,
+
+    /**
+     * Create a QDensityMatrix, which holds the exact (mixed) state of a small register as a density matrix, vectorized
+     * into a state vector of twice the qubits, of other QInterface classes.
+     */
+    QINTERFACE_DENSITY_MATRIX,
+
+    /**
+     * Create a QPrefixCache, which records gates and resumes each run from the cached state of the longest gate stream
+     * prefix that it has already simulated, on top of other QInterface classes.
+     */
+    QINTERFACE_PREFIX_CACHE,
+
 #if ENABLE_OPENCL
     QINTERFACE_OPTIMAL_SCHROEDINGER = QINTERFACE_QPAGER,
 
@@ -188,6 +234,30 @@ protected:
         XMask(xMask);
     }
 
+    /** Draw a seed for an independent pseudo-random stream, from this QInterface's generator. */
+    uint64_t RandSeed()
+    {
+        if (hardware_rand_generator != NULL) {
+            return ((uint64_t)hardware_rand_generator->NextRaw() << 32U) | (uint64_t)hardware_rand_generator->NextRaw();
+        }
+        return (uint64_t)(*rand_generator)();
+    }
+
+    /**
+     * Draw "shots" samples from the (unnormalized) distribution "maskProbs," over [0, maskMaxQPower), into
+     * "shotsArray." Shots are split into fixed blocks, each with its own CounterRng stream, under one seed drawn from
+     * this QInterface, so blocks run in parallel and results don't depend on thread count.
+     */
+    void SampleShots(
+        real1 const* maskProbs, bitCapIntOcl maskMaxQPower, unsigned shots, unsigned long long* shotsArray);
+
+    /** Count sampled outcomes into the dictionary that MultiShotMeasureMask() returns. */
+    static std::map<bitCapInt, int> ShotHistogram(
+        unsigned long long const* shotsArray, unsigned shots, bitCapIntOcl maskMaxQPower);
+
+    /** Check a ForEachAmplitudeChunk() range, and resolve its chunk length, (where 0 is the default) */
+    bitCapIntOcl ReadoutChunkLength(bitCapInt offset, bitCapInt length, bitCapIntOcl chunkLength);
+
 public:
     QInterface(bitLenInt n, qrack_rand_gen_ptr rgp = nullptr, bool doNorm = false, bool useHardwareRNG = true,
         bool randomGlobalPhase = true, real1_f norm_thresh = REAL1_EPSILON);
@@ -258,6 +328,47 @@ public:
      */
     virtual void GetProbs(real1* outputProbs) = 0;
 
+    /** Map the pure quantum state representation read-only, if it is one contiguous, host-resident array
+     *
+     * Returns a pointer to this simulator's own 2^n amplitudes, (without a copy, for CPU engines and OpenCL engines
+     * with host memory,) or NULL if it has no such array, (in which case, use GetQuantumState()). Call
+     * UnmapStateVector() before any other method of this simulator.
+     *
+     * \warning PSEUDO-QUANTUM
+     */
+    virtual complex const* MapStateVector() { return NULL; }
+
+    /** Release a MapStateVector() pointer */
+    virtual void UnmapStateVector() {}
+
+    /** Stream the amplitudes of permutations [offset, offset + length), in order, to "fn"
+     *
+     * Each chunk holds at most "chunkLength" amplitudes, (or 2^20, by default, or a page of a QPager,) so the caller
+     * never needs a buffer for all 2^n at once. QEngine types fetch the next chunk while "fn" handles the last, so "fn"
+     * must not call this simulator.
+     *
+     * \warning PSEUDO-QUANTUM
+     */
+    virtual void ForEachAmplitudeChunk(
+        bitCapInt offset, bitCapInt length, AmplitudeChunkFn fn, bitCapIntOcl chunkLength = 0U);
+
+    /** Stream the probabilities of permutations [offset, offset + length), in order, to "fn," as
+     * ForEachAmplitudeChunk() does amplitudes
+     *
+     * \warning PSEUDO-QUANTUM
+     */
+    virtual void ForEachProbChunk(bitCapInt offset, bitCapInt length, ProbChunkFn fn, bitCapIntOcl chunkLength = 0U);
+
+    /** Get the permutations with probability of at least "threshold," (and only the "maxCount" most probable of them,
+     * if "maxCount" is nonzero,) with their amplitudes, in decreasing order of probability
+     *
+     * The state is streamed through ForEachAmplitudeChunk(), so only one chunk and the results are ever held.
+     *
+     * \warning PSEUDO-QUANTUM
+     */
+    virtual std::vector<std::pair<bitCapInt, complex>> GetSignificantAmplitudes(
+        real1_f threshold, bitCapIntOcl maxCount = 0U);
+
     /** Get the representational amplitude of a full permutation
      *
      * \warning PSEUDO-QUANTUM
@@ -553,6 +664,18 @@ public:
      */
     virtual void TimeEvolve(Hamiltonian h, real1_f timeDiff);
 
+    /**
+     * Apply "steps" time steps of a CompiledHamiltonian, (with its exponentials, fusion, and TrotterOrder product
+     * formula fixed when it was compiled,) for a total evolution time of steps * h.GetTimeDiff()
+     */
+    virtual void TimeEvolve(const CompiledHamiltonian& h, unsigned steps = 1U);
+
+    /**
+     * Evolve for "timeDiff" by the exponential of the sum of a KrylovHamiltonian's terms, (without splitting error,)
+     * with adaptive Krylov steps over the state vector
+     */
+    virtual void TimeEvolve(const KrylovHamiltonian& h, real1_f timeDiff);
+
     /**
      * Apply a swap with arbitrary control bits.
      */
@@ -2174,6 +2297,28 @@ public:
     /** Phase flip always - equivalent to Z X Z X on any bit in the QInterface */
     virtual void PhaseFlip() { Phase(-ONE_CMPLX, -ONE_CMPLX, 0); }
 
+    /**
+     * Lookup table phase oracle: reverse the phase of each permutation of the "index" register whose entry in "values"
+     * equals "target." The table is laid out as for IndexedLDA(), with (valueLength + 7) / 8 little-endian bytes per
+     * index permutation, but no value register is needed.
+     */
+    virtual void PhaseFlipIfLookup(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+        const unsigned char* values, bitCapInt target);
+
+    /**
+     * One Grover iteration over the "index" register, with PhaseFlipIfLookup() as its oracle: the oracle, then the
+     * diffusion operator, (H, ZeroPhaseFlip(), and H again, on the index register). Engines fuse both into one pass
+     * over the state vector, and QEngineOCL keeps "values" resident on its device between calls.
+     */
+    virtual void GroverLookupIteration(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+        const unsigned char* values, bitCapInt target)
+    {
+        PhaseFlipIfLookup(indexStart, indexLength, valueLength, values, target);
+        H(indexStart, indexLength);
+        ZeroPhaseFlip(indexStart, indexLength);
+        H(indexStart, indexLength);
+    }
+
     /** Set register bits to given permutation */
     virtual void SetReg(bitLenInt start, bitLenInt length, bitCapInt value);
 
@@ -2311,6 +2456,30 @@ public:
      */
     virtual void ProbBitsAll(const std::vector<bitLenInt>& bits, real1* probsArray);
 
+    /**
+     * Direct measure of the probability of each listed bit to be in |1> state
+     *
+     * One marginal probability per entry of "bits" is returned in the "probsArray" parameter, in the same order, (unlike
+     * ProbBitsAll(), which returns their joint distribution). Engines read all of them in a single pass over the state.
+     *
+     * \warning PSEUDO-QUANTUM
+     */
+    virtual void ProbBits(const std::vector<bitLenInt>& bits, real1* probsArray);
+
+    /**
+     * Direct measure of the probability of every qubit to be in |1> state, (as ProbBits() of all qubits, in order)
+     *
+     * \warning PSEUDO-QUANTUM
+     */
+    virtual void ProbAllQubits(real1* probsArray)
+    {
+        std::vector<bitLenInt> bits(qubitCount);
+        for (bitLenInt i = 0U; i < qubitCount; ++i) {
+            bits[i] = i;
+        }
+        ProbBits(bits, probsArray);
+    }
+
     /**
      * Get permutation expectation value of bits
      *
@@ -2321,6 +2490,16 @@ public:
      */
     virtual real1_f ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCapInt offset = 0);
 
+    /**
+     * Get the expectation values of many Pauli string observables
+     *
+     * Qubit-wise commuting terms are grouped, and each group is measured together, in one sweep over the state, which
+     * is left unchanged. The expectation value of each term in "terms" is returned, in the same order.
+     *
+     * \warning PSEUDO-QUANTUM
+     */
+    virtual std::vector<real1_f> ExpectationPauliAll(const std::vector<PauliString>& terms);
+
     /**
      * Statistical measure of masked permutation probability
      *
@@ -2491,12 +2670,42 @@ public:
      * helps.
      */
     virtual bool GetTInjection() { return false; }
+    /**
+     *  Set whether wide gates are dispatched asynchronously (off by default)
+     *
+     *  As in Qrack::QEngineCPU, only gates narrower than the parallel stride are usually queued. QUnit turns this on
+     * for its units, so that wide gates on disjoint units overlap, rather than each blocking the caller.
+     */
+    virtual void SetDispatchWide(bool isWide) {}
 
     /**
      *  Clone this QInterface
      */
     virtual QInterfacePtr Clone() = 0;
 
+    /**
+     *  Stream this simulator's full state, (including its layer structure,) to a checkpoint
+     *
+     *  Each layer writes its own section: QUnit its shard table, QPager its pages, QBdt its node table, and
+     * QStabilizer its tableau, while state vectors stream out chunk by chunk, so no 2^n host copy is ever made. Throws
+     * std::domain_error if this simulator type does not support checkpoints.
+     */
+    virtual void SaveCheckpoint(CheckpointWriter& writer)
+    {
+        throw std::domain_error("QInterface::SaveCheckpoint() is not supported by this simulator type!");
+    }
+
+    /**
+     *  Restore this simulator's full state from a checkpoint written by SaveCheckpoint()
+     *
+     *  The simulator must be of the same layer stack and qubit count as the one that was saved, (though engines below
+     * that stack, such as QUnit units, are recreated as needed). State vector chunks are restored in parallel.
+     */
+    virtual void LoadCheckpoint(CheckpointReader& reader)
+    {
+        throw std::domain_error("QInterface::LoadCheckpoint() is not supported by this simulator type!");
+    }
+
     /**
      *  Set the device index, if more than one device is available.
      */
@@ -2547,6 +2756,33 @@ public:
      */
     virtual bitLenInt DepolarizingChannelStrong1Qb(bitLenInt qubit, real1_f lambda);
 
+    /**
+     * Get the probability of each Kraus operator of a single qubit noise channel, ||K_k|psi>||^2, (without changing the
+     * state). "kraus" holds the 2x2 Kraus operators in row-major order, consecutively, and "probs" receives one
+     * probability per operator. If every K_k^+ K_k is proportional to the identity, (as for any mixture of unitaries,)
+     * the probabilities don't depend on the state, and it isn't queried.
+     *
+     * \warning PSEUDO-QUANTUM
+     */
+    virtual void KrausProbs1Qb(const std::vector<complex>& kraus, bitLenInt qubit, real1_f* probs);
+
+    /**
+     * Apply one (generally non-unitary) Kraus operator to a qubit, and renormalize, as the state of one quantum
+     * trajectory that took that branch of its noise channel. This throws std::domain_error if the branch has zero
+     * probability.
+     *
+     * \warning PSEUDO-QUANTUM
+     */
+    virtual void ApplyKraus1Qb(complex const* kraus, bitLenInt qubit);
+
+    /**
+     * Simulate a general single qubit noise channel, given by its Kraus operators, as one step of a quantum
+     * trajectory, (under a "weak simulation condition," as above). Kraus operator "k" is chosen with probability
+     * ||K_k|psi>||^2 and applied, with renormalization, and "k" is returned. The operators, consecutive row-major 2x2
+     * matrices, must satisfy sum_k K_k^+ K_k = I.
+     */
+    virtual size_t KrausChannel1Qb(const std::vector<complex>& kraus, bitLenInt qubit);
+
     /** @} */
 };
 } // namespace Qrack
@@ -0,0 +1,444 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qinterface.hpp"
+
+#include <functional>
+
+#if ENABLE_ALU
+#include "qalu.hpp"
+#endif
+#include "qparity.hpp"
+
+#define QINTERFACE_TO_QALU(qReg) std::dynamic_pointer_cast<QAlu>(qReg)
+#define QINTERFACE_TO_QPARITY(qReg) std::dynamic_pointer_cast<QParity>(qReg)
+
+namespace Qrack {
+
+class QMps;
+typedef std::shared_ptr<QMps> QMpsPtr;
+
+/**
+ * A "Qrack::QMps" is a matrix product state: one tensor per qubit, of shape (left bond, 2, right bond), in qubit
+ * order, so memory is O(n * chi^2) for bond dimension chi, rather than O(2^n).
+ *
+ * The state is kept in mixed canonical form, around one "center" site. A gate on the qubits from "lo" to "hi" moves the
+ * center to "lo," contracts those sites into one block, applies the gate there, and splits the block back into sites
+ * with SVDs, from left to right. Each SVD drops singular values in its tail while their total weight stays within
+ * "truncationThreshold," (by default, only the numerically zero ones,) and the dropped weight is added to
+ * GetTruncationError(). Single qubit probability and measurement only need the center site.
+ *
+ * If a bond would grow past "maxBondDimension," or a gate spans more than "maxBlockQubits" sites, (or an operation has
+ * no MPS form, like arithmetic,) the state moves into a dense engine of the configured "engines" stack, for good.
+ */
+#if ENABLE_ALU
+class QMps : public QAlu, public QParity, public QInterface {
+#else
+class QMps : public QParity, public QInterface {
+#endif
+protected:
+    bool useHostRam;
+    bool isSparse;
+    bitLenInt thresholdQubits;
+    bitLenInt maxBlockQubits;
+    bitLenInt center;
+    bitCapIntOcl maxBondDimension;
+    real1_f truncationThreshold;
+    real1_f truncationError;
+    real1_f separabilityThreshold;
+    int64_t devID;
+    complex phaseFactor;
+    // The dense fallback, once the MPS has exceeded its limits, (otherwise NULL)
+    QInterfacePtr engine;
+    std::vector<int64_t> deviceIDs;
+    std::vector<QInterfaceEngine> engines;
+    // Bond dimensions, with bonds[i] to the left of site i, and bonds[0] = bonds[qubitCount] = 1
+    std::vector<bitCapIntOcl> bonds;
+    // Site tensors, with site i indexed as (l * 2 + s) * bonds[i + 1] + r
+    std::vector<std::vector<complex>> sites;
+
+    QInterfacePtr MakeEngine(bitCapInt perm = 0U);
+
+    /// Move the state into a dense engine, (if it isn't already)
+    void SwitchToEngine();
+
+    /**
+     * Factor the (rows x cols) matrix "m" by SVD, dropping singular values as truncation allows, (and at most "maxRank,"
+     * if nonzero,) and return the rank. With "isLeft," m = iso * rest, for left isometry "iso;" otherwise, m = rest *
+     * iso, for right isometry "iso." Either way, "rest" carries the singular values.
+     */
+    bitCapIntOcl Split(const std::vector<complex>& m, bitCapIntOcl rows, bitCapIntOcl cols, std::vector<complex>& iso,
+        std::vector<complex>& rest, bool isLeft, bitCapIntOcl maxRank = 0U);
+    /// Move the orthogonality center one site right, (or left,) leaving at most "maxRank" on the bond it crosses
+    void ShiftCenter(bool isRight, bitCapIntOcl maxRank = 0U);
+    /// Move the orthogonality center to "site"
+    void MoveCenter(bitLenInt site)
+    {
+        while (center < site) {
+            ShiftCenter(true);
+        }
+        while (center > site) {
+            ShiftCenter(false);
+        }
+    }
+    /// Contract the sites from "lo" to "hi" into one block, (l, 2^(hi - lo + 1), r,) with site "lo" most significant
+    void ContractBlock(bitLenInt lo, bitLenInt hi, std::vector<complex>& block);
+    /// Split a block from ContractBlock() back into the sites from "lo" to "hi," leaving the center at "hi"
+    void SplitBlock(bitLenInt lo, bitLenInt hi, std::vector<complex> block, bitCapIntOcl right);
+    /**
+     * Contract the sites from "lo" to "hi," let "fn" act on the block, (with its left bond, physical, and right bond
+     * dimensions,) and split it back, or return false, untouched, if the block would be wider than "maxBlockQubits"
+     */
+    bool ApplyBlock(bitLenInt lo, bitLenInt hi,
+        std::function<void(std::vector<complex>&, bitCapIntOcl, bitCapIntOcl, bitCapIntOcl)> fn);
+    /// Apply "mtrx" to "target," where the "controls" are all |1>, (or all |0>, if "isAnti,") as one block operation
+    void ApplyControlled(
+        const std::vector<bitLenInt>& controls, bool isAnti, complex const* mtrx, bitLenInt target);
+    /// Cut out the sites from "start" to "start + length," (swapped to the end and cut to rank 1,) into "part"
+    void CutRange(bitLenInt start, bitLenInt length, QMpsPtr part);
+    /// <this|ket>, with the bits of "mask" projected onto those of "perm," in both
+    complex InnerProduct(const QMps& ket, bitCapInt mask = 0U, bitCapInt perm = 0U);
+    /// The norm of the state, (squared,) which is all in the center site
+    real1_f CenterNorm();
+    /// Scale the center site to unit norm
+    void NormalizeCenter();
+    /// Whether every bond is at most "maxBondDimension"
+    bool IsWithinBondLimit()
+    {
+        for (const bitCapIntOcl& b : bonds) {
+            if (b > maxBondDimension) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+public:
+    QMps(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState = 0U,
+        qrack_rand_gen_ptr rgp = nullptr, complex phaseFac = CMPLX_DEFAULT_ARG, bool doNorm = false,
+        bool randomGlobalPhase = true, bool useHostMem = false, int64_t deviceId = -1, bool useHardwareRNG = true,
+        bool useSparseStateVec = false, real1_f norm_thresh = REAL1_EPSILON, std::vector<int64_t> devList = {},
+        bitLenInt qubitThreshold = 0U, real1_f separation_thresh = FP_NORM_EPSILON_F);
+
+    QMps(bitLenInt qBitCount, bitCapInt initState = 0U, qrack_rand_gen_ptr rgp = nullptr,
+        complex phaseFac = CMPLX_DEFAULT_ARG, bool doNorm = false, bool randomGlobalPhase = true,
+        bool useHostMem = false, int64_t deviceId = -1, bool useHardwareRNG = true, bool useSparseStateVec = false,
+        real1_f norm_thresh = REAL1_EPSILON, std::vector<int64_t> devList = {}, bitLenInt qubitThreshold = 0U,
+        real1_f separation_thresh = FP_NORM_EPSILON_F)
+        : QMps({ QINTERFACE_OPTIMAL_BASE }, qBitCount, initState, rgp, phaseFac, doNorm, randomGlobalPhase, useHostMem,
+              deviceId, useHardwareRNG, useSparseStateVec, norm_thresh, devList, qubitThreshold, separation_thresh)
+    {
+    }
+
+    /// True until the state has moved into a dense engine
+    bool isMps() { return !engine; }
+
+    /// The largest bond dimension, before the state moves into a dense engine
+    void SetMaxBondDimension(bitCapIntOcl dim) { maxBondDimension = dim; }
+    bitCapIntOcl GetMaxBondDimension() { return maxBondDimension; }
+    /// The current largest bond dimension, (or 0, if dense)
+    bitCapIntOcl GetBondDimension()
+    {
+        if (engine) {
+            return 0U;
+        }
+
+        bitCapIntOcl toRet = 1U;
+        for (const bitCapIntOcl& b : bonds) {
+            toRet = (b > toRet) ? b : toRet;
+        }
+
+        return toRet;
+    }
+    /// The total weight of singular values each SVD may drop, (as a fraction of the norm)
+    void SetTruncationThreshold(real1_f thresh) { truncationThreshold = thresh; }
+    real1_f GetTruncationThreshold() { return truncationThreshold; }
+    /// The total weight of all singular values dropped so far, (about 1 minus the fidelity)
+    real1_f GetTruncationError() { return truncationError; }
+    void ResetTruncationError() { truncationError = ZERO_R1_F; }
+
+    void SetConcurrency(uint32_t threadCount)
+    {
+        QInterface::SetConcurrency(threadCount);
+        if (engine) {
+            engine->SetConcurrency(threadCount);
+        }
+    }
+
+    void SetPermutation(bitCapInt perm, complex phaseFac = CMPLX_DEFAULT_ARG);
+
+    void SetQuantumState(complex const* inputState);
+    void GetQuantumState(complex* outputState);
+    void GetProbs(real1* outputProbs);
+    complex GetAmplitude(bitCapInt perm);
+    void SetAmplitude(bitCapInt perm, complex amp)
+    {
+        SwitchToEngine();
+        engine->SetAmplitude(perm, amp);
+    }
+
+    using QInterface::Compose;
+    bitLenInt Compose(QInterfacePtr toCopy, bitLenInt start);
+    void Decompose(bitLenInt start, QInterfacePtr dest);
+    QInterfacePtr Decompose(bitLenInt start, bitLenInt length);
+    void Dispose(bitLenInt start, bitLenInt length);
+    void Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm);
+    using QInterface::Allocate;
+    bitLenInt Allocate(bitLenInt start, bitLenInt length);
+
+    void Mtrx(complex const* mtrx, bitLenInt target);
+    void MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+    {
+        ApplyControlled(controls, false, mtrx, target);
+    }
+    void MACMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+    {
+        ApplyControlled(controls, true, mtrx, target);
+    }
+    using QInterface::Swap;
+    void Swap(bitLenInt qubit1, bitLenInt qubit2);
+    void FSim(real1_f theta, real1_f phi, bitLenInt qubit1, bitLenInt qubit2);
+
+    bool ForceM(bitLenInt qubit, bool result, bool doForce = true, bool doApply = true);
+    real1_f Prob(bitLenInt qubit);
+    real1_f ProbAll(bitCapInt fullRegister);
+    real1_f ProbMask(bitCapInt mask, bitCapInt permutation);
+    real1_f ProbReg(bitLenInt start, bitLenInt length, bitCapInt permutation)
+    {
+        const bitCapInt mask = (pow2(length) - 1U) << start;
+        return ProbMask(mask, permutation << start);
+    }
+
+    real1_f ProbParity(bitCapInt mask)
+    {
+        SwitchToEngine();
+        return QINTERFACE_TO_QPARITY(engine)->ProbParity(mask);
+    }
+    bool ForceMParity(bitCapInt mask, bool result, bool doForce = true)
+    {
+        SwitchToEngine();
+        return QINTERFACE_TO_QPARITY(engine)->ForceMParity(mask, result, doForce);
+    }
+    void CUniformParityRZ(const std::vector<bitLenInt>& controls, bitCapInt mask, real1_f angle)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QPARITY(engine)->CUniformParityRZ(controls, mask, angle);
+    }
+
+#if ENABLE_ALU
+    using QInterface::M;
+    bool M(bitLenInt q) { return QInterface::M(q); }
+    using QInterface::X;
+    void X(bitLenInt q) { QInterface::X(q); }
+    void CPhaseFlipIfLess(bitCapInt greaterPerm, bitLenInt start, bitLenInt length, bitLenInt flagIndex)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->CPhaseFlipIfLess(greaterPerm, start, length, flagIndex);
+    }
+    void PhaseFlipIfLess(bitCapInt greaterPerm, bitLenInt start, bitLenInt length)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->PhaseFlipIfLess(greaterPerm, start, length);
+    }
+
+    void INC(bitCapInt toAdd, bitLenInt start, bitLenInt length)
+    {
+        if (!engine) {
+            QInterface::INC(toAdd, start, length);
+            return;
+        }
+
+        engine->INC(toAdd, start, length);
+    }
+    void DEC(bitCapInt toSub, bitLenInt start, bitLenInt length)
+    {
+        if (!engine) {
+            QInterface::DEC(toSub, start, length);
+            return;
+        }
+
+        engine->DEC(toSub, start, length);
+    }
+    void DECS(bitCapInt toSub, bitLenInt start, bitLenInt length, bitLenInt overflowIndex)
+    {
+        if (!engine) {
+            QInterface::DECS(toSub, start, length, overflowIndex);
+            return;
+        }
+
+        engine->DECS(toSub, start, length, overflowIndex);
+    }
+    void CINC(bitCapInt toAdd, bitLenInt inOutStart, bitLenInt length, const std::vector<bitLenInt>& controls)
+    {
+        if (!engine) {
+            QInterface::CINC(toAdd, inOutStart, length, controls);
+            return;
+        }
+
+        engine->CINC(toAdd, inOutStart, length, controls);
+    }
+    void INCS(bitCapInt toAdd, bitLenInt start, bitLenInt length, bitLenInt overflowIndex)
+    {
+        if (!engine) {
+            QInterface::INCS(toAdd, start, length, overflowIndex);
+            return;
+        }
+
+        engine->INCS(toAdd, start, length, overflowIndex);
+    }
+    void INCDECC(bitCapInt toAdd, bitLenInt start, bitLenInt length, bitLenInt carryIndex)
+    {
+        if (!engine) {
+            QInterface::INCDECC(toAdd, start, length, carryIndex);
+            return;
+        }
+
+        engine->INCDECC(toAdd, start, length, carryIndex);
+    }
+    void INCDECSC(bitCapInt toAdd, bitLenInt start, bitLenInt length, bitLenInt overflowIndex, bitLenInt carryIndex)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->INCDECSC(toAdd, start, length, overflowIndex, carryIndex);
+    }
+    void INCDECSC(bitCapInt toAdd, bitLenInt start, bitLenInt length, bitLenInt carryIndex)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->INCDECSC(toAdd, start, length, carryIndex);
+    }
+#if ENABLE_BCD
+    void INCBCD(bitCapInt toAdd, bitLenInt start, bitLenInt length)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->INCBCD(toAdd, start, length);
+    }
+    void INCDECBCDC(bitCapInt toAdd, bitLenInt start, bitLenInt length, bitLenInt carryIndex)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->INCDECBCDC(toAdd, start, length, carryIndex);
+    }
+#endif
+    void MUL(bitCapInt toMul, bitLenInt inOutStart, bitLenInt carryStart, bitLenInt length)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->MUL(toMul, inOutStart, carryStart, length);
+    }
+    void DIV(bitCapInt toDiv, bitLenInt inOutStart, bitLenInt carryStart, bitLenInt length)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->DIV(toDiv, inOutStart, carryStart, length);
+    }
+    void MULModNOut(bitCapInt toMul, bitCapInt modN, bitLenInt inStart, bitLenInt outStart, bitLenInt length)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->MULModNOut(toMul, modN, inStart, outStart, length);
+    }
+    void IMULModNOut(bitCapInt toMul, bitCapInt modN, bitLenInt inStart, bitLenInt outStart, bitLenInt length)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->IMULModNOut(toMul, modN, inStart, outStart, length);
+    }
+    void POWModNOut(bitCapInt base, bitCapInt modN, bitLenInt inStart, bitLenInt outStart, bitLenInt length)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->POWModNOut(base, modN, inStart, outStart, length);
+    }
+    void CMUL(bitCapInt toMul, bitLenInt inOutStart, bitLenInt carryStart, bitLenInt length,
+        const std::vector<bitLenInt>& controls)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->CMUL(toMul, inOutStart, carryStart, length, controls);
+    }
+    void CDIV(bitCapInt toDiv, bitLenInt inOutStart, bitLenInt carryStart, bitLenInt length,
+        const std::vector<bitLenInt>& controls)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->CDIV(toDiv, inOutStart, carryStart, length, controls);
+    }
+    void CMULModNOut(bitCapInt toMul, bitCapInt modN, bitLenInt inStart, bitLenInt outStart, bitLenInt length,
+        const std::vector<bitLenInt>& controls)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->CMULModNOut(toMul, modN, inStart, outStart, length, controls);
+    }
+    void CIMULModNOut(bitCapInt toMul, bitCapInt modN, bitLenInt inStart, bitLenInt outStart, bitLenInt length,
+        const std::vector<bitLenInt>& controls)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->CIMULModNOut(toMul, modN, inStart, outStart, length, controls);
+    }
+    void CPOWModNOut(bitCapInt base, bitCapInt modN, bitLenInt inStart, bitLenInt outStart, bitLenInt length,
+        const std::vector<bitLenInt>& controls)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->CPOWModNOut(base, modN, inStart, outStart, length, controls);
+    }
+
+    bitCapInt IndexedLDA(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueStart, bitLenInt valueLength,
+        const unsigned char* values, bool resetValue = true)
+    {
+        SwitchToEngine();
+        return QINTERFACE_TO_QALU(engine)->IndexedLDA(
+            indexStart, indexLength, valueStart, valueLength, values, resetValue);
+    }
+    bitCapInt IndexedADC(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueStart, bitLenInt valueLength,
+        bitLenInt carryIndex, const unsigned char* values)
+    {
+        SwitchToEngine();
+        return QINTERFACE_TO_QALU(engine)->IndexedADC(
+            indexStart, indexLength, valueStart, valueLength, carryIndex, values);
+    }
+    bitCapInt IndexedSBC(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueStart, bitLenInt valueLength,
+        bitLenInt carryIndex, const unsigned char* values)
+    {
+        SwitchToEngine();
+        return QINTERFACE_TO_QALU(engine)->IndexedSBC(
+            indexStart, indexLength, valueStart, valueLength, carryIndex, values);
+    }
+    void Hash(bitLenInt start, bitLenInt length, const unsigned char* values)
+    {
+        SwitchToEngine();
+        QINTERFACE_TO_QALU(engine)->Hash(start, length, values);
+    }
+#endif
+
+    real1_f SumSqrDiff(QInterfacePtr toCompare);
+    void UpdateRunningNorm(real1_f norm_thresh = REAL1_DEFAULT_ARG)
+    {
+        if (engine) {
+            engine->UpdateRunningNorm(norm_thresh);
+        }
+    }
+    void NormalizeState(
+        real1_f nrm = REAL1_DEFAULT_ARG, real1_f norm_thresh = REAL1_DEFAULT_ARG, real1_f phaseArg = ZERO_R1_F);
+
+    void Finish()
+    {
+        if (engine) {
+            engine->Finish();
+        }
+    }
+    bool isFinished() { return !engine || engine->isFinished(); }
+    void Dump()
+    {
+        if (engine) {
+            engine->Dump();
+        }
+    }
+
+    QInterfacePtr Clone();
+    void SetDevice(int64_t dID);
+    int64_t GetDevice() { return devID; }
+};
+} // namespace Qrack
@@ -25,7 +25,7 @@ private:
     bitLenInt outputIndex;
     real1 tolerance;
     std::vector<bitLenInt> inputIndices;
-    std::unique_ptr<real1> angles;
+    std::unique_ptr<real1[]> angles;
     QInterfacePtr qReg;
 
 public:
@@ -47,7 +47,7 @@ public:
         , inputIndices(inputIndcs)
     {
         qReg = reg;
-        angles = std::unique_ptr<real1>(new real1[inputPower]());
+        angles = std::unique_ptr<real1[]>(new real1[inputPower]());
     }
 
     /** Create a new QNeuron which is an exact duplicate of another, including its learned state. */
@@ -61,7 +61,7 @@ public:
     {
         qReg = toCopy.qReg;
         inputIndices = toCopy.inputIndices;
-        angles = std::unique_ptr<real1>(new real1[inputPower]());
+        angles = std::unique_ptr<real1[]>(new real1[inputPower]());
         std::copy(toCopy.angles.get(), toCopy.angles.get() + toCopy.inputPower, angles.get());
         outputIndex = toCopy.outputIndex;
         tolerance = toCopy.tolerance;
@@ -111,7 +111,7 @@ public:
             qReg->RY((real1_f)(-angles.get()[0U]), outputIndex);
         } else {
             // Otherwise, the action can always be represented as a uniformly controlled gate.
-            std::unique_ptr<real1> reverseAngles = std::unique_ptr<real1>(new real1[inputPower]);
+            std::unique_ptr<real1[]> reverseAngles(new real1[inputPower]);
             std::transform(angles.get(), angles.get() + inputPower, reverseAngles.get(), [](real1 r) { return -r; });
             qReg->UniformlyControlledRY(inputIndices, outputIndex, reverseAngles.get());
         }
@@ -182,6 +182,90 @@ public:
         }
     }
 
+    /** Add the gradient of the predicted probability of "expected," with respect to every angle, to "gradient"
+     *
+     * Inputs must be already loaded into "qReg" before calling this method. "gradient" has GetInputPower() elements.
+     * Every angle's part of the prediction is conditioned on one input permutation, so the whole gradient comes from
+     * one table of marginal probabilities, with no trial rotations. With "resetInit," the output is reset to the
+     * 0.5/0.5 superposition, and only the input marginals are needed; otherwise, the gradient is read from the output in
+     * the X basis, after one Predict(). To train on a (mini-)batch, load each sample and call this method with the same
+     * "gradient," then call ApplyGradient() once.
+     *
+     * The return value is the prediction, as from Predict(), before any update.
+     */
+    real1_f AccumulateGradient(bool expected, real1* gradient, bool resetInit = true)
+    {
+        const real1 sign = expected ? ONE_R1 : -ONE_R1;
+
+        if (resetInit) {
+            qReg->SetBit(outputIndex, false);
+            qReg->RY((real1_f)(PI_R1 / 2), outputIndex);
+
+            std::unique_ptr<real1[]> inputProbs(new real1[inputPower]);
+            if (inputIndices.size()) {
+                qReg->ProbBitsAll(inputIndices, inputProbs.get());
+            } else {
+                inputProbs.get()[0U] = ONE_R1;
+            }
+
+            // Conditioned on input permutation "p," the output is RY(angles[p]) * 1/sqrt(2) * (|0> + |1>), so
+            // Prob(1) is (1 + sin(angles[p])) / 2.
+            real1_f prob = ZERO_R1_F;
+            for (bitCapIntOcl perm = 0U; perm < inputPower; ++perm) {
+                const real1 angle = angles.get()[perm];
+                prob += (real1_f)(inputProbs.get()[perm] * (ONE_R1 + (real1)sin(angle)) / 2);
+                gradient[perm] += sign * inputProbs.get()[perm] * (real1)cos(angle) / 2;
+            }
+
+            return expected ? prob : (ONE_R1_F - prob);
+        }
+
+        // d(Prob(1))/d(angles[p]) is half of the expectation of X on the output, after the rotation, projected onto
+        // input permutation "p."
+        const real1_f prob = Predict(expected, false);
+        std::vector<bitLenInt> bits(inputIndices.size() + 1U);
+        bits[0U] = outputIndex;
+        std::copy(inputIndices.begin(), inputIndices.end(), bits.begin() + 1U);
+        std::unique_ptr<real1[]> probs(new real1[inputPower << 1U]);
+        qReg->H(outputIndex);
+        qReg->ProbBitsAll(bits, probs.get());
+        qReg->H(outputIndex);
+        Unpredict(expected);
+
+        for (bitCapIntOcl perm = 0U; perm < inputPower; ++perm) {
+            gradient[perm] += sign * (probs.get()[perm << 1U] - probs.get()[(perm << 1U) | 1U]) / 2;
+        }
+
+        return prob;
+    }
+
+    /** Step every angle up "gradient," (as accumulated by AccumulateGradient()) scaled by "eta"
+     *
+     * "eta" has the same scale as in Learn(): at the untrained default, an "eta" of 0.5 trains a single, classical input
+     * permutation from 0.5/0.5 output probability to 1.0 or 0.0 in one step.
+     */
+    void ApplyGradient(const real1* gradient, real1_f eta)
+    {
+        const real1 scale = (real1)(2 * eta) * PI_R1;
+        for (bitCapIntOcl perm = 0U; perm < inputPower; ++perm) {
+            angles.get()[perm] += scale * gradient[perm];
+        }
+    }
+
+    /** Perform one learning iteration, training all parameters at once, from the analytic gradient
+     *
+     * This is like Learn(), but it costs (at most) one prediction, rather than up to two for every angle.
+     */
+    void LearnGradient(bool expected, real1_f eta, bool resetInit = true)
+    {
+        std::unique_ptr<real1[]> gradient(new real1[inputPower]());
+        const real1_f startProb = AccumulateGradient(expected, gradient.get(), resetInit);
+        if ((ONE_R1 - startProb) <= tolerance) {
+            return;
+        }
+        ApplyGradient(gradient.get(), eta);
+    }
+
 protected:
     real1_f LearnInternal(bool expected, real1_f eta, bitCapInt perm, real1_f startProb)
     {
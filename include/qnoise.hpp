@@ -0,0 +1,91 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qcircuit.hpp"
+
+#include "common/counter_rng.hpp"
+
+#include <map>
+#include <mutex>
+
+namespace Qrack {
+
+class QNoiseModel;
+typedef std::shared_ptr<QNoiseModel> QNoiseModelPtr;
+
+/**
+ * A "Qrack::QNoiseModel" attaches single qubit noise channels, (as Kraus operators,) to the gates of a QCircuit, by
+ * gate width, and adds readout error, then samples shots of the noisy circuit as quantum trajectories, on any
+ * QInterface.
+ *
+ * After every gate of width "w," (its controls and target,) the channel set for width "w," if any, acts on each qubit
+ * the gate touched, independently. Channels follow the gates of the QCircuit as it was optimized, so gates that the
+ * QCircuit fused or cancelled carry noise once, or not at all.
+ *
+ * RunTrajectories() doesn't run one trajectory per shot. Every shot starts in one trajectory, and at each channel, the
+ * shots in a trajectory are split among the Kraus operators by their probabilities, (multinomially). The largest group
+ * continues in place, while every other group continues on a (copy-on-write) Clone(), so the shots share all of the
+ * noiseless, or equally noisy, history before they diverge, and each distinct trajectory is simulated once. Split
+ * trajectories run in parallel, and each is sampled for its share of the shots at the end.
+ */
+class QNoiseModel {
+protected:
+    std::map<bitLenInt, std::vector<complex>> gateNoise;
+    real1_f readoutFlip0;
+    real1_f readoutFlip1;
+    qrack_rand_gen_ptr rand_generator;
+
+    struct TrajectoryContext {
+        std::vector<QCircuitGatePtr> gates;
+        std::vector<real1_f> params;
+        std::vector<bitCapInt> qPowers;
+        std::map<bitCapInt, int> results;
+        std::mutex resultsMutex;
+        uint64_t seed;
+    };
+
+    void RunTrajectory(
+        TrajectoryContext& ctx, QInterfacePtr sim, size_t gate, size_t channel, unsigned shots, uint64_t stream);
+    void SampleTrajectory(TrajectoryContext& ctx, QInterfacePtr sim, unsigned shots, CounterRng& gen);
+
+public:
+    QNoiseModel(qrack_rand_gen_ptr rgp = nullptr);
+
+    /** Kraus operators of the single qubit depolarizing channel: with probability "p," one of X, Y, or Z is applied */
+    static std::vector<complex> DepolarizingKraus(real1_f p);
+    /** Kraus operators of the amplitude damping channel, which decays |1> to |0> with probability "gamma" */
+    static std::vector<complex> AmplitudeDampingKraus(real1_f gamma);
+    /** Kraus operators of the phase damping channel, with "lambda" the probability of a phase-destroying scatter */
+    static std::vector<complex> PhaseDampingKraus(real1_f lambda);
+
+    /**
+     * Set the channel that acts on every qubit of each gate on "width" qubits, (1 for single qubit gates, 2 for
+     * singly-controlled gates, and so on). "kraus" holds the 2x2 Kraus operators in row-major order, consecutively, and
+     * they must satisfy sum_k K_k^+ K_k = I. An empty "kraus" removes the channel.
+     */
+    void SetGateNoise(bitLenInt width, const std::vector<complex>& kraus);
+    /** Set the probabilities that a measured |0> reads as 1, and a measured |1> reads as 0, on every qubit */
+    void SetReadoutError(real1_f flip0, real1_f flip1);
+
+    /** Apply one trajectory step of the noise that follows "gate," to "sim" */
+    void ApplyGateNoise(QInterfacePtr sim, const QCircuitGate& gate);
+
+    /**
+     * Sample "shots" runs of "circuit," with noise, from the initial state "sim," which isn't changed. The returned
+     * histogram maps the measured permutation of every qubit of "sim," (with readout error,) to its number of shots.
+     */
+    std::map<bitCapInt, int> RunTrajectories(QCircuitPtr circuit, QInterfacePtr sim, unsigned shots,
+        const std::vector<real1_f>& params = std::vector<real1_f>());
+};
+} // namespace Qrack
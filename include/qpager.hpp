@@ -12,12 +12,22 @@
 #pragma once
 
 #include "qengine.hpp"
+#include "qubitswapmap.hpp"
 #if ENABLE_OPENCL
 #include "common/oclengine.hpp"
 #endif
 
+#include <list>
+#include <string>
+#include <unordered_map>
+
+// A QRACK_QPAGER_DEVICES entry for a page on the host CPU engine, (co-executing with OpenCL pages)
+#define QRACK_QPAGER_HOST_DEVICE -3
+
 namespace Qrack {
 
+class QEngineCPU;
+
 class QPager;
 typedef std::shared_ptr<QPager> QPagerPtr;
 
@@ -31,6 +41,8 @@ protected:
     bool useGpuThreshold;
     bool isSparse;
     bool useTGadget;
+    bool useQubitMap;
+    bool isQubitMapped;
     bitLenInt segmentGlobalQb;
     bitLenInt minPageQubits;
     bitLenInt maxPageQubits;
@@ -44,10 +56,41 @@ protected:
     bitCapInt basePageCount;
     std::vector<bool> devicesHostPointer;
     std::vector<int64_t> deviceIDs;
+#if ENABLE_NUMA
+    std::vector<int> numaNodes;
+#endif
+    std::string spillDir;
+    size_t maxResidentPages;
+    bool isCompressPages;
+    std::list<std::pair<QEngine*, std::weak_ptr<QEngineCPU>>> residentPages;
+    std::unordered_map<QEngine*, std::list<std::pair<QEngine*, std::weak_ptr<QEngineCPU>>>::iterator> residentPageMap;
     std::vector<QInterfaceEngine> engines;
     std::vector<QEnginePtr> qPages;
+    // Physical (page-order) position of each logical qubit, and the gate "clock" tick when each was last used
+    QubitSwapMap qubitMap;
+    std::vector<size_t> qubitLastUse;
+    size_t qubitUseClock;
 
     QEnginePtr MakeEngine(bitLenInt length, bitCapIntOcl pageId);
+    /** "engines," with the device engine types replaced by QINTERFACE_CPU, for host pages */
+    std::vector<QInterfaceEngine> HostEngines();
+#if ENABLE_OPENCL
+    /**
+     * For CPU+GPU co-execution, interleave host pages into the device list, in proportion to the profiled gate
+     * throughput of the host and the devices, (if both are profiled). With "isAutoHostPointer," device pages on
+     * integrated devices use host pointer buffers.
+     */
+    void InterleaveHostPages(bool isAutoHostPointer);
+#endif
+
+    /**
+     * With out-of-core (memory-mapped) or compressed CPU pages, mark a page most-recently-used, prefetching or
+     * inflating it if it had been evicted. This only hints residency; an evicted page is still correct to use without
+     * it, (since a compressed page inflates itself on first access).
+     */
+    void FaultInPage(const QEnginePtr& page);
+    /** Evict, (or compress,) least-recently-used CPU pages until at most maxResidentPages remain resident. */
+    void EvictColdPages();
 
     void SetQubitCount(bitLenInt qb)
     {
@@ -55,13 +98,43 @@ protected:
         baseQubitsPerPage = (qubitCount < thresholdQubitsPerPage) ? qubitCount : thresholdQubitsPerPage;
         basePageCount = pow2Ocl(qubitCount - baseQubitsPerPage);
         basePageMaxQPower = pow2Ocl(baseQubitsPerPage);
+        // (Callers resolve the qubit map before changing the qubit count.)
+        ResetQubitMap();
     }
 
+    void ResetQubitMap()
+    {
+        qubitMap = QubitSwapMap(qubitCount);
+        qubitLastUse = std::vector<size_t>(qubitCount, 0U);
+        qubitUseClock = 0U;
+        isQubitMapped = false;
+    }
+    /** Physically permute amplitudes back to the identity qubit map, for operations that need logical page order. */
+    void ResolveQubitMap();
+    bitLenInt GetPhysicalQubit(bitLenInt qubit)
+    {
+        qubitLastUse[qubit] = ++qubitUseClock;
+        return qubitMap[qubit];
+    }
+    bitCapInt GetPhysicalPerm(bitCapInt perm) { return isQubitMapped ? qubitMap.map(perm) : perm; }
+    /**
+     * With the adaptive qubit map, (a no-op otherwise,) move a logical qubit that is "global" across pages into the
+     * pages, by evicting the least-recently-used local qubit not in "keep," and return its physical position.
+     */
+    bitLenInt LocalizeQubit(bitLenInt qubit, const std::vector<bitLenInt>& keep = {});
+    /** SWAP two physical qubits, exchanging page halves directly when one is global and the other is local. */
+    void SwapPhysical(bitLenInt qubit1, bitLenInt qubit2);
+    /** Exchange the upper half of each page with the lower half of its partner page, across global qubit "target" */
+    void ShufflePagePairs(bitLenInt target);
+
     bitCapIntOcl pageMaxQPower() { return (bitCapIntOcl)(maxQPower / qPages.size()); }
     bitLenInt pagedQubitCount() { return log2((bitCapInt)qPages.size()); }
     bitLenInt qubitsPerPage() { return log2(pageMaxQPower()); }
     int64_t GetPageDevice(bitCapIntOcl page) { return deviceIDs[page % deviceIDs.size()]; }
     bool GetPageHostPointer(bitCapIntOcl page) { return devicesHostPointer[page % devicesHostPointer.size()]; }
+#if ENABLE_NUMA
+    int GetPageNumaNode(bitCapIntOcl page) { return numaNodes[page % numaNodes.size()]; }
+#endif
 
     void CombineEngines(bitLenInt thresholdBits);
     void CombineEngines() { CombineEngines(qubitCount); }
@@ -126,6 +199,18 @@ public:
             qPages[i]->SetConcurrency(threadsPerEngine);
         }
     }
+    /**
+     * Use an adaptive logical-to-physical qubit map: SWAP gates only relabel qubits, and a general gate on a qubit
+     * that is "global" across pages moves it into the pages, (with one page shuffle,) so later gates on it are local.
+     */
+    void SetAdaptiveQubitMap(bool useMap)
+    {
+        if (!useMap) {
+            ResolveQubitMap();
+        }
+        useQubitMap = useMap;
+    }
+    bool GetAdaptiveQubitMap() { return useQubitMap; }
     void SetTInjection(bool useGadget)
     {
         useTGadget = useGadget;
@@ -138,6 +223,7 @@ public:
 
     QEnginePtr ReleaseEngine()
     {
+        ResolveQubitMap();
         CombineEngines();
         return qPages[0U];
     }
@@ -146,6 +232,7 @@ public:
     {
         qPages.resize(1U);
         qPages[0U] = eng;
+        ResetQubitMap();
     }
 
     void ZeroAmplitudes()
@@ -157,6 +244,11 @@ public:
     void CopyStateVec(QEnginePtr src) { CopyStateVec(std::dynamic_pointer_cast<QPager>(src)); }
     void CopyStateVec(QPagerPtr src)
     {
+        qubitMap = src->qubitMap;
+        qubitLastUse = src->qubitLastUse;
+        qubitUseClock = src->qubitUseClock;
+        isQubitMapped = src->isQubitMapped;
+
         bitLenInt qpp = qubitsPerPage();
         src->CombineEngines(qpp);
         src->SeparateEngines(qpp, true);
@@ -177,10 +269,18 @@ public:
     }
     void GetAmplitudePage(complex* pagePtr, bitCapIntOcl offset, bitCapIntOcl length)
     {
+        ResolveQubitMap();
         GetSetAmplitudePage(pagePtr, NULL, offset, length);
     }
+    void ForEachAmplitudeChunk(bitCapInt offset, bitCapInt length, AmplitudeChunkFn fn, bitCapIntOcl chunkLength = 0U)
+    {
+        // By default, a chunk is a page, read while the next page is copied out.
+        ResolveQubitMap();
+        QEngine::ForEachAmplitudeChunk(offset, length, fn, chunkLength ? chunkLength : pageMaxQPower());
+    }
     void SetAmplitudePage(complex const* pagePtr, bitCapIntOcl offset, bitCapIntOcl length)
     {
+        ResolveQubitMap();
         GetSetAmplitudePage(NULL, pagePtr, offset, length);
     }
     void SetAmplitudePage(QEnginePtr pageEnginePtr, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length)
@@ -189,13 +289,18 @@ public:
     }
     void SetAmplitudePage(QPagerPtr pageEnginePtr, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length)
     {
+        ResolveQubitMap();
+        pageEnginePtr->ResolveQubitMap();
         CombineEngines();
         pageEnginePtr->CombineEngines();
         qPages[0U]->SetAmplitudePage(pageEnginePtr->qPages[0U], srcOffset, dstOffset, length);
     }
+    void ScatterAmplitudes(bitCapIntOcl const* perms, complex const* amps, bitCapIntOcl count);
     void ShuffleBuffers(QEnginePtr engine) { ShuffleBuffers(std::dynamic_pointer_cast<QPager>(engine)); }
     void ShuffleBuffers(QPagerPtr engine)
     {
+        ResolveQubitMap();
+        engine->ResolveQubitMap();
         bitLenInt qpp = qubitsPerPage();
         bitLenInt tcqpp = engine->qubitsPerPage();
         engine->SeparateEngines(qpp, true);
@@ -212,6 +317,8 @@ public:
         }
     }
     QEnginePtr CloneEmpty();
+    void SaveCheckpoint(CheckpointWriter& writer);
+    void LoadCheckpoint(CheckpointReader& reader);
     void QueueSetDoNormalize(bool doNorm)
     {
         Finish();
@@ -224,23 +331,27 @@ public:
     }
     real1_f ProbReg(bitLenInt start, bitLenInt length, bitCapInt permutation)
     {
+        ResolveQubitMap();
         CombineEngines();
         return qPages[0U]->ProbReg(start, length, permutation);
     }
     using QEngine::ApplyM;
     void ApplyM(bitCapInt regMask, bitCapInt result, complex nrm)
     {
+        ResolveQubitMap();
         CombineEngines();
         return qPages[0U]->ApplyM(regMask, result, nrm);
     }
     real1_f GetExpectation(bitLenInt valueStart, bitLenInt valueLength)
     {
+        ResolveQubitMap();
         CombineEngines();
         return qPages[0U]->GetExpectation(valueStart, valueLength);
     }
     void Apply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* mtrx, bitLenInt bitCount,
         const bitCapIntOcl* qPowersSorted, bool doCalcNorm, real1_f norm_thresh = REAL1_DEFAULT_ARG)
     {
+        ResolveQubitMap();
         CombineEngines();
         qPages[0U]->Apply2x2(offset1, offset2, mtrx, bitCount, qPowersSorted, doCalcNorm, norm_thresh);
     }
@@ -256,6 +367,7 @@ public:
 
     real1_f FirstNonzeroPhase()
     {
+        ResolveQubitMap();
         for (bitCapIntOcl i = 0U; i < qPages.size(); ++i) {
             if (!qPages[i]->IsZeroAmplitude()) {
                 return qPages[i]->FirstNonzeroPhase();
@@ -268,20 +380,35 @@ public:
     void SetQuantumState(complex const* inputState);
     void GetQuantumState(complex* outputState);
     void GetProbs(real1* outputProbs);
+    complex const* MapStateVector()
+    {
+        // Only a single page is one contiguous array.
+        ResolveQubitMap();
+        return (qPages.size() == 1U) ? qPages[0U]->MapStateVector() : NULL;
+    }
+    void UnmapStateVector()
+    {
+        if (qPages.size() == 1U) {
+            qPages[0U]->UnmapStateVector();
+        }
+    }
     complex GetAmplitude(bitCapInt perm)
     {
+        perm = GetPhysicalPerm(perm);
         const bitCapIntOcl pmqp = pageMaxQPower();
         const bitCapIntOcl subIndex = (bitCapIntOcl)(perm / pmqp);
         return qPages[subIndex]->GetAmplitude(perm & (pmqp - ONE_BCI));
     }
     void SetAmplitude(bitCapInt perm, complex amp)
     {
+        perm = GetPhysicalPerm(perm);
         const bitCapIntOcl pmqp = pageMaxQPower();
         const bitCapIntOcl subIndex = (bitCapIntOcl)(perm / pmqp);
         qPages[subIndex]->SetAmplitude(perm & (pmqp - ONE_BCI), amp);
     }
     real1_f ProbAll(bitCapInt perm)
     {
+        perm = GetPhysicalPerm(perm);
         const bitCapIntOcl pmqp = pageMaxQPower();
         const bitCapIntOcl subIndex = (bitCapIntOcl)(perm / pmqp);
         return qPages[subIndex]->ProbAll(perm & (pmqp - ONE_BCI));
@@ -306,11 +433,11 @@ public:
     void Mtrx(complex const* mtrx, bitLenInt target);
     void Phase(complex topLeft, complex bottomRight, bitLenInt qubitIndex)
     {
-        ApplySingleEither(false, topLeft, bottomRight, qubitIndex);
+        ApplySingleEither(false, topLeft, bottomRight, GetPhysicalQubit(qubitIndex));
     }
     void Invert(complex topRight, complex bottomLeft, bitLenInt qubitIndex)
     {
-        ApplySingleEither(true, topRight, bottomLeft, qubitIndex);
+        ApplySingleEither(true, topRight, bottomLeft, GetPhysicalQubit(qubitIndex));
     }
     void MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
     {
@@ -320,6 +447,7 @@ public:
     {
         ApplyEitherControlledSingleBit(true, controls, target, mtrx);
     }
+    void MtrxN(complex const* mtrx, const std::vector<bitLenInt>& targets);
 
     void UniformParityRZ(bitCapInt mask, real1_f angle);
     void CUniformParityRZ(const std::vector<bitLenInt>& controls, bitCapInt mask, real1_f angle);
@@ -387,7 +515,7 @@ public:
         }
 
         CombineEngines();
-        return qPages[0U]->ProbParity(mask);
+        return qPages[0U]->ProbParity(GetPhysicalPerm(mask));
     }
     bool ForceMParity(bitCapInt mask, bool result, bool doForce = true)
     {
@@ -396,9 +524,10 @@ public:
         }
 
         CombineEngines();
-        return qPages[0U]->ForceMParity(mask, result, doForce);
+        return qPages[0U]->ForceMParity(GetPhysicalPerm(mask), result, doForce);
     }
     real1_f ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCapInt offset = 0);
+    void ProbBits(const std::vector<bitLenInt>& bits, real1* probsArray);
 
     void UpdateRunningNorm(real1_f norm_thresh = REAL1_DEFAULT_ARG);
     void NormalizeState(
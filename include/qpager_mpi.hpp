@@ -0,0 +1,155 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+#pragma once
+
+#include "qengine.hpp"
+
+#if !ENABLE_MPI
+#error MPI has not been enabled
+#endif
+
+#include <mpi.h>
+
+namespace Qrack {
+
+class QPagerMpi;
+typedef std::shared_ptr<QPagerMpi> QPagerMpiPtr;
+
+/**
+ * A "Qrack::QPagerMpi" spreads a single coherent register over the ranks of an MPI communicator, the way
+ * "Qrack::QPager" spreads one over pages. The highest log2(rank count) qubits are "rank-global:" each rank holds the
+ * contiguous slice of amplitudes selected by its rank index, in a local "Qrack::QEngine," (a QPager, by default).
+ *
+ * Gates that mix amplitudes across a rank-global qubit exchange half-slices with the partner rank, by double-buffered
+ * nonblocking point-to-point transfers, like QPager::ShuffleBuffers(). Probabilities and norms are collective
+ * reductions, and random measurement outcomes are drawn on rank 0 and broadcast. Every rank must make the same
+ * sequence of public method calls, (SPMD style). The rank count must be a power of 2.
+ */
+class QPagerMpi : public QInterface {
+protected:
+    MPI_Comm comm;
+    int rank;
+    int rankCount;
+    bitLenInt globalQubitCount;
+    bitLenInt localQubitCount;
+    bool useHostRam;
+    bool isSparse;
+    int64_t devID;
+    bitLenInt thresholdQubitsPerPage;
+    std::vector<int64_t> deviceIDs;
+    std::vector<QInterfaceEngine> engines;
+    QEnginePtr local;
+
+    static void InitMpi();
+
+    QEnginePtr MakeLocalEngine(bitLenInt length);
+
+    bool IsLocal(bitLenInt qubit) { return qubit < localQubitCount; }
+    bool GetRankBit(bitLenInt qubit) { return (rank >> (qubit - localQubitCount)) & 1; }
+    bitCapIntOcl LocalMaxQPower() { return pow2Ocl(localQubitCount); }
+    real1_f LocalNorm();
+
+    real1_f AllReduceSum(real1_f partial);
+    complex AllReduceSum(complex partial);
+    bool BroadcastResult(bool result);
+
+    /**
+     * Swap the upper half of the local slice on the rank with 0 in rank-global qubit "globalQubit" with the lower
+     * half of the slice on its partner rank, so local qubit (localQubitCount - 1) stands in for that global qubit.
+     */
+    void ExchangeHalves(bitLenInt globalQubit);
+    void ApplyControlled(const std::vector<bitLenInt>& controls, bool isAnti, complex const* mtrx, bitLenInt target);
+
+public:
+    QPagerMpi(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState = 0U,
+        qrack_rand_gen_ptr rgp = nullptr, complex phaseFac = CMPLX_DEFAULT_ARG, bool doNorm = false,
+        bool ignored = false, bool useHostMem = false, int64_t deviceId = -1, bool useHardwareRNG = true,
+        bool useSparseStateVec = false, real1_f norm_thresh = REAL1_EPSILON, std::vector<int64_t> devList = {},
+        bitLenInt qubitThreshold = 0U, real1_f separation_thresh = FP_NORM_EPSILON_F);
+
+    QPagerMpi(bitLenInt qBitCount, bitCapInt initState = 0U, qrack_rand_gen_ptr rgp = nullptr,
+        complex phaseFac = CMPLX_DEFAULT_ARG, bool doNorm = false, bool ignored = false, bool useHostMem = false,
+        int64_t deviceId = -1, bool useHardwareRNG = true, bool useSparseStateVec = false,
+        real1_f norm_thresh = REAL1_EPSILON, std::vector<int64_t> devList = {}, bitLenInt qubitThreshold = 0U,
+        real1_f separation_thresh = FP_NORM_EPSILON_F)
+        : QPagerMpi({ QINTERFACE_QPAGER }, qBitCount, initState, rgp, phaseFac, doNorm, ignored, useHostMem, deviceId,
+              useHardwareRNG, useSparseStateVec, norm_thresh, devList, qubitThreshold, separation_thresh)
+    {
+    }
+
+    int GetRank() { return rank; }
+    int GetRankCount() { return rankCount; }
+
+    void SetConcurrency(uint32_t threadsPerEngine)
+    {
+        QInterface::SetConcurrency(threadsPerEngine);
+        local->SetConcurrency(threadsPerEngine);
+    }
+    void SetTInjection(bool useGadget) { local->SetTInjection(useGadget); }
+    void SetDevice(int64_t dID) { local->SetDevice(dID); }
+
+    void Finish() { local->Finish(); }
+    bool isFinished() { return local->isFinished(); }
+    void Dump() { local->Dump(); }
+
+    void SetPermutation(bitCapInt perm, complex phaseFac = CMPLX_DEFAULT_ARG);
+
+    /** Collective: every rank passes (and reads from) the full state vector. */
+    void SetQuantumState(complex const* inputState);
+    /** Collective: every rank receives the full state vector. */
+    void GetQuantumState(complex* outputState);
+    /** Collective: every rank receives the full probability vector. */
+    void GetProbs(real1* outputProbs);
+    complex GetAmplitude(bitCapInt perm);
+    void SetAmplitude(bitCapInt perm, complex amp);
+
+    using QInterface::Compose;
+    /** Collective: every rank passes the same "toCopy," and "start" must be below the rank-global qubits. */
+    bitLenInt Compose(QInterfacePtr toCopy) { return Compose(toCopy, qubitCount); }
+    bitLenInt Compose(QInterfacePtr toCopy, bitLenInt start);
+    /** Collective: the qubits must be below the rank-global qubits, and every rank receives the same "dest" state. */
+    void Decompose(bitLenInt start, QInterfacePtr dest);
+    /** Collective, like Decompose(start, dest), returning a (rank-local) engine of the local engine type */
+    QInterfacePtr Decompose(bitLenInt start, bitLenInt length);
+    void Dispose(bitLenInt start, bitLenInt length);
+    void Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm);
+    bitLenInt Allocate(bitLenInt start, bitLenInt length);
+
+    void Mtrx(complex const* mtrx, bitLenInt target) { ApplyControlled({}, false, mtrx, target); }
+    void MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+    {
+        ApplyControlled(controls, false, mtrx, target);
+    }
+    void MACMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+    {
+        ApplyControlled(controls, true, mtrx, target);
+    }
+
+    using QInterface::Swap;
+    void Swap(bitLenInt qubit1, bitLenInt qubit2);
+    void FSim(real1_f theta, real1_f phi, bitLenInt qubit1, bitLenInt qubit2);
+
+    bool ForceM(bitLenInt qubit, bool result, bool doForce = true, bool doApply = true);
+
+    real1_f Prob(bitLenInt qubit);
+    real1_f ProbMask(bitCapInt mask, bitCapInt permutation);
+
+    real1_f SumSqrDiff(QInterfacePtr toCompare) { return SumSqrDiff(std::dynamic_pointer_cast<QPagerMpi>(toCompare)); }
+    real1_f SumSqrDiff(QPagerMpiPtr toCompare);
+
+    void UpdateRunningNorm(real1_f norm_thresh = REAL1_DEFAULT_ARG);
+    void NormalizeState(
+        real1_f nrm = REAL1_DEFAULT_ARG, real1_f norm_thresh = REAL1_DEFAULT_ARG, real1_f phaseArg = ZERO_R1_F);
+
+    QInterfacePtr Clone();
+};
+} // namespace Qrack
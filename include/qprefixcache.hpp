@@ -0,0 +1,265 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qinterface.hpp"
+#include "qparity.hpp"
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace Qrack {
+
+class QPrefixCache;
+typedef std::shared_ptr<QPrefixCache> QPrefixCachePtr;
+
+class QPrefixCacheStore;
+typedef std::shared_ptr<QPrefixCacheStore> QPrefixCacheStorePtr;
+
+/**
+ * The snapshots of a QPrefixCache, keyed by the hash of the gate stream that produced them, and evicted least-recently
+ * used first, to stay within "maxBytes." A store is shared by a QPrefixCache and all of its clones, and it is
+ * thread-safe.
+ */
+class QPrefixCacheStore {
+protected:
+    struct Entry {
+        // A second, independent hash of the prefix, to rule out collisions
+        uint64_t check;
+        bitLenInt qubitCount;
+        // Exactly one of a cloned simulator or a checkpoint blob
+        QInterfacePtr snapshot;
+        std::shared_ptr<std::string> blob;
+        size_t bytes;
+        std::list<uint64_t>::iterator lruIt;
+    };
+
+    std::mutex mtx;
+    std::unordered_map<uint64_t, Entry> entries;
+    // Most recently used first
+    std::list<uint64_t> lru;
+    size_t maxBytes;
+    size_t usedBytes;
+    uint64_t hits;
+    uint64_t misses;
+
+    void Evict(std::unordered_map<uint64_t, Entry>::iterator it);
+
+public:
+    QPrefixCacheStore(size_t mxBytes)
+        : maxBytes(mxBytes)
+        , usedBytes(0U)
+        , hits(0U)
+        , misses(0U)
+    {
+    }
+
+    /// Bound the total size of all snapshots, evicting as needed, (where 0 disables the cache)
+    void SetMaxBytes(size_t mxBytes);
+    size_t GetMaxBytes() { return maxBytes; }
+    size_t GetUsedBytes() { return usedBytes; }
+    size_t GetEntryCount() { return entries.size(); }
+    /// Count of lookups that resumed from a cached prefix
+    uint64_t GetHits() { return hits; }
+    /// Count of lookups that found no cached prefix
+    uint64_t GetMisses() { return misses; }
+    void Clear();
+
+    /// True if the prefix is cached, (without counting a lookup)
+    bool Has(uint64_t key, uint64_t check, bitLenInt qubitCount);
+    /// Store a snapshot of "bytes," unless it could never fit
+    void Put(uint64_t key, uint64_t check, bitLenInt qubitCount, QInterfacePtr snapshot,
+        std::shared_ptr<std::string> blob, size_t bytes);
+    /// Fetch a snapshot, (marking it most recently used,) or return false
+    bool Get(uint64_t key, uint64_t check, bitLenInt qubitCount, QInterfacePtr& snapshot,
+        std::shared_ptr<std::string>& blob);
+    void CountMiss();
+};
+
+/**
+ * A "Qrack::QPrefixCache" wraps another simulator, for parameter sweeps that rerun a circuit with only its last few
+ * gates changed.
+ *
+ * From each SetPermutation(), gates are recorded, with a running hash of the gate stream, rather than applied. When an
+ * operation needs the state, the simulator resumes from the snapshot of the longest recorded prefix that the shared
+ * QPrefixCacheStore holds, (if any,) and replays only the gates after it, snapshotting the state again after every
+ * "snapshotInterval" gates of the stream. Snapshots are clones, (which the state vector engines copy on write,) or,
+ * with SetUseCheckpoints(), checkpoint blobs of exactly known size.
+ *
+ * Any other operation that changes the state, (such as measurement, Compose(), or SetAmplitude(),) stops caching
+ * until the next SetPermutation(), since the stream no longer determines the state.
+ */
+class QPrefixCache : public QParity, public QInterface {
+protected:
+    enum PrefixOpType { PREFIX_MTRX = 0, PREFIX_MCMTRX, PREFIX_MACMTRX, PREFIX_SWAP, PREFIX_FSIM, PREFIX_PARITY_RZ };
+
+    struct PrefixOp {
+        PrefixOpType type;
+        std::vector<bitLenInt> controls;
+        complex mtrx[4U];
+        bitLenInt target1;
+        bitLenInt target2;
+        bitCapInt mask;
+        real1_f theta;
+        real1_f phi;
+        // Hashes and depth of the stream through this gate
+        uint64_t key;
+        uint64_t check;
+        size_t depth;
+    };
+
+    bool isCacheable;
+    bool isPermPending;
+    bool useCheckpoints;
+    size_t snapshotInterval;
+    size_t depth;
+    uint64_t key;
+    uint64_t check;
+    bitCapInt initPerm;
+    complex initPhase;
+    QInterfacePtr engine;
+    QPrefixCacheStorePtr store;
+    std::vector<PrefixOp> pending;
+
+    void InitSettings();
+    void HashWord(uint64_t word);
+    void HashPerm(bitCapInt perm);
+    void HashReal(real1_f r);
+    void Record(PrefixOp& op);
+    void Apply(const PrefixOp& op);
+    void Snapshot(const PrefixOp& op);
+    bool Restore(const PrefixOp& op);
+    QParity* EngineParity();
+
+    /// Apply every recorded gate to the engine, resuming from the longest cached prefix
+    void Materialize();
+
+    /// The stream no longer determines the state, until the next SetPermutation()
+    void EndCaching()
+    {
+        isCacheable = false;
+        SetQubitCount(engine->GetQubitCount());
+    }
+
+    static QInterfacePtr Unwrap(QInterfacePtr qReg)
+    {
+        QPrefixCachePtr cache = std::dynamic_pointer_cast<QPrefixCache>(qReg);
+        return cache ? cache->GetEngine() : qReg;
+    }
+
+public:
+    QPrefixCache(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState = 0U,
+        qrack_rand_gen_ptr rgp = nullptr, complex phaseFac = CMPLX_DEFAULT_ARG, bool doNorm = false,
+        bool randomGlobalPhase = true, bool useHostMem = false, int64_t deviceId = -1, bool useHardwareRNG = true,
+        bool useSparseStateVec = false, real1_f norm_thresh = REAL1_EPSILON, std::vector<int64_t> devList = {},
+        bitLenInt qubitThreshold = 0U, real1_f separation_thresh = FP_NORM_EPSILON_F);
+
+    QPrefixCache(bitLenInt qBitCount, bitCapInt initState = 0U, qrack_rand_gen_ptr rgp = nullptr,
+        complex phaseFac = CMPLX_DEFAULT_ARG, bool doNorm = false, bool randomGlobalPhase = true,
+        bool useHostMem = false, int64_t deviceId = -1, bool useHardwareRNG = true, bool useSparseStateVec = false,
+        real1_f norm_thresh = REAL1_EPSILON, std::vector<int64_t> devList = {}, bitLenInt qubitThreshold = 0U,
+        real1_f separation_thresh = FP_NORM_EPSILON_F)
+        : QPrefixCache({ QINTERFACE_OPTIMAL }, qBitCount, initState, rgp, phaseFac, doNorm, randomGlobalPhase,
+              useHostMem, deviceId, useHardwareRNG, useSparseStateVec, norm_thresh, devList, qubitThreshold,
+              separation_thresh)
+    {
+    }
+
+    /// Wrap an existing simulator, (in its current state,) sharing "s," or else a new store, for snapshots
+    QPrefixCache(QInterfacePtr eng, QPrefixCacheStorePtr s = NULL);
+
+    /// The wrapped simulator, with every recorded gate applied
+    QInterfacePtr GetEngine()
+    {
+        Materialize();
+        return engine;
+    }
+    QPrefixCacheStorePtr GetStore() { return store; }
+
+    /// Snapshot after every "interval" gates of the stream since SetPermutation(), (at least 1)
+    void SetSnapshotInterval(size_t interval) { snapshotInterval = interval ? interval : 1U; }
+    size_t GetSnapshotInterval() { return snapshotInterval; }
+    /// Snapshot as checkpoint blobs, (if the engine supports them,) rather than clones
+    void SetUseCheckpoints(bool useCp) { useCheckpoints = useCp; }
+    bool GetUseCheckpoints() { return useCheckpoints; }
+
+    void SetConcurrency(uint32_t threadCount)
+    {
+        QInterface::SetConcurrency(threadCount);
+        engine->SetConcurrency(threadCount);
+    }
+
+    void SetPermutation(bitCapInt perm, complex phaseFac = CMPLX_DEFAULT_ARG);
+
+    void SetQuantumState(complex const* inputState);
+    void GetQuantumState(complex* outputState);
+    void GetProbs(real1* outputProbs);
+    complex GetAmplitude(bitCapInt perm);
+    void SetAmplitude(bitCapInt perm, complex amp);
+
+    using QInterface::Compose;
+    bitLenInt Compose(QInterfacePtr toCopy, bitLenInt start);
+    void Decompose(bitLenInt start, QInterfacePtr dest);
+    QInterfacePtr Decompose(bitLenInt start, bitLenInt length);
+    void Dispose(bitLenInt start, bitLenInt length);
+    void Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm);
+    using QInterface::Allocate;
+    bitLenInt Allocate(bitLenInt start, bitLenInt length);
+
+    void Mtrx(complex const* mtrx, bitLenInt target);
+    void MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target);
+    void MACMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target);
+    using QInterface::Swap;
+    void Swap(bitLenInt qubit1, bitLenInt qubit2);
+    void FSim(real1_f theta, real1_f phi, bitLenInt qubit1, bitLenInt qubit2);
+    void CUniformParityRZ(const std::vector<bitLenInt>& controls, bitCapInt mask, real1_f angle);
+
+    bool ForceM(bitLenInt qubit, bool result, bool doForce = true, bool doApply = true);
+    bitCapInt ForceMReg(
+        bitLenInt start, bitLenInt length, bitCapInt result, bool doForce = true, bool doApply = true);
+    bitCapInt MAll();
+    bool ForceMParity(bitCapInt mask, bool result, bool doForce = true);
+    real1_f ProbParity(bitCapInt mask);
+
+    real1_f Prob(bitLenInt qubit);
+    real1_f ProbAll(bitCapInt fullRegister);
+    real1_f ProbReg(bitLenInt start, bitLenInt length, bitCapInt permutation);
+    real1_f ProbMask(bitCapInt mask, bitCapInt permutation);
+    void ProbBitsAll(const std::vector<bitLenInt>& bits, real1* probsArray);
+    real1_f ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCapInt offset = 0U);
+    std::map<bitCapInt, int> MultiShotMeasureMask(const std::vector<bitCapInt>& qPowers, unsigned shots);
+    void MultiShotMeasureMask(const std::vector<bitCapInt>& qPowers, unsigned shots, unsigned long long* shotsArray);
+
+    real1_f SumSqrDiff(QInterfacePtr toCompare);
+    void UpdateRunningNorm(real1_f norm_thresh = REAL1_DEFAULT_ARG);
+    void NormalizeState(
+        real1_f nrm = REAL1_DEFAULT_ARG, real1_f norm_thresh = REAL1_DEFAULT_ARG, real1_f phaseArg = ZERO_R1_F);
+
+    void Finish() { engine->Finish(); }
+    bool isFinished() { return !isPermPending && !pending.size() && engine->isFinished(); }
+    void Dump()
+    {
+        pending.clear();
+        engine->Dump();
+        EndCaching();
+    }
+
+    void SaveCheckpoint(CheckpointWriter& writer);
+    void LoadCheckpoint(CheckpointReader& reader);
+
+    QInterfacePtr Clone();
+    void SetDevice(int64_t dID) { engine->SetDevice(dID); }
+    int64_t GetDevice() { return engine->GetDevice(); }
+};
+} // namespace Qrack
@@ -30,6 +30,7 @@
 #include "common/dispatchqueue.hpp"
 #endif
 
+#include <algorithm>
 #include <cstdint>
 
 namespace Qrack {
@@ -49,6 +50,8 @@ class QStabilizer;
 typedef std::shared_ptr<QStabilizer> QStabilizerPtr;
 
 class QStabilizer : public QInterface {
+    friend class QStabilizerRank;
+
 protected:
     unsigned rawRandBools;
     unsigned rawRandBoolsRemaining;
@@ -60,12 +63,50 @@ protected:
 
     // Phase bits: 0 for +1, 1 for i, 2 for -1, 3 for -i.  Normally either 0 or 2.
     std::vector<uint8_t> r;
-    // Typedef for special type std::vector<bool> compatibility
-    typedef std::vector<bool> BoolVector;
+    // One tableau row of Pauli bits, packed 64 qubits to a word, (as in the original CHP,) with zeroed padding bits
+    typedef std::vector<uint64_t> BitRow;
     // (2n+1)*n matrix for stabilizer/destabilizer x bits (there's one "scratch row" at the bottom)
-    std::vector<BoolVector> x;
+    std::vector<BitRow> x;
     // (2n+1)*n matrix for z bits
-    std::vector<BoolVector> z;
+    std::vector<BitRow> z;
+
+    static size_t WordCount(bitLenInt n) { return ((size_t)n + 63U) >> 6U; }
+    static bool GetBit(const BitRow& row, bitLenInt j) { return (row[j >> 6U] >> (j & 63U)) & 1U; }
+    static void SetBit(BitRow& row, bitLenInt j) { row[j >> 6U] |= 1ULL << (j & 63U); }
+    static void FlipBit(BitRow& row, bitLenInt j) { row[j >> 6U] ^= 1ULL << (j & 63U); }
+    static void XorBit(BitRow& row, bitLenInt j, bool v) { row[j >> 6U] ^= ((uint64_t)v) << (j & 63U); }
+    static void SetBitTo(BitRow& row, bitLenInt j, bool v)
+    {
+        const uint64_t mask = 1ULL << (j & 63U);
+        row[j >> 6U] = v ? (row[j >> 6U] | mask) : (row[j >> 6U] & ~mask);
+    }
+    /// Swap bits j and k, within one row
+    static void SwapBits(BitRow& row, bitLenInt j, bitLenInt k)
+    {
+        if (GetBit(row, j) != GetBit(row, k)) {
+            FlipBit(row, j);
+            FlipBit(row, k);
+        }
+    }
+    /// Swap bit j between two rows
+    static void SwapBits(BitRow& row1, BitRow& row2, bitLenInt j)
+    {
+        if (GetBit(row1, j) != GetBit(row2, j)) {
+            FlipBit(row1, j);
+            FlipBit(row2, j);
+        }
+    }
+    static bitLenInt PopCount(uint64_t v)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return (bitLenInt)__builtin_popcountll(v);
+#else
+        v = v - ((v >> 1U) & 0x5555555555555555ULL);
+        v = (v & 0x3333333333333333ULL) + ((v >> 2U) & 0x3333333333333333ULL);
+        v = (v + (v >> 4U)) & 0x0F0F0F0F0F0F0F0FULL;
+        return (bitLenInt)((v * 0x0101010101010101ULL) >> 56U);
+#endif
+    }
 
     typedef std::function<void(const bitLenInt&)> StabilizerParallelFunc;
     typedef std::function<void(void)> DispatchFn;
@@ -110,6 +151,8 @@ public:
     ~QStabilizer() { Dump(); }
 
     QInterfacePtr Clone();
+    void SaveCheckpoint(CheckpointWriter& writer);
+    void LoadCheckpoint(CheckpointReader& reader);
 
     bool isClifford() { return true; };
     bool isClifford(bitLenInt qubit) { return true; };
@@ -193,32 +236,59 @@ protected:
     /// Sets row i equal to the bth observable (X_1,...X_n,Z_1,...,Z_n)
     void rowset(const bitLenInt& i, bitLenInt b)
     {
-        // Dealloc, first
-        x[i] = BoolVector();
-        z[i] = BoolVector();
-
-        x[i] = BoolVector(qubitCount, false);
-        z[i] = BoolVector(qubitCount, false);
+        std::fill(x[i].begin(), x[i].end(), 0U);
+        std::fill(z[i].begin(), z[i].end(), 0U);
         r[i] = 0;
 
         if (b < qubitCount) {
-            x[i][b] = true;
+            SetBit(x[i], b);
         } else {
             b -= qubitCount;
-            z[i][b] = true;
+            SetBit(z[i], b);
         }
     }
     /// Left-multiply row i by row k - does not change the logical state
     void rowmult(const bitLenInt& i, const bitLenInt& k)
     {
         r[i] = clifford(i, k);
-        for (bitLenInt j = 0U; j < qubitCount; ++j) {
-            x[i][j] = x[i][j] ^ x[k][j];
-            z[i][j] = z[i][j] ^ z[k][j];
+        BitRow& xi = x[i];
+        BitRow& zi = z[i];
+        const BitRow& xk = x[k];
+        const BitRow& zk = z[k];
+        const size_t wordCount = xi.size();
+        // (Plain word loops, for the compiler to vectorize)
+        for (size_t w = 0U; w < wordCount; ++w) {
+            xi[w] ^= xk[w];
+        }
+        for (size_t w = 0U; w < wordCount; ++w) {
+            zi[w] ^= zk[w];
         }
     }
     /// Return the phase (0,1,2,3) when row i is LEFT-multiplied by row k
-    uint8_t clifford(const bitLenInt& i, const bitLenInt& k);
+    uint8_t clifford(const bitLenInt& i, const bitLenInt& k) { return clifford(x[i], z[i], r[i], k); }
+    /// Return the phase (0,1,2,3) when the row (xi, zi, ri) is LEFT-multiplied by row k
+    uint8_t clifford(const BitRow& xi, const BitRow& zi, const uint8_t& ri, const bitLenInt& k);
+
+    /// A copy of the scratch row, held apart from the tableau, so each thread can walk its own basis states
+    struct PauliRow {
+        BitRow x;
+        BitRow z;
+        uint8_t r;
+    };
+    /// Left-multiply "row" by tableau row k
+    void rowmult(PauliRow& row, const bitLenInt& k)
+    {
+        row.r = clifford(row.x, row.z, row.r, k);
+        const BitRow& xk = x[k];
+        const BitRow& zk = z[k];
+        const size_t wordCount = row.x.size();
+        for (size_t w = 0U; w < wordCount; ++w) {
+            row.x[w] ^= xk[w];
+        }
+        for (size_t w = 0U; w < wordCount; ++w) {
+            row.z[w] ^= zk[w];
+        }
+    }
 
     /**
      * Do Gaussian elimination to put the stabilizer generators in the following form:
@@ -235,17 +305,24 @@ protected:
      */
     void seed(const bitLenInt& g);
 
-    /// Helper for setBasisState() and setBasisProb()
-    AmplitudeEntry getBasisAmp(const real1_f& nrm);
-
-    /// Returns the result of applying the Pauli operator in the "scratch space" of q to |0...0>
-    void setBasisState(const real1_f& nrm, complex* stateVec);
-
-    /// Returns the result of applying the Pauli operator in the "scratch space" of q to |0...0>
-    void setBasisState(const real1_f& nrm, QInterfacePtr eng);
+    /// The basis state amplitude from applying the Pauli operator in the "scratch space" of q to |0...0>
+    AmplitudeEntry getBasisAmp(const real1_f& nrm)
+    {
+        const bitLenInt elemCount = qubitCount << 1U;
+        return getBasisAmp(x[elemCount], z[elemCount], r[elemCount], nrm);
+    }
+    /// The basis state amplitude from applying the Pauli operator (xs, zs, rs) to |0...0>
+    AmplitudeEntry getBasisAmp(const BitRow& xs, const BitRow& zs, const uint8_t& rs, const real1_f& nrm);
 
-    /// Returns the probability from applying the Pauli operator in the "scratch space" of q to |0...0>
-    void setBasisProb(const real1_f& nrm, real1* outputProbs);
+    typedef std::function<void(const bitCapIntOcl&, const AmplitudeEntry&)> BasisAmpFunc;
+    /**
+     * After gaussian() and seed(g), call fn(t, amplitude) for each nonzero basis state "t" in [begin, end) of the 2^g,
+     * (in the order of the serial walk over the scratch row,) in parallel. Basis state "t" is the seed multiplied by
+     * the X generators of the set bits of "t," so each chunk of the walk starts from its own copy of the scratch row.
+     * The scratch row itself isn't changed.
+     */
+    void ForEachBasisAmp(
+        const bitLenInt& g, const bitCapIntOcl& begin, const bitCapIntOcl& end, const real1_f& nrm, BasisAmpFunc fn);
 
     void DecomposeDispose(const bitLenInt start, const bitLenInt length, QStabilizerPtr toCopy);
 
@@ -310,7 +387,7 @@ public:
     void GetQuantumState(complex* stateVec);
 
     /// Convert the state to ket notation, directly into another QInterface
-    void GetQuantumState(QInterfacePtr eng);
+    virtual void GetQuantumState(QInterfacePtr eng);
 
     /// Get all probabilities corresponding to ket notation
     void GetProbs(real1* outputProbs);
@@ -318,10 +395,19 @@ public:
     /// Get a single basis state amplitude
     complex GetAmplitude(bitCapInt perm);
 
+    using QInterface::MultiShotMeasureMask;
+    /**
+     * Sample shots directly from the tableau, without measuring or cloning it. After one gaussian() reduction, the
+     * nonzero basis states are the seed permutation XOR every combination of the X generators, all with equal
+     * probability. Projected onto the measured qubits, those generators span at most one 64 bit word, so each shot is
+     * the projected seed XOR a uniformly random combination of a reduced basis of that span, read from byte tables.
+     */
+    void MultiShotMeasureMask(const std::vector<bitCapInt>& qPowers, unsigned shots, unsigned long long* shotsArray);
+
     /**
      * Returns "true" if target qubit is a Z basis eigenstate
      */
-    bool IsSeparableZ(const bitLenInt& target);
+    virtual bool IsSeparableZ(const bitLenInt& target);
     /**
      * Returns "true" if target qubit is an X basis eigenstate
      */
@@ -346,7 +432,7 @@ public:
     {
         return Compose(std::dynamic_pointer_cast<QStabilizer>(toCopy), start);
     }
-    bitLenInt Compose(QStabilizerPtr toCopy, bitLenInt start);
+    virtual bitLenInt Compose(QStabilizerPtr toCopy, bitLenInt start);
     void Decompose(bitLenInt start, QInterfacePtr dest)
     {
         DecomposeDispose(start, dest->GetQubitCount(), std::dynamic_pointer_cast<QStabilizer>(dest));
@@ -357,7 +443,7 @@ public:
     {
         DecomposeDispose(start, length, (QStabilizerPtr)NULL);
     }
-    bool CanDecomposeDispose(const bitLenInt start, const bitLenInt length);
+    virtual bool CanDecomposeDispose(const bitLenInt start, const bitLenInt length);
     using QInterface::Allocate;
     bitLenInt Allocate(bitLenInt start, bitLenInt length)
     {
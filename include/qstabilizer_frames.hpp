@@ -0,0 +1,145 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "common/parallel_for.hpp"
+#include "common/rdrandwrapper.hpp"
+
+#include <random>
+
+namespace Qrack {
+
+class QStabilizerFrames;
+typedef std::shared_ptr<QStabilizerFrames> QStabilizerFramesPtr;
+
+enum FrameOpType {
+    FRAME_H = 0,
+    FRAME_S,
+    FRAME_IS,
+    FRAME_X,
+    FRAME_Y,
+    FRAME_Z,
+    FRAME_CNOT,
+    FRAME_CY,
+    FRAME_CZ,
+    FRAME_SWAP,
+    FRAME_X_ERROR,
+    FRAME_Y_ERROR,
+    FRAME_Z_ERROR,
+    FRAME_DEPOLARIZE1,
+    FRAME_DEPOLARIZE2,
+    FRAME_M,
+    FRAME_R
+};
+
+struct FrameOp {
+    FrameOpType type;
+    bitLenInt q1;
+    bitLenInt q2;
+    real1_f p;
+
+    FrameOp(FrameOpType t, bitLenInt a, bitLenInt b, real1_f prob)
+        : type(t)
+        , q1(a)
+        , q2(b)
+        , p(prob)
+    {
+    }
+};
+
+/**
+ * A "Qrack::QStabilizerFrames" samples a noisy Clifford circuit, (like a quantum error correction memory experiment,)
+ * many times over, by Pauli-frame propagation.
+ *
+ * The circuit is recorded first, then the noiseless circuit is run once on a QStabilizer, for one reference
+ * measurement record. Each shot is that reference, XOR the flips accumulated by a Pauli frame, (the X and Z error
+ * components on every qubit,) which Clifford gates just permute. Frames are bit-packed, 64 shots to a word, and
+ * propagated "frameWidth" shots (64 to 512) at a time, so a shot costs a few word operations per gate. Z frame bits are
+ * randomized wherever the state is a Z eigenstate, (on initialization, after measurement, and after reset,) which is
+ * what reproduces the random outcomes of the real circuit.
+ */
+class QStabilizerFrames : public ParallelFor {
+protected:
+    bitLenInt qubitCount;
+    size_t frameWords;
+    size_t measurementCount;
+    std::vector<FrameOp> ops;
+    std::vector<bool> reference;
+    bool isReferenceStale;
+    qrack_rand_gen_ptr rand_generator;
+    std::shared_ptr<RdRandom> hardware_rand_generator;
+
+    void Append(FrameOpType type, bitLenInt q1, bitLenInt q2, real1_f p);
+    uint64_t RandSeed();
+    void SampleBlock(uint64_t seed, uint64_t block, std::vector<uint64_t>& records);
+
+public:
+    QStabilizerFrames(bitLenInt qBitCount, size_t frameWidth = 256U, qrack_rand_gen_ptr rgp = nullptr,
+        bool useHardwareRNG = true);
+
+    bitLenInt GetQubitCount() { return qubitCount; }
+    /** Shots propagated together, per frame block */
+    size_t GetFrameWidth() { return frameWords << 6U; }
+    /** Measurements recorded so far, (the length of every shot record, in bits) */
+    size_t GetMeasurementCount() { return measurementCount; }
+    /** 64-bit words per packed shot record */
+    size_t GetRecordWords() { return (measurementCount + 63U) >> 6U; }
+
+    /** Discard the recorded circuit. */
+    void Clear();
+
+    void H(bitLenInt q) { Append(FRAME_H, q, q, ZERO_R1_F); }
+    void S(bitLenInt q) { Append(FRAME_S, q, q, ZERO_R1_F); }
+    void IS(bitLenInt q) { Append(FRAME_IS, q, q, ZERO_R1_F); }
+    void X(bitLenInt q) { Append(FRAME_X, q, q, ZERO_R1_F); }
+    void Y(bitLenInt q) { Append(FRAME_Y, q, q, ZERO_R1_F); }
+    void Z(bitLenInt q) { Append(FRAME_Z, q, q, ZERO_R1_F); }
+    void CNOT(bitLenInt c, bitLenInt t) { Append(FRAME_CNOT, c, t, ZERO_R1_F); }
+    void CY(bitLenInt c, bitLenInt t) { Append(FRAME_CY, c, t, ZERO_R1_F); }
+    void CZ(bitLenInt c, bitLenInt t) { Append(FRAME_CZ, c, t, ZERO_R1_F); }
+    void Swap(bitLenInt q1, bitLenInt q2) { Append(FRAME_SWAP, q1, q2, ZERO_R1_F); }
+
+    /** Apply X to "q" with probability "p" */
+    void XError(bitLenInt q, real1_f p) { Append(FRAME_X_ERROR, q, q, p); }
+    /** Apply Y to "q" with probability "p" */
+    void YError(bitLenInt q, real1_f p) { Append(FRAME_Y_ERROR, q, q, p); }
+    /** Apply Z to "q" with probability "p" */
+    void ZError(bitLenInt q, real1_f p) { Append(FRAME_Z_ERROR, q, q, p); }
+    /** With probability "p," apply one of X, Y, or Z, uniformly at random */
+    void Depolarize1(bitLenInt q, real1_f p) { Append(FRAME_DEPOLARIZE1, q, q, p); }
+    /** With probability "p," apply one of the 15 non-identity two-qubit Paulis, uniformly at random */
+    void Depolarize2(bitLenInt q1, bitLenInt q2, real1_f p) { Append(FRAME_DEPOLARIZE2, q1, q2, p); }
+
+    /**
+     * Measure "q" in the Z basis, with the recorded result flipped with probability "flipProb." Returns the record
+     * index of this measurement.
+     */
+    size_t M(bitLenInt q, real1_f flipProb = ZERO_R1_F)
+    {
+        Append(FRAME_M, q, q, flipProb);
+        return measurementCount++;
+    }
+    /** Reset "q" to |0> */
+    void R(bitLenInt q) { Append(FRAME_R, q, q, ZERO_R1_F); }
+
+    /** The noiseless reference measurement record, (one valid outcome of the circuit, computed once). */
+    const std::vector<bool>& GetReference();
+
+    /**
+     * Sample "shots" complete runs of the recorded circuit. "records" receives (shots * GetRecordWords()) words:
+     * shot "s" is the packed record at [s * GetRecordWords(), (s + 1) * GetRecordWords()), with measurement "m" in
+     * bit (m % 64) of word (m / 64), and the padding bits cleared.
+     */
+    void MeasureShots(unsigned shots, unsigned long long* records);
+};
+} // namespace Qrack
@@ -0,0 +1,137 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "common/qrack_types.hpp"
+
+#if !ENABLE_OPENCL
+#error OpenCL has not been enabled
+#endif
+
+#include "common/oclengine.hpp"
+#include "qstabilizer.hpp"
+
+namespace Qrack {
+
+class QStabilizerOCL;
+typedef std::shared_ptr<QStabilizerOCL> QStabilizerOCLPtr;
+
+// (These must match the STAB_... op codes in qstabilizer.cl.)
+enum StabilizerGateOCL {
+    STAB_CNOT = 0,
+    STAB_ANTICNOT,
+    STAB_CY,
+    STAB_ANTICY,
+    STAB_CZ,
+    STAB_ANTICZ,
+    STAB_SWAP,
+    STAB_ISWAP,
+    STAB_IISWAP,
+    STAB_H,
+    STAB_S,
+    STAB_IS,
+    STAB_Z,
+    STAB_X,
+    STAB_Y
+};
+
+/**
+ * A "Qrack::QStabilizerOCL" is a QStabilizer that keeps its bit-packed tableau resident on an OpenCL device, (one work
+ * item per row,) for very wide Clifford circuits.
+ *
+ * Clifford gates and ForceM() run on the device. Everything else, (Gaussian elimination, state vector conversion,
+ * Compose()/Decompose(), and gates that must track global phase,) runs on the inherited host tableau: Finish() pulls
+ * the device tableau back to the host, and the next device gate pushes it back up.
+ */
+class QStabilizerOCL : public QStabilizer {
+protected:
+    typedef std::shared_ptr<cl::Buffer> BufferPtr;
+
+    int64_t devID;
+    DeviceContextPtr device_context;
+    // Our own in-order queue, on the shared OCLEngine device context
+    cl::CommandQueue queue;
+    BufferPtr xBuffer;
+    BufferPtr zBuffer;
+    BufferPtr rBuffer;
+    BufferPtr pivotBuffer;
+    bitLenInt deviceQubitCount;
+    // The device tableau has changes that the host tableau does not
+    bool isHostStale;
+    // The host tableau has changes that the device tableau does not
+    bool isDeviceStale;
+
+    cl_uint DeviceWordCount() { return (cl_uint)WordCount(qubitCount); }
+    cl_uint DeviceRowCount() { return (cl_uint)((qubitCount << 1U) + 1U); }
+
+    void ResetDeviceBuffers();
+    /** Push the host tableau to the device, if the device copy is out of date. */
+    void SyncToDevice();
+    /** Pull the device tableau to the host, if the host copy is out of date. */
+    void SyncToHost();
+    void ApplyGate(StabilizerGateOCL op, bitLenInt c, bitLenInt t);
+
+public:
+    QStabilizerOCL(bitLenInt n, bitCapInt perm = 0U, qrack_rand_gen_ptr rgp = nullptr,
+        complex ignored = CMPLX_DEFAULT_ARG, bool doNorm = false, bool randomGlobalPhase = true, bool ignored2 = false,
+        int64_t deviceId = -1, bool useHardwareRNG = true, bool ignored4 = false, real1_f ignored5 = REAL1_EPSILON,
+        std::vector<int64_t> ignored6 = {}, bitLenInt ignored7 = 0U, real1_f ignored8 = FP_NORM_EPSILON_F);
+
+    QInterfacePtr Clone();
+
+    /** Completes pending host work and makes the host tableau current, (and the authoritative copy). */
+    void Finish()
+    {
+        QStabilizer::Finish();
+        SyncToHost();
+        isDeviceStale = true;
+    }
+
+    bool isFinished() { return QStabilizer::isFinished() && !isHostStale; }
+
+    void Dump()
+    {
+        QStabilizer::Dump();
+        isHostStale = false;
+        isDeviceStale = true;
+    }
+
+    void SetDevice(int64_t dID);
+    int64_t GetDevice() { return devID; }
+
+    void CNOT(bitLenInt control, bitLenInt target) { ApplyGate(STAB_CNOT, control, target); }
+    void AntiCNOT(bitLenInt control, bitLenInt target) { ApplyGate(STAB_ANTICNOT, control, target); }
+    void CY(bitLenInt control, bitLenInt target);
+    void AntiCY(bitLenInt control, bitLenInt target);
+    void CZ(bitLenInt control, bitLenInt target);
+    void AntiCZ(bitLenInt control, bitLenInt target);
+    using QStabilizer::H;
+    void H(bitLenInt qubitIndex) { ApplyGate(STAB_H, qubitIndex, qubitIndex); }
+    void S(bitLenInt qubitIndex);
+    void IS(bitLenInt qubitIndex);
+    void Z(bitLenInt qubitIndex);
+    using QStabilizer::X;
+    void X(bitLenInt qubitIndex) { ApplyGate(STAB_X, qubitIndex, qubitIndex); }
+    void Y(bitLenInt qubitIndex);
+    void Swap(bitLenInt qubitIndex1, bitLenInt qubitIndex2)
+    {
+        if (qubitIndex1 != qubitIndex2) {
+            ApplyGate(STAB_SWAP, qubitIndex1, qubitIndex2);
+        }
+    }
+    void ISwap(bitLenInt qubitIndex1, bitLenInt qubitIndex2);
+    void IISwap(bitLenInt qubitIndex1, bitLenInt qubitIndex2);
+
+    bool ForceM(bitLenInt t, bool result, bool doForce = true, bool doApply = true);
+};
+} // namespace Qrack
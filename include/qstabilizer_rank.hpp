@@ -0,0 +1,159 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qstabilizer.hpp"
+
+#include <map>
+
+namespace Qrack {
+
+class QStabilizerRank;
+typedef std::shared_ptr<QStabilizerRank> QStabilizerRankPtr;
+
+/**
+ * A "Qrack::QStabilizerRank" is a QStabilizer that can also hold a weighted sum of stabilizer states, for circuits
+ * with few non-Clifford gates.
+ *
+ * Every term shares the one tableau: for stabilizer state |S>, with destabilizer rows D_i, the state is the sum over
+ * "syndromes" s of d_s * D^s|S>, where D^s is the product of the D_i with s_i = 1. These basis states are orthonormal,
+ * and Clifford gates conjugate every row at once, so they don't touch the coefficients at all. A Pauli operator sends
+ * each term to exactly one other term, so a non-Clifford gate, as a sum of Pauli strings, at most multiplies the
+ * number of terms by the number of strings, and terms that land on the same syndrome merge. Probabilities and
+ * measurement are Pauli expectation values, summed over the terms in parallel, without ever forming a state vector.
+ *
+ * With a single term, this is exactly a QStabilizer. (Collapsing back to one term does not preserve global phase.)
+ */
+class QStabilizerRank : public QStabilizer {
+protected:
+    typedef std::map<BitRow, complex> TermMap;
+
+    // Coefficients by destabilizer syndrome, (empty, for a single stabilizer state)
+    TermMap terms;
+
+    /// A Pauli string, by x and z bits, (with both set for Y,) times a coefficient, as one operator of a gate
+    struct PauliOp {
+        BitRow px;
+        BitRow pz;
+        complex coeff;
+    };
+
+    /// The action of Pauli string P on the terms: P * D^s|S> = omega * (-1)^|v & s| * D^(s ^ u)|S>
+    struct PauliAction {
+        BitRow u;
+        BitRow v;
+        complex omega;
+    };
+
+    static bool IsParityOdd(const BitRow& a, const BitRow& b)
+    {
+        uint64_t v = 0U;
+        for (size_t w = 0U; w < a.size(); ++w) {
+            v ^= a[w] & b[w];
+        }
+        return PopCount(v) & 1U;
+    }
+    static void XorRow(BitRow& a, const BitRow& b)
+    {
+        for (size_t w = 0U; w < a.size(); ++w) {
+            a[w] ^= b[w];
+        }
+    }
+
+    PauliAction GetPauliAction(const BitRow& px, const BitRow& pz);
+    /// Replace the terms with the sum of "ops" applied to them, dropping terms that cancel, and renormalize
+    void ApplyPauliSum(const std::vector<PauliOp>& ops);
+    /// Apply "mtrx" to "target," for the "perm" permutation of "controls," as a sum of Pauli strings
+    void ApplyControlledMtrx(
+        const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target, bitCapIntOcl perm);
+    /// The expectation value of the Pauli string with (x, z) bits "px" and "pz"
+    real1_f ExpectationPauli(const BitRow& px, const BitRow& pz);
+    /// With only one term left, absorb its syndrome into the stabilizer phases
+    void Compact();
+    /// Each term's D^s, as coefficient * X^x * Z^z, (which "GetTermsState()" and "GetAmplitude()" apply to |S>)
+    void GetTermPaulis(
+        std::vector<bitCapIntOcl>& xMasks, std::vector<bitCapIntOcl>& zMasks, std::vector<complex>& amps);
+    /// Fill "stateVec" with the sum of terms, (warning: could be huge!)
+    void GetTermsState(complex* stateVec);
+
+public:
+    QStabilizerRank(bitLenInt n, bitCapInt perm = 0U, qrack_rand_gen_ptr rgp = nullptr,
+        complex ignored = CMPLX_DEFAULT_ARG, bool doNorm = false, bool randomGlobalPhase = true, bool ignored2 = false,
+        int64_t ignored3 = -1, bool useHardwareRNG = true, bool ignored4 = false, real1_f ignored5 = REAL1_EPSILON,
+        std::vector<int64_t> ignored6 = {}, bitLenInt ignored7 = 0U, real1_f ignored8 = FP_NORM_EPSILON_F);
+
+    /// Copy the state of a single QStabilizer, to continue it as a sum of terms
+    QStabilizerRank(QStabilizerPtr toCopy);
+
+    /// The number of stabilizer states in the sum
+    size_t GetRank() { return terms.size() ? terms.size() : 1U; }
+
+    bool isClifford() { return terms.empty(); };
+    bool isClifford(bitLenInt qubit) { return terms.empty(); };
+
+    QInterfacePtr Clone();
+    void SaveCheckpoint(CheckpointWriter& writer);
+    void LoadCheckpoint(CheckpointReader& reader);
+
+    void SetPermutation(bitCapInt perm, complex phaseFac = CMPLX_DEFAULT_ARG);
+
+    bool ForceM(bitLenInt t, bool result, bool doForce = true, bool doApply = true);
+    real1_f Prob(bitLenInt qubit);
+
+    real1_f FirstNonzeroPhase();
+    void GetQuantumState(complex* stateVec);
+    void GetQuantumState(QInterfacePtr eng);
+    void GetProbs(real1* outputProbs);
+    complex GetAmplitude(bitCapInt perm);
+    using QStabilizer::MultiShotMeasureMask;
+    void MultiShotMeasureMask(const std::vector<bitCapInt>& qPowers, unsigned shots, unsigned long long* shotsArray)
+    {
+        if (terms.empty()) {
+            QStabilizer::MultiShotMeasureMask(qPowers, shots, shotsArray);
+        } else {
+            // A sum of stabilizer terms doesn't have the uniform support that the tableau sampler relies on.
+            QInterface::MultiShotMeasureMask(qPowers, shots, shotsArray);
+        }
+    }
+
+    bool IsSeparableZ(const bitLenInt& target);
+
+    using QStabilizer::Compose;
+    bitLenInt Compose(QStabilizerPtr toCopy, bitLenInt start);
+    void Decompose(bitLenInt start, QInterfacePtr dest);
+    void Dispose(bitLenInt start, bitLenInt length);
+    void Dispose(bitLenInt start, bitLenInt length, bitCapInt ignored);
+    bool CanDecomposeDispose(const bitLenInt start, const bitLenInt length);
+    using QInterface::Allocate;
+    bitLenInt Allocate(bitLenInt start, bitLenInt length)
+    {
+        if (!length) {
+            return start;
+        }
+
+        QStabilizerPtr nQubits = std::make_shared<QStabilizer>(length, 0U, rand_generator, CMPLX_DEFAULT_ARG, false,
+            randGlobalPhase, false, -1, hardware_rand_generator != NULL);
+        return Compose(nQubits, start);
+    }
+
+    void Mtrx(complex const* mtrx, bitLenInt target);
+    void Phase(complex topLeft, complex bottomRight, bitLenInt target);
+    void Invert(complex topRight, complex bottomLeft, bitLenInt target);
+    void MCPhase(const std::vector<bitLenInt>& controls, complex topLeft, complex bottomRight, bitLenInt target);
+    void MACPhase(const std::vector<bitLenInt>& controls, complex topLeft, complex bottomRight, bitLenInt target);
+    void MCInvert(const std::vector<bitLenInt>& controls, complex topRight, complex bottomLeft, bitLenInt target);
+    void MACInvert(const std::vector<bitLenInt>& controls, complex topRight, complex bottomLeft, bitLenInt target);
+    void MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target);
+    void MACMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target);
+};
+} // namespace Qrack
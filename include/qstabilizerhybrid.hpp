@@ -13,7 +13,7 @@
 
 #include "mpsshard.hpp"
 #include "qengine.hpp"
-#include "qstabilizer.hpp"
+#include "qstabilizer_rank.hpp"
 
 #define QINTERFACE_TO_QALU(qReg) std::dynamic_pointer_cast<QAlu>(qReg)
 #define QINTERFACE_TO_QPARITY(qReg) std::dynamic_pointer_cast<QParity>(qReg)
@@ -37,10 +37,18 @@ protected:
     bool doNormalize;
     bool isSparse;
     bool useTGadget;
+    bool isDispatchWide;
     bitLenInt thresholdQubits;
     bitLenInt ancillaCount;
     bitLenInt maxQubitPlusAncillaCount;
+    // Maximum number of stabilizer terms to buffer non-Clifford gates in, before switching to an engine, (0 for off)
+    size_t maxStabilizerRank;
     real1_f separabilityThreshold;
+    // Largest process infidelity of a single-qubit gate to round to the nearest Clifford gate, (0 for off)
+    real1_f roundingThreshold;
+    // Least GetUnitaryFidelity() that Clifford rounding may leave
+    real1_f minRoundingFidelity;
+    real1_f unitaryFidelity;
     int64_t devID;
     complex phaseFactor;
     QInterfacePtr engine;
@@ -57,9 +65,13 @@ protected:
     void InvertBuffer(bitLenInt qubit);
     void FlushH(bitLenInt qubit);
     void FlushIfBlocked(bitLenInt control, bitLenInt target, bool isPhase = false);
+    /// Apply the buffered gate on "qubit" to the stabilizer terms, if the rank limit allows, or else switch to engine
+    void FlushToStabilizerRank(bitLenInt qubit);
     bool CollapseSeparableShard(bitLenInt qubit);
     bool TrimControls(const std::vector<bitLenInt>& lControls, std::vector<bitLenInt>& output, bool anti = false);
     void CacheEigenstate(bitLenInt target);
+    /// Apply "mtrx" to the stabilizer as its nearest Clifford gate, if the rounding threshold and budget allow
+    bool RoundToClifford(complex const* mtrx, bitLenInt target);
     void FlushBuffers();
     void DumpBuffers()
     {
@@ -91,6 +103,12 @@ protected:
         return false;
     }
 
+    bool IsStabilizerRanked()
+    {
+        const QStabilizerRankPtr rankStabilizer = std::dynamic_pointer_cast<QStabilizerRank>(stabilizer);
+        return rankStabilizer && (rankStabilizer->GetRank() > 1U);
+    }
+
     real1_f ApproxCompareHelper(
         QStabilizerHybridPtr toCompare, bool isDiscreteBool, real1_f error_tol = TRYDECOMPOSE_EPSILON);
     void ISwapHelper(bitLenInt qubit1, bitLenInt qubit2, bool inverse);
@@ -115,6 +133,43 @@ public:
 
     void SetTInjection(bool useGadget) { useTGadget = useGadget; }
     bool GetTInjection() { return useTGadget; }
+    void SetDispatchWide(bool isWide)
+    {
+        isDispatchWide = isWide;
+        if (engine) {
+            engine->SetDispatchWide(isWide);
+        }
+    }
+
+    /**
+     * Once T-injection can't take a blocked non-Clifford gate, keep it as a sum of at most "rank" stabilizer terms,
+     * rather than switching to a state vector engine, (or 0, for no limit on switching)
+     */
+    void SetStabilizerRankLimit(size_t rank)
+    {
+        maxStabilizerRank = rank;
+        if (rank && stabilizer && !std::dynamic_pointer_cast<QStabilizerRank>(stabilizer)) {
+            stabilizer = std::make_shared<QStabilizerRank>(stabilizer);
+        }
+    }
+    size_t GetStabilizerRankLimit() { return maxStabilizerRank; }
+
+    /**
+     * Opt-in approximation: rather than buffer a non-Clifford single-qubit gate, apply its nearest Clifford gate, (up
+     * to global phase,) if the process infidelity between the two is at most "epsilon," and if the fidelity this
+     * costs would leave GetUnitaryFidelity() at or above "minFidelity." (An "epsilon" of 0 is exact simulation.)
+     */
+    void SetCliffordRounding(real1_f epsilon, real1_f minFidelity = ZERO_R1_F)
+    {
+        roundingThreshold = epsilon;
+        minRoundingFidelity = minFidelity;
+    }
+    /**
+     * Fidelity to the exact state, since the last SetPermutation() or ResetUnitaryFidelity(): the product of the
+     * process fidelities of every gate rounded to a Clifford gate
+     */
+    real1_f GetUnitaryFidelity() { return unitaryFidelity; }
+    void ResetUnitaryFidelity() { unitaryFidelity = ONE_R1_F; }
 
     void Finish()
     {
@@ -160,6 +215,7 @@ public:
     using QInterface::Compose;
     bitLenInt Compose(QStabilizerHybridPtr toCopy) { return ComposeEither(toCopy, false); };
     bitLenInt Compose(QInterfacePtr toCopy) { return Compose(std::dynamic_pointer_cast<QStabilizerHybrid>(toCopy)); }
+    std::map<QInterfacePtr, bitLenInt> Compose(std::vector<QInterfacePtr> toCopy);
     bitLenInt Compose(QStabilizerHybridPtr toCopy, bitLenInt start);
     bitLenInt Compose(QInterfacePtr toCopy, bitLenInt start)
     {
@@ -184,6 +240,13 @@ public:
 
     void GetQuantumState(complex* outputState);
     void GetProbs(real1* outputProbs);
+    complex const* MapStateVector() { return engine ? engine->MapStateVector() : NULL; }
+    void UnmapStateVector()
+    {
+        if (engine) {
+            engine->UnmapStateVector();
+        }
+    }
     complex GetAmplitude(bitCapInt perm);
     void SetQuantumState(complex const* inputState);
     void SetAmplitude(bitCapInt perm, complex amp)
@@ -424,6 +487,18 @@ public:
         SwitchToEngine();
         engine->ZeroPhaseFlip(start, length);
     }
+    void PhaseFlipIfLookup(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+        const unsigned char* values, bitCapInt target)
+    {
+        SwitchToEngine();
+        engine->PhaseFlipIfLookup(indexStart, indexLength, valueLength, values, target);
+    }
+    void GroverLookupIteration(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+        const unsigned char* values, bitCapInt target)
+    {
+        SwitchToEngine();
+        engine->GroverLookupIteration(indexStart, indexLength, valueLength, values, target);
+    }
 
     void SqrtSwap(bitLenInt qubitIndex1, bitLenInt qubitIndex2)
     {
@@ -499,6 +574,25 @@ public:
     void NormalizeState(
         real1_f nrm = REAL1_DEFAULT_ARG, real1_f norm_thresh = REAL1_DEFAULT_ARG, real1_f phaseArg = ZERO_R1_F);
 
+    void ProbBits(const std::vector<bitLenInt>& bits, real1* probsArray)
+    {
+        if (ancillaCount) {
+            // Read every bit from one engine, rather than one for each non-separable bit.
+            QStabilizerHybridPtr clone = std::dynamic_pointer_cast<QStabilizerHybrid>(Clone());
+            clone->SwitchToEngine();
+            clone->ProbBits(bits, probsArray);
+            return;
+        }
+
+        if (engine) {
+            engine->ProbBits(bits, probsArray);
+            return;
+        }
+
+        // Each stabilizer bit is a tableau query, without any pass over amplitudes.
+        QInterface::ProbBits(bits, probsArray);
+    }
+
     real1_f ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCapInt offset = 0)
     {
         if (stabilizer) {
@@ -513,6 +607,8 @@ public:
     bool TrySeparate(const std::vector<bitLenInt>& qubits, real1_f error_tol);
 
     QInterfacePtr Clone();
+    void SaveCheckpoint(CheckpointWriter& writer);
+    void LoadCheckpoint(CheckpointReader& reader);
 
     void SetDevice(int64_t dID)
     {
@@ -0,0 +1,83 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qinterface.hpp"
+
+namespace Qrack {
+
+class QTape;
+typedef std::shared_ptr<QTape> QTapePtr;
+
+/** One gate of a QTape: a fixed (multiply) controlled single bit gate, or a parameterized Pauli rotation */
+struct QTapeOp {
+    bitLenInt target;
+    std::vector<bitLenInt> controls;
+    // PauliI marks a fixed gate, "mtrx;" otherwise, the gate is a rotation e^(-i * theta / 2 * axis)
+    Pauli axis;
+    // Index of "theta" in the parameter vector, for a rotation
+    size_t param;
+    complex mtrx[4U];
+};
+
+/**
+ * A "Qrack::QTape" records a circuit of fixed and parameterized gates, to run on any QInterface, and to differentiate
+ * expectation values of its output state with respect to its parameters.
+ *
+ * Gradient() uses the adjoint method: one forward pass of the tape, then one backward pass of inverse gates, gets the
+ * derivative with respect to every parameter at once. (Parameter shift takes two full circuit runs per parameter.) The
+ * backward pass runs on one clone of the simulator, with one more (ancilla) qubit, so it takes the memory of two more
+ * state vectors, besides the simulator, plus a host copy of that register while it's prepared.
+ */
+class QTape {
+protected:
+    size_t paramCount;
+    std::vector<QTapeOp> ops;
+
+    void ApplyOp(QInterfacePtr sim, const QTapeOp& op, const std::vector<real1_f>& params, bool isInverse);
+    real1_f GeneratorImag(QInterfacePtr reg, bitLenInt ancilla, const QTapeOp& op);
+
+public:
+    QTape()
+        : paramCount(0U)
+        , ops()
+    {
+    }
+
+    /** Append a fixed single bit gate, controlled by all of "controls," if any */
+    void Mtrx(const complex* mtrx, bitLenInt target, const std::vector<bitLenInt>& controls = std::vector<bitLenInt>());
+    /** Append e^(-i * params[param] / 2 * axis), controlled by all of "controls," if any */
+    void R(Pauli axis, size_t param, bitLenInt target, const std::vector<bitLenInt>& controls = std::vector<bitLenInt>());
+    void RX(size_t param, bitLenInt target) { R(PauliX, param, target); }
+    void RY(size_t param, bitLenInt target) { R(PauliY, param, target); }
+    void RZ(size_t param, bitLenInt target) { R(PauliZ, param, target); }
+
+    /** One more than the highest parameter index used by the tape */
+    size_t GetParamCount() const { return paramCount; }
+    const std::vector<QTapeOp>& GetOps() const { return ops; }
+
+    /** Apply the tape to "sim," with "params" bound */
+    void Run(QInterfacePtr sim, const std::vector<real1_f>& params);
+
+    /**
+     * Get the expectation value of the observable sum of "coeffs[i]" times "terms[i]," for the tape run from the
+     * current state of "sim," and write its derivative with respect to each parameter to "gradient"
+     *
+     * "sim" is not changed.
+     *
+     * \warning PSEUDO-QUANTUM
+     */
+    real1_f Gradient(QInterfacePtr sim, const std::vector<real1_f>& params, const std::vector<PauliString>& terms,
+        const std::vector<real1_f>& coeffs, std::vector<real1_f>& gradient);
+};
+} // namespace Qrack
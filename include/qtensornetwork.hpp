@@ -0,0 +1,162 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#pragma once
+
+#include "qcircuit.hpp"
+#include "qinterface.hpp"
+
+namespace Qrack {
+
+class QTensorNetwork;
+typedef std::shared_ptr<QTensorNetwork> QTensorNetworkPtr;
+
+/**
+ * A "Qrack::QTensorNetwork" records its gates, (as a QCircuit,) rather than applying them, and answers amplitude and
+ * probability queries by contracting only the tensors they need.
+ *
+ * GetAmplitude() contracts the whole network, with its input and output wires fixed to permutation values, in a greedy
+ * order that always takes the pair of tensors with the smallest result. Controls and diagonal gates don't open a new
+ * wire, so a circuit of mostly diagonal or controlled gates contracts much narrower than its qubit count. Prob() of a
+ * single qubit only simulates that qubit's backward light cone, on a small engine of the configured "engines" stack.
+ *
+ * If a contraction or light cone would exceed "maxTensorRank" qubits, or any operation needs the whole state, (like
+ * measurement,) the circuit is run once on a full engine of the configured stack, which then takes every later gate.
+ */
+class QTensorNetwork : public QInterface {
+protected:
+    bool useHostRam;
+    bool isSparse;
+    bitLenInt thresholdQubits;
+    bitLenInt maxTensorRank;
+    real1_f separabilityThreshold;
+    int64_t devID;
+    complex globalPhase;
+    bitCapInt initPerm;
+    QCircuitPtr circuit;
+    // The full simulation, once anything has needed it, (otherwise NULL)
+    QInterfacePtr layerStack;
+    std::vector<int64_t> deviceIDs;
+    std::vector<QInterfaceEngine> engines;
+
+    QInterfacePtr MakeEngine(bitLenInt qbCount, bitCapInt perm, complex phaseFac);
+
+    /// Create the full simulation, if needed, and run the recorded circuit on it
+    void Materialize();
+
+    /// Contract the network for the amplitude of "perm," or return false if the contraction is too wide
+    bool ContractAmplitude(bitCapInt perm, complex& amp);
+
+    /// Simulate the backward light cone of "qubit," or return false if the cone is too wide
+    bool LightConeProb(bitLenInt qubit, real1_f& prob);
+
+public:
+    QTensorNetwork(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState = 0U,
+        qrack_rand_gen_ptr rgp = nullptr, complex phaseFac = CMPLX_DEFAULT_ARG, bool doNorm = false,
+        bool randomGlobalPhase = true, bool useHostMem = false, int64_t deviceId = -1, bool useHardwareRNG = true,
+        bool useSparseStateVec = false, real1_f norm_thresh = REAL1_EPSILON, std::vector<int64_t> devList = {},
+        bitLenInt qubitThreshold = 0U, real1_f separation_thresh = FP_NORM_EPSILON_F);
+
+    QTensorNetwork(bitLenInt qBitCount, bitCapInt initState = 0U, qrack_rand_gen_ptr rgp = nullptr,
+        complex phaseFac = CMPLX_DEFAULT_ARG, bool doNorm = false, bool randomGlobalPhase = true,
+        bool useHostMem = false, int64_t deviceId = -1, bool useHardwareRNG = true, bool useSparseStateVec = false,
+        real1_f norm_thresh = REAL1_EPSILON, std::vector<int64_t> devList = {}, bitLenInt qubitThreshold = 0U,
+        real1_f separation_thresh = FP_NORM_EPSILON_F)
+        : QTensorNetwork({ QINTERFACE_OPTIMAL_BASE }, qBitCount, initState, rgp, phaseFac, doNorm, randomGlobalPhase,
+              useHostMem, deviceId, useHardwareRNG, useSparseStateVec, norm_thresh, devList, qubitThreshold,
+              separation_thresh)
+    {
+    }
+
+    /// True until an operation has needed the full state
+    bool isNetwork() { return !layerStack; }
+
+    /// The widest intermediate, in qubits, of any contraction or light cone, before falling back to the full state
+    void SetMaxTensorRank(bitLenInt rank) { maxTensorRank = rank; }
+    bitLenInt GetMaxTensorRank() { return maxTensorRank; }
+
+    void SetConcurrency(uint32_t threadCount)
+    {
+        QInterface::SetConcurrency(threadCount);
+        if (layerStack) {
+            layerStack->SetConcurrency(threadCount);
+        }
+    }
+
+    void SetPermutation(bitCapInt perm, complex phaseFac = CMPLX_DEFAULT_ARG);
+
+    void SetQuantumState(complex const* inputState);
+    void GetQuantumState(complex* outputState);
+    void GetProbs(real1* outputProbs);
+    complex GetAmplitude(bitCapInt perm);
+    void SetAmplitude(bitCapInt perm, complex amp);
+
+    using QInterface::Compose;
+    bitLenInt Compose(QInterfacePtr toCopy, bitLenInt start);
+    void Decompose(bitLenInt start, QInterfacePtr dest);
+    QInterfacePtr Decompose(bitLenInt start, bitLenInt length);
+    void Dispose(bitLenInt start, bitLenInt length);
+    void Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm);
+    using QInterface::Allocate;
+    bitLenInt Allocate(bitLenInt start, bitLenInt length);
+
+    void Mtrx(complex const* mtrx, bitLenInt target) { circuit->Mtrx(mtrx, target); }
+    void MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+    {
+        circuit->MCMtrx(controls, mtrx, target);
+    }
+    void MACMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+    {
+        circuit->MACMtrx(controls, mtrx, target);
+    }
+    using QInterface::Swap;
+    void Swap(bitLenInt qubit1, bitLenInt qubit2)
+    {
+        if (qubit1 != qubit2) {
+            circuit->Swap(qubit1, qubit2);
+        }
+    }
+    void FSim(real1_f theta, real1_f phi, bitLenInt qubit1, bitLenInt qubit2);
+
+    bool ForceM(bitLenInt qubit, bool result, bool doForce = true, bool doApply = true);
+    real1_f Prob(bitLenInt qubit);
+    real1_f ProbReg(bitLenInt start, bitLenInt length, bitCapInt permutation);
+    real1_f ProbMask(bitCapInt mask, bitCapInt permutation);
+    void ProbBitsAll(const std::vector<bitLenInt>& bits, real1* probsArray);
+    real1_f ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCapInt offset = 0U);
+    std::map<bitCapInt, int> MultiShotMeasureMask(const std::vector<bitCapInt>& qPowers, unsigned shots);
+    void MultiShotMeasureMask(const std::vector<bitCapInt>& qPowers, unsigned shots, unsigned long long* shotsArray);
+
+    real1_f SumSqrDiff(QInterfacePtr toCompare);
+    void UpdateRunningNorm(real1_f norm_thresh = REAL1_DEFAULT_ARG);
+    void NormalizeState(
+        real1_f nrm = REAL1_DEFAULT_ARG, real1_f norm_thresh = REAL1_DEFAULT_ARG, real1_f phaseArg = ZERO_R1_F);
+
+    void Finish()
+    {
+        if (layerStack) {
+            layerStack->Finish();
+        }
+    }
+    bool isFinished() { return !layerStack || layerStack->isFinished(); }
+    void Dump()
+    {
+        if (layerStack) {
+            layerStack->Dump();
+        }
+    }
+
+    QInterfacePtr Clone();
+    void SetDevice(int64_t dID);
+    int64_t GetDevice() { return devID; }
+};
+} // namespace Qrack
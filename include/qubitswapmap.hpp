@@ -8,6 +8,8 @@
 // See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
 // for details.
 
+#pragma once
+
 #include "common/qrack_types.hpp"
 
 #include <vector>
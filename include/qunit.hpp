@@ -19,6 +19,17 @@
 #include "qalu.hpp"
 #endif
 
+#include <future>
+
+#if !defined(QRACK_QUNIT_BG_SEP_PERIOD)
+// Gates between background separability probes
+#define QRACK_QUNIT_BG_SEP_PERIOD 32U
+#endif
+#if !defined(QRACK_QUNIT_BG_SEP_MIN_QB)
+// Smallest entangled unit a background probe considers
+#define QRACK_QUNIT_BG_SEP_MIN_QB 3U
+#endif
+
 namespace Qrack {
 
 class QUnit;
@@ -35,6 +46,8 @@ protected:
     bool isSparse;
     bool freezeBasis2Qb;
     bool isReactiveSeparate;
+    bool isBackgroundSeparate;
+    bool isLocalFrames;
     bool useTGadget;
     bitLenInt thresholdQubits;
     real1_f separabilityThreshold;
@@ -43,6 +56,10 @@ protected:
     QEngineShardMap shards;
     std::vector<int64_t> deviceIDs;
     std::vector<QInterfaceEngine> engines;
+    size_t bgSepCountdown;
+    std::weak_ptr<QInterface> bgSepUnit;
+    std::vector<bitLenInt> bgSepQubits;
+    std::future<std::vector<bitLenInt>> bgSepProbe;
 
     QInterfacePtr MakeEngine(bitLenInt length, bitCapInt perm);
 
@@ -91,12 +108,35 @@ public:
     virtual void SetReactiveSeparate(bool isAggSep) { isReactiveSeparate = isAggSep; }
     virtual bool GetReactiveSeparate() { return isReactiveSeparate; }
 
+    /**
+     * If enabled, a worker thread periodically probes a snapshot of the largest entangled unit for qubits with pure
+     * Bloch vectors, and the splits are (exactly) tried and committed between later gates, off of the gate path.
+     */
+    virtual void SetBackgroundSeparate(bool isBgSep) { isBackgroundSeparate = isBgSep; }
+    virtual bool GetBackgroundSeparate() { return isBackgroundSeparate; }
+
+    /**
+     * If enabled, (as by default,) arbitrary single-qubit gates on entangled qubits are composed into a 2x2 "frame"
+     * on the qubit's shard, and they are only applied to the unit's engine, as one gate, when a multi-qubit gate or a
+     * measurement needs them.
+     */
+    virtual void SetLocalFrames(bool isLocal) { isLocalFrames = isLocal; }
+    virtual bool GetLocalFrames() { return isLocalFrames; }
+
     virtual void SetDevice(int64_t dID);
     virtual int64_t GetDevice() { return devID; }
 
     virtual void SetQuantumState(complex const* inputState);
     virtual void GetQuantumState(complex* outputState);
     virtual void GetProbs(real1* outputProbs);
+    /** This makes one unit of every qubit, in order, first. */
+    virtual complex const* MapStateVector();
+    virtual void UnmapStateVector()
+    {
+        if (shards[0U].unit) {
+            shards[0U].unit->UnmapStateVector();
+        }
+    }
     virtual complex GetAmplitude(bitCapInt perm);
     virtual void SetAmplitude(bitCapInt perm, complex amp)
     {
@@ -165,6 +205,10 @@ public:
 
     virtual void ZMask(bitCapInt mask) { PhaseParity(PI_R1, mask); }
     virtual void PhaseParity(real1 radians, bitCapInt mask);
+    virtual void PhaseFlipIfLookup(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+        const unsigned char* values, bitCapInt target);
+    virtual void GroverLookupIteration(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+        const unsigned char* values, bitCapInt target);
 
     virtual void Phase(complex topLeft, complex bottomRight, bitLenInt qubitIndex);
     virtual void Invert(complex topRight, complex bottomLeft, bitLenInt qubitIndex);
@@ -320,6 +364,7 @@ public:
 
     virtual real1_f Prob(bitLenInt qubit)
     {
+        QRACK_INSTRUMENT("QUnit", "Prob");
         if (qubit >= qubitCount) {
             throw std::invalid_argument("QUnit::Prob target parameter must be within allocated qubit bounds!");
         }
@@ -335,6 +380,7 @@ public:
         return SumSqrDiff(std::dynamic_pointer_cast<QUnit>(toCompare));
     }
     virtual real1_f ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCapInt offset = 0);
+    virtual void ProbBits(const std::vector<bitLenInt>& bits, real1* probsArray);
 
     virtual real1_f SumSqrDiff(QUnitPtr toCompare);
     virtual void UpdateRunningNorm(real1_f norm_thresh = REAL1_DEFAULT_ARG);
@@ -356,6 +402,8 @@ public:
     virtual bool TrySeparate(bitLenInt qubit1, bitLenInt qubit2);
 
     virtual QInterfacePtr Clone();
+    virtual void SaveCheckpoint(CheckpointWriter& writer);
+    virtual void LoadCheckpoint(CheckpointReader& reader);
 
     /** @} */
 
@@ -368,6 +416,7 @@ protected:
     virtual real1_f ProbBase(bitLenInt qubit);
 
     virtual bool TrySeparateClifford(bitLenInt qubit);
+    virtual void PollBackgroundSeparate();
 
     virtual void EitherISwap(bitLenInt qubit1, bitLenInt qubit2, bool isInverse);
 
@@ -532,7 +581,7 @@ protected:
             ((real1)(ONE_R1 / 2)) * (ONE_CMPLX + I_CMPLX) };
 
         if (shard.unit) {
-            shard.unit->Mtrx(mtrx, shard.mapped);
+            ShardMtrx(shard, mtrx);
         }
 
         if (shard.isPhaseDirty || shard.isProbDirty) {
@@ -547,7 +596,7 @@ protected:
         ClampShard(i);
     }
 
-    void RevertBasis1Qb(bitLenInt i)
+    void RevertBasis1Qb(bitLenInt i, bool isForProb = false)
     {
         QEngineShard& shard = shards[i];
 
@@ -556,6 +605,11 @@ protected:
         } else {
             RevertBasisX(i);
         }
+
+        // Z basis probabilities, (and use as a control,) commute with a diagonal frame.
+        if (!isForProb || !shard.IsFrameDiagonal()) {
+            shard.FlushFrame();
+        }
     }
 
     void RevertBasisToX1Qb(bitLenInt i)
@@ -578,6 +632,17 @@ protected:
         }
     }
 
+    // Apply "mtrx" to an entangled shard, deferring it to the shard's local frame if that is (or can be) in use
+    void ShardMtrx(QEngineShard& shard, complex const* mtrx)
+    {
+        if (shard.isFramed ||
+            (isLocalFrames && (shard.unit->GetQubitCount() > 1U) && !shard.unit->isClifford())) {
+            shard.ComposeFrame(mtrx);
+        } else {
+            shard.unit->Mtrx(mtrx, shard.mapped);
+        }
+    }
+
     void ConvertZToX(bitLenInt i);
     void ConvertXToY(bitLenInt i);
     void ConvertYToZ(bitLenInt i);
@@ -588,7 +653,7 @@ protected:
     enum RevertControl { CONTROLS_AND_TARGETS = 0, ONLY_CONTROLS = 1, ONLY_TARGETS = 2 };
     enum RevertAnti { CTRL_AND_ANTI = 0, ONLY_CTRL = 1, ONLY_ANTI = 2 };
 
-    void ApplyBuffer(PhaseShardPtr phaseShard, bitLenInt control, bitLenInt target, bool isAnti);
+    void ApplyBuffer(const PhaseShardPtr& phaseShard, bitLenInt control, bitLenInt target, bool isAnti);
     void ApplyBufferMap(bitLenInt bitIndex, ShardToPhaseMap bufferMap, RevertExclusivity exclusivity, bool isControl,
         bool isAnti, const std::set<bitLenInt>& exceptPartners, bool dumpSkipped);
     void RevertBasis2Qb(bitLenInt i, RevertExclusivity exclusivity = INVERT_AND_PHASE,
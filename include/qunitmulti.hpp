@@ -17,6 +17,8 @@
 #include "qinterface.hpp"
 #include "qunit.hpp"
 
+#include <map>
+
 namespace Qrack {
 
 struct QEngineInfo {
@@ -63,10 +65,25 @@ class QUnitMulti : public QUnit {
 protected:
     bool isRedistributing;
     bool isQEngineOCL;
+    // True if every device in "deviceList" has an EngineProfile measurement
+    bool isProfiled;
+    // A unit only migrates if its estimated time on its own device is this many times its time on the best device.
+    real1_f migrateGain;
     size_t defaultDeviceID;
     std::vector<DeviceInfo> deviceList;
+    // Units that fell back to host memory, (by address, while they live,) because no device had room in its budget
+    std::map<QInterface*, std::weak_ptr<QInterface>> hostUnits;
 
     QInterfacePtr MakeEngine(bitLenInt length, bitCapInt perm);
+    /** "engines," with every OpenCL layer replaced by QEngineCPU */
+    std::vector<QInterfaceEngine> HostEngines();
+    /** Replace "unit" with a copy in host memory, if the host has room for it */
+    void MoveUnitToHost(QInterfacePtr unit);
+
+    /** Estimated seconds for one gate on a "qb" qubit unit, on "deviceList[devIndex]" */
+    double UnitTime(size_t devIndex, bitLenInt qb);
+    /** Estimated seconds for "deviceList[devIndex]" to drain the commands it already has queued */
+    double QueueTime(size_t devIndex);
 
 public:
     QUnitMulti(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState = 0U,
@@ -98,6 +115,7 @@ public:
             deviceIDs, thresholdQubits, separabilityThreshold);
 
         copyPtr->SetReactiveSeparate(isReactiveSeparate);
+        copyPtr->SetLocalFrames(isLocalFrames);
 
         return CloneBody(copyPtr);
     }
@@ -128,13 +146,7 @@ protected:
     }
 
     virtual QInterfacePtr EntangleInCurrentBasis(
-        std::vector<bitLenInt*>::iterator first, std::vector<bitLenInt*>::iterator last)
-    {
-        QInterfacePtr toRet = QUnit::EntangleInCurrentBasis(first, last);
-        RedistributeQEngines();
-
-        return toRet;
-    }
+        std::vector<bitLenInt*>::iterator first, std::vector<bitLenInt*>::iterator last);
 
     virtual void RedistributeQEngines();
 };
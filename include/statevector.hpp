@@ -13,10 +13,15 @@
 
 #pragma once
 
+#include "common/amplitude_codec.hpp"
 #include "common/parallel_for.hpp"
 #include "common/qrack_types.hpp"
+#include "common/statevec_pool.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <mutex>
 #include <set>
 
@@ -24,14 +29,229 @@
 #include <future>
 #endif
 
-#if QBCAPPOW > 7
-#include <boost/functional/hash.hpp>
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define QRACK_MAPPED_STATE_VEC 1
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
+
 #include <unordered_map>
-#define SparseStateVecMap std::unordered_map<bitCapIntOcl, complex>
+
+#define QRACK_SPARSE_SHARD_BITS 6U
+#define QRACK_SPARSE_SHARDS (1U << QRACK_SPARSE_SHARD_BITS)
+#define QRACK_SPARSE_EMPTY_KEY ((bitCapIntOcl)(-1))
+// Amplitudes per block of a StateVectorBlocked, (a multiple of every SIMD width, in real1 lanes)
+#define QRACK_BLOCKED_LANES 8U
 
 namespace Qrack {
 
+/**
+ * The nonzero amplitudes of a StateVectorSparse, in an open-addressing hash table.
+ *
+ * Keys are spread over QRACK_SPARSE_SHARDS independent shards by the high bits of their (mixed) hash, so threads that
+ * write different amplitudes rarely contend for the same lock, (and adjacent permutation indices don't pile into one
+ * shard). Each shard is a flat array of slots with linear probing and backward-shift deletion, (so no tombstones,) kept
+ * at most half full. The empty slot sentinel is the maximum bitCapIntOcl value, which can never be a valid index.
+ */
+class SparseStateVecMap {
+protected:
+    struct Slot {
+        bitCapIntOcl key;
+        complex amp;
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        std::vector<Slot> slots;
+        size_t count;
+
+        Shard()
+            : count(0U)
+        {
+        }
+    };
+
+    std::unique_ptr<Shard[]> shards;
+
+    static uint64_t Mix(bitCapIntOcl k)
+    {
+        // splitmix64 finalizer
+        uint64_t h = (uint64_t)k;
+        h = (h ^ (h >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27U)) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31U);
+    }
+
+    static size_t Find(const Shard& s, bitCapIntOcl k, uint64_t h)
+    {
+        const size_t mask = s.slots.size() - 1U;
+        size_t i = (size_t)h & mask;
+        while ((s.slots[i].key != k) && (s.slots[i].key != QRACK_SPARSE_EMPTY_KEY)) {
+            i = (i + 1U) & mask;
+        }
+
+        return i;
+    }
+
+    static void Grow(Shard& s)
+    {
+        std::vector<Slot> o(s.slots.size() ? (s.slots.size() << 1U) : 8U, Slot{ QRACK_SPARSE_EMPTY_KEY, ZERO_CMPLX });
+        o.swap(s.slots);
+        for (const Slot& slot : o) {
+            if (slot.key != QRACK_SPARSE_EMPTY_KEY) {
+                s.slots[Find(s, slot.key, Mix(slot.key))] = slot;
+            }
+        }
+    }
+
+    static void EraseAt(Shard& s, size_t i)
+    {
+        // Backward-shift deletion: pull later members of the probe run into the hole, where their probe starts allow.
+        const size_t mask = s.slots.size() - 1U;
+        size_t j = i;
+        while (true) {
+            j = (j + 1U) & mask;
+            if (s.slots[j].key == QRACK_SPARSE_EMPTY_KEY) {
+                break;
+            }
+            const size_t home = (size_t)Mix(s.slots[j].key) & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                s.slots[i] = s.slots[j];
+                i = j;
+            }
+        }
+        s.slots[i].key = QRACK_SPARSE_EMPTY_KEY;
+        --(s.count);
+    }
+
+    Shard& GetShard(uint64_t h) { return shards[(size_t)(h >> (64U - QRACK_SPARSE_SHARD_BITS))]; }
+
+public:
+    SparseStateVecMap()
+        : shards(new Shard[QRACK_SPARSE_SHARDS])
+    {
+    }
+
+    /** Read amplitude "k," taking its shard lock only if "isLocked" */
+    complex get(bitCapIntOcl k, bool isLocked)
+    {
+        const uint64_t h = Mix(k);
+        Shard& s = GetShard(h);
+        std::unique_lock<std::mutex> lock(s.mtx, std::defer_lock);
+        if (isLocked) {
+            lock.lock();
+        }
+        if (!s.count) {
+            return ZERO_CMPLX;
+        }
+        const Slot& slot = s.slots[Find(s, k, h)];
+
+        return (slot.key == QRACK_SPARSE_EMPTY_KEY) ? ZERO_CMPLX : slot.amp;
+    }
+
+    void set(bitCapIntOcl k, const complex& c)
+    {
+        const uint64_t h = Mix(k);
+        Shard& s = GetShard(h);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        if (((s.count + 1U) << 1U) > s.slots.size()) {
+            Grow(s);
+        }
+        Slot& slot = s.slots[Find(s, k, h)];
+        if (slot.key == QRACK_SPARSE_EMPTY_KEY) {
+            slot.key = k;
+            ++(s.count);
+        }
+        slot.amp = c;
+    }
+
+    void erase(bitCapIntOcl k)
+    {
+        const uint64_t h = Mix(k);
+        Shard& s = GetShard(h);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        if (!s.count) {
+            return;
+        }
+        const size_t i = Find(s, k, h);
+        if (s.slots[i].key != QRACK_SPARSE_EMPTY_KEY) {
+            EraseAt(s, i);
+        }
+    }
+
+    size_t size()
+    {
+        size_t toRet = 0U;
+        for (size_t i = 0U; i < QRACK_SPARSE_SHARDS; ++i) {
+            std::lock_guard<std::mutex> lock(shards[i].mtx);
+            toRet += shards[i].count;
+        }
+
+        return toRet;
+    }
+
+    void clear()
+    {
+        for (size_t i = 0U; i < QRACK_SPARSE_SHARDS; ++i) {
+            std::lock_guard<std::mutex> lock(shards[i].mtx);
+            shards[i].slots.clear();
+            shards[i].count = 0U;
+        }
+    }
+
+    void copy(SparseStateVecMap& o)
+    {
+        if (&o == this) {
+            return;
+        }
+        for (size_t i = 0U; i < QRACK_SPARSE_SHARDS; ++i) {
+            std::lock_guard<std::mutex> lock(shards[i].mtx);
+            std::lock_guard<std::mutex> oLock(o.shards[i].mtx);
+            shards[i].slots = o.shards[i].slots;
+            shards[i].count = o.shards[i].count;
+        }
+    }
+
+    /** Call "fn" on every key of shard "shard," (under its lock) */
+    template <typename Fn> void for_each_key(size_t shard, Fn fn)
+    {
+        Shard& s = shards[shard];
+        std::lock_guard<std::mutex> lock(s.mtx);
+        for (const Slot& slot : s.slots) {
+            if (slot.key != QRACK_SPARSE_EMPTY_KEY) {
+                fn(slot.key);
+            }
+        }
+    }
+
+    /** Release slack in every shard that is under 1/8 full, (after a large collapse, for example). */
+    void compact()
+    {
+        for (size_t i = 0U; i < QRACK_SPARSE_SHARDS; ++i) {
+            Shard& s = shards[i];
+            std::lock_guard<std::mutex> lock(s.mtx);
+            if ((s.slots.size() <= 8U) || ((s.count << 3U) >= s.slots.size())) {
+                continue;
+            }
+            std::vector<Slot> o;
+            o.swap(s.slots);
+            size_t nSize = 8U;
+            while (nSize < (s.count << 2U)) {
+                nSize <<= 1U;
+            }
+            s.slots.assign(nSize, Slot{ QRACK_SPARSE_EMPTY_KEY, ZERO_CMPLX });
+            for (const Slot& slot : o) {
+                if (slot.key != QRACK_SPARSE_EMPTY_KEY) {
+                    s.slots[Find(s, slot.key, Mix(slot.key))] = slot;
+                }
+            }
+        }
+    }
+};
+
 class StateVectorArray : public StateVector {
 public:
     std::unique_ptr<complex, void (*)(complex*)> amplitudes;
@@ -39,40 +259,27 @@ public:
 protected:
     static real1_f normHelper(const complex& c) { return (real1_f)norm(c); }
 
-#if defined(__APPLE__)
-    complex* _aligned_state_vec_alloc(bitCapIntOcl allocSize)
-    {
-        void* toRet;
-        posix_memalign(&toRet, QRACK_ALIGN_SIZE, allocSize);
-        return (complex*)toRet;
-    }
-#endif
-
     std::unique_ptr<complex, void (*)(complex*)> Alloc(bitCapIntOcl elemCount)
     {
 #if defined(__ANDROID__)
         return std::unique_ptr<complex, void (*)(complex*)>(new complex[elemCount], [](complex* c) { delete c; });
 #else
-        // elemCount is always a power of two, but might be smaller than QRACK_ALIGN_SIZE
-        size_t allocSize = sizeof(complex) * elemCount;
-        if (allocSize < QRACK_ALIGN_SIZE) {
-            allocSize = QRACK_ALIGN_SIZE;
-        }
-#if defined(__APPLE__)
-        return std::unique_ptr<complex, void (*)(complex*)>(
-            _aligned_state_vec_alloc(allocSize), [](complex* c) { free(c); });
-#elif defined(_WIN32) && !defined(__CYGWIN__)
-        return std::unique_ptr<complex, void (*)(complex*)>(
-            (complex*)_aligned_malloc(allocSize, QRACK_ALIGN_SIZE), [](complex* c) { _aligned_free(c); });
-#else
+        // (StateVecPool keeps released buffers, to reuse for the next engine of a similar size.)
         return std::unique_ptr<complex, void (*)(complex*)>(
-            (complex*)aligned_alloc(QRACK_ALIGN_SIZE, allocSize), [](complex* c) { free(c); });
-#endif
+            (complex*)StateVecPool::Instance().Acquire(sizeof(complex) * elemCount),
+            [](complex* c) { StateVecPool::Instance().Release(c); });
 #endif
     }
 
     virtual void Free() { amplitudes = NULL; }
 
+    StateVectorArray(bitCapIntOcl cap, complex* externalAmps)
+        : StateVector(cap)
+        , amplitudes(externalAmps, [](complex* c) {})
+    {
+        // Intentionally left blank.
+    }
+
 public:
     StateVectorArray(bitCapIntOcl cap)
         : StateVector(cap)
@@ -124,7 +331,13 @@ public:
         StateVectorPtr copyInSv, const bitCapIntOcl srcOffset, const bitCapIntOcl dstOffset, const bitCapIntOcl length)
     {
         if (copyInSv) {
-            complex const* copyIn = std::dynamic_pointer_cast<StateVectorArray>(copyInSv)->amplitudes.get() + srcOffset;
+            StateVectorArrayPtr copyInArray = std::dynamic_pointer_cast<StateVectorArray>(copyInSv);
+            if (!copyInArray) {
+                // (Another storage format converts itself.)
+                copyInSv->copy_out(amplitudes.get() + dstOffset, srcOffset, length);
+                return;
+            }
+            complex const* copyIn = copyInArray->amplitudes.get() + srcOffset;
             std::copy(copyIn, copyIn + length, amplitudes.get() + dstOffset);
         } else {
             std::fill(amplitudes.get() + dstOffset, amplitudes.get() + dstOffset + length, ZERO_CMPLX);
@@ -135,17 +348,39 @@ public:
 
     void copy_out(complex* copyOut, const bitCapIntOcl offset, const bitCapIntOcl length)
     {
-        std::copy(amplitudes.get() + offset, amplitudes.get() + offset + capacity, copyOut);
+        std::copy(amplitudes.get() + offset, amplitudes.get() + offset + length, copyOut);
     }
 
-    void copy(StateVectorPtr toCopy) { copy(std::dynamic_pointer_cast<StateVectorArray>(toCopy)); }
+    void copy(StateVectorPtr toCopy)
+    {
+        StateVectorArrayPtr toCopyArray = std::dynamic_pointer_cast<StateVectorArray>(toCopy);
+        if (toCopyArray) {
+            copy(toCopyArray);
+        } else {
+            toCopy->copy_out(amplitudes.get());
+        }
+    }
 
     void copy(StateVectorArrayPtr toCopy)
     {
         std::copy(toCopy->amplitudes.get(), toCopy->amplitudes.get() + capacity, amplitudes.get());
     }
 
-    void shuffle(StateVectorPtr svp) { shuffle(std::dynamic_pointer_cast<StateVectorArray>(svp)); }
+    void shuffle(StateVectorPtr svp)
+    {
+        StateVectorArrayPtr svpArray = std::dynamic_pointer_cast<StateVectorArray>(svp);
+        if (svpArray) {
+            shuffle(svpArray);
+            return;
+        }
+
+        const bitCapIntOcl halfCap = capacity >> ONE_BCI;
+        for (bitCapIntOcl i = 0U; i < halfCap; ++i) {
+            const complex amp = svp->read(i);
+            svp->write(i, amplitudes.get()[i + halfCap]);
+            amplitudes.get()[i + halfCap] = amp;
+        }
+    }
 
     void shuffle(StateVectorArrayPtr svp)
     {
@@ -160,98 +395,285 @@ public:
     bool is_sparse() { return false; }
 };
 
-class StateVectorSparse : public StateVector, public ParallelFor {
+#if QRACK_MAPPED_STATE_VEC
+/**
+ * A dense state vector backed by a shared memory map of an (unlinked) temporary file, so that the operating system can
+ * write cold amplitudes out to disk instead of holding them all in RAM. Evict() and Prefetch() are residency hints.
+ */
+class StateVectorMapped : public StateVectorArray {
 protected:
-    SparseStateVecMap amplitudes;
-    std::mutex mtx;
+    size_t mapSize;
 
-    complex readUnlocked(const bitCapIntOcl& i)
+    static complex* MapFile(const std::string& dir, size_t size)
     {
-        auto it = amplitudes.find(i);
-        return (it == amplitudes.end()) ? ZERO_CMPLX : it->second;
+        std::string path = dir + "/qrack_page_XXXXXX";
+        std::vector<char> pathBuf(path.begin(), path.end());
+        pathBuf.push_back('\0');
+
+        const int fd = mkstemp(pathBuf.data());
+        if (fd < 0) {
+            throw std::runtime_error("StateVectorMapped could not create a backing file in " + dir);
+        }
+        // The mapping keeps the file alive; nothing else should ever open it.
+        unlink(pathBuf.data());
+        if (ftruncate(fd, (off_t)size)) {
+            close(fd);
+            throw std::runtime_error("StateVectorMapped could not size its backing file in " + dir);
+        }
+        void* toRet = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (toRet == MAP_FAILED) {
+            throw std::runtime_error("StateVectorMapped could not map its backing file in " + dir);
+        }
+
+        return (complex*)toRet;
     }
 
-    complex readLocked(const bitCapIntOcl& i)
+    void Free()
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        return readUnlocked(i);
+        if (amplitudes) {
+            munmap(amplitudes.get(), mapSize);
+        }
+        amplitudes = NULL;
     }
 
 public:
-    StateVectorSparse(bitCapIntOcl cap)
+    StateVectorMapped(bitCapIntOcl cap, const std::string& dir)
+        : StateVectorArray(cap, MapFile(dir, sizeof(complex) * cap))
+        , mapSize(sizeof(complex) * cap)
+    {
+        // A fresh file reads as zeros, so there is nothing to clear.
+    }
+
+    ~StateVectorMapped() { Free(); }
+
+    /** Write dirty amplitudes back to the backing file, and unmap their RAM so it can be reclaimed. */
+    void Evict()
+    {
+        msync(amplitudes.get(), mapSize, MS_SYNC);
+        madvise(amplitudes.get(), mapSize, MADV_DONTNEED);
+    }
+
+    /** Ask the operating system to start reading the amplitudes back into RAM. */
+    void Prefetch() { madvise(amplitudes.get(), mapSize, MADV_WILLNEED); }
+};
+#endif
+
+/**
+ * A dense state vector held losslessly compressed, by CompressAmplitudes(), (as QPager holds its least recently used
+ * pages, with QRACK_QPAGER_COMPRESS). The first access of any kind inflates it, once and thread-safely, into a
+ * StateVectorArray, which every method then forwards to, so a compressed state vector is always correct to use.
+ */
+class StateVectorCompressed : public StateVector {
+protected:
+    std::vector<unsigned char> blob;
+    StateVectorArrayPtr inflated;
+    std::atomic<bool> isInflated;
+    std::mutex inflateMutex;
+
+    StateVectorArray* Array()
+    {
+        if (!IsInflated()) {
+            Inflate();
+        }
+        return inflated.get();
+    }
+
+public:
+    StateVectorCompressed(StateVectorArrayPtr toCompress, bitCapIntOcl cap)
         : StateVector(cap)
-        , amplitudes()
+        , blob(CompressAmplitudes(toCompress->amplitudes.get(), cap))
+        , isInflated(false)
     {
+        // Intentionally left blank.
     }
 
-    complex read(const bitCapIntOcl& i) { return isReadLocked ? readLocked(i) : readUnlocked(i); }
+    bool IsInflated() { return isInflated.load(std::memory_order_acquire); }
+    /** Size of the compressed amplitudes, in bytes, (or 0, once inflated) */
+    size_t CompressedSize() { return IsInflated() ? 0U : blob.size(); }
 
-#if ENABLE_COMPLEX_X2
-    complex2 read2(const bitCapIntOcl& i1, const bitCapIntOcl& i2)
+    /** Decompress into a StateVectorArray, (if not already done,) release the compressed copy, and return the array. */
+    StateVectorArrayPtr Inflate()
     {
-        if (isReadLocked) {
-            return complex2(readLocked(i1), readLocked(i2));
+        std::lock_guard<std::mutex> lock(inflateMutex);
+        if (!isInflated.load(std::memory_order_relaxed)) {
+            StateVectorArrayPtr nInflated = std::make_shared<StateVectorArray>(capacity);
+            DecompressAmplitudes(blob, nInflated->amplitudes.get(), capacity);
+            std::vector<unsigned char>().swap(blob);
+            inflated = nInflated;
+            isInflated.store(true, std::memory_order_release);
         }
-        return complex2(readUnlocked(i1), readUnlocked(i2));
+
+        return inflated;
     }
+
+    complex read(const bitCapIntOcl& i) { return Array()->read(i); }
+
+#if ENABLE_COMPLEX_X2
+    complex2 read2(const bitCapIntOcl& i1, const bitCapIntOcl& i2) { return Array()->read2(i1, i2); }
 #endif
 
-    void write(const bitCapIntOcl& i, const complex& c)
+    void write(const bitCapIntOcl& i, const complex& c) { Array()->write(i, c); }
+
+    void write2(const bitCapIntOcl& i1, const complex& c1, const bitCapIntOcl& i2, const complex& c2)
     {
-        const bool isCSet = abs(c) > REAL1_EPSILON;
-        ;
-        bool isFound;
-        SparseStateVecMap::iterator it;
-
-        // For lock_guard scope
-        if (true) {
-            std::lock_guard<std::mutex> lock(mtx);
-
-            it = amplitudes.find(i);
-            isFound = (it != amplitudes.end());
-            if (isCSet != isFound) {
-                if (isCSet) {
-                    amplitudes[i] = c;
-                } else {
-                    amplitudes.erase(it);
-                }
-            }
+        Array()->write2(i1, c1, i2, c2);
+    }
+
+    void clear() { Array()->clear(); }
+
+    void copy_in(complex const* copyIn) { Array()->copy_in(copyIn); }
+
+    void copy_in(complex const* copyIn, const bitCapIntOcl offset, const bitCapIntOcl length)
+    {
+        Array()->copy_in(copyIn, offset, length);
+    }
+
+    void copy_in(
+        StateVectorPtr copyInSv, const bitCapIntOcl srcOffset, const bitCapIntOcl dstOffset, const bitCapIntOcl length)
+    {
+        Array()->copy_in(copyInSv, srcOffset, dstOffset, length);
+    }
+
+    void copy_out(complex* copyOut) { Array()->copy_out(copyOut); }
+
+    void copy_out(complex* copyOut, const bitCapIntOcl offset, const bitCapIntOcl length)
+    {
+        Array()->copy_out(copyOut, offset, length);
+    }
+
+    void copy(StateVectorPtr toCopy) { Array()->copy(toCopy); }
+
+    void shuffle(StateVectorPtr svp) { Array()->shuffle(svp); }
+
+    void get_probs(real1* outArray) { Array()->get_probs(outArray); }
+
+    bool is_sparse() { return false; }
+};
+
+/** Storage formats for a dense state vector, (with arithmetic always at "real1" precision) */
+enum StateVecStorage {
+    /// One "complex" per amplitude
+    STATE_VEC_NATIVE = 0,
+    /// IEEE binary16 real and imaginary parts
+    STATE_VEC_FP16 = 1,
+    /// bfloat16 real and imaginary parts
+    STATE_VEC_BF16 = 2,
+    /// Blocks of QRACK_BLOCKED_LANES real parts, then their imaginary parts
+    STATE_VEC_BLOCKED = 3
+};
+
+/**
+ * A dense state vector that stores each amplitude as two 16-bit floats, (IEEE half precision, or bfloat16,) for half
+ * the memory and bandwidth of a float build, while every read widens to "complex" for arithmetic.
+ *
+ * Half precision has only 5 exponent bits, so amplitudes are stored multiplied by 2^(n/2), (for n qubits, in at most
+ * 2^15,) which puts a uniform superposition at about 1, in the middle of the representable range. bfloat16 keeps
+ * float's exponent range, and only 8 bits of mantissa, so it is stored unscaled.
+ */
+/**
+ * Dense amplitudes stored as pairs of 16-bit floats, (IEEE fp16 or bf16,) and widened to real1 on every read. fp16
+ * amplitudes are scaled up by about the square root of the state vector length, so typical magnitudes stay normal.
+ */
+class StateVectorHalf : public StateVector {
+protected:
+    std::unique_ptr<uint16_t[]> amplitudes;
+    bool isBf16;
+    float scale;
+    float invScale;
+
+    static uint32_t FloatBits(float f)
+    {
+        uint32_t b;
+        std::memcpy(&b, &f, sizeof(float));
+        return b;
+    }
+    static float BitsFloat(uint32_t b)
+    {
+        float f;
+        std::memcpy(&f, &b, sizeof(float));
+        return f;
+    }
+
+    // Rounding to the nearest even representable value, in both formats
+    static uint16_t ToHalf(float f)
+    {
+        // (After M. Maratyszcza's FP16 library: float arithmetic does the rounding, including to subnormals.)
+        float base = (std::fabs(f) * BitsFloat(0x77800000U)) * BitsFloat(0x08800000U);
+        const uint32_t w = FloatBits(f);
+        const uint32_t shl1W = w + w;
+        const uint32_t sign = w & 0x80000000U;
+        uint32_t bias = shl1W & 0xFF000000U;
+        if (bias < 0x71000000U) {
+            bias = 0x71000000U;
         }
+        base = BitsFloat((bias >> 1U) + 0x07800000U) + base;
+        const uint32_t bits = FloatBits(base);
+        const uint32_t nonSign = ((bits >> 13U) & 0x00007C00U) + (bits & 0x00000FFFU);
 
-        if (isCSet == isFound) {
-            if (isCSet) {
-                it->second = c;
-            }
+        return (uint16_t)((sign >> 16U) | ((shl1W > 0xFF000000U) ? 0x7E00U : nonSign));
+    }
+    static float FromHalf(uint16_t h)
+    {
+        const uint32_t w = (uint32_t)h << 16U;
+        const uint32_t sign = w & 0x80000000U;
+        const uint32_t twoW = w + w;
+        const float normalized = BitsFloat((twoW >> 4U) + (0xE0U << 23U)) * BitsFloat(0x07800000U);
+        const float denormalized = BitsFloat((twoW >> 17U) | (126U << 23U)) - 0.5f;
+
+        return BitsFloat(sign | FloatBits((twoW < (1U << 27U)) ? denormalized : normalized));
+    }
+    static uint16_t ToBf16(float f)
+    {
+        const uint32_t b = FloatBits(f);
+        if ((b & 0x7FFFFFFFU) > 0x7F800000U) {
+            // Keep NaN a (quiet) NaN.
+            return (uint16_t)((b >> 16U) | 0x0040U);
         }
+
+        return (uint16_t)((b + 0x7FFFU + ((b >> 16U) & 1U)) >> 16U);
+    }
+    static float FromBf16(uint16_t h) { return BitsFloat((uint32_t)h << 16U); }
+
+    uint16_t Store(real1 r) { return isBf16 ? ToBf16((float)r) : ToHalf((float)r * scale); }
+    real1 Load(uint16_t h) { return (real1)(isBf16 ? FromBf16(h) : (FromHalf(h) * invScale)); }
+
+public:
+    StateVectorHalf(bitCapIntOcl cap, bool bf16)
+        : StateVector(cap)
+        , amplitudes(new uint16_t[(size_t)cap << 1U])
+        , isBf16(bf16)
+    {
+        const int qb = (int)log2(cap);
+        scale = isBf16 ? 1.0f : std::ldexp(1.0f, ((qb >> 1) < 15) ? (qb >> 1) : 15);
+        invScale = 1.0f / scale;
+    }
+
+    complex read(const bitCapIntOcl& i)
+    {
+        return complex(Load(amplitudes[(size_t)i << 1U]), Load(amplitudes[((size_t)i << 1U) | 1U]));
+    }
+
+#if ENABLE_COMPLEX_X2
+    complex2 read2(const bitCapIntOcl& i1, const bitCapIntOcl& i2) { return complex2(read(i1), read(i2)); }
+#endif
+
+    void write(const bitCapIntOcl& i, const complex& c)
+    {
+        amplitudes[(size_t)i << 1U] = Store(real(c));
+        amplitudes[((size_t)i << 1U) | 1U] = Store(imag(c));
     }
 
     void write2(const bitCapIntOcl& i1, const complex& c1, const bitCapIntOcl& i2, const complex& c2)
     {
-        const bool isC1Set = abs(c1) > REAL1_EPSILON;
-        const bool isC2Set = abs(c2) > REAL1_EPSILON;
-        if (!isC1Set && !isC2Set) {
-            std::lock_guard<std::mutex> lock(mtx);
-            amplitudes.erase(i1);
-            amplitudes.erase(i2);
-        } else if (isC1Set && isC2Set) {
-            std::lock_guard<std::mutex> lock(mtx);
-            amplitudes[i1] = c1;
-            amplitudes[i2] = c2;
-        } else if (isC1Set) {
-            std::lock_guard<std::mutex> lock(mtx);
-            amplitudes.erase(i2);
-            amplitudes[i1] = c1;
-        } else {
-            std::lock_guard<std::mutex> lock(mtx);
-            amplitudes.erase(i1);
-            amplitudes[i2] = c2;
-        }
+        write(i1, c1);
+        write(i2, c2);
     }
 
     void clear()
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        amplitudes.clear();
+        // +0 is all 0 bits, in either format.
+        std::fill(amplitudes.get(), amplitudes.get() + ((size_t)capacity << 1U), 0U);
     }
 
     void copy_in(complex const* copyIn)
@@ -260,60 +682,32 @@ public:
             clear();
             return;
         }
-
-        std::lock_guard<std::mutex> lock(mtx);
         for (bitCapIntOcl i = 0U; i < capacity; ++i) {
-            if (abs(copyIn[i]) <= REAL1_EPSILON) {
-                amplitudes.erase(i);
-            } else {
-                amplitudes[i] = copyIn[i];
-            }
+            write(i, copyIn[i]);
         }
     }
 
     void copy_in(complex const* copyIn, const bitCapIntOcl offset, const bitCapIntOcl length)
     {
         if (!copyIn) {
-            std::lock_guard<std::mutex> lock(mtx);
-            for (bitCapIntOcl i = 0U; i < length; ++i) {
-                amplitudes.erase(i);
-            }
-
+            std::fill(amplitudes.get() + ((size_t)offset << 1U), amplitudes.get() + ((size_t)(offset + length) << 1U),
+                0U);
             return;
         }
-
-        std::lock_guard<std::mutex> lock(mtx);
         for (bitCapIntOcl i = 0U; i < length; ++i) {
-            if (abs(copyIn[i]) <= REAL1_EPSILON) {
-                amplitudes.erase(i);
-            } else {
-                amplitudes[i + offset] = copyIn[i];
-            }
+            write(i + offset, copyIn[i]);
         }
     }
 
     void copy_in(
         StateVectorPtr copyInSv, const bitCapIntOcl srcOffset, const bitCapIntOcl dstOffset, const bitCapIntOcl length)
     {
-        StateVectorSparsePtr copyIn = std::dynamic_pointer_cast<StateVectorSparse>(copyInSv);
-
-        if (!copyIn) {
-            std::lock_guard<std::mutex> lock(mtx);
-            for (bitCapIntOcl i = 0U; i < length; ++i) {
-                amplitudes.erase(i + srcOffset);
-            }
-
+        if (!copyInSv) {
+            copy_in(NULL, dstOffset, length);
             return;
         }
-
-        std::lock_guard<std::mutex> lock(mtx);
         for (bitCapIntOcl i = 0U; i < length; ++i) {
-            complex amp = copyIn->read(i + srcOffset);
-            if (abs(amp) <= REAL1_EPSILON) {
-                amplitudes.erase(i + srcOffset);
-            } else {
-                amplitudes[i + dstOffset] = amp;
-            }
+            write(i + dstOffset, copyInSv->read(i + srcOffset));
         }
     }
 
@@ -331,22 +725,21 @@ public:
         }
     }
 
-    void copy(const StateVectorPtr toCopy) { copy(std::dynamic_pointer_cast<StateVectorSparse>(toCopy)); }
-
-    void copy(StateVectorSparsePtr toCopy)
+    void copy(StateVectorPtr toCopy)
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        amplitudes = toCopy->amplitudes;
+        std::shared_ptr<StateVectorHalf> o = std::dynamic_pointer_cast<StateVectorHalf>(toCopy);
+        if (o && (o->isBf16 == isBf16) && (o->scale == scale)) {
+            std::copy(o->amplitudes.get(), o->amplitudes.get() + ((size_t)capacity << 1U), amplitudes.get());
+            return;
+        }
+        copy_in(toCopy, 0U, 0U, capacity);
     }
 
-    void shuffle(StateVectorPtr svp) { shuffle(std::dynamic_pointer_cast<StateVectorSparse>(svp)); }
-
-    void shuffle(StateVectorSparsePtr svp)
+    void shuffle(StateVectorPtr svp)
     {
-        const size_t halfCap = (size_t)(capacity >> ONE_BCI);
-        std::lock_guard<std::mutex> lock(mtx);
+        const bitCapIntOcl halfCap = capacity >> ONE_BCI;
         for (bitCapIntOcl i = 0U; i < halfCap; ++i) {
-            complex amp = svp->read(i);
+            const complex amp = svp->read(i);
             svp->write(i, read(i + halfCap));
             write(i + halfCap, amp);
         }
@@ -359,145 +752,312 @@ public:
         }
     }
 
-    bool is_sparse() { return (amplitudes.size() < (size_t)(capacity >> ONE_BCI)); }
+    bool is_sparse() { return false; }
+};
 
-    std::vector<bitCapIntOcl> iterable()
+/**
+ * A dense state vector in blocks of QRACK_BLOCKED_LANES amplitudes, each block holding all of its real parts, then all
+ * of its imaginary parts, (a "structure of arrays," per block). Kernels over contiguous runs of amplitudes then load,
+ * multiply, and store whole vectors of real parts and of imaginary parts, with no shuffling of interleaved lanes.
+ * read() and write() still exchange "complex," and the bulk copies convert whole ranges, so the interleaved layout only
+ * appears at the API boundary, (GetQuantumState(), SetAmplitudePage(), and the like).
+ */
+class StateVectorBlocked : public StateVector {
+protected:
+    std::unique_ptr<real1[]> data;
+
+    static size_t BlockedSize(bitCapIntOcl cap)
     {
-        std::vector<std::vector<bitCapIntOcl>> toRet(GetConcurrencyLevel());
-        std::vector<std::vector<bitCapIntOcl>>::iterator toRetIt;
+        // (Round up to whole blocks, for state vectors of fewer than QRACK_BLOCKED_LANES amplitudes.)
+        return (size_t)((cap + QRACK_BLOCKED_LANES - 1U) / QRACK_BLOCKED_LANES) * (QRACK_BLOCKED_LANES << 1U);
+    }
+    static bool IsBlockAligned(const bitCapIntOcl& i) { return !(i & (QRACK_BLOCKED_LANES - 1U)); }
 
-        // For lock_guard scope
-        if (true) {
-            std::lock_guard<std::mutex> lock(mtx);
+public:
+    /** The index in blocks() of the real part of amplitude "i," (with its imaginary part QRACK_BLOCKED_LANES later) */
+    static size_t RealIndex(const bitCapIntOcl& i)
+    {
+        const bitCapIntOcl lane = i & (QRACK_BLOCKED_LANES - 1U);
+        return ((size_t)(i ^ lane) << 1U) | (size_t)lane;
+    }
 
-            par_for(0U, amplitudes.size(), [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
-                auto it = amplitudes.begin();
-                std::advance(it, lcv);
-                toRet[cpu].push_back(it->first);
-            });
-        }
+    StateVectorBlocked(bitCapIntOcl cap)
+        : StateVector(cap)
+        , data(new real1[BlockedSize(cap)]())
+    {
+        // Intentionally left blank.
+    }
+
+    /** The blocked real and imaginary parts, where block-aligned amplitude "i" starts at index 2 * i */
+    real1* blocks() { return data.get(); }
+
+    complex read(const bitCapIntOcl& i)
+    {
+        const size_t r = RealIndex(i);
+        return complex(data[r], data[r + QRACK_BLOCKED_LANES]);
+    }
+
+#if ENABLE_COMPLEX_X2
+    complex2 read2(const bitCapIntOcl& i1, const bitCapIntOcl& i2) { return complex2(read(i1), read(i2)); }
+#endif
 
-        for (int64_t i = (int64_t)(toRet.size() - 1U); i >= 0; i--) {
-            if (!toRet[i].size()) {
-                toRetIt = toRet.begin();
-                std::advance(toRetIt, i);
-                toRet.erase(toRetIt);
+    void write(const bitCapIntOcl& i, const complex& c)
+    {
+        const size_t r = RealIndex(i);
+        data[r] = real(c);
+        data[r + QRACK_BLOCKED_LANES] = imag(c);
+    }
+
+    void write2(const bitCapIntOcl& i1, const complex& c1, const bitCapIntOcl& i2, const complex& c2)
+    {
+        write(i1, c1);
+        write(i2, c2);
+    }
+
+    void clear() { std::fill(data.get(), data.get() + BlockedSize(capacity), ZERO_R1); }
+
+    void copy_in(complex const* copyIn) { copy_in(copyIn, 0U, capacity); }
+
+    void copy_in(complex const* copyIn, const bitCapIntOcl offset, const bitCapIntOcl length)
+    {
+        if (!copyIn) {
+            for (bitCapIntOcl i = 0U; i < length; ++i) {
+                write(i + offset, ZERO_CMPLX);
             }
+            return;
         }
+        for (bitCapIntOcl i = 0U; i < length; ++i) {
+            write(i + offset, copyIn[i]);
+        }
+    }
 
-        if (!toRet.size()) {
-            return {};
+    void copy_in(
+        StateVectorPtr copyInSv, const bitCapIntOcl srcOffset, const bitCapIntOcl dstOffset, const bitCapIntOcl length)
+    {
+        if (!copyInSv) {
+            copy_in(NULL, dstOffset, length);
+            return;
         }
 
-        while (toRet.size() > 1U) {
-            // Work odd unit into collapse sequence:
-            if (toRet.size() & 1U) {
-                toRet[toRet.size() - 2U].insert(
-                    toRet[toRet.size() - 2U].end(), toRet[toRet.size() - 1U].begin(), toRet[toRet.size() - 1U].end());
-                toRet.pop_back();
-            }
+        std::shared_ptr<StateVectorBlocked> o = std::dynamic_pointer_cast<StateVectorBlocked>(copyInSv);
+        if (o && IsBlockAligned(srcOffset) && IsBlockAligned(dstOffset) && IsBlockAligned(length)) {
+            // (Whole blocks copy as they are.)
+            std::copy(o->data.get() + ((size_t)srcOffset << 1U), o->data.get() + ((size_t)(srcOffset + length) << 1U),
+                data.get() + ((size_t)dstOffset << 1U));
+            return;
+        }
 
-            const int64_t combineCount = (int64_t)(toRet.size() >> 1U);
-#if ENABLE_PTHREAD
-            std::vector<std::future<void>> futures(combineCount);
-            for (int64_t i = (combineCount - 1); i >= 0; i--) {
-                futures[i] = std::async(std::launch::async, [i, combineCount, &toRet]() {
-                    toRet[i].insert(toRet[i].end(), toRet[i + combineCount].begin(), toRet[i + combineCount].end());
-                    toRet[i + combineCount].clear();
-                });
-            }
-            for (int64_t i = (combineCount - 1); i >= 0; i--) {
-                futures[i].get();
-                toRet.pop_back();
-            }
-#else
-            for (int64_t i = (combineCount - 1); i >= 0; i--) {
-                toRet[i].insert(toRet[i].end(), toRet[i + combineCount].begin(), toRet[i + combineCount].end());
-                toRet.pop_back();
-            }
+        StateVectorArrayPtr a = std::dynamic_pointer_cast<StateVectorArray>(copyInSv);
+        if (a) {
+            copy_in(a->amplitudes.get() + srcOffset, dstOffset, length);
+            return;
+        }
+
+        for (bitCapIntOcl i = 0U; i < length; ++i) {
+            write(i + dstOffset, copyInSv->read(i + srcOffset));
+        }
+    }
+
+    void copy_out(complex* copyOut) { copy_out(copyOut, 0U, capacity); }
+
+    void copy_out(complex* copyOut, const bitCapIntOcl offset, const bitCapIntOcl length)
+    {
+        for (bitCapIntOcl i = 0U; i < length; ++i) {
+            copyOut[i] = read(i + offset);
+        }
+    }
+
+    void copy(StateVectorPtr toCopy) { copy_in(toCopy, 0U, 0U, capacity); }
+
+    void shuffle(StateVectorPtr svp)
+    {
+        const bitCapIntOcl halfCap = capacity >> ONE_BCI;
+        std::shared_ptr<StateVectorBlocked> o = std::dynamic_pointer_cast<StateVectorBlocked>(svp);
+        if (o && IsBlockAligned(halfCap)) {
+            std::swap_ranges(
+                data.get() + ((size_t)halfCap << 1U), data.get() + ((size_t)capacity << 1U), o->data.get());
+            return;
+        }
+
+        for (bitCapIntOcl i = 0U; i < halfCap; ++i) {
+            const complex amp = svp->read(i);
+            svp->write(i, read(i + halfCap));
+            write(i + halfCap, amp);
+        }
+    }
+
+    void get_probs(real1* outArray)
+    {
+        for (bitCapIntOcl i = 0U; i < capacity; ++i) {
+            const size_t r = RealIndex(i);
+            outArray[i] = (data[r] * data[r]) + (data[r + QRACK_BLOCKED_LANES] * data[r + QRACK_BLOCKED_LANES]);
+        }
+    }
+
+    bool is_sparse() { return false; }
+};
+
+class StateVectorSparse : public StateVector, public ParallelFor {
+protected:
+    SparseStateVecMap amplitudes;
+
+    void writeUnchecked(const bitCapIntOcl& i, const complex& c)
+    {
+        if (abs(c) > REAL1_EPSILON) {
+            amplitudes.set(i, c);
+        } else {
+            amplitudes.erase(i);
+        }
+    }
+
+public:
+    StateVectorSparse(bitCapIntOcl cap)
+        : StateVector(cap)
+        , amplitudes()
+    {
+    }
+
+    complex read(const bitCapIntOcl& i) { return amplitudes.get(i, isReadLocked); }
+
+#if ENABLE_COMPLEX_X2
+    complex2 read2(const bitCapIntOcl& i1, const bitCapIntOcl& i2)
+    {
+        return complex2(amplitudes.get(i1, isReadLocked), amplitudes.get(i2, isReadLocked));
+    }
 #endif
+
+    void write(const bitCapIntOcl& i, const complex& c) { writeUnchecked(i, c); }
+
+    void write2(const bitCapIntOcl& i1, const complex& c1, const bitCapIntOcl& i2, const complex& c2)
+    {
+        writeUnchecked(i1, c1);
+        writeUnchecked(i2, c2);
+    }
+
+    void clear() { amplitudes.clear(); }
+
+    void copy_in(complex const* copyIn)
+    {
+        if (!copyIn) {
+            clear();
+            return;
         }
 
-        return toRet[0U];
+        par_for(0U, capacity, [&](const bitCapIntOcl& lcv, const unsigned& cpu) { writeUnchecked(lcv, copyIn[lcv]); });
     }
 
-    /// Returns empty if iteration should be over full set, otherwise just the iterable elements:
-    std::set<bitCapIntOcl> iterable(
-        const bitCapIntOcl& setMask, const bitCapIntOcl& filterMask = 0, const bitCapIntOcl& filterValues = 0)
+    void copy_in(complex const* copyIn, const bitCapIntOcl offset, const bitCapIntOcl length)
     {
-        if (!filterMask && filterValues) {
-            return {};
+        if (!copyIn) {
+            par_for(0U, length, [&](const bitCapIntOcl& lcv, const unsigned& cpu) { amplitudes.erase(lcv + offset); });
+            return;
         }
 
-        const bitCapIntOcl unsetMask = ~setMask;
+        par_for(0U, length,
+            [&](const bitCapIntOcl& lcv, const unsigned& cpu) { writeUnchecked(lcv + offset, copyIn[lcv]); });
+    }
 
-        std::vector<std::set<bitCapIntOcl>> toRet(GetConcurrencyLevel());
-        std::vector<std::set<bitCapIntOcl>>::iterator toRetIt;
-
-        // For lock_guard scope
-        if (true) {
-            std::lock_guard<std::mutex> lock(mtx);
-
-            if (!filterMask && !filterValues) {
-                par_for(0U, amplitudes.size(), [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
-                    auto it = amplitudes.begin();
-                    std::advance(it, lcv);
-                    toRet[cpu].insert(it->first & unsetMask);
-                });
-            } else {
-                const bitCapIntOcl unfilterMask = ~filterMask;
-                par_for(0U, amplitudes.size(), [&](const bitCapIntOcl lcv, const unsigned& cpu) {
-                    auto it = amplitudes.begin();
-                    std::advance(it, lcv);
-                    if ((it->first & filterMask) == filterValues) {
-                        toRet[cpu].insert(it->first & unsetMask & unfilterMask);
-                    }
-                });
-            }
+    void copy_in(
+        StateVectorPtr copyInSv, const bitCapIntOcl srcOffset, const bitCapIntOcl dstOffset, const bitCapIntOcl length)
+    {
+        StateVectorSparsePtr copyIn = std::dynamic_pointer_cast<StateVectorSparse>(copyInSv);
+
+        if (!copyIn) {
+            par_for(
+                0U, length, [&](const bitCapIntOcl& lcv, const unsigned& cpu) { amplitudes.erase(lcv + dstOffset); });
+            return;
         }
 
-        for (int64_t i = (int64_t)(toRet.size() - 1U); i >= 0; i--) {
-            if (!toRet[i].size()) {
-                toRetIt = toRet.begin();
-                std::advance(toRetIt, i);
-                toRet.erase(toRetIt);
-            }
+        par_for(0U, length, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            writeUnchecked(lcv + dstOffset, copyIn->read(lcv + srcOffset));
+        });
+    }
+
+    void copy_out(complex* copyOut)
+    {
+        par_for(0U, capacity, [&](const bitCapIntOcl& lcv, const unsigned& cpu) { copyOut[lcv] = read(lcv); });
+    }
+
+    void copy_out(complex* copyOut, const bitCapIntOcl offset, const bitCapIntOcl length)
+    {
+        par_for(0U, length, [&](const bitCapIntOcl& lcv, const unsigned& cpu) { copyOut[lcv] = read(lcv + offset); });
+    }
+
+    void copy(const StateVectorPtr toCopy) { copy(std::dynamic_pointer_cast<StateVectorSparse>(toCopy)); }
+
+    void copy(StateVectorSparsePtr toCopy) { amplitudes.copy(toCopy->amplitudes); }
+
+    void shuffle(StateVectorPtr svp) { shuffle(std::dynamic_pointer_cast<StateVectorSparse>(svp)); }
+
+    void shuffle(StateVectorSparsePtr svp)
+    {
+        const bitCapIntOcl halfCap = capacity >> ONE_BCI;
+        par_for(0U, halfCap, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            const complex amp = svp->read(lcv);
+            svp->write(lcv, read(lcv + halfCap));
+            write(lcv + halfCap, amp);
+        });
+    }
+
+    void get_probs(real1* outArray)
+    {
+        par_for(0U, capacity, [&](const bitCapIntOcl& lcv, const unsigned& cpu) { outArray[lcv] = norm(read(lcv)); });
+    }
+
+    bool is_sparse() { return (amplitudes.size() < (size_t)(capacity >> ONE_BCI)); }
+
+    /// Returns the indices of every nonzero amplitude, (after compacting underfull shards,) in no particular order.
+    std::vector<bitCapIntOcl> iterable()
+    {
+        amplitudes.compact();
+
+        std::vector<std::vector<bitCapIntOcl>> perShard(QRACK_SPARSE_SHARDS);
+        par_for(0U, QRACK_SPARSE_SHARDS, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            amplitudes.for_each_key((size_t)lcv, [&](const bitCapIntOcl& k) { perShard[lcv].push_back(k); });
+        });
+
+        size_t total = 0U;
+        for (const auto& p : perShard) {
+            total += p.size();
         }
 
-        if (!toRet.size()) {
+        std::vector<bitCapIntOcl> toRet;
+        toRet.reserve(total);
+        for (const auto& p : perShard) {
+            toRet.insert(toRet.end(), p.begin(), p.end());
+        }
+
+        return toRet;
+    }
+
+    /// Returns empty if iteration should be over full set, otherwise just the iterable elements:
+    std::set<bitCapIntOcl> iterable(
+        const bitCapIntOcl& setMask, const bitCapIntOcl& filterMask = 0, const bitCapIntOcl& filterValues = 0)
+    {
+        if (!filterMask && filterValues) {
             return {};
         }
 
-        while (toRet.size() > 1U) {
-            // Work odd unit into collapse sequence:
-            if (toRet.size() & 1U) {
-                toRet[toRet.size() - 2U].insert(toRet[toRet.size() - 1U].begin(), toRet[toRet.size() - 1U].end());
-                toRet.pop_back();
-            }
+        amplitudes.compact();
 
-            const int64_t combineCount = (int64_t)(toRet.size() >> 1U);
-#if ENABLE_PTHREAD
-            std::vector<std::future<void>> futures(combineCount);
-            for (int64_t i = (combineCount - 1); i >= 0; i--) {
-                futures[i] = std::async(std::launch::async, [i, combineCount, &toRet]() {
-                    toRet[i].insert(toRet[i + combineCount].begin(), toRet[i + combineCount].end());
-                    toRet[i + combineCount].clear();
-                });
-            }
+        const bitCapIntOcl unsetMask = ~setMask;
+        const bitCapIntOcl unfilterMask = ~filterMask;
 
-            for (int64_t i = (combineCount - 1); i >= 0; i--) {
-                futures[i].get();
-                toRet.pop_back();
-            }
-#else
-            for (int64_t i = (combineCount - 1); i >= 0; i--) {
-                toRet[i].insert(toRet[i + combineCount].begin(), toRet[i + combineCount].end());
-                toRet.pop_back();
-            }
-#endif
+        std::vector<std::vector<bitCapIntOcl>> perShard(QRACK_SPARSE_SHARDS);
+        par_for(0U, QRACK_SPARSE_SHARDS, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            amplitudes.for_each_key((size_t)lcv, [&](const bitCapIntOcl& k) {
+                if ((k & filterMask) == filterValues) {
+                    perShard[lcv].push_back(k & unsetMask & unfilterMask);
+                }
+            });
+        });
+
+        std::set<bitCapIntOcl> toRet;
+        for (const auto& p : perShard) {
+            toRet.insert(p.begin(), p.end());
         }
 
-        return toRet[0U];
+        return toRet;
     }
 };
 
@@ -0,0 +1,74 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "common/alias_table.hpp"
+
+#include <stdexcept>
+
+namespace Qrack {
+
+AliasTable::AliasTable(real1 const* weights, bitCapIntOcl n)
+    : threshold(n)
+    , alias(n)
+{
+    if (!n) {
+        throw std::invalid_argument("AliasTable requires at least one outcome!");
+    }
+
+    double total = 0.0;
+    for (bitCapIntOcl i = 0U; i < n; ++i) {
+        total += (double)weights[i];
+    }
+
+    // A zero distribution has no preference: sample uniformly.
+    const double scale = (total > 0.0) ? ((double)n / total) : 0.0;
+    std::vector<bitCapIntOcl> small;
+    std::vector<bitCapIntOcl> large;
+    for (bitCapIntOcl i = 0U; i < n; ++i) {
+        threshold[i] = (total > 0.0) ? (real1)((double)weights[i] * scale) : ONE_R1;
+        alias[i] = i;
+        if (threshold[i] < ONE_R1) {
+            small.push_back(i);
+        } else {
+            large.push_back(i);
+        }
+    }
+
+    // Each "large" outcome tops up "small" ones until it is small itself. Only the donor's running total needs more
+    // than real1 precision, so it is held in a double, rather than a full table of them.
+    while (small.size() && large.size()) {
+        const bitCapIntOcl l = large.back();
+        large.pop_back();
+        double lScaled = (double)threshold[l];
+        while (small.size() && (lScaled >= 1.0)) {
+            const bitCapIntOcl s = small.back();
+            small.pop_back();
+            alias[s] = l;
+            lScaled -= 1.0 - (double)threshold[s];
+        }
+        if (lScaled < 1.0) {
+            threshold[l] = (real1)lScaled;
+            small.push_back(l);
+        } else {
+            threshold[l] = ONE_R1;
+        }
+    }
+
+    // Whatever is left is full, up to rounding error.
+    for (size_t i = 0U; i < large.size(); ++i) {
+        threshold[large[i]] = ONE_R1;
+    }
+    for (size_t i = 0U; i < small.size(); ++i) {
+        threshold[small[i]] = ONE_R1;
+    }
+}
+} // namespace Qrack
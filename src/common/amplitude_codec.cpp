@@ -0,0 +1,170 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "common/amplitude_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#define AMP_CODEC_ZEROS 0U
+#define AMP_CODEC_LITERALS 1U
+#define AMP_CODEC_MATCH 2U
+#define AMP_CODEC_HASH_BITS 12U
+#define AMP_CODEC_NO_MATCH ((bitCapIntOcl)(-1))
+
+namespace Qrack {
+
+namespace {
+    const size_t AMP_BYTES = sizeof(complex);
+
+    void PutVarint(std::vector<unsigned char>& blob, bitCapIntOcl v)
+    {
+        while (v >= 0x80U) {
+            blob.push_back((unsigned char)(v | 0x80U));
+            v >>= 7U;
+        }
+        blob.push_back((unsigned char)v);
+    }
+
+    bitCapIntOcl GetVarint(const std::vector<unsigned char>& blob, size_t& pos)
+    {
+        bitCapIntOcl v = 0U;
+        for (unsigned shift = 0U;; shift += 7U) {
+            if ((pos >= blob.size()) || (shift >= (sizeof(bitCapIntOcl) << 3U))) {
+                throw std::runtime_error("DecompressAmplitudes blob is corrupt!");
+            }
+            const unsigned char b = blob[pos++];
+            v |= (bitCapIntOcl)(b & 0x7FU) << shift;
+            if (!(b & 0x80U)) {
+                return v;
+            }
+        }
+    }
+
+    // FNV-1a over the bytes of the amplitude pair at "p," folded to AMP_CODEC_HASH_BITS
+    size_t HashPair(unsigned char const* p)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t b = 0U; b < (AMP_BYTES << 1U); ++b) {
+            h = (h ^ p[b]) * 1099511628211ULL;
+        }
+
+        return (size_t)(h >> (64U - AMP_CODEC_HASH_BITS));
+    }
+} // namespace
+
+std::vector<unsigned char> CompressAmplitudes(complex const* amps, bitCapIntOcl length)
+{
+    unsigned char const* src = (unsigned char const*)amps;
+    static const unsigned char zeroAmp[sizeof(complex)] = { 0U };
+    const auto isZero = [&](bitCapIntOcl i) { return !std::memcmp(src + i * AMP_BYTES, zeroAmp, AMP_BYTES); };
+    const auto isSame = [&](bitCapIntOcl i, bitCapIntOcl j) {
+        return !std::memcmp(src + i * AMP_BYTES, src + j * AMP_BYTES, AMP_BYTES);
+    };
+
+    std::vector<unsigned char> blob;
+    std::vector<bitCapIntOcl> lastSeen(1U << AMP_CODEC_HASH_BITS, AMP_CODEC_NO_MATCH);
+    bitCapIntOcl litStart = 0U;
+    const auto flushLiterals = [&](bitCapIntOcl end) {
+        if (end == litStart) {
+            return;
+        }
+        blob.push_back(AMP_CODEC_LITERALS);
+        PutVarint(blob, end - litStart);
+        blob.insert(blob.end(), src + litStart * AMP_BYTES, src + end * AMP_BYTES);
+    };
+
+    bitCapIntOcl i = 0U;
+    while (i < length) {
+        if (isZero(i)) {
+            bitCapIntOcl j = i + 1U;
+            while ((j < length) && isZero(j)) {
+                ++j;
+            }
+            flushLiterals(i);
+            blob.push_back(AMP_CODEC_ZEROS);
+            PutVarint(blob, j - i);
+            i = litStart = j;
+            continue;
+        }
+
+        if ((i + 1U) < length) {
+            const size_t h = HashPair(src + i * AMP_BYTES);
+            const bitCapIntOcl cand = lastSeen[h];
+            lastSeen[h] = i;
+            if ((cand != AMP_CODEC_NO_MATCH) && isSame(cand, i) && isSame(cand + 1U, i + 1U)) {
+                // (The match can overlap the amplitudes it produces, to encode a periodic run.)
+                bitCapIntOcl len = 2U;
+                while (((i + len) < length) && isSame(cand + len, i + len)) {
+                    ++len;
+                }
+                flushLiterals(i);
+                blob.push_back(AMP_CODEC_MATCH);
+                PutVarint(blob, i - cand);
+                PutVarint(blob, len);
+                i = litStart = i + len;
+                continue;
+            }
+        }
+
+        ++i;
+    }
+    flushLiterals(length);
+
+    blob.shrink_to_fit();
+    return blob;
+}
+
+void DecompressAmplitudes(const std::vector<unsigned char>& blob, complex* amps, bitCapIntOcl length)
+{
+    unsigned char* dst = (unsigned char*)amps;
+    size_t pos = 0U;
+    bitCapIntOcl i = 0U;
+    while (pos < blob.size()) {
+        const unsigned char tag = blob[pos++];
+        if (tag == AMP_CODEC_MATCH) {
+            const bitCapIntOcl dist = GetVarint(blob, pos);
+            const bitCapIntOcl len = GetVarint(blob, pos);
+            if (!dist || (dist > i) || (len > (length - i))) {
+                throw std::runtime_error("DecompressAmplitudes blob is corrupt!");
+            }
+            // Forward, one amplitude at a time, in case the match overlaps itself
+            for (bitCapIntOcl j = 0U; j < len; ++j, ++i) {
+                std::memcpy(dst + i * AMP_BYTES, dst + (i - dist) * AMP_BYTES, AMP_BYTES);
+            }
+            continue;
+        }
+
+        const bitCapIntOcl len = GetVarint(blob, pos);
+        if (len > (length - i)) {
+            throw std::runtime_error("DecompressAmplitudes blob is corrupt!");
+        }
+        if (tag == AMP_CODEC_ZEROS) {
+            std::fill(amps + i, amps + i + len, ZERO_CMPLX);
+        } else if (tag == AMP_CODEC_LITERALS) {
+            if ((blob.size() - pos) < (len * AMP_BYTES)) {
+                throw std::runtime_error("DecompressAmplitudes blob is corrupt!");
+            }
+            std::memcpy(dst + i * AMP_BYTES, blob.data() + pos, len * AMP_BYTES);
+            pos += len * AMP_BYTES;
+        } else {
+            throw std::runtime_error("DecompressAmplitudes blob is corrupt!");
+        }
+        i += len;
+    }
+
+    if (i != length) {
+        throw std::runtime_error("DecompressAmplitudes blob is corrupt!");
+    }
+}
+} // namespace Qrack
@@ -0,0 +1,233 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "checkpoint.hpp"
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#if ENABLE_PTHREAD
+#include <future>
+#endif
+
+#define QRACK_CHECKPOINT_VERSION 1U
+
+namespace Qrack {
+
+enum CheckpointChunkEncoding { CHUNK_END = 0U, CHUNK_RAW = 1U, CHUNK_ZERO_RUNS = 2U };
+
+CheckpointWriter::CheckpointWriter(std::ostream& o, bool compress)
+    : os(o)
+    , doCompress(compress)
+{
+    WriteBytes("QRCK", 4U);
+    Write<uint32_t>(QRACK_CHECKPOINT_VERSION);
+    Write<uint8_t>((uint8_t)sizeof(real1));
+    Write<uint8_t>((uint8_t)sizeof(bitCapInt));
+}
+
+void CheckpointWriter::WriteBytes(const void* data, size_t size)
+{
+    if (!os.write((const char*)data, size)) {
+        throw std::runtime_error("CheckpointWriter could not write to its stream!");
+    }
+}
+
+void CheckpointWriter::BeginSection(const char* tag) { WriteBytes(tag, 4U); }
+
+void CheckpointWriter::WriteRow(const std::vector<uint64_t>& row)
+{
+    Write<uint64_t>(row.size());
+    WriteBytes(row.data(), row.size() * sizeof(uint64_t));
+}
+
+void CheckpointWriter::WriteAmplitudes(bitCapIntOcl offset, complex const* amps, bitCapIntOcl count)
+{
+    // A run-length code is a series of (0 count, literal count) pairs, then the literals, in order.
+    std::vector<uint32_t> runs;
+    size_t literalCount = 0U;
+    if (doCompress) {
+        bitCapIntOcl i = 0U;
+        while (i < count) {
+            const bitCapIntOcl zStart = i;
+            while ((i < count) && (amps[i] == ZERO_CMPLX)) {
+                ++i;
+            }
+            const bitCapIntOcl lStart = i;
+            while ((i < count) && (amps[i] != ZERO_CMPLX)) {
+                ++i;
+            }
+            runs.push_back((uint32_t)(lStart - zStart));
+            runs.push_back((uint32_t)(i - lStart));
+            literalCount += i - lStart;
+        }
+    }
+
+    const size_t encodedSize =
+        sizeof(uint64_t) + runs.size() * sizeof(uint32_t) + literalCount * sizeof(complex);
+    const bool isEncoded = doCompress && (encodedSize < (count * sizeof(complex)));
+
+    Write<uint8_t>(isEncoded ? CHUNK_ZERO_RUNS : CHUNK_RAW);
+    Write<uint64_t>(offset);
+    Write<uint64_t>(count);
+
+    if (!isEncoded) {
+        Write<uint64_t>(count * sizeof(complex));
+        WriteBytes(amps, count * sizeof(complex));
+        return;
+    }
+
+    Write<uint64_t>(encodedSize);
+    Write<uint64_t>(runs.size());
+    WriteBytes(runs.data(), runs.size() * sizeof(uint32_t));
+    bitCapIntOcl i = 0U;
+    for (size_t r = 0U; r < runs.size(); r += 2U) {
+        i += runs[r];
+        WriteBytes(amps + i, runs[r + 1U] * sizeof(complex));
+        i += runs[r + 1U];
+    }
+}
+
+void CheckpointWriter::EndAmplitudes() { Write<uint8_t>(CHUNK_END); }
+
+CheckpointReader::CheckpointReader(std::istream& i)
+    : is(i)
+{
+    ExpectSection("QRCK");
+    if (Read<uint32_t>() != QRACK_CHECKPOINT_VERSION) {
+        throw std::runtime_error("CheckpointReader does not support this checkpoint format version!");
+    }
+    if ((Read<uint8_t>() != sizeof(real1)) || (Read<uint8_t>() != sizeof(bitCapInt))) {
+        throw std::runtime_error("CheckpointReader checkpoint was written with a different real1 or bitCapInt width!");
+    }
+}
+
+void CheckpointReader::ReadBytes(void* data, size_t size)
+{
+    if (!is.read((char*)data, size)) {
+        throw std::runtime_error("CheckpointReader checkpoint stream is truncated!");
+    }
+}
+
+void CheckpointReader::ExpectSection(const char* tag)
+{
+    char t[4U];
+    ReadBytes(t, 4U);
+    if (std::memcmp(t, tag, 4U)) {
+        throw std::runtime_error("CheckpointReader expected section \"" + std::string(tag, 4U) + "\"!");
+    }
+}
+
+std::vector<uint64_t> CheckpointReader::ReadRow()
+{
+    std::vector<uint64_t> row(Read<uint64_t>());
+    ReadBytes(row.data(), row.size() * sizeof(uint64_t));
+
+    return row;
+}
+
+static void DecodeChunk(uint8_t encoding, const std::vector<char>& payload, complex* amps, bitCapIntOcl count)
+{
+    if (encoding == CHUNK_RAW) {
+        if (payload.size() != (count * sizeof(complex))) {
+            throw std::runtime_error("CheckpointReader chunk has the wrong size!");
+        }
+        std::memcpy((void*)amps, payload.data(), payload.size());
+        return;
+    }
+
+    if ((encoding != CHUNK_ZERO_RUNS) || (payload.size() < sizeof(uint64_t))) {
+        throw std::runtime_error("CheckpointReader chunk encoding is invalid!");
+    }
+
+    uint64_t runCount;
+    std::memcpy(&runCount, payload.data(), sizeof(uint64_t));
+    const char* literals = payload.data() + sizeof(uint64_t) + runCount * sizeof(uint32_t);
+    const char* end = payload.data() + payload.size();
+    if ((runCount & 1U) || (literals > end)) {
+        throw std::runtime_error("CheckpointReader chunk encoding is invalid!");
+    }
+
+    const char* r = payload.data() + sizeof(uint64_t);
+    bitCapIntOcl i = 0U;
+    for (uint64_t j = 0U; j < runCount; j += 2U) {
+        uint32_t zeros, lits;
+        std::memcpy(&zeros, r, sizeof(uint32_t));
+        std::memcpy(&lits, r + sizeof(uint32_t), sizeof(uint32_t));
+        r += 2U * sizeof(uint32_t);
+        if (((i + zeros + lits) > count) || ((literals + lits * sizeof(complex)) > end)) {
+            throw std::runtime_error("CheckpointReader chunk encoding is invalid!");
+        }
+        std::fill(amps + i, amps + i + zeros, ZERO_CMPLX);
+        i += zeros;
+        std::memcpy((void*)(amps + i), literals, lits * sizeof(complex));
+        literals += lits * sizeof(complex);
+        i += lits;
+    }
+    if (i != count) {
+        throw std::runtime_error("CheckpointReader chunk encoding is invalid!");
+    }
+}
+
+void CheckpointReader::ReadAmplitudes(bitCapIntOcl maxPower, LaneFn lane, ApplyFn apply)
+{
+#if ENABLE_PTHREAD
+    std::map<size_t, std::future<void>> inFlight;
+#endif
+
+    for (;;) {
+        const uint8_t encoding = Read<uint8_t>();
+        if (encoding == CHUNK_END) {
+            break;
+        }
+
+        const bitCapIntOcl offset = (bitCapIntOcl)Read<uint64_t>();
+        const bitCapIntOcl count = (bitCapIntOcl)Read<uint64_t>();
+        if ((count > pow2Ocl(QRACK_CHECKPOINT_CHUNK_POW)) || (offset > maxPower) || (count > (maxPower - offset))) {
+            throw std::runtime_error("CheckpointReader chunk range is out-of-bounds!");
+        }
+
+        const uint64_t payloadSize = Read<uint64_t>();
+        if (payloadSize > (count * sizeof(complex) + sizeof(uint64_t))) {
+            throw std::runtime_error("CheckpointReader chunk has the wrong size!");
+        }
+        std::shared_ptr<std::vector<char>> payload = std::make_shared<std::vector<char>>(payloadSize);
+        ReadBytes(payload->data(), payloadSize);
+
+        auto restore = [encoding, payload, offset, count, apply]() {
+            std::unique_ptr<complex[]> amps(new complex[count]);
+            DecodeChunk(encoding, *payload, amps.get(), count);
+            apply(offset, amps.get(), count);
+        };
+
+#if ENABLE_PTHREAD
+        const size_t l = lane(offset);
+        auto it = inFlight.find(l);
+        if (it != inFlight.end()) {
+            it->second.get();
+        }
+        inFlight[l] = std::async(std::launch::async, restore);
+#else
+        restore();
+#endif
+    }
+
+#if ENABLE_PTHREAD
+    for (auto& f : inFlight) {
+        f.second.get();
+    }
+#endif
+}
+} // namespace Qrack
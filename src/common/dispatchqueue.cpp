@@ -13,105 +13,112 @@
 // From https://github.com/embeddedartistry/embedded-resources/blob/master/examples/cpp/dispatch.cpp
 
 #include "dispatchqueue.hpp"
+#include "parallel_pool.hpp"
 
 namespace Qrack {
 DispatchQueue::~DispatchQueue()
 {
-    std::unique_lock<std::mutex> lock(lock_);
-
-    if (!isStarted_) {
-        return;
-    }
+    std::unique_lock<std::mutex> lock(state_->lock);
 
     std::queue<DispatchFn> empty;
-    std::swap(q_, empty);
-    quit_ = true;
+    std::swap(state_->q, empty);
+    state_->quit = true;
 
-    lock.unlock();
-    cv_.notify_all();
+    // Queued operations capture their engine, so one that's running has to finish before the engine goes.
+    state_->cvIdle.wait(lock, [this] { return !state_->isRunning; });
+}
 
-    // Wait for thread to finish before we exit
-    thread_.get();
+void DispatchQueue::drain(State& state, std::unique_lock<std::mutex>& lock)
+{
+    while (state.q.size() && !state.quit) {
+        DispatchFn op = std::move(state.q.front());
+        state.q.pop();
+
+        // unlock now that we're done messing with the queue
+        lock.unlock();
+        try {
+            op();
+        } catch (...) {
+            lock.lock();
+            if (!state.error) {
+                state.error = std::current_exception();
+            }
+            lock.unlock();
+        }
+        lock.lock();
+    }
 
-    isFinished_ = true;
-    cvFinished_.notify_all();
+    state.isRunning = false;
+    state.cvIdle.notify_all();
 }
 
 void DispatchQueue::finish()
 {
-    std::unique_lock<std::mutex> lock(lock_);
+    std::unique_lock<std::mutex> lock(state_->lock);
 
-    if (quit_ || !isStarted_) {
-        return;
+    while (state_->q.size() && !state_->quit) {
+        if (state_->isRunning) {
+            state_->cvIdle.wait(lock, [this] { return !state_->isRunning; });
+            continue;
+        }
+        // No worker has started on it, so drain it here, (and the posted task will find nothing left).
+        state_->isRunning = true;
+        drain(*state_, lock);
     }
+    state_->cvIdle.wait(lock, [this] { return !state_->isRunning; });
 
-    cvFinished_.wait(lock, [this] { return isFinished_ || quit_; });
+    if (state_->error) {
+        std::exception_ptr error = state_->error;
+        state_->error = NULL;
+        std::rethrow_exception(error);
+    }
 }
 
 void DispatchQueue::dump()
 {
-    std::unique_lock<std::mutex> lock(lock_);
-
-    if (quit_ || !isStarted_) {
-        return;
-    }
+    std::unique_lock<std::mutex> lock(state_->lock);
 
     std::queue<DispatchFn> empty;
-    std::swap(q_, empty);
-    isFinished_ = true;
-    lock.unlock();
-    cvFinished_.notify_all();
+    std::swap(state_->q, empty);
+    state_->error = NULL;
+
+    // (The operation that's already running can't be recalled.)
+    state_->cvIdle.wait(lock, [this] { return !state_->isRunning; });
+}
+
+bool DispatchQueue::isFinished()
+{
+    std::lock_guard<std::mutex> lock(state_->lock);
+    return !state_->q.size() && !state_->isRunning;
 }
 
 void DispatchQueue::dispatch(const DispatchFn& op)
 {
-    std::unique_lock<std::mutex> lock(lock_);
+    std::unique_lock<std::mutex> lock(state_->lock);
 
-    if (quit_) {
+    if (state_->quit) {
         return;
     }
 
-    q_.push(op);
-    isFinished_ = false;
-    if (!isStarted_) {
-        isStarted_ = true;
-        thread_ = std::async(std::launch::async, [this] { dispatch_thread_handler(); });
+    state_->q.push(op);
+    if (state_->isRunning || state_->isPosted) {
+        // The running or posted drain will reach it.
+        return;
     }
-
-    // Manual unlocking is done before notifying, to avoid waking up
-    // the waiting thread only to block again (see notify_one for details)
+    state_->isPosted = true;
     lock.unlock();
-    cv_.notify_one();
-}
-
-void DispatchQueue::dispatch_thread_handler(void)
-{
-    std::unique_lock<std::mutex> lock(lock_);
-
-    do {
-        // Wait until we have data or a quit signal
-        cv_.wait(lock, [this] { return (q_.size() || quit_); });
-        // after wait, we own the lock
-
-        if (quit_) {
-            continue;
-        }
-
-        auto op = std::move(q_.front());
-        q_.pop();
-
-        // unlock now that we're done messing with the queue
-        lock.unlock();
-
-        op();
-
-        lock.lock();
 
-        if (!q_.size()) {
-            isFinished_ = true;
-            cvFinished_.notify_all();
+    std::shared_ptr<State> state = state_;
+    ParallelPool::Instance().Post([state] {
+        std::unique_lock<std::mutex> lock(state->lock);
+        state->isPosted = false;
+        if (state->isRunning) {
+            // finish() is already draining on its own thread.
+            return;
         }
-    } while (!quit_);
+        state->isRunning = true;
+        drain(*state, lock);
+    });
 }
 
 } // namespace Qrack
@@ -0,0 +1,285 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "engine_profile.hpp"
+#include "qengine_cpu.hpp"
+
+#if ENABLE_OPENCL
+#include "qengine_opencl.hpp"
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if !defined(_WIN32) || defined(__CYGWIN__)
+#include <unistd.h>
+#endif
+
+// Minimum wall-clock time, in seconds, to time any one measurement over
+#define QRACK_PROFILE_MIN_SECONDS 0.01
+#define QRACK_PROFILE_MAX_REPS 65536U
+
+namespace Qrack {
+
+double DeviceProfile::Apply2x2Time(bitLenInt qb) const
+{
+    if (apply2x2.empty()) {
+        return launchLatency;
+    }
+
+    auto it = apply2x2.upper_bound(qb);
+    if (it == apply2x2.begin()) {
+        // Narrower than anything measured is latency-bound.
+        return it->second;
+    }
+    --it;
+
+    return std::ldexp(it->second, (int)qb - (int)it->first);
+}
+
+double DeviceProfile::TransferTime(bitLenInt qb) const
+{
+    return (bandwidth > 0.0) ? (std::ldexp((double)sizeof(complex), (int)qb) / bandwidth) : 0.0;
+}
+
+static EngineProfile LoadDefaultProfile()
+{
+    EngineProfile profile;
+    profile.Load(EngineProfile::GetDefaultPath());
+
+    return profile;
+}
+
+EngineProfile& EngineProfile::Instance()
+{
+    static EngineProfile instance = LoadDefaultProfile();
+    return instance;
+}
+
+std::string EngineProfile::GetDefaultPath()
+{
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_ENGINE_PROFILE")) {
+        return std::string(getenv("QRACK_ENGINE_PROFILE"));
+    }
+#endif
+#if defined(_WIN32) && !defined(__CYGWIN__)
+    return std::string(getenv("HOMEDRIVE") ? getenv("HOMEDRIVE") : "") +
+        std::string(getenv("HOMEPATH") ? getenv("HOMEPATH") : "") + "\\.qrack\\engine_profile.txt";
+#else
+    return std::string(getenv("HOME") ? getenv("HOME") : "") + "/.qrack/engine_profile.txt";
+#endif
+}
+
+bool EngineProfile::Load(const std::string& path)
+{
+    cpu = DeviceProfile();
+    devices.clear();
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || (line[0] == '#')) {
+            continue;
+        }
+
+        std::istringstream ss(line);
+        std::string device, key;
+        if (!(ss >> device >> key)) {
+            continue;
+        }
+
+        DeviceProfile* dp;
+        if (device == "cpu") {
+            dp = &cpu;
+        } else {
+            int64_t devID;
+            std::istringstream ds(device);
+            if (!(ds >> devID)) {
+                continue;
+            }
+            dp = &(devices[devID]);
+        }
+
+        if (key == "latency") {
+            ss >> dp->launchLatency;
+        } else if (key == "bandwidth") {
+            ss >> dp->bandwidth;
+        } else if (key == "max_qb") {
+            size_t qb;
+            if (ss >> qb) {
+                dp->maxQubits = (bitLenInt)qb;
+            }
+        } else if (key == "2x2") {
+            size_t qb;
+            double t;
+            if ((ss >> qb >> t) && (t > 0.0)) {
+                dp->apply2x2[(bitLenInt)qb] = t;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void SaveDevice(std::ofstream& file, const std::string& name, const DeviceProfile& dp)
+{
+    file << name << " latency " << dp.launchLatency << std::endl;
+    file << name << " bandwidth " << dp.bandwidth << std::endl;
+    file << name << " max_qb " << (size_t)dp.maxQubits << std::endl;
+    for (const auto& m : dp.apply2x2) {
+        file << name << " 2x2 " << (size_t)m.first << " " << m.second << std::endl;
+    }
+}
+
+void EngineProfile::Save(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("EngineProfile::Save() could not open file: " + path);
+    }
+
+    file.precision(9);
+    file << "# Qrack engine profile: <device> <key> <values...>" << std::endl;
+    if (!cpu.IsEmpty()) {
+        SaveDevice(file, "cpu", cpu);
+    }
+    for (const auto& d : devices) {
+        if (!d.second.IsEmpty()) {
+            SaveDevice(file, std::to_string(d.first), d.second);
+        }
+    }
+}
+
+static double SecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Time Apply2x2() and state transfer on engines of width "minQb" to "maxQb" made by "make."
+template <typename Fn> static void MeasureEngine(DeviceProfile& dp, bitLenInt minQb, bitLenInt maxQb, Fn make)
+{
+    const complex mtrx[4U]{ complex(SQRT1_2_R1, ZERO_R1), complex(SQRT1_2_R1, ZERO_R1),
+        complex(SQRT1_2_R1, ZERO_R1), -complex(SQRT1_2_R1, ZERO_R1) };
+
+    if (!minQb) {
+        minQb = 1U;
+    }
+
+    for (bitLenInt qb = minQb; qb <= maxQb; ++qb) {
+        QInterfacePtr engine = make(qb);
+
+        // Warm up, (for allocation, and kernel compilation or caching).
+        engine->Mtrx(mtrx, 0U);
+        engine->Finish();
+
+        size_t reps = 0U;
+        const auto start = std::chrono::high_resolution_clock::now();
+        double elapsed;
+        do {
+            for (size_t i = 0U; i < 8U; ++i) {
+                engine->Mtrx(mtrx, (bitLenInt)((reps + i) % qb));
+            }
+            reps += 8U;
+            engine->Finish();
+            elapsed = SecondsSince(start);
+        } while ((elapsed < QRACK_PROFILE_MIN_SECONDS) && (reps < QRACK_PROFILE_MAX_REPS));
+
+        dp.apply2x2[qb] = elapsed / reps;
+
+        if (qb == maxQb) {
+            std::unique_ptr<complex[]> buffer(new complex[(bitCapIntOcl)pow2Ocl(qb)]);
+            reps = 0U;
+            const auto tStart = std::chrono::high_resolution_clock::now();
+            do {
+                engine->GetQuantumState(buffer.get());
+                engine->SetQuantumState(buffer.get());
+                engine->Finish();
+                reps += 2U;
+                elapsed = SecondsSince(tStart);
+            } while ((elapsed < QRACK_PROFILE_MIN_SECONDS) && (reps < QRACK_PROFILE_MAX_REPS));
+            dp.bandwidth = std::ldexp((double)(sizeof(complex) * reps), (int)qb) / elapsed;
+        }
+    }
+
+    dp.launchLatency = dp.apply2x2.begin()->second;
+}
+
+void EngineProfile::MeasureCpu(bitLenInt minQb, bitLenInt maxQb)
+{
+    cpu = DeviceProfile();
+    MeasureEngine(cpu, minQb, maxQb, [](bitLenInt qb) {
+        return std::make_shared<QEngineCPU>(qb, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false, false, -1, false);
+    });
+
+#if defined(_SC_PHYS_PAGES) && defined(_SC_PAGE_SIZE)
+    const double memBytes = (double)sysconf(_SC_PHYS_PAGES) * (double)sysconf(_SC_PAGE_SIZE);
+    if (memBytes > 0.0) {
+        // Leave room for one working copy of the state vector.
+        cpu.maxQubits = (bitLenInt)(std::floor(std::log2(memBytes / sizeof(complex))) - 1.0);
+    }
+#endif
+}
+
+void EngineProfile::MeasureDevice(int64_t devID, bitLenInt minQb, bitLenInt maxQb)
+{
+#if ENABLE_OPENCL
+    DeviceProfile& dp = devices[devID];
+    dp = DeviceProfile();
+    MeasureEngine(dp, minQb, maxQb, [devID](bitLenInt qb) {
+        return std::make_shared<QEngineOCL>(qb, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false, false, devID, false);
+    });
+    dp.maxQubits = log2(OCLEngine::Instance().GetDeviceContextPtr(devID)->GetMaxAlloc() / sizeof(complex));
+#endif
+}
+
+bitLenInt EngineProfile::GetGpuThresholdQubits(int64_t devID, bitLenInt fallback) const
+{
+    const auto dIt = devices.find(devID);
+    if (cpu.IsEmpty() || (dIt == devices.end()) || dIt->second.IsEmpty()) {
+        return fallback;
+    }
+    const DeviceProfile& dp = dIt->second;
+
+    // Walk down from the widest shared measurement, while the GPU keeps winning.
+    bitLenInt threshold = fallback;
+    for (auto it = cpu.apply2x2.rbegin(); it != cpu.apply2x2.rend(); ++it) {
+        const auto gIt = dp.apply2x2.find(it->first);
+        if (gIt == dp.apply2x2.end()) {
+            continue;
+        }
+        if (gIt->second > it->second) {
+            break;
+        }
+        threshold = it->first;
+    }
+
+    return threshold;
+}
+
+bitLenInt EngineProfile::GetMaxQubits(int64_t devID, bitLenInt fallback) const
+{
+    if (devID < 0) {
+        return cpu.maxQubits ? cpu.maxQubits : fallback;
+    }
+
+    const auto it = devices.find(devID);
+    return ((it != devices.end()) && it->second.maxQubits) ? it->second.maxQubits : fallback;
+}
+} // namespace Qrack
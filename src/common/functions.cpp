@@ -253,7 +253,7 @@ bitCapInt pushApartBits(const bitCapInt& perm, const std::vector<bitCapInt>& ski
     return i;
 }
 
-#if QBCAPPOW == 7U
+#if QBCAPPOW == 7U && !QRACK_BIG_INTEGER
 std::ostream& operator<<(std::ostream& os, bitCapInt b)
 {
     if (b == 0) {
@@ -0,0 +1,536 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "hamiltonian.hpp"
+#include "common/parallel_for.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace Qrack {
+
+namespace {
+
+// One compiled term, with its qubit support, (and, if diagonal, its phase at each permutation of that support,) for
+// fusion
+struct TrotterWork {
+    CompiledHamiltonianOp op;
+    std::vector<bitLenInt> support;
+    bool isDiagonal;
+    bool isMerged;
+    std::vector<complex> phases;
+};
+
+typedef std::vector<std::pair<size_t, real1_f>> TrotterSequence;
+
+void AppendSweep(TrotterSequence& seq, size_t termCount, real1_f coeff, bool isReversed)
+{
+    for (size_t i = 0U; i < termCount; ++i) {
+        seq.push_back(std::make_pair(isReversed ? (termCount - (i + 1U)) : i, coeff));
+    }
+}
+
+void AppendSecondOrder(TrotterSequence& seq, size_t termCount, real1_f coeff)
+{
+    AppendSweep(seq, termCount, coeff / 2, false);
+    AppendSweep(seq, termCount, coeff / 2, true);
+}
+
+TrotterSequence MakeSequence(size_t termCount, real1_f dt, TrotterOrder order)
+{
+    TrotterSequence seq;
+    if (order == TROTTER_FIRST_ORDER) {
+        AppendSweep(seq, termCount, dt, false);
+    } else if (order == TROTTER_SECOND_ORDER) {
+        AppendSecondOrder(seq, termCount, dt);
+    } else if (order == TROTTER_FOURTH_ORDER) {
+        const real1_f p = (real1_f)(1.0 / (4.0 - std::cbrt(4.0)));
+        AppendSecondOrder(seq, termCount, p * dt);
+        AppendSecondOrder(seq, termCount, p * dt);
+        AppendSecondOrder(seq, termCount, (ONE_R1_F - 4 * p) * dt);
+        AppendSecondOrder(seq, termCount, p * dt);
+        AppendSecondOrder(seq, termCount, p * dt);
+    } else {
+        throw std::invalid_argument("CompiledHamiltonian: unsupported TrotterOrder!");
+    }
+
+    // Consecutive factors of the same term, (like the middle of a second order sweep,) are one factor.
+    TrotterSequence merged;
+    for (size_t i = 0U; i < seq.size(); ++i) {
+        if (merged.size() && (merged.back().first == seq[i].first)) {
+            merged.back().second += seq[i].second;
+        } else {
+            merged.push_back(seq[i]);
+        }
+    }
+
+    return merged;
+}
+
+bool IsOverlapping(const std::vector<bitLenInt>& a, const std::vector<bitLenInt>& b)
+{
+    for (size_t i = 0U; i < a.size(); ++i) {
+        if (std::binary_search(b.begin(), b.end(), a[i])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// The (diagonal) term's phase factor at permutation "perm" of its support
+complex DiagonalFactor(const TrotterWork& w, bitCapIntOcl perm)
+{
+    const CompiledHamiltonianOp& op = w.op;
+    const auto bitOf = [&](bitLenInt q) -> bool {
+        const size_t pos = std::lower_bound(w.support.begin(), w.support.end(), q) - w.support.begin();
+        return (perm >> pos) & 1U;
+    };
+
+    bitCapIntOcl block = 0U;
+    for (size_t j = 0U; j < op.controls.size(); ++j) {
+        const bool toggle = (j < op.toggles.size()) && op.toggles[j];
+        const bool bit = bitOf(op.controls[j]) != toggle;
+        if (op.uniform) {
+            block |= (bitCapIntOcl)bit << j;
+        } else if (bit == op.anti) {
+            return ONE_CMPLX;
+        }
+    }
+
+    return op.mtrx[(block << 2U) | (bitOf(op.targetBit) ? 3U : 0U)];
+}
+
+void ToPhases(TrotterWork& w)
+{
+    const bitCapIntOcl maxPerm = pow2Ocl(w.support.size());
+    w.phases.resize(maxPerm);
+    for (bitCapIntOcl perm = 0U; perm < maxPerm; ++perm) {
+        w.phases[perm] = DiagonalFactor(w, perm);
+    }
+}
+
+// Merge diagonal "w" into diagonal "group," the later of the two
+void MergePhases(TrotterWork& group, const TrotterWork& w)
+{
+    std::vector<bitLenInt> support;
+    std::set_union(group.support.begin(), group.support.end(), w.support.begin(), w.support.end(),
+        std::back_inserter(support));
+
+    const auto subPerm = [&](const std::vector<bitLenInt>& sub, bitCapIntOcl perm) -> bitCapIntOcl {
+        bitCapIntOcl toRet = 0U;
+        for (size_t i = 0U; i < sub.size(); ++i) {
+            const size_t pos = std::lower_bound(support.begin(), support.end(), sub[i]) - support.begin();
+            toRet |= ((perm >> pos) & 1U) << i;
+        }
+        return toRet;
+    };
+
+    const bitCapIntOcl maxPerm = pow2Ocl(support.size());
+    std::vector<complex> phases(maxPerm);
+    for (bitCapIntOcl perm = 0U; perm < maxPerm; ++perm) {
+        phases[perm] = group.phases[subPerm(group.support, perm)] * w.phases[subPerm(w.support, perm)];
+    }
+
+    group.support = support;
+    group.phases = phases;
+    group.isMerged = true;
+}
+
+// A phase group as one uniformly controlled gate, with its lowest qubit as target
+void FromPhases(TrotterWork& w)
+{
+    CompiledHamiltonianOp& op = w.op;
+    op.targetBit = w.support[0U];
+    op.controls = std::vector<bitLenInt>(w.support.begin() + 1U, w.support.end());
+    op.toggles.clear();
+    op.anti = false;
+    op.uniform = true;
+    op.mtrx = std::vector<complex>(w.phases.size() << 1U, ZERO_CMPLX);
+    for (bitCapIntOcl block = 0U; block < (w.phases.size() >> 1U); ++block) {
+        op.mtrx[block << 2U] = w.phases[block << 1U];
+        op.mtrx[(block << 2U) | 3U] = w.phases[(block << 1U) | 1U];
+    }
+}
+
+TrotterWork Exponentiate(const HamiltonianOp& hop, real1_f coeff)
+{
+    TrotterWork w;
+    CompiledHamiltonianOp& op = w.op;
+    op.targetBit = hop.targetBit;
+    op.anti = hop.anti;
+    op.uniform = hop.uniform;
+    op.controls = hop.controls;
+    op.toggles = hop.toggles;
+
+    const bitCapIntOcl blocks = hop.uniform ? pow2Ocl(hop.controls.size()) : 1U;
+    const complex* hMtrx = hop.matrix.get();
+    op.mtrx.resize(blocks << 2U);
+    w.isDiagonal = true;
+    for (bitCapIntOcl b = 0U; b < blocks; ++b) {
+        const complex* h = hMtrx + (b << 2U);
+        // (As in QInterface::TimeEvolve(), uniform blocks are exponentiated without the factor of i.)
+        const complex factor = hop.uniform ? complex((real1)(-coeff), ZERO_R1) : complex(ZERO_R1, (real1)(-coeff));
+        const complex scaled[4U]{ factor * h[0U], factor * h[1U], factor * h[2U], factor * h[3U] };
+        complex* e = &(op.mtrx[b << 2U]);
+        exp2x2(scaled, e);
+        if ((h[1U] == ZERO_CMPLX) && (h[2U] == ZERO_CMPLX)) {
+            e[1U] = ZERO_CMPLX;
+            e[2U] = ZERO_CMPLX;
+        } else {
+            w.isDiagonal = false;
+        }
+    }
+
+    w.support = op.controls;
+    w.support.push_back(op.targetBit);
+    std::sort(w.support.begin(), w.support.end());
+    w.support.erase(std::unique(w.support.begin(), w.support.end()), w.support.end());
+    w.isMerged = false;
+    if (w.isDiagonal) {
+        ToPhases(w);
+    }
+
+    return w;
+}
+
+// The 2x2 gate of a term on a single qubit
+void SingleBitMtrx(const TrotterWork& w, complex* out)
+{
+    if (w.isDiagonal) {
+        out[0U] = w.phases[0U];
+        out[1U] = ZERO_CMPLX;
+        out[2U] = ZERO_CMPLX;
+        out[3U] = w.phases[1U];
+    } else {
+        std::copy(w.op.mtrx.begin(), w.op.mtrx.begin() + 4U, out);
+    }
+}
+
+// exp(a), for the small (row-major, m x m) "a," by scaling and squaring of a Taylor series
+std::vector<complex> ExpSmall(const std::vector<complex>& a, size_t m)
+{
+    real1_f nrm = ZERO_R1_F;
+    for (size_t c = 0U; c < m; ++c) {
+        real1_f colSum = ZERO_R1_F;
+        for (size_t r = 0U; r < m; ++r) {
+            colSum += (real1_f)abs(a[r * m + c]);
+        }
+        nrm = (colSum > nrm) ? colSum : nrm;
+    }
+    int squarings = 0;
+    while (nrm > (ONE_R1_F / 2)) {
+        nrm /= 2;
+        ++squarings;
+    }
+    const real1 scale = (real1)std::pow(2.0, -squarings);
+
+    const auto mul = [m](const std::vector<complex>& l, const std::vector<complex>& r) {
+        std::vector<complex> o(m * m, ZERO_CMPLX);
+        for (size_t i = 0U; i < m; ++i) {
+            for (size_t k = 0U; k < m; ++k) {
+                const complex lik = l[i * m + k];
+                for (size_t j = 0U; j < m; ++j) {
+                    o[i * m + j] += lik * r[k * m + j];
+                }
+            }
+        }
+        return o;
+    };
+
+    std::vector<complex> scaled(m * m);
+    for (size_t i = 0U; i < (m * m); ++i) {
+        scaled[i] = scale * a[i];
+    }
+    std::vector<complex> result(m * m, ZERO_CMPLX);
+    for (size_t i = 0U; i < m; ++i) {
+        result[i * m + i] = ONE_CMPLX;
+    }
+    std::vector<complex> term = result;
+    for (int k = 1; k <= 16; ++k) {
+        term = mul(term, scaled);
+        for (size_t i = 0U; i < (m * m); ++i) {
+            term[i] /= (real1)k;
+            result[i] += term[i];
+        }
+    }
+    for (int i = 0; i < squarings; ++i) {
+        result = mul(result, result);
+    }
+
+    return result;
+}
+} // namespace
+
+CompiledHamiltonian::CompiledHamiltonian(const Hamiltonian& h, real1_f dt, TrotterOrder o, bool mergeDiagonals)
+    : timeDiff(dt)
+    , order(o)
+{
+    const TrotterSequence seq = MakeSequence(h.size(), dt, o);
+
+    std::vector<TrotterWork> work;
+    for (size_t i = 0U; i < seq.size(); ++i) {
+        TrotterWork w = Exponentiate(*(h[seq[i].first]), seq[i].second);
+
+        // A single bit gate fuses into the last gate on its qubit, if that's also a single bit gate: everything
+        // applied since then acts on other qubits, and commutes with it.
+        if (w.support.size() == 1U) {
+            size_t j = work.size();
+            while (j && !std::binary_search(work[j - 1U].support.begin(), work[j - 1U].support.end(), w.support[0U])) {
+                --j;
+            }
+            if (j && (work[j - 1U].support.size() == 1U)) {
+                TrotterWork& prior = work[j - 1U];
+                complex left[4U], right[4U], fused[4U];
+                SingleBitMtrx(w, left);
+                SingleBitMtrx(prior, right);
+                mul2x2(left, right, fused);
+                prior.isDiagonal = prior.isDiagonal && w.isDiagonal;
+                prior.isMerged = false;
+                prior.op = w.op;
+                prior.op.mtrx = std::vector<complex>(fused, fused + 4U);
+                if (prior.isDiagonal) {
+                    prior.phases = std::vector<complex>{ fused[0U], fused[3U] };
+                }
+                continue;
+            }
+        }
+
+        // A diagonal term joins an earlier diagonal group, across everything between that is either diagonal or
+        // acts on other qubits, (all of which commutes with it,) while the group stays small enough.
+        if (mergeDiagonals && w.isDiagonal) {
+            bool isMerged = false;
+            for (size_t j = work.size(); j; --j) {
+                TrotterWork& prior = work[j - 1U];
+                if (!prior.isDiagonal) {
+                    if (IsOverlapping(w.support, prior.support)) {
+                        break;
+                    }
+                    continue;
+                }
+                std::vector<bitLenInt> support;
+                std::set_union(prior.support.begin(), prior.support.end(), w.support.begin(), w.support.end(),
+                    std::back_inserter(support));
+                if (support.size() <= QRACK_TROTTER_PHASE_QB) {
+                    MergePhases(prior, w);
+                    isMerged = true;
+                    break;
+                }
+            }
+            if (isMerged) {
+                continue;
+            }
+        }
+
+        work.push_back(w);
+    }
+
+    for (size_t i = 0U; i < work.size(); ++i) {
+        TrotterWork& w = work[i];
+        if (w.isMerged) {
+            FromPhases(w);
+        }
+        ops.push_back(w.op);
+    }
+}
+
+KrylovHamiltonian::KrylovHamiltonian(const Hamiltonian& h, real1_f tol, unsigned dim)
+    : tolerance(tol)
+    , krylovDim(dim)
+{
+    if (!krylovDim) {
+        throw std::invalid_argument("KrylovHamiltonian: Krylov subspace dimension must be at least 1!");
+    }
+
+    for (size_t i = 0U; i < h.size(); ++i) {
+        const HamiltonianOp& hop = *(h[i]);
+        KrylovHamiltonianTerm term;
+        term.targetPow = pow2Ocl(hop.targetBit);
+        term.anti = hop.anti;
+        term.uniform = hop.uniform;
+        term.controlMask = 0U;
+        term.toggleMask = 0U;
+        for (size_t j = 0U; j < hop.controls.size(); ++j) {
+            term.controlPowers.push_back(pow2Ocl(hop.controls[j]));
+            term.controlMask |= term.controlPowers.back();
+            if ((j < hop.toggles.size()) && hop.toggles[j]) {
+                term.toggleMask |= term.controlPowers.back();
+            }
+        }
+
+        // (As in QInterface::TimeEvolve(), uniform blocks are exponentiated without the factor of i.)
+        const complex factor = hop.uniform ? complex(-ONE_R1, ZERO_R1) : complex(ZERO_R1, -ONE_R1);
+        const bitCapIntOcl mtrxTermCount = (hop.uniform ? pow2Ocl(hop.controls.size()) : 1U) << 2U;
+        term.generator.resize(mtrxTermCount);
+        for (bitCapIntOcl j = 0U; j < mtrxTermCount; ++j) {
+            term.generator[j] = factor * hop.matrix.get()[j];
+        }
+
+        terms.push_back(term);
+    }
+}
+
+void KrylovHamiltonian::Apply(ParallelFor& pf, const complex* in, complex* out, bitCapIntOcl maxQPower) const
+{
+    pf.par_for(0U, maxQPower, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        complex amp = ZERO_CMPLX;
+        for (const KrylovHamiltonianTerm& term : terms) {
+            const bitCapIntOcl c = lcv ^ term.toggleMask;
+            bitCapIntOcl block = 0U;
+            if (term.uniform) {
+                for (size_t j = 0U; j < term.controlPowers.size(); ++j) {
+                    if (c & term.controlPowers[j]) {
+                        block |= pow2Ocl(j);
+                    }
+                }
+            } else if ((c & term.controlMask) != (term.anti ? 0U : term.controlMask)) {
+                continue;
+            }
+
+            const complex* m = &(term.generator[block << 2U]);
+            const bitCapIntOcl i0 = lcv & ~term.targetPow;
+            const size_t row = (lcv & term.targetPow) ? 2U : 0U;
+            amp += m[row] * in[i0] + m[row | 1U] * in[i0 | term.targetPow];
+        }
+        out[lcv] = amp;
+    });
+}
+
+unsigned KrylovHamiltonian::Evolve(ParallelFor& pf, complex* state, bitCapIntOcl maxQPower, real1_f t) const
+{
+    const unsigned numCores = pf.GetConcurrencyLevel();
+    // Inner products with every basis vector up to "count," in one pass over "w"
+    const auto project = [&](const std::vector<std::unique_ptr<complex[]>>& basis, size_t count, const complex* w) {
+        std::vector<complex> part(numCores * count, ZERO_CMPLX);
+        pf.par_for(0U, maxQPower, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            for (size_t k = 0U; k < count; ++k) {
+                part[cpu * count + k] += conj(basis[k][lcv]) * w[lcv];
+            }
+        });
+        std::vector<complex> toRet(count, ZERO_CMPLX);
+        for (unsigned c = 0U; c < numCores; ++c) {
+            for (size_t k = 0U; k < count; ++k) {
+                toRet[k] += part[c * count + k];
+            }
+        }
+        return toRet;
+    };
+    const auto vecNorm = [&](const complex* v) {
+        std::vector<real1_f> part(numCores, ZERO_R1_F);
+        pf.par_for(0U, maxQPower,
+            [&](const bitCapIntOcl& lcv, const unsigned& cpu) { part[cpu] += (real1_f)norm(v[lcv]); });
+        real1_f toRet = ZERO_R1_F;
+        for (const real1_f& p : part) {
+            toRet += p;
+        }
+        return (real1_f)sqrt(toRet);
+    };
+
+    const real1_f totalTime = (t < ZERO_R1_F) ? -t : t;
+    const real1 sign = (t < ZERO_R1_F) ? -ONE_R1 : ONE_R1;
+    real1_f remaining = totalTime;
+    real1_f tau = totalTime;
+    unsigned applyCount = 0U;
+    std::vector<std::unique_ptr<complex[]>> basis;
+
+    while (remaining > ZERO_R1_F) {
+        const real1_f beta = vecNorm(state);
+        if (beta <= ZERO_R1_F) {
+            break;
+        }
+
+        if (!basis.size()) {
+            basis.emplace_back(new complex[maxQPower]);
+        }
+        const complex invBeta = complex((real1)(ONE_R1_F / beta), ZERO_R1);
+        pf.par_for(0U, maxQPower,
+            [&](const bitCapIntOcl& lcv, const unsigned& cpu) { basis[0U][lcv] = invBeta * state[lcv]; });
+
+        // Arnoldi, with classical Gram-Schmidt done twice, (so it stays orthogonal to working precision)
+        std::vector<complex> hess((krylovDim + 1U) * krylovDim, ZERO_CMPLX);
+        size_t m = krylovDim;
+        bool isExact = false;
+        for (size_t j = 0U; j < krylovDim; ++j) {
+            if (basis.size() <= (j + 1U)) {
+                basis.emplace_back(new complex[maxQPower]);
+            }
+            complex* w = basis[j + 1U].get();
+            Apply(pf, basis[j].get(), w, maxQPower);
+            ++applyCount;
+
+            for (int pass = 0; pass < 2; ++pass) {
+                const std::vector<complex> coeffs = project(basis, j + 1U, w);
+                pf.par_for(0U, maxQPower, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+                    complex amp = w[lcv];
+                    for (size_t k = 0U; k <= j; ++k) {
+                        amp -= coeffs[k] * basis[k][lcv];
+                    }
+                    w[lcv] = amp;
+                });
+                for (size_t k = 0U; k <= j; ++k) {
+                    hess[k * krylovDim + j] += coeffs[k];
+                }
+            }
+
+            const real1_f hNext = vecNorm(w);
+            if (hNext <= (FP_NORM_EPSILON_F * beta)) {
+                // The subspace is invariant, so its exponential is exact, for any timestep.
+                m = j + 1U;
+                isExact = true;
+                break;
+            }
+            hess[(j + 1U) * krylovDim + j] = complex((real1)hNext, ZERO_R1);
+            const complex invH = complex((real1)(ONE_R1_F / hNext), ZERO_R1);
+            pf.par_for(0U, maxQPower, [&](const bitCapIntOcl& lcv, const unsigned& cpu) { w[lcv] *= invH; });
+        }
+        const real1_f hLast = isExact ? ZERO_R1_F : (real1_f)real(hess[m * krylovDim + (m - 1U)]);
+
+        // Shrink the timestep until the estimated error of this step is within its share of the tolerance.
+        std::vector<complex> small(m * m);
+        std::vector<complex> expH;
+        real1_f step, err;
+        while (true) {
+            step = isExact ? remaining : ((tau < remaining) ? tau : remaining);
+            for (size_t r = 0U; r < m; ++r) {
+                for (size_t c = 0U; c < m; ++c) {
+                    small[r * m + c] = (sign * (real1)step) * hess[r * krylovDim + c];
+                }
+            }
+            expH = ExpSmall(small, m);
+            err = beta * hLast * (real1_f)abs(expH[(m - 1U) * m]);
+            if ((err <= (tolerance * step / totalTime)) || (step <= (FP_NORM_EPSILON_F * totalTime))) {
+                break;
+            }
+            const real1_f shrink = (real1_f)(0.9 * std::pow((tolerance * step / totalTime) / err, 1.0 / m));
+            tau = step * ((shrink < (ONE_R1_F / 4)) ? (ONE_R1_F / 4) : shrink);
+        }
+
+        pf.par_for(0U, maxQPower, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            complex amp = ZERO_CMPLX;
+            for (size_t k = 0U; k < m; ++k) {
+                amp += expH[k * m] * basis[k][lcv];
+            }
+            state[lcv] = (real1)beta * amp;
+        });
+        remaining -= step;
+
+        // The next step can be longer, by as much as this one's error allows.
+        const real1_f grow = (err > ZERO_R1_F)
+            ? (real1_f)(0.9 * std::pow((tolerance * step / totalTime) / err, 1.0 / m))
+            : (real1_f)4.0f;
+        tau = step * ((grow > 4) ? 4 : ((grow < ONE_R1_F) ? ONE_R1_F : grow));
+    }
+
+    return applyCount;
+}
+} // namespace Qrack
@@ -0,0 +1,112 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "instrumentation.hpp"
+
+#include <iomanip>
+
+namespace Qrack {
+
+Instrumentation& Instrumentation::Instance()
+{
+    static Instrumentation instance;
+    return instance;
+}
+
+bool Instrumentation::IsEnabled()
+{
+#if ENABLE_INSTRUMENTATION
+    return true;
+#else
+    return false;
+#endif
+}
+
+InstrumentationStat& Instrumentation::GetStat(const char* layer, const char* op)
+{
+    return stats[std::string(layer) + "::" + op];
+}
+
+void Instrumentation::Record(const char* layer, const char* op, double seconds)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    InstrumentationStat& stat = GetStat(layer, op);
+    ++stat.calls;
+    stat.seconds += seconds;
+}
+
+void Instrumentation::Record(const char* layer, const char* op, Clock::time_point start, Clock::time_point end)
+{
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    std::lock_guard<std::mutex> lock(mtx);
+
+    InstrumentationStat& stat = GetStat(layer, op);
+    ++stat.calls;
+    stat.seconds += seconds;
+
+    if (!isTracing || (trace.size() >= maxTraceEvents)) {
+        return;
+    }
+
+    const std::thread::id tid = std::this_thread::get_id();
+    auto it = threadIds.find(tid);
+    if (it == threadIds.end()) {
+        it = threadIds.emplace(tid, threadIds.size()).first;
+    }
+
+    TraceEvent e;
+    e.name = std::string(layer) + "::" + op;
+    e.start = start;
+    e.seconds = seconds;
+    e.thread = it->second;
+    trace.push_back(e);
+}
+
+std::map<std::string, InstrumentationStat> Instrumentation::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return stats;
+}
+
+void Instrumentation::Reset()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    stats.clear();
+    trace.clear();
+    threadIds.clear();
+    epoch = Clock::now();
+}
+
+void Instrumentation::SetTracing(bool enable, size_t maxEvents)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    isTracing = enable;
+    maxTraceEvents = maxEvents;
+}
+
+void Instrumentation::WriteChromeTrace(std::ostream& os)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    // Chrome trace-event times are microseconds.
+    os << "{\"traceEvents\":[" << std::fixed << std::setprecision(3);
+    for (size_t i = 0U; i < trace.size(); ++i) {
+        const TraceEvent& e = trace[i];
+        const double ts = std::chrono::duration<double, std::micro>(e.start - epoch).count();
+        os << (i ? "," : "") << "{\"name\":\"" << e.name << "\",\"cat\":\"qrack\",\"ph\":\"X\",\"ts\":" << ts
+           << ",\"dur\":" << (e.seconds * 1e6) << ",\"pid\":0,\"tid\":" << e.thread << "}";
+    }
+    os << "],\"displayTimeUnit\":\"ns\"}";
+}
+} // namespace Qrack
@@ -0,0 +1,187 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "memory_governor.hpp"
+
+#include <chrono>
+#include <new>
+#include <string>
+
+namespace Qrack {
+
+MemoryGovernor::MemoryGovernor()
+    : deviceBudget((size_t)-1)
+    , spillPercent(QRACK_MEMORY_SPILL_PERCENT)
+    , waitMs(0U)
+    , refusedCount(0U)
+    , isLimited(false)
+{
+    size_t hostBudget = (size_t)-1;
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_MEMORY_BUDGET_MB")) {
+        hostBudget = ((size_t)std::stoull(std::string(getenv("QRACK_MEMORY_BUDGET_MB")))) << 20U;
+    }
+    if (getenv("QRACK_DEVICE_BUDGET_MB")) {
+        deviceBudget = ((size_t)std::stoull(std::string(getenv("QRACK_DEVICE_BUDGET_MB")))) << 20U;
+    }
+    if (getenv("QRACK_MEMORY_SPILL_PERCENT")) {
+        spillPercent = (unsigned)std::stoi(std::string(getenv("QRACK_MEMORY_SPILL_PERCENT")));
+    }
+    if (getenv("QRACK_MEMORY_WAIT_MS")) {
+        waitMs = (unsigned)std::stoi(std::string(getenv("QRACK_MEMORY_WAIT_MS")));
+    }
+#endif
+    pools[QRACK_HOST_MEMORY] = Pool(hostBudget);
+    isLimited = (hostBudget != (size_t)-1) || (deviceBudget != (size_t)-1);
+}
+
+MemoryGovernor& MemoryGovernor::Instance()
+{
+    // Never destroyed, so that engines with static storage duration can still release to it.
+    static MemoryGovernor* instance = new MemoryGovernor();
+    return *instance;
+}
+
+MemoryGovernor::Pool& MemoryGovernor::GetPool(int64_t pool)
+{
+    auto it = pools.find(pool);
+    if (it == pools.end()) {
+        // Every device starts with the default device budget.
+        it = pools.emplace(pool, Pool(deviceBudget)).first;
+    }
+
+    return it->second;
+}
+
+bool MemoryGovernor::TryReserve(int64_t pool, size_t bytes)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    Pool& p = GetPool(pool);
+
+    if (!IsAdmissible(p, bytes) && waitMs) {
+        // Other simulators see the pool under pressure, and spill, while this waits.
+        ++(p.waiting);
+        releasedCv.wait_for(lock, std::chrono::milliseconds(waitMs), [&] { return IsAdmissible(p, bytes); });
+        --(p.waiting);
+    }
+
+    if (!IsAdmissible(p, bytes)) {
+        ++refusedCount;
+        return false;
+    }
+
+    p.used += bytes;
+    if (p.peak < p.used) {
+        p.peak = p.used;
+    }
+
+    return true;
+}
+
+void MemoryGovernor::Reserve(int64_t pool, size_t bytes)
+{
+    if (!TryReserve(pool, bytes)) {
+        throw std::bad_alloc();
+    }
+}
+
+void MemoryGovernor::ForceReserve(int64_t pool, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    Pool& p = GetPool(pool);
+    p.used += bytes;
+    if (p.peak < p.used) {
+        p.peak = p.used;
+    }
+}
+
+void MemoryGovernor::Release(int64_t pool, size_t bytes)
+{
+    if (!bytes) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        Pool& p = GetPool(pool);
+        p.used = (bytes < p.used) ? (p.used - bytes) : 0U;
+    }
+
+    releasedCv.notify_all();
+}
+
+bool MemoryGovernor::Admit(int64_t pool, size_t bytes)
+{
+    if (!TryReserve(pool, bytes)) {
+        return false;
+    }
+    Release(pool, bytes);
+
+    return true;
+}
+
+bool MemoryGovernor::CanAdmit(int64_t pool, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return IsAdmissible(GetPool(pool), bytes);
+}
+
+bool MemoryGovernor::IsUnderPressure(int64_t pool)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    const Pool& p = GetPool(pool);
+    if (p.waiting) {
+        return true;
+    }
+
+    return (p.budget != (size_t)-1) && (p.used > ((p.budget / 100U) * spillPercent));
+}
+
+bool MemoryGovernor::IsLimited()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return isLimited;
+}
+
+void MemoryGovernor::SetBudget(int64_t pool, size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        GetPool(pool).budget = bytes;
+        isLimited = (deviceBudget != (size_t)-1);
+        for (const auto& p : pools) {
+            isLimited |= (p.second.budget != (size_t)-1);
+        }
+    }
+
+    // A raised budget might admit a waiting reservation.
+    releasedCv.notify_all();
+}
+
+size_t MemoryGovernor::GetBudget(int64_t pool)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return GetPool(pool).budget;
+}
+
+size_t MemoryGovernor::GetUsed(int64_t pool)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return GetPool(pool).used;
+}
+
+size_t MemoryGovernor::GetPeak(int64_t pool)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return GetPool(pool).peak;
+}
+} // namespace Qrack
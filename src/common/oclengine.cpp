@@ -13,11 +13,26 @@
 #include "oclengine.hpp"
 
 #include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <memory>
 #include <regex>
+#include <set>
 #include <sstream>
 
+#if defined(_WIN32) && !defined(__CYGWIN__)
+#include <process.h>
+#define QRACK_GETPID _getpid
+#else
+#include <unistd.h>
+#define QRACK_GETPID getpid
+#endif
+
+#define QRACK_OCL_BUILD_OPTIONS "-cl-strict-aliasing -cl-denorms-are-zero -cl-fast-relaxed-math"
+
 #if UINTPOW < 4
 #include "qheader_uint8cl.hpp"
 #elif UINTPOW < 5
@@ -39,6 +54,8 @@
 #endif
 
 #include "qenginecl.hpp"
+#include "qstabilizercl.hpp"
+#include "qbatchcl.hpp"
 
 #if ENABLE_ALU
 #include "qheader_alucl.hpp"
@@ -56,11 +73,12 @@ DeviceContextPtr OCLEngine::GetDeviceContextPtr(const int64_t& dev)
 {
     if ((dev >= GetDeviceCount()) || (dev < -1)) {
         throw std::invalid_argument("Invalid OpenCL device selection");
-    } else if (dev == -1) {
-        return default_device_context;
-    } else {
-        return all_device_contexts[dev];
     }
+
+    DeviceContextPtr toRet = (dev == -1) ? default_device_context : all_device_contexts[dev];
+    toRet->EnsureProgram();
+
+    return toRet;
 }
 
 // clang-format off
@@ -78,6 +96,8 @@ const std::vector<OCLKernelHandle> OCLEngine::kernelHandles{
     OCLKernelHandle(OCL_API_INVERT_SINGLE, "invertsingle"),
     OCLKernelHandle(OCL_API_INVERT_SINGLE_WIDE, "invertsinglewide"),
     OCLKernelHandle(OCL_API_UNIFORMLYCONTROLLED, "uniformlycontrolled"),
+    OCLKernelHandle(OCL_API_APPLYNXN, "applynxn"),
+    OCLKernelHandle(OCL_API_FFT_STAGE, "fftstage"),
     OCLKernelHandle(OCL_API_UNIFORMPARITYRZ, "uniformparityrz"),
     OCLKernelHandle(OCL_API_UNIFORMPARITYRZ_NORM, "uniformparityrznorm"),
     OCLKernelHandle(OCL_API_CUNIFORMPARITYRZ, "cuniformparityrz"),
@@ -87,9 +107,14 @@ const std::vector<OCLKernelHandle> OCLEngine::kernelHandles{
     OCLKernelHandle(OCL_API_Z_SINGLE, "zsingle"),
     OCLKernelHandle(OCL_API_Z_SINGLE_WIDE, "zsinglewide"),
     OCLKernelHandle(OCL_API_PHASE_PARITY, "phaseparity"),
+    OCLKernelHandle(OCL_API_PHASEFLIPIFLOOKUP, "phaseflipiflookup"),
+    OCLKernelHandle(OCL_API_GROVERLOOKUP, "groverlookup"),
+    OCLKernelHandle(OCL_API_SCATTER_AMPS, "scatteramps"),
+    OCLKernelHandle(OCL_API_GATE_LIST, "gatelist"),
     OCLKernelHandle(OCL_API_COMPOSE, "compose"),
     OCLKernelHandle(OCL_API_COMPOSE_WIDE, "compose"),
     OCLKernelHandle(OCL_API_COMPOSE_MID, "composemid"),
+    OCLKernelHandle(OCL_API_COMPOSE_MULTI, "composemulti"),
     OCLKernelHandle(OCL_API_DECOMPOSEPROB, "decomposeprob"),
     OCLKernelHandle(OCL_API_DECOMPOSEAMP, "decomposeamp"),
     OCLKernelHandle(OCL_API_DISPOSEPROB, "disposeprob"),
@@ -100,9 +125,12 @@ const std::vector<OCLKernelHandle> OCLEngine::kernelHandles{
     OCLKernelHandle(OCL_API_PROBREGALL, "probregall"),
     OCLKernelHandle(OCL_API_PROBMASK, "probmask"),
     OCLKernelHandle(OCL_API_PROBMASKALL, "probmaskall"),
+    OCLKernelHandle(OCL_API_CDFCHUNKS, "cdfchunks"),
+    OCLKernelHandle(OCL_API_SAMPLECDF, "samplecdf"),
     OCLKernelHandle(OCL_API_PROBPARITY, "probparity"),
     OCLKernelHandle(OCL_API_FORCEMPARITY, "forcemparity"),
     OCLKernelHandle(OCL_API_EXPPERM, "expperm"),
+    OCLKernelHandle(OCL_API_EXPPAULI, "exppauli"),
     OCLKernelHandle(OCL_API_ROL, "rol"),
 #if ENABLE_ALU
     OCLKernelHandle(OCL_API_INC, "inc"),
@@ -141,7 +169,12 @@ const std::vector<OCLKernelHandle> OCLEngine::kernelHandles{
     OCLKernelHandle(OCL_API_APPLYM, "applym"),
     OCLKernelHandle(OCL_API_APPLYMREG, "applymreg"),
     OCLKernelHandle(OCL_API_CLEARBUFFER, "clearbuffer"),
-    OCLKernelHandle(OCL_API_SHUFFLEBUFFERS, "shufflebuffers")
+    OCLKernelHandle(OCL_API_SHUFFLEBUFFERS, "shufflebuffers"),
+    OCLKernelHandle(OCL_API_STABILIZER_GATE, "stabgate"),
+    OCLKernelHandle(OCL_API_STABILIZER_PIVOTS, "stabpivots"),
+    OCLKernelHandle(OCL_API_STABILIZER_MEASURE, "stabmeasure"),
+    OCLKernelHandle(OCL_API_STABILIZER_SCRATCH, "stabscratch"),
+    OCLKernelHandle(OCL_API_BATCH_2X2, "batch2x2")
 };
 // clang-format on
 
@@ -159,8 +192,87 @@ void OCLEngine::SetDeviceContextPtrVector(std::vector<DeviceContextPtr> vec, Dev
 
 void OCLEngine::SetDefaultDeviceContext(DeviceContextPtr dcp) { default_device_context = dcp; }
 
-cl::Program OCLEngine::MakeProgram(bool buildFromSource, std::string path, std::shared_ptr<OCLDeviceContext> devCntxt)
+std::vector<std::pair<const unsigned char*, size_t>> OCLEngine::GetKernelSources()
+{
+    std::vector<std::pair<const unsigned char*, size_t>> sources;
+#if UINTPOW < 4
+    sources.push_back({ qheader_uint8_cl, (size_t)qheader_uint8_cl_len });
+#elif UINTPOW < 5
+    sources.push_back({ qheader_uint16_cl, (size_t)qheader_uint16_cl_len });
+#elif UINTPOW < 6
+    sources.push_back({ qheader_uint32_cl, (size_t)qheader_uint32_cl_len });
+#else
+    sources.push_back({ qheader_uint64_cl, (size_t)qheader_uint64_cl_len });
+#endif
+
+#if FPPOW < 5
+    sources.push_back({ qheader_half_cl, (size_t)qheader_half_cl_len });
+#elif FPPOW < 6
+    sources.push_back({ qheader_float_cl, (size_t)qheader_float_cl_len });
+#elif FPPOW < 7
+    sources.push_back({ qheader_double_cl, (size_t)qheader_double_cl_len });
+#else
+    sources.push_back({ qheader_quad_cl, (size_t)qheader_quad_cl_len });
+#endif
+
+    sources.push_back({ qengine_cl, (size_t)qengine_cl_len });
+    sources.push_back({ qstabilizer_cl, (size_t)qstabilizer_cl_len });
+    sources.push_back({ qbatch_cl, (size_t)qbatch_cl_len });
+
+#if ENABLE_ALU
+    sources.push_back({ qheader_alu_cl, (size_t)qheader_alu_cl_len });
+#if ENABLE_BCD
+    sources.push_back({ qheader_bcd_cl, (size_t)qheader_bcd_cl_len });
+#endif
+#endif
+
+    return sources;
+}
+
+std::string OCLEngine::GetBinaryFileName(cl::Platform& platform, cl::Device& device)
+{
+    // Anything that can change the compiled binary goes into the key: the device and its driver, the real1 and
+    // bitCapIntOcl widths (which select the qheader_*.cl sources), the kernel sources themselves, and build options.
+    std::stringstream key;
+    key << platform.getInfo<CL_PLATFORM_NAME>() << '|' << platform.getInfo<CL_PLATFORM_VERSION>() << '|'
+        << device.getInfo<CL_DEVICE_NAME>() << '|' << device.getInfo<CL_DEVICE_VERSION>() << '|'
+        << device.getInfo<CL_DRIVER_VERSION>() << "|real1:" << sizeof(real1) << "|bitCapIntOcl:" << sizeof(bitCapIntOcl)
+        << '|' << QRACK_OCL_BUILD_OPTIONS;
+    const std::string keyStr = key.str();
+
+    // 64-bit FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    const auto hashBytes = [&hash](const unsigned char* bytes, size_t len) {
+        for (size_t i = 0U; i < len; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    hashBytes((const unsigned char*)keyStr.c_str(), keyStr.size());
+    const std::vector<std::pair<const unsigned char*, size_t>> kernelSources = GetKernelSources();
+    for (size_t i = 0U; i < kernelSources.size(); ++i) {
+        hashBytes(kernelSources[i].first, kernelSources[i].second);
+    }
+
+    std::stringstream fileName;
+    fileName << binary_file_prefix << device.getInfo<CL_DEVICE_NAME>() << "_" << std::hex << std::setw(16)
+             << std::setfill('0') << hash << binary_file_ext;
+    std::string toRet = fileName.str();
+    // Device names can hold characters that don't belong in a file name.
+    std::replace_if(
+        toRet.begin(), toRet.end(), [](char c) { return !(isalnum((unsigned char)c) || (c == '_') || (c == '.')); },
+        '_');
+
+    return toRet;
+}
+
+cl::Program OCLEngine::MakeProgram(
+    bool buildFromSource, std::string path, OCLDeviceContext& devCntxt, bool* isFromBinary)
 {
+    if (isFromBinary) {
+        *isFromBinary = false;
+    }
+
     FILE* clBinFile;
     cl::Program program;
     cl_int buildError = -1;
@@ -182,10 +294,10 @@ cl::Program OCLEngine::MakeProgram(bool buildFromSource, std::string path, std::
             }
 
 #if defined(__APPLE__) || (defined(_WIN32) && !defined(__CYGWIN__)) || ENABLE_SNUCL
-            program = cl::Program(devCntxt->context, { devCntxt->device },
+            program = cl::Program(devCntxt.context, { devCntxt.device },
                 { std::pair<const void*, size_t>(&buffer[0U], buffer.size()) }, &binaryStatus, &buildError);
 #else
-            program = cl::Program(devCntxt->context, { devCntxt->device }, { buffer }, &binaryStatus, &buildError);
+            program = cl::Program(devCntxt.context, { devCntxt.device }, { buffer }, &binaryStatus, &buildError);
 #endif
 
             if ((buildError != CL_SUCCESS) || (binaryStatus[0U] != CL_SUCCESS)) {
@@ -199,40 +311,19 @@ cl::Program OCLEngine::MakeProgram(bool buildFromSource, std::string path, std::
 
     // If, either, there are no cached binaries, or binary loading failed, then fall back to JIT.
     if (buildError == CL_SUCCESS) {
+        if (isFromBinary) {
+            *isFromBinary = true;
+        }
         return program;
     }
 
     cl::Program::Sources sources;
-#if UINTPOW < 4
-    sources.push_back({ (const char*)qheader_uint8_cl, (long unsigned int)qheader_uint8_cl_len });
-#elif UINTPOW < 5
-    sources.push_back({ (const char*)qheader_uint16_cl, (long unsigned int)qheader_uint16_cl_len });
-#elif UINTPOW < 6
-    sources.push_back({ (const char*)qheader_uint32_cl, (long unsigned int)qheader_uint32_cl_len });
-#else
-    sources.push_back({ (const char*)qheader_uint64_cl, (long unsigned int)qheader_uint64_cl_len });
-#endif
-
-#if FPPOW < 5
-    sources.push_back({ (const char*)qheader_half_cl, (long unsigned int)qheader_half_cl_len });
-#elif FPPOW < 6
-    sources.push_back({ (const char*)qheader_float_cl, (long unsigned int)qheader_float_cl_len });
-#elif FPPOW < 7
-    sources.push_back({ (const char*)qheader_double_cl, (long unsigned int)qheader_double_cl_len });
-#else
-    sources.push_back({ (const char*)qheader_quad_cl, (long unsigned int)qheader_quad_cl_len });
-#endif
-
-    sources.push_back({ (const char*)qengine_cl, (long unsigned int)qengine_cl_len });
-
-#if ENABLE_ALU
-    sources.push_back({ (const char*)qheader_alu_cl, (long unsigned int)qheader_alu_cl_len });
-#if ENABLE_BCD
-    sources.push_back({ (const char*)qheader_bcd_cl, (long unsigned int)qheader_bcd_cl_len });
-#endif
-#endif
+    const std::vector<std::pair<const unsigned char*, size_t>> kernelSources = GetKernelSources();
+    for (size_t i = 0U; i < kernelSources.size(); ++i) {
+        sources.push_back({ (const char*)kernelSources[i].first, (long unsigned int)kernelSources[i].second });
+    }
 
-    program = cl::Program(devCntxt->context, sources);
+    program = cl::Program(devCntxt.context, sources);
     std::cout << "Building JIT." << std::endl;
 
     return program;
@@ -263,17 +354,84 @@ void OCLEngine::SaveBinary(cl::Program program, std::string path, std::string fi
         std::cout << "Making directory: " << path << std::endl;
     }
 
-    FILE* clBinFile = fopen((path + fileName).c_str(), "w");
+    // Write to a process-unique temporary file, then rename it over the final name, so concurrent processes never
+    // see (or load) a partly written binary.
+    const std::string finalPath = path + fileName;
+    const std::string tempPath = finalPath + ".tmp" + std::to_string((long long)QRACK_GETPID());
+    FILE* clBinFile = fopen(tempPath.c_str(), "wb");
+    if (!clBinFile) {
+        std::cout << "Binary warning: could not open " << tempPath << " for writing. (Not caching.)" << std::endl;
+        return;
+    }
 #if defined(__APPLE__) || (defined(_WIN32) && !defined(__CYGWIN__)) || ENABLE_SNUCL
     std::vector<char*> clBinaries = program.getInfo<CL_PROGRAM_BINARIES>();
     char* clBinary = clBinaries[clBinIndex];
-    fwrite(clBinary, clBinSize, sizeof(char), clBinFile);
+    const size_t written = fwrite(clBinary, sizeof(char), clBinSize, clBinFile);
 #else
     std::vector<std::vector<unsigned char>> clBinaries = program.getInfo<CL_PROGRAM_BINARIES>();
     std::vector<unsigned char> clBinary = clBinaries[clBinIndex];
-    fwrite(&clBinary[0U], clBinSize, sizeof(unsigned char), clBinFile);
+    const size_t written = fwrite(&clBinary[0U], sizeof(unsigned char), clBinSize, clBinFile);
 #endif
-    fclose(clBinFile);
+    if ((fclose(clBinFile) != 0) || (written != clBinSize)) {
+        std::cout << "Binary warning: failed writing " << tempPath << ". (Not caching.)" << std::endl;
+        std::remove(tempPath.c_str());
+        return;
+    }
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+    // Windows rename() won't replace an existing file.
+    std::remove(finalPath.c_str());
+#endif
+    if (std::rename(tempPath.c_str(), finalPath.c_str())) {
+        std::remove(tempPath.c_str());
+    }
+}
+
+// Binary cache files already written by this process, (devices of the same model share one)
+static std::mutex savedBinariesMutex;
+static std::set<std::string> savedBinaries;
+
+void OCLEngine::BuildProgram(
+    OCLDeviceContext& devCntxt, bool buildFromSource, bool saveBinaries, bool useCache, std::string home)
+{
+    cl::Platform platform = devCntxt.platform;
+    cl::Device device = devCntxt.device;
+    const std::string fileName = GetBinaryFileName(platform, device);
+
+    std::cout << "Device #" << devCntxt.device_id << ", ";
+    bool isFromBinary;
+    cl::Program program = MakeProgram(buildFromSource, home + fileName, devCntxt, &isFromBinary);
+
+    cl_int buildError = program.build({ device }, QRACK_OCL_BUILD_OPTIONS);
+    if (buildError != CL_SUCCESS) {
+        std::cout << "Error building for device #" << devCntxt.device_id << ": " << buildError << ", "
+                  << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device)
+                  << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+        throw std::runtime_error("Failed to build OpenCL program for device #" + std::to_string(devCntxt.device_id));
+    }
+
+    for (unsigned int j = 0U; j < kernelHandles.size(); ++j) {
+        devCntxt.calls[kernelHandles[j].oclapi] = cl::Kernel(program, kernelHandles[j].kernelname.c_str());
+        devCntxt.mutexes.emplace(kernelHandles[j].oclapi, new std::mutex);
+    }
+
+    // Autotuned launch shapes live next to the binary, (and, like it, are keyed to the device, driver and sources).
+    devCntxt.LoadLaunchTunings(home + fileName + QRACK_OCL_TUNE_EXT);
+
+    if (!saveBinaries && !(useCache && !isFromBinary)) {
+        return;
+    }
+
+    if (true) {
+        std::lock_guard<std::mutex> guard(savedBinariesMutex);
+        if (savedBinaries.find(fileName) != savedBinaries.end()) {
+            return;
+        }
+        savedBinaries.insert(fileName);
+    }
+
+    std::cout << "OpenCL program #" << devCntxt.device_id << ", ";
+    SaveBinary(program, home, fileName);
 }
 
 InitOClResult OCLEngine::InitOCL(
@@ -282,6 +440,14 @@ InitOClResult OCLEngine::InitOCL(
     if (home == "*") {
         home = GetDefaultBinaryPath();
     }
+
+    // Unless disabled, any device program that had to be JIT compiled is cached in "home," for the next process.
+    bool useCache = !buildFromSource;
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_DISABLE_OCL_CACHE")) {
+        useCache = false;
+    }
+#endif
     // get all platforms (drivers), e.g. NVIDIA
 
     std::vector<cl::Platform> all_platforms;
@@ -334,10 +500,9 @@ InitOClResult OCLEngine::InitOCL(
         }
     }
 
-    // create the programs that we want to execute on the devices
+    // Create every device context now, (which is cheap,) but defer building each device's kernels, (which is not).
     int64_t plat_id = -1;
     std::vector<cl::Context> all_contexts;
-    std::vector<std::string> all_filenames;
     for (int64_t i = 0; i < deviceCount; ++i) {
         // a context is like a "runtime link" to the device and platform;
         // i.e. communication is possible
@@ -347,51 +512,71 @@ InitOClResult OCLEngine::InitOCL(
         }
         DeviceContextPtr devCntxt = std::make_shared<OCLDeviceContext>(devPlatVec[i], all_devices[i],
             all_contexts[all_contexts.size() - 1U], i, plat_id, maxAllocVec[i % maxAllocVec.size()]);
+        devCntxt->programBuilder = [buildFromSource, saveBinaries, useCache, home](OCLDeviceContext& d) {
+            BuildProgram(d, buildFromSource, saveBinaries, useCache, home);
+        };
+        all_dev_contexts.push_back(devCntxt);
+    }
 
-        std::string fileName = binary_file_prefix + all_devices[i].getInfo<CL_DEVICE_NAME>() + binary_file_ext;
-        std::replace(fileName.begin(), fileName.end(), ' ', '_');
-        std::string clBinName = home + fileName;
-
-        std::cout << "Device #" << i << ", ";
-        cl::Program program = MakeProgram(buildFromSource, clBinName, devCntxt);
-
-        cl_int buildError =
-            program.build({ all_devices[i] }, "-cl-strict-aliasing -cl-denorms-are-zero -cl-fast-relaxed-math");
-        if (buildError != CL_SUCCESS) {
-            std::cout << "Error building for device #" << i << ": " << buildError << ", "
-                      << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(all_devices[i])
-                      << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(all_devices[i]) << std::endl;
-
-            // The default device was set above to be the last device in the list. If we can't compile for it, we
-            // use the first device. If the default is the first device, and we can't compile for it, then we don't
-            // have any devices that can compile at all, and the environment needs to be fixed by the user.
-            if (i == dev) {
-                default_dev_context = all_dev_contexts[0U];
-                default_platform = all_platforms[0U];
-                default_device = all_devices[0U];
+    const auto tryBuild = [](DeviceContextPtr devCntxt) -> bool {
+        try {
+            devCntxt->EnsureProgram();
+            return true;
+        } catch (...) {
+            return false;
+        }
+    };
+
+    // The default device was set above to be the last device in the list. If we can't compile for it, we use the
+    // first device that we can compile for. If there is none, the environment needs to be fixed by the user.
+    if (!tryBuild(all_dev_contexts[dev])) {
+        const int64_t failedDev = dev;
+        dev = -1;
+        for (int64_t i = 0; i < deviceCount; ++i) {
+            if ((i != failedDev) && tryBuild(all_dev_contexts[i])) {
+                dev = i;
+                break;
             }
-
-            continue;
         }
-
-        all_dev_contexts.push_back(devCntxt);
-
-        for (unsigned int j = 0U; j < kernelHandles.size(); ++j) {
-            all_dev_contexts[i]->calls[kernelHandles[j].oclapi] =
-                cl::Kernel(program, kernelHandles[j].kernelname.c_str());
-            all_dev_contexts[i]->mutexes.emplace(kernelHandles[j].oclapi, new std::mutex);
+        if (dev < 0) {
+            std::cout << " No device could build the Qrack kernels. Check OpenCL installation!\n";
+            return InitOClResult();
         }
-
-        std::vector<std::string>::iterator fileNameIt = std::find(all_filenames.begin(), all_filenames.end(), fileName);
-        if (saveBinaries && (fileNameIt == all_filenames.end())) {
-            std::cout << "OpenCL program #" << i << ", ";
-            SaveBinary(program, home, fileName);
+    }
+    default_dev_context = all_dev_contexts[dev];
+    default_platform = devPlatVec[dev];
+    default_device = all_devices[dev];
+
+    // Every other device builds on its first use. Unless QRACK_OCL_LAZY_BUILD is set, they also start building now, in
+    // parallel, in the background, (loading from the binary cache, where it's warm,) so that first use rarely waits.
+    bool isBackgroundBuild = true;
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_OCL_LAZY_BUILD")) {
+        isBackgroundBuild = false;
+    }
+#endif
+    if (isBackgroundBuild || saveBinaries) {
+        for (int64_t i = 0; i < deviceCount; ++i) {
+            if (i == dev) {
+                continue;
+            }
+            OCLDeviceContext* devCntxt = all_dev_contexts[i].get();
+            devCntxt->backgroundBuild = std::async(std::launch::async, [devCntxt]() {
+                try {
+                    devCntxt->EnsureProgram();
+                } catch (...) {
+                    // Reported, (and thrown again,) on first use of the device
+                }
+            });
         }
+    }
 
-        if (i == dev) {
-            default_dev_context = all_dev_contexts[i];
-            default_platform = all_platforms[plat_id];
-            default_device = all_devices[i];
+    // Precompiling binaries for every device means waiting for all of them.
+    if (saveBinaries) {
+        for (size_t i = 0U; i < all_dev_contexts.size(); ++i) {
+            if (all_dev_contexts[i]->backgroundBuild.valid()) {
+                all_dev_contexts[i]->backgroundBuild.wait();
+            }
         }
     }
 
@@ -451,4 +636,195 @@ OCLEngine::OCLEngine()
     activeAllocSizes = std::vector<size_t>(initResult.all_dev_contexts.size());
 }
 
+bool OCLDeviceContext::IsGridStride(OCLAPI api_call)
+{
+    // These kernels loop over their range with a stride of the global work item count, so they can run with fewer
+    // work items, each doing more of the range. (Others need exactly the work item count they're given.)
+    switch (api_call) {
+    case OCL_API_APPLY2X2:
+    case OCL_API_APPLY2X2_SINGLE:
+    case OCL_API_APPLY2X2_DOUBLE:
+    case OCL_API_PHASE_SINGLE:
+    case OCL_API_INVERT_SINGLE:
+    case OCL_API_UNIFORMLYCONTROLLED:
+    case OCL_API_APPLYNXN:
+    case OCL_API_UNIFORMPARITYRZ:
+    case OCL_API_CUNIFORMPARITYRZ:
+    case OCL_API_COMPOSE:
+    case OCL_API_COMPOSE_MID:
+    case OCL_API_COMPOSE_MULTI:
+    case OCL_API_X_SINGLE:
+    case OCL_API_X_MASK:
+    case OCL_API_Z_SINGLE:
+    case OCL_API_PHASE_PARITY:
+    case OCL_API_PHASEFLIPIFLOOKUP:
+    case OCL_API_GROVERLOOKUP:
+    case OCL_API_ROL:
+        return true;
+    default:
+#if ENABLE_ALU
+        return (api_call >= OCL_API_INC) && (api_call <= OCL_API_PHASEFLIPIFLESS);
+#else
+        return false;
+#endif
+    }
+}
+
+bool OCLDeviceContext::ApplyLaunchShape(
+    size_t itemsPerThread, size_t groupSize, size_t& workItemCount, size_t& localGroupSize)
+{
+    const size_t nWorkItemCount = workItemCount / itemsPerThread;
+    if (!nWorkItemCount || (workItemCount % itemsPerThread) || (nWorkItemCount < groupSize) ||
+        (nWorkItemCount % groupSize) || (groupSize > maxWorkGroupSize)) {
+        return false;
+    }
+    workItemCount = nWorkItemCount;
+    localGroupSize = groupSize;
+
+    return true;
+}
+
+int OCLDeviceContext::TuneLaunch(
+    OCLAPI api_call, bitLenInt qubitCount, const cl::Kernel& kernel, size_t& workItemCount, size_t& localGroupSize)
+{
+    std::lock_guard<std::mutex> guard(tuneMutex);
+    const std::pair<OCLAPI, bitLenInt> key(api_call, qubitCount);
+    auto it = launchTunings.find(key);
+    if (it == launchTunings.end()) {
+        if (!isAutotune) {
+            return -1;
+        }
+
+        // Candidates span a factor of 4 either way from the default local group size, (within the limits of the
+        // device and the kernel,) and, for grid-stride kernels, 1 to QRACK_OCL_TUNE_MAX_ITEMS work items per thread.
+        const size_t maxGroupSize =
+            std::min(maxWorkGroupSize, (size_t)kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+        const size_t maxItems = IsGridStride(api_call) ? QRACK_OCL_TUNE_MAX_ITEMS : 1U;
+        LaunchTuning tuning;
+        for (size_t items = 1U; items <= maxItems; items <<= 1U) {
+            for (size_t gs = std::max((size_t)1U, localGroupSize >> 2U);
+                 (gs <= maxGroupSize) && (gs <= (localGroupSize << 2U)); gs <<= 1U) {
+                size_t wic = workItemCount;
+                size_t lgs = localGroupSize;
+                if (ApplyLaunchShape(items, gs, wic, lgs)) {
+                    tuning.candidates.emplace_back(items, gs);
+                }
+            }
+        }
+        if (tuning.candidates.empty()) {
+            tuning.candidates.emplace_back(1U, localGroupSize);
+        }
+        tuning.times = std::vector<double>(tuning.candidates.size(), -1.0);
+        tuning.trials = 0U;
+        tuning.itemsPerThread = 1U;
+        tuning.groupSize = localGroupSize;
+        tuning.isTuned = tuning.candidates.size() == 1U;
+        it = launchTunings.emplace(key, tuning).first;
+    }
+
+    LaunchTuning& tuning = it->second;
+    if (tuning.isTuned) {
+        ApplyLaunchShape(tuning.itemsPerThread, tuning.groupSize, workItemCount, localGroupSize);
+        return -1;
+    }
+
+    const size_t candidate = tuning.trials % tuning.candidates.size();
+    if (!ApplyLaunchShape(tuning.candidates[candidate].first, tuning.candidates[candidate].second, workItemCount,
+            localGroupSize)) {
+        // This launch is smaller than the one the candidates were chosen for; it runs with the default shape.
+        return -1;
+    }
+
+    return (int)candidate;
+}
+
+void OCLDeviceContext::RecordLaunch(OCLAPI api_call, bitLenInt qubitCount, int candidate, double seconds)
+{
+    std::lock_guard<std::mutex> guard(tuneMutex);
+    auto it = launchTunings.find(std::pair<OCLAPI, bitLenInt>(api_call, qubitCount));
+    if ((it == launchTunings.end()) || it->second.isTuned || (candidate < 0) ||
+        ((size_t)candidate >= it->second.candidates.size())) {
+        return;
+    }
+
+    LaunchTuning& tuning = it->second;
+    if ((tuning.times[candidate] < 0) || (seconds < tuning.times[candidate])) {
+        tuning.times[candidate] = seconds;
+    }
+    ++tuning.trials;
+    if (tuning.trials < (QRACK_OCL_TUNE_TRIALS * tuning.candidates.size())) {
+        return;
+    }
+
+    size_t best = 0U;
+    for (size_t i = 1U; i < tuning.times.size(); ++i) {
+        if ((tuning.times[i] >= 0) && ((tuning.times[best] < 0) || (tuning.times[i] < tuning.times[best]))) {
+            best = i;
+        }
+    }
+    tuning.itemsPerThread = tuning.candidates[best].first;
+    tuning.groupSize = tuning.candidates[best].second;
+    tuning.isTuned = true;
+    hasLaunchTunings = true;
+
+    SaveLaunchTunings();
+}
+
+void OCLDeviceContext::LoadLaunchTunings(const std::string& path)
+{
+    std::lock_guard<std::mutex> guard(tuneMutex);
+    tuneFilePath = path;
+
+    // Each line holds a kernel, a qubit width, and the winning work items per thread and local group size.
+    std::ifstream tuneFile(path);
+    unsigned long long api, qb, items, gs;
+    while (tuneFile >> api >> qb >> items >> gs) {
+        if (!items || !gs || !api || (api > (unsigned long long)OCL_API_STABILIZER_SCRATCH)) {
+            continue;
+        }
+        LaunchTuning tuning;
+        tuning.trials = 0U;
+        tuning.itemsPerThread = (size_t)items;
+        tuning.groupSize = (size_t)gs;
+        tuning.isTuned = true;
+        launchTunings[std::pair<OCLAPI, bitLenInt>((OCLAPI)api, (bitLenInt)qb)] = tuning;
+        hasLaunchTunings = true;
+    }
+}
+
+void OCLDeviceContext::SaveLaunchTunings()
+{
+    // (The caller holds "tuneMutex.")
+    if (tuneFilePath.empty()) {
+        return;
+    }
+
+    // As for binaries, write a process-unique temporary file, then rename it over the final name.
+    const std::string tempPath = tuneFilePath + ".tmp" + std::to_string((long long)QRACK_GETPID());
+    std::ofstream tuneFile(tempPath);
+    if (!tuneFile) {
+        std::cout << "Tuning warning: could not open " << tempPath << " for writing. (Not saving.)" << std::endl;
+        return;
+    }
+    for (const auto& t : launchTunings) {
+        if (t.second.isTuned) {
+            tuneFile << (unsigned long long)t.first.first << " " << (unsigned long long)t.first.second << " "
+                     << (unsigned long long)t.second.itemsPerThread << " " << (unsigned long long)t.second.groupSize
+                     << std::endl;
+        }
+    }
+    tuneFile.close();
+    if (tuneFile.fail()) {
+        std::remove(tempPath.c_str());
+        return;
+    }
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+    std::remove(tuneFilePath.c_str());
+#endif
+    if (std::rename(tempPath.c_str(), tuneFilePath.c_str())) {
+        std::remove(tempPath.c_str());
+    }
+}
+
 } // namespace Qrack
@@ -16,17 +16,11 @@
 #include <direct.h>
 #endif
 
+#include <algorithm>
 #include <math.h>
 
 #if ENABLE_PTHREAD
-#include <atomic>
-#include <future>
-#include <mutex>
-
-#define DECLARE_ATOMIC_BITCAPINT() std::atomic<bitCapIntOcl> idx;
-#define ATOMIC_ASYNC(...)                                                                                              \
-    std::async(std::launch::async, [__VA_ARGS__]()
-#define ATOMIC_INC() i = idx++;
+#include "common/parallel_pool.hpp"
 #endif
 
 namespace Qrack {
@@ -51,14 +45,8 @@ void ParallelFor::par_for(const bitCapIntOcl begin, const bitCapIntOcl end, Para
 
 void ParallelFor::par_for_set(const std::set<bitCapIntOcl>& sparseSet, ParallelFunc fn)
 {
-    par_for_inc(
-        0U, sparseSet.size(),
-        [&sparseSet](const bitCapIntOcl& i, const unsigned& cpu) {
-            auto it = sparseSet.begin();
-            std::advance(it, i);
-            return *it;
-        },
-        fn);
+    // std::set iterators only advance one step at a time, so flatten the set once, for constant-time indexing.
+    par_for_set(std::vector<bitCapIntOcl>(sparseSet.begin(), sparseSet.end()), fn);
 }
 
 void ParallelFor::par_for_set(const std::vector<bitCapIntOcl>& sparseSet, ParallelFunc fn)
@@ -182,31 +170,58 @@ void ParallelFor::par_for_inc(
         return;
     }
 
-    DECLARE_ATOMIC_BITCAPINT();
-    idx = 0U;
-    std::vector<std::future<void>> futures(threads);
-    for (unsigned cpu = 0U; cpu != threads; ++cpu) {
-        futures[cpu] = ATOMIC_ASYNC(cpu, &idx, &begin, &itemCount, &Stride, inc, fn)
-        {
-            for (;;) {
-                bitCapIntOcl i;
-                ATOMIC_INC();
-                const bitCapIntOcl l = i * Stride;
-                if (l >= itemCount) {
-                    break;
-                }
-                const bitCapIntOcl maxJ = ((l + Stride) < itemCount) ? Stride : (itemCount - l);
-                for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
-                    bitCapIntOcl k = j + l;
-                    fn(inc(begin + k, cpu), cpu);
-                }
+    ParallelPool::Instance().Run((itemCount + Stride - 1U) / Stride, threads,
+        [&begin, &itemCount, &Stride, &inc, &fn](const bitCapIntOcl& i, const unsigned& cpu) {
+            const bitCapIntOcl l = i * Stride;
+            const bitCapIntOcl maxJ = ((l + Stride) < itemCount) ? Stride : (itemCount - l);
+            for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
+                const bitCapIntOcl k = j + l;
+                fn(inc(begin + k, cpu), cpu);
             }
         });
+}
+
+void ParallelFor::par_for_range(const bitCapIntOcl begin, const bitCapIntOcl end, RangeFunc fn)
+{
+    const bitCapIntOcl itemCount = end - begin;
+    const bitCapIntOcl Stride = pStride;
+    unsigned threads = (unsigned)(itemCount / pStride);
+    if (threads > numCores) {
+        threads = numCores;
     }
 
-    for (unsigned cpu = 0U; cpu != threads; ++cpu) {
-        futures[cpu].get();
+    if (threads <= 1U) {
+        fn(begin, end, 0U);
+        return;
+    }
+
+    ParallelPool::Instance().Run((itemCount + Stride - 1U) / Stride, threads,
+        [&begin, &itemCount, &Stride, &fn](const bitCapIntOcl& i, const unsigned& cpu) {
+            const bitCapIntOcl l = i * Stride;
+            const bitCapIntOcl maxJ = ((l + Stride) < itemCount) ? Stride : (itemCount - l);
+            fn(begin + l, begin + l + maxJ, cpu);
+        });
+}
+
+void ParallelFor::par_zero(complex* amps, const bitCapIntOcl itemCount)
+{
+    const bitCapIntOcl Stride = pStride;
+    unsigned threads = (unsigned)(itemCount / pStride);
+    if (threads > numCores) {
+        threads = numCores;
     }
+
+    if (threads <= 1U) {
+        std::fill(amps, amps + itemCount, ZERO_CMPLX);
+        return;
+    }
+
+    ParallelPool::Instance().Run((itemCount + Stride - 1U) / Stride, threads,
+        [&amps, &itemCount, &Stride](const bitCapIntOcl& i, const unsigned& cpu) {
+            const bitCapIntOcl l = i * Stride;
+            const bitCapIntOcl maxJ = ((l + Stride) < itemCount) ? Stride : (itemCount - l);
+            std::fill(amps + l, amps + l + maxJ, ZERO_CMPLX);
+        });
 }
 
 real1_f ParallelFor::par_norm(const bitCapIntOcl itemCount, const StateVectorPtr stateArray, real1_f norm_thresh)
@@ -234,37 +249,25 @@ real1_f ParallelFor::par_norm(const bitCapIntOcl itemCount, const StateVectorPtr
         return (real1_f)nrmSqr;
     }
 
-    DECLARE_ATOMIC_BITCAPINT();
-    idx = 0U;
-    std::vector<std::future<real1_f>> futures(threads);
-    for (unsigned cpu = 0U; cpu != threads; ++cpu) {
-        futures[cpu] = ATOMIC_ASYNC(&idx, &itemCount, stateArray, &Stride, &norm_thresh)
-        {
-            const real1 nrm_thresh = (real1)norm_thresh;
+    const real1 nrm_thresh = (real1)norm_thresh;
+    std::unique_ptr<real1[]> sqrNorms(new real1[threads]());
+    ParallelPool::Instance().Run((itemCount + Stride - 1U) / Stride, threads,
+        [&itemCount, &stateArray, &Stride, &nrm_thresh, &sqrNorms](const bitCapIntOcl& i, const unsigned& cpu) {
+            const bitCapIntOcl l = i * Stride;
+            const bitCapIntOcl maxJ = ((l + Stride) < itemCount) ? Stride : (itemCount - l);
             real1 sqrNorm = ZERO_R1;
-            for (;;) {
-                bitCapIntOcl i;
-                ATOMIC_INC();
-                const bitCapIntOcl l = i * Stride;
-                if (l >= itemCount) {
-                    break;
-                }
-                const bitCapIntOcl maxJ = ((l + Stride) < itemCount) ? Stride : (itemCount - l);
-                for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
-                    bitCapIntOcl k = i * Stride + j;
-                    const real1 nrm = norm(stateArray->read(k));
-                    if (nrm >= nrm_thresh) {
-                        sqrNorm += nrm;
-                    }
+            for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
+                const real1 nrm = norm(stateArray->read(l + j));
+                if (nrm >= nrm_thresh) {
+                    sqrNorm += nrm;
                 }
             }
-            return (real1_f)sqrNorm;
+            sqrNorms[cpu] += sqrNorm;
         });
-    }
 
     real1_f nrmSqr = ZERO_R1_F;
     for (unsigned cpu = 0U; cpu != threads; ++cpu) {
-        nrmSqr += futures[cpu].get();
+        nrmSqr += (real1_f)sqrNorms[cpu];
     }
 
     return nrmSqr;
@@ -287,32 +290,21 @@ real1_f ParallelFor::par_norm_exact(const bitCapIntOcl itemCount, const StateVec
         return (real1_f)nrmSqr;
     }
 
-    DECLARE_ATOMIC_BITCAPINT();
-    idx = 0U;
-    std::vector<std::future<real1_f>> futures(threads);
-    for (unsigned cpu = 0U; cpu != threads; ++cpu) {
-        futures[cpu] = ATOMIC_ASYNC(&idx, &itemCount, &Stride, stateArray)
-        {
+    std::unique_ptr<real1[]> sqrNorms(new real1[threads]());
+    ParallelPool::Instance().Run((itemCount + Stride - 1U) / Stride, threads,
+        [&itemCount, &stateArray, &Stride, &sqrNorms](const bitCapIntOcl& i, const unsigned& cpu) {
+            const bitCapIntOcl l = i * Stride;
+            const bitCapIntOcl maxJ = ((l + Stride) < itemCount) ? Stride : (itemCount - l);
             real1 sqrNorm = ZERO_R1;
-            for (;;) {
-                bitCapIntOcl i;
-                ATOMIC_INC();
-                const bitCapIntOcl l = i * Stride;
-                if (l >= itemCount) {
-                    break;
-                }
-                const bitCapIntOcl maxJ = ((l + Stride) < itemCount) ? Stride : (itemCount - l);
-                for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
-                    sqrNorm += norm(stateArray->read(i * Stride + j));
-                }
+            for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
+                sqrNorm += norm(stateArray->read(l + j));
             }
-            return (real1_f)sqrNorm;
+            sqrNorms[cpu] += sqrNorm;
         });
-    }
 
     real1_f nrmSqr = ZERO_R1_F;
     for (unsigned cpu = 0U; cpu != threads; ++cpu) {
-        nrmSqr += futures[cpu].get();
+        nrmSqr += (real1_f)sqrNorms[cpu];
     }
 
     return nrmSqr;
@@ -331,6 +323,16 @@ void ParallelFor::par_for_inc(
     }
 }
 
+void ParallelFor::par_for_range(const bitCapIntOcl begin, const bitCapIntOcl end, RangeFunc fn)
+{
+    fn(begin, end, 0U);
+}
+
+void ParallelFor::par_zero(complex* amps, const bitCapIntOcl itemCount)
+{
+    std::fill(amps, amps + itemCount, ZERO_CMPLX);
+}
+
 real1_f ParallelFor::par_norm(const bitCapIntOcl itemCount, const StateVectorPtr stateArray, real1_f norm_thresh)
 {
     if (norm_thresh <= ZERO_R1) {
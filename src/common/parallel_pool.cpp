@@ -0,0 +1,253 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2021. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "common/parallel_pool.hpp"
+
+#include <string>
+
+#if ENABLE_NUMA
+#include <numa.h>
+#include <unistd.h>
+#endif
+
+namespace Qrack {
+
+ParallelPool& ParallelPool::Instance()
+{
+    // Intentionally leaked, so the pool outlives any static simulator that might still run work during exit.
+    static ParallelPool* pool = NULL;
+    static std::once_flag poolFlag;
+    std::call_once(poolFlag, []() {
+        const unsigned hwThreads = std::thread::hardware_concurrency();
+        unsigned workerCount = hwThreads ? (hwThreads - 1U) : 0U;
+#if ENABLE_ENV_VARS
+        if (getenv("QRACK_POOL_THREADS")) {
+            workerCount = (unsigned)std::stoi(std::string(getenv("QRACK_POOL_THREADS")));
+        }
+#endif
+        unsigned nodeCount = 1U;
+#if ENABLE_NUMA
+        if (numa_available() >= 0) {
+            nodeCount = (unsigned)numa_num_configured_nodes();
+        }
+#if ENABLE_ENV_VARS
+        if (getenv("QRACK_DISABLE_NUMA")) {
+            nodeCount = 1U;
+        }
+#endif
+#endif
+        pool = new ParallelPool(workerCount, nodeCount ? nodeCount : 1U);
+    });
+
+    return *pool;
+}
+
+ParallelPool::ParallelPool(unsigned workerCount, unsigned nodeCount)
+    : nodeCount_(nodeCount)
+{
+    // The calling thread counts as participant 0, on node 0; worker i is participant i + 1.
+    workers_.reserve(workerCount);
+    for (unsigned i = 0U; i < workerCount; ++i) {
+        const unsigned node = ((i + 1U) * nodeCount) / (workerCount + 1U);
+        workers_.emplace_back([this, node]() { WorkerLoop(node); });
+    }
+}
+
+void ParallelPool::BindToNumaNode(void* ptr, size_t size, int node)
+{
+#if ENABLE_NUMA
+    if ((nodeCount_ <= 1U) || (node < 0)) {
+        return;
+    }
+
+    // mbind() works on whole pages; the (partial) pages at either end are left to first touch.
+    const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t start = (((size_t)ptr) + pageSize - 1U) & ~(pageSize - 1U);
+    const size_t end = (((size_t)ptr) + size) & ~(pageSize - 1U);
+    if (end > start) {
+        numa_tonode_memory((void*)start, end - start, node % (int)nodeCount_);
+    }
+#endif
+}
+
+unsigned ParallelPool::ClaimSlot(Job& job, const unsigned& node)
+{
+    // Prefer a slot in this node's band, then take whatever is left. (The caller holds lock_.)
+    const unsigned bandStart = (node * job.slotCount) / nodeCount_;
+    const unsigned bandEnd = ((node + 1U) * job.slotCount) / nodeCount_;
+    unsigned slot = job.slotCount;
+    for (unsigned s = bandStart; s < bandEnd; ++s) {
+        if (!job.isClaimed[s]) {
+            slot = s;
+            break;
+        }
+    }
+    if (slot == job.slotCount) {
+        for (unsigned s = 0U; s < job.slotCount; ++s) {
+            if (!job.isClaimed[s]) {
+                slot = s;
+                break;
+            }
+        }
+    }
+
+    job.isClaimed[slot] = true;
+    ++job.claimedCount;
+
+    return slot;
+}
+
+void ParallelPool::WorkerLoop(unsigned node)
+{
+#if ENABLE_NUMA
+    if (nodeCount_ > 1U) {
+        numa_run_on_node((int)node);
+    }
+#endif
+
+    for (;;) {
+        std::shared_ptr<Job> job;
+        unsigned slot;
+        {
+            std::unique_lock<std::mutex> lk(lock_);
+            cv_.wait(lk, [this] { return !jobs_.empty(); });
+            job = jobs_.front();
+            slot = ClaimSlot(*job, node);
+            if (job->claimedCount >= job->slotCount) {
+                // Every slot is claimed; nobody else can join this job.
+                jobs_.pop_front();
+            }
+        }
+
+        Participate(*job, slot);
+    }
+}
+
+bool ParallelPool::PopChunk(Job& job, const unsigned& slot, bitCapIntOcl& chunk)
+{
+    {
+        WorkRange& own = job.ranges[slot];
+        std::lock_guard<std::mutex> lk(own.lock);
+        if (own.front < own.back) {
+            chunk = own.front++;
+            return true;
+        }
+    }
+
+    for (unsigned i = 1U; i < job.slotCount; ++i) {
+        WorkRange& victim = job.ranges[(slot + i) % job.slotCount];
+        std::lock_guard<std::mutex> lk(victim.lock);
+        if (victim.front < victim.back) {
+            chunk = --victim.back;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ParallelPool::Participate(Job& job, const unsigned& slot)
+{
+    bitCapIntOcl chunk;
+    while (PopChunk(job, slot, chunk)) {
+        try {
+            job.fn(chunk, slot);
+        } catch (...) {
+            std::lock_guard<std::mutex> lk(job.doneLock);
+            if (!job.error) {
+                job.error = std::current_exception();
+            }
+        }
+
+        if (!(--job.pending)) {
+            std::lock_guard<std::mutex> lk(job.doneLock);
+            job.doneCv.notify_all();
+        }
+    }
+}
+
+void ParallelPool::Run(const bitCapIntOcl chunkCount, const unsigned slots, ParallelFunc fn)
+{
+    if ((slots <= 1U) || (chunkCount <= 1U) || workers_.empty()) {
+        for (bitCapIntOcl c = 0U; c < chunkCount; ++c) {
+            fn(c, 0U);
+        }
+        return;
+    }
+
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->fn = fn;
+    job->slotCount = slots;
+    job->claimedCount = 1U;
+    job->isClaimed = std::vector<bool>(slots, false);
+    job->isClaimed[0U] = true;
+    job->pending = chunkCount;
+    job->ranges = std::unique_ptr<WorkRange[]>(new WorkRange[slots]);
+    for (unsigned s = 0U; s < slots; ++s) {
+        job->ranges[s].front = (chunkCount * s) / slots;
+        job->ranges[s].back = (chunkCount * (s + 1U)) / slots;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        jobs_.push_back(job);
+    }
+    if ((slots - 1U) >= workers_.size()) {
+        cv_.notify_all();
+    } else {
+        for (unsigned s = 1U; s < slots; ++s) {
+            cv_.notify_one();
+        }
+    }
+
+    Participate(*job, 0U);
+
+    {
+        // Our own and every stolen chunk has been claimed, so late joiners would find nothing to do.
+        std::lock_guard<std::mutex> lk(lock_);
+        jobs_.remove(job);
+    }
+
+    std::unique_lock<std::mutex> lk(job->doneLock);
+    job->doneCv.wait(lk, [&job] { return !job->pending; });
+
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+void ParallelPool::Post(std::function<void()> task)
+{
+    if (workers_.empty()) {
+        task();
+        return;
+    }
+
+    // A job of one chunk and one slot, which no caller participates in or waits for
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->fn = [task](const bitCapIntOcl& chunk, const unsigned& slot) { task(); };
+    job->slotCount = 1U;
+    job->claimedCount = 0U;
+    job->isClaimed = std::vector<bool>(1U, false);
+    job->pending = 1U;
+    job->ranges = std::unique_ptr<WorkRange[]>(new WorkRange[1U]);
+    job->ranges[0U].front = 0U;
+    job->ranges[0U].back = 1U;
+
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        jobs_.push_back(job);
+    }
+    cv_.notify_one();
+}
+
+} // namespace Qrack
@@ -0,0 +1,29 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// Batched register kernels, for Qrack::QBatchOCL. Register "b" of a batch of "qubitCount"-qubit registers occupies
+// amplitudes [b << qubitCount, (b + 1) << qubitCount) of one state vector buffer, exactly as in the host QBatch.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+// As apply2x2, (with the same leading arguments, and the PUSH_APART_GEN() and APPLY_AND_OUT() of qengine.cl,) but with
+// one matrix per register: register "b" uses the 8 reals at mtrxs[8 * b * mtrxStride], so a stride of 0 applies the
+// same matrix to every register.
+void kernel batch2x2(global cmplx* stateVec, global const real1* mtrxs, constant bitCapIntOcl* bitCapIntOclPtr,
+    constant bitCapIntOcl* qPowersSorted)
+{
+    const bitCapIntOcl Nthreads = get_global_size(0);
+    const bitCapIntOcl qubitCount = bitCapIntOclPtr[4];
+    const bitCapIntOcl mtrxStride = bitCapIntOclPtr[5];
+    const real1 nrm = ONE_R1;
+
+    for (bitCapIntOcl lcv = ID; lcv < MAXI_ARG; lcv += Nthreads) {
+        PUSH_APART_GEN()
+        // (The inserted bits are all below "qubitCount," so the register index is untouched.)
+        const cmplx4 mtrx = vload8(0, mtrxs + (((i >> qubitCount) * mtrxStride) << 3U));
+        APPLY_AND_OUT()
+    }
+}
@@ -36,6 +36,31 @@ inline cmplx conj(const cmplx cmp)
     return (cmplx)(cmp.x, -cmp.y);
 }
 
+// Whether the lookup table entry for index "x," (little-endian, as for IndexedLDA,) equals "target"
+inline bool lookupmatch(global uchar* values, const bitCapIntOcl x, const bitCapIntOcl valueBytes,
+    const bitCapIntOcl target)
+{
+    bitCapIntOcl entry = 0U;
+    for (bitCapIntOcl j = 0U; j < valueBytes; j++) {
+        entry |= ((bitCapIntOcl)values[x * valueBytes + j]) << (8U * j);
+    }
+    return entry == target;
+}
+
+// Philox4x32-10, identical to the host's Qrack::Philox4x32(), so a (seed, stream, counter) draw agrees with CounterRng.
+inline uint4 philox4x32(uint4 ctr, uint2 key)
+{
+    for (unsigned round = 0U; round < 10U; round++) {
+        const uint hi0 = mul_hi(0xD2511F53U, ctr.x);
+        const uint lo0 = 0xD2511F53U * ctr.x;
+        const uint hi1 = mul_hi(0xCD9E8D57U, ctr.z);
+        const uint lo1 = 0xCD9E8D57U * ctr.z;
+        ctr = (uint4)(hi1 ^ ctr.y ^ key.x, lo1, hi0 ^ ctr.w ^ key.y, lo0);
+        key += (uint2)(0x9E3779B9U, 0xBB67AE85U);
+    }
+    return ctr;
+}
+
 #define OFFSET2_ARG bitCapIntOclPtr[0]
 #define OFFSET1_ARG bitCapIntOclPtr[1]
 #define MAXI_ARG bitCapIntOclPtr[2]
@@ -310,6 +335,65 @@ void kernel phaseparity(global cmplx* stateVec, constant bitCapIntOcl* bitCapInt
     }
 }
 
+void kernel phaseflipiflookup(global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclPtr, global uchar* values)
+{
+    const bitCapIntOcl Nthreads = get_global_size(0);
+    const bitCapIntOcl maxI = bitCapIntOclPtr[0];
+    const bitLenInt indexStart = (bitLenInt)bitCapIntOclPtr[1];
+    const bitCapIntOcl indexMask = bitCapIntOclPtr[2];
+    const bitCapIntOcl valueBytes = bitCapIntOclPtr[3];
+    const bitCapIntOcl target = bitCapIntOclPtr[4];
+
+    for (bitCapIntOcl lcv = ID; lcv < maxI; lcv += Nthreads) {
+        if (lookupmatch(values, (lcv & indexMask) >> indexStart, valueBytes, target)) {
+            stateVec[lcv] = -stateVec[lcv];
+        }
+    }
+}
+
+void kernel groverlookup(global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclPtr, global uchar* values)
+{
+    const bitCapIntOcl Nthreads = get_global_size(0);
+    const bitCapIntOcl maxI = bitCapIntOclPtr[0];
+    const bitLenInt indexStart = (bitLenInt)bitCapIntOclPtr[1];
+    const bitLenInt indexLength = (bitLenInt)bitCapIntOclPtr[2];
+    const bitCapIntOcl valueBytes = bitCapIntOclPtr[3];
+    const bitCapIntOcl target = bitCapIntOclPtr[4];
+    const bitCapIntOcl indexPower = ONE_BCI << indexLength;
+    const bitCapIntOcl lowMask = (ONE_BCI << indexStart) - ONE_BCI;
+    const real1 twoOverPower = ((real1)2) / ((real1)indexPower);
+
+    // Each work item owns one permutation of the qubits outside the index register: the oracle, then I - 2|s><s| over
+    // the index register, (which subtracts twice the mean).
+    for (bitCapIntOcl lcv = ID; lcv < maxI; lcv += Nthreads) {
+        const bitCapIntOcl iLow = lcv & lowMask;
+        const bitCapIntOcl otherRes = iLow | ((lcv ^ iLow) << indexLength);
+
+        cmplx sum = (cmplx)(ZERO_R1, ZERO_R1);
+        for (bitCapIntOcl x = 0U; x < indexPower; x++) {
+            const cmplx amp = stateVec[otherRes | (x << indexStart)];
+            sum += lookupmatch(values, x, valueBytes, target) ? -amp : amp;
+        }
+        const cmplx twoMean = twoOverPower * sum;
+
+        for (bitCapIntOcl x = 0U; x < indexPower; x++) {
+            const bitCapIntOcl i = otherRes | (x << indexStart);
+            const cmplx amp = stateVec[i];
+            stateVec[i] = (lookupmatch(values, x, valueBytes, target) ? -amp : amp) - twoMean;
+        }
+    }
+}
+
+void kernel scatteramps(
+    global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclPtr, global bitCapIntOcl* perms, global cmplx* amps)
+{
+    const bitCapIntOcl Nthreads = get_global_size(0);
+    const bitCapIntOcl maxI = bitCapIntOclPtr[0];
+    for (bitCapIntOcl lcv = ID; lcv < maxI; lcv += Nthreads) {
+        stateVec[perms[lcv]] = amps[lcv];
+    }
+}
+
 void kernel zsingle(global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclPtr)
 {
     const bitCapIntOcl Nthreads = get_global_size(0);
@@ -377,6 +461,150 @@ void kernel invertsinglewide(global cmplx* stateVec, constant cmplx* cmplxPtr, c
     APPLY_INVERT()
 }
 
+// Gate list op codes, (which must match QEngineOCL's)
+#define GATE_LIST_2X2 0
+#define GATE_LIST_X 1
+#define GATE_LIST_Z 2
+#define GATE_LIST_PHASE 3
+#define GATE_LIST_INVERT 4
+#define GATE_LIST_X_MASK 5
+
+// Gate list norm modes
+#define GATE_LIST_NORM_NONE 0
+#define GATE_LIST_NORM_IN_PLACE 1
+#define GATE_LIST_NORM_SUM 2
+
+// Interpret a list of single qubit gates and X masks, tile by tile: each work group loads 2^k contiguous amplitudes
+// into local memory, applies every gate in the list, (all of which act on qubits below k,) and writes the tile back,
+// for one launch, and one global read and write, for the whole list. If the tile is the whole state vector, the list
+// can also normalize in place, at its end; otherwise, it leaves per-group norm partial sums.
+void kernel gatelist(global cmplx* stateVec, constant cmplx* cmplxPtr, constant bitCapIntOcl* bitCapIntOclPtr,
+    global real1* sumBuffer, local cmplx* lStateVec)
+{
+    const bitCapIntOcl tileSize = bitCapIntOclPtr[0];
+    const bitCapIntOcl tileCount = bitCapIntOclPtr[1];
+    const bitCapIntOcl opCount = bitCapIntOclPtr[2];
+    const bitCapIntOcl normMode = bitCapIntOclPtr[3];
+    const bitCapIntOcl halfTileSize = tileSize >> ONE_BCI;
+    const bitCapIntOcl locID = get_local_id(0);
+    const bitCapIntOcl locNthreads = get_local_size(0);
+    const real1 nrm = cmplxPtr[opCount << 2U].x;
+    const real1 norm_thresh = cmplxPtr[opCount << 2U].y;
+    local real1* lBuffer = (local real1*)(lStateVec + tileSize);
+
+    real1 partNrm = ZERO_R1;
+    for (bitCapIntOcl tile = get_group_id(0); tile < tileCount; tile += get_num_groups(0)) {
+        const bitCapIntOcl offset = tile * tileSize;
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (bitCapIntOcl lcv = locID; lcv < tileSize; lcv += locNthreads) {
+            lStateVec[lcv] = nrm * stateVec[offset | lcv];
+        }
+
+        for (bitCapIntOcl op = 0U; op < opCount; op++) {
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            const bitCapIntOcl opCode = bitCapIntOclPtr[4U + (op << ONE_BCI)];
+            const bitCapIntOcl mask = bitCapIntOclPtr[5U + (op << ONE_BCI)];
+
+            if (opCode == GATE_LIST_X_MASK) {
+                const bitCapIntOcl otherMask = (tileSize - ONE_BCI) ^ mask;
+                for (bitCapIntOcl lcv = locID; lcv < tileSize; lcv += locNthreads) {
+                    const bitCapIntOcl otherRes = lcv & otherMask;
+                    bitCapIntOcl setInt = lcv & mask;
+                    bitCapIntOcl resetInt = setInt ^ mask;
+
+                    if (setInt < resetInt) {
+                        continue;
+                    }
+
+                    setInt |= otherRes;
+                    resetInt |= otherRes;
+
+                    const cmplx Y0 = lStateVec[resetInt];
+                    lStateVec[resetInt] = lStateVec[setInt];
+                    lStateVec[setInt] = Y0;
+                }
+                continue;
+            }
+
+            const cmplx4 mtrx = ((constant cmplx4*)cmplxPtr)[op];
+            const bitCapIntOcl qMask = mask - ONE_BCI;
+            for (bitCapIntOcl lcv = locID; lcv < halfTileSize; lcv += locNthreads) {
+                PUSH_APART_1()
+                const bitCapIntOcl j = i | mask;
+                const cmplx Y0 = lStateVec[i];
+
+                switch (opCode) {
+                case GATE_LIST_X:
+                    lStateVec[i] = lStateVec[j];
+                    lStateVec[j] = Y0;
+                    break;
+                case GATE_LIST_Z:
+                    lStateVec[j] = -lStateVec[j];
+                    break;
+                case GATE_LIST_PHASE:
+                    lStateVec[i] = zmul(mtrx.lo.xy, Y0);
+                    lStateVec[j] = zmul(mtrx.hi.zw, lStateVec[j]);
+                    break;
+                case GATE_LIST_INVERT:
+                    lStateVec[i] = zmul(mtrx.lo.zw, lStateVec[j]);
+                    lStateVec[j] = zmul(mtrx.hi.xy, Y0);
+                    break;
+                default: {
+                    const cmplx2 mulRes = zmatrixmul(ONE_R1, mtrx, (cmplx2)(Y0, lStateVec[j]));
+                    lStateVec[i] = mulRes.lo;
+                    lStateVec[j] = mulRes.hi;
+                }
+                }
+            }
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (bitCapIntOcl lcv = locID; lcv < tileSize; lcv += locNthreads) {
+            if (normMode != GATE_LIST_NORM_NONE) {
+                const cmplx amp = lStateVec[lcv];
+                const real1 dotAmp = dot(amp, amp);
+                if (dotAmp < norm_thresh) {
+                    lStateVec[lcv] = (cmplx)(ZERO_R1, ZERO_R1);
+                } else {
+                    partNrm += dotAmp;
+                }
+            }
+            if (normMode != GATE_LIST_NORM_IN_PLACE) {
+                stateVec[offset | lcv] = lStateVec[lcv];
+            }
+        }
+    }
+
+    if (normMode == GATE_LIST_NORM_NONE) {
+        return;
+    }
+
+    lBuffer[locID] = partNrm;
+    for (bitCapIntOcl lcv = (locNthreads >> ONE_BCI); lcv > 0U; lcv >>= ONE_BCI) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (locID < lcv) {
+            lBuffer[locID] += lBuffer[locID + lcv];
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (normMode == GATE_LIST_NORM_SUM) {
+        if (locID == 0U) {
+            sumBuffer[get_group_id(0)] = lBuffer[0];
+        }
+        return;
+    }
+
+    // In place normalization is only for a single tile, which is still in local memory.
+    const real1 outNrm = (lBuffer[0] > ZERO_R1) ? (ONE_R1 / sqrt(lBuffer[0])) : ONE_R1;
+    for (bitCapIntOcl lcv = locID; lcv < tileSize; lcv += locNthreads) {
+        stateVec[lcv] = outNrm * lStateVec[lcv];
+    }
+}
+
 void kernel uniformlycontrolled(global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclPtr,
     constant bitCapIntOcl* qPowers, global cmplx4* mtrxs, constant real1* nrmIn, global real1* sumBuffer,
     local real1* lBuffer)
@@ -426,6 +654,76 @@ void kernel uniformlycontrolled(global cmplx* stateVec, constant bitCapIntOcl* b
     SUM_LOCAL(partNrm)
 }
 
+void kernel applynxn(
+    global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclPtr, constant bitCapIntOcl* qPowers, global cmplx* mtrx)
+{
+    const bitCapIntOcl Nthreads = get_global_size(0);
+    const bitCapIntOcl maxI = bitCapIntOclPtr[0];
+    const bitCapIntOcl targetCount = bitCapIntOclPtr[1];
+    const bitCapIntOcl dim = ONE_BCI << targetCount;
+    // The first "targetCount" powers are sorted, for pushing apart, and the following "dim" are the row offsets.
+    constant bitCapIntOcl* offsets = qPowers + targetCount;
+
+    // (Host code limits targetCount to QRACK_MAX_MTRXN_QB, which is 5.)
+    cmplx amps[32];
+
+    for (bitCapIntOcl lcv = ID; lcv < maxI; lcv += Nthreads) {
+        bitCapIntOcl i = 0U;
+        bitCapIntOcl iHigh = lcv;
+        for (bitLenInt p = 0U; p < targetCount; p++) {
+            bitCapIntOcl iLow = iHigh & (qPowers[p] - ONE_BCI);
+            i |= iLow;
+            iHigh = (iHigh ^ iLow) << ONE_BCI;
+        }
+        i |= iHigh;
+
+        for (bitCapIntOcl j = 0U; j < dim; j++) {
+            amps[j] = stateVec[i | offsets[j]];
+        }
+
+        for (bitCapIntOcl j = 0U; j < dim; j++) {
+            const bitCapIntOcl row = j * dim;
+            cmplx amp = (cmplx)(ZERO_R1, ZERO_R1);
+            for (bitCapIntOcl k = 0U; k < dim; k++) {
+                amp += zmul(mtrx[row + k], amps[k]);
+            }
+            stateVec[i | offsets[j]] = amp;
+        }
+    }
+}
+
+// One radix-2 stage of the (inverse) QFT FFT, on the register bits from "start": each work item takes the pair of
+// amplitudes that differ in register bit "s," with twiddle angle -/+ pi * (register index mod 2^s) / 2^s.
+void kernel fftstage(global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclPtr)
+{
+    const bitCapIntOcl Nthreads = get_global_size(0);
+    const bitCapIntOcl maxI = bitCapIntOclPtr[0];
+    const bitCapIntOcl qPower = bitCapIntOclPtr[1];
+    const bitCapIntOcl start = bitCapIntOclPtr[2];
+    const bitCapIntOcl halfSize = bitCapIntOclPtr[3];
+    const bool isInverse = bitCapIntOclPtr[4];
+    const bitCapIntOcl qMask = qPower - 1U;
+    const real1 angle = (isInverse ? PI_R1 : -PI_R1) / (real1)halfSize;
+    const real1 nrm = sqrt(ONE_R1 / 2);
+
+    for (bitCapIntOcl lcv = ID; lcv < maxI; lcv += Nthreads) {
+        const bitCapIntOcl iLow = lcv & qMask;
+        const bitCapIntOcl i = ((lcv ^ iLow) << 1U) | iLow;
+        const real1 theta = angle * (real1)((i >> start) & (halfSize - 1U));
+        const cmplx w = (cmplx)(cos(theta), sin(theta));
+        const cmplx a = stateVec[i];
+        const cmplx b = stateVec[i | qPower];
+        if (isInverse) {
+            const cmplx t = zmul(w, b);
+            stateVec[i] = nrm * (a + t);
+            stateVec[i | qPower] = nrm * (a - t);
+        } else {
+            stateVec[i] = nrm * (a + b);
+            stateVec[i | qPower] = nrm * zmul(w, a - b);
+        }
+    }
+}
+
 void kernel uniformparityrz(global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclPtr, constant cmplx* cmplx_ptr)
 {
     const bitCapIntOcl Nthreads = get_global_size(0);
@@ -543,6 +841,25 @@ void kernel composemid(
     }
 }
 
+void kernel composemulti(global cmplx* stateVec, global cmplx* packedVec, constant bitCapIntOcl* bitCapIntOclPtr,
+    constant bitCapIntOcl* srcArgs, global cmplx* nStateVec)
+{
+    const bitCapIntOcl Nthreads = get_global_size(0);
+    const bitCapIntOcl nMaxQPower = bitCapIntOclPtr[0];
+    const bitCapIntOcl srcCount = bitCapIntOclPtr[1];
+    const bitCapIntOcl startMask = bitCapIntOclPtr[2];
+    // For each source "j," srcArgs holds its mask, its shift, and its offset into packedVec, starting at 3 * j.
+
+    for (bitCapIntOcl lcv = ID; lcv < nMaxQPower; lcv += Nthreads) {
+        cmplx amp = stateVec[lcv & startMask];
+        for (bitCapIntOcl j = 0U; j < srcCount; ++j) {
+            const bitCapIntOcl k = 3U * j;
+            amp = zmul(amp, packedVec[srcArgs[k + 2U] + ((lcv & srcArgs[k]) >> srcArgs[k + 1U])]);
+        }
+        nStateVec[lcv] = amp;
+    }
+}
+
 void kernel decomposeprob(global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclPtr,
     global real1* remainderStateProb, global real1* remainderStateAngle, global real1* partStateProb,
     global real1* partStateAngle)
@@ -842,6 +1159,68 @@ void kernel probmaskall(global cmplx* stateVec, constant bitCapIntOcl* bitCapInt
     }
 }
 
+void kernel cdfchunks(global real1* probs, constant bitCapIntOcl* bitCapIntOclPtr, global real1* chunkSums)
+{
+    const bitCapIntOcl maxI = bitCapIntOclPtr[0];
+    const bitCapIntOcl chunk = bitCapIntOclPtr[1];
+    const bitCapIntOcl start = ID * chunk;
+    const bitCapIntOcl end = min(start + chunk, maxI);
+
+    // In-place inclusive prefix sum of this work item's chunk
+    real1 sum = ZERO_R1;
+    for (bitCapIntOcl i = start; i < end; i++) {
+        sum += probs[i];
+        probs[i] = sum;
+    }
+    chunkSums[ID] = sum;
+}
+
+void kernel samplecdf(global real1* cdfs, constant bitCapIntOcl* bitCapIntOclPtr, global real1* chunkEnds,
+    global bitCapIntOcl* samples)
+{
+    const bitCapIntOcl Nthreads = get_global_size(0);
+    const bitCapIntOcl maxI = bitCapIntOclPtr[0];
+    const bitCapIntOcl chunk = bitCapIntOclPtr[1];
+    const bitCapIntOcl chunkCount = bitCapIntOclPtr[2];
+    const bitCapIntOcl shots = bitCapIntOclPtr[3];
+    const ulong seed = ((ulong)bitCapIntOclPtr[4] << 32U) | (ulong)bitCapIntOclPtr[5];
+    const real1 total = chunkEnds[chunkCount - ONE_BCI];
+
+    for (bitCapIntOcl shot = ID; shot < shots; shot += Nthreads) {
+        // The first draw of CounterRng(seed, shot): every shot gets its own stream, with no RNG state to carry.
+        const uint4 block = philox4x32((uint4)(0U, 0U, (uint)shot, (uint)((ulong)shot >> 32U)),
+            (uint2)((uint)seed, (uint)(seed >> 32U)));
+        const ulong z = ((ulong)block.y << 32U) | (ulong)block.x;
+        const real1 r = (real1)((float)(z >> 40U) * (1.0f / 16777216.0f)) * total;
+
+        // First chunk with an end past "r," then first entry past "r" within that chunk
+        bitCapIntOcl lo = 0U;
+        bitCapIntOcl hi = chunkCount - ONE_BCI;
+        while (lo < hi) {
+            const bitCapIntOcl mid = (lo + hi) >> ONE_BCI;
+            if (chunkEnds[mid] > r) {
+                hi = mid;
+            } else {
+                lo = mid + ONE_BCI;
+            }
+        }
+        const real1 rLocal = r - (lo ? chunkEnds[lo - ONE_BCI] : ZERO_R1);
+
+        hi = min((lo + ONE_BCI) * chunk, maxI) - ONE_BCI;
+        lo *= chunk;
+        while (lo < hi) {
+            const bitCapIntOcl mid = (lo + hi) >> ONE_BCI;
+            if (cdfs[mid] > rLocal) {
+                hi = mid;
+            } else {
+                lo = mid + ONE_BCI;
+            }
+        }
+
+        samples[shot] = lo;
+    }
+}
+
 void kernel probparity(global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclPtr, global real1* sumBuffer,
     local real1* lBuffer)
 {
@@ -923,6 +1302,35 @@ void kernel expperm(global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclP
     SUM_LOCAL(expectation)
 }
 
+void kernel exppauli(global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclPtr, global real1* sumBuffer,
+    local real1* lBuffer)
+{
+    const bitCapIntOcl Nthreads = get_global_size(0);
+    const bitCapIntOcl4 args = vload4(0, bitCapIntOclPtr);
+    const bitCapIntOcl maxI = args.x;
+    // X and Y bits flip the permutation, Y and Z bits contribute a sign.
+    const bitCapIntOcl xMask = args.y;
+    const bitCapIntOcl zMask = args.z;
+    // Odd Y count leaves a factor of i on the sum, so take its imaginary part instead.
+    const bool isImag = (bool)args.w;
+
+    real1 expectation = ZERO_R1;
+    for (bitCapIntOcl lcv = ID; lcv < maxI; lcv += Nthreads) {
+        bool parity = false;
+        bitCapIntOcl v = lcv & zMask;
+        while (v) {
+            parity = !parity;
+            v = v & (v - ONE_BCI);
+        }
+
+        const cmplx prod = zmul(conj(stateVec[lcv ^ xMask]), stateVec[lcv]);
+        const real1 part = isImag ? prod.y : prod.x;
+        expectation += parity ? -part : part;
+    }
+
+    SUM_LOCAL(expectation)
+}
+
 void kernel nrmlze(global cmplx* stateVec, constant bitCapIntOcl* bitCapIntOclPtr, constant cmplx* args_ptr)
 {
     const bitCapIntOcl Nthreads = get_global_size(0);
@@ -0,0 +1,312 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// Bit-packed stabilizer tableau kernels, for Qrack::QStabilizerOCL. Row "i" of the x (or z) tableau is the "wordCount"
+// 64-bit words at [i * wordCount, (i + 1) * wordCount), exactly as in the host QStabilizer::BitRow layout.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+// (These must match enum StabilizerGateOCL, in qstabilizer_opencl.hpp.)
+#define STAB_CNOT 0U
+#define STAB_ANTICNOT 1U
+#define STAB_CY 2U
+#define STAB_ANTICY 3U
+#define STAB_CZ 4U
+#define STAB_ANTICZ 5U
+#define STAB_SWAP 6U
+#define STAB_ISWAP 7U
+#define STAB_IISWAP 8U
+#define STAB_H 9U
+#define STAB_S 10U
+#define STAB_IS 11U
+#define STAB_Z 12U
+#define STAB_X 13U
+#define STAB_Y 14U
+
+#define STAB_GETBIT(row, j) ((uint)((row[(j) >> 6U] >> ((j)&63U)) & 1UL))
+#define STAB_FLIPBIT(row, j) row[(j) >> 6U] ^= (1UL << ((j)&63U))
+#define STAB_XORBIT(row, j, v) row[(j) >> 6U] ^= (((ulong)(v)) << ((j)&63U))
+#define STAB_SWAPBITS(row, j, k)                                                                                       \
+    if (STAB_GETBIT(row, j) != STAB_GETBIT(row, k)) {                                                                  \
+        STAB_FLIPBIT(row, j);                                                                                          \
+        STAB_FLIPBIT(row, k);                                                                                          \
+    }
+#define STAB_FLIPSIGN(ri) ri = (ri + 2U) & 0x3U
+
+// (popcount() is OpenCL 1.2, and we still support 1.1 devices.)
+inline int stabpopcount(ulong v)
+{
+    v = v - ((v >> 1U) & 0x5555555555555555UL);
+    v = (v & 0x3333333333333333UL) + ((v >> 2U) & 0x3333333333333333UL);
+    v = (v + (v >> 4U)) & 0x0F0F0F0F0F0F0F0FUL;
+    return (int)((v * 0x0101010101010101UL) >> 56U);
+}
+
+// Return the phase (0,1,2,3) when row "i" is LEFT-multiplied by row "k," as in QStabilizer::clifford()
+inline uchar stabclifford(global const ulong* xi, global const ulong* zi, const uchar ri, global const ulong* xk,
+    global const ulong* zk, const uchar rk, const uint wordCount)
+{
+    int e = 0;
+    for (uint w = 0U; w < wordCount; ++w) {
+        const ulong xOnlyK = xk[w] & ~zk[w];
+        const ulong yK = xk[w] & zk[w];
+        const ulong zOnlyK = ~xk[w] & zk[w];
+        const ulong xOnlyI = xi[w] & ~zi[w];
+        const ulong yI = xi[w] & zi[w];
+        const ulong zOnlyI = ~xi[w] & zi[w];
+
+        // XY=iZ, YZ=iX, ZX=iY
+        e += stabpopcount((xOnlyK & yI) | (yK & zOnlyI) | (zOnlyK & xOnlyI));
+        // XZ=-iY, YX=-iZ, ZY=-iX
+        e -= stabpopcount((xOnlyK & zOnlyI) | (yK & xOnlyI) | (zOnlyK & yI));
+    }
+
+    return (uchar)((e + (int)ri + (int)rk) & 0x3);
+}
+
+// Left-multiply row "i" by row "k," as in QStabilizer::rowmult()
+inline void stabrowmult(global ulong* xi, global ulong* zi, global uchar* ri, global const ulong* xk,
+    global const ulong* zk, const uchar rk, const uint wordCount)
+{
+    *ri = stabclifford(xi, zi, *ri, xk, zk, rk, wordCount);
+    for (uint w = 0U; w < wordCount; ++w) {
+        xi[w] ^= xk[w];
+        zi[w] ^= zk[w];
+    }
+}
+
+// One work item per tableau row: the same per-row updates as the QStabilizer gate methods
+void kernel stabgate(global ulong* x, global ulong* z, global uchar* r, const uint wordCount, const uint rowCount,
+    const uint op, const uint c, const uint t)
+{
+    const uint i = get_global_id(0);
+    if (i >= rowCount) {
+        return;
+    }
+
+    global ulong* xi = x + i * wordCount;
+    global ulong* zi = z + i * wordCount;
+    uchar ri = r[i];
+
+    switch (op) {
+    case STAB_CNOT:
+        if (STAB_GETBIT(xi, c)) {
+            STAB_FLIPBIT(xi, t);
+        }
+        if (STAB_GETBIT(zi, t)) {
+            STAB_FLIPBIT(zi, c);
+            if (STAB_GETBIT(xi, c) && (STAB_GETBIT(xi, t) == STAB_GETBIT(zi, c))) {
+                STAB_FLIPSIGN(ri);
+            }
+        }
+        break;
+    case STAB_ANTICNOT:
+        if (STAB_GETBIT(xi, c)) {
+            STAB_FLIPBIT(xi, t);
+        }
+        if (STAB_GETBIT(zi, t)) {
+            STAB_FLIPBIT(zi, c);
+            if (!STAB_GETBIT(xi, c) || (STAB_GETBIT(xi, t) != STAB_GETBIT(zi, c))) {
+                STAB_FLIPSIGN(ri);
+            }
+        }
+        break;
+    case STAB_CY:
+    case STAB_ANTICY:
+        STAB_XORBIT(zi, t, STAB_GETBIT(xi, t));
+        if (STAB_GETBIT(xi, c)) {
+            STAB_FLIPBIT(xi, t);
+        }
+        if (STAB_GETBIT(zi, t)) {
+            if (op == STAB_CY) {
+                if (STAB_GETBIT(xi, c) && (STAB_GETBIT(xi, t) == STAB_GETBIT(zi, c))) {
+                    STAB_FLIPSIGN(ri);
+                }
+            } else if (!STAB_GETBIT(xi, c) || (STAB_GETBIT(xi, t) != STAB_GETBIT(zi, c))) {
+                STAB_FLIPSIGN(ri);
+            }
+            STAB_FLIPBIT(zi, c);
+        }
+        STAB_XORBIT(zi, t, STAB_GETBIT(xi, t));
+        break;
+    case STAB_CZ:
+        if (STAB_GETBIT(xi, t)) {
+            STAB_FLIPBIT(zi, c);
+            if (STAB_GETBIT(xi, c) && (STAB_GETBIT(zi, t) == STAB_GETBIT(zi, c))) {
+                STAB_FLIPSIGN(ri);
+            }
+        }
+        if (STAB_GETBIT(xi, c)) {
+            STAB_FLIPBIT(zi, t);
+        }
+        break;
+    case STAB_ANTICZ:
+        if (STAB_GETBIT(xi, t)) {
+            STAB_FLIPBIT(zi, c);
+            if (!STAB_GETBIT(xi, c) || (STAB_GETBIT(zi, t) != STAB_GETBIT(zi, c))) {
+                STAB_FLIPSIGN(ri);
+            }
+        }
+        if (STAB_GETBIT(xi, c)) {
+            STAB_FLIPBIT(zi, t);
+        }
+        break;
+    case STAB_SWAP:
+        STAB_SWAPBITS(xi, c, t);
+        STAB_SWAPBITS(zi, c, t);
+        break;
+    case STAB_ISWAP:
+        STAB_SWAPBITS(xi, c, t);
+        STAB_SWAPBITS(zi, c, t);
+        if (STAB_GETBIT(xi, t)) {
+            STAB_FLIPBIT(zi, c);
+            if (!STAB_GETBIT(xi, c) && STAB_GETBIT(zi, t)) {
+                STAB_FLIPSIGN(ri);
+            }
+        }
+        if (STAB_GETBIT(xi, c)) {
+            STAB_FLIPBIT(zi, t);
+            if (STAB_GETBIT(zi, c) && !STAB_GETBIT(xi, t)) {
+                STAB_FLIPSIGN(ri);
+            }
+        }
+        STAB_XORBIT(zi, c, STAB_GETBIT(xi, c));
+        STAB_XORBIT(zi, t, STAB_GETBIT(xi, t));
+        break;
+    case STAB_IISWAP:
+        STAB_XORBIT(zi, c, STAB_GETBIT(xi, c));
+        STAB_XORBIT(zi, t, STAB_GETBIT(xi, t));
+        if (STAB_GETBIT(xi, c)) {
+            STAB_FLIPBIT(zi, t);
+            if (STAB_GETBIT(zi, c) && !STAB_GETBIT(xi, t)) {
+                STAB_FLIPSIGN(ri);
+            }
+        }
+        if (STAB_GETBIT(xi, t)) {
+            STAB_FLIPBIT(zi, c);
+            if (!STAB_GETBIT(xi, c) && STAB_GETBIT(zi, t)) {
+                STAB_FLIPSIGN(ri);
+            }
+        }
+        STAB_SWAPBITS(xi, c, t);
+        STAB_SWAPBITS(zi, c, t);
+        break;
+    case STAB_H:
+        if (STAB_GETBIT(xi, t) != STAB_GETBIT(zi, t)) {
+            STAB_FLIPBIT(xi, t);
+            STAB_FLIPBIT(zi, t);
+        }
+        if (STAB_GETBIT(xi, t) && STAB_GETBIT(zi, t)) {
+            STAB_FLIPSIGN(ri);
+        }
+        break;
+    case STAB_S:
+        if (STAB_GETBIT(xi, t) && STAB_GETBIT(zi, t)) {
+            STAB_FLIPSIGN(ri);
+        }
+        STAB_XORBIT(zi, t, STAB_GETBIT(xi, t));
+        break;
+    case STAB_IS:
+        STAB_XORBIT(zi, t, STAB_GETBIT(xi, t));
+        if (STAB_GETBIT(xi, t) && STAB_GETBIT(zi, t)) {
+            STAB_FLIPSIGN(ri);
+        }
+        break;
+    case STAB_Z:
+        if (STAB_GETBIT(xi, t)) {
+            STAB_FLIPSIGN(ri);
+        }
+        break;
+    case STAB_X:
+        if (STAB_GETBIT(zi, t)) {
+            STAB_FLIPSIGN(ri);
+        }
+        break;
+    case STAB_Y:
+        if (STAB_GETBIT(zi, t) ^ STAB_GETBIT(xi, t)) {
+            STAB_FLIPSIGN(ri);
+        }
+        break;
+    default:
+        break;
+    }
+
+    r[i] = ri;
+}
+
+// Lowest stabilizer row with an x bit on "t" goes in pivots[0], and lowest such destabilizer row in pivots[1].
+// (Both must be initialized to "n," for "none.")
+void kernel stabpivots(global const ulong* x, const uint wordCount, const uint n, const uint t, global uint* pivots)
+{
+    const uint i = get_global_id(0);
+    if (i >= n) {
+        return;
+    }
+
+    global const ulong* xd = x + i * wordCount;
+    global const ulong* xs = x + (i + n) * wordCount;
+    if (STAB_GETBIT(xs, t)) {
+        atomic_min(pivots, i);
+    }
+    if (STAB_GETBIT(xd, t)) {
+        atomic_min(pivots + 1U, i);
+    }
+}
+
+// Random-outcome measurement update: row "p" already holds the old row "p + n." Every other row that anticommutes
+// with Z_t is multiplied by row "p," and row "p + n" becomes Z_t, with sign "sign."
+void kernel stabmeasure(global ulong* x, global ulong* z, global uchar* r, const uint wordCount, const uint n,
+    const uint t, const uint p, const uchar sign)
+{
+    const uint i = get_global_id(0);
+    if ((i >= (n << 1U)) || (i == p)) {
+        return;
+    }
+
+    global ulong* xi = x + i * wordCount;
+    global ulong* zi = z + i * wordCount;
+
+    if (i == (p + n)) {
+        for (uint w = 0U; w < wordCount; ++w) {
+            xi[w] = 0UL;
+            zi[w] = 0UL;
+        }
+        STAB_FLIPBIT(zi, t);
+        r[i] = sign;
+        return;
+    }
+
+    if (STAB_GETBIT(xi, t)) {
+        stabrowmult(xi, zi, r + i, x + p * wordCount, z + p * wordCount, r[p], wordCount);
+    }
+}
+
+// Determinate-outcome measurement: accumulate the product of stabilizers into the scratch row, (row 2n,) which is a
+// sequential reduction over the sign, so a single work item does it.
+void kernel stabscratch(global ulong* x, global ulong* z, global uchar* r, const uint wordCount, const uint n,
+    const uint t, const uint m)
+{
+    if (get_global_id(0)) {
+        return;
+    }
+
+    const uint s = n << 1U;
+    global ulong* xs = x + s * wordCount;
+    global ulong* zs = z + s * wordCount;
+    global const ulong* xm = x + (m + n) * wordCount;
+    global const ulong* zm = z + (m + n) * wordCount;
+    for (uint w = 0U; w < wordCount; ++w) {
+        xs[w] = xm[w];
+        zs[w] = zm[w];
+    }
+    r[s] = r[m + n];
+
+    for (uint i = m + 1U; i < n; ++i) {
+        if (STAB_GETBIT((x + i * wordCount), t)) {
+            stabrowmult(xs, zs, r + s, x + (i + n) * wordCount, z + (i + n) * wordCount, r[i + n], wordCount);
+        }
+    }
+}
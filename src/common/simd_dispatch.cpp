@@ -0,0 +1,360 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// Runtime-dispatched AVX2 and AVX-512 kernels for the hot QEngineCPU loops. Each kernel
+// is compiled for its own target, so the library as a whole does not require either
+// instruction set.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "common/simd_dispatch.hpp"
+
+#include <immintrin.h>
+
+#if ENABLE_ENV_VARS
+#include <string>
+#endif
+
+#if (FPPOW == 5) || (FPPOW == 6)
+
+#if FPPOW == 5
+#define SIMD256 __m256
+#define SIMD256_OP(op) _mm256_##op##_ps
+#define SIMD512 __m512
+#define SIMD512_OP(op) _mm512_##op##_ps
+#define SIMD512_CMP_MASK _mm512_cmp_ps_mask
+#define SIMD512_FULL_MASK ((__mmask16)0xFFFF)
+#define SIMD512_MASK __mmask16
+#define SIMD_LANE_BITS uint32_t
+#define SIMD256_FROM_BITS _mm256_castsi256_ps
+#define SIMD256_SWAP 0xB1
+#define SIMD512_SWAP 0xB1
+#else
+#define SIMD256 __m256d
+#define SIMD256_OP(op) _mm256_##op##_pd
+#define SIMD512 __m512d
+#define SIMD512_OP(op) _mm512_##op##_pd
+#define SIMD512_CMP_MASK _mm512_cmp_pd_mask
+#define SIMD512_FULL_MASK ((__mmask8)0xFF)
+#define SIMD512_MASK __mmask8
+#define SIMD_LANE_BITS uint64_t
+#define SIMD256_FROM_BITS _mm256_castsi256_pd
+#define SIMD256_SWAP 0x5
+#define SIMD512_SWAP 0x55
+#endif
+
+// (The zero-masked AVX-512 permute avoids the "undefined" pass-through operand, which GCC 12 warns about.)
+#define SIMD512_PERMUTE(v) SIMD512_OP(maskz_permute)(SIMD512_FULL_MASK, v, SIMD512_SWAP)
+
+// Real scalars per vector register, (twice the complex amplitude count)
+#define SIMD256_LEN (32U / sizeof(real1))
+#define SIMD512_LEN (64U / sizeof(real1))
+
+// (x + iy)(u + iv) = (xu - yv) + i(yu + xv), where "s" is "v" with real and imaginary parts swapped.
+#define CMUL(OP, v, s, mr, mi) OP(fmaddsub)(v, mr, OP(mul)(s, mi))
+
+// Whether real scalar lane "j" belongs to an amplitude, (of a vector starting at an aligned index,) that matches "perm"
+#define LANE_SELECTED(j, mask, perm) ((((j) >> 1U) & (mask)) == (perm))
+
+namespace Qrack {
+
+// Vectors start at indices that are multiples of the width, so only the index bits below the width vary by lane, and
+// the same lane selection holds for every vector.
+__attribute__((target("avx2,fma"))) static SIMD256 SelectLanesAvx2(bitCapIntOcl mask, bitCapIntOcl perm)
+{
+    SIMD_LANE_BITS bits[SIMD256_LEN];
+    for (bitCapIntOcl j = 0U; j < SIMD256_LEN; ++j) {
+        bits[j] = LANE_SELECTED(j, mask, perm) ? ~((SIMD_LANE_BITS)0U) : (SIMD_LANE_BITS)0U;
+    }
+
+    return SIMD256_FROM_BITS(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bits)));
+}
+
+static SIMD512_MASK SelectLanesAvx512(bitCapIntOcl mask, bitCapIntOcl perm)
+{
+    SIMD512_MASK sel = 0U;
+    for (bitCapIntOcl j = 0U; j < SIMD512_LEN; ++j) {
+        if (LANE_SELECTED(j, mask, perm)) {
+            sel |= (SIMD512_MASK)(1U << j);
+        }
+    }
+
+    return sel;
+}
+
+__attribute__((target("avx2,fma"))) static void Apply2x2Avx2(
+    complex* lo, complex* hi, complex const* mtrx, bitCapIntOcl length)
+{
+    real1* l = reinterpret_cast<real1*>(lo);
+    real1* h = reinterpret_cast<real1*>(hi);
+    const SIMD256 m0r = SIMD256_OP(set1)(real(mtrx[0U]));
+    const SIMD256 m0i = SIMD256_OP(set1)(imag(mtrx[0U]));
+    const SIMD256 m1r = SIMD256_OP(set1)(real(mtrx[1U]));
+    const SIMD256 m1i = SIMD256_OP(set1)(imag(mtrx[1U]));
+    const SIMD256 m2r = SIMD256_OP(set1)(real(mtrx[2U]));
+    const SIMD256 m2i = SIMD256_OP(set1)(imag(mtrx[2U]));
+    const SIMD256 m3r = SIMD256_OP(set1)(real(mtrx[3U]));
+    const SIMD256 m3i = SIMD256_OP(set1)(imag(mtrx[3U]));
+
+    const bitCapIntOcl maxJ = length << 1U;
+    for (bitCapIntOcl j = 0U; j < maxJ; j += SIMD256_LEN) {
+        const SIMD256 a = SIMD256_OP(loadu)(l + j);
+        const SIMD256 b = SIMD256_OP(loadu)(h + j);
+        const SIMD256 aSwap = SIMD256_OP(permute)(a, SIMD256_SWAP);
+        const SIMD256 bSwap = SIMD256_OP(permute)(b, SIMD256_SWAP);
+        const SIMD256 outLo =
+            SIMD256_OP(add)(CMUL(SIMD256_OP, a, aSwap, m0r, m0i), CMUL(SIMD256_OP, b, bSwap, m1r, m1i));
+        const SIMD256 outHi =
+            SIMD256_OP(add)(CMUL(SIMD256_OP, a, aSwap, m2r, m2i), CMUL(SIMD256_OP, b, bSwap, m3r, m3i));
+        SIMD256_OP(storeu)(l + j, outLo);
+        SIMD256_OP(storeu)(h + j, outHi);
+    }
+}
+
+__attribute__((target("avx512f"))) static void Apply2x2Avx512(
+    complex* lo, complex* hi, complex const* mtrx, bitCapIntOcl length)
+{
+    real1* l = reinterpret_cast<real1*>(lo);
+    real1* h = reinterpret_cast<real1*>(hi);
+    const SIMD512 m0r = SIMD512_OP(set1)(real(mtrx[0U]));
+    const SIMD512 m0i = SIMD512_OP(set1)(imag(mtrx[0U]));
+    const SIMD512 m1r = SIMD512_OP(set1)(real(mtrx[1U]));
+    const SIMD512 m1i = SIMD512_OP(set1)(imag(mtrx[1U]));
+    const SIMD512 m2r = SIMD512_OP(set1)(real(mtrx[2U]));
+    const SIMD512 m2i = SIMD512_OP(set1)(imag(mtrx[2U]));
+    const SIMD512 m3r = SIMD512_OP(set1)(real(mtrx[3U]));
+    const SIMD512 m3i = SIMD512_OP(set1)(imag(mtrx[3U]));
+
+    const bitCapIntOcl maxJ = length << 1U;
+    for (bitCapIntOcl j = 0U; j < maxJ; j += SIMD512_LEN) {
+        const SIMD512 a = SIMD512_OP(loadu)(l + j);
+        const SIMD512 b = SIMD512_OP(loadu)(h + j);
+        const SIMD512 aSwap = SIMD512_PERMUTE(a);
+        const SIMD512 bSwap = SIMD512_PERMUTE(b);
+        const SIMD512 outLo =
+            SIMD512_OP(add)(CMUL(SIMD512_OP, a, aSwap, m0r, m0i), CMUL(SIMD512_OP, b, bSwap, m1r, m1i));
+        const SIMD512 outHi =
+            SIMD512_OP(add)(CMUL(SIMD512_OP, a, aSwap, m2r, m2i), CMUL(SIMD512_OP, b, bSwap, m3r, m3i));
+        SIMD512_OP(storeu)(l + j, outLo);
+        SIMD512_OP(storeu)(h + j, outHi);
+    }
+}
+
+__attribute__((target("avx2,fma"))) static real1_f NormAvx2(
+    complex const* amps, bitCapIntOcl length, real1_f norm_thresh)
+{
+    const real1* a = reinterpret_cast<const real1*>(amps);
+    const SIMD256 thresh = SIMD256_OP(set1)((real1)norm_thresh);
+    SIMD256 acc = SIMD256_OP(setzero)();
+
+    const bitCapIntOcl maxJ = length << 1U;
+    for (bitCapIntOcl j = 0U; j < maxJ; j += SIMD256_LEN) {
+        const SIMD256 v = SIMD256_OP(loadu)(a + j);
+        SIMD256 n = SIMD256_OP(mul)(v, v);
+        // Both lanes of each complex amplitude now hold its norm.
+        n = SIMD256_OP(add)(n, SIMD256_OP(permute)(n, SIMD256_SWAP));
+        acc = SIMD256_OP(add)(acc, SIMD256_OP(and)(SIMD256_OP(cmp)(n, thresh, _CMP_GE_OQ), n));
+    }
+
+    real1 lanes[SIMD256_LEN];
+    SIMD256_OP(storeu)(lanes, acc);
+    real1 nrmSqr = ZERO_R1;
+    for (bitCapIntOcl j = 0U; j < SIMD256_LEN; ++j) {
+        nrmSqr += lanes[j];
+    }
+
+    return (real1_f)(nrmSqr / 2);
+}
+
+__attribute__((target("avx512f"))) static real1_f NormAvx512(
+    complex const* amps, bitCapIntOcl length, real1_f norm_thresh)
+{
+    const real1* a = reinterpret_cast<const real1*>(amps);
+    const SIMD512 thresh = SIMD512_OP(set1)((real1)norm_thresh);
+    SIMD512 acc = SIMD512_OP(setzero)();
+
+    const bitCapIntOcl maxJ = length << 1U;
+    for (bitCapIntOcl j = 0U; j < maxJ; j += SIMD512_LEN) {
+        const SIMD512 v = SIMD512_OP(loadu)(a + j);
+        SIMD512 n = SIMD512_OP(mul)(v, v);
+        // Both lanes of each complex amplitude now hold its norm.
+        n = SIMD512_OP(add)(n, SIMD512_PERMUTE(n));
+        acc = SIMD512_OP(mask_add)(acc, SIMD512_CMP_MASK(n, thresh, _CMP_GE_OQ), acc, n);
+    }
+
+    real1 lanes[SIMD512_LEN];
+    SIMD512_OP(storeu)(lanes, acc);
+    real1 nrmSqr = ZERO_R1;
+    for (bitCapIntOcl j = 0U; j < SIMD512_LEN; ++j) {
+        nrmSqr += lanes[j];
+    }
+
+    return (real1_f)(nrmSqr / 2);
+}
+
+__attribute__((target("avx2,fma"))) static real1_f ProbMaskAvx2(
+    complex const* amps, bitCapIntOcl mask, bitCapIntOcl perm, bitCapIntOcl length)
+{
+    const real1* a = reinterpret_cast<const real1*>(amps);
+    const SIMD256 sel = SelectLanesAvx2(mask, perm);
+    SIMD256 acc = SIMD256_OP(setzero)();
+
+    const bitCapIntOcl maxJ = length << 1U;
+    for (bitCapIntOcl j = 0U; j < maxJ; j += SIMD256_LEN) {
+        const SIMD256 v = SIMD256_OP(loadu)(a + j);
+        acc = SIMD256_OP(add)(acc, SIMD256_OP(and)(sel, SIMD256_OP(mul)(v, v)));
+    }
+
+    real1 lanes[SIMD256_LEN];
+    SIMD256_OP(storeu)(lanes, acc);
+    real1 prob = ZERO_R1;
+    for (bitCapIntOcl j = 0U; j < SIMD256_LEN; ++j) {
+        prob += lanes[j];
+    }
+
+    return (real1_f)prob;
+}
+
+__attribute__((target("avx512f"))) static real1_f ProbMaskAvx512(
+    complex const* amps, bitCapIntOcl mask, bitCapIntOcl perm, bitCapIntOcl length)
+{
+    const real1* a = reinterpret_cast<const real1*>(amps);
+    const SIMD512_MASK sel = SelectLanesAvx512(mask, perm);
+    SIMD512 acc = SIMD512_OP(setzero)();
+
+    const bitCapIntOcl maxJ = length << 1U;
+    for (bitCapIntOcl j = 0U; j < maxJ; j += SIMD512_LEN) {
+        const SIMD512 v = SIMD512_OP(loadu)(a + j);
+        acc = SIMD512_OP(mask_add)(acc, sel, acc, SIMD512_OP(mul)(v, v));
+    }
+
+    real1 lanes[SIMD512_LEN];
+    SIMD512_OP(storeu)(lanes, acc);
+    real1 prob = ZERO_R1;
+    for (bitCapIntOcl j = 0U; j < SIMD512_LEN; ++j) {
+        prob += lanes[j];
+    }
+
+    return (real1_f)prob;
+}
+
+__attribute__((target("avx2,fma"))) static void ApplyMAvx2(
+    complex* amps, bitCapIntOcl mask, bitCapIntOcl result, complex nrm, bitCapIntOcl length)
+{
+    real1* a = reinterpret_cast<real1*>(amps);
+    const SIMD256 sel = SelectLanesAvx2(mask, result);
+    const SIMD256 nr = SIMD256_OP(set1)(real(nrm));
+    const SIMD256 ni = SIMD256_OP(set1)(imag(nrm));
+
+    const bitCapIntOcl maxJ = length << 1U;
+    for (bitCapIntOcl j = 0U; j < maxJ; j += SIMD256_LEN) {
+        const SIMD256 v = SIMD256_OP(loadu)(a + j);
+        const SIMD256 vSwap = SIMD256_OP(permute)(v, SIMD256_SWAP);
+        SIMD256_OP(storeu)(a + j, SIMD256_OP(and)(sel, CMUL(SIMD256_OP, v, vSwap, nr, ni)));
+    }
+}
+
+__attribute__((target("avx512f"))) static void ApplyMAvx512(
+    complex* amps, bitCapIntOcl mask, bitCapIntOcl result, complex nrm, bitCapIntOcl length)
+{
+    real1* a = reinterpret_cast<real1*>(amps);
+    const SIMD512_MASK sel = SelectLanesAvx512(mask, result);
+    const SIMD512 nr = SIMD512_OP(set1)(real(nrm));
+    const SIMD512 ni = SIMD512_OP(set1)(imag(nrm));
+
+    const bitCapIntOcl maxJ = length << 1U;
+    for (bitCapIntOcl j = 0U; j < maxJ; j += SIMD512_LEN) {
+        const SIMD512 v = SIMD512_OP(loadu)(a + j);
+        const SIMD512 vSwap = SIMD512_PERMUTE(v);
+        SIMD512_OP(storeu)(a + j, SIMD512_OP(maskz_mov)(sel, CMUL(SIMD512_OP, v, vSwap, nr, ni)));
+    }
+}
+
+static SimdIsa DetectSimdIsa()
+{
+    SimdIsa isa = SIMD_ISA_NONE;
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        isa = SIMD_ISA_AVX512;
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        isa = SIMD_ISA_AVX2;
+    }
+
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_SIMD_ISA")) {
+        const std::string cap = std::string(getenv("QRACK_SIMD_ISA"));
+        SimdIsa capIsa = SIMD_ISA_AVX512;
+        if (cap == "none") {
+            capIsa = SIMD_ISA_NONE;
+        } else if (cap == "avx2") {
+            capIsa = SIMD_ISA_AVX2;
+        }
+        if (capIsa < isa) {
+            isa = capIsa;
+        }
+    }
+#endif
+
+    return isa;
+}
+
+SimdIsa GetSimdIsa()
+{
+    static const SimdIsa isa = DetectSimdIsa();
+    return isa;
+}
+
+bitCapIntOcl GetSimdWidth()
+{
+    switch (GetSimdIsa()) {
+    case SIMD_ISA_AVX512:
+        return SIMD512_LEN >> 1U;
+    case SIMD_ISA_AVX2:
+        return SIMD256_LEN >> 1U;
+    default:
+        return 0U;
+    }
+}
+
+void SimdApply2x2(complex* lo, complex* hi, complex const* mtrx, bitCapIntOcl length)
+{
+    if (GetSimdIsa() == SIMD_ISA_AVX512) {
+        Apply2x2Avx512(lo, hi, mtrx, length);
+    } else {
+        Apply2x2Avx2(lo, hi, mtrx, length);
+    }
+}
+
+real1_f SimdNorm(complex const* amps, bitCapIntOcl length, real1_f norm_thresh)
+{
+    if (GetSimdIsa() == SIMD_ISA_AVX512) {
+        return NormAvx512(amps, length, norm_thresh);
+    }
+
+    return NormAvx2(amps, length, norm_thresh);
+}
+
+real1_f SimdProbMask(complex const* amps, bitCapIntOcl mask, bitCapIntOcl perm, bitCapIntOcl length)
+{
+    if (GetSimdIsa() == SIMD_ISA_AVX512) {
+        return ProbMaskAvx512(amps, mask, perm, length);
+    }
+
+    return ProbMaskAvx2(amps, mask, perm, length);
+}
+
+void SimdApplyM(complex* amps, bitCapIntOcl mask, bitCapIntOcl result, complex nrm, bitCapIntOcl length)
+{
+    if (GetSimdIsa() == SIMD_ISA_AVX512) {
+        ApplyMAvx512(amps, mask, result, nrm, length);
+    } else {
+        ApplyMAvx2(amps, mask, result, nrm, length);
+    }
+}
+} // namespace Qrack
+
+#endif
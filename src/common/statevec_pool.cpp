@@ -0,0 +1,180 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "statevec_pool.hpp"
+#include "memory_governor.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace Qrack {
+
+StateVecPool::StateVecPool()
+    : maxIdleBytes(256U << 20U)
+    , idleBytes(0U)
+    , hitCount(0U)
+    , missCount(0U)
+{
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_SV_POOL_MB")) {
+        maxIdleBytes = ((size_t)std::stoi(std::string(getenv("QRACK_SV_POOL_MB")))) << 20U;
+    }
+#endif
+}
+
+StateVecPool& StateVecPool::Instance()
+{
+    // Never destroyed, so that engines with static storage duration can still release to it.
+    static StateVecPool* instance = new StateVecPool();
+    return *instance;
+}
+
+void* StateVecPool::AlignedAlloc(size_t bytes)
+{
+#if defined(__APPLE__)
+    void* toRet;
+    if (posix_memalign(&toRet, QRACK_ALIGN_SIZE, bytes)) {
+        return NULL;
+    }
+    return toRet;
+#elif defined(_WIN32) && !defined(__CYGWIN__)
+    return _aligned_malloc(bytes, QRACK_ALIGN_SIZE);
+#else
+    return aligned_alloc(QRACK_ALIGN_SIZE, bytes);
+#endif
+}
+
+void StateVecPool::AlignedFree(void* ptr)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+void StateVecPool::EvictIdle(size_t bytes)
+{
+    // Largest first, since one large buffer is the likeliest to go unused
+    while (idle.size() && ((idleBytes + bytes) > maxIdleBytes)) {
+        FreeIdle(std::prev(idle.end()));
+    }
+}
+
+void StateVecPool::FreeIdle(std::multimap<size_t, void*>::iterator it)
+{
+    idleBytes -= it->first;
+    capacities.erase(it->second);
+    AlignedFree(it->second);
+    idle.erase(it);
+}
+
+void* StateVecPool::Acquire(size_t bytes)
+{
+    if (bytes < QRACK_ALIGN_SIZE) {
+        bytes = QRACK_ALIGN_SIZE;
+    }
+
+    // (Reserve before locking, since the reservation might wait for other threads to release buffers.)
+    MemoryGovernor& governor = MemoryGovernor::Instance();
+    governor.Reserve(QRACK_HOST_MEMORY, bytes);
+
+    std::lock_guard<std::mutex> lock(mtx);
+
+    auto it = idle.lower_bound(bytes);
+    if ((it != idle.end()) && (it->first <= (bytes << QRACK_SV_POOL_SLACK))) {
+        void* toRet = it->second;
+        // The budget counts the whole reused buffer.
+        governor.ForceReserve(QRACK_HOST_MEMORY, it->first - bytes);
+        idleBytes -= it->first;
+        idle.erase(it);
+        ++hitCount;
+        return toRet;
+    }
+
+    ++missCount;
+    void* toRet = AlignedAlloc(bytes);
+    if (!toRet && idle.size()) {
+        // Idle buffers might be what's in the way.
+        while (idle.size()) {
+            FreeIdle(idle.begin());
+        }
+        toRet = AlignedAlloc(bytes);
+    }
+    if (!toRet) {
+        governor.Release(QRACK_HOST_MEMORY, bytes);
+        throw std::bad_alloc();
+    }
+    capacities[toRet] = bytes;
+
+    return toRet;
+}
+
+void StateVecPool::Release(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+
+    auto it = capacities.find(ptr);
+    if (it == capacities.end()) {
+        AlignedFree(ptr);
+        return;
+    }
+
+    const size_t bytes = it->second;
+    MemoryGovernor& governor = MemoryGovernor::Instance();
+    governor.Release(QRACK_HOST_MEMORY, bytes);
+
+    const bool isPressured = governor.IsUnderPressure(QRACK_HOST_MEMORY);
+    if (isPressured) {
+        // (Under memory pressure, idle buffers only hold RAM that the budget doesn't count.)
+        while (idle.size()) {
+            FreeIdle(idle.begin());
+        }
+    }
+
+    if ((bytes > maxIdleBytes) || isPressured) {
+        capacities.erase(it);
+        AlignedFree(ptr);
+        return;
+    }
+
+    EvictIdle(bytes);
+    idle.emplace(bytes, ptr);
+    idleBytes += bytes;
+}
+
+void StateVecPool::Clear()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    while (idle.size()) {
+        FreeIdle(idle.begin());
+    }
+}
+
+void StateVecPool::SetMaxIdleBytes(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    maxIdleBytes = bytes;
+    EvictIdle(0U);
+}
+
+size_t StateVecPool::GetIdleBytes()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return idleBytes;
+}
+} // namespace Qrack
@@ -10,34 +10,38 @@
 
 // "qfactory.hpp" pulls in all headers needed to create any type of "Qrack::QInterface."
 #include "qfactory.hpp"
+#include "qbatch.hpp"
+#include "qstabilizer_frames.hpp"
+#include "qtape.hpp"
+
+#if ENABLE_OPENCL
+#include "qbatch_opencl.hpp"
+#endif
 
 #if !(FPPOW < 6 && !ENABLE_COMPLEX_X2)
 #include "hamiltonian.hpp"
 #endif
 
+#if ENABLE_PTHREAD && ENABLE_QUNIT_CPU_PARALLEL
+#include "common/dispatchqueue.hpp"
+#include "common/parallel_pool.hpp"
+
+#include <condition_variable>
+#endif
+
+#include <atomic>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <mutex>
 #include <vector>
 
-#define META_LOCK_GUARD()                                                                                              \
-    const std::lock_guard<std::mutex> metaLock(metaOperationMutex);                                                    \
-    std::map<QInterface*, std::mutex>::iterator mutexLockIt;                                                           \
-    std::vector<std::unique_ptr<const std::lock_guard<std::mutex>>> simulatorLocks;                                    \
-    for (mutexLockIt = simulatorMutexes.begin(); mutexLockIt != simulatorMutexes.end(); ++mutexLockIt) {               \
-        simulatorLocks.push_back(std::unique_ptr<const std::lock_guard<std::mutex>>(                                   \
-            new const std::lock_guard<std::mutex>(mutexLockIt->second)));                                              \
-    }
-
-// SIMULATOR_LOCK_GUARD variants will lock simulatorMutexes[NULL], if the requested simulator doesn't exist.
-// This is CORRECT behavior. This will effectively emplace a mutex for NULL key.
+// Each simulator ID has its own mutex. Looking up an ID never takes a global lock, so gates, init, and destroy on
+// one simulator ID never wait on unrelated simulator IDs. (Blocking calls also wait for the ID's queued asynchronous
+// calls, first, so that calls on one ID always run in the order they were made.)
 #define SIMULATOR_LOCK_GUARD(sid)                                                                                      \
-    std::unique_ptr<const std::lock_guard<std::mutex>> simulatorLock;                                                  \
-    if (true) {                                                                                                        \
-        const std::lock_guard<std::mutex> metaLock(metaOperationMutex);                                                \
-        simulatorLock = std::unique_ptr<const std::lock_guard<std::mutex>>(                                            \
-            new const std::lock_guard<std::mutex>(simulatorMutexes[simulators[sid].get()]));                           \
-    }
+    AwaitAsync(sid);                                                                                                   \
+    const std::lock_guard<std::mutex> simulatorLock(simulatorMutexes[sid]);
 
 #define SIMULATOR_LOCK_GUARD_DOUBLE(sid)                                                                               \
     SIMULATOR_LOCK_GUARD(sid)                                                                                          \
@@ -57,20 +61,308 @@
         return 0U;                                                                                                     \
     }
 
-#define QALU(qReg) std::dynamic_pointer_cast<QAlu>(qReg)
+#define BATCH_LOCK_GUARD(bid)                                                                                          \
+    const std::lock_guard<std::mutex> batchLock(batchMutexes[bid]);                                                    \
+    if (!batchSimulators[bid]) {                                                                                       \
+        return;                                                                                                        \
+    }
+
+#define FRAMES_LOCK_GUARD(fid)                                                                                         \
+    const std::lock_guard<std::mutex> framesLock(framesMutexes[fid]);                                                  \
+    if (!framesSimulators[fid]) {                                                                                      \
+        return;                                                                                                        \
+    }
+
+#define QALU(qReg) AsAlu(qReg)
 #define QPARITY(qReg) std::dynamic_pointer_cast<QParity>(qReg)
 
 using namespace Qrack;
 
+// Not every simulator type is a QAlu, (such as QPrefixCache,) so the arithmetic calls fail with an error, instead.
+static QAluPtr AsAlu(QInterfacePtr qReg)
+{
+    QAluPtr alu = std::dynamic_pointer_cast<QAlu>(qReg);
+    if (!alu) {
+        throw std::domain_error("This simulator type does not support arithmetic!");
+    }
+
+    return alu;
+}
+
+/**
+ * Registry storage indexed by (simulator, batch, or frames) ID
+ *
+ * Slots live in fixed-size chunks that are published once, with release ordering, and are never moved or freed while
+ * the library is loaded, so a reference to a slot stays valid as the table grows and an ID lookup is just an acquire
+ * load. Only growth must be serialized, (under "metaOperationMutex"); the contents of each slot are guarded by that
+ * ID's own mutex.
+ */
+template <typename T> class SlotTable {
+protected:
+    static constexpr size_t chunkPow = 6U;
+    static constexpr size_t chunkSize = (size_t)1U << chunkPow;
+    static constexpr size_t maxChunks = (size_t)1U << 12U;
+
+    std::atomic<T*> chunks[maxChunks];
+    std::atomic<size_t> count;
+
+public:
+    SlotTable()
+        : count(0U)
+    {
+        for (size_t i = 0U; i < maxChunks; ++i) {
+            chunks[i].store(NULL, std::memory_order_relaxed);
+        }
+    }
+
+    ~SlotTable()
+    {
+        for (size_t i = 0U; i < maxChunks; ++i) {
+            delete[] chunks[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    T& operator[](size_t i) { return chunks[i >> chunkPow].load(std::memory_order_acquire)[i & (chunkSize - 1U)]; }
+
+    size_t size() const { return count.load(std::memory_order_acquire); }
+
+    // Append one value-initialized slot. Callers must hold "metaOperationMutex."
+    void grow()
+    {
+        const size_t n = count.load(std::memory_order_relaxed);
+        if (!(n & (chunkSize - 1U))) {
+            if ((n >> chunkPow) >= maxChunks) {
+                throw std::runtime_error("SlotTable::grow() exceeded maximum ID count!");
+            }
+            chunks[n >> chunkPow].store(new T[chunkSize](), std::memory_order_release);
+        }
+        count.store(n + 1U, std::memory_order_release);
+    }
+};
+
 qrack_rand_gen_ptr randNumGen = std::make_shared<qrack_rand_gen>(time(0));
+// Guards only ID reservation and table growth; it is never held while a simulator is built, used, or freed.
 std::mutex metaOperationMutex;
-std::vector<int> simulatorErrors;
-std::vector<QInterfacePtr> simulators;
-std::vector<std::vector<QInterfaceEngine>> simulatorTypes;
-std::vector<bool> simulatorHostPointer;
-std::map<QInterface*, std::mutex> simulatorMutexes;
-std::vector<bool> simulatorReservations;
-std::map<QInterface*, std::map<uintq, bitLenInt>> shards;
+SlotTable<int> simulatorErrors;
+SlotTable<QInterfacePtr> simulators;
+SlotTable<std::vector<QInterfaceEngine>> simulatorTypes;
+SlotTable<bool> simulatorHostPointer;
+SlotTable<std::mutex> simulatorMutexes;
+SlotTable<bool> simulatorReservations;
+SlotTable<std::map<uintq, bitLenInt>> shards;
+SlotTable<QBatchPtr> batchSimulators;
+SlotTable<int> batchErrors;
+SlotTable<std::mutex> batchMutexes;
+SlotTable<bool> batchReservations;
+SlotTable<QStabilizerFramesPtr> framesSimulators;
+SlotTable<int> framesErrors;
+SlotTable<std::mutex> framesMutexes;
+SlotTable<bool> framesReservations;
+
+#if ENABLE_PTHREAD && ENABLE_QUNIT_CPU_PARALLEL
+// Each simulator ID's asynchronous calls run in order on its own DispatchQueue, which the shared worker pool drains, so
+// the queues of many simulator IDs overlap on a bounded set of threads, without a thread per ID.
+SlotTable<std::shared_ptr<DispatchQueue>> simulatorQueues;
+// Set while a pool worker runs an asynchronous call, (including its completion callback,) on "asyncWorkerSid"
+static thread_local bool isAsyncWorker = false;
+static thread_local uintq asyncWorkerSid = 0U;
+
+struct AsyncTicket {
+    bool isDone;
+    double result;
+
+    AsyncTicket()
+        : isDone(false)
+        , result(0.0)
+    {
+    }
+};
+
+// Guards only the ticket table, (never held while a simulator runs)
+std::mutex asyncMutex;
+std::condition_variable asyncCv;
+std::map<uintq, AsyncTicket> asyncTickets;
+uintq asyncTicketCount = 0U;
+
+// Wait for every queued asynchronous call on "sid." A completion callback doesn't wait for its own simulator ID, (since
+// it runs on that queue,) but it does wait for any other.
+void AwaitAsync(uintq sid)
+{
+    if (isAsyncWorker && (asyncWorkerSid == sid)) {
+        return;
+    }
+
+    std::shared_ptr<DispatchQueue> queue = std::atomic_load(&simulatorQueues[sid]);
+    if (queue) {
+        queue->finish();
+    }
+}
+
+void CompleteAsync(uintq ticket, double result, AsyncCallback callback)
+{
+    if (callback) {
+        // Tickets with callbacks are released once they're delivered.
+        callback(ticket, result);
+        const std::lock_guard<std::mutex> asyncLock(asyncMutex);
+        asyncTickets.erase(ticket);
+    } else {
+        const std::lock_guard<std::mutex> asyncLock(asyncMutex);
+        AsyncTicket& t = asyncTickets[ticket];
+        t.isDone = true;
+        t.result = result;
+    }
+    asyncCv.notify_all();
+}
+
+/**
+ * Queue "fn" to run on the simulator of "sid," under its lock, after every call queued before it, and return its
+ * ticket. "fn" maps its own qubit IDs when it runs, (which is safe, since every call that changes the ID map waits for
+ * the queue, first). An exception from "fn" sets the simulator's error flag, and the result is REAL1_DEFAULT_ARG.
+ */
+uintq EnqueueAsync(uintq sid, AsyncCallback callback, std::function<double(QInterfacePtr)> fn)
+{
+    uintq ticket;
+    if (true) {
+        const std::lock_guard<std::mutex> asyncLock(asyncMutex);
+        ticket = ++asyncTicketCount;
+        asyncTickets[ticket] = AsyncTicket();
+    }
+
+    std::shared_ptr<DispatchQueue> queue;
+    if (true) {
+        const std::lock_guard<std::mutex> simulatorLock(simulatorMutexes[sid]);
+        queue = std::atomic_load(&simulatorQueues[sid]);
+        if (!queue) {
+            queue = std::make_shared<DispatchQueue>();
+            std::atomic_store(&simulatorQueues[sid], queue);
+        }
+    }
+
+    queue->dispatch([sid, ticket, callback, fn] {
+        // (A callback's blocking call on another simulator ID can drain that ID's queue on this same thread.)
+        const bool wasAsyncWorker = isAsyncWorker;
+        const uintq lastAsyncWorkerSid = asyncWorkerSid;
+        isAsyncWorker = true;
+        asyncWorkerSid = sid;
+        double result = 0.0;
+        if (true) {
+            const std::lock_guard<std::mutex> simulatorLock(simulatorMutexes[sid]);
+            QInterfacePtr simulator = simulators[sid];
+            if (simulator) {
+                try {
+                    result = fn(simulator);
+                } catch (...) {
+                    simulatorErrors[sid] = 1;
+                    result = (double)REAL1_DEFAULT_ARG;
+                }
+            }
+        }
+        CompleteAsync(ticket, result, callback);
+        isAsyncWorker = wasAsyncWorker;
+        asyncWorkerSid = lastAsyncWorkerSid;
+    });
+
+    return ticket;
+}
+#else
+void AwaitAsync(uintq sid)
+{
+    // Without the worker pool, every call is blocking, so there's never anything to wait for.
+}
+#endif
+
+uintq ReserveSimulatorId()
+{
+    const std::lock_guard<std::mutex> metaLock(metaOperationMutex);
+
+    const uintq count = (uintq)simulators.size();
+    for (uintq i = 0U; i < count; ++i) {
+        if (!simulatorReservations[i]) {
+            simulatorReservations[i] = true;
+            return i;
+        }
+    }
+
+    // "simulators" grows last, since its size is what other threads read as the ID count.
+    simulatorErrors.grow();
+    simulatorTypes.grow();
+    simulatorHostPointer.grow();
+    simulatorMutexes.grow();
+    simulatorReservations.grow();
+    shards.grow();
+#if ENABLE_PTHREAD && ENABLE_QUNIT_CPU_PARALLEL
+    simulatorQueues.grow();
+#endif
+    simulators.grow();
+    simulatorReservations[count] = true;
+
+    return count;
+}
+
+uintq ReserveBatchId()
+{
+    const std::lock_guard<std::mutex> metaLock(metaOperationMutex);
+
+    const uintq count = (uintq)batchSimulators.size();
+    for (uintq i = 0U; i < count; ++i) {
+        if (!batchReservations[i]) {
+            batchReservations[i] = true;
+            return i;
+        }
+    }
+
+    batchErrors.grow();
+    batchMutexes.grow();
+    batchReservations.grow();
+    batchSimulators.grow();
+    batchReservations[count] = true;
+
+    return count;
+}
+
+uintq ReserveFramesId()
+{
+    const std::lock_guard<std::mutex> metaLock(metaOperationMutex);
+
+    const uintq count = (uintq)framesSimulators.size();
+    for (uintq i = 0U; i < count; ++i) {
+        if (!framesReservations[i]) {
+            framesReservations[i] = true;
+            return i;
+        }
+    }
+
+    framesErrors.grow();
+    framesMutexes.grow();
+    framesReservations.grow();
+    framesSimulators.grow();
+    framesReservations[count] = true;
+
+    return count;
+}
+
+// Fill a freshly reserved simulator ID. (Nothing else holds "sid" yet, but we lock it so that the writes are published
+// to whichever thread next takes its mutex.)
+void AttachSimulator(uintq sid, QInterfacePtr simulator, const std::vector<QInterfaceEngine>& simulatorType, bool hp,
+    bool isSuccess, uintq q)
+{
+    const std::lock_guard<std::mutex> simulatorLock(simulatorMutexes[sid]);
+
+    simulators[sid] = simulator;
+    simulatorTypes[sid] = simulatorType;
+    simulatorHostPointer[sid] = hp;
+    simulatorErrors[sid] = isSuccess ? 0 : 1;
+    shards[sid] = {};
+
+    if (!simulator) {
+        return;
+    }
+
+    for (uintq i = 0U; i < q; ++i) {
+        shards[sid][i] = (bitLenInt)i;
+    }
+}
+
 bitLenInt _maxShardQubits = 0U;
 bitLenInt MaxShardQubits()
 {
@@ -86,16 +378,17 @@ bitLenInt MaxShardQubits()
     return _maxShardQubits;
 }
 
-void TransformPauliBasis(QInterfacePtr simulator, uintq len, int* bases, uintq* qubitIds)
+void TransformPauliBasis(uintq sid, uintq len, int* bases, uintq* qubitIds)
 {
+    QInterfacePtr simulator = simulators[sid];
     for (uintq i = 0U; i < len; ++i) {
         switch (bases[i]) {
         case PauliX:
-            simulator->H(shards[simulator.get()][qubitIds[i]]);
+            simulator->H(shards[sid][qubitIds[i]]);
             break;
         case PauliY:
-            simulator->IS(shards[simulator.get()][qubitIds[i]]);
-            simulator->H(shards[simulator.get()][qubitIds[i]]);
+            simulator->IS(shards[sid][qubitIds[i]]);
+            simulator->H(shards[sid][qubitIds[i]]);
             break;
         case PauliZ:
         case PauliI:
@@ -105,16 +398,17 @@ void TransformPauliBasis(QInterfacePtr simulator, uintq len, int* bases, uintq*
     }
 }
 
-void RevertPauliBasis(QInterfacePtr simulator, uintq len, int* bases, uintq* qubitIds)
+void RevertPauliBasis(uintq sid, uintq len, int* bases, uintq* qubitIds)
 {
+    QInterfacePtr simulator = simulators[sid];
     for (uintq i = 0U; i < len; ++i) {
         switch (bases[i]) {
         case PauliX:
-            simulator->H(shards[simulator.get()][qubitIds[i]]);
+            simulator->H(shards[sid][qubitIds[i]]);
             break;
         case PauliY:
-            simulator->H(shards[simulator.get()][qubitIds[i]]);
-            simulator->S(shards[simulator.get()][qubitIds[i]]);
+            simulator->H(shards[sid][qubitIds[i]]);
+            simulator->S(shards[sid][qubitIds[i]]);
             break;
         case PauliZ:
         case PauliI:
@@ -147,17 +441,17 @@ void RHelper(uintq sid, uintq b, double phi, uintq q)
         // However, the underlying QInterface will not execute the gate
         // UNLESS it is specifically "keeping book" for non-measurable phase effects.
         complex phaseFac = exp(complex(ZERO_R1, (real1)(phi / 4)));
-        simulator->Phase(phaseFac, phaseFac, shards[simulator.get()][q]);
+        simulator->Phase(phaseFac, phaseFac, shards[sid][q]);
         break;
     }
     case PauliX:
-        simulator->RX((real1_f)phi, shards[simulator.get()][q]);
+        simulator->RX((real1_f)phi, shards[sid][q]);
         break;
     case PauliY:
-        simulator->RY((real1_f)phi, shards[simulator.get()][q]);
+        simulator->RY((real1_f)phi, shards[sid][q]);
         break;
     case PauliZ:
-        simulator->RZ((real1_f)phi, shards[simulator.get()][q]);
+        simulator->RZ((real1_f)phi, shards[sid][q]);
         break;
     default:
         break;
@@ -169,12 +463,12 @@ void MCRHelper(uintq sid, uintq b, double phi, uintq n, uintq* c, uintq q)
     QInterfacePtr simulator = simulators[sid];
     std::vector<bitLenInt> ctrlsArray(n);
     for (uintq i = 0U; i < n; ++i) {
-        ctrlsArray[i] = shards[simulator.get()][c[i]];
+        ctrlsArray[i] = shards[sid][c[i]];
     }
 
     if (b == PauliI) {
         complex phaseFac = exp(complex(ZERO_R1, (real1)(phi / 4)));
-        simulator->MCPhase(ctrlsArray, phaseFac, phaseFac, shards[simulator.get()][q]);
+        simulator->MCPhase(ctrlsArray, phaseFac, phaseFac, shards[sid][q]);
         return;
     }
 
@@ -188,17 +482,17 @@ void MCRHelper(uintq sid, uintq b, double phi, uintq n, uintq* c, uintq q)
         pauliR[1U] = complex(ZERO_R1, -sine);
         pauliR[2U] = complex(ZERO_R1, -sine);
         pauliR[3U] = complex(cosine, ZERO_R1);
-        simulator->MCMtrx(ctrlsArray, pauliR, shards[simulator.get()][q]);
+        simulator->MCMtrx(ctrlsArray, pauliR, shards[sid][q]);
         break;
     case PauliY:
         pauliR[0U] = complex(cosine, ZERO_R1);
         pauliR[1U] = complex(-sine, ZERO_R1);
         pauliR[2U] = complex(sine, ZERO_R1);
         pauliR[3U] = complex(cosine, ZERO_R1);
-        simulator->MCMtrx(ctrlsArray, pauliR, shards[simulator.get()][q]);
+        simulator->MCMtrx(ctrlsArray, pauliR, shards[sid][q]);
         break;
     case PauliZ:
-        simulator->MCPhase(ctrlsArray, complex(cosine, -sine), complex(cosine, sine), shards[simulator.get()][q]);
+        simulator->MCPhase(ctrlsArray, complex(cosine, -sine), complex(cosine, sine), shards[sid][q]);
         break;
     case PauliI:
     default:
@@ -233,19 +527,20 @@ void SwapShardValues(bitLenInt v1, bitLenInt v2, std::map<uintq, bitLenInt>& sim
     std::swap(it1->second, it2->second);
 }
 
-uintq MapArithmetic(QInterfacePtr simulator, uintq n, uintq* q)
+uintq MapArithmetic(uintq sid, uintq n, uintq* q)
 {
-    uintq start = shards[simulator.get()][q[0U]];
+    QInterfacePtr simulator = simulators[sid];
+    uintq start = shards[sid][q[0U]];
     std::unique_ptr<bitLenInt[]> bitArray(new bitLenInt[n]);
     for (uintq i = 0U; i < n; ++i) {
-        bitArray[i] = shards[simulator.get()][q[i]];
+        bitArray[i] = shards[sid][q[i]];
         if (start > bitArray[i]) {
             start = bitArray[i];
         }
     }
     for (uintq i = 0U; i < n; ++i) {
         simulator->Swap(start + i, bitArray[i]);
-        SwapShardValues(start + i, bitArray[i], shards[simulator.get()]);
+        SwapShardValues(start + i, bitArray[i], shards[sid]);
     }
 
     return start;
@@ -262,19 +557,20 @@ struct MapArithmeticResult2 {
     }
 };
 
-MapArithmeticResult2 MapArithmetic2(QInterfacePtr simulator, uintq n, uintq* q1, uintq* q2)
+MapArithmeticResult2 MapArithmetic2(uintq sid, uintq n, uintq* q1, uintq* q2)
 {
-    uintq start1 = shards[simulator.get()][q1[0U]];
-    uintq start2 = shards[simulator.get()][q2[0U]];
+    QInterfacePtr simulator = simulators[sid];
+    uintq start1 = shards[sid][q1[0U]];
+    uintq start2 = shards[sid][q2[0U]];
     std::unique_ptr<bitLenInt[]> bitArray1(new bitLenInt[n]);
     std::unique_ptr<bitLenInt[]> bitArray2(new bitLenInt[n]);
     for (uintq i = 0U; i < n; ++i) {
-        bitArray1[i] = shards[simulator.get()][q1[i]];
+        bitArray1[i] = shards[sid][q1[i]];
         if (start1 > bitArray1[i]) {
             start1 = bitArray1[i];
         }
 
-        bitArray2[i] = shards[simulator.get()][q2[i]];
+        bitArray2[i] = shards[sid][q2[i]];
         if (start2 > bitArray2[i]) {
             start2 = bitArray2[i];
         }
@@ -289,7 +585,7 @@ MapArithmeticResult2 MapArithmetic2(QInterfacePtr simulator, uintq n, uintq* q1,
 
     for (uintq i = 0U; i < n; ++i) {
         simulator->Swap(start1 + i, bitArray1[i]);
-        SwapShardValues(start1 + i, bitArray1[i], shards[simulator.get()]);
+        SwapShardValues(start1 + i, bitArray1[i], shards[sid]);
     }
 
     if ((start1 + n) > start2) {
@@ -298,7 +594,7 @@ MapArithmeticResult2 MapArithmetic2(QInterfacePtr simulator, uintq n, uintq* q1,
 
     for (uintq i = 0U; i < n; ++i) {
         simulator->Swap(start2 + i, bitArray2[i]);
-        SwapShardValues(start2 + i, bitArray2[i], shards[simulator.get()]);
+        SwapShardValues(start2 + i, bitArray2[i], shards[sid]);
     }
 
     if (isReversed) {
@@ -308,21 +604,22 @@ MapArithmeticResult2 MapArithmetic2(QInterfacePtr simulator, uintq n, uintq* q1,
     return MapArithmeticResult2(start1, start2);
 }
 
-MapArithmeticResult2 MapArithmetic3(QInterfacePtr simulator, uintq n1, uintq* q1, uintq n2, uintq* q2)
+MapArithmeticResult2 MapArithmetic3(uintq sid, uintq n1, uintq* q1, uintq n2, uintq* q2)
 {
-    uintq start1 = shards[simulator.get()][q1[0U]];
-    uintq start2 = shards[simulator.get()][q2[0U]];
+    QInterfacePtr simulator = simulators[sid];
+    uintq start1 = shards[sid][q1[0U]];
+    uintq start2 = shards[sid][q2[0U]];
     std::unique_ptr<bitLenInt[]> bitArray1(new bitLenInt[n1]);
     std::unique_ptr<bitLenInt[]> bitArray2(new bitLenInt[n2]);
     for (uintq i = 0U; i < n1; ++i) {
-        bitArray1[i] = shards[simulator.get()][q1[i]];
+        bitArray1[i] = shards[sid][q1[i]];
         if (start1 > bitArray1[i]) {
             start1 = bitArray1[i];
         }
     }
 
     for (uintq i = 0U; i < n2; ++i) {
-        bitArray2[i] = shards[simulator.get()][q2[i]];
+        bitArray2[i] = shards[sid][q2[i]];
         if (start2 > bitArray2[i]) {
             start2 = bitArray2[i];
         }
@@ -338,7 +635,7 @@ MapArithmeticResult2 MapArithmetic3(QInterfacePtr simulator, uintq n1, uintq* q1
 
     for (uintq i = 0U; i < n1; ++i) {
         simulator->Swap(start1 + i, bitArray1[i]);
-        SwapShardValues(start1 + i, bitArray1[i], shards[simulator.get()]);
+        SwapShardValues(start1 + i, bitArray1[i], shards[sid]);
     }
 
     if ((start1 + n1) > start2) {
@@ -347,7 +644,7 @@ MapArithmeticResult2 MapArithmetic3(QInterfacePtr simulator, uintq n1, uintq* q1
 
     for (uintq i = 0U; i < n2; ++i) {
         simulator->Swap(start2 + i, bitArray2[i]);
-        SwapShardValues(start2 + i, bitArray2[i], shards[simulator.get()]);
+        SwapShardValues(start2 + i, bitArray2[i], shards[sid]);
     }
 
     if (isReversed) {
@@ -395,17 +692,7 @@ MICROSOFT_QUANTUM_DECL int get_error(_In_ uintq sid) { return simulatorErrors[si
 MICROSOFT_QUANTUM_DECL uintq init_count_type(_In_ uintq q, _In_ bool md, _In_ bool sd, _In_ bool sh, _In_ bool bdt,
     _In_ bool pg, _In_ bool zxf, _In_ bool hy, _In_ bool oc, _In_ bool hp)
 {
-    META_LOCK_GUARD()
-
-    uintq sid = (uintq)simulators.size();
-
-    for (uintq i = 0U; i < simulators.size(); ++i) {
-        if (simulatorReservations[i] == false) {
-            sid = i;
-            simulatorReservations[i] = true;
-            break;
-        }
-    }
+    const uintq sid = ReserveSimulatorId();
 
 #if ENABLE_OPENCL
     bool isOcl = oc && (OCLEngine::Instance().GetDeviceCount() > 0);
@@ -464,28 +751,7 @@ MICROSOFT_QUANTUM_DECL uintq init_count_type(_In_ uintq q, _In_ bool md, _In_ bo
         }
     }
 
-    if (sid == simulators.size()) {
-        simulatorReservations.push_back(true);
-        simulators.push_back(simulator);
-        simulatorTypes.push_back(simulatorType);
-        simulatorHostPointer.push_back(hp);
-        simulatorErrors.push_back(isSuccess ? 0 : 1);
-    } else {
-        simulatorReservations[sid] = true;
-        simulators[sid] = simulator;
-        simulatorTypes[sid] = simulatorType;
-        simulatorHostPointer[sid] = hp;
-        simulatorErrors[sid] = isSuccess ? 0 : 1;
-    }
-
-    if (!q) {
-        return sid;
-    }
-
-    shards[simulator.get()] = {};
-    for (uintq i = 0U; i < q; ++i) {
-        shards[simulator.get()][i] = (bitLenInt)i;
-    }
+    AttachSimulator(sid, simulator, simulatorType, hp, isSuccess, q);
 
     return sid;
 }
@@ -495,17 +761,7 @@ MICROSOFT_QUANTUM_DECL uintq init_count_type(_In_ uintq q, _In_ bool md, _In_ bo
  */
 MICROSOFT_QUANTUM_DECL uintq init_count(_In_ uintq q, _In_ bool hp)
 {
-    META_LOCK_GUARD()
-
-    uintq sid = (uintq)simulators.size();
-
-    for (uintq i = 0U; i < simulators.size(); ++i) {
-        if (simulatorReservations[i] == false) {
-            sid = i;
-            simulatorReservations[i] = true;
-            break;
-        }
-    }
+    const uintq sid = ReserveSimulatorId();
 
     std::vector<QInterfaceEngine> simulatorType;
 
@@ -526,28 +782,7 @@ MICROSOFT_QUANTUM_DECL uintq init_count(_In_ uintq q, _In_ bool hp)
         }
     }
 
-    if (sid == simulators.size()) {
-        simulatorReservations.push_back(true);
-        simulators.push_back(simulator);
-        simulatorTypes.push_back(simulatorType);
-        simulatorHostPointer.push_back(hp);
-        simulatorErrors.push_back(isSuccess ? 0 : 1);
-    } else {
-        simulatorReservations[sid] = true;
-        simulators[sid] = simulator;
-        simulatorTypes[sid] = simulatorType;
-        simulatorHostPointer[sid] = hp;
-        simulatorErrors[sid] = isSuccess ? 0 : 1;
-    }
-
-    if (!q) {
-        return sid;
-    }
-
-    shards[simulator.get()] = {};
-    for (uintq i = 0U; i < q; ++i) {
-        shards[simulator.get()][i] = (bitLenInt)i;
-    }
+    AttachSimulator(sid, simulator, simulatorType, hp, isSuccess, q);
 
     return sid;
 }
@@ -557,17 +792,7 @@ MICROSOFT_QUANTUM_DECL uintq init_count(_In_ uintq q, _In_ bool hp)
  */
 MICROSOFT_QUANTUM_DECL uintq init_count_pager(_In_ uintq q, _In_ bool hp)
 {
-    META_LOCK_GUARD()
-
-    uintq sid = (uintq)simulators.size();
-
-    for (uintq i = 0U; i < simulators.size(); ++i) {
-        if (simulatorReservations[i] == false) {
-            sid = i;
-            simulatorReservations[i] = true;
-            break;
-        }
-    }
+    const uintq sid = ReserveSimulatorId();
 
     std::vector<QInterfaceEngine> simulatorType;
 
@@ -594,28 +819,7 @@ MICROSOFT_QUANTUM_DECL uintq init_count_pager(_In_ uintq q, _In_ bool hp)
         }
     }
 
-    if (sid == simulators.size()) {
-        simulatorReservations.push_back(true);
-        simulators.push_back(simulator);
-        simulatorTypes.push_back(simulatorType);
-        simulatorHostPointer.push_back(hp);
-        simulatorErrors.push_back(isSuccess ? 0 : 1);
-    } else {
-        simulatorReservations[sid] = true;
-        simulators[sid] = simulator;
-        simulatorTypes[sid] = simulatorType;
-        simulatorHostPointer[sid] = hp;
-        simulatorErrors[sid] = isSuccess ? 0 : 1;
-    }
-
-    if (!q) {
-        return sid;
-    }
-
-    shards[simulator.get()] = {};
-    for (uintq i = 0U; i < q; ++i) {
-        shards[simulator.get()][i] = (bitLenInt)i;
-    }
+    AttachSimulator(sid, simulator, simulatorType, hp, isSuccess, q);
 
     return sid;
 }
@@ -625,45 +829,33 @@ MICROSOFT_QUANTUM_DECL uintq init_count_pager(_In_ uintq q, _In_ bool hp)
  */
 MICROSOFT_QUANTUM_DECL uintq init_clone(_In_ uintq sid)
 {
-    META_LOCK_GUARD()
-
-    uintq nsid = (uintq)simulators.size();
-
-    for (uintq i = 0U; i < simulators.size(); ++i) {
-        if (simulatorReservations[i] == false) {
-            nsid = i;
-            simulatorReservations[i] = true;
-            break;
-        }
-    }
+    const uintq nsid = ReserveSimulatorId();
 
     bool isSuccess = true;
     QInterfacePtr simulator;
-    try {
-        simulator = simulators[sid]->Clone();
-    } catch (...) {
-        isSuccess = false;
-    }
+    std::vector<QInterfaceEngine> simulatorType;
+    bool hp = false;
+    std::map<uintq, bitLenInt> simulatorShards;
+    if (true) {
+        SIMULATOR_LOCK_GUARD(sid)
 
-    if (nsid == simulators.size()) {
-        simulatorReservations.push_back(true);
-        simulators.push_back(simulator);
-        simulatorTypes.push_back(simulatorTypes[sid]);
-        simulatorHostPointer.push_back(simulatorHostPointer[sid]);
-        simulatorErrors.push_back(isSuccess ? 0 : 1);
-        shards[simulator.get()] = {};
-    } else {
-        simulatorReservations[nsid] = true;
-        simulators[nsid] = simulator;
-        simulatorTypes[nsid] = simulatorTypes[sid];
-        simulatorHostPointer[nsid] = simulatorHostPointer[sid];
-        simulatorErrors[nsid] = isSuccess ? 0 : 1;
+        try {
+            simulator = simulators[sid]->Clone();
+        } catch (...) {
+            isSuccess = false;
+        }
+        simulatorType = simulatorTypes[sid];
+        hp = simulatorHostPointer[sid];
+        simulatorShards = shards[sid];
     }
 
-    shards[simulator.get()] = {};
-    for (uintq i = 0U; i < simulator->GetQubitCount(); ++i) {
-        shards[simulator.get()][i] = shards[simulators[sid].get()][i];
-    }
+    const std::lock_guard<std::mutex> simulatorLock(simulatorMutexes[nsid]);
+
+    simulators[nsid] = simulator;
+    simulatorTypes[nsid] = simulatorType;
+    simulatorHostPointer[nsid] = hp;
+    simulatorErrors[nsid] = isSuccess ? 0 : 1;
+    shards[nsid] = simulatorShards;
 
     return nsid;
 }
@@ -673,12 +865,32 @@ MICROSOFT_QUANTUM_DECL uintq init_clone(_In_ uintq sid)
  */
 MICROSOFT_QUANTUM_DECL void destroy(_In_ uintq sid)
 {
-    META_LOCK_GUARD()
+    // Take the simulator out under its own lock, but free it (which might be slow) after the lock is released.
+    QInterfacePtr simulator;
+#if ENABLE_PTHREAD && ENABLE_QUNIT_CPU_PARALLEL
+    std::shared_ptr<DispatchQueue> queue;
+#endif
+    if (true) {
+        SIMULATOR_LOCK_GUARD(sid)
+
+        simulator.swap(simulators[sid]);
+        shards[sid] = {};
+        simulatorErrors[sid] = 0;
+#if ENABLE_PTHREAD && ENABLE_QUNIT_CPU_PARALLEL
+        queue = std::atomic_exchange(&simulatorQueues[sid], std::shared_ptr<DispatchQueue>());
+#endif
+    }
+    simulator = NULL;
+#if ENABLE_PTHREAD && ENABLE_QUNIT_CPU_PARALLEL
+    if (queue && isAsyncWorker) {
+        // A completion callback is destroying a simulator, maybe its own, and the queue can't be freed until the
+        // callback returns, so the pool frees it later.
+        ParallelPool::Instance().Post([queue] {});
+    }
+    queue = NULL;
+#endif
 
-    shards.erase(simulators[sid].get());
-    simulatorMutexes.erase(simulators[sid].get());
-    simulators[sid] = NULL;
-    simulatorErrors[sid] = 0;
+    const std::lock_guard<std::mutex> metaLock(metaOperationMutex);
     simulatorReservations[sid] = false;
 }
 
@@ -722,56 +934,636 @@ MICROSOFT_QUANTUM_DECL void DumpIds(_In_ uintq sid, _In_ IdCallback callback)
     QInterfacePtr simulator = simulators[sid];
 
     std::map<uintq, bitLenInt>::iterator it;
-    for (it = shards[simulator.get()].begin(); it != shards[simulator.get()].end(); ++it) {
+    for (it = shards[sid].begin(); it != shards[sid].end(); ++it) {
         callback(it->first);
     }
 }
 
 /**
- * (External API) "Dump" state vector from the selected simulator ID into the callback
+ * (External API) "Dump" state vector from the selected simulator ID into the callback
+ */
+MICROSOFT_QUANTUM_DECL void Dump(_In_ uintq sid, _In_ ProbAmpCallback callback)
+{
+    SIMULATOR_LOCK_GUARD(sid)
+
+    QInterfacePtr simulator = simulators[sid];
+    bitCapIntOcl wfnl = (bitCapIntOcl)simulator->GetMaxQPower();
+
+    for (size_t i = 0U; i < wfnl; ++i) {
+        complex amp;
+        try {
+            amp = simulator->GetAmplitude(i);
+        } catch (...) {
+            simulatorErrors[sid] = 1;
+            break;
+        }
+
+        if (!callback(i, (double)real(amp), (double)imag(amp))) {
+            break;
+        }
+    }
+}
+
+/**
+ * (External API) Set state vector for the selected simulator ID.
+ */
+MICROSOFT_QUANTUM_DECL void InKet(_In_ uintq sid, _In_ real1_f* ket)
+{
+    SIMULATOR_LOCK_GUARD(sid)
+
+    QInterfacePtr simulator = simulators[sid];
+    simulator->SetQuantumState(reinterpret_cast<complex*>(ket));
+}
+
+/**
+ * (External API) Set state vector for the selected simulator ID.
+ */
+MICROSOFT_QUANTUM_DECL void OutKet(_In_ uintq sid, _In_ real1_f* ket)
+{
+    SIMULATOR_LOCK_GUARD(sid)
+
+    QInterfacePtr simulator = simulators[sid];
+    simulator->GetQuantumState(reinterpret_cast<complex*>(ket));
+}
+
+// One decoded and validated RunProgram() op
+struct ProgramOp {
+    QrackProgramOpType type;
+    bool isAnti;
+    std::vector<bitLenInt> controls;
+    bitLenInt target1;
+    bitLenInt target2;
+    // Index of "params[0U]" in the program's parameter array
+    uintq paramIndex;
+    real1_f params[3U];
+    complex mtrx[4U];
+};
+
+static void SetProgramMtrx(complex* mtrx, complex m0, complex m1, complex m2, complex m3)
+{
+    mtrx[0U] = m0;
+    mtrx[1U] = m1;
+    mtrx[2U] = m2;
+    mtrx[3U] = m3;
+}
+
+static bitLenInt MapProgramQubit(std::map<uintq, bitLenInt>& qubitMap, uintq id)
+{
+    const auto it = qubitMap.find(id);
+    if (it == qubitMap.end()) {
+        throw std::invalid_argument("RunProgram() qubit ID is not allocated!");
+    }
+
+    return it->second;
+}
+
+// Decode (and validate) the whole program, before running any of it.
+static std::vector<ProgramOp> DecodeProgram(
+    std::map<uintq, bitLenInt>& qubitMap, uintq n, uintq* ops, uintq pn, double* params)
+{
+    std::vector<ProgramOp> program;
+    uintq w = 0U, p = 0U;
+    const auto word = [&]() -> uintq {
+        if (w >= n) {
+            throw std::invalid_argument("RunProgram() op stream is truncated!");
+        }
+        return ops[w++];
+    };
+    const auto param = [&]() -> double {
+        if (p >= pn) {
+            throw std::invalid_argument("RunProgram() parameter array is too short!");
+        }
+        return params[p++];
+    };
+
+    while (w < n) {
+        ProgramOp o;
+        std::fill(o.params, o.params + 3U, ZERO_R1_F);
+        SetProgramMtrx(o.mtrx, ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX);
+        const uintq code = word();
+        o.type = (QrackProgramOpType)(code & ~(uintq)QPROG_ANTI);
+        o.isAnti = (code & QPROG_ANTI) != 0U;
+        if (o.type > QPROG_M) {
+            throw std::invalid_argument("RunProgram() op code is not a valid QrackProgramOpType!");
+        }
+
+        o.controls.resize(word());
+        if ((o.type == QPROG_M) && o.controls.size()) {
+            throw std::invalid_argument("RunProgram() measurement cannot be controlled!");
+        }
+        for (size_t i = 0U; i < o.controls.size(); ++i) {
+            o.controls[i] = MapProgramQubit(qubitMap, word());
+        }
+        o.target1 = MapProgramQubit(qubitMap, word());
+        o.target2 = (o.type == QPROG_SWAP) ? MapProgramQubit(qubitMap, word()) : o.target1;
+
+        const real1 sqrt1_2 = SQRT1_2_R1;
+        o.paramIndex = p;
+        const real1 theta = ((o.type >= QPROG_RX) && (o.type <= QPROG_U)) ? (real1)param() : ZERO_R1;
+        o.params[0U] = (real1_f)theta;
+        const real1 cosine = (real1)cos(theta / 2), sine = (real1)sin(theta / 2);
+        switch (o.type) {
+        case QPROG_X:
+            SetProgramMtrx(o.mtrx, ZERO_CMPLX, ONE_CMPLX, ONE_CMPLX, ZERO_CMPLX);
+            break;
+        case QPROG_Y:
+            SetProgramMtrx(o.mtrx, ZERO_CMPLX, -I_CMPLX, I_CMPLX, ZERO_CMPLX);
+            break;
+        case QPROG_Z:
+            SetProgramMtrx(o.mtrx, ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, -ONE_CMPLX);
+            break;
+        case QPROG_H:
+            SetProgramMtrx(o.mtrx, complex(sqrt1_2, ZERO_R1), complex(sqrt1_2, ZERO_R1), complex(sqrt1_2, ZERO_R1),
+                complex(-sqrt1_2, ZERO_R1));
+            break;
+        case QPROG_S:
+        case QPROG_IS:
+        case QPROG_T:
+        case QPROG_IT:
+            SetProgramMtrx(o.mtrx, ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX,
+                (o.type == QPROG_S)      ? I_CMPLX
+                    : (o.type == QPROG_IS) ? -I_CMPLX
+                    : (o.type == QPROG_T)  ? complex(sqrt1_2, sqrt1_2)
+                                           : complex(sqrt1_2, -sqrt1_2));
+            break;
+        case QPROG_RX:
+            SetProgramMtrx(o.mtrx, complex(cosine, ZERO_R1), complex(ZERO_R1, -sine), complex(ZERO_R1, -sine),
+                complex(cosine, ZERO_R1));
+            break;
+        case QPROG_RY:
+            SetProgramMtrx(o.mtrx, complex(cosine, ZERO_R1), complex(-sine, ZERO_R1), complex(sine, ZERO_R1),
+                complex(cosine, ZERO_R1));
+            break;
+        case QPROG_RZ:
+            SetProgramMtrx(o.mtrx, complex(cosine, -sine), ZERO_CMPLX, ZERO_CMPLX, complex(cosine, sine));
+            break;
+        case QPROG_R1:
+            SetProgramMtrx(
+                o.mtrx, ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, complex((real1)cos(theta), (real1)sin(theta)));
+            break;
+        case QPROG_U: {
+            const real1 phi = (real1)param(), lambda = (real1)param();
+            o.params[1U] = (real1_f)phi;
+            o.params[2U] = (real1_f)lambda;
+            SetProgramMtrx(o.mtrx, complex(cosine, ZERO_R1), -complex((real1)cos(lambda), (real1)sin(lambda)) * sine,
+                complex((real1)cos(phi), (real1)sin(phi)) * sine,
+                complex((real1)cos(phi + lambda), (real1)sin(phi + lambda)) * cosine);
+            break;
+        }
+        case QPROG_MTRX:
+            for (size_t i = 0U; i < 4U; ++i) {
+                const real1 re = (real1)param();
+                o.mtrx[i] = complex(re, (real1)param());
+            }
+            break;
+        case QPROG_SWAP:
+        case QPROG_M:
+        default:
+            break;
+        }
+
+        program.push_back(o);
+    }
+
+    return program;
+}
+
+// Run a decoded program on "simulator," counting measurements into "mCount," (which stays valid if an op throws)
+static void ExecuteProgram(QInterfacePtr simulator, const std::vector<ProgramOp>& program, uintq* m, uintq& mCount)
+{
+    for (const ProgramOp& o : program) {
+        if (o.type == QPROG_M) {
+            const bool result = simulator->M(o.target1);
+            if (m) {
+                m[mCount] = result ? 1U : 0U;
+            }
+            ++mCount;
+            continue;
+        }
+
+        if (o.type == QPROG_SWAP) {
+            if (!o.controls.size()) {
+                simulator->Swap(o.target1, o.target2);
+            } else if (o.isAnti) {
+                simulator->AntiCSwap(o.controls, o.target1, o.target2);
+            } else {
+                simulator->CSwap(o.controls, o.target1, o.target2);
+            }
+            continue;
+        }
+
+        if (o.controls.size()) {
+            if (o.isAnti) {
+                simulator->MACMtrx(o.controls, o.mtrx, o.target1);
+            } else {
+                simulator->MCMtrx(o.controls, o.mtrx, o.target1);
+            }
+            continue;
+        }
+
+        // Uncontrolled gates take the same specialized paths as their single gate API calls.
+        switch (o.type) {
+        case QPROG_X:
+            simulator->X(o.target1);
+            break;
+        case QPROG_Y:
+            simulator->Y(o.target1);
+            break;
+        case QPROG_Z:
+            simulator->Z(o.target1);
+            break;
+        case QPROG_H:
+            simulator->H(o.target1);
+            break;
+        case QPROG_S:
+            simulator->S(o.target1);
+            break;
+        case QPROG_IS:
+            simulator->IS(o.target1);
+            break;
+        case QPROG_T:
+            simulator->T(o.target1);
+            break;
+        case QPROG_IT:
+            simulator->IT(o.target1);
+            break;
+        case QPROG_RX:
+            simulator->RX(o.params[0U], o.target1);
+            break;
+        case QPROG_RY:
+            simulator->RY(o.params[0U], o.target1);
+            break;
+        case QPROG_RZ:
+            simulator->RZ(o.params[0U], o.target1);
+            break;
+        case QPROG_U:
+            simulator->U(o.target1, o.params[0U], o.params[1U], o.params[2U]);
+            break;
+        case QPROG_R1:
+        case QPROG_MTRX:
+        default:
+            simulator->Mtrx(o.mtrx, o.target1);
+            break;
+        }
+    }
+}
+
+/**
+ * (External API) Run a packed program of "n" op stream words, (see QrackProgramOpType,) drawing rotation angles and
+ * matrices from the "pn" entries of "params," in order. The whole program is validated, then run, under one lock, with
+ * each measurement result written to the next entry of "m," (if it is not NULL). Returns the measurement count.
+ */
+MICROSOFT_QUANTUM_DECL uintq RunProgram(
+    _In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* ops, _In_ uintq pn, _In_reads_(pn) double* params, uintq* m)
+{
+    SIMULATOR_LOCK_GUARD_INT(sid)
+
+    QInterfacePtr simulator = simulators[sid];
+    std::vector<ProgramOp> program;
+    try {
+        program = DecodeProgram(shards[sid], n, ops, pn, params);
+    } catch (const std::exception& ex) {
+        simulatorErrors[sid] = 1;
+        std::cout << ex.what() << std::endl;
+        return 0U;
+    }
+
+    uintq mCount = 0U;
+    try {
+        ExecuteProgram(simulator, program, m, mCount);
+    } catch (const std::exception& ex) {
+        simulatorErrors[sid] = 1;
+        std::cout << ex.what() << std::endl;
+    }
+
+    return mCount;
+}
+
+#if ENABLE_PTHREAD && ENABLE_QUNIT_CPU_PARALLEL
+/**
+ * (External API) Queue Prob() on simulator ID "sid," and return a ticket without blocking
+ */
+MICROSOFT_QUANTUM_DECL uintq ProbAsync(_In_ uintq sid, _In_ uintq q, _In_ AsyncCallback callback)
+{
+    return EnqueueAsync(
+        sid, callback, [sid, q](QInterfacePtr simulator) { return (double)simulator->Prob(shards[sid][q]); });
+}
+
+/**
+ * (External API) Queue M() on simulator ID "sid," and return a ticket without blocking, (with a result of 0 or 1)
+ */
+MICROSOFT_QUANTUM_DECL uintq MAsync(_In_ uintq sid, _In_ uintq q, _In_ AsyncCallback callback)
+{
+    return EnqueueAsync(
+        sid, callback, [sid, q](QInterfacePtr simulator) { return simulator->M(shards[sid][q]) ? 1.0 : 0.0; });
+}
+
+/**
+ * (External API) Queue MeasureShots() on simulator ID "sid," and return a ticket without blocking. "m" must stay valid
+ * until the ticket completes, (with a result of the shot count).
+ */
+MICROSOFT_QUANTUM_DECL uintq MeasureShotsAsync(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* q, _In_ uintq s,
+    _In_reads_(s) uintq* m, _In_ AsyncCallback callback)
+{
+    const std::vector<uintq> qubits(q, q + n);
+    return EnqueueAsync(sid, callback, [sid, qubits, s, m](QInterfacePtr simulator) {
+        std::vector<bitCapInt> qPowers(qubits.size());
+        for (size_t i = 0U; i < qubits.size(); ++i) {
+            qPowers[i] = Qrack::pow2(shards[sid][qubits[i]]);
+        }
+        simulator->MultiShotMeasureMask(qPowers, (unsigned)s, m);
+
+        return (double)s;
+    });
+}
+
+/**
+ * (External API) Queue PermutationExpectation() on simulator ID "sid," and return a ticket without blocking
+ */
+MICROSOFT_QUANTUM_DECL uintq PermutationExpectationAsync(
+    _In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* c, _In_ AsyncCallback callback)
+{
+    const std::vector<uintq> qubits(c, c + n);
+    return EnqueueAsync(sid, callback, [sid, qubits](QInterfacePtr simulator) {
+        std::vector<bitLenInt> q(qubits.size());
+        for (size_t i = 0U; i < qubits.size(); ++i) {
+            q[i] = shards[sid][qubits[i]];
+        }
+
+        return (double)simulator->ExpectationBitsAll(q);
+    });
+}
+
+/**
+ * (External API) Queue RunProgram() on simulator ID "sid," and return a ticket without blocking. The op stream and
+ * parameters are copied, but "m" must stay valid until the ticket completes, (with a result of the measurement count).
+ */
+MICROSOFT_QUANTUM_DECL uintq RunProgramAsync(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* ops, _In_ uintq pn,
+    _In_reads_(pn) double* params, uintq* m, _In_ AsyncCallback callback)
+{
+    const std::vector<uintq> opWords(ops, ops + n);
+    const std::vector<double> paramWords(params, params + pn);
+    return EnqueueAsync(sid, callback, [sid, opWords, paramWords, m](QInterfacePtr simulator) {
+        const std::vector<ProgramOp> program = DecodeProgram(shards[sid], (uintq)opWords.size(),
+            (uintq*)opWords.data(), (uintq)paramWords.size(), (double*)paramWords.data());
+        uintq mCount = 0U;
+        ExecuteProgram(simulator, program, m, mCount);
+
+        return (double)mCount;
+    });
+}
+
+/**
+ * (External API) Check whether an asynchronous call has completed, (or whether its ticket was already released)
+ */
+MICROSOFT_QUANTUM_DECL bool PollAsync(_In_ uintq ticket)
+{
+    const std::lock_guard<std::mutex> asyncLock(asyncMutex);
+    const auto it = asyncTickets.find(ticket);
+
+    return (it == asyncTickets.end()) || it->second.isDone;
+}
+
+/**
+ * (External API) Block until an asynchronous call completes, then release its ticket and return its result. (A ticket
+ * with a callback is released after its callback returns, and waiting on it after that returns REAL1_DEFAULT_ARG.)
+ */
+MICROSOFT_QUANTUM_DECL double WaitAsync(_In_ uintq ticket)
+{
+    std::unique_lock<std::mutex> asyncLock(asyncMutex);
+    asyncCv.wait(asyncLock, [ticket] {
+        const auto it = asyncTickets.find(ticket);
+        return (it == asyncTickets.end()) || it->second.isDone;
+    });
+
+    const auto it = asyncTickets.find(ticket);
+    if (it == asyncTickets.end()) {
+        return (double)REAL1_DEFAULT_ARG;
+    }
+    const double result = it->second.result;
+    asyncTickets.erase(it);
+
+    return result;
+}
+
+/**
+ * (External API) Block until every queued asynchronous call on simulator ID "sid" has completed
+ */
+MICROSOFT_QUANTUM_DECL void FinishAsync(_In_ uintq sid) { AwaitAsync(sid); }
+#endif
+
+/**
+ * (External API) Stream the full state of the selected simulator ID to a checkpoint file at "path."
+ */
+MICROSOFT_QUANTUM_DECL void SaveCheckpoint(_In_ uintq sid, _In_ const char* path, _In_ bool compress)
+{
+    SIMULATOR_LOCK_GUARD(sid)
+
+    QInterfacePtr simulator = simulators[sid];
+    try {
+        std::ofstream file(path, std::ios::binary);
+        CheckpointWriter writer(file, compress);
+        simulator->SaveCheckpoint(writer);
+        file.flush();
+        if (!file) {
+            simulatorErrors[sid] = 1;
+        }
+    } catch (...) {
+        simulatorErrors[sid] = 1;
+    }
+}
+
+/**
+ * (External API) Restore the full state of the selected simulator ID from a checkpoint file at "path."
+ */
+MICROSOFT_QUANTUM_DECL void LoadCheckpoint(_In_ uintq sid, _In_ const char* path)
+{
+    SIMULATOR_LOCK_GUARD(sid)
+
+    QInterfacePtr simulator = simulators[sid];
+    try {
+        std::ifstream file(path, std::ios::binary);
+        CheckpointReader reader(file);
+        simulator->LoadCheckpoint(reader);
+    } catch (...) {
+        simulatorErrors[sid] = 1;
+    }
+}
+
+/**
+ * (External API) Wrap the selected simulator ID in a circuit-prefix state cache, (QPrefixCache,) of at most "maxBytes"
+ * of snapshots, taken every "interval" gates, as checkpoint blobs if "useCheckpoints," or else as clones. Each later
+ * ResetAll() starts a gate stream that resumes from the longest prefix already simulated. A "maxBytes" of 0 unwraps
+ * the simulator again.
+ */
+MICROSOFT_QUANTUM_DECL void SetPrefixCache(
+    _In_ uintq sid, _In_ uintq maxBytes, _In_ uintq interval, _In_ bool useCheckpoints)
+{
+    SIMULATOR_LOCK_GUARD(sid)
+
+    if (!simulators[sid]) {
+        // (There is nothing to wrap, before the first qubit is allocated.)
+        simulatorErrors[sid] = 1;
+        return;
+    }
+
+    try {
+        QPrefixCachePtr cache = std::dynamic_pointer_cast<QPrefixCache>(simulators[sid]);
+        if (!maxBytes) {
+            if (cache) {
+                simulators[sid] = cache->GetEngine();
+            }
+            return;
+        }
+
+        if (!cache) {
+            cache = std::make_shared<QPrefixCache>(simulators[sid]);
+            simulators[sid] = cache;
+        }
+        cache->GetStore()->SetMaxBytes((size_t)maxBytes);
+        cache->SetSnapshotInterval((size_t)interval);
+        cache->SetUseCheckpoints(useCheckpoints);
+    } catch (const std::exception& ex) {
+        simulatorErrors[sid] = 1;
+        std::cout << ex.what() << std::endl;
+    }
+}
+
+/**
+ * (External API) Write the prefix cache statistics of the selected simulator ID, (hits, misses, bytes used, and
+ * snapshot count,) to "stats," or all 0, if it has no prefix cache.
+ */
+MICROSOFT_QUANTUM_DECL void GetPrefixCacheStats(_In_ uintq sid, uintq* stats)
+{
+    for (size_t i = 0U; i < 4U; ++i) {
+        stats[i] = 0U;
+    }
+
+    SIMULATOR_LOCK_GUARD(sid)
+
+    QPrefixCachePtr cache = std::dynamic_pointer_cast<QPrefixCache>(simulators[sid]);
+    if (!cache) {
+        return;
+    }
+
+    QPrefixCacheStorePtr store = cache->GetStore();
+    stats[0U] = (uintq)store->GetHits();
+    stats[1U] = (uintq)store->GetMisses();
+    stats[2U] = (uintq)store->GetUsedBytes();
+    stats[3U] = (uintq)store->GetEntryCount();
+}
+
+/**
+ * (External API) Report every hot-path statistic, as (name, call count, seconds), to the callback, until it returns
+ * false. Statistics are process-wide; the simulator ID only selects the simulator whose error flag is set, on failure.
+ */
+MICROSOFT_QUANTUM_DECL void GetStats(_In_ uintq sid, _In_ StatCallback callback)
+{
+    SIMULATOR_LOCK_GUARD(sid)
+
+    const std::map<std::string, InstrumentationStat> stats = Instrumentation::Instance().GetStats();
+    for (const auto& s : stats) {
+        if (!callback(s.first.c_str(), (uintq)s.second.calls, s.second.seconds)) {
+            break;
+        }
+    }
+}
+
+/**
+ * (External API) Clear the process-wide hot-path statistics and buffered trace.
+ */
+MICROSOFT_QUANTUM_DECL void ResetStats(_In_ uintq sid)
+{
+    SIMULATOR_LOCK_GUARD(sid)
+
+    Instrumentation::Instance().Reset();
+}
+
+/**
+ * (External API) Start or stop buffering process-wide trace events.
+ */
+MICROSOFT_QUANTUM_DECL void SetTracing(_In_ uintq sid, _In_ bool enable)
+{
+    SIMULATOR_LOCK_GUARD(sid)
+
+    Instrumentation::Instance().SetTracing(enable);
+}
+
+/**
+ * (External API) Write the buffered trace events to a Chrome trace-event JSON file at "path."
+ */
+MICROSOFT_QUANTUM_DECL void WriteChromeTrace(_In_ uintq sid, _In_ const char* path)
+{
+    SIMULATOR_LOCK_GUARD(sid)
+
+    std::ofstream file(path);
+    Instrumentation::Instance().WriteChromeTrace(file);
+    file.flush();
+    if (!file) {
+        simulatorErrors[sid] = 1;
+    }
+}
+
+/**
+ * (External API) Get the probabilities of every basis state for the selected simulator ID, in one bulk copy.
  */
-MICROSOFT_QUANTUM_DECL void Dump(_In_ uintq sid, _In_ ProbAmpCallback callback)
+MICROSOFT_QUANTUM_DECL void OutProbs(_In_ uintq sid, _In_ real1_f* p)
 {
     SIMULATOR_LOCK_GUARD(sid)
 
     QInterfacePtr simulator = simulators[sid];
-    bitCapIntOcl wfnl = (bitCapIntOcl)simulator->GetMaxQPower();
-
-    for (size_t i = 0U; i < wfnl; ++i) {
-        complex amp;
-        try {
-            amp = simulator->GetAmplitude(i);
-        } catch (...) {
-            simulatorErrors[sid] = 1;
-            break;
-        }
-
-        if (!callback(i, (double)real(amp), (double)imag(amp))) {
-            break;
-        }
+    try {
+#if FPPOW > 4
+        simulator->GetProbs(reinterpret_cast<real1*>(p));
+#else
+        const bitCapIntOcl maxQPower = (bitCapIntOcl)simulator->GetMaxQPower();
+        std::unique_ptr<real1[]> probs(new real1[maxQPower]);
+        simulator->GetProbs(probs.get());
+        std::copy(probs.get(), probs.get() + maxQPower, p);
+#endif
+    } catch (const std::exception& ex) {
+        simulatorErrors[sid] = 1;
+        std::cout << ex.what() << std::endl;
     }
 }
 
 /**
- * (External API) Set state vector for the selected simulator ID.
+ * (External API) Map the state vector of the selected simulator ID read-only, as interleaved (real, imaginary)
+ * pairs, without a copy where the simulator holds it in host memory. Returns NULL if the state isn't available this
+ * way, (such as for stabilizer or decision tree states, or paged states,) in which case use OutKet(). Call UnmapKet()
+ * before any other operation on this simulator.
  */
-MICROSOFT_QUANTUM_DECL void InKet(_In_ uintq sid, _In_ real1_f* ket)
+MICROSOFT_QUANTUM_DECL const real1_f* MapKet(_In_ uintq sid)
 {
     SIMULATOR_LOCK_GUARD(sid)
 
-    QInterfacePtr simulator = simulators[sid];
-    simulator->SetQuantumState(reinterpret_cast<complex*>(ket));
+    if (!simulators[sid]) {
+        return NULL;
+    }
+
+#if FPPOW > 4
+    try {
+        return reinterpret_cast<const real1_f*>(simulators[sid]->MapStateVector());
+    } catch (const std::exception& ex) {
+        simulatorErrors[sid] = 1;
+        std::cout << ex.what() << std::endl;
+    }
+#endif
+
+    // (Reduced precision amplitudes aren't laid out as real1_f.)
+    return NULL;
 }
 
 /**
- * (External API) Set state vector for the selected simulator ID.
+ * (External API) Release a MapKet() pointer for the selected simulator ID.
  */
-MICROSOFT_QUANTUM_DECL void OutKet(_In_ uintq sid, _In_ real1_f* ket)
+MICROSOFT_QUANTUM_DECL void UnmapKet(_In_ uintq sid)
 {
     SIMULATOR_LOCK_GUARD(sid)
 
-    QInterfacePtr simulator = simulators[sid];
-    simulator->GetQuantumState(reinterpret_cast<complex*>(ket));
+    if (simulators[sid]) {
+        simulators[sid]->UnmapStateVector();
+    }
 }
 
 /**
@@ -789,7 +1581,7 @@ MICROSOFT_QUANTUM_DECL void PhaseParity(_In_ uintq sid, _In_ double lambda, _In_
     QInterfacePtr simulator = simulators[sid];
     bitCapInt mask = 0U;
     for (uintq i = 0U; i < n; ++i) {
-        mask |= pow2(shards[simulator.get()][q[i]]);
+        mask |= pow2(shards[sid][q[i]]);
     }
 
     try {
@@ -800,8 +1592,9 @@ MICROSOFT_QUANTUM_DECL void PhaseParity(_In_ uintq sid, _In_ double lambda, _In_
     }
 }
 
-double _JointEnsembleProbabilityHelper(QInterfacePtr simulator, uintq n, int* b, uintq* q, bool doMeasure)
+double _JointEnsembleProbabilityHelper(uintq sid, uintq n, int* b, uintq* q, bool doMeasure)
 {
+    QInterfacePtr simulator = simulators[sid];
 
     if (!n) {
         return 0.0;
@@ -819,7 +1612,7 @@ double _JointEnsembleProbabilityHelper(QInterfacePtr simulator, uintq n, int* b,
 
     bitCapInt mask = 0U;
     for (bitLenInt i = 0U; i < (bitLenInt)n; ++i) {
-        bitCapInt bit = pow2(shards[simulator.get()][qVec[i]]);
+        bitCapInt bit = pow2(shards[sid][qVec[i]]);
         mask |= bit;
     }
 
@@ -840,11 +1633,11 @@ MICROSOFT_QUANTUM_DECL double JointEnsembleProbability(
     double jointProb = (double)REAL1_DEFAULT_ARG;
 
     try {
-        TransformPauliBasis(simulator, n, b, q);
+        TransformPauliBasis(sid, n, b, q);
 
-        jointProb = _JointEnsembleProbabilityHelper(simulator, n, b, q, false);
+        jointProb = _JointEnsembleProbabilityHelper(sid, n, b, q, false);
 
-        RevertPauliBasis(simulator, n, b, q);
+        RevertPauliBasis(sid, n, b, q);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -853,6 +1646,118 @@ MICROSOFT_QUANTUM_DECL double JointEnsembleProbability(
     return jointProb;
 }
 
+static std::vector<PauliString> DecodePauliTerms(
+    std::map<uintq, bitLenInt>& qubitMap, uintq t, uintq* n, int* b, uintq* q)
+{
+    std::vector<PauliString> terms(t);
+    uintq start = 0U;
+    for (uintq i = 0U; i < t; ++i) {
+        for (uintq j = start; j < (start + n[i]); ++j) {
+            terms[i].qubits.push_back(MapProgramQubit(qubitMap, q[j]));
+            terms[i].paulis.push_back((Pauli)b[j]);
+        }
+        start += n[i];
+    }
+
+    return terms;
+}
+
+/**
+ * (External API) Get the expectation values of many Pauli string observables, without changing the state.
+ */
+MICROSOFT_QUANTUM_DECL void PauliExpectationAll(
+    _In_ uintq sid, _In_ uintq t, _In_reads_(t) uintq* n, _In_ int* b, _In_ uintq* q, double* e)
+{
+    SIMULATOR_LOCK_GUARD(sid)
+
+    QInterfacePtr simulator = simulators[sid];
+    if (!simulator) {
+        return;
+    }
+
+    try {
+        const std::vector<real1_f> expectations =
+            simulator->ExpectationPauliAll(DecodePauliTerms(shards[sid], t, n, b, q));
+        std::copy(expectations.begin(), expectations.end(), e);
+    } catch (const std::exception& ex) {
+        simulatorErrors[sid] = 1;
+        std::cout << ex.what() << std::endl;
+    }
+}
+
+/**
+ * (External API) Get the expectation value of the observable sum of "c[i]" times Pauli string term "i," after a packed
+ * program, (as for RunProgram(),) and its derivative with respect to every entry of "params," by the adjoint method.
+ *
+ * Only RX, RY, and RZ angles are differentiated; the gradient entries of other parameters are 0. The simulator is left
+ * in its starting state.
+ */
+MICROSOFT_QUANTUM_DECL double ProgramGradient(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* ops, _In_ uintq pn,
+    _In_reads_(pn) double* params, _In_ uintq t, _In_reads_(t) uintq* tn, _In_ int* b, _In_ uintq* q,
+    _In_reads_(t) double* c, double* g)
+{
+    SIMULATOR_LOCK_GUARD_DOUBLE(sid)
+
+    QInterfacePtr simulator = simulators[sid];
+
+    try {
+        const std::vector<ProgramOp> program = DecodeProgram(shards[sid], n, ops, pn, params);
+
+        const complex xMtrx[4U]{ ZERO_CMPLX, ONE_CMPLX, ONE_CMPLX, ZERO_CMPLX };
+        QTape tape;
+        for (const ProgramOp& o : program) {
+            if (o.type == QPROG_M) {
+                throw std::invalid_argument("ProgramGradient() program cannot include measurement!");
+            }
+
+            // Anti-controls are controls, conjugated by X.
+            if (o.isAnti) {
+                for (const bitLenInt& ctrl : o.controls) {
+                    tape.Mtrx(xMtrx, ctrl);
+                }
+            }
+
+            if (o.type == QPROG_SWAP) {
+                std::vector<bitLenInt> controls1(o.controls);
+                controls1.push_back(o.target1);
+                std::vector<bitLenInt> controls2(o.controls);
+                controls2.push_back(o.target2);
+                tape.Mtrx(xMtrx, o.target2, controls1);
+                tape.Mtrx(xMtrx, o.target1, controls2);
+                tape.Mtrx(xMtrx, o.target2, controls1);
+            } else if (o.type == QPROG_RX) {
+                tape.R(PauliX, (size_t)o.paramIndex, o.target1, o.controls);
+            } else if (o.type == QPROG_RY) {
+                tape.R(PauliY, (size_t)o.paramIndex, o.target1, o.controls);
+            } else if (o.type == QPROG_RZ) {
+                tape.R(PauliZ, (size_t)o.paramIndex, o.target1, o.controls);
+            } else {
+                tape.Mtrx(o.mtrx, o.target1, o.controls);
+            }
+
+            if (o.isAnti) {
+                for (const bitLenInt& ctrl : o.controls) {
+                    tape.Mtrx(xMtrx, ctrl);
+                }
+            }
+        }
+
+        const std::vector<real1_f> p(params, params + pn);
+        const std::vector<real1_f> coeffs(c, c + t);
+        std::vector<real1_f> gradient;
+        const real1_f expectation = tape.Gradient(
+            simulator, p, DecodePauliTerms(shards[sid], t, tn, b, q), coeffs, gradient);
+        std::copy(gradient.begin(), gradient.end(), g);
+
+        return (double)expectation;
+    } catch (const std::exception& ex) {
+        simulatorErrors[sid] = 1;
+        std::cout << ex.what() << std::endl;
+    }
+
+    return (double)REAL1_DEFAULT_ARG;
+}
+
 /**
  * (External API) Set the simulator to a computational basis permutation.
  */
@@ -873,15 +1778,15 @@ MICROSOFT_QUANTUM_DECL void ResetAll(_In_ uintq sid)
  */
 MICROSOFT_QUANTUM_DECL void allocateQubit(_In_ uintq sid, _In_ uintq qid)
 {
-    META_LOCK_GUARD()
+    SIMULATOR_LOCK_GUARD(sid)
 
     QInterfacePtr nQubit = CreateQuantumInterface(
         simulatorTypes[sid], 1U, 0U, randNumGen, CMPLX_DEFAULT_ARG, false, true, simulatorHostPointer[sid]);
 
     if (simulators[sid] == NULL) {
         simulators[sid] = nQubit;
-        shards[nQubit.get()] = {};
-        shards[nQubit.get()][qid] = 0;
+        shards[sid] = {};
+        shards[sid][qid] = 0;
 
         return;
     }
@@ -895,7 +1800,7 @@ MICROSOFT_QUANTUM_DECL void allocateQubit(_In_ uintq sid, _In_ uintq qid)
         std::cout << ex.what() << std::endl;
     }
 
-    shards[simulators[sid].get()][qid] = (qubitCount - 1U);
+    shards[sid][qid] = (qubitCount - 1U);
 }
 
 /**
@@ -903,25 +1808,25 @@ MICROSOFT_QUANTUM_DECL void allocateQubit(_In_ uintq sid, _In_ uintq qid)
  */
 MICROSOFT_QUANTUM_DECL bool release(_In_ uintq sid, _In_ uintq q)
 {
-    META_LOCK_GUARD()
+    SIMULATOR_LOCK_GUARD(sid)
 
     QInterfacePtr simulator = simulators[sid];
 
     // Check that the qubit is in the |0> state, to within a small tolerance.
-    bool toRet = simulator->Prob(shards[simulator.get()][q]) < (ONE_R1 / 100);
+    bool toRet = simulator->Prob(shards[sid][q]) < (ONE_R1 / 100);
 
     if (simulator->GetQubitCount() == 1U) {
-        shards[simulator.get()] = {};
+        shards[sid] = {};
         simulators[sid] = NULL;
     } else {
-        bitLenInt oIndex = shards[simulator.get()][q];
+        bitLenInt oIndex = shards[sid][q];
         simulator->Dispose(oIndex, 1U);
-        for (uintq i = 0U; i < shards[simulator.get()].size(); ++i) {
-            if (shards[simulator.get()][i] > oIndex) {
-                --(shards[simulator.get()][i]);
+        for (uintq i = 0U; i < shards[sid].size(); ++i) {
+            if (shards[sid][i] > oIndex) {
+                --(shards[sid][i]);
             }
         }
-        shards[simulator.get()].erase(q);
+        shards[sid].erase(q);
     }
 
     return toRet;
@@ -948,7 +1853,7 @@ MICROSOFT_QUANTUM_DECL void X(_In_ uintq sid, _In_ uintq q)
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->X(shards[simulator.get()][q]);
+        simulator->X(shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -964,7 +1869,7 @@ MICROSOFT_QUANTUM_DECL void Y(_In_ uintq sid, _In_ uintq q)
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->Y(shards[simulator.get()][q]);
+        simulator->Y(shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -980,7 +1885,7 @@ MICROSOFT_QUANTUM_DECL void Z(_In_ uintq sid, _In_ uintq q)
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->Z(shards[simulator.get()][q]);
+        simulator->Z(shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -996,7 +1901,7 @@ MICROSOFT_QUANTUM_DECL void H(_In_ uintq sid, _In_ uintq q)
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->H(shards[simulator.get()][q]);
+        simulator->H(shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1012,7 +1917,7 @@ MICROSOFT_QUANTUM_DECL void S(_In_ uintq sid, _In_ uintq q)
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->S(shards[simulator.get()][q]);
+        simulator->S(shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1028,7 +1933,7 @@ MICROSOFT_QUANTUM_DECL void T(_In_ uintq sid, _In_ uintq q)
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->T(shards[simulator.get()][q]);
+        simulator->T(shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1044,7 +1949,7 @@ MICROSOFT_QUANTUM_DECL void AdjS(_In_ uintq sid, _In_ uintq q)
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->IS(shards[simulator.get()][q]);
+        simulator->IS(shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1060,7 +1965,7 @@ MICROSOFT_QUANTUM_DECL void AdjT(_In_ uintq sid, _In_ uintq q)
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->IT(shards[simulator.get()][q]);
+        simulator->IT(shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1076,7 +1981,7 @@ MICROSOFT_QUANTUM_DECL void U(_In_ uintq sid, _In_ uintq q, _In_ double theta, _
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->U(shards[simulator.get()][q], (real1_f)theta, (real1_f)phi, (real1_f)lambda);
+        simulator->U(shards[sid][q], (real1_f)theta, (real1_f)phi, (real1_f)lambda);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1095,10 +2000,33 @@ MICROSOFT_QUANTUM_DECL void Mtrx(_In_ uintq sid, _In_reads_(8) double* m, _In_ u
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->Mtrx(mtrx, shards[simulator.get()][q]);
+        simulator->Mtrx(mtrx, shards[sid][q]);
+    } catch (const std::exception& ex) {
+        simulatorErrors[sid] = 1;
+        std::cout << ex.what() << std::endl;
+    }
+}
+
+/**
+ * (External API) One quantum trajectory step of a single qubit noise channel: "k" holds "n" 2x2 Kraus operators, (8
+ * doubles each, real and imaginary parts in row-major order,) and the index of the applied operator is returned.
+ */
+MICROSOFT_QUANTUM_DECL uintq KrausChannel(_In_ uintq sid, _In_ uintq n, _In_reads_(8 * n) double* k, _In_ uintq q)
+{
+    SIMULATOR_LOCK_GUARD_INT(sid)
+
+    std::vector<complex> kraus(n << 2U);
+    for (size_t i = 0U; i < kraus.size(); ++i) {
+        kraus[i] = complex((real1)k[i << 1U], (real1)k[(i << 1U) + 1U]);
+    }
+
+    QInterfacePtr simulator = simulators[sid];
+    try {
+        return (uintq)simulator->KrausChannel1Qb(kraus, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
+        return 0U;
     }
 }
 
@@ -1107,7 +2035,7 @@ MICROSOFT_QUANTUM_DECL void Mtrx(_In_ uintq sid, _In_reads_(8) double* m, _In_ u
     QInterfacePtr simulator = simulators[sid];                                                                         \
     std::vector<bitLenInt> ctrlsArray(numC);                                                                           \
     for (uintq i = 0; i < numC; ++i) {                                                                                 \
-        ctrlsArray[i] = shards[simulator.get()][c[i]];                                                                 \
+        ctrlsArray[i] = shards[sid][c[i]];                                                                 \
     }
 
 /**
@@ -1117,7 +2045,7 @@ MICROSOFT_QUANTUM_DECL void MCX(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uint
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MCInvert(ctrlsArray, ONE_CMPLX, ONE_CMPLX, shards[simulator.get()][q]);
+        simulator->MCInvert(ctrlsArray, ONE_CMPLX, ONE_CMPLX, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1131,7 +2059,7 @@ MICROSOFT_QUANTUM_DECL void MCY(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uint
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MCInvert(ctrlsArray, -I_CMPLX, I_CMPLX, shards[simulator.get()][q]);
+        simulator->MCInvert(ctrlsArray, -I_CMPLX, I_CMPLX, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1145,7 +2073,7 @@ MICROSOFT_QUANTUM_DECL void MCZ(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uint
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MCPhase(ctrlsArray, ONE_CMPLX, -ONE_CMPLX, shards[simulator.get()][q]);
+        simulator->MCPhase(ctrlsArray, ONE_CMPLX, -ONE_CMPLX, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1162,7 +2090,7 @@ MICROSOFT_QUANTUM_DECL void MCH(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uint
 
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MCMtrx(ctrlsArray, hGate, shards[simulator.get()][q]);
+        simulator->MCMtrx(ctrlsArray, hGate, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1176,7 +2104,7 @@ MICROSOFT_QUANTUM_DECL void MCS(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uint
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MCPhase(ctrlsArray, ONE_CMPLX, I_CMPLX, shards[simulator.get()][q]);
+        simulator->MCPhase(ctrlsArray, ONE_CMPLX, I_CMPLX, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1190,7 +2118,7 @@ MICROSOFT_QUANTUM_DECL void MCT(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uint
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MCPhase(ctrlsArray, ONE_CMPLX, complex(SQRT1_2_R1, SQRT1_2_R1), shards[simulator.get()][q]);
+        simulator->MCPhase(ctrlsArray, ONE_CMPLX, complex(SQRT1_2_R1, SQRT1_2_R1), shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1204,7 +2132,7 @@ MICROSOFT_QUANTUM_DECL void MCAdjS(_In_ uintq sid, _In_ uintq n, _In_reads_(n) u
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MCPhase(ctrlsArray, ONE_CMPLX, -I_CMPLX, shards[simulator.get()][q]);
+        simulator->MCPhase(ctrlsArray, ONE_CMPLX, -I_CMPLX, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1218,7 +2146,7 @@ MICROSOFT_QUANTUM_DECL void MCAdjT(_In_ uintq sid, _In_ uintq n, _In_reads_(n) u
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MCPhase(ctrlsArray, ONE_CMPLX, complex(SQRT1_2_R1, -SQRT1_2_R1), shards[simulator.get()][q]);
+        simulator->MCPhase(ctrlsArray, ONE_CMPLX, complex(SQRT1_2_R1, -SQRT1_2_R1), shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1233,7 +2161,7 @@ MICROSOFT_QUANTUM_DECL void MCU(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uint
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->CU(ctrlsArray, shards[simulator.get()][q], (real1_f)theta, (real1_f)phi, (real1_f)lambda);
+        simulator->CU(ctrlsArray, shards[sid][q], (real1_f)theta, (real1_f)phi, (real1_f)lambda);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1251,7 +2179,7 @@ MICROSOFT_QUANTUM_DECL void MCMtrx(
 
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MCMtrx(ctrlsArray, mtrx, shards[simulator.get()][q]);
+        simulator->MCMtrx(ctrlsArray, mtrx, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1265,7 +2193,7 @@ MICROSOFT_QUANTUM_DECL void MACX(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uin
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MACInvert(ctrlsArray, ONE_CMPLX, ONE_CMPLX, shards[simulator.get()][q]);
+        simulator->MACInvert(ctrlsArray, ONE_CMPLX, ONE_CMPLX, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1279,7 +2207,7 @@ MICROSOFT_QUANTUM_DECL void MACY(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uin
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MACInvert(ctrlsArray, -I_CMPLX, I_CMPLX, shards[simulator.get()][q]);
+        simulator->MACInvert(ctrlsArray, -I_CMPLX, I_CMPLX, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1293,7 +2221,7 @@ MICROSOFT_QUANTUM_DECL void MACZ(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uin
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MACPhase(ctrlsArray, ONE_CMPLX, -ONE_CMPLX, shards[simulator.get()][q]);
+        simulator->MACPhase(ctrlsArray, ONE_CMPLX, -ONE_CMPLX, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1310,7 +2238,7 @@ MICROSOFT_QUANTUM_DECL void MACH(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uin
 
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MACMtrx(ctrlsArray, hGate, shards[simulator.get()][q]);
+        simulator->MACMtrx(ctrlsArray, hGate, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1324,7 +2252,7 @@ MICROSOFT_QUANTUM_DECL void MACS(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uin
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MACPhase(ctrlsArray, ONE_CMPLX, I_CMPLX, shards[simulator.get()][q]);
+        simulator->MACPhase(ctrlsArray, ONE_CMPLX, I_CMPLX, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1338,7 +2266,7 @@ MICROSOFT_QUANTUM_DECL void MACT(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uin
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MACPhase(ctrlsArray, ONE_CMPLX, complex(SQRT1_2_R1, SQRT1_2_R1), shards[simulator.get()][q]);
+        simulator->MACPhase(ctrlsArray, ONE_CMPLX, complex(SQRT1_2_R1, SQRT1_2_R1), shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1352,7 +2280,7 @@ MICROSOFT_QUANTUM_DECL void MACAdjS(_In_ uintq sid, _In_ uintq n, _In_reads_(n)
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MACPhase(ctrlsArray, ONE_CMPLX, -I_CMPLX, shards[simulator.get()][q]);
+        simulator->MACPhase(ctrlsArray, ONE_CMPLX, -I_CMPLX, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1366,7 +2294,7 @@ MICROSOFT_QUANTUM_DECL void MACAdjT(_In_ uintq sid, _In_ uintq n, _In_reads_(n)
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MACPhase(ctrlsArray, ONE_CMPLX, complex(SQRT1_2_R1, -SQRT1_2_R1), shards[simulator.get()][q]);
+        simulator->MACPhase(ctrlsArray, ONE_CMPLX, complex(SQRT1_2_R1, -SQRT1_2_R1), shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1381,7 +2309,7 @@ MICROSOFT_QUANTUM_DECL void MACU(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uin
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->AntiCU(ctrlsArray, shards[simulator.get()][q], (real1_f)theta, (real1_f)phi, (real1_f)lambda);
+        simulator->AntiCU(ctrlsArray, shards[sid][q], (real1_f)theta, (real1_f)phi, (real1_f)lambda);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1399,7 +2327,7 @@ MICROSOFT_QUANTUM_DECL void MACMtrx(
 
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->MACMtrx(ctrlsArray, mtrx, shards[simulator.get()][q]);
+        simulator->MACMtrx(ctrlsArray, mtrx, shards[sid][q]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1415,7 +2343,7 @@ MICROSOFT_QUANTUM_DECL void Multiplex1Mtrx(
 
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->UniformlyControlledSingleBit(ctrlsArray, shards[simulator.get()][q], mtrxs.get());
+        simulator->UniformlyControlledSingleBit(ctrlsArray, shards[sid][q], mtrxs.get());
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1427,7 +2355,7 @@ MICROSOFT_QUANTUM_DECL void Multiplex1Mtrx(
     QInterfacePtr simulator = simulators[sid];                                                                         \
     bitCapInt mask = 0U;                                                                                               \
     for (uintq i = 0U; i < numQ; ++i) {                                                                                \
-        mask |= pow2(shards[simulator.get()][q[i]]);                                                                   \
+        mask |= pow2(shards[sid][q[i]]);                                                                   \
     }
 
 /**
@@ -1530,12 +2458,12 @@ MICROSOFT_QUANTUM_DECL void Exp(
         } else {
             QInterfacePtr simulator = simulators[sid];
 
-            TransformPauliBasis(simulator, n, b, q);
+            TransformPauliBasis(sid, n, b, q);
 
             std::size_t mask = make_mask(qVec);
             QPARITY(simulator)->UniformParityRZ((bitCapInt)mask, (real1_f)(-phi));
 
-            RevertPauliBasis(simulator, n, b, q);
+            RevertPauliBasis(sid, n, b, q);
         }
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -1571,12 +2499,12 @@ MICROSOFT_QUANTUM_DECL void MCExp(_In_ uintq sid, _In_ uintq n, _In_reads_(n) in
             QInterfacePtr simulator = simulators[sid];
             std::vector<bitLenInt> csVec(cs, cs + nc);
 
-            TransformPauliBasis(simulator, n, b, q);
+            TransformPauliBasis(sid, n, b, q);
 
             std::size_t mask = make_mask(qVec);
             QPARITY(simulator)->CUniformParityRZ(csVec, (bitCapInt)mask, (real1_f)(-phi));
 
-            RevertPauliBasis(simulator, n, b, q);
+            RevertPauliBasis(sid, n, b, q);
         }
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -1593,7 +2521,7 @@ MICROSOFT_QUANTUM_DECL uintq M(_In_ uintq sid, _In_ uintq q)
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        return simulator->M(shards[simulator.get()][q]) ? 1U : 0U;
+        return simulator->M(shards[sid][q]) ? 1U : 0U;
     } catch (...) {
         simulatorErrors[sid] = 1;
         return -1;
@@ -1609,7 +2537,7 @@ MICROSOFT_QUANTUM_DECL uintq ForceM(_In_ uintq sid, _In_ uintq q, _In_ bool r)
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        return simulator->ForceM(shards[simulator.get()][q], r) ? 1U : 0U;
+        return simulator->ForceM(shards[sid][q], r) ? 1U : 0U;
     } catch (...) {
         simulatorErrors[sid] = 1;
         return -1;
@@ -1642,13 +2570,13 @@ MICROSOFT_QUANTUM_DECL uintq Measure(_In_ uintq sid, _In_ uintq n, _In_reads_(n)
 
     uintq toRet = -1;
     try {
-        TransformPauliBasis(simulator, n, b, q);
+        TransformPauliBasis(sid, n, b, q);
 
-        double jointProb = _JointEnsembleProbabilityHelper(simulator, n, b, q, true);
+        double jointProb = _JointEnsembleProbabilityHelper(sid, n, b, q, true);
 
         toRet = (jointProb < (ONE_R1 / 2)) ? 0U : 1U;
 
-        RevertPauliBasis(simulator, n, b, q);
+        RevertPauliBasis(sid, n, b, q);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1665,7 +2593,7 @@ MICROSOFT_QUANTUM_DECL void MeasureShots(
     QInterfacePtr simulator = simulators[sid];
     std::vector<bitCapInt> qPowers(n);
     for (uintq i = 0U; i < n; ++i) {
-        qPowers[i] = Qrack::pow2(shards[simulator.get()][q[i]]);
+        qPowers[i] = Qrack::pow2(shards[sid][q[i]]);
     }
 
     try {
@@ -1682,7 +2610,7 @@ MICROSOFT_QUANTUM_DECL void SWAP(_In_ uintq sid, _In_ uintq qi1, _In_ uintq qi2)
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->Swap(shards[simulator.get()][qi1], shards[simulator.get()][qi2]);
+        simulator->Swap(shards[sid][qi1], shards[sid][qi2]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1695,7 +2623,7 @@ MICROSOFT_QUANTUM_DECL void ISWAP(_In_ uintq sid, _In_ uintq qi1, _In_ uintq qi2
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->ISwap(shards[simulator.get()][qi1], shards[simulator.get()][qi2]);
+        simulator->ISwap(shards[sid][qi1], shards[sid][qi2]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1708,7 +2636,7 @@ MICROSOFT_QUANTUM_DECL void AdjISWAP(_In_ uintq sid, _In_ uintq qi1, _In_ uintq
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->IISwap(shards[simulator.get()][qi1], shards[simulator.get()][qi2]);
+        simulator->IISwap(shards[sid][qi1], shards[sid][qi2]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1721,7 +2649,7 @@ MICROSOFT_QUANTUM_DECL void FSim(_In_ uintq sid, _In_ double theta, _In_ double
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->FSim((real1_f)theta, (real1_f)phi, shards[simulator.get()][qi1], shards[simulator.get()][qi2]);
+        simulator->FSim((real1_f)theta, (real1_f)phi, shards[sid][qi1], shards[sid][qi2]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1732,7 +2660,7 @@ MICROSOFT_QUANTUM_DECL void CSWAP(_In_ uintq sid, _In_ uintq n, _In_reads_(n) ui
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->CSwap(ctrlsArray, shards[simulator.get()][qi1], shards[simulator.get()][qi2]);
+        simulator->CSwap(ctrlsArray, shards[sid][qi1], shards[sid][qi2]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1743,7 +2671,7 @@ MICROSOFT_QUANTUM_DECL void ACSWAP(_In_ uintq sid, _In_ uintq n, _In_reads_(n) u
 {
     MAP_CONTROLS_AND_LOCK(sid, n)
     try {
-        simulator->AntiCSwap(ctrlsArray, shards[simulator.get()][qi1], shards[simulator.get()][qi2]);
+        simulator->AntiCSwap(ctrlsArray, shards[sid][qi1], shards[sid][qi2]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1752,11 +2680,17 @@ MICROSOFT_QUANTUM_DECL void ACSWAP(_In_ uintq sid, _In_ uintq n, _In_reads_(n) u
 
 MICROSOFT_QUANTUM_DECL void Compose(_In_ uintq sid1, _In_ uintq sid2, uintq* q)
 {
+    AwaitAsync(sid1);
+    AwaitAsync(sid2);
+
+    // Lock both IDs together, (deadlock-free regardless of argument order).
+    std::lock(simulatorMutexes[sid1], simulatorMutexes[sid2]);
+    const std::lock_guard<std::mutex> simulatorLock1(simulatorMutexes[sid1], std::adopt_lock);
+    const std::lock_guard<std::mutex> simulatorLock2(simulatorMutexes[sid2], std::adopt_lock);
+
     if (!simulators[sid1] || !simulators[sid2]) {
         return;
     }
-    const std::lock_guard<std::mutex> simulatorLock1(simulatorMutexes[simulators[sid1].get()]);
-    const std::lock_guard<std::mutex> simulatorLock2(simulatorMutexes[simulators[sid2].get()]);
 
     if (simulatorTypes[sid1].size() != simulatorTypes[sid2].size()) {
         throw std::runtime_error("Cannot 'Compose()' simulators of different layer stack types.");
@@ -1782,7 +2716,7 @@ MICROSOFT_QUANTUM_DECL void Compose(_In_ uintq sid1, _In_ uintq sid2, uintq* q)
     }
 
     for (bitLenInt i = 0; i < pQubitCount; ++i) {
-        shards[simulator1.get()][q[i]] = oQubitCount + i;
+        shards[sid1][q[i]] = oQubitCount + i;
     }
 }
 
@@ -1799,7 +2733,7 @@ MICROSOFT_QUANTUM_DECL uintq Decompose(_In_ uintq sid, _In_ uintq n, _In_reads_(
         nQubitIndex = simulator->GetQubitCount() - n;
 
         for (uintq i = 0U; i < n; ++i) {
-            simulator->Swap(shards[simulator.get()][q[i]], i + nQubitIndex);
+            simulator->Swap(shards[sid][q[i]], i + nQubitIndex);
         }
 
         simulator->Decompose(nQubitIndex, simulators[nSid]);
@@ -1810,13 +2744,13 @@ MICROSOFT_QUANTUM_DECL uintq Decompose(_In_ uintq sid, _In_ uintq n, _In_reads_(
 
     bitLenInt oIndex;
     for (uintq j = 0U; j < n; ++j) {
-        oIndex = shards[simulator.get()][q[j]];
-        for (uintq i = 0U; i < shards[simulator.get()].size(); ++i) {
-            if (shards[simulator.get()][i] > oIndex) {
-                --(shards[simulator.get()][i]);
+        oIndex = shards[sid][q[j]];
+        for (uintq i = 0U; i < shards[sid].size(); ++i) {
+            if (shards[sid][i] > oIndex) {
+                --(shards[sid][i]);
             }
         }
-        shards[simulator.get()].erase(q[j]);
+        shards[sid].erase(q[j]);
     }
 
     simulatorTypes[nSid] = simulatorTypes[sid];
@@ -1836,7 +2770,7 @@ MICROSOFT_QUANTUM_DECL void Dispose(_In_ uintq sid, _In_ uintq n, _In_reads_(n)
         nQubitIndex = simulator->GetQubitCount() - n;
 
         for (uintq i = 0U; i < n; ++i) {
-            simulator->Swap(shards[simulator.get()][q[i]], i + nQubitIndex);
+            simulator->Swap(shards[sid][q[i]], i + nQubitIndex);
         }
 
         simulator->Dispose(nQubitIndex, n);
@@ -1847,13 +2781,13 @@ MICROSOFT_QUANTUM_DECL void Dispose(_In_ uintq sid, _In_ uintq n, _In_reads_(n)
 
     bitLenInt oIndex;
     for (uintq j = 0U; j < n; ++j) {
-        oIndex = shards[simulator.get()][q[j]];
-        for (uintq i = 0U; i < shards[simulator.get()].size(); ++i) {
-            if (shards[simulator.get()][i] > oIndex) {
-                --(shards[simulator.get()][i]);
+        oIndex = shards[sid][q[j]];
+        for (uintq i = 0U; i < shards[sid].size(); ++i) {
+            if (shards[sid][i] > oIndex) {
+                --(shards[sid][i]);
             }
         }
-        shards[simulator.get()].erase(q[j]);
+        shards[sid].erase(q[j]);
     }
 }
 
@@ -1863,7 +2797,7 @@ MICROSOFT_QUANTUM_DECL void AND(_In_ uintq sid, _In_ uintq qi1, _In_ uintq qi2,
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->AND(shards[simulator.get()][qi1], shards[simulator.get()][qi2], shards[simulator.get()][qo]);
+        simulator->AND(shards[sid][qi1], shards[sid][qi2], shards[sid][qo]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1876,7 +2810,7 @@ MICROSOFT_QUANTUM_DECL void OR(_In_ uintq sid, _In_ uintq qi1, _In_ uintq qi2, _
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->OR(shards[simulator.get()][qi1], shards[simulator.get()][qi2], shards[simulator.get()][qo]);
+        simulator->OR(shards[sid][qi1], shards[sid][qi2], shards[sid][qo]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1889,7 +2823,7 @@ MICROSOFT_QUANTUM_DECL void XOR(_In_ uintq sid, _In_ uintq qi1, _In_ uintq qi2,
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->XOR(shards[simulator.get()][qi1], shards[simulator.get()][qi2], shards[simulator.get()][qo]);
+        simulator->XOR(shards[sid][qi1], shards[sid][qi2], shards[sid][qo]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1902,7 +2836,7 @@ MICROSOFT_QUANTUM_DECL void NAND(_In_ uintq sid, _In_ uintq qi1, _In_ uintq qi2,
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->NAND(shards[simulator.get()][qi1], shards[simulator.get()][qi2], shards[simulator.get()][qo]);
+        simulator->NAND(shards[sid][qi1], shards[sid][qi2], shards[sid][qo]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1915,7 +2849,7 @@ MICROSOFT_QUANTUM_DECL void NOR(_In_ uintq sid, _In_ uintq qi1, _In_ uintq qi2,
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->NOR(shards[simulator.get()][qi1], shards[simulator.get()][qi2], shards[simulator.get()][qo]);
+        simulator->NOR(shards[sid][qi1], shards[sid][qi2], shards[sid][qo]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1928,7 +2862,7 @@ MICROSOFT_QUANTUM_DECL void XNOR(_In_ uintq sid, _In_ uintq qi1, _In_ uintq qi2,
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->XNOR(shards[simulator.get()][qi1], shards[simulator.get()][qi2], shards[simulator.get()][qo]);
+        simulator->XNOR(shards[sid][qi1], shards[sid][qi2], shards[sid][qo]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1941,7 +2875,7 @@ MICROSOFT_QUANTUM_DECL void CLAND(_In_ uintq sid, _In_ bool ci, _In_ uintq qi, _
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->CLAND(ci, shards[simulator.get()][qi], shards[simulator.get()][qo]);
+        simulator->CLAND(ci, shards[sid][qi], shards[sid][qo]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1954,7 +2888,7 @@ MICROSOFT_QUANTUM_DECL void CLOR(_In_ uintq sid, _In_ bool ci, _In_ uintq qi, _I
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->CLOR(ci, shards[simulator.get()][qi], shards[simulator.get()][qo]);
+        simulator->CLOR(ci, shards[sid][qi], shards[sid][qo]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1967,7 +2901,7 @@ MICROSOFT_QUANTUM_DECL void CLXOR(_In_ uintq sid, _In_ bool ci, _In_ uintq qi, _
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->CLXOR(ci, shards[simulator.get()][qi], shards[simulator.get()][qo]);
+        simulator->CLXOR(ci, shards[sid][qi], shards[sid][qo]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1980,7 +2914,7 @@ MICROSOFT_QUANTUM_DECL void CLNAND(_In_ uintq sid, _In_ bool ci, _In_ uintq qi,
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->CLNAND(ci, shards[simulator.get()][qi], shards[simulator.get()][qo]);
+        simulator->CLNAND(ci, shards[sid][qi], shards[sid][qo]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -1993,7 +2927,7 @@ MICROSOFT_QUANTUM_DECL void CLNOR(_In_ uintq sid, _In_ bool ci, _In_ uintq qi, _
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->CLNOR(ci, shards[simulator.get()][qi], shards[simulator.get()][qo]);
+        simulator->CLNOR(ci, shards[sid][qi], shards[sid][qo]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -2006,7 +2940,7 @@ MICROSOFT_QUANTUM_DECL void CLXNOR(_In_ uintq sid, _In_ bool ci, _In_ uintq qi,
 
     QInterfacePtr simulator = simulators[sid];
     try {
-        simulator->CLXNOR(ci, shards[simulator.get()][qi], shards[simulator.get()][qo]);
+        simulator->CLXNOR(ci, shards[sid][qi], shards[sid][qo]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -2022,13 +2956,39 @@ MICROSOFT_QUANTUM_DECL double Prob(_In_ uintq sid, _In_ uintq q)
 
     try {
         QInterfacePtr simulator = simulators[sid];
-        return (double)simulator->Prob(shards[simulator.get()][q]);
+        return (double)simulator->Prob(shards[sid][q]);
     } catch (...) {
         simulatorErrors[sid] = 1;
         return (double)REAL1_DEFAULT_ARG;
     }
 }
 
+/**
+ * (External API) Get the probability that each of "n" qubits is in the |1> state, in one pass where possible.
+ */
+MICROSOFT_QUANTUM_DECL void ProbBits(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uintq* q, double* p)
+{
+    SIMULATOR_LOCK_GUARD(sid)
+
+    QInterfacePtr simulator = simulators[sid];
+    if (!simulator) {
+        return;
+    }
+
+    try {
+        std::vector<bitLenInt> bits(n);
+        for (uintq i = 0U; i < n; ++i) {
+            bits[i] = shards[sid][q[i]];
+        }
+        std::unique_ptr<real1[]> probs(new real1[n]);
+        simulator->ProbBits(bits, probs.get());
+        std::copy(probs.get(), probs.get() + n, p);
+    } catch (const std::exception& ex) {
+        simulatorErrors[sid] = 1;
+        std::cout << ex.what() << std::endl;
+    }
+}
+
 /**
  * (External API) Get the permutation expectation value, based upon the order of input qubits.
  */
@@ -2038,7 +2998,7 @@ MICROSOFT_QUANTUM_DECL double PermutationExpectation(_In_ uintq sid, _In_ uintq
 
     std::vector<bitLenInt> q(n);
     for (uintq i = 0U; i < n; ++i) {
-        q[i] = shards[simulators[sid].get()][c[i]];
+        q[i] = shards[sid][c[i]];
     }
 
     try {
@@ -2061,7 +3021,7 @@ MICROSOFT_QUANTUM_DECL void QFT(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uint
 #else
         std::vector<bitLenInt> q(n);
         for (uintq i = 0U; i < n; ++i) {
-            q[i] = shards[simulators[sid].get()][c[i]];
+            q[i] = shards[sid][c[i]];
         }
         simulator->QFTR(q);
 #endif
@@ -2081,7 +3041,7 @@ MICROSOFT_QUANTUM_DECL void IQFT(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uin
 #else
         std::vector<bitLenInt> q(n);
         for (uintq i = 0U; i < n; ++i) {
-            q[i] = shards[simulators[sid].get()][c[i]];
+            q[i] = shards[sid][c[i]];
         }
         simulator->IQFTR(q);
 #endif
@@ -2100,7 +3060,7 @@ MICROSOFT_QUANTUM_DECL void ADD(
 
     try {
         bitCapInt aTot = _combineA(na, a);
-        uintq start = MapArithmetic(simulator, n, q);
+        uintq start = MapArithmetic(sid, n, q);
         simulator->INC(aTot, start, n);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2115,7 +3075,7 @@ MICROSOFT_QUANTUM_DECL void SUB(
 
     try {
         bitCapInt aTot = _combineA(na, a);
-        uintq start = MapArithmetic(simulator, n, q);
+        uintq start = MapArithmetic(sid, n, q);
         simulator->DEC(aTot, start, n);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2130,8 +3090,8 @@ MICROSOFT_QUANTUM_DECL void ADDS(
 
     try {
         bitCapInt aTot = _combineA(na, a);
-        uintq start = MapArithmetic(simulator, n, q);
-        simulator->INCS(aTot, start, n, shards[simulator.get()][s]);
+        uintq start = MapArithmetic(sid, n, q);
+        simulator->INCS(aTot, start, n, shards[sid][s]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -2145,8 +3105,8 @@ MICROSOFT_QUANTUM_DECL void SUBS(
 
     try {
         bitCapInt aTot = _combineA(na, a);
-        uintq start = MapArithmetic(simulator, n, q);
-        simulator->DECS(aTot, start, n, shards[simulator.get()][s]);
+        uintq start = MapArithmetic(sid, n, q);
+        simulator->DECS(aTot, start, n, shards[sid][s]);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -2160,7 +3120,7 @@ MICROSOFT_QUANTUM_DECL void MCADD(_In_ uintq sid, _In_ uintq na, _In_reads_(na)
 
     try {
         bitCapInt aTot = _combineA(na, a);
-        uintq start = MapArithmetic(simulator, nq, q);
+        uintq start = MapArithmetic(sid, nq, q);
         simulator->CINC(aTot, start, nq, ctrlsArray);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2174,7 +3134,7 @@ MICROSOFT_QUANTUM_DECL void MCSUB(_In_ uintq sid, _In_ uintq na, _In_reads_(na)
 
     try {
         bitCapInt aTot = _combineA(na, a);
-        uintq start = MapArithmetic(simulator, nq, q);
+        uintq start = MapArithmetic(sid, nq, q);
         simulator->CDEC(aTot, start, nq, ctrlsArray);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2190,7 +3150,7 @@ MICROSOFT_QUANTUM_DECL void MUL(_In_ uintq sid, _In_ uintq na, _In_reads_(na) ui
 
     try {
         bitCapInt aTot = _combineA(na, a);
-        MapArithmeticResult2 starts = MapArithmetic2(simulator, n, q, o);
+        MapArithmeticResult2 starts = MapArithmetic2(sid, n, q, o);
         QALU(simulator)->MUL(aTot, starts.start1, starts.start2, n);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2205,7 +3165,7 @@ MICROSOFT_QUANTUM_DECL void DIV(_In_ uintq sid, _In_ uintq na, _In_reads_(na) ui
 
     try {
         bitCapInt aTot = _combineA(na, a);
-        MapArithmeticResult2 starts = MapArithmetic2(simulator, n, q, o);
+        MapArithmeticResult2 starts = MapArithmetic2(sid, n, q, o);
         QALU(simulator)->DIV(aTot, starts.start1, starts.start2, n);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2221,7 +3181,7 @@ MICROSOFT_QUANTUM_DECL void MULN(_In_ uintq sid, _In_ uintq na, _In_reads_(na) u
     try {
         bitCapInt aTot = _combineA(na, a);
         bitCapInt mTot = _combineA(na, m);
-        MapArithmeticResult2 starts = MapArithmetic2(simulator, n, q, o);
+        MapArithmeticResult2 starts = MapArithmetic2(sid, n, q, o);
         QALU(simulator)->MULModNOut(aTot, mTot, starts.start1, starts.start2, n);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2237,7 +3197,7 @@ MICROSOFT_QUANTUM_DECL void DIVN(_In_ uintq sid, _In_ uintq na, _In_reads_(na) u
     try {
         bitCapInt aTot = _combineA(na, a);
         bitCapInt mTot = _combineA(na, m);
-        MapArithmeticResult2 starts = MapArithmetic2(simulator, n, q, o);
+        MapArithmeticResult2 starts = MapArithmetic2(sid, n, q, o);
         QALU(simulator)->IMULModNOut(aTot, mTot, starts.start1, starts.start2, n);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2253,7 +3213,7 @@ MICROSOFT_QUANTUM_DECL void POWN(_In_ uintq sid, _In_ uintq na, _In_reads_(na) u
     try {
         bitCapInt aTot = _combineA(na, a);
         bitCapInt mTot = _combineA(na, m);
-        MapArithmeticResult2 starts = MapArithmetic2(simulator, n, q, o);
+        MapArithmeticResult2 starts = MapArithmetic2(sid, n, q, o);
         QALU(simulator)->POWModNOut(aTot, mTot, starts.start1, starts.start2, n);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2268,7 +3228,7 @@ MICROSOFT_QUANTUM_DECL void MCMUL(_In_ uintq sid, _In_ uintq na, _In_reads_(na)
 
     try {
         bitCapInt aTot = _combineA(na, a);
-        MapArithmeticResult2 starts = MapArithmetic2(simulator, n, q, o);
+        MapArithmeticResult2 starts = MapArithmetic2(sid, n, q, o);
         QALU(simulator)->CMUL(aTot, starts.start1, starts.start2, n, ctrlsArray);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2282,7 +3242,7 @@ MICROSOFT_QUANTUM_DECL void MCDIV(_In_ uintq sid, _In_ uintq na, _In_reads_(na)
 
     try {
         bitCapInt aTot = _combineA(na, a);
-        MapArithmeticResult2 starts = MapArithmetic2(simulator, n, q, o);
+        MapArithmeticResult2 starts = MapArithmetic2(sid, n, q, o);
         QALU(simulator)->CDIV(aTot, starts.start1, starts.start2, n, ctrlsArray);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2297,7 +3257,7 @@ MICROSOFT_QUANTUM_DECL void MCMULN(_In_ uintq sid, _In_ uintq na, _In_reads_(na)
     try {
         bitCapInt aTot = _combineA(na, a);
         bitCapInt mTot = _combineA(na, m);
-        MapArithmeticResult2 starts = MapArithmetic2(simulator, n, q, o);
+        MapArithmeticResult2 starts = MapArithmetic2(sid, n, q, o);
         QALU(simulator)->CMULModNOut(aTot, mTot, starts.start1, starts.start2, n, ctrlsArray);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2312,7 +3272,7 @@ MICROSOFT_QUANTUM_DECL void MCDIVN(_In_ uintq sid, _In_ uintq na, _In_reads_(na)
     try {
         bitCapInt aTot = _combineA(na, a);
         bitCapInt mTot = _combineA(na, m);
-        MapArithmeticResult2 starts = MapArithmetic2(simulator, n, q, o);
+        MapArithmeticResult2 starts = MapArithmetic2(sid, n, q, o);
         QALU(simulator)->CIMULModNOut(aTot, mTot, starts.start1, starts.start2, n, ctrlsArray);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2327,7 +3287,7 @@ MICROSOFT_QUANTUM_DECL void MCPOWN(_In_ uintq sid, _In_ uintq na, _In_reads_(na)
     try {
         bitCapInt aTot = _combineA(na, a);
         bitCapInt mTot = _combineA(na, m);
-        MapArithmeticResult2 starts = MapArithmetic2(simulator, n, q, o);
+        MapArithmeticResult2 starts = MapArithmetic2(sid, n, q, o);
         QALU(simulator)->CPOWModNOut(aTot, mTot, starts.start1, starts.start2, n, ctrlsArray);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2342,7 +3302,7 @@ MICROSOFT_QUANTUM_DECL void LDA(
     QInterfacePtr simulator = simulators[sid];
 
     try {
-        MapArithmeticResult2 starts = MapArithmetic3(simulator, ni, qi, nv, qv);
+        MapArithmeticResult2 starts = MapArithmetic3(sid, ni, qi, nv, qv);
         QALU(simulator)->IndexedLDA(starts.start1, ni, starts.start2, nv, t, true);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2356,8 +3316,8 @@ MICROSOFT_QUANTUM_DECL void ADC(_In_ uintq sid, uintq s, _In_ uintq ni, _In_read
     QInterfacePtr simulator = simulators[sid];
 
     try {
-        MapArithmeticResult2 starts = MapArithmetic3(simulator, ni, qi, nv, qv);
-        QALU(simulator)->IndexedADC(starts.start1, ni, starts.start2, nv, shards[simulator.get()][s], t);
+        MapArithmeticResult2 starts = MapArithmetic3(sid, ni, qi, nv, qv);
+        QALU(simulator)->IndexedADC(starts.start1, ni, starts.start2, nv, shards[sid][s], t);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -2370,8 +3330,8 @@ MICROSOFT_QUANTUM_DECL void SBC(_In_ uintq sid, uintq s, _In_ uintq ni, _In_read
     QInterfacePtr simulator = simulators[sid];
 
     try {
-        MapArithmeticResult2 starts = MapArithmetic3(simulator, ni, qi, nv, qv);
-        QALU(simulator)->IndexedSBC(starts.start1, ni, starts.start2, nv, shards[simulator.get()][s], t);
+        MapArithmeticResult2 starts = MapArithmetic3(sid, ni, qi, nv, qv);
+        QALU(simulator)->IndexedSBC(starts.start1, ni, starts.start2, nv, shards[sid][s], t);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
         std::cout << ex.what() << std::endl;
@@ -2383,7 +3343,7 @@ MICROSOFT_QUANTUM_DECL void Hash(_In_ uintq sid, _In_ uintq n, _In_reads_(n) uin
     QInterfacePtr simulator = simulators[sid];
 
     try {
-        uintq start = MapArithmetic(simulator, n, q);
+        uintq start = MapArithmetic(sid, n, q);
         QALU(simulator)->Hash(start, n, t);
     } catch (const std::exception& ex) {
         simulatorErrors[sid] = 1;
@@ -2398,7 +3358,7 @@ MICROSOFT_QUANTUM_DECL bool TrySeparate1Qb(_In_ uintq sid, _In_ uintq qi1)
 
     try {
         QInterfacePtr simulator = simulators[sid];
-        return simulators[sid]->TrySeparate(shards[simulator.get()][qi1]);
+        return simulators[sid]->TrySeparate(shards[sid][qi1]);
     } catch (...) {
         simulatorErrors[sid] = 1;
         return false;
@@ -2411,7 +3371,7 @@ MICROSOFT_QUANTUM_DECL bool TrySeparate2Qb(_In_ uintq sid, _In_ uintq qi1, _In_
 
     try {
         QInterfacePtr simulator = simulators[sid];
-        return simulators[sid]->TrySeparate(shards[simulator.get()][qi1], shards[simulator.get()][qi2]);
+        return simulators[sid]->TrySeparate(shards[sid][qi1], shards[sid][qi2]);
     } catch (...) {
         simulatorErrors[sid] = 1;
         return false;
@@ -2425,7 +3385,7 @@ MICROSOFT_QUANTUM_DECL bool TrySeparateTol(_In_ uintq sid, _In_ uintq n, _In_rea
     QInterfacePtr simulator = simulators[sid];
     std::vector<bitLenInt> bitArray(n);
     for (uintq i = 0U; i < n; ++i) {
-        bitArray[i] = shards[simulator.get()][q[i]];
+        bitArray[i] = shards[sid][q[i]];
     }
 
     try {
@@ -2459,6 +3419,261 @@ MICROSOFT_QUANTUM_DECL void SetTInjection(_In_ uintq sid, _In_ bool irs)
     }
 }
 
+/**
+ * (External API) Initialize a batch of "n" independent "q"-qubit registers, all in |0>, returning a batch ID. Batch
+ * qubit IDs are simply 0 to (q - 1); they are not remapped like simulator qubit IDs. The batch lives on the default
+ * OpenCL device, if there is one.
+ */
+MICROSOFT_QUANTUM_DECL uintq init_batch(_In_ uintq n, _In_ uintq q)
+{
+    const uintq bid = ReserveBatchId();
+
+    QBatchPtr batch;
+    bool isSuccess = true;
+    try {
+#if ENABLE_OPENCL
+        if (OCLEngine::Instance().GetDeviceCount()) {
+            batch = std::make_shared<QBatchOCL>((bitLenInt)q, (bitCapIntOcl)n, 0U, randNumGen);
+        } else {
+            batch = std::make_shared<QBatch>((bitLenInt)q, (bitCapIntOcl)n, 0U, randNumGen);
+        }
+#else
+        batch = std::make_shared<QBatch>((bitLenInt)q, (bitCapIntOcl)n, 0U, randNumGen);
+#endif
+    } catch (const std::exception& ex) {
+        std::cout << ex.what() << std::endl;
+        isSuccess = false;
+    }
+
+    const std::lock_guard<std::mutex> batchLock(batchMutexes[bid]);
+    batchSimulators[bid] = batch;
+    batchErrors[bid] = isSuccess ? 0 : 1;
+
+    return bid;
+}
+
+/**
+ * (External API) Destroy a register batch
+ */
+MICROSOFT_QUANTUM_DECL void destroy_batch(_In_ uintq bid)
+{
+    QBatchPtr batch;
+    if (true) {
+        const std::lock_guard<std::mutex> batchLock(batchMutexes[bid]);
+        batch.swap(batchSimulators[bid]);
+        batchErrors[bid] = 0;
+    }
+    batch = NULL;
+
+    const std::lock_guard<std::mutex> metaLock(metaOperationMutex);
+    batchReservations[bid] = false;
+}
+
+MICROSOFT_QUANTUM_DECL int get_batch_error(_In_ uintq bid) { return batchErrors[bid]; }
+
+/**
+ * (External API) Apply one arbitrary single-qubit matrix per register in the batch, ("m" holds 8 doubles, real and
+ * imaginary parts in row-major order, for each register, consecutively).
+ */
+MICROSOFT_QUANTUM_DECL void MtrxBatch(_In_ uintq bid, _In_ double* m, _In_ uintq q)
+{
+    MCMtrxBatch(bid, 0U, NULL, m, q);
+}
+
+/**
+ * (External API) Apply one arbitrary controlled single-qubit matrix per register in the batch, (with "m" as in
+ * MtrxBatch()).
+ */
+MICROSOFT_QUANTUM_DECL void MCMtrxBatch(
+    _In_ uintq bid, _In_ uintq n, _In_reads_(n) uintq* c, _In_ double* m, _In_ uintq q)
+{
+    BATCH_LOCK_GUARD(bid)
+
+    QBatchPtr batch = batchSimulators[bid];
+    const bitCapIntOcl mtrxCount = batch->GetBatchCount() << 2U;
+    std::unique_ptr<complex[]> mtrxs(new complex[mtrxCount]);
+    for (bitCapIntOcl i = 0U; i < mtrxCount; ++i) {
+        mtrxs[i] = complex((real1)m[i << 1U], (real1)m[(i << 1U) + 1U]);
+    }
+
+    std::vector<bitLenInt> ctrlsArray(n);
+    for (uintq i = 0U; i < n; ++i) {
+        ctrlsArray[i] = (bitLenInt)c[i];
+    }
+
+    try {
+        batch->MCMtrxBatch(ctrlsArray, mtrxs.get(), (bitLenInt)q);
+    } catch (const std::exception& ex) {
+        batchErrors[bid] = 1;
+        std::cout << ex.what() << std::endl;
+    }
+}
+
+/**
+ * (External API) Sample "s" shots of qubits "q" from every register in the batch, without collapse. "m" receives
+ * (batch count * s) results, register by register.
+ */
+MICROSOFT_QUANTUM_DECL void MeasureShotsBatch(
+    _In_ uintq bid, _In_ uintq n, _In_reads_(n) uintq* q, _In_ uintq s, uintq* m)
+{
+    BATCH_LOCK_GUARD(bid)
+
+    std::vector<bitCapInt> qPowers(n);
+    for (uintq i = 0U; i < n; ++i) {
+        qPowers[i] = Qrack::pow2((bitLenInt)q[i]);
+    }
+
+    try {
+        batchSimulators[bid]->MultiShotMeasureMask(qPowers, (unsigned)s, m);
+    } catch (const std::exception& ex) {
+        batchErrors[bid] = 1;
+        std::cout << ex.what() << std::endl;
+    }
+}
+
+/**
+ * (External API) Initialize a Pauli-frame sampler over "q" qubits, propagating "w" (64 to 512) shots at a time,
+ * returning a frames ID. Frames qubit IDs are simply 0 to (q - 1).
+ */
+MICROSOFT_QUANTUM_DECL uintq init_frames(_In_ uintq q, _In_ uintq w)
+{
+    const uintq fid = ReserveFramesId();
+
+    QStabilizerFramesPtr frames;
+    bool isSuccess = true;
+    try {
+        frames = std::make_shared<QStabilizerFrames>((bitLenInt)q, (size_t)w, randNumGen);
+    } catch (const std::exception& ex) {
+        std::cout << ex.what() << std::endl;
+        isSuccess = false;
+    }
+
+    const std::lock_guard<std::mutex> framesLock(framesMutexes[fid]);
+    framesSimulators[fid] = frames;
+    framesErrors[fid] = isSuccess ? 0 : 1;
+
+    return fid;
+}
+
+/**
+ * (External API) Destroy a Pauli-frame sampler
+ */
+MICROSOFT_QUANTUM_DECL void destroy_frames(_In_ uintq fid)
+{
+    QStabilizerFramesPtr frames;
+    if (true) {
+        const std::lock_guard<std::mutex> framesLock(framesMutexes[fid]);
+        frames.swap(framesSimulators[fid]);
+        framesErrors[fid] = 0;
+    }
+    frames = NULL;
+
+    const std::lock_guard<std::mutex> metaLock(metaOperationMutex);
+    framesReservations[fid] = false;
+}
+
+MICROSOFT_QUANTUM_DECL int get_frames_error(_In_ uintq fid) { return framesErrors[fid]; }
+
+/**
+ * (External API) Append one operation to the recorded circuit: "op" is a Qrack::FrameOpType code, "q2" is ignored for
+ * single-qubit operations, and "p" is the error (or measurement flip) probability, ignored for noiseless gates.
+ */
+MICROSOFT_QUANTUM_DECL void FramesAppend(_In_ uintq fid, _In_ uintq op, _In_ uintq q1, _In_ uintq q2, _In_ double p)
+{
+    FRAMES_LOCK_GUARD(fid)
+
+    QStabilizerFramesPtr frames = framesSimulators[fid];
+    try {
+        switch ((FrameOpType)op) {
+        case FRAME_H:
+            frames->H((bitLenInt)q1);
+            break;
+        case FRAME_S:
+            frames->S((bitLenInt)q1);
+            break;
+        case FRAME_IS:
+            frames->IS((bitLenInt)q1);
+            break;
+        case FRAME_X:
+            frames->X((bitLenInt)q1);
+            break;
+        case FRAME_Y:
+            frames->Y((bitLenInt)q1);
+            break;
+        case FRAME_Z:
+            frames->Z((bitLenInt)q1);
+            break;
+        case FRAME_CNOT:
+            frames->CNOT((bitLenInt)q1, (bitLenInt)q2);
+            break;
+        case FRAME_CY:
+            frames->CY((bitLenInt)q1, (bitLenInt)q2);
+            break;
+        case FRAME_CZ:
+            frames->CZ((bitLenInt)q1, (bitLenInt)q2);
+            break;
+        case FRAME_SWAP:
+            frames->Swap((bitLenInt)q1, (bitLenInt)q2);
+            break;
+        case FRAME_X_ERROR:
+            frames->XError((bitLenInt)q1, (real1_f)p);
+            break;
+        case FRAME_Y_ERROR:
+            frames->YError((bitLenInt)q1, (real1_f)p);
+            break;
+        case FRAME_Z_ERROR:
+            frames->ZError((bitLenInt)q1, (real1_f)p);
+            break;
+        case FRAME_DEPOLARIZE1:
+            frames->Depolarize1((bitLenInt)q1, (real1_f)p);
+            break;
+        case FRAME_DEPOLARIZE2:
+            frames->Depolarize2((bitLenInt)q1, (bitLenInt)q2, (real1_f)p);
+            break;
+        case FRAME_M:
+            frames->M((bitLenInt)q1, (real1_f)p);
+            break;
+        case FRAME_R:
+            frames->R((bitLenInt)q1);
+            break;
+        default:
+            throw std::invalid_argument("FramesAppend() op code is not a valid FrameOpType!");
+        }
+    } catch (const std::exception& ex) {
+        framesErrors[fid] = 1;
+        std::cout << ex.what() << std::endl;
+    }
+}
+
+/**
+ * (External API) Number of measurements in the recorded circuit, (bits per shot record)
+ */
+MICROSOFT_QUANTUM_DECL uintq FramesMeasurementCount(_In_ uintq fid)
+{
+    const std::lock_guard<std::mutex> framesLock(framesMutexes[fid]);
+    if (!framesSimulators[fid]) {
+        return 0U;
+    }
+
+    return (uintq)framesSimulators[fid]->GetMeasurementCount();
+}
+
+/**
+ * (External API) Sample "s" shots of the recorded circuit. "m" receives one packed record per shot, of
+ * ceil(FramesMeasurementCount() / 64) words each, with measurement "i" in bit (i % 64) of word (i / 64).
+ */
+MICROSOFT_QUANTUM_DECL void MeasureShotsFrames(_In_ uintq fid, _In_ uintq s, uintq* m)
+{
+    FRAMES_LOCK_GUARD(fid)
+
+    try {
+        framesSimulators[fid]->MeasureShots((unsigned)s, m);
+    } catch (const std::exception& ex) {
+        framesErrors[fid] = 1;
+        std::cout << ex.what() << std::endl;
+    }
+}
+
 #if !(FPPOW < 6 && !ENABLE_COMPLEX_X2)
 /**
  * (External API) Simulate a Hamiltonian
@@ -0,0 +1,297 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qbatch.hpp"
+
+#include "common/counter_rng.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace Qrack {
+
+QBatch::QBatch(
+    bitLenInt qBitCount, bitCapIntOcl batches, bitCapInt initState, qrack_rand_gen_ptr rgp, bool useHardwareRNG)
+    : qubitCount(qBitCount)
+    , batchCount(batches)
+    , maxQPowerOcl(pow2Ocl(qBitCount))
+    , rand_distribution(ZERO_R1_F, ONE_R1_F)
+    , hardware_rand_generator(NULL)
+{
+    if (!batchCount) {
+        throw std::invalid_argument("QBatch requires at least one register in the batch!");
+    }
+    if ((qBitCount >= (bitLenInt)(sizeof(bitCapIntOcl) * 8U)) ||
+        (((batchCount * maxQPowerOcl) / maxQPowerOcl) != batchCount)) {
+        throw std::invalid_argument("QBatch total amplitude count must fit in bitCapIntOcl!");
+    }
+
+#if !ENABLE_RDRAND && !ENABLE_RNDFILE && !ENABLE_DEVRAND
+    useHardwareRNG = false;
+#endif
+    if (useHardwareRNG) {
+        hardware_rand_generator = std::make_shared<RdRandom>();
+#if !ENABLE_RNDFILE && !ENABLE_DEVRAND
+        if (!hardware_rand_generator->SupportsRDRAND()) {
+            hardware_rand_generator = NULL;
+        }
+#endif
+    }
+    if (!rgp && !hardware_rand_generator) {
+        std::random_device rd;
+        rand_generator = std::make_shared<qrack_rand_gen>(rd());
+    } else {
+        rand_generator = rgp;
+    }
+
+    SetConcurrencyLevel(std::thread::hardware_concurrency());
+
+    stateVec = std::unique_ptr<complex[]>(new complex[batchCount * maxQPowerOcl]);
+    SetPermutation(initState);
+}
+
+void QBatch::SetPermutation(bitCapInt perm)
+{
+    const bitCapIntOcl permOcl = (bitCapIntOcl)perm & (maxQPowerOcl - 1U);
+    par_for(0U, batchCount * maxQPowerOcl, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        stateVec[lcv] = ((lcv & (maxQPowerOcl - 1U)) == permOcl) ? ONE_CMPLX : ZERO_CMPLX;
+    });
+    InvalidateDevice();
+}
+
+void QBatch::SetQuantumState(bitCapIntOcl batch, complex const* inputState)
+{
+    ThrowIfBadBatch(batch, "QBatch::SetQuantumState");
+    SyncToHost();
+    std::copy(inputState, inputState + maxQPowerOcl, GetBatchPtr(batch));
+    InvalidateDevice();
+}
+
+void QBatch::GetQuantumState(bitCapIntOcl batch, complex* outputState)
+{
+    ThrowIfBadBatch(batch, "QBatch::GetQuantumState");
+    SyncToHost();
+    complex const* amps = GetBatchPtr(batch);
+    std::copy(amps, amps + maxQPowerOcl, outputState);
+}
+
+void QBatch::GetProbs(bitCapIntOcl batch, real1* outputProbs)
+{
+    ThrowIfBadBatch(batch, "QBatch::GetProbs");
+    SyncToHost();
+    complex const* amps = GetBatchPtr(batch);
+    std::transform(amps, amps + maxQPowerOcl, outputProbs, [](const complex& amp) { return (real1)norm(amp); });
+}
+
+complex QBatch::GetAmplitude(bitCapIntOcl batch, bitCapInt perm)
+{
+    ThrowIfBadBatch(batch, "QBatch::GetAmplitude");
+    if (perm >= maxQPowerOcl) {
+        throw std::invalid_argument("QBatch::GetAmplitude argument out-of-bounds!");
+    }
+    SyncToHost();
+
+    return GetBatchPtr(batch)[(bitCapIntOcl)perm];
+}
+
+void QBatch::SetAmplitude(bitCapIntOcl batch, bitCapInt perm, complex amp)
+{
+    ThrowIfBadBatch(batch, "QBatch::SetAmplitude");
+    if (perm >= maxQPowerOcl) {
+        throw std::invalid_argument("QBatch::SetAmplitude argument out-of-bounds!");
+    }
+
+    SyncToHost();
+    GetBatchPtr(batch)[(bitCapIntOcl)perm] = amp;
+    InvalidateDevice();
+}
+
+std::vector<bitCapIntOcl> QBatch::SortGatePowers(
+    const std::vector<bitLenInt>& controls, bitCapIntOcl controlPerm, bitLenInt target, bitCapIntOcl& controlMask)
+{
+    if (target >= qubitCount) {
+        throw std::invalid_argument("QBatch gate target parameter must be within allocated qubit bounds!");
+    }
+
+    const bitCapIntOcl targetPower = pow2Ocl(target);
+    std::vector<bitCapIntOcl> qPowersSorted;
+    qPowersSorted.reserve(controls.size() + 1U);
+    controlMask = 0U;
+    for (size_t i = 0U; i < controls.size(); ++i) {
+        if ((controls[i] >= qubitCount) || (controls[i] == target)) {
+            throw std::invalid_argument("QBatch gate control parameter must be a valid qubit, distinct from target!");
+        }
+        const bitCapIntOcl controlPower = pow2Ocl(controls[i]);
+        if ((controlPerm >> i) & 1U) {
+            controlMask |= controlPower;
+        }
+        qPowersSorted.push_back(controlPower);
+    }
+    qPowersSorted.push_back(targetPower);
+    std::sort(qPowersSorted.begin(), qPowersSorted.end());
+
+    return qPowersSorted;
+}
+
+void QBatch::ApplyControlled2x2(const std::vector<bitLenInt>& controls, bitCapIntOcl controlPerm,
+    complex const* mtrxs, bitCapIntOcl mtrxStride, bitLenInt target)
+{
+    bitCapIntOcl controlMask;
+    const std::vector<bitCapIntOcl> qPowersSorted = SortGatePowers(controls, controlPerm, target, controlMask);
+    const bitCapIntOcl targetPower = pow2Ocl(target);
+
+    // Register index sits above the qubit bits, so one masked dispatch covers every register.
+    const bitLenInt qubitCountConst = qubitCount;
+    complex* sv = stateVec.get();
+    par_for_mask(0U, batchCount * maxQPowerOcl, qPowersSorted, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        complex const* m = mtrxs + ((lcv >> qubitCountConst) * mtrxStride << 2U);
+        const bitCapIntOcl i0 = lcv | controlMask;
+        const bitCapIntOcl i1 = i0 | targetPower;
+        const complex y0 = sv[i0];
+        const complex y1 = sv[i1];
+        sv[i0] = m[0U] * y0 + m[1U] * y1;
+        sv[i1] = m[2U] * y0 + m[3U] * y1;
+    });
+}
+
+void QBatch::MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+{
+    ApplyControlled2x2(controls, pow2Ocl(controls.size()) - 1U, mtrx, 0U, target);
+}
+
+void QBatch::MCMtrxBatch(const std::vector<bitLenInt>& controls, complex const* mtrxs, bitLenInt target)
+{
+    ApplyControlled2x2(controls, pow2Ocl(controls.size()) - 1U, mtrxs, 1U, target);
+}
+
+void QBatch::H(bitLenInt target)
+{
+    const complex mtrx[4U]{ complex(SQRT1_2_R1, ZERO_R1), complex(SQRT1_2_R1, ZERO_R1),
+        complex(SQRT1_2_R1, ZERO_R1), complex(-SQRT1_2_R1, ZERO_R1) };
+    Mtrx(mtrx, target);
+}
+
+void QBatch::X(bitLenInt target)
+{
+    const complex mtrx[4U]{ ZERO_CMPLX, ONE_CMPLX, ONE_CMPLX, ZERO_CMPLX };
+    Mtrx(mtrx, target);
+}
+
+void QBatch::CNOT(bitLenInt control, bitLenInt target)
+{
+    const complex mtrx[4U]{ ZERO_CMPLX, ONE_CMPLX, ONE_CMPLX, ZERO_CMPLX };
+    MCMtrx({ control }, mtrx, target);
+}
+
+void QBatch::CZ(bitLenInt control, bitLenInt target)
+{
+    const complex mtrx[4U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, -ONE_CMPLX };
+    MCMtrx({ control }, mtrx, target);
+}
+
+void QBatch::RZBatch(real1_f const* angles, bitLenInt target)
+{
+    std::unique_ptr<complex[]> mtrxs(new complex[batchCount << 2U]);
+    for (bitCapIntOcl b = 0U; b < batchCount; ++b) {
+        const real1 cosine = (real1)cos(angles[b] / 2);
+        const real1 sine = (real1)sin(angles[b] / 2);
+        complex* m = mtrxs.get() + (b << 2U);
+        m[0U] = complex(cosine, -sine);
+        m[1U] = ZERO_CMPLX;
+        m[2U] = ZERO_CMPLX;
+        m[3U] = complex(cosine, sine);
+    }
+    MtrxBatch(mtrxs.get(), target);
+}
+
+void QBatch::RYBatch(real1_f const* angles, bitLenInt target)
+{
+    std::unique_ptr<complex[]> mtrxs(new complex[batchCount << 2U]);
+    for (bitCapIntOcl b = 0U; b < batchCount; ++b) {
+        const real1 cosine = (real1)cos(angles[b] / 2);
+        const real1 sine = (real1)sin(angles[b] / 2);
+        complex* m = mtrxs.get() + (b << 2U);
+        m[0U] = complex(cosine, ZERO_R1);
+        m[1U] = complex(-sine, ZERO_R1);
+        m[2U] = complex(sine, ZERO_R1);
+        m[3U] = complex(cosine, ZERO_R1);
+    }
+    MtrxBatch(mtrxs.get(), target);
+}
+
+real1_f QBatch::Prob(bitCapIntOcl batch, bitLenInt qubit)
+{
+    ThrowIfBadBatch(batch, "QBatch::Prob");
+    if (qubit >= qubitCount) {
+        throw std::invalid_argument("QBatch::Prob qubit index parameter must be within allocated qubit bounds!");
+    }
+
+    SyncToHost();
+    const bitCapIntOcl qPower = pow2Ocl(qubit);
+    complex const* amps = GetBatchPtr(batch);
+    real1 oneChance = ZERO_R1;
+    for (bitCapIntOcl i = 0U; i < maxQPowerOcl; ++i) {
+        if (i & qPower) {
+            oneChance += norm(amps[i]);
+        }
+    }
+
+    return (oneChance > ONE_R1) ? ONE_R1_F : (real1_f)oneChance;
+}
+
+void QBatch::MultiShotMeasureMask(
+    const std::vector<bitCapInt>& qPowers, unsigned shots, unsigned long long* shotsArray)
+{
+    if (!shots) {
+        return;
+    }
+
+    for (size_t i = 0U; i < qPowers.size(); ++i) {
+        if (qPowers[i] >= maxQPowerOcl) {
+            throw std::invalid_argument(
+                "QBatch::MultiShotMeasureMask parameter qPowers array values must be within allocated qubit bounds!");
+        }
+    }
+
+    SyncToHost();
+
+    // Each register samples its own counter-based stream under one seed, so registers run in parallel, reproducibly.
+    const uint64_t seed = RandSeed();
+
+    const bitCapIntOcl maskMaxQPower = pow2Ocl(qPowers.size());
+    par_for(0U, batchCount, [&](const bitCapIntOcl& b, const unsigned& cpu) {
+        complex const* amps = GetBatchPtr(b);
+        std::vector<real1_f> cumulative(maskMaxQPower, ZERO_R1_F);
+        for (bitCapIntOcl i = 0U; i < maxQPowerOcl; ++i) {
+            bitCapIntOcl maskPerm = 0U;
+            for (size_t j = 0U; j < qPowers.size(); ++j) {
+                if (i & (bitCapIntOcl)qPowers[j]) {
+                    maskPerm |= pow2Ocl(j);
+                }
+            }
+            cumulative[maskPerm] += (real1_f)norm(amps[i]);
+        }
+        for (bitCapIntOcl i = 1U; i < maskMaxQPower; ++i) {
+            cumulative[i] += cumulative[i - 1U];
+        }
+
+        const real1_f total = cumulative.back();
+        CounterRng gen(seed, b);
+        for (unsigned shot = 0U; shot < shots; ++shot) {
+            const bitCapIntOcl s = b * shots + shot;
+            const auto it = std::upper_bound(cumulative.begin(), cumulative.end(), gen.NextReal() * total);
+            shotsArray[s] = (unsigned long long)std::min(
+                (bitCapIntOcl)(it - cumulative.begin()), (bitCapIntOcl)(maskMaxQPower - 1U));
+        }
+    });
+}
+} // namespace Qrack
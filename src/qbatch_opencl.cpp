@@ -0,0 +1,112 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qbatch_opencl.hpp"
+
+namespace Qrack {
+
+#define CHECK_OCL(call, message)                                                                                       \
+    if ((call) != CL_SUCCESS) {                                                                                        \
+        throw std::runtime_error(message);                                                                             \
+    }
+
+QBatchOCL::QBatchOCL(bitLenInt qBitCount, bitCapIntOcl batches, bitCapInt initState, qrack_rand_gen_ptr rgp,
+    bool useHardwareRNG, int64_t deviceId)
+    : QBatch(qBitCount, batches, initState, rgp, useHardwareRNG)
+    , devID(deviceId)
+    , isHostStale(false)
+    , isDeviceStale(true)
+{
+    if (!(OCLEngine::Instance().GetDeviceCount())) {
+        throw std::runtime_error("Tried to initialize QBatchOCL, but no available OpenCL devices.");
+    }
+
+    device_context = OCLEngine::Instance().GetDeviceContextPtr(devID);
+    if (StateBytes() > device_context->GetMaxAlloc()) {
+        throw std::invalid_argument("QBatchOCL state vector buffer must fit in one OpenCL device allocation!");
+    }
+
+    cl_int error;
+    queue = cl::CommandQueue(device_context->context, device_context->device, 0, &error);
+    CHECK_OCL(error, "Failed to create OpenCL command queue for QBatchOCL!");
+
+    stateBuffer = std::make_shared<cl::Buffer>(
+        device_context->context, CL_MEM_READ_WRITE, StateBytes(), (void*)NULL, &error);
+    CHECK_OCL(error, "Failed to allocate QBatchOCL state vector buffer!");
+}
+
+void QBatchOCL::SyncToDevice()
+{
+    if (!isDeviceStale) {
+        return;
+    }
+
+    // (This blocks, so the host can write "stateVec" again as soon as we return.)
+    CHECK_OCL(queue.enqueueWriteBuffer(*stateBuffer, CL_TRUE, 0U, StateBytes(), stateVec.get()),
+        "Failed to write QBatchOCL state vector buffer!");
+
+    isDeviceStale = false;
+}
+
+void QBatchOCL::SyncToHost()
+{
+    if (!isHostStale) {
+        return;
+    }
+
+    CHECK_OCL(queue.enqueueReadBuffer(*stateBuffer, CL_TRUE, 0U, StateBytes(), stateVec.get()),
+        "Failed to read QBatchOCL state vector buffer!");
+
+    isHostStale = false;
+}
+
+void QBatchOCL::ApplyControlled2x2(const std::vector<bitLenInt>& controls, bitCapIntOcl controlPerm,
+    complex const* mtrxs, bitCapIntOcl mtrxStride, bitLenInt target)
+{
+    bitCapIntOcl controlMask;
+    std::vector<bitCapIntOcl> qPowersSorted = SortGatePowers(controls, controlPerm, target, controlMask);
+
+    SyncToDevice();
+
+    // (As for QEngineOCL::Apply2x2(), except for the last two, which locate each register's matrix.)
+    const bitCapIntOcl maxI = (batchCount * maxQPowerOcl) >> qPowersSorted.size();
+    bitCapIntOcl bciArgs[6U]{ controlMask | pow2Ocl(target), controlMask, maxI, (bitCapIntOcl)qPowersSorted.size(),
+        (bitCapIntOcl)qubitCount, mtrxStride };
+
+    // Small, per-gate, read-only buffers: they copy their host arrays when they're made, and the runtime keeps them
+    // alive until the kernel that uses them completes, so the launch does not have to block.
+    const size_t mtrxBytes = sizeof(complex) * 4U * (mtrxStride * (batchCount - 1U) + 1U);
+    cl_int error;
+    cl::Buffer mtrxBuffer(device_context->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, mtrxBytes,
+        (void*)mtrxs, &error);
+    CHECK_OCL(error, "Failed to allocate QBatchOCL matrix buffer!");
+    cl::Buffer bciBuffer(device_context->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(bciArgs),
+        (void*)bciArgs, &error);
+    CHECK_OCL(error, "Failed to allocate QBatchOCL argument buffer!");
+    cl::Buffer powersBuffer(device_context->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        sizeof(bitCapIntOcl) * qPowersSorted.size(), (void*)&(qPowersSorted[0U]), &error);
+    CHECK_OCL(error, "Failed to allocate QBatchOCL qubit power buffer!");
+
+    const size_t workItemCount = std::min((size_t)maxI, device_context->GetPreferredConcurrency());
+
+    OCLDeviceCall ocl = device_context->Reserve(OCL_API_BATCH_2X2);
+    ocl.call.setArg(0, *stateBuffer);
+    ocl.call.setArg(1, mtrxBuffer);
+    ocl.call.setArg(2, bciBuffer);
+    ocl.call.setArg(3, powersBuffer);
+    CHECK_OCL(queue.enqueueNDRangeKernel(ocl.call, cl::NullRange, cl::NDRange(workItemCount), cl::NullRange),
+        "Failed to enqueue QBatchOCL gate kernel!");
+    queue.flush();
+
+    isHostStale = true;
+}
+} // namespace Qrack
@@ -15,29 +15,21 @@
 // for details.
 
 #include "qbdt_node.hpp"
-
-#if ENABLE_PTHREAD
-#include <future>
-#include <thread>
-#endif
+#include "qbdt_unique_table.hpp"
 
 #define IS_NODE_0(c) (norm(c) <= _qrack_qbdt_sep_thresh)
 #define IS_NORM_0(c) (norm(c) <= FP_NORM_EPSILON)
+#define IS_SAME_SCALE(a, b) (norm((a) - (b)) <= (FP_NORM_EPSILON * FP_NORM_EPSILON))
 
 namespace Qrack {
 
-const unsigned numThreads = std::thread::hardware_concurrency() << 1U;
-#if ENABLE_ENV_VARS
-const bitLenInt pStridePow =
-    (((bitLenInt)(getenv("QRACK_PSTRIDEPOW") ? std::stoi(std::string(getenv("QRACK_PSTRIDEPOW"))) : PSTRIDEPOW)) +
-        1U) >>
-    1U;
-#else
-const bitLenInt pStridePow = (PSTRIDEPOW + 1U) >> 1U;
-#endif
-const bitCapInt pStride = pow2(pStridePow);
-
 void QBdtNode::Prune(bitLenInt depth, bitLenInt parDepth)
+{
+    QBdtUniqueTable table;
+    PruneUnique(depth, table, parDepth);
+}
+
+void QBdtNode::PruneUnique(bitLenInt depth, QBdtUniqueTable& table, bitLenInt parDepth)
 {
     if (!depth) {
         return;
@@ -56,58 +48,63 @@ void QBdtNode::Prune(bitLenInt depth, bitLenInt parDepth)
     }
     QBdtNodeInterfacePtr b1 = branches[1U];
 
+    // If we're already canonical, we're shared with a subtree that this pass already pruned.
+    if (table.IsCanonical(this, depth)) {
+        return;
+    }
+
     // Prune recursively to depth.
     --depth;
 
     if (b0.get() == b1.get()) {
         std::lock_guard<std::mutex> lock(b0->mtx);
-        b0->Prune(depth, parDepth);
+        b0->PruneUnique(depth, table, parDepth);
     } else {
         std::lock(b0->mtx, b1->mtx);
         std::lock_guard<std::mutex> lock0(b0->mtx, std::adopt_lock);
         std::lock_guard<std::mutex> lock1(b1->mtx, std::adopt_lock);
 
-#if ENABLE_QBDT_CPU_PARALLEL && ENABLE_PTHREAD
-        unsigned underThreads = (unsigned)(pow2(depth) / pStride);
-        if (underThreads == 1U) {
-            underThreads = 0U;
-        }
-        if ((depth >= pStridePow) && ((pow2(parDepth) * (underThreads + 1U)) <= numThreads)) {
+        if (IsParallelFork(depth, parDepth)) {
             ++parDepth;
-
-            std::future<void> future0 = std::async(std::launch::async, [&] { b0->Prune(depth, parDepth); });
-            b1->Prune(depth, parDepth);
-
-            future0.get();
+            _par_pair([&] { b0->PruneUnique(depth, table, parDepth); },
+                [&] { b1->PruneUnique(depth, table, parDepth); });
         } else {
-            b0->Prune(depth, parDepth);
-            b1->Prune(depth, parDepth);
+            b0->PruneUnique(depth, table, parDepth);
+            b1->PruneUnique(depth, table, parDepth);
         }
-#else
-        b0->Prune(depth, parDepth);
-        b1->Prune(depth, parDepth);
-#endif
     }
 
-    Normalize();
-
-    QBdtNodeInterfacePtr b0Ref = b0;
-    QBdtNodeInterfacePtr b1Ref = b1;
-
-    b0 = branches[0U];
-    b1 = branches[1U];
-
-    // When we lock a peer pair of (distinct) nodes, deadlock can arise from not locking both at once.
-    // However, we can't assume that peer pairs of nodes don't point to the same memory (and mutex).
-    // As we're locked on the node above already, our shared_ptr copies are safe.
+    // Branches might be shared with other parents, (through the unique table, or by QBdt gate application,) so we
+    // don't write to them in place: a branch that needs a different scale is replaced by an updated copy.
+    // (SetZero() takes the branch locks, itself.)
     if (b0.get() == b1.get()) {
+        if (IS_NODE_0(b0->scale)) {
+            SetZero();
+            return;
+        }
+
         std::lock_guard<std::mutex> lock(b0->mtx);
 
-        const complex phaseFac = std::polar(ONE_R1, (real1)(std::arg(b0->scale)));
-        scale *= phaseFac;
-        b0->scale /= phaseFac;
+        complex s0 = b0->scale / (real1)sqrt(2 * norm(b0->scale));
+        const complex phaseFac = std::polar(ONE_R1, (real1)std::arg(s0));
+        s0 /= phaseFac;
+
+        QBdtNodeInterfacePtr nb0 = b0;
+        if (!IS_SAME_SCALE(s0, b0->scale)) {
+            scale *= phaseFac;
+            nb0 = b0->ShallowClone();
+            nb0->scale = s0;
+        }
 
         // Phase factor applied, and branches point to same object.
+        branches[0U] = table.Emplace(nb0, depth);
+        branches[1U] = branches[0U];
+
+        return;
+    }
+
+    if ((norm(b0->scale) + norm(b1->scale)) <= _qrack_qbdt_sep_thresh) {
+        SetZero();
         return;
     }
 
@@ -115,81 +112,57 @@ void QBdtNode::Prune(bitLenInt depth, bitLenInt parDepth)
     std::lock_guard<std::mutex> lock0(b0->mtx, std::adopt_lock);
     std::lock_guard<std::mutex> lock1(b1->mtx, std::adopt_lock);
 
-    if (IS_NODE_0(b0->scale)) {
-        b0->SetZero();
-        b1->scale /= abs(b1->scale);
-    } else if (IS_NODE_0(b1->scale)) {
-        b1->SetZero();
-        b0->scale /= abs(b0->scale);
-    }
-
-    const complex phaseFac =
-        std::polar(ONE_R1, (real1)((b0->scale == ZERO_CMPLX) ? std::arg(b1->scale) : std::arg(b0->scale)));
-    scale *= phaseFac;
-
-    b0->scale /= phaseFac;
-    b1->scale /= phaseFac;
+    const real1 nrm = (real1)sqrt(norm(b0->scale) + norm(b1->scale));
 
-    // Now, we try to combine pointers to equivalent branches.
-    const bitCapInt depthPow = pow2(depth);
-    // Combine single elements at bottom of full depth, up to where branches are equal below:
-    _par_for_qbdt(depthPow, [&](const bitCapInt& i) {
-        const size_t topBit = SelectBit(i, depth - 1U);
-        QBdtNodeInterfacePtr leaf0 = b0->branches[topBit];
-        QBdtNodeInterfacePtr leaf1 = b1->branches[topBit];
-
-        if (!leaf0 || !leaf1 || (leaf0.get() == leaf1.get())) {
-            // WARNING: Mutates loop control variable!
-            return (bitCapInt)(pow2(depth) - ONE_BCI);
-        }
-
-        if (true) {
-            std::lock(leaf0->mtx, leaf1->mtx);
-            std::lock_guard<std::mutex> lock00(leaf0->mtx, std::adopt_lock);
-            std::lock_guard<std::mutex> lock11(leaf1->mtx, std::adopt_lock);
+    complex s0 = b0->scale / nrm;
+    complex s1 = b1->scale / nrm;
+    const bool isZero0 = IS_NODE_0(s0);
+    const bool isZero1 = !isZero0 && IS_NODE_0(s1);
+    if (isZero0) {
+        s0 = ZERO_CMPLX;
+        s1 /= abs(s1);
+    } else if (isZero1) {
+        s1 = ZERO_CMPLX;
+        s0 /= abs(s0);
+    }
 
-            if (leaf0->isEqual(leaf1)) {
-                b1->branches[topBit] = b0->branches[topBit];
+    const complex phaseFac = std::polar(ONE_R1, (real1)(isZero0 ? std::arg(s1) : std::arg(s0)));
+    s0 /= phaseFac;
+    s1 /= phaseFac;
 
-                // WARNING: Mutates loop control variable!
-                return (bitCapInt)(pow2(depth) - ONE_BCI);
-            }
+    const bool isChanged0 = isZero0 ? ((b0->scale != ZERO_CMPLX) || b0->branches[0U]) : !IS_SAME_SCALE(s0, b0->scale);
+    const bool isChanged1 = isZero1 ? ((b1->scale != ZERO_CMPLX) || b1->branches[0U]) : !IS_SAME_SCALE(s1, b1->scale);
+    if (isChanged0 || isChanged1) {
+        scale *= phaseFac;
+    }
+    // (The originals stay referenced until their locks are released.)
+    QBdtNodeInterfacePtr nb0 = b0;
+    QBdtNodeInterfacePtr nb1 = b1;
+    if (isChanged0) {
+        nb0 = b0->ShallowClone();
+        if (isZero0) {
+            nb0->SetZero();
+        } else {
+            nb0->scale = s0;
         }
-
-        for (bitLenInt j = 1U; j < depth; ++j) {
-            size_t bit = SelectBit(i, depth - (j + 1U));
-
-            QBdtNodeInterfacePtr lRef = leaf0;
-            QBdtNodeInterfacePtr rRef = leaf1;
-
-            std::lock(lRef->mtx, rRef->mtx);
-            std::lock_guard<std::mutex> lock0(lRef->mtx, std::adopt_lock);
-            std::lock_guard<std::mutex> lock1(rRef->mtx, std::adopt_lock);
-
-            leaf0 = lRef->branches[bit];
-            leaf1 = rRef->branches[bit];
-
-            if (!leaf0 || !leaf1 || (leaf0.get() == leaf1.get())) {
-                // WARNING: Mutates loop control variable!
-                return (bitCapInt)(pow2(depth - j) - ONE_BCI);
-            }
-
-            std::lock(leaf0->mtx, leaf1->mtx);
-            std::lock_guard<std::mutex> lock00(leaf0->mtx, std::adopt_lock);
-            std::lock_guard<std::mutex> lock11(leaf1->mtx, std::adopt_lock);
-
-            if (leaf0->isEqual(leaf1)) {
-                lRef->branches[bit] = rRef->branches[bit];
-
-                // WARNING: Mutates loop control variable!
-                return (bitCapInt)(pow2(depth - j) - ONE_BCI);
-            }
+    }
+    if (isChanged1) {
+        nb1 = b1->ShallowClone();
+        if (isZero1) {
+            nb1->SetZero();
+        } else {
+            nb1->scale = s1;
         }
+    }
 
-        return (bitCapInt)0U;
-    });
+    // Both branches are final now, so we replace them with their canonical equivalents, (which combines pointers to
+    // equal branches anywhere at this depth, in one lookup each).
+    branches[0U] = table.Emplace(nb0, depth);
+    branches[1U] = table.Emplace(nb1, depth);
 
-    if (b0 == b1) {
+    // Hybrid QEngine leaves aren't hashed, so compare those directly.
+    if (!depth && (branches[0U].get() != branches[1U].get()) && !nb0->branches[0U] && !nb1->branches[0U] &&
+        !dynamic_cast<QBdtNode*>(nb0.get()) && nb0->isEqual(nb1)) {
         branches[1U] = branches[0U];
     }
 }
@@ -209,8 +182,8 @@ void QBdtNode::Branch(bitLenInt depth, bitLenInt parDepth)
     QBdtNodeInterfacePtr b1 = branches[1U];
 
     if (!b0) {
-        branches[0U] = std::make_shared<QBdtNode>(SQRT1_2_R1);
-        branches[1U] = std::make_shared<QBdtNode>(SQRT1_2_R1);
+        branches[0U] = QBdtNode::Make(SQRT1_2_R1);
+        branches[1U] = QBdtNode::Make(SQRT1_2_R1);
     } else {
         // Split all clones.
         if (true) {
@@ -228,17 +201,14 @@ void QBdtNode::Branch(bitLenInt depth, bitLenInt parDepth)
     b0 = branches[0U];
     b1 = branches[1U];
 
-    if ((depth <= pStridePow) || (pow2(parDepth) > numThreads)) {
+    if (!IsParallelFork(depth, parDepth)) {
         b0->Branch(depth, parDepth);
         b1->Branch(depth, parDepth);
         return;
     }
 
     ++parDepth;
-
-    std::future<void> future0 = std::async(std::launch::async, [&] { b0->Branch(depth, parDepth); });
-    b1->Branch(depth, parDepth);
-    future0.get();
+    _par_pair([&] { b0->Branch(depth, parDepth); }, [&] { b1->Branch(depth, parDepth); });
 }
 
 void QBdtNode::Normalize(bitLenInt depth)
@@ -361,122 +331,108 @@ void QBdtNode::PopStateVector(bitLenInt depth, bitLenInt parDepth)
     b1->scale /= scale;
 }
 
-void QBdtNode::InsertAtDepth(QBdtNodeInterfacePtr b, bitLenInt depth, const bitLenInt& size, bitLenInt parDepth)
-{
-    if (!b) {
-        return;
-    }
+typedef std::unordered_map<QBdtNodeInterface*, QBdtNodeInterfacePtr> QBdtInsertTable;
 
-    if (IS_NODE_0(scale)) {
-        SetZero();
-        return;
+// Copy-on-write subtree "t" of an inserted tree, "depth" levels above its terminals, with "cont," (the node the tree
+// is inserted over,) continuing under every terminal
+static QBdtNodeInterfacePtr GraftUnder(
+    const QBdtNodeInterfacePtr& t, bitLenInt depth, const QBdtNodeInterfacePtr& cont, QBdtInsertTable& memo)
+{
+    if (IS_NODE_0(t->scale)) {
+        return t;
     }
 
-    QBdtNodeInterfacePtr b0 = branches[0U];
-    QBdtNodeInterfacePtr b1 = branches[1U];
-
+    const bool isContLeaf = !cont->branches[0U];
     if (!depth) {
-        if (!size) {
-            return;
+        if (isContLeaf && dynamic_cast<QBdtNode*>(cont.get())) {
+            // Appended at the bottom of the tree
+            return t;
         }
+        if (!dynamic_cast<QBdtNode*>(t.get())) {
+            throw std::domain_error("QBdtNode::InsertAtDepth() can't insert QEngine leaf qubits above tree qubits!");
+        }
+        QBdtNodeInterfacePtr x = cont->ShallowClone();
+        x->scale = t->scale;
 
-        QBdtNodeInterfacePtr c = ShallowClone();
-        scale = b->scale;
-
-        branches[0U] = b->branches[0U]->ShallowClone();
-        branches[1U] = b->branches[1U]->ShallowClone();
-
-        InsertAtDepth(c, size, 0U, parDepth);
-
-        return;
+        return x;
     }
-    --depth;
 
-    if (b0.get() == b1.get()) {
-        if (!depth && size) {
-            std::lock_guard<std::mutex> lock(b0->mtx);
-            QBdtNodeInterfacePtr n0 = std::make_shared<QBdtNode>(b0->scale, b->branches);
-            branches[0U] = n0;
-            branches[1U] = n0;
-            std::lock_guard<std::mutex> nLock(n0->mtx);
-            n0->InsertAtDepth(b, size, 0U, parDepth);
+    const auto it = memo.find(t.get());
+    if (it != memo.end()) {
+        return it->second;
+    }
 
-            return;
-        }
+    QBdtNodeInterfacePtr x = t->ShallowClone();
+    for (size_t k = 0U; k < 2U; ++k) {
+        x->branches[k] = GraftUnder(t->branches[k], depth - 1U, cont, memo);
+    }
+    memo[t.get()] = x;
 
-        std::lock_guard<std::mutex> lock(b0->mtx);
-        b0->InsertAtDepth(b, depth, size, parDepth);
+    return x;
+}
 
-        return;
+// Copy-on-write "n," with "b" inserted over every node "depth" levels under it
+static QBdtNodeInterfacePtr InsertUnder(const QBdtNodeInterfacePtr& n, bitLenInt depth, const QBdtNodeInterfacePtr& b,
+    const bitLenInt& size, std::vector<QBdtInsertTable>& memo)
+{
+    if (IS_NODE_0(n->scale)) {
+        return n;
     }
 
-    if (!depth && size) {
-        std::lock(b0->mtx, b1->mtx);
-        std::lock_guard<std::mutex> lock0(b0->mtx, std::adopt_lock);
-        std::lock_guard<std::mutex> lock1(b1->mtx, std::adopt_lock);
+    QBdtInsertTable& level = memo[depth];
+    const auto it = level.find(n.get());
+    if (it != level.end()) {
+        return it->second;
+    }
 
-        if (IS_NODE_0(b0->scale)) {
-            branches[1U] = std::make_shared<QBdtNode>(b1->scale, b->branches);
-            QBdtNodeInterfacePtr n1 = branches[1U];
-            std::lock_guard<std::mutex> nLock(n1->mtx);
-            n1->InsertAtDepth(b, size, 0U, parDepth);
-        } else if (IS_NODE_0(b0->scale)) {
-            branches[0U] = std::make_shared<QBdtNode>(b0->scale, b->branches);
-            QBdtNodeInterfacePtr n0 = branches[0U];
-            std::lock_guard<std::mutex> nLock(n0->mtx);
-            n0->InsertAtDepth(b, size, 0U, parDepth);
+    QBdtNodeInterfacePtr x;
+    if (depth) {
+        x = n->ShallowClone();
+        for (size_t k = 0U; k < 2U; ++k) {
+            x->branches[k] = InsertUnder(n->branches[k], depth - 1U, b, size, memo);
+        }
+    } else if (!b->branches[0U]) {
+        if (dynamic_cast<QBdtNode*>(n.get())) {
+            // A QEngine leaf appended under a tree terminal
+            x = b->ShallowClone();
+            x->scale *= n->scale;
         } else {
-            branches[0U] = std::make_shared<QBdtNode>(b0->scale, b->branches);
-            branches[1U] = std::make_shared<QBdtNode>(b1->scale, b->branches);
-            QBdtNodeInterfacePtr n0 = branches[0U];
-            QBdtNodeInterfacePtr n1 = branches[1U];
-            // These were just created, so there's no chance of deadlock in separate locks.
-            std::lock_guard<std::mutex> nLock0(n0->mtx);
-            std::lock_guard<std::mutex> nLock1(n1->mtx);
-
-#if ENABLE_QBDT_CPU_PARALLEL && ENABLE_PTHREAD
-            if ((depth >= pStridePow) && (pow2(parDepth) <= numThreads)) {
-                ++parDepth;
-
-                std::future<void> future0 =
-                    std::async(std::launch::async, [&] { n0->InsertAtDepth(b, size, 0U, parDepth); });
-                n1->InsertAtDepth(b, size, 0U, parDepth);
-
-                future0.get();
-            } else {
-                n0->InsertAtDepth(b, size, 0U, parDepth);
-                n1->InsertAtDepth(b, size, 0U, parDepth);
-            }
-#else
-            n0->InsertAtDepth(b, size, 0U, parDepth);
-            n1->InsertAtDepth(b, size, 0U, parDepth);
-#endif
+            // QEngine leaves are composed, (in a copy, since their engines can be shared).
+            x = n->ShallowClone();
+            x->Branch();
+            x->InsertAtDepth(b, 0U, size);
+        }
+    } else {
+        QBdtInsertTable graftMemo;
+        x = QBdtNode::Make(n->scale * b->scale);
+        for (size_t k = 0U; k < 2U; ++k) {
+            x->branches[k] = GraftUnder(b->branches[k], size - 1U, n, graftMemo);
         }
+    }
+    level[n.get()] = x;
 
+    return x;
+}
+
+void QBdtNode::InsertAtDepth(QBdtNodeInterfacePtr b, bitLenInt depth, const bitLenInt& size, bitLenInt parDepth)
+{
+    if (!b || !size) {
         return;
     }
 
-    std::lock(b0->mtx, b1->mtx);
-    std::lock_guard<std::mutex> lock0(b0->mtx, std::adopt_lock);
-    std::lock_guard<std::mutex> lock1(b1->mtx, std::adopt_lock);
-
-#if ENABLE_QBDT_CPU_PARALLEL && ENABLE_PTHREAD
-    if ((depth >= pStridePow) && (pow2(parDepth) <= numThreads)) {
-        ++parDepth;
+    if (IS_NODE_0(scale)) {
+        SetZero();
+        return;
+    }
 
-        std::future<void> future0 =
-            std::async(std::launch::async, [&] { b0->InsertAtDepth(b, depth, size, parDepth); });
-        b1->InsertAtDepth(b, depth, size, parDepth);
+    // Nodes under this one can be shared, (with clones, and with each other,) so the result is built copy-on-write,
+    // once per distinct subtree, and this root takes on its scale and branches.
+    std::vector<QBdtInsertTable> memo(depth + 1U);
+    const QBdtNodeInterfacePtr x = InsertUnder(ShallowClone(), depth, b, size, memo);
 
-        future0.get();
-    } else {
-        b0->InsertAtDepth(b, depth, size, parDepth);
-        b1->InsertAtDepth(b, depth, size, parDepth);
-    }
-#else
-    b0->InsertAtDepth(b, depth, size, parDepth);
-    b1->InsertAtDepth(b, depth, size, parDepth);
-#endif
+    scale = x->scale;
+    branches[0U] = x->branches[0U];
+    branches[1U] = x->branches[1U];
 }
 
 #if ENABLE_COMPLEX_X2
@@ -610,23 +566,14 @@ void QBdtNode::PushStateVector(const complex2& mtrxCol1, const complex2& mtrxCol
     b1->scale = SQRT1_2_R1;
 
     --depth;
-#if ENABLE_QBDT_CPU_PARALLEL && ENABLE_PTHREAD
-    if ((depth >= pStridePow) && (pow2(parDepth) <= numThreads)) {
+    if (IsParallelFork(depth, parDepth)) {
         ++parDepth;
-
-        std::future<void> future0 = std::async(std::launch::async,
-            [&] { b0->PushStateVector(mtrxCol1, mtrxCol2, b0->branches[0U], b1->branches[0U], depth, parDepth); });
-        b1->PushStateVector(mtrxCol1, mtrxCol2, b0->branches[1U], b1->branches[1U], depth, parDepth);
-
-        future0.get();
+        _par_pair([&] { b0->PushStateVector(mtrxCol1, mtrxCol2, b0->branches[0U], b1->branches[0U], depth, parDepth); },
+            [&] { b1->PushStateVector(mtrxCol1, mtrxCol2, b0->branches[1U], b1->branches[1U], depth, parDepth); });
     } else {
         b0->PushStateVector(mtrxCol1, mtrxCol2, b0->branches[0U], b1->branches[0U], depth, parDepth);
         b1->PushStateVector(mtrxCol1, mtrxCol2, b0->branches[1U], b1->branches[1U], depth, parDepth);
     }
-#else
-    b0->PushStateVector(mtrxCol1, mtrxCol2, b0->branches[0U], b1->branches[0U], depth);
-    b1->PushStateVector(mtrxCol1, mtrxCol2, b0->branches[1U], b1->branches[1U], depth);
-#endif
 
     b0->PopStateVector();
     b1->PopStateVector();
@@ -762,23 +709,14 @@ void QBdtNode::PushStateVector(
     b1->scale = SQRT1_2_R1;
 
     --depth;
-#if ENABLE_QBDT_CPU_PARALLEL && ENABLE_PTHREAD
-    if ((depth >= pStridePow) && (pow2(parDepth) <= numThreads)) {
+    if (IsParallelFork(depth, parDepth)) {
         ++parDepth;
-
-        std::future<void> future0 = std::async(std::launch::async,
-            [&] { b0->PushStateVector(mtrx, b0->branches[0U], b1->branches[0U], depth, parDepth); });
-        b1->PushStateVector(mtrx, b0->branches[1U], b1->branches[1U], depth, parDepth);
-
-        future0.get();
+        _par_pair([&] { b0->PushStateVector(mtrx, b0->branches[0U], b1->branches[0U], depth, parDepth); },
+            [&] { b1->PushStateVector(mtrx, b0->branches[1U], b1->branches[1U], depth, parDepth); });
     } else {
         b0->PushStateVector(mtrx, b0->branches[0U], b1->branches[0U], depth, parDepth);
         b1->PushStateVector(mtrx, b0->branches[1U], b1->branches[1U], depth, parDepth);
     }
-#else
-    b0->PushStateVector(mtrx, b0->branches[0U], b1->branches[0U], depth);
-    b1->PushStateVector(mtrx, b0->branches[1U], b1->branches[1U], depth);
-#endif
 
     b0->PopStateVector();
     b1->PopStateVector();
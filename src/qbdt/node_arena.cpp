@@ -0,0 +1,186 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// QBinaryDecision tree is an alternative approach to quantum state representation, as
+// opposed to state vector representation. This is a compressed form that can be
+// operated directly on while compressed. Inspiration for the Qrack implementation was
+// taken from JKQ DDSIM, maintained by the Institute for Integrated Circuits at the
+// Johannes Kepler University Linz:
+//
+// https://github.com/iic-jku/ddsim
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qbdt_node_arena.hpp"
+
+#include <mutex>
+#include <new>
+
+// Slot sizes are rounded up to this granularity, (which is also the slot alignment).
+#define QRACK_ARENA_ALIGN 16U
+// Size classes, (so, allocations up to 256 bytes are pooled, and anything larger goes to the heap).
+#define QRACK_ARENA_CLASSES 16U
+#define QRACK_ARENA_CHUNK_BYTES 65536U
+// Slots moved at once between a thread cache and the shared free list
+#define QRACK_ARENA_BATCH 64U
+
+namespace Qrack {
+
+struct ArenaSlot {
+    ArenaSlot* next;
+};
+
+struct ArenaPool {
+    std::mutex mtx;
+    ArenaSlot* freeList;
+
+    ArenaPool()
+        : freeList(NULL)
+    {
+    }
+};
+
+// Intentionally leaked, so nodes that outlive static destruction can still be freed.
+static ArenaPool* const arenaPools = new ArenaPool[QRACK_ARENA_CLASSES];
+
+struct ArenaCache {
+    ArenaSlot* heads[QRACK_ARENA_CLASSES];
+    size_t counts[QRACK_ARENA_CLASSES];
+
+    ArenaCache();
+    ~ArenaCache();
+};
+
+// Trivially destructible, so it can still be read after the owning thread's cache is gone.
+static thread_local bool isArenaCacheDead = false;
+static thread_local ArenaCache arenaCache;
+
+static void SpillSlots(size_t cls, ArenaSlot* head, size_t count)
+{
+    if (!count) {
+        return;
+    }
+
+    ArenaSlot* tail = head;
+    for (size_t i = 1U; i < count; ++i) {
+        tail = tail->next;
+    }
+
+    ArenaPool& pool = arenaPools[cls];
+    std::lock_guard<std::mutex> lock(pool.mtx);
+    tail->next = pool.freeList;
+    pool.freeList = head;
+}
+
+ArenaCache::ArenaCache()
+{
+    for (size_t i = 0U; i < QRACK_ARENA_CLASSES; ++i) {
+        heads[i] = NULL;
+        counts[i] = 0U;
+    }
+}
+
+ArenaCache::~ArenaCache()
+{
+    for (size_t i = 0U; i < QRACK_ARENA_CLASSES; ++i) {
+        SpillSlots(i, heads[i], counts[i]);
+    }
+    isArenaCacheDead = true;
+}
+
+// Refill a thread cache, from the shared free list, or else from a new chunk.
+static void RefillSlots(size_t cls, ArenaCache& cache)
+{
+    ArenaPool& pool = arenaPools[cls];
+    std::lock_guard<std::mutex> lock(pool.mtx);
+
+    if (!pool.freeList) {
+        const size_t slotSize = (cls + 1U) * QRACK_ARENA_ALIGN;
+        const size_t slotCount = QRACK_ARENA_CHUNK_BYTES / slotSize;
+        char* chunk = (char*)::operator new(slotCount * slotSize);
+        for (size_t i = 0U; i < slotCount; ++i) {
+            ArenaSlot* slot = (ArenaSlot*)(chunk + i * slotSize);
+            slot->next = pool.freeList;
+            pool.freeList = slot;
+        }
+    }
+
+    size_t count = 0U;
+    while (pool.freeList && (count < QRACK_ARENA_BATCH)) {
+        ArenaSlot* slot = pool.freeList;
+        pool.freeList = slot->next;
+        slot->next = cache.heads[cls];
+        cache.heads[cls] = slot;
+        ++count;
+    }
+    cache.counts[cls] += count;
+}
+
+void* QBdtNodeArena::Allocate(size_t size)
+{
+    const size_t cls = (size + QRACK_ARENA_ALIGN - 1U) / QRACK_ARENA_ALIGN - 1U;
+    if (!size || (cls >= QRACK_ARENA_CLASSES)) {
+        return ::operator new(size);
+    }
+
+    if (isArenaCacheDead) {
+        ArenaCache temp;
+        RefillSlots(cls, temp);
+        ArenaSlot* slot = temp.heads[cls];
+        temp.heads[cls] = slot->next;
+        --(temp.counts[cls]);
+
+        return slot;
+    }
+
+    ArenaCache& cache = arenaCache;
+    if (!cache.heads[cls]) {
+        RefillSlots(cls, cache);
+    }
+
+    ArenaSlot* slot = cache.heads[cls];
+    cache.heads[cls] = slot->next;
+    --(cache.counts[cls]);
+
+    return slot;
+}
+
+void QBdtNodeArena::Deallocate(void* p, size_t size)
+{
+    const size_t cls = (size + QRACK_ARENA_ALIGN - 1U) / QRACK_ARENA_ALIGN - 1U;
+    if (!size || (cls >= QRACK_ARENA_CLASSES)) {
+        ::operator delete(p);
+        return;
+    }
+
+    ArenaSlot* slot = (ArenaSlot*)p;
+
+    if (isArenaCacheDead) {
+        slot->next = NULL;
+        SpillSlots(cls, slot, 1U);
+        return;
+    }
+
+    ArenaCache& cache = arenaCache;
+    slot->next = cache.heads[cls];
+    cache.heads[cls] = slot;
+    ++(cache.counts[cls]);
+
+    if (cache.counts[cls] < (QRACK_ARENA_BATCH << 1U)) {
+        return;
+    }
+
+    // Keep one batch, and spill the rest.
+    ArenaSlot* keepTail = cache.heads[cls];
+    for (size_t i = 1U; i < QRACK_ARENA_BATCH; ++i) {
+        keepTail = keepTail->next;
+    }
+    ArenaSlot* spill = keepTail->next;
+    keepTail->next = NULL;
+    SpillSlots(cls, spill, cache.counts[cls] - QRACK_ARENA_BATCH);
+    cache.counts[cls] = QRACK_ARENA_BATCH;
+}
+} // namespace Qrack
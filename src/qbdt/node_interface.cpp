@@ -17,20 +17,14 @@
 #include "qbdt_node_interface.hpp"
 
 #if ENABLE_QBDT_CPU_PARALLEL && ENABLE_PTHREAD
-#include <future>
-#include <thread>
+#include "common/parallel_pool.hpp"
 #endif
 
 #define IS_NODE_0(c) (norm(c) <= _qrack_qbdt_sep_thresh)
 #define IS_SAME_AMP(a, b) (abs((a) - (b)) <= REAL1_EPSILON)
-#if ENABLE_QBDT_CPU_PARALLEL && ENABLE_PTHREAD
-#define ATOMIC_ASYNC(...)                                                                                              \
-    std::async(std::launch::async, [__VA_ARGS__]()
-#endif
 
 namespace Qrack {
 
-const unsigned numThreads = std::thread::hardware_concurrency() << 1U;
 #if ENABLE_ENV_VARS
 const bitLenInt pStridePow =
     (((bitLenInt)(getenv("QRACK_PSTRIDEPOW") ? std::stoi(std::string(getenv("QRACK_PSTRIDEPOW"))) : PSTRIDEPOW)) +
@@ -171,12 +165,10 @@ QBdtNodeInterfacePtr QBdtNodeInterface::RemoveSeparableAtDepth(
         --depth;
 
         QBdtNodeInterfacePtr toRet1, toRet2;
-        if ((depth >= pStridePow) && (pow2(parDepth) <= numThreads)) {
+        if (IsParallelFork(depth, parDepth)) {
             ++parDepth;
-            std::future<QBdtNodeInterfacePtr> future0 = std::async(
-                std::launch::async, [&] { return branches[0U]->RemoveSeparableAtDepth(depth, size, parDepth); });
-            toRet2 = branches[1U]->RemoveSeparableAtDepth(depth, size, parDepth);
-            toRet1 = future0.get();
+            _par_pair([&] { toRet1 = branches[0U]->RemoveSeparableAtDepth(depth, size, parDepth); },
+                [&] { toRet2 = branches[1U]->RemoveSeparableAtDepth(depth, size, parDepth); });
         } else {
             toRet1 = branches[0U]->RemoveSeparableAtDepth(depth, size, parDepth);
             toRet2 = branches[1U]->RemoveSeparableAtDepth(depth, size, parDepth);
@@ -203,12 +195,44 @@ QBdtNodeInterfacePtr QBdtNodeInterface::RemoveSeparableAtDepth(
 }
 
 #if ENABLE_QBDT_CPU_PARALLEL && ENABLE_PTHREAD
+bool QBdtNodeInterface::IsParallelFork(bitLenInt depth, bitLenInt parDepth)
+{
+    // Past about 4 pairs per pool thread, (counting the default parDepth of 1,) work stealing already balances the
+    // forks, and more of them only add queueing.
+    static const bitLenInt maxParDepth = []() {
+        const unsigned slots = ParallelPool::Instance().GetWorkerCount() + 1U;
+        if (slots == 1U) {
+            return (bitLenInt)0U;
+        }
+        bitLenInt l = 0U;
+        while ((1U << l) < slots) {
+            ++l;
+        }
+        return (bitLenInt)(l + 3U);
+    }();
+
+    // A subtree with fewer than pStridePow levels under it is too small to be worth a fork.
+    return (depth >= pStridePow) && (parDepth < maxParDepth);
+}
+
+void QBdtNodeInterface::_par_pair(std::function<void()> fn0, std::function<void()> fn1)
+{
+    ParallelPool::Instance().Run(2U, 2U, [&fn0, &fn1](const bitCapIntOcl& i, const unsigned& cpu) {
+        if (i) {
+            fn1();
+        } else {
+            fn0();
+        }
+    });
+}
+
 void QBdtNodeInterface::_par_for_qbdt(const bitCapInt end, BdtFunc fn)
 {
-    const bitCapInt Stride = pStride;
-    unsigned threads = (unsigned)(end / pStride);
-    if (threads > numThreads) {
-        threads = numThreads;
+    const bitCapIntOcl Stride = (bitCapIntOcl)pStride;
+    const bitCapIntOcl itemCount = (bitCapIntOcl)end;
+    unsigned threads = (unsigned)(itemCount / Stride);
+    if (threads > (ParallelPool::Instance().GetWorkerCount() + 1U)) {
+        threads = ParallelPool::Instance().GetWorkerCount() + 1U;
     }
 
     if (threads <= 1U) {
@@ -218,43 +242,26 @@ void QBdtNodeInterface::_par_for_qbdt(const bitCapInt end, BdtFunc fn)
         return;
     }
 
-    std::mutex myMutex;
-    bitCapInt idx = 0U;
-    std::vector<std::future<void>> futures(threads);
-    for (unsigned cpu = 0U; cpu != threads; ++cpu) {
-        futures[cpu] = ATOMIC_ASYNC(&myMutex, &idx, &end, &Stride, fn)
-        {
-            for (;;) {
-                bitCapInt i;
-                if (true) {
-                    std::lock_guard<std::mutex> lock(myMutex);
-                    i = idx++;
-                }
-                const bitCapInt l = i * Stride;
-                if (l >= end) {
-                    break;
-                }
-                const bitCapInt maxJ = ((l + Stride) < end) ? Stride : (end - l);
-                bitCapInt j;
-                for (j = 0U; j < maxJ; ++j) {
-                    bitCapInt k = j + l;
-                    k |= fn(k);
-                    j = k - l;
-                    if (j >= maxJ) {
-                        std::lock_guard<std::mutex> lock(myMutex);
-                        idx |= j / Stride;
-                        break;
-                    }
-                }
+    // A skip only holds inside one chunk; a later chunk that the skip covered just repeats redundant work.
+    ParallelPool::Instance().Run((itemCount + Stride - 1U) / Stride, threads,
+        [&itemCount, &Stride, &fn](const bitCapIntOcl& i, const unsigned& cpu) {
+            const bitCapIntOcl l = i * Stride;
+            const bitCapIntOcl maxJ = ((l + Stride) < itemCount) ? Stride : (itemCount - l);
+            for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
+                const bitCapIntOcl k = (bitCapIntOcl)(j + l) | (bitCapIntOcl)fn(j + l);
+                j = k - l;
             }
         });
-    }
-
-    for (unsigned cpu = 0U; cpu != threads; ++cpu) {
-        futures[cpu].get();
-    }
 }
 #else
+bool QBdtNodeInterface::IsParallelFork(bitLenInt depth, bitLenInt parDepth) { return false; }
+
+void QBdtNodeInterface::_par_pair(std::function<void()> fn0, std::function<void()> fn1)
+{
+    fn0();
+    fn1();
+}
+
 void QBdtNodeInterface::_par_for_qbdt(const bitCapInt end, BdtFunc fn)
 {
     for (bitCapInt j = 0U; j < end; ++j) {
@@ -188,8 +188,9 @@ void QBdtQEngineNode::PushSpecial(complex const* mtrx, QBdtNodeInterfacePtr& b1)
     qReg0->NormalizeState((real1_f)(ONE_R1 / norm(scale)), REAL1_DEFAULT_ARG, (real1_f)std::arg(scale));
     qReg1->NormalizeState((real1_f)(ONE_R1 / norm(b1->scale)), REAL1_DEFAULT_ARG, (real1_f)std::arg(b1->scale));
 
-    scale = SQRT1_2_R1;
-    b1->scale = SQRT1_2_R1;
+    // The scales are folded into the engines, now.
+    scale = ONE_CMPLX;
+    b1->scale = ONE_CMPLX;
 
     qReg0->ShuffleBuffers(qReg1);
 
@@ -217,7 +218,9 @@ void QBdtQEngineNode::PopStateVector(bitLenInt depth, bitLenInt unused)
         return;
     }
 
+    // A leaf can be popped again by its parent, after the push, so the norm is taken out of the engine into the
+    // existing scale, rather than replacing it.
     qReg->NormalizeState();
-    scale = std::polar((real1)sqrt(nrm), ZERO_R1);
+    scale *= (real1)sqrt(nrm);
 }
 } // namespace Qrack
@@ -15,8 +15,15 @@
 // for details.
 
 #include "qbdt_node.hpp"
+#include "qbdt_unique_table.hpp"
 #include "qfactory.hpp"
 
+#if ENABLE_QBDT_CPU_PARALLEL && ENABLE_PTHREAD
+#include "common/parallel_pool.hpp"
+#endif
+
+#include <unordered_set>
+
 #define IS_NODE_0(c) (norm(c) <= _qrack_qbdt_sep_thresh)
 
 namespace Qrack {
@@ -31,6 +38,11 @@ QBdt::QBdt(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt ini
     , root(NULL)
     , deviceIDs(devIds)
     , engines(eng)
+    , truncationThreshold(ZERO_R1_F)
+    , mergeEpsilon(ZERO_R1_F)
+    , unitaryFidelity(ONE_R1_F)
+    , attachSaturation(ZERO_R1_F)
+    , maxAttachedQubits(0U)
 {
     Init();
 
@@ -51,6 +63,11 @@ QBdt::QBdt(QEnginePtr enginePtr, std::vector<QInterfaceEngine> eng, bitLenInt qB
     , root(NULL)
     , deviceIDs(devIds)
     , engines(eng)
+    , truncationThreshold(ZERO_R1_F)
+    , mergeEpsilon(ZERO_R1_F)
+    , unitaryFidelity(ONE_R1_F)
+    , attachSaturation(ZERO_R1_F)
+    , maxAttachedQubits(0U)
 {
     Init();
 
@@ -67,6 +84,12 @@ void QBdt::Init()
 
     bdtStride = (GetStride() + 1U) >> 1U;
 
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_QBDT_HYBRID_SATURATION")) {
+        attachSaturation = (real1_f)std::stof(std::string(getenv("QRACK_QBDT_HYBRID_SATURATION")));
+    }
+#endif
+
     bitLenInt engineLevel = 0U;
     if (!engines.size()) {
         engines.push_back(QINTERFACE_OPTIMAL_BASE);
@@ -109,73 +132,6 @@ QBdtQEngineNodePtr QBdt::MakeQEngineNode(complex scale, bitLenInt qbCount, bitCa
                 hardware_rand_generator != NULL, false, (real1_f)amplitudeFloor, deviceIDs)));
 }
 
-void QBdt::par_for_qbdt(const bitCapInt& end, bitLenInt maxQubit, BdtFunc fn)
-{
-#if ENABLE_QBDT_CPU_PARALLEL && ENABLE_PTHREAD
-    Finish();
-    root->Branch(maxQubit);
-
-    const bitCapInt Stride = bdtStride;
-    unsigned underThreads = (unsigned)(pow2(qubitCount - (maxQubit + 1U)) / Stride);
-    if (underThreads == 1U) {
-        underThreads = 0U;
-    }
-    const unsigned nmCrs = (unsigned)(GetConcurrencyLevel() / (underThreads + 1U));
-    unsigned threads = (unsigned)(end / Stride);
-    if (threads > nmCrs) {
-        threads = nmCrs;
-    }
-
-    if (threads <= 1U) {
-        for (bitCapInt j = 0U; j < end; ++j) {
-            j |= fn(j);
-        }
-        root->Prune(maxQubit);
-        return;
-    }
-
-    std::mutex myMutex;
-    bitCapInt idx = 0U;
-    std::vector<std::future<void>> futures(threads);
-    for (unsigned cpu = 0U; cpu != threads; ++cpu) {
-        futures[cpu] = std::async(std::launch::async, [&myMutex, &idx, &end, &Stride, fn]() {
-            for (;;) {
-                bitCapInt i;
-                if (true) {
-                    std::lock_guard<std::mutex> lock(myMutex);
-                    i = idx++;
-                }
-                const bitCapInt l = i * Stride;
-                if (l >= end) {
-                    break;
-                }
-                const bitCapInt maxJ = ((l + Stride) < end) ? Stride : (end - l);
-                bitCapInt j;
-                for (j = 0U; j < maxJ; ++j) {
-                    bitCapInt k = j + l;
-                    k |= fn(k);
-                    j = k - l;
-                    if (j >= maxJ) {
-                        std::lock_guard<std::mutex> lock(myMutex);
-                        idx |= j / Stride;
-                        break;
-                    }
-                }
-            }
-        });
-    }
-
-    for (unsigned cpu = 0U; cpu != threads; ++cpu) {
-        futures[cpu].get();
-    }
-#else
-    for (bitCapInt j = 0U; j < end; ++j) {
-        j |= fn(j);
-    }
-#endif
-    root->Prune(maxQubit);
-}
-
 void QBdt::_par_for(const bitCapInt& end, ParallelFuncBdt fn)
 {
 #if ENABLE_QBDT_CPU_PARALLEL && ENABLE_PTHREAD
@@ -193,32 +149,16 @@ void QBdt::_par_for(const bitCapInt& end, ParallelFuncBdt fn)
         return;
     }
 
-    std::mutex myMutex;
-    bitCapInt idx = 0U;
-    std::vector<std::future<void>> futures(threads);
-    for (unsigned cpu = 0U; cpu != threads; ++cpu) {
-        futures[cpu] = std::async(std::launch::async, [&myMutex, &idx, &end, &Stride, cpu, fn]() {
-            for (;;) {
-                bitCapInt i;
-                if (true) {
-                    std::lock_guard<std::mutex> lock(myMutex);
-                    i = idx++;
-                }
-                const bitCapInt l = i * Stride;
-                if (l >= end) {
-                    break;
-                }
-                const bitCapInt maxJ = ((l + Stride) < end) ? Stride : (end - l);
-                for (bitCapInt j = 0U; j < maxJ; ++j) {
-                    fn(j + l, cpu);
-                }
+    const bitCapIntOcl itemCount = (bitCapIntOcl)end;
+    const bitCapIntOcl oclStride = (bitCapIntOcl)Stride;
+    ParallelPool::Instance().Run((itemCount + oclStride - 1U) / oclStride, threads,
+        [&itemCount, &oclStride, &fn](const bitCapIntOcl& i, const unsigned& cpu) {
+            const bitCapIntOcl l = i * oclStride;
+            const bitCapIntOcl maxJ = ((l + oclStride) < itemCount) ? oclStride : (itemCount - l);
+            for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
+                fn(j + l, cpu);
             }
         });
-    }
-
-    for (unsigned cpu = 0U; cpu != threads; ++cpu) {
-        futures[cpu].get();
-    }
 #else
     for (bitCapInt j = 0U; j < end; ++j) {
         fn(j, 0U);
@@ -243,6 +183,13 @@ void QBdt::SetPermutation(bitCapInt initState, complex phaseFac)
         }
     }
 
+    unitaryFidelity = ONE_R1_F;
+
+    if (attachSaturation > ZERO_R1_F) {
+        // A permutation state is best held entirely by the tree.
+        SetQubitCount(qubitCount, 0U);
+    }
+
     if (!bdtQubitCount) {
         root = MakeQEngineNode(phaseFac, attachedQubitCount, initState);
 
@@ -250,12 +197,12 @@ void QBdt::SetPermutation(bitCapInt initState, complex phaseFac)
     }
 
     const bitLenInt maxQubit = attachedQubitCount ? (bdtQubitCount - 1U) : bdtQubitCount;
-    root = std::make_shared<QBdtNode>(phaseFac);
+    root = QBdtNode::Make(phaseFac);
     QBdtNodeInterfacePtr leaf = root;
     for (bitLenInt qubit = 0U; qubit < maxQubit; ++qubit) {
         const size_t bit = SelectBit(initState, qubit);
-        leaf->branches[bit] = std::make_shared<QBdtNode>(ONE_CMPLX);
-        leaf->branches[bit ^ 1U] = std::make_shared<QBdtNode>(ZERO_CMPLX);
+        leaf->branches[bit] = QBdtNode::Make(ONE_CMPLX);
+        leaf->branches[bit ^ 1U] = QBdtNode::Make(ZERO_CMPLX);
         leaf = leaf->branches[bit];
     }
 
@@ -275,6 +222,9 @@ QInterfacePtr QBdt::Clone()
 
     copyPtr->root = root ? root->ShallowClone() : NULL;
     copyPtr->SetQubitCount(qubitCount, attachedQubitCount);
+    copyPtr->SetApproximation(truncationThreshold, mergeEpsilon);
+    copyPtr->SetHybridLeaves(attachSaturation, maxAttachedQubits);
+    copyPtr->unitaryFidelity = unitaryFidelity;
 
     if (!attachedQubitCount) {
         return copyPtr;
@@ -288,21 +238,173 @@ QInterfacePtr QBdt::Clone()
         return copyPtr;
     }
 
-    std::map<QEnginePtr, QEnginePtr> qis;
+    // Copy the tree down to its leaves, once per distinct node, and each distinct leaf engine once.
+    std::map<QEngine*, QEnginePtr> qis;
+    QBdtComputeTable memo(bdtQubitCount + 1U);
+    std::function<QBdtNodeInterfacePtr(const QBdtNodeInterfacePtr&, bitLenInt)> copyUnder =
+        [&](const QBdtNodeInterfacePtr& n, bitLenInt depth) -> QBdtNodeInterfacePtr {
+        if (IS_NODE_0(n->scale)) {
+            return n;
+        }
+
+        std::unordered_map<QBdtNodeInterface*, QBdtNodeInterfacePtr>& level = memo[depth];
+        const auto it = level.find(n.get());
+        if (it != level.end()) {
+            return it->second;
+        }
 
-    copyPtr->SetTraversal([&qis](bitCapIntOcl i, QBdtNodeInterfacePtr leaf) {
-        QBdtQEngineNodePtr qenp = std::dynamic_pointer_cast<QBdtQEngineNode>(leaf);
-        QEnginePtr qi = NODE_TO_QENGINE(qenp);
-        if (qis.find(qi) == qis.end()) {
-            qis[qi] = std::dynamic_pointer_cast<QEngine>(qi->Clone());
+        QBdtNodeInterfacePtr c = n->ShallowClone();
+        if (depth == bdtQubitCount) {
+            QEnginePtr& qi = NODE_TO_QENGINE(c);
+            QEnginePtr& cqi = qis[qi.get()];
+            if (!cqi) {
+                cqi = std::dynamic_pointer_cast<QEngine>(qi->Clone());
+            }
+            qi = cqi;
+        } else {
+            for (size_t k = 0U; k < 2U; ++k) {
+                c->branches[k] = copyUnder(n->branches[k], depth + 1U);
+            }
         }
-        NODE_TO_QENGINE(qenp) = qis[qi];
-    });
-    copyPtr->root->Prune(bdtQubitCount);
+        level[n.get()] = c;
+
+        return c;
+    };
+    copyPtr->root = copyUnder(root, 0U);
 
     return copyPtr;
 }
 
+// Node records, in the checkpoint node table
+#define QBDT_CHECKPOINT_END 0U
+#define QBDT_CHECKPOINT_NODE 1U
+#define QBDT_CHECKPOINT_QENGINE 2U
+#define QBDT_CHECKPOINT_NULL ((uint64_t)-1)
+
+void QBdt::SaveCheckpoint(CheckpointWriter& writer)
+{
+    Finish();
+
+    writer.BeginSection("QBDT");
+    writer.Write<uint64_t>(qubitCount);
+    writer.Write<uint64_t>(attachedQubitCount);
+
+    // The node table is written in post-order, so every record only refers to records before it. Shared subtrees,
+    // (and QEngine leaves shared between nodes,) are written once.
+    std::unordered_map<QBdtNodeInterface*, uint64_t> nodeIds;
+    std::unordered_map<QEngine*, uint64_t> engineIds;
+    std::function<uint64_t(const QBdtNodeInterfacePtr&)> save = [&](const QBdtNodeInterfacePtr& n) -> uint64_t {
+        if (!n) {
+            return QBDT_CHECKPOINT_NULL;
+        }
+        const auto it = nodeIds.find(n.get());
+        if (it != nodeIds.end()) {
+            return it->second;
+        }
+
+        QBdtQEngineNodePtr eLeaf = std::dynamic_pointer_cast<QBdtQEngineNode>(n);
+        if (eLeaf) {
+            uint64_t e = QBDT_CHECKPOINT_NULL;
+            bool isNewEngine = false;
+            if (eLeaf->qReg) {
+                const auto eIt = engineIds.find(eLeaf->qReg.get());
+                isNewEngine = eIt == engineIds.end();
+                e = isNewEngine ? (uint64_t)engineIds.size() : eIt->second;
+                if (isNewEngine) {
+                    engineIds[eLeaf->qReg.get()] = e;
+                }
+            }
+            writer.Write<uint8_t>(QBDT_CHECKPOINT_QENGINE);
+            writer.Write<complex>(n->scale);
+            writer.Write<uint64_t>(e);
+            if (isNewEngine) {
+                eLeaf->qReg->SaveCheckpoint(writer);
+            }
+        } else {
+            const uint64_t b0 = save(n->branches[0U]);
+            const uint64_t b1 = save(n->branches[1U]);
+            writer.Write<uint8_t>(QBDT_CHECKPOINT_NODE);
+            writer.Write<complex>(n->scale);
+            writer.Write<uint64_t>(b0);
+            writer.Write<uint64_t>(b1);
+        }
+
+        const uint64_t id = nodeIds.size();
+        nodeIds[n.get()] = id;
+
+        return id;
+    };
+
+    const uint64_t rootId = save(root);
+    writer.Write<uint8_t>(QBDT_CHECKPOINT_END);
+    writer.Write<uint64_t>(rootId);
+}
+
+void QBdt::LoadCheckpoint(CheckpointReader& reader)
+{
+    reader.ExpectSection("QBDT");
+    if (reader.Read<uint64_t>() != qubitCount) {
+        throw std::invalid_argument("QBdt::LoadCheckpoint() checkpoint qubit count does not match!");
+    }
+    const bitLenInt aqb = (bitLenInt)reader.Read<uint64_t>();
+    if (aqb > qubitCount) {
+        throw std::runtime_error("QBdt::LoadCheckpoint() checkpoint attached qubit count is invalid!");
+    }
+
+    Finish();
+    root = NULL;
+    SetQubitCount(qubitCount, aqb);
+
+    std::vector<QBdtNodeInterfacePtr> nodes;
+    std::vector<QEnginePtr> qRegs;
+    const auto getNode = [&nodes](uint64_t id) -> QBdtNodeInterfacePtr {
+        if (id == QBDT_CHECKPOINT_NULL) {
+            return NULL;
+        }
+        if (id >= nodes.size()) {
+            throw std::runtime_error("QBdt::LoadCheckpoint() checkpoint node table is invalid!");
+        }
+        return nodes[id];
+    };
+
+    for (;;) {
+        const uint8_t type = reader.Read<uint8_t>();
+        if (type == QBDT_CHECKPOINT_END) {
+            break;
+        }
+        const complex scale = reader.Read<complex>();
+
+        if (type == QBDT_CHECKPOINT_NODE) {
+            const uint64_t b0 = reader.Read<uint64_t>();
+            const uint64_t b1 = reader.Read<uint64_t>();
+            QBdtNodeInterfacePtr n = QBdtNode::Make(scale);
+            n->branches[0U] = getNode(b0);
+            n->branches[1U] = getNode(b1);
+            nodes.push_back(n);
+            continue;
+        }
+
+        if (type != QBDT_CHECKPOINT_QENGINE) {
+            throw std::runtime_error("QBdt::LoadCheckpoint() checkpoint node table is invalid!");
+        }
+
+        const uint64_t e = reader.Read<uint64_t>();
+        QEnginePtr qReg = NULL;
+        if (e == qRegs.size()) {
+            qReg = NODE_TO_QENGINE(MakeQEngineNode(ONE_CMPLX, attachedQubitCount));
+            qReg->LoadCheckpoint(reader);
+            qRegs.push_back(qReg);
+        } else if (e < qRegs.size()) {
+            qReg = qRegs[e];
+        } else if (e != QBDT_CHECKPOINT_NULL) {
+            throw std::runtime_error("QBdt::LoadCheckpoint() checkpoint node table is invalid!");
+        }
+        nodes.push_back(std::make_shared<QBdtQEngineNode>(scale, qReg));
+    }
+
+    root = getNode(reader.Read<uint64_t>());
+}
+
 template <typename Fn> void QBdt::GetTraversal(Fn getLambda)
 {
     Finish();
@@ -329,24 +431,35 @@ template <typename Fn> void QBdt::SetTraversal(Fn setLambda)
 {
     Dump();
 
-    root = std::make_shared<QBdtNode>();
+    root = QBdtNode::Make();
     root->Branch(bdtQubitCount);
 
-    _par_for(maxQPower, [&](const bitCapInt& i, const unsigned& cpu) {
-        QBdtNodeInterfacePtr prevLeaf = root;
-        QBdtNodeInterfacePtr leaf = root;
-        for (bitLenInt j = 0U; j < bdtQubitCount; ++j) {
-            prevLeaf = leaf;
-            leaf = leaf->branches[SelectBit(i, j)];
-        }
+    if (!attachedQubitCount) {
+        _par_for(maxQPower, [&](const bitCapInt& i, const unsigned& cpu) {
+            QBdtNodeInterfacePtr leaf = root;
+            for (bitLenInt j = 0U; j < bdtQubitCount; ++j) {
+                leaf = leaf->branches[SelectBit(i, j)];
+            }
 
-        if (attachedQubitCount) {
-            leaf = MakeQEngineNode(ONE_CMPLX, attachedQubitCount, 0U);
-            prevLeaf->branches[SelectBit(i, bdtQubitCount - 1U)] = leaf;
+            setLambda((bitCapIntOcl)i, leaf);
+        });
+    } else {
+        // Every tree path gets one leaf engine, which all of its amplitudes are then written into.
+        std::vector<QBdtNodeInterfacePtr> leaves((size_t)bdtMaxQPower);
+        for (bitCapIntOcl i = 0U; i < (bitCapIntOcl)bdtMaxQPower; ++i) {
+            QBdtNodeInterfacePtr prevLeaf = root;
+            for (bitLenInt j = 0U; j < (bdtQubitCount - 1U); ++j) {
+                prevLeaf = prevLeaf->branches[SelectBit(i, j)];
+            }
+            leaves[i] = MakeQEngineNode(ONE_CMPLX, attachedQubitCount, 0U);
+            prevLeaf->branches[SelectBit(i, bdtQubitCount - 1U)] = leaves[i];
         }
 
-        setLambda((bitCapIntOcl)i, leaf);
-    });
+        const bitCapIntOcl bdtMask = (bitCapIntOcl)bdtMaxQPower - 1U;
+        for (bitCapIntOcl i = 0U; i < (bitCapIntOcl)maxQPower; ++i) {
+            setLambda(i, leaves[i & bdtMask]);
+        }
+    }
 
     root->PopStateVector(bdtQubitCount);
     root->Prune(bdtQubitCount);
@@ -407,7 +520,8 @@ void QBdt::SetStateVector()
     }
 
     if (attachedQubitCount) {
-        throw std::domain_error("QBdt::SetStateVector() not yet implemented, after Attach() call!");
+        AttachStateVector(qubitCount);
+        return;
     }
 
     QBdtQEngineNodePtr nRoot = MakeQEngineNode(ONE_R1, qubitCount);
@@ -423,25 +537,268 @@ void QBdt::ResetStateVector(bitLenInt aqb)
 
     Finish();
 
-    if (!bdtQubitCount) {
-        QBdtQEngineNodePtr oRoot = std::dynamic_pointer_cast<QBdtQEngineNode>(root);
-        SetQubitCount(qubitCount, aqb);
-        SetQuantumState(NODE_TO_QENGINE(oRoot));
+    // Every distinct leaf engine is expanded into a subtree once, (with its own deepest "aqb" qubits left in
+    // engines,) and the leaves that share it share the subtree, too.
+    const bitLenInt length = attachedQubitCount - aqb;
+    std::map<QEngine*, QBdtNodeInterfacePtr> subtrees;
+    if (true) {
+        QBdtComputeTable memo(bdtQubitCount + 1U);
+        root = DetachUnder(root, 0U, length, aqb, memo, subtrees);
     }
 
-    const bitLenInt length = attachedQubitCount - aqb;
-    const bitLenInt oBdtQubitCount = bdtQubitCount;
-    QBdtPtr nQubits = std::make_shared<QBdt>(engines, length, 0U, rand_generator, ONE_CMPLX, doNormalize,
-        randGlobalPhase, false, -1, (hardware_rand_generator == NULL) ? false : true, false, (real1_f)amplitudeFloor);
-    nQubits->SetQubitCount(length, 0U);
-    nQubits->SetPermutation(0U);
-    root->InsertAtDepth(nQubits->root, oBdtQubitCount, length);
-    SetQubitCount(qubitCount + length, attachedQubitCount);
-    for (bitLenInt i = 0U; i < length; ++i) {
-        Swap(oBdtQubitCount + i, oBdtQubitCount + length + i);
+    SetQubitCount(qubitCount, aqb);
+    root->Prune(bdtQubitCount);
+}
+
+QBdtNodeInterfacePtr QBdt::DetachUnder(const QBdtNodeInterfacePtr& n, bitLenInt depth, bitLenInt length,
+    bitLenInt aqb, QBdtComputeTable& memo, std::map<QEngine*, QBdtNodeInterfacePtr>& subtrees)
+{
+    if (IS_NODE_0(n->scale)) {
+        if (depth < bdtQubitCount) {
+            return n;
+        }
+        return aqb ? (QBdtNodeInterfacePtr)std::make_shared<QBdtQEngineNode>() : QBdtNode::Make(ZERO_CMPLX);
+    }
+
+    std::unordered_map<QBdtNodeInterface*, QBdtNodeInterfacePtr>& level = memo[depth];
+    const auto it = level.find(n.get());
+    if (it != level.end()) {
+        return it->second;
+    }
+
+    QBdtNodeInterfacePtr toRet;
+    if (depth == bdtQubitCount) {
+        QEnginePtr qReg = NODE_TO_QENGINE(n);
+        QBdtNodeInterfacePtr& sub = subtrees[qReg.get()];
+        if (!sub) {
+            std::unique_ptr<complex[]> amps(new complex[(bitCapIntOcl)qReg->GetMaxQPower()]);
+            qReg->GetQuantumState(amps.get());
+            sub = MakeSubtree(amps.get(), 0U, length, aqb, 0U);
+            sub->PopStateVector(length);
+        }
+        toRet = sub->ShallowClone();
+        toRet->scale *= n->scale;
+    } else {
+        toRet = n->ShallowClone();
+        for (size_t k = 0U; k < 2U; ++k) {
+            toRet->branches[k] = DetachUnder(n->branches[k], depth + 1U, length, aqb, memo, subtrees);
+        }
+    }
+    level[n.get()] = toRet;
+
+    return toRet;
+}
+
+QBdtNodeInterfacePtr QBdt::MakeSubtree(
+    complex const* amps, bitLenInt depth, bitLenInt length, bitLenInt aqb, bitCapIntOcl offset)
+{
+    if (depth == length) {
+        if (!aqb) {
+            return QBdtNode::Make(amps[offset]);
+        }
+
+        const bitCapIntOcl maxJ = pow2Ocl(aqb);
+        std::unique_ptr<complex[]> slice(new complex[maxJ]);
+        for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
+            slice[j] = amps[offset | (j << length)];
+        }
+        QBdtQEngineNodePtr leaf = MakeQEngineNode(ONE_CMPLX, aqb);
+        leaf->qReg->SetQuantumState(slice.get());
+
+        return leaf;
+    }
+
+    // (Scales are left unnormalized, for PopStateVector().)
+    QBdtNodeInterfacePtr n = QBdtNode::Make(ONE_CMPLX);
+    n->branches[0U] = MakeSubtree(amps, depth + 1U, length, aqb, offset);
+    n->branches[1U] = MakeSubtree(amps, depth + 1U, length, aqb, offset | pow2Ocl(depth));
+
+    return n;
+}
+
+void QBdt::AttachStateVector(bitLenInt aqb)
+{
+    if (aqb > qubitCount) {
+        throw std::invalid_argument("QBdt::AttachStateVector argument out-of-bounds!");
+    }
+
+    if (aqb <= attachedQubitCount) {
+        ResetStateVector(aqb);
+        return;
+    }
+
+    Finish();
+
+    // Every distinct subtree under the new boundary becomes one QEngine leaf. The state under a node is fixed by its
+    // branches, not its own scale, so nodes that differ only in scale share their leaf engine, too.
+    const bitLenInt boundary = qubitCount - aqb;
+    QBdtAttachTable table;
+    if (true) {
+        QBdtComputeTable memo(boundary + 1U);
+        root = AttachUnder(root, 0U, boundary, memo, table);
+    }
+
+    const size_t subtreeCount = table.subtrees.size();
+    std::vector<QEnginePtr> qRegs(subtreeCount);
+    std::vector<real1> nrms(subtreeCount);
+    for (size_t i = 0U; i < subtreeCount; ++i) {
+        qRegs[i] = NODE_TO_QENGINE(MakeQEngineNode(ONE_CMPLX, aqb));
+    }
+
+    const bitCapIntOcl maxJ = pow2Ocl(aqb);
+    _par_for(subtreeCount, [&](const bitCapInt& i, const unsigned& cpu) {
+        const size_t k = (size_t)i;
+        std::unique_ptr<complex[]> amps(new complex[maxJ]());
+        FillUnder(table.subtrees[k], boundary, boundary, ONE_CMPLX, 0U, amps.get());
+
+        real1 nrm = ZERO_R1;
+        for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
+            nrm += norm(amps[j]);
+        }
+        nrms[k] = nrm;
+        if (nrm <= _qrack_qbdt_sep_thresh) {
+            return;
+        }
+
+        const real1 invNrm = ONE_R1 / (real1)sqrt(nrm);
+        for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
+            amps[j] *= invNrm;
+        }
+        qRegs[k]->SetQuantumState(amps.get());
+    });
+
+    for (size_t i = 0U; i < subtreeCount; ++i) {
+        for (const QBdtQEngineNodePtr& leaf : table.leaves[i]) {
+            if (nrms[i] <= _qrack_qbdt_sep_thresh) {
+                leaf->SetZero();
+            } else {
+                leaf->qReg = qRegs[i];
+                leaf->scale *= (real1)sqrt(nrms[i]);
+            }
+        }
+    }
+
+    SetQubitCount(qubitCount, aqb);
+    root->Prune(bdtQubitCount);
+}
+
+QBdtNodeInterfacePtr QBdt::AttachUnder(const QBdtNodeInterfacePtr& n, bitLenInt depth, bitLenInt boundary,
+    QBdtComputeTable& memo, QBdtAttachTable& table)
+{
+    if (IS_NODE_0(n->scale)) {
+        return (depth == boundary) ? std::make_shared<QBdtQEngineNode>() : n;
+    }
+
+    std::unordered_map<QBdtNodeInterface*, QBdtNodeInterfacePtr>& level = memo[depth];
+    const auto it = level.find(n.get());
+    if (it != level.end()) {
+        return it->second;
+    }
+
+    QBdtNodeInterfacePtr toRet;
+    if (depth == boundary) {
+        const std::pair<QBdtNodeInterface*, QBdtNodeInterface*> key(n->branches[0U].get(), n->branches[1U].get());
+        size_t i;
+        const auto tIt = table.index.find(key);
+        if (tIt == table.index.end()) {
+            i = table.subtrees.size();
+            table.index[key] = i;
+            table.subtrees.push_back(n);
+            table.leaves.emplace_back();
+        } else {
+            i = tIt->second;
+        }
+        QBdtQEngineNodePtr leaf = std::make_shared<QBdtQEngineNode>(n->scale, nullptr);
+        table.leaves[i].push_back(leaf);
+        toRet = leaf;
+    } else {
+        toRet = n->ShallowClone();
+        for (size_t k = 0U; k < 2U; ++k) {
+            toRet->branches[k] = AttachUnder(n->branches[k], depth + 1U, boundary, memo, table);
+        }
+    }
+    level[n.get()] = toRet;
+
+    return toRet;
+}
+
+void QBdt::FillUnder(const QBdtNodeInterfacePtr& n, bitLenInt depth, bitLenInt boundary, complex scale,
+    bitCapIntOcl offset, complex* amps)
+{
+    if (depth == bdtQubitCount) {
+        if (!attachedQubitCount) {
+            amps[offset] = scale;
+            return;
+        }
+
+        QEnginePtr qReg = NODE_TO_QENGINE(n);
+        const bitLenInt shift = bdtQubitCount - boundary;
+        const bitCapIntOcl maxJ = pow2Ocl(attachedQubitCount);
+        for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
+            amps[offset | (j << shift)] = scale * qReg->GetAmplitude(j);
+        }
+
+        return;
+    }
+
+    for (size_t k = 0U; k < 2U; ++k) {
+        const QBdtNodeInterfacePtr& b = n->branches[k];
+        if (!b || IS_NODE_0(b->scale)) {
+            continue;
+        }
+        FillUnder(b, depth + 1U, boundary, scale * b->scale, k ? (offset | pow2Ocl(depth - boundary)) : offset, amps);
+    }
+}
+
+bitLenInt QBdt::SaturatedQubitCount()
+{
+    // Distinct nonzero nodes at each depth of the tree
+    std::vector<std::unordered_set<QBdtNodeInterface*>> levels(bdtQubitCount + 1U);
+    if (!IS_NODE_0(root->scale)) {
+        levels[0U].insert(root.get());
+    }
+    for (bitLenInt j = 0U; j < bdtQubitCount; ++j) {
+        for (QBdtNodeInterface* n : levels[j]) {
+            for (size_t k = 0U; k < 2U; ++k) {
+                const QBdtNodeInterfacePtr& b = n->branches[k];
+                if (b && !IS_NODE_0(b->scale)) {
+                    levels[j + 1U].insert(b.get());
+                }
+            }
+        }
+    }
+
+    const bitLenInt maxAqb =
+        (maxAttachedQubits && (maxAttachedQubits < qubitCount)) ? maxAttachedQubits : qubitCount;
+    bitLenInt aqb = attachedQubitCount;
+    size_t nodesUnder = 0U;
+    for (bitLenInt b = bdtQubitCount; b > 0U; --b) {
+        const bitLenInt boundary = b - 1U;
+        const bitLenInt length = bdtQubitCount - boundary;
+        if ((attachedQubitCount + length) > maxAqb) {
+            break;
+        }
+        nodesUnder += levels[b].size();
+        // (Existing leaves are already dense, so only the tree levels are weighed.)
+        const real1_f ampsUnder = (real1_f)std::ldexp((real1_f)levels[boundary].size(), length);
+        if ((real1_f)nodesUnder >= (attachSaturation * ampsUnder)) {
+            aqb = attachedQubitCount + length;
+        }
+    }
+
+    return aqb;
+}
+
+void QBdt::BalanceAttachedQubits(bool isReset)
+{
+    if (isReset) {
+        ResetStateVector();
+    }
+
+    const bitLenInt aqb = SaturatedQubitCount();
+    if (aqb > attachedQubitCount) {
+        AttachStateVector(aqb);
     }
-    root->RemoveSeparableAtDepth(qubitCount - length, length);
-    SetQubitCount(qubitCount - length, 0U);
 }
 
 void QBdt::SetDevice(int64_t dID)
@@ -535,6 +892,12 @@ bitLenInt QBdt::Compose(QBdtPtr toCopy, bitLenInt start)
         return start;
     }
 
+    if (attachSaturation > ZERO_R1_F) {
+        // The hybrid leaf policy picks the boundary again after the next gate.
+        ResetStateVector();
+        toCopy->ResetStateVector();
+    }
+
     if (maxPageQubits < (attachedQubitCount + toCopy->attachedQubitCount)) {
         const bitLenInt diff = (attachedQubitCount + toCopy->attachedQubitCount) - maxPageQubits;
         ResetStateVector((diff < qubitCount) ? (qubitCount - diff) : 0U);
@@ -585,8 +948,9 @@ bitLenInt QBdt::Compose(QBdtPtr toCopy, bitLenInt start)
 
 QInterfacePtr QBdt::Decompose(bitLenInt start, bitLenInt length)
 {
-    QBdtPtr dest = std::make_shared<QBdt>(engines, bdtQubitCount, length, rand_generator, ONE_CMPLX, doNormalize,
+    QBdtPtr dest = std::make_shared<QBdt>(engines, length, 0U, rand_generator, ONE_CMPLX, doNormalize,
         randGlobalPhase, false, -1, (hardware_rand_generator == NULL) ? false : true, false, (real1_f)amplitudeFloor);
+    dest->SetHybridLeaves(attachSaturation, maxAttachedQubits);
 
     Decompose(start, dest);
 
@@ -603,6 +967,10 @@ void QBdt::DecomposeDispose(bitLenInt start, bitLenInt length, QBdtPtr dest)
         return;
     }
 
+    if (attachSaturation > ZERO_R1_F) {
+        ResetStateVector();
+    }
+
     if (start && bdtQubitCount && attachedQubitCount) {
         ROR(start, 0U, qubitCount);
         DecomposeDispose(0U, length, dest);
@@ -654,52 +1022,49 @@ real1_f QBdt::Prob(bitLenInt qubit)
         throw std::invalid_argument("QBdt::Prob qubit index parameter must be within allocated qubit bounds!");
     }
 
-    const bool isKet = (qubit >= bdtQubitCount);
-    const bitLenInt maxQubit = isKet ? bdtQubitCount : qubit;
-    const bitCapInt qPower = pow2(maxQubit);
-
-    std::map<QEnginePtr, real1> qiProbs;
-
-    const unsigned numCores = GetConcurrencyLevel();
-    std::unique_ptr<real1[]> oneChanceBuff(new real1[numCores]());
+    const bitLenInt maxQubit = (qubit >= bdtQubitCount) ? bdtQubitCount : qubit;
 
     Finish();
 
-    _par_for(qPower, [&](const bitCapInt& i, const unsigned& cpu) {
-        QBdtNodeInterfacePtr leaf = root;
-        complex scale = leaf->scale;
-        for (bitLenInt j = 0U; j < maxQubit; ++j) {
-            if (IS_NODE_0(leaf->scale)) {
-                break;
-            }
-            leaf = leaf->branches[SelectBit(i, j)];
-            scale *= leaf->scale;
-        }
+    QBdtProbTable memo(maxQubit + 1U);
 
-        if (IS_NODE_0(leaf->scale)) {
-            return;
-        }
+    return clampProb((real1_f)(norm(root->scale) * ProbUnder(root, 0U, maxQubit, qubit, memo)));
+}
 
-        if (isKet) {
-            // Phase effects don't matter, for probability expectation.
-            QEnginePtr qi = NODE_TO_QENGINE(leaf);
-            if (qiProbs.find(qi) == qiProbs.end()) {
-                qiProbs[qi] = sqrt(NODE_TO_QENGINE(leaf)->Prob(qubit - bdtQubitCount));
-            }
-            oneChanceBuff[cpu] += norm(scale * qiProbs[qi]);
+real1 QBdt::ProbUnder(
+    const QBdtNodeInterfacePtr& n, bitLenInt depth, bitLenInt maxQubit, bitLenInt qubit, QBdtProbTable& memo)
+{
+    if (IS_NODE_0(n->scale)) {
+        return ZERO_R1;
+    }
 
-            return;
+    // A node with only one reference can't be reached again, so it doesn't need an entry.
+    const bool isShared = n.use_count() > 1;
+    std::unordered_map<QBdtNodeInterface*, real1>& level = memo[depth];
+    if (isShared) {
+        const auto it = level.find(n.get());
+        if (it != level.end()) {
+            return it->second;
         }
+    }
 
-        oneChanceBuff[cpu] += norm(scale * leaf->branches[1U]->scale);
-    });
-
-    real1 oneChance = ZERO_R1;
-    for (unsigned i = 0U; i < numCores; ++i) {
-        oneChance += oneChanceBuff[i];
+    real1 oneChance;
+    if (depth < maxQubit) {
+        const QBdtNodeInterfacePtr& b0 = n->branches[0U];
+        const QBdtNodeInterfacePtr& b1 = n->branches[1U];
+        oneChance = norm(b0->scale) * ProbUnder(b0, depth + 1U, maxQubit, qubit, memo) +
+            norm(b1->scale) * ProbUnder(b1, depth + 1U, maxQubit, qubit, memo);
+    } else if (qubit >= bdtQubitCount) {
+        // Phase effects don't matter, for probability expectation.
+        oneChance = (real1)NODE_TO_QENGINE(n)->Prob(qubit - bdtQubitCount);
+    } else {
+        oneChance = norm(n->branches[1U]->scale);
+    }
+    if (isShared) {
+        level[n.get()] = oneChance;
     }
 
-    return clampProb((real1_f)oneChance);
+    return oneChance;
 }
 
 real1_f QBdt::ProbAll(bitCapInt perm)
@@ -766,8 +1131,18 @@ bool QBdt::ForceM(bitLenInt qubit, bool result, bool doForce, bool doApply)
 
         leaf->Branch();
 
+        // Every surviving branch keeps its weight, relative to the others, and the whole tree is renormalized below.
         if (isKet) {
-            NODE_TO_QENGINE(leaf)->ForceM(qubit - bdtQubitCount, result, true, true);
+            QEnginePtr qReg = NODE_TO_QENGINE(leaf);
+            const bitLenInt ketQubit = qubit - bdtQubitCount;
+            const real1_f leafOneChance = qReg->Prob(ketQubit);
+            const real1_f leafChance = result ? leafOneChance : (ONE_R1_F - leafOneChance);
+            if (leafChance <= FP_NORM_EPSILON) {
+                leaf->SetZero();
+                return;
+            }
+            qReg->ForceM(ketQubit, result, true, true);
+            leaf->scale *= (real1)sqrt(leafChance);
             return;
         }
 
@@ -779,23 +1154,73 @@ bool QBdt::ForceM(bitLenInt qubit, bool result, bool doForce, bool doApply)
                 leaf->SetZero();
             } else {
                 b0->SetZero();
-                b1->scale /= abs(b1->scale);
             }
         } else {
             if (IS_NODE_0(b0->scale)) {
                 leaf->SetZero();
             } else {
-                b0->scale /= abs(b0->scale);
                 b1->SetZero();
             }
         }
     });
 
-    root->Prune(maxQubit);
+    // (The measured level itself is renormalized, too.)
+    const bitLenInt maxDepth = isKet ? maxQubit : (maxQubit + 1U);
+    if (true) {
+        QBdtComputeTable memo(maxDepth + 1U);
+        root = RenormalizeUnder(root, 0U, maxDepth, memo);
+    }
+    root->scale /= abs(root->scale);
+    root->Prune(maxDepth);
+
+    if (attachSaturation > ZERO_R1_F) {
+        // Measurement can only lessen entanglement, so the boundary is chosen again from the whole tree.
+        BalanceAttachedQubits(true);
+    }
 
     return result;
 }
 
+QBdtNodeInterfacePtr QBdt::RenormalizeUnder(
+    const QBdtNodeInterfacePtr& n, bitLenInt depth, bitLenInt maxDepth, QBdtComputeTable& memo)
+{
+    if ((depth == maxDepth) || IS_NODE_0(n->scale) || !n->branches[0U]) {
+        return n;
+    }
+
+    std::unordered_map<QBdtNodeInterface*, QBdtNodeInterfacePtr>& level = memo[depth];
+    const auto it = level.find(n.get());
+    if (it != level.end()) {
+        return it->second;
+    }
+
+    QBdtNodeInterfacePtr b[2U];
+    real1 nrm = ZERO_R1;
+    for (size_t k = 0U; k < 2U; ++k) {
+        b[k] = RenormalizeUnder(n->branches[k], depth + 1U, maxDepth, memo);
+        nrm += norm(b[k]->scale);
+    }
+
+    QBdtNodeInterfacePtr toRet = n;
+    if (nrm <= _qrack_qbdt_sep_thresh) {
+        toRet = n->ShallowClone();
+        toRet->SetZero();
+    } else if ((abs(ONE_R1 - nrm) > FP_NORM_EPSILON) || (b[0U].get() != n->branches[0U].get()) ||
+        (b[1U].get() != n->branches[1U].get())) {
+        // Nodes can be shared, so the rescaled branches are copies.
+        const real1 s = (real1)sqrt(nrm);
+        toRet = n->ShallowClone();
+        toRet->scale *= s;
+        for (size_t k = 0U; k < 2U; ++k) {
+            toRet->branches[k] = b[k]->ShallowClone();
+            toRet->branches[k]->scale /= s;
+        }
+    }
+    level[n.get()] = toRet;
+
+    return toRet;
+}
+
 bitCapInt QBdt::MAll()
 {
     bitCapInt result = 0U;
@@ -832,6 +1257,11 @@ bitCapInt QBdt::MAll()
         result |= NODE_TO_QENGINE(leaf)->MAll() << bdtQubitCount;
     }
 
+    if (attachSaturation > ZERO_R1_F) {
+        // The state is a permutation, now.
+        ResetStateVector();
+    }
+
     return result;
 }
 
@@ -851,50 +1281,264 @@ void QBdt::ApplySingle(complex const* mtrx, bitLenInt target)
         return;
     }
 
+    const bitLenInt maxQubit = (target >= bdtQubitCount) ? bdtQubitCount : target;
+    ApplyUnderControls(mtrx, std::vector<int8_t>(maxQubit, -1), target, std::vector<bitLenInt>(), false);
+}
+
+QBdtNodeInterfacePtr QBdt::CopyToTargets(const QBdtNodeInterfacePtr& n, bitLenInt depth, bitLenInt maxQubit,
+    const std::vector<int8_t>& controlPerms, QBdtComputeTable& memo, std::vector<QBdtNodeInterfacePtr>& targets)
+{
+    if (IS_NODE_0(n->scale)) {
+        return n;
+    }
+
+    // A node with only one reference can't be reached again, so it doesn't need an entry.
+    const bool isShared = n.use_count() > 1;
+    std::unordered_map<QBdtNodeInterface*, QBdtNodeInterfacePtr>& level = memo[depth];
+    if (isShared) {
+        const auto it = level.find(n.get());
+        if (it != level.end()) {
+            return it->second;
+        }
+    }
+
+    QBdtNodeInterfacePtr c = n->ShallowClone();
+    if (depth == maxQubit) {
+        targets.push_back(c);
+    } else {
+        // Branches that fail a control are left shared with the original.
+        const int8_t controlPerm = controlPerms[depth];
+        for (size_t k = 0U; k < 2U; ++k) {
+            if ((controlPerm < 0) || ((size_t)controlPerm == k)) {
+                c->branches[k] = CopyToTargets(n->branches[k], depth + 1U, maxQubit, controlPerms, memo, targets);
+            }
+        }
+    }
+    if (isShared) {
+        level[n.get()] = c;
+    }
+
+    return c;
+}
+
+void QBdt::ApplyUnderControls(complex const* mtrx, const std::vector<int8_t>& controlPerms, bitLenInt target,
+    const std::vector<bitLenInt>& ketControls, bool isAnti)
+{
     const bool isKet = (target >= bdtQubitCount);
     const bitLenInt maxQubit = isKet ? bdtQubitCount : target;
-    const bitCapInt qPower = pow2(maxQubit);
+
+    // Copy-on-write down to the target depth, once per distinct subtree, collecting the distinct nodes to transform.
+    std::vector<QBdtNodeInterfacePtr> targets;
+    if (true) {
+        QBdtComputeTable memo(maxQubit + 1U);
+        root = CopyToTargets(root, 0U, maxQubit, controlPerms, memo, targets);
+    }
 
 #if ENABLE_COMPLEX_X2
     const complex2 mtrxCol1(mtrx[0U], mtrx[2U]);
     const complex2 mtrxCol2(mtrx[1U], mtrx[3U]);
 #endif
 
-    par_for_qbdt(qPower, maxQubit,
+    _par_for(targets.size(), [&](const bitCapInt& i, const unsigned& cpu) {
+        QBdtNodeInterfacePtr leaf = targets[(size_t)i];
+
+        if (!isKet) {
 #if ENABLE_COMPLEX_X2
-        [this, maxQubit, target, mtrx, mtrxCol1, mtrxCol2, isKet](const bitCapInt& i) {
+            leaf->Apply2x2(mtrxCol1, mtrxCol2, bdtQubitCount - target);
 #else
-        [this, maxQubit, target, mtrx, isKet](const bitCapInt& i) {
+            leaf->Apply2x2(mtrx, bdtQubitCount - target);
 #endif
-            QBdtNodeInterfacePtr leaf = root;
-            // Iterate to qubit depth.
-            for (bitLenInt j = 0U; j < maxQubit; ++j) {
-                if (IS_NODE_0(leaf->scale)) {
-                    // WARNING: Mutates loop control variable!
-                    return (bitCapInt)(pow2(maxQubit - j) - ONE_BCI);
+            return;
+        }
+
+        leaf->Branch();
+        QEnginePtr qi = NODE_TO_QENGINE(leaf);
+        if (ketControls.empty()) {
+            qi->Mtrx(mtrx, target - bdtQubitCount);
+        } else if (isAnti) {
+            qi->MACMtrx(ketControls, mtrx, target - bdtQubitCount);
+        } else {
+            qi->MCMtrx(ketControls, mtrx, target - bdtQubitCount);
+        }
+    });
+
+    PruneRoot(maxQubit);
+
+    if (attachSaturation > ZERO_R1_F) {
+        BalanceAttachedQubits(false);
+    }
+}
+
+void QBdt::PruneRoot(bitLenInt depth)
+{
+    root->Prune(depth);
+
+    if (!bdtQubitCount || ((truncationThreshold <= ZERO_R1_F) && (mergeEpsilon <= ZERO_R1_F))) {
+        return;
+    }
+
+    // Nodes can be shared with clones of this QBdt, so the approximate tree is built copy-on-write.
+    QBdtNodeInterfacePtr nRoot = root;
+
+    if (mergeEpsilon > ZERO_R1_F) {
+        QBdtUniqueTable table(mergeEpsilon);
+        QBdtComputeTable memo(bdtQubitCount + 1U);
+        nRoot = MergeUnder(nRoot, 0U, table, memo);
+    }
+
+    if (truncationThreshold > ZERO_R1_F) {
+        // Total probability carried into every distinct node, top down, level by level
+        QBdtProbTable mass(bdtQubitCount + 1U);
+        mass[0U][nRoot.get()] = norm(nRoot->scale);
+        for (bitLenInt j = 0U; j < bdtQubitCount; ++j) {
+            for (const auto& p : mass[j]) {
+                QBdtNodeInterface* n = p.first;
+                if (IS_NODE_0(n->scale) || !n->branches[0U]) {
+                    continue;
+                }
+                for (size_t k = 0U; k < 2U; ++k) {
+                    const QBdtNodeInterfacePtr& b = n->branches[k];
+                    if (!IS_NODE_0(b->scale)) {
+                        mass[j + 1U][b.get()] += p.second * norm(b->scale);
+                    }
                 }
-                leaf = leaf->branches[SelectBit(i, maxQubit - (j + 1U))];
             }
+        }
 
-            std::lock_guard<std::mutex> lock(leaf->mtx);
+        QBdtComputeTable memo(bdtQubitCount + 1U);
+        nRoot = TruncateUnder(nRoot, 0U, mass, memo);
+    }
 
-            if (IS_NODE_0(leaf->scale)) {
-                return (bitCapInt)0U;
-            }
+    if (nRoot.get() == root.get()) {
+        return;
+    }
 
-            if (isKet) {
-                leaf->Branch();
-                NODE_TO_QENGINE(leaf)->Mtrx(mtrx, target - bdtQubitCount);
-            } else {
-#if ENABLE_COMPLEX_X2
-                leaf->Apply2x2(mtrxCol1, mtrxCol2, bdtQubitCount - target);
-#else
-                leaf->Apply2x2(mtrx, bdtQubitCount - target);
-#endif
-            }
+    if (true) {
+        QBdtProbTable memoA(bdtQubitCount + 1U);
+        QBdtProbTable memoB(bdtQubitCount + 1U);
+        QBdtInnerTable memoAB(bdtQubitCount + 1U);
+        const real1 nrmA = NormUnder(root, 0U, memoA);
+        const real1 nrmB = NormUnder(nRoot, 0U, memoB);
+        const real1 fidelity = norm(InnerUnder(root, nRoot, 0U, memoAB)) / (nrmA * nrmB);
+        unitaryFidelity *= (fidelity < ONE_R1) ? (real1_f)fidelity : ONE_R1_F;
+    }
 
-            return (bitCapInt)0U;
-        });
+    root = nRoot;
+    root->Prune(bdtQubitCount);
+}
+
+QBdtNodeInterfacePtr QBdt::MergeUnder(
+    const QBdtNodeInterfacePtr& n, bitLenInt depth, QBdtUniqueTable& table, QBdtComputeTable& memo)
+{
+    if ((depth == bdtQubitCount) || IS_NODE_0(n->scale) || !n->branches[0U]) {
+        return table.Emplace(n, depth);
+    }
+
+    std::unordered_map<QBdtNodeInterface*, QBdtNodeInterfacePtr>& level = memo[depth];
+    const auto it = level.find(n.get());
+    if (it != level.end()) {
+        return it->second;
+    }
+
+    const QBdtNodeInterfacePtr b0 = MergeUnder(n->branches[0U], depth + 1U, table, memo);
+    const QBdtNodeInterfacePtr b1 = MergeUnder(n->branches[1U], depth + 1U, table, memo);
+
+    QBdtNodeInterfacePtr toRet = n;
+    if ((b0.get() != n->branches[0U].get()) || (b1.get() != n->branches[1U].get())) {
+        toRet = n->ShallowClone();
+        toRet->branches[0U] = b0;
+        toRet->branches[1U] = b1;
+    }
+    toRet = table.Emplace(toRet, depth);
+    level[n.get()] = toRet;
+
+    return toRet;
+}
+
+QBdtNodeInterfacePtr QBdt::TruncateUnder(
+    const QBdtNodeInterfacePtr& n, bitLenInt depth, const QBdtProbTable& mass, QBdtComputeTable& memo)
+{
+    if ((depth == bdtQubitCount) || IS_NODE_0(n->scale) || !n->branches[0U]) {
+        return n;
+    }
+
+    std::unordered_map<QBdtNodeInterface*, QBdtNodeInterfacePtr>& level = memo[depth];
+    const auto it = level.find(n.get());
+    if (it != level.end()) {
+        return it->second;
+    }
+
+    const real1 m = mass[depth].at(n.get());
+    QBdtNodeInterfacePtr b[2U];
+    for (size_t k = 0U; k < 2U; ++k) {
+        const QBdtNodeInterfacePtr& c = n->branches[k];
+        if (!IS_NODE_0(c->scale) && ((m * norm(c->scale)) < truncationThreshold)) {
+            b[k] = c->ShallowClone();
+            b[k]->SetZero();
+        } else {
+            b[k] = TruncateUnder(c, depth + 1U, mass, memo);
+        }
+    }
+
+    QBdtNodeInterfacePtr toRet = n;
+    if ((b[0U].get() != n->branches[0U].get()) || (b[1U].get() != n->branches[1U].get())) {
+        toRet = n->ShallowClone();
+        toRet->branches[0U] = b[0U];
+        toRet->branches[1U] = b[1U];
+    }
+    level[n.get()] = toRet;
+
+    return toRet;
+}
+
+real1 QBdt::NormUnder(const QBdtNodeInterfacePtr& n, bitLenInt depth, QBdtProbTable& memo)
+{
+    if (IS_NODE_0(n->scale)) {
+        return ZERO_R1;
+    }
+
+    if ((depth == bdtQubitCount) || !n->branches[0U]) {
+        return norm(n->scale);
+    }
+
+    std::unordered_map<QBdtNodeInterface*, real1>& level = memo[depth];
+    const auto it = level.find(n.get());
+    if (it != level.end()) {
+        return it->second;
+    }
+
+    const real1 toRet = norm(n->scale) *
+        (NormUnder(n->branches[0U], depth + 1U, memo) + NormUnder(n->branches[1U], depth + 1U, memo));
+    level[n.get()] = toRet;
+
+    return toRet;
+}
+
+complex QBdt::InnerUnder(
+    const QBdtNodeInterfacePtr& a, const QBdtNodeInterfacePtr& b, bitLenInt depth, QBdtInnerTable& memo)
+{
+    if (IS_NODE_0(a->scale) || IS_NODE_0(b->scale)) {
+        return ZERO_CMPLX;
+    }
+
+    const complex scale = conj(a->scale) * b->scale;
+    if ((depth == bdtQubitCount) || !a->branches[0U] || !b->branches[0U]) {
+        return scale;
+    }
+
+    std::map<std::pair<QBdtNodeInterface*, QBdtNodeInterface*>, complex>& level = memo[depth];
+    const std::pair<QBdtNodeInterface*, QBdtNodeInterface*> key(a.get(), b.get());
+    const auto it = level.find(key);
+    if (it != level.end()) {
+        return it->second;
+    }
+
+    const complex toRet = scale *
+        (InnerUnder(a->branches[0U], b->branches[0U], depth + 1U, memo) +
+            InnerUnder(a->branches[1U], b->branches[1U], depth + 1U, memo));
+    level[key] = toRet;
+
+    return toRet;
 }
 
 void QBdt::ApplyControlledSingle(
@@ -930,71 +1574,19 @@ void QBdt::ApplyControlledSingle(
         std::swap(target, controlVec.back());
     }
 
-    const bool isKet = (target >= bdtQubitCount);
-    const bitLenInt maxQubit = isKet ? bdtQubitCount : target;
-    const bitCapInt qPower = pow2(maxQubit);
+    const bitLenInt maxQubit = (target >= bdtQubitCount) ? bdtQubitCount : target;
+    std::vector<int8_t> controlPerms(maxQubit, -1);
     std::vector<bitLenInt> ketControlsVec;
-    bitCapInt lowControlMask = 0U;
     for (size_t c = 0U; c < controls.size(); ++c) {
         const bitLenInt control = controlVec[c];
         if (control < bdtQubitCount) {
-            lowControlMask |= pow2(maxQubit - (control + 1U));
+            controlPerms[control] = isAnti ? 0 : 1;
         } else {
             ketControlsVec.push_back(control - bdtQubitCount);
         }
     }
-    bitCapInt lowControlPerm = isAnti ? 0U : lowControlMask;
-
-#if ENABLE_COMPLEX_X2
-    const complex2 mtrxCol1(mtrx[0U], mtrx[2U]);
-    const complex2 mtrxCol2(mtrx[1U], mtrx[3U]);
-#endif
-
-    par_for_qbdt(qPower, maxQubit,
-#if ENABLE_COMPLEX_X2
-        [this, lowControlMask, lowControlPerm, maxQubit, target, mtrx, mtrxCol1, mtrxCol2, isKet, isAnti,
-            ketControlsVec](const bitCapInt& i) {
-#else
-        [this, lowControlMask, lowControlPerm, maxQubit, target, mtrx, isKet, isAnti, ketControlsVec](const bitCapInt& i) {
-#endif
-            if ((i & lowControlMask) != lowControlPerm) {
-                return (bitCapInt)(lowControlMask - ONE_BCI);
-            }
-
-            QBdtNodeInterfacePtr leaf = root;
-            // Iterate to qubit depth.
-            for (bitLenInt j = 0U; j < maxQubit; ++j) {
-                if (IS_NODE_0(leaf->scale)) {
-                    // WARNING: Mutates loop control variable!
-                    return (bitCapInt)(pow2(maxQubit - j) - ONE_BCI);
-                }
-                leaf = leaf->branches[SelectBit(i, maxQubit - (j + 1U))];
-            }
 
-            std::lock_guard<std::mutex> lock(leaf->mtx);
-
-            if (IS_NODE_0(leaf->scale)) {
-                return (bitCapInt)0U;
-            }
-
-            if (isKet) {
-                leaf->Branch();
-                QEnginePtr qi = NODE_TO_QENGINE(leaf);
-                if (isAnti) {
-                    qi->MACMtrx(ketControlsVec, mtrx, target - bdtQubitCount);
-                } else {
-                    qi->MCMtrx(ketControlsVec, mtrx, target - bdtQubitCount);
-                }
-            } else {
-#if ENABLE_COMPLEX_X2
-                leaf->Apply2x2(mtrxCol1, mtrxCol2, bdtQubitCount - target);
-#else
-                leaf->Apply2x2(mtrx, bdtQubitCount - target);
-#endif
-            }
-
-            return (bitCapInt)0U;
-        });
+    ApplyUnderControls(mtrx, controlPerms, target, ketControlsVec, isAnti);
 
     // Undo isSwapped.
     if (isSwapped) {
@@ -0,0 +1,86 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// QBinaryDecision tree is an alternative approach to quantum state representation, as
+// opposed to state vector representation. This is a compressed form that can be
+// operated directly on while compressed. Inspiration for the Qrack implementation was
+// taken from JKQ DDSIM, maintained by the Institute for Integrated Circuits at the
+// Johannes Kepler University Linz:
+//
+// https://github.com/iic-jku/ddsim
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qbdt_unique_table.hpp"
+#include "qbdt_node.hpp"
+
+#define QRACK_QBDT_UNIQUE_SHARDS 16U
+
+namespace Qrack {
+
+size_t QBdtUniqueTable::KeyHash::operator()(const Key& k) const
+{
+    // (std::hash maps -0 and +0 to the same value, consistent with the key comparison.)
+    size_t h = std::hash<real1>()(real(k.scale));
+    h ^= std::hash<real1>()(imag(k.scale)) + 0x9e3779b9U + (h << 6U) + (h >> 2U);
+    h ^= std::hash<QBdtNodeInterface*>()(k.b0) + 0x9e3779b9U + (h << 6U) + (h >> 2U);
+    h ^= std::hash<QBdtNodeInterface*>()(k.b1) + 0x9e3779b9U + (h << 6U) + (h >> 2U);
+    h ^= (size_t)k.depth + 0x9e3779b9U + (h << 6U) + (h >> 2U);
+
+    return h;
+}
+
+QBdtUniqueTable::QBdtUniqueTable(real1_f mergeEps)
+    : mergeEpsilon(mergeEps)
+    , shards(new Shard[QRACK_QBDT_UNIQUE_SHARDS])
+{
+}
+
+QBdtUniqueTable::Shard& QBdtUniqueTable::GetShard(const Key& k)
+{
+    // (The maps consume the low bits of the hash; shard on the high bits.)
+    return shards[(KeyHash()(k) >> ((sizeof(size_t) << 3U) - 4U)) % QRACK_QBDT_UNIQUE_SHARDS];
+}
+
+QBdtNodeInterfacePtr QBdtUniqueTable::Emplace(const QBdtNodeInterfacePtr& n, bitLenInt depth)
+{
+    if (!n) {
+        return n;
+    }
+
+    // Hybrid QEngine leaves have no branches, and their contents aren't part of the key.
+    if (!n->branches[0U] && !dynamic_cast<QBdtNode*>(n.get())) {
+        return n;
+    }
+
+    Key k = MakeKey(n.get(), depth);
+
+    // A scale that rounds to 0 is a 0 branch.
+    QBdtNodeInterfacePtr nz;
+    if ((mergeEpsilon > ZERO_R1_F) && (k.scale == ZERO_CMPLX) && n->branches[0U]) {
+        nz = n->ShallowClone();
+        nz->SetZero();
+        k = MakeKey(nz.get(), depth);
+    }
+    const QBdtNodeInterfacePtr& e = nz ? nz : n;
+
+    Shard& shard = GetShard(k);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    return shard.nodes.emplace(k, e).first->second;
+}
+
+bool QBdtUniqueTable::IsCanonical(QBdtNodeInterface* n, bitLenInt depth)
+{
+    const Key k = MakeKey(n, depth);
+    Shard& shard = GetShard(k);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    const auto it = shard.nodes.find(k);
+
+    return (it != shard.nodes.end()) && (it->second.get() == n);
+}
+} // namespace Qrack
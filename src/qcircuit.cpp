@@ -0,0 +1,384 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qcircuit.hpp"
+
+#include <algorithm>
+
+namespace Qrack {
+
+namespace {
+
+// Sort the controls, and carry the control permutation's bits along with them.
+bitCapIntOcl SortControls(const std::vector<bitLenInt>& ctrls, bitLenInt target, bitCapIntOcl perm,
+    std::vector<bitLenInt>& sortedCtrls)
+{
+    sortedCtrls = ctrls;
+    std::sort(sortedCtrls.begin(), sortedCtrls.end());
+    if (std::adjacent_find(sortedCtrls.begin(), sortedCtrls.end()) != sortedCtrls.end()) {
+        throw std::invalid_argument("QCircuitGate controls must be unique!");
+    }
+    if (std::binary_search(sortedCtrls.begin(), sortedCtrls.end(), target)) {
+        throw std::invalid_argument("QCircuitGate target cannot also be a control!");
+    }
+
+    bitCapIntOcl sortedPerm = 0U;
+    for (size_t i = 0U; i < ctrls.size(); ++i) {
+        if ((perm >> i) & 1U) {
+            sortedPerm |= pow2Ocl(std::lower_bound(sortedCtrls.begin(), sortedCtrls.end(), ctrls[i]) -
+                sortedCtrls.begin());
+        }
+    }
+
+    return sortedPerm;
+}
+
+bool IsIdentityMtrx(const std::vector<complex>& mtrx)
+{
+    return IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U]) && IS_SAME(ONE_CMPLX, mtrx[0U]) && IS_SAME(ONE_CMPLX, mtrx[3U]);
+}
+
+bool IsPhaseMtrx(const std::vector<complex>& mtrx) { return IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U]); }
+
+bool IsInvertMtrx(const std::vector<complex>& mtrx) { return IS_NORM_0(mtrx[0U]) && IS_NORM_0(mtrx[3U]); }
+
+} // namespace
+
+QCircuitGate::QCircuitGate(bitLenInt trgt, const complex* mtrx, const std::vector<bitLenInt>& ctrls, bitCapIntOcl perm)
+    : target(trgt)
+    , controls()
+    , payloads()
+    , axis(PauliI)
+    , param(0U)
+    , dispatch(QCIRCUIT_MTRX)
+    , uniformMtrxs()
+{
+    const bitCapIntOcl sortedPerm = SortControls(ctrls, trgt, perm, controls);
+    const std::vector<complex> m(mtrx, mtrx + 4U);
+    if (!IsIdentityMtrx(m)) {
+        payloads[sortedPerm] = m;
+    }
+    Classify();
+}
+
+QCircuitGate::QCircuitGate(
+    Pauli ax, size_t prm, bitLenInt trgt, const std::vector<bitLenInt>& ctrls, bitCapIntOcl perm)
+    : target(trgt)
+    , controls()
+    , payloads()
+    , axis(ax)
+    , param(prm)
+    , dispatch(QCIRCUIT_MTRX)
+    , uniformMtrxs()
+{
+    if (axis == PauliI) {
+        throw std::invalid_argument("QCircuitGate rotation axis must be PauliX, PauliY, or PauliZ!");
+    }
+    payloads[SortControls(ctrls, trgt, perm, controls)] = std::vector<complex>();
+}
+
+bool QCircuitGate::IsIdentity() const { return !IsParameterized() && !payloads.size(); }
+
+bool QCircuitGate::IsDiagonal() const
+{
+    if (IsParameterized()) {
+        return axis == PauliZ;
+    }
+
+    for (const auto& p : payloads) {
+        if (!IsPhaseMtrx(p.second)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool QCircuitGate::CanFuse(const QCircuitGate& other) const
+{
+    return !IsParameterized() && !other.IsParameterized() && (target == other.target) && (controls == other.controls);
+}
+
+void QCircuitGate::Fuse(const QCircuitGate& other)
+{
+    const std::vector<complex> identity{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX };
+    std::map<bitCapIntOcl, std::vector<complex>> fused;
+    std::vector<bitCapIntOcl> perms;
+    for (const auto& p : payloads) {
+        perms.push_back(p.first);
+    }
+    for (const auto& p : other.payloads) {
+        if (payloads.find(p.first) == payloads.end()) {
+            perms.push_back(p.first);
+        }
+    }
+
+    for (const bitCapIntOcl& perm : perms) {
+        const auto lIt = other.payloads.find(perm);
+        const auto rIt = payloads.find(perm);
+        const std::vector<complex>& left = (lIt == other.payloads.end()) ? identity : lIt->second;
+        const std::vector<complex>& right = (rIt == payloads.end()) ? identity : rIt->second;
+        std::vector<complex> out(4U);
+        mul2x2(left.data(), right.data(), out.data());
+        if (!IsIdentityMtrx(out)) {
+            fused[perm] = out;
+        }
+    }
+
+    payloads = fused;
+    Classify();
+}
+
+bool QCircuitGate::CommutesWith(const QCircuitGate& other) const
+{
+    // A control acts diagonally on its qubit; a target does if its gate is diagonal.
+    if (!IsDiagonal() && std::binary_search(other.controls.begin(), other.controls.end(), target)) {
+        return false;
+    }
+    if (!other.IsDiagonal() && std::binary_search(controls.begin(), controls.end(), other.target)) {
+        return false;
+    }
+    if ((target == other.target) && (!IsDiagonal() || !other.IsDiagonal())) {
+        return false;
+    }
+
+    return true;
+}
+
+void QCircuitGate::Classify()
+{
+    uniformMtrxs.clear();
+    if (IsParameterized() || !payloads.size()) {
+        dispatch = QCIRCUIT_MTRX;
+        return;
+    }
+
+    const bitCapIntOcl permCount = pow2Ocl(controls.size());
+    const bitCapIntOcl perm = payloads.begin()->first;
+    if ((payloads.size() == 1U) && (!perm || (perm == (permCount - 1U)))) {
+        const std::vector<complex>& mtrx = payloads.begin()->second;
+        const bool isAnti = controls.size() && !perm;
+        if (IsPhaseMtrx(mtrx)) {
+            dispatch = isAnti ? QCIRCUIT_ANTI_PHASE : QCIRCUIT_PHASE;
+        } else if (IsInvertMtrx(mtrx)) {
+            dispatch = isAnti ? QCIRCUIT_ANTI_INVERT : QCIRCUIT_INVERT;
+        } else {
+            dispatch = isAnti ? QCIRCUIT_ANTI_MTRX : QCIRCUIT_MTRX;
+        }
+
+        return;
+    }
+
+    dispatch = QCIRCUIT_UNIFORM;
+    uniformMtrxs.resize(permCount << 2U);
+    for (bitCapIntOcl i = 0U; i < permCount; ++i) {
+        const auto it = payloads.find(i);
+        if (it == payloads.end()) {
+            uniformMtrxs[(i << 2U)] = ONE_CMPLX;
+            uniformMtrxs[(i << 2U) | 1U] = ZERO_CMPLX;
+            uniformMtrxs[(i << 2U) | 2U] = ZERO_CMPLX;
+            uniformMtrxs[(i << 2U) | 3U] = ONE_CMPLX;
+        } else {
+            std::copy(it->second.begin(), it->second.end(), uniformMtrxs.begin() + (i << 2U));
+        }
+    }
+}
+
+QCircuitGatePtr QCircuitGate::Bind(const std::vector<real1_f>& params) const
+{
+    if (!IsParameterized()) {
+        return std::make_shared<QCircuitGate>(*this);
+    }
+
+    const real1 cosine = (real1)cos(params[param] / 2);
+    const real1 sine = (real1)sin(params[param] / 2);
+    complex mtrx[4U];
+    switch (axis) {
+    case PauliX:
+        mtrx[0U] = complex(cosine, ZERO_R1);
+        mtrx[1U] = complex(ZERO_R1, -sine);
+        mtrx[2U] = complex(ZERO_R1, -sine);
+        mtrx[3U] = complex(cosine, ZERO_R1);
+        break;
+    case PauliY:
+        mtrx[0U] = complex(cosine, ZERO_R1);
+        mtrx[1U] = complex(-sine, ZERO_R1);
+        mtrx[2U] = complex(sine, ZERO_R1);
+        mtrx[3U] = complex(cosine, ZERO_R1);
+        break;
+    case PauliZ:
+    default:
+        mtrx[0U] = complex(cosine, -sine);
+        mtrx[1U] = ZERO_CMPLX;
+        mtrx[2U] = ZERO_CMPLX;
+        mtrx[3U] = complex(cosine, sine);
+        break;
+    }
+
+    // The controls are already sorted, so the permutation carries over as it is.
+    return std::make_shared<QCircuitGate>(target, mtrx, controls, payloads.begin()->first);
+}
+
+void QCircuitGate::Run(QInterfacePtr sim, const std::vector<real1_f>& params) const
+{
+    if (IsParameterized()) {
+        Bind(params)->Run(sim, params);
+        return;
+    }
+
+    if (!payloads.size()) {
+        return;
+    }
+
+    const complex* mtrx = payloads.begin()->second.data();
+    switch (dispatch) {
+    case QCIRCUIT_PHASE:
+        if (controls.size()) {
+            sim->MCPhase(controls, mtrx[0U], mtrx[3U], target);
+        } else {
+            sim->Phase(mtrx[0U], mtrx[3U], target);
+        }
+        break;
+    case QCIRCUIT_INVERT:
+        if (controls.size()) {
+            sim->MCInvert(controls, mtrx[1U], mtrx[2U], target);
+        } else {
+            sim->Invert(mtrx[1U], mtrx[2U], target);
+        }
+        break;
+    case QCIRCUIT_ANTI_MTRX:
+        sim->MACMtrx(controls, mtrx, target);
+        break;
+    case QCIRCUIT_ANTI_PHASE:
+        sim->MACPhase(controls, mtrx[0U], mtrx[3U], target);
+        break;
+    case QCIRCUIT_ANTI_INVERT:
+        sim->MACInvert(controls, mtrx[1U], mtrx[2U], target);
+        break;
+    case QCIRCUIT_UNIFORM:
+        sim->UniformlyControlledSingleBit(controls, target, uniformMtrxs.data());
+        break;
+    case QCIRCUIT_MTRX:
+    default:
+        if (controls.size()) {
+            sim->MCMtrx(controls, mtrx, target);
+        } else {
+            sim->Mtrx(mtrx, target);
+        }
+        break;
+    }
+}
+
+void QCircuit::AppendGate(QCircuitGatePtr gate)
+{
+    if (gate->IsIdentity()) {
+        return;
+    }
+
+    bitLenInt maxQubit = gate->target;
+    if (gate->controls.size() && (gate->controls.back() > maxQubit)) {
+        maxQubit = gate->controls.back();
+    }
+    if (qubitCount <= maxQubit) {
+        qubitCount = maxQubit + 1U;
+    }
+    if (gate->IsParameterized() && (paramCount <= gate->param)) {
+        paramCount = gate->param + 1U;
+    }
+
+    // Move the gate back, past every gate it commutes with, to the nearest gate that it fuses with, (or to just after
+    // the nearest one that it doesn't commute with).
+    for (auto it = gates.end(); it != gates.begin();) {
+        --it;
+        QCircuitGatePtr& prior = *it;
+        if (prior->CanFuse(*gate)) {
+            prior->Fuse(*gate);
+            if (prior->IsIdentity()) {
+                gates.erase(it);
+            }
+            return;
+        }
+        if (!prior->CommutesWith(*gate)) {
+            gates.insert(std::next(it), std::make_shared<QCircuitGate>(*gate));
+            return;
+        }
+    }
+
+    gates.push_front(std::make_shared<QCircuitGate>(*gate));
+}
+
+void QCircuit::H(bitLenInt target)
+{
+    const complex mtrx[4U]{ complex(SQRT1_2_R1, ZERO_R1), complex(SQRT1_2_R1, ZERO_R1), complex(SQRT1_2_R1, ZERO_R1),
+        complex(-SQRT1_2_R1, ZERO_R1) };
+    Mtrx(mtrx, target);
+}
+
+void QCircuit::X(bitLenInt target)
+{
+    const complex mtrx[4U]{ ZERO_CMPLX, ONE_CMPLX, ONE_CMPLX, ZERO_CMPLX };
+    Mtrx(mtrx, target);
+}
+
+void QCircuit::Z(bitLenInt target)
+{
+    const complex mtrx[4U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, -ONE_CMPLX };
+    Mtrx(mtrx, target);
+}
+
+void QCircuit::CNOT(bitLenInt control, bitLenInt target)
+{
+    const complex mtrx[4U]{ ZERO_CMPLX, ONE_CMPLX, ONE_CMPLX, ZERO_CMPLX };
+    MCMtrx({ control }, mtrx, target);
+}
+
+void QCircuit::CZ(bitLenInt control, bitLenInt target)
+{
+    const complex mtrx[4U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, -ONE_CMPLX };
+    MCMtrx({ control }, mtrx, target);
+}
+
+void QCircuit::Swap(bitLenInt qubit1, bitLenInt qubit2)
+{
+    CNOT(qubit1, qubit2);
+    CNOT(qubit2, qubit1);
+    CNOT(qubit1, qubit2);
+}
+
+QCircuitPtr QCircuit::Bind(const std::vector<real1_f>& params) const
+{
+    if (params.size() < paramCount) {
+        throw std::invalid_argument("QCircuit::Bind params vector is shorter than the circuit's parameter count!");
+    }
+
+    QCircuitPtr bound = std::make_shared<QCircuit>();
+    for (const QCircuitGatePtr& gate : gates) {
+        bound->AppendGate(gate->Bind(params));
+    }
+
+    return bound;
+}
+
+void QCircuit::Run(QInterfacePtr sim, const std::vector<real1_f>& params) const
+{
+    if (params.size() < paramCount) {
+        throw std::invalid_argument("QCircuit::Run params vector is shorter than the circuit's parameter count!");
+    }
+    if (sim->GetQubitCount() < qubitCount) {
+        throw std::invalid_argument("QCircuit::Run simulator has fewer qubits than the circuit!");
+    }
+
+    for (const QCircuitGatePtr& gate : gates) {
+        gate->Run(sim, params);
+    }
+}
+} // namespace Qrack
@@ -0,0 +1,583 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qfactory.hpp"
+
+// Completeness of a Kraus set, (sum_k K_k^+ K_k = I,) is checked to this tolerance, as by QInterface.
+#define KRAUS_EPSILON ((real1)(64 * FP_NORM_EPSILON))
+// Tr(rho^2) may fall this far short of Tr(rho)^2, (relatively,) for rho to still count as pure.
+#define PURITY_EPSILON ((real1_f)(256 * FP_NORM_EPSILON))
+
+namespace Qrack {
+
+// Add the superoperator of rho -> K rho K^+, on a row and column qubit pair, (with the row qubit the low bit)
+static void AddKrausSuperOp(complex const* K, complex* sop)
+{
+    for (size_t row = 0U; row < 4U; ++row) {
+        const size_t r = row & 1U;
+        const size_t c = row >> 1U;
+        for (size_t col = 0U; col < 4U; ++col) {
+            sop[(row << 2U) | col] += K[(r << 1U) | (col & 1U)] * conj(K[(c << 1U) | (col >> 1U)]);
+        }
+    }
+}
+
+QDensityMatrix::QDensityMatrix(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState,
+    qrack_rand_gen_ptr rgp, complex phaseFac, bool doNorm, bool randomGlobalPhase, bool useHostMem, int64_t deviceId,
+    bool useHardwareRNG, bool useSparseStateVec, real1_f norm_thresh, std::vector<int64_t> devList,
+    bitLenInt qubitThreshold, real1_f separation_thresh)
+    : QInterface(qBitCount, rgp, doNorm, useHardwareRNG, randomGlobalPhase, norm_thresh)
+    , useHostRam(useHostMem)
+    , isSparse(useSparseStateVec)
+    , thresholdQubits(qubitThreshold)
+    , separabilityThreshold(separation_thresh)
+    , devID(deviceId)
+    , deviceIDs(devList)
+    , engines(eng)
+{
+    engine = MakeEngine(qubitCount << 1U, initState | (initState << qubitCount));
+}
+
+QEnginePtr QDensityMatrix::MakeEngine(bitLenInt qubits, bitCapInt perm)
+{
+    // rho is not a normalized state vector, and its global phase matters, so the engine must neither renormalize nor
+    // randomize phase.
+    QEnginePtr toRet = std::dynamic_pointer_cast<QEngine>(CreateQuantumInterface(engines, qubits, perm, rand_generator,
+        ONE_CMPLX, false, false, useHostRam, devID, useRDRAND, isSparse, ZERO_R1_F, deviceIDs, thresholdQubits,
+        separabilityThreshold));
+    if (!toRet) {
+        throw std::invalid_argument("QDensityMatrix engines must be a state vector QEngine type!");
+    }
+    toRet->SetConcurrency(GetConcurrencyLevel());
+
+    return toRet;
+}
+
+real1_f QDensityMatrix::Trace()
+{
+    real1 tr = ZERO_R1;
+    for (bitCapIntOcl i = 0U; i < Dim(); ++i) {
+        tr += Diagonal(i);
+    }
+
+    return (real1_f)tr;
+}
+
+void QDensityMatrix::ReducedDensityMatrix1Qb(bitLenInt qubit, complex* rho2)
+{
+    const bitCapIntOcl qPower = pow2Ocl(qubit);
+    real1 r00 = ZERO_R1, r11 = ZERO_R1;
+    complex r01 = ZERO_CMPLX;
+    for (bitCapIntOcl i = 0U; i < Dim(); ++i) {
+        if (i & qPower) {
+            continue;
+        }
+        r00 += Diagonal(i);
+        r11 += Diagonal(i | qPower);
+        r01 += engine->GetAmplitude(RowCol(i, i | qPower));
+    }
+
+    rho2[0U] = complex(r00, ZERO_R1);
+    rho2[1U] = r01;
+    rho2[2U] = conj(r01);
+    rho2[3U] = complex(r11, ZERO_R1);
+}
+
+bitCapIntOcl QDensityMatrix::PureColumn(complex* column, real1_f& pivot, real1_f& trace)
+{
+    bitCapIntOcl k = 0U;
+    real1 tr = ZERO_R1, kk = ZERO_R1;
+    for (bitCapIntOcl i = 0U; i < Dim(); ++i) {
+        const real1 d = Diagonal(i);
+        tr += d;
+        if (d > kk) {
+            kk = d;
+            k = i;
+        }
+    }
+    if (kk <= ZERO_R1) {
+        throw std::domain_error("QDensityMatrix has zero trace, so it has no state vector!");
+    }
+
+    // Column "k" is contiguous in the engine.
+    engine->GetAmplitudePage(column, RowCol(0U, k), Dim());
+
+    // For rho = t |psi><psi|, sum_i |rho_ik|^2 = t rho_kk, while it's strictly less for any mixed state.
+    real1 colNorm = ZERO_R1;
+    for (bitCapIntOcl i = 0U; i < Dim(); ++i) {
+        colNorm += norm(column[i]);
+    }
+    if (((tr * kk) - colNorm) > ((real1)PURITY_EPSILON * tr * kk)) {
+        throw std::domain_error("QDensityMatrix is in a mixed state, so it has no state vector!");
+    }
+
+    pivot = (real1_f)kk;
+    trace = (real1_f)tr;
+
+    return k;
+}
+
+QDensityMatrixPtr QDensityMatrix::MakePeer(QInterfacePtr q)
+{
+    QDensityMatrixPtr dm = std::dynamic_pointer_cast<QDensityMatrix>(q);
+    if (dm && (dm->engines == engines)) {
+        return dm;
+    }
+
+    QDensityMatrixPtr toRet = std::make_shared<QDensityMatrix>(engines, q->GetQubitCount(), 0U, rand_generator,
+        ONE_CMPLX, doNormalize, randGlobalPhase, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor,
+        deviceIDs, thresholdQubits, separabilityThreshold);
+    if (dm) {
+        std::unique_ptr<complex[]> rho(new complex[dm->Dim() * dm->Dim()]);
+        dm->GetDensityMatrix(rho.get());
+        toRet->SetDensityMatrix(rho.get());
+    } else {
+        std::unique_ptr<complex[]> psi(new complex[toRet->Dim()]);
+        q->GetQuantumState(psi.get());
+        toRet->SetQuantumState(psi.get());
+    }
+
+    return toRet;
+}
+
+void QDensityMatrix::GetDensityMatrix(complex* outputRho)
+{
+    const bitCapIntOcl dim = Dim();
+    std::unique_ptr<complex[]> column(new complex[dim]);
+    for (bitCapIntOcl j = 0U; j < dim; ++j) {
+        engine->GetAmplitudePage(column.get(), RowCol(0U, j), dim);
+        for (bitCapIntOcl i = 0U; i < dim; ++i) {
+            outputRho[i * dim + j] = column[i];
+        }
+    }
+}
+
+void QDensityMatrix::SetDensityMatrix(complex const* inputRho)
+{
+    const bitCapIntOcl dim = Dim();
+    std::unique_ptr<complex[]> column(new complex[dim]);
+    for (bitCapIntOcl j = 0U; j < dim; ++j) {
+        for (bitCapIntOcl i = 0U; i < dim; ++i) {
+            column[i] = inputRho[i * dim + j];
+        }
+        engine->SetAmplitudePage(column.get(), RowCol(0U, j), dim);
+    }
+}
+
+real1_f QDensityMatrix::Purity()
+{
+    const bitCapIntOcl dim = Dim();
+    std::unique_ptr<complex[]> column(new complex[dim]);
+    real1 toRet = ZERO_R1;
+    for (bitCapIntOcl j = 0U; j < dim; ++j) {
+        engine->GetAmplitudePage(column.get(), RowCol(0U, j), dim);
+        for (bitCapIntOcl i = 0U; i < dim; ++i) {
+            toRet += norm(column[i]);
+        }
+    }
+
+    return (real1_f)toRet;
+}
+
+void QDensityMatrix::SetQuantumState(complex const* inputState)
+{
+    const bitCapIntOcl dim = Dim();
+    std::unique_ptr<complex[]> column(new complex[dim]);
+    for (bitCapIntOcl j = 0U; j < dim; ++j) {
+        const complex c = conj(inputState[j]);
+        for (bitCapIntOcl i = 0U; i < dim; ++i) {
+            column[i] = inputState[i] * c;
+        }
+        engine->SetAmplitudePage(column.get(), RowCol(0U, j), dim);
+    }
+}
+
+void QDensityMatrix::GetQuantumState(complex* outputState)
+{
+    real1_f pivot, trace;
+    PureColumn(outputState, pivot, trace);
+
+    // rho_ik = t psi_i psi_k*, so dividing by sqrt(t rho_kk) leaves psi, with psi_k real and positive.
+    const real1 nrm = (real1)(ONE_R1_F / sqrt(pivot * trace));
+    for (bitCapIntOcl i = 0U; i < Dim(); ++i) {
+        outputState[i] *= nrm;
+    }
+}
+
+void QDensityMatrix::GetProbs(real1* outputProbs)
+{
+    for (bitCapIntOcl i = 0U; i < Dim(); ++i) {
+        outputProbs[i] = (real1)clampProb((real1_f)Diagonal(i));
+    }
+}
+
+complex QDensityMatrix::GetAmplitude(bitCapInt perm)
+{
+    if (perm >= maxQPower) {
+        throw std::invalid_argument("QDensityMatrix::GetAmplitude argument out-of-bounds!");
+    }
+
+    std::unique_ptr<complex[]> column(new complex[Dim()]);
+    real1_f pivot, trace;
+    PureColumn(column.get(), pivot, trace);
+
+    return column[(bitCapIntOcl)perm] / (real1)sqrt(pivot * trace);
+}
+
+void QDensityMatrix::SetAmplitude(bitCapInt perm, complex amp)
+{
+    if (perm >= maxQPower) {
+        throw std::invalid_argument("QDensityMatrix::SetAmplitude argument out-of-bounds!");
+    }
+
+    std::unique_ptr<complex[]> psi(new complex[Dim()]);
+    GetQuantumState(psi.get());
+    psi[(bitCapIntOcl)perm] = amp;
+    SetQuantumState(psi.get());
+}
+
+bitLenInt QDensityMatrix::Compose(QInterfacePtr toCopy, bitLenInt start)
+{
+    if (start > qubitCount) {
+        throw std::invalid_argument("QDensityMatrix::Compose start index is out-of-bounds!");
+    }
+
+    QDensityMatrixPtr dm = MakePeer(toCopy);
+    const bitLenInt n = qubitCount;
+    const bitLenInt m = dm->qubitCount;
+    const bitLenInt nQubitCount = n + m;
+
+    // The engine composes all 2m qubits of "toCopy" at "start," so its column qubits then sit between our row qubits.
+    // Move them behind all row qubits, and among our column qubits, in one relabeling.
+    engine->Compose(dm->engine, start);
+    std::vector<bitLenInt> dest(nQubitCount << 1U);
+    for (bitLenInt i = 0U; i < (start + m); ++i) {
+        dest[i] = i;
+    }
+    for (bitLenInt i = 0U; i < m; ++i) {
+        dest[start + m + i] = nQubitCount + start + i;
+    }
+    for (bitLenInt i = start; i < n; ++i) {
+        dest[i + (m << 1U)] = i + m;
+    }
+    for (bitLenInt i = 0U; i < n; ++i) {
+        dest[n + (m << 1U) + i] = nQubitCount + ((i < start) ? i : (i + m));
+    }
+    engine->PermuteQubits(dest);
+
+    SetQubitCount(nQubitCount);
+
+    return start;
+}
+
+void QDensityMatrix::Decompose(bitLenInt start, QInterfacePtr dest)
+{
+    const bitLenInt length = dest->GetQubitCount();
+    if (isBadBitRange(start, length, qubitCount)) {
+        throw std::invalid_argument("QDensityMatrix::Decompose range is out-of-bounds!");
+    }
+
+    QDensityMatrixPtr part = std::dynamic_pointer_cast<QDensityMatrix>(Clone());
+    part->Dispose(start + length, qubitCount - (start + length));
+    part->Dispose(0U, start);
+    Dispose(start, length);
+
+    QDensityMatrixPtr destDm = std::dynamic_pointer_cast<QDensityMatrix>(dest);
+    if (destDm) {
+        destDm->engine = part->engine;
+        destDm->engines = engines;
+        return;
+    }
+
+    std::unique_ptr<complex[]> psi(new complex[part->Dim()]);
+    part->GetQuantumState(psi.get());
+    dest->SetQuantumState(psi.get());
+}
+
+QInterfacePtr QDensityMatrix::Decompose(bitLenInt start, bitLenInt length)
+{
+    QDensityMatrixPtr dest = std::make_shared<QDensityMatrix>(engines, length, 0U, rand_generator, ONE_CMPLX,
+        doNormalize, randGlobalPhase, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs,
+        thresholdQubits, separabilityThreshold);
+    Decompose(start, dest);
+
+    return dest;
+}
+
+void QDensityMatrix::Dispose(bitLenInt start, bitLenInt length)
+{
+    if (isBadBitRange(start, length, qubitCount)) {
+        throw std::invalid_argument("QDensityMatrix::Dispose range is out-of-bounds!");
+    }
+
+    if (!length) {
+        return;
+    }
+
+    // The partial trace over a qubit keeps rho_00 + rho_11 of its row and column pair, which this (non-unitary)
+    // superoperator leaves in the |0>|0> corner of the pair, for the engine to dispose.
+    const complex traceOut[16U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ZERO_CMPLX,
+        ZERO_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ZERO_CMPLX };
+    for (bitLenInt i = 0U; i < length; ++i) {
+        SuperOp1Qb(traceOut, start + i);
+    }
+
+    Dispose(start, length, 0U);
+}
+
+void QDensityMatrix::Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm)
+{
+    if (isBadBitRange(start, length, qubitCount)) {
+        throw std::invalid_argument("QDensityMatrix::Dispose range is out-of-bounds!");
+    }
+
+    if (!length) {
+        return;
+    }
+
+    const bitLenInt nQubitCount = qubitCount - length;
+    engine->Dispose(start, length, disposedPerm);
+    engine->Dispose(nQubitCount + start, length, disposedPerm);
+
+    SetQubitCount(nQubitCount);
+}
+
+bitLenInt QDensityMatrix::Allocate(bitLenInt start, bitLenInt length)
+{
+    if (start > qubitCount) {
+        throw std::invalid_argument("QDensityMatrix::Allocate argument is out-of-bounds!");
+    }
+
+    if (!length) {
+        return start;
+    }
+
+    const bitLenInt nQubitCount = qubitCount + length;
+    engine->Allocate(start, length);
+    engine->Allocate(nQubitCount + start, length);
+
+    SetQubitCount(nQubitCount);
+
+    return start;
+}
+
+void QDensityMatrix::Mtrx(complex const* mtrx, bitLenInt target)
+{
+    const complex mtrxConj[4U]{ conj(mtrx[0U]), conj(mtrx[1U]), conj(mtrx[2U]), conj(mtrx[3U]) };
+    engine->Mtrx(mtrx, target);
+    engine->Mtrx(mtrxConj, target + qubitCount);
+}
+
+void QDensityMatrix::MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+{
+    const complex mtrxConj[4U]{ conj(mtrx[0U]), conj(mtrx[1U]), conj(mtrx[2U]), conj(mtrx[3U]) };
+    std::vector<bitLenInt> colControls(controls);
+    for (bitLenInt& c : colControls) {
+        c += qubitCount;
+    }
+    engine->MCMtrx(controls, mtrx, target);
+    engine->MCMtrx(colControls, mtrxConj, target + qubitCount);
+}
+
+void QDensityMatrix::MACMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+{
+    const complex mtrxConj[4U]{ conj(mtrx[0U]), conj(mtrx[1U]), conj(mtrx[2U]), conj(mtrx[3U]) };
+    std::vector<bitLenInt> colControls(controls);
+    for (bitLenInt& c : colControls) {
+        c += qubitCount;
+    }
+    engine->MACMtrx(controls, mtrx, target);
+    engine->MACMtrx(colControls, mtrxConj, target + qubitCount);
+}
+
+bool QDensityMatrix::ForceM(bitLenInt qubit, bool result, bool doForce, bool doApply)
+{
+    if (qubit >= qubitCount) {
+        throw std::invalid_argument(
+            "QDensityMatrix::ForceM qubit index parameter must be within allocated qubit bounds!");
+    }
+
+    const real1_f oneChance = Prob(qubit);
+    if (!doForce) {
+        if (oneChance >= ONE_R1) {
+            result = true;
+        } else if (oneChance <= ZERO_R1) {
+            result = false;
+        } else {
+            result = (Rand() <= oneChance);
+        }
+    }
+
+    const real1_f nrmlzr = result ? oneChance : (ONE_R1 - oneChance);
+    if (nrmlzr <= ZERO_R1) {
+        throw std::invalid_argument("QDensityMatrix::ForceM() forced a measurement result with 0 probability!");
+    }
+
+    if (doApply && ((ONE_R1 - nrmlzr) > REAL1_EPSILON)) {
+        // Project both the row and the column qubit, and restore unit trace.
+        const bitCapInt mask = pow2(qubit) | pow2(qubit + qubitCount);
+        const bitCapInt res = result ? mask : bitCapInt(0U);
+        engine->ApplyM(mask, res, complex((real1)(ONE_R1_F / nrmlzr), ZERO_R1));
+    }
+
+    return result;
+}
+
+real1_f QDensityMatrix::Prob(bitLenInt qubit)
+{
+    if (qubit >= qubitCount) {
+        throw std::invalid_argument(
+            "QDensityMatrix::Prob qubit index parameter must be within allocated qubit bounds!");
+    }
+
+    const bitCapIntOcl qPower = pow2Ocl(qubit);
+    real1 oneChance = ZERO_R1;
+    for (bitCapIntOcl i = 0U; i < Dim(); ++i) {
+        if (i & qPower) {
+            oneChance += Diagonal(i);
+        }
+    }
+
+    return clampProb((real1_f)oneChance);
+}
+
+real1_f QDensityMatrix::ProbMask(bitCapInt mask, bitCapInt permutation)
+{
+    const bitCapIntOcl maskOcl = (bitCapIntOcl)mask;
+    const bitCapIntOcl permOcl = (bitCapIntOcl)permutation;
+    real1 prob = ZERO_R1;
+    for (bitCapIntOcl i = 0U; i < Dim(); ++i) {
+        if ((i & maskOcl) == permOcl) {
+            prob += Diagonal(i);
+        }
+    }
+
+    return clampProb((real1_f)prob);
+}
+
+void QDensityMatrix::KrausProbs1Qb(const std::vector<complex>& kraus, bitLenInt qubit, real1_f* probs)
+{
+    complex rho2[4U];
+    ReducedDensityMatrix1Qb(qubit, rho2);
+
+    const size_t krausCount = kraus.size() >> 2U;
+    for (size_t k = 0U; k < krausCount; ++k) {
+        complex const* K = &(kraus[k << 2U]);
+        // Tr(K rho K^+) = sum_r sum_ab K_ra rho_ab K_rb*
+        real1 p = ZERO_R1;
+        for (size_t r = 0U; r < 2U; ++r) {
+            for (size_t a = 0U; a < 2U; ++a) {
+                for (size_t b = 0U; b < 2U; ++b) {
+                    p += real(K[(r << 1U) | a] * rho2[(a << 1U) | b] * conj(K[(r << 1U) | b]));
+                }
+            }
+        }
+        probs[k] = clampProb((real1_f)p);
+    }
+}
+
+void QDensityMatrix::ApplyKraus1Qb(complex const* kraus, bitLenInt qubit)
+{
+    real1_f prob;
+    KrausProbs1Qb(std::vector<complex>(kraus, kraus + 4U), qubit, &prob);
+    if (prob <= ZERO_R1_F) {
+        throw std::domain_error("QDensityMatrix::ApplyKraus1Qb Kraus operator branch has zero probability!");
+    }
+
+    complex sop[16U];
+    std::fill(sop, sop + 16U, ZERO_CMPLX);
+    AddKrausSuperOp(kraus, sop);
+    SuperOp1Qb(sop, qubit);
+    Scale(ONE_R1_F / prob);
+}
+
+size_t QDensityMatrix::KrausChannel1Qb(const std::vector<complex>& kraus, bitLenInt qubit)
+{
+    if (!kraus.size() || (kraus.size() & 3U)) {
+        throw std::invalid_argument("QDensityMatrix::KrausChannel1Qb kraus parameter must hold 2x2 matrices!");
+    }
+
+    complex sop[16U];
+    std::fill(sop, sop + 16U, ZERO_CMPLX);
+    real1 s00 = ZERO_R1, s11 = ZERO_R1;
+    complex s01 = ZERO_CMPLX;
+    for (size_t i = 0U; i < kraus.size(); i += 4U) {
+        s00 += norm(kraus[i]) + norm(kraus[i + 2U]);
+        s11 += norm(kraus[i + 1U]) + norm(kraus[i + 3U]);
+        s01 += conj(kraus[i]) * kraus[i + 1U] + conj(kraus[i + 2U]) * kraus[i + 3U];
+        AddKrausSuperOp(&(kraus[i]), sop);
+    }
+    if ((abs(s00 - ONE_R1) > KRAUS_EPSILON) || (abs(s11 - ONE_R1) > KRAUS_EPSILON) || (abs(s01) > KRAUS_EPSILON)) {
+        throw std::invalid_argument(
+            "QDensityMatrix::KrausChannel1Qb Kraus operators must satisfy sum_k K_k^+ K_k = I!");
+    }
+
+    SuperOp1Qb(sop, qubit);
+
+    return 0U;
+}
+
+real1_f QDensityMatrix::SumSqrDiff(QInterfacePtr toCompare)
+{
+    if (!toCompare) {
+        return ONE_R1_F;
+    }
+    if (this == toCompare.get()) {
+        return ZERO_R1_F;
+    }
+    if (qubitCount != toCompare->GetQubitCount()) {
+        return ONE_R1_F;
+    }
+
+    QDensityMatrixPtr dm = MakePeer(toCompare);
+    const bitCapIntOcl dim = Dim();
+    std::unique_ptr<complex[]> column(new complex[dim]);
+    std::unique_ptr<complex[]> otherColumn(new complex[dim]);
+    real1 toRet = ZERO_R1;
+    for (bitCapIntOcl j = 0U; j < dim; ++j) {
+        engine->GetAmplitudePage(column.get(), RowCol(0U, j), dim);
+        dm->engine->GetAmplitudePage(otherColumn.get(), RowCol(0U, j), dim);
+        for (bitCapIntOcl i = 0U; i < dim; ++i) {
+            toRet += norm(column[i] - otherColumn[i]);
+        }
+    }
+
+    return clampProb((real1_f)(toRet / 2));
+}
+
+void QDensityMatrix::NormalizeState(real1_f nrm, real1_f norm_thresh, real1_f phaseArg)
+{
+    if (nrm < ZERO_R1_F) {
+        nrm = Trace();
+    }
+    if (nrm <= ZERO_R1_F) {
+        throw std::domain_error("QDensityMatrix::NormalizeState() called with zero trace!");
+    }
+    if (abs(ONE_R1_F - nrm) <= FP_NORM_EPSILON) {
+        return;
+    }
+
+    Scale(ONE_R1_F / nrm);
+}
+
+QInterfacePtr QDensityMatrix::Clone()
+{
+    // Start from one qubit, (so as not to allocate a second full engine,) and take a copy of ours.
+    QDensityMatrixPtr c = std::make_shared<QDensityMatrix>(engines, 1U, 0U, rand_generator, ONE_CMPLX, doNormalize,
+        randGlobalPhase, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs, thresholdQubits,
+        separabilityThreshold);
+    c->SetQubitCount(qubitCount);
+    c->engine = std::dynamic_pointer_cast<QEngine>(engine->Clone());
+
+    return c;
+}
+} // namespace Qrack
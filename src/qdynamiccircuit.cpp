@@ -0,0 +1,194 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qdynamiccircuit.hpp"
+
+#include "common/counter_rng.hpp"
+
+#if ENABLE_PTHREAD
+#include "common/parallel_pool.hpp"
+#endif
+
+#include <algorithm>
+#include <random>
+
+namespace Qrack {
+
+static bitCapInt SetCbit(const bitCapInt& cbits, const bitCapInt& cPower, bool value)
+{
+    return (value == (bool)(cbits & cPower)) ? cbits : (cbits ^ cPower);
+}
+
+QDynamicCircuit::QDynamicCircuit(qrack_rand_gen_ptr rgp)
+    : qubitCount(0U)
+    , cbitCount(0U)
+    , branchCount(0U)
+{
+    if (!rgp) {
+        std::random_device rd;
+        rand_generator = std::make_shared<qrack_rand_gen>(rd());
+    } else {
+        rand_generator = rgp;
+    }
+}
+
+void QDynamicCircuit::AppendCircuit(QCircuitPtr circuit, bitCapInt mask, bitCapInt value)
+{
+    if (!circuit) {
+        throw std::invalid_argument("QDynamicCircuit::AppendCircuit circuit parameter cannot be NULL!");
+    }
+    if ((value & mask) != value) {
+        throw std::invalid_argument("QDynamicCircuit::AppendCircuit value parameter has bits outside of mask!");
+    }
+
+    QDynamicOp op;
+    op.circuit = circuit;
+    op.conditionMask = mask;
+    op.conditionValue = value;
+    op.qubit = 0U;
+    op.cbit = 0U;
+    ops.push_back(op);
+
+    if (circuit->GetQubitCount() > qubitCount) {
+        qubitCount = circuit->GetQubitCount();
+    }
+    if (mask) {
+        const bitLenInt maskBits = log2(mask) + 1U;
+        if (maskBits > cbitCount) {
+            cbitCount = maskBits;
+        }
+    }
+}
+
+void QDynamicCircuit::M(bitLenInt qubit, bitLenInt cbit)
+{
+    QDynamicOp op;
+    op.conditionMask = 0U;
+    op.conditionValue = 0U;
+    op.qubit = qubit;
+    op.cbit = cbit;
+    ops.push_back(op);
+
+    if (qubit >= qubitCount) {
+        qubitCount = qubit + 1U;
+    }
+    if (cbit >= cbitCount) {
+        cbitCount = cbit + 1U;
+    }
+}
+
+std::map<bitCapInt, int> QDynamicCircuit::RunShots(
+    QInterfacePtr sim, unsigned shots, const std::vector<real1_f>& params)
+{
+    if (qubitCount > sim->GetQubitCount()) {
+        throw std::invalid_argument("QDynamicCircuit::RunShots circuit is wider than the simulator!");
+    }
+
+    ShotContext ctx;
+    ctx.params = params;
+    ctx.branches = 0U;
+    ctx.seed = (uint64_t)(*rand_generator)();
+
+    // The terminal readout is every measurement after the last block.
+    ctx.tailStart = ops.size();
+    while (ctx.tailStart && ops[ctx.tailStart - 1U].IsMeasurement()) {
+        --ctx.tailStart;
+    }
+    for (size_t i = ctx.tailStart; i < ops.size(); ++i) {
+        const bitCapInt qPower = pow2(ops[i].qubit);
+        const auto found = std::find(ctx.tailPowers.begin(), ctx.tailPowers.end(), qPower);
+        ctx.tailIndices.push_back(found - ctx.tailPowers.begin());
+        if (found == ctx.tailPowers.end()) {
+            ctx.tailPowers.push_back(qPower);
+        }
+    }
+
+    if (shots) {
+        RunBranch(ctx, sim->Clone(), 0U, 0U, shots, 0U);
+    }
+    branchCount = ctx.branches;
+
+    return ctx.results;
+}
+
+void QDynamicCircuit::RunBranch(
+    ShotContext& ctx, QInterfacePtr sim, size_t op, bitCapInt cbits, unsigned shots, uint64_t stream)
+{
+    CounterRng gen(ctx.seed, stream);
+
+    for (; op < ctx.tailStart; ++op) {
+        const QDynamicOp& o = ops[op];
+        if (!o.IsMeasurement()) {
+            if ((cbits & o.conditionMask) == o.conditionValue) {
+                o.circuit->Run(sim, ctx.params);
+            }
+            continue;
+        }
+
+        const bitCapInt cPower = pow2(o.cbit);
+        const double oneChance = std::min(std::max((double)sim->Prob(o.qubit), 0.0), 1.0);
+        const unsigned ones = std::binomial_distribution<unsigned>(shots, oneChance)(gen);
+        if (!ones || (ones == shots)) {
+            const bool result = (bool)ones;
+            sim->ForceM(o.qubit, result);
+            cbits = SetCbit(cbits, cPower, result);
+            continue;
+        }
+
+        // The larger group continues on "sim," and the other on a clone, (which is made before "sim" collapses).
+        const bool isOneLarger = (ones << 1U) > shots;
+        QInterfacePtr sims[2U]{ sim, sim->Clone() };
+        const bool results[2U]{ isOneLarger, !isOneLarger };
+        const unsigned counts[2U]{ isOneLarger ? ones : (shots - ones), isOneLarger ? (shots - ones) : ones };
+        const uint64_t streams[2U]{ gen(), gen() };
+        const size_t next = op + 1U;
+
+        const auto runBranch = [&](const size_t& i) {
+            sims[i]->ForceM(o.qubit, results[i]);
+            RunBranch(ctx, sims[i], next, SetCbit(cbits, cPower, results[i]), counts[i], streams[i]);
+            sims[i] = NULL;
+        };
+#if ENABLE_PTHREAD
+        ParallelPool::Instance().Run(
+            2U, 2U, [&runBranch](const bitCapIntOcl& i, const unsigned& cpu) { runBranch((size_t)i); });
+#else
+        runBranch(0U);
+        runBranch(1U);
+#endif
+
+        return;
+    }
+
+    SampleTail(ctx, sim, cbits, shots);
+}
+
+void QDynamicCircuit::SampleTail(ShotContext& ctx, QInterfacePtr sim, bitCapInt cbits, unsigned shots)
+{
+    // Clones share the random generator of the simulator they came from, so sampling is serialized.
+    std::lock_guard<std::mutex> lock(ctx.resultsMutex);
+    ++ctx.branches;
+
+    if (!ctx.tailPowers.size()) {
+        ctx.results[cbits] += shots;
+        return;
+    }
+
+    const std::map<bitCapInt, int> sampled = sim->MultiShotMeasureMask(ctx.tailPowers, shots);
+    for (const auto& s : sampled) {
+        bitCapInt key = cbits;
+        for (size_t i = 0U; i < ctx.tailIndices.size(); ++i) {
+            key = SetCbit(key, pow2(ops[ctx.tailStart + i].cbit), (bool)(s.first & pow2(ctx.tailIndices[i])));
+        }
+        ctx.results[key] += s.second;
+    }
+}
+} // namespace Qrack
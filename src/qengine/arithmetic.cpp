@@ -19,6 +19,86 @@
 
 namespace Qrack {
 
+namespace {
+// Move each amplitude "lcv" in the domain of "fn" to its image, (negated, if "fn" says so,) in place: every chain of
+// displaced amplitudes is either a cycle or ends on a state outside the domain, so one amplitude in flight follows it.
+// (As out-of-place, states nothing maps to end at zero.) This needs no second state vector, at 1 bit per amplitude.
+template <typename Fn> void PermuteInPlace(const StateVectorPtr& sv, const bitCapIntOcl& maxQPower, const Fn& fn)
+{
+    std::vector<bool> isDone(maxQPower, false);
+    for (bitCapIntOcl lcv = 0U; lcv < maxQPower; ++lcv) {
+        if (isDone[lcv]) {
+            continue;
+        }
+        isDone[lcv] = true;
+
+        bitCapIntOcl dst;
+        bool isNegated = false;
+        if (!fn(lcv, dst, isNegated)) {
+            sv->write(lcv, ZERO_CMPLX);
+            continue;
+        }
+
+        complex amp = sv->read(lcv);
+        sv->write(lcv, ZERO_CMPLX);
+        while (true) {
+            if (isNegated) {
+                amp = -amp;
+            }
+            bitCapIntOcl nDst;
+            bool nIsNegated = false;
+            if (isDone[dst] || !fn(dst, nDst, nIsNegated)) {
+                // Either already moved out of, or never needed: this ends the chain.
+                isDone[dst] = true;
+                sv->write(dst, amp);
+                break;
+            }
+            isDone[dst] = true;
+            const complex displaced = sv->read(dst);
+            sv->write(dst, amp);
+            amp = displaced;
+            dst = nDst;
+            isNegated = nIsNegated;
+        }
+    }
+}
+
+// Scatter amplitude "lcv" to its image under "fn" in "nsv"
+template <typename Fn>
+inline void PermuteAmp(const StateVectorPtr& sv, const StateVectorPtr& nsv, const Fn& fn, const bitCapIntOcl& lcv)
+{
+    bitCapIntOcl outRes;
+    bool isNegated = false;
+    if (fn(lcv, outRes, isNegated)) {
+        nsv->write(outRes, isNegated ? -sv->read(lcv) : sv->read(lcv));
+    }
+}
+} // namespace
+
+StateVectorPtr QEngineCPU::AllocPermutationStateVec()
+{
+    if (!stateVec->is_sparse()) {
+        const bitCapIntOcl ampBytes = ((storage == STATE_VEC_FP16) || (storage == STATE_VEC_BF16))
+            ? (2U * sizeof(uint16_t))
+            : sizeof(complex);
+        if (isInPlaceArithmetic ||
+            ((maxAllocBytes >= 0) && ((ampBytes * maxQPowerOcl) > ((bitCapIntOcl)maxAllocBytes >> 1U)))) {
+            EnsureUniqueStateVec();
+            return nullptr;
+        }
+    }
+
+    try {
+        return AllocStateVec(maxQPowerOcl);
+    } catch (const std::bad_alloc&) {
+        if (stateVec->is_sparse()) {
+            throw;
+        }
+        EnsureUniqueStateVec();
+        return nullptr;
+    }
+}
+
 /// "Circular shift left" - shift bits left, and carry last bits.
 void QEngineCPU::ROL(bitLenInt shift, bitLenInt start, bitLenInt length)
 {
@@ -42,16 +122,80 @@ void QEngineCPU::ROL(bitLenInt shift, bitLenInt start, bitLenInt length)
     const bitCapIntOcl regMask = lengthMask << start;
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ regMask;
 
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        const bitCapIntOcl otherRes = lcv & otherMask;
+        const bitCapIntOcl regInt = (lcv & regMask) >> start;
+        const bitCapIntOcl outInt = (regInt >> (length - shift)) | ((regInt << shift) & lengthMask);
+        outRes = (outInt << start) | otherRes;
+        return true;
+    };
+
     Finish();
 
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
     stateVec->isReadLocked = false;
 
     ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
-        const bitCapIntOcl otherRes = lcv & otherMask;
-        const bitCapIntOcl regInt = (lcv & regMask) >> start;
-        const bitCapIntOcl outInt = (regInt >> (length - shift)) | ((regInt << shift) & lengthMask);
-        nStateVec->write((outInt << start) | otherRes, stateVec->read(lcv));
+        PermuteAmp(stateVec, nStateVec, permFn, lcv);
+    };
+
+    if (stateVec->is_sparse()) {
+        par_for_set(CastStateVecSparse()->iterable(), fn);
+    } else {
+        par_for(0, maxQPowerOcl, fn);
+    }
+
+    ResetStateVec(nStateVec);
+}
+
+/// Relabel every qubit in one pass, (or one in-place cycle walk,) instead of one pass per SWAP
+void QEngineCPU::PermuteQubits(const std::vector<bitLenInt>& dest)
+{
+    if (dest.size() != qubitCount) {
+        throw std::invalid_argument("QEngineCPU::PermuteQubits must map every qubit!");
+    }
+    ThrowIfQbIdArrayIsBad(dest, qubitCount, "QEngineCPU::PermuteQubits destination is out-of-bounds!");
+
+    CHECK_ZERO_SKIP();
+
+    std::vector<bitLenInt> moved;
+    bitCapIntOcl movedMask = 0U;
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        if (dest[i] != i) {
+            moved.push_back(i);
+            movedMask |= pow2Ocl(i);
+        }
+    }
+
+    if (!moved.size()) {
+        return;
+    }
+
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        outRes = lcv & ~movedMask;
+        for (const bitLenInt& i : moved) {
+            if ((lcv >> i) & 1U) {
+                outRes |= pow2Ocl(dest[i]);
+            }
+        }
+        return true;
+    };
+
+    Finish();
+
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
+    stateVec->isReadLocked = false;
+
+    ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        PermuteAmp(stateVec, nStateVec, permFn, lcv);
     };
 
     if (stateVec->is_sparse()) {
@@ -153,16 +297,25 @@ void QEngineCPU::INC(bitCapInt toAdd, bitLenInt inOutStart, bitLenInt length)
     const bitCapIntOcl inOutMask = lengthMask << inOutStart;
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ inOutMask;
 
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        const bitCapIntOcl otherRes = lcv & otherMask;
+        const bitCapIntOcl inOutInt = (lcv & inOutMask) >> inOutStart;
+        const bitCapIntOcl outInt = (inOutInt + toAddOcl) & lengthMask;
+        outRes = (outInt << inOutStart) | otherRes;
+        return true;
+    };
+
     Finish();
 
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
     stateVec->isReadLocked = false;
 
     ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
-        const bitCapIntOcl otherRes = lcv & otherMask;
-        const bitCapIntOcl inOutInt = (lcv & inOutMask) >> inOutStart;
-        const bitCapIntOcl outInt = (inOutInt + toAddOcl) & lengthMask;
-        nStateVec->write((outInt << inOutStart) | otherRes, stateVec->read(lcv));
+        PermuteAmp(stateVec, nStateVec, permFn, lcv);
     };
 
     if (stateVec->is_sparse()) {
@@ -213,17 +366,31 @@ void QEngineCPU::CINC(bitCapInt toAdd, bitLenInt inOutStart, bitLenInt length, c
     const bitCapIntOcl inOutMask = lengthMask << inOutStart;
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ (inOutMask | controlMask);
 
+    // Where the controls aren't all set, this is the identity.
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        if ((lcv & controlMask) != controlMask) {
+            outRes = lcv;
+            return true;
+        }
+        const bitCapIntOcl otherRes = lcv & otherMask;
+        const bitCapIntOcl inOutInt = (lcv & inOutMask) >> inOutStart;
+        const bitCapIntOcl outInt = (inOutInt + toAddOcl) & lengthMask;
+        outRes = (outInt << inOutStart) | otherRes | controlMask;
+        return true;
+    };
+
     Finish();
 
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
     nStateVec->copy(stateVec);
     stateVec->isReadLocked = false;
 
     par_for_mask(0, maxQPowerOcl, controlPowers, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
-        const bitCapIntOcl otherRes = lcv & otherMask;
-        const bitCapIntOcl inOutInt = (lcv & inOutMask) >> inOutStart;
-        const bitCapIntOcl outInt = (inOutInt + toAddOcl) & lengthMask;
-        nStateVec->write((outInt << inOutStart) | otherRes | controlMask, stateVec->read(lcv | controlMask));
+        PermuteAmp(stateVec, nStateVec, permFn, lcv | controlMask);
     });
 
     ResetStateVec(nStateVec);
@@ -258,24 +425,34 @@ void QEngineCPU::INCDECC(bitCapInt toMod, bitLenInt inOutStart, bitLenInt length
     const bitCapIntOcl inOutMask = lengthMask << inOutStart;
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ (inOutMask | carryMask);
 
-    Finish();
-
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
-    nStateVec->clear();
-    stateVec->isReadLocked = false;
-
-    par_for_skip(0, maxQPowerOcl, pow2Ocl(carryIndex), ONE_BCI, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+    // (The carry is clear coming in.)
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        if (lcv & carryMask) {
+            return false;
+        }
         const bitCapIntOcl otherRes = lcv & otherMask;
         const bitCapIntOcl inOutInt = (lcv & inOutMask) >> inOutStart;
         const bitCapIntOcl outInt = inOutInt + toModOcl;
-        bitCapIntOcl outRes;
         if (outInt < lengthPower) {
             outRes = (outInt << inOutStart) | otherRes;
         } else {
             outRes = ((outInt - lengthPower) << inOutStart) | otherRes | carryMask;
         }
-        nStateVec->write(outRes, stateVec->read(lcv));
-    });
+        return true;
+    };
+
+    Finish();
+
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
+    nStateVec->clear();
+    stateVec->isReadLocked = false;
+
+    par_for_skip(0, maxQPowerOcl, pow2Ocl(carryIndex), ONE_BCI,
+        [&](const bitCapIntOcl& lcv, const unsigned& cpu) { PermuteAmp(stateVec, nStateVec, permFn, lcv); });
     ResetStateVec(nStateVec);
 }
 
@@ -315,28 +492,32 @@ void QEngineCPU::INCS(bitCapInt toAdd, bitLenInt inOutStart, bitLenInt length, b
     const bitCapIntOcl inOutMask = lengthMask << inOutStart;
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ inOutMask;
 
-    Finish();
-
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
-    nStateVec->clear();
-    stateVec->isReadLocked = false;
-
-    ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
         const bitCapIntOcl otherRes = lcv & otherMask;
         const bitCapIntOcl inOutInt = (lcv & inOutMask) >> inOutStart;
         const bitCapIntOcl outInt = inOutInt + toAddOcl;
-        bitCapIntOcl outRes;
         if (outInt < lengthPower) {
             outRes = (outInt << inOutStart) | otherRes;
         } else {
             outRes = ((outInt - lengthPower) << inOutStart) | otherRes;
         }
         bool isOverflow = isOverflowAdd(inOutInt, toAddOcl, signMask, lengthPower);
-        if (isOverflow && ((outRes & overflowMask) == overflowMask)) {
-            nStateVec->write(outRes, -stateVec->read(lcv));
-        } else {
-            nStateVec->write(outRes, stateVec->read(lcv));
-        }
+        isNegated = isOverflow && ((outRes & overflowMask) == overflowMask);
+        return true;
+    };
+
+    Finish();
+
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
+    nStateVec->clear();
+    stateVec->isReadLocked = false;
+
+    ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        PermuteAmp(stateVec, nStateVec, permFn, lcv);
     };
 
     if (stateVec->is_sparse()) {
@@ -377,30 +558,37 @@ void QEngineCPU::INCDECSC(bitCapInt toMod, bitLenInt inOutStart, bitLenInt lengt
     const bitCapIntOcl inOutMask = lengthMask << inOutStart;
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ (inOutMask | carryMask);
 
-    Finish();
-
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
-    nStateVec->clear();
-    stateVec->isReadLocked = false;
-
-    par_for_skip(0, maxQPowerOcl, carryMask, ONE_BCI, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+    // (The carry is clear coming in.)
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        if (lcv & carryMask) {
+            return false;
+        }
         const bitCapIntOcl otherRes = lcv & otherMask;
         const bitCapIntOcl inOutInt = (lcv & inOutMask) >> inOutStart;
         const bitCapIntOcl inInt = toModOcl;
         const bitCapIntOcl outInt = inOutInt + toModOcl;
-        bitCapIntOcl outRes;
         if (outInt < lengthPower) {
             outRes = (outInt << inOutStart) | otherRes;
         } else {
             outRes = ((outInt - lengthPower) << inOutStart) | otherRes | carryMask;
         }
         bool isOverflow = isOverflowAdd(inOutInt, inInt, signMask, lengthPower);
-        if (isOverflow) {
-            nStateVec->write(outRes, -stateVec->read(lcv));
-        } else {
-            nStateVec->write(outRes, stateVec->read(lcv));
-        }
-    });
+        isNegated = isOverflow;
+        return true;
+    };
+
+    Finish();
+
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
+    nStateVec->clear();
+    stateVec->isReadLocked = false;
+
+    par_for_skip(0, maxQPowerOcl, carryMask, ONE_BCI,
+        [&](const bitCapIntOcl& lcv, const unsigned& cpu) { PermuteAmp(stateVec, nStateVec, permFn, lcv); });
     ResetStateVec(nStateVec);
 }
 
@@ -439,35 +627,42 @@ void QEngineCPU::INCDECSC(
     const bitCapIntOcl inOutMask = lengthMask << inOutStart;
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ (inOutMask | carryMask);
 
-    Finish();
-
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
-    nStateVec->clear();
-    stateVec->isReadLocked = false;
-
-    par_for_skip(0, maxQPowerOcl, carryMask, ONE_BCI, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+    // (The carry is clear coming in.)
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        if (lcv & carryMask) {
+            return false;
+        }
         const bitCapIntOcl otherRes = lcv & otherMask;
         const bitCapIntOcl inOutInt = (lcv & inOutMask) >> inOutStart;
         const bitCapIntOcl inInt = toModOcl;
         const bitCapIntOcl outInt = inOutInt + toModOcl;
-        bitCapIntOcl outRes;
         if (outInt < lengthPower) {
             outRes = (outInt << inOutStart) | otherRes;
         } else {
             outRes = ((outInt - lengthPower) << inOutStart) | otherRes | carryMask;
         }
         bool isOverflow = isOverflowAdd(inOutInt, inInt, signMask, lengthPower);
-        if (isOverflow && ((outRes & overflowMask) == overflowMask)) {
-            nStateVec->write(outRes, -stateVec->read(lcv));
-        } else {
-            nStateVec->write(outRes, stateVec->read(lcv));
-        }
-    });
+        isNegated = isOverflow && ((outRes & overflowMask) == overflowMask);
+        return true;
+    };
+
+    Finish();
+
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
+    nStateVec->clear();
+    stateVec->isReadLocked = false;
+
+    par_for_skip(0, maxQPowerOcl, carryMask, ONE_BCI,
+        [&](const bitCapIntOcl& lcv, const unsigned& cpu) { PermuteAmp(stateVec, nStateVec, permFn, lcv); });
     ResetStateVec(nStateVec);
 }
 
 void QEngineCPU::MULDIV(const IOFn& inFn, const IOFn& outFn, const bitCapInt& toMul, const bitLenInt& inOutStart,
-    const bitLenInt& carryStart, const bitLenInt& length)
+    const bitLenInt& carryStart, const bitLenInt& length, const bool& inverse)
 {
     if (isBadBitRange(inOutStart, length, qubitCount)) {
         throw std::invalid_argument("QEngineCPU::MULDIV range is out-of-bounds!");
@@ -486,9 +681,33 @@ void QEngineCPU::MULDIV(const IOFn& inFn, const IOFn& outFn, const bitCapInt& to
     const bitCapIntOcl carryMask = lowMask << carryStart;
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ (inOutMask | carryMask);
 
+    // In place, each product (in "inOutStart" and "carryStart") moves back to its quotient, if it has one, for DIV.
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        const bitCapIntOcl otherRes = lcv & otherMask;
+        if (inverse) {
+            const bitCapIntOcl mulInt =
+                ((lcv & inOutMask) >> inOutStart) | (((lcv & carryMask) >> carryStart) << length);
+            if ((mulInt % toMulOcl) || ((mulInt / toMulOcl) > lowMask)) {
+                return false;
+            }
+            outRes = ((mulInt / toMulOcl) << inOutStart) | otherRes;
+            return true;
+        }
+        if (lcv & carryMask) {
+            return false;
+        }
+        const bitCapIntOcl mulInt = ((lcv & inOutMask) >> inOutStart) * toMulOcl;
+        outRes = ((mulInt & lowMask) << inOutStart) | (((mulInt & highMask) >> length) << carryStart) | otherRes;
+        return true;
+    };
+
     Finish();
 
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
     nStateVec->clear();
     stateVec->isReadLocked = false;
 
@@ -529,11 +748,12 @@ void QEngineCPU::DIV(bitCapInt toDiv, bitLenInt inOutStart, bitLenInt carryStart
     }
 
     MULDIV([](const bitCapIntOcl& orig, const bitCapIntOcl& mul) { return mul; },
-        [](const bitCapIntOcl& orig, const bitCapIntOcl& mul) { return orig; }, toDiv, inOutStart, carryStart, length);
+        [](const bitCapIntOcl& orig, const bitCapIntOcl& mul) { return orig; }, toDiv, inOutStart, carryStart, length,
+        true);
 }
 
 void QEngineCPU::CMULDIV(const IOFn& inFn, const IOFn& outFn, const bitCapInt& toMul, const bitLenInt& inOutStart,
-    const bitLenInt& carryStart, const bitLenInt& length, const std::vector<bitLenInt>& controls)
+    const bitLenInt& carryStart, const bitLenInt& length, const std::vector<bitLenInt>& controls, const bool& inverse)
 {
     if (isBadBitRange(inOutStart, length, qubitCount)) {
         throw std::invalid_argument("QEngineCPU::CMULDIV range is out-of-bounds!");
@@ -568,9 +788,38 @@ void QEngineCPU::CMULDIV(const IOFn& inFn, const IOFn& outFn, const bitCapInt& t
 
     bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ (inOutMask | carryMask | controlMask);
 
+    // As MULDIV(), where the controls are all set, and otherwise the identity
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        const bitCapIntOcl otherRes = lcv & otherMask;
+        if (inverse && ((lcv & controlMask) == controlMask)) {
+            const bitCapIntOcl mulInt =
+                ((lcv & inOutMask) >> inOutStart) | (((lcv & carryMask) >> carryStart) << length);
+            if ((mulInt % toMulOcl) || ((mulInt / toMulOcl) > lowMask)) {
+                return false;
+            }
+            outRes = ((mulInt / toMulOcl) << inOutStart) | otherRes | controlMask;
+            return true;
+        }
+        if (lcv & carryMask) {
+            return false;
+        }
+        if ((lcv & controlMask) != controlMask) {
+            outRes = lcv;
+            return true;
+        }
+        const bitCapIntOcl mulInt = ((lcv & inOutMask) >> inOutStart) * toMulOcl;
+        outRes = ((mulInt & lowMask) << inOutStart) | (((mulInt & highMask) >> length) << carryStart) | otherRes |
+            controlMask;
+        return true;
+    };
+
     Finish();
 
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
     nStateVec->clear();
     stateVec->isReadLocked = false;
 
@@ -638,7 +887,7 @@ void QEngineCPU::CDIV(bitCapInt toDiv, bitLenInt inOutStart, bitLenInt carryStar
 
     CMULDIV([](const bitCapIntOcl& orig, const bitCapIntOcl& mul) { return mul; },
         [](const bitCapIntOcl& orig, const bitCapIntOcl& mul) { return orig; }, toDiv, inOutStart, carryStart, length,
-        controls);
+        controls, true);
 }
 
 void QEngineCPU::ModNOut(const MFn& kernelFn, const bitCapInt& modN, const bitLenInt& inStart,
@@ -660,10 +909,33 @@ void QEngineCPU::ModNOut(const MFn& kernelFn, const bitCapInt& modN, const bitLe
     const bitCapIntOcl modMask = (isPowerOfTwo(modN) ? modNOcl : pow2Ocl(log2(modNOcl) + 1U)) - ONE_BCI;
     const bitCapIntOcl outMask = modMask << outStart;
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ (inMask | outMask);
+    const bitCapIntOcl outRegMask = lowMask << outStart;
+
+    // In place, the inverse moves each state with "outStart" equal to its function of "inStart" back to 0 output.
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        const bitCapIntOcl inRes = lcv & inMask;
+        const bitCapIntOcl modRes = (kernelFn(inRes >> inStart) % modNOcl) << outStart;
+        if (inverse) {
+            if ((lcv & outRegMask) != modRes) {
+                return false;
+            }
+            outRes = lcv ^ modRes;
+            return true;
+        }
+        if (lcv & outRegMask) {
+            return false;
+        }
+        outRes = lcv | modRes;
+        return true;
+    };
 
     Finish();
 
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
     nStateVec->clear();
     stateVec->isReadLocked = false;
 
@@ -751,9 +1023,31 @@ void QEngineCPU::CModNOut(const MFn& kernelFn, const bitCapInt& modN, const bitL
 
     bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ (inMask | outMask | controlMask);
 
+    // As ModNOut(), where the controls are all set, and otherwise the identity
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        const bitCapIntOcl inRes = lcv & inMask;
+        const bitCapIntOcl modRes = (kernelFn(inRes >> inStart) % modNOcl) << outStart;
+        if (inverse && ((lcv & controlMask) == controlMask)) {
+            if ((lcv & outMask) != modRes) {
+                return false;
+            }
+            outRes = lcv ^ modRes;
+            return true;
+        }
+        if (lcv & outMask) {
+            return false;
+        }
+        outRes = ((lcv & controlMask) == controlMask) ? (lcv | modRes) : lcv;
+        return true;
+    };
+
     Finish();
 
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
     nStateVec->clear();
     stateVec->isReadLocked = false;
 
@@ -853,13 +1147,7 @@ void QEngineCPU::INCBCD(bitCapInt toAdd, bitLenInt inOutStart, bitLenInt length)
     const bitCapIntOcl inOutMask = bitRegMaskOcl(inOutStart, length);
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ inOutMask;
 
-    Finish();
-
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
-    nStateVec->clear();
-    stateVec->isReadLocked = false;
-
-    ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
         const bitCapIntOcl otherRes = lcv & otherMask;
         bitCapIntOcl partToAdd = toAddOcl;
         bitCapIntOcl inOutInt = (lcv & inOutMask) >> inOutStart;
@@ -886,10 +1174,25 @@ void QEngineCPU::INCBCD(bitCapInt toAdd, bitLenInt inOutStart, bitLenInt length)
                 }
                 outInt |= (bitCapIntOcl)nibbles[j] << (j * 4U * ONE_BCI);
             }
-            nStateVec->write((outInt << inOutStart) | otherRes, stateVec->read(lcv));
+            outRes = (outInt << inOutStart) | otherRes;
         } else {
-            nStateVec->write(lcv, stateVec->read(lcv));
+            outRes = lcv;
         }
+        return true;
+    };
+
+    Finish();
+
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
+    nStateVec->clear();
+    stateVec->isReadLocked = false;
+
+    ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        PermuteAmp(stateVec, nStateVec, permFn, lcv);
     };
 
     if (stateVec->is_sparse()) {
@@ -934,13 +1237,8 @@ void QEngineCPU::INCDECBCDC(bitCapInt toMod, bitLenInt inOutStart, bitLenInt len
     const bitCapIntOcl carryMask = pow2Ocl(carryIndex);
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ (inOutMask | carryMask);
 
-    Finish();
-
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
-    nStateVec->clear();
-    stateVec->isReadLocked = false;
-
-    par_for_skip(0, maxQPowerOcl, pow2Ocl(carryIndex), ONE_BCI, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+    // (A set carry coming in flips the carry going out.)
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
         const bitCapIntOcl otherRes = lcv & otherMask;
         bitCapIntOcl partToAdd = toModOcl;
         bitCapIntOcl inOutInt = (lcv & inOutMask) >> inOutStart;
@@ -969,7 +1267,6 @@ void QEngineCPU::INCDECBCDC(bitCapInt toMod, bitLenInt inOutStart, bitLenInt len
         }
         if (isValid) {
             bitCapIntOcl outInt = 0;
-            bitCapIntOcl outRes = 0;
             bitCapIntOcl carryRes = 0;
             for (bitLenInt j = 0; j < nibbleCount; ++j) {
                 if (nibbles[j] > 9) {
@@ -982,15 +1279,27 @@ void QEngineCPU::INCDECBCDC(bitCapInt toMod, bitLenInt inOutStart, bitLenInt len
                 }
                 outInt |= (bitCapIntOcl)nibbles[j] << (j * 4U * ONE_BCI);
             }
-            outRes = (outInt << inOutStart) | otherRes | carryRes;
-            nStateVec->write(outRes, stateVec->read(lcv));
-            outRes ^= carryMask;
-            nStateVec->write(outRes, stateVec->read(lcv | carryMask));
+            outRes = ((outInt << inOutStart) | otherRes | carryRes) ^ (lcv & carryMask);
         } else {
-            nStateVec->write(lcv, stateVec->read(lcv));
-            nStateVec->write(lcv | carryMask, stateVec->read(lcv | carryMask));
+            outRes = lcv;
         }
         delete[] nibbles;
+        return true;
+    };
+
+    Finish();
+
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
+    nStateVec->clear();
+    stateVec->isReadLocked = false;
+
+    par_for_skip(0, maxQPowerOcl, pow2Ocl(carryIndex), ONE_BCI, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        PermuteAmp(stateVec, nStateVec, permFn, lcv);
+        PermuteAmp(stateVec, nStateVec, permFn, lcv | carryMask);
     });
     ResetStateVec(nStateVec);
 }
@@ -1018,52 +1327,53 @@ bitCapInt QEngineCPU::IndexedLDA(bitLenInt indexStart, bitLenInt indexLength, bi
 
     const bitLenInt valueBytes = (valueLength + 7U) / 8U;
     const bitCapIntOcl inputMask = bitRegMaskOcl(indexStart, indexLength);
+    const bitCapIntOcl outputMask = bitRegMaskOcl(valueStart, valueLength);
     const bitCapIntOcl skipPower = pow2Ocl(valueStart);
 
-    Finish();
-
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
-    nStateVec->clear();
-    stateVec->isReadLocked = false;
-
-    ParallelFunc fn;
-    if (valueBytes == 1) {
-        fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
-            nStateVec->write(
-                lcv | ((bitCapIntOcl)values[(lcv & inputMask) >> indexStart] << valueStart), stateVec->read(lcv));
-        };
-    } else if (valueBytes == 2) {
-        uint16_t* inputIntPtr = (uint16_t*)values;
-        fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
-            nStateVec->write(
-                lcv | ((bitCapIntOcl)inputIntPtr[(lcv & inputMask) >> indexStart] << valueStart), stateVec->read(lcv));
-        };
-    } else if (valueBytes == 4) {
-        uint32_t* inputIntPtr = (uint32_t*)values;
-        fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
-            nStateVec->write(
-                lcv | ((bitCapIntOcl)inputIntPtr[(lcv & inputMask) >> indexStart] << valueStart), stateVec->read(lcv));
-        };
-    } else {
-        fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
-            bitCapIntOcl inputInt = (lcv & inputMask) >> indexStart;
-            bitCapIntOcl outputInt = 0;
+    // (The value register is clear coming in.)
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        if (lcv & outputMask) {
+            return false;
+        }
+        const bitCapIntOcl inputInt = (lcv & inputMask) >> indexStart;
+        bitCapIntOcl outputInt = 0;
+        if (valueBytes == 1) {
+            outputInt = values[inputInt];
+        } else if (valueBytes == 2) {
+            outputInt = ((uint16_t*)values)[inputInt];
+        } else if (valueBytes == 4) {
+            outputInt = ((uint32_t*)values)[inputInt];
+        } else {
             for (bitCapIntOcl j = 0; j < valueBytes; ++j) {
                 outputInt |= (bitCapIntOcl)values[inputInt * valueBytes + j] << (8U * j);
             }
-            bitCapIntOcl outputRes = outputInt << valueStart;
-            nStateVec->write(outputRes | lcv, stateVec->read(lcv));
+        }
+        outRes = (outputInt << valueStart) | lcv;
+        return true;
+    };
+
+    Finish();
+
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (nStateVec) {
+        nStateVec->clear();
+        stateVec->isReadLocked = false;
+
+        ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            PermuteAmp(stateVec, nStateVec, permFn, lcv);
         };
-    }
 
-    if (stateVec->is_sparse()) {
-        par_for_set(CastStateVecSparse()->iterable(0, skipPower, 0), fn);
+        if (stateVec->is_sparse()) {
+            par_for_set(CastStateVecSparse()->iterable(0, skipPower, 0), fn);
+        } else {
+            par_for_skip(0, maxQPowerOcl, skipPower, valueLength, fn);
+        }
+
+        ResetStateVec(nStateVec);
     } else {
-        par_for_skip(0, maxQPowerOcl, skipPower, valueLength, fn);
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
     }
 
-    ResetStateVec(nStateVec);
-
 #if ENABLE_VM6502Q_DEBUG
     return (bitCapInt)(GetExpectation(valueStart, valueLength) + (real1_f)0.5f);
 #else
@@ -1110,11 +1420,6 @@ bitCapInt QEngineCPU::IndexedADC(bitLenInt indexStart, bitLenInt indexLength, bi
 
     Finish();
 
-    // We calloc a new stateVector for output.
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
-    nStateVec->clear();
-    stateVec->isReadLocked = false;
-
     // We're going to loop over every eigenstate in the vector, (except, we
     // already know the carry is zero).  This bit masks let us quickly
     // distinguish the different values of the input register, output register,
@@ -1127,7 +1432,11 @@ bitCapInt QEngineCPU::IndexedADC(bitLenInt indexStart, bitLenInt indexLength, bi
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) & (~(inputMask | outputMask | carryMask));
     const bitCapIntOcl skipPower = pow2Ocl(carryIndex);
 
-    ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        if (lcv & carryMask) {
+            return false;
+        }
+
         // These are qubits that are not directly involved in the
         // operation. We iterate over all of their possibilities, but their
         // input value matches their output value:
@@ -1173,19 +1482,33 @@ bitCapInt QEngineCPU::IndexedADC(bitLenInt indexStart, bitLenInt indexLength, bi
         // shunt the uninvoled "other" bits from input to output.
         outputRes = outputInt << valueStart;
 
-        nStateVec->write(outputRes | inputRes | otherRes | carryRes, stateVec->read(lcv));
+        outRes = outputRes | inputRes | otherRes | carryRes;
+        return true;
     };
 
-    if (stateVec->is_sparse()) {
-        par_for_set(CastStateVecSparse()->iterable(0, skipPower, 0), fn);
+    // We calloc a new stateVector for output, unless we permute in place.
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (nStateVec) {
+        nStateVec->clear();
+        stateVec->isReadLocked = false;
+
+        ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            PermuteAmp(stateVec, nStateVec, permFn, lcv);
+        };
+
+        if (stateVec->is_sparse()) {
+            par_for_set(CastStateVecSparse()->iterable(0, skipPower, 0), fn);
+        } else {
+            par_for_skip(0, maxQPowerOcl, skipPower, 1, fn);
+        }
+
+        // We dealloc the old state vector and replace it with the one we
+        // just calculated.
+        ResetStateVec(nStateVec);
     } else {
-        par_for_skip(0, maxQPowerOcl, skipPower, 1, fn);
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
     }
 
-    // We dealloc the old state vector and replace it with the one we
-    // just calculated.
-    ResetStateVec(nStateVec);
-
 #if ENABLE_VM6502Q_DEBUG
     return (bitCapInt)(GetExpectation(valueStart, valueLength) + (real1_f)0.5f);
 #else
@@ -1233,11 +1556,6 @@ bitCapInt QEngineCPU::IndexedSBC(bitLenInt indexStart, bitLenInt indexLength, bi
 
     Finish();
 
-    // We calloc a new stateVector for output.
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
-    nStateVec->clear();
-    stateVec->isReadLocked = false;
-
     // We're going to loop over every eigenstate in the vector, (except, we already know the carry is zero).
     // This bit masks let us quickly distinguish the different values of the input register, output register, carry, and
     // other bits that aren't involved in the operation.
@@ -1249,7 +1567,11 @@ bitCapInt QEngineCPU::IndexedSBC(bitLenInt indexStart, bitLenInt indexLength, bi
     const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) & (~(inputMask | outputMask | carryMask));
     const bitCapIntOcl skipPower = pow2Ocl(carryIndex);
 
-    ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
+        if (lcv & carryMask) {
+            return false;
+        }
+
         // These are qubits that are not directly involved in the
         // operation. We iterate over all of their possibilities, but their
         // input value matches their output value:
@@ -1299,19 +1621,33 @@ bitCapInt QEngineCPU::IndexedSBC(bitLenInt indexStart, bitLenInt indexLength, bi
         // shunt the uninvoled "other" bits from input to output.
         outputRes = outputInt << valueStart;
 
-        nStateVec->write(outputRes | inputRes | otherRes | carryRes, stateVec->read(lcv));
+        outRes = outputRes | inputRes | otherRes | carryRes;
+        return true;
     };
 
-    if (stateVec->is_sparse()) {
-        par_for_set(CastStateVecSparse()->iterable(0, skipPower, 0), fn);
+    // We calloc a new stateVector for output, unless we permute in place.
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (nStateVec) {
+        nStateVec->clear();
+        stateVec->isReadLocked = false;
+
+        ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            PermuteAmp(stateVec, nStateVec, permFn, lcv);
+        };
+
+        if (stateVec->is_sparse()) {
+            par_for_set(CastStateVecSparse()->iterable(0, skipPower, 0), fn);
+        } else {
+            par_for_skip(0, maxQPowerOcl, skipPower, 1, fn);
+        }
+
+        // We dealloc the old state vector and replace it with the one we
+        // just calculated.
+        ResetStateVec(nStateVec);
     } else {
-        par_for_skip(0, maxQPowerOcl, skipPower, valueLength, fn);
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
     }
 
-    // We dealloc the old state vector and replace it with the one we
-    // just calculated.
-    ResetStateVec(nStateVec);
-
 #if ENABLE_VM6502Q_DEBUG
     return (bitCapInt)(GetExpectation(valueStart, valueLength) + (real1_f)0.5f);
 #else
@@ -1331,13 +1667,7 @@ void QEngineCPU::Hash(bitLenInt start, bitLenInt length, const unsigned char* va
     const bitLenInt bytes = (length + 7U) / 8U;
     const bitCapIntOcl inputMask = bitRegMaskOcl(start, length);
 
-    Finish();
-
-    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
-    nStateVec->clear();
-    stateVec->isReadLocked = false;
-
-    ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+    const auto permFn = [&](const bitCapIntOcl& lcv, bitCapIntOcl& outRes, bool& isNegated) -> bool {
         const bitCapIntOcl inputRes = lcv & inputMask;
         const bitCapIntOcl inputInt = inputRes >> start;
         bitCapIntOcl outputInt = 0;
@@ -1353,7 +1683,22 @@ void QEngineCPU::Hash(bitLenInt start, bitLenInt length, const unsigned char* va
             }
         }
         bitCapIntOcl outputRes = outputInt << start;
-        nStateVec->write(outputRes | (lcv & ~inputRes), stateVec->read(lcv));
+        outRes = outputRes | (lcv & ~inputRes);
+        return true;
+    };
+
+    Finish();
+
+    StateVectorPtr nStateVec = AllocPermutationStateVec();
+    if (!nStateVec) {
+        PermuteInPlace(stateVec, maxQPowerOcl, permFn);
+        return;
+    }
+    nStateVec->clear();
+    stateVec->isReadLocked = false;
+
+    ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        PermuteAmp(stateVec, nStateVec, permFn, lcv);
     };
 
     if (stateVec->is_sparse()) {
@@ -1394,6 +1739,7 @@ void QEngineCPU::FullAdd(bitLenInt inputBit1, bitLenInt inputBit2, bitLenInt car
     std::sort(qPowers.begin(), qPowers.end());
 
     Finish();
+    EnsureUniqueStateVec();
 
     par_for_mask(0, maxQPowerOcl, qPowers, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
         // Carry-in, sum bit in
@@ -1478,6 +1824,7 @@ void QEngineCPU::IFullAdd(bitLenInt inputBit1, bitLenInt inputBit2, bitLenInt ca
     std::sort(qPowers.begin(), qPowers.end());
 
     Finish();
+    EnsureUniqueStateVec();
 
     par_for_mask(0, maxQPowerOcl, qPowers, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
         // Carry-in, sum bit out
@@ -1546,6 +1893,9 @@ void QEngineCPU::CPhaseFlipIfLess(bitCapInt greaterPerm, bitLenInt start, bitLen
 
     CHECK_ZERO_SKIP();
 
+    DirtyProbCache(0U);
+    EnsureUniqueStateVec(true, false);
+
     Dispatch(maxQPower, [this, greaterPerm, start, length, flagIndex] {
         const bitCapIntOcl regMask = bitRegMaskOcl(start, length);
         const bitCapIntOcl flagMask = pow2Ocl(flagIndex);
@@ -1567,6 +1917,9 @@ void QEngineCPU::PhaseFlipIfLess(bitCapInt greaterPerm, bitLenInt start, bitLenI
 
     CHECK_ZERO_SKIP();
 
+    DirtyProbCache(0U);
+    EnsureUniqueStateVec(true, false);
+
     Dispatch(maxQPower, [this, greaterPerm, start, length] {
         const bitCapIntOcl regMask = bitRegMaskOcl(start, length);
         const bitCapIntOcl greaterPermOcl = (bitCapIntOcl)greaterPerm;
@@ -28,6 +28,21 @@ namespace Qrack {
 #define APPLY2X2_PHASE 0x40
 #define APPLY2X2_INVERT 0x80
 
+// Op codes for the "gatelist" kernel, (which must match qengine.cl)
+#define GATE_LIST_2X2 0U
+#define GATE_LIST_X 1U
+#define GATE_LIST_Z 2U
+#define GATE_LIST_PHASE 3U
+#define GATE_LIST_INVERT 4U
+#define GATE_LIST_X_MASK 5U
+#define GATE_LIST_NORM_NONE 0U
+#define GATE_LIST_NORM_IN_PLACE 1U
+#define GATE_LIST_NORM_SUM 2U
+
+// Cross-context page transfers are staged through host memory in chunks of at most 2^QRACK_OCL_TRANSFER_CHUNK_POW
+// amplitudes, double buffered.
+#define QRACK_OCL_TRANSFER_CHUNK_POW 18U
+
 // These are commonly used emplace patterns, for OpenCL buffer I/O.
 #define DISPATCH_BLOCK_WRITE(waitVec, buff, offset, length, array)                                                     \
     tryOcl("Failed to write buffer",                                                                                   \
@@ -76,11 +91,18 @@ QEngineOCL::QEngineOCL(bitLenInt qBitCount, bitCapInt initState, qrack_rand_gen_
     : QEngine(qBitCount, rgp, doNorm, randomGlobalPhase, useHostMem, useHardwareRNG, norm_thresh)
     , unlockHostMem(false)
     , callbackError(CL_SUCCESS)
+    , tuneCandidate(-1)
+    , tuneApiCall(OCL_API_UNKNOWN)
+    , tuneQubitCount(0U)
     , nrmGroupSize(0U)
     , totalOclAllocSize(0U)
     , deviceID(devID)
     , wait_refs()
     , nrmArray(NULL, [](real1* r) {})
+    , gateListDoNorm(false)
+    , gateListLoadNrm(ONE_R1)
+    , gateListNormThresh(ZERO_R1_F)
+    , gateListMaxQb(0U)
 {
     InitOCL(devID);
     clFinish();
@@ -98,6 +120,7 @@ void QEngineOCL::FreeAll()
     powersBuffer = NULL;
     nrmBuffer = NULL;
     nrmArray = NULL;
+    ClearLookupTables();
 
     SubtractAlloc(totalOclAllocSize);
 }
@@ -130,6 +153,7 @@ void QEngineOCL::CopyStateVec(QEnginePtr src)
 
     if (stateBuffer) {
         clDump();
+        EnsureUniqueStateBuffer(false);
     } else {
         ReinitBuffer();
     }
@@ -153,7 +177,11 @@ void QEngineOCL::GetAmplitudePage(complex* pagePtr, bitCapIntOcl offset, bitCapI
     }
 
     EventVecPtr waitVec = ResetWaitEvents();
-    DISPATCH_BLOCK_READ(waitVec, *stateBuffer, sizeof(complex) * offset, sizeof(complex) * length, pagePtr);
+    tryOcl("Failed to read buffer", [&] {
+        return transferQueue.enqueueReadBuffer(
+            *stateBuffer, CL_TRUE, sizeof(complex) * offset, sizeof(complex) * length, pagePtr, waitVec.get());
+    });
+    wait_refs.clear();
 }
 
 void QEngineOCL::SetAmplitudePage(complex const* pagePtr, bitCapIntOcl offset, bitCapIntOcl length)
@@ -169,8 +197,58 @@ void QEngineOCL::SetAmplitudePage(complex const* pagePtr, bitCapIntOcl offset, b
         }
     }
 
+    EnsureUniqueStateBuffer(length != maxQPowerOcl);
+
+    EventVecPtr waitVec = ResetWaitEvents();
+    tryOcl("Failed to write buffer", [&] {
+        return transferQueue.enqueueWriteBuffer(
+            *stateBuffer, CL_TRUE, sizeof(complex) * offset, sizeof(complex) * length, pagePtr, waitVec.get());
+    });
+    wait_refs.clear();
+
+    runningNorm = REAL1_DEFAULT_ARG;
+}
+
+void QEngineOCL::ScatterAmplitudes(bitCapIntOcl const* perms, complex const* amps, bitCapIntOcl count)
+{
+    for (bitCapIntOcl i = 0U; i < count; ++i) {
+        if (perms[i] >= maxQPowerOcl) {
+            throw std::invalid_argument("QEngineOCL::ScatterAmplitudes argument out-of-bounds!");
+        }
+    }
+
+    if (!count) {
+        return;
+    }
+
+    if (!stateBuffer) {
+        ReinitBuffer();
+        ClearBuffer(stateBuffer, 0U, maxQPowerOcl);
+    }
+
+    EnsureUniqueStateBuffer();
+
+    // The page of (permutation, amplitude) pairs goes straight to the device, to be scattered into the state buffer.
+    const size_t sizeDiff = (sizeof(bitCapIntOcl) + sizeof(complex)) * count;
+    AddAlloc(sizeDiff);
+    BufferPtr permsBuffer =
+        MakeBuffer(CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY, sizeof(bitCapIntOcl) * count, (void*)perms);
+    BufferPtr ampsBuffer = MakeBuffer(CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY, sizeof(complex) * count, (void*)amps);
+
     EventVecPtr waitVec = ResetWaitEvents();
-    DISPATCH_BLOCK_WRITE(waitVec, *stateBuffer, sizeof(complex) * offset, sizeof(complex) * length, pagePtr);
+    PoolItemPtr poolItem = GetFreePoolItem();
+
+    const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ count, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U };
+    DISPATCH_WRITE(waitVec, *(poolItem->ulongBuffer), sizeof(bitCapIntOcl), bciArgs);
+
+    const size_t ngc = FixWorkItemCount(count, nrmGroupCount);
+    const size_t ngs = FixGroupSize(ngc, nrmGroupSize);
+
+    WaitCall(OCL_API_SCATTER_AMPS, ngc, ngs, { stateBuffer, poolItem->ulongBuffer, permsBuffer, ampsBuffer });
+
+    permsBuffer.reset();
+    ampsBuffer.reset();
+    SubtractAlloc(sizeDiff);
 
     runningNorm = REAL1_DEFAULT_ARG;
 }
@@ -188,6 +266,12 @@ void QEngineOCL::SetAmplitudePage(
         throw std::invalid_argument("QEngineOCL::SetAmplitudePage source range is out-of-bounds!");
     }
 
+    if (!pageEngineOclPtr) {
+        // Another engine type, (as a host page of a heterogeneous QPager,) copies out through its own interface.
+        SetAmplitudePageFromHost(pageEnginePtr, srcOffset, dstOffset, length);
+        return;
+    }
+
     BufferPtr oStateBuffer = pageEngineOclPtr->stateBuffer;
 
     if (!stateBuffer && !oStateBuffer) {
@@ -210,13 +294,20 @@ void QEngineOCL::SetAmplitudePage(
         ClearBuffer(stateBuffer, 0U, maxQPowerOcl);
     }
 
+    EnsureUniqueStateBuffer(length != maxQPowerOcl);
+
     pageEngineOclPtr->clFinish();
 
     if (device_context->context_id != pageEngineOclPtr->device_context->context_id) {
         // Cross-platform - can't automatically migrate buffers.
-        pageEngineOclPtr->LockSync(CL_MAP_READ);
-        SetAmplitudePage(pageEngineOclPtr->stateVec.get() + srcOffset, dstOffset, length);
-        pageEngineOclPtr->UnlockSync();
+        if (pageEngineOclPtr->usingHostRam) {
+            pageEngineOclPtr->LockSync(CL_MAP_READ);
+            SetAmplitudePage(pageEngineOclPtr->stateVec.get() + srcOffset, dstOffset, length);
+            pageEngineOclPtr->UnlockSync();
+        } else {
+            StagedCopyFrom(pageEngineOclPtr, srcOffset, dstOffset, length);
+            runningNorm = REAL1_DEFAULT_ARG;
+        }
 
         return;
     }
@@ -233,14 +324,87 @@ void QEngineOCL::SetAmplitudePage(
     runningNorm = REAL1_DEFAULT_ARG;
 }
 
+void QEngineOCL::SetAmplitudePageFromHost(
+    QEnginePtr pageEnginePtr, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length)
+{
+    if (pageEnginePtr->IsZeroAmplitude()) {
+        if (!stateBuffer) {
+            return;
+        }
+        if (length == maxQPower) {
+            ZeroAmplitudes();
+        } else {
+            ClearBuffer(stateBuffer, dstOffset, length);
+            runningNorm = REAL1_DEFAULT_ARG;
+        }
+
+        return;
+    }
+
+    if (!stateBuffer) {
+        ReinitBuffer();
+        ClearBuffer(stateBuffer, 0U, maxQPowerOcl);
+    }
+
+    if (usingHostRam) {
+        // The buffer is mapped in place, (without a copy, on an integrated device,) for the other engine to write.
+        LockSync(CL_MAP_READ | CL_MAP_WRITE);
+        pageEnginePtr->GetAmplitudePage(stateVec.get() + dstOffset, srcOffset, length);
+        UnlockSync();
+    } else {
+        std::unique_ptr<complex[]> page(new complex[length]);
+        pageEnginePtr->GetAmplitudePage(page.get(), srcOffset, length);
+        SetAmplitudePage(page.get(), dstOffset, length);
+    }
+
+    runningNorm = REAL1_DEFAULT_ARG;
+}
+
+void QEngineOCL::ShuffleBuffersWithHost(QEnginePtr engine)
+{
+    if (!stateBuffer && engine->IsZeroAmplitude()) {
+        return;
+    }
+
+    if (!stateBuffer) {
+        ReinitBuffer();
+        ClearBuffer(stateBuffer, 0U, maxQPowerOcl);
+    }
+
+    const bitCapIntOcl halfMaxQPower = (bitCapIntOcl)(maxQPowerOcl >> ONE_BCI);
+    std::unique_ptr<complex[]> upper(new complex[halfMaxQPower]);
+
+    if (usingHostRam) {
+        LockSync(CL_MAP_READ | CL_MAP_WRITE);
+        std::copy(stateVec.get() + halfMaxQPower, stateVec.get() + maxQPowerOcl, upper.get());
+        engine->GetAmplitudePage(stateVec.get() + halfMaxQPower, 0U, halfMaxQPower);
+        UnlockSync();
+    } else {
+        GetAmplitudePage(upper.get(), halfMaxQPower, halfMaxQPower);
+        std::unique_ptr<complex[]> lower(new complex[halfMaxQPower]);
+        engine->GetAmplitudePage(lower.get(), 0U, halfMaxQPower);
+        SetAmplitudePage(lower.get(), halfMaxQPower, halfMaxQPower);
+    }
+
+    engine->SetAmplitudePage(upper.get(), 0U, halfMaxQPower);
+
+    runningNorm = REAL1_DEFAULT_ARG;
+}
+
 void QEngineOCL::ShuffleBuffers(QEnginePtr engine)
 {
+    QRACK_INSTRUMENT("QEngineOCL", "ShuffleBuffers");
     if (qubitCount != engine->GetQubitCount()) {
         throw std::invalid_argument("QEngineOCL::ShuffleBuffers argument size differs from this!");
     }
 
     QEngineOCLPtr engineOcl = std::dynamic_pointer_cast<QEngineOCL>(engine);
 
+    if (!engineOcl) {
+        ShuffleBuffersWithHost(engine);
+        return;
+    }
+
     if (!stateBuffer && !(engineOcl->stateBuffer)) {
         return;
     }
@@ -255,9 +419,21 @@ void QEngineOCL::ShuffleBuffers(QEnginePtr engine)
         engineOcl->ClearBuffer(engineOcl->stateBuffer, 0U, engineOcl->maxQPowerOcl);
     }
 
+    EnsureUniqueStateBuffer();
+    engineOcl->EnsureUniqueStateBuffer();
+
     const bitCapIntOcl halfMaxQPower = (bitCapIntOcl)(maxQPowerOcl >> ONE_BCI);
 
     if (device_context->context_id != engineOcl->device_context->context_id) {
+        if (!usingHostRam || !engineOcl->usingHostRam) {
+            // At least one side needs a bus transfer, so pipeline it rather than mapping both whole buffers.
+            StagedShuffle(engineOcl);
+            runningNorm = REAL1_DEFAULT_ARG;
+            engineOcl->runningNorm = REAL1_DEFAULT_ARG;
+
+            return;
+        }
+
         LockSync(CL_MAP_READ | CL_MAP_WRITE);
         engineOcl->LockSync(CL_MAP_READ | CL_MAP_WRITE);
 
@@ -270,6 +446,16 @@ void QEngineOCL::ShuffleBuffers(QEnginePtr engine)
         return;
     }
 
+    if (device_context->device_id != engineOcl->device_context->device_id) {
+        // Let the driver route device-to-device copies, (over a peer link, if it has one,) rather than have one
+        // device's kernel read and write both whole buffers.
+        PeerShuffle(engineOcl);
+        runningNorm = REAL1_DEFAULT_ARG;
+        engineOcl->runningNorm = REAL1_DEFAULT_ARG;
+
+        return;
+    }
+
     const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ halfMaxQPower, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U };
 
     EventVecPtr waitVec = ResetWaitEvents();
@@ -288,8 +474,160 @@ void QEngineOCL::ShuffleBuffers(QEnginePtr engine)
     engineOcl->runningNorm = REAL1_DEFAULT_ARG;
 }
 
+void QEngineOCL::StagedCopyFrom(
+    QEngineOCLPtr src, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length)
+{
+    if (!length) {
+        return;
+    }
+
+    const bitCapIntOcl chunk = std::min(length, pow2Ocl(QRACK_OCL_TRANSFER_CHUNK_POW));
+    const bitCapIntOcl chunkCount = (length + chunk - 1U) / chunk;
+    std::unique_ptr<complex[]> stage[2U] = { std::unique_ptr<complex[]>(new complex[chunk]),
+        std::unique_ptr<complex[]>(new complex[chunk]) };
+    cl::Event reads[2U];
+    cl::Event writes[2U];
+
+    EventVecPtr srcWaitVec = src->ResetWaitEvents();
+    EventVecPtr waitVec = ResetWaitEvents();
+
+    // Chunk c + 1 is read from the source device while chunk c is written to this one.
+    const auto read = [&](const bitCapIntOcl& c) {
+        const size_t b = c & 1U;
+        if (c >= 2U) {
+            writes[b].wait();
+        }
+        const bitCapIntOcl len = std::min(chunk, length - c * chunk);
+        src->tryOcl("Failed to enqueue staged buffer read", [&] {
+            return src->transferQueue.enqueueReadBuffer(*(src->stateBuffer), CL_FALSE,
+                sizeof(complex) * (srcOffset + c * chunk), sizeof(complex) * len, stage[b].get(), srcWaitVec.get(),
+                &(reads[b]));
+        });
+    };
+
+    read(0U);
+    for (bitCapIntOcl c = 0U; c < chunkCount; ++c) {
+        const size_t b = c & 1U;
+        if ((c + 1U) < chunkCount) {
+            read(c + 1U);
+        }
+        reads[b].wait();
+        const bitCapIntOcl len = std::min(chunk, length - c * chunk);
+        tryOcl("Failed to enqueue staged buffer write", [&] {
+            return transferQueue.enqueueWriteBuffer(*stateBuffer, CL_FALSE, sizeof(complex) * (dstOffset + c * chunk),
+                sizeof(complex) * len, stage[b].get(), waitVec.get(), &(writes[b]));
+        });
+    }
+
+    writes[(chunkCount - 1U) & 1U].wait();
+    if (chunkCount > 1U) {
+        writes[chunkCount & 1U].wait();
+    }
+
+    src->wait_refs.clear();
+    wait_refs.clear();
+}
+
+void QEngineOCL::PeerShuffle(QEngineOCLPtr engine)
+{
+    const bitCapIntOcl halfMaxQPower = (bitCapIntOcl)(maxQPowerOcl >> ONE_BCI);
+    const size_t halfSize = sizeof(complex) * halfMaxQPower;
+    BufferPtr tempBuffer = MakeBuffer(CL_MEM_READ_WRITE, halfSize);
+
+    // Events from either device's queue are valid waits in our shared context.
+    EventVecPtr waitVec = ResetWaitEvents();
+    EventVecPtr oWaitVec = engine->ResetWaitEvents();
+    waitVec->insert(waitVec->end(), oWaitVec->begin(), oWaitVec->end());
+
+    cl::Event events[3U];
+    tryOcl("Failed to enqueue peer buffer copy", [&] {
+        return queue.enqueueCopyBuffer(*stateBuffer, *tempBuffer, halfSize, 0U, halfSize, waitVec.get(), &(events[0U]));
+    });
+    EventVec toWait{ events[0U] };
+    tryOcl("Failed to enqueue peer buffer copy", [&] {
+        return queue.enqueueCopyBuffer(
+            *(engine->stateBuffer), *stateBuffer, 0U, halfSize, halfSize, &toWait, &(events[1U]));
+    });
+    toWait = EventVec{ events[1U] };
+    engine->tryOcl("Failed to enqueue peer buffer copy", [&] {
+        return engine->queue.enqueueCopyBuffer(
+            *tempBuffer, *(engine->stateBuffer), 0U, 0U, halfSize, &toWait, &(events[2U]));
+    });
+    events[2U].wait();
+
+    wait_refs.clear();
+    engine->wait_refs.clear();
+}
+
+void QEngineOCL::StagedShuffle(QEngineOCLPtr engine)
+{
+    const bitCapIntOcl halfMaxQPower = (bitCapIntOcl)(maxQPowerOcl >> ONE_BCI);
+    const bitCapIntOcl chunk = std::min(halfMaxQPower, pow2Ocl(QRACK_OCL_TRANSFER_CHUNK_POW));
+    const bitCapIntOcl chunkCount = halfMaxQPower / chunk;
+    // stage[b][0] holds a chunk of our upper half, and stage[b][1] holds a chunk of the other engine's lower half.
+    std::unique_ptr<complex[]> stage[2U][2U] = {
+        { std::unique_ptr<complex[]>(new complex[chunk]), std::unique_ptr<complex[]>(new complex[chunk]) },
+        { std::unique_ptr<complex[]>(new complex[chunk]), std::unique_ptr<complex[]>(new complex[chunk]) }
+    };
+    cl::Event reads[2U][2U];
+    cl::Event writes[2U][2U];
+
+    EventVecPtr waitVec = ResetWaitEvents();
+    EventVecPtr oWaitVec = engine->ResetWaitEvents();
+
+    const auto read = [&](const bitCapIntOcl& c) {
+        const size_t b = c & 1U;
+        if (c >= 2U) {
+            writes[b][0U].wait();
+            writes[b][1U].wait();
+        }
+        tryOcl("Failed to enqueue staged buffer read", [&] {
+            return transferQueue.enqueueReadBuffer(*stateBuffer, CL_FALSE,
+                sizeof(complex) * (halfMaxQPower + c * chunk), sizeof(complex) * chunk, stage[b][0U].get(),
+                waitVec.get(), &(reads[b][0U]));
+        });
+        engine->tryOcl("Failed to enqueue staged buffer read", [&] {
+            return engine->transferQueue.enqueueReadBuffer(*(engine->stateBuffer), CL_FALSE,
+                sizeof(complex) * c * chunk, sizeof(complex) * chunk, stage[b][1U].get(), oWaitVec.get(),
+                &(reads[b][1U]));
+        });
+    };
+
+    read(0U);
+    for (bitCapIntOcl c = 0U; c < chunkCount; ++c) {
+        const size_t b = c & 1U;
+        if ((c + 1U) < chunkCount) {
+            read(c + 1U);
+        }
+        reads[b][0U].wait();
+        reads[b][1U].wait();
+        tryOcl("Failed to enqueue staged buffer write", [&] {
+            return transferQueue.enqueueWriteBuffer(*stateBuffer, CL_FALSE,
+                sizeof(complex) * (halfMaxQPower + c * chunk), sizeof(complex) * chunk, stage[b][1U].get(),
+                waitVec.get(), &(writes[b][0U]));
+        });
+        engine->tryOcl("Failed to enqueue staged buffer write", [&] {
+            return engine->transferQueue.enqueueWriteBuffer(*(engine->stateBuffer), CL_FALSE,
+                sizeof(complex) * c * chunk, sizeof(complex) * chunk, stage[b][0U].get(), oWaitVec.get(),
+                &(writes[b][1U]));
+        });
+    }
+
+    for (bitCapIntOcl c = (chunkCount > 1U) ? (chunkCount - 2U) : 0U; c < chunkCount; ++c) {
+        writes[c & 1U][0U].wait();
+        writes[c & 1U][1U].wait();
+    }
+
+    engine->wait_refs.clear();
+    wait_refs.clear();
+}
+
 void QEngineOCL::LockSync(cl_map_flags flags)
 {
+    if (flags & CL_MAP_WRITE) {
+        EnsureUniqueStateBuffer();
+    }
+
     lockSyncFlags = flags;
     EventVecPtr waitVec = ResetWaitEvents();
 
@@ -337,6 +675,8 @@ void QEngineOCL::clFinish(bool doHard)
         return;
     }
 
+    FlushFused2x2();
+    FlushGateList();
     checkCallbackError();
 
     while (wait_queue_items.size() > 1) {
@@ -357,6 +697,9 @@ void QEngineOCL::clFinish(bool doHard)
 
 void QEngineOCL::clDump()
 {
+    DumpFused2x2();
+    DumpGateList();
+
     if (!device_context) {
         return;
     }
@@ -391,6 +734,9 @@ PoolItemPtr QEngineOCL::GetFreePoolItem()
 EventVecPtr QEngineOCL::ResetWaitEvents(bool waitQueue)
 {
     if (waitQueue) {
+        // (The kernel dispatch callback passes "false," and it must never apply a gate itself.)
+        FlushFused2x2();
+        FlushGateList();
         while (wait_queue_items.size() > 1) {
             device_context->WaitOnAllEvents();
             PopQueue(true);
@@ -412,7 +758,33 @@ void QEngineOCL::WaitCall(
     clFinish();
 }
 
-void CL_CALLBACK _PopQueue(cl_event event, cl_int type, void* user_data) { ((QEngineOCL*)user_data)->PopQueue(true); }
+void CL_CALLBACK _PopQueue(cl_event event, cl_int type, void* user_data)
+{
+#if ENABLE_INSTRUMENTATION
+    cl_ulong start, end;
+    if ((clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL) == CL_SUCCESS) &&
+        (clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL) == CL_SUCCESS)) {
+        // Event profiling times are device nanoseconds.
+        Instrumentation::Instance().Record("QEngineOCL", "Kernel", (end - start) * 1e-9);
+    }
+#endif
+    ((QEngineOCL*)user_data)->RecordLaunch(event);
+    ((QEngineOCL*)user_data)->PopQueue(true);
+}
+
+void QEngineOCL::RecordLaunch(cl_event event)
+{
+    if (tuneCandidate < 0) {
+        return;
+    }
+
+    cl_ulong start, end;
+    if ((clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL) == CL_SUCCESS) &&
+        (clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL) == CL_SUCCESS)) {
+        device_context->RecordLaunch(tuneApiCall, tuneQubitCount, tuneCandidate, (end - start) * 1e-9);
+    }
+    tuneCandidate = -1;
+}
 
 void QEngineOCL::PopQueue(bool isDispatch)
 {
@@ -496,14 +868,25 @@ void QEngineOCL::DispatchQueue()
 #endif
     }
 
+    // Kernels without local memory can run in any launch shape, so they run in the autotuned one, (if any).
+    size_t workItemCount = item.workItemCount;
+    size_t localGroupSize = item.localGroupSize;
+    tuneCandidate = -1;
+    if (!item.localBuffSize && device_context->IsLaunchTuned()) {
+        tuneApiCall = item.api_call;
+        tuneQubitCount = qubitCount;
+        tuneCandidate =
+            device_context->TuneLaunch(item.api_call, qubitCount, ocl.call, workItemCount, localGroupSize);
+    }
+
     // Dispatch the primary kernel, to apply the gate.
     EventVecPtr kernelWaitVec = ResetWaitEvents(false);
     device_context->LockWaitEvents();
     device_context->wait_events->emplace_back();
     device_context->wait_events->back().setCallback(CL_COMPLETE, _PopQueue, this);
     cl_int error = queue.enqueueNDRangeKernel(ocl.call, cl::NullRange, // kernel, offset
-        cl::NDRange(item.workItemCount), // global number of work items
-        cl::NDRange(item.localGroupSize), // local number (per group)
+        cl::NDRange(workItemCount), // global number of work items
+        cl::NDRange(localGroupSize), // local number (per group)
         kernelWaitVec.get(), // vector of events to wait for
         &(device_context->wait_events->back())); // handle to wait for the kernel
     device_context->UnlockWaitEvents();
@@ -535,6 +918,7 @@ void QEngineOCL::SetDevice(int64_t dID)
     clFinish();
 
     const int64_t oldContextId = device_context ? device_context->context_id : 0;
+    const int64_t oldDeviceId = device_context ? device_context->device_id : -1;
     const DeviceContextPtr nDeviceContext = OCLEngine::Instance().GetDeviceContextPtr(dID);
     const int64_t defDevId = (int)OCLEngine::Instance().GetDefaultDeviceID();
 
@@ -552,10 +936,25 @@ void QEngineOCL::SetDevice(int64_t dID)
         GetQuantumState(copyVec.get());
     }
 
+    if (stateVec && (oldContextId != nDeviceContext->context_id)) {
+        // Host memory shared with a copy-on-write clone can't follow this engine into the new context.
+        EnsureUniqueStateBuffer();
+    }
+
+    // Cached lookup tables belong to the old context.
+    ClearLookupTables();
+
+    const int64_t oldPool = GovernorPool();
     device_context = nDeviceContext;
     deviceID = dID;
+    if (didInit) {
+        // This engine's buffers now count against the budget of its new device.
+        MemoryGovernor::Instance().Release(oldPool, totalOclAllocSize);
+        MemoryGovernor::Instance().ForceReserve(GovernorPool(), totalOclAllocSize);
+    }
     context = device_context->context;
     queue = device_context->queue;
+    transferQueue = device_context->transfer_queue;
 
     // If the user wants not to use host RAM, but we can't allocate enough on the device, fall back to host RAM anyway.
 #if ENABLE_OCL_MEM_GUARDS
@@ -576,6 +975,22 @@ void QEngineOCL::SetDevice(int64_t dID)
     // constrain to a power of two
     nrmGroupSize = (size_t)pow2(log2(nrmGroupSize));
 
+    // Gate list tiles, and one norm partial sum per work item, must fit in local memory.
+    gateListMaxQb = 0U;
+    while ((gateListMaxQb < QRACK_GATE_LIST_MAX_QB) &&
+        (((sizeof(complex) << (gateListMaxQb + 1U)) + sizeof(real1) * nrmGroupSize) <=
+            device_context->GetLocalSize())) {
+        ++gateListMaxQb;
+    }
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_GATE_LIST_QB")) {
+        const bitLenInt envQb = (bitLenInt)std::stoi(std::string(getenv("QRACK_GATE_LIST_QB")));
+        if (envQb < gateListMaxQb) {
+            gateListMaxQb = envQb;
+        }
+    }
+#endif
+
     const size_t nrmArrayAllocSize =
         (!nrmGroupSize || ((sizeof(real1) * nrmGroupCount / nrmGroupSize) < QRACK_ALIGN_SIZE))
         ? QRACK_ALIGN_SIZE
@@ -617,6 +1032,23 @@ void QEngineOCL::SetDevice(int64_t dID)
 
     // If this is the same context, then all other buffers are valid.
     if (oldContextId == nDeviceContext->context_id) {
+        if (didInit && stateBuffer && (oldDeviceId != device_context->device_id)) {
+            // Start moving the state vector to the new device now, (device-to-device, over a peer link if the driver
+            // has one,) rather than stall the next kernel on an implicit migration. Kernels queued after this wait on
+            // it, like any other event.
+            EventVecPtr waitVec = ResetWaitEvents();
+            device_context->LockWaitEvents();
+            device_context->wait_events->emplace_back();
+            tryOcl(
+                "Failed to enqueue buffer migration",
+                [&] {
+                    return queue.enqueueMigrateMemObjects(std::vector<cl::Memory>{ *stateBuffer }, 0U, waitVec.get(),
+                        &(device_context->wait_events->back()));
+                },
+                true);
+            device_context->UnlockWaitEvents();
+        }
+
         return;
     }
 
@@ -662,11 +1094,16 @@ real1_f QEngineOCL::ParSum(real1* toSum, bitCapIntOcl maxI)
 
 void QEngineOCL::InitOCL(int64_t devID) { SetDevice(devID); }
 
-void QEngineOCL::ResetStateBuffer(BufferPtr nStateBuffer) { stateBuffer = nStateBuffer; }
+void QEngineOCL::ResetStateBuffer(BufferPtr nStateBuffer)
+{
+    stateBuffer = nStateBuffer;
+    stateBufferOwners = NULL;
+}
 
 void QEngineOCL::SetPermutation(bitCapInt perm, complex phaseFac)
 {
     clDump();
+    EnsureUniqueStateBuffer(false);
 
     if (!stateBuffer) {
         ReinitBuffer();
@@ -770,11 +1207,53 @@ void QEngineOCL::PhaseParity(real1_f radians, bitCapInt mask)
     BitMask((bitCapIntOcl)mask, OCL_API_PHASE_PARITY, radians);
 }
 
+void QEngineOCL::PhaseFlipIfLookup(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+    const unsigned char* values, bitCapInt target)
+{
+    if (isBadBitRange(indexStart, indexLength, qubitCount)) {
+        throw std::invalid_argument("QEngineOCL::PhaseFlipIfLookup range is out-of-bounds!");
+    }
+
+    if (!indexLength) {
+        QEngine::PhaseFlipIfLookup(indexStart, indexLength, valueLength, values, target);
+        return;
+    }
+
+    const bitLenInt valueBytes = (valueLength + 7U) / 8U;
+    const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ maxQPowerOcl, indexStart, bitRegMaskOcl(indexStart, indexLength),
+        valueBytes, (bitCapIntOcl)target, 0U, 0U, 0U, 0U, 0U };
+
+    LookupCall(OCL_API_PHASEFLIPIFLOOKUP, bciArgs, values, pow2Ocl(indexLength) * valueBytes);
+}
+
+void QEngineOCL::GroverLookupIteration(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+    const unsigned char* values, bitCapInt target)
+{
+    if (isBadBitRange(indexStart, indexLength, qubitCount)) {
+        throw std::invalid_argument("QEngineOCL::GroverLookupIteration range is out-of-bounds!");
+    }
+
+    if (!indexLength) {
+        QEngine::GroverLookupIteration(indexStart, indexLength, valueLength, values, target);
+        return;
+    }
+
+    const bitLenInt valueBytes = (valueLength + 7U) / 8U;
+    const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ maxQPowerOcl >> indexLength, indexStart, indexLength, valueBytes,
+        (bitCapIntOcl)target, 0U, 0U, 0U, 0U, 0U };
+
+    LookupCall(OCL_API_GROVERLOOKUP, bciArgs, values, pow2Ocl(indexLength) * valueBytes);
+}
+
 void QEngineOCL::Apply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* mtrx, bitLenInt bitCount,
     const bitCapIntOcl* qPowersSorted, bool doCalcNorm, SPECIAL_2X2 special, real1_f norm_thresh)
 {
+    QRACK_INSTRUMENT("QEngineOCL", "Apply2x2");
     CHECK_ZERO_SKIP();
 
+    // Special-case gates bypass fusion, so apply anything pending before reading the running norm.
+    FlushFused2x2();
+
     if ((offset1 >= maxQPowerOcl) || (offset2 >= maxQPowerOcl)) {
         throw std::invalid_argument(
             "QEngineOCL::Apply2x2 offset1 and offset2 parameters must be within allocated qubit bounds!");
@@ -804,6 +1283,19 @@ void QEngineOCL::Apply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex co
     doCalcNorm &= doApplyNorm || (runningNorm <= ZERO_R1);
     doApplyNorm &= (runningNorm != ONE_R1);
 
+    if ((bitCount == 1U) && !offset1 && (offset2 == qPowersSorted[0U])) {
+        const bitCapIntOcl opCode = isXGate ? GATE_LIST_X
+            : isZGate                       ? GATE_LIST_Z
+            : isPhaseGate                   ? GATE_LIST_PHASE
+            : isInvertGate                  ? GATE_LIST_INVERT
+                                            : GATE_LIST_2X2;
+        // (A list calculates the norm once, at its end, instead of per gate.)
+        const real1 nrm = doApplyNorm ? (ONE_R1 / (real1)sqrt(runningNorm)) : ONE_R1;
+        if (AppendGateList(opCode, qPowersSorted[0U], mtrx, doCalcNorm, nrm, norm_thresh)) {
+            return;
+        }
+    }
+
     // We grab the wait event queue. We will replace it with three new asynchronous events, to wait for.
     EventVecPtr waitVec = ResetWaitEvents();
 
@@ -1000,6 +1492,102 @@ void QEngineOCL::Apply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex co
     }
 }
 
+bool QEngineOCL::AppendGateList(bitCapIntOcl opCode, bitCapIntOcl mask, complex const* mtrx, bool doCalcNorm,
+    real1 nrm, real1_f norm_thresh)
+{
+    // Wider engines are tiled, so only gates below the tile's qubits can join the list.
+    if (!gateListMaxQb || ((qubitCount > gateListMaxQb) && (mask >= pow2Ocl(gateListMaxQb)))) {
+        return false;
+    }
+
+    if (nrm != ONE_R1) {
+        // The list applies its normalization factor as it loads each tile, ahead of every gate.
+        FlushGateList();
+        gateListLoadNrm = nrm;
+        runningNorm = ONE_R1;
+    }
+
+    gateListOps.push_back(opCode);
+    gateListOps.push_back(mask);
+    if (mtrx) {
+        gateListMtrxs.insert(gateListMtrxs.end(), mtrx, mtrx + 4U);
+    } else {
+        gateListMtrxs.insert(gateListMtrxs.end(), 4U, ZERO_CMPLX);
+    }
+
+    if (doCalcNorm) {
+        gateListDoNorm = true;
+        norm_thresh = (norm_thresh < ZERO_R1_F) ? (real1_f)amplitudeFloor : norm_thresh;
+        if (norm_thresh > gateListNormThresh) {
+            gateListNormThresh = norm_thresh;
+        }
+    }
+
+    if ((gateListOps.size() >> 1U) >= QRACK_GATE_LIST_MAX_OPS) {
+        FlushGateList();
+    }
+
+    return true;
+}
+
+void QEngineOCL::FlushGateList()
+{
+    if (gateListOps.empty()) {
+        return;
+    }
+
+    if (!stateBuffer) {
+        DumpGateList();
+        return;
+    }
+
+    const bool isTiled = qubitCount > gateListMaxQb;
+    const bitCapIntOcl tileSize = isTiled ? pow2Ocl(gateListMaxQb) : maxQPowerOcl;
+    const bitCapIntOcl tileCount = maxQPowerOcl / tileSize;
+    // Only a single tile can normalize itself; otherwise, we sum the norm on the host, as for one gate.
+    const bitCapIntOcl normMode = !gateListDoNorm ? GATE_LIST_NORM_NONE
+        : (!isTiled && doNormalize)               ? GATE_LIST_NORM_IN_PLACE
+                                                  : GATE_LIST_NORM_SUM;
+
+    // Release the list before queueing it, so that the queue call below does not flush it again.
+    std::vector<bitCapIntOcl> bciArgs{ tileSize, tileCount, (bitCapIntOcl)(gateListOps.size() >> 1U), normMode };
+    bciArgs.insert(bciArgs.end(), gateListOps.begin(), gateListOps.end());
+    std::vector<complex> mtrxs = std::move(gateListMtrxs);
+    mtrxs.push_back(complex(gateListLoadNrm, (real1)gateListNormThresh));
+    DumpGateList();
+
+    // The host copies are consumed at buffer creation, so these need no write events.
+    BufferPtr bciBuffer =
+        MakeBuffer(CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(bitCapIntOcl) * bciArgs.size(), &(bciArgs[0U]));
+    BufferPtr cmplxBuffer =
+        MakeBuffer(CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(complex) * mtrxs.size(), &(mtrxs[0U]));
+
+    // Work groups are a power of 2 in size, (for the norm reduction,) and each loops over its share of the tiles.
+    size_t ngs = nrmGroupSize;
+    while ((ngs > 1U) && ((ngs << 1U) > tileSize)) {
+        ngs >>= 1U;
+    }
+    size_t groupCount = nrmGroupSize ? (nrmGroupCount / nrmGroupSize) : 1U;
+    if (groupCount > tileCount) {
+        groupCount = tileCount;
+    }
+    if (!groupCount) {
+        groupCount = 1U;
+    }
+
+    QueueCall(OCL_API_GATE_LIST, groupCount * ngs, ngs, { stateBuffer, cmplxBuffer, bciBuffer, nrmBuffer },
+        sizeof(complex) * tileSize + sizeof(real1) * ngs);
+
+    if (normMode == GATE_LIST_NORM_IN_PLACE) {
+        QueueSetRunningNorm(ONE_R1_F);
+    } else if (normMode == GATE_LIST_NORM_SUM) {
+        WAIT_REAL1_SUM(*nrmBuffer, groupCount, nrmArray, &runningNorm);
+        if (runningNorm <= FP_NORM_EPSILON) {
+            ZeroAmplitudes();
+        }
+    }
+}
+
 void QEngineOCL::BitMask(bitCapIntOcl mask, OCLAPI api_call, real1_f phase)
 {
     if (mask >= maxQPowerOcl) {
@@ -1008,6 +1596,10 @@ void QEngineOCL::BitMask(bitCapIntOcl mask, OCLAPI api_call, real1_f phase)
 
     CHECK_ZERO_SKIP();
 
+    if ((api_call == OCL_API_X_MASK) && AppendGateList(GATE_LIST_X_MASK, mask, NULL, false, ONE_R1, ZERO_R1_F)) {
+        return;
+    }
+
     bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ mask;
 
     EventVecPtr waitVec = ResetWaitEvents();
@@ -1113,6 +1705,140 @@ void QEngineOCL::UniformlyControlledSingleBit(const std::vector<bitLenInt>& cont
     SubtractAlloc(sizeDiff);
 }
 
+void QEngineOCL::MtrxN(complex const* mtrx, const std::vector<bitLenInt>& targets)
+{
+    if (!targets.size() || (targets.size() > QRACK_MAX_MTRXN_QB)) {
+        throw std::invalid_argument("QEngineOCL::MtrxN target count must be between 1 and QRACK_MAX_MTRXN_QB!");
+    }
+
+    ThrowIfQbIdArrayIsBad(targets, qubitCount, "QEngineOCL::MtrxN target is out-of-bounds!");
+
+    if (targets.size() == 1U) {
+        Mtrx(mtrx, targets[0U]);
+        return;
+    }
+
+    CHECK_ZERO_SKIP();
+
+    const bitLenInt targetCount = (bitLenInt)targets.size();
+    const bitCapIntOcl dim = pow2Ocl(targetCount);
+
+    // We grab the wait event queue. We will replace it with three new asynchronous events, to wait for.
+    EventVecPtr waitVec = ResetWaitEvents();
+    PoolItemPtr poolItem = GetFreePoolItem();
+
+    // Load the integer kernel arguments buffer.
+    const bitCapIntOcl maxI = maxQPowerOcl >> targetCount;
+    const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ maxI, targetCount, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U };
+    DISPATCH_WRITE(waitVec, *(poolItem->ulongBuffer), sizeof(bitCapIntOcl) * 2, bciArgs);
+
+    const size_t sizeDiff = sizeof(complex) * dim * dim;
+    AddAlloc(sizeDiff);
+    BufferPtr mtrxBuffer = MakeBuffer(CL_MEM_READ_ONLY, sizeDiff);
+    DISPATCH_WRITE(waitVec, *mtrxBuffer, sizeDiff, mtrx);
+
+    // The sorted target powers, (for pushing apart,) followed by the state vector offset of each matrix row.
+    std::unique_ptr<bitCapIntOcl[]> qPowers(new bitCapIntOcl[targetCount + dim]);
+    for (bitLenInt i = 0U; i < targetCount; ++i) {
+        qPowers[i] = pow2Ocl(targets[i]);
+    }
+    std::sort(qPowers.get(), qPowers.get() + targetCount);
+    for (bitCapIntOcl j = 0U; j < dim; ++j) {
+        bitCapIntOcl offset = 0U;
+        for (bitLenInt i = 0U; i < targetCount; ++i) {
+            if ((j >> i) & 1U) {
+                offset |= pow2Ocl(targets[i]);
+            }
+        }
+        qPowers[targetCount + j] = offset;
+    }
+    DISPATCH_WRITE(waitVec, *powersBuffer, sizeof(bitCapIntOcl) * (targetCount + dim), qPowers.get());
+
+    const size_t ngc = FixWorkItemCount(maxI, nrmGroupCount);
+    const size_t ngs = FixGroupSize(ngc, nrmGroupSize);
+
+    WaitCall(OCL_API_APPLYNXN, ngc, ngs, { stateBuffer, poolItem->ulongBuffer, powersBuffer, mtrxBuffer });
+
+    mtrxBuffer.reset();
+    qPowers.reset();
+
+    SubtractAlloc(sizeDiff);
+
+    if (doNormalize) {
+        UpdateRunningNorm();
+    }
+}
+
+void QEngineOCL::QFT(bitLenInt start, bitLenInt length, bool trySeparate) { FourierTransform(start, length, false); }
+
+void QEngineOCL::IQFT(bitLenInt start, bitLenInt length, bool trySeparate) { FourierTransform(start, length, true); }
+
+void QEngineOCL::QFTR(const std::vector<bitLenInt>& qubits, bool trySeparate)
+{
+    for (size_t i = 1U; i < qubits.size(); ++i) {
+        if (qubits[i] != (qubits[0U] + i)) {
+            QInterface::QFTR(qubits, trySeparate);
+            return;
+        }
+    }
+    FourierTransform(qubits.size() ? qubits[0U] : 0U, (bitLenInt)qubits.size(), false);
+}
+
+void QEngineOCL::IQFTR(const std::vector<bitLenInt>& qubits, bool trySeparate)
+{
+    for (size_t i = 1U; i < qubits.size(); ++i) {
+        if (qubits[i] != (qubits[0U] + i)) {
+            QInterface::IQFTR(qubits, trySeparate);
+            return;
+        }
+    }
+    FourierTransform(qubits.size() ? qubits[0U] : 0U, (bitLenInt)qubits.size(), true);
+}
+
+void QEngineOCL::FourierTransform(bitLenInt start, bitLenInt length, bool isInverse)
+{
+    if (!length) {
+        return;
+    }
+
+    if (((bitLenInt)(start + length) > qubitCount) || ((bitLenInt)(start + length) < start)) {
+        throw std::invalid_argument("QEngineOCL QFT range is out-of-bounds!");
+    }
+
+    if (length == 1U) {
+        H(start);
+        return;
+    }
+
+    CHECK_ZERO_SKIP();
+
+    // QFT() is an in-place decimation-in-frequency FFT over the register, which writes its output in the bit-reversed
+    // order the gate decomposition does, and IQFT() is the decimation-in-time inverse. Each radix-2 stage is one pass
+    // of the "fftstage" kernel, so the register takes "length" passes, instead of O(length^2) gates.
+    const bitCapIntOcl maxI = maxQPowerOcl >> 1U;
+    const size_t ngc = FixWorkItemCount(maxI, nrmGroupCount);
+    const size_t ngs = FixGroupSize(ngc, nrmGroupSize);
+
+    for (bitLenInt i = 0U; i < length; ++i) {
+        const bitLenInt s = isInverse ? i : (length - (i + 1U));
+
+        EventVecPtr waitVec = ResetWaitEvents();
+        PoolItemPtr poolItem = GetFreePoolItem();
+
+        const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ maxI, pow2Ocl(start + s), start, pow2Ocl(s), isInverse ? 1U : 0U, 0U,
+            0U, 0U, 0U, 0U };
+
+        cl::Event writeArgsEvent;
+        DISPATCH_TEMP_WRITE(waitVec, *(poolItem->ulongBuffer), sizeof(bitCapIntOcl) * 5, bciArgs, writeArgsEvent);
+
+        // Wait for buffer write from limited lifetime objects
+        writeArgsEvent.wait();
+        wait_refs.clear();
+
+        QueueCall(OCL_API_FFT_STAGE, ngc, ngs, { stateBuffer, poolItem->ulongBuffer });
+    }
+}
+
 void QEngineOCL::UniformParityRZ(bitCapInt mask, real1_f angle)
 {
     if (mask >= maxQPowerOcl) {
@@ -1313,9 +2039,158 @@ void QEngineOCL::Compose(OCLAPI apiCall, const bitCapIntOcl* bciArgs, QEngineOCL
     EventVecPtr waitVec = ResetWaitEvents();
 
     cl::Event writeArgsEvent;
-    DISPATCH_TEMP_WRITE(waitVec, *(poolItem->ulongBuffer), sizeof(bitCapIntOcl) * 7, bciArgs, writeArgsEvent);
+    DISPATCH_TEMP_WRITE(waitVec, *(poolItem->ulongBuffer), sizeof(bitCapIntOcl) * 7, bciArgs, writeArgsEvent);
+
+    AddAlloc(sizeof(complex) * nMaxQPower);
+
+    SetQubitCount(nQubitCount);
+
+    const size_t ngc = FixWorkItemCount(maxQPowerOcl, nrmGroupCount);
+    const size_t ngs = FixGroupSize(ngc, nrmGroupSize);
+    const bool forceAlloc = !stateVec && ((OclMemDenom * nStateVecSize) > device_context->GetGlobalSize());
+
+    writeArgsEvent.wait();
+    wait_refs.clear();
+
+    std::shared_ptr<complex> nStateVec = AllocStateVec(maxQPowerOcl, forceAlloc);
+    BufferPtr nStateBuffer = MakeStateVecBuffer(nStateVec);
+
+    toCopy->clFinish();
+
+    QueueCall(apiCall, ngc, ngs, { stateBuffer, toCopy->stateBuffer, poolItem->ulongBuffer, nStateBuffer });
+    toCopy->wait_refs.emplace_back(device_context->wait_events);
+
+    stateVec = nStateVec;
+    ResetStateBuffer(nStateBuffer);
+
+    SubtractAlloc(sizeof(complex) * oMaxQPower);
+}
+
+bitLenInt QEngineOCL::Compose(QEngineOCLPtr toCopy)
+{
+    const bitLenInt result = qubitCount;
+
+    const bitCapIntOcl oQubitCount = toCopy->qubitCount;
+    const bitCapIntOcl nQubitCount = qubitCount + oQubitCount;
+    const bitCapIntOcl nMaxQPower = pow2Ocl(nQubitCount);
+    const bitCapIntOcl startMask = maxQPowerOcl - ONE_BCI;
+    const bitCapIntOcl endMask = (toCopy->maxQPowerOcl - ONE_BCI) << (bitCapIntOcl)qubitCount;
+    const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ nMaxQPower, qubitCount, startMask, endMask, 0U, 0U, 0U, 0U, 0U, 0U };
+
+    OCLAPI api_call;
+    if (nMaxQPower <= nrmGroupCount) {
+        api_call = OCL_API_COMPOSE_WIDE;
+    } else {
+        api_call = OCL_API_COMPOSE;
+    }
+
+    Compose(api_call, bciArgs, toCopy);
+
+    return result;
+}
+
+bitLenInt QEngineOCL::Compose(QEngineOCLPtr toCopy, bitLenInt start)
+{
+    if (start > qubitCount) {
+        throw std::invalid_argument("QEngineOCL::Compose start index is out-of-bounds!");
+    }
+
+    const bitLenInt result = start;
+
+    const bitLenInt oQubitCount = toCopy->qubitCount;
+    const bitLenInt nQubitCount = qubitCount + oQubitCount;
+    const bitCapIntOcl nMaxQPower = pow2Ocl(nQubitCount);
+    const bitCapIntOcl startMask = pow2Ocl(start) - ONE_BCI;
+    const bitCapIntOcl midMask = bitRegMaskOcl(start, oQubitCount);
+    const bitCapIntOcl endMask = pow2MaskOcl(qubitCount + oQubitCount) & ~(startMask | midMask);
+    const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ nMaxQPower, qubitCount, oQubitCount, startMask, midMask, endMask, start,
+        0U, 0U, 0U };
+
+    Compose(OCL_API_COMPOSE_MID, bciArgs, toCopy);
+
+    return result;
+}
+
+std::map<QInterfacePtr, bitLenInt> QEngineOCL::Compose(std::vector<QInterfacePtr> toCopy)
+{
+    std::map<QInterfacePtr, bitLenInt> ret;
+    std::vector<QEngineOCLPtr> srcs;
+    // Per source, (mask, shift, offset into the packed source buffer)
+    std::vector<bitCapIntOcl> srcArgs;
+    bitLenInt nQubitCount = qubitCount;
+    bitCapIntOcl packedPower = 0U;
+    bool isZero = !stateBuffer;
+
+    for (size_t i = 0U; i < toCopy.size(); ++i) {
+        QEngineOCLPtr src = std::dynamic_pointer_cast<QEngineOCL>(toCopy[i]);
+        ret[toCopy[i]] = nQubitCount;
+        if (!src->qubitCount) {
+            continue;
+        }
+        isZero |= !src->stateBuffer;
+        srcs.push_back(src);
+        srcArgs.push_back((src->maxQPowerOcl - ONE_BCI) << (bitCapIntOcl)nQubitCount);
+        srcArgs.push_back(nQubitCount);
+        srcArgs.push_back(packedPower);
+        nQubitCount += src->qubitCount;
+        packedPower += src->maxQPowerOcl;
+    }
+
+    if ((srcs.size() < 2U) || !qubitCount || isZero) {
+        // Pairwise composition already handles these cases in one step, (or with no state to write).
+        for (const QEngineOCLPtr& src : srcs) {
+            Compose(src);
+        }
+        return ret;
+    }
+
+    const bitCapIntOcl oMaxQPower = maxQPowerOcl;
+    const bitCapIntOcl nMaxQPower = pow2Ocl(nQubitCount);
+    const size_t nStateVecSize = nMaxQPower * sizeof(complex);
+#if ENABLE_OCL_MEM_GUARDS
+    if (nStateVecSize > device_context->GetMaxAlloc()) {
+        throw bad_alloc("VRAM limits exceeded in QEngineOCL::Compose()");
+    }
+#endif
+
+    if (doNormalize) {
+        NormalizeState();
+    }
+    for (const QEngineOCLPtr& src : srcs) {
+        if (src->doNormalize) {
+            src->NormalizeState();
+        }
+        if (device_context->context_id != src->device_context->context_id) {
+            src->SetDevice(deviceID);
+        }
+    }
+
+    // Every source is copied, back to back, into one packed buffer, so that a single kernel reads all of them.
+    const size_t tempSize = sizeof(complex) * packedPower + sizeof(bitCapIntOcl) * srcArgs.size();
+    AddAlloc(tempSize);
+    BufferPtr packedBuffer = MakeBuffer(CL_MEM_READ_ONLY, sizeof(complex) * packedPower);
+    BufferPtr srcArgsBuffer =
+        MakeBuffer(CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY, sizeof(bitCapIntOcl) * srcArgs.size(), srcArgs.data());
+
+    for (size_t i = 0U; i < srcs.size(); ++i) {
+        srcs[i]->clFinish();
+        cl::Event copyEvent;
+        tryOcl("Failed to enqueue buffer copy", [&] {
+            return queue.enqueueCopyBuffer(*(srcs[i]->stateBuffer), *packedBuffer, 0U,
+                sizeof(complex) * srcArgs[3U * i + 2U], sizeof(complex) * srcs[i]->maxQPowerOcl, NULL, &copyEvent);
+        });
+        copyEvent.wait();
+    }
+
+    PoolItemPtr poolItem = GetFreePoolItem();
+    EventVecPtr waitVec = ResetWaitEvents();
+
+    const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ nMaxQPower, (bitCapIntOcl)srcs.size(), maxQPowerOcl - ONE_BCI, 0U, 0U, 0U,
+        0U, 0U, 0U, 0U };
+    cl::Event writeArgsEvent;
+    DISPATCH_TEMP_WRITE(waitVec, *(poolItem->ulongBuffer), sizeof(bitCapIntOcl) * 3, bciArgs, writeArgsEvent);
 
-    AddAlloc(sizeof(complex) * nMaxQPower);
+    AddAlloc(nStateVecSize);
 
     SetQubitCount(nQubitCount);
 
@@ -1329,60 +2204,16 @@ void QEngineOCL::Compose(OCLAPI apiCall, const bitCapIntOcl* bciArgs, QEngineOCL
     std::shared_ptr<complex> nStateVec = AllocStateVec(maxQPowerOcl, forceAlloc);
     BufferPtr nStateBuffer = MakeStateVecBuffer(nStateVec);
 
-    toCopy->clFinish();
-
-    QueueCall(apiCall, ngc, ngs, { stateBuffer, toCopy->stateBuffer, poolItem->ulongBuffer, nStateBuffer });
-    toCopy->wait_refs.emplace_back(device_context->wait_events);
+    // The temporary buffers are held by the queue item, and their allocation is returned when it completes.
+    QueueCall(OCL_API_COMPOSE_MULTI, ngc, ngs,
+        { stateBuffer, packedBuffer, poolItem->ulongBuffer, srcArgsBuffer, nStateBuffer }, 0U, tempSize);
 
     stateVec = nStateVec;
     ResetStateBuffer(nStateBuffer);
 
     SubtractAlloc(sizeof(complex) * oMaxQPower);
-}
-
-bitLenInt QEngineOCL::Compose(QEngineOCLPtr toCopy)
-{
-    const bitLenInt result = qubitCount;
-
-    const bitCapIntOcl oQubitCount = toCopy->qubitCount;
-    const bitCapIntOcl nQubitCount = qubitCount + oQubitCount;
-    const bitCapIntOcl nMaxQPower = pow2Ocl(nQubitCount);
-    const bitCapIntOcl startMask = maxQPowerOcl - ONE_BCI;
-    const bitCapIntOcl endMask = (toCopy->maxQPowerOcl - ONE_BCI) << (bitCapIntOcl)qubitCount;
-    const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ nMaxQPower, qubitCount, startMask, endMask, 0U, 0U, 0U, 0U, 0U, 0U };
-
-    OCLAPI api_call;
-    if (nMaxQPower <= nrmGroupCount) {
-        api_call = OCL_API_COMPOSE_WIDE;
-    } else {
-        api_call = OCL_API_COMPOSE;
-    }
-
-    Compose(api_call, bciArgs, toCopy);
-
-    return result;
-}
 
-bitLenInt QEngineOCL::Compose(QEngineOCLPtr toCopy, bitLenInt start)
-{
-    if (start > qubitCount) {
-        throw std::invalid_argument("QEngineOCL::Compose start index is out-of-bounds!");
-    }
-
-    const bitLenInt result = start;
-
-    const bitLenInt oQubitCount = toCopy->qubitCount;
-    const bitLenInt nQubitCount = qubitCount + oQubitCount;
-    const bitCapIntOcl nMaxQPower = pow2Ocl(nQubitCount);
-    const bitCapIntOcl startMask = pow2Ocl(start) - ONE_BCI;
-    const bitCapIntOcl midMask = bitRegMaskOcl(start, oQubitCount);
-    const bitCapIntOcl endMask = pow2MaskOcl(qubitCount + oQubitCount) & ~(startMask | midMask);
-    const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ nMaxQPower, qubitCount, oQubitCount, startMask, midMask, endMask, start,
-        0U, 0U, 0U };
-
-    Compose(OCL_API_COMPOSE_MID, bciArgs, toCopy);
-
-    return result;
+    return ret;
 }
 
 void QEngineOCL::DecomposeDispose(bitLenInt start, bitLenInt length, QEngineOCLPtr destination)
@@ -1408,6 +2239,8 @@ void QEngineOCL::DecomposeDispose(bitLenInt start, bitLenInt length, QEngineOCLP
     if (destination && !destination->stateBuffer) {
         // Reinitialize stateVec RAM
         destination->SetPermutation(0U);
+    } else if (destination) {
+        destination->EnsureUniqueStateBuffer(false);
     }
 
     if (doNormalize) {
@@ -1423,7 +2256,9 @@ void QEngineOCL::DecomposeDispose(bitLenInt start, bitLenInt length, QEngineOCLP
         if (destination != NULL) {
             destination->stateVec = stateVec;
             destination->stateBuffer = stateBuffer;
+            destination->stateBufferOwners = stateBufferOwners;
             stateBuffer = NULL;
+            stateBufferOwners = NULL;
             stateVec = NULL;
         }
         SetQubitCount(0U);
@@ -1831,15 +2666,11 @@ void QEngineOCL::ProbMaskAll(bitCapInt mask, real1* probsArray)
 
     bitCapIntOcl v = (bitCapIntOcl)mask; // count the number of bits set in v
     bitLenInt length;
-    std::vector<bitCapIntOcl> powersVec;
     for (length = 0U; v; ++length) {
-        bitCapIntOcl oldV = v;
         v &= v - ONE_BCI; // clear the least significant bit set
-        powersVec.push_back((v ^ oldV) & oldV);
     }
 
     const bitCapIntOcl lengthPower = pow2Ocl(length);
-    const bitCapIntOcl maxJ = maxQPowerOcl >> length;
 
     if (!stateBuffer) {
         std::fill(probsArray, probsArray + lengthPower, ZERO_R1);
@@ -1853,7 +2684,34 @@ void QEngineOCL::ProbMaskAll(bitCapInt mask, real1* probsArray)
         return;
     }
 
-    v = (~(bitCapIntOcl)mask) & (maxQPowerOcl - ONE_BCI); // count the number of bits set in v
+    AddAlloc(sizeof(real1) * lengthPower);
+    BufferPtr probsBuffer = MakeBuffer(CL_MEM_WRITE_ONLY, sizeof(real1) * lengthPower);
+
+    QueueProbMaskAll((bitCapIntOcl)mask, probsBuffer);
+
+    EventVecPtr waitVec = ResetWaitEvents();
+    DISPATCH_BLOCK_READ(waitVec, *probsBuffer, 0U, sizeof(real1) * lengthPower, probsArray);
+
+    probsBuffer.reset();
+
+    SubtractAlloc(sizeof(real1) * lengthPower);
+}
+
+void QEngineOCL::QueueProbMaskAll(bitCapIntOcl mask, BufferPtr probsBuffer)
+{
+    bitCapIntOcl v = mask; // count the number of bits set in v
+    bitLenInt length;
+    std::vector<bitCapIntOcl> powersVec;
+    for (length = 0U; v; ++length) {
+        bitCapIntOcl oldV = v;
+        v &= v - ONE_BCI; // clear the least significant bit set
+        powersVec.push_back((v ^ oldV) & oldV);
+    }
+
+    const bitCapIntOcl lengthPower = pow2Ocl(length);
+    const bitCapIntOcl maxJ = maxQPowerOcl >> length;
+
+    v = (~mask) & (maxQPowerOcl - ONE_BCI); // count the number of bits set in v
     bitCapIntOcl skipPower;
     bitLenInt skipLength = 0U; // c accumulates the total bits set in v
     std::vector<bitCapIntOcl> skipPowersVec;
@@ -1871,11 +2729,9 @@ void QEngineOCL::ProbMaskAll(bitCapInt mask, real1* probsArray)
 
     DISPATCH_WRITE(waitVec, *(poolItem->ulongBuffer), sizeof(bitCapIntOcl) * 4, bciArgs);
 
-    size_t sizeDiff = sizeof(real1) * lengthPower + sizeof(bitCapIntOcl) * length + sizeof(bitCapIntOcl) * skipLength;
+    const size_t sizeDiff = sizeof(bitCapIntOcl) * length + sizeof(bitCapIntOcl) * skipLength;
     AddAlloc(sizeDiff);
 
-    BufferPtr probsBuffer = MakeBuffer(CL_MEM_WRITE_ONLY, sizeof(real1) * lengthPower);
-
     std::unique_ptr<bitCapIntOcl[]> powers(new bitCapIntOcl[length]);
     std::copy(powersVec.begin(), powersVec.end(), powers.get());
     BufferPtr qPowersBuffer =
@@ -1891,17 +2747,111 @@ void QEngineOCL::ProbMaskAll(bitCapInt mask, real1* probsArray)
     const size_t ngc = FixWorkItemCount(lengthPower, nrmGroupCount);
     const size_t ngs = FixGroupSize(ngc, nrmGroupSize);
 
+    // (The queue item holds the power buffers until the kernel completes, then releases their allocation.)
     QueueCall(OCL_API_PROBMASKALL, ngc, ngs,
-        { stateBuffer, poolItem->ulongBuffer, probsBuffer, qPowersBuffer, qSkipPowersBuffer });
+        { stateBuffer, poolItem->ulongBuffer, probsBuffer, qPowersBuffer, qSkipPowersBuffer }, 0U, sizeDiff);
+}
+
+void QEngineOCL::MultiShotMeasureMask(
+    const std::vector<bitCapInt>& qPowers, unsigned shots, unsigned long long* shotsArray)
+{
+    if (!shots) {
+        return;
+    }
+
+    std::vector<bitLenInt> bitMap(qPowers.size());
+    std::transform(qPowers.begin(), qPowers.end(), bitMap.begin(), log2);
+
+    ThrowIfQbIdArrayIsBad(bitMap, qubitCount,
+        "QEngineOCL::MultiShotMeasureMask parameter qPowers array values must be within allocated qubit bounds!");
+
+    const bitLenInt length = (bitLenInt)qPowers.size();
+    const bitCapIntOcl lengthPower = pow2Ocl(length);
+
+    // Sampling on the device pays when the outcome distribution is larger than the samples, to move over the bus.
+    if (!stateBuffer || (shots == 1U) || ((unsigned)(bitCapIntOcl)shots != shots) ||
+        ((sizeof(real1) * lengthPower) <= (sizeof(bitCapIntOcl) * shots)) ||
+        ((lengthPower * lengthPower) < nrmGroupCount)) {
+        QEngine::MultiShotMeasureMask(qPowers, shots, shotsArray);
+        return;
+    }
+
+    if (doNormalize) {
+        NormalizeState();
+    }
+
+    // The device orders outcome bits by ascending qubit; results are reordered to "qPowers" order at the end.
+    bitCapIntOcl mask = 0U;
+    std::vector<std::pair<bitLenInt, bitLenInt>> sortedBits(length);
+    for (bitLenInt i = 0U; i < length; ++i) {
+        mask |= (bitCapIntOcl)qPowers[i];
+        sortedBits[i] = std::make_pair(bitMap[i], i);
+    }
+    std::sort(sortedBits.begin(), sortedBits.end());
+
+    const size_t ngc = FixWorkItemCount(lengthPower, nrmGroupCount);
+    const size_t ngs = FixGroupSize(ngc, nrmGroupSize);
+    const bitCapIntOcl chunk = lengthPower / ngc;
+
+    const size_t sizeDiff = sizeof(real1) * (lengthPower + ngc) + sizeof(bitCapIntOcl) * shots;
+    AddAlloc(sizeDiff);
+
+    BufferPtr cdfBuffer = MakeBuffer(CL_MEM_READ_WRITE, sizeof(real1) * lengthPower);
+    BufferPtr chunkBuffer = MakeBuffer(CL_MEM_READ_WRITE, sizeof(real1) * ngc);
+    BufferPtr samplesBuffer = MakeBuffer(CL_MEM_WRITE_ONLY, sizeof(bitCapIntOcl) * shots);
+
+    // Outcome probabilities, then an in-place prefix sum per work item chunk, never leave the device.
+    QueueProbMaskAll(mask, cdfBuffer);
+
+    const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ lengthPower, chunk, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U };
+    EventVecPtr waitVec = ResetWaitEvents();
+    PoolItemPtr poolItem = GetFreePoolItem();
+    DISPATCH_WRITE(waitVec, *(poolItem->ulongBuffer), sizeof(bitCapIntOcl) * 2, bciArgs);
+    QueueCall(OCL_API_CDFCHUNKS, ngc, ngs, { cdfBuffer, poolItem->ulongBuffer, chunkBuffer });
+
+    // Only the per-chunk totals are scanned on the host.
+    std::unique_ptr<real1[]> chunkEnds(new real1[ngc]);
+    clFinish();
+    tryOcl("Failed to enqueue buffer read", [&] {
+        return queue.enqueueReadBuffer(*chunkBuffer, CL_TRUE, 0U, sizeof(real1) * ngc, chunkEnds.get(), NULL, NULL);
+    });
+    double partial = 0.0;
+    for (size_t i = 0U; i < ngc; ++i) {
+        partial += (double)chunkEnds[i];
+        chunkEnds[i] = (real1)partial;
+    }
 
+    const uint64_t seed = RandSeed();
+    const bitCapIntOcl bciArgs2[BCI_ARG_LEN]{ lengthPower, chunk, (bitCapIntOcl)ngc, (bitCapIntOcl)shots,
+        (bitCapIntOcl)(seed >> 32U), (bitCapIntOcl)(seed & 0xFFFFFFFFU), 0U, 0U, 0U, 0U };
     EventVecPtr waitVec2 = ResetWaitEvents();
-    DISPATCH_BLOCK_READ(waitVec2, *probsBuffer, 0U, sizeof(real1) * lengthPower, probsArray);
+    PoolItemPtr poolItem2 = GetFreePoolItem();
+    DISPATCH_WRITE(waitVec2, *chunkBuffer, sizeof(real1) * ngc, chunkEnds.get());
+    DISPATCH_WRITE(waitVec2, *(poolItem2->ulongBuffer), sizeof(bitCapIntOcl) * 6, bciArgs2);
 
-    probsBuffer.reset();
-    qPowersBuffer.reset();
-    qSkipPowersBuffer.reset();
+    const size_t sgc = FixWorkItemCount(shots, nrmGroupCount);
+    const size_t sgs = FixGroupSize(sgc, nrmGroupSize);
+    QueueCall(OCL_API_SAMPLECDF, sgc, sgs, { cdfBuffer, poolItem2->ulongBuffer, chunkBuffer, samplesBuffer });
 
+    std::unique_ptr<bitCapIntOcl[]> samples(new bitCapIntOcl[shots]);
+    EventVecPtr waitVec3 = ResetWaitEvents();
+    DISPATCH_BLOCK_READ(waitVec3, *samplesBuffer, 0U, sizeof(bitCapIntOcl) * shots, samples.get());
+
+    cdfBuffer.reset();
+    chunkBuffer.reset();
+    samplesBuffer.reset();
     SubtractAlloc(sizeDiff);
+
+    par_for(0U, shots, [&](const bitCapIntOcl& shot, const unsigned& cpu) {
+        const bitCapIntOcl sample = samples[shot];
+        unsigned long long result = 0U;
+        for (bitLenInt i = 0U; i < length; ++i) {
+            if ((sample >> i) & 1U) {
+                result |= 1ULL << sortedBits[i].second;
+            }
+        }
+        shotsArray[shot] = result;
+    });
 }
 
 real1_f QEngineOCL::ProbParity(bitCapInt mask)
@@ -1994,6 +2944,75 @@ real1_f QEngineOCL::ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCa
     return expectation;
 }
 
+std::vector<real1_f> QEngineOCL::ExpectationPauliAll(const std::vector<PauliString>& terms)
+{
+    std::vector<real1_f> toRet(terms.size(), ZERO_R1_F);
+    if (!stateBuffer) {
+        return toRet;
+    }
+
+    if (doNormalize) {
+        NormalizeState();
+    }
+
+    // Each term is one read-only "exppauli" pass, with no basis change and no copy of the state, so commuting groups
+    // buy nothing over separate terms here.
+    for (size_t t = 0U; t < terms.size(); ++t) {
+        const PauliString& term = terms[t];
+        if (term.qubits.size() != term.paulis.size()) {
+            throw std::invalid_argument("QEngineOCL::ExpectationPauliAll term qubit and Pauli counts must match!");
+        }
+        ThrowIfQbIdArrayIsBad(term.qubits, qubitCount,
+            "QEngineOCL::ExpectationPauliAll parameter qubits vector values must be within allocated qubit bounds!");
+
+        bitCapIntOcl xMask = 0U;
+        bitCapIntOcl zMask = 0U;
+        bitCapIntOcl yCount = 0U;
+        for (size_t i = 0U; i < term.qubits.size(); ++i) {
+            const bitCapIntOcl qPower = pow2Ocl(term.qubits[i]);
+            switch (term.paulis[i]) {
+            case PauliX:
+                xMask ^= qPower;
+                break;
+            case PauliY:
+                xMask ^= qPower;
+                zMask ^= qPower;
+                ++yCount;
+                break;
+            case PauliZ:
+                zMask ^= qPower;
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (!xMask && !zMask) {
+            toRet[t] = ONE_R1_F;
+            continue;
+        }
+
+        EventVecPtr waitVec = ResetWaitEvents();
+        PoolItemPtr poolItem = GetFreePoolItem();
+
+        const bitCapIntOcl bciArgs[BCI_ARG_LEN]{ maxQPowerOcl, xMask, zMask, yCount & 1U, 0U, 0U, 0U, 0U, 0U, 0U };
+        DISPATCH_WRITE(waitVec, *(poolItem->ulongBuffer), sizeof(bitCapIntOcl) * 4, bciArgs);
+
+        const size_t ngc = FixWorkItemCount(maxQPowerOcl, nrmGroupCount);
+        const size_t ngs = FixGroupSize(ngc, nrmGroupSize);
+
+        QueueCall(OCL_API_EXPPAULI, ngc, ngs, { stateBuffer, poolItem->ulongBuffer, nrmBuffer }, sizeof(real1) * ngs);
+
+        real1_f expectation;
+        WAIT_REAL1_SUM(*nrmBuffer, ngc / ngs, nrmArray, &expectation);
+
+        // The kernel sums without the i^(Y count) factor: fold it back in.
+        toRet[t] = ((yCount + 1U) & 2U) ? -expectation : expectation;
+    }
+
+    return toRet;
+}
+
 real1_f QEngineOCL::GetExpectation(bitLenInt valueStart, bitLenInt valueLength)
 {
     real1 average = ZERO_R1;
@@ -2028,9 +3047,6 @@ void QEngineOCL::CArithmeticCall(OCLAPI api_call, const bitCapIntOcl (&bciArgs)[
     if (controlLen) {
         sizeDiff += sizeof(bitCapIntOcl) * controlLen;
     }
-    if (values) {
-        sizeDiff += sizeof(unsigned char) * valuesPower;
-    }
     AddAlloc(sizeDiff);
 
     EventVecPtr waitVec = ResetWaitEvents();
@@ -2070,11 +3086,8 @@ void QEngineOCL::CArithmeticCall(OCLAPI api_call, const bitCapIntOcl (&bciArgs)[
 
     std::vector<BufferPtr> oclArgs{ stateBuffer, poolItem->ulongBuffer, nStateBuffer };
 
-    BufferPtr loadBuffer;
     if (values) {
-        loadBuffer =
-            MakeBuffer(CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY, sizeof(unsigned char) * valuesPower, (void*)values);
-        oclArgs.push_back(loadBuffer);
+        oclArgs.push_back(GetLookupTableBuffer(values, valuesPower));
     }
     if (controlLen) {
         oclArgs.push_back(controlBuffer);
@@ -2113,7 +3126,15 @@ void QEngineOCL::ROx(OCLAPI api_call, bitLenInt shift, bitLenInt start, bitLenIn
 }
 
 /// "Circular shift left" - shift bits left, and carry last bits.
-void QEngineOCL::ROL(bitLenInt shift, bitLenInt start, bitLenInt length) { ROx(OCL_API_ROL, shift, start, length); }
+void QEngineOCL::ROL(bitLenInt shift, bitLenInt start, bitLenInt length)
+{
+    try {
+        ROx(OCL_API_ROL, shift, start, length);
+    } catch (const bad_alloc&) {
+        // With no room for a second state vector, (before anything is queued,) reversals by swaps are in place.
+        QInterface::ROL(shift, start, length);
+    }
+}
 
 #if ENABLE_ALU
 /// Add or Subtract integer (without sign or carry)
@@ -2931,6 +3952,7 @@ void QEngineOCL::PhaseFlipIfLess(bitCapInt greaterPerm, bitLenInt start, bitLenI
 void QEngineOCL::SetQuantumState(complex const* inputState)
 {
     clDump();
+    EnsureUniqueStateBuffer(false);
 
     if (!stateBuffer) {
         ReinitBuffer();
@@ -2975,6 +3997,7 @@ void QEngineOCL::SetAmplitude(bitCapInt perm, complex amp)
         ClearBuffer(stateBuffer, 0U, maxQPowerOcl);
     }
 
+    EnsureUniqueStateBuffer();
     permutationAmp = amp;
 
     if (runningNorm != REAL1_DEFAULT_ARG) {
@@ -3110,20 +4133,18 @@ QInterfacePtr QEngineOCL::Clone()
         return CloneEmpty();
     }
 
-    QEngineOCLPtr copyPtr = std::make_shared<QEngineOCL>(qubitCount, 0U, rand_generator, ONE_CMPLX, doNormalize,
-        randGlobalPhase, useHostRam, deviceID, hardware_rand_generator != NULL, false, (real1_f)amplitudeFloor);
-
-    cl::Event copyEvent;
+    QEngineOCLPtr copyPtr = std::dynamic_pointer_cast<QEngineOCL>(CloneEmpty());
 
-    copyPtr->clFinish();
     clFinish();
+    copyPtr->AddAlloc(sizeof(complex) * maxQPowerOcl);
 
-    tryOcl("Failed to enqueue buffer copy", [&] {
-        return queue.enqueueCopyBuffer(
-            *stateBuffer, *(copyPtr->stateBuffer), 0U, 0U, sizeof(complex) * maxQPowerOcl, NULL, &copyEvent);
-    });
-    copyEvent.wait();
-
+    // The clone is copy-on-write: both engines share one state buffer, until either writes to it.
+    if (!stateBufferOwners || (*stateBufferOwners != stateBuffer.get())) {
+        stateBufferOwners = std::make_shared<cl::Buffer*>(stateBuffer.get());
+    }
+    copyPtr->stateVec = stateVec;
+    copyPtr->stateBuffer = stateBuffer;
+    copyPtr->stateBufferOwners = stateBufferOwners;
     copyPtr->runningNorm = runningNorm;
 
     return copyPtr;
@@ -3235,15 +4256,6 @@ void QEngineOCL::UpdateRunningNorm(real1_f norm_thresh)
     }
 }
 
-#if defined(__APPLE__)
-complex* _aligned_state_vec_alloc(bitCapIntOcl allocSize)
-{
-    void* toRet;
-    posix_memalign(&toRet, QRACK_ALIGN_SIZE, allocSize);
-    return (complex*)toRet;
-}
-#endif
-
 std::shared_ptr<complex> QEngineOCL::AllocStateVec(bitCapInt elemCount, bool doForceAlloc)
 {
     // If we're not using host ram, there's no reason to allocate.
@@ -3254,19 +4266,8 @@ std::shared_ptr<complex> QEngineOCL::AllocStateVec(bitCapInt elemCount, bool doF
 #if defined(__ANDROID__)
     return std::shared_ptr<complex>(elemCount);
 #else
-    // elemCount is always a power of two, but might be smaller than QRACK_ALIGN_SIZE
-    size_t allocSize = sizeof(complex) * (size_t)elemCount;
-    if (allocSize < QRACK_ALIGN_SIZE) {
-        allocSize = QRACK_ALIGN_SIZE;
-    }
-#if defined(__APPLE__)
-    return std::shared_ptr<complex>(_aligned_state_vec_alloc(allocSize), [](complex* c) { free(c); });
-#elif defined(_WIN32) && !defined(__CYGWIN__)
-    return std::shared_ptr<complex>(
-        (complex*)_aligned_malloc(allocSize, QRACK_ALIGN_SIZE), [](complex* c) { _aligned_free(c); });
-#else
-    return std::shared_ptr<complex>((complex*)aligned_alloc(QRACK_ALIGN_SIZE, allocSize), [](complex* c) { free(c); });
-#endif
+    return std::shared_ptr<complex>((complex*)StateVecPool::Instance().Acquire(sizeof(complex) * (size_t)elemCount),
+        [](complex* c) { StateVecPool::Instance().Release(c); });
 #endif
 }
 
@@ -3278,9 +4279,16 @@ BufferPtr QEngineOCL::MakeStateVecBuffer(std::shared_ptr<complex> nStateVec)
 
     if (nStateVec) {
         return MakeBuffer(CL_MEM_USE_HOST_PTR | CL_MEM_READ_WRITE, sizeof(complex) * maxQPowerOcl, nStateVec.get());
-    } else {
-        return MakeBuffer(CL_MEM_READ_WRITE, sizeof(complex) * maxQPowerOcl);
     }
+
+    // Device-only state buffers come from, and go back to, the device context's pool.
+    const size_t size = sizeof(complex) * maxQPowerOcl;
+    BufferPtr toRet = device_context->AcquireBuffer(size);
+    if (toRet) {
+        return toRet;
+    }
+
+    return device_context->PoolBuffer(MakeBuffer(CL_MEM_READ_WRITE, size), size);
 }
 
 void QEngineOCL::ReinitBuffer()
@@ -3290,6 +4298,175 @@ void QEngineOCL::ReinitBuffer()
     ResetStateBuffer(MakeStateVecBuffer(stateVec));
 }
 
+void QEngineOCL::EnsureUniqueStateBuffer(bool doCopy)
+{
+    if (!stateBufferOwners) {
+        return;
+    }
+    if (!stateBuffer || (*stateBufferOwners != stateBuffer.get())) {
+        // The state buffer was replaced, since it was shared.
+        stateBufferOwners = NULL;
+        return;
+    }
+    if (stateBufferOwners.use_count() < 2) {
+        return;
+    }
+
+    // Our own queued kernels must read the shared buffer before its other owner could write to it in place.
+    while (wait_queue_items.size() > 1) {
+        device_context->WaitOnAllEvents();
+        PopQueue(true);
+        checkCallbackError();
+    }
+
+    std::shared_ptr<complex> nStateVec = AllocStateVec(maxQPowerOcl, usingHostRam);
+    BufferPtr nStateBuffer = MakeStateVecBuffer(nStateVec);
+
+    if (doCopy) {
+        EventVecPtr waitVec = ResetWaitEvents(false);
+        device_context->LockWaitEvents();
+        device_context->wait_events->emplace_back();
+        tryOcl(
+            "Failed to enqueue buffer copy",
+            [&] {
+                return queue.enqueueCopyBuffer(*stateBuffer, *nStateBuffer, 0U, 0U, sizeof(complex) * maxQPowerOcl,
+                    waitVec.get(), &(device_context->wait_events->back()));
+            },
+            true);
+        device_context->UnlockWaitEvents();
+    }
+
+    stateVec = nStateVec;
+    ResetStateBuffer(nStateBuffer);
+}
+
+// Kernels which only read the state buffer, or which write their output to a new buffer
+static bool IsStateBufferReadOnly(OCLAPI api_call)
+{
+    switch (api_call) {
+    case OCL_API_COMPOSE:
+    case OCL_API_COMPOSE_WIDE:
+    case OCL_API_COMPOSE_MID:
+    case OCL_API_DECOMPOSEPROB:
+    case OCL_API_DISPOSEPROB:
+    case OCL_API_DISPOSE:
+    case OCL_API_PROB:
+    case OCL_API_CPROB:
+    case OCL_API_PROBREG:
+    case OCL_API_PROBREGALL:
+    case OCL_API_PROBMASK:
+    case OCL_API_PROBMASKALL:
+    case OCL_API_PROBPARITY:
+    case OCL_API_EXPPERM:
+    case OCL_API_EXPPAULI:
+    case OCL_API_ROL:
+#if ENABLE_ALU
+    case OCL_API_INC:
+    case OCL_API_CINC:
+    case OCL_API_INCDECC:
+    case OCL_API_INCS:
+    case OCL_API_INCDECSC_1:
+    case OCL_API_INCDECSC_2:
+#if ENABLE_BCD
+    case OCL_API_INCBCD:
+    case OCL_API_INCDECBCDC:
+#endif
+    case OCL_API_MUL:
+    case OCL_API_DIV:
+    case OCL_API_MULMODN_OUT:
+    case OCL_API_IMULMODN_OUT:
+    case OCL_API_POWMODN_OUT:
+    case OCL_API_CMUL:
+    case OCL_API_CDIV:
+    case OCL_API_CMULMODN_OUT:
+    case OCL_API_CIMULMODN_OUT:
+    case OCL_API_CPOWMODN_OUT:
+    case OCL_API_INDEXEDLDA:
+    case OCL_API_INDEXEDADC:
+    case OCL_API_INDEXEDSBC:
+    case OCL_API_HASH:
+#endif
+    case OCL_API_APPROXCOMPARE:
+    case OCL_API_UPDATENORM:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void QEngineOCL::CopyOnWrite(OCLAPI api_call, std::vector<BufferPtr>& args)
+{
+    if (!stateBuffer || IsStateBufferReadOnly(api_call)) {
+        return;
+    }
+
+    const BufferPtr oStateBuffer = stateBuffer;
+    if (std::find(args.begin(), args.end(), oStateBuffer) == args.end()) {
+        return;
+    }
+
+    EnsureUniqueStateBuffer();
+    std::replace(args.begin(), args.end(), oStateBuffer, stateBuffer);
+}
+
+BufferPtr QEngineOCL::GetLookupTableBuffer(const unsigned char* values, bitCapIntOcl size)
+{
+    // FNV-1a over the table bytes
+    uint64_t checksum = 14695981039346656037ULL;
+    for (bitCapIntOcl i = 0U; i < size; ++i) {
+        checksum = (checksum ^ values[i]) * 1099511628211ULL;
+    }
+
+    for (auto it = lookupTables.begin(); it != lookupTables.end(); ++it) {
+        if ((it->checksum == checksum) && (it->size == size)) {
+            lookupTables.splice(lookupTables.begin(), lookupTables, it);
+            return it->buffer;
+        }
+    }
+
+    if (lookupTables.size() >= QRACK_OCL_LOOKUP_TABLES) {
+        SubtractAlloc(lookupTables.back().size);
+        lookupTables.pop_back();
+    }
+
+    AddAlloc(size);
+    BufferPtr buffer = MakeBuffer(CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY, size, (void*)values);
+    lookupTables.push_front(LookupTable{ checksum, size, buffer });
+
+    return buffer;
+}
+
+void QEngineOCL::ClearLookupTables()
+{
+    for (const LookupTable& table : lookupTables) {
+        SubtractAlloc(table.size);
+    }
+    lookupTables.clear();
+}
+
+void QEngineOCL::LookupCall(
+    OCLAPI api_call, const bitCapIntOcl* bciArgs, const unsigned char* values, bitCapIntOcl size)
+{
+    CHECK_ZERO_SKIP();
+
+    BufferPtr tableBuffer = GetLookupTableBuffer(values, size);
+
+    EventVecPtr waitVec = ResetWaitEvents();
+    PoolItemPtr poolItem = GetFreePoolItem();
+
+    cl::Event writeArgsEvent;
+    DISPATCH_TEMP_WRITE(waitVec, *(poolItem->ulongBuffer), sizeof(bitCapIntOcl) * 5, bciArgs, writeArgsEvent);
+
+    const size_t ngc = FixWorkItemCount(bciArgs[0], nrmGroupCount);
+    const size_t ngs = FixGroupSize(ngc, nrmGroupSize);
+
+    // Wait for buffer write from limited lifetime objects
+    writeArgsEvent.wait();
+    wait_refs.clear();
+
+    QueueCall(api_call, ngc, ngs, { stateBuffer, poolItem->ulongBuffer, tableBuffer });
+}
+
 void QEngineOCL::ClearBuffer(BufferPtr buff, bitCapIntOcl offset, bitCapIntOcl size)
 {
     PoolItemPtr poolItem = GetFreePoolItem();
@@ -14,6 +14,10 @@
 
 #include <algorithm>
 
+#if ENABLE_PTHREAD
+#include <future>
+#endif
+
 namespace Qrack {
 
 void QEngine::Mtrx(complex const* mtrx, bitLenInt qubit)
@@ -26,6 +30,133 @@ void QEngine::Mtrx(complex const* mtrx, bitLenInt qubit)
     Apply2x2(0U, qPowers[0U], mtrx, 1U, qPowers, doNormalize && !(IsPhase(mtrx) || IsInvert(mtrx)));
 }
 
+void QEngine::ScatterAmplitudes(bitCapIntOcl const* perms, complex const* amps, bitCapIntOcl count)
+{
+    for (bitCapIntOcl i = 0U; i < count; ++i) {
+        SetAmplitude(perms[i], amps[i]);
+    }
+}
+
+void QEngine::ForEachAmplitudeChunk(bitCapInt offset, bitCapInt length, AmplitudeChunkFn fn, bitCapIntOcl chunkLength)
+{
+    chunkLength = ReadoutChunkLength(offset, length, chunkLength);
+    if (!chunkLength) {
+        return;
+    }
+
+    // Double-buffered: one chunk is read by "fn," while the next is copied out, (from a device, or a QPager page).
+    std::unique_ptr<complex[]> buffers[2U];
+    buffers[0U].reset(new complex[chunkLength]);
+    if (chunkLength < length) {
+        buffers[1U].reset(new complex[chunkLength]);
+    }
+
+    const bitCapIntOcl end = (bitCapIntOcl)(offset + length);
+    bitCapIntOcl o = (bitCapIntOcl)offset;
+    GetAmplitudePage(buffers[0U].get(), o, chunkLength);
+    for (size_t b = 0U; o < end; b ^= 1U) {
+        const bitCapIntOcl l = ((end - o) < chunkLength) ? (end - o) : chunkLength;
+        const bitCapIntOcl next = o + l;
+        const bitCapIntOcl nextLength = ((end - next) < chunkLength) ? (end - next) : chunkLength;
+        complex* nextBuffer = buffers[b ^ 1U].get();
+#if ENABLE_PTHREAD
+        std::future<void> fetch;
+        if (next < end) {
+            fetch = std::async(std::launch::async,
+                [this, nextBuffer, next, nextLength]() { GetAmplitudePage(nextBuffer, next, nextLength); });
+        }
+        fn(o, l, buffers[b].get());
+        if (fetch.valid()) {
+            fetch.get();
+        }
+#else
+        fn(o, l, buffers[b].get());
+        if (next < end) {
+            GetAmplitudePage(nextBuffer, next, nextLength);
+        }
+#endif
+        o = next;
+    }
+}
+
+void QEngine::ValidateApply2x2(
+    bitCapIntOcl offset1, bitCapIntOcl offset2, bitLenInt bitCount, bitCapIntOcl const* qPowersSorted)
+{
+    if ((offset1 >= maxQPowerOcl) || (offset2 >= maxQPowerOcl)) {
+        throw std::invalid_argument(
+            "QEngine::Apply2x2 offset1 and offset2 parameters must be within allocated qubit bounds!");
+    }
+
+    for (bitLenInt i = 0U; i < bitCount; ++i) {
+        if (qPowersSorted[i] >= maxQPowerOcl) {
+            throw std::invalid_argument(
+                "QEngine::Apply2x2 parameter qPowersSorted array values must be within allocated qubit bounds!");
+        }
+        if (i && (qPowersSorted[i - 1U] == qPowersSorted[i])) {
+            throw std::invalid_argument("QEngine::Apply2x2 parameter qPowersSorted array values cannot be "
+                                        "duplicated (for control and target qubits)!");
+        }
+    }
+}
+
+bool QEngine::FuseApply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* mtrx, bitLenInt bitCount,
+    bitCapIntOcl const* qPowersSorted, bool doCalcNorm, real1_f norm_thresh)
+{
+    ValidateApply2x2(offset1, offset2, bitCount, qPowersSorted);
+
+    if (!fused2x2) {
+        fused2x2 = std::unique_ptr<Fused2x2>(new Fused2x2());
+        fused2x2->offset1 = offset1;
+        fused2x2->offset2 = offset2;
+        fused2x2->qPowersSorted = std::vector<bitCapIntOcl>(qPowersSorted, qPowersSorted + bitCount);
+        std::copy(mtrx, mtrx + 4U, fused2x2->mtrx);
+        fused2x2->doCalcNorm = doCalcNorm;
+        fused2x2->norm_thresh = norm_thresh;
+
+        return true;
+    }
+
+    // Only operators that act on exactly the same pairs of amplitudes can be multiplied together.
+    if ((offset1 != fused2x2->offset1) || (offset2 != fused2x2->offset2) || (norm_thresh != fused2x2->norm_thresh) ||
+        (bitCount != fused2x2->qPowersSorted.size()) ||
+        !std::equal(qPowersSorted, qPowersSorted + bitCount, fused2x2->qPowersSorted.begin())) {
+        return false;
+    }
+
+    complex out[4U];
+    mul2x2(mtrx, fused2x2->mtrx, out);
+
+    if (IsIdentity(out, bitCount > 1U)) {
+        // The run cancelled itself out.
+        fused2x2 = NULL;
+
+        return true;
+    }
+
+    std::copy(out, out + 4U, fused2x2->mtrx);
+    fused2x2->doCalcNorm |= doCalcNorm;
+
+    return true;
+}
+
+void QEngine::PermuteQubits(const std::vector<bitLenInt>& dest)
+{
+    if (dest.size() != qubitCount) {
+        throw std::invalid_argument("QEngine::PermuteQubits must map every qubit!");
+    }
+    ThrowIfQbIdArrayIsBad(dest, qubitCount, "QEngine::PermuteQubits destination is out-of-bounds!");
+
+    // Follow each cycle, putting one qubit in its final place per SWAP.
+    std::vector<bitLenInt> d(dest);
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        while (d[i] != i) {
+            const bitLenInt j = d[i];
+            Swap(i, j);
+            std::swap(d[i], d[j]);
+        }
+    }
+}
+
 void QEngine::EitherMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target, bool isAnti)
 {
     if (!controls.size()) {
@@ -536,4 +667,34 @@ bitCapInt QEngine::ForceMReg(bitLenInt start, bitLenInt length, bitCapInt result
     return result;
 }
 
+void QEngine::SaveCheckpoint(CheckpointWriter& writer)
+{
+    Finish();
+
+    writer.BeginSection("QENG");
+    writer.Write<uint64_t>(qubitCount);
+
+    const bitCapIntOcl maxQPowerOcl = (bitCapIntOcl)maxQPower;
+    const bitCapIntOcl chunk = std::min(maxQPowerOcl, pow2Ocl(QRACK_CHECKPOINT_CHUNK_POW));
+    std::unique_ptr<complex[]> amps(new complex[chunk]);
+    for (bitCapIntOcl i = 0U; i < maxQPowerOcl; i += chunk) {
+        GetAmplitudePage(amps.get(), i, chunk);
+        writer.WriteAmplitudes(i, amps.get(), chunk);
+    }
+    writer.EndAmplitudes();
+}
+
+void QEngine::LoadCheckpoint(CheckpointReader& reader)
+{
+    reader.ExpectSection("QENG");
+    if (reader.Read<uint64_t>() != qubitCount) {
+        throw std::invalid_argument("QEngine::LoadCheckpoint() checkpoint qubit count does not match!");
+    }
+
+    Finish();
+    reader.ReadAmplitudes((bitCapIntOcl)maxQPower, [](bitCapIntOcl offset) { return (size_t)0U; },
+        [this](bitCapIntOcl offset, complex const* amps, bitCapIntOcl count) {
+            SetAmplitudePage(amps, offset, count);
+        });
+}
 } // namespace Qrack
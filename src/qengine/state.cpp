@@ -10,8 +10,14 @@
 // See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
 // for details.
 
+#include "common/simd_dispatch.hpp"
 #include "qengine_cpu.hpp"
 
+#if ENABLE_NUMA
+#include "common/parallel_pool.hpp"
+#endif
+
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
@@ -20,6 +26,13 @@
         return;                                                                                                        \
     }
 
+// Amplitudes per dispatched SIMD norm sum or measurement block, (a multiple of every SIMD width)
+#define SIMD_NORM_BLOCK 64U
+// Most skipped bits, (target and controls,) of the compiled Apply2x2Unfused() kernels
+#define APPLY2X2_KERNEL_MAX_BITS 4U
+// Lowest skipped power at which an Apply2x2Unfused() kernel loops over contiguous runs, rather than single indices
+#define APPLY2X2_KERNEL_MIN_RUN 8U
+
 namespace Qrack {
 
 /**
@@ -37,8 +50,50 @@ QEngineCPU::QEngineCPU(bitLenInt qBitCount, bitCapInt initState, qrack_rand_gen_
     real1_f norm_thresh, std::vector<int64_t> devList, bitLenInt qubitThreshold, real1_f sep_thresh)
     : QEngine(qBitCount, rgp, doNorm, randomGlobalPhase, true, useHardwareRNG, norm_thresh)
     , isSparse(useSparseStateVec)
+    , isInPlaceArithmetic(false)
     , maxQubits(-1)
+    , maxAllocBytes(-1)
+    , numaNode(-1)
+    , isCompressEvicted(false)
+    , storage(STATE_VEC_NATIVE)
+    , probCacheMisses(0U)
+    , runningNormThresh(-ONE_R1_F)
+    , maxDiagonalQubits(12U)
 {
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_DIAGONAL_FUSION_QB")) {
+        maxDiagonalQubits = (bitLenInt)std::stoi(std::string(getenv("QRACK_DIAGONAL_FUSION_QB")));
+    }
+    if (getenv("QRACK_STATE_VEC_STORAGE")) {
+        const std::string s(getenv("QRACK_STATE_VEC_STORAGE"));
+        if (s == "fp16") {
+            storage = STATE_VEC_FP16;
+        } else if (s == "bf16") {
+            storage = STATE_VEC_BF16;
+        } else if (s == "blocked") {
+            storage = STATE_VEC_BLOCKED;
+        }
+    }
+    if (getenv("QRACK_INPLACE_ARITHMETIC")) {
+        isInPlaceArithmetic = std::stoi(std::string(getenv("QRACK_INPLACE_ARITHMETIC"))) != 0;
+    }
+    if (getenv("QRACK_MAX_ALLOC_MB")) {
+        // The host has no entry of its own, so it takes the first, in the syntax OCLEngine reads.
+        std::string term(getenv("QRACK_MAX_ALLOC_MB"));
+        term = term.substr(0U, term.find(','));
+        const size_t dot = term.find('.');
+        if (dot != std::string::npos) {
+            term = term.substr(dot + 1U);
+            term = term.substr(0U, term.find('.'));
+        }
+        if (term.size()) {
+            maxAllocBytes = std::stoi(term);
+            if (maxAllocBytes >= 0) {
+                maxAllocBytes = maxAllocBytes << 20U;
+            }
+        }
+    }
+#endif
 #if ENABLE_QUNIT_CPU_PARALLEL && ENABLE_PTHREAD
 #if ENABLE_ENV_VARS
     const bitLenInt pStridePow =
@@ -52,6 +107,7 @@ QEngineCPU::QEngineCPU(bitLenInt qBitCount, bitCapInt initState, qrack_rand_gen_
     const unsigned numCores = GetConcurrencyLevel();
     const bitLenInt minStridePow = (numCores > 1U) ? (bitLenInt)pow2Ocl(log2(numCores - 1U)) : 0U;
     dispatchThreshold = (pStridePow > minStridePow) ? (pStridePow - minStridePow) : 0U;
+    isDispatchWide = false;
 #endif
 
     if (qBitCount > maxQubits) {
@@ -99,11 +155,44 @@ void QEngineCPU::SetAmplitudePage(complex const* pagePtr, bitCapIntOcl offset, b
     }
 
     Finish();
+    EnsureUniqueStateVec();
 
     stateVec->copy_in(pagePtr, offset, length);
 
     runningNorm = REAL1_DEFAULT_ARG;
 }
+void QEngineCPU::ScatterAmplitudes(bitCapIntOcl const* perms, complex const* amps, bitCapIntOcl count)
+{
+    for (bitCapIntOcl i = 0U; i < count; ++i) {
+        if (perms[i] >= maxQPowerOcl) {
+            throw std::invalid_argument("QEngineCPU::ScatterAmplitudes argument out-of-bounds!");
+        }
+    }
+
+    if (!count) {
+        return;
+    }
+
+    if (!stateVec) {
+        ResetStateVec(AllocStateVec(maxQPowerOcl));
+        stateVec->clear();
+    }
+
+    Finish();
+    EnsureUniqueStateVec();
+
+    if (stateVec->is_sparse()) {
+        for (bitCapIntOcl i = 0U; i < count; ++i) {
+            stateVec->write(perms[i], amps[i]);
+        }
+    } else {
+        // (The permutations are distinct, so no two threads write the same amplitude.)
+        par_for(0U, count,
+            [&](const bitCapIntOcl& lcv, const unsigned& cpu) { stateVec->write(perms[lcv], amps[lcv]); });
+    }
+
+    runningNorm = REAL1_DEFAULT_ARG;
+}
 void QEngineCPU::SetAmplitudePage(
     QEnginePtr pageEnginePtr, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length)
 {
@@ -117,6 +206,14 @@ void QEngineCPU::SetAmplitudePage(
         throw std::invalid_argument("QEngineCPU::SetAmplitudePage source range is out-of-bounds!");
     }
 
+    if (!pageEngineCpuPtr) {
+        // Another engine type, (as a device page of a heterogeneous QPager,) copies out through its own interface.
+        SetAmplitudePageFromDevice(pageEnginePtr, srcOffset, dstOffset, length);
+        return;
+    }
+
+    // (Finish first, so pending gates don't see this reference as a copy-on-write share.)
+    pageEngineCpuPtr->Finish();
     StateVectorPtr oStateVec = pageEngineCpuPtr->stateVec;
 
     if (!stateVec && !oStateVec) {
@@ -134,20 +231,90 @@ void QEngineCPU::SetAmplitudePage(
     }
 
     Finish();
-    pageEngineCpuPtr->Finish();
+    EnsureUniqueStateVec();
 
     stateVec->copy_in(oStateVec, srcOffset, dstOffset, length);
 
     runningNorm = REAL1_DEFAULT_ARG;
 }
+void QEngineCPU::SetAmplitudePageFromDevice(
+    QEnginePtr pageEnginePtr, bitCapIntOcl srcOffset, bitCapIntOcl dstOffset, bitCapIntOcl length)
+{
+    if (pageEnginePtr->IsZeroAmplitude()) {
+        if (!stateVec) {
+            return;
+        }
+        if (length == maxQPower) {
+            ZeroAmplitudes();
+            return;
+        }
+    }
+
+    if (!stateVec) {
+        ResetStateVec(AllocStateVec(maxQPowerOcl));
+        stateVec->clear();
+    }
+
+    Finish();
+    EnsureUniqueStateVec();
+
+    StateVectorArray* sva = dynamic_cast<StateVectorArray*>(stateVec.get());
+    if (sva) {
+        // The other engine reads out straight into this state vector.
+        pageEnginePtr->GetAmplitudePage(sva->amplitudes.get() + dstOffset, srcOffset, length);
+    } else {
+        std::unique_ptr<complex[]> page(new complex[length]);
+        pageEnginePtr->GetAmplitudePage(page.get(), srcOffset, length);
+        stateVec->copy_in(page.get(), dstOffset, length);
+    }
+
+    runningNorm = REAL1_DEFAULT_ARG;
+}
+void QEngineCPU::ShuffleBuffersWithDevice(QEnginePtr engine)
+{
+    if (!stateVec && engine->IsZeroAmplitude()) {
+        return;
+    }
+
+    if (!stateVec) {
+        ResetStateVec(AllocStateVec(maxQPowerOcl));
+        stateVec->clear();
+    }
+
+    Finish();
+    EnsureUniqueStateVec();
+
+    const bitCapIntOcl halfMaxQPower = maxQPowerOcl >> 1U;
+    std::unique_ptr<complex[]> upper(new complex[halfMaxQPower]);
+    stateVec->copy_out(upper.get(), halfMaxQPower, halfMaxQPower);
+
+    StateVectorArray* sva = dynamic_cast<StateVectorArray*>(stateVec.get());
+    if (sva) {
+        engine->GetAmplitudePage(sva->amplitudes.get() + halfMaxQPower, 0U, halfMaxQPower);
+    } else {
+        std::unique_ptr<complex[]> lower(new complex[halfMaxQPower]);
+        engine->GetAmplitudePage(lower.get(), 0U, halfMaxQPower);
+        stateVec->copy_in(lower.get(), halfMaxQPower, halfMaxQPower);
+    }
+
+    engine->SetAmplitudePage(upper.get(), 0U, halfMaxQPower);
+
+    runningNorm = REAL1_DEFAULT_ARG;
+}
 void QEngineCPU::ShuffleBuffers(QEnginePtr engine)
 {
+    QRACK_INSTRUMENT("QEngineCPU", "ShuffleBuffers");
     if (qubitCount != engine->GetQubitCount()) {
         throw std::invalid_argument("QEngineCPU::ShuffleBuffers argument size differs from this!");
     }
 
     QEngineCPUPtr engineCpu = std::dynamic_pointer_cast<QEngineCPU>(engine);
 
+    if (!engineCpu) {
+        ShuffleBuffersWithDevice(engine);
+        return;
+    }
+
     if (!stateVec && !(engineCpu->stateVec)) {
         return;
     }
@@ -164,6 +331,8 @@ void QEngineCPU::ShuffleBuffers(QEnginePtr engine)
 
     Finish();
     engineCpu->Finish();
+    EnsureUniqueStateVec();
+    engineCpu->EnsureUniqueStateVec();
 
     stateVec->shuffle(engineCpu->stateVec);
 
@@ -183,16 +352,18 @@ void QEngineCPU::CopyStateVec(QEnginePtr src)
 
     if (stateVec) {
         Dump();
+        EnsureUniqueStateVec(false);
     } else {
         ResetStateVec(AllocStateVec(maxQPowerOcl));
     }
 
-    if (isSparse) {
-        std::unique_ptr<complex> sv = std::unique_ptr<complex>(new complex[maxQPowerOcl]);
+    StateVectorArrayPtr sva = std::dynamic_pointer_cast<StateVectorArray>(stateVec);
+    if (sva) {
+        src->GetQuantumState(sva->amplitudes.get());
+    } else {
+        std::unique_ptr<complex[]> sv(new complex[maxQPowerOcl]);
         src->GetQuantumState(sv.get());
         SetQuantumState(sv.get());
-    } else {
-        src->GetQuantumState(std::dynamic_pointer_cast<StateVectorArray>(stateVec)->amplitudes.get());
     }
 
     runningNorm = src->GetRunningNorm();
@@ -236,12 +407,14 @@ void QEngineCPU::SetAmplitude(bitCapInt perm, complex amp)
         stateVec->clear();
     }
 
+    EnsureUniqueStateVec();
     stateVec->write((bitCapIntOcl)perm, amp);
 }
 
 void QEngineCPU::SetPermutation(bitCapInt perm, complex phaseFac)
 {
     Dump();
+    EnsureUniqueStateVec(false);
 
     if (!stateVec) {
         ResetStateVec(AllocStateVec(maxQPowerOcl));
@@ -270,6 +443,7 @@ void QEngineCPU::SetPermutation(bitCapInt perm, complex phaseFac)
 void QEngineCPU::SetQuantumState(complex const* inputState)
 {
     Dump();
+    EnsureUniqueStateVec(false);
 
     if (!stateVec) {
         ResetStateVec(AllocStateVec(maxQPowerOcl));
@@ -311,6 +485,476 @@ void QEngineCPU::GetProbs(real1* outputProbs)
     stateVec->get_probs(outputProbs);
 }
 
+void QEngineCPU::DirtyProbCache2x2(
+    bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* mtrx, bitLenInt bitCount, bool isRescaled)
+{
+    // Only a unitary keeps the norm of every amplitude pair it acts on, (and so every other qubit's marginal).
+    const bool isUnitary = (abs(ONE_R1 - (norm(mtrx[0U]) + norm(mtrx[2U]))) <= FP_NORM_EPSILON) &&
+        (abs(ONE_R1 - (norm(mtrx[1U]) + norm(mtrx[3U]))) <= FP_NORM_EPSILON) &&
+        (norm(mtrx[0U] * std::conj(mtrx[1U]) + mtrx[2U] * std::conj(mtrx[3U])) <= FP_NORM_EPSILON);
+
+    if (isRescaled || !isUnitary) {
+        DirtyProbCache();
+    } else if (IsPhase(mtrx)) {
+        DirtyProbCache(0U);
+    } else if ((bitCount == 1U) && IsInvert(mtrx)) {
+        FlipProbCache(offset1 ^ offset2);
+    } else {
+        DirtyProbCache(offset1 ^ offset2);
+    }
+}
+
+bool QEngineCPU::FuseDiagonal(bitCapIntOcl mask, const DiagonalFn& phaseFn)
+{
+    // A pending 2x2 operator must not commute past the diagonal.
+    FlushFused2x2();
+
+    const bitCapIntOcl nMask = fusedDiagonal ? (fusedDiagonal->mask | mask) : mask;
+    std::vector<bitCapIntOcl> qPowers;
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        if ((nMask >> i) & 1U) {
+            qPowers.push_back(pow2Ocl(i));
+        }
+    }
+
+    if (qPowers.size() > maxDiagonalQubits) {
+        if (!fusedDiagonal) {
+            return false;
+        }
+        FlushFusedDiagonal();
+
+        return FuseDiagonal(mask, phaseFn);
+    }
+
+    // Expand the pending table over the union of both masks, multiplying in the new gate's factors.
+    const bitCapIntOcl tableSize = pow2Ocl(qPowers.size());
+    std::vector<complex> phases(tableSize);
+    bool isIdentity = true;
+    for (bitCapIntOcl j = 0U; j < tableSize; ++j) {
+        bitCapIntOcl perm = 0U;
+        bitCapIntOcl oldJ = 0U;
+        bitLenInt oldBit = 0U;
+        for (size_t b = 0U; b < qPowers.size(); ++b) {
+            const bool isSet = (j >> b) & 1U;
+            if (isSet) {
+                perm |= qPowers[b];
+            }
+            if (fusedDiagonal && (fusedDiagonal->mask & qPowers[b])) {
+                if (isSet) {
+                    oldJ |= pow2Ocl(oldBit);
+                }
+                ++oldBit;
+            }
+        }
+
+        phases[j] = phaseFn(perm & mask);
+        if (fusedDiagonal) {
+            phases[j] *= fusedDiagonal->phases[oldJ];
+        }
+        isIdentity &= IS_SAME(phases[j], phases[0U]);
+    }
+
+    if (isIdentity && (randGlobalPhase || IS_SAME(phases[0U], ONE_CMPLX))) {
+        // The run cancelled itself out, (up to a global phase).
+        fusedDiagonal = NULL;
+
+        return true;
+    }
+
+    if (!fusedDiagonal) {
+        fusedDiagonal = std::unique_ptr<FusedDiagonal>(new FusedDiagonal());
+    }
+    fusedDiagonal->mask = nMask;
+    fusedDiagonal->qPowers = qPowers;
+    fusedDiagonal->phases = phases;
+
+    return true;
+}
+
+bool QEngineCPU::FuseDiagonal2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* mtrx, bitLenInt bitCount,
+    const bitCapIntOcl* qPowersSorted, real1_f norm_thresh)
+{
+    // Apply2x2Unfused() renormalizes single qubit gates in passing, which a buffered phase would skip, and a
+    // non-unitary "phase" would change the norm and the cached marginals.
+    if (((bitCount == 1U) && doNormalize && (runningNorm != ONE_R1)) ||
+        (abs(ONE_R1 - norm(mtrx[0U])) > FP_NORM_EPSILON) || (abs(ONE_R1 - norm(mtrx[3U])) > FP_NORM_EPSILON)) {
+        return false;
+    }
+
+    ValidateApply2x2(offset1, offset2, bitCount, qPowersSorted);
+
+    // A phase gate on the same pairs as a pending 2x2 operator still multiplies into that instead.
+    if (fused2x2 && FuseApply2x2(offset1, offset2, mtrx, bitCount, qPowersSorted, false, norm_thresh)) {
+        return true;
+    }
+
+    bitCapIntOcl mask = 0U;
+    for (bitLenInt i = 0U; i < bitCount; ++i) {
+        mask |= qPowersSorted[i];
+    }
+    const complex phase0 = mtrx[0U];
+    const complex phase1 = mtrx[3U];
+    if (!FuseDiagonal(mask, [offset1, offset2, phase0, phase1](const bitCapIntOcl& perm) {
+            return (perm == offset1) ? phase0 : ((perm == offset2) ? phase1 : ONE_CMPLX);
+        })) {
+        return false;
+    }
+    DirtyProbCache(0U);
+
+    return true;
+}
+
+void QEngineCPU::FlushFusedDiagonal()
+{
+    if (!fusedDiagonal) {
+        return;
+    }
+
+    // Release the table before applying it, so that the dispatch below does not flush it again.
+    std::shared_ptr<FusedDiagonal> toApply(fusedDiagonal.release());
+
+    CHECK_ZERO_SKIP();
+
+    QRACK_INSTRUMENT("QEngineCPU", "FlushFusedDiagonal");
+
+    DirtyProbCache(0U);
+    EnsureUniqueStateVec(true, false);
+
+    Dispatch(maxQPower, [this, toApply] {
+        const std::vector<bitCapIntOcl>& qPowers = toApply->qPowers;
+        const std::vector<complex>& phases = toApply->phases;
+        const size_t width = qPowers.size();
+        ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            bitCapIntOcl j = 0U;
+            for (size_t b = 0U; b < width; ++b) {
+                if (lcv & qPowers[b]) {
+                    j |= pow2Ocl(b);
+                }
+            }
+            stateVec->write(lcv, phases[j] * stateVec->read(lcv));
+        };
+
+        if (stateVec->is_sparse()) {
+            par_for_set(CastStateVecSparse()->iterable(), fn);
+        } else {
+            par_for(0U, maxQPowerOcl, fn);
+        }
+    });
+}
+
+namespace {
+// Apply2x2Unfused() shapes and norm modes that are compiled as separate kernels
+enum Apply2x2Shape { APPLY2X2_GENERAL = 0, APPLY2X2_DIAGONAL, APPLY2X2_ANTIDIAGONAL, APPLY2X2_SHAPES };
+enum Apply2x2NormMode { APPLY2X2_NO_NORM = 0, APPLY2X2_CALC_NORM, APPLY2X2_THRESH_NORM, APPLY2X2_NORM_MODES };
+
+struct Apply2x2Args {
+    complex* amps;
+    real1* blocks;
+    complex mtrx[4U];
+    bitCapIntOcl qPowersSorted[APPLY2X2_KERNEL_MAX_BITS];
+    bitCapIntOcl offset1;
+    bitCapIntOcl offset2;
+    real1 nrm;
+    real1 norm_thresh;
+};
+
+// (Written out, so that it inlines without the checks for infinities of std::complex multiplication.)
+inline complex MulCmplx(const complex& a, const complex& b)
+{
+    return complex(
+        (real(a) * real(b)) - (imag(a) * imag(b)), (real(a) * imag(b)) + (imag(a) * real(b)));
+}
+
+inline real1 FlushNorm(complex& amp, const real1& norm_thresh)
+{
+    const real1 nrm = (real(amp) * real(amp)) + (imag(amp) * imag(amp));
+    if (nrm < norm_thresh) {
+        amp = ZERO_CMPLX;
+        return ZERO_R1;
+    }
+
+    return nrm;
+}
+
+// Spread the bits of "i" apart, with a 0 at each of the skipped powers, (unrolled, for a fixed bit count)
+template <bitLenInt BitCount> inline bitCapIntOcl InsertZeros(bitCapIntOcl i, const bitCapIntOcl* qPowersSorted)
+{
+    for (bitLenInt p = 0U; p < BitCount; ++p) {
+        const bitCapIntOcl iLow = i & (qPowersSorted[p] - 1U);
+        i = ((i ^ iLow) << 1U) | iLow;
+    }
+
+    return i;
+}
+
+// Apply the matrix to one pair of amplitudes, returning their norm after, (if the norm mode needs it)
+template <int Shape, int NormMode> inline real1 Apply2x2Pair(complex* a1, complex* a2, const Apply2x2Args& args)
+{
+    const complex y1 = *a1;
+    const complex y2 = *a2;
+    complex r1, r2;
+    if (Shape == APPLY2X2_DIAGONAL) {
+        r1 = MulCmplx(args.mtrx[0U], y1);
+        r2 = MulCmplx(args.mtrx[3U], y2);
+    } else if (Shape == APPLY2X2_ANTIDIAGONAL) {
+        r1 = MulCmplx(args.mtrx[1U], y2);
+        r2 = MulCmplx(args.mtrx[2U], y1);
+    } else {
+        r1 = MulCmplx(args.mtrx[0U], y1) + MulCmplx(args.mtrx[1U], y2);
+        r2 = MulCmplx(args.mtrx[2U], y1) + MulCmplx(args.mtrx[3U], y2);
+    }
+
+    if (NormMode == APPLY2X2_NO_NORM) {
+        *a1 = r1;
+        *a2 = r2;
+        return ZERO_R1;
+    }
+
+    r1 = complex(args.nrm * real(r1), args.nrm * imag(r1));
+    r2 = complex(args.nrm * real(r2), args.nrm * imag(r2));
+    const real1 n = (NormMode == APPLY2X2_THRESH_NORM)
+        ? (FlushNorm(r1, args.norm_thresh) + FlushNorm(r2, args.norm_thresh))
+        : (norm(r1) + norm(r2));
+    *a1 = r1;
+    *a2 = r2;
+
+    return n;
+}
+
+/*
+ * Apply the matrix to the amplitude pairs of loop indices [begin, end), returning their norm sum. With "IsLowSkip,"
+ * the lowest skipped power is too small for long runs of contiguous indices, so every index is spread on its own,
+ * (unrolled). Otherwise, each run up to the lowest skipped power is spread once, and the loop over it vectorizes.
+ */
+template <bitLenInt BitCount, int Shape, int NormMode, bool IsLowSkip>
+real1 Apply2x2Range(const Apply2x2Args& args, bitCapIntOcl begin, bitCapIntOcl end)
+{
+    complex* amps1 = args.amps + args.offset1;
+    complex* amps2 = args.amps + args.offset2;
+    real1 nrmSqr = ZERO_R1;
+
+    if (IsLowSkip) {
+        for (bitCapIntOcl lcv = begin; lcv < end; ++lcv) {
+            const bitCapIntOcl i = InsertZeros<BitCount>(lcv, args.qPowersSorted);
+            nrmSqr += Apply2x2Pair<Shape, NormMode>(amps1 + i, amps2 + i, args);
+        }
+
+        return nrmSqr;
+    }
+
+    const bitCapIntOcl runMask = args.qPowersSorted[0U] - 1U;
+    bitCapIntOcl lcv = begin;
+    while (lcv < end) {
+        const bitCapIntOcl runEnd = std::min(end, (lcv | runMask) + 1U);
+        const bitCapIntOcl i = InsertZeros<BitCount>(lcv, args.qPowersSorted);
+        const bitCapIntOcl runLength = runEnd - lcv;
+        complex* a1 = amps1 + i;
+        complex* a2 = amps2 + i;
+        for (bitCapIntOcl j = 0U; j < runLength; ++j) {
+            nrmSqr += Apply2x2Pair<Shape, NormMode>(a1 + j, a2 + j, args);
+        }
+        lcv = runEnd;
+    }
+
+    return nrmSqr;
+}
+
+// Apply the matrix to one block of amplitude pairs of a StateVectorBlocked, (lane by lane, so it vectorizes)
+template <int Shape, int NormMode> inline real1 Apply2x2Block(real1* b1, real1* b2, const Apply2x2Args& args)
+{
+    const real1 m0r = real(args.mtrx[0U]), m0i = imag(args.mtrx[0U]);
+    const real1 m1r = real(args.mtrx[1U]), m1i = imag(args.mtrx[1U]);
+    const real1 m2r = real(args.mtrx[2U]), m2i = imag(args.mtrx[2U]);
+    const real1 m3r = real(args.mtrx[3U]), m3i = imag(args.mtrx[3U]);
+    real1* re1 = b1;
+    real1* im1 = b1 + QRACK_BLOCKED_LANES;
+    real1* re2 = b2;
+    real1* im2 = b2 + QRACK_BLOCKED_LANES;
+
+    real1 nrmSqr = ZERO_R1;
+    for (size_t k = 0U; k < QRACK_BLOCKED_LANES; ++k) {
+        const real1 xr = re1[k], xi = im1[k];
+        const real1 yr = re2[k], yi = im2[k];
+        real1 r1r, r1i, r2r, r2i;
+        if (Shape == APPLY2X2_DIAGONAL) {
+            r1r = (m0r * xr) - (m0i * xi);
+            r1i = (m0r * xi) + (m0i * xr);
+            r2r = (m3r * yr) - (m3i * yi);
+            r2i = (m3r * yi) + (m3i * yr);
+        } else if (Shape == APPLY2X2_ANTIDIAGONAL) {
+            r1r = (m1r * yr) - (m1i * yi);
+            r1i = (m1r * yi) + (m1i * yr);
+            r2r = (m2r * xr) - (m2i * xi);
+            r2i = (m2r * xi) + (m2i * xr);
+        } else {
+            r1r = (m0r * xr) - (m0i * xi) + (m1r * yr) - (m1i * yi);
+            r1i = (m0r * xi) + (m0i * xr) + (m1r * yi) + (m1i * yr);
+            r2r = (m2r * xr) - (m2i * xi) + (m3r * yr) - (m3i * yi);
+            r2i = (m2r * xi) + (m2i * xr) + (m3r * yi) + (m3i * yr);
+        }
+
+        if (NormMode != APPLY2X2_NO_NORM) {
+            r1r *= args.nrm;
+            r1i *= args.nrm;
+            r2r *= args.nrm;
+            r2i *= args.nrm;
+            real1 n1 = (r1r * r1r) + (r1i * r1i);
+            real1 n2 = (r2r * r2r) + (r2i * r2i);
+            if (NormMode == APPLY2X2_THRESH_NORM) {
+                if (n1 < args.norm_thresh) {
+                    r1r = r1i = n1 = ZERO_R1;
+                }
+                if (n2 < args.norm_thresh) {
+                    r2r = r2i = n2 = ZERO_R1;
+                }
+            }
+            nrmSqr += n1 + n2;
+        }
+
+        re1[k] = r1r;
+        im1[k] = r1i;
+        re2[k] = r2r;
+        im2[k] = r2i;
+    }
+
+    return nrmSqr;
+}
+
+/*
+ * As Apply2x2Range(), over a StateVectorBlocked. Unless "IsLowSkip," the lowest skipped power is at least a block, so
+ * every run is whole, aligned blocks, applied lane by lane. Otherwise, each pair is gathered and scattered on its own.
+ */
+template <bitLenInt BitCount, int Shape, int NormMode, bool IsLowSkip>
+real1 Apply2x2BlockedRange(const Apply2x2Args& args, bitCapIntOcl begin, bitCapIntOcl end)
+{
+    real1 nrmSqr = ZERO_R1;
+
+    if (IsLowSkip) {
+        for (bitCapIntOcl lcv = begin; lcv < end; ++lcv) {
+            const bitCapIntOcl i = InsertZeros<BitCount>(lcv, args.qPowersSorted);
+            real1* r1 = args.blocks + StateVectorBlocked::RealIndex(i | args.offset1);
+            real1* r2 = args.blocks + StateVectorBlocked::RealIndex(i | args.offset2);
+            complex a1(r1[0U], r1[QRACK_BLOCKED_LANES]);
+            complex a2(r2[0U], r2[QRACK_BLOCKED_LANES]);
+            nrmSqr += Apply2x2Pair<Shape, NormMode>(&a1, &a2, args);
+            r1[0U] = real(a1);
+            r1[QRACK_BLOCKED_LANES] = imag(a1);
+            r2[0U] = real(a2);
+            r2[QRACK_BLOCKED_LANES] = imag(a2);
+        }
+
+        return nrmSqr;
+    }
+
+    real1* blocks1 = args.blocks + ((size_t)args.offset1 << 1U);
+    real1* blocks2 = args.blocks + ((size_t)args.offset2 << 1U);
+    const bitCapIntOcl runMask = args.qPowersSorted[0U] - 1U;
+
+    bitCapIntOcl lcv = begin;
+    while (lcv < end) {
+        const bitCapIntOcl runEnd = std::min(end, (lcv | runMask) + 1U);
+        const size_t i = (size_t)InsertZeros<BitCount>(lcv, args.qPowersSorted) << 1U;
+        const size_t runLength = (size_t)(runEnd - lcv) << 1U;
+        for (size_t j = 0U; j < runLength; j += (QRACK_BLOCKED_LANES << 1U)) {
+            nrmSqr += Apply2x2Block<Shape, NormMode>(blocks1 + i + j, blocks2 + i + j, args);
+        }
+        lcv = runEnd;
+    }
+
+    return nrmSqr;
+}
+
+typedef real1 (*Apply2x2RangeFn)(const Apply2x2Args& args, bitCapIntOcl begin, bitCapIntOcl end);
+
+#define APPLY2X2_RANGE_SKIPS(b, s, n) { &Apply2x2Range<b, s, n, false>, &Apply2x2Range<b, s, n, true> }
+#define APPLY2X2_RANGE_NORMS(b, s)                                                                                     \
+    {                                                                                                                  \
+        APPLY2X2_RANGE_SKIPS(b, s, APPLY2X2_NO_NORM), APPLY2X2_RANGE_SKIPS(b, s, APPLY2X2_CALC_NORM),                  \
+            APPLY2X2_RANGE_SKIPS(b, s, APPLY2X2_THRESH_NORM)                                                           \
+    }
+#define APPLY2X2_RANGE_SHAPES(b)                                                                                       \
+    {                                                                                                                  \
+        APPLY2X2_RANGE_NORMS(b, APPLY2X2_GENERAL), APPLY2X2_RANGE_NORMS(b, APPLY2X2_DIAGONAL),                         \
+            APPLY2X2_RANGE_NORMS(b, APPLY2X2_ANTIDIAGONAL)                                                             \
+    }
+
+// Indexed by skipped bit count less 1, (so, control count,) shape, norm mode, and whether the lowest skip is low
+const Apply2x2RangeFn apply2x2Ranges[APPLY2X2_KERNEL_MAX_BITS][APPLY2X2_SHAPES][APPLY2X2_NORM_MODES][2U] = {
+    APPLY2X2_RANGE_SHAPES(1U), APPLY2X2_RANGE_SHAPES(2U), APPLY2X2_RANGE_SHAPES(3U), APPLY2X2_RANGE_SHAPES(4U)
+};
+
+#define APPLY2X2_BLOCKED_SKIPS(b, s, n)                                                                                \
+    {                                                                                                                  \
+        &Apply2x2BlockedRange<b, s, n, false>, &Apply2x2BlockedRange<b, s, n, true>                                    \
+    }
+#define APPLY2X2_BLOCKED_NORMS(b, s)                                                                                   \
+    {                                                                                                                  \
+        APPLY2X2_BLOCKED_SKIPS(b, s, APPLY2X2_NO_NORM), APPLY2X2_BLOCKED_SKIPS(b, s, APPLY2X2_CALC_NORM),              \
+            APPLY2X2_BLOCKED_SKIPS(b, s, APPLY2X2_THRESH_NORM)                                                         \
+    }
+#define APPLY2X2_BLOCKED_SHAPES(b)                                                                                     \
+    {                                                                                                                  \
+        APPLY2X2_BLOCKED_NORMS(b, APPLY2X2_GENERAL), APPLY2X2_BLOCKED_NORMS(b, APPLY2X2_DIAGONAL),                     \
+            APPLY2X2_BLOCKED_NORMS(b, APPLY2X2_ANTIDIAGONAL)                                                           \
+    }
+
+// Indexed as apply2x2Ranges, where the low skip variants are for a lowest skipped power of less than a block
+const Apply2x2RangeFn apply2x2BlockedRanges[APPLY2X2_KERNEL_MAX_BITS][APPLY2X2_SHAPES][APPLY2X2_NORM_MODES][2U] = {
+    APPLY2X2_BLOCKED_SHAPES(1U), APPLY2X2_BLOCKED_SHAPES(2U), APPLY2X2_BLOCKED_SHAPES(3U), APPLY2X2_BLOCKED_SHAPES(4U)
+};
+} // namespace
+
+bool QEngineCPU::Apply2x2Kernel(complex const* mtrx, const std::vector<bitCapIntOcl>& qPowersSorted,
+    bitCapIntOcl offset1, bitCapIntOcl offset2, bool doCalcNorm, real1 nrm, real1 norm_thresh, real1& nrmSqr)
+{
+    const bitLenInt bitCount = (bitLenInt)qPowersSorted.size();
+    if (!bitCount || (bitCount > APPLY2X2_KERNEL_MAX_BITS) || stateVec->is_sparse()) {
+        return false;
+    }
+
+    // (Half precision storage widens amplitudes one at a time, instead.)
+    StateVectorArray* sva = dynamic_cast<StateVectorArray*>(stateVec.get());
+    StateVectorBlocked* svb = sva ? NULL : dynamic_cast<StateVectorBlocked*>(stateVec.get());
+    if (!sva && !svb) {
+        return false;
+    }
+
+    Apply2x2Args args;
+    args.amps = sva ? sva->amplitudes.get() : NULL;
+    args.blocks = svb ? svb->blocks() : NULL;
+    std::copy(mtrx, mtrx + 4U, args.mtrx);
+    std::copy(qPowersSorted.begin(), qPowersSorted.end(), args.qPowersSorted);
+    args.offset1 = offset1;
+    args.offset2 = offset2;
+    args.nrm = nrm;
+    args.norm_thresh = norm_thresh;
+
+    const int shape = (IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U]))
+        ? APPLY2X2_DIAGONAL
+        : ((IS_NORM_0(mtrx[0U]) && IS_NORM_0(mtrx[3U])) ? APPLY2X2_ANTIDIAGONAL : APPLY2X2_GENERAL);
+    const int normMode =
+        doCalcNorm ? ((norm_thresh > ZERO_R1) ? APPLY2X2_THRESH_NORM : APPLY2X2_CALC_NORM) : APPLY2X2_NO_NORM;
+    const bool isLowSkip = qPowersSorted[0U] < APPLY2X2_KERNEL_MIN_RUN;
+    // (Blocked runs must be whole blocks, starting from stride boundaries that are whole blocks.)
+    const bool isBlockedLowSkip = (qPowersSorted[0U] < QRACK_BLOCKED_LANES) || (GetStride() % QRACK_BLOCKED_LANES);
+    const Apply2x2RangeFn fn = svb ? apply2x2BlockedRanges[bitCount - 1U][shape][normMode][isBlockedLowSkip ? 1U : 0U]
+                                   : apply2x2Ranges[bitCount - 1U][shape][normMode][isLowSkip ? 1U : 0U];
+
+    const unsigned numCores = GetConcurrencyLevel();
+    std::unique_ptr<real1[]> rngNrm(new real1[numCores]());
+    par_for_range(0U, maxQPowerOcl >> bitCount,
+        [&](const bitCapIntOcl& begin, const bitCapIntOcl& end, const unsigned& cpu) {
+            rngNrm[cpu] += fn(args, begin, end);
+        });
+
+    nrmSqr = ZERO_R1;
+    for (unsigned i = 0U; i < numCores; ++i) {
+        nrmSqr += rngNrm[i];
+    }
+
+    return true;
+}
+
 /**
  * Apply a 2x2 matrix to the state vector
  *
@@ -348,27 +992,12 @@ void QEngineCPU::GetProbs(real1* outputProbs)
         stateVec->write2(lcv + offset1, qubit.c[0U], lcv + offset2, qubit.c[1U]);                                      \
     };
 
-void QEngineCPU::Apply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* matrix, const bitLenInt bitCount,
-    const bitCapIntOcl* qPowsSorted, bool doCalcNorm, real1_f nrm_thresh)
+void QEngineCPU::Apply2x2Unfused(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* matrix,
+    const bitLenInt bitCount, const bitCapIntOcl* qPowsSorted, bool doCalcNorm, real1_f nrm_thresh)
 {
+    QRACK_INSTRUMENT("QEngineCPU", "Apply2x2");
     CHECK_ZERO_SKIP();
 
-    if ((offset1 >= maxQPowerOcl) || (offset2 >= maxQPowerOcl)) {
-        throw std::invalid_argument(
-            "QEngineCPU::Apply2x2 offset1 and offset2 parameters must be within allocated qubit bounds!");
-    }
-
-    for (bitLenInt i = 0U; i < bitCount; ++i) {
-        if (qPowsSorted[i] >= maxQPowerOcl) {
-            throw std::invalid_argument(
-                "QEngineCPU::Apply2x2 parameter qPowsSorted array values must be within allocated qubit bounds!");
-        }
-        if (i && (qPowsSorted[i - 1U] == qPowsSorted[i])) {
-            throw std::invalid_argument("QEngineCPU::Apply2x2 parameter qPowSorted array values cannot be "
-                                        "duplicated (for control and target qubits)!");
-        }
-    }
-
     std::shared_ptr<complex> mtrxS(new complex[4U], std::default_delete<complex[]>());
     std::copy(matrix, matrix + 4U, mtrxS.get());
 
@@ -384,11 +1013,35 @@ void QEngineCPU::Apply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex co
         runningNorm = ONE_R1;
     }
 
+    DirtyProbCache2x2(offset1, offset2, matrix, bitCount, doApplyNorm && (nrm != ONE_R1));
+    EnsureUniqueStateVec(true, false);
+
     Dispatch(maxQPower >> bitCount,
         [this, mtrxS, qPowersSorted, offset1, offset2, bitCount, doCalcNorm, doApplyNorm, nrm, nrm_thresh] {
             complex* mtrx = mtrxS.get();
 
+            if (!doCalcNorm && Apply2x2Simd(mtrx, qPowersSorted, offset1, offset2)) {
+                if (doApplyNorm) {
+                    runningNorm = ONE_R1;
+                }
+                return;
+            }
+
             const real1_f norm_thresh = (nrm_thresh < ZERO_R1) ? amplitudeFloor : nrm_thresh;
+
+            real1 nrmSqr;
+            if (Apply2x2Kernel(mtrx, qPowersSorted, offset1, offset2, doCalcNorm, nrm, (real1)norm_thresh, nrmSqr)) {
+                if (doApplyNorm) {
+                    runningNorm = ONE_R1;
+                }
+                if (doCalcNorm) {
+                    runningNorm = nrmSqr;
+                    if (runningNorm <= FP_NORM_EPSILON) {
+                        ZeroAmplitudes();
+                    }
+                }
+                return;
+            }
             const unsigned numCores = GetConcurrencyLevel();
 
             const complex2 mtrxCol1(mtrx[0U], mtrx[2U]);
@@ -533,27 +1186,12 @@ void QEngineCPU::Apply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex co
         stateVec->write2(lcv + offset1, qubit[0U], lcv + offset2, qubit[1U]);                                          \
     };
 
-void QEngineCPU::Apply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* matrix, const bitLenInt bitCount,
-    const bitCapIntOcl* qPowsSorted, bool doCalcNorm, real1_f nrm_thresh)
+void QEngineCPU::Apply2x2Unfused(bitCapIntOcl offset1, bitCapIntOcl offset2, complex const* matrix,
+    const bitLenInt bitCount, const bitCapIntOcl* qPowsSorted, bool doCalcNorm, real1_f nrm_thresh)
 {
+    QRACK_INSTRUMENT("QEngineCPU", "Apply2x2");
     CHECK_ZERO_SKIP();
 
-    if ((offset1 >= maxQPowerOcl) || (offset2 >= maxQPowerOcl)) {
-        throw std::invalid_argument(
-            "QEngineCPU::Apply2x2 offset1 and offset2 parameters must be within allocated qubit bounds!");
-    }
-
-    for (bitLenInt i = 0U; i < bitCount; ++i) {
-        if (qPowsSorted[i] >= maxQPowerOcl) {
-            throw std::invalid_argument(
-                "QEngineCPU::Apply2x2 parameter qPowsSorted array values must be within allocated qubit bounds!");
-        }
-        if (i && (qPowsSorted[i - 1U] == qPowsSorted[i])) {
-            throw std::invalid_argument("QEngineCPU::Apply2x2 parameter qPowsSorted array values cannot be "
-                                        "duplicated (for control and target qubits)!");
-        }
-    }
-
     std::shared_ptr<complex> mtrxS(new complex[4U], std::default_delete<complex[]>());
     std::copy(matrix, matrix + 4U, mtrxS.get());
 
@@ -569,15 +1207,39 @@ void QEngineCPU::Apply2x2(bitCapIntOcl offset1, bitCapIntOcl offset2, complex co
         runningNorm = ONE_R1;
     }
 
+    DirtyProbCache2x2(offset1, offset2, matrix, bitCount, doApplyNorm && (nrm != ONE_R1));
+    EnsureUniqueStateVec(true, false);
+
     Dispatch(maxQPower >> bitCount,
         [this, mtrxS, qPowersSorted, offset1, offset2, bitCount, doCalcNorm, doApplyNorm, nrm, nrm_thresh] {
             complex* mtrx = mtrxS.get();
+
+            if (!doCalcNorm && Apply2x2Simd(mtrx, qPowersSorted, offset1, offset2)) {
+                if (doApplyNorm) {
+                    runningNorm = ONE_R1;
+                }
+                return;
+            }
             const complex mtrx0 = mtrx[0U];
             const complex mtrx1 = mtrx[1U];
             const complex mtrx2 = mtrx[2U];
             const complex mtrx3 = mtrx[3U];
 
             const real1 norm_thresh = (nrm_thresh < ZERO_R1) ? amplitudeFloor : (real1)nrm_thresh;
+
+            real1 nrmSqr;
+            if (Apply2x2Kernel(mtrx, qPowersSorted, offset1, offset2, doCalcNorm, nrm, (real1)norm_thresh, nrmSqr)) {
+                if (doApplyNorm) {
+                    runningNorm = ONE_R1;
+                }
+                if (doCalcNorm) {
+                    runningNorm = nrmSqr;
+                    if (runningNorm <= FP_NORM_EPSILON) {
+                        ZeroAmplitudes();
+                    }
+                }
+                return;
+            }
             const unsigned numCores = GetConcurrencyLevel();
 
             std::unique_ptr<real1[]> rngNrm(new real1[numCores]());
@@ -698,6 +1360,9 @@ void QEngineCPU::XMask(bitCapInt mask)
         return;
     }
 
+    FlipProbCache((bitCapIntOcl)mask);
+    EnsureUniqueStateVec(true, false);
+
     Dispatch(maxQPower, [this, mask] {
         const bitCapIntOcl maskOcl = (bitCapIntOcl)mask;
         const bitCapIntOcl otherMask = (maxQPowerOcl - ONE_BCI) ^ maskOcl;
@@ -734,9 +1399,22 @@ void QEngineCPU::PhaseParity(real1_f radians, bitCapInt mask)
         return;
     }
 
+    const complex phaseFac = std::polar(ONE_R1, (real1)(radians / 2));
+    const complex iPhaseFac = ONE_CMPLX / phaseFac;
+
     if (!(mask & (mask - ONE_BCI))) {
-        const complex phaseFac = std::polar(ONE_R1, (real1)(radians / 2));
-        Phase(ONE_CMPLX / phaseFac, phaseFac, log2(mask));
+        Phase(iPhaseFac, phaseFac, log2(mask));
+        return;
+    }
+
+    if (FuseDiagonal((bitCapIntOcl)mask, [phaseFac, iPhaseFac](const bitCapIntOcl& perm) {
+            bool isOdd = false;
+            for (bitCapIntOcl v = perm; v; v &= v - 1U) {
+                isOdd = !isOdd;
+            }
+            return isOdd ? phaseFac : iPhaseFac;
+        })) {
+        DirtyProbCache(0U);
         return;
     }
 
@@ -745,6 +1423,9 @@ void QEngineCPU::PhaseParity(real1_f radians, bitCapInt mask)
         return;
     }
 
+    DirtyProbCache(0U);
+    EnsureUniqueStateVec(true, false);
+
     Dispatch(maxQPower, [this, mask, radians] {
         const bitCapIntOcl parityStartSize = 4U * sizeof(bitCapIntOcl);
         const complex phaseFac = std::polar(ONE_R1, (real1)(radians / 2));
@@ -770,6 +1451,107 @@ void QEngineCPU::PhaseParity(real1_f radians, bitCapInt mask)
     });
 }
 
+/// Mark each permutation of a lookup table's index register whose entry, (as for IndexedLDA(),) equals "target"
+static std::vector<bool> LookupMarks(
+    bitLenInt indexLength, bitLenInt valueLength, const unsigned char* values, bitCapInt target)
+{
+    const bitLenInt valueBytes = (valueLength + 7U) / 8U;
+    std::vector<bool> marks(pow2Ocl(indexLength));
+    for (bitCapIntOcl i = 0U; i < marks.size(); ++i) {
+        bitCapIntOcl entry = 0U;
+        for (bitLenInt j = 0U; j < valueBytes; ++j) {
+            entry |= (bitCapIntOcl)values[i * valueBytes + j] << (8U * j);
+        }
+        marks[i] = ((bitCapInt)entry == target);
+    }
+
+    return marks;
+}
+
+void QEngineCPU::PhaseFlipIfLookup(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+    const unsigned char* values, bitCapInt target)
+{
+    if (isBadBitRange(indexStart, indexLength, qubitCount)) {
+        throw std::invalid_argument("QEngineCPU::PhaseFlipIfLookup range is out-of-bounds!");
+    }
+
+    CHECK_ZERO_SKIP();
+
+    if (stateVec->is_sparse()) {
+        QInterface::PhaseFlipIfLookup(indexStart, indexLength, valueLength, values, target);
+        return;
+    }
+
+    const std::vector<bool> marks = LookupMarks(indexLength, valueLength, values, target);
+
+    // (The oracle is diagonal, so a small enough index register joins any pending diagonal table.)
+    const DiagonalFn phaseFn = [&marks, indexStart](const bitCapIntOcl& perm) {
+        return marks[perm >> indexStart] ? -ONE_CMPLX : ONE_CMPLX;
+    };
+    if (FuseDiagonal(bitRegMaskOcl(indexStart, indexLength), phaseFn)) {
+        DirtyProbCache(0U);
+        return;
+    }
+
+    DirtyProbCache(0U);
+    EnsureUniqueStateVec(true, false);
+
+    Dispatch(maxQPower, [this, marks, indexStart, indexLength] {
+        const bitCapIntOcl indexMask = bitRegMaskOcl(indexStart, indexLength);
+        par_for(0U, maxQPowerOcl, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            if (marks[(lcv & indexMask) >> indexStart]) {
+                stateVec->write(lcv, -stateVec->read(lcv));
+            }
+        });
+    });
+}
+
+void QEngineCPU::GroverLookupIteration(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+    const unsigned char* values, bitCapInt target)
+{
+    if (isBadBitRange(indexStart, indexLength, qubitCount)) {
+        throw std::invalid_argument("QEngineCPU::GroverLookupIteration range is out-of-bounds!");
+    }
+
+    CHECK_ZERO_SKIP();
+
+    if (stateVec->is_sparse() || !indexLength) {
+        QInterface::GroverLookupIteration(indexStart, indexLength, valueLength, values, target);
+        return;
+    }
+
+    const std::vector<bool> marks = LookupMarks(indexLength, valueLength, values, target);
+
+    DirtyProbCache();
+    EnsureUniqueStateVec();
+
+    // Diffusion is I - 2|s><s| on the index register, (H ZeroPhaseFlip H,) so each amplitude, after the oracle, loses
+    // twice the mean over its index permutations. Each work item owns one permutation of the other qubits, and makes
+    // two passes over its index permutations, the first for the mean, and the second to apply both operators.
+    Dispatch(maxQPower, [this, marks, indexStart, indexLength] {
+        const bitCapIntOcl indexPower = pow2Ocl(indexLength);
+        const bitCapIntOcl lowMask = pow2MaskOcl(indexStart);
+        const real1 twoOverPower = (real1)2 / (real1)indexPower;
+        par_for(0U, maxQPowerOcl >> indexLength, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            const bitCapIntOcl iLow = lcv & lowMask;
+            const bitCapIntOcl otherRes = iLow | ((lcv ^ iLow) << indexLength);
+
+            complex sum = ZERO_CMPLX;
+            for (bitCapIntOcl x = 0U; x < indexPower; ++x) {
+                const complex amp = stateVec->read(otherRes | (x << indexStart));
+                sum += marks[x] ? -amp : amp;
+            }
+            const complex twoMean = twoOverPower * sum;
+
+            for (bitCapIntOcl x = 0U; x < indexPower; ++x) {
+                const bitCapIntOcl i = otherRes | (x << indexStart);
+                const complex amp = stateVec->read(i);
+                stateVec->write(i, (marks[x] ? -amp : amp) - twoMean);
+            }
+        });
+    });
+}
+
 void QEngineCPU::UniformlyControlledSingleBit(const std::vector<bitLenInt>& controls, bitLenInt qubitIndex,
     complex const* mtrxs, const std::vector<bitCapInt>& mtrxSkipPowers, bitCapInt mtrxSkipValueMask)
 {
@@ -807,6 +1589,7 @@ void QEngineCPU::UniformlyControlledSingleBit(const std::vector<bitLenInt>& cont
     std::unique_ptr<real1[]> rngNrm(new real1[numCores]());
 
     Finish();
+    EnsureUniqueStateVec();
 
     par_for_skip(0U, maxQPowerOcl, targetPower, 1U, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
         bitCapIntOcl offset = 0U;
@@ -834,18 +1617,271 @@ void QEngineCPU::UniformlyControlledSingleBit(const std::vector<bitLenInt>& cont
         const complex Y0 = stateVec->read(lcv);
         qubit[1U] = stateVec->read(lcv | targetPower);
 
-        qubit[0U] = nrm * ((mtrxs[0U + offset] * Y0) + (mtrxs[1U + offset] * qubit[1U]));
-        qubit[1U] = nrm * ((mtrxs[2U + offset] * Y0) + (mtrxs[3U + offset] * qubit[1U]));
+        qubit[0U] = nrm * ((mtrxs[0U + offset] * Y0) + (mtrxs[1U + offset] * qubit[1U]));
+        qubit[1U] = nrm * ((mtrxs[2U + offset] * Y0) + (mtrxs[3U + offset] * qubit[1U]));
+
+        rngNrm[cpu] += norm(qubit[0U]) + norm(qubit[1U]);
+
+        stateVec->write2(lcv, qubit[0U], lcv | targetPower, qubit[1U]);
+    });
+
+    runningNorm = ZERO_R1;
+    for (unsigned i = 0U; i < numCores; ++i) {
+        runningNorm += rngNrm[i];
+    }
+}
+
+void QEngineCPU::MtrxN(complex const* mtrx, const std::vector<bitLenInt>& targets)
+{
+    if (!targets.size() || (targets.size() > QRACK_MAX_MTRXN_QB)) {
+        throw std::invalid_argument("QEngineCPU::MtrxN target count must be between 1 and QRACK_MAX_MTRXN_QB!");
+    }
+
+    ThrowIfQbIdArrayIsBad(targets, qubitCount, "QEngineCPU::MtrxN target is out-of-bounds!");
+
+    if (targets.size() == 1U) {
+        Mtrx(mtrx, targets[0U]);
+        return;
+    }
+
+    CHECK_ZERO_SKIP();
+
+    const bitLenInt targetCount = (bitLenInt)targets.size();
+    const bitCapIntOcl dim = pow2Ocl(targetCount);
+
+    std::vector<bitCapIntOcl> qPowersSorted(targetCount);
+    for (bitLenInt i = 0U; i < targetCount; ++i) {
+        qPowersSorted[i] = pow2Ocl(targets[i]);
+    }
+    std::sort(qPowersSorted.begin(), qPowersSorted.end());
+
+    // "offsets[j]" is the state vector index offset of matrix row (or column) "j," from the "pushed apart" base index.
+    std::vector<bitCapIntOcl> offsets(dim);
+    for (bitCapIntOcl j = 0U; j < dim; ++j) {
+        bitCapIntOcl offset = 0U;
+        for (bitLenInt i = 0U; i < targetCount; ++i) {
+            if ((j >> i) & 1U) {
+                offset |= pow2Ocl(targets[i]);
+            }
+        }
+        offsets[j] = offset;
+    }
+
+    std::shared_ptr<complex> mtrxS(new complex[dim * dim], std::default_delete<complex[]>());
+    std::copy(mtrx, mtrx + dim * dim, mtrxS.get());
+
+    EnsureUniqueStateVec();
+
+    Dispatch(maxQPowerOcl >> targetCount, [this, mtrxS, qPowersSorted, offsets, dim] {
+        complex const* m = mtrxS.get();
+        par_for_mask(0U, maxQPowerOcl, qPowersSorted, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            complex amps[ONE_BCI << QRACK_MAX_MTRXN_QB];
+            for (bitCapIntOcl j = 0U; j < dim; ++j) {
+                amps[j] = stateVec->read(lcv | offsets[j]);
+            }
+            for (bitCapIntOcl j = 0U; j < dim; ++j) {
+                complex const* row = m + j * dim;
+                complex amp = ZERO_CMPLX;
+                for (bitCapIntOcl k = 0U; k < dim; ++k) {
+                    amp += row[k] * amps[k];
+                }
+                stateVec->write(lcv | offsets[j], amp);
+            }
+        });
+    });
+
+    if (doNormalize) {
+        UpdateRunningNorm();
+    }
+}
+
+void QEngineCPU::QFT(bitLenInt start, bitLenInt length, bool trySeparate)
+{
+    std::vector<bitLenInt> qubits(length);
+    for (bitLenInt i = 0U; i < length; ++i) {
+        qubits[i] = start + i;
+    }
+    FourierTransform(qubits, false);
+}
+
+void QEngineCPU::QFTR(const std::vector<bitLenInt>& qubits, bool trySeparate) { FourierTransform(qubits, false); }
+
+void QEngineCPU::IQFT(bitLenInt start, bitLenInt length, bool trySeparate)
+{
+    std::vector<bitLenInt> qubits(length);
+    for (bitLenInt i = 0U; i < length; ++i) {
+        qubits[i] = start + i;
+    }
+    FourierTransform(qubits, true);
+}
+
+void QEngineCPU::IQFTR(const std::vector<bitLenInt>& qubits, bool trySeparate) { FourierTransform(qubits, true); }
+
+void QEngineCPU::FourierTransform(const std::vector<bitLenInt>& qubits, bool isInverse)
+{
+    if (!qubits.size()) {
+        return;
+    }
+
+    ThrowIfQbIdArrayIsBad(qubits, qubitCount, "QEngineCPU QFT qubit is out-of-bounds!");
+
+    if (qubits.size() == 1U) {
+        H(qubits[0U]);
+        return;
+    }
+
+    CHECK_ZERO_SKIP();
+
+    if (stateVec->is_sparse()) {
+        if (isInverse) {
+            QInterface::IQFTR(qubits);
+        } else {
+            QInterface::QFTR(qubits);
+        }
+        return;
+    }
+
+    // With register index j, (qubits[0] low,) QFT() is the DFT with e^(-2 * pi * i * j * k / 2^length), written in
+    // bit-reversed order, which is exactly the output of an in-place decimation-in-frequency FFT. IQFT() is its
+    // inverse: bit-reversed input, decimation-in-time, with e^(+2 * pi * i * j * k / 2^length).
+    const bitLenInt length = (bitLenInt)qubits.size();
+    const bitCapIntOcl dim = pow2Ocl(length);
+    const bitLenInt blockBits = (length < QRACK_FFT_BLOCK_QB) ? length : (bitLenInt)QRACK_FFT_BLOCK_QB;
+    const bitCapIntOcl blockDim = pow2Ocl(blockBits);
+
+    std::vector<bitCapIntOcl> qPowersSorted(length);
+    for (bitLenInt i = 0U; i < length; ++i) {
+        qPowersSorted[i] = pow2Ocl(qubits[i]);
+    }
+    std::sort(qPowersSorted.begin(), qPowersSorted.end());
+
+    // The state vector offset of register index j is highOffsets[j >> blockBits] | lowOffsets[j & (blockDim - 1)].
+    const auto offsetOf = [&qubits](bitCapIntOcl j, bitLenInt shift) -> bitCapIntOcl {
+        bitCapIntOcl offset = 0U;
+        for (bitLenInt i = 0U; (i + shift) < qubits.size(); ++i) {
+            if ((j >> i) & 1U) {
+                offset |= pow2Ocl(qubits[i + shift]);
+            }
+        }
+        return offset;
+    };
+    std::vector<bitCapIntOcl> lowOffsets(blockDim);
+    for (bitCapIntOcl j = 0U; j < blockDim; ++j) {
+        lowOffsets[j] = offsetOf(j, 0U);
+    }
+    std::vector<bitCapIntOcl> highOffsets(dim >> blockBits);
+    for (bitCapIntOcl j = 0U; j < highOffsets.size(); ++j) {
+        highOffsets[j] = offsetOf(j, blockBits);
+    }
+
+    // Twiddle factor k < 2^(length - 1) is twLo[k & (2^loBits - 1)] * twHi[k >> loBits], to keep the tables small.
+    const bitLenInt loBits = length >> 1U;
+    const real1_f angle = (isInverse ? 2 : -2) * (real1_f)PI_R1 / (real1_f)dim;
+    std::vector<complex> twLo(pow2Ocl(loBits));
+    for (bitCapIntOcl k = 0U; k < twLo.size(); ++k) {
+        twLo[k] = std::polar(ONE_R1, (real1)(angle * k));
+    }
+    std::vector<complex> twHi(pow2Ocl((length - 1U) - loBits));
+    for (bitCapIntOcl k = 0U; k < twHi.size(); ++k) {
+        twHi[k] = std::polar(ONE_R1, (real1)(angle * (k << loBits)));
+    }
+
+    bitCapIntOcl regMask = 0U;
+    for (const bitCapIntOcl& qPower : qPowersSorted) {
+        regMask |= qPower;
+    }
+    DirtyProbCache(regMask);
+    EnsureUniqueStateVec(true, false);
+
+    Dispatch(maxQPowerOcl,
+        [this, isInverse, length, dim, blockBits, blockDim, qPowersSorted, lowOffsets, highOffsets, loBits, twLo,
+            twHi] {
+            const bitCapIntOcl loMask = pow2Ocl(loBits) - 1U;
+            const real1 nrm = SQRT1_2_R1;
+
+            // The butterfly of stage "s," on register indices j and j | 2^s, where "pos" is j mod 2^s
+            const auto butterfly = [&](complex& a, complex& b, bitCapIntOcl pos, bitLenInt s) {
+                const bitCapIntOcl k = pos << ((length - 1U) - s);
+                const complex w = twLo[k & loMask] * twHi[k >> loBits];
+                if (isInverse) {
+                    const complex t = w * b;
+                    b = nrm * (a - t);
+                    a = nrm * (a + t);
+                } else {
+                    const complex d = a - b;
+                    a = nrm * (a + b);
+                    b = nrm * w * d;
+                }
+            };
+
+            // The stages below blockBits act within each block of 2^blockBits register indices, which is copied out
+            // once, transformed in cache, and copied back.
+            const unsigned numCores = GetConcurrencyLevel();
+            std::unique_ptr<complex[]> scratch(new complex[numCores * blockDim]);
+            const auto blockPass = [&](bitCapIntOcl base, const unsigned& cpu) {
+                complex* buf = scratch.get() + cpu * blockDim;
+                for (bitCapIntOcl j = 0U; j < blockDim; ++j) {
+                    buf[j] = stateVec->read(base | lowOffsets[j]);
+                }
+                for (bitLenInt i = 0U; i < blockBits; ++i) {
+                    const bitLenInt s = isInverse ? i : (blockBits - (i + 1U));
+                    const bitCapIntOcl h = pow2Ocl(s);
+                    for (bitCapIntOcl k = 0U; k < (blockDim >> 1U); ++k) {
+                        const bitCapIntOcl pos = k & (h - 1U);
+                        const bitCapIntOcl j = ((k ^ pos) << 1U) | pos;
+                        butterfly(buf[j], buf[j | h], pos, s);
+                    }
+                }
+                for (bitCapIntOcl j = 0U; j < blockDim; ++j) {
+                    stateVec->write(base | lowOffsets[j], buf[j]);
+                }
+            };
+
+            if (dim == blockDim) {
+                par_for_mask(0U, maxQPowerOcl, qPowersSorted,
+                    [&](const bitCapIntOcl& lcv, const unsigned& cpu) { blockPass(lcv, cpu); });
+                return;
+            }
 
-        rngNrm[cpu] += norm(qubit[0U]) + norm(qubit[1U]);
+            // Each stage at or above blockBits is one parallel pass over the register.
+            const auto widePass = [&](bitCapIntOcl base, bitLenInt s) {
+                const bitCapIntOcl h = pow2Ocl(s);
+                par_for(0U, dim >> 1U, [&](const bitCapIntOcl& k, const unsigned& cpu) {
+                    const bitCapIntOcl pos = k & (h - 1U);
+                    const bitCapIntOcl j0 = ((k ^ pos) << 1U) | pos;
+                    const bitCapIntOcl j1 = j0 | h;
+                    const bitCapIntOcl i0 = base | highOffsets[j0 >> blockBits] | lowOffsets[j0 & (blockDim - 1U)];
+                    const bitCapIntOcl i1 = base | highOffsets[j1 >> blockBits] | lowOffsets[j1 & (blockDim - 1U)];
+                    complex a = stateVec->read(i0);
+                    complex b = stateVec->read(i1);
+                    butterfly(a, b, pos, s);
+                    stateVec->write2(i0, a, i1, b);
+                });
+            };
 
-        stateVec->write2(lcv, qubit[0U], lcv | targetPower, qubit[1U]);
-    });
+            const bitCapIntOcl outerCount = maxQPowerOcl >> length;
+            for (bitCapIntOcl o = 0U; o < outerCount; ++o) {
+                bitCapIntOcl base = o;
+                for (size_t p = 0U; p < qPowersSorted.size(); ++p) {
+                    const bitCapIntOcl iLow = base & (qPowersSorted[p] - 1U);
+                    base = ((base ^ iLow) << 1U) | iLow;
+                }
 
-    runningNorm = ZERO_R1;
-    for (unsigned i = 0U; i < numCores; ++i) {
-        runningNorm += rngNrm[i];
-    }
+                if (!isInverse) {
+                    for (bitLenInt s = length; s > blockBits; --s) {
+                        widePass(base, s - 1U);
+                    }
+                }
+                par_for(0U, dim >> blockBits, [&](const bitCapIntOcl& hi, const unsigned& cpu) {
+                    blockPass(base | highOffsets[hi], cpu);
+                });
+                if (isInverse) {
+                    for (bitLenInt s = blockBits; s < length; ++s) {
+                        widePass(base, s);
+                    }
+                }
+            }
+        });
 }
 
 void QEngineCPU::UniformParityRZ(bitCapInt mask, real1_f angle)
@@ -856,6 +1892,22 @@ void QEngineCPU::UniformParityRZ(bitCapInt mask, real1_f angle)
 
     CHECK_ZERO_SKIP();
 
+    DirtyProbCache(0U);
+
+    const complex phaseFac((real1)cos(angle), (real1)sin(angle));
+    const complex phaseFacAdj = std::conj(phaseFac);
+    if (FuseDiagonal((bitCapIntOcl)mask, [phaseFac, phaseFacAdj](const bitCapIntOcl& perm) {
+            bool isOdd = false;
+            for (bitCapIntOcl v = perm; v; v &= v - 1U) {
+                isOdd = !isOdd;
+            }
+            return isOdd ? phaseFac : phaseFacAdj;
+        })) {
+        return;
+    }
+
+    EnsureUniqueStateVec(true, false);
+
     Dispatch(maxQPower, [this, mask, angle] {
         const real1 cosine = (real1)cos(angle);
         const real1 sine = (real1)sin(angle);
@@ -898,6 +1950,30 @@ void QEngineCPU::CUniformParityRZ(const std::vector<bitLenInt>& cControls, bitCa
     std::vector<bitLenInt> controls(cControls.begin(), cControls.end());
     std::sort(controls.begin(), controls.end());
 
+    DirtyProbCache(0U);
+
+    bitCapIntOcl cMask = 0U;
+    for (const bitLenInt& c : controls) {
+        cMask |= pow2Ocl(c);
+    }
+    const complex phaseFac((real1)cos(angle), (real1)sin(angle));
+    const complex phaseFacAdj = std::conj(phaseFac);
+    const bitCapIntOcl pMask = (bitCapIntOcl)mask;
+    if (FuseDiagonal(cMask | pMask, [cMask, pMask, phaseFac, phaseFacAdj](const bitCapIntOcl& perm) {
+            if ((perm & cMask) != cMask) {
+                return ONE_CMPLX;
+            }
+            bool isOdd = false;
+            for (bitCapIntOcl v = perm & pMask; v; v &= v - 1U) {
+                isOdd = !isOdd;
+            }
+            return isOdd ? phaseFac : phaseFacAdj;
+        })) {
+        return;
+    }
+
+    EnsureUniqueStateVec(true, false);
+
     Dispatch(maxQPower >> cControls.size(), [this, controls, mask, angle] {
         bitCapIntOcl controlMask = 0U;
         std::vector<bitCapIntOcl> controlPowers(controls.size());
@@ -953,7 +2029,7 @@ bitLenInt QEngineCPU::Compose(QEngineCPUPtr toCopy)
         toCopy->Finish();
         runningNorm = toCopy->runningNorm;
         if (toCopy->stateVec) {
-            stateVec = AllocStateVec(toCopy->maxQPowerOcl);
+            ResetStateVec(AllocStateVec(toCopy->maxQPowerOcl));
             stateVec->copy(toCopy->stateVec);
         }
 
@@ -1076,49 +2152,85 @@ bitLenInt QEngineCPU::Compose(QEngineCPUPtr toCopy, bitLenInt start)
  * index of this one. (If the programmer doesn't want to "cheat," it is left up
  * to them to delete the old unit that was added.
  *
+ * The full tensor product is written in one pass, from every source at once, rather than composing pairwise.
+ *
  * Returns a mapping of the index into the new QEngine that each old one was mapped to.
  */
 std::map<QInterfacePtr, bitLenInt> QEngineCPU::Compose(std::vector<QInterfacePtr> toCopy)
 {
-    const bitLenInt toComposeCount = toCopy.size();
-    bitLenInt nQubitCount = qubitCount;
     std::map<QInterfacePtr, bitLenInt> ret;
-    std::vector<bitLenInt> offset(toComposeCount);
-    std::vector<bitCapIntOcl> mask(toComposeCount);
+    std::vector<QEngineCPUPtr> srcs;
+    std::vector<bitLenInt> offset;
+    std::vector<bitCapIntOcl> mask;
+    bitLenInt nQubitCount = qubitCount;
+    bool isZero = !stateVec;
 
-    const bitCapIntOcl startMask = maxQPowerOcl - ONE_BCI;
+    for (size_t i = 0U; i < toCopy.size(); ++i) {
+        QEngineCPUPtr src = std::dynamic_pointer_cast<QEngineCPU>(toCopy[i]);
+        ret[toCopy[i]] = nQubitCount;
+        if (!src->qubitCount) {
+            continue;
+        }
+        src->Finish();
+        isZero |= !src->stateVec;
+        srcs.push_back(src);
+        mask.push_back((src->maxQPowerOcl - ONE_BCI) << (bitCapIntOcl)nQubitCount);
+        offset.push_back(nQubitCount);
+        nQubitCount += src->qubitCount;
+    }
+
+    if (nQubitCount > maxQubits) {
+        throw std::invalid_argument(
+            "Cannot instantiate a QEngineCPU with greater capacity than environment variable QRACK_MAX_CPU_QB.");
+    }
+
+    if (srcs.size() < 2U) {
+        // Nothing to fuse
+        if (srcs.size()) {
+            Compose(srcs[0U]);
+        }
+        return ret;
+    }
+
+    if (isZero) {
+        // Compose will have a wider but 0 stateVec
+        ZeroAmplitudes();
+        SetQubitCount(nQubitCount);
+        return ret;
+    }
 
     if (doNormalize) {
         NormalizeState();
     }
     Finish();
 
-    for (bitLenInt i = 0U; i < toComposeCount; ++i) {
-        QEngineCPUPtr src = std::dynamic_pointer_cast<Qrack::QEngineCPU>(toCopy[i]);
+    for (const QEngineCPUPtr& src : srcs) {
         if (src->doNormalize) {
             src->NormalizeState();
         }
         src->Finish();
-        mask[i] = (src->maxQPowerOcl - ONE_BCI) << (bitCapIntOcl)nQubitCount;
-        offset[i] = nQubitCount;
-        ret[toCopy[i]] = nQubitCount;
-        nQubitCount += src->GetQubitCount();
+        src->stateVec->isReadLocked = false;
     }
 
+    const bitCapIntOcl startMask = maxQPowerOcl - ONE_BCI;
     const bitCapIntOcl nMaxQPower = pow2Ocl(nQubitCount);
+    const size_t srcCount = srcs.size();
 
     StateVectorPtr nStateVec = AllocStateVec(nMaxQPower);
     stateVec->isReadLocked = false;
 
     par_for(0U, nMaxQPower, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
-        nStateVec->write(lcv, stateVec->read(lcv & startMask));
-
-        for (bitLenInt j = 0U; j < toComposeCount; ++j) {
-            QEngineCPUPtr src = std::dynamic_pointer_cast<Qrack::QEngineCPU>(toCopy[j]);
-            nStateVec->write(lcv, nStateVec->read(lcv) * src->stateVec->read((lcv & mask[j]) >> offset[j]));
+        complex amp = stateVec->read(lcv & startMask);
+        for (size_t j = 0U; (j < srcCount) && (norm(amp) > ZERO_R1); ++j) {
+            amp *= srcs[j]->stateVec->read((lcv & mask[j]) >> offset[j]);
         }
+        nStateVec->write(lcv, amp);
     });
 
+    for (const QEngineCPUPtr& src : srcs) {
+        src->stateVec->isReadLocked = true;
+    }
+
     SetQubitCount(nQubitCount);
 
     ResetStateVec(nStateVec);
@@ -1154,10 +2266,11 @@ void QEngineCPU::DecomposeDispose(bitLenInt start, bitLenInt length, QEngineCPUP
     }
 
     if (!nLength) {
+        Finish();
         if (destination) {
-            destination->stateVec = stateVec;
+            destination->ResetStateVec(stateVec);
         }
-        stateVec = NULL;
+        FreeStateVec();
         SetQubitCount(0U);
 
         return;
@@ -1166,6 +2279,8 @@ void QEngineCPU::DecomposeDispose(bitLenInt start, bitLenInt length, QEngineCPUP
     if (destination && !destination->stateVec) {
         // Reinitialize stateVec RAM
         destination->SetPermutation(0U);
+    } else if (destination) {
+        destination->EnsureUniqueStateVec(false);
     }
 
     const bitCapIntOcl partPower = pow2Ocl(length);
@@ -1278,6 +2393,106 @@ void QEngineCPU::Decompose(bitLenInt start, QInterfacePtr destination)
     DecomposeDispose(start, destination->GetQubitCount(), std::dynamic_pointer_cast<QEngineCPU>(destination));
 }
 
+bool QEngineCPU::TryDecompose(bitLenInt start, QInterfacePtr dest, real1_f error_tol)
+{
+    const bitLenInt length = dest->GetQubitCount();
+    if (isBadBitRange(start, length, qubitCount)) {
+        throw std::invalid_argument("QEngineCPU::TryDecompose range is out-of-bounds!");
+    }
+
+    if (doNormalize) {
+        NormalizeState();
+    }
+    Finish();
+
+    if (!stateVec || !length || (length == qubitCount)) {
+        return QEngine::TryDecompose(start, dest, error_tol);
+    }
+
+    // View the state vector as a matrix, with a row per basis state of the larger side of the partition and a column
+    // per basis state of the smaller side. The sides are separable exactly when this matrix has Schmidt rank 1, so we
+    // project every row onto the row of greatest norm, and the residual norm is the infidelity of the best product
+    // state along that pivot. Both passes only read the state, and only the pivot row is copied.
+    const bitLenInt nLength = qubitCount - length;
+    const bool isPartInner = length <= nLength;
+    const bitCapIntOcl innerPower = pow2Ocl(isPartInner ? length : nLength);
+    const bitCapIntOcl outerPower = pow2Ocl(isPartInner ? nLength : length);
+    const bitCapIntOcl startMask = pow2MaskOcl(start);
+    const auto toIndex = [&](const bitCapIntOcl& outer, const bitCapIntOcl& inner) {
+        const bitCapIntOcl part = isPartInner ? inner : outer;
+        const bitCapIntOcl remainder = isPartInner ? outer : inner;
+        const bitCapIntOcl low = remainder & startMask;
+        return low | (part << start) | ((remainder ^ low) << length);
+    };
+
+    const unsigned numCores = GetConcurrencyLevel();
+    std::unique_ptr<real1[]> totNorm(new real1[numCores]());
+    std::unique_ptr<real1[]> maxNorm(new real1[numCores]());
+    std::unique_ptr<bitCapIntOcl[]> maxRow(new bitCapIntOcl[numCores]());
+
+    stateVec->isReadLocked = false;
+
+    par_for(0U, outerPower, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        real1 nrm = ZERO_R1;
+        for (bitCapIntOcl k = 0U; k < innerPower; ++k) {
+            nrm += norm(stateVec->read(toIndex(lcv, k)));
+        }
+        totNorm[cpu] += nrm;
+        if (nrm > maxNorm[cpu]) {
+            maxNorm[cpu] = nrm;
+            maxRow[cpu] = lcv;
+        }
+    });
+
+    real1 tot = ZERO_R1;
+    real1 pivotNorm = ZERO_R1;
+    bitCapIntOcl pivotRow = 0U;
+    for (unsigned i = 0U; i < numCores; ++i) {
+        tot += totNorm[i];
+        if (maxNorm[i] > pivotNorm) {
+            pivotNorm = maxNorm[i];
+            pivotRow = maxRow[i];
+        }
+    }
+
+    if (pivotNorm <= FP_NORM_EPSILON) {
+        stateVec->isReadLocked = true;
+        return QEngine::TryDecompose(start, dest, error_tol);
+    }
+
+    std::unique_ptr<complex[]> pivot(new complex[innerPower]);
+    for (bitCapIntOcl k = 0U; k < innerPower; ++k) {
+        pivot[k] = stateVec->read(toIndex(pivotRow, k));
+    }
+
+    std::fill(totNorm.get(), totNorm.get() + numCores, ZERO_R1);
+    par_for(0U, outerPower, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        complex inner = ZERO_CMPLX;
+        real1 nrm = ZERO_R1;
+        for (bitCapIntOcl k = 0U; k < innerPower; ++k) {
+            const complex amp = stateVec->read(toIndex(lcv, k));
+            inner += conj(pivot[k]) * amp;
+            nrm += norm(amp);
+        }
+        totNorm[cpu] += nrm - norm(inner) / pivotNorm;
+    });
+
+    stateVec->isReadLocked = true;
+
+    real1 residual = ZERO_R1;
+    for (unsigned i = 0U; i < numCores; ++i) {
+        residual += totNorm[i];
+    }
+
+    if ((real1_f)(residual / tot) > error_tol) {
+        return false;
+    }
+
+    Decompose(start, dest);
+
+    return true;
+}
+
 void QEngineCPU::Dispose(bitLenInt start, bitLenInt length) { DecomposeDispose(start, length, (QEngineCPUPtr)NULL); }
 
 void QEngineCPU::Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm)
@@ -1344,6 +2559,23 @@ real1_f QEngineCPU::Prob(bitLenInt qubit)
         return norm(stateVec->read(1U));
     }
 
+    if (probCache.size() != qubitCount) {
+        DirtyProbCache();
+    }
+    if (probCache[qubit] >= ZERO_R1) {
+        return clampProb((real1_f)probCache[qubit]);
+    }
+    if (probCacheMisses) {
+        // Another qubit has already been read since the state changed, so read them all, at once.
+        std::vector<bitLenInt> qubits(qubitCount);
+        for (bitLenInt i = 0U; i < qubitCount; ++i) {
+            qubits[i] = i;
+        }
+        FillProbCache(qubits);
+        return clampProb((real1_f)probCache[qubit]);
+    }
+    ++probCacheMisses;
+
     const bitCapIntOcl qPower = pow2Ocl(qubit);
     const unsigned numCores = GetConcurrencyLevel();
     std::unique_ptr<real1[]> oneChanceBuff(new real1[numCores]());
@@ -1391,10 +2623,78 @@ real1_f QEngineCPU::Prob(bitLenInt qubit)
     for (unsigned i = 0U; i < numCores; ++i) {
         oneChance += oneChanceBuff[i];
     }
+    probCache[qubit] = oneChance;
 
     return clampProb((real1_f)oneChance);
 }
 
+void QEngineCPU::ProbBits(const std::vector<bitLenInt>& bits, real1* probsArray)
+{
+    ThrowIfQbIdArrayIsBad(
+        bits, qubitCount, "QEngineCPU::ProbBits parameter bits vector values must be within allocated qubit bounds!");
+
+    if (doNormalize) {
+        NormalizeState();
+    }
+    Finish();
+
+    if (!stateVec) {
+        std::fill(probsArray, probsArray + bits.size(), ZERO_R1);
+        return;
+    }
+
+    if (probCache.size() != qubitCount) {
+        DirtyProbCache();
+    }
+    FillProbCache(bits);
+
+    for (size_t i = 0U; i < bits.size(); ++i) {
+        probsArray[i] = (real1)clampProb((real1_f)probCache[bits[i]]);
+    }
+}
+
+void QEngineCPU::FillProbCache(const std::vector<bitLenInt>& qubits)
+{
+    std::vector<bitLenInt> stale;
+    for (const bitLenInt& i : qubits) {
+        if (probCache[i] < ZERO_R1) {
+            probCache[i] = ZERO_R1;
+            stale.push_back(i);
+        }
+    }
+    if (!stale.size()) {
+        return;
+    }
+
+    const bitLenInt staleCount = (bitLenInt)stale.size();
+    const unsigned numCores = GetConcurrencyLevel();
+    std::unique_ptr<real1[]> oneChanceBuff(new real1[numCores * staleCount]());
+
+    ParallelFunc fn = [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        const real1 nrm = norm(stateVec->read(lcv));
+        real1* oneChance = oneChanceBuff.get() + cpu * staleCount;
+        for (bitLenInt i = 0U; i < staleCount; ++i) {
+            oneChance[i] += ((lcv >> stale[i]) & 1U) ? nrm : ZERO_R1;
+        }
+    };
+
+    stateVec->isReadLocked = false;
+    if (stateVec->is_sparse()) {
+        par_for_set(CastStateVecSparse()->iterable(), fn);
+    } else {
+        par_for(0U, maxQPowerOcl, fn);
+    }
+    stateVec->isReadLocked = true;
+
+    for (bitLenInt i = 0U; i < staleCount; ++i) {
+        real1 oneChance = ZERO_R1;
+        for (unsigned j = 0U; j < numCores; ++j) {
+            oneChance += oneChanceBuff[j * staleCount + i];
+        }
+        probCache[stale[i]] = oneChance;
+    }
+}
+
 /// PSEUDO-QUANTUM Direct measure of bit probability to be in |1> state, if control is in |0>/|1>, false/true,
 /// "controlState".
 real1_f QEngineCPU::CtrlOrAntiProb(bool controlState, bitLenInt control, bitLenInt target)
@@ -1460,6 +2760,12 @@ real1_f QEngineCPU::ProbReg(bitLenInt start, bitLenInt length, bitCapInt permuta
         return ZERO_R1_F;
     }
 
+    if (length == 1U) {
+        // (Prob() might have this cached.)
+        const real1_f prob = Prob(start);
+        return (permutation & ONE_BCI) ? prob : (ONE_R1_F - prob);
+    }
+
     const unsigned num_threads = GetConcurrencyLevel();
     std::unique_ptr<real1[]> probs(new real1[num_threads]());
 
@@ -1500,6 +2806,12 @@ real1_f QEngineCPU::ProbMask(bitCapInt mask, bitCapInt permutation)
         return ZERO_R1_F;
     }
 
+    if (mask && !(mask & (mask - ONE_BCI)) && (permutation & mask)) {
+        // (Prob() might have this cached. The 0 case isn't 1 - Prob(), unless this engine holds the whole norm, which
+        // QPager pages don't.)
+        return Prob(log2(mask));
+    }
+
     bitCapIntOcl v = (bitCapIntOcl)mask; // count the number of bits set in v
     bitLenInt length; // c accumulates the total bits set in v
     std::vector<bitCapIntOcl> skipPowersVec;
@@ -1513,11 +2825,35 @@ real1_f QEngineCPU::ProbMask(bitCapInt mask, bitCapInt permutation)
     std::unique_ptr<real1[]> probs(new real1[num_threads]());
 
     const bitCapIntOcl permutationOcl = (bitCapIntOcl)permutation;
-    stateVec->isReadLocked = false;
-    par_for_mask(0U, maxQPowerOcl, skipPowersVec, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
-        probs[cpu] += norm(stateVec->read(lcv | permutationOcl));
-    });
-    stateVec->isReadLocked = true;
+    const bitCapIntOcl width = GetSimdWidth();
+    StateVectorArray* sva = width ? dynamic_cast<StateVectorArray*>(stateVec.get()) : NULL;
+    if (sva && (maxQPowerOcl >= width)) {
+        // Mask bits below the SIMD width select lanes; those above it select whole contiguous blocks.
+        complex const* amps = sva->amplitudes.get();
+        const bitCapIntOcl lowMask = (bitCapIntOcl)mask & (width - ONE_BCI);
+        const bitCapIntOcl highMask = (bitCapIntOcl)mask ^ lowMask;
+        const bitCapIntOcl highPerm = permutationOcl & highMask;
+        bitCapIntOcl block = highMask ? (highMask & ~(highMask - ONE_BCI)) : maxQPowerOcl;
+        if (block > SIMD_NORM_BLOCK) {
+            block = SIMD_NORM_BLOCK;
+        }
+        std::vector<bitCapIntOcl> blockSkipPowers;
+        for (const bitCapIntOcl& skipPower : skipPowersVec) {
+            if (skipPower >= width) {
+                blockSkipPowers.push_back(skipPower / block);
+            }
+        }
+        par_for_mask(0U, maxQPowerOcl / block, blockSkipPowers, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            probs[cpu] +=
+                (real1)SimdProbMask(amps + ((lcv * block) | highPerm), lowMask, permutationOcl & lowMask, block);
+        });
+    } else {
+        stateVec->isReadLocked = false;
+        par_for_mask(0U, maxQPowerOcl, skipPowersVec, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            probs[cpu] += norm(stateVec->read(lcv | permutationOcl));
+        });
+        stateVec->isReadLocked = true;
+    }
 
     real1 prob = ZERO_R1;
     for (unsigned thrd = 0; thrd < num_threads; ++thrd) {
@@ -1590,6 +2926,9 @@ bool QEngineCPU::ForceMParity(bitCapInt mask, bool result, bool doForce)
         result = (Rand() <= ProbParity(mask));
     }
 
+    Finish();
+    EnsureUniqueStateVec();
+
     real1 oddChance = ZERO_R1;
 
     const unsigned numCores = GetConcurrencyLevel();
@@ -1706,7 +3045,34 @@ void QEngineCPU::ApplyM(bitCapInt regMask, bitCapInt result, complex nrm)
 {
     CHECK_ZERO_SKIP();
 
+    EnsureUniqueStateVec();
+
     Dispatch(maxQPower, [this, regMask, result, nrm] {
+        const bitCapIntOcl width = GetSimdWidth();
+        StateVectorArray* sva = width ? dynamic_cast<StateVectorArray*>(stateVec.get()) : NULL;
+        if (sva && (maxQPowerOcl >= width)) {
+            // Mask bits below the SIMD width select lanes; those above it select whole contiguous blocks.
+            complex* amps = sva->amplitudes.get();
+            const bitCapIntOcl lowMask = (bitCapIntOcl)regMask & (width - ONE_BCI);
+            const bitCapIntOcl highMask = (bitCapIntOcl)regMask ^ lowMask;
+            const bitCapIntOcl highResult = (bitCapIntOcl)result & highMask;
+            bitCapIntOcl block = highMask ? (highMask & ~(highMask - ONE_BCI)) : maxQPowerOcl;
+            if (block > SIMD_NORM_BLOCK) {
+                block = SIMD_NORM_BLOCK;
+            }
+            par_for(0U, maxQPowerOcl / block, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+                complex* blockAmps = amps + lcv * block;
+                if (((lcv * block) & highMask) == highResult) {
+                    SimdApplyM(blockAmps, lowMask, (bitCapIntOcl)result & lowMask, nrm, block);
+                } else {
+                    std::fill(blockAmps, blockAmps + block, ZERO_CMPLX);
+                }
+            });
+
+            runningNorm = ONE_R1;
+            return;
+        }
+
         ParallelFunc fn = [&](const bitCapIntOcl& i, const unsigned& cpu) {
             if ((i & regMask) == result) {
                 stateVec->write(i, nrm * stateVec->read(i));
@@ -1751,6 +3117,7 @@ void QEngineCPU::NormalizeState(real1_f nrm_f, real1_f norm_thresh_f, real1_f ph
     }
     // We might have async execution of gates still happening.
     Finish();
+    EnsureUniqueStateVec();
 
     if (norm_thresh < ZERO_R1) {
         norm_thresh = amplitudeFloor;
@@ -1774,6 +3141,40 @@ void QEngineCPU::NormalizeState(real1_f nrm_f, real1_f norm_thresh_f, real1_f ph
     runningNorm = ONE_R1;
 }
 
+bool QEngineCPU::Apply2x2Simd(complex const* mtrx, const std::vector<bitCapIntOcl>& qPowersSorted,
+    bitCapIntOcl offset1, bitCapIntOcl offset2)
+{
+    const bitCapIntOcl width = GetSimdWidth();
+    if (!width || stateVec->is_sparse() || (qPowersSorted[0U] < width)) {
+        return false;
+    }
+
+    // (Half precision storage widens amplitudes one at a time, instead.)
+    StateVectorArray* sva = dynamic_cast<StateVectorArray*>(stateVec.get());
+    if (!sva) {
+        return false;
+    }
+    complex* amps = sva->amplitudes.get();
+    const bitLenInt bitCount = (bitLenInt)qPowersSorted.size();
+
+    par_for(0U, (maxQPowerOcl >> bitCount) / width, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        // Since "width" is no greater than the lowest power, "width" consecutive indices stay contiguous when pushed
+        // apart.
+        bitCapIntOcl i = 0U;
+        bitCapIntOcl iHigh = lcv * width;
+        for (bitLenInt p = 0U; p < bitCount; ++p) {
+            const bitCapIntOcl iLow = iHigh & (qPowersSorted[p] - ONE_BCI);
+            i |= iLow;
+            iHigh = (iHigh ^ iLow) << ONE_BCI;
+        }
+        i |= iHigh;
+
+        SimdApply2x2(amps + i + offset1, amps + i + offset2, mtrx, width);
+    });
+
+    return true;
+}
+
 void QEngineCPU::UpdateRunningNorm(real1_f norm_thresh)
 {
     Finish();
@@ -1786,19 +3187,139 @@ void QEngineCPU::UpdateRunningNorm(real1_f norm_thresh)
     if (norm_thresh < ZERO_R1) {
         norm_thresh = (real1_f)amplitudeFloor;
     }
-    runningNorm = par_norm(maxQPowerOcl, stateVec, norm_thresh);
+
+    if ((runningNormThresh == norm_thresh) && (runningNorm >= ZERO_R1)) {
+        // Nothing has written the state since this was last summed.
+        return;
+    }
+
+    StateVectorArray* sva = GetSimdWidth() ? dynamic_cast<StateVectorArray*>(stateVec.get()) : NULL;
+    if (sva && (maxQPowerOcl >= SIMD_NORM_BLOCK)) {
+        complex const* amps = sva->amplitudes.get();
+        const unsigned numCores = GetConcurrencyLevel();
+        std::unique_ptr<real1[]> rngNrm(new real1[numCores]());
+        par_for(0U, maxQPowerOcl / SIMD_NORM_BLOCK, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            rngNrm[cpu] += (real1)SimdNorm(amps + lcv * SIMD_NORM_BLOCK, SIMD_NORM_BLOCK, norm_thresh);
+        });
+        runningNorm = ZERO_R1;
+        for (unsigned i = 0U; i < numCores; ++i) {
+            runningNorm += rngNrm[i];
+        }
+    } else {
+        runningNorm = par_norm(maxQPowerOcl, stateVec, norm_thresh);
+    }
 
     if (runningNorm <= FP_NORM_EPSILON) {
         ZeroAmplitudes();
+        return;
+    }
+
+    runningNormThresh = norm_thresh;
+}
+
+void QEngineCPU::SetStateVecStorage(StateVecStorage s)
+{
+    if (s == storage) {
+        return;
+    }
+    storage = s;
+
+    if (!stateVec || isSparse) {
+        return;
+    }
+
+    Finish();
+    StateVectorPtr nStateVec = AllocStateVec(maxQPowerOcl);
+    nStateVec->copy_in(stateVec, 0U, 0U, maxQPowerOcl);
+    ResetStateVec(nStateVec);
+}
+
+void QEngineCPU::EvictStateVec()
+{
+    // (Finish first, so pending gates don't see this reference as a copy-on-write share.)
+    Finish();
+
+#if QRACK_MAPPED_STATE_VEC
+    std::shared_ptr<StateVectorMapped> mapped = std::dynamic_pointer_cast<StateVectorMapped>(stateVec);
+    if (mapped) {
+        mapped->Evict();
+        return;
+    }
+#endif
+
+    if (!isCompressEvicted) {
+        return;
+    }
+
+    std::shared_ptr<StateVectorCompressed> compressed = std::dynamic_pointer_cast<StateVectorCompressed>(stateVec);
+    if (compressed && !compressed->IsInflated()) {
+        return;
+    }
+
+    // (A copy-on-write share keeps its own reference to the uncompressed amplitudes.)
+    StateVectorArrayPtr sva =
+        compressed ? compressed->Inflate() : std::dynamic_pointer_cast<StateVectorArray>(stateVec);
+    if (sva) {
+        stateVec = std::make_shared<StateVectorCompressed>(sva, maxQPowerOcl);
+    }
+}
+
+void QEngineCPU::PrefetchStateVec()
+{
+    if (isCompressEvicted) {
+        // (Pending gates might still replace the state vector.)
+        Finish();
+        std::shared_ptr<StateVectorCompressed> compressed = std::dynamic_pointer_cast<StateVectorCompressed>(stateVec);
+        if (compressed) {
+            // Unwrap it, so gates on a hot page don't pay for the wrapper.
+            stateVec = compressed->Inflate();
+            return;
+        }
+    }
+
+#if QRACK_MAPPED_STATE_VEC
+    std::shared_ptr<StateVectorMapped> mapped = std::dynamic_pointer_cast<StateVectorMapped>(stateVec);
+    if (mapped) {
+        mapped->Prefetch();
     }
+#endif
 }
 
 StateVectorPtr QEngineCPU::AllocStateVec(bitCapIntOcl elemCount)
 {
     if (isSparse) {
         return std::make_shared<StateVectorSparse>(elemCount);
-    } else {
-        return std::make_shared<StateVectorArray>(elemCount);
     }
+
+    if (storage == STATE_VEC_BLOCKED) {
+        return std::make_shared<StateVectorBlocked>(elemCount);
+    }
+
+    if (storage != STATE_VEC_NATIVE) {
+        return std::make_shared<StateVectorHalf>(elemCount, storage == STATE_VEC_BF16);
+    }
+
+#if QRACK_MAPPED_STATE_VEC
+    if (mappedDir.size()) {
+        return std::make_shared<StateVectorMapped>(elemCount, mappedDir);
+    }
+#endif
+
+#if ENABLE_NUMA
+    ParallelPool& pool = ParallelPool::Instance();
+    if (pool.GetNumaNodeCount() > 1U) {
+        StateVectorArrayPtr sv = std::make_shared<StateVectorArray>(elemCount);
+        if (numaNode >= 0) {
+            pool.BindToNumaNode(sv->amplitudes.get(), sizeof(complex) * elemCount, numaNode);
+            sv->clear();
+        } else {
+            par_zero(sv->amplitudes.get(), elemCount);
+        }
+
+        return sv;
+    }
+#endif
+
+    return std::make_shared<StateVectorArray>(elemCount);
 }
 } // namespace Qrack
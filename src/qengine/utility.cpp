@@ -20,14 +20,14 @@ QInterfacePtr QEngineCPU::Clone()
         return CloneEmpty();
     }
 
-    QEngineCPUPtr clone =
-        std::make_shared<QEngineCPU>(qubitCount, 0U, rand_generator, ONE_CMPLX, doNormalize, randGlobalPhase, false, -1,
-            (hardware_rand_generator == NULL) ? false : true, isSparse, (real1_f)amplitudeFloor);
+    QEngineCPUPtr clone = std::dynamic_pointer_cast<QEngineCPU>(CloneEmpty());
 
+    // The clone is copy-on-write: both engines share one state vector, until either writes to it.
     Finish();
-    clone->Finish();
+    clone->stateVec = stateVec;
     clone->runningNorm = runningNorm;
-    clone->stateVec->copy(stateVec);
+    clone->probCache = probCache;
+    clone->runningNormThresh = runningNormThresh;
 
     return clone;
 }
@@ -38,6 +38,13 @@ QEnginePtr QEngineCPU::CloneEmpty()
         false, -1, (hardware_rand_generator == NULL) ? false : true, isSparse, (real1_f)amplitudeFloor);
 
     clone->SetQubitCount(qubitCount);
+    clone->numaNode = numaNode;
+    clone->mappedDir = mappedDir;
+    clone->isCompressEvicted = isCompressEvicted;
+    clone->storage = storage;
+#if ENABLE_QUNIT_CPU_PARALLEL && ENABLE_PTHREAD
+    clone->isDispatchWide = isDispatchWide;
+#endif
 
     return clone;
 }
@@ -60,6 +67,8 @@ bitLenInt QEngineCPU::Allocate(bitLenInt start, bitLenInt length)
 
 real1_f QEngineCPU::GetExpectation(bitLenInt valueStart, bitLenInt valueLength)
 {
+    Finish();
+
     const bitCapIntOcl outputMask = bitRegMaskOcl(valueStart, valueLength);
     real1 average = ZERO_R1;
     real1 totProb = ZERO_R1;
@@ -72,6 +72,36 @@ void QEngineShard::DumpMultiBit()
     }
 }
 
+void QEngineShard::ComposeFrame(complex const* mtrx)
+{
+    const complex nFrame[4U]{ (mtrx[0U] * frame[0U]) + (mtrx[1U] * frame[2U]),
+        (mtrx[0U] * frame[1U]) + (mtrx[1U] * frame[3U]), (mtrx[2U] * frame[0U]) + (mtrx[3U] * frame[2U]),
+        (mtrx[2U] * frame[1U]) + (mtrx[3U] * frame[3U]) };
+    std::copy(nFrame, nFrame + 4U, frame);
+
+    // An exact identity, (like a gate followed by its inverse,) needs no application at all.
+    isFramed = (frame[1U] != ZERO_CMPLX) || (frame[2U] != ZERO_CMPLX) || (frame[0U] != ONE_CMPLX) ||
+        (frame[3U] != ONE_CMPLX);
+}
+
+void QEngineShard::FlushFrame()
+{
+    if (!isFramed) {
+        return;
+    }
+
+    isFramed = false;
+    const complex mtrx[4U]{ frame[0U], frame[1U], frame[2U], frame[3U] };
+    frame[0U] = ONE_CMPLX;
+    frame[1U] = ZERO_CMPLX;
+    frame[2U] = ZERO_CMPLX;
+    frame[3U] = ONE_CMPLX;
+
+    if (unit) {
+        unit->Mtrx(mtrx, mapped);
+    }
+}
+
 void QEngineShard::RemoveBuffer(QEngineShardPtr p, ShardToPhaseMap& localMap, GetBufferFn remoteMapGet)
 {
     auto phaseShard = localMap.find(p);
@@ -99,7 +129,7 @@ void QEngineShard::DumpSamePhaseBuffer(OptimizeFn optimizeFn, ShardToPhaseMap& l
     int lcv = 0;
 
     while (phaseShard != localMap.end()) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
         if (!buffer->isInvert && IS_SAME(buffer->cmplxDiff, buffer->cmplxSame)) {
             ((*this).*remoteFn)(phaseShard->first);
         } else {
@@ -113,7 +143,7 @@ void QEngineShard::DumpSamePhaseBuffer(OptimizeFn optimizeFn, ShardToPhaseMap& l
 void QEngineShard::AddBuffer(QEngineShardPtr p, ShardToPhaseMap& localMap, GetBufferFn remoteFn)
 {
     if (p && (localMap.find(p) == localMap.end())) {
-        PhaseShardPtr ps = std::make_shared<PhaseShard>();
+        PhaseShardPtr ps = std::allocate_shared<PhaseShard>(PhaseShardAllocator<PhaseShard>());
         localMap[p] = ps;
         ((*p).*remoteFn)()[this] = ps;
     }
@@ -147,7 +177,7 @@ void QEngineShard::OptimizeBuffer(
     ShardToPhaseMap tempLocalMap = localMap;
 
     for (auto phaseShard = tempLocalMap.begin(); phaseShard != tempLocalMap.end(); ++phaseShard) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
         QEngineShardPtr partner = phaseShard->first;
 
         if (buffer->isInvert || !IS_ARG_0(buffer->cmplxDiff)) {
@@ -169,7 +199,7 @@ void QEngineShard::OptimizeBothTargets()
 {
     ShardToPhaseMap tempLocalMap = targetOfShards;
     for (auto phaseShard = tempLocalMap.begin(); phaseShard != tempLocalMap.end(); ++phaseShard) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
         QEngineShardPtr partner = phaseShard->first;
 
         if (buffer->isInvert) {
@@ -189,7 +219,7 @@ void QEngineShard::OptimizeBothTargets()
 
     tempLocalMap = antiTargetOfShards;
     for (auto phaseShard = tempLocalMap.begin(); phaseShard != tempLocalMap.end(); ++phaseShard) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
         QEngineShardPtr partner = phaseShard->first;
 
         if (buffer->isInvert) {
@@ -221,8 +251,8 @@ void QEngineShard::CombineBuffers(GetBufferFn targetMapGet, GetBufferFn controlM
             continue;
         }
 
-        PhaseShardPtr buffer1 = phaseShard->second;
-        PhaseShardPtr buffer2 = partnerShard->second;
+        const PhaseShardPtr& buffer1 = phaseShard->second;
+        const PhaseShardPtr& buffer2 = partnerShard->second;
 
         if (!buffer1->isInvert && IS_ARG_0(buffer1->cmplxDiff)) {
             ((*partner).*targetMapGet)().erase(this);
@@ -283,7 +313,7 @@ void QEngineShard::FlipPhaseAnti()
 void QEngineShard::CommutePhase(complex topLeft, complex bottomRight)
 {
     for (auto phaseShard = targetOfShards.begin(); phaseShard != targetOfShards.end(); ++phaseShard) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
         if (!buffer->isInvert) {
             return;
         }
@@ -293,7 +323,7 @@ void QEngineShard::CommutePhase(complex topLeft, complex bottomRight)
     }
 
     for (auto phaseShard = antiTargetOfShards.begin(); phaseShard != antiTargetOfShards.end(); ++phaseShard) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
         if (!buffer->isInvert) {
             return;
         }
@@ -309,7 +339,7 @@ void QEngineShard::RemoveIdentityBuffers(ShardToPhaseMap& localMap, GetBufferFn
     bitLenInt i = 0;
 
     while (phaseShard != localMap.end()) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
         if (!buffer->isInvert && IS_ARG_0(buffer->cmplxDiff) && IS_ARG_0(buffer->cmplxSame)) {
             // The buffer is equal to the identity operator, and it can be removed.
             ((*phaseShard->first).*remoteMapGet)().erase(this);
@@ -346,7 +376,7 @@ void QEngineShard::CommuteH()
 {
     // See QUnit::CommuteH() for which cases cannot be commuted and are flushed.
     for (auto phaseShard = targetOfShards.begin(); phaseShard != targetOfShards.end(); ++phaseShard) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
         if (abs(buffer->cmplxDiff - buffer->cmplxSame) < 1) {
             if (buffer->isInvert) {
                 buffer->isInvert = false;
@@ -365,7 +395,7 @@ void QEngineShard::CommuteH()
     RemoveIdentityBuffers(targetOfShards, &QEngineShard::GetControlsShards);
 
     for (auto phaseShard = antiTargetOfShards.begin(); phaseShard != antiTargetOfShards.end(); ++phaseShard) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
         if (abs(buffer->cmplxDiff - buffer->cmplxSame) < 1) {
             if (buffer->isInvert) {
                 buffer->isInvert = false;
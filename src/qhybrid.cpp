@@ -8,6 +8,7 @@
 // See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
 // for details.
 
+#include "common/engine_profile.hpp"
 #include "qfactory.hpp"
 
 #include <thread>
@@ -20,6 +21,7 @@ QHybrid::QHybrid(bitLenInt qBitCount, bitCapInt initState, qrack_rand_gen_ptr rg
     : QEngine(qBitCount, rgp, doNorm, randomGlobalPhase, useHostMem, useHardwareRNG, norm_thresh)
     , useRDRAND(useHardwareRNG)
     , isSparse(useSparseStateVec)
+    , isDispatchWide(false)
     , separabilityThreshold(sep_thresh)
     , devID(deviceId)
     , phaseFactor(phaseFac)
@@ -31,7 +33,10 @@ QHybrid::QHybrid(bitLenInt qBitCount, bitCapInt initState, qrack_rand_gen_ptr rg
         const bitLenInt gpuQubits =
             log2(OCLEngine::Instance().GetDeviceContextPtr(devID)->GetPreferredConcurrency()) + 1U;
         const bitLenInt cpuQubits = (GetStride() <= ONE_BCI) ? 0U : (log2(GetStride() - ONE_BCI) + 1U);
-        gpuThresholdQubits = gpuQubits < cpuQubits ? gpuQubits : cpuQubits;
+        // A measured "qrack_profile," if there is one, overrides the heuristic.
+        gpuThresholdQubits = EngineProfile::Instance().GetGpuThresholdQubits(
+            (devID < 0) ? (int64_t)OCLEngine::Instance().GetDefaultDeviceID() : devID,
+            gpuQubits < cpuQubits ? gpuQubits : cpuQubits);
     }
 
     pagerThresholdQubits = log2(OCLEngine::Instance().GetDeviceContextPtr(devID)->GetMaxAlloc() / sizeof(complex));
@@ -67,6 +72,7 @@ QEnginePtr QHybrid::MakeEngine(bool isOpenCL)
             (real1_f)amplitudeFloor, deviceIDs, pagerThresholdQubits, separabilityThreshold));
     toRet->SetQubitCount(qubitCount);
     toRet->SetConcurrency(GetConcurrencyLevel());
+    toRet->SetDispatchWide(isDispatchWide);
     return toRet;
 }
 } // namespace Qrack
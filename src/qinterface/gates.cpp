@@ -15,6 +15,8 @@
 #define C_SQRT1_2 complex(SQRT1_2_R1, ZERO_R1)
 #define C_SQRT_I complex(SQRT1_2_R1, SQRT1_2_R1)
 #define C_SQRT_N_I complex(SQRT1_2_R1, -SQRT1_2_R1)
+// Kraus operator arithmetic, (like the completeness of a Kraus set,) is checked to this tolerance.
+#define KRAUS_EPSILON ((real1)(64 * FP_NORM_EPSILON))
 
 namespace Qrack {
 
@@ -58,6 +60,31 @@ void QInterface::ZeroPhaseFlip(bitLenInt start, bitLenInt length)
     MACPhase(controls, -ONE_CMPLX, ONE_CMPLX, start + controls.size());
 }
 
+void QInterface::PhaseFlipIfLookup(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+    const unsigned char* values, bitCapInt target)
+{
+    if (isBadBitRange(indexStart, indexLength, qubitCount)) {
+        throw std::invalid_argument("QInterface::PhaseFlipIfLookup range is out-of-bounds!");
+    }
+
+    const bitLenInt valueBytes = (valueLength + 7U) / 8U;
+    const bitCapIntOcl indexPower = pow2Ocl(indexLength);
+    for (bitCapIntOcl i = 0U; i < indexPower; ++i) {
+        bitCapIntOcl entry = 0U;
+        for (bitLenInt j = 0U; j < valueBytes; ++j) {
+            entry |= (bitCapIntOcl)values[i * valueBytes + j] << (8U * j);
+        }
+        if ((bitCapInt)entry != target) {
+            continue;
+        }
+        // Map |i> to |0> on the index register, flip it, and map it back.
+        const bitCapInt flipMask = (bitCapInt)i << indexStart;
+        XMask(flipMask);
+        ZeroPhaseFlip(indexStart, indexLength);
+        XMask(flipMask);
+    }
+}
+
 void QInterface::XMask(bitCapInt mask)
 {
     bitCapInt v = mask;
@@ -372,66 +399,61 @@ void QInterface::PhaseParity(real1_f radians, bitCapInt mask)
 
 void QInterface::TimeEvolve(Hamiltonian h, real1_f timeDiff_f)
 {
-    real1 timeDiff = (real1)timeDiff_f;
-
-    if (abs(timeDiff) <= REAL1_EPSILON) {
+    if (abs(timeDiff_f) <= REAL1_EPSILON) {
         return;
     }
 
     // Exponentiation of an arbitrary serial string of gates, each HamiltonianOp component times timeDiff, e^(-i * H *
     // t) as e^(-i * H_(N - 1) * t) * e^(-i * H_(N - 2) * t) * ... e^(-i * H_0 * t)
+    TimeEvolve(CompiledHamiltonian(h, timeDiff_f, TROTTER_FIRST_ORDER, false));
+}
 
-    for (size_t i = 0U; i < h.size(); ++i) {
-        HamiltonianOpPtr op = h[i];
-        complex* opMtrx = op->matrix.get();
-
-        bitCapIntOcl maxJ = 4U;
-        if (op->uniform) {
-            maxJ *= pow2Ocl(op->controls.size());
-        }
-        std::unique_ptr<complex[]> mtrx(new complex[maxJ]);
+void QInterface::TimeEvolve(const CompiledHamiltonian& h, unsigned steps)
+{
+    const std::vector<CompiledHamiltonianOp>& ops = h.GetOps();
 
-        for (bitCapIntOcl j = 0U; j < maxJ; ++j) {
-            mtrx[j] = opMtrx[j] * (-timeDiff);
-        }
+    for (unsigned step = 0U; step < steps; ++step) {
+        for (size_t i = 0U; i < ops.size(); ++i) {
+            const CompiledHamiltonianOp& op = ops[i];
 
-        if (op->toggles.size()) {
-            for (size_t j = 0U; j < op->controls.size(); ++j) {
-                if (op->toggles[j]) {
-                    X(op->controls[j]);
+            for (size_t j = 0U; j < op.toggles.size(); ++j) {
+                if (op.toggles[j]) {
+                    X(op.controls[j]);
                 }
             }
-        }
 
-        if (op->uniform) {
-            std::unique_ptr<complex[]> expMtrx(new complex[maxJ]);
-            for (bitCapIntOcl j = 0U; j < pow2(op->controls.size()); ++j) {
-                exp2x2(mtrx.get() + (j * 4U), expMtrx.get() + (j * 4U));
-            }
-            UniformlyControlledSingleBit(op->controls, op->targetBit, expMtrx.get());
-        } else {
-            complex timesI[4U]{ I_CMPLX * mtrx[0U], I_CMPLX * mtrx[1U], I_CMPLX * mtrx[2U], I_CMPLX * mtrx[3U] };
-            complex toApply[4U];
-            exp2x2(timesI, toApply);
-            if (op->controls.size() == 0U) {
-                Mtrx(toApply, op->targetBit);
-            } else if (op->anti) {
-                MACMtrx(op->controls, toApply, op->targetBit);
+            if (op.controls.size() == 0U) {
+                Mtrx(&(op.mtrx[0U]), op.targetBit);
+            } else if (op.uniform) {
+                UniformlyControlledSingleBit(op.controls, op.targetBit, &(op.mtrx[0U]));
+            } else if (op.anti) {
+                MACMtrx(op.controls, &(op.mtrx[0U]), op.targetBit);
             } else {
-                MCMtrx(op->controls, toApply, op->targetBit);
+                MCMtrx(op.controls, &(op.mtrx[0U]), op.targetBit);
             }
-        }
 
-        if (op->toggles.size()) {
-            for (size_t j = 0U; j < op->controls.size(); ++j) {
-                if (op->toggles[j]) {
-                    X(op->controls[j]);
+            for (size_t j = 0U; j < op.toggles.size(); ++j) {
+                if (op.toggles[j]) {
+                    X(op.controls[j]);
                 }
             }
         }
     }
 }
 
+void QInterface::TimeEvolve(const KrylovHamiltonian& h, real1_f timeDiff)
+{
+    if (abs(timeDiff) <= REAL1_EPSILON) {
+        return;
+    }
+
+    const bitCapIntOcl maxQPowerOcl = (bitCapIntOcl)maxQPower;
+    std::unique_ptr<complex[]> state(new complex[maxQPowerOcl]);
+    GetQuantumState(state.get());
+    h.Evolve(*this, state.get(), maxQPowerOcl, timeDiff);
+    SetQuantumState(state.get());
+}
+
 void QInterface::DepolarizingChannelWeak1Qb(bitLenInt qubit, real1_f lambda)
 {
     if (lambda <= ZERO_R1) {
@@ -473,4 +495,176 @@ bitLenInt QInterface::DepolarizingChannelStrong1Qb(bitLenInt qubit, real1_f lamb
     return ancilla;
 }
 
+// K^+ K, for K = [[k[0], k[1]], [k[2], k[3]]]
+static void KrausGram(complex const* k, real1& m00, real1& m11, complex& m01)
+{
+    m00 = norm(k[0U]) + norm(k[2U]);
+    m11 = norm(k[1U]) + norm(k[3U]);
+    m01 = conj(k[0U]) * k[1U] + conj(k[2U]) * k[3U];
+}
+
+static bool IsGramScaledIdentity(const real1& m00, const real1& m11, const complex& m01)
+{
+    return (abs(m01) <= KRAUS_EPSILON) && (abs(m00 - m11) <= KRAUS_EPSILON);
+}
+
+void QInterface::KrausProbs1Qb(const std::vector<complex>& kraus, bitLenInt qubit, real1_f* probs)
+{
+    if (!kraus.size() || (kraus.size() & 3U)) {
+        throw std::invalid_argument("QInterface::KrausProbs1Qb kraus parameter must hold one or more 2x2 matrices!");
+    }
+    if (qubit >= qubitCount) {
+        throw std::invalid_argument(
+            "QInterface::KrausProbs1Qb qubit index parameter must be within allocated qubit bounds!");
+    }
+
+    const size_t krausCount = kraus.size() >> 2U;
+    std::vector<real1> m00(krausCount), m11(krausCount);
+    std::vector<complex> m01(krausCount);
+    bool isMixedUnitary = true;
+    for (size_t k = 0U; k < krausCount; ++k) {
+        KrausGram(&(kraus[k << 2U]), m00[k], m11[k], m01[k]);
+        isMixedUnitary &= IsGramScaledIdentity(m00[k], m11[k], m01[k]);
+    }
+
+    // With the qubit's reduced density matrix, rho = (I + x X + y Y + z Z) / 2, the probability is Tr(K^+ K rho).
+    real1_f x = ZERO_R1_F, y = ZERO_R1_F, z = ZERO_R1_F;
+    if (!isMixedUnitary) {
+        const std::vector<real1_f> bloch =
+            ExpectationPauliAll({ PauliString{ std::vector<bitLenInt>{ qubit }, std::vector<Pauli>{ PauliX } },
+                PauliString{ std::vector<bitLenInt>{ qubit }, std::vector<Pauli>{ PauliY } },
+                PauliString{ std::vector<bitLenInt>{ qubit }, std::vector<Pauli>{ PauliZ } } });
+        x = bloch[0U];
+        y = bloch[1U];
+        z = bloch[2U];
+    }
+
+    for (size_t k = 0U; k < krausCount; ++k) {
+        const real1_f p = (real1_f)((m00[k] * (ONE_R1 + (real1)z) + m11[k] * (ONE_R1 - (real1)z)) / 2 +
+            real(m01[k] * complex((real1)x, (real1)y)));
+        probs[k] = (p < ZERO_R1_F) ? ZERO_R1_F : p;
+    }
+}
+
+void QInterface::ApplyKraus1Qb(complex const* kraus, bitLenInt qubit)
+{
+    real1 m00, m11;
+    complex m01;
+    KrausGram(kraus, m00, m11, m01);
+
+    if (IsGramScaledIdentity(m00, m11, m01)) {
+        // K is a multiple of a unitary.
+        const real1 s = (real1)sqrt((m00 + m11) / 2);
+        if (s <= KRAUS_EPSILON) {
+            throw std::domain_error("QInterface::ApplyKraus1Qb Kraus operator branch has zero probability!");
+        }
+        if ((abs(kraus[1U]) <= KRAUS_EPSILON) && (abs(kraus[2U]) <= KRAUS_EPSILON) &&
+            (abs(kraus[0U] - kraus[3U]) <= KRAUS_EPSILON)) {
+            // Only a global phase
+            return;
+        }
+        const complex u[4U]{ kraus[0U] / s, kraus[1U] / s, kraus[2U] / s, kraus[3U] / s };
+        Mtrx(u, qubit);
+
+        return;
+    }
+
+    // K = W diag(s0, s1) V^+, where V diag(s0^2, s1^2) V^+ = K^+ K. The unitaries are gates, and the diagonal factor,
+    // relative to s0, is a weak measurement, with one ancilla.
+    const real1 halfTr = (m00 + m11) / 2;
+    const real1 disc = (real1)sqrt((m00 - m11) * (m00 - m11) / 4 + norm(m01));
+    const real1 s0 = (real1)sqrt(halfTr + disc);
+    const real1 s1Sqr = halfTr - disc;
+    const real1 s1 = (s1Sqr > ZERO_R1) ? (real1)sqrt(s1Sqr) : ZERO_R1;
+
+    complex v0[2U];
+    if (abs(m01) > KRAUS_EPSILON) {
+        v0[0U] = m01;
+        v0[1U] = complex(s0 * s0 - m00, ZERO_R1);
+        const real1 nrm = (real1)sqrt(norm(v0[0U]) + norm(v0[1U]));
+        v0[0U] /= nrm;
+        v0[1U] /= nrm;
+    } else {
+        v0[0U] = (m00 >= m11) ? ONE_CMPLX : ZERO_CMPLX;
+        v0[1U] = (m00 >= m11) ? ZERO_CMPLX : ONE_CMPLX;
+    }
+    const complex v1[2U]{ -conj(v0[1U]), conj(v0[0U]) };
+
+    complex w0[2U]{ (kraus[0U] * v0[0U] + kraus[1U] * v0[1U]) / s0, (kraus[2U] * v0[0U] + kraus[3U] * v0[1U]) / s0 };
+    complex w1[2U];
+    if (s1 > KRAUS_EPSILON) {
+        w1[0U] = (kraus[0U] * v1[0U] + kraus[1U] * v1[1U]) / s1;
+        w1[1U] = (kraus[2U] * v1[0U] + kraus[3U] * v1[1U]) / s1;
+    } else {
+        w1[0U] = -conj(w0[1U]);
+        w1[1U] = conj(w0[0U]);
+    }
+
+    const complex vAdj[4U]{ conj(v0[0U]), conj(v0[1U]), conj(v1[0U]), conj(v1[1U]) };
+    const complex v[4U]{ v0[0U], v1[0U], v0[1U], v1[1U] };
+    const complex w[4U]{ w0[0U], w1[0U], w0[1U], w1[1U] };
+    const real1 ratio = s1 / s0;
+
+    Mtrx(vAdj, qubit);
+
+    const real1_f p1 = Prob(qubit);
+    if (((ONE_R1_F - p1) + (real1_f)(ratio * ratio) * p1) <= FP_NORM_EPSILON_F) {
+        Mtrx(v, qubit);
+        throw std::domain_error("QInterface::ApplyKraus1Qb Kraus operator branch has zero probability!");
+    }
+
+    if (ratio <= KRAUS_EPSILON) {
+        ForceM(qubit, false);
+    } else if (ratio < (ONE_R1 - KRAUS_EPSILON)) {
+        const bitLenInt ancilla = Allocate(1U);
+        CRY((real1_f)(2 * acos(ratio)), qubit, ancilla);
+        ForceM(ancilla, false);
+        Dispose(ancilla, 1U, 0U);
+    }
+
+    Mtrx(w, qubit);
+}
+
+size_t QInterface::KrausChannel1Qb(const std::vector<complex>& kraus, bitLenInt qubit)
+{
+    const size_t krausCount = kraus.size() >> 2U;
+    real1 s00 = ZERO_R1, s11 = ZERO_R1;
+    complex s01 = ZERO_CMPLX;
+    for (size_t k = 0U; k < krausCount; ++k) {
+        real1 m00, m11;
+        complex m01;
+        KrausGram(&(kraus[k << 2U]), m00, m11, m01);
+        s00 += m00;
+        s11 += m11;
+        s01 += m01;
+    }
+    if ((abs(s00 - ONE_R1) > KRAUS_EPSILON) || (abs(s11 - ONE_R1) > KRAUS_EPSILON) || (abs(s01) > KRAUS_EPSILON)) {
+        throw std::invalid_argument("QInterface::KrausChannel1Qb Kraus operators must satisfy sum_k K_k^+ K_k = I!");
+    }
+
+    std::unique_ptr<real1_f[]> probs(new real1_f[krausCount]);
+    KrausProbs1Qb(kraus, qubit, probs.get());
+
+    real1_f totProb = ZERO_R1_F;
+    for (size_t k = 0U; k < krausCount; ++k) {
+        totProb += probs[k];
+    }
+    real1_f r = Rand() * totProb;
+    size_t k = 0U;
+    for (; k < (krausCount - 1U); ++k) {
+        if ((probs[k] > ZERO_R1_F) && (r < probs[k])) {
+            break;
+        }
+        r -= probs[k];
+    }
+    // Rounding can leave "r" past the last operator, which might have no probability.
+    while (!(probs[k] > ZERO_R1_F) && k) {
+        --k;
+    }
+
+    ApplyKraus1Qb(&(kraus[k << 2U]), qubit);
+
+    return k;
+}
+
 } // namespace Qrack
@@ -11,6 +11,10 @@
 // for details.
 
 #include "qinterface.hpp"
+#include "qparity.hpp"
+
+#include "common/alias_table.hpp"
+#include "common/counter_rng.hpp"
 
 #include <algorithm>
 #include <random>
@@ -20,6 +24,13 @@
 #include <sys/random.h>
 #endif
 
+// Shots per counter-based RNG stream, in QInterface::SampleShots()
+#define QRACK_SHOT_BLOCK 4096U
+// Widest Pauli term group that QInterface::ExpectationPauliAll() reads as one probability table
+#define QRACK_PAULI_GROUP_QB 20U
+// Default amplitudes per chunk of ForEachAmplitudeChunk(), as a power of 2
+#define QRACK_READOUT_CHUNK_QB 20U
+
 namespace Qrack {
 
 QInterface::QInterface(
@@ -382,6 +393,16 @@ void QInterface::ProbBitsAll(const std::vector<bitLenInt>& bits, real1* probsArr
     }
 }
 
+void QInterface::ProbBits(const std::vector<bitLenInt>& bits, real1* probsArray)
+{
+    ThrowIfQbIdArrayIsBad(
+        bits, qubitCount, "QInterface::ProbBits parameter bits vector values must be within allocated qubit bounds!");
+
+    for (size_t i = 0U; i < bits.size(); ++i) {
+        probsArray[i] = (real1)Prob(bits[i]);
+    }
+}
+
 real1_f QInterface::ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCapInt offset)
 {
     ThrowIfQbIdArrayIsBad(bits, qubitCount,
@@ -408,34 +429,283 @@ real1_f QInterface::ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCa
     return expectation;
 }
 
-std::map<bitCapInt, int> QInterface::MultiShotMeasureMask(const std::vector<bitCapInt>& qPowers, unsigned shots)
+std::vector<real1_f> QInterface::ExpectationPauliAll(const std::vector<PauliString>& terms)
 {
-    if (!shots) {
-        return std::map<bitCapInt, int>();
+    // Greedily group qubit-wise commuting terms: each group has one (non-identity) basis per qubit.
+    std::vector<std::map<bitLenInt, Pauli>> bases;
+    std::vector<std::vector<size_t>> groups;
+    for (size_t t = 0U; t < terms.size(); ++t) {
+        const PauliString& term = terms[t];
+        if (term.qubits.size() != term.paulis.size()) {
+            throw std::invalid_argument("QInterface::ExpectationPauliAll term qubit and Pauli counts must match!");
+        }
+        ThrowIfQbIdArrayIsBad(term.qubits, qubitCount,
+            "QInterface::ExpectationPauliAll parameter qubits vector values must be within allocated qubit bounds!");
+
+        size_t g = 0U;
+        for (; g < groups.size(); ++g) {
+            bool isCommuting = true;
+            for (size_t i = 0U; isCommuting && (i < term.qubits.size()); ++i) {
+                const auto it = bases[g].find(term.qubits[i]);
+                isCommuting = (term.paulis[i] == PauliI) || (it == bases[g].end()) || (it->second == term.paulis[i]);
+            }
+            if (isCommuting) {
+                break;
+            }
+        }
+        if (g == groups.size()) {
+            bases.push_back(std::map<bitLenInt, Pauli>());
+            groups.push_back(std::vector<size_t>());
+        }
+        for (size_t i = 0U; i < term.qubits.size(); ++i) {
+            if (term.paulis[i] != PauliI) {
+                bases[g][term.qubits[i]] = term.paulis[i];
+            }
+        }
+        groups[g].push_back(t);
     }
 
-    std::vector<bitLenInt> bitMap(qPowers.size());
-    std::transform(qPowers.begin(), qPowers.end(), bitMap.begin(), log2);
+    std::vector<real1_f> toRet(terms.size(), ONE_R1_F);
+    for (size_t g = 0U; g < groups.size(); ++g) {
+        if (!bases[g].size()) {
+            continue;
+        }
 
-    ThrowIfQbIdArrayIsBad(bitMap, qubitCount,
-        "QInterface::MultiShotMeasureMask parameter qPowers array values must be within allocated qubit bounds!");
+        // Rotate a copy of the state so that the whole group is diagonal.
+        std::vector<bitLenInt> qubits;
+        QInterfacePtr clone = Clone();
+        for (const auto& b : bases[g]) {
+            qubits.push_back(b.first);
+            if (b.second == PauliY) {
+                clone->IS(b.first);
+            }
+            if (b.second != PauliZ) {
+                clone->H(b.first);
+            }
+        }
 
-    const bitCapIntOcl maskMaxQPower = pow2Ocl(qPowers.size());
-    std::vector<real1> maskProbsVec((bitCapIntOcl)maskMaxQPower);
-    ProbBitsAll(bitMap, &(maskProbsVec[0]));
-    std::discrete_distribution<bitCapIntOcl> dist(maskProbsVec.begin(), maskProbsVec.end());
+        std::vector<bitCapInt> masks(groups[g].size());
+        for (size_t t = 0U; t < groups[g].size(); ++t) {
+            const PauliString& term = terms[groups[g][t]];
+            bitCapInt mask = 0U;
+            for (size_t i = 0U; i < term.qubits.size(); ++i) {
+                if (term.paulis[i] != PauliI) {
+                    mask |= pow2(std::lower_bound(qubits.begin(), qubits.end(), term.qubits[i]) - qubits.begin());
+                }
+            }
+            masks[t] = mask;
+        }
+
+        QParity* parity = dynamic_cast<QParity*>(clone.get());
+        if (parity && (qubits.size() > QRACK_PAULI_GROUP_QB)) {
+            // Too wide for a probability table: one parity per term.
+            for (size_t t = 0U; t < groups[g].size(); ++t) {
+                bitCapInt mask = 0U;
+                for (size_t i = 0U; i < qubits.size(); ++i) {
+                    if ((masks[t] >> i) & ONE_BCI) {
+                        mask |= pow2(qubits[i]);
+                    }
+                }
+                toRet[groups[g][t]] = ONE_R1_F - 2 * parity->ProbParity(mask);
+            }
+            continue;
+        }
+
+        const bitCapIntOcl maxPerm = pow2Ocl(qubits.size());
+        std::unique_ptr<real1[]> probs(new real1[maxPerm]);
+        clone->ProbBitsAll(qubits, probs.get());
+        for (size_t t = 0U; t < groups[g].size(); ++t) {
+            const bitCapIntOcl mask = (bitCapIntOcl)masks[t];
+            real1_f expectation = ZERO_R1_F;
+            for (bitCapIntOcl p = 0U; p < maxPerm; ++p) {
+                bool isOdd = false;
+                for (bitCapIntOcl v = p & mask; v; v &= v - ONE_BCI) {
+                    isOdd = !isOdd;
+                }
+                expectation += isOdd ? -(real1_f)probs[p] : (real1_f)probs[p];
+            }
+            toRet[groups[g][t]] = expectation;
+        }
+    }
+
+    return toRet;
+}
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
+void QInterface::SampleShots(
+    real1 const* maskProbs, bitCapIntOcl maskMaxQPower, unsigned shots, unsigned long long* shotsArray)
+{
+    if (shots == 1U) {
+        // A single shot doesn't pay for a table.
+        real1 total = ZERO_R1;
+        for (bitCapIntOcl i = 0U; i < maskMaxQPower; ++i) {
+            total += maskProbs[i];
+        }
+        const real1 r = (real1)Rand() * total;
+        real1 cumulative = ZERO_R1;
+        // If rounding leaves "r" past the end, the last possible outcome takes the shot.
+        bitCapIntOcl result = 0U;
+        for (bitCapIntOcl i = 0U; i < maskMaxQPower; ++i) {
+            if (maskProbs[i] <= ZERO_R1) {
+                continue;
+            }
+            result = i;
+            cumulative += maskProbs[i];
+            if (cumulative > r) {
+                break;
+            }
+        }
+        shotsArray[0U] = (unsigned long long)result;
+        return;
+    }
+
+    const AliasTable table(maskProbs, maskMaxQPower);
+
+    const unsigned blockCount = (shots + QRACK_SHOT_BLOCK - 1U) / QRACK_SHOT_BLOCK;
+    const uint64_t seed = RandSeed();
+
+    par_for(0U, blockCount, [&](const bitCapIntOcl& b, const unsigned& cpu) {
+        CounterRng gen(seed, b);
+        const unsigned end = std::min((unsigned)((b + 1U) * QRACK_SHOT_BLOCK), shots);
+        for (unsigned shot = (unsigned)(b * QRACK_SHOT_BLOCK); shot < end; ++shot) {
+            // The outcome count is a power of 2, so masking a raw draw is an unbiased bucket.
+            const bitCapIntOcl bucket = (bitCapIntOcl)gen() & (maskMaxQPower - 1U);
+            shotsArray[shot] = (unsigned long long)table.Sample(bucket, gen.NextReal());
+        }
+    });
+}
 
+std::map<bitCapInt, int> QInterface::ShotHistogram(
+    unsigned long long const* shotsArray, unsigned shots, bitCapIntOcl maskMaxQPower)
+{
     std::map<bitCapInt, int> results;
-    for (unsigned int shot = 0U; shot < shots; ++shot) {
-        ++(results[dist(gen)]);
+
+    if (maskMaxQPower <= ((bitCapIntOcl)shots << 2U)) {
+        // Dense enough for a flat count array, read off in key order.
+        std::vector<int> counts(maskMaxQPower, 0);
+        for (unsigned shot = 0U; shot < shots; ++shot) {
+            ++(counts[(bitCapIntOcl)shotsArray[shot]]);
+        }
+        for (bitCapIntOcl i = 0U; i < maskMaxQPower; ++i) {
+            if (counts[i]) {
+                results.emplace_hint(results.end(), (bitCapInt)i, counts[i]);
+            }
+        }
+
+        return results;
+    }
+
+    std::vector<unsigned long long> sorted(shotsArray, shotsArray + shots);
+    std::sort(sorted.begin(), sorted.end());
+    for (size_t i = 0U; i < sorted.size();) {
+        size_t j = i + 1U;
+        while ((j < sorted.size()) && (sorted[j] == sorted[i])) {
+            ++j;
+        }
+        results.emplace_hint(results.end(), (bitCapInt)sorted[i], (int)(j - i));
+        i = j;
     }
 
     return results;
 }
 
+bitCapIntOcl QInterface::ReadoutChunkLength(bitCapInt offset, bitCapInt length, bitCapIntOcl chunkLength)
+{
+    if ((offset > maxQPower) || (length > (maxQPower - offset))) {
+        throw std::invalid_argument("QInterface readout range must be within the permutations of allocated qubits!");
+    }
+
+    if (!chunkLength) {
+        chunkLength = pow2Ocl(QRACK_READOUT_CHUNK_QB);
+    }
+
+    return (length < chunkLength) ? (bitCapIntOcl)length : chunkLength;
+}
+
+void QInterface::ForEachAmplitudeChunk(
+    bitCapInt offset, bitCapInt length, AmplitudeChunkFn fn, bitCapIntOcl chunkLength)
+{
+    chunkLength = ReadoutChunkLength(offset, length, chunkLength);
+    if (!chunkLength) {
+        return;
+    }
+
+    std::unique_ptr<complex[]> amps(new complex[chunkLength]);
+    const bitCapInt end = offset + length;
+    for (bitCapInt o = offset; o < end; o += chunkLength) {
+        const bitCapIntOcl l = ((end - o) < chunkLength) ? (bitCapIntOcl)(end - o) : chunkLength;
+        for (bitCapIntOcl i = 0U; i < l; ++i) {
+            amps[i] = GetAmplitude(o + i);
+        }
+        fn(o, l, amps.get());
+    }
+}
+
+void QInterface::ForEachProbChunk(bitCapInt offset, bitCapInt length, ProbChunkFn fn, bitCapIntOcl chunkLength)
+{
+    chunkLength = ReadoutChunkLength(offset, length, chunkLength);
+    if (!chunkLength) {
+        return;
+    }
+
+    std::unique_ptr<real1[]> probs(new real1[chunkLength]);
+    ForEachAmplitudeChunk(
+        offset, length,
+        [&](const bitCapInt& o, const bitCapIntOcl& l, complex const* amps) {
+            std::transform(amps, amps + l, probs.get(), [](const complex& amp) { return (real1)norm(amp); });
+            fn(o, l, probs.get());
+        },
+        chunkLength);
+}
+
+std::vector<std::pair<bitCapInt, complex>> QInterface::GetSignificantAmplitudes(
+    real1_f threshold, bitCapIntOcl maxCount)
+{
+    typedef std::pair<real1, std::pair<bitCapInt, complex>> ProbEntry;
+    // With "maxCount," this is a min-heap of the most probable so far, (so the least of them is the first replaced).
+    std::vector<ProbEntry> heap;
+    const auto greater = [](const ProbEntry& a, const ProbEntry& b) { return a.first > b.first; };
+
+    ForEachAmplitudeChunk(0U, maxQPower, [&](const bitCapInt& o, const bitCapIntOcl& l, complex const* amps) {
+        for (bitCapIntOcl i = 0U; i < l; ++i) {
+            const real1 prob = norm(amps[i]);
+            if ((prob <= ZERO_R1) || (prob < (real1)threshold)) {
+                continue;
+            }
+            if (!maxCount || (heap.size() < maxCount)) {
+                heap.push_back(ProbEntry(prob, std::make_pair(o + i, amps[i])));
+                if (maxCount) {
+                    std::push_heap(heap.begin(), heap.end(), greater);
+                }
+            } else if (prob > heap.front().first) {
+                std::pop_heap(heap.begin(), heap.end(), greater);
+                heap.back() = ProbEntry(prob, std::make_pair(o + i, amps[i]));
+                std::push_heap(heap.begin(), heap.end(), greater);
+            }
+        }
+    });
+
+    std::stable_sort(heap.begin(), heap.end(), greater);
+    std::vector<std::pair<bitCapInt, complex>> toRet;
+    toRet.reserve(heap.size());
+    for (const ProbEntry& e : heap) {
+        toRet.push_back(e.second);
+    }
+
+    return toRet;
+}
+
+std::map<bitCapInt, int> QInterface::MultiShotMeasureMask(const std::vector<bitCapInt>& qPowers, unsigned shots)
+{
+    if (!shots) {
+        return std::map<bitCapInt, int>();
+    }
+
+    std::unique_ptr<unsigned long long[]> shotsArray(new unsigned long long[shots]);
+    MultiShotMeasureMask(qPowers, shots, shotsArray.get());
+
+    return ShotHistogram(shotsArray.get(), shots, pow2Ocl(qPowers.size()));
+}
+
 void QInterface::MultiShotMeasureMask(
     const std::vector<bitCapInt>& qPowers, unsigned shots, unsigned long long* shotsArray)
 {
@@ -450,14 +720,10 @@ void QInterface::MultiShotMeasureMask(
         "QInterface::MultiShotMeasureMask parameter qPowers array values must be within allocated qubit bounds!");
 
     const bitCapIntOcl maskMaxQPower = pow2Ocl(qPowers.size());
-    std::vector<real1> maskProbsVec((bitCapIntOcl)maskMaxQPower);
-    ProbBitsAll(bitMap, &(maskProbsVec[0]));
-    std::discrete_distribution<bitCapIntOcl> dist(maskProbsVec.begin(), maskProbsVec.end());
-
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    std::unique_ptr<real1[]> maskProbs(new real1[maskMaxQPower]);
+    ProbBitsAll(bitMap, maskProbs.get());
 
-    par_for(0, shots, [&](const bitCapIntOcl& shot, const unsigned& cpu) { shotsArray[shot] = (unsigned)dist(gen); });
+    SampleShots(maskProbs.get(), maskMaxQPower, shots, shotsArray);
 }
 
 bool QInterface::TryDecompose(bitLenInt start, QInterfacePtr dest, real1_f error_tol)
@@ -0,0 +1,1209 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qfactory.hpp"
+
+namespace Qrack {
+
+namespace {
+// Row-major (n x k) times (k x m)
+std::vector<complex> MatMul(
+    const std::vector<complex>& a, const std::vector<complex>& b, bitCapIntOcl n, bitCapIntOcl k, bitCapIntOcl m)
+{
+    std::vector<complex> c(n * m, ZERO_CMPLX);
+    for (bitCapIntOcl i = 0U; i < n; ++i) {
+        complex* row = &(c[i * m]);
+        for (bitCapIntOcl j = 0U; j < k; ++j) {
+            const complex aij = a[i * k + j];
+            if (aij == ZERO_CMPLX) {
+                continue;
+            }
+            const complex* bRow = &(b[j * m]);
+            for (bitCapIntOcl l = 0U; l < m; ++l) {
+                row[l] += aij * bRow[l];
+            }
+        }
+    }
+
+    return c;
+}
+
+// Make the "count" vectors of length "len" in "a" orthonormal, in order, by modified Gram-Schmidt, (with a second pass
+// against rounding,) replacing any vector without an independent direction by a unit basis vector. Element "i" of vector
+// "k" is a[k * kStride + i * iStride].
+void Orthonormalize(
+    std::vector<complex>& a, bitCapIntOcl len, bitCapIntOcl count, bitCapIntOcl kStride, bitCapIntOcl iStride)
+{
+    bitCapIntOcl basis = 0U;
+    for (bitCapIntOcl k = 0U; k < count; ++k) {
+        complex* ak = &(a[k * kStride]);
+        // A unit basis vector is kept if more than 1 / (2 * len) of its weight remains, which some remaining basis
+        // vector is always guaranteed to meet, so the completion can't run out of candidates.
+        bool isBasis = false;
+        for (;;) {
+            real1 before = ZERO_R1;
+            for (bitCapIntOcl i = 0U; i < len; ++i) {
+                before += norm(ak[i * iStride]);
+            }
+            for (int pass = 0; pass < 2; ++pass) {
+                for (bitCapIntOcl j = 0U; j < k; ++j) {
+                    const complex* aj = &(a[j * kStride]);
+                    complex d = ZERO_CMPLX;
+                    for (bitCapIntOcl i = 0U; i < len; ++i) {
+                        d += conj(aj[i * iStride]) * ak[i * iStride];
+                    }
+                    for (bitCapIntOcl i = 0U; i < len; ++i) {
+                        ak[i * iStride] -= d * aj[i * iStride];
+                    }
+                }
+            }
+            real1 after = ZERO_R1;
+            for (bitCapIntOcl i = 0U; i < len; ++i) {
+                after += norm(ak[i * iStride]);
+            }
+
+            if ((after > ZERO_R1) && (isBasis ? ((2 * len * after) > ONE_R1) : ((4 * after) > before))) {
+                const real1 inv = ONE_R1 / sqrt(after);
+                for (bitCapIntOcl i = 0U; i < len; ++i) {
+                    ak[i * iStride] *= inv;
+                }
+                break;
+            }
+
+            for (bitCapIntOcl i = 0U; i < len; ++i) {
+                ak[i * iStride] = ZERO_CMPLX;
+            }
+            if (basis >= len) {
+                break;
+            }
+            ak[(basis++) * iStride] = ONE_CMPLX;
+            isBasis = true;
+        }
+    }
+}
+
+// Thin SVD of the (rows x cols) row-major "m," as m = u * diag(s) * vh, with singular values in (nearly) descending
+// order, by one-sided (Hestenes) Jacobi rotations of the columns, for rows >= cols. Columns that are numerically 0,
+// relative to the whole block, are dropped rather than rotated, and the squared norm they carried is returned.
+real1 SvdTall(const std::vector<complex>& m, bitCapIntOcl rows, bitCapIntOcl cols, std::vector<complex>& u,
+    std::vector<real1>& s, std::vector<complex>& vh)
+{
+    // Column-major working copies, so each rotation runs down contiguous columns
+    std::vector<complex> w(rows * cols);
+    real1 total = ZERO_R1;
+    for (bitCapIntOcl i = 0U; i < rows; ++i) {
+        for (bitCapIntOcl j = 0U; j < cols; ++j) {
+            w[j * rows + i] = m[i * cols + j];
+            total += norm(m[i * cols + j]);
+        }
+    }
+    std::vector<complex> v(cols * cols, ZERO_CMPLX);
+    for (bitCapIntOcl j = 0U; j < cols; ++j) {
+        v[j * cols + j] = ONE_CMPLX;
+    }
+
+    // Squared norm under which a column is only rounding error, (the same 16 epsilon that Split() treats as 0)
+    const real1 zeroNorm = 256 * FP_NORM_EPSILON * FP_NORM_EPSILON * total;
+    real1 lost = ZERO_R1;
+    for (int sweep = 0; sweep < 64; ++sweep) {
+        real1 maxNorm = ZERO_R1;
+        for (bitCapIntOcl j = 0U; j < cols; ++j) {
+            complex* wj = &(w[j * rows]);
+            real1 nrm = ZERO_R1;
+            for (bitCapIntOcl i = 0U; i < rows; ++i) {
+                nrm += norm(wj[i]);
+            }
+            if (nrm > zeroNorm) {
+                maxNorm = std::max(maxNorm, nrm);
+            } else if (nrm > ZERO_R1) {
+                lost += nrm;
+                std::fill(wj, wj + rows, ZERO_CMPLX);
+            }
+        }
+        // Rounding in each inner product scales with the largest column, not with the pair, so convergence does too.
+        const real1 tol = FP_NORM_EPSILON * maxNorm;
+
+        bool isRotated = false;
+        for (bitCapIntOcl p = 0U; p < cols; ++p) {
+            complex* wp = &(w[p * rows]);
+            for (bitCapIntOcl q = p + 1U; q < cols; ++q) {
+                complex* wq = &(w[q * rows]);
+                real1 alpha = ZERO_R1, beta = ZERO_R1;
+                complex gamma = ZERO_CMPLX;
+                for (bitCapIntOcl i = 0U; i < rows; ++i) {
+                    alpha += norm(wp[i]);
+                    beta += norm(wq[i]);
+                    gamma += conj(wp[i]) * wq[i];
+                }
+                const real1 g = abs(gamma);
+                if (g <= tol) {
+                    continue;
+                }
+                isRotated = true;
+
+                // Rotate the phase of column q so that <w_p|w_q> is real, then zero it with a real Jacobi rotation.
+                const complex phase = conj(gamma) / g;
+                const real1 zeta = (beta - alpha) / (2 * g);
+                const real1 t = ((zeta < ZERO_R1) ? -ONE_R1 : ONE_R1) / (abs(zeta) + sqrt(ONE_R1 + zeta * zeta));
+                const real1 c = ONE_R1 / sqrt(ONE_R1 + t * t);
+                const real1 sn = c * t;
+                for (bitCapIntOcl i = 0U; i < rows; ++i) {
+                    const complex a = wp[i];
+                    const complex b = wq[i] * phase;
+                    wp[i] = c * a - sn * b;
+                    wq[i] = sn * a + c * b;
+                }
+                complex* vp = &(v[p * cols]);
+                complex* vq = &(v[q * cols]);
+                for (bitCapIntOcl i = 0U; i < cols; ++i) {
+                    const complex a = vp[i];
+                    const complex b = vq[i] * phase;
+                    vp[i] = c * a - sn * b;
+                    vq[i] = sn * a + c * b;
+                }
+            }
+        }
+        if (!isRotated) {
+            break;
+        }
+    }
+
+    std::vector<real1> norms(cols);
+    std::vector<bitCapIntOcl> order(cols);
+    for (bitCapIntOcl j = 0U; j < cols; ++j) {
+        real1 nrm = ZERO_R1;
+        for (bitCapIntOcl i = 0U; i < rows; ++i) {
+            nrm += norm(w[j * rows + i]);
+        }
+        norms[j] = sqrt(nrm);
+        order[j] = j;
+    }
+    std::sort(order.begin(), order.end(),
+        [&norms](const bitCapIntOcl& a, const bitCapIntOcl& b) { return norms[a] > norms[b]; });
+
+    // The normalized columns are the left singular vectors, up to the rounding that the sweeps leave, (or their cap,) so
+    // they're made exactly orthonormal, (filling in for dropped columns,) and the right factor is recomputed from them.
+    u.resize(rows * cols);
+    for (bitCapIntOcl k = 0U; k < cols; ++k) {
+        const bitCapIntOcl j = order[k];
+        const real1 inv = (norms[j] > ZERO_R1) ? (ONE_R1 / norms[j]) : ZERO_R1;
+        for (bitCapIntOcl i = 0U; i < rows; ++i) {
+            u[i * cols + k] = w[j * rows + i] * inv;
+        }
+    }
+    Orthonormalize(u, rows, cols, 1U, cols);
+
+    // vh = u^dagger * m, with each row normalized by its singular value
+    s.resize(cols);
+    vh = std::vector<complex>(cols * cols, ZERO_CMPLX);
+    for (bitCapIntOcl k = 0U; k < cols; ++k) {
+        complex* row = &(vh[k * cols]);
+        for (bitCapIntOcl i = 0U; i < rows; ++i) {
+            const complex uik = conj(u[i * cols + k]);
+            if (uik == ZERO_CMPLX) {
+                continue;
+            }
+            const complex* mRow = &(m[i * cols]);
+            for (bitCapIntOcl c = 0U; c < cols; ++c) {
+                row[c] += uik * mRow[c];
+            }
+        }
+        real1 nrm = ZERO_R1;
+        for (bitCapIntOcl c = 0U; c < cols; ++c) {
+            nrm += norm(row[c]);
+        }
+        s[k] = sqrt(nrm);
+        const real1 inv = (s[k] > ZERO_R1) ? (ONE_R1 / s[k]) : ZERO_R1;
+        for (bitCapIntOcl c = 0U; c < cols; ++c) {
+            row[c] *= inv;
+        }
+    }
+
+    return lost;
+}
+
+// Thin SVD of the (rows x cols) row-major "m," as m = u * diag(s) * vh, with u (rows x k) and vh (k x cols), returning
+// the squared norm dropped as numerically 0
+real1 Svd(const std::vector<complex>& m, bitCapIntOcl rows, bitCapIntOcl cols, std::vector<complex>& u,
+    std::vector<real1>& s, std::vector<complex>& vh)
+{
+    if (rows >= cols) {
+        return SvdTall(m, rows, cols, u, s, vh);
+    }
+
+    // m^dagger = u2 * s * vh2, so m = vh2^dagger * s * u2^dagger
+    std::vector<complex> mh(cols * rows);
+    for (bitCapIntOcl i = 0U; i < rows; ++i) {
+        for (bitCapIntOcl j = 0U; j < cols; ++j) {
+            mh[j * rows + i] = conj(m[i * cols + j]);
+        }
+    }
+    std::vector<complex> u2, vh2;
+    const real1 lost = SvdTall(mh, cols, rows, u2, s, vh2);
+
+    const bitCapIntOcl k = rows;
+    u.resize(rows * k);
+    vh.resize(k * cols);
+    for (bitCapIntOcl i = 0U; i < rows; ++i) {
+        for (bitCapIntOcl j = 0U; j < k; ++j) {
+            u[i * k + j] = conj(vh2[j * rows + i]);
+        }
+    }
+    for (bitCapIntOcl j = 0U; j < k; ++j) {
+        for (bitCapIntOcl c = 0U; c < cols; ++c) {
+            vh[j * cols + c] = conj(u2[c * k + j]);
+        }
+    }
+
+    return lost;
+}
+} // namespace
+
+QMps::QMps(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState, qrack_rand_gen_ptr rgp,
+    complex phaseFac, bool doNorm, bool randomGlobalPhase, bool useHostMem, int64_t deviceId, bool useHardwareRNG,
+    bool useSparseStateVec, real1_f norm_thresh, std::vector<int64_t> devList, bitLenInt qubitThreshold,
+    real1_f separation_thresh)
+    : QInterface(qBitCount, rgp, doNorm, useHardwareRNG, randomGlobalPhase, norm_thresh)
+    , useHostRam(useHostMem)
+    , isSparse(useSparseStateVec)
+    , thresholdQubits(qubitThreshold)
+    , maxBlockQubits(8U)
+    , center(0U)
+    , maxBondDimension(64U)
+    , truncationThreshold(ZERO_R1_F)
+    , truncationError(ZERO_R1_F)
+    , separabilityThreshold(separation_thresh)
+    , devID(deviceId)
+    , phaseFactor(phaseFac)
+    , engine(NULL)
+    , deviceIDs(devList)
+    , engines(eng)
+{
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_MPS_MAX_BOND")) {
+        maxBondDimension = (bitCapIntOcl)std::stoull(std::string(getenv("QRACK_MPS_MAX_BOND")));
+    }
+    if (getenv("QRACK_MPS_TRUNCATION_THRESHOLD")) {
+        truncationThreshold = (real1_f)std::stof(std::string(getenv("QRACK_MPS_TRUNCATION_THRESHOLD")));
+    }
+#endif
+
+    SetPermutation(initState, phaseFac);
+}
+
+QInterfacePtr QMps::MakeEngine(bitCapInt perm)
+{
+    QInterfacePtr toRet = CreateQuantumInterface(engines, qubitCount, perm, rand_generator, phaseFactor, doNormalize,
+        randGlobalPhase, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs, thresholdQubits,
+        separabilityThreshold);
+    toRet->SetConcurrency(GetConcurrencyLevel());
+    return toRet;
+}
+
+void QMps::SwitchToEngine()
+{
+    if (engine) {
+        return;
+    }
+
+    std::unique_ptr<complex[]> stateVec(new complex[(bitCapIntOcl)maxQPower]);
+    GetQuantumState(stateVec.get());
+    engine = MakeEngine();
+    engine->SetQuantumState(stateVec.get());
+
+    sites.clear();
+    bonds.clear();
+}
+
+void QMps::SetPermutation(bitCapInt perm, complex phaseFac)
+{
+    engine = NULL;
+    center = 0U;
+    truncationError = ZERO_R1_F;
+    bonds = std::vector<bitCapIntOcl>(qubitCount + 1U, 1U);
+    sites = std::vector<std::vector<complex>>(qubitCount, std::vector<complex>(2U, ZERO_CMPLX));
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        sites[i][(perm & pow2(i)) ? 1U : 0U] = ONE_CMPLX;
+    }
+
+    if (qubitCount) {
+        const complex phase = (phaseFac == CMPLX_DEFAULT_ARG) ? GetNonunitaryPhase() : phaseFac;
+        sites[0U][0U] *= phase;
+        sites[0U][1U] *= phase;
+    }
+}
+
+bitCapIntOcl QMps::Split(const std::vector<complex>& m, bitCapIntOcl rows, bitCapIntOcl cols,
+    std::vector<complex>& iso, std::vector<complex>& rest, bool isLeft, bitCapIntOcl maxRank)
+{
+    std::vector<complex> u, vh;
+    std::vector<real1> s;
+    const real1_f lost = (real1_f)Svd(m, rows, cols, u, s, vh);
+    const bitCapIntOcl k = s.size();
+
+    real1_f total = lost;
+    for (const real1& sv : s) {
+        total += (real1_f)(sv * sv);
+    }
+
+    // Drop the tail of the singular values while its weight stays within the threshold, (or the rank limit,) along
+    // with anything that's numerically zero.
+    const real1_f zeroThreshold = 16 * FP_NORM_EPSILON_F * (real1_f)s[0U];
+    bitCapIntOcl rank = k;
+    real1_f dropped = lost;
+    while (rank > 1U) {
+        const real1_f sv = (real1_f)s[rank - 1U];
+        if ((sv > zeroThreshold) && ((dropped + sv * sv) > (truncationThreshold * total)) &&
+            (!maxRank || (rank <= maxRank))) {
+            break;
+        }
+        dropped += sv * sv;
+        --rank;
+    }
+
+    real1 scale = ONE_R1;
+    if ((dropped > ZERO_R1_F) && (total > dropped)) {
+        truncationError += dropped / total;
+        scale = (real1)sqrt(total / (total - dropped));
+    }
+
+    // The isometry is made exactly orthonormal, and "rest" is the projection of "m" onto it, so the MPS stays in
+    // canonical form, and "m" is reproduced up to the dropped weight, however well the SVD converged.
+    if (isLeft) {
+        iso.resize(rows * rank);
+        for (bitCapIntOcl i = 0U; i < rows; ++i) {
+            std::copy(u.begin() + i * k, u.begin() + i * k + rank, iso.begin() + i * rank);
+        }
+        Orthonormalize(iso, rows, rank, 1U, rank);
+        rest = std::vector<complex>(rank * cols, ZERO_CMPLX);
+        for (bitCapIntOcl i = 0U; i < rows; ++i) {
+            const complex* mRow = &(m[i * cols]);
+            for (bitCapIntOcl j = 0U; j < rank; ++j) {
+                const complex ij = conj(iso[i * rank + j]) * scale;
+                complex* row = &(rest[j * cols]);
+                for (bitCapIntOcl c = 0U; c < cols; ++c) {
+                    row[c] += ij * mRow[c];
+                }
+            }
+        }
+    } else {
+        iso = std::vector<complex>(vh.begin(), vh.begin() + rank * cols);
+        Orthonormalize(iso, cols, rank, cols, 1U);
+        rest.resize(rows * rank);
+        for (bitCapIntOcl i = 0U; i < rows; ++i) {
+            const complex* mRow = &(m[i * cols]);
+            for (bitCapIntOcl j = 0U; j < rank; ++j) {
+                const complex* isoRow = &(iso[j * cols]);
+                complex r = ZERO_CMPLX;
+                for (bitCapIntOcl c = 0U; c < cols; ++c) {
+                    r += mRow[c] * conj(isoRow[c]);
+                }
+                rest[i * rank + j] = r * scale;
+            }
+        }
+    }
+
+    return rank;
+}
+
+void QMps::ShiftCenter(bool isRight, bitCapIntOcl maxRank)
+{
+    const bitCapIntOcl left = bonds[center];
+    const bitCapIntOcl right = bonds[center + 1U];
+    std::vector<complex> iso, rest;
+
+    if (isRight) {
+        const bitCapIntOcl rank = Split(sites[center], left << 1U, right, iso, rest, true, maxRank);
+        sites[center] = iso;
+        sites[center + 1U] = MatMul(rest, sites[center + 1U], rank, right, bonds[center + 2U] << 1U);
+        bonds[center + 1U] = rank;
+        ++center;
+        return;
+    }
+
+    const bitCapIntOcl rank = Split(sites[center], left, right << 1U, iso, rest, false, maxRank);
+    sites[center] = iso;
+    sites[center - 1U] = MatMul(sites[center - 1U], rest, bonds[center - 1U] << 1U, left, rank);
+    bonds[center] = rank;
+    --center;
+}
+
+void QMps::ContractBlock(bitLenInt lo, bitLenInt hi, std::vector<complex>& block)
+{
+    block = sites[lo];
+    bitCapIntOcl rows = bonds[lo] << 1U;
+    for (bitLenInt i = lo + 1U; i <= hi; ++i) {
+        block = MatMul(block, sites[i], rows, bonds[i], bonds[i + 1U] << 1U);
+        rows <<= 1U;
+    }
+}
+
+void QMps::SplitBlock(bitLenInt lo, bitLenInt hi, std::vector<complex> block, bitCapIntOcl right)
+{
+    std::vector<complex> iso, rest;
+    for (bitLenInt i = lo; i < hi; ++i) {
+        const bitCapIntOcl rows = bonds[i] << 1U;
+        const bitCapIntOcl cols = pow2Ocl(hi - i) * right;
+        bonds[i + 1U] = Split(block, rows, cols, iso, rest, true);
+        sites[i] = iso;
+        block = rest;
+    }
+    sites[hi] = block;
+    center = hi;
+}
+
+bool QMps::ApplyBlock(bitLenInt lo, bitLenInt hi,
+    std::function<void(std::vector<complex>&, bitCapIntOcl, bitCapIntOcl, bitCapIntOcl)> fn)
+{
+    if ((hi - lo + 1U) > maxBlockQubits) {
+        return false;
+    }
+
+    MoveCenter(lo);
+
+    const bitCapIntOcl left = bonds[lo];
+    const bitCapIntOcl right = bonds[hi + 1U];
+    std::vector<complex> block;
+    ContractBlock(lo, hi, block);
+    fn(block, left, pow2Ocl(hi - lo + 1U), right);
+    SplitBlock(lo, hi, block, right);
+
+    if (!IsWithinBondLimit()) {
+        SwitchToEngine();
+    }
+
+    return true;
+}
+
+void QMps::Mtrx(complex const* mtrx, bitLenInt target)
+{
+    if (target >= qubitCount) {
+        throw std::invalid_argument("QMps::Mtrx qubit index parameter must be within allocated qubit bounds!");
+    }
+
+    if (engine) {
+        engine->Mtrx(mtrx, target);
+        return;
+    }
+
+    // A unitary on one site keeps it an isometry, so the center doesn't need to move.
+    std::vector<complex>& site = sites[target];
+    const bitCapIntOcl left = bonds[target];
+    const bitCapIntOcl right = bonds[target + 1U];
+    for (bitCapIntOcl l = 0U; l < left; ++l) {
+        complex* a0 = &(site[(l << 1U) * right]);
+        complex* a1 = a0 + right;
+        for (bitCapIntOcl r = 0U; r < right; ++r) {
+            const complex z0 = a0[r];
+            const complex z1 = a1[r];
+            a0[r] = mtrx[0U] * z0 + mtrx[1U] * z1;
+            a1[r] = mtrx[2U] * z0 + mtrx[3U] * z1;
+        }
+    }
+}
+
+void QMps::ApplyControlled(
+    const std::vector<bitLenInt>& controls, bool isAnti, complex const* mtrx, bitLenInt target)
+{
+    if (!controls.size()) {
+        Mtrx(mtrx, target);
+        return;
+    }
+
+    ThrowIfQbIdArrayIsBad(controls, qubitCount,
+        "QMps::ApplyControlled parameter controls array values must be within allocated qubit bounds!");
+    if (target >= qubitCount) {
+        throw std::invalid_argument(
+            "QMps::ApplyControlled qubit index parameter must be within allocated qubit bounds!");
+    }
+
+    bitLenInt lo = target, hi = target;
+    for (const bitLenInt& c : controls) {
+        lo = (c < lo) ? c : lo;
+        hi = (c > hi) ? c : hi;
+    }
+
+    // Site "lo" is the most significant bit of the block's physical index.
+    bitCapIntOcl controlMask = 0U;
+    for (const bitLenInt& c : controls) {
+        controlMask |= pow2Ocl(hi - c);
+    }
+    const bitCapIntOcl controlPerm = isAnti ? 0U : controlMask;
+    const bitCapIntOcl targetPow = pow2Ocl(hi - target);
+
+    const bool isApplied = !engine &&
+        ApplyBlock(lo, hi,
+            [&](std::vector<complex>& block, bitCapIntOcl left, bitCapIntOcl phys, bitCapIntOcl right) {
+                for (bitCapIntOcl l = 0U; l < left; ++l) {
+                    for (bitCapIntOcl p = 0U; p < phys; ++p) {
+                        if ((p & targetPow) || ((p & controlMask) != controlPerm)) {
+                            continue;
+                        }
+                        complex* a0 = &(block[(l * phys + p) * right]);
+                        complex* a1 = &(block[(l * phys + (p | targetPow)) * right]);
+                        for (bitCapIntOcl r = 0U; r < right; ++r) {
+                            const complex z0 = a0[r];
+                            const complex z1 = a1[r];
+                            a0[r] = mtrx[0U] * z0 + mtrx[1U] * z1;
+                            a1[r] = mtrx[2U] * z0 + mtrx[3U] * z1;
+                        }
+                    }
+                }
+            });
+    if (isApplied) {
+        return;
+    }
+
+    SwitchToEngine();
+    if (isAnti) {
+        engine->MACMtrx(controls, mtrx, target);
+    } else {
+        engine->MCMtrx(controls, mtrx, target);
+    }
+}
+
+void QMps::Swap(bitLenInt qubit1, bitLenInt qubit2)
+{
+    if (qubit1 == qubit2) {
+        return;
+    }
+    if (qubit1 > qubit2) {
+        std::swap(qubit1, qubit2);
+    }
+
+    const bitCapIntOcl pow1 = pow2Ocl(qubit2 - qubit1);
+    const bool isApplied = !engine &&
+        ApplyBlock(qubit1, qubit2,
+            [&](std::vector<complex>& block, bitCapIntOcl left, bitCapIntOcl phys, bitCapIntOcl right) {
+                // Within the block, "qubit1" is the highest bit and "qubit2" the lowest.
+                for (bitCapIntOcl l = 0U; l < left; ++l) {
+                    for (bitCapIntOcl p = 1U; p < pow1; p += 2U) {
+                        std::swap_ranges(block.begin() + (l * phys + p) * right,
+                            block.begin() + (l * phys + p + 1U) * right,
+                            block.begin() + (l * phys + ((p ^ 1U) | pow1)) * right);
+                    }
+                }
+            });
+    if (isApplied) {
+        return;
+    }
+
+    SwitchToEngine();
+    engine->Swap(qubit1, qubit2);
+}
+
+void QMps::FSim(real1_f theta, real1_f phi, bitLenInt qubit1, bitLenInt qubit2)
+{
+    if (qubit1 == qubit2) {
+        return;
+    }
+    if (qubit1 > qubit2) {
+        std::swap(qubit1, qubit2);
+    }
+
+    const bitCapIntOcl pow1 = pow2Ocl(qubit2 - qubit1);
+    const real1 cosine = (real1)cos(theta);
+    const complex sine = complex(ZERO_R1, (real1)-sin(theta));
+    const complex phase = complex((real1)cos(phi), (real1)sin(phi));
+    const bool isApplied = !engine &&
+        ApplyBlock(qubit1, qubit2,
+            [&](std::vector<complex>& block, bitCapIntOcl left, bitCapIntOcl phys, bitCapIntOcl right) {
+                for (bitCapIntOcl l = 0U; l < left; ++l) {
+                    for (bitCapIntOcl p = 0U; p < phys; ++p) {
+                        if (p & (pow1 | 1U)) {
+                            continue;
+                        }
+                        complex* a01 = &(block[(l * phys + (p | 1U)) * right]);
+                        complex* a10 = &(block[(l * phys + (p | pow1)) * right]);
+                        complex* a11 = &(block[(l * phys + (p | pow1 | 1U)) * right]);
+                        for (bitCapIntOcl r = 0U; r < right; ++r) {
+                            const complex z01 = a01[r];
+                            const complex z10 = a10[r];
+                            a01[r] = cosine * z01 + sine * z10;
+                            a10[r] = sine * z01 + cosine * z10;
+                            a11[r] *= phase;
+                        }
+                    }
+                }
+            });
+    if (isApplied) {
+        return;
+    }
+
+    SwitchToEngine();
+    engine->FSim(theta, phi, qubit1, qubit2);
+}
+
+real1_f QMps::CenterNorm()
+{
+    if (!qubitCount) {
+        return ONE_R1_F;
+    }
+
+    real1_f nrm = ZERO_R1_F;
+    for (const complex& amp : sites[center]) {
+        nrm += (real1_f)norm(amp);
+    }
+
+    return nrm;
+}
+
+void QMps::NormalizeCenter()
+{
+    const real1_f nrm = CenterNorm();
+    if ((nrm <= ZERO_R1_F) || (nrm == ONE_R1_F) || !qubitCount) {
+        return;
+    }
+
+    const real1 scale = (real1)(ONE_R1_F / sqrt(nrm));
+    for (complex& amp : sites[center]) {
+        amp *= scale;
+    }
+}
+
+void QMps::NormalizeState(real1_f nrm, real1_f norm_thresh, real1_f phaseArg)
+{
+    if (engine) {
+        engine->NormalizeState(nrm, norm_thresh, phaseArg);
+        return;
+    }
+
+    NormalizeCenter();
+    if ((phaseArg == ZERO_R1_F) || !qubitCount) {
+        return;
+    }
+
+    const complex phase = complex((real1)cos(phaseArg), (real1)sin(phaseArg));
+    for (complex& amp : sites[center]) {
+        amp *= phase;
+    }
+}
+
+real1_f QMps::Prob(bitLenInt qubit)
+{
+    if (qubit >= qubitCount) {
+        throw std::invalid_argument("QMps::Prob qubit index parameter must be within allocated qubit bounds!");
+    }
+
+    if (engine) {
+        return engine->Prob(qubit);
+    }
+
+    // In canonical form, around the center, the center site alone has the marginal.
+    MoveCenter(qubit);
+    const std::vector<complex>& site = sites[qubit];
+    const bitCapIntOcl left = bonds[qubit];
+    const bitCapIntOcl right = bonds[qubit + 1U];
+    real1_f oneChance = ZERO_R1_F, total = ZERO_R1_F;
+    for (bitCapIntOcl l = 0U; l < left; ++l) {
+        for (bitCapIntOcl r = 0U; r < right; ++r) {
+            const real1_f p0 = (real1_f)norm(site[(l << 1U) * right + r]);
+            const real1_f p1 = (real1_f)norm(site[((l << 1U) | 1U) * right + r]);
+            oneChance += p1;
+            total += p0 + p1;
+        }
+    }
+
+    return (total > ZERO_R1_F) ? clampProb(oneChance / total) : ZERO_R1_F;
+}
+
+bool QMps::ForceM(bitLenInt qubit, bool result, bool doForce, bool doApply)
+{
+    if (qubit >= qubitCount) {
+        throw std::invalid_argument("QMps::ForceM qubit index parameter must be within allocated qubit bounds!");
+    }
+
+    if (engine) {
+        return engine->ForceM(qubit, result, doForce, doApply);
+    }
+
+    const real1_f oneChance = Prob(qubit);
+    if (!doForce) {
+        if (oneChance >= ONE_R1_F) {
+            result = true;
+        } else if (oneChance <= ZERO_R1_F) {
+            result = false;
+        } else {
+            result = (Rand() <= oneChance);
+        }
+    }
+
+    const real1_f nrmlzr = result ? oneChance : (ONE_R1_F - oneChance);
+    if (nrmlzr <= ZERO_R1_F) {
+        throw std::invalid_argument("QMps::ForceM() forced a measurement result with 0 probability!");
+    }
+
+    if (!doApply || (nrmlzr == ONE_R1_F)) {
+        return result;
+    }
+
+    // Prob() left the center on "qubit."
+    std::vector<complex>& site = sites[qubit];
+    const bitCapIntOcl left = bonds[qubit];
+    const bitCapIntOcl right = bonds[qubit + 1U];
+    const complex nrm = GetNonunitaryPhase() / (real1)sqrt(nrmlzr);
+    for (bitCapIntOcl l = 0U; l < left; ++l) {
+        complex* keep = &(site[((l << 1U) | (result ? 1U : 0U)) * right]);
+        complex* drop = &(site[((l << 1U) | (result ? 0U : 1U)) * right]);
+        for (bitCapIntOcl r = 0U; r < right; ++r) {
+            keep[r] *= nrm;
+            drop[r] = ZERO_CMPLX;
+        }
+    }
+
+    return result;
+}
+
+complex QMps::InnerProduct(const QMps& ket, bitCapInt mask, bitCapInt perm)
+{
+    // Sweep the transfer matrix, E[l][l'] = <bra to the left of the bond l|ket to the left of l'>, across the chain.
+    std::vector<complex> env(1U, ONE_CMPLX);
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        const std::vector<complex>& a = sites[i];
+        const std::vector<complex>& b = ket.sites[i];
+        const bitCapIntOcl la = bonds[i], ra = bonds[i + 1U];
+        const bitCapIntOcl lb = ket.bonds[i], rb = ket.bonds[i + 1U];
+        const bool isMasked = (bool)(mask & pow2(i));
+        const size_t sOnly = (perm & pow2(i)) ? 1U : 0U;
+
+        // T[l][s][r'] = sum over l' of E[l][l'] * B[l'][s][r']
+        std::vector<complex> t = MatMul(env, b, la, lb, rb << 1U);
+        std::vector<complex> nEnv(ra * rb, ZERO_CMPLX);
+        for (bitCapIntOcl l = 0U; l < la; ++l) {
+            for (size_t s = 0U; s < 2U; ++s) {
+                if (isMasked && (s != sOnly)) {
+                    continue;
+                }
+                const complex* aRow = &(a[((l << 1U) | s) * ra]);
+                const complex* tRow = &(t[((l << 1U) | s) * rb]);
+                for (bitCapIntOcl r = 0U; r < ra; ++r) {
+                    const complex ca = conj(aRow[r]);
+                    if (ca == ZERO_CMPLX) {
+                        continue;
+                    }
+                    complex* eRow = &(nEnv[r * rb]);
+                    for (bitCapIntOcl r2 = 0U; r2 < rb; ++r2) {
+                        eRow[r2] += ca * tRow[r2];
+                    }
+                }
+            }
+        }
+        env = nEnv;
+    }
+
+    return env[0U];
+}
+
+real1_f QMps::ProbAll(bitCapInt fullRegister)
+{
+    if (engine) {
+        return engine->ProbAll(fullRegister);
+    }
+
+    return clampProb((real1_f)norm(GetAmplitude(fullRegister)) / CenterNorm());
+}
+
+real1_f QMps::ProbMask(bitCapInt mask, bitCapInt permutation)
+{
+    if (engine) {
+        return engine->ProbMask(mask, permutation);
+    }
+
+    return clampProb((real1_f)real(InnerProduct(*this, mask, permutation)) / CenterNorm());
+}
+
+complex QMps::GetAmplitude(bitCapInt perm)
+{
+    if (perm >= maxQPower) {
+        throw std::invalid_argument("QMps::GetAmplitude argument out-of-bounds!");
+    }
+
+    if (engine) {
+        return engine->GetAmplitude(perm);
+    }
+
+    std::vector<complex> v(1U, ONE_CMPLX);
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        const bitCapIntOcl left = bonds[i];
+        const bitCapIntOcl right = bonds[i + 1U];
+        const size_t s = (perm & pow2(i)) ? 1U : 0U;
+        std::vector<complex> nv(right, ZERO_CMPLX);
+        for (bitCapIntOcl l = 0U; l < left; ++l) {
+            const complex* row = &(sites[i][((l << 1U) | s) * right]);
+            for (bitCapIntOcl r = 0U; r < right; ++r) {
+                nv[r] += v[l] * row[r];
+            }
+        }
+        v = nv;
+    }
+
+    return v[0U];
+}
+
+void QMps::GetQuantumState(complex* outputState)
+{
+    if (engine) {
+        engine->GetQuantumState(outputState);
+        return;
+    }
+
+    // Grow the state one site at a time: index (p * bond + b), for permutation p of the sites so far
+    std::vector<complex> t(1U, ONE_CMPLX);
+    bitCapIntOcl perms = 1U;
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        const bitCapIntOcl left = bonds[i];
+        const bitCapIntOcl right = bonds[i + 1U];
+        std::vector<complex> nt((perms << 1U) * right, ZERO_CMPLX);
+        for (bitCapIntOcl p = 0U; p < perms; ++p) {
+            for (bitCapIntOcl l = 0U; l < left; ++l) {
+                const complex z = t[p * left + l];
+                if (z == ZERO_CMPLX) {
+                    continue;
+                }
+                for (size_t s = 0U; s < 2U; ++s) {
+                    const complex* row = &(sites[i][((l << 1U) | s) * right]);
+                    complex* out = &(nt[(p | (s ? perms : 0U)) * right]);
+                    for (bitCapIntOcl r = 0U; r < right; ++r) {
+                        out[r] += z * row[r];
+                    }
+                }
+            }
+        }
+        t = nt;
+        perms <<= 1U;
+    }
+
+    std::copy(t.begin(), t.end(), outputState);
+}
+
+void QMps::GetProbs(real1* outputProbs)
+{
+    if (engine) {
+        engine->GetProbs(outputProbs);
+        return;
+    }
+
+    std::unique_ptr<complex[]> stateVec(new complex[(bitCapIntOcl)maxQPower]);
+    GetQuantumState(stateVec.get());
+    std::transform(stateVec.get(), stateVec.get() + (bitCapIntOcl)maxQPower, outputProbs, normHelper);
+}
+
+void QMps::SetQuantumState(complex const* inputState)
+{
+    if (engine) {
+        engine->SetQuantumState(inputState);
+        return;
+    }
+
+    if (!qubitCount) {
+        return;
+    }
+
+    // As one block, qubit 0 is the most significant bit.
+    const bitCapIntOcl maxQPowerOcl = (bitCapIntOcl)maxQPower;
+    std::vector<complex> block(maxQPowerOcl);
+    for (bitCapIntOcl i = 0U; i < maxQPowerOcl; ++i) {
+        bitCapIntOcl j = 0U;
+        for (bitLenInt b = 0U; b < qubitCount; ++b) {
+            if ((i >> b) & 1U) {
+                j |= pow2Ocl(qubitCount - 1U - b);
+            }
+        }
+        block[j] = inputState[i];
+    }
+
+    bonds = std::vector<bitCapIntOcl>(qubitCount + 1U, 1U);
+    sites.resize(qubitCount);
+    SplitBlock(0U, qubitCount - 1U, block, 1U);
+
+    if (!IsWithinBondLimit()) {
+        SwitchToEngine();
+    }
+}
+
+bitLenInt QMps::Compose(QInterfacePtr toCopy, bitLenInt start)
+{
+    if (start > qubitCount) {
+        throw std::invalid_argument("QMps::Compose start index is out-of-bounds!");
+    }
+
+    QMpsPtr toCopyMps = std::dynamic_pointer_cast<QMps>(toCopy);
+    if (toCopyMps) {
+        // Leave the original's form alone.
+        toCopyMps = std::dynamic_pointer_cast<QMps>(toCopyMps->Clone());
+    }
+
+    if (!engine && toCopyMps && !toCopyMps->engine && (!start || (start == qubitCount))) {
+        const bitLenInt length = toCopyMps->qubitCount;
+        toCopyMps->NormalizeCenter();
+        if (start) {
+            // Every site to the right of the center stays a right isometry.
+            toCopyMps->MoveCenter(0U);
+            sites.insert(sites.end(), toCopyMps->sites.begin(), toCopyMps->sites.end());
+            bonds.insert(bonds.end(), toCopyMps->bonds.begin() + 1U, toCopyMps->bonds.end());
+        } else {
+            // Every site to the left of the center stays a left isometry.
+            if (length) {
+                toCopyMps->MoveCenter(length - 1U);
+            }
+            sites.insert(sites.begin(), toCopyMps->sites.begin(), toCopyMps->sites.end());
+            bonds.insert(bonds.begin(), toCopyMps->bonds.begin(), toCopyMps->bonds.end() - 1U);
+            center += length;
+        }
+        SetQubitCount(qubitCount + length);
+
+        return start;
+    }
+
+    SwitchToEngine();
+    if (toCopyMps) {
+        toCopyMps->SwitchToEngine();
+        toCopy = toCopyMps->engine;
+    }
+    const bitLenInt toRet = engine->Compose(toCopy, start);
+    SetQubitCount(engine->GetQubitCount());
+
+    return toRet;
+}
+
+void QMps::CutRange(bitLenInt start, bitLenInt length, QMpsPtr part)
+{
+    if (start && ((start + length) < qubitCount)) {
+        // The rest of the chain can still be entangled "through" the range, so swap the range to the end, for one cut.
+        for (bitLenInt i = 0U; i < length; ++i) {
+            for (bitLenInt j = start + length - (i + 1U); j < (qubitCount - (i + 1U)); ++j) {
+                MoveCenter(j);
+                std::vector<complex> block;
+                ContractBlock(j, j + 1U, block);
+                const bitCapIntOcl left = bonds[j];
+                const bitCapIntOcl right = bonds[j + 2U];
+                for (bitCapIntOcl l = 0U; l < left; ++l) {
+                    std::swap_ranges(block.begin() + ((l << 2U) | 1U) * right,
+                        block.begin() + ((l << 2U) | 2U) * right, block.begin() + ((l << 2U) | 2U) * right);
+                }
+                SplitBlock(j, j + 1U, block, right);
+            }
+        }
+        start = qubitCount - length;
+    }
+
+    const bitLenInt end = start + length;
+
+    // Crossing a cut moves its whole Schmidt decomposition into one SVD, which keeps only the largest term.
+    if (start) {
+        MoveCenter(start - 1U);
+        ShiftCenter(true, 1U);
+    }
+    if (end < qubitCount) {
+        MoveCenter(end - 1U);
+        ShiftCenter(true, 1U);
+    }
+
+    if (part) {
+        part->engine = NULL;
+        part->sites = std::vector<std::vector<complex>>(sites.begin() + start, sites.begin() + end);
+        part->bonds = std::vector<bitCapIntOcl>(bonds.begin() + start, bonds.begin() + end + 1U);
+        part->center = (center < end) ? (center - start) : (length - 1U);
+        part->NormalizeCenter();
+    }
+
+    sites.erase(sites.begin() + start, sites.begin() + end);
+    bonds.erase(bonds.begin() + start + 1U, bonds.begin() + end + 1U);
+    if (center >= end) {
+        center -= length;
+    } else if (center >= start) {
+        center = start ? (start - 1U) : 0U;
+    }
+    SetQubitCount(qubitCount - length);
+    NormalizeCenter();
+
+    if (!IsWithinBondLimit()) {
+        SwitchToEngine();
+    }
+}
+
+void QMps::Decompose(bitLenInt start, QInterfacePtr dest)
+{
+    const bitLenInt length = dest->GetQubitCount();
+    if ((start + length) > qubitCount) {
+        throw std::invalid_argument("QMps::Decompose range is out-of-bounds!");
+    }
+
+    QMpsPtr destMps = std::dynamic_pointer_cast<QMps>(dest);
+    if (engine) {
+        if (destMps) {
+            destMps->SwitchToEngine();
+            dest = destMps->engine;
+        }
+        engine->Decompose(start, dest);
+        SetQubitCount(engine->GetQubitCount());
+        return;
+    }
+
+    if (destMps) {
+        CutRange(start, length, destMps);
+        return;
+    }
+
+    QMpsPtr part = std::make_shared<QMps>(engines, length, 0U, rand_generator, ONE_CMPLX, doNormalize,
+        randGlobalPhase, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs, thresholdQubits,
+        separabilityThreshold);
+    CutRange(start, length, part);
+    std::unique_ptr<complex[]> stateVec(new complex[pow2Ocl(length)]);
+    part->GetQuantumState(stateVec.get());
+    dest->SetQuantumState(stateVec.get());
+}
+
+QInterfacePtr QMps::Decompose(bitLenInt start, bitLenInt length)
+{
+    QMpsPtr dest = std::make_shared<QMps>(engines, length, 0U, rand_generator, ONE_CMPLX, doNormalize,
+        randGlobalPhase, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs, thresholdQubits,
+        separabilityThreshold);
+    dest->maxBondDimension = maxBondDimension;
+    dest->truncationThreshold = truncationThreshold;
+    Decompose(start, dest);
+
+    return dest;
+}
+
+void QMps::Dispose(bitLenInt start, bitLenInt length)
+{
+    if ((start + length) > qubitCount) {
+        throw std::invalid_argument("QMps::Dispose range is out-of-bounds!");
+    }
+
+    if (engine) {
+        engine->Dispose(start, length);
+        SetQubitCount(engine->GetQubitCount());
+        return;
+    }
+
+    CutRange(start, length, NULL);
+}
+
+void QMps::Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm)
+{
+    if ((start + length) > qubitCount) {
+        throw std::invalid_argument("QMps::Dispose range is out-of-bounds!");
+    }
+
+    if (engine) {
+        engine->Dispose(start, length, disposedPerm);
+        SetQubitCount(engine->GetQubitCount());
+        return;
+    }
+
+    CutRange(start, length, NULL);
+}
+
+bitLenInt QMps::Allocate(bitLenInt start, bitLenInt length)
+{
+    if (start > qubitCount) {
+        throw std::invalid_argument("QMps::Allocate argument is out-of-bounds!");
+    }
+
+    if (!length) {
+        return start;
+    }
+
+    if (engine) {
+        const bitLenInt toRet = engine->Allocate(start, length);
+        SetQubitCount(engine->GetQubitCount());
+        return toRet;
+    }
+
+    // A |0> site that passes its bond straight through is an isometry from both sides.
+    const bitCapIntOcl bond = bonds[start];
+    std::vector<complex> site((bond * bond) << 1U, ZERO_CMPLX);
+    for (bitCapIntOcl b = 0U; b < bond; ++b) {
+        site[(b << 1U) * bond + b] = ONE_CMPLX;
+    }
+    sites.insert(sites.begin() + start, length, site);
+    bonds.insert(bonds.begin() + start, length, bond);
+    if (center >= start) {
+        center += length;
+    }
+    SetQubitCount(qubitCount + length);
+
+    return start;
+}
+
+real1_f QMps::SumSqrDiff(QInterfacePtr toCompare)
+{
+    if (!toCompare) {
+        return ONE_R1_F;
+    }
+    if (this == toCompare.get()) {
+        return ZERO_R1_F;
+    }
+    if (qubitCount != toCompare->GetQubitCount()) {
+        return ONE_R1_F;
+    }
+
+    QMpsPtr toCompareMps = std::dynamic_pointer_cast<QMps>(toCompare);
+    if (!engine && toCompareMps && !toCompareMps->engine) {
+        // As for a state vector, 1 - |<a|b>|^2, (for normalized "a" and "b")
+        const real1_f overlap = (real1_f)norm(InnerProduct(*toCompareMps));
+        return ONE_R1_F - clampProb(overlap / (CenterNorm() * toCompareMps->CenterNorm()));
+    }
+
+    // Compare dense copies, without moving either original out of its form.
+    QInterfacePtr thisEngine = engine;
+    if (!thisEngine) {
+        QMpsPtr clone = std::dynamic_pointer_cast<QMps>(Clone());
+        clone->SwitchToEngine();
+        thisEngine = clone->engine;
+    }
+    if (toCompareMps) {
+        if (!toCompareMps->engine) {
+            toCompareMps = std::dynamic_pointer_cast<QMps>(toCompareMps->Clone());
+            toCompareMps->SwitchToEngine();
+        }
+        toCompare = toCompareMps->engine;
+    }
+
+    return thisEngine->SumSqrDiff(toCompare);
+}
+
+QInterfacePtr QMps::Clone()
+{
+    QMpsPtr c = std::make_shared<QMps>(engines, 0U, 0U, rand_generator, ONE_CMPLX, doNormalize, randGlobalPhase,
+        useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs, thresholdQubits,
+        separabilityThreshold);
+    c->SetQubitCount(qubitCount);
+    c->maxBlockQubits = maxBlockQubits;
+    c->maxBondDimension = maxBondDimension;
+    c->truncationThreshold = truncationThreshold;
+    c->truncationError = truncationError;
+    c->phaseFactor = phaseFactor;
+    if (engine) {
+        c->engine = engine->Clone();
+        c->sites.clear();
+        c->bonds.clear();
+        return c;
+    }
+
+    c->center = center;
+    c->bonds = bonds;
+    c->sites = sites;
+
+    return c;
+}
+
+void QMps::SetDevice(int64_t dID)
+{
+    devID = dID;
+    if (engine) {
+        engine->SetDevice(dID);
+    }
+}
+} // namespace Qrack
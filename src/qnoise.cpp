@@ -0,0 +1,272 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qnoise.hpp"
+
+#if ENABLE_PTHREAD
+#include "common/parallel_pool.hpp"
+#endif
+
+#include <random>
+
+// Completeness of a Kraus set, (sum_k K_k^+ K_k = I,) is checked to this tolerance, as by QInterface.
+#define KRAUS_EPSILON ((real1)(64 * FP_NORM_EPSILON))
+
+namespace Qrack {
+
+QNoiseModel::QNoiseModel(qrack_rand_gen_ptr rgp)
+    : readoutFlip0(ZERO_R1_F)
+    , readoutFlip1(ZERO_R1_F)
+{
+    if (!rgp) {
+        std::random_device rd;
+        rand_generator = std::make_shared<qrack_rand_gen>(rd());
+    } else {
+        rand_generator = rgp;
+    }
+}
+
+static void ThrowIfBadProb(real1_f p, std::string methodName)
+{
+    if ((p < ZERO_R1_F) || (p > ONE_R1_F)) {
+        throw std::invalid_argument(methodName + " probability parameter must be in [0, 1]!");
+    }
+}
+
+std::vector<complex> QNoiseModel::DepolarizingKraus(real1_f p)
+{
+    ThrowIfBadProb(p, "QNoiseModel::DepolarizingKraus");
+
+    const real1 s0 = (real1)sqrt(ONE_R1_F - p);
+    const real1 s1 = (real1)sqrt(p / 3);
+    return std::vector<complex>{ complex(s0, ZERO_R1), ZERO_CMPLX, ZERO_CMPLX, complex(s0, ZERO_R1), ZERO_CMPLX,
+        complex(s1, ZERO_R1), complex(s1, ZERO_R1), ZERO_CMPLX, ZERO_CMPLX, complex(ZERO_R1, -s1),
+        complex(ZERO_R1, s1), ZERO_CMPLX, complex(s1, ZERO_R1), ZERO_CMPLX, ZERO_CMPLX, complex(-s1, ZERO_R1) };
+}
+
+std::vector<complex> QNoiseModel::AmplitudeDampingKraus(real1_f gamma)
+{
+    ThrowIfBadProb(gamma, "QNoiseModel::AmplitudeDampingKraus");
+
+    return std::vector<complex>{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, complex((real1)sqrt(ONE_R1_F - gamma), ZERO_R1),
+        ZERO_CMPLX, complex((real1)sqrt(gamma), ZERO_R1), ZERO_CMPLX, ZERO_CMPLX };
+}
+
+std::vector<complex> QNoiseModel::PhaseDampingKraus(real1_f lambda)
+{
+    ThrowIfBadProb(lambda, "QNoiseModel::PhaseDampingKraus");
+
+    return std::vector<complex>{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, complex((real1)sqrt(ONE_R1_F - lambda), ZERO_R1),
+        ZERO_CMPLX, ZERO_CMPLX, ZERO_CMPLX, complex((real1)sqrt(lambda), ZERO_R1) };
+}
+
+void QNoiseModel::SetGateNoise(bitLenInt width, const std::vector<complex>& kraus)
+{
+    if (!width) {
+        throw std::invalid_argument("QNoiseModel::SetGateNoise width parameter must be at least 1!");
+    }
+
+    if (!kraus.size()) {
+        gateNoise.erase(width);
+        return;
+    }
+
+    if (kraus.size() & 3U) {
+        throw std::invalid_argument("QNoiseModel::SetGateNoise kraus parameter must hold 2x2 matrices!");
+    }
+
+    real1 s00 = ZERO_R1, s11 = ZERO_R1;
+    complex s01 = ZERO_CMPLX;
+    for (size_t i = 0U; i < kraus.size(); i += 4U) {
+        s00 += norm(kraus[i]) + norm(kraus[i + 2U]);
+        s11 += norm(kraus[i + 1U]) + norm(kraus[i + 3U]);
+        s01 += conj(kraus[i]) * kraus[i + 1U] + conj(kraus[i + 2U]) * kraus[i + 3U];
+    }
+    if ((abs(s00 - ONE_R1) > KRAUS_EPSILON) || (abs(s11 - ONE_R1) > KRAUS_EPSILON) || (abs(s01) > KRAUS_EPSILON)) {
+        throw std::invalid_argument("QNoiseModel::SetGateNoise Kraus operators must satisfy sum_k K_k^+ K_k = I!");
+    }
+
+    gateNoise[width] = kraus;
+}
+
+void QNoiseModel::SetReadoutError(real1_f flip0, real1_f flip1)
+{
+    ThrowIfBadProb(flip0, "QNoiseModel::SetReadoutError");
+    ThrowIfBadProb(flip1, "QNoiseModel::SetReadoutError");
+
+    readoutFlip0 = flip0;
+    readoutFlip1 = flip1;
+}
+
+void QNoiseModel::ApplyGateNoise(QInterfacePtr sim, const QCircuitGate& gate)
+{
+    const auto noise = gateNoise.find((bitLenInt)(gate.controls.size() + 1U));
+    if (noise == gateNoise.end()) {
+        return;
+    }
+
+    for (const bitLenInt& control : gate.controls) {
+        sim->KrausChannel1Qb(noise->second, control);
+    }
+    sim->KrausChannel1Qb(noise->second, gate.target);
+}
+
+std::map<bitCapInt, int> QNoiseModel::RunTrajectories(
+    QCircuitPtr circuit, QInterfacePtr sim, unsigned shots, const std::vector<real1_f>& params)
+{
+    if (circuit->GetQubitCount() > sim->GetQubitCount()) {
+        throw std::invalid_argument("QNoiseModel::RunTrajectories circuit is wider than the simulator!");
+    }
+
+    TrajectoryContext ctx;
+    ctx.gates = std::vector<QCircuitGatePtr>(circuit->GetGates().begin(), circuit->GetGates().end());
+    ctx.params = params;
+    for (bitLenInt i = 0U; i < sim->GetQubitCount(); ++i) {
+        ctx.qPowers.push_back(pow2(i));
+    }
+    ctx.seed = (uint64_t)(*rand_generator)();
+
+    if (shots) {
+        RunTrajectory(ctx, sim->Clone(), 0U, 0U, shots, 0U);
+    }
+
+    return ctx.results;
+}
+
+void QNoiseModel::RunTrajectory(
+    TrajectoryContext& ctx, QInterfacePtr sim, size_t gate, size_t channel, unsigned shots, uint64_t stream)
+{
+    CounterRng gen(ctx.seed, stream);
+
+    // "channel" counts the noise channels of the current gate already applied, with 0 meaning the gate isn't.
+    while (gate < ctx.gates.size()) {
+        const QCircuitGate& g = *(ctx.gates[gate]);
+        if (!channel) {
+            g.Run(sim, ctx.params);
+        }
+
+        const auto noise = gateNoise.find((bitLenInt)(g.controls.size() + 1U));
+        if ((noise == gateNoise.end()) || (channel > g.controls.size())) {
+            ++gate;
+            channel = 0U;
+            continue;
+        }
+        const bitLenInt qubit = (channel < g.controls.size()) ? g.controls[channel] : g.target;
+        ++channel;
+
+        const std::vector<complex>& kraus = noise->second;
+        const size_t krausCount = kraus.size() >> 2U;
+        std::vector<real1_f> probs(krausCount);
+        sim->KrausProbs1Qb(kraus, qubit, probs.data());
+
+        // Split the shots among the Kraus operators, multinomially, by one binomial draw per operator.
+        real1_f remainingProb = ZERO_R1_F;
+        size_t likeliest = 0U;
+        for (size_t k = 0U; k < krausCount; ++k) {
+            remainingProb += probs[k];
+            if (probs[k] > probs[likeliest]) {
+                likeliest = k;
+            }
+        }
+        std::vector<unsigned> counts(krausCount, 0U);
+        unsigned remainingShots = shots;
+        for (size_t k = 0U; (k < krausCount) && remainingShots; ++k) {
+            real1_f p = ZERO_R1_F;
+            if (probs[k] > ZERO_R1_F) {
+                p = (remainingProb > probs[k]) ? (probs[k] / remainingProb) : ONE_R1_F;
+            }
+            counts[k] = std::binomial_distribution<unsigned>(remainingShots, (double)p)(gen);
+            remainingShots -= counts[k];
+            remainingProb -= probs[k];
+        }
+        // Rounding might leave shots over, which go to the likeliest operator.
+        counts[likeliest] += remainingShots;
+
+        std::vector<size_t> branches;
+        size_t largest = 0U;
+        for (size_t k = 0U; k < krausCount; ++k) {
+            if (!counts[k]) {
+                continue;
+            }
+            if (!branches.size() || (counts[k] > counts[branches[largest]])) {
+                largest = branches.size();
+            }
+            branches.push_back(k);
+        }
+
+        if (branches.size() == 1U) {
+            sim->ApplyKraus1Qb(&(kraus[branches[0U] << 2U]), qubit);
+            continue;
+        }
+
+        // Every branch but the largest gets a clone, before the largest continues on "sim."
+        std::vector<QInterfacePtr> sims(branches.size());
+        std::vector<uint64_t> streams(branches.size());
+        for (size_t i = 0U; i < branches.size(); ++i) {
+            sims[i] = (i == largest) ? sim : sim->Clone();
+            streams[i] = gen();
+        }
+
+        const auto runBranch = [&](const size_t& i) {
+            sims[i]->ApplyKraus1Qb(&(kraus[branches[i] << 2U]), qubit);
+            RunTrajectory(ctx, sims[i], gate, channel, counts[branches[i]], streams[i]);
+            sims[i] = NULL;
+        };
+#if ENABLE_PTHREAD
+        ParallelPool::Instance().Run((bitCapIntOcl)branches.size(), (unsigned)branches.size(),
+            [&runBranch](const bitCapIntOcl& i, const unsigned& cpu) { runBranch((size_t)i); });
+#else
+        for (size_t i = 0U; i < branches.size(); ++i) {
+            runBranch(i);
+        }
+#endif
+
+        return;
+    }
+
+    SampleTrajectory(ctx, sim, shots, gen);
+}
+
+void QNoiseModel::SampleTrajectory(TrajectoryContext& ctx, QInterfacePtr sim, unsigned shots, CounterRng& gen)
+{
+    // Clones share the random generator of the simulator they came from, so sampling is serialized.
+    std::unique_lock<std::mutex> lock(ctx.resultsMutex);
+    const std::map<bitCapInt, int> sampled = sim->MultiShotMeasureMask(ctx.qPowers, shots);
+
+    if ((readoutFlip0 <= ZERO_R1_F) && (readoutFlip1 <= ZERO_R1_F)) {
+        for (const auto& s : sampled) {
+            ctx.results[s.first] += s.second;
+        }
+        return;
+    }
+    lock.unlock();
+
+    std::map<bitCapInt, int> flipped;
+    for (const auto& s : sampled) {
+        for (int shot = 0; shot < s.second; ++shot) {
+            bitCapInt key = s.first;
+            for (size_t i = 0U; i < ctx.qPowers.size(); ++i) {
+                const bool bit = (bool)(s.first & ctx.qPowers[i]);
+                if (gen.NextReal() < (bit ? readoutFlip1 : readoutFlip0)) {
+                    key ^= ctx.qPowers[i];
+                }
+            }
+            ++flipped[key];
+        }
+    }
+
+    lock.lock();
+    for (const auto& s : flipped) {
+        ctx.results[s.first] += s.second;
+    }
+}
+} // namespace Qrack
@@ -8,14 +8,27 @@
 // See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
 // for details.
 
+#include "common/engine_profile.hpp"
+#include "common/memory_governor.hpp"
 #include "qfactory.hpp"
 
+#if ENABLE_NUMA
+#include "common/parallel_pool.hpp"
+#endif
+
 #if ENABLE_PTHREAD
 #include <future>
 #endif
+#include <algorithm>
 #include <regex>
+#include <set>
 #include <string>
 
+// Memory-mapped (out-of-core) CPU pages allowed in RAM at once, by default
+#define QRACK_DEFAULT_RESIDENT_PAGES 8U
+// Page slots per QRACK_QPAGER_DEVICES entry, over which host pages are interleaved in proportion to throughput
+#define QRACK_COEXECUTE_SLOTS 8U
+
 namespace Qrack {
 
 QPager::QPager(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState, qrack_rand_gen_ptr rgp,
@@ -26,12 +39,19 @@ QPager::QPager(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt
     , useHardwareThreshold(false)
     , isSparse(useSparseStateVec)
     , useTGadget(true)
+    , useQubitMap(false)
+    , isQubitMapped(false)
+    , segmentGlobalQb(0U)
     , minPageQubits(0U)
+    , maxPageQubits(-1)
     , thresholdQubitsPerPage(qubitThreshold)
     , devID(deviceId)
     , phaseFactor(phaseFac)
     , deviceIDs(devList)
+    , maxResidentPages(0U)
+    , isCompressPages(false)
     , engines(eng)
+    , qubitUseClock(0U)
 {
     Init();
 
@@ -61,6 +81,8 @@ QPager::QPager(QEnginePtr enginePtr, std::vector<QInterfaceEngine> eng, bitLenIn
     : QEngine(qBitCount, rgp, false, false, useHostMem, useHardwareRNG, norm_thresh)
     , useHardwareThreshold(false)
     , isSparse(useSparseStateVec)
+    , useQubitMap(false)
+    , isQubitMapped(false)
     , segmentGlobalQb(0U)
     , minPageQubits(0U)
     , maxPageQubits(-1)
@@ -68,7 +90,10 @@ QPager::QPager(QEnginePtr enginePtr, std::vector<QInterfaceEngine> eng, bitLenIn
     , devID(deviceId)
     , phaseFactor(phaseFac)
     , deviceIDs(devList)
+    , maxResidentPages(0U)
+    , isCompressPages(false)
     , engines(eng)
+    , qubitUseClock(0U)
 {
     Init();
     LockEngine(enginePtr);
@@ -95,6 +120,9 @@ void QPager::Init()
     }
 
 #if ENABLE_ENV_VARS
+    if (getenv("QRACK_QPAGER_ADAPTIVE_MAP")) {
+        useQubitMap = (bool)std::stoi(std::string(getenv("QRACK_QPAGER_ADAPTIVE_MAP")));
+    }
     if (getenv("QRACK_SEGMENT_GLOBAL_QB")) {
         segmentGlobalQb = (bitLenInt)std::stoi(std::string(getenv("QRACK_SEGMENT_GLOBAL_QB")));
     }
@@ -239,6 +267,52 @@ void QPager::Init()
         deviceIDs.push_back(devID);
     }
 
+#if ENABLE_OPENCL
+#if ENABLE_ENV_VARS
+    if (((rootEngine == QINTERFACE_OPENCL) || (rootEngine == QINTERFACE_HYBRID)) && getenv("QRACK_QPAGER_COEXECUTE") &&
+        std::stoi(std::string(getenv("QRACK_QPAGER_COEXECUTE")))) {
+        InterleaveHostPages(!getenv("QRACK_QPAGER_DEVICES_HOST_POINTER"));
+    }
+#endif
+#endif
+
+#if ENABLE_ENV_VARS
+    if (rootEngine == QINTERFACE_CPU) {
+        if (getenv("QRACK_QPAGER_SPILL_PATH")) {
+            spillDir = std::string(getenv("QRACK_QPAGER_SPILL_PATH"));
+        } else if (getenv("QRACK_QPAGER_COMPRESS")) {
+            isCompressPages = (std::stoi(std::string(getenv("QRACK_QPAGER_COMPRESS"))) != 0);
+        }
+        if (spillDir.size() || isCompressPages) {
+            maxResidentPages = getenv("QRACK_QPAGER_RESIDENT_PAGES")
+                ? (size_t)std::stoi(std::string(getenv("QRACK_QPAGER_RESIDENT_PAGES")))
+                : QRACK_DEFAULT_RESIDENT_PAGES;
+        }
+    }
+#endif
+
+#if ENABLE_NUMA
+    // CPU pages are spread over NUMA nodes the same way deviceIDs spreads pages over OpenCL devices.
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_QPAGER_NUMA_NODES")) {
+        std::stringstream nodeListStr_stream(std::string(getenv("QRACK_QPAGER_NUMA_NODES")));
+        while (nodeListStr_stream.good()) {
+            std::string term;
+            getline(nodeListStr_stream, term, ',');
+            if (term.size()) {
+                numaNodes.push_back(stoi(term));
+            }
+        }
+    }
+#endif
+    if (!numaNodes.size()) {
+        const unsigned nodeCount = ParallelPool::Instance().GetNumaNodeCount();
+        for (unsigned i = 0U; i < nodeCount; ++i) {
+            numaNodes.push_back((int)i);
+        }
+    }
+#endif
+
     SetQubitCount(qubitCount);
 
     maxQubits = sizeof(bitCapIntOcl) * bitsInByte;
@@ -257,42 +331,182 @@ void QPager::Init()
     }
 }
 
+#if ENABLE_OPENCL
+void QPager::InterleaveHostPages(bool isAutoHostPointer)
+{
+    EngineProfile& profile = EngineProfile::Instance();
+    const double hostTime = profile.GetCpu().Apply2x2Time(thresholdQubitsPerPage);
+    if (profile.GetCpu().IsEmpty() || (hostTime <= 0.0)) {
+        // Without a measurement, there is no basis to split.
+        return;
+    }
+
+    // Every page does the same work per gate, so each side gets pages in proportion to its gate throughput.
+    std::set<int64_t> devices;
+    for (size_t i = 0U; i < deviceIDs.size(); ++i) {
+        if (deviceIDs[i] == QRACK_QPAGER_HOST_DEVICE) {
+            // QRACK_QPAGER_DEVICES already places host pages.
+            return;
+        }
+        devices.insert((deviceIDs[i] < 0) ? OCLEngine::Instance().GetDefaultDeviceID() : deviceIDs[i]);
+    }
+    const double hostRate = 1.0 / hostTime;
+    double deviceRate = 0.0;
+    for (const int64_t& d : devices) {
+        const double deviceTime = profile.GetDevice(d).Apply2x2Time(thresholdQubitsPerPage);
+        if (!profile.HasDevice(d) || (deviceTime <= 0.0)) {
+            return;
+        }
+        deviceRate += 1.0 / deviceTime;
+    }
+
+    const size_t slots = QRACK_COEXECUTE_SLOTS * deviceIDs.size();
+    size_t hostSlots = (size_t)(slots * hostRate / (hostRate + deviceRate) + 0.5);
+    if (!hostSlots) {
+        return;
+    }
+    if (hostSlots >= slots) {
+        // (The devices were asked for, so they keep at least one slot.)
+        hostSlots = slots - 1U;
+    }
+
+    std::vector<int64_t> mixedIDs;
+    std::vector<bool> mixedHostPointer;
+    mixedIDs.reserve(slots);
+    size_t deviceSlot = 0U;
+    for (size_t i = 0U; i < slots; ++i) {
+        // Spread host slots evenly, so any power-of-2 run of pages gets close to its share.
+        if ((((i + 1U) * hostSlots) / slots) != ((i * hostSlots) / slots)) {
+            mixedIDs.push_back(QRACK_QPAGER_HOST_DEVICE);
+            mixedHostPointer.push_back(false);
+            continue;
+        }
+
+        const int64_t d = deviceIDs[deviceSlot % deviceIDs.size()];
+        bool isHostPointer = devicesHostPointer[deviceSlot % devicesHostPointer.size()];
+        if (isAutoHostPointer && !isHostPointer) {
+            // On an integrated device, host pointer buffers are shared with the host pages without a copy.
+            const int64_t od = (d < 0) ? OCLEngine::Instance().GetDefaultDeviceID() : d;
+            isHostPointer =
+                (bool)OCLEngine::Instance().GetDeviceContextPtr(od)->device.getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>();
+        }
+        mixedIDs.push_back(d);
+        mixedHostPointer.push_back(isHostPointer);
+        ++deviceSlot;
+    }
+
+    deviceIDs = mixedIDs;
+    devicesHostPointer = mixedHostPointer;
+}
+#endif
+
+std::vector<QInterfaceEngine> QPager::HostEngines()
+{
+    std::vector<QInterfaceEngine> hostEngines(engines);
+    for (size_t i = 0U; i < hostEngines.size(); ++i) {
+        if ((hostEngines[i] == QINTERFACE_OPENCL) || (hostEngines[i] == QINTERFACE_HYBRID)) {
+            hostEngines[i] = QINTERFACE_CPU;
+        }
+    }
+
+    return hostEngines;
+}
+
 QEnginePtr QPager::MakeEngine(bitLenInt length, bitCapIntOcl pageId)
 {
-    QEnginePtr toRet =
-        std::dynamic_pointer_cast<QEngine>(CreateQuantumInterface(engines, 0U, 0U, rand_generator, phaseFactor, false,
-            false, GetPageHostPointer(pageId), GetPageDevice(pageId), useRDRAND, isSparse, (real1_f)amplitudeFloor));
+    const int64_t pageDevice = GetPageDevice(pageId);
+    const bool isHostPage = (pageDevice == QRACK_QPAGER_HOST_DEVICE);
+    QEnginePtr toRet = std::dynamic_pointer_cast<QEngine>(CreateQuantumInterface(isHostPage ? HostEngines() : engines,
+        0U, 0U, rand_generator, phaseFactor, false, false, !isHostPage && GetPageHostPointer(pageId),
+        isHostPage ? -1 : pageDevice, useRDRAND, isSparse, (real1_f)amplitudeFloor));
     toRet->SetQubitCount(length);
     toRet->SetConcurrency(GetConcurrencyLevel());
     toRet->SetTInjection(useTGadget);
+    QEngineCPUPtr cpuPage = std::dynamic_pointer_cast<QEngineCPU>(toRet);
+#if ENABLE_NUMA
+    if (cpuPage && (numaNodes.size() > 1U)) {
+        cpuPage->SetNumaNode(GetPageNumaNode(pageId));
+    }
+#endif
+    if (cpuPage && spillDir.size()) {
+        // The page was constructed in RAM; from here on, its allocations are memory-mapped.
+        cpuPage->SetMappedDir(spillDir);
+    }
+    if (cpuPage && isCompressPages) {
+        cpuPage->SetCompressEvicted(true);
+    }
 
     return toRet;
 }
 
-void QPager::GetSetAmplitudePage(complex* pagePtr, complex const* cPagePtr, bitCapIntOcl offset, bitCapIntOcl length)
+void QPager::FaultInPage(const QEnginePtr& page)
 {
-    const bitCapIntOcl pageLength = (bitCapIntOcl)pageMaxQPower();
-    bitCapIntOcl perm = 0U;
-    for (bitCapIntOcl i = 0U; i < qPages.size(); ++i) {
-        if ((perm + length) < offset) {
-            continue;
+    if (!spillDir.size() && !isCompressPages) {
+        return;
+    }
+
+    QEngineCPUPtr cpuPage = std::dynamic_pointer_cast<QEngineCPU>(page);
+    if (!cpuPage) {
+        return;
+    }
+
+    auto it = residentPageMap.find(page.get());
+    if ((it != residentPageMap.end()) && !it->second->second.expired()) {
+        residentPages.erase(it->second);
+    } else {
+        if (it != residentPageMap.end()) {
+            // A dead page's address was reused.
+            residentPages.erase(it->second);
         }
-        if (perm >= (offset + length)) {
-            break;
+        cpuPage->PrefetchStateVec();
+    }
+
+    residentPages.emplace_front(page.get(), cpuPage);
+    residentPageMap[page.get()] = residentPages.begin();
+}
+
+void QPager::EvictColdPages()
+{
+    // Under host memory pressure, every page but the most recently used one goes cold.
+    const bool isPressured = (maxResidentPages > 1U) && MemoryGovernor::Instance().IsUnderPressure(QRACK_HOST_MEMORY);
+    const size_t maxResident = isPressured ? 1U : maxResidentPages;
+    while (residentPages.size() > maxResident) {
+        auto last = std::prev(residentPages.end());
+        QEngineCPUPtr cpuPage = last->second.lock();
+        residentPageMap.erase(last->first);
+        residentPages.erase(last);
+        if (cpuPage) {
+            cpuPage->EvictStateVec();
         }
-        const bitCapInt partOffset = (perm < offset) ? (offset - perm) : 0U;
-        const bitCapInt partLength = (length < pageLength) ? length : pageLength;
+    }
+}
+
+void QPager::GetSetAmplitudePage(complex* pagePtr, complex const* cPagePtr, bitCapIntOcl offset, bitCapIntOcl length)
+{
+    if (isBadPermRange(offset, length, (bitCapIntOcl)maxQPower)) {
+        throw std::invalid_argument("QPager::GetSetAmplitudePage range is out-of-bounds!");
+    }
+
+    // The range can start and end mid-page, (as when another engine type copies from or into a page of this).
+    const bitCapIntOcl pageLength = (bitCapIntOcl)pageMaxQPower();
+    const bitCapIntOcl end = offset + length;
+    bitCapIntOcl perm = offset;
+    while (perm < end) {
+        const bitCapIntOcl page = perm / pageLength;
+        const bitCapIntOcl partOffset = perm - page * pageLength;
+        const bitCapIntOcl partLength = std::min(pageLength - partOffset, end - perm);
         if (cPagePtr) {
-            qPages[i]->SetAmplitudePage(cPagePtr, (bitCapIntOcl)partOffset, (bitCapIntOcl)partLength);
+            qPages[page]->SetAmplitudePage(cPagePtr + (perm - offset), partOffset, partLength);
         } else {
-            qPages[i]->GetAmplitudePage(pagePtr, (bitCapIntOcl)partOffset, (bitCapIntOcl)partLength);
+            qPages[page]->GetAmplitudePage(pagePtr + (perm - offset), partOffset, partLength);
         }
-        perm += pageLength;
+        perm += partLength;
     }
 }
 
 void QPager::CombineEngines(bitLenInt bit)
 {
+    QRACK_INSTRUMENT("QPager", "CombineEngines");
     if (bit > qubitCount) {
         bit = qubitCount;
     }
@@ -321,6 +535,7 @@ void QPager::CombineEngines(bitLenInt bit)
 
 void QPager::SeparateEngines(bitLenInt thresholdBits, bool noBaseFloor)
 {
+    QRACK_INSTRUMENT("QPager", "SeparateEngines");
     if (!noBaseFloor && (thresholdBits < baseQubitsPerPage)) {
         thresholdBits = baseQubitsPerPage;
     }
@@ -344,6 +559,166 @@ void QPager::SeparateEngines(bitLenInt thresholdBits, bool noBaseFloor)
     qPages = nQPages;
 }
 
+void QPager::ShufflePagePairs(bitLenInt target)
+{
+    const bitCapIntOcl targetPow = pow2Ocl(target);
+    const bitCapIntOcl targetMask = targetPow - ONE_BCI;
+    const bitCapIntOcl maxLcv = (bitCapIntOcl)qPages.size() >> ONE_BCI;
+#if ENABLE_PTHREAD
+    std::vector<std::future<void>> futures(maxLcv);
+#endif
+    for (bitCapIntOcl i = 0U; i < maxLcv; ++i) {
+        bitCapIntOcl j = i & targetMask;
+        j |= (i ^ j) << ONE_BCI;
+
+        QEnginePtr engine1 = qPages[j];
+        QEnginePtr engine2 = qPages[j + targetPow];
+        FaultInPage(engine1);
+        FaultInPage(engine2);
+
+#if ENABLE_PTHREAD
+        futures[i] = std::async(std::launch::async, [engine1, engine2]() { engine1->ShuffleBuffers(engine2); });
+#else
+        engine1->ShuffleBuffers(engine2);
+#endif
+    }
+
+#if ENABLE_PTHREAD
+    for (size_t i = 0U; i < futures.size(); ++i) {
+        futures[i].get();
+    }
+#endif
+
+    EvictColdPages();
+}
+
+void QPager::SwapPhysical(bitLenInt qubit1, bitLenInt qubit2)
+{
+    if (qubit1 == qubit2) {
+        return;
+    }
+
+    if (qubit1 > qubit2) {
+        std::swap(qubit1, qubit2);
+    }
+
+    if (qubit2 >= qubitsPerPage()) {
+        SeparateEngines();
+    }
+    const bitLenInt qpp = qubitsPerPage();
+
+    if (qubit2 < qpp) {
+        for (size_t i = 0U; i < qPages.size(); ++i) {
+            qPages[i]->Swap(qubit1, qubit2);
+        }
+        return;
+    }
+
+    if (qubit1 >= qpp) {
+        MetaSwap(qubit1, qubit2, false, false);
+        return;
+    }
+
+    // Swapping the highest local qubit with a global qubit exchanges the upper half of each page with the lower half
+    // of its partner page.
+    const bitLenInt sqi = qpp - 1U;
+    if (qubit1 != sqi) {
+        for (size_t i = 0U; i < qPages.size(); ++i) {
+            qPages[i]->Swap(qubit1, sqi);
+        }
+    }
+    ShufflePagePairs(qubit2 - qpp);
+    if (qubit1 != sqi) {
+        for (size_t i = 0U; i < qPages.size(); ++i) {
+            qPages[i]->Swap(qubit1, sqi);
+        }
+    }
+}
+
+void QPager::ResolveQubitMap()
+{
+    if (!isQubitMapped) {
+        return;
+    }
+
+    // SWAPs that reach a global qubit move page halves, so those are made one at a time, first: each puts one logical
+    // qubit in its own global position. What remains of the map then only permutes qubits within every page, which
+    // each page does in a single pass, rather than one pass per SWAP. (The first global SWAP can separate the pages,
+    // so this counts down, against the current page width.)
+    for (bitLenInt i = qubitCount; i > qubitsPerPage();) {
+        --i;
+        if (qubitMap[i] == i) {
+            continue;
+        }
+        bitLenInt j = 0U;
+        while (qubitMap[j] != i) {
+            ++j;
+        }
+        SwapPhysical(qubitMap[i], i);
+        qubitMap.swap(i, j);
+    }
+
+    const bitLenInt qpp = qubitsPerPage();
+    std::vector<bitLenInt> dest(qpp);
+    bool isIdentity = true;
+    for (bitLenInt i = 0U; i < qpp; ++i) {
+        dest[qubitMap[i]] = i;
+        isIdentity &= (qubitMap[i] == i);
+    }
+    if (!isIdentity) {
+        for (size_t i = 0U; i < qPages.size(); ++i) {
+            qPages[i]->PermuteQubits(dest);
+        }
+    }
+
+    qubitMap = QubitSwapMap(qubitCount);
+    isQubitMapped = false;
+}
+
+bitLenInt QPager::LocalizeQubit(bitLenInt qubit, const std::vector<bitLenInt>& keep)
+{
+    const bitLenInt physical = GetPhysicalQubit(qubit);
+    const bitLenInt qpp = qubitsPerPage();
+    if (!useQubitMap || !qpp || (physical < qpp)) {
+        return physical;
+    }
+
+    // Evict the least-recently-used local qubit, preferring the highest local qubit on a tie, since it costs no
+    // in-page SWAP to move.
+    const bitLenInt sqi = qpp - 1U;
+    bitLenInt victim = qubitCount;
+    bitLenInt occupant = qubitCount;
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        if (qubitMap[i] == sqi) {
+            occupant = i;
+        }
+        if ((qubitMap[i] >= qpp) || (std::find(keep.begin(), keep.end(), i) != keep.end())) {
+            continue;
+        }
+        if ((victim == qubitCount) || (qubitLastUse[i] < qubitLastUse[victim]) ||
+            ((qubitLastUse[i] == qubitLastUse[victim]) && (qubitMap[i] == sqi))) {
+            victim = i;
+        }
+    }
+
+    if (victim == qubitCount) {
+        return physical;
+    }
+
+    if (victim != occupant) {
+        const bitLenInt vPhysical = qubitMap[victim];
+        for (size_t i = 0U; i < qPages.size(); ++i) {
+            qPages[i]->Swap(vPhysical, sqi);
+        }
+        qubitMap.swap(victim, occupant);
+    }
+    ShufflePagePairs(physical - qpp);
+    qubitMap.swap(qubit, victim);
+    isQubitMapped = true;
+
+    return sqi;
+}
+
 template <typename Qubit1Fn> void QPager::SingleBitGate(bitLenInt target, Qubit1Fn fn, bool isSqiCtrl, bool isAnti)
 {
     bitLenInt qpp = qubitsPerPage();
@@ -363,10 +738,12 @@ template <typename Qubit1Fn> void QPager::SingleBitGate(bitLenInt target, Qubit1
     if (target < qpp) {
         for (bitCapIntOcl i = 0U; i < qPages.size(); ++i) {
             QEnginePtr engine = qPages[i];
+            FaultInPage(engine);
             fn(engine, target);
             if (doNormalize) {
                 engine->QueueSetDoNormalize(false);
             }
+            EvictColdPages();
         }
 
         return;
@@ -386,6 +763,8 @@ template <typename Qubit1Fn> void QPager::SingleBitGate(bitLenInt target, Qubit1
 
         QEnginePtr engine1 = qPages[j];
         QEnginePtr engine2 = qPages[j + targetPow];
+        FaultInPage(engine1);
+        FaultInPage(engine2);
 
         const bool doNrm = doNormalize;
 
@@ -415,6 +794,8 @@ template <typename Qubit1Fn> void QPager::SingleBitGate(bitLenInt target, Qubit1
         futures[i].get();
     }
 #endif
+
+    EvictColdPages();
 }
 
 // This is like the QEngineCPU and QEngineOCL logic for register-like CNOT and CCNOT, just swapping sub-engine indices
@@ -423,6 +804,7 @@ template <typename Qubit1Fn>
 void QPager::MetaControlled(bool anti, const std::vector<bitLenInt>& controls, bitLenInt target, Qubit1Fn fn,
     complex const* mtrx, bool isSqiCtrl, bool isIntraCtrled)
 {
+    QRACK_INSTRUMENT("QPager", "MetaControlled");
     const bitLenInt qpp = qubitsPerPage();
     const bitLenInt sqi = qpp - 1U;
     target -= qpp;
@@ -480,6 +862,8 @@ void QPager::MetaControlled(bool anti, const std::vector<bitLenInt>& controls, b
 
         QEnginePtr engine1 = qPages[j];
         QEnginePtr engine2 = qPages[j + targetPow];
+        FaultInPage(engine1);
+        FaultInPage(engine2);
 
         if (isSpecial) {
             if (!IS_NORM_0(ONE_CMPLX - top)) {
@@ -529,6 +913,8 @@ void QPager::MetaControlled(bool anti, const std::vector<bitLenInt>& controls, b
         futures[i].get();
     }
 #endif
+
+    EvictColdPages();
 }
 
 // This is called when control bits are "meta-" but the target bit is below the "meta-" threshold, (low enough to
@@ -536,6 +922,7 @@ void QPager::MetaControlled(bool anti, const std::vector<bitLenInt>& controls, b
 template <typename Qubit1Fn>
 void QPager::SemiMetaControlled(bool anti, std::vector<bitLenInt> controls, bitLenInt target, Qubit1Fn fn)
 {
+    QRACK_INSTRUMENT("QPager", "SemiMetaControlled");
     const bitLenInt qpp = qubitsPerPage();
 
     std::vector<bitLenInt> sortedMasks(controls.size());
@@ -561,12 +948,16 @@ void QPager::SemiMetaControlled(bool anti, std::vector<bitLenInt> controls, bitL
         }
         j |= jHi | controlMask;
 
+        FaultInPage(qPages[j]);
         fn(qPages[j], target);
+        EvictColdPages();
     }
 }
 
 template <typename F> void QPager::CombineAndOp(F fn, std::vector<bitLenInt> bits)
 {
+    ResolveQubitMap();
+
     if (qPages.size() == 1U) {
         fn(qPages[0U]);
         return;
@@ -587,7 +978,9 @@ template <typename F> void QPager::CombineAndOp(F fn, std::vector<bitLenInt> bit
     }
 
     for (bitCapIntOcl i = 0U; i < qPages.size(); ++i) {
+        FaultInPage(qPages[i]);
         fn(qPages[i]);
+        EvictColdPages();
     }
 }
 
@@ -608,6 +1001,9 @@ bitLenInt QPager::ComposeEither(QPagerPtr toCopy, bool willDestroy)
         return toRet;
     }
 
+    ResolveQubitMap();
+    toCopy->ResolveQubitMap();
+
     const bitLenInt nQubitCount = qubitCount + toCopy->qubitCount;
     if (nQubitCount > maxQubits) {
         throw std::invalid_argument(
@@ -624,6 +1020,7 @@ bitLenInt QPager::ComposeEither(QPagerPtr toCopy, bool willDestroy)
     if (qubitCount < toCopy->qubitCount) {
         QPagerPtr toCopyClone = willDestroy ? toCopy : std::dynamic_pointer_cast<QPager>(toCopy->Clone());
         toCopyClone->Compose(shared_from_this(), 0U);
+        toCopyClone->ResolveQubitMap();
         qPages = toCopyClone->qPages;
         SetQubitCount(nQubitCount);
         return toRet;
@@ -706,6 +1103,8 @@ QInterfacePtr QPager::Decompose(bitLenInt start, bitLenInt length)
 
 void QPager::Decompose(bitLenInt start, QPagerPtr dest)
 {
+    ResolveQubitMap();
+    dest->ResolveQubitMap();
     CombineEngines();
     dest->CombineEngines();
     qPages[0U]->Decompose(start, dest->qPages[0U]);
@@ -716,6 +1115,8 @@ void QPager::Decompose(bitLenInt start, QPagerPtr dest)
 
 void QPager::Dispose(bitLenInt start, bitLenInt length)
 {
+    ResolveQubitMap();
+
     if (qubitCount <= thresholdQubitsPerPage) {
         CombineEngines();
         return qPages[0U]->Dispose(start, length);
@@ -750,6 +1151,8 @@ void QPager::Dispose(bitLenInt start, bitLenInt length)
 
 void QPager::Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm)
 {
+    ResolveQubitMap();
+
     if (qubitCount <= thresholdQubitsPerPage) {
         CombineEngines();
         return qPages[0U]->Dispose(start, length, disposedPerm);
@@ -800,6 +1203,7 @@ bitLenInt QPager::Allocate(bitLenInt start, bitLenInt length)
 
 void QPager::SetQuantumState(complex const* inputState)
 {
+    ResetQubitMap();
     const bitCapIntOcl pagePower = (bitCapIntOcl)pageMaxQPower();
     bitCapIntOcl pagePerm = 0U;
 #if ENABLE_PTHREAD
@@ -828,8 +1232,32 @@ void QPager::SetQuantumState(complex const* inputState)
 #endif
 }
 
+void QPager::ScatterAmplitudes(bitCapIntOcl const* perms, complex const* amps, bitCapIntOcl count)
+{
+    // Sort the amplitudes into their pages, and scatter each page's share in one call.
+    const bitCapIntOcl pmqp = pageMaxQPower();
+    std::vector<std::vector<bitCapIntOcl>> pagePerms(qPages.size());
+    std::vector<std::vector<complex>> pageAmps(qPages.size());
+    for (bitCapIntOcl i = 0U; i < count; ++i) {
+        const bitCapIntOcl perm = (bitCapIntOcl)GetPhysicalPerm(perms[i]);
+        const bitCapIntOcl subIndex = perm / pmqp;
+        if (subIndex >= qPages.size()) {
+            throw std::invalid_argument("QPager::ScatterAmplitudes argument out-of-bounds!");
+        }
+        pagePerms[subIndex].push_back(perm & (pmqp - ONE_BCI));
+        pageAmps[subIndex].push_back(amps[i]);
+    }
+
+    for (size_t i = 0U; i < qPages.size(); ++i) {
+        if (pagePerms[i].size()) {
+            qPages[i]->ScatterAmplitudes(pagePerms[i].data(), pageAmps[i].data(), pagePerms[i].size());
+        }
+    }
+}
+
 void QPager::GetQuantumState(complex* outputState)
 {
+    ResolveQubitMap();
     const bitCapIntOcl pagePower = (bitCapIntOcl)pageMaxQPower();
     bitCapIntOcl pagePerm = 0U;
 #if ENABLE_PTHREAD
@@ -854,6 +1282,7 @@ void QPager::GetQuantumState(complex* outputState)
 
 void QPager::GetProbs(real1* outputProbs)
 {
+    ResolveQubitMap();
     const bitCapIntOcl pagePower = (bitCapIntOcl)pageMaxQPower();
     bitCapIntOcl pagePerm = 0U;
 #if ENABLE_PTHREAD
@@ -878,6 +1307,7 @@ void QPager::GetProbs(real1* outputProbs)
 
 void QPager::SetPermutation(bitCapInt perm, complex phaseFac)
 {
+    ResetQubitMap();
     const bitCapIntOcl pagePower = (bitCapIntOcl)pageMaxQPower();
     perm &= maxQPower - ONE_BCI;
     bitCapIntOcl pagePerm = 0U;
@@ -897,6 +1327,7 @@ void QPager::SetPermutation(bitCapInt perm, complex phaseFac)
 
 void QPager::Mtrx(complex const* mtrx, bitLenInt target)
 {
+    QRACK_INSTRUMENT("QPager", "Mtrx");
     if (IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U])) {
         Phase(mtrx[0U], mtrx[3U], target);
         return;
@@ -906,7 +1337,8 @@ void QPager::Mtrx(complex const* mtrx, bitLenInt target)
     }
 
     SeparateEngines();
-    SingleBitGate(target, [mtrx](QEnginePtr engine, bitLenInt lTarget) { engine->Mtrx(mtrx, lTarget); });
+    SingleBitGate(
+        LocalizeQubit(target), [mtrx](QEnginePtr engine, bitLenInt lTarget) { engine->Mtrx(mtrx, lTarget); });
 }
 
 void QPager::ApplySingleEither(bool isInvert, complex top, complex bottom, bitLenInt target)
@@ -960,7 +1392,15 @@ void QPager::ApplyEitherControlledSingleBit(
         return;
     }
 
+    const bool isSpecial =
+        (IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U])) || (IS_NORM_0(mtrx[0U]) && IS_NORM_0(mtrx[3U]));
+    const bitLenInt lTarget = target;
+    target = GetPhysicalQubit(target);
     SeparateEngines(target + 1U);
+    if (!isSpecial) {
+        // (Diagonal and anti-diagonal gates on a global target need no page shuffle, so they don't move qubits.)
+        target = LocalizeQubit(lTarget, controls);
+    }
 
     bitLenInt qpp = qubitsPerPage();
 
@@ -968,12 +1408,13 @@ void QPager::ApplyEitherControlledSingleBit(
     std::vector<bitLenInt> intraControls;
     bool isSqiCtrl = false;
     for (size_t i = 0U; i < controls.size(); ++i) {
-        if ((target >= qpp) && (controls[i] == (qpp - 1U))) {
+        const bitLenInt control = GetPhysicalQubit(controls[i]);
+        if ((target >= qpp) && (control == (qpp - 1U))) {
             isSqiCtrl = true;
-        } else if (controls[i] < qpp) {
-            intraControls.push_back(controls[i]);
+        } else if (control < qpp) {
+            intraControls.push_back(control);
         } else {
-            metaControls.push_back(controls[i]);
+            metaControls.push_back(control);
         }
     }
 
@@ -998,6 +1439,16 @@ void QPager::ApplyEitherControlledSingleBit(
     }
 }
 
+void QPager::MtrxN(complex const* mtrx, const std::vector<bitLenInt>& targets)
+{
+    if (targets.size() == 1U) {
+        Mtrx(mtrx, targets[0U]);
+        return;
+    }
+
+    CombineAndOp([&](QEnginePtr engine) { engine->MtrxN(mtrx, targets); }, targets);
+}
+
 void QPager::UniformParityRZ(bitCapInt mask, real1_f angle)
 {
     CombineAndOp([&](QEnginePtr engine) { engine->UniformParityRZ(mask, angle); }, { log2(mask) });
@@ -1011,6 +1462,7 @@ void QPager::CUniformParityRZ(const std::vector<bitLenInt>& controls, bitCapInt
 
 void QPager::XMask(bitCapInt mask)
 {
+    mask = GetPhysicalPerm(mask);
     const bitCapInt pageMask = pageMaxQPower() - ONE_BCI;
     const bitCapIntOcl intraMask = (bitCapIntOcl)(mask & pageMask);
     bitCapInt interMask = mask ^ (bitCapInt)intraMask;
@@ -1020,7 +1472,7 @@ void QPager::XMask(bitCapInt mask)
         v = interMask & (interMask - ONE_BCI);
         bit = log2(interMask ^ v);
         interMask = v;
-        X(bit);
+        ApplySingleEither(true, ONE_CMPLX, ONE_CMPLX, bit);
     }
 
     for (bitCapIntOcl i = 0U; i < qPages.size(); ++i) {
@@ -1030,6 +1482,7 @@ void QPager::XMask(bitCapInt mask)
 
 void QPager::PhaseParity(real1_f radians, bitCapInt mask)
 {
+    mask = GetPhysicalPerm(mask);
     const bitCapIntOcl parityStartSize = 4U * sizeof(bitCapIntOcl);
     const bitCapInt pageMask = pageMaxQPower() - ONE_BCI;
     const bitCapIntOcl intraMask = (bitCapIntOcl)(mask & pageMask);
@@ -1058,11 +1511,13 @@ void QPager::PhaseParity(real1_f radians, bitCapInt mask)
 
 bool QPager::ForceM(bitLenInt qubit, bool result, bool doForce, bool doApply)
 {
+    QRACK_INSTRUMENT("QPager", "ForceM");
     if (qPages.size() == 1U) {
-        return qPages[0U]->ForceM(qubit, result, doForce, doApply);
+        return qPages[0U]->ForceM(GetPhysicalQubit(qubit), result, doForce, doApply);
     }
 
     real1_f oneChance = Prob(qubit);
+    qubit = GetPhysicalQubit(qubit);
     if (!doForce) {
         if (oneChance >= ONE_R1) {
             result = true;
@@ -1299,6 +1754,8 @@ void QPager::MetaSwap(bitLenInt qubit1, bitLenInt qubit2, bool isIPhaseFac, bool
             continue;
         }
 
+        FaultInPage(qPages[j + qubit1Pow]);
+        FaultInPage(qPages[j + qubit2Pow]);
         if (isInverse) {
             qPages[j + qubit1Pow]->Phase(-I_CMPLX, -I_CMPLX, 0U);
             qPages[j + qubit2Pow]->Phase(-I_CMPLX, -I_CMPLX, 0U);
@@ -1306,6 +1763,7 @@ void QPager::MetaSwap(bitLenInt qubit1, bitLenInt qubit2, bool isIPhaseFac, bool
             qPages[j + qubit1Pow]->Phase(I_CMPLX, I_CMPLX, 0U);
             qPages[j + qubit2Pow]->Phase(I_CMPLX, I_CMPLX, 0U);
         }
+        EvictColdPages();
     }
 }
 
@@ -1315,22 +1773,14 @@ void QPager::Swap(bitLenInt qubit1, bitLenInt qubit2)
         return;
     }
 
-    const bool isQubit1Meta = qubit1 >= baseQubitsPerPage;
-    const bool isQubit2Meta = qubit2 >= baseQubitsPerPage;
-    if (isQubit1Meta && isQubit2Meta) {
-        SeparateEngines();
-        MetaSwap(qubit1, qubit2, false, false);
-        return;
-    }
-    if (isQubit1Meta || isQubit2Meta) {
-        SeparateEngines();
-        QInterface::Swap(qubit1, qubit2);
+    if (useQubitMap) {
+        // Relabel the qubits, instead of moving amplitudes.
+        qubitMap.swap(qubit1, qubit2);
+        isQubitMapped = true;
         return;
     }
 
-    for (size_t i = 0U; i < qPages.size(); ++i) {
-        qPages[i]->Swap(qubit1, qubit2);
-    }
+    SwapPhysical(qubit1, qubit2);
 }
 void QPager::EitherISwap(bitLenInt qubit1, bitLenInt qubit2, bool isInverse)
 {
@@ -1338,14 +1788,17 @@ void QPager::EitherISwap(bitLenInt qubit1, bitLenInt qubit2, bool isInverse)
         return;
     }
 
-    const bool isQubit1Meta = qubit1 >= baseQubitsPerPage;
-    const bool isQubit2Meta = qubit2 >= baseQubitsPerPage;
+    const bitLenInt physical1 = GetPhysicalQubit(qubit1);
+    const bitLenInt physical2 = GetPhysicalQubit(qubit2);
+    const bool isQubit1Meta = physical1 >= baseQubitsPerPage;
+    const bool isQubit2Meta = physical2 >= baseQubitsPerPage;
     if (isQubit1Meta && isQubit2Meta) {
         SeparateEngines();
-        MetaSwap(qubit1, qubit2, true, isInverse);
+        MetaSwap(physical1, physical2, true, isInverse);
         return;
     }
     if (isQubit1Meta || isQubit2Meta) {
+        // (The decomposition takes logical qubits.)
         SeparateEngines();
         if (isInverse) {
             QInterface::IISwap(qubit1, qubit2);
@@ -1357,11 +1810,11 @@ void QPager::EitherISwap(bitLenInt qubit1, bitLenInt qubit2, bool isInverse)
 
     if (isInverse) {
         for (size_t i = 0U; i < qPages.size(); ++i) {
-            qPages[i]->IISwap(qubit1, qubit2);
+            qPages[i]->IISwap(physical1, physical2);
         }
     } else {
         for (size_t i = 0U; i < qPages.size(); ++i) {
-            qPages[i]->ISwap(qubit1, qubit2);
+            qPages[i]->ISwap(physical1, physical2);
         }
     }
 }
@@ -1416,6 +1869,9 @@ void QPager::FSim(real1_f theta, real1_f phi, bitLenInt qubit1, bitLenInt qubit2
 
 real1_f QPager::Prob(bitLenInt qubit)
 {
+    QRACK_INSTRUMENT("QPager", "Prob");
+    qubit = GetPhysicalQubit(qubit);
+
     if (qPages.size() == 1U) {
         return qPages[0U]->Prob(qubit);
     }
@@ -1465,9 +1921,86 @@ real1_f QPager::Prob(bitLenInt qubit)
     return clampProb((real1_f)oneChance);
 }
 
+void QPager::ProbBits(const std::vector<bitLenInt>& bits, real1* probsArray)
+{
+    ThrowIfQbIdArrayIsBad(
+        bits, qubitCount, "QPager::ProbBits parameter bits vector values must be within allocated qubit bounds!");
+
+    // Bits within a page are summed over every page, in one pass each, and global bits are sums of page norms.
+    const bitLenInt qpp = qubitsPerPage();
+    std::vector<bitLenInt> localBits;
+    std::vector<size_t> localIndices;
+    std::vector<size_t> globalIndices;
+    std::vector<bitLenInt> globalPages;
+    for (size_t i = 0U; i < bits.size(); ++i) {
+        const bitLenInt qubit = GetPhysicalQubit(bits[i]);
+        if (qubit < qpp) {
+            localBits.push_back(qubit);
+            localIndices.push_back(i);
+        } else {
+            globalPages.push_back(qubit - qpp);
+            globalIndices.push_back(i);
+        }
+    }
+
+    if (qPages.size() == 1U) {
+        qPages[0U]->ProbBits(localBits, probsArray);
+        return;
+    }
+
+    const size_t localCount = localBits.size();
+    const bool isGlobal = globalIndices.size();
+    std::vector<real1> pageProbs(qPages.size() * localCount);
+    std::vector<real1_f> pageNorms(qPages.size(), ZERO_R1_F);
+#if ENABLE_PTHREAD
+    std::vector<std::future<void>> futures;
+#endif
+    for (bitCapIntOcl i = 0U; i < qPages.size(); ++i) {
+        QEnginePtr engine = qPages[i];
+        real1* probs = localCount ? &(pageProbs[i * localCount]) : NULL;
+        real1_f* nrm = &(pageNorms[i]);
+        const auto fn = [engine, &localBits, probs, nrm, isGlobal]() {
+            if (localBits.size()) {
+                engine->ProbBits(localBits, probs);
+            }
+            if (isGlobal) {
+                engine->UpdateRunningNorm();
+                *nrm = engine->GetRunningNorm();
+            }
+        };
+#if ENABLE_PTHREAD
+        futures.push_back(std::async(std::launch::async, fn));
+#else
+        fn();
+#endif
+    }
+#if ENABLE_PTHREAD
+    for (size_t i = 0U; i < futures.size(); ++i) {
+        futures[i].get();
+    }
+#endif
+
+    std::fill(probsArray, probsArray + bits.size(), ZERO_R1);
+    for (bitCapIntOcl i = 0U; i < qPages.size(); ++i) {
+        for (size_t j = 0U; j < localCount; ++j) {
+            probsArray[localIndices[j]] += pageProbs[i * localCount + j];
+        }
+        for (size_t j = 0U; j < globalIndices.size(); ++j) {
+            if ((i >> globalPages[j]) & 1U) {
+                probsArray[globalIndices[j]] += (real1)pageNorms[i];
+            }
+        }
+    }
+    for (size_t i = 0U; i < bits.size(); ++i) {
+        probsArray[i] = (real1)clampProb((real1_f)probsArray[i]);
+    }
+}
+
 real1_f QPager::ProbMask(bitCapInt mask, bitCapInt permutation)
 {
-    CombineEngines(log2(mask));
+    mask = GetPhysicalPerm(mask);
+    permutation = GetPhysicalPerm(permutation);
+    CombineEngines(log2(mask) + 1U);
 
     real1_f maskChance = ZERO_R1_F;
     for (bitCapIntOcl i = 0U; i < qPages.size(); ++i) {
@@ -1488,6 +2021,8 @@ real1_f QPager::ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCapInt
         }
     }
 
+    ResolveQubitMap();
+
     const bitCapIntOcl pagePower = (bitCapIntOcl)pageMaxQPower();
     real1_f expectation = ZERO_R1_F;
     bitCapIntOcl pagePerm = 0U;
@@ -1548,6 +2083,11 @@ QInterfacePtr QPager::Clone()
     for (bitCapIntOcl i = 0U; i < qPages.size(); ++i) {
         clone->qPages[i] = std::dynamic_pointer_cast<QEngine>(qPages[i]->Clone());
     }
+    clone->useQubitMap = useQubitMap;
+    clone->qubitMap = qubitMap;
+    clone->qubitLastUse = qubitLastUse;
+    clone->qubitUseClock = qubitUseClock;
+    clone->isQubitMapped = isQubitMapped;
 
     return clone;
 }
@@ -1563,10 +2103,59 @@ QEnginePtr QPager::CloneEmpty()
     for (bitCapIntOcl i = 0U; i < qPages.size(); ++i) {
         clone->qPages[i] = qPages[i]->CloneEmpty();
     }
+    clone->useQubitMap = useQubitMap;
 
     return clone;
 }
 
+void QPager::SaveCheckpoint(CheckpointWriter& writer)
+{
+    ResolveQubitMap();
+
+    // This is the QEngine format, (so QPager and single engine checkpoints are interchangeable,) with each page
+    // streamed out chunk by chunk, by global offset.
+    writer.BeginSection("QENG");
+    writer.Write<uint64_t>(qubitCount);
+
+    const bitCapIntOcl pagePower = pageMaxQPower();
+    const bitCapIntOcl chunk = std::min(pagePower, pow2Ocl(QRACK_CHECKPOINT_CHUNK_POW));
+    std::unique_ptr<complex[]> amps(new complex[chunk]);
+    for (bitCapIntOcl i = 0U; i < qPages.size(); ++i) {
+        for (bitCapIntOcl j = 0U; j < pagePower; j += chunk) {
+            qPages[i]->GetAmplitudePage(amps.get(), j, chunk);
+            writer.WriteAmplitudes(i * pagePower + j, amps.get(), chunk);
+        }
+    }
+    writer.EndAmplitudes();
+}
+
+void QPager::LoadCheckpoint(CheckpointReader& reader)
+{
+    reader.ExpectSection("QENG");
+    if (reader.Read<uint64_t>() != qubitCount) {
+        throw std::invalid_argument("QPager::LoadCheckpoint() checkpoint qubit count does not match!");
+    }
+
+    ResolveQubitMap();
+    Finish();
+
+    // Every page restores in parallel with every other; a chunk wider than our pages covers whole pages.
+    const bitLenInt qpp = qubitsPerPage();
+    const bitCapIntOcl pagePower = pageMaxQPower();
+    reader.ReadAmplitudes(
+        (bitCapIntOcl)maxQPower, [qpp](bitCapIntOcl offset) { return (size_t)(offset >> qpp); },
+        [this, qpp, pagePower](bitCapIntOcl offset, complex const* amps, bitCapIntOcl count) {
+            while (count) {
+                const bitCapIntOcl local = offset & (pagePower - 1U);
+                const bitCapIntOcl length = std::min(count, pagePower - local);
+                qPages[offset >> qpp]->SetAmplitudePage(amps, local, length);
+                amps += length;
+                offset += length;
+                count -= length;
+            }
+        });
+}
+
 real1_f QPager::SumSqrDiff(QPagerPtr toCompare)
 {
     if (this == toCompare.get()) {
@@ -1579,6 +2168,9 @@ real1_f QPager::SumSqrDiff(QPagerPtr toCompare)
         return ONE_R1_F;
     }
 
+    ResolveQubitMap();
+    toCompare->ResolveQubitMap();
+
     SeparateEngines(toCompare->qubitsPerPage());
     toCompare->SeparateEngines(qubitsPerPage());
     CombineEngines(toCompare->qubitsPerPage());
@@ -0,0 +1,629 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qpager_mpi.hpp"
+#include "qfactory.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+// Each half-slice exchange moves at most 2^QRACK_MPI_CHUNK_POW amplitudes per message.
+#define QRACK_MPI_CHUNK_POW 20U
+
+namespace Qrack {
+
+void QPagerMpi::InitMpi()
+{
+    int isInit;
+    MPI_Initialized(&isInit);
+    if (isInit) {
+        return;
+    }
+
+    // Only the thread that constructs and drives the simulator makes MPI calls.
+    int provided;
+    MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
+    std::atexit([]() {
+        int isFinalized;
+        MPI_Finalized(&isFinalized);
+        if (!isFinalized) {
+            MPI_Finalize();
+        }
+    });
+}
+
+QPagerMpi::QPagerMpi(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState,
+    qrack_rand_gen_ptr rgp, complex phaseFac, bool doNorm, bool ignored, bool useHostMem, int64_t deviceId,
+    bool useHardwareRNG, bool useSparseStateVec, real1_f norm_thresh, std::vector<int64_t> devList,
+    bitLenInt qubitThreshold, real1_f sep_thresh)
+    : QInterface(qBitCount, rgp, doNorm, useHardwareRNG, false, norm_thresh)
+    , comm(MPI_COMM_WORLD)
+    , useHostRam(useHostMem)
+    , isSparse(useSparseStateVec)
+    , devID(deviceId)
+    , thresholdQubitsPerPage(qubitThreshold)
+    , deviceIDs(devList)
+    , engines(eng)
+{
+    InitMpi();
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &rankCount);
+
+    if (rankCount & (rankCount - 1)) {
+        throw std::invalid_argument("QPagerMpi requires a power-of-2 MPI rank count!");
+    }
+    globalQubitCount = log2((bitCapInt)rankCount);
+    if (qBitCount <= globalQubitCount) {
+        throw std::invalid_argument("QPagerMpi requires more qubits than log2(MPI rank count)!");
+    }
+    localQubitCount = qBitCount - globalQubitCount;
+
+    if (!engines.size()) {
+        engines.push_back(QINTERFACE_QPAGER);
+    }
+
+    local = MakeLocalEngine(localQubitCount);
+    SetPermutation(initState, phaseFac);
+}
+
+QEnginePtr QPagerMpi::MakeLocalEngine(bitLenInt length)
+{
+    QEnginePtr toRet = std::dynamic_pointer_cast<QEngine>(CreateQuantumInterface(engines, length, 0U, rand_generator,
+        ONE_CMPLX, false, false, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs,
+        thresholdQubitsPerPage));
+    if (!toRet) {
+        throw std::invalid_argument("QPagerMpi local engine type must be a QEngine!");
+    }
+
+    return toRet;
+}
+
+real1_f QPagerMpi::LocalNorm() { return clampProb(local->Prob(0U) + local->ProbMask(ONE_BCI, 0U)); }
+
+real1_f QPagerMpi::AllReduceSum(real1_f partial)
+{
+    double in = (double)partial;
+    double out;
+    MPI_Allreduce(&in, &out, 1, MPI_DOUBLE, MPI_SUM, comm);
+
+    return (real1_f)out;
+}
+
+complex QPagerMpi::AllReduceSum(complex partial)
+{
+    double in[2U] = { (double)real(partial), (double)imag(partial) };
+    double out[2U];
+    MPI_Allreduce(in, out, 2, MPI_DOUBLE, MPI_SUM, comm);
+
+    return complex((real1)out[0U], (real1)out[1U]);
+}
+
+bool QPagerMpi::BroadcastResult(bool result)
+{
+    int v = result ? 1 : 0;
+    MPI_Bcast(&v, 1, MPI_INT, 0, comm);
+
+    return v != 0;
+}
+
+void QPagerMpi::ExchangeHalves(bitLenInt globalQubit)
+{
+    const int partner = rank ^ (1 << globalQubit);
+    const bitCapIntOcl halfPower = pow2Ocl(localQubitCount - 1U);
+    // The rank with 0 in this qubit trades its upper half; its partner trades its lower half.
+    const bitCapIntOcl offset = (rank & (1 << globalQubit)) ? 0U : halfPower;
+    const bitCapIntOcl chunk = std::min(halfPower, pow2Ocl(QRACK_MPI_CHUNK_POW));
+    const bitCapIntOcl chunkCount = halfPower / chunk;
+    const int chunkBytes = (int)(chunk * sizeof(complex));
+
+    // Double buffered: while one chunk is in flight, the next is read out of the local engine.
+    std::unique_ptr<complex[]> sendBuffers[2U] = { std::unique_ptr<complex[]>(new complex[chunk]),
+        std::unique_ptr<complex[]>(new complex[chunk]) };
+    std::unique_ptr<complex[]> recvBuffers[2U] = { std::unique_ptr<complex[]>(new complex[chunk]),
+        std::unique_ptr<complex[]>(new complex[chunk]) };
+    MPI_Request requests[2U][2U];
+
+    for (bitCapIntOcl c = 0U; c < (chunkCount + 2U); ++c) {
+        const size_t b = c & 1U;
+        if (c >= 2U) {
+            MPI_Waitall(2, requests[b], MPI_STATUSES_IGNORE);
+            local->SetAmplitudePage(recvBuffers[b].get(), offset + (c - 2U) * chunk, chunk);
+        }
+        if (c >= chunkCount) {
+            continue;
+        }
+        local->GetAmplitudePage(sendBuffers[b].get(), offset + c * chunk, chunk);
+        MPI_Irecv(recvBuffers[b].get(), chunkBytes, MPI_BYTE, partner, 0, comm, &(requests[b][0U]));
+        MPI_Isend(sendBuffers[b].get(), chunkBytes, MPI_BYTE, partner, 0, comm, &(requests[b][1U]));
+    }
+}
+
+void QPagerMpi::ApplyControlled(
+    const std::vector<bitLenInt>& controls, bool isAnti, complex const* mtrx, bitLenInt target)
+{
+    if (target >= qubitCount) {
+        throw std::invalid_argument("QPagerMpi gate target parameter must be within allocated qubit bounds!");
+    }
+
+    std::vector<bitLenInt> localControls;
+    for (size_t i = 0U; i < controls.size(); ++i) {
+        if (controls[i] >= qubitCount) {
+            throw std::invalid_argument("QPagerMpi gate control parameter must be within allocated qubit bounds!");
+        }
+        if (IsLocal(controls[i])) {
+            localControls.push_back(controls[i]);
+        } else if (GetRankBit(controls[i]) == isAnti) {
+            // This whole slice is outside the control condition, (and so is the partner slice, if any).
+            return;
+        }
+    }
+
+    if (IsLocal(target)) {
+        if (isAnti) {
+            local->MACMtrx(localControls, mtrx, target);
+        } else {
+            local->MCMtrx(localControls, mtrx, target);
+        }
+        return;
+    }
+
+    if (IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U])) {
+        // Diagonal in a rank-global qubit: just a (controlled) scalar on this slice.
+        const complex scalar = GetRankBit(target) ? mtrx[3U] : mtrx[0U];
+        if (IS_NORM_0(ONE_CMPLX - scalar)) {
+            return;
+        }
+        if (!localControls.size()) {
+            local->Phase(scalar, scalar, 0U);
+            return;
+        }
+        const bitLenInt lastControl = localControls.back();
+        localControls.pop_back();
+        if (isAnti) {
+            local->MACPhase(localControls, scalar, ONE_CMPLX, lastControl);
+        } else {
+            local->MCPhase(localControls, ONE_CMPLX, scalar, lastControl);
+        }
+        return;
+    }
+
+    // The top local qubit stands in for the global target while half-slices are exchanged, so move any control off it.
+    const bitLenInt top = localQubitCount - 1U;
+    bitLenInt moved = top;
+    auto topIt = std::find(localControls.begin(), localControls.end(), top);
+    if (topIt != localControls.end()) {
+        for (bitLenInt i = top; i > 0U; --i) {
+            if (std::find(localControls.begin(), localControls.end(), i - 1U) == localControls.end()) {
+                moved = i - 1U;
+                break;
+            }
+        }
+        if (moved == top) {
+            throw std::domain_error("QPagerMpi cannot control a rank-global gate on every local qubit!");
+        }
+        local->Swap(top, moved);
+        *topIt = moved;
+    }
+
+    const bitLenInt globalQubit = target - localQubitCount;
+    ExchangeHalves(globalQubit);
+    if (isAnti) {
+        local->MACMtrx(localControls, mtrx, top);
+    } else {
+        local->MCMtrx(localControls, mtrx, top);
+    }
+    ExchangeHalves(globalQubit);
+
+    if (moved != top) {
+        local->Swap(top, moved);
+    }
+}
+
+void QPagerMpi::SetPermutation(bitCapInt perm, complex phaseFac)
+{
+    perm &= maxQPower - ONE_BCI;
+    if (phaseFac == CMPLX_DEFAULT_ARG) {
+        phaseFac = GetNonunitaryPhase();
+    }
+
+    if ((int)(perm >> localQubitCount) == rank) {
+        local->SetPermutation(perm & (LocalMaxQPower() - ONE_BCI), phaseFac);
+    } else {
+        local->ZeroAmplitudes();
+    }
+}
+
+void QPagerMpi::SetQuantumState(complex const* inputState)
+{
+    local->SetQuantumState(inputState + (bitCapIntOcl)rank * LocalMaxQPower());
+}
+
+void QPagerMpi::GetQuantumState(complex* outputState)
+{
+    const bitCapIntOcl localPower = LocalMaxQPower();
+    if ((localPower * sizeof(complex)) > (bitCapIntOcl)INT_MAX) {
+        throw std::domain_error("QPagerMpi::GetQuantumState() slice is too large to gather!");
+    }
+
+    local->GetQuantumState(outputState + (bitCapIntOcl)rank * localPower);
+    MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, outputState, (int)(localPower * sizeof(complex)), MPI_BYTE, comm);
+}
+
+void QPagerMpi::GetProbs(real1* outputProbs)
+{
+    const bitCapIntOcl localPower = LocalMaxQPower();
+    if ((localPower * sizeof(real1)) > (bitCapIntOcl)INT_MAX) {
+        throw std::domain_error("QPagerMpi::GetProbs() slice is too large to gather!");
+    }
+
+    local->GetProbs(outputProbs + (bitCapIntOcl)rank * localPower);
+    MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, outputProbs, (int)(localPower * sizeof(real1)), MPI_BYTE, comm);
+}
+
+complex QPagerMpi::GetAmplitude(bitCapInt perm)
+{
+    if (perm >= maxQPower) {
+        throw std::invalid_argument("QPagerMpi::GetAmplitude argument out-of-bounds!");
+    }
+
+    const int owner = (int)(perm >> localQubitCount);
+    double amp[2U] = { 0.0, 0.0 };
+    if (owner == rank) {
+        const complex c = local->GetAmplitude(perm & (LocalMaxQPower() - ONE_BCI));
+        amp[0U] = (double)real(c);
+        amp[1U] = (double)imag(c);
+    }
+    MPI_Bcast(amp, 2, MPI_DOUBLE, owner, comm);
+
+    return complex((real1)amp[0U], (real1)amp[1U]);
+}
+
+void QPagerMpi::SetAmplitude(bitCapInt perm, complex amp)
+{
+    if (perm >= maxQPower) {
+        throw std::invalid_argument("QPagerMpi::SetAmplitude argument out-of-bounds!");
+    }
+
+    if ((int)(perm >> localQubitCount) == rank) {
+        local->SetAmplitude(perm & (LocalMaxQPower() - ONE_BCI), amp);
+    }
+}
+
+bitLenInt QPagerMpi::Compose(QInterfacePtr toCopy, bitLenInt start)
+{
+    if (start > localQubitCount) {
+        throw std::domain_error("QPagerMpi::Compose() can only compose below the rank-global qubits!");
+    }
+
+    const bitLenInt length = toCopy->GetQubitCount();
+    if (!length) {
+        return start;
+    }
+
+    // Every rank holds all of "toCopy," so each composes a copy into its own slice, through a local-type engine.
+    std::unique_ptr<complex[]> state(new complex[pow2Ocl(length)]);
+    toCopy->GetQuantumState(state.get());
+    QEnginePtr part = MakeLocalEngine(length);
+    part->SetQuantumState(state.get());
+    local->Compose(part, start);
+    localQubitCount += length;
+    SetQubitCount(qubitCount + length);
+
+    return start;
+}
+
+void QPagerMpi::Decompose(bitLenInt start, QInterfacePtr dest)
+{
+    const bitLenInt length = dest->GetQubitCount();
+    if ((start + length) > localQubitCount) {
+        throw std::domain_error("QPagerMpi::Decompose() can only decompose qubits below the rank-global qubits!");
+    }
+    if (length >= localQubitCount) {
+        throw std::domain_error("QPagerMpi::Decompose() must leave at least one local qubit!");
+    }
+    const bitCapIntOcl partPower = pow2Ocl(length);
+    if ((partPower * sizeof(complex)) > (bitCapIntOcl)INT_MAX) {
+        throw std::domain_error("QPagerMpi::Decompose() part is too large to broadcast!");
+    }
+
+    // The local engine keeps neither this slice's share of the global norm nor its global phase when it decomposes,
+    // so note the slice's largest amplitude first, to restore both from afterward.
+    const bitCapIntOcl localPower = LocalMaxQPower();
+    const bitCapIntOcl chunk = std::min(localPower, pow2Ocl(QRACK_MPI_CHUNK_POW));
+    std::unique_ptr<complex[]> buffer(new complex[chunk]);
+    bitCapIntOcl refIndex = 0U;
+    complex refAmp = ZERO_CMPLX;
+    for (bitCapIntOcl offset = 0U; offset < localPower; offset += chunk) {
+        local->GetAmplitudePage(buffer.get(), offset, chunk);
+        for (bitCapIntOcl i = 0U; i < chunk; ++i) {
+            if (norm(buffer[i]) > norm(refAmp)) {
+                refIndex = offset + i;
+                refAmp = buffer[i];
+            }
+        }
+    }
+    buffer.reset();
+
+    QEnginePtr part = MakeLocalEngine(length);
+    local->Decompose(start, part);
+    localQubitCount -= length;
+    SetQubitCount(qubitCount - length);
+    std::unique_ptr<complex[]> sourceState(new complex[partPower]);
+
+    // For a separable part, every slice with any weight holds the same part, up to phase, so the rank with the largest
+    // amplitude broadcasts its copy, and every rank fits its own remainder to it.
+    struct {
+        double nrm;
+        int rank;
+    } mine = { (double)norm(refAmp), rank }, source;
+    MPI_Allreduce(&mine, &source, 1, MPI_DOUBLE_INT, MPI_MAXLOC, comm);
+    if (rank == source.rank) {
+        part->GetQuantumState(sourceState.get());
+    }
+    MPI_Bcast(sourceState.get(), (int)(partPower * sizeof(complex)), MPI_BYTE, source.rank, comm);
+    // The source slice needn't hold the whole norm, so neither does its copy of the part.
+    real1 sourceNrm = ZERO_R1;
+    for (bitCapIntOcl i = 0U; i < partPower; ++i) {
+        sourceNrm += norm(sourceState[i]);
+    }
+    sourceNrm = (real1)sqrt(sourceNrm);
+    for (bitCapIntOcl i = 0U; i < partPower; ++i) {
+        sourceState[i] /= sourceNrm;
+    }
+
+    if (norm(refAmp) > ZERO_R1) {
+        // The remainder amplitude times the source part amplitude must give back the noted slice amplitude.
+        const bitCapIntOcl lowMask = pow2MaskOcl(start);
+        const bitCapIntOcl remainderIndex = (refIndex & lowMask) | ((refIndex >> (start + length)) << start);
+        const complex fit =
+            refAmp / (sourceState[(refIndex >> start) & pow2MaskOcl(length)] * local->GetAmplitude(remainderIndex));
+        local->NormalizeState((real1_f)(ONE_R1 / norm(fit)), REAL1_DEFAULT_ARG, (real1_f)std::arg(fit));
+    }
+
+    dest->SetQuantumState(sourceState.get());
+}
+
+QInterfacePtr QPagerMpi::Decompose(bitLenInt start, bitLenInt length)
+{
+    QEnginePtr dest = MakeLocalEngine(length);
+    Decompose(start, dest);
+
+    return dest;
+}
+
+bitLenInt QPagerMpi::Allocate(bitLenInt start, bitLenInt length)
+{
+    if (start > localQubitCount) {
+        throw std::domain_error("QPagerMpi::Allocate() can only allocate below the rank-global qubits!");
+    }
+
+    if (!length) {
+        return start;
+    }
+
+    local->Allocate(start, length);
+    localQubitCount += length;
+    SetQubitCount(qubitCount + length);
+
+    return start;
+}
+
+void QPagerMpi::Dispose(bitLenInt start, bitLenInt length)
+{
+    if ((start + length) > localQubitCount) {
+        throw std::domain_error("QPagerMpi::Dispose() can only dispose qubits below the rank-global qubits!");
+    }
+    if (length >= localQubitCount) {
+        throw std::domain_error("QPagerMpi::Dispose() must leave at least one local qubit!");
+    }
+
+    // The local engine renormalizes its own slice, so restore this slice's share of the global norm.
+    const real1_f nrm = LocalNorm();
+    local->Dispose(start, length);
+    localQubitCount -= length;
+    SetQubitCount(qubitCount - length);
+    if (nrm > ZERO_R1_F) {
+        local->NormalizeState(LocalNorm() / nrm);
+    }
+}
+
+void QPagerMpi::Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm)
+{
+    if ((start + length) > localQubitCount) {
+        throw std::domain_error("QPagerMpi::Dispose() can only dispose qubits below the rank-global qubits!");
+    }
+    if (length >= localQubitCount) {
+        throw std::domain_error("QPagerMpi::Dispose() must leave at least one local qubit!");
+    }
+
+    const real1_f nrm = LocalNorm();
+    local->Dispose(start, length, disposedPerm);
+    localQubitCount -= length;
+    SetQubitCount(qubitCount - length);
+    if (nrm > ZERO_R1_F) {
+        local->NormalizeState(LocalNorm() / nrm);
+    }
+}
+
+void QPagerMpi::Swap(bitLenInt qubit1, bitLenInt qubit2)
+{
+    if (qubit1 == qubit2) {
+        return;
+    }
+
+    if (IsLocal(qubit1) && IsLocal(qubit2)) {
+        local->Swap(qubit1, qubit2);
+        return;
+    }
+
+    QInterface::Swap(qubit1, qubit2);
+}
+
+void QPagerMpi::FSim(real1_f theta, real1_f phi, bitLenInt qubit1, bitLenInt qubit2)
+{
+    if (qubit1 == qubit2) {
+        return;
+    }
+
+    // Swap any rank-global operand down into a free local qubit, (from the top,) apply locally, and swap back.
+    bitLenInt l1 = qubit1, l2 = qubit2;
+    bitLenInt scratch = localQubitCount;
+    if (!IsLocal(l1)) {
+        do {
+            if (!scratch) {
+                throw std::domain_error("QPagerMpi::FSim() has no free local qubit to swap into!");
+            }
+            --scratch;
+        } while (scratch == l2);
+        l1 = scratch;
+    }
+    if (!IsLocal(l2)) {
+        do {
+            if (!scratch) {
+                throw std::domain_error("QPagerMpi::FSim() has no free local qubit to swap into!");
+            }
+            --scratch;
+        } while (scratch == l1);
+        l2 = scratch;
+    }
+
+    Swap(qubit1, l1);
+    Swap(qubit2, l2);
+    local->FSim(theta, phi, l1, l2);
+    Swap(qubit2, l2);
+    Swap(qubit1, l1);
+}
+
+bool QPagerMpi::ForceM(bitLenInt qubit, bool result, bool doForce, bool doApply)
+{
+    if (qubit >= qubitCount) {
+        throw std::invalid_argument("QPagerMpi::ForceM qubit index parameter must be within allocated qubit bounds!");
+    }
+
+    const real1_f oneChance = Prob(qubit);
+    if (!doForce) {
+        if (oneChance >= ONE_R1) {
+            result = true;
+        } else if (oneChance <= ZERO_R1) {
+            result = false;
+        } else {
+            // Every rank must agree on the outcome.
+            result = BroadcastResult(Rand() <= oneChance);
+        }
+    }
+
+    const real1 nrmlzr = result ? oneChance : (ONE_R1 - oneChance);
+    if (nrmlzr <= ZERO_R1) {
+        throw std::invalid_argument("QPagerMpi::ForceM() forced a measurement result with 0 probability");
+    }
+
+    if (!doApply || ((ONE_R1 - nrmlzr) <= ZERO_R1)) {
+        return result;
+    }
+
+    if (IsLocal(qubit)) {
+        const complex nrmFac = GetNonunitaryPhase() / (real1)std::sqrt((real1_s)nrmlzr);
+        local->ApplyM(pow2Ocl(qubit), result, nrmFac);
+    } else if (GetRankBit(qubit) == result) {
+        local->NormalizeState((real1_f)nrmlzr);
+    } else {
+        local->ZeroAmplitudes();
+    }
+
+    return result;
+}
+
+real1_f QPagerMpi::Prob(bitLenInt qubit)
+{
+    if (qubit >= qubitCount) {
+        throw std::invalid_argument("QPagerMpi::Prob qubit index parameter must be within allocated qubit bounds!");
+    }
+
+    if (IsLocal(qubit)) {
+        return clampProb(AllReduceSum(local->Prob(qubit)));
+    }
+
+    return clampProb(AllReduceSum(GetRankBit(qubit) ? LocalNorm() : ZERO_R1_F));
+}
+
+real1_f QPagerMpi::ProbMask(bitCapInt mask, bitCapInt permutation)
+{
+    const bitCapInt localMask = mask & (LocalMaxQPower() - ONE_BCI);
+    const bitCapIntOcl globalMask = (bitCapIntOcl)(mask >> localQubitCount);
+    const bitCapIntOcl globalPerm = (bitCapIntOcl)(permutation >> localQubitCount);
+
+    real1_f partial = ZERO_R1_F;
+    if (!(((bitCapIntOcl)rank ^ globalPerm) & globalMask)) {
+        partial = localMask ? local->ProbMask(localMask, permutation & localMask) : LocalNorm();
+    }
+
+    return clampProb(AllReduceSum(partial));
+}
+
+real1_f QPagerMpi::SumSqrDiff(QPagerMpiPtr toCompare)
+{
+    if (!toCompare || (qubitCount != toCompare->qubitCount)) {
+        return ONE_R1_F;
+    }
+
+    if (this == toCompare.get()) {
+        return ZERO_R1_F;
+    }
+
+    if (doNormalize) {
+        NormalizeState();
+    }
+    if (toCompare->doNormalize) {
+        toCompare->NormalizeState();
+    }
+
+    const bitCapIntOcl localPower = LocalMaxQPower();
+    const bitCapIntOcl chunk = std::min(localPower, pow2Ocl(QRACK_MPI_CHUNK_POW));
+    std::unique_ptr<complex[]> lBuffer(new complex[chunk]);
+    std::unique_ptr<complex[]> rBuffer(new complex[chunk]);
+    complex partInner = ZERO_CMPLX;
+    for (bitCapIntOcl offset = 0U; offset < localPower; offset += chunk) {
+        local->GetAmplitudePage(lBuffer.get(), offset, chunk);
+        toCompare->local->GetAmplitudePage(rBuffer.get(), offset, chunk);
+        for (bitCapIntOcl i = 0U; i < chunk; ++i) {
+            partInner += conj(lBuffer[i]) * rBuffer[i];
+        }
+    }
+
+    return ONE_R1_F - clampProb((real1_f)norm(AllReduceSum(partInner)));
+}
+
+void QPagerMpi::UpdateRunningNorm(real1_f norm_thresh) { local->UpdateRunningNorm(norm_thresh); }
+
+void QPagerMpi::NormalizeState(real1_f nrm, real1_f norm_thresh, real1_f phaseArg)
+{
+    if (nrm == REAL1_DEFAULT_ARG) {
+        nrm = AllReduceSum(LocalNorm());
+    }
+
+    if (nrm <= ZERO_R1_F) {
+        return;
+    }
+
+    local->NormalizeState(nrm, norm_thresh, phaseArg);
+}
+
+QInterfacePtr QPagerMpi::Clone()
+{
+    QPagerMpiPtr clone = std::make_shared<QPagerMpi>(engines, qubitCount, 0U, rand_generator, ONE_CMPLX, doNormalize,
+        false, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs, thresholdQubitsPerPage);
+    clone->local = std::dynamic_pointer_cast<QEngine>(local->Clone());
+
+    return clone;
+}
+} // namespace Qrack
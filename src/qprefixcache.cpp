@@ -0,0 +1,666 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qfactory.hpp"
+
+#include "common/checkpoint.hpp"
+
+#include <cstring>
+#include <sstream>
+
+#define QRACK_PREFIX_CACHE_DEFAULT_BYTES ((size_t)1U << 30U)
+#define QRACK_PREFIX_CACHE_DEFAULT_INTERVAL 16U
+
+namespace Qrack {
+
+namespace {
+uint64_t Mix(uint64_t h)
+{
+    // splitmix64 finalizer
+    h = (h ^ (h >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27U)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31U);
+}
+
+size_t DefaultMaxBytes()
+{
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_PREFIX_CACHE_MAX_MB")) {
+        return (size_t)std::stoull(std::string(getenv("QRACK_PREFIX_CACHE_MAX_MB"))) << 20U;
+    }
+#endif
+
+    return QRACK_PREFIX_CACHE_DEFAULT_BYTES;
+}
+} // namespace
+
+void QPrefixCacheStore::Evict(std::unordered_map<uint64_t, Entry>::iterator it)
+{
+    usedBytes -= it->second.bytes;
+    lru.erase(it->second.lruIt);
+    entries.erase(it);
+}
+
+void QPrefixCacheStore::SetMaxBytes(size_t mxBytes)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    maxBytes = mxBytes;
+    while (usedBytes > maxBytes) {
+        Evict(entries.find(lru.back()));
+    }
+}
+
+void QPrefixCacheStore::Clear()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    entries.clear();
+    lru.clear();
+    usedBytes = 0U;
+    hits = 0U;
+    misses = 0U;
+}
+
+bool QPrefixCacheStore::Has(uint64_t key, uint64_t check, bitLenInt qubitCount)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    const auto it = entries.find(key);
+    return (it != entries.end()) && (it->second.check == check) && (it->second.qubitCount == qubitCount);
+}
+
+void QPrefixCacheStore::Put(uint64_t key, uint64_t check, bitLenInt qubitCount, QInterfacePtr snapshot,
+    std::shared_ptr<std::string> blob, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    if (bytes > maxBytes) {
+        return;
+    }
+
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        Evict(it);
+    }
+    while ((usedBytes + bytes) > maxBytes) {
+        Evict(entries.find(lru.back()));
+    }
+
+    lru.push_front(key);
+    entries[key] = Entry{ check, qubitCount, snapshot, blob, bytes, lru.begin() };
+    usedBytes += bytes;
+}
+
+bool QPrefixCacheStore::Get(uint64_t key, uint64_t check, bitLenInt qubitCount, QInterfacePtr& snapshot,
+    std::shared_ptr<std::string>& blob)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    const auto it = entries.find(key);
+    if ((it == entries.end()) || (it->second.check != check) || (it->second.qubitCount != qubitCount)) {
+        return false;
+    }
+
+    lru.splice(lru.begin(), lru, it->second.lruIt);
+    snapshot = it->second.snapshot;
+    blob = it->second.blob;
+    ++hits;
+
+    return true;
+}
+
+void QPrefixCacheStore::CountMiss()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    ++misses;
+}
+
+QPrefixCache::QPrefixCache(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState,
+    qrack_rand_gen_ptr rgp, complex phaseFac, bool doNorm, bool randomGlobalPhase, bool useHostMem, int64_t deviceId,
+    bool useHardwareRNG, bool useSparseStateVec, real1_f norm_thresh, std::vector<int64_t> devList,
+    bitLenInt qubitThreshold, real1_f separation_thresh)
+    : QInterface(qBitCount, rgp, doNorm, useHardwareRNG, randomGlobalPhase, norm_thresh)
+    , engine(NULL)
+    , store(std::make_shared<QPrefixCacheStore>(DefaultMaxBytes()))
+{
+    InitSettings();
+
+    if (!eng.size()) {
+        eng.push_back(QINTERFACE_OPTIMAL);
+    }
+    engine = CreateQuantumInterface(eng, qBitCount, initState, rand_generator, phaseFac, doNorm, randomGlobalPhase,
+        useHostMem, deviceId, useHardwareRNG, useSparseStateVec, norm_thresh, devList, qubitThreshold,
+        separation_thresh);
+
+    SetPermutation(initState, phaseFac);
+}
+
+QPrefixCache::QPrefixCache(QInterfacePtr eng, QPrefixCacheStorePtr s)
+    : QInterface(eng->GetQubitCount(), nullptr, false, false, eng->GetIsArbitraryGlobalPhase())
+    , engine(eng)
+    , store(s ? s : std::make_shared<QPrefixCacheStore>(DefaultMaxBytes()))
+{
+    InitSettings();
+
+    // The wrapped state didn't come from a stream that this cache recorded.
+    isCacheable = false;
+}
+
+void QPrefixCache::InitSettings()
+{
+    isCacheable = false;
+    isPermPending = false;
+    useCheckpoints = false;
+    snapshotInterval = QRACK_PREFIX_CACHE_DEFAULT_INTERVAL;
+    depth = 0U;
+    key = 0U;
+    check = 0U;
+    initPerm = 0U;
+    initPhase = ONE_CMPLX;
+
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_PREFIX_CACHE_INTERVAL")) {
+        SetSnapshotInterval((size_t)std::stoull(std::string(getenv("QRACK_PREFIX_CACHE_INTERVAL"))));
+    }
+    if (getenv("QRACK_PREFIX_CACHE_CHECKPOINTS")) {
+        useCheckpoints = (bool)std::stoi(std::string(getenv("QRACK_PREFIX_CACHE_CHECKPOINTS")));
+    }
+#endif
+}
+
+void QPrefixCache::HashWord(uint64_t word)
+{
+    // Two independent chains: "key" indexes the store, and "check" must also match, for a hit.
+    key = Mix(key ^ word);
+    check = Mix(check + word * 0x9e3779b97f4a7c15ULL + 0x632be59bd9b4e019ULL);
+}
+
+void QPrefixCache::HashPerm(bitCapInt perm)
+{
+    // (Shifted in steps of 16 bits, which no bitCapInt width overflows.)
+    for (size_t i = 0U; i < sizeof(bitCapInt); i += 8U) {
+        HashWord((uint64_t)perm);
+        for (size_t j = 0U; j < 4U; ++j) {
+            perm >>= 16U;
+        }
+    }
+}
+
+void QPrefixCache::HashReal(real1_f r)
+{
+    // Exact bits, so only an identical gate continues a cached prefix
+    const double d = (double)r;
+    uint64_t word;
+    std::memcpy(&word, &d, sizeof(uint64_t));
+    HashWord(word);
+}
+
+void QPrefixCache::Record(PrefixOp& op)
+{
+    if (!isCacheable) {
+        Materialize();
+        Apply(op);
+        return;
+    }
+
+    HashWord((uint64_t)op.type);
+    HashWord((uint64_t)op.controls.size());
+    for (const bitLenInt& c : op.controls) {
+        HashWord((uint64_t)c);
+    }
+    HashWord((uint64_t)op.target1);
+    HashWord((uint64_t)op.target2);
+    switch (op.type) {
+    case PREFIX_MTRX:
+    case PREFIX_MCMTRX:
+    case PREFIX_MACMTRX:
+        for (size_t i = 0U; i < 4U; ++i) {
+            HashReal((real1_f)real(op.mtrx[i]));
+            HashReal((real1_f)imag(op.mtrx[i]));
+        }
+        break;
+    case PREFIX_FSIM:
+        HashReal(op.theta);
+        HashReal(op.phi);
+        break;
+    case PREFIX_PARITY_RZ:
+        HashPerm(op.mask);
+        HashReal(op.theta);
+        break;
+    case PREFIX_SWAP:
+    default:
+        break;
+    }
+
+    ++depth;
+    op.key = key;
+    op.check = check;
+    op.depth = depth;
+    pending.push_back(op);
+}
+
+QParity* QPrefixCache::EngineParity()
+{
+    QParity* p = dynamic_cast<QParity*>(engine.get());
+    if (!p) {
+        throw std::domain_error("QPrefixCache wrapped simulator does not support parity operations!");
+    }
+
+    return p;
+}
+
+void QPrefixCache::Apply(const PrefixOp& op)
+{
+    switch (op.type) {
+    case PREFIX_MTRX:
+        engine->Mtrx(op.mtrx, op.target1);
+        break;
+    case PREFIX_MCMTRX:
+        engine->MCMtrx(op.controls, op.mtrx, op.target1);
+        break;
+    case PREFIX_MACMTRX:
+        engine->MACMtrx(op.controls, op.mtrx, op.target1);
+        break;
+    case PREFIX_SWAP:
+        engine->Swap(op.target1, op.target2);
+        break;
+    case PREFIX_FSIM:
+        engine->FSim(op.theta, op.phi, op.target1, op.target2);
+        break;
+    case PREFIX_PARITY_RZ:
+        EngineParity()->CUniformParityRZ(op.controls, op.mask, op.theta);
+        break;
+    }
+}
+
+void QPrefixCache::Snapshot(const PrefixOp& op)
+{
+    if (!store->GetMaxBytes() || store->Has(op.key, op.check, qubitCount)) {
+        return;
+    }
+
+    if (useCheckpoints) {
+        try {
+            std::ostringstream oss;
+            CheckpointWriter writer(oss, true);
+            engine->SaveCheckpoint(writer);
+            std::shared_ptr<std::string> blob = std::make_shared<std::string>(oss.str());
+            store->Put(op.key, op.check, qubitCount, NULL, blob, blob->size());
+            return;
+        } catch (const std::domain_error&) {
+            // This engine doesn't checkpoint, so it falls back to clones.
+        }
+    }
+
+    // A clone is charged as a dense state vector, (which bounds every engine,) unless that couldn't fit at all.
+    const size_t bytes = (qubitCount < ((sizeof(size_t) << 3U) - 5U)) ? (sizeof(complex) << qubitCount) : SIZE_MAX;
+    if (bytes > store->GetMaxBytes()) {
+        return;
+    }
+    store->Put(op.key, op.check, qubitCount, engine->Clone(), NULL, bytes);
+}
+
+bool QPrefixCache::Restore(const PrefixOp& op)
+{
+    QInterfacePtr snapshot;
+    std::shared_ptr<std::string> blob;
+    if (!store->Get(op.key, op.check, qubitCount, snapshot, blob)) {
+        return false;
+    }
+
+    if (blob) {
+        std::istringstream iss(*blob);
+        CheckpointReader reader(iss);
+        engine->LoadCheckpoint(reader);
+    } else {
+        // The cached snapshot stays pristine for the next run.
+        engine = snapshot->Clone();
+    }
+
+    return true;
+}
+
+void QPrefixCache::Materialize()
+{
+    if (!isPermPending && !pending.size()) {
+        return;
+    }
+
+    // Resume from the deepest cached prefix, (which can only end on a snapshot depth).
+    size_t start = 0U;
+    if (isCacheable && store->GetMaxBytes()) {
+        for (size_t i = pending.size(); i > 0U; --i) {
+            if (!(pending[i - 1U].depth % snapshotInterval) && Restore(pending[i - 1U])) {
+                start = i;
+                break;
+            }
+        }
+        if (!start && pending.size()) {
+            store->CountMiss();
+        }
+    }
+
+    if (!start && isPermPending) {
+        engine->SetPermutation(initPerm, initPhase);
+    }
+    isPermPending = false;
+
+    for (size_t i = start; i < pending.size(); ++i) {
+        const PrefixOp& op = pending[i];
+        Apply(op);
+        if (isCacheable && !(op.depth % snapshotInterval)) {
+            Snapshot(op);
+        }
+    }
+    pending.clear();
+}
+
+void QPrefixCache::SetPermutation(bitCapInt perm, complex phaseFac)
+{
+    pending.clear();
+    initPerm = perm;
+    initPhase = phaseFac;
+    isPermPending = true;
+    isCacheable = true;
+    depth = 0U;
+
+    // Each stream is seeded by the register width and initial state.
+    key = 0U;
+    check = 0U;
+    HashWord((uint64_t)qubitCount);
+    HashPerm(perm);
+    if (phaseFac == CMPLX_DEFAULT_ARG) {
+        HashWord(1U);
+    } else {
+        HashWord(0U);
+        HashReal((real1_f)real(phaseFac));
+        HashReal((real1_f)imag(phaseFac));
+    }
+}
+
+void QPrefixCache::SetQuantumState(complex const* inputState)
+{
+    pending.clear();
+    isPermPending = false;
+    engine->SetQuantumState(inputState);
+    EndCaching();
+}
+
+void QPrefixCache::GetQuantumState(complex* outputState)
+{
+    Materialize();
+    engine->GetQuantumState(outputState);
+}
+
+void QPrefixCache::GetProbs(real1* outputProbs)
+{
+    Materialize();
+    engine->GetProbs(outputProbs);
+}
+
+complex QPrefixCache::GetAmplitude(bitCapInt perm)
+{
+    Materialize();
+    return engine->GetAmplitude(perm);
+}
+
+void QPrefixCache::SetAmplitude(bitCapInt perm, complex amp)
+{
+    Materialize();
+    engine->SetAmplitude(perm, amp);
+    EndCaching();
+}
+
+bitLenInt QPrefixCache::Compose(QInterfacePtr toCopy, bitLenInt start)
+{
+    Materialize();
+    const bitLenInt toRet = engine->Compose(Unwrap(toCopy), start);
+    EndCaching();
+
+    return toRet;
+}
+
+void QPrefixCache::Decompose(bitLenInt start, QInterfacePtr dest)
+{
+    Materialize();
+
+    QPrefixCachePtr destCache = std::dynamic_pointer_cast<QPrefixCache>(dest);
+    engine->Decompose(start, Unwrap(dest));
+    if (destCache) {
+        destCache->EndCaching();
+    }
+    EndCaching();
+}
+
+QInterfacePtr QPrefixCache::Decompose(bitLenInt start, bitLenInt length)
+{
+    Materialize();
+
+    QPrefixCachePtr dest = std::make_shared<QPrefixCache>(engine->Decompose(start, length), store);
+    dest->snapshotInterval = snapshotInterval;
+    dest->useCheckpoints = useCheckpoints;
+    EndCaching();
+
+    return dest;
+}
+
+void QPrefixCache::Dispose(bitLenInt start, bitLenInt length)
+{
+    Materialize();
+    engine->Dispose(start, length);
+    EndCaching();
+}
+
+void QPrefixCache::Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm)
+{
+    Materialize();
+    engine->Dispose(start, length, disposedPerm);
+    EndCaching();
+}
+
+bitLenInt QPrefixCache::Allocate(bitLenInt start, bitLenInt length)
+{
+    Materialize();
+    const bitLenInt toRet = engine->Allocate(start, length);
+    EndCaching();
+
+    return toRet;
+}
+
+void QPrefixCache::Mtrx(complex const* mtrx, bitLenInt target)
+{
+    PrefixOp op{ PREFIX_MTRX, {}, { mtrx[0U], mtrx[1U], mtrx[2U], mtrx[3U] }, target, target, 0U, ZERO_R1_F,
+        ZERO_R1_F, 0U, 0U, 0U };
+    Record(op);
+}
+
+void QPrefixCache::MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+{
+    PrefixOp op{ PREFIX_MCMTRX, controls, { mtrx[0U], mtrx[1U], mtrx[2U], mtrx[3U] }, target, target, 0U, ZERO_R1_F,
+        ZERO_R1_F, 0U, 0U, 0U };
+    Record(op);
+}
+
+void QPrefixCache::MACMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+{
+    PrefixOp op{ PREFIX_MACMTRX, controls, { mtrx[0U], mtrx[1U], mtrx[2U], mtrx[3U] }, target, target, 0U,
+        ZERO_R1_F, ZERO_R1_F, 0U, 0U, 0U };
+    Record(op);
+}
+
+void QPrefixCache::Swap(bitLenInt qubit1, bitLenInt qubit2)
+{
+    if (qubit1 == qubit2) {
+        return;
+    }
+
+    PrefixOp op{ PREFIX_SWAP, {}, { ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX }, qubit1, qubit2, 0U, ZERO_R1_F,
+        ZERO_R1_F, 0U, 0U, 0U };
+    Record(op);
+}
+
+void QPrefixCache::FSim(real1_f theta, real1_f phi, bitLenInt qubit1, bitLenInt qubit2)
+{
+    PrefixOp op{ PREFIX_FSIM, {}, { ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX }, qubit1, qubit2, 0U, theta, phi,
+        0U, 0U, 0U };
+    Record(op);
+}
+
+void QPrefixCache::CUniformParityRZ(const std::vector<bitLenInt>& controls, bitCapInt mask, real1_f angle)
+{
+    PrefixOp op{ PREFIX_PARITY_RZ, controls, { ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX }, 0U, 0U, mask, angle,
+        ZERO_R1_F, 0U, 0U, 0U };
+    Record(op);
+}
+
+bool QPrefixCache::ForceM(bitLenInt qubit, bool result, bool doForce, bool doApply)
+{
+    Materialize();
+    const bool toRet = engine->ForceM(qubit, result, doForce, doApply);
+    if (doApply) {
+        EndCaching();
+    }
+
+    return toRet;
+}
+
+bitCapInt QPrefixCache::ForceMReg(bitLenInt start, bitLenInt length, bitCapInt result, bool doForce, bool doApply)
+{
+    Materialize();
+    const bitCapInt toRet = engine->ForceMReg(start, length, result, doForce, doApply);
+    if (doApply) {
+        EndCaching();
+    }
+
+    return toRet;
+}
+
+bitCapInt QPrefixCache::MAll()
+{
+    Materialize();
+    const bitCapInt toRet = engine->MAll();
+    EndCaching();
+
+    return toRet;
+}
+
+bool QPrefixCache::ForceMParity(bitCapInt mask, bool result, bool doForce)
+{
+    Materialize();
+    const bool toRet = EngineParity()->ForceMParity(mask, result, doForce);
+    EndCaching();
+
+    return toRet;
+}
+
+real1_f QPrefixCache::ProbParity(bitCapInt mask)
+{
+    Materialize();
+    return EngineParity()->ProbParity(mask);
+}
+
+real1_f QPrefixCache::Prob(bitLenInt qubit)
+{
+    Materialize();
+    return engine->Prob(qubit);
+}
+
+real1_f QPrefixCache::ProbAll(bitCapInt fullRegister)
+{
+    Materialize();
+    return engine->ProbAll(fullRegister);
+}
+
+real1_f QPrefixCache::ProbReg(bitLenInt start, bitLenInt length, bitCapInt permutation)
+{
+    Materialize();
+    return engine->ProbReg(start, length, permutation);
+}
+
+real1_f QPrefixCache::ProbMask(bitCapInt mask, bitCapInt permutation)
+{
+    Materialize();
+    return engine->ProbMask(mask, permutation);
+}
+
+void QPrefixCache::ProbBitsAll(const std::vector<bitLenInt>& bits, real1* probsArray)
+{
+    Materialize();
+    engine->ProbBitsAll(bits, probsArray);
+}
+
+real1_f QPrefixCache::ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCapInt offset)
+{
+    Materialize();
+    return engine->ExpectationBitsAll(bits, offset);
+}
+
+std::map<bitCapInt, int> QPrefixCache::MultiShotMeasureMask(const std::vector<bitCapInt>& qPowers, unsigned shots)
+{
+    Materialize();
+    return engine->MultiShotMeasureMask(qPowers, shots);
+}
+
+void QPrefixCache::MultiShotMeasureMask(
+    const std::vector<bitCapInt>& qPowers, unsigned shots, unsigned long long* shotsArray)
+{
+    Materialize();
+    engine->MultiShotMeasureMask(qPowers, shots, shotsArray);
+}
+
+real1_f QPrefixCache::SumSqrDiff(QInterfacePtr toCompare)
+{
+    Materialize();
+    return engine->SumSqrDiff(Unwrap(toCompare));
+}
+
+void QPrefixCache::UpdateRunningNorm(real1_f norm_thresh)
+{
+    Materialize();
+    engine->UpdateRunningNorm(norm_thresh);
+}
+
+void QPrefixCache::NormalizeState(real1_f nrm, real1_f norm_thresh, real1_f phaseArg)
+{
+    Materialize();
+    engine->NormalizeState(nrm, norm_thresh, phaseArg);
+    EndCaching();
+}
+
+void QPrefixCache::SaveCheckpoint(CheckpointWriter& writer)
+{
+    Materialize();
+    engine->SaveCheckpoint(writer);
+}
+
+void QPrefixCache::LoadCheckpoint(CheckpointReader& reader)
+{
+    pending.clear();
+    isPermPending = false;
+    engine->LoadCheckpoint(reader);
+    EndCaching();
+}
+
+QInterfacePtr QPrefixCache::Clone()
+{
+    Materialize();
+
+    // The clone shares the store, so its sweeps and this one's reuse each other's prefixes.
+    QPrefixCachePtr c = std::make_shared<QPrefixCache>(engine->Clone(), store);
+    c->isCacheable = isCacheable;
+    c->useCheckpoints = useCheckpoints;
+    c->snapshotInterval = snapshotInterval;
+    c->depth = depth;
+    c->key = key;
+    c->check = check;
+
+    return c;
+}
+} // namespace Qrack
@@ -0,0 +1,42 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This utility microbenchmarks the simulation devices of this host, and saves an
+// engine profile, which Qrack consults to choose between engines by qubit count.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "common/engine_profile.hpp"
+#if ENABLE_OPENCL
+#include "common/oclengine.hpp"
+#endif
+
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+    const std::string path = (argc < 2) ? Qrack::EngineProfile::GetDefaultPath() : std::string(argv[1]);
+    const bitLenInt maxQb = (argc < 3) ? 24U : (bitLenInt)std::stoi(std::string(argv[2]));
+
+    Qrack::EngineProfile profile;
+
+    std::cout << "Profiling CPU engine, up to " << (int)maxQb << " qubits..." << std::endl;
+    profile.MeasureCpu(1U, maxQb);
+
+#if ENABLE_OPENCL
+    const int64_t deviceCount = Qrack::OCLEngine::Instance().GetDeviceCount();
+    for (int64_t i = 0; i < deviceCount; ++i) {
+        std::cout << "Profiling OpenCL device #" << i << ", up to " << (int)maxQb << " qubits..." << std::endl;
+        profile.MeasureDevice(i, 1U, maxQb);
+        std::cout << "GPU threshold: " << (int)profile.GetGpuThresholdQubits(i, 0U) << " qubits" << std::endl;
+    }
+#endif
+
+    std::cout << "Will save to: " << path << std::endl;
+    profile.Save(path);
+    std::cout << "Done profiling." << std::endl;
+}
@@ -23,6 +23,12 @@
 // for details.
 
 #include "qstabilizer.hpp"
+#include "common/counter_rng.hpp"
+#include "qengine.hpp"
+
+#if ENABLE_PTHREAD
+#include "common/parallel_pool.hpp"
+#endif
 
 #include <chrono>
 
@@ -32,6 +38,10 @@
 
 #define IS_0_R1(r) (abs(r) <= REAL1_EPSILON)
 #define IS_1_R1(r) (abs(r) <= REAL1_EPSILON)
+// Basis states are handed to a QEngine this many at a time, (as (permutation, amplitude) pairs,) in GetQuantumState()
+#define QRACK_STABILIZER_SCATTER_POW 18U
+// Tableau shots are drawn in blocks of this many, each from its own CounterRng stream, (as in SampleShots())
+#define QRACK_STABILIZER_SHOT_BLOCK 4096U
 
 namespace Qrack {
 
@@ -43,8 +53,8 @@ QStabilizer::QStabilizer(bitLenInt n, bitCapInt perm, qrack_rand_gen_ptr rgp, co
     , rawRandBoolsRemaining(0U)
     , phaseOffset(ONE_CMPLX)
     , r((n << 1U) + 1U)
-    , x((n << 1U) + 1U, BoolVector(n, false))
-    , z((n << 1U) + 1U, BoolVector(n, false))
+    , x((n << 1U) + 1U, BitRow(WordCount(n), 0U))
+    , z((n << 1U) + 1U, BitRow(WordCount(n), 0U))
 {
 #if ENABLE_QUNIT_CPU_PARALLEL && ENABLE_PTHREAD
 #if ENABLE_ENV_VARS
@@ -91,6 +101,45 @@ QInterfacePtr QStabilizer::Clone()
     return clone;
 }
 
+void QStabilizer::SaveCheckpoint(CheckpointWriter& writer)
+{
+    Finish();
+
+    writer.BeginSection("QSTB");
+    writer.Write<uint64_t>(qubitCount);
+    writer.Write<complex>(phaseOffset);
+    writer.Write<uint64_t>(r.size());
+    for (size_t i = 0U; i < r.size(); ++i) {
+        writer.Write<uint8_t>(r[i]);
+        writer.WriteRow(x[i]);
+        writer.WriteRow(z[i]);
+    }
+}
+
+void QStabilizer::LoadCheckpoint(CheckpointReader& reader)
+{
+    reader.ExpectSection("QSTB");
+    if (reader.Read<uint64_t>() != qubitCount) {
+        throw std::invalid_argument("QStabilizer::LoadCheckpoint() checkpoint qubit count does not match!");
+    }
+
+    Finish();
+
+    phaseOffset = reader.Read<complex>();
+    if (reader.Read<uint64_t>() != r.size()) {
+        throw std::runtime_error("QStabilizer::LoadCheckpoint() checkpoint tableau is invalid!");
+    }
+    const size_t wordCount = WordCount(qubitCount);
+    for (size_t i = 0U; i < r.size(); ++i) {
+        r[i] = reader.Read<uint8_t>();
+        x[i] = reader.ReadRow();
+        z[i] = reader.ReadRow();
+        if ((x[i].size() != wordCount) || (z[i].size() != wordCount)) {
+            throw std::runtime_error("QStabilizer::LoadCheckpoint() checkpoint tableau is invalid!");
+        }
+    }
+}
+
 void QStabilizer::SetPermutation(bitCapInt perm, complex phaseFac)
 {
     Dump();
@@ -104,18 +153,14 @@ void QStabilizer::SetPermutation(bitCapInt perm, complex phaseFac)
     std::fill(r.begin(), r.end(), 0U);
 
     for (bitLenInt i = 0; i < rowCount; ++i) {
-        // Dealloc, first
-        x[i] = BoolVector();
-        z[i] = BoolVector();
-
-        x[i] = BoolVector(qubitCount, false);
-        z[i] = BoolVector(qubitCount, false);
+        std::fill(x[i].begin(), x[i].end(), 0U);
+        std::fill(z[i].begin(), z[i].end(), 0U);
 
         if (i < qubitCount) {
-            x[i][i] = true;
+            SetBit(x[i], i);
         } else {
             const bitLenInt j = i - qubitCount;
-            z[i][j] = true;
+            SetBit(z[i], j);
         }
     }
 
@@ -130,37 +175,31 @@ void QStabilizer::SetPermutation(bitCapInt perm, complex phaseFac)
     }
 }
 
-/// Return the phase (0,1,2,3) when row i is LEFT-multiplied by row k
-uint8_t QStabilizer::clifford(const bitLenInt& i, const bitLenInt& k)
+/// Return the phase (0,1,2,3) when the row (xi, zi, ri) is LEFT-multiplied by row k
+uint8_t QStabilizer::clifford(const BitRow& xi, const BitRow& zi, const uint8_t& ri, const bitLenInt& k)
 {
-    // Power to which i is raised
+    const BitRow& xk = x[k];
+    const BitRow& zk = z[k];
+    const size_t wordCount = xi.size();
+
+    // Power to which i is raised, counted 64 qubits at a time
     bitLenInt e = 0U;
 
-    for (bitLenInt j = 0U; j < qubitCount; ++j) {
-        // X
-        if (x[k][j] && !z[k][j]) {
-            // XY=iZ
-            e += x[i][j] && z[i][j];
-            // XZ=-iY
-            e -= !x[i][j] && z[i][j];
-        }
-        // Y
-        if (x[k][j] && z[k][j]) {
-            // YZ=iX
-            e += !x[i][j] && z[i][j];
-            // YX=-iZ
-            e -= x[i][j] && !z[i][j];
-        }
-        // Z
-        if (!x[k][j] && z[k][j]) {
-            // ZX=iY
-            e += x[i][j] && !z[i][j];
-            // ZY=-iX
-            e -= x[i][j] && z[i][j];
-        }
+    for (size_t w = 0U; w < wordCount; ++w) {
+        const uint64_t xOnlyK = xk[w] & ~zk[w];
+        const uint64_t yK = xk[w] & zk[w];
+        const uint64_t zOnlyK = ~xk[w] & zk[w];
+        const uint64_t xOnlyI = xi[w] & ~zi[w];
+        const uint64_t yI = xi[w] & zi[w];
+        const uint64_t zOnlyI = ~xi[w] & zi[w];
+
+        // XY=iZ, YZ=iX, ZX=iY
+        e += PopCount((xOnlyK & yI) | (yK & zOnlyI) | (zOnlyK & xOnlyI));
+        // XZ=-iY, YX=-iZ, ZY=-iX
+        e -= PopCount((xOnlyK & zOnlyI) | (yK & xOnlyI) | (zOnlyK & yI));
     }
 
-    e = (e + r[i] + r[k]) & 0x3U;
+    e = (e + ri + r[k]) & 0x3U;
 
     return e;
 }
@@ -183,7 +222,7 @@ bitLenInt QStabilizer::gaussian()
 
         // Find a generator containing X in jth column
         for (k = i; k < maxLcv; ++k) {
-            if (x[k][j]) {
+            if (GetBit(x[k], j)) {
                 break;
             }
         }
@@ -192,7 +231,7 @@ bitLenInt QStabilizer::gaussian()
             rowswap(i, k);
             rowswap(i - n, k - n);
             for (bitLenInt k2 = i + 1U; k2 < maxLcv; ++k2) {
-                if (x[k2][j]) {
+                if (GetBit(x[k2], j)) {
                     // Gaussian elimination step:
                     rowmult(k2, i);
                     rowmult(i - n, k2 - n);
@@ -208,7 +247,7 @@ bitLenInt QStabilizer::gaussian()
 
         // Find a generator containing Z in jth column
         for (k = i; k < maxLcv; ++k) {
-            if (z[k][j]) {
+            if (GetBit(z[k], j)) {
                 break;
             }
         }
@@ -217,7 +256,7 @@ bitLenInt QStabilizer::gaussian()
             rowswap(i, k);
             rowswap(i - n, k - n);
             for (bitLenInt k2 = i + 1U; k2 < maxLcv; ++k2) {
-                if (z[k2][j]) {
+                if (GetBit(z[k2], j)) {
                     rowmult(k2, i);
                     rowmult(i - n, k2 - n);
                 }
@@ -242,43 +281,43 @@ void QStabilizer::seed(const bitLenInt& g)
     // Wipe the scratch space clean
     r[elemCount] = 0U;
 
-    // Dealloc, first
-    x[elemCount] = BoolVector();
-    z[elemCount] = BoolVector();
-
-    x[elemCount] = BoolVector(qubitCount, false);
-    z[elemCount] = BoolVector(qubitCount, false);
+    std::fill(x[elemCount].begin(), x[elemCount].end(), 0U);
+    std::fill(z[elemCount].begin(), z[elemCount].end(), 0U);
 
+    const size_t wordCount = x[elemCount].size();
     for (int i = elemCount - 1; i >= (int)(qubitCount + g); i--) {
         int f = r[i];
-        for (int j = qubitCount - 1; j >= 0; j--) {
-            if (z[i][j]) {
-                min = j;
-                if (x[elemCount][j]) {
-                    f = (f + 2) & 0x3;
-                }
+        bool isMinFound = false;
+        for (size_t w = 0U; w < wordCount; ++w) {
+            f = (f + 2 * (int)PopCount(z[i][w] & x[elemCount][w])) & 0x3;
+            if (isMinFound || !z[i][w]) {
+                continue;
+            }
+            // Lowest Z in the row
+            isMinFound = true;
+            int j = 0;
+            while (!((z[i][w] >> j) & 1U)) {
+                ++j;
             }
+            min = (int)(w << 6U) + j;
         }
 
         if (f == 2) {
             const int j = min;
             // Make the seed consistent with the ith equation
-            x[elemCount][j] = !x[elemCount][j];
+            FlipBit(x[elemCount], j);
         }
     }
 }
 
-/// Helper for setBasisState() and setBasisProb()
-AmplitudeEntry QStabilizer::getBasisAmp(const real1_f& nrm)
+/// The basis state amplitude from applying the Pauli operator (xs, zs, rs) to |0...0>
+AmplitudeEntry QStabilizer::getBasisAmp(const BitRow& xs, const BitRow& zs, const uint8_t& rs, const real1_f& nrm)
 {
-    const bitLenInt elemCount = qubitCount << 1U;
-    uint8_t e = r[elemCount];
+    uint8_t e = rs;
 
-    for (bitLenInt j = 0U; j < qubitCount; ++j) {
-        // Pauli operator is "Y"
-        if (x[elemCount][j] && z[elemCount][j]) {
-            e = (e + 1U) & 0x3U;
-        }
+    // Count Pauli "Y" operators
+    for (size_t w = 0U; w < xs.size(); ++w) {
+        e = (e + PopCount(xs[w] & zs[w])) & 0x3U;
     }
 
     complex amp((real1)nrm, ZERO_R1);
@@ -292,7 +331,7 @@ AmplitudeEntry QStabilizer::getBasisAmp(const real1_f& nrm)
 
     bitCapIntOcl perm = 0U;
     for (bitLenInt j = 0U; j < qubitCount; ++j) {
-        if (x[elemCount][j]) {
+        if (GetBit(xs, j)) {
             perm |= pow2Ocl(j);
         }
     }
@@ -300,29 +339,58 @@ AmplitudeEntry QStabilizer::getBasisAmp(const real1_f& nrm)
     return AmplitudeEntry(perm, amp);
 }
 
-/// Returns the result of applying the Pauli operator in the "scratch space" of q to |0...0>
-void QStabilizer::setBasisState(const real1_f& nrm, complex* stateVec)
+void QStabilizer::ForEachBasisAmp(
+    const bitLenInt& g, const bitCapIntOcl& begin, const bitCapIntOcl& end, const real1_f& nrm, BasisAmpFunc fn)
 {
-    const AmplitudeEntry entry = getBasisAmp(nrm);
-    if (entry.amplitude != ZERO_CMPLX) {
-        stateVec[entry.permutation] = entry.amplitude;
+    const bitLenInt elemCount = qubitCount << 1U;
+
+    // Walk [cBegin, cEnd) from a private copy of the scratch row.
+    const auto walk = [&](const bitCapIntOcl& cBegin, const bitCapIntOcl& cEnd) {
+        PauliRow row{ x[elemCount], z[elemCount], r[elemCount] };
+        // (The stabilizer generators commute, so the product doesn't depend on the order they're applied in.)
+        for (bitLenInt i = 0U; i < g; ++i) {
+            if ((cBegin >> i) & 1U) {
+                rowmult(row, qubitCount + i);
+            }
+        }
+
+        for (bitCapIntOcl t = cBegin;;) {
+            fn(t, getBasisAmp(row.x, row.z, row.r, nrm));
+            if (++t == cEnd) {
+                break;
+            }
+            const bitCapIntOcl t2 = t ^ (t - 1U);
+            for (bitLenInt i = 0U; i < g; ++i) {
+                if ((t2 >> i) & 1U) {
+                    rowmult(row, qubitCount + i);
+                }
+            }
+        }
+    };
+
+    if (begin >= end) {
+        return;
     }
-}
 
-/// Returns the result of applying the Pauli operator in the "scratch space" of q to |0...0>
-void QStabilizer::setBasisState(const real1_f& nrm, QInterfacePtr eng)
-{
-    const AmplitudeEntry entry = getBasisAmp(nrm);
-    if (entry.amplitude != ZERO_CMPLX) {
-        eng->SetAmplitude(entry.permutation, entry.amplitude);
+#if ENABLE_PTHREAD
+    const bitCapIntOcl Stride = GetStride();
+    const bitCapIntOcl itemCount = end - begin;
+    unsigned threads = (unsigned)(itemCount / Stride);
+    if (threads > GetConcurrencyLevel()) {
+        threads = GetConcurrencyLevel();
     }
-}
 
-/// Returns the probability from applying the Pauli operator in the "scratch space" of q to |0...0>
-void QStabilizer::setBasisProb(const real1_f& nrm, real1* outputProbs)
-{
-    const AmplitudeEntry entry = getBasisAmp(nrm);
-    outputProbs[entry.permutation] = norm(entry.amplitude);
+    if (threads > 1U) {
+        ParallelPool::Instance().Run((itemCount + Stride - 1U) / Stride, threads,
+            [&begin, &end, &Stride, &walk](const bitCapIntOcl& i, const unsigned& cpu) {
+                const bitCapIntOcl cBegin = begin + i * Stride;
+                walk(cBegin, ((end - cBegin) > Stride) ? (cBegin + Stride) : end);
+            });
+        return;
+    }
+#endif
+
+    walk(begin, end);
 }
 
 #define C_SQRT1_2 complex(M_SQRT1_2, ZERO_R1)
@@ -370,25 +438,19 @@ void QStabilizer::GetQuantumState(complex* stateVec)
     // log_2 of number of nonzero basis states
     const bitLenInt g = gaussian();
     const bitCapIntOcl permCount = pow2Ocl(g);
-    const bitCapIntOcl permCountMin1 = permCount - ONE_BCI;
-    const bitLenInt elemCount = qubitCount << 1U;
     const real1_f nrm = sqrt((real1_f)(ONE_R1 / permCount));
 
     seed(g);
 
     // init stateVec as all 0 values
-    std::fill(stateVec, stateVec + pow2Ocl(qubitCount), ZERO_CMPLX);
+    par_zero(stateVec, pow2Ocl(qubitCount));
 
-    setBasisState(nrm, stateVec);
-    for (bitCapIntOcl t = 0U; t < permCountMin1; ++t) {
-        const bitCapIntOcl t2 = t ^ (t + 1U);
-        for (bitLenInt i = 0U; i < g; ++i) {
-            if ((t2 >> i) & 1U) {
-                rowmult(elemCount, qubitCount + i);
-            }
+    // Every basis state of the walk is a distinct permutation, so threads never write the same amplitude.
+    ForEachBasisAmp(g, 0U, permCount, nrm, [stateVec](const bitCapIntOcl& t, const AmplitudeEntry& entry) {
+        if (entry.amplitude != ZERO_CMPLX) {
+            stateVec[entry.permutation] = entry.amplitude;
         }
-        setBasisState(nrm, stateVec);
-    }
+    });
 }
 
 /// Convert the state to ket notation (warning: could be huge!)
@@ -399,8 +461,6 @@ void QStabilizer::GetQuantumState(QInterfacePtr eng)
     // log_2 of number of nonzero basis states
     const bitLenInt g = gaussian();
     const bitCapIntOcl permCount = pow2Ocl(g);
-    const bitCapIntOcl permCountMin1 = permCount - ONE_BCI;
-    const bitLenInt elemCount = qubitCount << 1U;
     const real1_f nrm = sqrt((real1_f)(ONE_R1 / permCount));
 
     seed(g);
@@ -409,15 +469,33 @@ void QStabilizer::GetQuantumState(QInterfacePtr eng)
     eng->SetPermutation(0U);
     eng->SetAmplitude(0U, ZERO_CMPLX);
 
-    setBasisState(nrm, eng);
-    for (bitCapIntOcl t = 0U; t < permCountMin1; ++t) {
-        const bitCapIntOcl t2 = t ^ (t + 1U);
-        for (bitLenInt i = 0U; i < g; ++i) {
-            if ((t2 >> i) & 1U) {
-                rowmult(elemCount, qubitCount + i);
+    // Generate the basis states a page at a time, in parallel, and hand each page to the engine, (which, for
+    // QEngineOCL, scatters it directly into the device state buffer,) so no 2^n host copy of the state is staged.
+    const QEnginePtr qEngine = std::dynamic_pointer_cast<QEngine>(eng);
+    const bitCapIntOcl pageLength = (permCount < pow2Ocl(QRACK_STABILIZER_SCATTER_POW))
+        ? permCount
+        : pow2Ocl(QRACK_STABILIZER_SCATTER_POW);
+    std::unique_ptr<bitCapIntOcl[]> perms(new bitCapIntOcl[pageLength]);
+    std::unique_ptr<complex[]> amps(new complex[pageLength]);
+    bitCapIntOcl* pPerms = perms.get();
+    complex* pAmps = amps.get();
+    for (bitCapIntOcl page = 0U; page < permCount; page += pageLength) {
+        ForEachBasisAmp(
+            g, page, page + pageLength, nrm, [&page, pPerms, pAmps](const bitCapIntOcl& t, const AmplitudeEntry& e) {
+                pPerms[t - page] = e.permutation;
+                pAmps[t - page] = e.amplitude;
+            });
+
+        if (qEngine) {
+            qEngine->ScatterAmplitudes(pPerms, pAmps, pageLength);
+            continue;
+        }
+
+        for (bitCapIntOcl i = 0U; i < pageLength; ++i) {
+            if (pAmps[i] != ZERO_CMPLX) {
+                eng->SetAmplitude(pPerms[i], pAmps[i]);
             }
         }
-        setBasisState(nrm, eng);
     }
 }
 
@@ -429,8 +507,6 @@ void QStabilizer::GetProbs(real1* outputProbs)
     // log_2 of number of nonzero basis states
     const bitLenInt g = gaussian();
     const bitCapIntOcl permCount = pow2Ocl(g);
-    const bitCapIntOcl permCountMin1 = permCount - ONE_BCI;
-    const bitLenInt elemCount = qubitCount << 1U;
     const real1_f nrm = sqrt((real1_f)(ONE_R1 / permCount));
 
     seed(g);
@@ -438,16 +514,9 @@ void QStabilizer::GetProbs(real1* outputProbs)
     // init stateVec as all 0 values
     std::fill(outputProbs, outputProbs + pow2Ocl(qubitCount), ZERO_R1);
 
-    setBasisProb(nrm, outputProbs);
-    for (bitCapIntOcl t = 0U; t < permCountMin1; ++t) {
-        const bitCapIntOcl t2 = t ^ (t + 1U);
-        for (bitLenInt i = 0U; i < g; ++i) {
-            if ((t2 >> i) & 1U) {
-                rowmult(elemCount, qubitCount + i);
-            }
-        }
-        setBasisProb(nrm, outputProbs);
-    }
+    ForEachBasisAmp(g, 0U, permCount, nrm, [outputProbs](const bitCapIntOcl& t, const AmplitudeEntry& entry) {
+        outputProbs[entry.permutation] = norm(entry.amplitude);
+    });
 }
 
 /// Convert the state to ket notation (warning: could be huge!)
@@ -484,19 +553,108 @@ complex QStabilizer::GetAmplitude(bitCapInt perm)
     return ZERO_CMPLX;
 }
 
+void QStabilizer::MultiShotMeasureMask(
+    const std::vector<bitCapInt>& qPowers, unsigned shots, unsigned long long* shotsArray)
+{
+    if (!shots) {
+        return;
+    }
+
+    if (qPowers.size() > (sizeof(unsigned long long) << 3U)) {
+        throw std::invalid_argument("QStabilizer::MultiShotMeasureMask can't return more than 64 bits per shot!");
+    }
+
+    std::vector<bitLenInt> bits(qPowers.size());
+    std::transform(qPowers.begin(), qPowers.end(), bits.begin(), log2);
+    ThrowIfQbIdArrayIsBad(bits, qubitCount,
+        "QStabilizer::MultiShotMeasureMask parameter qPowers array values must be within allocated qubit bounds!");
+
+    Finish();
+
+    // log_2 of number of nonzero basis states
+    const bitLenInt g = gaussian();
+    seed(g);
+
+    const auto project = [&bits](const BitRow& row) {
+        uint64_t m = 0U;
+        for (size_t i = 0U; i < bits.size(); ++i) {
+            if (GetBit(row, bits[i])) {
+                m |= 1ULL << i;
+            }
+        }
+        return m;
+    };
+
+    const uint64_t base = project(x[qubitCount << 1U]);
+
+    // Reduce the projected X generators to a basis of their span, with distinct leading bits.
+    uint64_t pivots[64U] = { 0U };
+    for (bitLenInt i = 0U; i < g; ++i) {
+        uint64_t v = project(x[qubitCount + i]);
+        for (int b = 63; v && (b >= 0); --b) {
+            if (!((v >> b) & 1U)) {
+                continue;
+            }
+            if (!pivots[b]) {
+                pivots[b] = v;
+                break;
+            }
+            v ^= pivots[b];
+        }
+    }
+    std::vector<uint64_t> basis;
+    for (size_t b = 0U; b < 64U; ++b) {
+        if (pivots[b]) {
+            basis.push_back(pivots[b]);
+        }
+    }
+
+    // Every outcome in the span is equally likely, so each random bit picks one basis vector, 8 at a time by table.
+    const size_t tableCount = (basis.size() + 7U) >> 3U;
+    std::vector<uint64_t> tables(tableCount << 8U, 0U);
+    for (size_t t = 0U; t < tableCount; ++t) {
+        uint64_t* table = &(tables[t << 8U]);
+        for (size_t j = 0U; j < 8U; ++j) {
+            // (Past the end of the basis, random bits select nothing.)
+            const size_t b = (t << 3U) + j;
+            const uint64_t v = (b < basis.size()) ? basis[b] : 0U;
+            const size_t bit = 1U << j;
+            for (size_t k = 0U; k < bit; ++k) {
+                table[bit | k] = table[k] ^ v;
+            }
+        }
+    }
+
+    const unsigned blockCount = (shots + QRACK_STABILIZER_SHOT_BLOCK - 1U) / QRACK_STABILIZER_SHOT_BLOCK;
+    const uint64_t rngSeed = RandSeed();
+
+    par_for(0U, blockCount, [&](const bitCapIntOcl& blk, const unsigned& cpu) {
+        CounterRng gen(rngSeed, blk);
+        const unsigned end = std::min((unsigned)((blk + 1U) * QRACK_STABILIZER_SHOT_BLOCK), shots);
+        for (unsigned shot = (unsigned)(blk * QRACK_STABILIZER_SHOT_BLOCK); shot < end; ++shot) {
+            const uint64_t r = tableCount ? gen() : 0U;
+            uint64_t sample = base;
+            for (size_t t = 0U; t < tableCount; ++t) {
+                sample ^= tables[(t << 8U) | ((r >> (t << 3U)) & 0xFFU)];
+            }
+            shotsArray[shot] = (unsigned long long)sample;
+        }
+    });
+}
+
 /// Apply a CNOT gate with control and target
 void QStabilizer::CNOT(bitLenInt c, bitLenInt t)
 {
     ParFor(
         [this, c, t](const bitLenInt& i) {
-            if (x[i][c]) {
-                x[i][t] = !x[i][t];
+            if (GetBit(x[i], c)) {
+                FlipBit(x[i], t);
             }
 
-            if (z[i][t]) {
-                z[i][c] = !z[i][c];
+            if (GetBit(z[i], t)) {
+                FlipBit(z[i], c);
 
-                if (x[i][c] && (x[i][t] == z[i][c])) {
+                if (GetBit(x[i], c) && (GetBit(x[i], t) == GetBit(z[i], c))) {
                     r[i] = (r[i] + 2U) & 0x3U;
                 }
             }
@@ -509,14 +667,14 @@ void QStabilizer::AntiCNOT(bitLenInt c, bitLenInt t)
 {
     ParFor(
         [this, c, t](const bitLenInt& i) {
-            if (x[i][c]) {
-                x[i][t] = !x[i][t];
+            if (GetBit(x[i], c)) {
+                FlipBit(x[i], t);
             }
 
-            if (z[i][t]) {
-                z[i][c] = !z[i][c];
+            if (GetBit(z[i], t)) {
+                FlipBit(z[i], c);
 
-                if (!x[i][c] || (x[i][t] != z[i][c])) {
+                if (!GetBit(x[i], c) || (GetBit(x[i], t) != GetBit(z[i], c))) {
                     r[i] = (r[i] + 2U) & 0x3U;
                 }
             }
@@ -532,21 +690,21 @@ void QStabilizer::CY(bitLenInt c, bitLenInt t)
     }
     ParFor(
         [this, c, t](const bitLenInt& i) {
-            z[i][t] = z[i][t] ^ x[i][t];
+            XorBit(z[i], t, GetBit(x[i], t));
 
-            if (x[i][c]) {
-                x[i][t] = !x[i][t];
+            if (GetBit(x[i], c)) {
+                FlipBit(x[i], t);
             }
 
-            if (z[i][t]) {
-                if (x[i][c] && (x[i][t] == z[i][c])) {
+            if (GetBit(z[i], t)) {
+                if (GetBit(x[i], c) && (GetBit(x[i], t) == GetBit(z[i], c))) {
                     r[i] = (r[i] + 2U) & 0x3U;
                 }
 
-                z[i][c] = !z[i][c];
+                FlipBit(z[i], c);
             }
 
-            z[i][t] = z[i][t] ^ x[i][t];
+            XorBit(z[i], t, GetBit(x[i], t));
         },
         { c, t });
 }
@@ -559,21 +717,21 @@ void QStabilizer::AntiCY(bitLenInt c, bitLenInt t)
     }
     ParFor(
         [this, c, t](const bitLenInt& i) {
-            z[i][t] = z[i][t] ^ x[i][t];
+            XorBit(z[i], t, GetBit(x[i], t));
 
-            if (x[i][c]) {
-                x[i][t] = !x[i][t];
+            if (GetBit(x[i], c)) {
+                FlipBit(x[i], t);
             }
 
-            if (z[i][t]) {
-                if (!x[i][c] || (x[i][t] != z[i][c])) {
+            if (GetBit(z[i], t)) {
+                if (!GetBit(x[i], c) || (GetBit(x[i], t) != GetBit(z[i], c))) {
                     r[i] = (r[i] + 2U) & 0x3U;
                 }
 
-                z[i][c] = !z[i][c];
+                FlipBit(z[i], c);
             }
 
-            z[i][t] = z[i][t] ^ x[i][t];
+            XorBit(z[i], t, GetBit(x[i], t));
         },
         { c, t });
 }
@@ -586,16 +744,16 @@ void QStabilizer::CZ(bitLenInt c, bitLenInt t)
     }
     ParFor(
         [this, c, t](const bitLenInt& i) {
-            if (x[i][t]) {
-                z[i][c] = !z[i][c];
+            if (GetBit(x[i], t)) {
+                FlipBit(z[i], c);
 
-                if (x[i][c] && (z[i][t] == z[i][c])) {
+                if (GetBit(x[i], c) && (GetBit(z[i], t) == GetBit(z[i], c))) {
                     r[i] = (r[i] + 2U) & 0x3U;
                 }
             }
 
-            if (x[i][c]) {
-                z[i][t] = !z[i][t];
+            if (GetBit(x[i], c)) {
+                FlipBit(z[i], t);
             }
         },
         { c, t });
@@ -609,16 +767,16 @@ void QStabilizer::AntiCZ(bitLenInt c, bitLenInt t)
     }
     ParFor(
         [this, c, t](const bitLenInt& i) {
-            if (x[i][t]) {
-                z[i][c] = !z[i][c];
+            if (GetBit(x[i], t)) {
+                FlipBit(z[i], c);
 
-                if (!x[i][c] || (z[i][t] != z[i][c])) {
+                if (!GetBit(x[i], c) || (GetBit(z[i], t) != GetBit(z[i], c))) {
                     r[i] = (r[i] + 2U) & 0x3U;
                 }
             }
 
-            if (x[i][c]) {
-                z[i][t] = !z[i][t];
+            if (GetBit(x[i], c)) {
+                FlipBit(z[i], t);
             }
         },
         { c, t });
@@ -632,8 +790,8 @@ void QStabilizer::Swap(bitLenInt c, bitLenInt t)
 
     ParFor(
         [this, c, t](const bitLenInt& i) {
-            BoolVector::swap(x[i][c], x[i][t]);
-            BoolVector::swap(z[i][c], z[i][t]);
+            SwapBits(x[i], c, t);
+            SwapBits(z[i], c, t);
         },
         { c, t });
 }
@@ -650,27 +808,27 @@ void QStabilizer::ISwap(bitLenInt c, bitLenInt t)
 
     ParFor(
         [this, c, t](const bitLenInt& i) {
-            BoolVector::swap(x[i][c], x[i][t]);
-            BoolVector::swap(z[i][c], z[i][t]);
+            SwapBits(x[i], c, t);
+            SwapBits(z[i], c, t);
 
-            if (x[i][t]) {
-                z[i][c] = !z[i][c];
+            if (GetBit(x[i], t)) {
+                FlipBit(z[i], c);
 
-                if (!x[i][c] && z[i][t]) {
+                if (!GetBit(x[i], c) && GetBit(z[i], t)) {
                     r[i] = (r[i] + 2U) & 0x3U;
                 }
             }
 
-            if (x[i][c]) {
-                z[i][t] = !z[i][t];
+            if (GetBit(x[i], c)) {
+                FlipBit(z[i], t);
 
-                if (z[i][c] && !x[i][t]) {
+                if (GetBit(z[i], c) && !GetBit(x[i], t)) {
                     r[i] = (r[i] + 2U) & 0x3U;
                 }
             }
 
-            z[i][c] = z[i][c] ^ x[i][c];
-            z[i][t] = z[i][t] ^ x[i][t];
+            XorBit(z[i], c, GetBit(x[i], c));
+            XorBit(z[i], t, GetBit(x[i], t));
         },
         { c, t });
 }
@@ -687,27 +845,27 @@ void QStabilizer::IISwap(bitLenInt c, bitLenInt t)
 
     ParFor(
         [this, c, t](const bitLenInt& i) {
-            z[i][c] = z[i][c] ^ x[i][c];
-            z[i][t] = z[i][t] ^ x[i][t];
+            XorBit(z[i], c, GetBit(x[i], c));
+            XorBit(z[i], t, GetBit(x[i], t));
 
-            if (x[i][c]) {
-                z[i][t] = !z[i][t];
+            if (GetBit(x[i], c)) {
+                FlipBit(z[i], t);
 
-                if (z[i][c] && !x[i][t]) {
+                if (GetBit(z[i], c) && !GetBit(x[i], t)) {
                     r[i] = (r[i] + 2U) & 0x3U;
                 }
             }
 
-            if (x[i][t]) {
-                z[i][c] = !z[i][c];
+            if (GetBit(x[i], t)) {
+                FlipBit(z[i], c);
 
-                if (!x[i][c] && z[i][t]) {
+                if (!GetBit(x[i], c) && GetBit(z[i], t)) {
                     r[i] = (r[i] + 2U) & 0x3U;
                 }
             }
 
-            BoolVector::swap(x[i][c], x[i][t]);
-            BoolVector::swap(z[i][c], z[i][t]);
+            SwapBits(x[i], c, t);
+            SwapBits(z[i], c, t);
         },
         { c, t });
 }
@@ -717,8 +875,8 @@ void QStabilizer::H(bitLenInt t)
 {
     ParFor(
         [this, t](const bitLenInt& i) {
-            BoolVector::swap(x[i][t], z[i][t]);
-            if (x[i][t] && z[i][t]) {
+            SwapBits(x[i], z[i], t);
+            if (GetBit(x[i], t) && GetBit(z[i], t)) {
                 r[i] = (r[i] + 2U) & 0x3U;
             }
         },
@@ -733,10 +891,10 @@ void QStabilizer::S(bitLenInt t)
     }
     ParFor(
         [this, t](const bitLenInt& i) {
-            if (x[i][t] && z[i][t]) {
+            if (GetBit(x[i], t) && GetBit(z[i], t)) {
                 r[i] = (r[i] + 2U) & 0x3U;
             }
-            z[i][t] = z[i][t] ^ x[i][t];
+            XorBit(z[i], t, GetBit(x[i], t));
         },
         { t });
 }
@@ -749,8 +907,8 @@ void QStabilizer::IS(bitLenInt t)
     }
     ParFor(
         [this, t](const bitLenInt& i) {
-            z[i][t] = z[i][t] ^ x[i][t];
-            if (x[i][t] && z[i][t]) {
+            XorBit(z[i], t, GetBit(x[i], t));
+            if (GetBit(x[i], t) && GetBit(z[i], t)) {
                 r[i] = (r[i] + 2U) & 0x3U;
             }
         },
@@ -765,7 +923,7 @@ void QStabilizer::Z(bitLenInt t)
     }
     ParFor(
         [this, t](const bitLenInt& i) {
-            if (x[i][t]) {
+            if (GetBit(x[i], t)) {
                 r[i] = (r[i] + 2U) & 0x3U;
             }
         },
@@ -777,7 +935,7 @@ void QStabilizer::X(bitLenInt t)
 {
     ParFor(
         [this, t](const bitLenInt& i) {
-            if (z[i][t]) {
+            if (GetBit(z[i], t)) {
                 r[i] = (r[i] + 2U) & 0x3U;
             }
         },
@@ -793,7 +951,7 @@ void QStabilizer::Y(bitLenInt t)
     }
     ParFor(
         [this, t](const bitLenInt& i) {
-            if (z[i][t] ^ x[i][t]) {
+            if (GetBit(z[i], t) ^ GetBit(x[i], t)) {
                 r[i] = (r[i] + 2U) & 0x3U;
             }
         },
@@ -817,7 +975,7 @@ bool QStabilizer::IsSeparableZ(const bitLenInt& t)
     // loop over stabilizer generators
     for (bitLenInt p = 0U; p < n; ++p) {
         // if a Zbar does NOT commute with Z_b (the operator being measured), then outcome is random
-        if (x[p + n][t]) {
+        if (GetBit(x[p + n], t)) {
             return false;
         }
     }
@@ -895,7 +1053,7 @@ bool QStabilizer::ForceM(bitLenInt t, bool result, bool doForce, bool doApply)
     // loop over stabilizer generators
     for (p = 0U; p < n; ++p) {
         // if a Zbar does NOT commute with Z_b (the operator being measured), then outcome is random
-        if (x[p + n][t]) {
+        if (GetBit(x[p + n], t)) {
             // The outcome is random
             break;
         }
@@ -920,13 +1078,13 @@ bool QStabilizer::ForceM(bitLenInt t, bool result, bool doForce, bool doApply)
         r[p + n] = result ? 2U : 0U;
         // Now update the Xbar's and Zbar's that don't commute with Z_b
         for (bitLenInt i = 0U; i < p; ++i) {
-            if (x[i][t]) {
+            if (GetBit(x[i], t)) {
                 rowmult(i, p);
             }
         }
         // (Skip "p" row)
         for (bitLenInt i = p + 1U; i < elemCount; ++i) {
-            if (x[i][t]) {
+            if (GetBit(x[i], t)) {
                 rowmult(i, p);
             }
         }
@@ -942,7 +1100,7 @@ bool QStabilizer::ForceM(bitLenInt t, bool result, bool doForce, bool doApply)
     // pivot row in destabilizer
     bitLenInt m;
     for (m = 0U; m < n; ++m) {
-        if (x[m][t]) {
+        if (GetBit(x[m], t)) {
             break;
         }
     }
@@ -954,7 +1112,7 @@ bool QStabilizer::ForceM(bitLenInt t, bool result, bool doForce, bool doApply)
 
     rowcopy(elemCount, m + n);
     for (bitLenInt i = m + 1U; i < n; ++i) {
-        if (x[i][t]) {
+        if (GetBit(x[i], t)) {
             rowmult(elemCount, i + n);
         }
     }
@@ -979,40 +1137,41 @@ bitLenInt QStabilizer::Compose(QStabilizerPtr toCopy, bitLenInt start)
     toCopy->Finish();
     Finish();
 
-    const bitLenInt rowCount = (qubitCount << 1U) + 1U;
     const bitLenInt length = toCopy->qubitCount;
     const bitLenInt nQubitCount = qubitCount + length;
-    const bitLenInt endLength = qubitCount - start;
-    const bitLenInt secondStart = nQubitCount + start;
-    const bitLenInt dLen = length << 1U;
-    const BoolVector row(length, false);
+    const bitLenInt nRowCount = (nQubitCount << 1U) + 1U;
+    const size_t nWordCount = WordCount(nQubitCount);
+
+    std::vector<BitRow> nX(nRowCount, BitRow(nWordCount, 0U));
+    std::vector<BitRow> nZ(nRowCount, BitRow(nWordCount, 0U));
+    std::vector<uint8_t> nR(nRowCount, 0U);
+
+    // Copy a row into the new tableau, with its qubit columns shifted to start at "colOffset," for "toCopy," or split
+    // around the inserted range, otherwise.
+    const auto copyRow = [&](const BitRow& oX, const BitRow& oZ, uint8_t oR, bitLenInt rowQubits, bitLenInt nRow,
+                             bool isInserted) {
+        for (bitLenInt j = 0U; j < rowQubits; ++j) {
+            const bitLenInt nj = isInserted ? (start + j) : ((j < start) ? j : (j + length));
+            SetBitTo(nX[nRow], nj, GetBit(oX, j));
+            SetBitTo(nZ[nRow], nj, GetBit(oZ, j));
+        }
+        nR[nRow] = oR;
+    };
 
-    for (bitLenInt i = 0U; i < rowCount; ++i) {
-        x[i].insert(x[i].begin() + start, row.begin(), row.end());
-        z[i].insert(z[i].begin() + start, row.begin(), row.end());
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        const bitLenInt ni = (i < start) ? i : (i + length);
+        copyRow(x[i], z[i], r[i], qubitCount, ni, false);
+        copyRow(x[i + qubitCount], z[i + qubitCount], r[i + qubitCount], qubitCount, ni + nQubitCount, false);
     }
-
-    x.insert(x.begin() + start, toCopy->x.begin(), toCopy->x.begin() + length);
-    z.insert(z.begin() + start, toCopy->z.begin(), toCopy->z.begin() + length);
-    r.insert(r.begin() + start, toCopy->r.begin(), toCopy->r.begin() + length);
     for (bitLenInt i = 0U; i < length; ++i) {
-        const bitLenInt offset = start + i;
-        x[offset].insert(x[offset].begin(), start, false);
-        x[offset].insert(x[offset].end(), endLength, false);
-        z[offset].insert(z[offset].begin(), start, false);
-        z[offset].insert(z[offset].end(), endLength, false);
+        copyRow(toCopy->x[i], toCopy->z[i], toCopy->r[i], length, start + i, true);
+        copyRow(toCopy->x[i + length], toCopy->z[i + length], toCopy->r[i + length], length,
+            start + i + nQubitCount, true);
     }
 
-    x.insert(x.begin() + secondStart, toCopy->x.begin() + length, toCopy->x.begin() + dLen);
-    z.insert(z.begin() + secondStart, toCopy->z.begin() + length, toCopy->z.begin() + dLen);
-    r.insert(r.begin() + secondStart, toCopy->r.begin() + length, toCopy->r.begin() + dLen);
-    for (bitLenInt i = 0U; i < length; ++i) {
-        const bitLenInt offset = secondStart + i;
-        x[offset].insert(x[offset].begin(), start, false);
-        x[offset].insert(x[offset].end(), endLength, false);
-        z[offset].insert(z[offset].begin(), start, false);
-        z[offset].insert(z[offset].end(), endLength, false);
-    }
+    x.swap(nX);
+    z.swap(nZ);
+    r.swap(nR);
 
     qubitCount = nQubitCount;
 
@@ -1047,7 +1206,7 @@ bool QStabilizer::CanDecomposeDispose(const bitLenInt start, const bitLenInt len
     for (bitLenInt i = 0U; i < start; ++i) {
         const bitLenInt i2 = i + qubitCount;
         for (bitLenInt j = start; j < end; ++j) {
-            if (x[i][j] || z[i][j] || x[i2][j] || z[i2][j]) {
+            if (GetBit(x[i], j) || GetBit(z[i], j) || GetBit(x[i2], j) || GetBit(z[i2], j)) {
                 return false;
             }
         }
@@ -1056,7 +1215,7 @@ bool QStabilizer::CanDecomposeDispose(const bitLenInt start, const bitLenInt len
     for (bitLenInt i = end; i < qubitCount; ++i) {
         const bitLenInt i2 = i + qubitCount;
         for (bitLenInt j = start; j < end; ++j) {
-            if (x[i][j] || z[i][j] || x[i2][j] || z[i2][j]) {
+            if (GetBit(x[i], j) || GetBit(z[i], j) || GetBit(x[i2], j) || GetBit(z[i2], j)) {
                 return false;
             }
         }
@@ -1065,12 +1224,12 @@ bool QStabilizer::CanDecomposeDispose(const bitLenInt start, const bitLenInt len
     for (bitLenInt i = start; i < end; ++i) {
         const bitLenInt i2 = i + qubitCount;
         for (bitLenInt j = 0U; j < start; ++j) {
-            if (x[i][j] || z[i][j] || x[i2][j] || z[i2][j]) {
+            if (GetBit(x[i], j) || GetBit(z[i], j) || GetBit(x[i2], j) || GetBit(z[i2], j)) {
                 return false;
             }
         }
         for (bitLenInt j = end; j < qubitCount; ++j) {
-            if (x[i][j] || z[i][j] || x[i2][j] || z[i2][j]) {
+            if (GetBit(x[i], j) || GetBit(z[i], j) || GetBit(x[i2], j) || GetBit(z[i2], j)) {
                 return false;
             }
         }
@@ -1103,18 +1262,17 @@ void QStabilizer::DecomposeDispose(const bitLenInt start, const bitLenInt length
 
     const bitLenInt end = start + length;
     const bitLenInt nQubitCount = qubitCount - length;
-    const bitLenInt secondStart = nQubitCount + start;
-    const bitLenInt secondEnd = nQubitCount + end;
 
     if (dest) {
         for (bitLenInt i = 0U; i < length; ++i) {
-            bitLenInt j = start + i;
-            std::copy(x[j].begin() + start, x[j].begin() + end, dest->x[i].begin());
-            std::copy(z[j].begin() + start, z[j].begin() + end, dest->z[i].begin());
-
-            j = qubitCount + start + i;
-            std::copy(x[j].begin() + start, x[j].begin() + end, dest->x[(i + length)].begin());
-            std::copy(z[j].begin() + start, z[j].begin() + end, dest->z[(i + length)].begin());
+            const bitLenInt j = start + i;
+            const bitLenInt j2 = qubitCount + start + i;
+            for (bitLenInt k = 0U; k < length; ++k) {
+                SetBitTo(dest->x[i], k, GetBit(x[j], start + k));
+                SetBitTo(dest->z[i], k, GetBit(z[j], start + k));
+                SetBitTo(dest->x[i + length], k, GetBit(x[j2], start + k));
+                SetBitTo(dest->z[i + length], k, GetBit(z[j2], start + k));
+            }
         }
         bitLenInt j = start;
         std::copy(r.begin() + j, r.begin() + j + length, dest->r.begin());
@@ -1122,21 +1280,36 @@ void QStabilizer::DecomposeDispose(const bitLenInt start, const bitLenInt length
         std::copy(r.begin() + j, r.begin() + j + length, dest->r.begin() + length);
     }
 
-    x.erase(x.begin() + start, x.begin() + end);
-    z.erase(z.begin() + start, z.begin() + end);
-    r.erase(r.begin() + start, r.begin() + end);
-    x.erase(x.begin() + secondStart, x.begin() + secondEnd);
-    z.erase(z.begin() + secondStart, z.begin() + secondEnd);
-    r.erase(r.begin() + secondStart, r.begin() + secondEnd);
+    const bitLenInt nRowCount = (nQubitCount << 1U) + 1U;
+    const size_t nWordCount = WordCount(nQubitCount);
 
-    qubitCount = nQubitCount;
+    std::vector<BitRow> nX(nRowCount, BitRow(nWordCount, 0U));
+    std::vector<BitRow> nZ(nRowCount, BitRow(nWordCount, 0U));
+    std::vector<uint8_t> nR(nRowCount, 0U);
 
     const bitLenInt rowCount = (qubitCount << 1U) + 1U;
-
+    bitLenInt ni = 0U;
     for (bitLenInt i = 0U; i < rowCount; ++i) {
-        x[i].erase(x[i].begin() + start, x[i].begin() + end);
-        z[i].erase(z[i].begin() + start, z[i].begin() + end);
+        if (((i >= start) && (i < end)) || ((i >= (qubitCount + start)) && (i < (qubitCount + end)))) {
+            continue;
+        }
+        for (bitLenInt k = 0U; k < qubitCount; ++k) {
+            if ((k >= start) && (k < end)) {
+                continue;
+            }
+            const bitLenInt nk = (k < start) ? k : (k - length);
+            SetBitTo(nX[ni], nk, GetBit(x[i], k));
+            SetBitTo(nZ[ni], nk, GetBit(z[i], k));
+        }
+        nR[ni] = r[i];
+        ++ni;
     }
+
+    x.swap(nX);
+    z.swap(nZ);
+    r.swap(nR);
+
+    qubitCount = nQubitCount;
 }
 
 real1_f QStabilizer::ApproxCompareHelper(QStabilizerPtr toCompare, bool isDiscreteBool, real1_f error_tol)
@@ -0,0 +1,362 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qstabilizer_frames.hpp"
+#include "qstabilizer.hpp"
+
+#include "common/counter_rng.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// Frame words per block are capped, so a block's frames stay cache-resident for circuits of moderate width.
+#define QRACK_MAX_FRAME_WORDS 8U
+
+namespace Qrack {
+
+QStabilizerFrames::QStabilizerFrames(
+    bitLenInt qBitCount, size_t frameWidth, qrack_rand_gen_ptr rgp, bool useHardwareRNG)
+    : qubitCount(qBitCount)
+    , frameWords(frameWidth >> 6U)
+    , measurementCount(0U)
+    , isReferenceStale(true)
+    , hardware_rand_generator(NULL)
+{
+    if (!frameWords || (frameWidth & 63U) || (frameWords > QRACK_MAX_FRAME_WORDS)) {
+        throw std::invalid_argument("QStabilizerFrames frame width must be a multiple of 64, from 64 to 512!");
+    }
+
+#if !ENABLE_RDRAND && !ENABLE_RNDFILE && !ENABLE_DEVRAND
+    useHardwareRNG = false;
+#endif
+    if (useHardwareRNG) {
+        hardware_rand_generator = std::make_shared<RdRandom>();
+#if !ENABLE_RNDFILE && !ENABLE_DEVRAND
+        if (!hardware_rand_generator->SupportsRDRAND()) {
+            hardware_rand_generator = NULL;
+        }
+#endif
+    }
+    if (!rgp) {
+        std::random_device rd;
+        rand_generator = std::make_shared<qrack_rand_gen>(rd());
+    } else {
+        rand_generator = rgp;
+    }
+
+    SetConcurrencyLevel(std::thread::hardware_concurrency());
+}
+
+void QStabilizerFrames::Append(FrameOpType type, bitLenInt q1, bitLenInt q2, real1_f p)
+{
+    if ((q1 >= qubitCount) || (q2 >= qubitCount)) {
+        throw std::invalid_argument("QStabilizerFrames qubit index parameter must be within allocated qubit bounds!");
+    }
+    if ((type == FRAME_CNOT || type == FRAME_CY || type == FRAME_CZ || type == FRAME_DEPOLARIZE2) && (q1 == q2)) {
+        throw std::invalid_argument("QStabilizerFrames two-qubit operation qubits must be distinct!");
+    }
+    if ((p < ZERO_R1_F) || (p > ONE_R1_F)) {
+        throw std::invalid_argument("QStabilizerFrames error probability must be in [0, 1]!");
+    }
+
+    ops.push_back(FrameOp(type, q1, q2, p));
+    isReferenceStale = true;
+}
+
+void QStabilizerFrames::Clear()
+{
+    ops.clear();
+    reference.clear();
+    measurementCount = 0U;
+    isReferenceStale = true;
+}
+
+uint64_t QStabilizerFrames::RandSeed()
+{
+    if (hardware_rand_generator) {
+        return ((uint64_t)hardware_rand_generator->NextRaw() << 32U) | (uint64_t)hardware_rand_generator->NextRaw();
+    }
+    return (uint64_t)(*rand_generator)();
+}
+
+const std::vector<bool>& QStabilizerFrames::GetReference()
+{
+    if (!isReferenceStale) {
+        return reference;
+    }
+
+    // Any valid noiseless outcome will do, since frames re-randomize wherever the circuit is random.
+    QStabilizer ref(qubitCount, 0U, rand_generator, CMPLX_DEFAULT_ARG, false, true, false, -1,
+        hardware_rand_generator != NULL);
+    reference.clear();
+    reference.reserve(measurementCount);
+    for (size_t i = 0U; i < ops.size(); ++i) {
+        const FrameOp& op = ops[i];
+        switch (op.type) {
+        case FRAME_H:
+            ref.H(op.q1);
+            break;
+        case FRAME_S:
+            ref.S(op.q1);
+            break;
+        case FRAME_IS:
+            ref.IS(op.q1);
+            break;
+        case FRAME_X:
+            ref.X(op.q1);
+            break;
+        case FRAME_Y:
+            ref.Y(op.q1);
+            break;
+        case FRAME_Z:
+            ref.Z(op.q1);
+            break;
+        case FRAME_CNOT:
+            ref.CNOT(op.q1, op.q2);
+            break;
+        case FRAME_CY:
+            ref.CY(op.q1, op.q2);
+            break;
+        case FRAME_CZ:
+            ref.CZ(op.q1, op.q2);
+            break;
+        case FRAME_SWAP:
+            ref.Swap(op.q1, op.q2);
+            break;
+        case FRAME_M:
+            reference.push_back(ref.M(op.q1));
+            break;
+        case FRAME_R:
+            if (ref.M(op.q1)) {
+                ref.X(op.q1);
+            }
+            break;
+        default:
+            // Noise channels don't act on the reference.
+            break;
+        }
+    }
+    isReferenceStale = false;
+
+    return reference;
+}
+
+/// XOR a Bernoulli("p") bit into each of the "bitCount" bits at "mask," (by geometric skipping, when "p" is small).
+static void XorBernoulli(CounterRng& gen, real1_f p, uint64_t* mask, size_t bitCount)
+{
+    if (p <= ZERO_R1_F) {
+        return;
+    }
+
+    const size_t wordCount = bitCount >> 6U;
+    if (p >= ONE_R1_F) {
+        for (size_t w = 0U; w < wordCount; ++w) {
+            mask[w] = ~mask[w];
+        }
+        return;
+    }
+
+    // Uniform on (0, 1]
+    const auto uniform = [&gen]() { return ((double)(gen() >> 11U) + 1.0) * (1.0 / 9007199254740992.0); };
+
+    if (p > 0.125) {
+        const double pd = (double)p;
+        for (size_t b = 0U; b < bitCount; ++b) {
+            if (uniform() <= pd) {
+                mask[b >> 6U] ^= 1ULL << (b & 63U);
+            }
+        }
+        return;
+    }
+
+    const double logNotP = std::log1p(-(double)p);
+    double gap = std::floor(std::log(uniform()) / logNotP);
+    size_t b = 0U;
+    while (gap < (double)(bitCount - b)) {
+        b += (size_t)gap;
+        mask[b >> 6U] ^= 1ULL << (b & 63U);
+        ++b;
+        gap = std::floor(std::log(uniform()) / logNotP);
+    }
+}
+
+/// Call "fn(word, bit)" for each success of "bitCount" Bernoulli("p") trials, with the success as a one-bit mask.
+template <typename Fn> static void ForBernoulli(CounterRng& gen, real1_f p, size_t bitCount, Fn fn)
+{
+    std::vector<uint64_t> hits(bitCount >> 6U, 0U);
+    XorBernoulli(gen, p, &(hits[0U]), bitCount);
+    for (size_t w = 0U; w < hits.size(); ++w) {
+        uint64_t word = hits[w];
+        while (word) {
+            // (Lowest set bit)
+            const uint64_t low = word & (~word + 1U);
+            fn(w, low);
+            word ^= low;
+        }
+    }
+}
+
+void QStabilizerFrames::SampleBlock(uint64_t seed, uint64_t block, std::vector<uint64_t>& records)
+{
+    CounterRng gen(seed, block);
+    const size_t fw = frameWords;
+    const size_t frameBits = fw << 6U;
+
+    // x[q * fw + w] and z[q * fw + w] hold word "w" of qubit "q"'s frame, one shot per bit.
+    std::vector<uint64_t> x(qubitCount * fw, 0U);
+    std::vector<uint64_t> z(qubitCount * fw);
+    for (size_t i = 0U; i < z.size(); ++i) {
+        z[i] = gen();
+    }
+
+    size_t m = 0U;
+    for (size_t i = 0U; i < ops.size(); ++i) {
+        const FrameOp& op = ops[i];
+        uint64_t* x1 = &(x[op.q1 * fw]);
+        uint64_t* z1 = &(z[op.q1 * fw]);
+        uint64_t* x2 = &(x[op.q2 * fw]);
+        uint64_t* z2 = &(z[op.q2 * fw]);
+
+        switch (op.type) {
+        case FRAME_H:
+            for (size_t w = 0U; w < fw; ++w) {
+                std::swap(x1[w], z1[w]);
+            }
+            break;
+        case FRAME_S:
+        case FRAME_IS:
+            for (size_t w = 0U; w < fw; ++w) {
+                z1[w] ^= x1[w];
+            }
+            break;
+        case FRAME_CNOT:
+            for (size_t w = 0U; w < fw; ++w) {
+                x2[w] ^= x1[w];
+                z1[w] ^= z2[w];
+            }
+            break;
+        case FRAME_CY:
+            // As IS on target, then CNOT, then S on target
+            for (size_t w = 0U; w < fw; ++w) {
+                z2[w] ^= x2[w];
+                x2[w] ^= x1[w];
+                z1[w] ^= z2[w];
+                z2[w] ^= x2[w];
+            }
+            break;
+        case FRAME_CZ:
+            for (size_t w = 0U; w < fw; ++w) {
+                z1[w] ^= x2[w];
+                z2[w] ^= x1[w];
+            }
+            break;
+        case FRAME_SWAP:
+            for (size_t w = 0U; w < fw; ++w) {
+                std::swap(x1[w], x2[w]);
+                std::swap(z1[w], z2[w]);
+            }
+            break;
+        case FRAME_X_ERROR:
+            XorBernoulli(gen, op.p, x1, frameBits);
+            break;
+        case FRAME_Z_ERROR:
+            XorBernoulli(gen, op.p, z1, frameBits);
+            break;
+        case FRAME_Y_ERROR:
+            ForBernoulli(gen, op.p, frameBits, [&](size_t w, uint64_t bit) {
+                x1[w] ^= bit;
+                z1[w] ^= bit;
+            });
+            break;
+        case FRAME_DEPOLARIZE1:
+            ForBernoulli(gen, op.p, frameBits, [&](size_t w, uint64_t bit) {
+                // 1 = X, 2 = Z, 3 = Y
+                const uint64_t pauli = 1U + (gen() % 3U);
+                x1[w] ^= (pauli & 1U) ? bit : 0U;
+                z1[w] ^= (pauli & 2U) ? bit : 0U;
+            });
+            break;
+        case FRAME_DEPOLARIZE2:
+            ForBernoulli(gen, op.p, frameBits, [&](size_t w, uint64_t bit) {
+                const uint64_t pauli = 1U + (gen() % 15U);
+                x1[w] ^= (pauli & 1U) ? bit : 0U;
+                z1[w] ^= (pauli & 2U) ? bit : 0U;
+                x2[w] ^= (pauli & 4U) ? bit : 0U;
+                z2[w] ^= (pauli & 8U) ? bit : 0U;
+            });
+            break;
+        case FRAME_M: {
+            uint64_t* rec = &(records[m * fw]);
+            std::copy(x1, x1 + fw, rec);
+            XorBernoulli(gen, op.p, rec, frameBits);
+            // The post-measurement state is a Z eigenstate.
+            for (size_t w = 0U; w < fw; ++w) {
+                z1[w] ^= gen();
+            }
+            ++m;
+            break;
+        }
+        case FRAME_R:
+            for (size_t w = 0U; w < fw; ++w) {
+                x1[w] = 0U;
+                z1[w] = gen();
+            }
+            break;
+        default:
+            // Paulis only change signs, which the reference already carries.
+            break;
+        }
+    }
+}
+
+void QStabilizerFrames::MeasureShots(unsigned shots, unsigned long long* records)
+{
+    if (!shots) {
+        return;
+    }
+
+    const std::vector<bool>& ref = GetReference();
+    const size_t recordWords = GetRecordWords();
+    std::fill(records, records + shots * recordWords, 0ULL);
+    if (!measurementCount) {
+        return;
+    }
+
+    const size_t frameBits = frameWords << 6U;
+    const size_t blockCount = (shots + frameBits - 1U) / frameBits;
+
+    // Every block has its own counter-based stream under one seed, so results don't depend on thread count.
+    const uint64_t seed = RandSeed();
+
+    par_for(0U, blockCount, [&](const bitCapIntOcl& b, const unsigned& cpu) {
+        // Measurement-major: word "w" of measurement "m"'s flips is flips[m * frameWords + w].
+        std::vector<uint64_t> flips(measurementCount * frameWords);
+        SampleBlock(seed, b, flips);
+
+        // Transpose this block's flips into shot-major records, XOR the reference.
+        const size_t shotStart = b * frameBits;
+        const size_t shotCount = std::min(frameBits, (size_t)shots - shotStart);
+        unsigned long long* out = records + shotStart * recordWords;
+        for (size_t m = 0U; m < measurementCount; ++m) {
+            const uint64_t refWord = ref[m] ? ~0ULL : 0ULL;
+            const unsigned long long recBit = 1ULL << (m & 63U);
+            const size_t recWord = m >> 6U;
+            for (size_t s = 0U; s < shotCount; ++s) {
+                if (((flips[m * frameWords + (s >> 6U)] ^ refWord) >> (s & 63U)) & 1U) {
+                    out[s * recordWords + recWord] |= recBit;
+                }
+            }
+        }
+    });
+}
+} // namespace Qrack
@@ -0,0 +1,346 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qstabilizer_opencl.hpp"
+
+namespace Qrack {
+
+#define CHECK_OCL(call, message)                                                                                       \
+    if ((call) != CL_SUCCESS) {                                                                                        \
+        throw std::runtime_error(message);                                                                             \
+    }
+
+QStabilizerOCL::QStabilizerOCL(bitLenInt n, bitCapInt perm, qrack_rand_gen_ptr rgp, complex ignored, bool doNorm,
+    bool randomGlobalPhase, bool ignored2, int64_t deviceId, bool useHardwareRNG, bool ignored4, real1_f ignored5,
+    std::vector<int64_t> ignored6, bitLenInt ignored7, real1_f ignored8)
+    : QStabilizer(n, perm, rgp, ignored, doNorm, randomGlobalPhase, ignored2, deviceId, useHardwareRNG, ignored4,
+          ignored5, ignored6, ignored7, ignored8)
+    , devID(-2)
+    , deviceQubitCount(0U)
+    , isHostStale(false)
+    , isDeviceStale(true)
+{
+    SetDevice(deviceId);
+}
+
+void QStabilizerOCL::SetDevice(int64_t dID)
+{
+    if (!(OCLEngine::Instance().GetDeviceCount())) {
+        throw std::runtime_error("Tried to initialize QStabilizerOCL, but no available OpenCL devices.");
+    }
+
+    if (device_context && (dID == devID)) {
+        return;
+    }
+
+    // The host tableau carries the state across the switch.
+    Finish();
+
+    device_context = OCLEngine::Instance().GetDeviceContextPtr(dID);
+    devID = dID;
+
+    cl_int error;
+    queue = cl::CommandQueue(device_context->context, device_context->device, 0, &error);
+    CHECK_OCL(error, "Failed to create OpenCL command queue for QStabilizerOCL!");
+
+    ResetDeviceBuffers();
+}
+
+void QStabilizerOCL::ResetDeviceBuffers()
+{
+    const size_t rowWords = (size_t)DeviceRowCount() * DeviceWordCount();
+    cl_int error;
+
+    xBuffer = std::make_shared<cl::Buffer>(
+        device_context->context, CL_MEM_READ_WRITE, sizeof(uint64_t) * rowWords, (void*)NULL, &error);
+    CHECK_OCL(error, "Failed to allocate QStabilizerOCL tableau buffer!");
+    zBuffer = std::make_shared<cl::Buffer>(
+        device_context->context, CL_MEM_READ_WRITE, sizeof(uint64_t) * rowWords, (void*)NULL, &error);
+    CHECK_OCL(error, "Failed to allocate QStabilizerOCL tableau buffer!");
+    rBuffer = std::make_shared<cl::Buffer>(
+        device_context->context, CL_MEM_READ_WRITE, sizeof(uint8_t) * DeviceRowCount(), (void*)NULL, &error);
+    CHECK_OCL(error, "Failed to allocate QStabilizerOCL tableau buffer!");
+    if (!pivotBuffer) {
+        pivotBuffer = std::make_shared<cl::Buffer>(
+            device_context->context, CL_MEM_READ_WRITE, sizeof(cl_uint) * 2U, (void*)NULL, &error);
+        CHECK_OCL(error, "Failed to allocate QStabilizerOCL pivot buffer!");
+    }
+
+    deviceQubitCount = qubitCount;
+    isDeviceStale = true;
+}
+
+void QStabilizerOCL::SyncToDevice()
+{
+    if (!isDeviceStale) {
+        return;
+    }
+
+    // Host gates might still be in flight on the dispatch queue.
+    QStabilizer::Finish();
+
+    if (deviceQubitCount != qubitCount) {
+        ResetDeviceBuffers();
+    }
+
+    const size_t rowCount = DeviceRowCount();
+    const size_t wordCount = DeviceWordCount();
+    std::vector<uint64_t> xFlat(rowCount * wordCount);
+    std::vector<uint64_t> zFlat(rowCount * wordCount);
+    for (size_t i = 0U; i < rowCount; ++i) {
+        std::copy(x[i].begin(), x[i].end(), xFlat.begin() + i * wordCount);
+        std::copy(z[i].begin(), z[i].end(), zFlat.begin() + i * wordCount);
+    }
+
+    CHECK_OCL(queue.enqueueWriteBuffer(*xBuffer, CL_FALSE, 0U, sizeof(uint64_t) * xFlat.size(), &(xFlat[0U])),
+        "Failed to write QStabilizerOCL tableau buffer!");
+    CHECK_OCL(queue.enqueueWriteBuffer(*zBuffer, CL_FALSE, 0U, sizeof(uint64_t) * zFlat.size(), &(zFlat[0U])),
+        "Failed to write QStabilizerOCL tableau buffer!");
+    // (This one blocks, and the queue is in-order, so the staging vectors outlive all three writes.)
+    CHECK_OCL(queue.enqueueWriteBuffer(*rBuffer, CL_TRUE, 0U, sizeof(uint8_t) * rowCount, &(r[0U])),
+        "Failed to write QStabilizerOCL tableau buffer!");
+
+    isDeviceStale = false;
+}
+
+void QStabilizerOCL::SyncToHost()
+{
+    if (!isHostStale) {
+        return;
+    }
+
+    const size_t rowCount = DeviceRowCount();
+    const size_t wordCount = DeviceWordCount();
+    std::vector<uint64_t> xFlat(rowCount * wordCount);
+    std::vector<uint64_t> zFlat(rowCount * wordCount);
+
+    CHECK_OCL(queue.enqueueReadBuffer(*xBuffer, CL_FALSE, 0U, sizeof(uint64_t) * xFlat.size(), &(xFlat[0U])),
+        "Failed to read QStabilizerOCL tableau buffer!");
+    CHECK_OCL(queue.enqueueReadBuffer(*zBuffer, CL_FALSE, 0U, sizeof(uint64_t) * zFlat.size(), &(zFlat[0U])),
+        "Failed to read QStabilizerOCL tableau buffer!");
+    CHECK_OCL(queue.enqueueReadBuffer(*rBuffer, CL_TRUE, 0U, sizeof(uint8_t) * rowCount, &(r[0U])),
+        "Failed to read QStabilizerOCL tableau buffer!");
+
+    for (size_t i = 0U; i < rowCount; ++i) {
+        std::copy(xFlat.begin() + i * wordCount, xFlat.begin() + (i + 1U) * wordCount, x[i].begin());
+        std::copy(zFlat.begin() + i * wordCount, zFlat.begin() + (i + 1U) * wordCount, z[i].begin());
+    }
+
+    isHostStale = false;
+}
+
+void QStabilizerOCL::ApplyGate(StabilizerGateOCL op, bitLenInt c, bitLenInt t)
+{
+    if ((c >= qubitCount) || (t >= qubitCount)) {
+        throw std::domain_error("QStabilizer gate qubit indices are out-of-bounds!");
+    }
+
+    SyncToDevice();
+
+    // (As in QStabilizer::ParFor(), the scratch row is left alone.)
+    const cl_uint rowCount = (cl_uint)(qubitCount << 1U);
+
+    OCLDeviceCall ocl = device_context->Reserve(OCL_API_STABILIZER_GATE);
+    ocl.call.setArg(0, *xBuffer);
+    ocl.call.setArg(1, *zBuffer);
+    ocl.call.setArg(2, *rBuffer);
+    ocl.call.setArg(3, DeviceWordCount());
+    ocl.call.setArg(4, rowCount);
+    ocl.call.setArg(5, (cl_uint)op);
+    ocl.call.setArg(6, (cl_uint)c);
+    ocl.call.setArg(7, (cl_uint)t);
+    CHECK_OCL(queue.enqueueNDRangeKernel(ocl.call, cl::NullRange, cl::NDRange(rowCount), cl::NullRange),
+        "Failed to enqueue QStabilizerOCL gate kernel!");
+    queue.flush();
+
+    isHostStale = true;
+}
+
+#define PHASE_TRACKED_GATE_1(name, op)                                                                                 \
+    void QStabilizerOCL::name(bitLenInt t)                                                                             \
+    {                                                                                                                  \
+        if (randGlobalPhase) {                                                                                         \
+            ApplyGate(op, t, t);                                                                                       \
+            return;                                                                                                    \
+        }                                                                                                              \
+        /* Global phase tracking needs to inspect the state, so this is cheapest on the host. */                       \
+        Finish();                                                                                                      \
+        QStabilizer::name(t);                                                                                          \
+    }
+
+#define PHASE_TRACKED_GATE_2(name, op)                                                                                 \
+    void QStabilizerOCL::name(bitLenInt c, bitLenInt t)                                                                \
+    {                                                                                                                  \
+        if (randGlobalPhase) {                                                                                         \
+            ApplyGate(op, c, t);                                                                                       \
+            return;                                                                                                    \
+        }                                                                                                              \
+        /* Global phase tracking needs to inspect the state, so this is cheapest on the host. */                       \
+        Finish();                                                                                                      \
+        QStabilizer::name(c, t);                                                                                       \
+    }
+
+PHASE_TRACKED_GATE_1(S, STAB_S)
+PHASE_TRACKED_GATE_1(IS, STAB_IS)
+PHASE_TRACKED_GATE_1(Z, STAB_Z)
+PHASE_TRACKED_GATE_1(Y, STAB_Y)
+PHASE_TRACKED_GATE_2(CY, STAB_CY)
+PHASE_TRACKED_GATE_2(AntiCY, STAB_ANTICY)
+PHASE_TRACKED_GATE_2(CZ, STAB_CZ)
+PHASE_TRACKED_GATE_2(AntiCZ, STAB_ANTICZ)
+
+void QStabilizerOCL::ISwap(bitLenInt c, bitLenInt t)
+{
+    if (c == t) {
+        return;
+    }
+    if (randGlobalPhase) {
+        ApplyGate(STAB_ISWAP, c, t);
+        return;
+    }
+    Finish();
+    QStabilizer::ISwap(c, t);
+}
+
+void QStabilizerOCL::IISwap(bitLenInt c, bitLenInt t)
+{
+    if (c == t) {
+        return;
+    }
+    if (randGlobalPhase) {
+        ApplyGate(STAB_IISWAP, c, t);
+        return;
+    }
+    Finish();
+    QStabilizer::IISwap(c, t);
+}
+
+bool QStabilizerOCL::ForceM(bitLenInt t, bool result, bool doForce, bool doApply)
+{
+    if (t >= qubitCount) {
+        throw std::invalid_argument("QStabilizer::ForceM qubit index is out-of-bounds!");
+    }
+
+    if (doForce && !doApply) {
+        return result;
+    }
+
+    // Measure wherever the current tableau already is.
+    if (!isHostStale) {
+        return QStabilizer::ForceM(t, result, doForce, doApply);
+    }
+
+    const cl_uint n = (cl_uint)qubitCount;
+    const cl_uint wordCount = DeviceWordCount();
+    const size_t rowBytes = sizeof(uint64_t) * wordCount;
+
+    cl_uint pivots[2U] = { n, n };
+    CHECK_OCL(queue.enqueueWriteBuffer(*pivotBuffer, CL_FALSE, 0U, sizeof(cl_uint) * 2U, pivots),
+        "Failed to write QStabilizerOCL pivot buffer!");
+    if (true) {
+        OCLDeviceCall ocl = device_context->Reserve(OCL_API_STABILIZER_PIVOTS);
+        ocl.call.setArg(0, *xBuffer);
+        ocl.call.setArg(1, wordCount);
+        ocl.call.setArg(2, n);
+        ocl.call.setArg(3, (cl_uint)t);
+        ocl.call.setArg(4, *pivotBuffer);
+        CHECK_OCL(queue.enqueueNDRangeKernel(ocl.call, cl::NullRange, cl::NDRange(n), cl::NullRange),
+            "Failed to enqueue QStabilizerOCL pivot kernel!");
+    }
+    CHECK_OCL(queue.enqueueReadBuffer(*pivotBuffer, CL_TRUE, 0U, sizeof(cl_uint) * 2U, pivots),
+        "Failed to read QStabilizerOCL pivot buffer!");
+
+    const cl_uint p = pivots[0U];
+
+    // If outcome is indeterminate
+    if (p < n) {
+        // moment of quantum randomness
+        if (!doForce) {
+            result = Rand();
+        }
+
+        if (!doApply) {
+            return result;
+        }
+
+        // Set Xbar_p := Zbar_p
+        CHECK_OCL(queue.enqueueCopyBuffer(*xBuffer, *xBuffer, (p + n) * rowBytes, p * rowBytes, rowBytes),
+            "Failed to copy QStabilizerOCL tableau row!");
+        CHECK_OCL(queue.enqueueCopyBuffer(*zBuffer, *zBuffer, (p + n) * rowBytes, p * rowBytes, rowBytes),
+            "Failed to copy QStabilizerOCL tableau row!");
+        CHECK_OCL(queue.enqueueCopyBuffer(*rBuffer, *rBuffer, p + n, p, 1U),
+            "Failed to copy QStabilizerOCL tableau row!");
+
+        // Set Zbar_p := Z_b, and update the Xbar's and Zbar's that don't commute with Z_b, all at once
+        OCLDeviceCall ocl = device_context->Reserve(OCL_API_STABILIZER_MEASURE);
+        ocl.call.setArg(0, *xBuffer);
+        ocl.call.setArg(1, *zBuffer);
+        ocl.call.setArg(2, *rBuffer);
+        ocl.call.setArg(3, wordCount);
+        ocl.call.setArg(4, n);
+        ocl.call.setArg(5, (cl_uint)t);
+        ocl.call.setArg(6, p);
+        ocl.call.setArg(7, (cl_uchar)(result ? 2U : 0U));
+        CHECK_OCL(queue.enqueueNDRangeKernel(ocl.call, cl::NullRange, cl::NDRange(n << 1U), cl::NullRange),
+            "Failed to enqueue QStabilizerOCL measurement kernel!");
+        queue.flush();
+
+        return result;
+    }
+
+    // If outcome is determinate
+    const cl_uint m = pivots[1U];
+    if (m >= n) {
+        // For example, diagonal permutation state is |0>.
+        return false;
+    }
+
+    if (true) {
+        OCLDeviceCall ocl = device_context->Reserve(OCL_API_STABILIZER_SCRATCH);
+        ocl.call.setArg(0, *xBuffer);
+        ocl.call.setArg(1, *zBuffer);
+        ocl.call.setArg(2, *rBuffer);
+        ocl.call.setArg(3, wordCount);
+        ocl.call.setArg(4, n);
+        ocl.call.setArg(5, (cl_uint)t);
+        ocl.call.setArg(6, m);
+        CHECK_OCL(queue.enqueueNDRangeKernel(ocl.call, cl::NullRange, cl::NDRange(1U), cl::NullRange),
+            "Failed to enqueue QStabilizerOCL scratch row kernel!");
+    }
+
+    cl_uchar scratchR;
+    CHECK_OCL(queue.enqueueReadBuffer(*rBuffer, CL_TRUE, n << 1U, 1U, &scratchR),
+        "Failed to read QStabilizerOCL tableau buffer!");
+
+    if (doForce && (result != (bool)scratchR)) {
+        throw std::invalid_argument("QStabilizer::ForceM() forced a measurement with 0 probability!");
+    }
+
+    return (bool)scratchR;
+}
+
+QInterfacePtr QStabilizerOCL::Clone()
+{
+    Finish();
+
+    QStabilizerOCLPtr clone = std::make_shared<QStabilizerOCL>(qubitCount, 0U, rand_generator, CMPLX_DEFAULT_ARG,
+        false, randGlobalPhase, false, devID, hardware_rand_generator != NULL);
+
+    clone->x = x;
+    clone->z = z;
+    clone->r = r;
+    clone->phaseOffset = phaseOffset;
+    clone->randomSeed = randomSeed;
+
+    return clone;
+}
+} // namespace Qrack
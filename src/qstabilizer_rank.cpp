@@ -0,0 +1,754 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qstabilizer_rank.hpp"
+
+namespace Qrack {
+
+// Powers of i, by exponent mod 4
+static const complex I_POWERS[4U]{ ONE_CMPLX, I_CMPLX, -ONE_CMPLX, -I_CMPLX };
+
+QStabilizerRank::QStabilizerRank(bitLenInt n, bitCapInt perm, qrack_rand_gen_ptr rgp, complex ignored, bool doNorm,
+    bool randomGlobalPhase, bool ignored2, int64_t ignored3, bool useHardwareRNG, bool ignored4, real1_f ignored5,
+    std::vector<int64_t> ignored6, bitLenInt ignored7, real1_f ignored8)
+    : QStabilizer(n, perm, rgp, ignored, doNorm, randomGlobalPhase, ignored2, ignored3, useHardwareRNG, ignored4,
+          ignored5, ignored6, ignored7, ignored8)
+    , terms()
+{
+}
+
+QStabilizerRank::QStabilizerRank(QStabilizerPtr toCopy)
+    : QStabilizer(toCopy->qubitCount, 0U, toCopy->rand_generator, CMPLX_DEFAULT_ARG, false, toCopy->randGlobalPhase,
+          false, -1, toCopy->hardware_rand_generator != NULL)
+    , terms()
+{
+    toCopy->Finish();
+
+    x = toCopy->x;
+    z = toCopy->z;
+    r = toCopy->r;
+    phaseOffset = toCopy->phaseOffset;
+    randomSeed = toCopy->randomSeed;
+
+    const QStabilizerRankPtr rankCopy = std::dynamic_pointer_cast<QStabilizerRank>(toCopy);
+    if (rankCopy) {
+        terms = rankCopy->terms;
+    }
+}
+
+QInterfacePtr QStabilizerRank::Clone()
+{
+    Finish();
+
+    QStabilizerRankPtr clone = std::make_shared<QStabilizerRank>(qubitCount, 0U, rand_generator, CMPLX_DEFAULT_ARG,
+        false, randGlobalPhase, false, -1, hardware_rand_generator != NULL);
+    clone->Finish();
+
+    clone->x = x;
+    clone->z = z;
+    clone->r = r;
+    clone->phaseOffset = phaseOffset;
+    clone->randomSeed = randomSeed;
+    clone->terms = terms;
+
+    return clone;
+}
+
+void QStabilizerRank::SaveCheckpoint(CheckpointWriter& writer)
+{
+    if (terms.size()) {
+        throw std::domain_error("QStabilizerRank::SaveCheckpoint() not implemented for more than one term!");
+    }
+
+    QStabilizer::SaveCheckpoint(writer);
+}
+
+void QStabilizerRank::LoadCheckpoint(CheckpointReader& reader)
+{
+    terms.clear();
+    QStabilizer::LoadCheckpoint(reader);
+}
+
+void QStabilizerRank::SetPermutation(bitCapInt perm, complex phaseFac)
+{
+    terms.clear();
+    QStabilizer::SetPermutation(perm, phaseFac);
+}
+
+QStabilizerRank::PauliAction QStabilizerRank::GetPauliAction(const BitRow& px, const BitRow& pz)
+{
+    Finish();
+
+    // for brevity
+    const bitLenInt n = qubitCount;
+    const bitLenInt elemCount = n << 1U;
+    const size_t wordCount = WordCount(n);
+
+    PauliAction action;
+    action.u = BitRow(wordCount, 0U);
+    action.v = BitRow(wordCount, 0U);
+
+    // P anticommutes with S_i exactly where D^u does, and with D_i exactly where S^v does, so P is D^u * S^v, up to
+    // phase.
+    for (bitLenInt i = 0U; i < n; ++i) {
+        if (IsParityOdd(px, z[i + n]) != IsParityOdd(pz, x[i + n])) {
+            SetBit(action.u, i);
+        }
+        if (IsParityOdd(px, z[i]) != IsParityOdd(pz, x[i])) {
+            SetBit(action.v, i);
+        }
+    }
+
+    // Form D^u * S^v in the scratch row, to read off that phase.
+    r[elemCount] = 0U;
+    std::fill(x[elemCount].begin(), x[elemCount].end(), 0U);
+    std::fill(z[elemCount].begin(), z[elemCount].end(), 0U);
+    for (bitLenInt i = 0U; i < n; ++i) {
+        if (GetBit(action.v, i)) {
+            rowmult(elemCount, i + n);
+        }
+    }
+    for (bitLenInt i = 0U; i < n; ++i) {
+        if (GetBit(action.u, i)) {
+            rowmult(elemCount, i);
+        }
+    }
+
+    // S^v|S> = |S>, and S^v * D^s = (-1)^|v & s| * D^s * S^v
+    action.omega = I_POWERS[(4U - r[elemCount]) & 0x3U];
+
+    return action;
+}
+
+void QStabilizerRank::ApplyPauliSum(const std::vector<PauliOp>& ops)
+{
+    if (terms.empty()) {
+        terms[BitRow(WordCount(qubitCount), 0U)] = ONE_CMPLX;
+    }
+
+    std::vector<PauliAction> actions;
+    actions.reserve(ops.size());
+    for (size_t i = 0U; i < ops.size(); ++i) {
+        actions.push_back(GetPauliAction(ops[i].px, ops[i].pz));
+    }
+
+    TermMap nTerms;
+    for (const auto& term : terms) {
+        for (size_t i = 0U; i < ops.size(); ++i) {
+            const PauliAction& action = actions[i];
+            BitRow key = term.first;
+            XorRow(key, action.u);
+            const complex amp = ops[i].coeff * action.omega * term.second;
+            nTerms[key] += IsParityOdd(action.v, term.first) ? -amp : amp;
+        }
+    }
+
+    real1 nrm = ZERO_R1;
+    for (auto it = nTerms.begin(); it != nTerms.end();) {
+        const real1 amp = norm(it->second);
+        if (amp <= FP_NORM_EPSILON) {
+            it = nTerms.erase(it);
+        } else {
+            nrm += amp;
+            ++it;
+        }
+    }
+
+    if (nrm <= ZERO_R1) {
+        throw std::domain_error("QStabilizerRank::ApplyPauliSum() left no terms with nonzero norm!");
+    }
+
+    const real1 scale = ONE_R1 / (real1)sqrt(nrm);
+    for (auto& term : nTerms) {
+        term.second *= scale;
+    }
+
+    terms.swap(nTerms);
+
+    Compact();
+}
+
+void QStabilizerRank::ApplyControlledMtrx(
+    const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target, bitCapIntOcl perm)
+{
+    if (target >= qubitCount) {
+        throw std::invalid_argument("QStabilizerRank gate qubit indices are out-of-bounds!");
+    }
+    ThrowIfQbIdArrayIsBad(controls, qubitCount, "QStabilizerRank gate qubit indices are out-of-bounds!");
+
+    // Each control projector, |0><0| or |1><1|, is (I +/- Z) / 2, and the payload only acts, (as M - I,) on their
+    // product.
+    complex payload[4U]{ mtrx[0U], mtrx[1U], mtrx[2U], mtrx[3U] };
+    if (controls.size()) {
+        payload[0U] -= ONE_CMPLX;
+        payload[3U] -= ONE_CMPLX;
+    }
+
+    // Pauli components of the payload, tr(P * payload) / 2, for I, X, Y, and Z
+    const complex components[4U]{ (payload[0U] + payload[3U]) / (real1)2,
+        (payload[1U] + payload[2U]) / (real1)2, I_CMPLX * (payload[1U] - payload[2U]) / (real1)2,
+        (payload[0U] - payload[3U]) / (real1)2 };
+
+    const size_t wordCount = WordCount(qubitCount);
+    const bitCapIntOcl subsetCount = pow2Ocl(controls.size());
+    const real1 subsetNorm = ONE_R1 / (real1)subsetCount;
+
+    std::vector<PauliOp> ops;
+    for (bitCapIntOcl subset = 0U; subset < subsetCount; ++subset) {
+        // Every control set to |1> contributes a factor of -Z / 2, and every one set to |0> a factor of Z / 2.
+        const bool isOdd = PopCount(subset & perm) & 1U;
+        for (size_t p = 0U; p < 4U; ++p) {
+            complex coeff = (isOdd ? -subsetNorm : subsetNorm) * components[p];
+            if (controls.size() && !subset && !p) {
+                coeff += ONE_CMPLX;
+            }
+            if (norm(coeff) <= FP_NORM_EPSILON) {
+                continue;
+            }
+
+            PauliOp op;
+            op.px = BitRow(wordCount, 0U);
+            op.pz = BitRow(wordCount, 0U);
+            op.coeff = coeff;
+            for (size_t i = 0U; i < controls.size(); ++i) {
+                if ((subset >> i) & 1U) {
+                    SetBit(op.pz, controls[i]);
+                }
+            }
+            if ((p == 1U) || (p == 2U)) {
+                SetBit(op.px, target);
+            }
+            if ((p == 2U) || (p == 3U)) {
+                SetBit(op.pz, target);
+            }
+            ops.push_back(op);
+        }
+    }
+
+    ApplyPauliSum(ops);
+}
+
+real1_f QStabilizerRank::ExpectationPauli(const BitRow& px, const BitRow& pz)
+{
+    const PauliAction action = GetPauliAction(px, pz);
+
+    std::vector<const TermMap::value_type*> entries;
+    entries.reserve(terms.size());
+    for (const auto& term : terms) {
+        entries.push_back(&term);
+    }
+
+    const unsigned numCores = GetConcurrencyLevel();
+    std::unique_ptr<complex[]> expBuff(new complex[numCores]());
+    std::unique_ptr<real1[]> nrmBuff(new real1[numCores]());
+
+    // <P> is the sum over s of conj(d_(s ^ u)) * omega * (-1)^|v & s| * d_s.
+    par_for(0U, entries.size(), [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        const TermMap::value_type& term = *(entries[lcv]);
+        nrmBuff[cpu] += norm(term.second);
+
+        BitRow key = term.first;
+        XorRow(key, action.u);
+        const auto partner = terms.find(key);
+        if (partner == terms.end()) {
+            return;
+        }
+
+        const complex amp = conj(partner->second) * action.omega * term.second;
+        expBuff[cpu] += IsParityOdd(action.v, term.first) ? -amp : amp;
+    });
+
+    complex expectation = ZERO_CMPLX;
+    real1 nrm = ZERO_R1;
+    for (unsigned i = 0U; i < numCores; ++i) {
+        expectation += expBuff[i];
+        nrm += nrmBuff[i];
+    }
+
+    return (real1_f)(real(expectation) / nrm);
+}
+
+void QStabilizerRank::Compact()
+{
+    if (terms.size() != 1U) {
+        return;
+    }
+
+    Finish();
+
+    // D^s|S> is stabilized by D^s * S_i * D^s, which is -S_i exactly where s_i = 1.
+    const BitRow& key = terms.begin()->first;
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        if (GetBit(key, i)) {
+            r[i + qubitCount] = (r[i + qubitCount] + 2U) & 0x3U;
+        }
+    }
+
+    terms.clear();
+}
+
+void QStabilizerRank::GetTermPaulis(
+    std::vector<bitCapIntOcl>& xMasks, std::vector<bitCapIntOcl>& zMasks, std::vector<complex>& amps)
+{
+    Finish();
+
+    const bitLenInt elemCount = qubitCount << 1U;
+
+    xMasks.clear();
+    zMasks.clear();
+    amps.clear();
+
+    for (const auto& term : terms) {
+        r[elemCount] = 0U;
+        std::fill(x[elemCount].begin(), x[elemCount].end(), 0U);
+        std::fill(z[elemCount].begin(), z[elemCount].end(), 0U);
+        for (bitLenInt i = 0U; i < qubitCount; ++i) {
+            if (GetBit(term.first, i)) {
+                rowmult(elemCount, i);
+            }
+        }
+
+        // Every Pauli "Y" is i * X * Z.
+        uint8_t e = r[elemCount];
+        for (size_t w = 0U; w < x[elemCount].size(); ++w) {
+            e = (e + PopCount(x[elemCount][w] & z[elemCount][w])) & 0x3U;
+        }
+
+        bitCapIntOcl xMask = 0U;
+        bitCapIntOcl zMask = 0U;
+        for (bitLenInt j = 0U; j < qubitCount; ++j) {
+            if (GetBit(x[elemCount], j)) {
+                xMask |= pow2Ocl(j);
+            }
+            if (GetBit(z[elemCount], j)) {
+                zMask |= pow2Ocl(j);
+            }
+        }
+
+        xMasks.push_back(xMask);
+        zMasks.push_back(zMask);
+        amps.push_back(I_POWERS[e] * term.second);
+    }
+}
+
+void QStabilizerRank::GetTermsState(complex* stateVec)
+{
+    std::vector<bitCapIntOcl> xMasks;
+    std::vector<bitCapIntOcl> zMasks;
+    std::vector<complex> amps;
+    GetTermPaulis(xMasks, zMasks, amps);
+
+    // Gaussian elimination, for the ket of |S>, rewrites the rows that define the terms' basis, so we put them back.
+    std::vector<BitRow> sX(x);
+    std::vector<BitRow> sZ(z);
+    std::vector<uint8_t> sR(r);
+
+    const bitCapIntOcl maxQPower = pow2Ocl(qubitCount);
+    std::unique_ptr<complex[]> stabilizerState(new complex[maxQPower]);
+    QStabilizer::GetQuantumState(stabilizerState.get());
+
+    x.swap(sX);
+    z.swap(sZ);
+    r.swap(sR);
+
+    // <j|X^x * Z^z|S> = (-1)^|(j ^ x) & z| * <j ^ x|S>
+    par_for(0U, maxQPower, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        complex amp = ZERO_CMPLX;
+        for (size_t i = 0U; i < amps.size(); ++i) {
+            const bitCapIntOcl j = lcv ^ xMasks[i];
+            const complex termAmp = amps[i] * stabilizerState[j];
+            amp += (PopCount(j & zMasks[i]) & 1U) ? -termAmp : termAmp;
+        }
+        stateVec[lcv] = amp;
+    });
+}
+
+bool QStabilizerRank::ForceM(bitLenInt t, bool result, bool doForce, bool doApply)
+{
+    if (terms.empty()) {
+        return QStabilizer::ForceM(t, result, doForce, doApply);
+    }
+
+    if (t >= qubitCount) {
+        throw std::invalid_argument("QStabilizerRank::ForceM qubit index is out-of-bounds!");
+    }
+
+    if (doForce && !doApply) {
+        return result;
+    }
+
+    const real1_f prob = Prob(t);
+    if (!doForce) {
+        if (prob <= ZERO_R1_F) {
+            result = false;
+        } else if (prob >= ONE_R1_F) {
+            result = true;
+        } else {
+            result = (QInterface::Rand() <= prob);
+        }
+    }
+
+    if ((result ? prob : (ONE_R1_F - prob)) <= FP_NORM_EPSILON_F) {
+        throw std::invalid_argument("QStabilizerRank::ForceM() forced a measurement with 0 probability!");
+    }
+
+    if (!doApply) {
+        return result;
+    }
+
+    // Project with (I +/- Z) / 2, (and renormalize).
+    const size_t wordCount = WordCount(qubitCount);
+    const real1 half = ONE_R1 / 2;
+    std::vector<PauliOp> ops(2U);
+    ops[0U].px = BitRow(wordCount, 0U);
+    ops[0U].pz = BitRow(wordCount, 0U);
+    ops[0U].coeff = complex(half, ZERO_R1);
+    ops[1U].px = BitRow(wordCount, 0U);
+    ops[1U].pz = BitRow(wordCount, 0U);
+    SetBit(ops[1U].pz, t);
+    ops[1U].coeff = complex(result ? -half : half, ZERO_R1);
+    ApplyPauliSum(ops);
+
+    return result;
+}
+
+real1_f QStabilizerRank::Prob(bitLenInt qubit)
+{
+    if (terms.empty()) {
+        return QStabilizer::Prob(qubit);
+    }
+
+    if (qubit >= qubitCount) {
+        throw std::invalid_argument("QStabilizerRank::Prob qubit index is out-of-bounds!");
+    }
+
+    const size_t wordCount = WordCount(qubitCount);
+    const BitRow px(wordCount, 0U);
+    BitRow pz(wordCount, 0U);
+    SetBit(pz, qubit);
+
+    return clampProb((ONE_R1_F - ExpectationPauli(px, pz)) / 2);
+}
+
+bool QStabilizerRank::IsSeparableZ(const bitLenInt& target)
+{
+    if (terms.empty()) {
+        return QStabilizer::IsSeparableZ(target);
+    }
+
+    if (target >= qubitCount) {
+        throw std::invalid_argument("QStabilizerRank::IsSeparableZ qubit index is out-of-bounds!");
+    }
+
+    const size_t wordCount = WordCount(qubitCount);
+    const BitRow px(wordCount, 0U);
+    BitRow pz(wordCount, 0U);
+    SetBit(pz, target);
+
+    return (ONE_R1_F - abs(ExpectationPauli(px, pz))) <= TRYDECOMPOSE_EPSILON;
+}
+
+real1_f QStabilizerRank::FirstNonzeroPhase()
+{
+    if (terms.empty()) {
+        return QStabilizer::FirstNonzeroPhase();
+    }
+
+    const bitCapIntOcl maxQPower = pow2Ocl(qubitCount);
+    std::unique_ptr<complex[]> stateVec(new complex[maxQPower]);
+    GetTermsState(stateVec.get());
+
+    for (bitCapIntOcl i = 0U; i < maxQPower; ++i) {
+        if (norm(stateVec[i]) > FP_NORM_EPSILON) {
+            return (real1_f)std::arg(stateVec[i]);
+        }
+    }
+
+    return ZERO_R1_F;
+}
+
+void QStabilizerRank::GetQuantumState(complex* stateVec)
+{
+    if (terms.empty()) {
+        QStabilizer::GetQuantumState(stateVec);
+        return;
+    }
+
+    GetTermsState(stateVec);
+}
+
+void QStabilizerRank::GetQuantumState(QInterfacePtr eng)
+{
+    if (terms.empty()) {
+        QStabilizer::GetQuantumState(eng);
+        return;
+    }
+
+    std::unique_ptr<complex[]> stateVec(new complex[pow2Ocl(qubitCount)]);
+    GetTermsState(stateVec.get());
+    eng->SetQuantumState(stateVec.get());
+}
+
+void QStabilizerRank::GetProbs(real1* outputProbs)
+{
+    if (terms.empty()) {
+        QStabilizer::GetProbs(outputProbs);
+        return;
+    }
+
+    const bitCapIntOcl maxQPower = pow2Ocl(qubitCount);
+    std::unique_ptr<complex[]> stateVec(new complex[maxQPower]);
+    GetTermsState(stateVec.get());
+    for (bitCapIntOcl i = 0U; i < maxQPower; ++i) {
+        outputProbs[i] = norm(stateVec[i]);
+    }
+}
+
+complex QStabilizerRank::GetAmplitude(bitCapInt perm)
+{
+    if (terms.empty()) {
+        return QStabilizer::GetAmplitude(perm);
+    }
+
+    std::vector<bitCapIntOcl> xMasks;
+    std::vector<bitCapIntOcl> zMasks;
+    std::vector<complex> amps;
+    GetTermPaulis(xMasks, zMasks, amps);
+
+    const std::vector<BitRow> sX(x);
+    const std::vector<BitRow> sZ(z);
+    const std::vector<uint8_t> sR(r);
+
+    complex amp = ZERO_CMPLX;
+    for (size_t i = 0U; i < amps.size(); ++i) {
+        const bitCapIntOcl j = (bitCapIntOcl)perm ^ xMasks[i];
+        const complex termAmp = amps[i] * QStabilizer::GetAmplitude(j);
+        amp += (PopCount(j & zMasks[i]) & 1U) ? -termAmp : termAmp;
+
+        // (Gaussian elimination rewrites the rows that define the terms' basis.)
+        x = sX;
+        z = sZ;
+        r = sR;
+    }
+
+    return amp;
+}
+
+bitLenInt QStabilizerRank::Compose(QStabilizerPtr toCopy, bitLenInt start)
+{
+    const QStabilizerRankPtr rankCopy = std::dynamic_pointer_cast<QStabilizerRank>(toCopy);
+    const bool isCopyRanked = rankCopy && rankCopy->terms.size();
+    if (terms.empty() && !isCopyRanked) {
+        return QStabilizer::Compose(toCopy, start);
+    }
+
+    if (start > qubitCount) {
+        throw std::invalid_argument("QStabilizerRank::Compose start index is out-of-bounds!");
+    }
+
+    const bitLenInt oQubitCount = qubitCount;
+    const bitLenInt length = toCopy->GetQubitCount();
+
+    TermMap oTerms;
+    oTerms.swap(terms);
+    if (oTerms.empty()) {
+        oTerms[BitRow(WordCount(oQubitCount), 0U)] = ONE_CMPLX;
+    }
+    TermMap cTerms;
+    if (isCopyRanked) {
+        cTerms = rankCopy->terms;
+    } else {
+        cTerms[BitRow(WordCount(length), 0U)] = ONE_CMPLX;
+    }
+
+    QStabilizer::Compose(toCopy, start);
+
+    // Destabilizer rows move as in QStabilizer::Compose(), and the syndrome bits move with them.
+    const size_t nWordCount = WordCount(qubitCount);
+    std::vector<std::pair<BitRow, complex>> oShifted;
+    for (const auto& term : oTerms) {
+        BitRow key(nWordCount, 0U);
+        for (bitLenInt i = 0U; i < oQubitCount; ++i) {
+            if (GetBit(term.first, i)) {
+                SetBit(key, (i < start) ? i : (i + length));
+            }
+        }
+        oShifted.push_back(std::make_pair(key, term.second));
+    }
+    std::vector<std::pair<BitRow, complex>> cShifted;
+    for (const auto& term : cTerms) {
+        BitRow key(nWordCount, 0U);
+        for (bitLenInt i = 0U; i < length; ++i) {
+            if (GetBit(term.first, i)) {
+                SetBit(key, start + i);
+            }
+        }
+        cShifted.push_back(std::make_pair(key, term.second));
+    }
+
+    for (const auto& oTerm : oShifted) {
+        for (const auto& cTerm : cShifted) {
+            BitRow key = oTerm.first;
+            XorRow(key, cTerm.first);
+            terms[key] = oTerm.second * cTerm.second;
+        }
+    }
+
+    Compact();
+
+    return start;
+}
+
+void QStabilizerRank::Decompose(bitLenInt start, QInterfacePtr dest)
+{
+    if (terms.size()) {
+        throw std::domain_error("QStabilizerRank::Decompose() not implemented for more than one term!");
+    }
+
+    QStabilizer::Decompose(start, dest);
+}
+
+void QStabilizerRank::Dispose(bitLenInt start, bitLenInt length)
+{
+    if (terms.size()) {
+        throw std::domain_error("QStabilizerRank::Dispose() not implemented for more than one term!");
+    }
+
+    QStabilizer::Dispose(start, length);
+}
+
+void QStabilizerRank::Dispose(bitLenInt start, bitLenInt length, bitCapInt ignored)
+{
+    if (terms.size()) {
+        throw std::domain_error("QStabilizerRank::Dispose() not implemented for more than one term!");
+    }
+
+    QStabilizer::Dispose(start, length, ignored);
+}
+
+bool QStabilizerRank::CanDecomposeDispose(const bitLenInt start, const bitLenInt length)
+{
+    if (terms.empty()) {
+        return QStabilizer::CanDecomposeDispose(start, length);
+    }
+
+    if (isBadBitRange(start, length, qubitCount)) {
+        throw std::invalid_argument("QStabilizerRank::CanDecomposeDispose range is out-of-bounds!");
+    }
+
+    // (A sum of terms could factor, but we don't try to find out.)
+    return false;
+}
+
+void QStabilizerRank::Mtrx(complex const* mtrx, bitLenInt target)
+{
+    try {
+        QStabilizer::Mtrx(mtrx, target);
+    } catch (const std::domain_error&) {
+        ApplyControlledMtrx(std::vector<bitLenInt>(), mtrx, target, 0U);
+    }
+}
+
+void QStabilizerRank::Phase(complex topLeft, complex bottomRight, bitLenInt target)
+{
+    try {
+        QStabilizer::Phase(topLeft, bottomRight, target);
+    } catch (const std::domain_error&) {
+        const complex mtrx[4U]{ topLeft, ZERO_CMPLX, ZERO_CMPLX, bottomRight };
+        ApplyControlledMtrx(std::vector<bitLenInt>(), mtrx, target, 0U);
+    }
+}
+
+void QStabilizerRank::Invert(complex topRight, complex bottomLeft, bitLenInt target)
+{
+    try {
+        QStabilizer::Invert(topRight, bottomLeft, target);
+    } catch (const std::domain_error&) {
+        const complex mtrx[4U]{ ZERO_CMPLX, topRight, bottomLeft, ZERO_CMPLX };
+        ApplyControlledMtrx(std::vector<bitLenInt>(), mtrx, target, 0U);
+    }
+}
+
+void QStabilizerRank::MCPhase(
+    const std::vector<bitLenInt>& controls, complex topLeft, complex bottomRight, bitLenInt target)
+{
+    try {
+        QStabilizer::MCPhase(controls, topLeft, bottomRight, target);
+    } catch (const std::domain_error&) {
+        const complex mtrx[4U]{ topLeft, ZERO_CMPLX, ZERO_CMPLX, bottomRight };
+        ApplyControlledMtrx(controls, mtrx, target, pow2Ocl(controls.size()) - 1U);
+    }
+}
+
+void QStabilizerRank::MACPhase(
+    const std::vector<bitLenInt>& controls, complex topLeft, complex bottomRight, bitLenInt target)
+{
+    try {
+        QStabilizer::MACPhase(controls, topLeft, bottomRight, target);
+    } catch (const std::domain_error&) {
+        const complex mtrx[4U]{ topLeft, ZERO_CMPLX, ZERO_CMPLX, bottomRight };
+        ApplyControlledMtrx(controls, mtrx, target, 0U);
+    }
+}
+
+void QStabilizerRank::MCInvert(
+    const std::vector<bitLenInt>& controls, complex topRight, complex bottomLeft, bitLenInt target)
+{
+    try {
+        QStabilizer::MCInvert(controls, topRight, bottomLeft, target);
+    } catch (const std::domain_error&) {
+        const complex mtrx[4U]{ ZERO_CMPLX, topRight, bottomLeft, ZERO_CMPLX };
+        ApplyControlledMtrx(controls, mtrx, target, pow2Ocl(controls.size()) - 1U);
+    }
+}
+
+void QStabilizerRank::MACInvert(
+    const std::vector<bitLenInt>& controls, complex topRight, complex bottomLeft, bitLenInt target)
+{
+    try {
+        QStabilizer::MACInvert(controls, topRight, bottomLeft, target);
+    } catch (const std::domain_error&) {
+        const complex mtrx[4U]{ ZERO_CMPLX, topRight, bottomLeft, ZERO_CMPLX };
+        ApplyControlledMtrx(controls, mtrx, target, 0U);
+    }
+}
+
+void QStabilizerRank::MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+{
+    if (!controls.size()) {
+        Mtrx(mtrx, target);
+        return;
+    }
+
+    if ((IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U])) || (IS_NORM_0(mtrx[0U]) && IS_NORM_0(mtrx[3U]))) {
+        QStabilizer::MCMtrx(controls, mtrx, target);
+        return;
+    }
+
+    ApplyControlledMtrx(controls, mtrx, target, pow2Ocl(controls.size()) - 1U);
+}
+
+void QStabilizerRank::MACMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
+{
+    if (!controls.size()) {
+        Mtrx(mtrx, target);
+        return;
+    }
+
+    if ((IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U])) || (IS_NORM_0(mtrx[0U]) && IS_NORM_0(mtrx[3U]))) {
+        QStabilizer::MACMtrx(controls, mtrx, target);
+        return;
+    }
+
+    ApplyControlledMtrx(controls, mtrx, target, 0U);
+}
+} // namespace Qrack
@@ -8,8 +8,10 @@
 // See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
 // for details.
 
+#include "common/engine_profile.hpp"
 #include "qfactory.hpp"
 
+#include <array>
 #include <thread>
 
 #define IS_REAL_1(r) (abs(ONE_CMPLX - r) <= FP_NORM_EPSILON)
@@ -40,10 +42,15 @@ QStabilizerHybrid::QStabilizerHybrid(std::vector<QInterfaceEngine> eng, bitLenIn
     , doNormalize(doNorm)
     , isSparse(useSparseStateVec)
     , useTGadget(true)
+    , isDispatchWide(false)
     , thresholdQubits(qubitThreshold)
     , ancillaCount(0)
     , maxQubitPlusAncillaCount(28)
+    , maxStabilizerRank(0U)
     , separabilityThreshold(sep_thresh)
+    , roundingThreshold(ZERO_R1_F)
+    , minRoundingFidelity(ZERO_R1_F)
+    , unitaryFidelity(ONE_R1_F)
     , devID(deviceId)
     , phaseFactor(phaseFac)
     , engine(NULL)
@@ -58,7 +65,8 @@ QStabilizerHybrid::QStabilizerHybrid(std::vector<QInterfaceEngine> eng, bitLenIn
     const bitLenInt maxPageQubits = log2(devContext->GetMaxAlloc() / sizeof(complex));
 #else
     const bitLenInt maxPageQubits =
-        getenv("QRACK_MAX_CPU_QB") ? (bitLenInt)std::stoi(std::string(getenv("QRACK_MAX_CPU_QB"))) - 2U : 30U;
+        getenv("QRACK_MAX_CPU_QB") ? (bitLenInt)std::stoi(std::string(getenv("QRACK_MAX_CPU_QB"))) - 2U
+                                   : (bitLenInt)(EngineProfile::Instance().GetMaxQubits(-1, 32U) - 2U);
 #endif
 
 #if ENABLE_ENV_VARS
@@ -69,11 +77,28 @@ QStabilizerHybrid::QStabilizerHybrid(std::vector<QInterfaceEngine> eng, bitLenIn
     maxQubitPlusAncillaCount = maxPageQubits + 2U;
 #endif
 
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_MAX_STABILIZER_RANK")) {
+        maxStabilizerRank = (size_t)std::stoull(std::string(getenv("QRACK_MAX_STABILIZER_RANK")));
+    }
+    if (getenv("QRACK_CLIFFORD_ROUNDING_EPSILON")) {
+        roundingThreshold = (real1_f)std::stof(std::string(getenv("QRACK_CLIFFORD_ROUNDING_EPSILON")));
+    }
+    if (getenv("QRACK_CLIFFORD_ROUNDING_MIN_FIDELITY")) {
+        minRoundingFidelity = (real1_f)std::stof(std::string(getenv("QRACK_CLIFFORD_ROUNDING_MIN_FIDELITY")));
+    }
+#endif
+
     stabilizer = MakeStabilizer(initState);
 }
 
 QStabilizerPtr QStabilizerHybrid::MakeStabilizer(bitCapInt perm)
 {
+    if (maxStabilizerRank) {
+        return std::make_shared<QStabilizerRank>(qubitCount + ancillaCount, perm, rand_generator, CMPLX_DEFAULT_ARG,
+            false, randGlobalPhase, false, -1, useRDRAND);
+    }
+
     return std::make_shared<QStabilizer>(qubitCount + ancillaCount, perm, rand_generator, CMPLX_DEFAULT_ARG, false,
         randGlobalPhase, false, -1, useRDRAND);
 }
@@ -83,6 +108,7 @@ QInterfacePtr QStabilizerHybrid::MakeEngine(bitCapInt perm)
         doNormalize, randGlobalPhase, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs,
         thresholdQubits, separabilityThreshold);
     toRet->SetConcurrency(GetConcurrencyLevel());
+    toRet->SetDispatchWide(isDispatchWide);
     return toRet;
 }
 QInterfacePtr QStabilizerHybrid::MakeEngine(bitCapInt perm, bitLenInt qbCount)
@@ -91,6 +117,7 @@ QInterfacePtr QStabilizerHybrid::MakeEngine(bitCapInt perm, bitLenInt qbCount)
         randGlobalPhase, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs, thresholdQubits,
         separabilityThreshold);
     toRet->SetConcurrency(GetConcurrencyLevel());
+    toRet->SetDispatchWide(isDispatchWide);
     return toRet;
 }
 
@@ -129,8 +156,10 @@ void QStabilizerHybrid::FlushIfBlocked(bitLenInt control, bitLenInt target, bool
     }
     shard = shards[control];
     if (shard && !shard->IsPhase()) {
-        SwitchToEngine();
-        return;
+        FlushToStabilizerRank(control);
+        if (engine) {
+            return;
+        }
     }
 
     shard = shards[target];
@@ -149,7 +178,7 @@ void QStabilizerHybrid::FlushIfBlocked(bitLenInt control, bitLenInt target, bool
     // Shard is definitely non-NULL.
 
     if (!(shard->IsPhase())) {
-        SwitchToEngine();
+        FlushToStabilizerRank(target);
         return;
     }
     // Shard is definitely a phase gate.
@@ -164,8 +193,8 @@ void QStabilizerHybrid::FlushIfBlocked(bitLenInt control, bitLenInt target, bool
     // PRX Quantum 3, 020361 – Published 23 June 2022
 
     if (!useTGadget || ((qubitCount + ancillaCount) >= maxQubitPlusAncillaCount)) {
-        // The option to optimize this case is off.
-        SwitchToEngine();
+        // The option to optimize this case is off, (but we might still have room for more stabilizer terms).
+        FlushToStabilizerRank(target);
         return;
     }
 
@@ -190,6 +219,21 @@ void QStabilizerHybrid::FlushIfBlocked(bitLenInt control, bitLenInt target, bool
     // Dispose(ancillaIndex, 1U);
 }
 
+void QStabilizerHybrid::FlushToStabilizerRank(bitLenInt qubit)
+{
+    const MpsShardPtr shard = shards[qubit];
+    const QStabilizerRankPtr rankStabilizer = std::dynamic_pointer_cast<QStabilizerRank>(stabilizer);
+    // A general single bit gate can split every term into 4, but a phase or inversion gate only splits it into 2.
+    const size_t growth = (shard->IsPhase() || shard->IsInvert()) ? 2U : 4U;
+    if (!rankStabilizer || ((rankStabilizer->GetRank() * growth) > maxStabilizerRank)) {
+        SwitchToEngine();
+        return;
+    }
+
+    shards[qubit] = NULL;
+    rankStabilizer->Mtrx(shard->gate, qubit);
+}
+
 bool QStabilizerHybrid::CollapseSeparableShard(bitLenInt qubit)
 {
     MpsShardPtr shard = shards[qubit];
@@ -217,9 +261,11 @@ bool QStabilizerHybrid::CollapseSeparableShard(bitLenInt qubit)
 void QStabilizerHybrid::FlushBuffers()
 {
     if (stabilizer) {
-        if (IsBuffered()) {
-            // This will call FlushBuffers() again after no longer stabilizer.
-            SwitchToEngine();
+        for (size_t i = 0U; stabilizer && (i < shards.size()); ++i) {
+            if (shards[i]) {
+                // If we run out of stabilizer rank, this will call FlushBuffers() again after no longer stabilizer.
+                FlushToStabilizerRank(i);
+            }
         }
         return;
     }
@@ -312,11 +358,87 @@ void QStabilizerHybrid::CacheEigenstate(bitLenInt target)
     shards[target] = toRet;
 }
 
+/// The 24 single-qubit Clifford gates, (up to global phase,) as the closure of H and S
+static std::vector<std::array<complex, 4U>> MakeSingleQubitCliffords()
+{
+    const complex h[4U]{ complex(SQRT1_2_R1, ZERO_R1), complex(SQRT1_2_R1, ZERO_R1), complex(SQRT1_2_R1, ZERO_R1),
+        -complex(SQRT1_2_R1, ZERO_R1) };
+    const complex s[4U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, I_CMPLX };
+    std::vector<std::array<complex, 4U>> cliffords{ { ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX } };
+    for (size_t i = 0U; i < cliffords.size(); ++i) {
+        for (const complex* gen : { h, s }) {
+            std::array<complex, 4U> product;
+            mul2x2(gen, cliffords[i].data(), product.data());
+            bool isNew = true;
+            for (const std::array<complex, 4U>& c : cliffords) {
+                // |Tr(C^dagger D)| is 2 for the same gate, up to phase, and at most sqrt(2) for distinct ones.
+                const complex tr = conj(c[0U]) * product[0U] + conj(c[2U]) * product[2U] +
+                    conj(c[1U]) * product[1U] + conj(c[3U]) * product[3U];
+                if (abs(tr) > (real1)(1.9f)) {
+                    isNew = false;
+                    break;
+                }
+            }
+            if (isNew) {
+                cliffords.push_back(product);
+            }
+        }
+    }
+
+    return cliffords;
+}
+
+bool QStabilizerHybrid::RoundToClifford(complex const* mtrx, bitLenInt target)
+{
+    if (roundingThreshold <= ZERO_R1_F) {
+        return false;
+    }
+
+    static const std::vector<std::array<complex, 4U>> cliffords = MakeSingleQubitCliffords();
+
+    // The process fidelity of unitary U to C is |Tr(C^dagger U)|^2 / 4, which is blind to global phase.
+    real1_f bestFidelity = ZERO_R1_F;
+    size_t best = 0U;
+    complex bestTrace = ONE_CMPLX;
+    for (size_t i = 0U; i < cliffords.size(); ++i) {
+        const std::array<complex, 4U>& c = cliffords[i];
+        const complex tr =
+            conj(c[0U]) * mtrx[0U] + conj(c[2U]) * mtrx[2U] + conj(c[1U]) * mtrx[1U] + conj(c[3U]) * mtrx[3U];
+        const real1_f fidelity = (real1_f)(norm(tr) / 4);
+        if (fidelity > bestFidelity) {
+            bestFidelity = fidelity;
+            best = i;
+            bestTrace = tr;
+        }
+    }
+    if (bestFidelity > ONE_R1_F) {
+        bestFidelity = ONE_R1_F;
+    }
+
+    if (((ONE_R1_F - bestFidelity) > roundingThreshold) || ((unitaryFidelity * bestFidelity) < minRoundingFidelity)) {
+        // (Once the budget is spent, gates are buffered exactly, as without rounding.)
+        return false;
+    }
+
+    // Keep the global phase of "mtrx," as nearly as the Clifford gate can.
+    const complex phase = (abs(bestTrace) > ZERO_R1) ? (bestTrace / abs(bestTrace)) : ONE_CMPLX;
+    const complex rounded[4U]{ phase * cliffords[best][0U], phase * cliffords[best][1U], phase * cliffords[best][2U],
+        phase * cliffords[best][3U] };
+    stabilizer->Mtrx(rounded, target);
+    unitaryFidelity *= bestFidelity;
+
+    return true;
+}
+
 QInterfacePtr QStabilizerHybrid::Clone()
 {
     QStabilizerHybridPtr c = std::make_shared<QStabilizerHybrid>(cloneEngineTypes, qubitCount, 0, rand_generator,
         phaseFactor, doNormalize, randGlobalPhase, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor,
         std::vector<int64_t>{}, thresholdQubits, separabilityThreshold);
+    c->roundingThreshold = roundingThreshold;
+    c->minRoundingFidelity = minRoundingFidelity;
+    c->unitaryFidelity = unitaryFidelity;
+    c->isDispatchWide = isDispatchWide;
 
     if (engine) {
         // Clone and set engine directly.
@@ -330,6 +452,7 @@ QInterfacePtr QStabilizerHybrid::Clone()
     c->stabilizer = std::dynamic_pointer_cast<QStabilizer>(stabilizer->Clone());
     c->shards.resize(shards.size());
     c->ancillaCount = ancillaCount;
+    c->maxStabilizerRank = maxStabilizerRank;
     for (size_t i = 0U; i < shards.size(); ++i) {
         if (shards[i]) {
             c->shards[i] = std::make_shared<MpsShard>(shards[i]->gate);
@@ -339,8 +462,77 @@ QInterfacePtr QStabilizerHybrid::Clone()
     return c;
 }
 
+void QStabilizerHybrid::SaveCheckpoint(CheckpointWriter& writer)
+{
+    if (IsStabilizerRanked()) {
+        // The checkpoint format holds a single stabilizer state.
+        SwitchToEngine();
+    }
+
+    writer.BeginSection("QSHY");
+    writer.Write<uint64_t>(qubitCount);
+    writer.Write<uint64_t>(ancillaCount);
+    writer.Write<uint8_t>(engine ? 1U : 0U);
+
+    // Buffered single qubit gates, (including on ancillae,) are part of the state.
+    writer.Write<uint64_t>(shards.size());
+    for (size_t i = 0U; i < shards.size(); ++i) {
+        writer.Write<uint8_t>(shards[i] ? 1U : 0U);
+        if (shards[i]) {
+            for (size_t j = 0U; j < 4U; ++j) {
+                writer.Write<complex>(shards[i]->gate[j]);
+            }
+        }
+    }
+
+    if (engine) {
+        writer.Write<uint64_t>(engine->GetQubitCount());
+        engine->SaveCheckpoint(writer);
+    } else {
+        stabilizer->SaveCheckpoint(writer);
+    }
+}
+
+void QStabilizerHybrid::LoadCheckpoint(CheckpointReader& reader)
+{
+    reader.ExpectSection("QSHY");
+    if (reader.Read<uint64_t>() != qubitCount) {
+        throw std::invalid_argument("QStabilizerHybrid::LoadCheckpoint() checkpoint qubit count does not match!");
+    }
+    const bitLenInt ancillae = (bitLenInt)reader.Read<uint64_t>();
+    const bool isEngine = reader.Read<uint8_t>() != 0U;
+
+    std::vector<MpsShardPtr> nShards(reader.Read<uint64_t>());
+    if (nShards.size() < qubitCount) {
+        throw std::runtime_error("QStabilizerHybrid::LoadCheckpoint() checkpoint shard count is invalid!");
+    }
+    for (size_t i = 0U; i < nShards.size(); ++i) {
+        if (!reader.Read<uint8_t>()) {
+            continue;
+        }
+        complex gate[4U];
+        for (size_t j = 0U; j < 4U; ++j) {
+            gate[j] = reader.Read<complex>();
+        }
+        nShards[i] = std::make_shared<MpsShard>(gate);
+    }
+
+    ancillaCount = ancillae;
+    if (isEngine) {
+        engine = MakeEngine(0U, (bitLenInt)reader.Read<uint64_t>());
+        engine->LoadCheckpoint(reader);
+        stabilizer = NULL;
+    } else {
+        stabilizer = MakeStabilizer(0U);
+        stabilizer->LoadCheckpoint(reader);
+        engine = NULL;
+    }
+    shards = nShards;
+}
+
 void QStabilizerHybrid::SwitchToEngine()
 {
+    QRACK_INSTRUMENT("QStabilizerHybrid", "SwitchToEngine");
     if (engine) {
         return;
     }
@@ -396,9 +588,14 @@ bitLenInt QStabilizerHybrid::ComposeEither(QStabilizerHybridPtr toCopy, bool wil
         SwitchToEngine();
         toRet = willDestroy ? engine->ComposeNoClone(toCopy->engine) : engine->Compose(toCopy->engine);
     } else {
+        if (toCopy->IsStabilizerRanked() && !std::dynamic_pointer_cast<QStabilizerRank>(stabilizer)) {
+            // Only a QStabilizerRank can carry the other's terms.
+            stabilizer = std::make_shared<QStabilizerRank>(stabilizer);
+        }
         toRet = stabilizer->Compose(toCopy->stabilizer, qubitCount);
         ancillaCount += toCopy->ancillaCount;
     }
+    unitaryFidelity *= toCopy->unitaryFidelity;
 
     // Resize the shards buffer.
     shards.insert(shards.begin() + qubitCount, toCopy->shards.begin(), toCopy->shards.end());
@@ -414,6 +611,49 @@ bitLenInt QStabilizerHybrid::ComposeEither(QStabilizerHybridPtr toCopy, bool wil
     return toRet;
 }
 
+std::map<QInterfacePtr, bitLenInt> QStabilizerHybrid::Compose(std::vector<QInterfacePtr> toCopy)
+{
+    std::vector<QStabilizerHybridPtr> srcs;
+    bool isEngine = !!engine;
+    for (const QInterfacePtr& q : toCopy) {
+        srcs.push_back(std::dynamic_pointer_cast<QStabilizerHybrid>(q));
+        isEngine |= !!srcs.back()->engine;
+    }
+
+    if (!isEngine) {
+        // Tableaux are cheap to compose pairwise.
+        return QInterface::Compose(toCopy);
+    }
+
+    // Composing with any engine switches every other unit to an engine, so switch them all up front, and let the
+    // engine write the full tensor product at once.
+    SwitchToEngine();
+
+    std::map<QInterfacePtr, bitLenInt> ret;
+    std::vector<QInterfacePtr> engines;
+    bitLenInt nQubits = qubitCount;
+    for (size_t i = 0U; i < srcs.size(); ++i) {
+        const QStabilizerHybridPtr& src = srcs[i];
+        ret[toCopy[i]] = nQubits;
+        if (!src->qubitCount) {
+            continue;
+        }
+        src->SwitchToEngine();
+        engines.push_back(src->engine);
+        unitaryFidelity *= src->unitaryFidelity;
+        // Resize the shards buffer, splitting the common shared_ptr references with "src."
+        for (const MpsShardPtr& shard : src->shards) {
+            shards.push_back(shard ? shard->Clone() : NULL);
+        }
+        nQubits += src->qubitCount;
+    }
+
+    engine->Compose(engines);
+    SetQubitCount(nQubits);
+
+    return ret;
+}
+
 bitLenInt QStabilizerHybrid::Compose(QStabilizerHybridPtr toCopy, bitLenInt start)
 {
     if (start == qubitCount) {
@@ -443,8 +683,13 @@ bitLenInt QStabilizerHybrid::Compose(QStabilizerHybridPtr toCopy, bitLenInt star
         SwitchToEngine();
         toRet = engine->Compose(toCopy->engine, start);
     } else {
+        if (toCopy->IsStabilizerRanked() && !std::dynamic_pointer_cast<QStabilizerRank>(stabilizer)) {
+            // Only a QStabilizerRank can carry the other's terms.
+            stabilizer = std::make_shared<QStabilizerRank>(stabilizer);
+        }
         toRet = stabilizer->Compose(toCopy->stabilizer, start);
     }
+    unitaryFidelity *= toCopy->unitaryFidelity;
 
     // Resize the shards buffer.
     shards.insert(shards.begin() + start, toCopy->shards.begin(), toCopy->shards.end());
@@ -481,6 +726,11 @@ void QStabilizerHybrid::Decompose(bitLenInt start, QStabilizerHybridPtr dest)
 
     const bitLenInt nQubits = qubitCount - length;
 
+    if (IsStabilizerRanked()) {
+        // (A sum of stabilizer terms doesn't decompose.)
+        SwitchToEngine();
+    }
+
     if (engine) {
         dest->SwitchToEngine();
         engine->Decompose(start, dest->engine);
@@ -503,6 +753,10 @@ void QStabilizerHybrid::Dispose(bitLenInt start, bitLenInt length)
 {
     const bitLenInt nQubits = qubitCount - length;
 
+    if (IsStabilizerRanked()) {
+        SwitchToEngine();
+    }
+
     if (engine) {
         engine->Dispose(start, length);
     } else {
@@ -517,6 +771,10 @@ void QStabilizerHybrid::Dispose(bitLenInt start, bitLenInt length, bitCapInt dis
 {
     const bitLenInt nQubits = qubitCount - length;
 
+    if (IsStabilizerRanked()) {
+        SwitchToEngine();
+    }
+
     if (engine) {
         engine->Dispose(start, length, disposedPerm);
     } else {
@@ -624,6 +882,7 @@ void QStabilizerHybrid::SetQuantumState(complex const* inputState)
 void QStabilizerHybrid::SetPermutation(bitCapInt perm, complex phaseFac)
 {
     DumpBuffers();
+    unitaryFidelity = ONE_R1_F;
 
     engine = NULL;
 
@@ -775,6 +1034,7 @@ void QStabilizerHybrid::ZMask(bitCapInt mask)
 
 void QStabilizerHybrid::Mtrx(complex const* lMtrx, bitLenInt target)
 {
+    QRACK_INSTRUMENT("QStabilizerHybrid", "Mtrx");
     const bool wasCached = (bool)shards[target];
     complex mtrx[4U];
     if (wasCached) {
@@ -795,6 +1055,10 @@ void QStabilizerHybrid::Mtrx(complex const* lMtrx, bitLenInt target)
         return;
     }
 
+    if (RoundToClifford(mtrx, target)) {
+        return;
+    }
+
     shards[target] = std::make_shared<MpsShard>(mtrx);
     if (!wasCached) {
         CacheEigenstate(target);
@@ -803,6 +1067,7 @@ void QStabilizerHybrid::Mtrx(complex const* lMtrx, bitLenInt target)
 
 void QStabilizerHybrid::MCMtrx(const std::vector<bitLenInt>& lControls, complex const* mtrx, bitLenInt target)
 {
+    QRACK_INSTRUMENT("QStabilizerHybrid", "MCMtrx");
     if (IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U])) {
         MCPhase(lControls, mtrx[0U], mtrx[3U], target);
         return;
@@ -830,6 +1095,7 @@ void QStabilizerHybrid::MCMtrx(const std::vector<bitLenInt>& lControls, complex
 void QStabilizerHybrid::MCPhase(
     const std::vector<bitLenInt>& lControls, complex topLeft, complex bottomRight, bitLenInt target)
 {
+    QRACK_INSTRUMENT("QStabilizerHybrid", "MCPhase");
     if (IS_NORM_0(topLeft - ONE_CMPLX) && IS_NORM_0(bottomRight - ONE_CMPLX)) {
         return;
     }
@@ -920,6 +1186,7 @@ void QStabilizerHybrid::MCInvert(
 
 void QStabilizerHybrid::MACMtrx(const std::vector<bitLenInt>& lControls, complex const* mtrx, bitLenInt target)
 {
+    QRACK_INSTRUMENT("QStabilizerHybrid", "MACMtrx");
     if (IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U])) {
         MACPhase(lControls, mtrx[0U], mtrx[3U], target);
         return;
@@ -1033,6 +1300,7 @@ void QStabilizerHybrid::MACInvert(
 
 real1_f QStabilizerHybrid::Prob(bitLenInt qubit)
 {
+    QRACK_INSTRUMENT("QStabilizerHybrid", "Prob");
     if (ancillaCount && !(stabilizer->IsSeparable(qubit))) {
         QStabilizerHybridPtr clone = std::dynamic_pointer_cast<QStabilizerHybrid>(Clone());
         clone->SwitchToEngine();
@@ -1056,8 +1324,20 @@ real1_f QStabilizerHybrid::Prob(bitLenInt qubit)
             return (real1_f)norm(shards[qubit]->gate[2U]);
         }
 
-        // Otherwise, buffer will not change the fact that state appears maximally mixed.
-        return ONE_R1_F / 2;
+        if (!IsStabilizerRanked()) {
+            // Otherwise, buffer will not change the fact that state appears maximally mixed.
+            return ONE_R1_F / 2;
+        }
+
+        // A sum of stabilizer terms needn't look maximally mixed, so it has to take the buffer.
+        FlushToStabilizerRank(qubit);
+        if (engine) {
+            return engine->Prob(qubit);
+        }
+    }
+
+    if (IsStabilizerRanked()) {
+        return stabilizer->Prob(qubit);
     }
 
     if (stabilizer->IsSeparableZ(qubit)) {
@@ -1070,6 +1350,7 @@ real1_f QStabilizerHybrid::Prob(bitLenInt qubit)
 
 bool QStabilizerHybrid::ForceM(bitLenInt qubit, bool result, bool doForce, bool doApply)
 {
+    QRACK_INSTRUMENT("QStabilizerHybrid", "ForceM");
     if (ancillaCount && !(stabilizer->IsSeparable(qubit))) {
         SwitchToEngine();
     }
@@ -1101,8 +1382,10 @@ bool QStabilizerHybrid::ForceM(bitLenInt qubit, bool result, bool doForce, bool
         }
 
         // Otherwise, we have non-Clifford measurement.
-        SwitchToEngine();
-        return engine->ForceM(qubit, result, doForce, doApply);
+        FlushToStabilizerRank(qubit);
+        if (engine) {
+            return engine->ForceM(qubit, result, doForce, doApply);
+        }
     }
     shards[qubit] = NULL;
 
@@ -1128,16 +1411,18 @@ bitCapInt QStabilizerHybrid::MAll()
         }
 
         if (shards[i] && !shards[i]->IsPhase()) {
-            if (!stabilizer->IsSeparableZ(i)) {
+            if (stabilizer->IsSeparableZ(i)) {
+                // Bit was already rotated to Z basis, if separable.
+                CollapseSeparableShard(i);
+            } else {
                 // Otherwise, we have non-Clifford measurement.
-                SwitchToEngine();
-                bitCapInt toRet = engine->MAll();
-                SetPermutation(toRet);
-                return toRet;
+                FlushToStabilizerRank(i);
+                if (engine) {
+                    bitCapInt toRet = engine->MAll();
+                    SetPermutation(toRet);
+                    return toRet;
+                }
             }
-
-            // Bit was already rotated to Z basis, if separable.
-            CollapseSeparableShard(i);
         }
         shards[i] = NULL;
 
@@ -1178,6 +1463,11 @@ std::map<bitCapInt, int> QStabilizerHybrid::MultiShotMeasureMask(const std::vect
         return engine->MultiShotMeasureMask(qPowers, shots);
     }
 
+    if (!IsProbBuffered() && !IsStabilizerRanked()) {
+        // Buffered phase gates don't change Z basis outcomes, so the tableau can sample every shot by itself.
+        return stabilizer->MultiShotMeasureMask(qPowers, shots);
+    }
+
     std::vector<bitLenInt> bits(qPowers.size());
     std::transform(qPowers.begin(), qPowers.end(), bits.begin(), log2);
 
@@ -1214,6 +1504,11 @@ void QStabilizerHybrid::MultiShotMeasureMask(
         return;
     }
 
+    if (!IsProbBuffered() && !IsStabilizerRanked()) {
+        stabilizer->MultiShotMeasureMask(qPowers, shots, shotsArray);
+        return;
+    }
+
     std::vector<bitLenInt> bits(qPowers.size());
     std::transform(qPowers.begin(), qPowers.end(), bits.begin(), log2);
 
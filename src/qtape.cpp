@@ -0,0 +1,258 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qtape.hpp"
+
+namespace Qrack {
+
+void QTape::Mtrx(const complex* mtrx, bitLenInt target, const std::vector<bitLenInt>& controls)
+{
+    QTapeOp op;
+    op.target = target;
+    op.controls = controls;
+    op.axis = PauliI;
+    op.param = 0U;
+    std::copy(mtrx, mtrx + 4U, op.mtrx);
+    ops.push_back(op);
+}
+
+void QTape::R(Pauli axis, size_t param, bitLenInt target, const std::vector<bitLenInt>& controls)
+{
+    if (axis == PauliI) {
+        throw std::invalid_argument("QTape::R axis must be PauliX, PauliY, or PauliZ!");
+    }
+
+    QTapeOp op;
+    op.target = target;
+    op.controls = controls;
+    op.axis = axis;
+    op.param = param;
+    std::fill(op.mtrx, op.mtrx + 4U, ZERO_CMPLX);
+    ops.push_back(op);
+
+    if (paramCount <= param) {
+        paramCount = param + 1U;
+    }
+}
+
+void QTape::ApplyOp(QInterfacePtr sim, const QTapeOp& op, const std::vector<real1_f>& params, bool isInverse)
+{
+    complex mtrx[4U];
+    if (op.axis == PauliI) {
+        if (isInverse) {
+            mtrx[0U] = conj(op.mtrx[0U]);
+            mtrx[1U] = conj(op.mtrx[2U]);
+            mtrx[2U] = conj(op.mtrx[1U]);
+            mtrx[3U] = conj(op.mtrx[3U]);
+        } else {
+            std::copy(op.mtrx, op.mtrx + 4U, mtrx);
+        }
+    } else {
+        const real1_f theta = isInverse ? -params[op.param] : params[op.param];
+        const real1 cosine = (real1)cos(theta / 2);
+        const real1 sine = (real1)sin(theta / 2);
+        switch (op.axis) {
+        case PauliX:
+            mtrx[0U] = complex(cosine, ZERO_R1);
+            mtrx[1U] = complex(ZERO_R1, -sine);
+            mtrx[2U] = complex(ZERO_R1, -sine);
+            mtrx[3U] = complex(cosine, ZERO_R1);
+            break;
+        case PauliY:
+            mtrx[0U] = complex(cosine, ZERO_R1);
+            mtrx[1U] = complex(-sine, ZERO_R1);
+            mtrx[2U] = complex(sine, ZERO_R1);
+            mtrx[3U] = complex(cosine, ZERO_R1);
+            break;
+        case PauliZ:
+        default:
+            mtrx[0U] = complex(cosine, -sine);
+            mtrx[1U] = ZERO_CMPLX;
+            mtrx[2U] = ZERO_CMPLX;
+            mtrx[3U] = complex(cosine, sine);
+            break;
+        }
+    }
+
+    if (op.controls.size()) {
+        sim->MCMtrx(op.controls, mtrx, op.target);
+    } else {
+        sim->Mtrx(mtrx, op.target);
+    }
+}
+
+real1_f QTape::GeneratorImag(QInterfacePtr reg, bitLenInt ancilla, const QTapeOp& op)
+{
+    // The generator of a rotation controlled by "m" qubits is |1...1><1...1| (x) P, or the sum over every subset "S" of
+    // the controls of (-1)^|S| * Z_S (x) P / 2^m. With the ancilla's |0> branch holding |phi> and its |1> branch
+    // holding |lambda>, Im(<lambda|G|phi>) is -<Y_ancilla (x) G>, so all the terms come from one table of the
+    // probabilities of the ancilla, target, and control qubits, in the eigenbasis of "P" on the target.
+    std::vector<bitLenInt> qubits(op.controls.size() + 2U);
+    qubits[0U] = ancilla;
+    qubits[1U] = op.target;
+    std::copy(op.controls.begin(), op.controls.end(), qubits.begin() + 2U);
+
+    reg->IS(ancilla);
+    reg->H(ancilla);
+    if (op.axis == PauliY) {
+        reg->IS(op.target);
+    }
+    if (op.axis != PauliZ) {
+        reg->H(op.target);
+    }
+
+    const bitCapIntOcl maxPerm = pow2Ocl(qubits.size());
+    std::unique_ptr<real1[]> probs(new real1[maxPerm]);
+    reg->ProbBitsAll(qubits, probs.get());
+
+    if (op.axis != PauliZ) {
+        reg->H(op.target);
+    }
+    if (op.axis == PauliY) {
+        reg->S(op.target);
+    }
+    reg->H(ancilla);
+    reg->S(ancilla);
+
+    real1_f expectation = ZERO_R1_F;
+    const bitCapIntOcl subsetCount = pow2Ocl(op.controls.size());
+    for (bitCapIntOcl subset = 0U; subset < subsetCount; ++subset) {
+        const bitCapIntOcl mask = 3U | (subset << 2U);
+        // The sign of the term, (-1)^|S|, is the parity of the subset itself.
+        bool isSubsetOdd = false;
+        for (bitCapIntOcl v = subset; v; v &= v - 1U) {
+            isSubsetOdd = !isSubsetOdd;
+        }
+        for (bitCapIntOcl p = 0U; p < maxPerm; ++p) {
+            bool isOdd = isSubsetOdd;
+            for (bitCapIntOcl v = p & mask; v; v &= v - 1U) {
+                isOdd = !isOdd;
+            }
+            expectation += isOdd ? -(real1_f)probs[p] : (real1_f)probs[p];
+        }
+    }
+
+    return -expectation / (real1_f)subsetCount;
+}
+
+void QTape::Run(QInterfacePtr sim, const std::vector<real1_f>& params)
+{
+    if (params.size() < paramCount) {
+        throw std::invalid_argument("QTape::Run params vector is shorter than the tape's parameter count!");
+    }
+
+    for (const QTapeOp& op : ops) {
+        ApplyOp(sim, op, params, false);
+    }
+}
+
+real1_f QTape::Gradient(QInterfacePtr sim, const std::vector<real1_f>& params, const std::vector<PauliString>& terms,
+    const std::vector<real1_f>& coeffs, std::vector<real1_f>& gradient)
+{
+    if (terms.size() != coeffs.size()) {
+        throw std::invalid_argument("QTape::Gradient terms and coeffs vectors must have the same size!");
+    }
+
+    const bitLenInt qubitCount = sim->GetQubitCount();
+    for (const PauliString& term : terms) {
+        if (term.qubits.size() != term.paulis.size()) {
+            throw std::invalid_argument("QTape::Gradient term qubit and Pauli counts must match!");
+        }
+        ThrowIfQbIdArrayIsBad(term.qubits, qubitCount,
+            "QTape::Gradient parameter qubits vector values must be within allocated qubit bounds!");
+    }
+
+    gradient.assign(params.size(), ZERO_R1_F);
+
+    // The backward pass runs |phi> and |lambda> = H|psi> back together, as the two branches of an ancilla qubit, in
+    // one register, so they can't pick up different global phases from the simulator. |lambda> is a sum of states, so
+    // the register is prepared once, from the host.
+    QInterfacePtr reg = sim->Clone();
+    Run(reg, params);
+
+    const bitCapIntOcl maxQPower = pow2Ocl(qubitCount);
+    std::unique_ptr<complex[]> branches(new complex[maxQPower << 1U]());
+    complex* psi = branches.get();
+    complex* lambda = branches.get() + maxQPower;
+    reg->GetQuantumState(psi);
+
+    for (size_t t = 0U; t < terms.size(); ++t) {
+        const PauliString& term = terms[t];
+        bitCapIntOcl xMask = 0U;
+        bitCapIntOcl zMask = 0U;
+        complex phase((real1)coeffs[t], ZERO_R1);
+        for (size_t i = 0U; i < term.qubits.size(); ++i) {
+            const bitCapIntOcl qPower = pow2Ocl(term.qubits[i]);
+            switch (term.paulis[i]) {
+            case PauliX:
+                xMask |= qPower;
+                break;
+            case PauliY:
+                // Y = i * X * Z
+                xMask |= qPower;
+                zMask |= qPower;
+                phase *= I_CMPLX;
+                break;
+            case PauliZ:
+                zMask |= qPower;
+                break;
+            default:
+                break;
+            }
+        }
+
+        for (bitCapIntOcl j = 0U; j < maxQPower; ++j) {
+            bool isOdd = false;
+            for (bitCapIntOcl v = j & zMask; v; v &= v - 1U) {
+                isOdd = !isOdd;
+            }
+            lambda[j ^ xMask] += (isOdd ? -phase : phase) * psi[j];
+        }
+    }
+
+    real1_f expectation = ZERO_R1_F;
+    real1_f lambdaNorm = ZERO_R1_F;
+    for (bitCapIntOcl j = 0U; j < maxQPower; ++j) {
+        expectation += (real1_f)real(conj(psi[j]) * lambda[j]);
+        lambdaNorm += (real1_f)norm(lambda[j]);
+    }
+    lambdaNorm = (real1_f)sqrt(lambdaNorm);
+
+    if (lambdaNorm <= FP_NORM_EPSILON) {
+        return expectation;
+    }
+
+    const real1 sqrt1_2 = (real1)SQRT1_2_R1;
+    const real1 lambdaScale = (real1)(SQRT1_2_R1 / lambdaNorm);
+    for (bitCapIntOcl j = 0U; j < maxQPower; ++j) {
+        psi[j] *= sqrt1_2;
+        lambda[j] *= lambdaScale;
+    }
+    const bitLenInt ancilla = reg->Allocate(1U);
+    reg->SetQuantumState(branches.get());
+    branches.reset();
+
+    // d<psi|H|psi>/d(theta) = Im(<lambda|G|phi>), for a rotation e^(-i * theta / 2 * G), where |phi> is the state just
+    // after that rotation, and <lambda| is H|psi> run back to the same point.
+    for (size_t i = ops.size(); i > 0U; --i) {
+        const QTapeOp& op = ops[i - 1U];
+        if (op.axis != PauliI) {
+            gradient[op.param] += lambdaNorm * GeneratorImag(reg, ancilla, op);
+        }
+        if (i > 1U) {
+            ApplyOp(reg, op, params, true);
+        }
+    }
+
+    return expectation;
+}
+} // namespace Qrack
@@ -0,0 +1,630 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Daniel Strano and the Qrack contributors 2017-2022. All rights reserved.
+//
+// This is a multithreaded, universal quantum register simulation, allowing
+// (nonphysical) register cloning and direct measurement of probability and
+// phase, to leverage what advantages classical emulation of qubits can have.
+//
+// Licensed under the GNU Lesser General Public License V3.
+// See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
+// for details.
+
+#include "qfactory.hpp"
+
+namespace Qrack {
+
+namespace {
+// A tensor with every leg of dimension 2: bit "i" of an index into "data" is the value of wire "legs[i]"
+struct Tensor {
+    std::vector<size_t> legs;
+    std::vector<complex> data;
+};
+
+// Fix leg "legIndex" of "t" to "value," removing the leg
+void SliceTensor(Tensor& t, size_t legIndex, bool value)
+{
+    const bitCapIntOcl legPow = pow2Ocl(legIndex);
+    const bitCapIntOcl lowMask = legPow - 1U;
+    std::vector<complex> nData(t.data.size() >> 1U);
+    for (bitCapIntOcl i = 0U; i < nData.size(); ++i) {
+        nData[i] = t.data[(i & lowMask) | ((i & ~lowMask) << 1U) | (value ? legPow : 0U)];
+    }
+    t.data = std::move(nData);
+    t.legs.erase(t.legs.begin() + legIndex);
+}
+
+size_t FindLeg(const Tensor& t, size_t wire)
+{
+    const auto it = std::find(t.legs.begin(), t.legs.end(), wire);
+    return (it == t.legs.end()) ? t.legs.size() : (size_t)(it - t.legs.begin());
+}
+} // namespace
+
+QTensorNetwork::QTensorNetwork(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState,
+    qrack_rand_gen_ptr rgp, complex phaseFac, bool doNorm, bool randomGlobalPhase, bool useHostMem, int64_t deviceId,
+    bool useHardwareRNG, bool useSparseStateVec, real1_f norm_thresh, std::vector<int64_t> devList,
+    bitLenInt qubitThreshold, real1_f separation_thresh)
+    : QInterface(qBitCount, rgp, doNorm, useHardwareRNG, randomGlobalPhase, norm_thresh)
+    , useHostRam(useHostMem)
+    , isSparse(useSparseStateVec)
+    , thresholdQubits(qubitThreshold)
+    , maxTensorRank(20U)
+    , separabilityThreshold(separation_thresh)
+    , devID(deviceId)
+    , globalPhase(ONE_CMPLX)
+    , initPerm(0U)
+    , circuit(NULL)
+    , layerStack(NULL)
+    , deviceIDs(devList)
+    , engines(eng)
+{
+#if ENABLE_ENV_VARS
+    if (getenv("QRACK_TENSOR_NETWORK_MAX_RANK")) {
+        maxTensorRank = (bitLenInt)std::stoi(std::string(getenv("QRACK_TENSOR_NETWORK_MAX_RANK")));
+    }
+#endif
+
+    SetPermutation(initState, phaseFac);
+}
+
+QInterfacePtr QTensorNetwork::MakeEngine(bitLenInt qbCount, bitCapInt perm, complex phaseFac)
+{
+    QInterfacePtr toRet = CreateQuantumInterface(engines, qbCount, perm, rand_generator, phaseFac, doNormalize,
+        randGlobalPhase, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs, thresholdQubits,
+        separabilityThreshold);
+    toRet->SetConcurrency(GetConcurrencyLevel());
+    return toRet;
+}
+
+void QTensorNetwork::Materialize()
+{
+    if (!layerStack) {
+        layerStack = MakeEngine(qubitCount, initPerm, globalPhase);
+    }
+
+    if (circuit->GetGates().size()) {
+        circuit->Run(layerStack);
+        circuit = std::make_shared<QCircuit>();
+    }
+}
+
+void QTensorNetwork::SetPermutation(bitCapInt perm, complex phaseFac)
+{
+    initPerm = perm;
+    globalPhase = (phaseFac == CMPLX_DEFAULT_ARG) ? GetNonunitaryPhase() : phaseFac;
+    circuit = std::make_shared<QCircuit>();
+    layerStack = NULL;
+}
+
+bool QTensorNetwork::ContractAmplitude(bitCapInt perm, complex& amp)
+{
+    // Wires are numbered in order of creation; each is fixed to 0 or 1, or is free (-1) and summed over.
+    std::vector<int> wireValues;
+    std::vector<size_t> qubitWires(qubitCount);
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        qubitWires[i] = i;
+        wireValues.push_back((initPerm & pow2(i)) ? 1 : 0);
+    }
+
+    // Controls and the target of a diagonal gate pass their wires through, (as hyperedges,) while a general gate ends
+    // its target's wire and starts a new one.
+    const complex identity[4U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX };
+    std::vector<Tensor> tensors;
+    for (const QCircuitGatePtr& gate : circuit->GetGates()) {
+        const size_t controlCount = gate->controls.size();
+        const bool isDiagonal = gate->IsDiagonal();
+        if ((controlCount + (isDiagonal ? 1U : 2U)) > maxTensorRank) {
+            return false;
+        }
+
+        Tensor t;
+        for (const bitLenInt& c : gate->controls) {
+            t.legs.push_back(qubitWires[c]);
+        }
+        t.legs.push_back(qubitWires[gate->target]);
+        if (!isDiagonal) {
+            qubitWires[gate->target] = wireValues.size();
+            wireValues.push_back(-1);
+            t.legs.push_back(qubitWires[gate->target]);
+        }
+        t.data.resize(pow2Ocl(t.legs.size()));
+
+        const bitCapIntOcl inPow = pow2Ocl(controlCount);
+        const bitCapIntOcl outPow = inPow << 1U;
+        for (bitCapIntOcl c = 0U; c < inPow; ++c) {
+            const auto payload = gate->payloads.find(c);
+            const complex* mtrx = (payload == gate->payloads.end()) ? identity : &(payload->second[0U]);
+            if (isDiagonal) {
+                t.data[c] = mtrx[0U];
+                t.data[c | inPow] = mtrx[3U];
+                continue;
+            }
+            t.data[c] = mtrx[0U];
+            t.data[c | inPow] = mtrx[1U];
+            t.data[c | outPow] = mtrx[2U];
+            t.data[c | inPow | outPow] = mtrx[3U];
+        }
+
+        tensors.push_back(std::move(t));
+    }
+
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        const int value = (perm & pow2(i)) ? 1 : 0;
+        int& wireValue = wireValues[qubitWires[i]];
+        if (wireValue == -1) {
+            wireValue = value;
+        } else if (wireValue != value) {
+            // No gate ever changes this qubit, and it doesn't match.
+            amp = ZERO_CMPLX;
+            return true;
+        }
+    }
+
+    // Slice every fixed wire out, and collect the tensors that use each free one.
+    complex scalar = globalPhase;
+    std::vector<bool> isAlive(tensors.size(), true);
+    std::vector<std::vector<size_t>> wireUsers(wireValues.size());
+    for (size_t i = 0U; i < tensors.size(); ++i) {
+        Tensor& t = tensors[i];
+        for (size_t l = t.legs.size(); l > 0U;) {
+            --l;
+            const int value = wireValues[t.legs[l]];
+            if (value != -1) {
+                SliceTensor(t, l, value == 1);
+            }
+        }
+        if (!t.legs.size()) {
+            scalar *= t.data[0U];
+            isAlive[i] = false;
+            continue;
+        }
+        for (const size_t& w : t.legs) {
+            wireUsers[w].push_back(i);
+        }
+    }
+
+    for (;;) {
+        // Greedily contract the pair of tensors sharing a wire with the fewest legs in their product.
+        size_t bestA = 0U, bestB = 0U, bestRank = -1;
+        bool isAny = false;
+        for (size_t i = 0U; i < tensors.size(); ++i) {
+            if (!isAlive[i]) {
+                continue;
+            }
+            isAny = true;
+            for (const size_t& w : tensors[i].legs) {
+                for (const size_t& j : wireUsers[w]) {
+                    if (j <= i) {
+                        continue;
+                    }
+                    size_t rank = tensors[i].legs.size();
+                    for (const size_t& v : tensors[j].legs) {
+                        if (FindLeg(tensors[i], v) == tensors[i].legs.size()) {
+                            ++rank;
+                        } else if (wireUsers[v].size() == 2U) {
+                            --rank;
+                        }
+                    }
+                    if (rank < bestRank) {
+                        bestRank = rank;
+                        bestA = i;
+                        bestB = j;
+                    }
+                }
+            }
+        }
+
+        if (!isAny) {
+            break;
+        }
+        if ((bestRank == (size_t)-1) || (bestRank > maxTensorRank)) {
+            return false;
+        }
+
+        const Tensor& a = tensors[bestA];
+        const Tensor& b = tensors[bestB];
+
+        // Result legs keep their (bit) positions in each operand, or 0 where they're absent; summed legs need both.
+        Tensor c;
+        std::vector<bitCapIntOcl> resultPowsA, resultPowsB, sumPowsA, sumPowsB;
+        for (size_t l = 0U; l < a.legs.size(); ++l) {
+            const size_t w = a.legs[l];
+            const size_t lb = FindLeg(b, w);
+            const bitCapIntOcl bPow = (lb == b.legs.size()) ? 0U : pow2Ocl(lb);
+            if (bPow && (wireUsers[w].size() == 2U)) {
+                sumPowsA.push_back(pow2Ocl(l));
+                sumPowsB.push_back(bPow);
+                continue;
+            }
+            c.legs.push_back(w);
+            resultPowsA.push_back(pow2Ocl(l));
+            resultPowsB.push_back(bPow);
+        }
+        for (size_t l = 0U; l < b.legs.size(); ++l) {
+            if (FindLeg(a, b.legs[l]) == a.legs.size()) {
+                c.legs.push_back(b.legs[l]);
+                resultPowsA.push_back(0U);
+                resultPowsB.push_back(pow2Ocl(l));
+            }
+        }
+
+        c.data.resize(pow2Ocl(c.legs.size()));
+        const bitCapIntOcl sumCount = pow2Ocl(sumPowsA.size());
+        complex* cData = &(c.data[0U]);
+        par_for(0U, c.data.size(), [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+            bitCapIntOcl aBase = 0U, bBase = 0U;
+            for (size_t k = 0U; k < resultPowsA.size(); ++k) {
+                if ((lcv >> k) & 1U) {
+                    aBase |= resultPowsA[k];
+                    bBase |= resultPowsB[k];
+                }
+            }
+            complex sum = ZERO_CMPLX;
+            for (bitCapIntOcl s = 0U; s < sumCount; ++s) {
+                bitCapIntOcl aIndex = aBase, bIndex = bBase;
+                for (size_t k = 0U; k < sumPowsA.size(); ++k) {
+                    if ((s >> k) & 1U) {
+                        aIndex |= sumPowsA[k];
+                        bIndex |= sumPowsB[k];
+                    }
+                }
+                sum += a.data[aIndex] * b.data[bIndex];
+            }
+            cData[lcv] = sum;
+        });
+
+        for (const Tensor* t : { &a, &b }) {
+            for (const size_t& w : t->legs) {
+                std::vector<size_t>& users = wireUsers[w];
+                users.erase(std::remove_if(users.begin(), users.end(),
+                                [&](const size_t& u) { return (u == bestA) || (u == bestB); }),
+                    users.end());
+            }
+        }
+        isAlive[bestA] = false;
+        isAlive[bestB] = false;
+        tensors[bestA].data.clear();
+        tensors[bestB].data.clear();
+
+        if (!c.legs.size()) {
+            scalar *= c.data[0U];
+            continue;
+        }
+        for (const size_t& w : c.legs) {
+            wireUsers[w].push_back(tensors.size());
+        }
+        isAlive.push_back(true);
+        tensors.push_back(std::move(c));
+    }
+
+    amp = scalar;
+    return true;
+}
+
+bool QTensorNetwork::LightConeProb(bitLenInt qubit, real1_f& prob)
+{
+    // Walk back from the end, collecting every gate that can affect the measurement. While the observable is still
+    // diagonal, it commutes with diagonal gates, and with any gate that only controls on the cone, so those drop out.
+    std::vector<bool> isInCone(qubitCount, false);
+    isInCone[qubit] = true;
+    bool isObservableDiagonal = true;
+    std::vector<QCircuitGatePtr> coneGates;
+    const std::list<QCircuitGatePtr>& gates = circuit->GetGates();
+    for (auto gate = gates.rbegin(); gate != gates.rend(); ++gate) {
+        const QCircuitGatePtr& g = *gate;
+        if (isObservableDiagonal && (!isInCone[g->target] || g->IsDiagonal())) {
+            continue;
+        }
+        bool isTouching = isInCone[g->target];
+        for (const bitLenInt& c : g->controls) {
+            isTouching |= isInCone[c];
+        }
+        if (!isTouching) {
+            continue;
+        }
+        isObservableDiagonal = false;
+        isInCone[g->target] = true;
+        for (const bitLenInt& c : g->controls) {
+            isInCone[c] = true;
+        }
+        coneGates.push_back(g);
+    }
+
+    // Cone qubits keep their relative order, so every gate's sorted controls (and payload keys) stay valid.
+    std::vector<bitLenInt> coneMap(qubitCount);
+    bitLenInt coneCount = 0U;
+    bitCapInt conePerm = 0U;
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        if (!isInCone[i]) {
+            continue;
+        }
+        if (initPerm & pow2(i)) {
+            conePerm |= pow2(coneCount);
+        }
+        coneMap[i] = coneCount;
+        ++coneCount;
+    }
+
+    if (coneCount > maxTensorRank) {
+        return false;
+    }
+
+    QCircuitPtr coneCircuit = std::make_shared<QCircuit>();
+    for (auto gate = coneGates.rbegin(); gate != coneGates.rend(); ++gate) {
+        QCircuitGatePtr g = std::make_shared<QCircuitGate>(**gate);
+        g->target = coneMap[g->target];
+        for (bitLenInt& c : g->controls) {
+            c = coneMap[c];
+        }
+        coneCircuit->AppendGate(g);
+    }
+
+    QInterfacePtr coneSim = MakeEngine(coneCount, conePerm, ONE_CMPLX);
+    coneCircuit->Run(coneSim);
+    prob = coneSim->Prob(coneMap[qubit]);
+
+    return true;
+}
+
+void QTensorNetwork::SetQuantumState(complex const* inputState)
+{
+    Materialize();
+    layerStack->SetQuantumState(inputState);
+}
+
+void QTensorNetwork::GetQuantumState(complex* outputState)
+{
+    Materialize();
+    layerStack->GetQuantumState(outputState);
+}
+
+void QTensorNetwork::GetProbs(real1* outputProbs)
+{
+    Materialize();
+    layerStack->GetProbs(outputProbs);
+}
+
+complex QTensorNetwork::GetAmplitude(bitCapInt perm)
+{
+    if (perm >= maxQPower) {
+        throw std::invalid_argument("QTensorNetwork::GetAmplitude argument out-of-bounds!");
+    }
+
+    complex amp;
+    if (!layerStack && ContractAmplitude(perm, amp)) {
+        return amp;
+    }
+
+    Materialize();
+    return layerStack->GetAmplitude(perm);
+}
+
+void QTensorNetwork::SetAmplitude(bitCapInt perm, complex amp)
+{
+    Materialize();
+    layerStack->SetAmplitude(perm, amp);
+}
+
+bitLenInt QTensorNetwork::Compose(QInterfacePtr toCopy, bitLenInt start)
+{
+    Materialize();
+
+    QTensorNetworkPtr toCopyNetwork = std::dynamic_pointer_cast<QTensorNetwork>(toCopy);
+    if (toCopyNetwork) {
+        toCopyNetwork->Materialize();
+        toCopy = toCopyNetwork->layerStack;
+    }
+
+    const bitLenInt toRet = layerStack->Compose(toCopy, start);
+    SetQubitCount(layerStack->GetQubitCount());
+
+    return toRet;
+}
+
+void QTensorNetwork::Decompose(bitLenInt start, QInterfacePtr dest)
+{
+    Materialize();
+
+    QTensorNetworkPtr destNetwork = std::dynamic_pointer_cast<QTensorNetwork>(dest);
+    if (destNetwork) {
+        destNetwork->Materialize();
+        dest = destNetwork->layerStack;
+    }
+
+    layerStack->Decompose(start, dest);
+    SetQubitCount(layerStack->GetQubitCount());
+}
+
+QInterfacePtr QTensorNetwork::Decompose(bitLenInt start, bitLenInt length)
+{
+    QTensorNetworkPtr dest = std::make_shared<QTensorNetwork>(engines, length, 0U, rand_generator, ONE_CMPLX,
+        doNormalize, randGlobalPhase, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs,
+        thresholdQubits, separabilityThreshold);
+    Decompose(start, dest);
+
+    return dest;
+}
+
+void QTensorNetwork::Dispose(bitLenInt start, bitLenInt length)
+{
+    Materialize();
+    layerStack->Dispose(start, length);
+    SetQubitCount(layerStack->GetQubitCount());
+}
+
+void QTensorNetwork::Dispose(bitLenInt start, bitLenInt length, bitCapInt disposedPerm)
+{
+    Materialize();
+    layerStack->Dispose(start, length, disposedPerm);
+    SetQubitCount(layerStack->GetQubitCount());
+}
+
+bitLenInt QTensorNetwork::Allocate(bitLenInt start, bitLenInt length)
+{
+    if (!length) {
+        return start;
+    }
+
+    if (!layerStack && (start == qubitCount)) {
+        // New |0> qubits at the end just widen the network.
+        SetQubitCount(qubitCount + length);
+        return start;
+    }
+
+    Materialize();
+    const bitLenInt toRet = layerStack->Allocate(start, length);
+    SetQubitCount(layerStack->GetQubitCount());
+
+    return toRet;
+}
+
+void QTensorNetwork::FSim(real1_f theta, real1_f phi, bitLenInt qubit1, bitLenInt qubit2)
+{
+    if (qubit1 == qubit2) {
+        return;
+    }
+    if (qubit1 > qubit2) {
+        std::swap(qubit1, qubit2);
+    }
+
+    // The |01>/|10> rotation is a controlled RX between CNOTs, followed by the |11> phase.
+    const real1 cosine = (real1)cos(theta);
+    const real1 sine = (real1)sin(theta);
+    const complex rx[4U]{ complex(cosine, ZERO_R1), complex(ZERO_R1, -sine), complex(ZERO_R1, -sine),
+        complex(cosine, ZERO_R1) };
+    const std::vector<bitLenInt> c1{ qubit1 };
+    const std::vector<bitLenInt> c2{ qubit2 };
+
+    circuit->CNOT(qubit1, qubit2);
+    circuit->MCMtrx(c2, rx, qubit1);
+    circuit->CNOT(qubit1, qubit2);
+
+    const complex phase[4U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, complex((real1)cos(phi), (real1)sin(phi)) };
+    circuit->MCMtrx(c1, phase, qubit2);
+}
+
+bool QTensorNetwork::ForceM(bitLenInt qubit, bool result, bool doForce, bool doApply)
+{
+    Materialize();
+    return layerStack->ForceM(qubit, result, doForce, doApply);
+}
+
+real1_f QTensorNetwork::Prob(bitLenInt qubit)
+{
+    if (qubit >= qubitCount) {
+        throw std::invalid_argument("QTensorNetwork::Prob qubit index parameter must be within allocated qubit bounds!");
+    }
+
+    real1_f prob;
+    if (!layerStack && LightConeProb(qubit, prob)) {
+        return prob;
+    }
+
+    Materialize();
+    return layerStack->Prob(qubit);
+}
+
+real1_f QTensorNetwork::ProbReg(bitLenInt start, bitLenInt length, bitCapInt permutation)
+{
+    Materialize();
+    return layerStack->ProbReg(start, length, permutation);
+}
+
+real1_f QTensorNetwork::ProbMask(bitCapInt mask, bitCapInt permutation)
+{
+    Materialize();
+    return layerStack->ProbMask(mask, permutation);
+}
+
+void QTensorNetwork::ProbBitsAll(const std::vector<bitLenInt>& bits, real1* probsArray)
+{
+    Materialize();
+    layerStack->ProbBitsAll(bits, probsArray);
+}
+
+real1_f QTensorNetwork::ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCapInt offset)
+{
+    ThrowIfQbIdArrayIsBad(bits, qubitCount,
+        "QTensorNetwork::ExpectationBitsAll parameter controls array values must be within allocated qubit bounds!");
+
+    if (layerStack) {
+        Materialize();
+        return layerStack->ExpectationBitsAll(bits, offset);
+    }
+
+    // The expectation is linear, so it only needs each bit's own light cone.
+    real1_f expectation = (real1_f)(bitCapIntOcl)offset;
+    for (size_t p = 0U; p < bits.size(); ++p) {
+        expectation += (real1_f)pow2Ocl(p) * Prob(bits[p]);
+    }
+
+    return expectation;
+}
+
+std::map<bitCapInt, int> QTensorNetwork::MultiShotMeasureMask(const std::vector<bitCapInt>& qPowers, unsigned shots)
+{
+    Materialize();
+    return layerStack->MultiShotMeasureMask(qPowers, shots);
+}
+
+void QTensorNetwork::MultiShotMeasureMask(
+    const std::vector<bitCapInt>& qPowers, unsigned shots, unsigned long long* shotsArray)
+{
+    Materialize();
+    layerStack->MultiShotMeasureMask(qPowers, shots, shotsArray);
+}
+
+real1_f QTensorNetwork::SumSqrDiff(QInterfacePtr toCompare)
+{
+    Materialize();
+
+    QTensorNetworkPtr toCompareNetwork = std::dynamic_pointer_cast<QTensorNetwork>(toCompare);
+    if (toCompareNetwork) {
+        toCompareNetwork->Materialize();
+        toCompare = toCompareNetwork->layerStack;
+    }
+
+    return layerStack->SumSqrDiff(toCompare);
+}
+
+void QTensorNetwork::UpdateRunningNorm(real1_f norm_thresh)
+{
+    // The network itself is unitary.
+    if (layerStack) {
+        Materialize();
+        layerStack->UpdateRunningNorm(norm_thresh);
+    }
+}
+
+void QTensorNetwork::NormalizeState(real1_f nrm, real1_f norm_thresh, real1_f phaseArg)
+{
+    if (layerStack) {
+        Materialize();
+        layerStack->NormalizeState(nrm, norm_thresh, phaseArg);
+    }
+}
+
+QInterfacePtr QTensorNetwork::Clone()
+{
+    QTensorNetworkPtr c = std::make_shared<QTensorNetwork>(engines, qubitCount, initPerm, rand_generator, globalPhase,
+        doNormalize, randGlobalPhase, useHostRam, devID, useRDRAND, isSparse, (real1_f)amplitudeFloor, deviceIDs,
+        thresholdQubits, separabilityThreshold);
+    c->maxTensorRank = maxTensorRank;
+    // Gates fuse in place, so the clone needs its own copies.
+    c->circuit = circuit->Bind(std::vector<real1_f>());
+    if (layerStack) {
+        c->layerStack = layerStack->Clone();
+    }
+
+    return c;
+}
+
+void QTensorNetwork::SetDevice(int64_t dID)
+{
+    devID = dID;
+    if (layerStack) {
+        layerStack->SetDevice(dID);
+    }
+}
+} // namespace Qrack
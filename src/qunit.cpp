@@ -21,8 +21,11 @@
 // See LICENSE.md in the project root or https://www.gnu.org/licenses/lgpl-3.0.en.html
 // for details.
 
+#include "common/memory_governor.hpp"
 #include "qfactory.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <ctime>
 #include <initializer_list>
 #include <map>
@@ -66,6 +69,8 @@ QUnit::QUnit(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt i
     , isSparse(useSparseStateVec)
     , freezeBasis2Qb(false)
     , isReactiveSeparate(true)
+    , isBackgroundSeparate(false)
+    , isLocalFrames(true)
     , useTGadget(true)
     , thresholdQubits(qubitThreshold)
     , separabilityThreshold(sep_thresh)
@@ -73,15 +78,29 @@ QUnit::QUnit(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt i
     , phaseFactor(phaseFac)
     , deviceIDs(devList)
     , engines(eng)
+    , bgSepCountdown(QRACK_QUNIT_BG_SEP_PERIOD)
 {
     if (!engines.size()) {
         engines.push_back(QINTERFACE_STABILIZER_HYBRID);
     }
 
+#if ENABLE_MPI
+    // Units compose and decompose over their whole width, which QPagerMpi can't do across its rank-global qubits.
+    if (std::find(engines.begin(), engines.end(), QINTERFACE_QPAGER_MPI) != engines.end()) {
+        throw std::invalid_argument("QUnit cannot use QPagerMpi as a sub-engine!");
+    }
+#endif
+
 #if ENABLE_ENV_VARS
     if (getenv("QRACK_QUNIT_SEPARABILITY_THRESHOLD")) {
         separabilityThreshold = (real1_f)std::stof(std::string(getenv("QRACK_QUNIT_SEPARABILITY_THRESHOLD")));
     }
+    if (getenv("QRACK_QUNIT_BACKGROUND_SEPARATE")) {
+        isBackgroundSeparate = (bool)std::stoi(std::string(getenv("QRACK_QUNIT_BACKGROUND_SEPARATE")));
+    }
+    if (getenv("QRACK_QUNIT_LOCAL_FRAMES")) {
+        isLocalFrames = (bool)std::stoi(std::string(getenv("QRACK_QUNIT_LOCAL_FRAMES")));
+    }
 #endif
 
     if (qubitCount) {
@@ -96,6 +115,7 @@ QInterfacePtr QUnit::MakeEngine(bitLenInt length, bitCapInt perm)
         separabilityThreshold);
     toRet->SetConcurrency(GetConcurrencyLevel());
     toRet->SetTInjection(useTGadget);
+    toRet->SetDispatchWide(true);
 
     return toRet;
 }
@@ -181,6 +201,22 @@ void QUnit::GetQuantumState(complex* outputState)
     thisCopy->shards[0U].unit->GetQuantumState(outputState);
 }
 
+complex const* QUnit::MapStateVector()
+{
+    if (!qubitCount) {
+        return NULL;
+    }
+
+    ToPermBasisAll();
+    EntangleAll();
+    if (!shards[0U].unit) {
+        return NULL;
+    }
+    OrderContiguous(shards[0U].unit);
+
+    return shards[0U].unit->MapStateVector();
+}
+
 void QUnit::GetProbs(real1* outputProbs)
 {
     if (qubitCount == 1U) {
@@ -266,6 +302,7 @@ void QUnit::Detach(bitLenInt start, bitLenInt length, QUnitPtr dest)
 
     for (bitLenInt i = 0U; i < length; ++i) {
         RevertBasis2Qb(start + i);
+        shards[start + i].FlushFrame();
     }
 
     // Move "emulated" bits immediately into the destination, which is initialized.
@@ -338,6 +375,7 @@ void QUnit::Detach(bitLenInt start, bitLenInt length, QUnitPtr dest)
                         }
 
                         QEngineShard* pShard = &shards[i];
+                        pShard->FlushFrame();
                         complex amps[2U];
                         pShard->unit->GetQuantumState(amps);
                         pShard->amp0 = amps[0U];
@@ -377,6 +415,7 @@ void QUnit::Detach(bitLenInt start, bitLenInt length, QUnitPtr dest)
 QInterfacePtr QUnit::EntangleInCurrentBasis(
     std::vector<bitLenInt*>::iterator first, std::vector<bitLenInt*>::iterator last)
 {
+    QRACK_INSTRUMENT("QUnit", "EntangleInCurrentBasis");
     for (auto bit = first; bit < last; ++bit) {
         EndEmulation(**bit);
     }
@@ -395,6 +434,34 @@ QInterfacePtr QUnit::EntangleInCurrentBasis(
         }
     }
 
+    if ((units.size() > 1U) && MemoryGovernor::Instance().IsLimited()) {
+        // A composition that can't fit the host memory budget is refused before any unit changes, not partway through.
+        bitLenInt qb = 0U;
+        bool isClifford = true;
+        for (const QInterfacePtr& unit : units) {
+            qb += unit->GetQubitCount();
+            isClifford &= unit->isClifford();
+        }
+        const size_t bytes = (qb < ((sizeof(size_t) << 3U) - 4U)) ? (sizeof(complex) << qb) : (size_t)-1;
+        if (!isClifford && !MemoryGovernor::Instance().Admit(QRACK_HOST_MEMORY, bytes)) {
+            throw std::bad_alloc();
+        }
+    }
+
+    if (units.size() > 2U) {
+        /* Compose all of the other units into unit1 at once, so the tensor product is written in a single pass. */
+        const std::vector<QInterfacePtr> consumed(units.begin() + 1U, units.end());
+        const std::map<QInterfacePtr, bitLenInt> offsets = unit1->Compose(consumed);
+        for (auto&& shard : shards) {
+            const auto search = offsets.find(shard.unit);
+            if (search != offsets.end()) {
+                shard.mapped += search->second;
+                shard.unit = unit1;
+            }
+        }
+        units.resize(1U);
+    }
+
     /* Collapse all of the other units into unit1, returning a map to the new bit offset. */
     while (units.size() > 1U) {
         // Work odd unit into collapse sequence:
@@ -478,6 +545,7 @@ QInterfacePtr QUnit::Entangle(std::vector<bitLenInt*> bits)
 
 QInterfacePtr QUnit::EntangleRange(bitLenInt start, bitLenInt length, bool isForProb)
 {
+    QRACK_INSTRUMENT("QUnit", "EntangleRange");
     if (isForProb) {
         ToPermBasisProb(start, length);
     } else {
@@ -503,6 +571,7 @@ QInterfacePtr QUnit::EntangleRange(bitLenInt start, bitLenInt length, bool isFor
 
 QInterfacePtr QUnit::EntangleRange(bitLenInt start1, bitLenInt length1, bitLenInt start2, bitLenInt length2)
 {
+    QRACK_INSTRUMENT("QUnit", "EntangleRange");
     ToPermBasis(start1, length1);
     ToPermBasis(start2, length2);
 
@@ -532,6 +601,7 @@ QInterfacePtr QUnit::EntangleRange(bitLenInt start1, bitLenInt length1, bitLenIn
 QInterfacePtr QUnit::EntangleRange(
     bitLenInt start1, bitLenInt length1, bitLenInt start2, bitLenInt length2, bitLenInt start3, bitLenInt length3)
 {
+    QRACK_INSTRUMENT("QUnit", "EntangleRange");
     ToPermBasis(start1, length1);
     ToPermBasis(start2, length2);
     ToPermBasis(start3, length3);
@@ -753,6 +823,7 @@ bool QUnit::TrySeparate(bitLenInt qubit)
     const real1_f inclination = atan2(sqrt(x * x + y * y), z);
     const real1_f azimuth = atan2(y, x);
 
+    shard.FlushFrame();
     shard.unit->IAI(shard.mapped, azimuth, inclination);
     prob = 2 * shard.unit->Prob(shard.mapped);
 
@@ -843,6 +914,88 @@ bool QUnit::TrySeparate(bitLenInt qubit1, bitLenInt qubit2)
     return isShard1Sep && isShard2Sep;
 }
 
+namespace {
+// Runs on a worker, against a private snapshot: the (mapped) qubits whose Bloch vectors are pure, to within "tol"
+std::vector<bitLenInt> ProbeSeparable(QInterfacePtr snapshot, real1_f tol)
+{
+    std::vector<bitLenInt> toRet;
+    for (bitLenInt i = 0U; i < snapshot->GetQubitCount(); ++i) {
+        const real1_f z = ONE_R1_F - 2 * snapshot->Prob(i);
+        snapshot->H(i);
+        const real1_f x = ONE_R1_F - 2 * snapshot->Prob(i);
+        snapshot->H(i);
+        snapshot->IS(i);
+        snapshot->H(i);
+        const real1_f y = ONE_R1_F - 2 * snapshot->Prob(i);
+        snapshot->H(i);
+        snapshot->S(i);
+
+        if ((ONE_R1_F - sqrt(x * x + y * y + z * z)) <= tol) {
+            toRet.push_back(i);
+        }
+    }
+
+    return toRet;
+}
+} // namespace
+
+void QUnit::PollBackgroundSeparate()
+{
+    if (bgSepProbe.valid()) {
+        // (Without threads, the probe is deferred, and runs here, instead.)
+        if (bgSepProbe.wait_for(std::chrono::seconds(0)) == std::future_status::timeout) {
+            return;
+        }
+
+        // The snapshot might be stale, by now, but TrySeparate() is exact, and it leaves the state alone if not.
+        const std::vector<bitLenInt> candidates = bgSepProbe.get();
+        const QInterfacePtr unit = bgSepUnit.lock();
+        bgSepUnit.reset();
+        std::vector<bitLenInt> toTry;
+        for (size_t i = 0U; unit && (i < candidates.size()); ++i) {
+            const bitLenInt qubit = bgSepQubits[candidates[i]];
+            if ((qubit < qubitCount) && (shards[qubit].unit == unit)) {
+                toTry.push_back(qubit);
+            }
+        }
+        for (size_t i = 0U; i < toTry.size(); ++i) {
+            TrySeparate(toTry[i]);
+        }
+    }
+
+    if (bgSepCountdown) {
+        --bgSepCountdown;
+        return;
+    }
+    bgSepCountdown = QRACK_QUNIT_BG_SEP_PERIOD;
+
+    // Only (non-Clifford) engines are probed: their Prob() and 1-qubit gates never draw from the shared generator.
+    QInterfacePtr unit = NULL;
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        const QInterfacePtr& u = shards[i].unit;
+        if (u && !u->isClifford() && (u->GetQubitCount() >= QRACK_QUNIT_BG_SEP_MIN_QB) &&
+            (!unit || (u->GetQubitCount() > unit->GetQubitCount()))) {
+            unit = u;
+        }
+    }
+    if (!unit) {
+        return;
+    }
+
+    bgSepQubits = std::vector<bitLenInt>(unit->GetQubitCount());
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        if (shards[i].unit == unit) {
+            bgSepQubits[shards[i].mapped] = i;
+        }
+    }
+    bgSepUnit = unit;
+#if ENABLE_PTHREAD
+    bgSepProbe = std::async(std::launch::async, ProbeSeparable, unit->Clone(), separabilityThreshold);
+#else
+    bgSepProbe = std::async(std::launch::deferred, ProbeSeparable, unit->Clone(), separabilityThreshold);
+#endif
+}
+
 void QUnit::OrderContiguous(QInterfacePtr unit)
 {
     /* Before we call OrderContinguous, when we are cohering lists of shards, we should always proactively sort the
@@ -1007,6 +1160,10 @@ real1_f QUnit::ProbBase(bitLenInt qubit)
 
     shard.isProbDirty = false;
 
+    if (!shard.IsFrameDiagonal()) {
+        shard.FlushFrame();
+    }
+
     QInterfacePtr unit = shard.unit;
     bitLenInt mapped = shard.mapped;
     real1_f prob = unit->Prob(mapped);
@@ -1022,6 +1179,63 @@ real1_f QUnit::ProbBase(bitLenInt qubit)
     return prob;
 }
 
+void QUnit::ProbBits(const std::vector<bitLenInt>& bits, real1* probsArray)
+{
+    ThrowIfQbIdArrayIsBad(
+        bits, qubitCount, "QUnit::ProbBits parameter bits vector values must be within allocated qubit bounds!");
+
+    for (const bitLenInt& bit : bits) {
+        ToPermBasisProb(bit);
+    }
+
+    // Read the dirty marginals of each entangled unit with one call, which its engine answers in one pass.
+    std::map<QInterfacePtr, std::vector<bitLenInt>> unitBits;
+    for (const bitLenInt& bit : bits) {
+        QEngineShard& shard = shards[bit];
+        if (shard.unit && shard.isProbDirty && (shard.unit->GetQubitCount() > 1U)) {
+            std::vector<bitLenInt>& uBits = unitBits[shard.unit];
+            if (std::find(uBits.begin(), uBits.end(), bit) == uBits.end()) {
+                uBits.push_back(bit);
+            }
+        }
+    }
+
+    std::vector<bitLenInt> readBits;
+    for (const auto& uBits : unitBits) {
+        std::vector<bitLenInt> mapped(uBits.second.size());
+        for (size_t i = 0U; i < mapped.size(); ++i) {
+            mapped[i] = shards[uBits.second[i]].mapped;
+        }
+        std::unique_ptr<real1[]> probs(new real1[mapped.size()]);
+        uBits.first->ProbBits(mapped, probs.get());
+
+        for (size_t i = 0U; i < mapped.size(); ++i) {
+            QEngineShard& shard = shards[uBits.second[i]];
+            shard.isProbDirty = false;
+            shard.amp1 = complex((real1)sqrt(probs[i]), ZERO_R1);
+            shard.amp0 = complex((real1)sqrt(ONE_R1 - probs[i]), ZERO_R1);
+        }
+        readBits.insert(readBits.end(), uBits.second.begin(), uBits.second.end());
+    }
+
+    // As in ProbBase(), any qubit we find in a Z eigenstate is separable.
+    for (const bitLenInt& bit : readBits) {
+        QEngineShard& shard = shards[bit];
+        if (!shard.unit) {
+            continue;
+        }
+        if (IS_NORM_0(shard.amp1)) {
+            SeparateBit(false, bit);
+        } else if (IS_NORM_0(shard.amp0)) {
+            SeparateBit(true, bit);
+        }
+    }
+
+    for (size_t i = 0U; i < bits.size(); ++i) {
+        probsArray[i] = (real1)ProbBase(bits[i]);
+    }
+}
+
 real1_f QUnit::ExpectationBitsAll(const std::vector<bitLenInt>& bits, bitCapInt offset)
 {
     ThrowIfQbIdArrayIsBad(bits, qubitCount,
@@ -1114,6 +1328,46 @@ void QUnit::PhaseParity(real1 radians, bitCapInt mask)
     unit->PhaseParity((real1_f)(flipResult ? -radians : radians), mappedMask);
 }
 
+void QUnit::PhaseFlipIfLookup(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+    const unsigned char* values, bitCapInt target)
+{
+    if (isBadBitRange(indexStart, indexLength, qubitCount)) {
+        throw std::invalid_argument("QUnit::PhaseFlipIfLookup range is out-of-bounds!");
+    }
+
+    if (CheckBitsPermutation(indexStart, indexLength)) {
+        // A single index permutation only picks up a global phase.
+        const bitCapIntOcl indexInt = (bitCapIntOcl)GetCachedPermutation(indexStart, indexLength);
+        const bitLenInt valueBytes = (valueLength + 7U) / 8U;
+        bitCapInt entry = 0U;
+        for (bitCapIntOcl j = 0U; j < valueBytes; ++j) {
+            entry |= (bitCapInt)values[indexInt * valueBytes + j] << (8U * j);
+        }
+        if (entry == target) {
+            PhaseFlip();
+        }
+
+        return;
+    }
+
+    DirtyShardRange(indexStart, indexLength);
+    EntangleRange(indexStart, indexLength)
+        ->PhaseFlipIfLookup(shards[indexStart].mapped, indexLength, valueLength, values, target);
+}
+
+void QUnit::GroverLookupIteration(bitLenInt indexStart, bitLenInt indexLength, bitLenInt valueLength,
+    const unsigned char* values, bitCapInt target)
+{
+    if (isBadBitRange(indexStart, indexLength, qubitCount)) {
+        throw std::invalid_argument("QUnit::GroverLookupIteration range is out-of-bounds!");
+    }
+
+    // (Buffered single qubit bases must be applied before the cached amplitudes are dirtied.)
+    QInterfacePtr unit = EntangleRange(indexStart, indexLength);
+    DirtyShardRange(indexStart, indexLength);
+    unit->GroverLookupIteration(shards[indexStart].mapped, indexLength, valueLength, values, target);
+}
+
 real1_f QUnit::ProbParity(bitCapInt mask)
 {
     if (mask >= maxQPower) {
@@ -1347,6 +1601,7 @@ void QUnit::CUniformParityRZ(const std::vector<bitLenInt>& cControls, bitCapInt
 bool QUnit::SeparateBit(bool value, bitLenInt qubit)
 {
     QEngineShard& shard = shards[qubit];
+    shard.FlushFrame();
     QInterfacePtr unit = shard.unit;
     bitLenInt mapped = shard.mapped;
 
@@ -1400,6 +1655,7 @@ bool QUnit::SeparateBit(bool value, bitLenInt qubit)
 
 bool QUnit::ForceM(bitLenInt qubit, bool res, bool doForce, bool doApply)
 {
+    QRACK_INSTRUMENT("QUnit", "ForceM");
     if (qubit >= qubitCount) {
         throw std::invalid_argument("QUnit::ForceM target parameter must be within allocated qubit bounds!");
     }
@@ -1695,7 +1951,8 @@ std::map<bitCapInt, int> QUnit::MultiShotMeasureMask(const std::vector<bitCapInt
 
         for (size_t i = 0U; i < qIndices.size(); ++i) {
             QEngineShard& shard = shards[qIndices[i]];
-            ShardToPhaseMap controlsShards = ((perm >> i) & 1U) ? shard.controlsShards : shard.antiControlsShards;
+            const ShardToPhaseMap& controlsShards =
+                ((perm >> i) & 1U) ? shard.controlsShards : shard.antiControlsShards;
             for (auto phaseShard = controlsShards.begin(); phaseShard != controlsShards.end(); ++phaseShard) {
                 if (!phaseShard->second->isInvert) {
                     continue;
@@ -2051,7 +2308,10 @@ void QUnit::S(bitLenInt target)
         return;
     }
 
-    if (shard.unit) {
+    if (shard.isFramed) {
+        const complex mtrx[4U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, I_CMPLX };
+        shard.ComposeFrame(mtrx);
+    } else if (shard.unit) {
         shard.unit->S(shard.mapped);
     }
 
@@ -2079,7 +2339,10 @@ void QUnit::IS(bitLenInt target)
         return;
     }
 
-    if (shard.unit) {
+    if (shard.isFramed) {
+        const complex mtrx[4U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, -I_CMPLX };
+        shard.ComposeFrame(mtrx);
+    } else if (shard.unit) {
         shard.unit->IS(shard.mapped);
     }
 
@@ -2094,7 +2357,10 @@ void QUnit::XBase(bitLenInt target)
 
     QEngineShard& shard = shards[target];
 
-    if (shard.unit) {
+    if (shard.isFramed) {
+        const complex mtrx[4U]{ ZERO_CMPLX, ONE_CMPLX, ONE_CMPLX, ZERO_CMPLX };
+        shard.ComposeFrame(mtrx);
+    } else if (shard.unit) {
         shard.unit->X(shard.mapped);
     }
 
@@ -2109,7 +2375,10 @@ void QUnit::YBase(bitLenInt target)
 
     QEngineShard& shard = shards[target];
 
-    if (shard.unit) {
+    if (shard.isFramed) {
+        const complex mtrx[4U]{ ZERO_CMPLX, -I_CMPLX, I_CMPLX, ZERO_CMPLX };
+        shard.ComposeFrame(mtrx);
+    } else if (shard.unit) {
         shard.unit->Y(shard.mapped);
     }
 
@@ -2126,7 +2395,10 @@ void QUnit::ZBase(bitLenInt target)
 
     QEngineShard& shard = shards[target];
 
-    if (shard.unit) {
+    if (shard.isFramed) {
+        const complex mtrx[4U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, -ONE_CMPLX };
+        shard.ComposeFrame(mtrx);
+    } else if (shard.unit) {
         shard.unit->Z(shard.mapped);
     }
 
@@ -2232,7 +2504,10 @@ void QUnit::Phase(complex topLeft, complex bottomRight, bitLenInt target)
     shard.CommutePhase(topLeft, bottomRight);
 
     if (shard.pauliBasis == PauliZ) {
-        if (shard.unit) {
+        if (shard.isFramed) {
+            const complex mtrx[4U]{ topLeft, ZERO_CMPLX, ZERO_CMPLX, bottomRight };
+            shard.ComposeFrame(mtrx);
+        } else if (shard.unit) {
             shard.unit->Phase(topLeft, bottomRight, shard.mapped);
         }
 
@@ -2246,7 +2521,7 @@ void QUnit::Phase(complex topLeft, complex bottomRight, bitLenInt target)
     TransformPhase(topLeft, bottomRight, mtrx);
 
     if (shard.unit) {
-        shard.unit->Mtrx(mtrx, shard.mapped);
+        ShardMtrx(shard, mtrx);
     }
 
     if (DIRTY(shard)) {
@@ -2271,7 +2546,10 @@ void QUnit::Invert(complex topRight, complex bottomLeft, bitLenInt target)
     shard.CommutePhase(topRight, bottomLeft);
 
     if (shard.pauliBasis == PauliZ) {
-        if (shard.unit) {
+        if (shard.isFramed) {
+            const complex mtrx[4U]{ ZERO_CMPLX, topRight, bottomLeft, ZERO_CMPLX };
+            shard.ComposeFrame(mtrx);
+        } else if (shard.unit) {
             shard.unit->Invert(topRight, bottomLeft, shard.mapped);
         }
 
@@ -2290,7 +2568,7 @@ void QUnit::Invert(complex topRight, complex bottomLeft, bitLenInt target)
     }
 
     if (shard.unit) {
-        shard.unit->Mtrx(mtrx, shard.mapped);
+        ShardMtrx(shard, mtrx);
     }
 
     if (DIRTY(shard)) {
@@ -2305,6 +2583,7 @@ void QUnit::Invert(complex topRight, complex bottomLeft, bitLenInt target)
 
 void QUnit::MCPhase(const std::vector<bitLenInt>& lControls, complex topLeft, complex bottomRight, bitLenInt target)
 {
+    QRACK_INSTRUMENT("QUnit", "MCPhase");
     ThrowIfQbIdArrayIsBad(
         lControls, qubitCount, "QUnit::MCPhase parameter controls array values must be within allocated qubit bounds!");
 
@@ -2407,6 +2686,7 @@ void QUnit::MACPhase(const std::vector<bitLenInt>& lControls, complex topLeft, c
 
 void QUnit::MCInvert(const std::vector<bitLenInt>& lControls, complex topRight, complex bottomLeft, bitLenInt target)
 {
+    QRACK_INSTRUMENT("QUnit", "MCInvert");
     ThrowIfQbIdArrayIsBad(lControls, qubitCount,
         "QUnit::MCInvert parameter controls array values must be within allocated qubit bounds!");
 
@@ -2509,6 +2789,7 @@ void QUnit::MACInvert(const std::vector<bitLenInt>& lControls, complex topRight,
 
 void QUnit::Mtrx(complex const* mtrx, bitLenInt target)
 {
+    QRACK_INSTRUMENT("QUnit", "Mtrx");
     QEngineShard& shard = shards[target];
 
     if (IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U])) {
@@ -2553,7 +2834,7 @@ void QUnit::Mtrx(complex const* mtrx, bitLenInt target)
     }
 
     if (shard.unit) {
-        shard.unit->Mtrx(trnsMtrx, shard.mapped);
+        ShardMtrx(shard, trnsMtrx);
     }
 
     if (DIRTY(shard)) {
@@ -2568,6 +2849,7 @@ void QUnit::Mtrx(complex const* mtrx, bitLenInt target)
 
 void QUnit::MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
 {
+    QRACK_INSTRUMENT("QUnit", "MCMtrx");
     if (IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U])) {
         MCPhase(controls, mtrx[0U], mtrx[3U], target);
         return;
@@ -2600,6 +2882,7 @@ void QUnit::MCMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx,
 
 void QUnit::MACMtrx(const std::vector<bitLenInt>& controls, complex const* mtrx, bitLenInt target)
 {
+    QRACK_INSTRUMENT("QUnit", "MACMtrx");
     if (IS_NORM_0(mtrx[1U]) && IS_NORM_0(mtrx[2U])) {
         MACPhase(controls, mtrx[0U], mtrx[3U], target);
         return;
@@ -2772,6 +3055,10 @@ template <typename CF>
 void QUnit::ApplyEitherControlled(
     std::vector<bitLenInt> controlVec, const std::vector<bitLenInt> targets, CF cfn, bool isPhase)
 {
+    if (isBackgroundSeparate) {
+        PollBackgroundSeparate();
+    }
+
     // If we've made it this far, we have to form the entangled representation and apply the gate.
 
     for (size_t i = 0U; i < controlVec.size(); ++i) {
@@ -2788,6 +3075,14 @@ void QUnit::ApplyEitherControlled(
         RevertBasis2Qb(targets[0U]);
     }
 
+    // Frames on the controls are diagonal, by now, and only a Z basis phase gate commutes with a diagonal target frame.
+    if (targets.size() == 1U) {
+        QEngineShard& shard = shards[targets[0U]];
+        if (!isPhase || (shard.pauliBasis != PauliZ) || !shard.IsFrameDiagonal()) {
+            shard.FlushFrame();
+        }
+    }
+
     std::vector<bitLenInt> allBits(controlVec.size() + targets.size());
     std::copy(controlVec.begin(), controlVec.end(), allBits.begin());
     std::copy(targets.begin(), targets.end(), allBits.begin() + controlVec.size());
@@ -2841,7 +3136,10 @@ void QUnit::ConvertZToX(bitLenInt i)
     // WARNING: Might be called when shard is in either Z or X basis
     shard.pauliBasis = (shard.pauliBasis == PauliX) ? PauliZ : PauliX;
 
-    if (shard.unit) {
+    if (shard.isFramed) {
+        const complex mtrx[4U]{ SQRT1_2_R1, SQRT1_2_R1, SQRT1_2_R1, -SQRT1_2_R1 };
+        shard.ComposeFrame(mtrx);
+    } else if (shard.unit) {
         shard.unit->H(shard.mapped);
     }
 
@@ -2866,7 +3164,7 @@ void QUnit::ConvertXToY(bitLenInt i)
         ((real1)(ONE_R1 / 2)) * (ONE_CMPLX - I_CMPLX) };
 
     if (shard.unit) {
-        shard.unit->Mtrx(mtrx, shard.mapped);
+        ShardMtrx(shard, mtrx);
     }
 
     if (shard.isPhaseDirty || shard.isProbDirty) {
@@ -2889,7 +3187,7 @@ void QUnit::ConvertYToZ(bitLenInt i)
         complex(ZERO_R1, -SQRT1_2_R1) };
 
     if (shard.unit) {
-        shard.unit->Mtrx(mtrx, shard.mapped);
+        ShardMtrx(shard, mtrx);
     }
 
     if (shard.isPhaseDirty || shard.isProbDirty) {
@@ -2912,7 +3210,7 @@ void QUnit::ConvertZToY(bitLenInt i)
         complex(ZERO_R1, SQRT1_2_R1) };
 
     if (shard.unit) {
-        shard.unit->Mtrx(mtrx, shard.mapped);
+        ShardMtrx(shard, mtrx);
     }
 
     if (shard.isPhaseDirty || shard.isProbDirty) {
@@ -2975,13 +3273,13 @@ void QUnit::ToPermBasis(bitLenInt start, bitLenInt length)
 }
 void QUnit::ToPermBasisProb(bitLenInt qubit)
 {
-    RevertBasis1Qb(qubit);
+    RevertBasis1Qb(qubit, true);
     RevertBasis2Qb(qubit, ONLY_INVERT, ONLY_TARGETS);
 }
 void QUnit::ToPermBasisProb(bitLenInt start, bitLenInt length)
 {
     for (bitLenInt i = 0U; i < length; ++i) {
-        RevertBasis1Qb(start + i);
+        RevertBasis1Qb(start + i, true);
     }
     for (bitLenInt i = 0U; i < length; ++i) {
         RevertBasis2Qb(start + i, ONLY_INVERT, ONLY_TARGETS);
@@ -4088,6 +4386,8 @@ QInterfacePtr QUnit::Clone()
         separabilityThreshold);
 
     copyPtr->SetReactiveSeparate(isReactiveSeparate);
+    copyPtr->SetBackgroundSeparate(isBackgroundSeparate);
+    copyPtr->SetLocalFrames(isLocalFrames);
 
     return CloneBody(copyPtr);
 }
@@ -4113,7 +4413,90 @@ QInterfacePtr QUnit::CloneBody(QUnitPtr copyPtr)
     return copyPtr;
 }
 
-void QUnit::ApplyBuffer(PhaseShardPtr phaseShard, bitLenInt control, bitLenInt target, bool isAnti)
+void QUnit::SaveCheckpoint(CheckpointWriter& writer)
+{
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        RevertBasis2Qb(i);
+        shards[i].FlushFrame();
+    }
+
+    writer.BeginSection("QUNT");
+    writer.Write<uint64_t>(qubitCount);
+
+    // The shard table refers to each distinct unit by its order of first appearance.
+    std::map<QInterfacePtr, int64_t> unitIndices;
+    std::vector<QInterfacePtr> units;
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        QEngineShard& shard = shards[i];
+        int64_t u = -1;
+        if (shard.unit) {
+            const auto it = unitIndices.find(shard.unit);
+            if (it == unitIndices.end()) {
+                u = (int64_t)units.size();
+                unitIndices[shard.unit] = u;
+                units.push_back(shard.unit);
+            } else {
+                u = it->second;
+            }
+        }
+        writer.Write<int64_t>(u);
+        writer.Write<uint64_t>(shard.mapped);
+        writer.Write<complex>(shard.amp0);
+        writer.Write<complex>(shard.amp1);
+        writer.Write<uint8_t>((uint8_t)shard.pauliBasis);
+        writer.Write<uint8_t>(shard.isProbDirty ? 1U : 0U);
+        writer.Write<uint8_t>(shard.isPhaseDirty ? 1U : 0U);
+    }
+
+    writer.Write<uint64_t>(units.size());
+    for (size_t i = 0U; i < units.size(); ++i) {
+        writer.Write<uint64_t>(units[i]->GetQubitCount());
+        units[i]->SaveCheckpoint(writer);
+    }
+}
+
+void QUnit::LoadCheckpoint(CheckpointReader& reader)
+{
+    reader.ExpectSection("QUNT");
+    if (reader.Read<uint64_t>() != qubitCount) {
+        throw std::invalid_argument("QUnit::LoadCheckpoint() checkpoint qubit count does not match!");
+    }
+
+    std::vector<int64_t> unitIndices(qubitCount);
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        QEngineShard shard;
+        unitIndices[i] = reader.Read<int64_t>();
+        shard.mapped = (bitLenInt)reader.Read<uint64_t>();
+        shard.amp0 = reader.Read<complex>();
+        shard.amp1 = reader.Read<complex>();
+        shard.pauliBasis = (Pauli)reader.Read<uint8_t>();
+        shard.isProbDirty = reader.Read<uint8_t>() != 0U;
+        shard.isPhaseDirty = reader.Read<uint8_t>() != 0U;
+        shards[i] = shard;
+    }
+
+    std::vector<QInterfacePtr> units(reader.Read<uint64_t>());
+    for (size_t i = 0U; i < units.size(); ++i) {
+        const bitLenInt length = (bitLenInt)reader.Read<uint64_t>();
+        if (!length || (length > qubitCount)) {
+            throw std::runtime_error("QUnit::LoadCheckpoint() checkpoint unit width is invalid!");
+        }
+        units[i] = MakeEngine(length, 0U);
+        units[i]->LoadCheckpoint(reader);
+    }
+
+    for (bitLenInt i = 0U; i < qubitCount; ++i) {
+        if (unitIndices[i] < 0) {
+            continue;
+        }
+        if (((size_t)unitIndices[i] >= units.size()) || (shards[i].mapped >= units[unitIndices[i]]->GetQubitCount())) {
+            throw std::runtime_error("QUnit::LoadCheckpoint() checkpoint shard table is invalid!");
+        }
+        shards[i].unit = units[unitIndices[i]];
+    }
+}
+
+void QUnit::ApplyBuffer(const PhaseShardPtr& phaseShard, bitLenInt control, bitLenInt target, bool isAnti)
 {
     const std::vector<bitLenInt> controls{ control };
 
@@ -4262,7 +4645,7 @@ void QUnit::CommuteH(bitLenInt bitIndex)
     ShardToPhaseMap controlsShards = shard.controlsShards;
 
     for (auto phaseShard = controlsShards.begin(); phaseShard != controlsShards.end(); ++phaseShard) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
         QEngineShardPtr partner = phaseShard->first;
 
         if (buffer->isInvert) {
@@ -4284,7 +4667,7 @@ void QUnit::CommuteH(bitLenInt bitIndex)
     controlsShards = shard.antiControlsShards;
 
     for (auto phaseShard = controlsShards.begin(); phaseShard != controlsShards.end(); ++phaseShard) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
         QEngineShardPtr partner = phaseShard->first;
 
         if (buffer->isInvert) {
@@ -4308,7 +4691,7 @@ void QUnit::CommuteH(bitLenInt bitIndex)
     ShardToPhaseMap targetOfShards = shard.targetOfShards;
 
     for (auto phaseShard = targetOfShards.begin(); phaseShard != targetOfShards.end(); ++phaseShard) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
 
         const complex polarDiff = buffer->cmplxDiff;
         const complex polarSame = buffer->cmplxSame;
@@ -4331,7 +4714,7 @@ void QUnit::CommuteH(bitLenInt bitIndex)
     targetOfShards = shard.antiTargetOfShards;
 
     for (auto phaseShard = targetOfShards.begin(); phaseShard != targetOfShards.end(); ++phaseShard) {
-        PhaseShardPtr buffer = phaseShard->second;
+        const PhaseShardPtr& buffer = phaseShard->second;
 
         const complex polarDiff = buffer->cmplxDiff;
         const complex polarSame = buffer->cmplxSame;
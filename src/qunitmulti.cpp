@@ -13,6 +13,11 @@
 
 #include "qfactory.hpp"
 
+#include "common/engine_profile.hpp"
+#include "common/memory_governor.hpp"
+
+#include <limits>
+
 namespace Qrack {
 
 QUnitMulti::QUnitMulti(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, bitCapInt initState,
@@ -22,9 +27,14 @@ QUnitMulti::QUnitMulti(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, b
     : QUnit(eng, qBitCount, initState, rgp, phaseFac, doNorm, randomGlobalPhase, useHostMem, -1, useHardwareRNG,
           useSparseStateVec, norm_thresh, devList, qubitThreshold, sep_thresh)
     , isQEngineOCL(false)
+    , isProfiled(false)
+    , migrateGain((real1_f)1.25f)
 {
 #if ENABLE_ENV_VARS
     isRedistributing = (bool)getenv("QRACK_ENABLE_QUNITMULTI_REDISTRIBUTE");
+    if (getenv("QRACK_QUNITMULTI_MIGRATE_GAIN")) {
+        migrateGain = (real1_f)std::stof(std::string(getenv("QRACK_QUNITMULTI_MIGRATE_GAIN")));
+    }
 #else
     isRedistributing = false;
 #endif
@@ -72,21 +82,72 @@ QUnitMulti::QUnitMulti(std::vector<QInterfaceEngine> eng, bitLenInt qBitCount, b
     if (!devList.size()) {
         std::sort(deviceList.begin() + 1U, deviceList.end(), std::greater<DeviceInfo>());
     }
+
+    // Measured costs are only comparable if every device has them.
+    isProfiled = true;
+    for (size_t i = 0U; i < deviceList.size(); ++i) {
+        if (!EngineProfile::Instance().HasDevice(deviceList[i].id)) {
+            isProfiled = false;
+            break;
+        }
+    }
+}
+
+double QUnitMulti::UnitTime(size_t devIndex, bitLenInt qb)
+{
+    const size_t devID = deviceList[devIndex].id;
+    if (isProfiled) {
+        return EngineProfile::Instance().GetDevice(devID).Apply2x2Time(qb);
+    }
+
+    // Without a profile, assume throughput scales with the device's preferred concurrency.
+    return std::ldexp(1.0, (int)qb) /
+        (double)OCLEngine::Instance().GetDeviceContextPtr(devID)->GetPreferredConcurrency();
+}
+
+double QUnitMulti::QueueTime(size_t devIndex)
+{
+    const size_t devID = deviceList[devIndex].id;
+    const double depth = (double)OCLEngine::Instance().GetDeviceContextPtr(devID)->GetQueueDepth();
+    if (isProfiled) {
+        return depth * EngineProfile::Instance().GetDevice(devID).launchLatency;
+    }
+
+    // Count each queued command as one pass over the preferred concurrency, (the unit of UnitTime(), here).
+    return depth;
 }
 
 QInterfacePtr QUnitMulti::MakeEngine(bitLenInt length, bitCapInt perm)
 {
+    // Of the devices with room in their memory budgets, take the least loaded.
+    MemoryGovernor& governor = MemoryGovernor::Instance();
+    const size_t bytes = sizeof(complex) * (size_t)pow2Ocl(length);
+    bool isAdmitted = governor.CanAdmit(defaultDeviceID, bytes);
     size_t deviceId = defaultDeviceID;
     uint64_t sz = OCLEngine::Instance().GetActiveAllocSize(deviceId);
 
     for (size_t i = 0U; i < deviceList.size(); ++i) {
+        if (!governor.CanAdmit(deviceList[i].id, bytes)) {
+            continue;
+        }
         uint64_t tSz = OCLEngine::Instance().GetActiveAllocSize(deviceList[i].id);
-        if (sz > tSz) {
+        if (!isAdmitted || (sz > tSz)) {
+            isAdmitted = true;
             sz = tSz;
             deviceId = deviceList[i].id;
         }
     }
 
+    if (!isAdmitted) {
+        // No device has room, so the unit starts on the host.
+        QInterfacePtr toRet = CreateQuantumInterface(HostEngines(), length, perm, rand_generator, phaseFactor,
+            doNormalize, randGlobalPhase, true, -1, useRDRAND, isSparse, (real1_f)amplitudeFloor,
+            std::vector<int64_t>{}, thresholdQubits, separabilityThreshold);
+        hostUnits[toRet.get()] = toRet;
+
+        return toRet;
+    }
+
     // Suppress passing device list, since QUnitMulti occupies all devices in the list
     QInterfacePtr toRet = CreateQuantumInterface(engines, length, perm, rand_generator, phaseFactor, doNormalize,
         randGlobalPhase, useHostRam, deviceId, useRDRAND, isSparse, (real1_f)amplitudeFloor, std::vector<int64_t>{},
@@ -101,24 +162,60 @@ std::vector<QEngineInfo> QUnitMulti::GetQInfos()
     std::vector<QInterfacePtr> qips;
     std::vector<QEngineInfo> qinfos;
 
+    std::map<QInterface*, std::weak_ptr<QInterface>> nHostUnits;
     for (auto&& shard : shards) {
         if (shard.unit && (std::find(qips.begin(), qips.end(), shard.unit) == qips.end())) {
             qips.push_back(shard.unit);
+            const auto hostUnit = hostUnits.find(shard.unit.get());
+            if ((hostUnit != hostUnits.end()) && !hostUnit->second.expired()) {
+                // Host units are past the end of the device list.
+                nHostUnits[shard.unit.get()] = shard.unit;
+                qinfos.push_back(QEngineInfo(shard.unit, deviceList.size()));
+                continue;
+            }
             const size_t deviceIndex = std::distance(
                 deviceList.begin(), std::find_if(deviceList.begin(), deviceList.end(), [&](DeviceInfo di) {
-                    return di.id == (shard.unit->GetDevice() < 0) ? OCLEngine::Instance().GetDefaultDeviceID()
-                                                                  : (size_t)shard.unit->GetDevice();
+                    return di.id ==
+                        ((shard.unit->GetDevice() < 0) ? OCLEngine::Instance().GetDefaultDeviceID()
+                                                       : (size_t)shard.unit->GetDevice());
                 }));
             qinfos.push_back(QEngineInfo(shard.unit, deviceIndex));
         }
     }
 
+    // (Forget host units that have since been composed away.)
+    hostUnits = nHostUnits;
+
     // We distribute in descending size order:
     std::sort(qinfos.rbegin(), qinfos.rend());
 
     return qinfos;
 }
 
+QInterfacePtr QUnitMulti::EntangleInCurrentBasis(
+    std::vector<bitLenInt*>::iterator first, std::vector<bitLenInt*>::iterator last)
+{
+    // Every unit is composed into that of the first bit, on its device, so the widest unit should stay where it is, and
+    // the first should join it there, (rather than the widest crossing devices to the first).
+    QInterfacePtr widest = NULL;
+    for (auto bit = first; bit < last; ++bit) {
+        EndEmulation(**bit);
+        const QInterfacePtr& unit = shards[**bit].unit;
+        if (!widest || (unit->GetQubitCount() > widest->GetQubitCount())) {
+            widest = unit;
+        }
+    }
+    const QInterfacePtr& unit1 = shards[**first].unit;
+    if ((unit1 != widest) && (unit1->GetDevice() != widest->GetDevice())) {
+        unit1->SetDevice(widest->GetDevice());
+    }
+
+    QInterfacePtr toRet = QUnit::EntangleInCurrentBasis(first, last);
+    RedistributeQEngines();
+
+    return toRet;
+}
+
 void QUnitMulti::RedistributeQEngines()
 {
     // Only redistribute if the env var flag is set and NOT a null string.
@@ -130,46 +227,101 @@ void QUnitMulti::RedistributeQEngines()
     // Get shard sizes and devices
     std::vector<QEngineInfo> qinfos = GetQInfos();
 
-    std::vector<bitCapInt> devSizes(deviceList.size(), 0U);
+    // Each device's estimated time to finish its queue, and then one gate on every unit placed on it so far
+    std::vector<double> devTimes(deviceList.size());
+    for (size_t j = 0U; j < deviceList.size(); ++j) {
+        devTimes[j] = QueueTime(j);
+    }
 
+    MemoryGovernor& governor = MemoryGovernor::Instance();
     for (size_t i = 0U; i < qinfos.size(); ++i) {
+        if (qinfos[i].deviceIndex >= deviceList.size()) {
+            // Host units stay on the host.
+            continue;
+        }
+
+        size_t devIndex = qinfos[i].deviceIndex;
+        // A unit on a device under memory pressure has to move, even if redistribution is off.
+        const bool isPressured = !qinfos[i].unit->isClifford() && governor.IsUnderPressure(deviceList[devIndex].id);
+
         // We want to proactively set OpenCL devices for the event they cross threshold.
-        if (!isRedistributing &&
+        if (!isRedistributing && !isPressured &&
             !((qinfos[i].unit->GetMaxQPower() <= 2U) ||
                 (!isQEngineOCL && (qinfos[i].unit->GetQubitCount() < thresholdQubits)) ||
                 qinfos[i].unit->isClifford())) {
             continue;
         }
 
-        // If the original OpenCL device has equal load to the least, we prefer the original.
-        int64_t deviceID = qinfos[i].unit->GetDevice();
-        int64_t devIndex = qinfos[i].deviceIndex;
-        bitCapInt sz = devSizes[devIndex];
-
-        // If the original device has 0 determined load, don't switch the unit.
-        if (sz) {
-            // If the default OpenCL device has equal load to the least, we prefer the default.
-            if (devSizes[0U] < sz) {
-                deviceID = deviceList[0U].id;
-                devIndex = 0U;
-                sz = devSizes[0U];
-            }
+        const bitLenInt qb = qinfos[i].unit->GetQubitCount();
+        const size_t unitBytes = sizeof(complex) * (size_t)qinfos[i].unit->GetMaxQPower();
+        double time = devTimes[devIndex] + UnitTime(devIndex, qb);
 
-            // Find the device with the lowest load.
-            for (size_t j = 0U; j < deviceList.size(); ++j) {
-                if ((devSizes[j] < sz) && ((devSizes[j] + qinfos[i].unit->GetMaxQPower()) <= deviceList[j].maxSize)) {
-                    deviceID = deviceList[j].id;
-                    devIndex = j;
-                    sz = devSizes[j];
-                }
+        // Find the device that would finish this unit soonest, (preferring the current device on ties).
+        size_t bestIndex = devIndex;
+        double bestTime = isPressured ? std::numeric_limits<double>::infinity() : time;
+        for (size_t j = 0U; j < deviceList.size(); ++j) {
+            if ((j == devIndex) || (unitBytes > deviceList[j].maxSize) ||
+                governor.IsUnderPressure(deviceList[j].id) || !governor.CanAdmit(deviceList[j].id, unitBytes)) {
+                continue;
+            }
+            const double jTime = devTimes[j] + UnitTime(j, qb);
+            if (jTime < bestTime) {
+                bestIndex = j;
+                bestTime = jTime;
             }
+        }
+
+        if (isPressured && (bestIndex == devIndex)) {
+            // No other device has room, so fall back to host memory.
+            MoveUnitToHost(qinfos[i].unit);
+            // (Drop this reference, so the device memory is released before the next unit is weighed.)
+            qinfos[i].unit = NULL;
+            continue;
+        }
+
+        // Only migrate for a clear gain, so that units don't bounce between devices with similar loads.
+        if ((bestIndex != devIndex) && (isPressured || ((bestTime * migrateGain) < time))) {
+            qinfos[i].unit->SetDevice(deviceList[bestIndex].id);
+            devIndex = bestIndex;
+            time = bestTime;
+        }
+
+        devTimes[devIndex] = time;
+    }
+}
 
-            // Add this unit to the device with the lowest load.
-            qinfos[i].unit->SetDevice(deviceID);
+std::vector<QInterfaceEngine> QUnitMulti::HostEngines()
+{
+    std::vector<QInterfaceEngine> hostEngines(engines);
+    for (size_t i = 0U; i < hostEngines.size(); ++i) {
+        if ((hostEngines[i] == QINTERFACE_OPENCL) || (hostEngines[i] == QINTERFACE_HYBRID)) {
+            hostEngines[i] = QINTERFACE_CPU;
         }
+    }
+
+    return hostEngines;
+}
 
-        // Update the size of buffers handles by this device.
-        devSizes[devIndex] += qinfos[i].unit->GetMaxQPower();
+void QUnitMulti::MoveUnitToHost(QInterfacePtr unit)
+{
+    const bitCapIntOcl maxQPower = (bitCapIntOcl)unit->GetMaxQPower();
+    if (!MemoryGovernor::Instance().CanAdmit(QRACK_HOST_MEMORY, sizeof(complex) * maxQPower)) {
+        // The host is full, too, so the unit stays where it is.
+        return;
+    }
+
+    QInterfacePtr hostUnit = CreateQuantumInterface(HostEngines(), unit->GetQubitCount(), 0U, rand_generator,
+        phaseFactor, doNormalize, randGlobalPhase, true, -1, useRDRAND, isSparse, (real1_f)amplitudeFloor,
+        std::vector<int64_t>{}, thresholdQubits, separabilityThreshold);
+    std::unique_ptr<complex[]> amps(new complex[maxQPower]);
+    unit->GetQuantumState(amps.get());
+    hostUnit->SetQuantumState(amps.get());
+
+    for (auto&& shard : shards) {
+        if (shard.unit == unit) {
+            shard.unit = hostUnit;
+        }
     }
+    hostUnits[hostUnit.get()] = hostUnit;
 }
 } // namespace Qrack
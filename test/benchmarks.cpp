@@ -11,15 +11,24 @@
 // for details.
 
 #include "qfactory.hpp"
+#include "qneuron.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <iostream>
 #include <list>
+#include <map>
+#include <numeric>
+#include <random>
 #include <set>
 #include <stdio.h>
 #include <stdlib.h>
 
+#if !defined(__linux__) && !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
 #include "catch.hpp"
 
 #include "tests.hpp"
@@ -35,6 +44,13 @@
 
 #define QALU(qReg) std::dynamic_pointer_cast<QAlu>(qReg)
 
+// Circuit seed of the "[workload]" suite, so every sample, on every engine stack, replays the same circuit
+#define WORKLOAD_SEED 5489U
+// Widest QEngineCPU reference the "[workload]" suite builds to measure fidelity
+#define WORKLOAD_REFERENCE_MAX_QB 26U
+// Measurement shots per sample, in "[workload]" tests that sample
+#define WORKLOAD_SHOTS 1024U
+
 using namespace Qrack;
 
 const double clockFactor = 1.0 / 1000.0; // Report in ms
@@ -48,6 +64,91 @@ double formatTime(double t, bool logNormal)
     }
 }
 
+std::string EngineStackName(const std::vector<QInterfaceEngine>& engineStack)
+{
+    static const std::map<QInterfaceEngine, std::string> names = { { QINTERFACE_CPU, "CPU" },
+        { QINTERFACE_OPENCL, "OpenCL" }, { QINTERFACE_HYBRID, "QHybrid" }, { QINTERFACE_BDT, "QBdt" },
+        { QINTERFACE_STABILIZER, "QStabilizer" }, { QINTERFACE_STABILIZER_HYBRID, "QStabilizerHybrid" },
+        { QINTERFACE_QPAGER, "QPager" }, { QINTERFACE_QUNIT, "QUnit" }, { QINTERFACE_QUNIT_MULTI, "QUnitMulti" },
+        { QINTERFACE_QPAGER_MPI, "QPagerMpi" } };
+
+    std::string toRet;
+    for (size_t i = 0U; i < engineStack.size(); ++i) {
+        const auto it = names.find(engineStack[i]);
+        toRet += (i ? ">" : "") + ((it == names.end()) ? std::to_string((int)engineStack[i]) : it->second);
+    }
+
+    return toRet;
+}
+
+// Restart the peak resident memory measurement, where the OS allows it.
+void ResetPeakMemory()
+{
+#if defined(__linux__)
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+#endif
+}
+
+// Peak resident memory, in kB, since ResetPeakMemory(), (or since process launch, off of Linux)
+size_t PeakMemoryKb()
+{
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0U, 6U, "VmHWM:") == 0) {
+            return std::stoul(line.substr(6U));
+        }
+    }
+    return 0U;
+#elif defined(_WIN32)
+    return 0U;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return 0U;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss >> 10U;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+void RecordBenchmarkResult(const std::vector<QInterfaceEngine>& engineStack, bitLenInt numBits,
+    const std::vector<double>& sortedClocks, int sampleFailureCount, bool logNormal, size_t peakKb, real1_f fidelity)
+{
+    BenchmarkResult result;
+    result.test = Catch::getResultCapture().getCurrentTestName();
+    result.stack = EngineStackName(engineStack);
+    result.qubits = numBits;
+    result.samples = (int)sortedClocks.size();
+    result.failures = sampleFailureCount;
+    result.peakKb = peakKb;
+    result.fidelity = fidelity;
+
+    result.meanMs = 0.0;
+    for (size_t i = 0U; i < sortedClocks.size(); ++i) {
+        result.meanMs += formatTime(sortedClocks[i], logNormal);
+    }
+    result.meanMs /= sortedClocks.size();
+
+    const size_t mid = sortedClocks.size() >> 1U;
+    result.medianMs = (sortedClocks.size() & 1U)
+        ? formatTime(sortedClocks[mid], logNormal)
+        : (formatTime(sortedClocks[mid - 1U], logNormal) + formatTime(sortedClocks[mid], logNormal)) / 2;
+
+    // Nearest-rank 99th percentile
+    const size_t p99 = (size_t)std::ceil(0.99 * sortedClocks.size()) - 1U;
+    result.p99Ms = formatTime(sortedClocks[p99], logNormal);
+
+    result.ampUpdatesPerSec = (result.meanMs > 0.0) ? (pow(2.0, numBits) * 1000.0 / result.meanMs) : 0.0;
+
+    benchmarkResults.push_back(result);
+}
+
 void RandomInitQubit(QInterfacePtr sim, bitLenInt i)
 {
     real1_f theta = 4 * M_PI * sim->Rand();
@@ -57,8 +158,41 @@ void RandomInitQubit(QInterfacePtr sim, bitLenInt i)
     sim->U(i, theta, phi, lambda);
 }
 
+// Overlap, |<reference|state>|^2, of "qftReg" with the state that "fn" prepares from |0> on a QEngineCPU, (or -1 if the
+// reference is too wide or can't be simulated)
+real1_f WorkloadFidelity(QInterfacePtr qftReg, std::function<void(QInterfacePtr, bitLenInt)> fn, bitLenInt numBits)
+{
+    if (numBits > WORKLOAD_REFERENCE_MAX_QB) {
+        return -ONE_R1_F;
+    }
+
+    try {
+        QEnginePtr reference = std::dynamic_pointer_cast<QEngine>(CreateQuantumInterface(QINTERFACE_CPU, numBits, 0,
+            rng, CMPLX_DEFAULT_ARG, enable_normalization, true, false, -1, !disable_hardware_rng));
+        fn(reference, numBits);
+        reference->Finish();
+
+        // Stream the tested state, so only the reference is ever held whole.
+        std::vector<complex> refChunk;
+        complex overlap = ZERO_CMPLX;
+        qftReg->ForEachAmplitudeChunk(0U, qftReg->GetMaxQPower(),
+            [&](const bitCapInt& offset, const bitCapIntOcl& length, complex const* amps) {
+                refChunk.resize(length);
+                reference->GetAmplitudePage(&(refChunk[0U]), (bitCapIntOcl)offset, length);
+                for (bitCapIntOcl i = 0U; i < length; ++i) {
+                    overlap += conj(refChunk[i]) * amps[i];
+                }
+            });
+
+        return (real1_f)norm(overlap);
+    } catch (const std::exception& e) {
+        return -ONE_R1_F;
+    }
+}
+
 void benchmarkLoopVariable(std::function<void(QInterfacePtr, bitLenInt)> fn, bitLenInt mxQbts,
-    bool resetRandomPerm = true, bool hadamardRandomBits = false, bool logNormal = false, bool qUniverse = false)
+    bool resetRandomPerm = true, bool hadamardRandomBits = false, bool logNormal = false, bool qUniverse = false,
+    bool measureFidelity = false)
 {
     std::cout << std::endl;
     std::cout << ">>> '" << Catch::getResultCapture().getCurrentTestName() << "':" << std::endl;
@@ -71,7 +205,11 @@ void benchmarkLoopVariable(std::function<void(QInterfacePtr, bitLenInt)> fn, bit
     std::cout << "Median (ms), ";
     std::cout << "3rd Quartile (ms), ";
     std::cout << "Slowest (ms), ";
-    std::cout << "Failure count" << std::endl;
+    std::cout << "Failure count";
+    if (measureFidelity) {
+        std::cout << ", Fidelity";
+    }
+    std::cout << std::endl;
 
     std::vector<double> trialClocks;
     bool isTrialSuccessful = true;
@@ -107,6 +245,7 @@ void benchmarkLoopVariable(std::function<void(QInterfacePtr, bitLenInt)> fn, bit
     }
 
     for (numBits = mnQbts; numBits <= mxQbts; numBits++) {
+        ResetPeakMemory();
         QInterfacePtr qftReg = CreateQuantumInterface(engineStack, numBits, 0, rng, CMPLX_DEFAULT_ARG,
             enable_normalization, true, use_host_dma, device_id, !disable_hardware_rng, sparse, REAL1_EPSILON, devList);
         if (disable_t_injection) {
@@ -204,7 +343,7 @@ void benchmarkLoopVariable(std::function<void(QInterfacePtr, bitLenInt)> fn, bit
                 for (bitLenInt i = 0U; i < numBits; ++i) {
                     qPowers.push_back(pow2(i));
                 }
-                std::unique_ptr<unsigned long long> results(new unsigned long long[1000000U]);
+                std::unique_ptr<unsigned long long[]> results(new unsigned long long[1000000U]);
                 qftReg->MultiShotMeasureMask(qPowers, 1000000U, results.get());
                 for (size_t i = 0U; i < 1000000U; ++i) {
                     mOutputFile << results.get()[i] << std::endl;
@@ -277,7 +416,22 @@ void benchmarkLoopVariable(std::function<void(QInterfacePtr, bitLenInt)> fn, bit
         }
 
         // Failure count
-        std::cout << sampleFailureCount << std::endl;
+        std::cout << sampleFailureCount;
+
+        // (Peak memory excludes the fidelity reference.)
+        const size_t peakKb = PeakMemoryKb();
+
+        // The last sample's final state, if it succeeded, is the one to compare.
+        real1_f fidelity = -ONE_R1_F;
+        if (measureFidelity) {
+            if (isTrialSuccessful) {
+                fidelity = WorkloadFidelity(qftReg, fn, numBits);
+            }
+            std::cout << "," << fidelity;
+        }
+        std::cout << std::endl;
+
+        RecordBenchmarkResult(engineStack, numBits, trialClocks, sampleFailureCount, logNormal, peakKb, fidelity);
     }
 }
 
@@ -287,6 +441,13 @@ void benchmarkLoop(std::function<void(QInterfacePtr, bitLenInt)> fn, bool resetR
     benchmarkLoopVariable(fn, max_qubits, resetRandomPerm, hadamardRandomBits, logNormal, qUniverse);
 }
 
+// Application workloads start from |0>, and "fn" must replay the same circuit every sample, (seeded by WORKLOAD_SEED,
+// not by the simulator's own random number generator,) so that the final state can be compared with a reference.
+void benchmarkWorkload(std::function<void(QInterfacePtr, bitLenInt)> fn)
+{
+    benchmarkLoopVariable(fn, max_qubits, false, false, false, false, true);
+}
+
 TEST_CASE("test_cnot_single", "[gates]")
 {
     benchmarkLoop([](QInterfacePtr qftReg, bitLenInt n) { qftReg->CNOT(0, 1); });
@@ -3373,6 +3534,36 @@ TEST_CASE("test_repeat_h_cnot", "[stabilizer]")
     });
 }
 
+TEST_CASE("test_disjoint_wide_units", "[gates]")
+{
+    // Four entangled registers that never interact, (so QUnit keeps each in its own unit,) with layers of random gates
+    // issued round-robin across them, where wide gates on one unit can overlap those on the others
+    benchmarkLoop([](QInterfacePtr qftReg, bitLenInt n) {
+        const bitLenInt width = n >> 2U;
+        if (width < 2U) {
+            return;
+        }
+        for (bitLenInt u = 0U; u < 4U; ++u) {
+            const bitLenInt start = u * width;
+            qftReg->H(start);
+            for (bitLenInt i = 1U; i < width; ++i) {
+                qftReg->CNOT(start + i - 1U, start + i);
+            }
+        }
+        for (int d = 0; d < benchmarkDepth; ++d) {
+            for (bitLenInt i = 0U; i < width; ++i) {
+                for (bitLenInt u = 0U; u < 4U; ++u) {
+                    const bitLenInt q = u * width + i;
+                    qftReg->U(q, 2 * M_PI * qftReg->Rand(), 2 * M_PI * qftReg->Rand(), 2 * M_PI * qftReg->Rand());
+                    if (i) {
+                        qftReg->CNOT(q - 1U, q);
+                    }
+                }
+            }
+        }
+    });
+}
+
 struct MultiQubitGate {
     int gate;
     bitLenInt b1;
@@ -4321,7 +4512,7 @@ TEST_CASE("test_noisy_fidelity_validation", "[supreme]")
     for (bitLenInt i = 0U; i < w; ++i) {
         qPowers.push_back(pow2(i));
     }
-    std::unique_ptr<unsigned long long> results(new unsigned long long[1000000U]);
+    std::unique_ptr<unsigned long long[]> results(new unsigned long long[1000000U]);
 
     auto start = std::chrono::high_resolution_clock::now();
     double sdrp = 1.0;
@@ -5387,7 +5578,7 @@ TEST_CASE("test_noisy_fidelity_nn_validation", "[supreme]")
     for (bitLenInt i = 0U; i < w; ++i) {
         qPowers.push_back(pow2(i));
     }
-    std::unique_ptr<unsigned long long> results(new unsigned long long[1000000U]);
+    std::unique_ptr<unsigned long long[]> results(new unsigned long long[1000000U]);
 
     auto start = std::chrono::high_resolution_clock::now();
     double sdrp = 1.0;
@@ -6201,7 +6392,7 @@ TEST_CASE("test_noisy_fidelity_2qb_nn_validation", "[supreme]")
     for (bitLenInt i = 0U; i < w; ++i) {
         qPowers.push_back(pow2(i));
     }
-    std::unique_ptr<unsigned long long> results(new unsigned long long[1000000U]);
+    std::unique_ptr<unsigned long long[]> results(new unsigned long long[1000000U]);
 
     auto start = std::chrono::high_resolution_clock::now();
     double sdrp = 1.0;
@@ -7233,7 +7424,7 @@ TEST_CASE("test_noisy_sycamore_validation", "[supreme]")
     for (bitLenInt i = 0U; i < w; ++i) {
         qPowers.push_back(pow2(i));
     }
-    std::unique_ptr<unsigned long long> results(new unsigned long long[1000000U]);
+    std::unique_ptr<unsigned long long[]> results(new unsigned long long[1000000U]);
 
     std::vector<std::vector<int>> gate1QbRands(n);
     std::vector<std::vector<MultiQubitGate>> gateMultiQbRands(n);
@@ -7484,3 +7675,251 @@ TEST_CASE("test_noisy_sycamore_validation", "[supreme]")
         sdrp -= 0.025;
     }
 }
+
+// Random single qubit gate, drawn from "gen," for the "[workload]" suite
+void WorkloadU(QInterfacePtr qReg, bitLenInt q, std::mt19937& gen)
+{
+    std::uniform_real_distribution<real1_f> angle(ZERO_R1_F, 2 * PI_R1);
+    const real1_f theta = angle(gen);
+    const real1_f phi = angle(gen);
+    const real1_f lambda = angle(gen);
+
+    qReg->U(q, theta, phi, lambda);
+}
+
+std::vector<bitCapInt> WorkloadQubitPowers(bitLenInt n)
+{
+    std::vector<bitCapInt> qPowers(n);
+    for (bitLenInt i = 0U; i < n; ++i) {
+        qPowers[i] = pow2(i);
+    }
+
+    return qPowers;
+}
+
+TEST_CASE("test_workload_qaoa_maxcut", "[workload]")
+{
+    // Two QAOA layers for MaxCut on a ring with seeded random chords, then sampling of candidate cuts
+    benchmarkWorkload([](QInterfacePtr qReg, bitLenInt n) {
+        std::mt19937 gen(WORKLOAD_SEED);
+        std::uniform_int_distribution<int> qubit(0, n - 1);
+        std::vector<std::pair<bitLenInt, bitLenInt>> edges;
+        for (bitLenInt i = 0U; i < n; ++i) {
+            edges.push_back(std::make_pair(i, (bitLenInt)((i + 1U) % n)));
+        }
+        for (bitLenInt i = 0U; i < (n >> 1U); ++i) {
+            const bitLenInt a = (bitLenInt)qubit(gen);
+            const bitLenInt b = (bitLenInt)qubit(gen);
+            if (a != b) {
+                edges.push_back(std::make_pair(a, b));
+            }
+        }
+
+        const real1_f gammas[2U]{ (real1_f)0.4f, (real1_f)0.8f };
+        const real1_f betas[2U]{ (real1_f)0.7f, (real1_f)0.35f };
+
+        qReg->H(0, n);
+        for (size_t p = 0U; p < 2U; ++p) {
+            for (size_t e = 0U; e < edges.size(); ++e) {
+                qReg->CNOT(edges[e].first, edges[e].second);
+                qReg->RZ(2 * gammas[p], edges[e].second);
+                qReg->CNOT(edges[e].first, edges[e].second);
+            }
+            for (bitLenInt i = 0U; i < n; ++i) {
+                qReg->RX(2 * betas[p], i);
+            }
+        }
+
+        qReg->MultiShotMeasureMask(WorkloadQubitPowers(n), WORKLOAD_SHOTS);
+    });
+}
+
+TEST_CASE("test_workload_quantum_volume", "[workload]")
+{
+    // Square quantum volume circuit: each of "n" layers pairs up a seeded random permutation of the qubits, and applies
+    // a random two qubit unitary, (in KAK form, as three CNOTs between random single qubit gates,) to each pair.
+    benchmarkWorkload([](QInterfacePtr qReg, bitLenInt n) {
+        std::mt19937 gen(WORKLOAD_SEED);
+        std::vector<bitLenInt> perm(n);
+        for (bitLenInt d = 0U; d < n; ++d) {
+            std::iota(perm.begin(), perm.end(), 0U);
+            std::shuffle(perm.begin(), perm.end(), gen);
+            for (bitLenInt i = 1U; i < n; i += 2U) {
+                const bitLenInt a = perm[i - 1U];
+                const bitLenInt b = perm[i];
+                WorkloadU(qReg, a, gen);
+                WorkloadU(qReg, b, gen);
+                qReg->CNOT(a, b);
+                WorkloadU(qReg, a, gen);
+                WorkloadU(qReg, b, gen);
+                qReg->CNOT(b, a);
+                WorkloadU(qReg, a, gen);
+                WorkloadU(qReg, b, gen);
+                qReg->CNOT(a, b);
+                WorkloadU(qReg, a, gen);
+                WorkloadU(qReg, b, gen);
+            }
+        }
+    });
+}
+
+#if ENABLE_ALU
+TEST_CASE("test_workload_shor_modexp", "[workload]")
+{
+    // The period finding subroutine of examples/shors_factoring.cpp, for the largest modulus 2^(n/2)-1 that fits, with
+    // a seeded random base that is relatively prime to it
+    benchmarkWorkload([](QInterfacePtr qReg, bitLenInt n) {
+        const bitLenInt qubitCount = n >> 1U;
+        const bitCapIntOcl toFactor = pow2Ocl(qubitCount) - 1U;
+
+        std::mt19937 gen(WORKLOAD_SEED);
+        bitCapIntOcl base, a, b;
+        do {
+            base = 2U + (gen() % (toFactor - 2U));
+            a = toFactor;
+            b = base;
+            while (b) {
+                const bitCapIntOcl t = a % b;
+                a = b;
+                b = t;
+            }
+        } while (a != 1U);
+
+        qReg->H(0, qubitCount);
+        QALU(qReg)->POWModNOut(base, toFactor, 0, qubitCount, qubitCount);
+        qReg->IQFT(0, qubitCount);
+    });
+}
+#endif
+
+TEST_CASE("test_workload_grover_lookup", "[workload]")
+{
+    // Grover search of a seeded random table of 2^n bytes for its one entry equal to 255, with the fused lookup oracle,
+    // (for the optimal number of iterations, up to --benchmark-depth)
+    benchmarkWorkload([](QInterfacePtr qReg, bitLenInt n) {
+        const bitCapIntOcl tableSize = pow2Ocl(n);
+        const unsigned char target = 255U;
+        std::unique_ptr<unsigned char[]> table(new unsigned char[tableSize]);
+        std::mt19937 gen(WORKLOAD_SEED);
+        for (bitCapIntOcl i = 0U; i < tableSize; ++i) {
+            table[i] = (unsigned char)(gen() % target);
+        }
+        table[gen() % tableSize] = target;
+
+        const int optIter = M_PI / (4.0 * asin(1.0 / sqrt((double)tableSize)));
+        const int iterations = std::min(optIter, benchmarkDepth);
+
+        qReg->H(0, n);
+        for (int i = 0; i < iterations; ++i) {
+            qReg->GroverLookupIteration(0, n, 8U, table.get(), target);
+        }
+    });
+}
+
+TEST_CASE("test_workload_trotter_ising", "[workload]")
+{
+    // Transverse field Ising ring, H = -J sum Z_i Z_(i+1) - h sum X_i, Trotterized (second order) by TimeEvolve() over
+    // --benchmark-depth time steps
+    benchmarkWorkload([](QInterfacePtr qReg, bitLenInt n) {
+        const real1 J = ONE_R1;
+        const real1 hx = (real1)0.75f;
+        const real1_f dt = (real1_f)0.1f;
+
+        BitOp xField(new complex[4U], std::default_delete<complex[]>());
+        xField.get()[0U] = ZERO_CMPLX;
+        xField.get()[1U] = complex(-hx, ZERO_R1);
+        xField.get()[2U] = complex(-hx, ZERO_R1);
+        xField.get()[3U] = ZERO_CMPLX;
+
+        // Z_i Z_j is Z_j controlled on |0> of qubit i, and -Z_j controlled on |1>.
+        BitOp zzCtrl(new complex[4U], std::default_delete<complex[]>());
+        zzCtrl.get()[0U] = complex(J, ZERO_R1);
+        zzCtrl.get()[1U] = ZERO_CMPLX;
+        zzCtrl.get()[2U] = ZERO_CMPLX;
+        zzCtrl.get()[3U] = complex(-J, ZERO_R1);
+        BitOp zzAnti(new complex[4U], std::default_delete<complex[]>());
+        zzAnti.get()[0U] = complex(-J, ZERO_R1);
+        zzAnti.get()[1U] = ZERO_CMPLX;
+        zzAnti.get()[2U] = ZERO_CMPLX;
+        zzAnti.get()[3U] = complex(J, ZERO_R1);
+
+        Hamiltonian h;
+        for (bitLenInt i = 0U; i < n; ++i) {
+            const std::vector<bitLenInt> ctrl{ i };
+            const bitLenInt j = (i + 1U) % n;
+            h.push_back(std::make_shared<HamiltonianOp>(ctrl, j, zzCtrl));
+            h.push_back(std::make_shared<HamiltonianOp>(ctrl, j, zzAnti, true));
+            h.push_back(std::make_shared<HamiltonianOp>(i, xField));
+        }
+
+        qReg->TimeEvolve(CompiledHamiltonian(h, dt, TROTTER_SECOND_ORDER), (unsigned)benchmarkDepth);
+    });
+}
+
+TEST_CASE("test_workload_surface_code_sampling", "[workload]")
+{
+    // Encode the qubits, as a grid, into the joint +1 eigenstate of X-type stabilizers on a checkerboard of 2x2
+    // plaquettes, inject seeded random Pauli errors, at a rate of about 1/n per qubit, and sample the result.
+    benchmarkWorkload([](QInterfacePtr qReg, bitLenInt n) {
+        const bitLenInt rows = (bitLenInt)std::sqrt((real1_f)n);
+        const bitLenInt cols = n / rows;
+
+        // Working from the last plaquette to the first, each pivot is still |0> when it's prepared.
+        for (int r = rows - 2; r >= 0; --r) {
+            for (int c = cols - 2; c >= 0; --c) {
+                if ((r + c) & 1) {
+                    continue;
+                }
+                const bitLenInt pivot = r * cols + c;
+                qReg->H(pivot);
+                qReg->CNOT(pivot, pivot + 1U);
+                qReg->CNOT(pivot, pivot + cols);
+                qReg->CNOT(pivot, pivot + cols + 1U);
+            }
+        }
+
+        std::mt19937 gen(WORKLOAD_SEED);
+        for (bitLenInt i = 0U; i < n; ++i) {
+            if (gen() % n) {
+                continue;
+            }
+            if (gen() & 1U) {
+                qReg->X(i);
+            } else {
+                qReg->Z(i);
+            }
+        }
+
+        qReg->MultiShotMeasureMask(WorkloadQubitPowers(n), WORKLOAD_SHOTS);
+    });
+}
+
+TEST_CASE("test_workload_qneuron_training", "[workload]")
+{
+    // Train one QNeuron, with every other qubit as input, on seeded random examples of input parity, then predict one.
+    benchmarkWorkload([](QInterfacePtr qReg, bitLenInt n) {
+        const bitLenInt inputCount = n - 1U;
+        const bitCapIntOcl inputMask = pow2Ocl(inputCount) - 1U;
+        const real1_f eta = (real1_f)0.5f;
+
+        std::vector<bitLenInt> inputIndices(inputCount);
+        std::iota(inputIndices.begin(), inputIndices.end(), 0U);
+        QNeuron neuron(qReg, inputIndices, inputCount);
+
+        std::mt19937 gen(WORKLOAD_SEED);
+        for (int i = 0; i < benchmarkDepth; ++i) {
+            const bitCapIntOcl perm = gen() & inputMask;
+            bitCapIntOcl v = perm;
+            bool parity = false;
+            while (v) {
+                parity = !parity;
+                v &= v - 1U;
+            }
+            qReg->SetPermutation(perm);
+            neuron.LearnPermutation(parity, eta);
+        }
+
+        qReg->SetPermutation(gen() & inputMask);
+        neuron.Predict();
+    });
+}
@@ -16,6 +16,7 @@
 #include "tests.hpp"
 
 #include <iostream>
+#include <map>
 #include <random>
 #include <regex>
 #include <sstream>
@@ -47,12 +48,126 @@ int timeout = -1;
 std::vector<int64_t> devList;
 bool optimal = false;
 bool optimal_single = false;
+std::vector<BenchmarkResult> benchmarkResults;
+std::string resultsFileName;
+std::string baselineFileName;
+double regressionThreshold = 10.0;
 
 #define SHOW_OCL_BANNER()                                                                                              \
     if (OCLEngine::Instance().GetDeviceCount()) {                                                                      \
         CreateQuantumInterface(QINTERFACE_OPENCL, 1, 0).reset();                                                       \
     }
 
+// Sample times are measured in whole microseconds.
+#define BENCHMARK_CLOCK_RESOLUTION_MS 0.001
+
+bool IsCsvFileName(const std::string& fileName)
+{
+    return (fileName.size() >= 4U) && !fileName.compare(fileName.size() - 4U, 4U, ".csv");
+}
+
+void WriteBenchmarkResults(const std::string& fileName)
+{
+    std::ofstream out(fileName);
+    out << std::setprecision(9);
+    if (IsCsvFileName(fileName)) {
+        out << "test,stack,qubits,samples,failures,mean_ms,median_ms,p99_ms,peak_kb,amp_updates_per_sec,fidelity"
+            << std::endl;
+        for (const BenchmarkResult& r : benchmarkResults) {
+            out << r.test << "," << r.stack << "," << (int)r.qubits << "," << r.samples << "," << r.failures << ","
+                << r.meanMs << "," << r.medianMs << "," << r.p99Ms << "," << r.peakKb << "," << r.ampUpdatesPerSec
+                << "," << r.fidelity << std::endl;
+        }
+    } else {
+        // One result object per line, which LoadBenchmarkBaseline() relies on.
+        out << "{\"benchmarks\":[" << std::endl;
+        for (size_t i = 0U; i < benchmarkResults.size(); ++i) {
+            const BenchmarkResult& r = benchmarkResults[i];
+            out << "{\"test\":\"" << r.test << "\",\"stack\":\"" << r.stack << "\",\"qubits\":" << (int)r.qubits
+                << ",\"samples\":" << r.samples << ",\"failures\":" << r.failures << ",\"mean_ms\":" << r.meanMs
+                << ",\"median_ms\":" << r.medianMs << ",\"p99_ms\":" << r.p99Ms << ",\"peak_kb\":" << r.peakKb
+                << ",\"amp_updates_per_sec\":" << r.ampUpdatesPerSec << ",\"fidelity\":" << r.fidelity << "}"
+                << (((i + 1U) < benchmarkResults.size()) ? "," : "") << std::endl;
+        }
+        out << "]}" << std::endl;
+    }
+
+    if (!out) {
+        std::cout << "Could not write benchmark results to " << fileName << "!" << std::endl;
+    }
+}
+
+// Median times, keyed by "test|stack|qubits," from a --results-output file
+std::map<std::string, double> LoadBenchmarkBaseline(const std::string& fileName)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream in(fileName);
+    if (!in) {
+        throw std::invalid_argument("Could not read benchmark baseline file " + fileName + "!");
+    }
+
+    const bool isCsv = IsCsvFileName(fileName);
+    const std::regex re("\"test\":\"([^\"]*)\",\"stack\":\"([^\"]*)\",\"qubits\":([0-9]+).*\"median_ms\":([^,}]+)");
+    std::string line;
+    if (isCsv) {
+        std::getline(in, line);
+    }
+    while (std::getline(in, line)) {
+        std::vector<std::string> fields;
+        if (isCsv) {
+            std::stringstream lineStream(line);
+            std::string field;
+            while (std::getline(lineStream, field, ',')) {
+                fields.push_back(field);
+            }
+            if (fields.size() < 7U) {
+                continue;
+            }
+            fields = { fields[0U], fields[1U], fields[2U], fields[6U] };
+        } else {
+            std::smatch match;
+            if (!std::regex_search(line, match, re)) {
+                continue;
+            }
+            fields = { match[1U], match[2U], match[3U], match[4U] };
+        }
+        baseline[fields[0U] + "|" + fields[1U] + "|" + fields[2U]] = std::stod(fields[3U]);
+    }
+
+    return baseline;
+}
+
+// Write results and compare against the baseline, reporting every regression, and return the final exit code.
+int FinishBenchmarks(int num_failed)
+{
+    if (resultsFileName.compare("")) {
+        WriteBenchmarkResults(resultsFileName);
+    }
+
+    if (!baselineFileName.compare("")) {
+        return num_failed;
+    }
+
+    const std::map<std::string, double> baseline = LoadBenchmarkBaseline(baselineFileName);
+    int regressions = 0;
+    for (const BenchmarkResult& r : benchmarkResults) {
+        const auto it = baseline.find(r.test + "|" + r.stack + "|" + std::to_string((int)r.qubits));
+        if (it == baseline.end()) {
+            continue;
+        }
+        const double limit = it->second * (1.0 + regressionThreshold / 100.0);
+        if ((r.medianMs > limit) && ((r.medianMs - it->second) > BENCHMARK_CLOCK_RESOLUTION_MS)) {
+            std::cout << "REGRESSION: '" << r.test << "' (" << r.stack << ", " << (int)r.qubits
+                      << " qubits) median " << r.medianMs << " ms vs. baseline " << it->second << " ms" << std::endl;
+            ++regressions;
+        }
+    }
+    std::cout << regressions << " regression(s) beyond " << regressionThreshold << "% of baseline " << baselineFileName
+              << std::endl;
+
+    return num_failed ? num_failed : regressions;
+}
+
 int main(int argc, char* argv[])
 {
     Catch::Session session;
@@ -139,7 +254,14 @@ int main(int argc, char* argv[])
         Opt(timeout, "timeout")["--timeout"](
             "Timeout in milliseconds per sample for test_stabilizer_t_nn and test_stabilizer_t_nn_d (default: none)") |
         Opt(devListStr, "devices")["--devices"](
-            "list of devices, for QPager (default is solely default OpenCL device)");
+            "list of devices, for QPager (default is solely default OpenCL device)") |
+        Opt(resultsFileName, "results-output")["--results-output"](
+            "Specifies a file name for machine-readable timing results per test, engine stack, and qubit count, as "
+            "CSV if the name ends in \".csv\", or JSON otherwise") |
+        Opt(baselineFileName, "baseline")["--baseline"](
+            "A --results-output file to compare median times against, failing the run on regressions") |
+        Opt(regressionThreshold, "percent")["--regression-threshold"](
+            "Percent slowdown of median time from --baseline counted as a regression (default: 10)");
 
     session.cli(cli);
 
@@ -278,13 +400,13 @@ int main(int argc, char* argv[])
     if (num_failed == 0 && optimal) {
         session.config().stream() << "############ Default Optimal (QUnitMulti/QUnit) ############" << std::endl;
         num_failed = session.run();
-        return num_failed;
+        return FinishBenchmarks(num_failed);
     }
 
     if (num_failed == 0 && optimal_single) {
         session.config().stream() << "############ Default Optimal (QUnit) ############" << std::endl;
         num_failed = session.run();
-        return num_failed;
+        return FinishBenchmarks(num_failed);
     }
 
     if (num_failed == 0 && optimal_cpu) {
@@ -293,7 +415,7 @@ int main(int argc, char* argv[])
         testSubEngineType = QINTERFACE_STABILIZER_HYBRID;
         testSubSubEngineType = QINTERFACE_CPU;
         num_failed = session.run();
-        return num_failed;
+        return FinishBenchmarks(num_failed);
     }
 
     if (num_failed == 0 && qengine) {
@@ -519,7 +641,7 @@ int main(int argc, char* argv[])
         mOutputFile.close();
     }
 
-    return num_failed;
+    return FinishBenchmarks(num_failed);
 }
 
 QInterfaceTestFixture::QInterfaceTestFixture()
@@ -63,9 +63,11 @@ int main(int argc, char* argv[])
     bool opencl = false;
     bool hybrid = false;
     bool bdt = false;
+    bool mps = false;
     bool stabilizer = false;
     bool stabilizer_qpager = false;
     bool stabilizer_bdt = false;
+    bool stabilizer_ocl = false;
 
     std::string devListStr;
 
@@ -88,7 +90,10 @@ int main(int argc, char* argv[])
         Opt(opencl)["--proc-opencl"]("Single (parallel) processor OpenCL tests") |
         Opt(hybrid)["--proc-hybrid"]("Enable CPU/OpenCL hybrid implementation tests") |
         Opt(bdt)["--proc-bdt"]("Enable binary decision tree implementation tests") |
+        Opt(mps)["--proc-mps"]("Enable matrix product state implementation tests") |
         Opt(stabilizer)["--proc-stabilizer"]("Enable (hybrid) stabilizer implementation tests") |
+        Opt(stabilizer_ocl)["--proc-stabilizer-ocl"](
+            "Enable OpenCL device-resident stabilizer tableau (QStabilizerOCL) tests") |
         Opt(async_time)["--async-time"]("Time based on asynchronous return") |
         Opt(enable_normalization)["--enable-normalization"](
             "Enable state vector normalization. (Usually not "
@@ -146,12 +151,15 @@ int main(int argc, char* argv[])
         // qunit_multi_qpager = true;
     }
 
-    if (!cpu && !opencl && !hybrid && !bdt && !stabilizer && !stabilizer_qpager && !stabilizer_bdt) {
+    if (!cpu && !opencl && !hybrid && !bdt && !mps && !stabilizer && !stabilizer_qpager && !stabilizer_bdt &&
+        !stabilizer_ocl) {
         cpu = true;
         opencl = true;
         hybrid = true;
         stabilizer = true;
+        stabilizer_ocl = true;
         // bdt = true;
+        // mps = true;
         // stabilizer_qpager = true;
         // stabilizer_bdt = true;
     }
@@ -206,6 +214,13 @@ int main(int argc, char* argv[])
             num_failed = session.run();
         }
 
+        if (num_failed == 0 && mps) {
+            testEngineType = QINTERFACE_MPS;
+            testSubEngineType = QINTERFACE_CPU;
+            session.config().stream() << "############ QMps -> QEngine -> CPU ############" << std::endl;
+            num_failed = session.run();
+        }
+
 #if ENABLE_OPENCL
         if (num_failed == 0 && opencl) {
             session.config().stream() << "############ QEngine -> OpenCL ############" << std::endl;
@@ -220,6 +235,43 @@ int main(int argc, char* argv[])
             testSubEngineType = QINTERFACE_HYBRID;
             num_failed = session.run();
         }
+
+        if (num_failed == 0 && stabilizer_ocl) {
+            // Only the "[stabilizer]" cases build a bare tableau; the rest of the suite needs non-Clifford gates.
+            session.config().stream() << "############ QStabilizerOCL ############" << std::endl;
+            testEngineType = QINTERFACE_STABILIZER;
+            testSubEngineType = QINTERFACE_STABILIZER;
+            const int defaultDeviceId = device_id;
+            if (device_id < 0) {
+                device_id = (int)OCLEngine::Instance().GetDefaultDeviceID();
+            }
+            const Catch::ConfigData configData = session.configData();
+            Catch::ConfigData stabilizerConfigData = configData;
+            // Catch ANDs the patterns within a filter and ORs the comma-separated filters, so the tag has to be
+            // added to every filter the user supplied, (or else it would only narrow the last of them).
+            if (stabilizerConfigData.testsOrTags.empty()) {
+                stabilizerConfigData.testsOrTags.push_back("[stabilizer]");
+            } else {
+                for (std::string& spec : stabilizerConfigData.testsOrTags) {
+                    std::string tagged = "[stabilizer] ";
+                    for (size_t i = 0U; i < spec.size(); ++i) {
+                        tagged += spec[i];
+                        if (spec[i] == '\\') {
+                            if ((i + 1U) < spec.size()) {
+                                tagged += spec[++i];
+                            }
+                        } else if (spec[i] == ',') {
+                            tagged += "[stabilizer] ";
+                        }
+                    }
+                    spec = tagged;
+                }
+            }
+            session.useConfigData(stabilizerConfigData);
+            num_failed = session.run();
+            session.useConfigData(configData);
+            device_id = defaultDeviceId;
+        }
 #else
         if (num_failed == 0 && stabilizer) {
             session.config().stream() << "############ QStabilizerHybrid -> QEngineCPU ############" << std::endl;
@@ -266,6 +318,13 @@ int main(int argc, char* argv[])
             num_failed = session.run();
         }
 
+        if (num_failed == 0 && mps) {
+            session.config().stream() << "############ QUnit -> QMps -> QEngine -> CPU ############" << std::endl;
+            testSubEngineType = QINTERFACE_MPS;
+            testSubSubEngineType = QINTERFACE_CPU;
+            num_failed = session.run();
+        }
+
 #if ENABLE_OPENCL
         if (num_failed == 0 && opencl) {
             session.config().stream() << "############ QUnit -> QEngine -> OpenCL ############" << std::endl;
@@ -12,17 +12,52 @@
 
 #include "qfactory.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <iostream>
 #include <list>
+#include <numeric>
+#include <random>
+#include <sstream>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "catch.hpp"
+#include "pinvoke_api.hpp"
+#include "qbatch.hpp"
+#if ENABLE_OPENCL
+#include "qbatch_opencl.hpp"
+#endif
+#if ENABLE_QBDT
+#include "qbdt.hpp"
+#include "qbdt_node.hpp"
+#include "qcircuit.hpp"
+#endif
+#include "qdynamiccircuit.hpp"
 #include "qneuron.hpp"
+#include "qnoise.hpp"
+#include "qprefixcache.hpp"
+#include "qstabilizer.hpp"
+#include "qstabilizer_frames.hpp"
+#include "qstabilizer_rank.hpp"
+#include "qtape.hpp"
 
 #include "tests.hpp"
 
+#include "common/big_integer.hpp"
+#include "common/counter_rng.hpp"
+#include "common/engine_profile.hpp"
+#include "common/memory_governor.hpp"
+#include "common/simd_dispatch.hpp"
+
+#if ENABLE_PTHREAD
+#include "common/parallel_pool.hpp"
+
+#include <chrono>
+#include <future>
+#include <thread>
+#endif
+
 using namespace Qrack;
 
 #define EPSILON 0.01f
@@ -150,6 +185,45 @@ TEST_CASE("test_push_apart_bits")
     REQUIRE(pushApartBits(perm, skipPowers) == 0x23U);
 }
 
+TEST_CASE("test_big_integer")
+{
+    typedef BigInteger<4U> bi256;
+
+    // Shifts and masks across word boundaries
+    bi256 a = (bi256)1U << 200U;
+    REQUIRE(a.bits[3U] == (1ULL << 8U));
+    REQUIRE(bi_ctz(a) == 200U);
+    REQUIRE(bi_log2(a) == 200U);
+    REQUIRE((a >> 137U) == ((bi256)1U << 63U));
+    REQUIRE(bi_popcount(a - 1U) == 200U);
+    REQUIRE(((a - 1U) & ~((bi256)0xFFU << 64U)) == ((a - 1U) ^ ((bi256)0xFFU << 64U)));
+    REQUIRE(!(a & (a - 1U)));
+
+    // Wrap-around matches built-in unsigned arithmetic
+    REQUIRE(((bi256)0U - 1U) == ~(bi256)0U);
+    REQUIRE((~(bi256)0U + 1U) == 0U);
+    REQUIRE((bi256)(-1) == ~(bi256)0U);
+
+    // Multiplication, division, and remainder, (single- and multi-word divisors)
+    const bi256 b = ((bi256)0x123456789ABCDEFULL << 130U) + 987654321U;
+    const bi256 c = ((bi256)0xFEDCBAULL << 70U) + 12345U;
+    REQUIRE((((b * 7U) + 5U) / 7U) == b);
+    REQUIRE((((b * 7U) + 5U) % 7U) == 5U);
+    REQUIRE((((b / c) * c) + (b % c)) == b);
+    REQUIRE((b % c) < c);
+
+    // Conversions and decimal round trip
+    REQUIRE((uint64_t)((bi256)0xDEADBEEFULL << 128U >> 128U) == 0xDEADBEEFULL);
+    REQUIRE((double)a == std::ldexp(1.0, 200));
+    REQUIRE((bi256)std::ldexp(3.0, 150) == ((bi256)3U << 150U));
+    std::stringstream ss;
+    ss << ((bi256)1U << 128U);
+    REQUIRE(ss.str() == "340282366920938463463374607431768211456");
+    bi256 d;
+    ss >> d;
+    REQUIRE(d == ((bi256)1U << 128U));
+}
+
 #if UINTPOW > 3
 TEST_CASE("test_qengine_cpu_par_for")
 {
@@ -249,63 +323,2985 @@ TEST_CASE("test_qengine_cpu_par_for_mask")
     const std::vector<bitCapIntOcl> skipArray{ 0x4, 0x100 }; // Skip bits 0b100000100
     int NUM_SKIP = skipArray.size();
 
-    calls.store(0);
+    calls.store(0);
+
+    for (int i = 0; i < NUM_ENTRIES; i++) {
+        hit[i].store(false);
+    }
+
+    qengine->SetConcurrencyLevel(1);
+
+    qengine->par_for_mask(0, NUM_ENTRIES, skipArray, [&](const bitCapInt lcv, const int cpu) {
+        bool old = true;
+        old = hit[(bitCapIntOcl)lcv].exchange(old);
+        REQUIRE(old == false);
+        for (int i = 0; i < NUM_SKIP; i++) {
+            REQUIRE((lcv & skipArray[i]) == 0);
+        }
+        calls++;
+    });
+}
+
+TEST_CASE("test_qengine_cpu_par_for_range")
+{
+    QEngineCPUPtr qengine = std::make_shared<QEngineCPU>(1, 0);
+
+    const int NUM_ENTRIES = 5000;
+    std::atomic_bool hit[NUM_ENTRIES];
+
+    for (int i = 0; i < NUM_ENTRIES; i++) {
+        hit[i].store(false);
+    }
+
+    qengine->par_for_range(
+        0, NUM_ENTRIES, [&](const bitCapIntOcl& begin, const bitCapIntOcl& end, const unsigned& cpu) {
+            REQUIRE(begin < end);
+            for (bitCapIntOcl lcv = begin; lcv < end; ++lcv) {
+                bool old = true;
+                old = hit[lcv].exchange(old);
+                REQUIRE(old == false);
+            }
+        });
+
+    for (int i = 0; i < NUM_ENTRIES; i++) {
+        REQUIRE(hit[i].load() == true);
+    }
+}
+
+TEST_CASE("test_qengine_cpu_numa_first_touch")
+{
+    REQUIRE(ParallelPool::Instance().GetNumaNodeCount() >= 1U);
+
+    // First-touch zeroing covers a ragged last stride, across several pool slots.
+    QEngineCPUPtr qengine = std::make_shared<QEngineCPU>(1U, 0U);
+    qengine->SetConcurrency(4U);
+    const bitCapIntOcl itemCount = 3U * qengine->GetStride() + 5U;
+    std::unique_ptr<complex[]> amps(new complex[itemCount]);
+    std::fill(amps.get(), amps.get() + itemCount, ONE_CMPLX);
+    qengine->par_zero(amps.get(), itemCount);
+    for (bitCapIntOcl i = 0U; i < itemCount; ++i) {
+        REQUIRE(amps[i] == ZERO_CMPLX);
+    }
+
+    // State vectors bound to a node, (or spread over the node bands,) simulate the same.
+    QEngineCPUPtr reference = std::make_shared<QEngineCPU>(4U, 5U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    reference->H(0U);
+    reference->CNOT(0U, 1U);
+    reference->Allocate(4U, 6U);
+    reference->H(9U);
+    for (const int node : { 0, -1 }) {
+        QEngineCPUPtr numaEngine = std::make_shared<QEngineCPU>(4U, 5U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+        numaEngine->SetNumaNode(node);
+        numaEngine->H(0U);
+        numaEngine->CNOT(0U, 1U);
+        numaEngine->Allocate(4U, 6U);
+        numaEngine->H(9U);
+        REQUIRE(numaEngine->SumSqrDiff(reference) < 1e-6f);
+    }
+}
+#endif
+
+#if UINTPOW > 3
+TEST_CASE("test_state_vector_sparse")
+{
+    const bitCapIntOcl cap = 1U << 12U;
+    StateVectorSparse sv(cap);
+
+    // Concurrent inserts, then erase every other amplitude
+    sv.par_for(0, cap, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        sv.write(lcv, ((lcv % 3U) == 0U) ? complex((real1)(lcv + 1U), ZERO_R1) : ZERO_CMPLX);
+    });
+    sv.par_for(0, cap, [&](const bitCapIntOcl& lcv, const unsigned& cpu) {
+        if (lcv & 1U) {
+            sv.write(lcv, ZERO_CMPLX);
+        }
+    });
+
+    std::vector<bitCapIntOcl> keys = sv.iterable();
+    std::sort(keys.begin(), keys.end());
+    std::vector<bitCapIntOcl> expected;
+    for (bitCapIntOcl i = 0U; i < cap; ++i) {
+        if (((i % 3U) == 0U) && !(i & 1U)) {
+            expected.push_back(i);
+        }
+        REQUIRE(sv.read(i) == ((((i % 3U) == 0U) && !(i & 1U)) ? complex((real1)(i + 1U), ZERO_R1) : ZERO_CMPLX));
+    }
+    REQUIRE(keys == expected);
+    REQUIRE(sv.is_sparse());
+
+    // Filtered iteration keeps matching indices, with the set and filter bits masked off.
+    std::set<bitCapIntOcl> expectedFiltered;
+    for (const bitCapIntOcl& k : expected) {
+        if (!(k & 2U)) {
+            expectedFiltered.insert(k & ~4U);
+        }
+    }
+    REQUIRE(sv.iterable(4U, 2U, 0U) == expectedFiltered);
+
+    sv.clear();
+    REQUIRE(sv.iterable().empty());
+}
+#endif
+
+TEST_CASE("test_state_vector_half")
+{
+    const bitLenInt qb = 8U;
+    const bitCapIntOcl cap = 1U << qb;
+    const real1_f tol[2U] = { 1e-3f, 1e-2f };
+
+    for (int bf16 = 0; bf16 < 2; ++bf16) {
+        // Round trip within the format's precision, (including values below the fp16 normal range, before scaling).
+        StateVectorHalf sv(cap, bf16 != 0);
+        for (bitCapIntOcl i = 0U; i < cap; ++i) {
+            sv.write(i, complex((real1)(std::pow(2.0, -(real1_f)(i % 24U))), -(real1)(i + 1U) / cap));
+        }
+        for (bitCapIntOcl i = 0U; i < cap; ++i) {
+            const complex amp((real1)(std::pow(2.0, -(real1_f)(i % 24U))), -(real1)(i + 1U) / cap);
+            REQUIRE(abs(sv.read(i) - amp) <= (real1)(tol[bf16] * abs(amp)));
+        }
+        REQUIRE(!sv.is_sparse());
+
+        // A mixed precision engine tracks a native one.
+        QEngineCPUPtr native = std::make_shared<QEngineCPU>(qb, 0U, nullptr, CMPLX_DEFAULT_ARG, true, false);
+        QEngineCPUPtr half = std::make_shared<QEngineCPU>(qb, 0U, nullptr, CMPLX_DEFAULT_ARG, true, false);
+        half->SetStateVecStorage(bf16 ? STATE_VEC_BF16 : STATE_VEC_FP16);
+        REQUIRE(half->GetStateVecStorage() == (bf16 ? STATE_VEC_BF16 : STATE_VEC_FP16));
+        for (bitLenInt i = 0U; i < qb; ++i) {
+            native->H(i);
+            half->H(i);
+            native->RZ(0.3f * (i + 1U), i);
+            half->RZ(0.3f * (i + 1U), i);
+        }
+        for (bitLenInt i = 1U; i < qb; ++i) {
+            native->CNOT(i - 1U, i);
+            half->CNOT(i - 1U, i);
+            native->RY(0.7f, i);
+            half->RY(0.7f, i);
+        }
+        REQUIRE(native->SumSqrDiff(std::dynamic_pointer_cast<QInterface>(half->Clone())) < (10 * tol[bf16]));
+        REQUIRE(half->ProbAll(0U) == Approx(native->ProbAll(0U)).margin(tol[bf16]));
+
+        half->SetStateVecStorage(STATE_VEC_NATIVE);
+        REQUIRE(native->SumSqrDiff(std::dynamic_pointer_cast<QInterface>(half)) < (10 * tol[bf16]));
+    }
+}
+
+TEST_CASE("test_state_vector_blocked")
+{
+    // Exact round trips, (including a state vector shorter than one block,) and bulk conversion at the boundary
+    for (bitLenInt qb = 2U; qb < 7U; qb += 4U) {
+        const bitCapIntOcl cap = 1U << qb;
+        StateVectorBlocked sv(cap);
+        std::vector<complex> amps(cap);
+        for (bitCapIntOcl i = 0U; i < cap; ++i) {
+            amps[i] = complex((real1)(i + 1U), -(real1)(2U * i + 1U));
+            sv.write(i, amps[i]);
+        }
+        std::vector<complex> out(cap);
+        sv.copy_out(&(out[0U]));
+        for (bitCapIntOcl i = 0U; i < cap; ++i) {
+            REQUIRE(sv.read(i) == amps[i]);
+            REQUIRE(out[i] == amps[i]);
+        }
+        REQUIRE(!sv.is_sparse());
+    }
+
+    // A blocked engine tracks a native one, through the compiled kernels, (for high targets,) and the generic path.
+    const bitLenInt qb = 8U;
+    QEngineCPUPtr native = std::make_shared<QEngineCPU>(qb, 0U, nullptr, CMPLX_DEFAULT_ARG, true, false);
+    QEngineCPUPtr blocked = std::make_shared<QEngineCPU>(qb, 0U, nullptr, CMPLX_DEFAULT_ARG, true, false);
+    blocked->SetStateVecStorage(STATE_VEC_BLOCKED);
+    REQUIRE(blocked->GetStateVecStorage() == STATE_VEC_BLOCKED);
+    for (bitLenInt i = 0U; i < qb; ++i) {
+        native->H(i);
+        blocked->H(i);
+        native->RZ(0.3f * (i + 1U), i);
+        blocked->RZ(0.3f * (i + 1U), i);
+    }
+    for (bitLenInt i = 1U; i < qb; ++i) {
+        native->CNOT(i - 1U, i);
+        blocked->CNOT(i - 1U, i);
+        native->RY(0.7f, i);
+        blocked->RY(0.7f, i);
+        native->CCY(0U, 7U, (i >> 1U) + 1U);
+        blocked->CCY(0U, 7U, (i >> 1U) + 1U);
+    }
+    REQUIRE(native->SumSqrDiff(std::dynamic_pointer_cast<QInterface>(blocked->Clone())) < 1e-5f);
+    REQUIRE(blocked->ProbAll(0U) == Approx(native->ProbAll(0U)));
+
+    std::vector<complex> nativeAmps(1U << qb);
+    std::vector<complex> blockedAmps(1U << qb);
+    native->GetQuantumState(&(nativeAmps[0U]));
+    blocked->GetQuantumState(&(blockedAmps[0U]));
+    for (size_t i = 0U; i < nativeAmps.size(); ++i) {
+        REQUIRE(abs(nativeAmps[i] - blockedAmps[i]) < 1e-3f);
+    }
+    blocked->SetAmplitudePage(&(nativeAmps[3U]), 3U, 20U);
+    blocked->GetQuantumState(&(blockedAmps[0U]));
+    REQUIRE(blockedAmps[3U] == nativeAmps[3U]);
+    REQUIRE(blockedAmps[22U] == nativeAmps[22U]);
+
+    blocked->SetStateVecStorage(STATE_VEC_NATIVE);
+    REQUIRE(native->SumSqrDiff(std::dynamic_pointer_cast<QInterface>(blocked)) < 1e-5f);
+}
+
+TEST_CASE("test_qengine_cpu_clone_copy_on_write")
+{
+    const bitLenInt qb = 6U;
+    QEngineCPUPtr a = std::make_shared<QEngineCPU>(qb, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    for (bitLenInt i = 0U; i < qb; ++i) {
+        a->H(i);
+        a->RZ(0.2f * (i + 1U), i);
+    }
+    QEngineCPUPtr reference = std::dynamic_pointer_cast<QEngineCPU>(a->Clone());
+    QEngineCPUPtr b = std::dynamic_pointer_cast<QEngineCPU>(a->Clone());
+    QEngineCPUPtr c = std::dynamic_pointer_cast<QEngineCPU>(b->Clone());
+
+    // Writing to any one of the shared copies leaves the others alone.
+    a->X(0U);
+    REQUIRE(b->SumSqrDiff(reference) < 1e-6f);
+    REQUIRE(c->SumSqrDiff(reference) < 1e-6f);
+    REQUIRE(a->SumSqrDiff(reference) > 0.01f);
+
+    b->SetAmplitude(0U, ZERO_CMPLX);
+    REQUIRE(norm(c->GetAmplitude(0U)) == Approx(ONE_R1_F / 64));
+    c->ForceM(1U, true);
+    REQUIRE(reference->Prob(1U) == Approx(0.5f));
+    REQUIRE(b->Prob(1U) > 0.4f);
+
+    a->X(0U);
+    REQUIRE(a->SumSqrDiff(reference) < 1e-6f);
+}
+
+TEST_CASE("test_qengine_cpu_prob_cache")
+{
+    const bitLenInt qb = 5U;
+    QEngineCPUPtr qengine = std::make_shared<QEngineCPU>(qb, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    const complex tGate[4U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, complex((real1)SQRT1_2_R1, (real1)SQRT1_2_R1) };
+
+    // Every (cached) marginal must match a fresh sum over the probabilities.
+    const auto checkProbs = [&qb](QEngineCPUPtr q) {
+        std::unique_ptr<real1[]> probs(new real1[pow2Ocl(qb)]);
+        q->GetProbs(probs.get());
+        for (bitLenInt i = 0U; i < qb; ++i) {
+            real1_f oneChance = ZERO_R1_F;
+            real1_f zeroChance = ZERO_R1_F;
+            for (bitCapIntOcl j = 0U; j < pow2Ocl(qb); ++j) {
+                if ((j >> i) & 1U) {
+                    oneChance += probs[j];
+                } else {
+                    zeroChance += probs[j];
+                }
+            }
+            REQUIRE(q->Prob(i) == Approx(oneChance).margin(1e-5f));
+            REQUIRE(q->ProbMask(pow2(i), pow2(i)) == Approx(oneChance).margin(1e-5f));
+            // (Without normalization, as for the pages of a QPager, this isn't 1 - Prob(i).)
+            REQUIRE(q->ProbMask(pow2(i), 0U) == Approx(zeroChance).margin(1e-5f));
+        }
+    };
+
+    const std::vector<std::function<void(QEngineCPUPtr)>> gates{ [](QEngineCPUPtr q) { q->H(0U); },
+        [](QEngineCPUPtr q) { q->RY(0.7f, 1U); }, [](QEngineCPUPtr q) { q->CNOT(0U, 2U); },
+        [](QEngineCPUPtr q) { q->X(2U); }, [](QEngineCPUPtr q) { q->AntiCNOT(1U, 3U); },
+        [&tGate](QEngineCPUPtr q) { q->Mtrx(tGate, 1U); }, [](QEngineCPUPtr q) { q->CY(3U, 4U); },
+        [](QEngineCPUPtr q) { q->Swap(0U, 4U); }, [](QEngineCPUPtr q) { q->XMask(0x13U); },
+        [](QEngineCPUPtr q) { q->PhaseParity(0.3f, 0x1aU); }, [](QEngineCPUPtr q) { q->QFT(1U, 3U); },
+        [](QEngineCPUPtr q) { q->ISwap(2U, 3U); }, [](QEngineCPUPtr q) { q->ForceM(1U, true); },
+        [](QEngineCPUPtr q) { q->SetAmplitude(0U, ZERO_CMPLX); },
+        [](QEngineCPUPtr q) { q->SetAmplitude(2U, ZERO_CMPLX); },
+        [](QEngineCPUPtr q) { q->NormalizeState(); } };
+
+    for (const auto& gate : gates) {
+        gate(qengine);
+        checkProbs(qengine);
+    }
+
+    // A clone shares the cache, until either of them writes.
+    QEngineCPUPtr clone = std::dynamic_pointer_cast<QEngineCPU>(qengine->Clone());
+    checkProbs(clone);
+    clone->H(3U);
+    checkProbs(clone);
+    checkProbs(qengine);
+
+    qengine->Compose(std::make_shared<QEngineCPU>(1U, 1U, nullptr, CMPLX_DEFAULT_ARG, false, false), 2U);
+    REQUIRE(qengine->Prob(2U) > (ONE_R1_F - 1e-5f));
+    qengine->Dispose(2U, 1U, 1U);
+    checkProbs(qengine);
+}
+
+TEST_CASE("test_qengine_cpu_fused_diagonal")
+{
+    const bitLenInt qb = 6U;
+    QEngineCPUPtr qengine = std::make_shared<QEngineCPU>(qb, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    for (bitLenInt i = 0U; i < qb; ++i) {
+        qengine->H(i);
+    }
+
+    // Each diagonal gate, with the phase it gives to each basis state, (and X gates, which relabel the basis).
+    const auto parityPhase = [](bitCapIntOcl perm, real1 angle) {
+        bool isOdd = false;
+        for (; perm; perm &= perm - 1U) {
+            isOdd = !isOdd;
+        }
+        return std::polar(ONE_R1, isOdd ? angle : -angle);
+    };
+    typedef std::function<complex(bitCapIntOcl)> PhaseFn;
+    const std::vector<std::pair<std::function<void(QEngineCPUPtr)>, PhaseFn>> gates{
+        { [](QEngineCPUPtr q) { q->CZ(0U, 1U); },
+            [](bitCapIntOcl j) { return ((j & 3U) == 3U) ? -ONE_CMPLX : ONE_CMPLX; } },
+        { [](QEngineCPUPtr q) { q->T(2U); },
+            [](bitCapIntOcl j) { return ((j >> 2U) & 1U) ? std::polar(ONE_R1, (real1)(PI_R1 / 4)) : ONE_CMPLX; } },
+        { [](QEngineCPUPtr q) { q->RZ(0.4f, 3U); },
+            [](bitCapIntOcl j) { return std::polar(ONE_R1, (real1)(((j >> 3U) & 1U) ? 0.2f : -0.2f)); } },
+        { [](QEngineCPUPtr q) { q->MCPhase({ 0U, 4U }, ONE_CMPLX, I_CMPLX, 5U); },
+            [](bitCapIntOcl j) { return ((j & 0x31U) == 0x31U) ? I_CMPLX : ONE_CMPLX; } },
+        { [](QEngineCPUPtr q) { q->PhaseParity(0.6f, 0x2aU); },
+            [&parityPhase](bitCapIntOcl j) { return parityPhase(j & 0x2aU, 0.3f); } },
+        { [](QEngineCPUPtr q) { q->UniformParityRZ(0x15U, 0.2f); },
+            [&parityPhase](bitCapIntOcl j) { return parityPhase(j & 0x15U, 0.2f); } },
+        { [](QEngineCPUPtr q) { q->CUniformParityRZ({ 5U }, 0x03U, 0.5f); },
+            [&parityPhase](bitCapIntOcl j) { return ((j >> 5U) & 1U) ? parityPhase(j & 0x03U, 0.5f) : ONE_CMPLX; } },
+        { [](QEngineCPUPtr q) { q->X(1U); }, nullptr },
+        { [](QEngineCPUPtr q) { q->S(1U); },
+            [](bitCapIntOcl j) { return ((j >> 1U) & 1U) ? I_CMPLX : ONE_CMPLX; } },
+        { [](QEngineCPUPtr q) { q->X(1U); }, nullptr }, { [](QEngineCPUPtr q) { q->CZ(1U, 5U); },
+            [](bitCapIntOcl j) { return ((j & 0x22U) == 0x22U) ? -ONE_CMPLX : ONE_CMPLX; } }
+    };
+
+    // Phase each basis state picks up, in the original labels, through the relabelling of the X gates
+    std::vector<complex> expected(pow2Ocl(qb), complex((real1)(ONE_R1 / 8), ZERO_R1));
+    bitCapIntOcl xMask = 0U;
+    for (const auto& gate : gates) {
+        gate.first(qengine);
+        if (!gate.second) {
+            xMask ^= 2U;
+            continue;
+        }
+        for (bitCapIntOcl j = 0U; j < pow2Ocl(qb); ++j) {
+            expected[j] *= gate.second(j ^ xMask);
+        }
+    }
+
+    for (bitCapIntOcl j = 0U; j < pow2Ocl(qb); ++j) {
+        REQUIRE(norm(qengine->GetAmplitude(j) - expected[j]) < 1e-8f);
+    }
+
+    // A run that cancels itself out leaves the state untouched.
+    QEngineCPUPtr clone = std::dynamic_pointer_cast<QEngineCPU>(qengine->Clone());
+    clone->CZ(2U, 4U);
+    clone->PhaseParity(0.5f, 0x07U);
+    clone->CZ(2U, 4U);
+    clone->PhaseParity(-0.5f, 0x07U);
+    REQUIRE(clone->SumSqrDiff(qengine) < 1e-6f);
+}
+
+TEST_CASE("test_qengine_cpu_apply2x2_kernels")
+{
+    // The compiled kernels, (over 0 to 3 controls, every shape and norm mode, and low and high targets,) agree with the
+    // generic path that sparse state vectors take.
+    const bitLenInt qb = 8U;
+    const real1_f s = (real1_f)(ONE_R1 / sqrt((real1)2));
+    const complex general[4U]{ complex(s, ZERO_R1), complex(ZERO_R1, s), complex(ZERO_R1, s), complex(s, ZERO_R1) };
+    const complex diagonal[4U]{ I_CMPLX, ZERO_CMPLX, ZERO_CMPLX, complex(s, s) };
+    const complex antidiagonal[4U]{ ZERO_CMPLX, complex(s, -s), -I_CMPLX, ZERO_CMPLX };
+    const std::vector<complex const*> mtrxs{ general, diagonal, antidiagonal };
+    const std::vector<std::vector<bitLenInt>> controls{ {}, { 7U }, { 1U, 6U }, { 2U, 4U, 7U } };
+    const std::vector<bitLenInt> targets{ 0U, 3U, 5U };
+
+    for (int doNorm = 0; doNorm < 2; ++doNorm) {
+        QEngineCPUPtr dense =
+            std::make_shared<QEngineCPU>(qb, 0x5aU, nullptr, ONE_CMPLX, doNorm != 0, false, false, -1, false, false);
+        QEngineCPUPtr sparse =
+            std::make_shared<QEngineCPU>(qb, 0x5aU, nullptr, ONE_CMPLX, doNorm != 0, false, false, -1, false, true);
+        for (bitLenInt i = 0U; i < qb; ++i) {
+            dense->H(i);
+            sparse->H(i);
+        }
+
+        for (const auto& mtrx : mtrxs) {
+            for (const auto& c : controls) {
+                for (const bitLenInt& t : targets) {
+                    if (std::find(c.begin(), c.end(), t) != c.end()) {
+                        continue;
+                    }
+                    dense->MCMtrx(c, mtrx, t);
+                    sparse->MCMtrx(c, mtrx, t);
+                    dense->MACMtrx(c, mtrx, t);
+                    sparse->MACMtrx(c, mtrx, t);
+                }
+            }
+        }
+
+        REQUIRE(dense->SumSqrDiff(sparse) < 0.0001f);
+    }
+}
+
+TEST_CASE("test_simd_dispatch_kernels")
+{
+    // The dispatched AVX2 or AVX-512 kernels, (if the host has either,) agree with scalar arithmetic.
+    const bitCapIntOcl width = GetSimdWidth();
+    REQUIRE((width == 0U) == (GetSimdIsa() == SIMD_ISA_NONE));
+    if (!width) {
+        return;
+    }
+
+    const bitCapIntOcl length = 8U * width;
+    const real1_f thresh = (real1_f)0.01f;
+    qrack_rand_gen gen(3U);
+    std::uniform_real_distribution<real1_f> dist(-ONE_R1_F, ONE_R1_F);
+    const complex mtrx[4U]{ complex(dist(gen), dist(gen)), complex(dist(gen), dist(gen)),
+        complex(dist(gen), dist(gen)), complex(dist(gen), dist(gen)) };
+    std::vector<complex> lo(length), hi(length);
+    real1 expectedNorm = ZERO_R1;
+    for (bitCapIntOcl i = 0U; i < length; ++i) {
+        lo[i] = complex(dist(gen), dist(gen));
+        // Every fourth amplitude falls below the norm threshold.
+        hi[i] = (i & 3U) ? complex(dist(gen), dist(gen)) : complex((real1)0.05f, ZERO_R1);
+        expectedNorm += (norm(hi[i]) < thresh) ? ZERO_R1 : norm(hi[i]);
+    }
+    REQUIRE_FLOAT(SimdNorm(&(hi[0U]), length, thresh), expectedNorm);
+
+    std::vector<complex> expectedLo(length), expectedHi(length);
+    for (bitCapIntOcl i = 0U; i < length; ++i) {
+        expectedLo[i] = mtrx[0U] * lo[i] + mtrx[1U] * hi[i];
+        expectedHi[i] = mtrx[2U] * lo[i] + mtrx[3U] * hi[i];
+    }
+    SimdApply2x2(&(lo[0U]), &(hi[0U]), mtrx, length);
+    for (bitCapIntOcl i = 0U; i < length; ++i) {
+        REQUIRE(norm(lo[i] - expectedLo[i]) < 1e-8f);
+        REQUIRE(norm(hi[i] - expectedHi[i]) < 1e-8f);
+    }
+
+    // Lane selection by the index bits below the width, (the highest and lowest of them, if they differ)
+    const bitCapIntOcl mask = (width >> 1U) | 1U;
+    const bitCapIntOcl perm = width >> 1U;
+    const complex nrm = mtrx[0U];
+    real1 expectedProb = ZERO_R1;
+    for (bitCapIntOcl i = 0U; i < length; ++i) {
+        if ((i & mask) == perm) {
+            expectedProb += norm(lo[i]);
+            expectedLo[i] = nrm * lo[i];
+        } else {
+            expectedLo[i] = ZERO_CMPLX;
+        }
+    }
+    REQUIRE_FLOAT(SimdProbMask(&(lo[0U]), mask, perm, length), expectedProb);
+    SimdApplyM(&(lo[0U]), mask, perm, nrm, length);
+    for (bitCapIntOcl i = 0U; i < length; ++i) {
+        REQUIRE(norm(lo[i] - expectedLo[i]) < 1e-8f);
+    }
+
+    // QEngineCPU::ProbMask() and ApplyM() split their masks at the width, so measure bits on both sides of it.
+    const bitLenInt qb = 8U;
+    QEngineCPUPtr qengine = std::make_shared<QEngineCPU>(qb, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    for (bitLenInt i = 0U; i < qb; ++i) {
+        qengine->RY(0.3f * (i + 1U), i);
+        qengine->RZ(0.2f * (i + 1U), i);
+    }
+    qengine->CNOT(0U, 7U);
+    const bitCapIntOcl maxQPower = pow2Ocl(qb);
+    std::vector<complex> before(maxQPower), after(maxQPower);
+    qengine->GetQuantumState(&(before[0U]));
+
+    const std::vector<bitLenInt> bits{ 0U, 2U, 6U };
+    const bitCapIntOcl regMask = 0x45U;
+    const bitCapIntOcl result = 0x41U;
+    real1 expectedRegProb = ZERO_R1;
+    for (bitCapIntOcl i = 0U; i < maxQPower; ++i) {
+        if ((i & regMask) == result) {
+            expectedRegProb += norm(before[i]);
+        }
+    }
+    REQUIRE_FLOAT(qengine->ProbMask(regMask, result), expectedRegProb);
+    REQUIRE(qengine->ForceM(bits, std::vector<bool>{ true, false, true }) == result);
+    qengine->GetQuantumState(&(after[0U]));
+    const real1 regNrm = ONE_R1 / (real1)std::sqrt((real1_s)expectedRegProb);
+    for (bitCapIntOcl i = 0U; i < maxQPower; ++i) {
+        const complex expectedAmp = ((i & regMask) == result) ? (regNrm * before[i]) : ZERO_CMPLX;
+        REQUIRE(norm(after[i] - expectedAmp) < 1e-6f);
+    }
+}
+
+TEST_CASE("test_qengine_cpu_permute_qubits")
+{
+    const bitLenInt qb = 5U;
+    const std::vector<bitLenInt> dest{ 3U, 0U, 2U, 4U, 1U };
+    for (const bool isInPlace : { false, true }) {
+        QEngineCPUPtr qengine = std::make_shared<QEngineCPU>(qb, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+        QEngineCPUPtr reference = std::make_shared<QEngineCPU>(qb, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+        qengine->SetInPlaceArithmetic(isInPlace);
+        for (bitLenInt i = 0U; i < qb; ++i) {
+            qengine->RY(0.3f * (i + 1U), i);
+            reference->RY(0.3f * (i + 1U), i);
+        }
+        qengine->CNOT(0U, 3U);
+        reference->CNOT(0U, 3U);
+
+        // The same relabelling, as the SWAPs the default QEngine::PermuteQubits() would make
+        qengine->PermuteQubits(dest);
+        reference->QEngine::PermuteQubits(dest);
+        REQUIRE(qengine->SumSqrDiff(reference) < 1e-6f);
+
+        for (bitLenInt i = 0U; i < qb; ++i) {
+            REQUIRE_FLOAT(qengine->Prob(dest[i]), (real1_f)(sin(0.15f * (i + 1U)) * sin(0.15f * (i + 1U))) +
+                    ((i == 3U) ? (real1_f)(sin(0.15f) * sin(0.15f) * cos(1.2f)) : ZERO_R1_F));
+        }
+    }
+}
+
+TEST_CASE("test_statevec_pool")
+{
+    StateVecPool& pool = StateVecPool::Instance();
+    const size_t maxIdleBytes = pool.GetMaxIdleBytes();
+    pool.SetMaxIdleBytes(1U << 20U);
+    pool.Clear();
+
+    void* a = pool.Acquire(4096U);
+    pool.Release(a);
+    REQUIRE(pool.GetIdleBytes() == 4096U);
+
+    // A smaller request reuses an idle buffer, within QRACK_SV_POOL_SLACK size classes, but not beyond.
+    size_t hits = pool.GetHitCount();
+    void* b = pool.Acquire(2048U);
+    REQUIRE(b == a);
+    REQUIRE(pool.GetHitCount() == (hits + 1U));
+    REQUIRE(!pool.GetIdleBytes());
+    pool.Release(b);
+    void* c = pool.Acquire(4096U >> (QRACK_SV_POOL_SLACK + 1U));
+    REQUIRE(c != a);
+    pool.Release(c);
+
+    // Lowering the limit frees idle buffers, largest first.
+    pool.SetMaxIdleBytes(4096U);
+    REQUIRE(pool.GetIdleBytes() == (4096U >> (QRACK_SV_POOL_SLACK + 1U)));
+
+    // An engine that shrinks and grows back reuses its old state vector.
+    pool.SetMaxIdleBytes(1U << 20U);
+    QEngineCPUPtr qengine = std::make_shared<QEngineCPU>(12U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    qengine->H(0U);
+    qengine->Dispose(11U, 1U);
+    hits = pool.GetHitCount();
+    qengine->Allocate(1U);
+    REQUIRE(pool.GetHitCount() > hits);
+    REQUIRE(qengine->Prob(0U) == Approx(0.5f));
+    REQUIRE(qengine->Prob(11U) < 1e-6f);
+
+    pool.SetMaxIdleBytes(maxIdleBytes);
+}
+
+TEST_CASE("test_memory_governor")
+{
+    MemoryGovernor& governor = MemoryGovernor::Instance();
+    const size_t budget = governor.GetBudget(QRACK_HOST_MEMORY);
+    const unsigned waitMs = governor.GetWaitMs();
+    governor.SetWaitMs(0U);
+    const size_t used = governor.GetUsed(QRACK_HOST_MEMORY);
+
+    // Engines reserve their state vectors against the host budget, and return them when they're destroyed.
+    {
+        QEngineCPUPtr qengine = std::make_shared<QEngineCPU>(14U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+        REQUIRE(governor.GetUsed(QRACK_HOST_MEMORY) >= (used + (sizeof(complex) << 14U)));
+    }
+    REQUIRE(governor.GetUsed(QRACK_HOST_MEMORY) == used);
+
+    // An engine that doesn't fit the budget is refused before it allocates.
+    governor.SetBudget(QRACK_HOST_MEMORY, used + (sizeof(complex) << 12U));
+    const size_t refused = governor.GetRefusedCount();
+    REQUIRE_THROWS_AS(std::make_shared<QEngineCPU>(14U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false), std::bad_alloc);
+    REQUIRE(governor.GetRefusedCount() > refused);
+    REQUIRE(governor.IsUnderPressure(QRACK_HOST_MEMORY) == false);
+
+    // QUnit refuses an entangling gate that's too wide before it composes any unit, so its state is intact.
+    governor.SetBudget(QRACK_HOST_MEMORY, (size_t)-1);
+    QInterfacePtr qunit = CreateQuantumInterface(QINTERFACE_QUNIT, QINTERFACE_CPU, 14U, 0U);
+    QInterfacePtr reference = CreateQuantumInterface(QINTERFACE_QUNIT, QINTERFACE_CPU, 14U, 0U);
+    std::vector<bitLenInt> controls;
+    for (bitLenInt i = 0U; i < 13U; ++i) {
+        qunit->H(i);
+        reference->H(i);
+        controls.push_back(i);
+    }
+    qunit->CNOT(0U, 1U);
+    qunit->T(1U);
+    reference->CNOT(0U, 1U);
+    reference->T(1U);
+    governor.SetBudget(QRACK_HOST_MEMORY, governor.GetUsed(QRACK_HOST_MEMORY) + (sizeof(complex) << 12U));
+    REQUIRE_THROWS_AS(qunit->MCInvert(controls, ONE_CMPLX, ONE_CMPLX, 13U), std::bad_alloc);
+    governor.SetBudget(QRACK_HOST_MEMORY, (size_t)-1);
+    REQUIRE(qunit->SumSqrDiff(std::dynamic_pointer_cast<QUnit>(reference)) < 1e-5f);
+
+#if ENABLE_PTHREAD
+    // A reservation that doesn't fit waits for another thread to release memory.
+    governor.SetBudget(QRACK_HOST_MEMORY, governor.GetUsed(QRACK_HOST_MEMORY) + 4096U);
+    governor.SetWaitMs(10000U);
+    REQUIRE(governor.TryReserve(QRACK_HOST_MEMORY, 4096U));
+    std::future<void> release = std::async(std::launch::async, [&governor] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        governor.Release(QRACK_HOST_MEMORY, 4096U);
+    });
+    REQUIRE(governor.TryReserve(QRACK_HOST_MEMORY, 4096U));
+    release.get();
+    governor.Release(QRACK_HOST_MEMORY, 4096U);
+#endif
+
+    governor.SetBudget(QRACK_HOST_MEMORY, budget);
+    governor.SetWaitMs(waitMs);
+}
+
+#if ENABLE_PTHREAD
+namespace {
+class QUnitShardProbe : public QUnit {
+public:
+    QUnitShardProbe(bitLenInt qBitCount)
+        : QUnit(std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, qBitCount, 0U, nullptr, CMPLX_DEFAULT_ARG, false,
+              false)
+    {
+    }
+    bitLenInt GetUnitQubitCount(bitLenInt qubit) { return shards[qubit].GetQubitCount(); }
+};
+} // namespace
+
+TEST_CASE("test_background_separate")
+{
+    std::shared_ptr<QUnitShardProbe> qunit = std::make_shared<QUnitShardProbe>(4U);
+    std::shared_ptr<QUnitShardProbe> reference = std::make_shared<QUnitShardProbe>(4U);
+    qunit->SetReactiveSeparate(false);
+    qunit->SetBackgroundSeparate(true);
+
+    // Qubit 3 is entangled into the unit, and then disentangled again, but nothing on the gate path notices.
+    qunit->H(0U);
+    qunit->CNOT(0U, 1U);
+    qunit->H(3U);
+    qunit->CH(3U, 1U);
+    qunit->CH(3U, 1U);
+    reference->H(0U);
+    reference->CNOT(0U, 1U);
+    reference->H(3U);
+    REQUIRE(qunit->GetUnitQubitCount(3U) == 3U);
+
+    // Later gates commit the split, once the probe reports.
+    for (int i = 0; (i < 2000) && (qunit->GetUnitQubitCount(3U) > 1U); ++i) {
+        qunit->CNOT(0U, 1U);
+        reference->CNOT(0U, 1U);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(qunit->GetUnitQubitCount(3U) == 1U);
+    REQUIRE(qunit->GetUnitQubitCount(0U) == 2U);
+    REQUIRE(qunit->SumSqrDiff(std::dynamic_pointer_cast<QUnit>(reference)) < 1e-5f);
+}
+#endif
+
+namespace {
+class QUnitFrameProbe : public QUnit {
+public:
+    QUnitFrameProbe(bitLenInt qBitCount)
+        : QUnit(std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, qBitCount, 0U, nullptr, CMPLX_DEFAULT_ARG, false,
+              false)
+    {
+    }
+    bool IsFramed(bitLenInt qubit) { return shards[qubit].isFramed; }
+};
+} // namespace
+
+TEST_CASE("test_qunit_local_frames")
+{
+    const bitLenInt qb = 4U;
+    std::shared_ptr<QUnitFrameProbe> qunit = std::make_shared<QUnitFrameProbe>(qb);
+    std::shared_ptr<QUnitFrameProbe> reference = std::make_shared<QUnitFrameProbe>(qb);
+    REQUIRE(qunit->GetLocalFrames());
+    reference->SetLocalFrames(false);
+
+    const auto both = [&](std::function<void(QInterfacePtr)> fn) {
+        fn(qunit);
+        fn(reference);
+    };
+
+    // Entangle everything, then run variational layers of arbitrary single-qubit rotations and a CNOT ladder.
+    both([&](QInterfacePtr q) {
+        q->H(0U);
+        for (bitLenInt i = 0U; i < (qb - 1U); ++i) {
+            q->CNOT(i, i + 1U);
+        }
+    });
+    for (int layer = 0; layer < 3; ++layer) {
+        both([&](QInterfacePtr q) {
+            for (bitLenInt i = 0U; i < qb; ++i) {
+                q->RY(0.3f + 0.2f * i + layer, i);
+                q->RZ(0.7f - 0.1f * i, i);
+                q->U(i, 0.4f, 0.2f * layer, 1.1f);
+                q->T(i);
+            }
+        });
+        // The rotations are only composed, until the next multi-qubit gate.
+        REQUIRE(qunit->IsFramed(qb - 1U));
+        both([&](QInterfacePtr q) {
+            for (bitLenInt i = 0U; i < (qb - 1U); ++i) {
+                q->CNOT(i, i + 1U);
+            }
+            q->CZ(qb - 1U, 0U);
+        });
+        REQUIRE(qunit->SumSqrDiff(std::dynamic_pointer_cast<QUnit>(reference)) < 1e-5f);
+    }
+
+    // Reading out probability flushes the frame, (and a diagonal frame doesn't need to be flushed for it).
+    both([&](QInterfacePtr q) { q->RX(0.5f, 1U); });
+    REQUIRE(qunit->IsFramed(1U));
+    REQUIRE(qunit->Prob(1U) == Approx(reference->Prob(1U)).epsilon(1e-3f));
+    REQUIRE(!qunit->IsFramed(1U));
+    both([&](QInterfacePtr q) { q->RZ(0.5f, 1U); });
+    REQUIRE(qunit->Prob(1U) == Approx(reference->Prob(1U)).epsilon(1e-3f));
+    REQUIRE(qunit->SumSqrDiff(std::dynamic_pointer_cast<QUnit>(reference)) < 1e-5f);
+
+    // Measurement demands the frame, and disabling frames applies every gate to the engine immediately.
+    both([&](QInterfacePtr q) { q->RX(0.9f, 2U); });
+    REQUIRE(qunit->IsFramed(2U));
+    both([&](QInterfacePtr q) { q->ForceM(2U, true); });
+    REQUIRE(!qunit->IsFramed(2U));
+    qunit->SetLocalFrames(false);
+    both([&](QInterfacePtr q) { q->RY(0.9f, 0U); });
+    REQUIRE(!qunit->IsFramed(0U));
+    REQUIRE(qunit->SumSqrDiff(std::dynamic_pointer_cast<QUnit>(reference)) < 1e-5f);
+}
+
+TEST_CASE("test_qunit_phase_buffer_map")
+{
+    // The flat buffer map iterates in partner order, like the std::map it replaced, however it was filled.
+    std::vector<QEngineShard> partners(5U);
+    ShardToPhaseMap buffers;
+    for (const size_t i : { 3U, 0U, 4U, 1U }) {
+        buffers[&(partners[i])] = std::allocate_shared<PhaseShard>(PhaseShardAllocator<PhaseShard>());
+        buffers[&(partners[i])]->cmplxDiff = complex((real1)i, ZERO_R1);
+    }
+    REQUIRE(buffers.size() == 4U);
+    REQUIRE(buffers.find(&(partners[2U])) == buffers.end());
+    REQUIRE(buffers.find(&(partners[4U]))->second->cmplxDiff == complex((real1)4, ZERO_R1));
+    REQUIRE(buffers.erase(&(partners[0U])) == 1U);
+    REQUIRE(buffers.erase(&(partners[0U])) == 0U);
+    QEngineShardPtr last = NULL;
+    for (const auto& entry : buffers) {
+        REQUIRE(std::less<QEngineShardPtr>()(last, entry.first));
+        last = entry.first;
+    }
+
+    // A retired buffer's block is handed to the next buffer.
+    PhaseShard* block = buffers.begin()->second.get();
+    buffers.erase(buffers.begin());
+    PhaseShardPtr recycled = std::allocate_shared<PhaseShard>(PhaseShardAllocator<PhaseShard>());
+    REQUIRE(recycled.get() == block);
+
+    // Buffered controlled phases flush in the same order, (and to the same state,) as unbuffered gates.
+    const bitLenInt qb = 8U;
+    QInterfacePtr qunit = CreateQuantumInterface({ QINTERFACE_QUNIT, QINTERFACE_CPU }, qb, 0U);
+    QInterfacePtr reference = CreateQuantumInterface(QINTERFACE_CPU, qb, 0U);
+    qrack_rand_gen gen(11U);
+    std::uniform_int_distribution<int> qubit(0, qb - 1);
+    for (QInterfacePtr q : { qunit, reference }) {
+        q->H(0U, qb);
+    }
+    for (int i = 0; i < 100; ++i) {
+        const bitLenInt c = (bitLenInt)qubit(gen);
+        const bitLenInt t = (bitLenInt)((c + 1 + (qubit(gen) % (qb - 1))) % qb);
+        const int gate = i % 3;
+        for (QInterfacePtr q : { qunit, reference }) {
+            if (gate == 0) {
+                q->CZ(c, t);
+            } else if (gate == 1) {
+                q->CPhaseRootN(2U, c, t);
+            } else {
+                q->AntiCZ(c, t);
+            }
+        }
+        if (!(i % 10)) {
+            for (QInterfacePtr q : { qunit, reference }) {
+                q->H(t);
+            }
+        }
+    }
+    // (SumSqrDiff() only compares engines of one type.)
+    std::unique_ptr<complex[]> qunitState(new complex[pow2Ocl(qb)]);
+    std::unique_ptr<complex[]> referenceState(new complex[pow2Ocl(qb)]);
+    qunit->GetQuantumState(qunitState.get());
+    reference->GetQuantumState(referenceState.get());
+    complex inner = ZERO_CMPLX;
+    for (bitCapIntOcl i = 0U; i < pow2Ocl(qb); ++i) {
+        inner += conj(qunitState[i]) * referenceState[i];
+    }
+    REQUIRE_FLOAT((real1_f)norm(inner), ONE_R1_F);
+}
+
+#if ENABLE_ALU
+TEST_CASE("test_inplace_arithmetic")
+{
+    // Registers: a = [0, 4), b = [4, 8), and flag/control qubits 8 and 9
+    const bitLenInt qb = 10U;
+    const unsigned char values[16U]{ 3, 14, 15, 9, 2, 6, 5, 13, 0, 8, 7, 11, 10, 1, 12, 4 };
+    // (Carry measurements draw the same results from identically seeded generators.)
+    QEngineCPUPtr outOfPlace = std::make_shared<QEngineCPU>(
+        qb, 0U, std::make_shared<qrack_rand_gen>(7U), CMPLX_DEFAULT_ARG, false, false, false, -1, false);
+    QEngineCPUPtr inPlace = std::make_shared<QEngineCPU>(
+        qb, 0U, std::make_shared<qrack_rand_gen>(7U), CMPLX_DEFAULT_ARG, false, false, false, -1, false);
+    inPlace->SetInPlaceArithmetic(true);
+    REQUIRE(inPlace->GetInPlaceArithmetic());
+
+    const auto both = [&](std::function<void(QEngineCPUPtr)> fn) {
+        fn(outOfPlace);
+        fn(inPlace);
+        REQUIRE(outOfPlace->SumSqrDiff(std::dynamic_pointer_cast<QInterface>(inPlace)) < 1e-5f);
+    };
+
+    both([](QEngineCPUPtr q) {
+        for (bitLenInt i = 0U; i < 4U; ++i) {
+            q->H(i);
+            q->RZ(0.4f * (i + 1U), i);
+        }
+        q->H(9U);
+    });
+    both([](QEngineCPUPtr q) { q->ROL(3U, 0U, 4U); });
+    both([](QEngineCPUPtr q) { q->INC(11U, 0U, 4U); });
+    both([](QEngineCPUPtr q) { q->CINC(5U, 0U, 4U, { 9U }); });
+    both([](QEngineCPUPtr q) { q->INCS(7U, 0U, 4U, 9U); });
+    both([](QEngineCPUPtr q) { q->INCC(9U, 0U, 4U, 8U); });
+    both([](QEngineCPUPtr q) { q->DECC(9U, 0U, 4U, 8U); });
+    both([](QEngineCPUPtr q) { q->MUL(3U, 0U, 4U, 4U); });
+    both([](QEngineCPUPtr q) { q->DIV(3U, 0U, 4U, 4U); });
+    both([](QEngineCPUPtr q) { q->CMUL(5U, 0U, 4U, 4U, { 9U }); });
+    both([](QEngineCPUPtr q) { q->CDIV(5U, 0U, 4U, 4U, { 9U }); });
+    both([](QEngineCPUPtr q) { q->MULModNOut(7U, 13U, 0U, 4U, 4U); });
+    both([](QEngineCPUPtr q) { q->IMULModNOut(7U, 13U, 0U, 4U, 4U); });
+    both([](QEngineCPUPtr q) { q->CPOWModNOut(3U, 11U, 0U, 4U, 4U, { 9U }); });
+    both([&values](QEngineCPUPtr q) { q->IndexedLDA(0U, 4U, 4U, 4U, values); });
+    both([&values](QEngineCPUPtr q) { q->IndexedADC(0U, 4U, 4U, 4U, 8U, values); });
+    both([&values](QEngineCPUPtr q) { q->IndexedSBC(0U, 4U, 4U, 4U, 8U, values); });
+    both([&values](QEngineCPUPtr q) { q->Hash(0U, 4U, values); });
+}
+#endif
+
+TEST_CASE("test_checkpoint_round_trip")
+{
+    const bitLenInt qb = 12U;
+    const auto circuit = [qb](QInterfacePtr q) {
+        for (bitLenInt i = 0U; i < qb; ++i) {
+            q->H(i);
+        }
+        for (bitLenInt i = 0U; i < (qb - 1U); ++i) {
+            q->CNOT(i, i + 1U);
+        }
+        q->S(3U);
+        q->T(5U);
+        q->X(qb - 1U);
+    };
+    const auto roundTrip = [](QInterfacePtr from, QInterfacePtr to, bool compress) {
+        std::stringstream ss;
+        CheckpointWriter writer(ss, compress);
+        from->SaveCheckpoint(writer);
+        CheckpointReader reader(ss);
+        to->LoadCheckpoint(reader);
+        real1_f diff = ZERO_R1_F;
+        for (bitCapInt i = 0U; i < from->GetMaxQPower(); ++i) {
+            diff += (real1_f)norm(to->GetAmplitude(i) - from->GetAmplitude(i));
+        }
+        REQUIRE(diff < 1e-6f);
+    };
+
+    const std::vector<std::vector<QInterfaceEngine>> stacks{ { QINTERFACE_CPU }, { QINTERFACE_BDT },
+        { QINTERFACE_STABILIZER_HYBRID, QINTERFACE_CPU }, { QINTERFACE_QUNIT, QINTERFACE_CPU },
+        { QINTERFACE_QUNIT, QINTERFACE_STABILIZER_HYBRID, QINTERFACE_CPU } };
+    for (size_t i = 0U; i < stacks.size(); ++i) {
+        QInterfacePtr q = CreateQuantumInterface(stacks[i], qb, 0U);
+        circuit(q);
+        roundTrip(q, CreateQuantumInterface(stacks[i], qb, 0U), (i & 1U) == 0U);
+    }
+
+    // Clifford-only QStabilizerHybrid state restores as a tableau.
+    QInterfacePtr stab = CreateQuantumInterface({ QINTERFACE_STABILIZER_HYBRID, QINTERFACE_CPU }, qb, 0U);
+    stab->H(0U);
+    stab->CNOT(0U, 1U);
+    stab->S(1U);
+    QInterfacePtr stabCopy = CreateQuantumInterface({ QINTERFACE_STABILIZER_HYBRID, QINTERFACE_CPU }, qb, 0U);
+    roundTrip(stab, stabCopy, true);
+    REQUIRE(stabCopy->isClifford());
+
+    // Pages restore by global offset, whatever the paging of the saved and restored instances.
+    QInterfacePtr wide = std::make_shared<QPager>(std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, qb, 0U, nullptr,
+        CMPLX_DEFAULT_ARG, false, false, false, -1, true, false, REAL1_EPSILON, std::vector<int64_t>{}, qb - 1U);
+    QInterfacePtr narrow = std::make_shared<QPager>(std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, qb, 0U, nullptr,
+        CMPLX_DEFAULT_ARG, false, false, false, -1, true, false, REAL1_EPSILON, std::vector<int64_t>{}, qb - 3U);
+    circuit(wide);
+    roundTrip(wide, narrow, true);
+    narrow->H(0U);
+    roundTrip(narrow, wide, false);
+
+    // Exact 0 amplitudes compress, and the width must match.
+    QInterfacePtr zero = std::make_shared<QEngineCPU>(qb, 0U);
+    std::stringstream raw, compressed;
+    CheckpointWriter rawWriter(raw, false), compressedWriter(compressed, true);
+    zero->SaveCheckpoint(rawWriter);
+    zero->SaveCheckpoint(compressedWriter);
+    REQUIRE((compressed.str().size() * 100U) < raw.str().size());
+    CheckpointReader badReader(compressed);
+    REQUIRE_THROWS_AS(std::make_shared<QEngineCPU>(qb + 1U, 0U)->LoadCheckpoint(badReader), std::invalid_argument);
+
+    // Sparse states restore from their run-length coded chunks.
+    for (bitLenInt i = 0U; i < 2U; ++i) {
+        QInterfacePtr ghz = std::make_shared<QEngineCPU>(qb, 0U);
+        ghz->H(0U);
+        for (bitLenInt j = 0U; j < (i ? (qb - 1U) : 1U); ++j) {
+            ghz->CNOT(j, j + 1U);
+        }
+        std::stringstream sparse;
+        CheckpointWriter sparseWriter(sparse, true);
+        ghz->SaveCheckpoint(sparseWriter);
+        REQUIRE(sparse.str().size() < raw.str().size());
+        QInterfacePtr ghzCopy = std::make_shared<QEngineCPU>(qb, 0U);
+        CheckpointReader sparseReader(sparse);
+        ghzCopy->LoadCheckpoint(sparseReader);
+        const bitCapInt last = i ? (ghz->GetMaxQPower() - ONE_BCI) : (bitCapInt)3U;
+        REQUIRE_FLOAT((real1_f)abs(ghzCopy->GetAmplitude(0U)), (real1_f)SQRT1_2_R1);
+        REQUIRE_FLOAT((real1_f)abs(ghzCopy->GetAmplitude(last)), (real1_f)SQRT1_2_R1);
+        REQUIRE(ghz->SumSqrDiff(ghzCopy) < 1e-6f);
+    }
+}
+
+#if ENABLE_PTHREAD
+TEST_CASE("test_parallel_pool")
+{
+    const unsigned SLOTS = 4U;
+    const int NUM_CHUNKS = 2000;
+    std::atomic_bool hit[NUM_CHUNKS];
+    // Slot indices are per job, (each caller takes slot 0 of its own,) so each of the two jobs gets its own array.
+    std::atomic_bool slotBusy[2U][SLOTS];
+
+    for (int i = 0; i < NUM_CHUNKS; i++) {
+        hit[i].store(false);
+    }
+    for (unsigned j = 0U; j < 2U; j++) {
+        for (unsigned i = 0U; i < SLOTS; i++) {
+            slotBusy[j][i].store(false);
+        }
+    }
+
+    // Every chunk runs exactly once, and no slot index of a job is ever held by two threads at once.
+    // (Catch assertions are not thread-safe, so violations are counted and checked on this thread.)
+    std::atomic_int violations;
+    violations.store(0);
+    auto job = [&](const unsigned& jobId, const bitCapIntOcl& chunk, const unsigned& slot) {
+        if ((slot >= SLOTS) || slotBusy[jobId][slot].exchange(true)) {
+            violations++;
+            return;
+        }
+        if (hit[chunk].exchange(true)) {
+            violations++;
+        }
+        slotBusy[jobId][slot].store(false);
+    };
+
+    std::future<void> other = std::async(std::launch::async, [&]() {
+        ParallelPool::Instance().Run(
+            NUM_CHUNKS / 2, SLOTS, [&](const bitCapIntOcl& chunk, const unsigned& slot) { job(0U, chunk, slot); });
+    });
+    ParallelPool::Instance().Run(NUM_CHUNKS / 2, SLOTS, [&](const bitCapIntOcl& chunk, const unsigned& slot) {
+        job(1U, chunk + NUM_CHUNKS / 2, slot);
+    });
+    other.get();
+
+    REQUIRE(violations.load() == 0);
+    for (int i = 0; i < NUM_CHUNKS; i++) {
+        REQUIRE(hit[i].load() == true);
+    }
+
+    REQUIRE_THROWS(ParallelPool::Instance().Run(NUM_CHUNKS, SLOTS, [](const bitCapIntOcl& chunk, const unsigned& slot) {
+        if (chunk == 7U) {
+            throw std::runtime_error("test_parallel_pool");
+        }
+    }));
+}
+
+#if ENABLE_QUNIT_CPU_PARALLEL
+TEST_CASE("test_dispatch_queue")
+{
+    // Several queues share the pool, but each runs its own operations in order, (whether a worker or finish() does).
+    const int QUEUES = 8;
+    const int OPS = 200;
+    std::vector<std::unique_ptr<DispatchQueue>> queues;
+    std::vector<std::vector<int>> logs(QUEUES);
+    for (int i = 0; i < QUEUES; ++i) {
+        queues.emplace_back(new DispatchQueue());
+    }
+    for (int j = 0; j < OPS; ++j) {
+        for (int i = 0; i < QUEUES; ++i) {
+            std::vector<int>* log = &(logs[i]);
+            queues[i]->dispatch([log, j] { log->push_back(j); });
+        }
+    }
+    for (int i = 0; i < QUEUES; ++i) {
+        queues[i]->finish();
+        REQUIRE(queues[i]->isFinished());
+        REQUIRE(logs[i].size() == (size_t)OPS);
+        for (int j = 0; j < OPS; ++j) {
+            REQUIRE(logs[i][j] == j);
+        }
+    }
+
+    // An exception from a queued operation surfaces at the next synchronization point.
+    queues[0U]->dispatch([] { throw std::runtime_error("test_dispatch_queue"); });
+    REQUIRE_THROWS(queues[0U]->finish());
+    queues[0U]->finish();
+
+    // A wide QEngineCPU returns from gates before they run, and Prob() waits for them.
+    QEngineCPUPtr qengine = std::make_shared<QEngineCPU>(16U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    for (int i = 0; i < 8; ++i) {
+        qengine->H(0U);
+        qengine->CNOT(0U, 15U);
+        qengine->H(0U);
+        qengine->CNOT(0U, 15U);
+    }
+    qengine->H(0U);
+    qengine->CNOT(0U, 15U);
+    REQUIRE_FLOAT(qengine->Prob(15U), ONE_R1_F / 2);
+    REQUIRE(qengine->isFinished());
+}
+
+#if ENABLE_ENV_VARS && !defined(_WIN32)
+namespace {
+class QUnitEntangleProbe : public QUnit {
+public:
+    QUnitEntangleProbe(bitLenInt qBitCount)
+        : QUnit(std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, qBitCount, 0U, nullptr, CMPLX_DEFAULT_ARG, false,
+              false)
+    {
+    }
+    using QUnit::EntangleRange;
+};
+} // namespace
+
+TEST_CASE("test_qunit_wide_dispatch")
+{
+    // Under a small stride, QUnit's engines queue every gate, so gates interleaved across disjoint units overlap until
+    // Compose() and EntangleRange() join the units, which must see each unit's gates in order.
+    setenv("QRACK_PSTRIDEPOW", "2", 1);
+    const bitLenInt width = 5U;
+    std::shared_ptr<QUnitEntangleProbe> qunitProbe = std::make_shared<QUnitEntangleProbe>(2U * width);
+    QInterfacePtr qunit = qunitProbe;
+    QInterfacePtr qunitAdd = CreateQuantumInterface({ QINTERFACE_QUNIT, QINTERFACE_CPU }, width, 0U);
+    QInterfacePtr reference = CreateQuantumInterface(QINTERFACE_CPU, 2U * width, 0U);
+    QInterfacePtr referenceAdd = CreateQuantumInterface(QINTERFACE_CPU, width, 0U);
+
+    qrack_rand_gen gen(19U);
+    std::uniform_real_distribution<real1_f> angle(ZERO_R1_F, (real1_f)(2 * PI_R1));
+    // Unit "u" of three, (the third held apart, to be composed,) as its register and first qubit
+    const auto unitQubit = [&](bool isRef, bitLenInt u, bitLenInt i) {
+        QInterfacePtr q = isRef ? ((u < 2U) ? reference : referenceAdd) : ((u < 2U) ? qunit : qunitAdd);
+        return std::make_pair(q, (bitLenInt)(((u < 2U) ? (u * width) : 0U) + i));
+    };
+    for (int layer = 0; layer < 4; ++layer) {
+        for (bitLenInt i = 0U; i < width; ++i) {
+            for (bitLenInt u = 0U; u < 3U; ++u) {
+                const real1_f theta = angle(gen), phi = angle(gen), lambda = angle(gen);
+                for (const bool isRef : { false, true }) {
+                    const auto target = unitQubit(isRef, u, i);
+                    if (!layer && !i) {
+                        target.first->H(target.second);
+                    }
+                    target.first->U(target.second, theta, phi, lambda);
+                    if (i) {
+                        target.first->CNOT(target.second - 1U, target.second);
+                    }
+                }
+            }
+        }
+    }
+
+    qunit->Compose(qunitAdd);
+    reference->Compose(referenceAdd);
+    qunitProbe->EntangleRange(width - 2U, 4U);
+    for (QInterfacePtr q : { qunit, reference }) {
+        q->CNOT(width - 1U, width);
+        q->CNOT(2U * width - 1U, 2U * width);
+        q->RY(0.7f, 0U);
+        q->RX(1.1f, 3U * width - 1U);
+    }
+
+    const bitCapIntOcl maxQPower = pow2Ocl(3U * width);
+    std::unique_ptr<complex[]> qunitState(new complex[maxQPower]);
+    std::unique_ptr<complex[]> referenceState(new complex[maxQPower]);
+    qunit->GetQuantumState(qunitState.get());
+    reference->GetQuantumState(referenceState.get());
+    unsetenv("QRACK_PSTRIDEPOW");
+    complex inner = ZERO_CMPLX;
+    for (bitCapIntOcl i = 0U; i < maxQPower; ++i) {
+        inner += conj(qunitState[i]) * referenceState[i];
+    }
+    REQUIRE_FLOAT((real1_f)norm(inner), ONE_R1_F);
+}
+#endif
+
+namespace {
+// (Completion callbacks are plain function pointers, so they report back through these.)
+uintq asyncTestSid;
+uintq asyncTestOtherSid;
+double asyncTestOtherProb;
+std::atomic_int asyncTestCallbacks;
+
+void CountAsyncCallback(uintq ticket, double result) { ++asyncTestCallbacks; }
+
+void ReadOtherAsyncCallback(uintq ticket, double result)
+{
+    asyncTestOtherProb = Prob(asyncTestOtherSid, 0U);
+    ++asyncTestCallbacks;
+}
+
+void DestroyAsyncCallback(uintq ticket, double result)
+{
+    destroy(asyncTestSid);
+    ++asyncTestCallbacks;
+}
+} // namespace
+
+TEST_CASE("test_pinvoke_async")
+{
+    // A blocking call waits for the simulator ID's queued asynchronous calls, so calls run in the order they're made.
+    asyncTestSid = init_count(2U, false);
+    const uintq before = ProbAsync(asyncTestSid, 0U, NULL);
+    X(asyncTestSid, 0U);
+    const uintq after = ProbAsync(asyncTestSid, 0U, NULL);
+    REQUIRE_FLOAT((real1_f)Prob(asyncTestSid, 0U), ONE_R1_F);
+    REQUIRE_FLOAT((real1_f)WaitAsync(before), ZERO_R1_F);
+    REQUIRE_FLOAT((real1_f)WaitAsync(after), ONE_R1_F);
+
+    // Waiting on a ticket with a callback returns after the callback does, (which has already released the ticket).
+    asyncTestCallbacks = 0;
+    const uintq withCallback = ProbAsync(asyncTestSid, 0U, CountAsyncCallback);
+    REQUIRE(WaitAsync(withCallback) == (double)REAL1_DEFAULT_ARG);
+    REQUIRE(asyncTestCallbacks == 1);
+
+    // A callback's blocking call on another simulator ID waits for that ID's queue, (here, a slow call, then M()).
+    asyncTestOtherSid = init_count(1U, false);
+    H(asyncTestOtherSid, 0U);
+    uintq q = 0U;
+    std::vector<uintq> shots(1U << 16U);
+    const uintq shotsTicket = MeasureShotsAsync(asyncTestOtherSid, 1U, &q, shots.size(), shots.data(), NULL);
+    const uintq measured = MAsync(asyncTestOtherSid, 0U, NULL);
+    ProbAsync(asyncTestSid, 0U, ReadOtherAsyncCallback);
+    FinishAsync(asyncTestSid);
+    REQUIRE(asyncTestCallbacks == 2);
+    WaitAsync(shotsTicket);
+    REQUIRE_FLOAT((real1_f)asyncTestOtherProb, (real1_f)WaitAsync(measured));
+
+    // A callback can destroy its own simulator ID.
+    ProbAsync(asyncTestSid, 0U, DestroyAsyncCallback);
+    FinishAsync(asyncTestSid);
+    REQUIRE(asyncTestCallbacks == 3);
+    const uintq sid = init_count(1U, false);
+    REQUIRE_FLOAT((real1_f)Prob(sid, 0U), ZERO_R1_F);
+    REQUIRE(get_error(sid) == 0);
+    destroy(sid);
+    destroy(asyncTestOtherSid);
+}
+#endif
+#endif
+
+TEST_CASE("test_engine_profile")
+{
+    EngineProfile profile;
+    profile.MeasureCpu(1U, 4U);
+    REQUIRE(profile.GetCpu().apply2x2.size() == 4U);
+    REQUIRE(profile.GetCpu().bandwidth > 0.0);
+
+    // A synthetic device that overtakes the CPU at 3 qubits
+    DeviceProfile& dp = profile.GetDevice(0);
+    for (bitLenInt qb = 1U; qb <= 4U; ++qb) {
+        profile.GetCpu().apply2x2[qb] = std::ldexp(1e-6, qb);
+        dp.apply2x2[qb] = (qb < 3U) ? 1e-3 : 1e-7;
+    }
+    dp.maxQubits = 20U;
+    REQUIRE(profile.GetGpuThresholdQubits(0, 99U) == 3U);
+    REQUIRE(profile.GetGpuThresholdQubits(1, 99U) == 99U);
+    REQUIRE(dp.Apply2x2Time(6U) == Approx(4e-7));
+
+    const std::string path = "engine_profile_test.txt";
+    profile.Save(path);
+    EngineProfile loaded;
+    REQUIRE(loaded.Load(path));
+    std::remove(path.c_str());
+    REQUIRE(loaded.GetGpuThresholdQubits(0, 99U) == 3U);
+    REQUIRE(loaded.GetMaxQubits(0, 0U) == 20U);
+    REQUIRE(loaded.GetDevice(0).apply2x2[4U] == Approx(1e-7));
+    REQUIRE(!loaded.Load("nonexistent_engine_profile.txt"));
+}
+
+TEST_CASE("test_instrumentation")
+{
+    Instrumentation stats;
+    const Instrumentation::Clock::time_point start = Instrumentation::Clock::now();
+    stats.Record("QEngineOCL", "Kernel", 2e-6);
+    stats.SetTracing(true);
+    stats.Record("QUnit", "Mtrx", start, start + std::chrono::microseconds(5));
+    stats.Record("QUnit", "Mtrx", start, start + std::chrono::microseconds(3));
+
+    std::map<std::string, InstrumentationStat> s = stats.GetStats();
+    REQUIRE(s.size() == 2U);
+    REQUIRE(s["QUnit::Mtrx"].calls == 2U);
+    REQUIRE(s["QUnit::Mtrx"].seconds == Approx(8e-6));
+    REQUIRE(s["QEngineOCL::Kernel"].calls == 1U);
+
+    // Device-only records have no host time span, so only the two scoped records are traced.
+    std::stringstream trace;
+    stats.WriteChromeTrace(trace);
+    const std::string json = trace.str();
+    REQUIRE(json.find("{\"traceEvents\":[") == 0U);
+    REQUIRE(json.find("\"name\":\"QUnit::Mtrx\"") != std::string::npos);
+    REQUIRE(json.find("\"dur\":5.000") != std::string::npos);
+    REQUIRE(json.find("QEngineOCL::Kernel") == std::string::npos);
+
+    stats.Reset();
+    REQUIRE(stats.GetStats().empty());
+
+    if (Instrumentation::IsEnabled()) {
+        Instrumentation::Instance().Reset();
+        QInterfacePtr qReg = CreateQuantumInterface(QINTERFACE_QUNIT, QINTERFACE_CPU, 2U, 0U);
+        const complex mtrx[4U] = { SQRT1_2_R1, SQRT1_2_R1, SQRT1_2_R1, -SQRT1_2_R1 };
+        qReg->Mtrx(mtrx, 0U);
+        qReg->CNOT(0U, 1U);
+        qReg->Prob(1U);
+        s = Instrumentation::Instance().GetStats();
+        REQUIRE(s["QUnit::Mtrx"].calls > 0U);
+        REQUIRE(s["QUnit::EntangleInCurrentBasis"].calls > 0U);
+        REQUIRE(s["QUnit::Prob"].calls == 1U);
+    }
+}
+
+TEST_CASE("test_counter_rng")
+{
+    // Philox4x32-10 known-answer vectors, (from the Random123 distribution)
+    uint32_t ctr[4U] = { 0U, 0U, 0U, 0U };
+    const uint32_t key[2U] = { 0U, 0U };
+    Philox4x32(ctr, key);
+    REQUIRE(ctr[0U] == 0x6627e8d5U);
+    REQUIRE(ctr[1U] == 0xe169c58dU);
+    REQUIRE(ctr[2U] == 0xbc57ac4cU);
+    REQUIRE(ctr[3U] == 0x9b00dbd8U);
+
+    uint32_t ctr2[4U] = { 0x243f6a88U, 0x85a308d3U, 0x13198a2eU, 0x03707344U };
+    const uint32_t key2[2U] = { 0xa4093822U, 0x299f31d0U };
+    Philox4x32(ctr2, key2);
+    REQUIRE(ctr2[0U] == 0xd16cfe09U);
+    REQUIRE(ctr2[1U] == 0x94fdccebU);
+    REQUIRE(ctr2[2U] == 0x5001e420U);
+    REQUIRE(ctr2[3U] == 0x24126ea1U);
+
+    // Draws are a pure function of (seed, stream, counter).
+    CounterRng a(12345U, 7U);
+    std::vector<uint64_t> draws(5U);
+    for (size_t i = 0U; i < draws.size(); ++i) {
+        draws[i] = a();
+    }
+    CounterRng b(12345U, 7U);
+    b.Seek(3U);
+    REQUIRE(b() == draws[3U]);
+    REQUIRE(b() == draws[4U]);
+    CounterRng c(12345U, 8U);
+    REQUIRE(c() != draws[0U]);
+    for (size_t i = 0U; i < 1000U; ++i) {
+        const real1_f r = c.NextReal();
+        REQUIRE(r >= ZERO_R1_F);
+        REQUIRE(r < ONE_R1_F);
+    }
+
+    // Shot sampling from one seeded generator repeats exactly, however many threads run it.
+    const std::vector<bitCapInt> qPowers = { 1U, 2U, 4U, 8U };
+    std::vector<std::vector<unsigned long long>> results;
+    for (unsigned threads = 1U; threads <= 4U; threads += 3U) {
+        qrack_rand_gen_ptr gen = std::make_shared<qrack_rand_gen>(42U);
+        QInterfacePtr qReg =
+            CreateQuantumInterface(QINTERFACE_CPU, 4U, 0U, gen, CMPLX_DEFAULT_ARG, false, true, false, -1, false);
+        qReg->SetConcurrencyLevel(threads);
+        qReg->H(0U, 4U);
+        std::vector<unsigned long long> shots(10000U);
+        qReg->MultiShotMeasureMask(qPowers, (unsigned)shots.size(), shots.data());
+        results.push_back(shots);
+    }
+    REQUIRE(results[0U] == results[1U]);
+}
+
+#if ENABLE_ENV_VARS && !defined(_WIN32)
+TEST_CASE("test_qpager_spill")
+{
+    // 16 memory-mapped CPU pages of 3 qubits each, with at most 2 resident at once
+    setenv("QRACK_QPAGER_SPILL_PATH", "/tmp", 1);
+    setenv("QRACK_QPAGER_RESIDENT_PAGES", "2", 1);
+    QInterfacePtr paged = std::make_shared<QPager>(std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, 7U, 0U, nullptr,
+        ONE_CMPLX, false, false, false, -1, true, false, REAL1_EPSILON, std::vector<int64_t>{}, 3U);
+    unsetenv("QRACK_QPAGER_SPILL_PATH");
+    unsetenv("QRACK_QPAGER_RESIDENT_PAGES");
+    QInterfacePtr ram = std::make_shared<QEngineCPU>(7U, 0U, nullptr, ONE_CMPLX, false, false);
+
+    for (bitLenInt q = 0U; q < 7U; ++q) {
+        paged->H(q);
+        ram->H(q);
+        paged->T(q);
+        ram->T(q);
+    }
+    for (bitLenInt q = 0U; q < 6U; ++q) {
+        paged->CNOT(q, q + 1U);
+        ram->CNOT(q, q + 1U);
+    }
+    paged->Swap(1U, 6U);
+    ram->Swap(1U, 6U);
+    paged->ISwap(4U, 5U);
+    ram->ISwap(4U, 5U);
+    paged->RY(0.3f, 5U);
+    ram->RY(0.3f, 5U);
+
+    REQUIRE_FLOAT(paged->Prob(6U), ram->Prob(6U));
+    for (bitCapIntOcl i = 0U; i < 128U; ++i) {
+        REQUIRE_CMPLX(paged->GetAmplitude(i), ram->GetAmplitude(i));
+    }
+}
+#endif
+
+TEST_CASE("test_qpager_compress")
+{
+    // The codec is exact, bit for bit, through zero runs, (overlapping) repeats, negative zero, and literals.
+    const bitCapIntOcl cap = 1024U;
+    std::vector<complex> amps(cap, ZERO_CMPLX);
+    for (bitCapIntOcl i = 0U; i < cap; ++i) {
+        if (i < 256U) {
+            amps[i] = complex(ONE_R1 / 16, (i & 1U) ? -ZERO_R1 : ZERO_R1);
+        } else if (i >= 768U) {
+            amps[i] = complex((real1)std::sin((real1_f)i), (real1)std::cos((real1_f)i * 3));
+        }
+    }
+    const std::vector<unsigned char> blob = CompressAmplitudes(amps.data(), cap);
+    REQUIRE(blob.size() < ((sizeof(complex) * cap) / 3U));
+    std::vector<complex> inflated(cap);
+    DecompressAmplitudes(blob, inflated.data(), cap);
+    REQUIRE(!std::memcmp(amps.data(), inflated.data(), sizeof(complex) * cap));
+
+    // An evicted engine compresses in RAM, and inflates itself on its next gate.
+    QEngineCPUPtr compressed = std::make_shared<QEngineCPU>(8U, 0U, nullptr, ONE_CMPLX, false, false);
+    QEngineCPUPtr ram = std::make_shared<QEngineCPU>(8U, 0U, nullptr, ONE_CMPLX, false, false);
+    compressed->SetCompressEvicted(true);
+    compressed->H(0U, 6U);
+    ram->H(0U, 6U);
+    compressed->EvictStateVec();
+    compressed->CNOT(2U, 7U);
+    ram->CNOT(2U, 7U);
+    compressed->EvictStateVec();
+    compressed->PrefetchStateVec();
+    compressed->RY(0.4f, 7U);
+    ram->RY(0.4f, 7U);
+    compressed->EvictStateVec();
+    for (bitCapIntOcl i = 0U; i < 256U; ++i) {
+        REQUIRE_CMPLX(compressed->GetAmplitude(i), ram->GetAmplitude(i));
+    }
+
+#if ENABLE_ENV_VARS && !defined(_WIN32)
+    // 16 CPU pages of 3 qubits each, with at most 2 left uncompressed
+    setenv("QRACK_QPAGER_COMPRESS", "1", 1);
+    setenv("QRACK_QPAGER_RESIDENT_PAGES", "2", 1);
+    QInterfacePtr paged = std::make_shared<QPager>(std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, 7U, 0U, nullptr,
+        ONE_CMPLX, false, false, false, -1, true, false, REAL1_EPSILON, std::vector<int64_t>{}, 3U);
+    unsetenv("QRACK_QPAGER_COMPRESS");
+    unsetenv("QRACK_QPAGER_RESIDENT_PAGES");
+    QInterfacePtr flat = std::make_shared<QEngineCPU>(7U, 0U, nullptr, ONE_CMPLX, false, false);
+
+    for (bitLenInt q = 0U; q < 7U; ++q) {
+        paged->H(q);
+        flat->H(q);
+        paged->T(q);
+        flat->T(q);
+    }
+    for (bitLenInt q = 0U; q < 6U; ++q) {
+        paged->CNOT(q, q + 1U);
+        flat->CNOT(q, q + 1U);
+    }
+    paged->Swap(1U, 6U);
+    flat->Swap(1U, 6U);
+    paged->RY(0.3f, 5U);
+    flat->RY(0.3f, 5U);
+
+    REQUIRE_FLOAT(paged->Prob(6U), flat->Prob(6U));
+    for (bitCapIntOcl i = 0U; i < 128U; ++i) {
+        REQUIRE_CMPLX(paged->GetAmplitude(i), flat->GetAmplitude(i));
+    }
+#endif
+}
+
+TEST_CASE("test_qpager_adaptive_qubit_map")
+{
+    // 16 CPU pages of 3 qubits each, so most of these gates target "global" qubits, which the map moves into pages.
+    QPagerPtr paged = std::make_shared<QPager>(std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, 7U, 0U, nullptr,
+        ONE_CMPLX, false, false, false, -1, true, false, REAL1_EPSILON, std::vector<int64_t>{}, 3U);
+    paged->SetAdaptiveQubitMap(true);
+    QInterfacePtr ram = std::make_shared<QEngineCPU>(7U, 0U, nullptr, ONE_CMPLX, false, false);
+
+    for (bitLenInt q = 0U; q < 7U; ++q) {
+        paged->H(q);
+        ram->H(q);
+        paged->RY(0.2f * (q + 1U), q);
+        ram->RY(0.2f * (q + 1U), q);
+    }
+    for (bitLenInt q = 0U; q < 6U; ++q) {
+        paged->CNOT(6U - q, 5U - q);
+        ram->CNOT(6U - q, 5U - q);
+        paged->RX(0.4f, 6U - q);
+        ram->RX(0.4f, 6U - q);
+    }
+    paged->Swap(0U, 6U);
+    ram->Swap(0U, 6U);
+    paged->ISwap(1U, 5U);
+    ram->ISwap(1U, 5U);
+    paged->XMask(0x51U);
+    ram->XMask(0x51U);
+    paged->ZMask(0x23U);
+    ram->ZMask(0x23U);
+    paged->CCNOT(0U, 4U, 6U);
+    ram->CCNOT(0U, 4U, 6U);
+
+    REQUIRE_FLOAT(paged->Prob(6U), ram->Prob(6U));
+    REQUIRE_FLOAT(paged->ProbMask(0x41U, 0x40U), ram->ProbMask(0x41U, 0x40U));
+    for (bitCapIntOcl i = 0U; i < 128U; ++i) {
+        REQUIRE_CMPLX(paged->GetAmplitude(i), ram->GetAmplitude(i));
+    }
+
+    paged->ForceM(5U, true);
+    ram->ForceM(5U, true);
+    std::unique_ptr<complex[]> pagedState(new complex[128U]);
+    std::unique_ptr<complex[]> ramState(new complex[128U]);
+    paged->GetQuantumState(pagedState.get());
+    ram->GetQuantumState(ramState.get());
+    for (bitCapIntOcl i = 0U; i < 128U; ++i) {
+        REQUIRE_CMPLX(pagedState[i], ramState[i]);
+    }
+}
+
+TEST_CASE("test_qpager_mixed_page_types")
+{
+    // Pages of different engine types, (as in CPU+GPU co-execution,) exchange amplitudes through the QEngine interface.
+    std::unique_ptr<complex[]> hostState(new complex[8U]);
+    std::unique_ptr<complex[]> otherState(new complex[8U]);
+    for (bitCapIntOcl i = 0U; i < 8U; ++i) {
+        hostState[i] = complex((real1)(i + 1U), ZERO_R1);
+        otherState[i] = complex(ZERO_R1, -(real1)(i + 1U));
+    }
+
+    QEngineCPUPtr host = std::make_shared<QEngineCPU>(3U, 0U, nullptr, ONE_CMPLX, false, false);
+    QEnginePtr other = std::make_shared<QPager>(std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, 3U, 0U, nullptr,
+        ONE_CMPLX, false, false, false, -1, true, false, REAL1_EPSILON, std::vector<int64_t>{}, 2U);
+    host->SetQuantumState(hostState.get());
+    other->SetQuantumState(otherState.get());
+
+    host->ShuffleBuffers(other);
+    for (bitCapIntOcl i = 0U; i < 4U; ++i) {
+        REQUIRE_CMPLX(host->GetAmplitude(i), hostState[i]);
+        REQUIRE_CMPLX(host->GetAmplitude(i + 4U), otherState[i]);
+        REQUIRE_CMPLX(other->GetAmplitude(i), hostState[i + 4U]);
+        REQUIRE_CMPLX(other->GetAmplitude(i + 4U), otherState[i + 4U]);
+    }
+
+    host->SetAmplitudePage(other, 2U, 1U, 4U);
+    REQUIRE_CMPLX(host->GetAmplitude(0U), hostState[0U]);
+    REQUIRE_CMPLX(host->GetAmplitude(1U), hostState[6U]);
+    REQUIRE_CMPLX(host->GetAmplitude(2U), hostState[7U]);
+    REQUIRE_CMPLX(host->GetAmplitude(3U), otherState[4U]);
+    REQUIRE_CMPLX(host->GetAmplitude(4U), otherState[5U]);
+    REQUIRE_CMPLX(host->GetAmplitude(5U), otherState[1U]);
+}
+
+#if ENABLE_MPI
+TEST_CASE("test_qpager_mpi")
+{
+    // Run under "mpirun -np <2^n>" to exercise rank-global qubits; every rank checks the same full state.
+    QInterfacePtr distributed =
+        std::make_shared<QPagerMpi>(std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, 6U, 0U, nullptr, ONE_CMPLX);
+    QInterfacePtr ram = std::make_shared<QEngineCPU>(6U, 0U, nullptr, ONE_CMPLX, false, false);
+
+    for (bitLenInt q = 0U; q < 6U; ++q) {
+        distributed->H(q);
+        ram->H(q);
+        distributed->T(q);
+        ram->T(q);
+    }
+    for (bitLenInt q = 0U; q < 5U; ++q) {
+        distributed->CNOT(q + 1U, q);
+        ram->CNOT(q + 1U, q);
+    }
+    distributed->CY(4U, 5U);
+    ram->CY(4U, 5U);
+    distributed->CZ(5U, 0U);
+    ram->CZ(5U, 0U);
+    distributed->Swap(0U, 5U);
+    ram->Swap(0U, 5U);
+    distributed->ISwap(4U, 5U);
+    ram->ISwap(4U, 5U);
+    distributed->FSim(0.3f, 0.7f, 1U, 5U);
+    ram->FSim(0.3f, 0.7f, 1U, 5U);
+    distributed->RY(0.3f, 5U);
+    ram->RY(0.3f, 5U);
+
+    REQUIRE_FLOAT(distributed->Prob(5U), ram->Prob(5U));
+    REQUIRE_FLOAT(distributed->ProbMask(0x21U, 0x20U), ram->ProbMask(0x21U, 0x20U));
+    for (bitCapIntOcl i = 0U; i < 64U; ++i) {
+        REQUIRE_CMPLX(distributed->GetAmplitude(i), ram->GetAmplitude(i));
+    }
+
+    REQUIRE(distributed->ForceM(5U, true) == ram->ForceM(5U, true));
+    REQUIRE(distributed->ForceM(0U, false) == ram->ForceM(0U, false));
+    REQUIRE_FLOAT(distributed->SumSqrDiff(distributed->Clone()), ZERO_R1_F);
+    for (bitCapIntOcl i = 0U; i < 64U; ++i) {
+        REQUIRE_CMPLX(distributed->GetAmplitude(i), ram->GetAmplitude(i));
+    }
+
+    // Qubits below the rank-global ones compose and decompose within each rank's own slice.
+    QInterfacePtr part = std::make_shared<QEngineCPU>(2U, 0U, nullptr, ONE_CMPLX, false, false);
+    part->H(0U);
+    part->CNOT(0U, 1U);
+    part->T(1U);
+    REQUIRE(distributed->Compose(part->Clone(), 1U) == 1U);
+    ram->Compose(part->Clone(), 1U);
+    for (bitCapIntOcl i = 0U; i < 256U; ++i) {
+        REQUIRE_CMPLX(distributed->GetAmplitude(i), ram->GetAmplitude(i));
+    }
+    QInterfacePtr partCopy = distributed->Decompose(1U, 2U);
+    ram->Dispose(1U, 2U);
+    REQUIRE(distributed->GetQubitCount() == 6U);
+    REQUIRE(partCopy->SumSqrDiff(part) < 1e-6f);
+    complex overlap = ZERO_CMPLX;
+    for (bitCapIntOcl i = 0U; i < 64U; ++i) {
+        overlap += conj(ram->GetAmplitude(i)) * distributed->GetAmplitude(i);
+    }
+    REQUIRE_FLOAT((real1_f)norm(overlap), ONE_R1_F);
+
+    // QUnit composes and decomposes its units over their whole width, so it rejects QPagerMpi up front.
+    REQUIRE_THROWS_AS(CreateQuantumInterface({ QINTERFACE_QUNIT, QINTERFACE_QPAGER_MPI, QINTERFACE_CPU }, 8U, 0U),
+        std::invalid_argument);
+}
+#endif
+
+TEST_CASE("test_workload_fidelity_streaming")
+{
+    // The "[workload]" benchmarks measure fidelity by streaming the tested state, with ForEachAmplitudeChunk(), against
+    // a QEngineCPU reference that replays the same seeded circuit. On paged and QUnit stacks, that comes to 1, and an
+    // extra gate on either side shows up.
+    const bitLenInt qb = 8U;
+    const auto quantumVolume = [](QInterfacePtr qReg, bitLenInt n) {
+        std::mt19937 gen(5489U);
+        std::uniform_real_distribution<real1_f> angle(ZERO_R1_F, 2 * PI_R1);
+        std::vector<bitLenInt> perm(n);
+        for (bitLenInt d = 0U; d < n; ++d) {
+            std::iota(perm.begin(), perm.end(), 0U);
+            std::shuffle(perm.begin(), perm.end(), gen);
+            for (bitLenInt i = 1U; i < n; i += 2U) {
+                for (int j = 0; j < 3; ++j) {
+                    for (bitLenInt q : { perm[i - 1U], perm[i] }) {
+                        const real1_f theta = angle(gen);
+                        const real1_f phi = angle(gen);
+                        const real1_f lambda = angle(gen);
+                        qReg->U(q, theta, phi, lambda);
+                    }
+                    qReg->CNOT((j & 1) ? perm[i] : perm[i - 1U], (j & 1) ? perm[i - 1U] : perm[i]);
+                }
+            }
+        }
+    };
+    const auto fidelity = [&](QInterfacePtr qReg, QEnginePtr reference) {
+        std::vector<complex> refChunk;
+        complex overlap = ZERO_CMPLX;
+        qReg->ForEachAmplitudeChunk(0U, qReg->GetMaxQPower(),
+            [&](const bitCapInt& offset, const bitCapIntOcl& length, complex const* amps) {
+                refChunk.resize(length);
+                reference->GetAmplitudePage(&(refChunk[0U]), (bitCapIntOcl)offset, length);
+                for (bitCapIntOcl i = 0U; i < length; ++i) {
+                    overlap += conj(refChunk[i]) * amps[i];
+                }
+            },
+            16U);
+        return (real1_f)norm(overlap);
+    };
+
+    QEnginePtr reference = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+    quantumVolume(reference, qb);
+    // (Pages of 3 qubits, so most gates cross pages)
+    const std::vector<QInterfacePtr> stacks{ std::make_shared<QPager>(std::vector<QInterfaceEngine>{ QINTERFACE_CPU },
+                                                 qb, 0U, nullptr, ONE_CMPLX, false, false, false, -1, true, false,
+                                                 REAL1_EPSILON, std::vector<int64_t>{}, 3U),
+        CreateQuantumInterface({ QINTERFACE_QUNIT, QINTERFACE_CPU }, qb, 0U, nullptr, ONE_CMPLX, false, false) };
+    for (QInterfacePtr qReg : stacks) {
+        quantumVolume(qReg, qb);
+        REQUIRE_FLOAT(fidelity(qReg, reference), ONE_R1_F);
+        qReg->H(0U);
+        REQUIRE(fidelity(qReg, reference) < 0.99f);
+    }
+}
+
+TEST_CASE("test_qbatch")
+{
+    // 5 registers of 4 qubits, each with its own rotation angles, checked against independent engines
+    const bitCapIntOcl batchCount = 5U;
+    QBatch batch(4U, batchCount, 0U, nullptr, false);
+    std::vector<QInterfacePtr> engines;
+    std::vector<real1_f> angles(batchCount);
+    for (bitCapIntOcl b = 0U; b < batchCount; ++b) {
+        engines.push_back(std::make_shared<QEngineCPU>(4U, 0U, nullptr, ONE_CMPLX, false, false));
+        angles[b] = 0.4f * (b + 1U);
+    }
+
+    for (bitLenInt q = 0U; q < 4U; ++q) {
+        batch.H(q);
+        batch.RYBatch(&(angles[0U]), q);
+    }
+    batch.CNOT(0U, 3U);
+    batch.CZ(2U, 1U);
+    batch.RZBatch(&(angles[0U]), 3U);
+    for (bitCapIntOcl b = 0U; b < batchCount; ++b) {
+        for (bitLenInt q = 0U; q < 4U; ++q) {
+            engines[b]->H(q);
+            engines[b]->RY(angles[b], q);
+        }
+        engines[b]->CNOT(0U, 3U);
+        engines[b]->CZ(2U, 1U);
+        engines[b]->RZ(angles[b], 3U);
+    }
+
+    for (bitCapIntOcl b = 0U; b < batchCount; ++b) {
+        REQUIRE_FLOAT(batch.Prob(b, 3U), engines[b]->Prob(3U));
+        for (bitCapIntOcl i = 0U; i < 16U; ++i) {
+            REQUIRE_CMPLX(batch.GetAmplitude(b, i), engines[b]->GetAmplitude(i));
+        }
+    }
+
+    // After X on every qubit from |0>, every shot of every register reads all ones.
+    batch.SetPermutation(0U);
+    for (bitLenInt q = 0U; q < 4U; ++q) {
+        batch.X(q);
+    }
+    const unsigned shots = 16U;
+    std::vector<unsigned long long> results(batchCount * shots);
+    batch.MultiShotMeasureMask({ 1U, 4U, 8U }, shots, &(results[0U]));
+    for (size_t i = 0U; i < results.size(); ++i) {
+        REQUIRE(results[i] == 7U);
+    }
+}
+
+// QStabilizerOCL, when run under --proc-stabilizer-ocl, or otherwise QStabilizer
+QStabilizerPtr MakeStabilizer(bitLenInt qubitCount, bitCapInt perm = 0U)
+{
+    return std::dynamic_pointer_cast<QStabilizer>(CreateQuantumInterface(QINTERFACE_STABILIZER, qubitCount, perm,
+        nullptr, CMPLX_DEFAULT_ARG, false, false, false, (testEngineType == QINTERFACE_STABILIZER) ? device_id : -1));
+}
+
+TEST_CASE("test_stabilizer_packed_rows", "[stabilizer]")
+{
+    // 70 qubits spans two tableau words per row; entangle, compose, and decompose across the word boundary.
+    QStabilizerPtr stabilizer = MakeStabilizer(70U);
+    stabilizer->H(62U);
+    for (bitLenInt q = 63U; q < 67U; ++q) {
+        stabilizer->CNOT(q - 1U, q);
+    }
+    stabilizer->X(69U);
+    REQUIRE_FLOAT(stabilizer->Prob(66U), 0.5);
+    REQUIRE_FLOAT(stabilizer->Prob(69U), 1.0);
+
+    QStabilizerPtr toCompose = MakeStabilizer(2U, 1U);
+    stabilizer->Compose(toCompose, 64U);
+    REQUIRE(stabilizer->GetQubitCount() == 72U);
+    REQUIRE_FLOAT(stabilizer->Prob(64U), 1.0);
+    REQUIRE_FLOAT(stabilizer->Prob(65U), 0.0);
+    REQUIRE_FLOAT(stabilizer->Prob(71U), 1.0);
+
+    QStabilizerPtr decomposed = MakeStabilizer(2U);
+    stabilizer->Decompose(64U, decomposed);
+    REQUIRE(stabilizer->GetQubitCount() == 70U);
+    REQUIRE_FLOAT(decomposed->Prob(0U), 1.0);
+    REQUIRE_FLOAT(decomposed->Prob(1U), 0.0);
+
+    const bool result = stabilizer->M(62U);
+    for (bitLenInt q = 63U; q < 67U; ++q) {
+        REQUIRE(stabilizer->M(q) == result);
+    }
+    REQUIRE(stabilizer->M(69U));
+}
+
+TEST_CASE("test_stabilizer_parallel_state", "[stabilizer]")
+{
+    // 2^14 basis states, walked in parallel chunks that each seed their own scratch row, must agree with the serial
+    // walk of GetAmplitude(), whether written to an array or scattered into an engine.
+    const bitLenInt n = 14U;
+    QStabilizerPtr stabilizer = MakeStabilizer(n);
+    stabilizer->SetConcurrency(4U);
+    for (bitLenInt q = 0U; q < n; ++q) {
+        stabilizer->H(q);
+        if (q & 1U) {
+            stabilizer->S(q);
+            stabilizer->CNOT(q, q - 1U);
+        }
+    }
+    stabilizer->CZ(0U, n - 1U);
+
+    std::unique_ptr<complex[]> state(new complex[pow2Ocl(n)]);
+    stabilizer->GetQuantumState(state.get());
+    QInterfacePtr engine = CreateQuantumInterface(QINTERFACE_CPU, n, 0U);
+    stabilizer->GetQuantumState(engine);
+
+    for (bitCapIntOcl i = 0U; i < pow2Ocl(n); i += 37U) {
+        const complex amp = stabilizer->GetAmplitude(i);
+        REQUIRE_FLOAT(real(state[i]), real(amp));
+        REQUIRE_FLOAT(imag(state[i]), imag(amp));
+        REQUIRE_FLOAT(real(engine->GetAmplitude(i)), real(amp));
+        REQUIRE_FLOAT(imag(engine->GetAmplitude(i)), imag(amp));
+    }
+}
+
+TEST_CASE("test_stabilizer_tableau_shots", "[stabilizer]")
+{
+    // A GHZ state on qubits 0 to 5, a deterministic |1> on qubit 6, and a uniformly random qubit 7, sampled from the
+    // tableau, across several parallel shot blocks
+    const unsigned shots = 10000U;
+    QStabilizerPtr stabilizer = MakeStabilizer(8U);
+    stabilizer->SetConcurrency(4U);
+    stabilizer->H(0U);
+    for (bitLenInt q = 1U; q < 6U; ++q) {
+        stabilizer->CNOT(q - 1U, q);
+    }
+    stabilizer->X(6U);
+    stabilizer->H(7U);
+    stabilizer->S(7U);
+
+    const std::vector<bitCapInt> qPowers{ 1U, 32U, 64U, 128U };
+    std::unique_ptr<unsigned long long[]> results(new unsigned long long[shots]);
+    stabilizer->MultiShotMeasureMask(qPowers, shots, results.get());
+
+    unsigned counts[16U] = { 0U };
+    for (unsigned shot = 0U; shot < shots; ++shot) {
+        REQUIRE(results[shot] < 16U);
+        ++(counts[results[shot]]);
+    }
+    for (size_t i = 0U; i < 16U; ++i) {
+        const bool isSupported = ((i & 3U) == 0U || (i & 3U) == 3U) && (i & 4U);
+        if (isSupported) {
+            REQUIRE(counts[i] > (shots / 5U));
+        } else {
+            REQUIRE(counts[i] == 0U);
+        }
+    }
+
+    // The tableau is untouched.
+    REQUIRE_FLOAT(stabilizer->Prob(6U), ONE_R1_F);
+    REQUIRE_FLOAT(stabilizer->Prob(0U), ONE_R1_F / 2);
+}
+
+TEST_CASE("test_stabilizer_frames")
+{
+    const unsigned shots = 1000U;
+    for (size_t frameWidth = 64U; frameWidth <= 512U; frameWidth <<= 3U) {
+        QStabilizerFrames frames(4U, frameWidth, nullptr, false);
+        // Bell pair, a deterministic |1>, and certain X noise before the last measurement
+        frames.H(0U);
+        frames.CNOT(0U, 1U);
+        frames.X(2U);
+        frames.CNOT(0U, 3U);
+        frames.XError(3U, ONE_R1_F);
+        frames.M(0U);
+        frames.M(1U);
+        frames.M(2U);
+        frames.M(3U);
+        // A fresh random outcome, after collapse
+        frames.H(0U);
+        frames.M(0U);
+        REQUIRE(frames.GetRecordWords() == 1U);
+
+        std::vector<unsigned long long> records(shots);
+        frames.MeasureShots(shots, &(records[0U]));
+        unsigned ones0 = 0U;
+        unsigned ones4 = 0U;
+        for (unsigned i = 0U; i < shots; ++i) {
+            const unsigned long long rec = records[i];
+            REQUIRE((rec >> 5U) == 0U);
+            REQUIRE(((rec >> 1U) & 1U) == (rec & 1U));
+            REQUIRE(((rec >> 2U) & 1U) == 1U);
+            REQUIRE(((rec >> 3U) & 1U) != (rec & 1U));
+            ones0 += rec & 1U;
+            ones4 += (rec >> 4U) & 1U;
+        }
+        REQUIRE(ones0 > 400U);
+        REQUIRE(ones0 < 600U);
+        REQUIRE(ones4 > 400U);
+        REQUIRE(ones4 < 600U);
+    }
+
+    // Independent measurement flips at a low rate
+    QStabilizerFrames noisy(1U, 256U, nullptr, false);
+    noisy.M(0U, 0.1f);
+    std::vector<unsigned long long> records(2000U);
+    noisy.MeasureShots(2000U, &(records[0U]));
+    unsigned flips = 0U;
+    for (size_t i = 0U; i < records.size(); ++i) {
+        flips += records[i] & 1U;
+    }
+    REQUIRE(flips > 140U);
+    REQUIRE(flips < 260U);
+}
+
+TEST_CASE("test_noise_trajectories")
+{
+    const real1_f gamma = 0.2f;
+    const std::vector<complex> damping = QNoiseModel::AmplitudeDampingKraus(gamma);
+
+    // One step of amplitude damping, on RY(theta)|0>, branch by branch
+    const real1_f theta = 1.2f;
+    const real1_f sinSqr = (real1_f)(sin(theta / 2) * sin(theta / 2));
+    QInterfacePtr q = std::make_shared<QEngineCPU>(2U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    q->RY(theta, 1U);
+    real1_f probs[2U];
+    q->KrausProbs1Qb(damping, 1U, probs);
+    REQUIRE_FLOAT(probs[1U], gamma * sinSqr);
+    REQUIRE_FLOAT(probs[0U], ONE_R1_F - gamma * sinSqr);
+    QInterfacePtr jumped = q->Clone();
+    jumped->ApplyKraus1Qb(&(damping[4U]), 1U);
+    REQUIRE_FLOAT(jumped->Prob(1U), ZERO_R1_F);
+    q->ApplyKraus1Qb(&(damping[0U]), 1U);
+    REQUIRE_FLOAT(q->Prob(1U), (ONE_R1_F - gamma) * sinSqr / (ONE_R1_F - gamma * sinSqr));
+    REQUIRE(q->GetQubitCount() == 2U);
+
+    // X then CNOT: only the X decays, (single qubit gate noise,) so the outcomes are |11> or |00>.
+    QCircuitPtr circuit = std::make_shared<QCircuit>();
+    circuit->X(0U);
+    circuit->CNOT(0U, 1U);
+    QNoiseModel noise;
+    noise.SetGateNoise(1U, damping);
+    const unsigned shots = 2000U;
+    QInterfacePtr initial = std::make_shared<QEngineCPU>(2U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    std::map<bitCapInt, int> results = noise.RunTrajectories(circuit, initial, shots);
+    REQUIRE(results.size() == 2U);
+    REQUIRE((results[0U] + results[3U]) == (int)shots);
+    REQUIRE(results[0U] > 320);
+    REQUIRE(results[0U] < 480);
+
+    // Certain readout flips of |1>
+    noise.SetReadoutError(ZERO_R1_F, ONE_R1_F);
+    results = noise.RunTrajectories(circuit, initial, shots);
+    REQUIRE(results.size() == 1U);
+    REQUIRE(results[0U] == (int)shots);
+
+    REQUIRE_THROWS(noise.SetGateNoise(2U, std::vector<complex>{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX, ONE_CMPLX,
+        ZERO_CMPLX, ZERO_CMPLX, ZERO_CMPLX }));
+}
+
+TEST_CASE("test_density_matrix")
+{
+    // Noiseless, a density matrix tracks a state vector exactly.
+    QInterfacePtr rho = CreateQuantumInterface(
+        { QINTERFACE_DENSITY_MATRIX, QINTERFACE_CPU }, 3U, 1U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    QInterfacePtr psi = std::make_shared<QEngineCPU>(3U, 1U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    const auto circuit = [](QInterfacePtr q) {
+        q->H(0U);
+        q->CNOT(0U, 2U);
+        q->RY(0.7f, 1U);
+        q->T(1U);
+        q->FSim(0.3f, 0.9f, 1U, 2U);
+        q->Swap(0U, 1U);
+    };
+    circuit(rho);
+    circuit(psi);
+    REQUIRE(rho->SumSqrDiff(psi) < 0.0001f);
+    REQUIRE_FLOAT(rho->Prob(2U), psi->Prob(2U));
+    REQUIRE_FLOAT((real1_f)norm(rho->GetAmplitude(5U)), (real1_f)norm(psi->GetAmplitude(5U)));
+
+    QInterfacePtr part = CreateQuantumInterface(
+        { QINTERFACE_DENSITY_MATRIX, QINTERFACE_CPU }, 1U, 1U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    rho->Compose(part, 1U);
+    psi->Compose(std::make_shared<QEngineCPU>(1U, 1U, nullptr, CMPLX_DEFAULT_ARG, false, false), 1U);
+    REQUIRE(rho->GetQubitCount() == 4U);
+    REQUIRE(rho->SumSqrDiff(psi) < 0.0001f);
+
+    // Tracing out half of a Bell pair leaves the maximally mixed state.
+    QDensityMatrixPtr bell = std::make_shared<QDensityMatrix>(
+        std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, 2U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    bell->H(0U);
+    bell->CNOT(0U, 1U);
+    REQUIRE_FLOAT(bell->Purity(), ONE_R1_F);
+    bell->Dispose(1U, 1U);
+    REQUIRE_FLOAT(bell->Purity(), (real1_f)0.5f);
+    REQUIRE_FLOAT(bell->Prob(0U), (real1_f)0.5f);
+    REQUIRE_THROWS(bell->GetAmplitude(0U));
+
+    // Channels apply exactly, without sampling.
+    const real1_f gamma = 0.2f;
+    QDensityMatrixPtr noisy = std::make_shared<QDensityMatrix>(
+        std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, 2U, 3U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    noisy->KrausChannel1Qb(QNoiseModel::AmplitudeDampingKraus(gamma), 0U);
+    REQUIRE_FLOAT(noisy->Prob(0U), ONE_R1_F - gamma);
+    REQUIRE_FLOAT(noisy->Prob(1U), ONE_R1_F);
+    noisy->H(1U);
+    noisy->KrausChannel1Qb(QNoiseModel::DepolarizingKraus(0.3f), 1U);
+    noisy->H(1U);
+    // Depolarizing shrinks <X> of |-> from -1 to -(1 - 4p/3).
+    REQUIRE_FLOAT(noisy->Prob(1U), (real1_f)0.8f);
+    noisy->ForceM(0U, true);
+    REQUIRE_FLOAT(noisy->Prob(0U), ONE_R1_F);
+    REQUIRE_FLOAT(noisy->Prob(1U), (real1_f)0.8f);
+}
+
+TEST_CASE("test_prefix_cache")
+{
+    // A sweep that changes only the last layer resumes every run after the first from the shared prefix.
+    const auto circuit = [](QInterfacePtr q, real1_f angle) {
+        q->SetPermutation(0U);
+        for (bitLenInt i = 0U; i < 5U; ++i) {
+            q->H(i);
+        }
+        for (bitLenInt i = 0U; i < 4U; ++i) {
+            q->CNOT(i, i + 1U);
+        }
+        for (bitLenInt i = 0U; i < 5U; ++i) {
+            q->RZ(0.3f * (i + 1U), i);
+        }
+        for (bitLenInt i = 0U; i < 5U; ++i) {
+            q->RY(angle, i);
+        }
+    };
+
+    QInterfacePtr psi = std::make_shared<QEngineCPU>(5U, 0U, nullptr, ONE_CMPLX, false, false);
+    for (int useCheckpoints = 0; useCheckpoints < 2; ++useCheckpoints) {
+        QPrefixCachePtr cache = std::make_shared<QPrefixCache>(
+            std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, 5U, 0U, nullptr, ONE_CMPLX, false, false);
+        cache->SetSnapshotInterval(4U);
+        cache->SetUseCheckpoints(useCheckpoints != 0);
+        for (int run = 0; run < 4; ++run) {
+            circuit(cache, 0.2f * run);
+            circuit(psi, 0.2f * run);
+            REQUIRE(cache->SumSqrDiff(psi) < 0.0001f);
+        }
+        // The 14 gate prefix is snapshot at depths 4, 8 and 12, and each run's own layer at depth 16.
+        REQUIRE(cache->GetStore()->GetMisses() == 1U);
+        REQUIRE(cache->GetStore()->GetHits() == 3U);
+        REQUIRE(cache->GetStore()->GetEntryCount() == 7U);
+    }
+
+    // With room for only one snapshot, results are still exact, and the LRU stays within its bound.
+    QPrefixCachePtr cache = std::make_shared<QPrefixCache>(
+        std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, 5U, 0U, nullptr, ONE_CMPLX, false, false);
+    cache->SetSnapshotInterval(4U);
+    cache->GetStore()->SetMaxBytes(sizeof(complex) << 5U);
+    for (int run = 0; run < 3; ++run) {
+        circuit(cache, 0.2f * run);
+        circuit(psi, 0.2f * run);
+        REQUIRE(cache->SumSqrDiff(psi) < 0.0001f);
+        REQUIRE(cache->GetStore()->GetEntryCount() == 1U);
+    }
+
+    // Measurement stops caching until the next SetPermutation(), and clones share the store.
+    cache->M(0U);
+    cache->H(0U);
+    QInterfacePtr clone = cache->Clone();
+    REQUIRE(std::dynamic_pointer_cast<QPrefixCache>(clone)->GetStore() == cache->GetStore());
+    REQUIRE(clone->SumSqrDiff(cache) < 0.0001f);
+}
+
+TEST_CASE("test_dynamic_circuit")
+{
+    // Teleport RY(theta)|0> from qubit 0 to qubit 2, with feed-forward corrections.
+    const real1_f theta = 1.1f;
+    const real1 c = (real1)cos(theta / 2), s = (real1)sin(theta / 2);
+    const complex ry[4U]{ complex(c, ZERO_R1), complex(-s, ZERO_R1), complex(s, ZERO_R1), complex(c, ZERO_R1) };
+    QCircuitPtr prep = std::make_shared<QCircuit>();
+    prep->Mtrx(ry, 0U);
+    prep->H(1U);
+    prep->CNOT(1U, 2U);
+    prep->CNOT(0U, 1U);
+    prep->H(0U);
+    QCircuitPtr xFix = std::make_shared<QCircuit>();
+    xFix->X(2U);
+    QCircuitPtr zFix = std::make_shared<QCircuit>();
+    zFix->Z(2U);
+
+    QDynamicCircuit teleport;
+    teleport.AppendCircuit(prep);
+    teleport.M(0U, 0U);
+    teleport.M(1U, 1U);
+    teleport.AppendCircuit(xFix, 2U, 2U);
+    teleport.AppendCircuit(zFix, 1U, 1U);
+    teleport.M(2U, 2U);
+    REQUIRE(teleport.GetQubitCount() == 3U);
+    REQUIRE(teleport.GetClassicalBitCount() == 3U);
+
+    const unsigned shots = 4000U;
+    QInterfacePtr initial = std::make_shared<QEngineCPU>(3U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    std::map<bitCapInt, int> results = teleport.RunShots(initial, shots);
+    int total = 0, ones = 0;
+    for (const auto& r : results) {
+        total += r.second;
+        if ((bool)(r.first & 4U)) {
+            ones += r.second;
+        }
+    }
+    REQUIRE(total == (int)shots);
+    // sin^2(0.55) is about 0.27.
+    REQUIRE(ones > 980);
+    REQUIRE(ones < 1180);
+    // One branch per pair of mid-circuit outcomes, while the terminal readout is only sampled
+    REQUIRE(teleport.GetBranchCount() == 4U);
+    REQUIRE(initial->Prob(0U) == ZERO_R1_F);
+}
+
+TEST_CASE("test_stabilizer_rank")
+{
+    const complex tGate[4U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, complex((real1)SQRT1_2_R1, (real1)SQRT1_2_R1) };
+    const complex uGate[4U]{ complex((real1)0.6f, ZERO_R1), complex(ZERO_R1, (real1)-0.8f),
+        complex(ZERO_R1, (real1)-0.8f), complex((real1)0.6f, ZERO_R1) };
+    const auto circuit = [&](QInterfacePtr q, bool isToffoli) {
+        q->H(0U);
+        q->Mtrx(tGate, 0U);
+        q->CNOT(0U, 1U);
+        q->H(1U);
+        q->Mtrx(tGate, 1U);
+        q->H(2U);
+        q->CZ(1U, 2U);
+        q->Mtrx(tGate, 2U);
+        q->Mtrx(uGate, 3U);
+        q->CNOT(2U, 3U);
+        q->IT(0U);
+        if (isToffoli) {
+            q->CCNOT(0U, 1U, 3U);
+        }
+        q->H(3U);
+        q->H(1U);
+    };
+
+    QStabilizerRankPtr rank = std::make_shared<QStabilizerRank>(4U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    QInterfacePtr engine = std::make_shared<QEngineCPU>(4U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    circuit(rank, true);
+    circuit(engine, true);
+    REQUIRE(rank->GetRank() > 1U);
+    REQUIRE(rank->GetRank() <= 64U);
+
+    QInterfacePtr fromRank = std::make_shared<QEngineCPU>(4U, 0U);
+    rank->GetQuantumState(fromRank);
+    REQUIRE(fromRank->ApproxCompare(engine));
+    for (bitLenInt i = 0U; i < 4U; ++i) {
+        REQUIRE_FLOAT(rank->Prob(i), engine->Prob(i));
+    }
+    REQUIRE_FLOAT(norm(rank->GetAmplitude(5U)), norm(engine->GetAmplitude(5U)));
+
+    // A tensor product with a copy of itself, in the middle
+    QStabilizerRankPtr composed = std::dynamic_pointer_cast<QStabilizerRank>(rank->Clone());
+    composed->Compose(std::dynamic_pointer_cast<QStabilizer>(rank->Clone()), 2U);
+    QInterfacePtr engineComposed = engine->Clone();
+    engineComposed->Compose(engine->Clone(), 2U);
+    QInterfacePtr fromComposed = std::make_shared<QEngineCPU>(8U, 0U);
+    composed->GetQuantumState(fromComposed);
+    REQUIRE(fromComposed->ApproxCompare(engineComposed));
+
+    // Measurement projects the terms, without a state vector.
+    const bool result = !(engine->Prob(3U) > (ONE_R1 / 2));
+    rank->ForceM(3U, result);
+    engine->ForceM(3U, result);
+    for (bitLenInt i = 0U; i < 4U; ++i) {
+        REQUIRE_FLOAT(rank->Prob(i), engine->Prob(i));
+    }
+    rank->GetQuantumState(fromRank);
+    REQUIRE(fromRank->ApproxCompare(engine));
+
+    // Undoing every non-Clifford gate returns to a single stabilizer state.
+    rank->SetPermutation(0U);
+    rank->H(0U);
+    rank->T(0U);
+    REQUIRE(rank->GetRank() == 2U);
+    rank->IT(0U);
+    REQUIRE(rank->GetRank() == 1U);
+    REQUIRE_FLOAT(rank->Prob(0U), ONE_R1 / 2);
+
+    // QStabilizerHybrid keeps blocked T gates as stabilizer terms, instead of switching to a state vector.
+    QStabilizerHybridPtr hybrid =
+        std::make_shared<QStabilizerHybrid>(4U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    hybrid->SetTInjection(false);
+    hybrid->SetStabilizerRankLimit(64U);
+    engine->SetPermutation(0U);
+    // (A doubly-controlled gate still switches the hybrid to an engine.)
+    circuit(hybrid, false);
+    circuit(engine, false);
+    REQUIRE(hybrid->isClifford());
+    for (bitLenInt i = 0U; i < 4U; ++i) {
+        REQUIRE_FLOAT(hybrid->Prob(i), engine->Prob(i));
+    }
+    REQUIRE(hybrid->isClifford());
+    QInterfacePtr fromHybrid = std::make_shared<QEngineCPU>(4U, 0U);
+    std::unique_ptr<complex[]> hybridState(new complex[16U]);
+    hybrid->GetQuantumState(hybridState.get());
+    fromHybrid->SetQuantumState(hybridState.get());
+    REQUIRE(fromHybrid->ApproxCompare(engine));
+}
+
+TEST_CASE("test_stabilizer_clifford_rounding")
+{
+    QStabilizerHybridPtr hybrid =
+        std::make_shared<QStabilizerHybrid>(2U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    QInterfacePtr exact = std::make_shared<QEngineCPU>(2U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+    hybrid->SetCliffordRounding(0.01f, 0.99f);
+
+    // An RZ within a small angle of S rounds to S, in the tableau.
+    hybrid->H(0U);
+    exact->H(0U);
+    hybrid->RZ(PI_R1 / 2 + 0.05f, 0U);
+    exact->RZ(PI_R1 / 2 + 0.05f, 0U);
+    hybrid->CNOT(0U, 1U);
+    exact->CNOT(0U, 1U);
+    REQUIRE(hybrid->isClifford(0U));
+    REQUIRE(hybrid->GetUnitaryFidelity() < ONE_R1_F);
+    REQUIRE(hybrid->GetUnitaryFidelity() > 0.999f);
+
+    std::unique_ptr<complex[]> hybridState(new complex[4U]);
+    std::unique_ptr<complex[]> exactState(new complex[4U]);
+    hybrid->GetQuantumState(hybridState.get());
+    exact->GetQuantumState(exactState.get());
+    complex overlap = ZERO_CMPLX;
+    for (bitCapIntOcl i = 0U; i < 4U; ++i) {
+        overlap += conj(exactState[i]) * hybridState[i];
+    }
+    REQUIRE(norm(overlap) > 0.999f);
+
+    // T is too far from any Clifford gate to round.
+    hybrid->T(1U);
+    REQUIRE(!hybrid->isClifford(1U));
+    REQUIRE(hybrid->isClifford());
+
+    // Once rounding would spend past the fidelity budget, it stops.
+    hybrid->SetCliffordRounding(0.01f, hybrid->GetUnitaryFidelity());
+    hybrid->RZ(PI_R1 / 2 + 0.05f, 0U);
+    REQUIRE(!hybrid->isClifford(0U));
+}
+
+#if ENABLE_QBDT
+TEST_CASE("test_qbdt_unique_table")
+{
+    // Equal leaves in crossed positions, under different parents, which pairwise comparison can't combine
+    QBdtNodeInterfacePtr leaves[4U] = { QBdtNode::Make((real1)0.6f), QBdtNode::Make((real1)0.8f),
+        QBdtNode::Make((real1)0.8f), QBdtNode::Make((real1)0.6f) };
+    QBdtNodeInterfacePtr root = QBdtNode::Make(ONE_CMPLX);
+    root->branches[0U] = QBdtNode::Make(SQRT1_2_R1, leaves);
+    root->branches[1U] = QBdtNode::Make((real1)(-SQRT1_2_R1), leaves + 2U);
+    QBdtNodeInterfacePtr b0 = root->branches[0U];
+    QBdtNodeInterfacePtr b1 = root->branches[1U];
+
+    root->Prune(2U);
+
+    REQUIRE(root->branches[0U].get() != root->branches[1U].get());
+    REQUIRE(b0->branches[0U].get() == b1->branches[1U].get());
+    REQUIRE(b0->branches[1U].get() == b1->branches[0U].get());
+    REQUIRE_FLOAT((real1_f)norm(b0->branches[0U]->scale), 0.36f);
+    REQUIRE_FLOAT((real1_f)norm(b0->scale), 0.5f);
+
+    // Identical subtrees collapse to one node.
+    QBdtNodeInterfacePtr same[2U] = { QBdtNode::Make(SQRT1_2_R1, leaves), QBdtNode::Make(SQRT1_2_R1, leaves) };
+    root = QBdtNode::Make(ONE_CMPLX, same);
+    root->Prune(2U);
+    REQUIRE(root->branches[0U].get() == root->branches[1U].get());
+}
+
+TEST_CASE("test_qbdt_compute_table")
+{
+    // Gates land on subtrees shared by many paths, (and partly under controls,) so each is cloned and transformed once.
+    qrack_rand_gen_ptr rng = std::make_shared<qrack_rand_gen>(1);
+    QInterfacePtr qBdt = CreateQuantumInterface(QINTERFACE_BDT, 6U, 0U, rng);
+    QInterfacePtr qGold = CreateQuantumInterface(QINTERFACE_CPU, 6U, 0U, rng);
+    for (bitLenInt i = 0U; i < 6U; ++i) {
+        qBdt->H(i);
+        qGold->H(i);
+    }
+    qBdt->CNOT(0U, 3U);
+    qGold->CNOT(0U, 3U);
+    qBdt->T(4U);
+    qGold->T(4U);
+    qBdt->AntiCY(1U, 5U);
+    qGold->AntiCY(1U, 5U);
+    qBdt->CCZ(0U, 2U, 4U);
+    qGold->CCZ(0U, 2U, 4U);
+    qBdt->SqrtX(5U);
+    qGold->SqrtX(5U);
+
+    for (bitLenInt i = 0U; i < 6U; ++i) {
+        REQUIRE_FLOAT(qBdt->Prob(i), qGold->Prob(i));
+    }
+
+    std::unique_ptr<complex[]> bdtState(new complex[64U]);
+    std::unique_ptr<complex[]> goldState(new complex[64U]);
+    qBdt->GetQuantumState(bdtState.get());
+    qGold->GetQuantumState(goldState.get());
+    // (Equal up to global phase)
+    complex innerProd = ZERO_CMPLX;
+    for (size_t i = 0U; i < 64U; ++i) {
+        innerProd += conj(bdtState[i]) * goldState[i];
+    }
+    REQUIRE_FLOAT((real1_f)norm(innerProd), ONE_R1_F);
+}
+
+TEST_CASE("test_qbdt_approximation")
+{
+    // |11> carries 2.5e-5 of the probability, and the q1 subtrees under q0 agree to within 0.01.
+    QBdtPtr qBdt = std::make_shared<QBdt>(3U, 0U);
+    qBdt->H(0U);
+    qBdt->H(2U);
+    qBdt->CRY(0.02f, 0U, 1U);
+    REQUIRE(qBdt->GetUnitaryFidelity() == ONE_R1_F);
+    REQUIRE(qBdt->Prob(1U) > ZERO_R1_F);
+
+    qBdt->SetPermutation(0U);
+    qBdt->SetApproximation(0.0001f);
+    qBdt->H(0U);
+    qBdt->H(2U);
+    qBdt->CRY(0.02f, 0U, 1U);
+    REQUIRE(qBdt->Prob(1U) == ZERO_R1_F);
+    REQUIRE(qBdt->GetUnitaryFidelity() < ONE_R1_F);
+    REQUIRE_FLOAT(qBdt->GetUnitaryFidelity(), ONE_R1_F);
+
+    qBdt->SetPermutation(0U);
+    REQUIRE(qBdt->GetUnitaryFidelity() == ONE_R1_F);
+    qBdt->SetApproximation(ZERO_R1_F, 0.1f);
+    qBdt->H(0U);
+    qBdt->H(2U);
+    qBdt->CRY(0.02f, 0U, 1U);
+    REQUIRE(qBdt->Prob(1U) == ZERO_R1_F);
+    REQUIRE(qBdt->GetUnitaryFidelity() < ONE_R1_F);
+    REQUIRE_FLOAT(qBdt->GetUnitaryFidelity(), ONE_R1_F);
+}
+
+TEST_CASE("test_qbdt_hybrid_leaves")
+{
+    // q0 and q1 stay a product state, while q2 to q5 are entangled past what the tree compresses.
+    QBdtPtr qBdt = std::make_shared<QBdt>(6U, 0U, nullptr, ONE_CMPLX, false, false);
+    QInterfacePtr qGold = std::make_shared<QEngineCPU>(6U, 0U, nullptr, ONE_CMPLX, false, false);
+    qBdt->SetHybridLeaves(ONE_R1_F);
+    for (QInterfacePtr q : { (QInterfacePtr)qBdt, qGold }) {
+        q->H(0U);
+        q->RY(0.7f, 1U);
+        for (bitLenInt i = 2U; i < 6U; ++i) {
+            q->RY(0.3f + i, i);
+            q->T(i);
+        }
+        q->CNOT(2U, 3U);
+        q->CNOT(3U, 4U);
+        q->CNOT(4U, 5U);
+        q->CRY(1.1f, 5U, 2U);
+        q->CZ(1U, 4U);
+        q->H(3U);
+    }
+    REQUIRE(qBdt->GetAttachedQubitCount() > 0U);
+    REQUIRE(qBdt->GetAttachedQubitCount() < 6U);
+
+    const auto requireStateEqual = [&]() {
+        std::unique_ptr<complex[]> bdtState(new complex[64U]);
+        std::unique_ptr<complex[]> goldState(new complex[64U]);
+        qBdt->GetQuantumState(bdtState.get());
+        qGold->GetQuantumState(goldState.get());
+        complex innerProd = ZERO_CMPLX;
+        for (size_t i = 0U; i < 64U; ++i) {
+            innerProd += conj(bdtState[i]) * goldState[i];
+        }
+        REQUIRE_FLOAT((real1_f)norm(innerProd), ONE_R1_F);
+    };
+    requireStateEqual();
+
+    // Measurement returns the leaf qubits to the tree, to choose the boundary again.
+    qBdt->ForceM(4U, true);
+    qGold->ForceM(4U, true);
+    requireStateEqual();
+    for (bitLenInt i = 0U; i < 6U; ++i) {
+        REQUIRE_FLOAT(qBdt->Prob(i), qGold->Prob(i));
+    }
+
+    qBdt->AttachStateVector(6U);
+    REQUIRE(qBdt->GetAttachedQubitCount() == 6U);
+    qBdt->ResetStateVector(2U);
+    REQUIRE(qBdt->GetAttachedQubitCount() == 2U);
+    requireStateEqual();
+}
+
+TEST_CASE("test_qbdt_parallel_forks")
+{
+    // Trees deep enough for their traversals to fork, (and to nest forks,) on the shared pool, from two callers at once
+    const bitLenInt qb = 12U;
+    const auto fidelity = [qb](unsigned seed) {
+        QBdtPtr qBdt = std::make_shared<QBdt>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+        QInterfacePtr qGold = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+        qrack_rand_gen gen(seed);
+        std::uniform_real_distribution<real1_f> angle(ZERO_R1_F, 2 * PI_R1);
+        for (int layer = 0; layer < 3; ++layer) {
+            for (bitLenInt i = 0U; i < qb; ++i) {
+                const real1_f theta = angle(gen);
+                for (QInterfacePtr q : { (QInterfacePtr)qBdt, qGold }) {
+                    q->RY(theta, i);
+                    q->T(i);
+                }
+            }
+            for (bitLenInt i = (layer & 1); i < (qb - 1U); i += 2U) {
+                for (QInterfacePtr q : { (QInterfacePtr)qBdt, qGold }) {
+                    q->CNOT(i, i + 1U);
+                }
+            }
+        }
+        qBdt->ForceM(qb - 1U, false);
+        qGold->ForceM(qb - 1U, false);
+
+        std::unique_ptr<complex[]> bdtState(new complex[pow2Ocl(qb)]);
+        std::unique_ptr<complex[]> goldState(new complex[pow2Ocl(qb)]);
+        qBdt->GetQuantumState(bdtState.get());
+        qGold->GetQuantumState(goldState.get());
+        complex innerProd = ZERO_CMPLX;
+        for (bitCapIntOcl i = 0U; i < pow2Ocl(qb); ++i) {
+            innerProd += conj(bdtState[i]) * goldState[i];
+        }
+
+        return (real1_f)norm(innerProd);
+    };
+
+#if ENABLE_PTHREAD
+    std::future<real1_f> other = std::async(std::launch::async, fidelity, 2U);
+    REQUIRE_FLOAT(fidelity(1U), ONE_R1_F);
+    REQUIRE_FLOAT(other.get(), ONE_R1_F);
+#else
+    REQUIRE_FLOAT(fidelity(1U), ONE_R1_F);
+#endif
+}
+#endif
+
+TEST_CASE("test_tensor_network")
+{
+    const bitLenInt qb = 5U;
+    QTensorNetworkPtr network = std::make_shared<QTensorNetwork>(std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, qb,
+        0U, nullptr, ONE_CMPLX, false, false);
+    QInterfacePtr reference = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+    for (QInterfacePtr q : { (QInterfacePtr)network, reference }) {
+        q->H(0U);
+        q->CNOT(0U, 1U);
+        q->T(1U);
+        q->RX(0.4f, 2U);
+        q->CCNOT(1U, 2U, 3U);
+        q->CZ(3U, 4U);
+        q->FSim(0.3f, 0.7f, 4U, 2U);
+        q->RY(1.1f, 4U);
+        q->Swap(0U, 3U);
+    }
+
+    for (bitCapIntOcl i = 0U; i < pow2Ocl(qb); ++i) {
+        const complex amp = network->GetAmplitude(i);
+        REQUIRE(norm(amp - reference->GetAmplitude(i)) < 1e-6f);
+    }
+    for (bitLenInt i = 0U; i < qb; ++i) {
+        REQUIRE_FLOAT(network->Prob(i), reference->Prob(i));
+    }
+    REQUIRE_FLOAT(network->ExpectationBitsAll({ 0U, 2U, 4U }, 3U), reference->ExpectationBitsAll({ 0U, 2U, 4U }, 3U));
+    REQUIRE(network->isNetwork());
+
+    // Measurement needs the full state, which then takes every later gate.
+    network->ForceM(4U, true);
+    reference->ForceM(4U, true);
+    REQUIRE(!network->isNetwork());
+    network->H(1U);
+    reference->H(1U);
+    REQUIRE(network->SumSqrDiff(reference) < 1e-6f);
+
+    // 40 qubits would never fit in a state vector, but a GHZ amplitude contracts as a chain...
+    const bitLenInt wide = 40U;
+    network = std::make_shared<QTensorNetwork>(
+        std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, wide, 0U, nullptr, ONE_CMPLX, false, false);
+    network->H(0U);
+    for (bitLenInt i = 1U; i < wide; ++i) {
+        network->CNOT(i - 1U, i);
+    }
+    REQUIRE_FLOAT((real1_f)real(network->GetAmplitude(0U)), SQRT1_2_R1);
+    REQUIRE_FLOAT((real1_f)real(network->GetAmplitude(pow2(wide) - 1U)), SQRT1_2_R1);
+    REQUIRE(norm(network->GetAmplitude(pow2(wide / 2U))) < 1e-6f);
+    REQUIRE(network->isNetwork());
+
+    // ...and a 1D graph state qubit only has 3 qubits in its light cone.
+    network->SetPermutation(0U, ONE_CMPLX);
+    reference = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+    for (bitLenInt i = 0U; i < wide; ++i) {
+        network->H(i);
+    }
+    for (bitLenInt i = 1U; i < wide; ++i) {
+        network->CZ(i - 1U, i);
+    }
+    for (bitLenInt i = 0U; i < wide; ++i) {
+        network->RX(0.1f * (i % qb + 1U), i);
+    }
+    for (bitLenInt i = 0U; i < qb; ++i) {
+        reference->H(i);
+    }
+    for (bitLenInt i = 1U; i < qb; ++i) {
+        reference->CZ(i - 1U, i);
+    }
+    for (bitLenInt i = 0U; i < qb; ++i) {
+        reference->RX(0.1f * (i + 1U), i);
+    }
+    REQUIRE_FLOAT(network->Prob(22U), reference->Prob(2U));
+    REQUIRE_FLOAT(network->ExpectationBitsAll({ 21U, 22U, 23U }), reference->ExpectationBitsAll({ 1U, 2U, 3U }));
+    REQUIRE(network->isNetwork());
+}
+
+TEST_CASE("test_mps")
+{
+    const bitLenInt qb = 6U;
+    QMpsPtr mps = std::make_shared<QMps>(
+        std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, qb, 0U, nullptr, ONE_CMPLX, false, false);
+    QInterfacePtr reference = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+    for (QInterfacePtr q : { (QInterfacePtr)mps, reference }) {
+        q->H(0U);
+        q->CNOT(0U, 1U);
+        q->T(1U);
+        q->RX(0.4f, 2U);
+        q->CCNOT(1U, 2U, 3U);
+        q->AntiCNOT(5U, 0U);
+        q->CZ(3U, 4U);
+        q->FSim(0.3f, 0.7f, 4U, 2U);
+        q->RY(1.1f, 4U);
+        q->Swap(0U, 3U);
+    }
+    REQUIRE(mps->isMps());
+
+    for (bitCapIntOcl i = 0U; i < pow2Ocl(qb); ++i) {
+        REQUIRE(norm(mps->GetAmplitude(i) - reference->GetAmplitude(i)) < 1e-6f);
+    }
+    for (bitLenInt i = 0U; i < qb; ++i) {
+        REQUIRE_FLOAT(mps->Prob(i), reference->Prob(i));
+    }
+    REQUIRE_FLOAT(mps->ProbMask(0x15U, 0x11U), reference->ProbMask(0x15U, 0x11U));
+    REQUIRE(mps->GetTruncationError() < 1e-6f);
+
+    mps->ForceM(2U, false);
+    reference->ForceM(2U, false);
+    REQUIRE(mps->SumSqrDiff(reference) < 1e-6f);
+
+    QInterfacePtr part = mps->Decompose(5U, 1U);
+    reference->Dispose(5U, 1U, 0U);
+    mps->Compose(part);
+    reference->Compose(std::make_shared<QEngineCPU>(1U, 0U, nullptr, ONE_CMPLX, false, false));
+    REQUIRE(mps->SumSqrDiff(reference) < 1e-6f);
+    REQUIRE(mps->isMps());
+
+    // A 1D circuit of nearest neighbor gates at 60 qubits only needs a small bond dimension.
+    const bitLenInt wide = 60U;
+    mps = std::make_shared<QMps>(
+        std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, wide, 0U, nullptr, ONE_CMPLX, false, false);
+    mps->H(0U);
+    for (bitLenInt i = 1U; i < wide; ++i) {
+        mps->CNOT(i - 1U, i);
+    }
+    REQUIRE(mps->GetBondDimension() == 2U);
+    REQUIRE_FLOAT((real1_f)real(mps->GetAmplitude(0U)), SQRT1_2_R1);
+    REQUIRE_FLOAT((real1_f)real(mps->GetAmplitude(pow2(wide) - 1U)), SQRT1_2_R1);
+    REQUIRE_FLOAT(mps->Prob(37U), ONE_R1_F / 2);
+    REQUIRE(mps->M(10U) == mps->M(50U));
+
+    // Truncation drops the smallest Schmidt values, and counts their weight.
+    mps = std::make_shared<QMps>(
+        std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, 2U, 0U, nullptr, ONE_CMPLX, false, false);
+    mps->SetTruncationThreshold(0.1f);
+    mps->RY(0.5f, 0U);
+    mps->CNOT(0U, 1U);
+    REQUIRE(mps->GetBondDimension() == 1U);
+    REQUIRE_FLOAT(mps->GetTruncationError(), (real1_f)(sin(0.25f) * sin(0.25f)));
+    REQUIRE(mps->Prob(1U) < 1e-6f);
+
+    // Past the bond dimension cap, the state moves into the dense engine.
+    mps = std::make_shared<QMps>(
+        std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, 4U, 0U, nullptr, ONE_CMPLX, false, false);
+    reference = std::make_shared<QEngineCPU>(4U, 0U, nullptr, ONE_CMPLX, false, false);
+    mps->SetMaxBondDimension(2U);
+    for (QInterfacePtr q : { (QInterfacePtr)mps, reference }) {
+        q->H(0U);
+        q->H(1U);
+        q->CNOT(0U, 2U);
+        q->CNOT(1U, 3U);
+    }
+    REQUIRE(!mps->isMps());
+    REQUIRE(mps->SumSqrDiff(reference) < 1e-6f);
+
+    // QUnit can place its separable subsystems on MPS units.
+    QInterfacePtr qUnit = CreateQuantumInterface(
+        { QINTERFACE_QUNIT, QINTERFACE_MPS, QINTERFACE_CPU }, qb, 0U, nullptr, ONE_CMPLX, false, false);
+    reference = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+    for (QInterfacePtr q : { qUnit, reference }) {
+        q->H(0U);
+        q->CNOT(0U, 1U);
+        q->RY(0.8f, 2U);
+        q->CNOT(1U, 2U);
+        q->CY(4U, 5U);
+        q->H(4U);
+        q->CZ(2U, 4U);
+    }
+    for (bitCapIntOcl i = 0U; i < pow2Ocl(qb); ++i) {
+        REQUIRE(norm(qUnit->GetAmplitude(i) - reference->GetAmplitude(i)) < 1e-6f);
+    }
+}
+
+TEST_CASE("test_mps_random_circuits")
+{
+    // Seeded Clifford+T circuits, with long-range 2 qubit gates, give rank deficient and degenerate blocks to factor.
+    const bitLenInt qb = 8U;
+    const int TRIALS = 200;
+    const int DEPTH = 30;
+    qrack_rand_gen gen(17U);
+    for (int trial = 0; trial < TRIALS; ++trial) {
+        QMpsPtr mps = std::make_shared<QMps>(
+            std::vector<QInterfaceEngine>{ QINTERFACE_CPU }, qb, 0U, nullptr, ONE_CMPLX, false, false);
+        QInterfacePtr reference = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+        for (int d = 0; d < DEPTH; ++d) {
+            for (bitLenInt i = 0U; i < qb; ++i) {
+                const unsigned gate = gen() % 4U;
+                for (QInterfacePtr q : { (QInterfacePtr)mps, reference }) {
+                    if (gate == 0U) {
+                        q->H(i);
+                    } else if (gate == 1U) {
+                        q->S(i);
+                    } else if (gate == 2U) {
+                        q->T(i);
+                    } else {
+                        q->X(i);
+                    }
+                }
+            }
+            const bitLenInt b1 = (bitLenInt)(gen() % qb);
+            const bitLenInt b2 = (bitLenInt)((b1 + 1U + gen() % (qb - 1U)) % qb);
+            const unsigned gate = gen() % 3U;
+            for (QInterfacePtr q : { (QInterfacePtr)mps, reference }) {
+                if (gate == 0U) {
+                    q->CNOT(b1, b2);
+                } else if (gate == 1U) {
+                    q->CZ(b1, b2);
+                } else {
+                    q->ISwap(b1, b2);
+                }
+            }
+        }
+        REQUIRE(mps->isMps());
+        REQUIRE(mps->GetTruncationError() < 1e-6f);
+        REQUIRE(mps->SumSqrDiff(reference) < 1e-4f);
+    }
+}
+
+TEST_CASE("test_exp2x2_log2x2")
+{
+    complex mtrx1[4] = { ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX };
+    complex mtrx2[4];
+
+    exp2x2(mtrx1, mtrx2);
+    REQUIRE_FLOAT((real1_f)real(mtrx2[0]), M_E);
+    REQUIRE_FLOAT((real1_f)imag(mtrx2[0]), ZERO_R1_F);
+    REQUIRE_FLOAT((real1_f)real(mtrx2[1]), ZERO_R1_F);
+    REQUIRE_FLOAT((real1_f)imag(mtrx2[1]), ZERO_R1_F);
+    REQUIRE_FLOAT((real1_f)real(mtrx2[2]), ZERO_R1_F);
+    REQUIRE_FLOAT((real1_f)imag(mtrx2[2]), ZERO_R1_F);
+    REQUIRE_FLOAT((real1_f)real(mtrx2[3]), M_E);
+    REQUIRE_FLOAT((real1_f)imag(mtrx2[3]), ZERO_R1_F);
+
+    log2x2(mtrx2, mtrx1);
+    REQUIRE_FLOAT((real1_f)real(mtrx1[0]), ONE_R1_F);
+    REQUIRE_FLOAT((real1_f)imag(mtrx1[0]), ZERO_R1_F);
+    REQUIRE_FLOAT((real1_f)real(mtrx1[1]), ZERO_R1_F);
+    REQUIRE_FLOAT((real1_f)imag(mtrx1[1]), ZERO_R1_F);
+    REQUIRE_FLOAT((real1_f)real(mtrx1[2]), ZERO_R1_F);
+    REQUIRE_FLOAT((real1_f)imag(mtrx1[2]), ZERO_R1_F);
+    REQUIRE_FLOAT((real1_f)real(mtrx1[3]), ONE_R1_F);
+    REQUIRE_FLOAT((real1_f)imag(mtrx1[3]), ZERO_R1_F);
+}
+
+#if ENABLE_OPENCL && !ENABLE_SNUCL
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_change_device")
+{
+    if (testEngineType == QINTERFACE_OPENCL) {
+        qftReg->SetPermutation(0x55F00);
+        REQUIRE_THAT(qftReg, HasProbability(0x55F00));
+        std::dynamic_pointer_cast<QEngineOCL>(qftReg)->SetDevice(0);
+        REQUIRE_THAT(qftReg, HasProbability(0x55F00));
+    }
+}
+#endif
+
+#if ENABLE_OPENCL
+TEST_CASE("test_qengine_ocl_page_transfers")
+{
+    // Page reads and writes queue after pending kernels, and page copies and shuffles between engines, (staged through
+    // host chunks when the engines are in different contexts,) match the same moves between QEngineCPU pages, for
+    // every combination of host and device RAM.
+    if (!OCLEngine::Instance().GetDeviceCount()) {
+        return;
+    }
+    const bitLenInt qb = 12U;
+    const bitCapIntOcl maxQPower = pow2Ocl(qb);
+    const int64_t lastDevice = (int64_t)OCLEngine::Instance().GetDeviceCount() - 1;
+    const auto prepare = [qb](QEnginePtr q1, QEnginePtr q2) {
+        for (bitLenInt i = 0U; i < qb; ++i) {
+            q1->RY(0.2f + 0.1f * i, i);
+        }
+        q1->CNOT(0U, qb - 1U);
+        q2->X(3U);
+        q2->H(5U);
+        q2->T(5U);
+    };
+    for (int hostMem = 0; hostMem < 4; ++hostMem) {
+        QEnginePtr ocl1 =
+            std::make_shared<QEngineOCL>(qb, 0U, nullptr, ONE_CMPLX, false, false, (hostMem & 1) != 0, 0);
+        QEnginePtr ocl2 =
+            std::make_shared<QEngineOCL>(qb, 0U, nullptr, ONE_CMPLX, false, false, (hostMem & 2) != 0, lastDevice);
+        QEnginePtr cpu1 = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+        QEnginePtr cpu2 = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+        prepare(ocl1, ocl2);
+        prepare(cpu1, cpu2);
+
+        std::unique_ptr<complex[]> oclPage(new complex[maxQPower]);
+        std::unique_ptr<complex[]> cpuPage(new complex[maxQPower]);
+        ocl1->GetAmplitudePage(oclPage.get(), 0U, maxQPower);
+        cpu1->GetAmplitudePage(cpuPage.get(), 0U, maxQPower);
+        for (bitCapIntOcl i = 0U; i < maxQPower; ++i) {
+            REQUIRE(norm(oclPage[i] - cpuPage[i]) < 1e-8f);
+        }
+
+        ocl1->ShuffleBuffers(ocl2);
+        cpu1->ShuffleBuffers(cpu2);
+        ocl2->SetAmplitudePage(ocl1, 5U, 100U, 1000U);
+        cpu2->SetAmplitudePage(cpu1, 5U, 100U, 1000U);
+        ocl1->SetAmplitudePage(cpuPage.get(), maxQPower - 7U, 7U);
+        cpu1->SetAmplitudePage(cpuPage.get(), maxQPower - 7U, 7U);
+
+        for (const std::pair<QEnginePtr, QEnginePtr>& pair :
+            { std::make_pair(ocl1, cpu1), std::make_pair(ocl2, cpu2) }) {
+            pair.first->GetAmplitudePage(oclPage.get(), 0U, maxQPower);
+            pair.second->GetAmplitudePage(cpuPage.get(), 0U, maxQPower);
+            for (bitCapIntOcl i = 0U; i < maxQPower; ++i) {
+                REQUIRE(norm(oclPage[i] - cpuPage[i]) < 1e-8f);
+            }
+        }
+    }
+}
+
+TEST_CASE("test_ocl_binary_cache")
+{
+    // Every device's program is cached under a name keyed to the device, (and its driver, type widths, sources and
+    // build options,) and initializing again from the same folder finds the same names.
+    if (!OCLEngine::Instance().GetDeviceCount()) {
+        return;
+    }
+    const std::string home = OCLEngine::GetDefaultBinaryPath();
+    // (Like qrack_cl_compile, this waits for every device, and saves its binary.)
+    InitOClResult saved = OCLEngine::InitOCL(false, true, home);
+    InitOClResult loaded = OCLEngine::InitOCL(false, false, home);
+    REQUIRE(saved.all_dev_contexts.size() == loaded.all_dev_contexts.size());
+    for (size_t i = 0U; i < saved.all_dev_contexts.size(); ++i) {
+        const std::string fileName = OCLEngine::GetBinaryFileName(saved.all_dev_contexts[i]);
+        REQUIRE(fileName == OCLEngine::GetBinaryFileName(loaded.all_dev_contexts[i]));
+        REQUIRE(fileName.find("qrack_ocl_dev_") == 0U);
+        // (A 16 hex digit hash, and the extension)
+        REQUIRE(fileName.size() > 34U);
+        REQUIRE(fileName.substr(fileName.size() - 3U) == ".ir");
+        REQUIRE(fileName[fileName.size() - 20U] == '_');
+
+        std::ifstream binary(home + fileName, std::ios::binary | std::ios::ate);
+        REQUIRE(binary.good());
+        REQUIRE(binary.tellg() > 0);
+    }
+}
+
+TEST_CASE("test_qengine_ocl_gate_list")
+{
+    // Runs of single qubit gates on an engine that fits in local memory, (batched into one kernel, and flushed at the
+    // op limit, by reads, and by other kernels,) match QEngineCPU, with and without normalization.
+    if (!OCLEngine::Instance().GetDeviceCount()) {
+        return;
+    }
+    const bitLenInt qb = 6U;
+    for (int doNorm = 0; doNorm < 2; ++doNorm) {
+        QInterfacePtr ocl =
+            std::make_shared<QEngineOCL>(qb, 0U, nullptr, ONE_CMPLX, doNorm != 0, false, false, device_id);
+        QInterfacePtr cpu = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, doNorm != 0, false);
+        qrack_rand_gen gen(5U);
+        std::uniform_int_distribution<int> qubit(0, qb - 1);
+        std::uniform_real_distribution<real1_f> angle(ZERO_R1_F, 2 * PI_R1);
+        for (int i = 0; i < 300; ++i) {
+            const bitLenInt q = (bitLenInt)qubit(gen);
+            const real1_f theta = angle(gen);
+            const real1_f phi = angle(gen);
+            const int gate = i % 6;
+            for (QInterfacePtr e : { ocl, cpu }) {
+                switch (gate) {
+                case 0:
+                    e->U(q, theta, phi, ZERO_R1_F);
+                    break;
+                case 1:
+                    e->X(q);
+                    break;
+                case 2:
+                    e->Z(q);
+                    break;
+                case 3:
+                    e->T(q);
+                    break;
+                case 4:
+                    e->Y(q);
+                    break;
+                default:
+                    e->XMask(0x15U);
+                }
+            }
+            if (i == 150) {
+                REQUIRE_FLOAT(ocl->Prob(q), cpu->Prob(q));
+            }
+            if (i == 200) {
+                ocl->CNOT(0U, qb - 1U);
+                cpu->CNOT(0U, qb - 1U);
+            }
+        }
+        for (bitCapIntOcl i = 0U; i < pow2Ocl(qb); ++i) {
+            REQUIRE(norm(ocl->GetAmplitude(i) - cpu->GetAmplitude(i)) < 1e-6f);
+        }
+
+        // Resetting the state discards a pending batch.
+        ocl->H(2U);
+        ocl->SetPermutation(5U);
+        REQUIRE_FLOAT((real1_f)norm(ocl->GetAmplitude(5U)), ONE_R1_F);
+    }
+}
+
+TEST_CASE("test_qengine_ocl_gate_list_tiled")
+{
+    // On an engine too wide for one local memory tile, gates on low qubits batch per tile, (reducing the norm over all
+    // tiles,) while gates on high qubits flush the batch and launch on their own, all matching QEngineCPU.
+    if (!OCLEngine::Instance().GetDeviceCount()) {
+        return;
+    }
+    const bitLenInt qb = 18U;
+    for (int doNorm = 0; doNorm < 2; ++doNorm) {
+        QInterfacePtr ocl =
+            std::make_shared<QEngineOCL>(qb, 0U, nullptr, ONE_CMPLX, doNorm != 0, false, false, device_id);
+        QInterfacePtr cpu = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, doNorm != 0, false);
+        qrack_rand_gen gen(6U);
+        std::uniform_int_distribution<int> lowQubit(0, 3);
+        std::uniform_real_distribution<real1_f> angle(ZERO_R1_F, 2 * PI_R1);
+        for (int i = 0; i < 200; ++i) {
+            const bitLenInt q = (bitLenInt)lowQubit(gen);
+            const real1_f theta = angle(gen);
+            const real1_f phi = angle(gen);
+            for (QInterfacePtr e : { ocl, cpu }) {
+                e->U(q, theta, phi, -phi);
+                e->T(q + 1U);
+                if (!(i % 40)) {
+                    e->H(qb - 1U - (i % 3));
+                    e->XMask(0x5U);
+                }
+            }
+        }
+        REQUIRE_FLOAT(ocl->Prob(qb - 1U), cpu->Prob(qb - 1U));
+        std::unique_ptr<complex[]> oclState(new complex[pow2Ocl(qb)]);
+        std::unique_ptr<complex[]> cpuState(new complex[pow2Ocl(qb)]);
+        ocl->GetQuantumState(oclState.get());
+        cpu->GetQuantumState(cpuState.get());
+        real1_f sumSqrDiff = ZERO_R1_F;
+        for (bitCapIntOcl i = 0U; i < pow2Ocl(qb); ++i) {
+            sumSqrDiff += (real1_f)norm(oclState[i] - cpuState[i]);
+        }
+        REQUIRE(sumSqrDiff < 1e-4f);
+    }
+}
+
+TEST_CASE("test_ocl_lazy_program_build")
+{
+    // Every device builds its kernels on first use, whether or not its background build has finished, and concurrent
+    // first uses wait on the one build.
+    const size_t devCount = OCLEngine::Instance().GetDeviceCount();
+    if (!devCount) {
+        return;
+    }
+    InitOClResult fresh = OCLEngine::InitOCL();
+    REQUIRE(fresh.all_dev_contexts.size() == devCount);
+    std::vector<std::future<void>> builds;
+    for (size_t i = 0U; i < devCount; ++i) {
+        for (int j = 0; j < 2; ++j) {
+            builds.push_back(
+                std::async(std::launch::async, [&fresh, i]() { fresh.all_dev_contexts[i]->EnsureProgram(); }));
+        }
+    }
+    for (size_t i = 0U; i < builds.size(); ++i) {
+        // (Rethrows, if a device failed to build.)
+        builds[i].get();
+    }
+
+    // A device that no engine has used yet still runs gates.
+    for (size_t i = 0U; i < devCount; ++i) {
+        QInterfacePtr ocl = std::make_shared<QEngineOCL>(2U, 0U, nullptr, ONE_CMPLX, false, false, false, (int64_t)i);
+        ocl->H(0U);
+        ocl->CNOT(0U, 1U);
+        REQUIRE_FLOAT(ocl->Prob(1U), 0.5f);
+        REQUIRE_FLOAT(ocl->ProbMask(3U, 3U), 0.5f);
+    }
+}
+
+TEST_CASE("test_qbatch_ocl")
+{
+    // 7 registers of 5 qubits on the device, (with shared and per-register matrices, controls, and host reads and
+    // writes between gates,) match the host QBatch.
+    if (!OCLEngine::Instance().GetDeviceCount()) {
+        return;
+    }
+    const bitLenInt qb = 5U;
+    const bitCapIntOcl batchCount = 7U;
+    QBatchOCL ocl(qb, batchCount, 0U, nullptr, false);
+    QBatch cpu(qb, batchCount, 0U, nullptr, false);
+    std::vector<real1_f> angles(batchCount);
+    std::vector<complex> mtrxs(batchCount << 2U);
+    for (bitCapIntOcl b = 0U; b < batchCount; ++b) {
+        angles[b] = 0.3f * (b + 1U);
+        const real1 cosine = (real1)cos(angles[b]);
+        const real1 sine = (real1)sin(angles[b]);
+        mtrxs[(b << 2U) + 0U] = complex(cosine, ZERO_R1);
+        mtrxs[(b << 2U) + 1U] = complex(ZERO_R1, -sine);
+        mtrxs[(b << 2U) + 2U] = complex(ZERO_R1, -sine);
+        mtrxs[(b << 2U) + 3U] = complex(cosine, ZERO_R1);
+    }
+
+    for (QBatch* batch : std::vector<QBatch*>{ &ocl, &cpu }) {
+        for (bitLenInt q = 0U; q < qb; ++q) {
+            batch->H(q);
+            batch->RYBatch(&(angles[0U]), q);
+        }
+        batch->CNOT(0U, 4U);
+        batch->MCMtrxBatch({ 1U, 3U }, &(mtrxs[0U]), 2U);
+        // (A host read, and a host write, between device gates)
+        REQUIRE(batch->Prob(3U, 2U) > ZERO_R1_F);
+        batch->SetAmplitude(6U, 0U, batch->GetAmplitude(6U, 31U));
+        batch->SetAmplitude(6U, 31U, ZERO_CMPLX);
+        batch->CZ(4U, 1U);
+        batch->RZBatch(&(angles[0U]), 0U);
+        batch->MtrxBatch(&(mtrxs[0U]), 3U);
+    }
 
-    for (int i = 0; i < NUM_ENTRIES; i++) {
-        hit[i].store(false);
+    std::unique_ptr<complex[]> oclState(new complex[pow2Ocl(qb)]);
+    std::unique_ptr<complex[]> cpuState(new complex[pow2Ocl(qb)]);
+    for (bitCapIntOcl b = 0U; b < batchCount; ++b) {
+        ocl.GetQuantumState(b, oclState.get());
+        cpu.GetQuantumState(b, cpuState.get());
+        for (bitCapIntOcl i = 0U; i < pow2Ocl(qb); ++i) {
+            REQUIRE_CMPLX(oclState[i], cpuState[i]);
+        }
     }
 
-    qengine->SetConcurrencyLevel(1);
+    // After X on every qubit from |0>, every shot of every register reads all ones.
+    ocl.SetPermutation(0U);
+    for (bitLenInt q = 0U; q < qb; ++q) {
+        ocl.X(q);
+    }
+    const unsigned shots = 16U;
+    std::vector<unsigned long long> results(batchCount * shots);
+    ocl.MultiShotMeasureMask({ 1U, 8U, 16U }, shots, &(results[0U]));
+    for (size_t i = 0U; i < results.size(); ++i) {
+        REQUIRE(results[i] == 7U);
+    }
+}
 
-    qengine->par_for_mask(0, NUM_ENTRIES, skipArray, [&](const bitCapInt lcv, const int cpu) {
-        bool old = true;
-        old = hit[(bitCapIntOcl)lcv].exchange(old);
-        REQUIRE(old == false);
-        for (int i = 0; i < NUM_SKIP; i++) {
-            REQUIRE((lcv & skipArray[i]) == 0);
+#if ENABLE_ENV_VARS && !defined(_WIN32)
+TEST_CASE("test_ocl_autotune")
+{
+    // While QRACK_OCL_AUTOTUNE is set, gate kernels cycle through candidate launch shapes on real work, and the state
+    // still matches QEngineCPU, through every candidate and after the winners are chosen.
+    if (!OCLEngine::Instance().GetDeviceCount()) {
+        return;
+    }
+    const std::vector<DeviceContextPtr> previous = OCLEngine::Instance().GetDeviceContextPtrVector();
+    const DeviceContextPtr previousDefault = OCLEngine::Instance().GetDeviceContextPtr(-1);
+    setenv("QRACK_OCL_AUTOTUNE", "1", 1);
+    InitOClResult tuning = OCLEngine::InitOCL(false, false, OCLEngine::GetDefaultBinaryPath());
+    unsetenv("QRACK_OCL_AUTOTUNE");
+    OCLEngine::Instance().SetDeviceContextPtrVector(tuning.all_dev_contexts, tuning.default_dev_context);
+    REQUIRE(tuning.default_dev_context->IsLaunchTuned());
+
+    {
+        // Too wide for one local memory tile, so gates on the high qubits launch on their own. 5 group sizes, times up
+        // to QRACK_OCL_TUNE_MAX_ITEMS work items per thread, times QRACK_OCL_TUNE_TRIALS, takes at most 120 launches.
+        const bitLenInt qb = 18U;
+        QInterfacePtr ocl = std::make_shared<QEngineOCL>(qb, 0U, nullptr, ONE_CMPLX, false, false, false, -1);
+        QInterfacePtr cpu = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+        qrack_rand_gen gen(8U);
+        std::uniform_int_distribution<int> highQubit(qb - 4, qb - 1);
+        std::uniform_real_distribution<real1_f> angle(ZERO_R1_F, 2 * PI_R1);
+        for (int i = 0; i < 300; ++i) {
+            const bitLenInt q = (bitLenInt)highQubit(gen);
+            const real1_f theta = angle(gen);
+            const real1_f phi = angle(gen);
+            for (QInterfacePtr e : { ocl, cpu }) {
+                e->U(q, theta, phi, ZERO_R1_F);
+                e->CNOT(q, (bitLenInt)(i % 4));
+            }
         }
-        calls++;
-    });
+        REQUIRE_FLOAT(ocl->Prob(qb - 1U), cpu->Prob(qb - 1U));
+        std::unique_ptr<complex[]> oclState(new complex[pow2Ocl(qb)]);
+        std::unique_ptr<complex[]> cpuState(new complex[pow2Ocl(qb)]);
+        ocl->GetQuantumState(oclState.get());
+        cpu->GetQuantumState(cpuState.get());
+        real1_f sumSqrDiff = ZERO_R1_F;
+        for (bitCapIntOcl i = 0U; i < pow2Ocl(qb); ++i) {
+            sumSqrDiff += (real1_f)norm(oclState[i] - cpuState[i]);
+        }
+        REQUIRE(sumSqrDiff < 1e-4f);
+    }
+
+    OCLEngine::Instance().SetDeviceContextPtrVector(previous, previousDefault);
 }
 #endif
 
-TEST_CASE("test_exp2x2_log2x2")
+#if ENABLE_ENV_VARS && !defined(_WIN32)
+TEST_CASE("test_qunitmulti_redistribute")
 {
-    complex mtrx1[4] = { ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, ONE_CMPLX };
-    complex mtrx2[4];
-
-    exp2x2(mtrx1, mtrx2);
-    REQUIRE_FLOAT((real1_f)real(mtrx2[0]), M_E);
-    REQUIRE_FLOAT((real1_f)imag(mtrx2[0]), ZERO_R1_F);
-    REQUIRE_FLOAT((real1_f)real(mtrx2[1]), ZERO_R1_F);
-    REQUIRE_FLOAT((real1_f)imag(mtrx2[1]), ZERO_R1_F);
-    REQUIRE_FLOAT((real1_f)real(mtrx2[2]), ZERO_R1_F);
-    REQUIRE_FLOAT((real1_f)imag(mtrx2[2]), ZERO_R1_F);
-    REQUIRE_FLOAT((real1_f)real(mtrx2[3]), M_E);
-    REQUIRE_FLOAT((real1_f)imag(mtrx2[3]), ZERO_R1_F);
+    // With redistribution on, and a migration gain low enough that units move at nearly every chance, QUnitMulti still
+    // matches QEngineCPU as its units entangle, separate, and (on a multi-device host) cross devices.
+    if (!OCLEngine::Instance().GetDeviceCount()) {
+        return;
+    }
+    setenv("QRACK_ENABLE_QUNITMULTI_REDISTRIBUTE", "1", 1);
+    setenv("QRACK_QUNITMULTI_MIGRATE_GAIN", "0.01", 1);
+    const bitLenInt qb = 10U;
+    QInterfacePtr multi = std::make_shared<QUnitMulti>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+    unsetenv("QRACK_ENABLE_QUNITMULTI_REDISTRIBUTE");
+    unsetenv("QRACK_QUNITMULTI_MIGRATE_GAIN");
+    QInterfacePtr cpu = std::make_shared<QEngineCPU>(qb, 0U, nullptr, ONE_CMPLX, false, false);
+
+    qrack_rand_gen gen(9U);
+    std::uniform_real_distribution<real1_f> angle(ZERO_R1_F, 2 * PI_R1);
+    for (int layer = 0; layer < 8; ++layer) {
+        for (bitLenInt q = 0U; q < qb; ++q) {
+            const real1_f theta = angle(gen);
+            const real1_f phi = angle(gen);
+            multi->U(q, theta, phi, ZERO_R1_F);
+            cpu->U(q, theta, phi, ZERO_R1_F);
+        }
+        for (bitLenInt q = (bitLenInt)(layer & 1); (q + 1U) < qb; q += 2U) {
+            multi->CNOT(q, q + 1U);
+            cpu->CNOT(q, q + 1U);
+        }
+        // Measuring splits units, which redistributes them.
+        const bitLenInt q = (bitLenInt)((3 * layer) % qb);
+        const bool result = cpu->Prob(q) > 0.5f;
+        multi->ForceM(q, result);
+        cpu->ForceM(q, result);
+    }
 
-    log2x2(mtrx2, mtrx1);
-    REQUIRE_FLOAT((real1_f)real(mtrx1[0]), ONE_R1_F);
-    REQUIRE_FLOAT((real1_f)imag(mtrx1[0]), ZERO_R1_F);
-    REQUIRE_FLOAT((real1_f)real(mtrx1[1]), ZERO_R1_F);
-    REQUIRE_FLOAT((real1_f)imag(mtrx1[1]), ZERO_R1_F);
-    REQUIRE_FLOAT((real1_f)real(mtrx1[2]), ZERO_R1_F);
-    REQUIRE_FLOAT((real1_f)imag(mtrx1[2]), ZERO_R1_F);
-    REQUIRE_FLOAT((real1_f)real(mtrx1[3]), ONE_R1_F);
-    REQUIRE_FLOAT((real1_f)imag(mtrx1[3]), ZERO_R1_F);
-}
+    std::unique_ptr<complex[]> multiState(new complex[pow2Ocl(qb)]);
+    std::unique_ptr<complex[]> cpuState(new complex[pow2Ocl(qb)]);
+    multi->GetQuantumState(multiState.get());
+    cpu->GetQuantumState(cpuState.get());
+    complex inner = ZERO_CMPLX;
+    for (bitCapIntOcl i = 0U; i < pow2Ocl(qb); ++i) {
+        inner += conj(multiState[i]) * cpuState[i];
+    }
+    REQUIRE_FLOAT((real1_f)norm(inner), ONE_R1_F);
 
-#if ENABLE_OPENCL && !ENABLE_SNUCL
-TEST_CASE_METHOD(QInterfaceTestFixture, "test_change_device")
-{
-    if (testEngineType == QINTERFACE_OPENCL) {
-        qftReg->SetPermutation(0x55F00);
-        REQUIRE_THAT(qftReg, HasProbability(0x55F00));
-        std::dynamic_pointer_cast<QEngineOCL>(qftReg)->SetDevice(0);
-        REQUIRE_THAT(qftReg, HasProbability(0x55F00));
+    // Once the units finish, no device reports queued work.
+    multi->Finish();
+    const std::vector<DeviceContextPtr> devices = OCLEngine::Instance().GetDeviceContextPtrVector();
+    for (size_t i = 0U; i < devices.size(); ++i) {
+        REQUIRE(devices[i]->GetQueueDepth() == 0U);
     }
 }
 #endif
+#endif
 
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_qengine_getmaxqpower")
 {
@@ -712,6 +3708,56 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_fsim")
     REQUIRE_THAT(qftReg, HasProbability(0, 8, 0x03));
 }
 
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_mtrxn")
+{
+    QEnginePtr qEngine = std::dynamic_pointer_cast<QEngine>(qftReg);
+    if (!qEngine) {
+        // MtrxN() is only exposed by "Schroedinger method" engines.
+        return;
+    }
+
+    // Swapping matrix indices 1 and 3 acts as a CNOT, controlled by the first target.
+    complex cnot[16U];
+    std::fill(cnot, cnot + 16U, ZERO_CMPLX);
+    cnot[0U] = ONE_CMPLX;
+    cnot[7U] = ONE_CMPLX;
+    cnot[10U] = ONE_CMPLX;
+    cnot[13U] = ONE_CMPLX;
+
+    qEngine->SetPermutation(0x01);
+    qEngine->MtrxN(cnot, { 0, 1 });
+    REQUIRE_THAT(qftReg, HasProbability(0, 8, 0x03));
+    qEngine->MtrxN(cnot, { 1, 0 });
+    REQUIRE_THAT(qftReg, HasProbability(0, 8, 0x02));
+
+    // Swapping matrix indices 3 and 7 acts as a Toffoli, on arbitrarily ordered targets.
+    complex ccnot[64U];
+    std::fill(ccnot, ccnot + 64U, ZERO_CMPLX);
+    for (size_t i = 0U; i < 8U; ++i) {
+        const size_t j = (i == 3U) ? 7U : ((i == 7U) ? 3U : i);
+        ccnot[(i << 3U) | j] = ONE_CMPLX;
+    }
+
+    qEngine->SetPermutation(0x14);
+    qEngine->MtrxN(ccnot, { 4, 2, 7 });
+    REQUIRE_THAT(qftReg, HasProbability(0, 8, 0x94));
+
+    // H on both targets, as a single dense operator
+    complex hh[16U];
+    for (size_t i = 0U; i < 16U; ++i) {
+        const size_t row = i >> 2U;
+        const size_t col = i & 3U;
+        size_t parity = row & col;
+        parity = (parity ^ (parity >> 1U)) & 1U;
+        hh[i] = complex(parity ? -ONE_R1 / 2 : ONE_R1 / 2, ZERO_R1);
+    }
+
+    qEngine->SetPermutation(0x02);
+    qEngine->MtrxN(hh, { 0, 1 });
+    qftReg->H(0, 2);
+    REQUIRE_THAT(qftReg, HasProbability(0, 8, 0x02));
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_apply_single_bit")
 {
     const complex pauliX[4]{ ZERO_CMPLX, ONE_CMPLX, ONE_CMPLX, ZERO_CMPLX };
@@ -989,6 +4035,42 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_t")
     REQUIRE_THAT(qftReg, HasProbability(0, 8, 0x01));
 }
 
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_fused_2x2")
+{
+    // Runs of gates on the same target (or the same control set) may be multiplied together before they are applied.
+    qftReg->SetPermutation(0x00);
+    qftReg->H(0);
+    qftReg->T(0);
+    qftReg->T(0);
+    qftReg->H(1);
+    qftReg->T(0);
+    qftReg->T(0);
+    qftReg->H(0);
+    qftReg->H(1);
+    REQUIRE_THAT(qftReg, HasProbability(0, 8, 0x01));
+
+    qftReg->SetPermutation(0x00);
+    qftReg->H(0);
+    qftReg->H(0);
+    qftReg->X(2);
+    REQUIRE_THAT(qftReg, HasProbability(0, 8, 0x04));
+
+    qftReg->SetPermutation(0x01);
+    qftReg->CNOT(0, 1);
+    qftReg->CNOT(0, 1);
+    qftReg->CNOT(0, 1);
+    qftReg->CNOT(0, 2);
+    REQUIRE_THAT(qftReg, HasProbability(0, 8, 0x07));
+
+    qftReg->SetPermutation(0x00);
+    qftReg->H(0);
+    REQUIRE_FLOAT(qftReg->Prob(0), 0.5);
+    qftReg->S(0);
+    qftReg->S(0);
+    qftReg->H(0);
+    REQUIRE_THAT(qftReg, HasProbability(0, 8, 0x01));
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_sh")
 {
     qftReg->SH(0);
@@ -2736,6 +5818,53 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_qft_h")
     REQUIRE_THAT(qftReg, HasProbability(0, 8, randPerm));
 }
 
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_qft_native")
+{
+    // State vector engines replace the gate decomposition with an FFT, (blocked, past QRACK_FFT_BLOCK_QB qubits).
+    const bitLenInt n = 14U;
+    qftReg = CreateQuantumInterface(
+        { testEngineType, testSubEngineType, testSubSubEngineType }, n, 0, rng, CMPLX_DEFAULT_ARG, false, false);
+    for (bitLenInt i = 0U; i < n; ++i) {
+        qftReg->RY((real1_f)(qftReg->Rand() * 2 * PI_R1), i);
+        qftReg->RZ((real1_f)(qftReg->Rand() * 2 * PI_R1), i);
+    }
+    for (bitLenInt i = 1U; i < n; ++i) {
+        qftReg->CNOT(i - 1U, i);
+    }
+
+    const std::vector<bitLenInt> scattered{ 5U, 0U, 9U, 3U, 12U };
+    const auto requireSame = [&](QInterfacePtr a, QInterfacePtr b) {
+        for (bitCapInt i = 0U; i < pow2(n); i += 7U) {
+            const complex ampA = a->GetAmplitude(i);
+            const complex ampB = b->GetAmplitude(i);
+            REQUIRE_FLOAT((real1_f)real(ampA), (real1_f)real(ampB));
+            REQUIRE_FLOAT((real1_f)imag(ampA), (real1_f)imag(ampB));
+        }
+    };
+
+    QInterfacePtr gates = qftReg->Clone();
+
+    qftReg->QFT(1U, 12U);
+    gates->QInterface::QFT(1U, 12U);
+    requireSame(qftReg, gates);
+
+    qftReg->QFTR(scattered);
+    gates->QInterface::QFTR(scattered);
+    requireSame(qftReg, gates);
+
+    qftReg->IQFTR(scattered);
+    gates->QInterface::IQFTR(scattered);
+    requireSame(qftReg, gates);
+
+    qftReg->IQFT(0U, 6U);
+    gates->QInterface::IQFT(0U, 6U);
+    requireSame(qftReg, gates);
+
+    qftReg->IQFT(0U, n);
+    gates->QInterface::IQFT(0U, n);
+    requireSame(qftReg, gates);
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_isfinished")
 {
     if (QINTERFACE_RESTRICTED) {
@@ -2950,6 +6079,37 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_compose")
     REQUIRE_THAT(qftReg, HasProbability(0, 8, 0x2b));
 }
 
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_compose_multi")
+{
+    qftReg = CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 3, 0x05, rng);
+    QInterfacePtr qftReg2 =
+        CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 2, 0x02, rng);
+    QInterfacePtr qftReg3 =
+        CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 3, 0x03, rng);
+    std::map<QInterfacePtr, bitLenInt> offsets = qftReg->Compose({ qftReg2, qftReg3 });
+    REQUIRE(offsets[qftReg2] == 3U);
+    REQUIRE(offsets[qftReg3] == 5U);
+    REQUIRE_THAT(qftReg, HasProbability(0, 8, 0x75));
+
+    // Superposed sources compose to the same state as pairwise composition.
+    qftReg = CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 2, 0x01, rng);
+    QInterfacePtr qftRegPairwise =
+        CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 2, 0x01, rng);
+    std::vector<QInterfacePtr> toCopy;
+    for (bitLenInt i = 0U; i < 3U; ++i) {
+        QInterfacePtr src =
+            CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 2, i, rng);
+        src->U(0U, 0.4 * i + 0.3, 0.2 * i, 0.1);
+        src->H(1U);
+        src->CNOT(0U, 1U);
+        qftRegPairwise->Compose(src->Clone());
+        toCopy.push_back(src);
+    }
+    qftReg->Compose(toCopy);
+    REQUIRE(qftReg->GetQubitCount() == 8U);
+    REQUIRE(qftReg->SumSqrDiff(qftRegPairwise) < 1e-5);
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_trydecompose")
 {
     if (testEngineType == QINTERFACE_QUNIT_MULTI || testEngineType == QINTERFACE_QPAGER ||
@@ -2978,6 +6138,37 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_trydecompose")
     REQUIRE_THAT(qftReg2, HasProbability(0, 4, 0xb));
 }
 
+TEST_CASE("test_trydecompose_schmidt")
+{
+    // QEngineCPU tests separability directly, for either side of the partition being the smaller one.
+    for (bitLenInt length = 3U; length <= 9U; length += 6U) {
+        QEngineCPUPtr qengine = std::make_shared<QEngineCPU>(12U, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+        for (bitLenInt i = 0U; i < 12U; ++i) {
+            qengine->U(i, 0.3 * i + 0.1, 0.7 * i, 0.2 - 0.5 * i);
+        }
+        // Entangle qubits within the part, (2 to 1 + length,) and within the remainder, but not across them.
+        qengine->CNOT(0U, 1U);
+        qengine->CNOT(11U, 1U);
+        qengine->CNOT(2U, 1U + length);
+        qengine->CZ(3U, 1U + length);
+
+        QEngineCPUPtr dest = std::make_shared<QEngineCPU>(length, 0U, nullptr, CMPLX_DEFAULT_ARG, false, false);
+        QInterfacePtr original = qengine->Clone();
+
+        QEngineCPUPtr entangled = std::dynamic_pointer_cast<QEngineCPU>(qengine->Clone());
+        entangled->CNOT(2U, 2U + length);
+        QInterfacePtr entangledOriginal = entangled->Clone();
+        REQUIRE(!entangled->TryDecompose(2U, dest));
+        REQUIRE(entangled->GetQubitCount() == 12U);
+        REQUIRE(entangled->SumSqrDiff(entangledOriginal) < 1e-5);
+
+        REQUIRE(qengine->TryDecompose(2U, dest));
+        REQUIRE(qengine->GetQubitCount() == (12U - length));
+        qengine->Compose(dest, 2U);
+        REQUIRE(qengine->SumSqrDiff(original) < 1e-5);
+    }
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_qunit_paging")
 {
     qftReg = CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 18, 1, rng, ONE_CMPLX);
@@ -3105,6 +6296,32 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_probbitsall")
     REQUIRE(probs1[3] < 0.01);
 }
 
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_probbits")
+{
+    qftReg = CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 6, 5, rng);
+    qftReg->H(0);
+    qftReg->CNOT(0, 3);
+    qftReg->RY(M_PI / 3, 4);
+    qftReg->CNOT(4, 5);
+    qftReg->RX(M_PI / 5, 1);
+
+    const std::vector<bitLenInt> bits{ 5, 1, 3, 0 };
+    real1 probs1[4];
+    qftReg->ProbBits(bits, probs1);
+    for (size_t i = 0U; i < bits.size(); ++i) {
+        REQUIRE_FLOAT((real1_f)probs1[i], qftReg->Prob(bits[i]));
+    }
+
+    real1 probs2[6];
+    qftReg->ProbAllQubits(probs2);
+    for (bitLenInt i = 0U; i < 6U; ++i) {
+        REQUIRE_FLOAT((real1_f)probs2[i], qftReg->Prob(i));
+    }
+    REQUIRE_FLOAT((real1_f)probs2[0], 0.5);
+    REQUIRE_FLOAT((real1_f)probs2[3], 0.5);
+    REQUIRE_FLOAT((real1_f)probs2[5], (real1_f)probs2[4]);
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_expectationbitsall")
 {
     qftReg = CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 8, 0, rng);
@@ -3113,6 +6330,140 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_expectationbitsall")
     REQUIRE_FLOAT(qftReg->ExpectationBitsAll(bits), 127 + (ONE_R1_F / 2))
 }
 
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_expectationpauliall")
+{
+    qftReg->SetPermutation(0);
+    qftReg->H(0);
+    qftReg->CNOT(0, 1);
+    qftReg->H(2);
+    qftReg->S(2);
+
+    const std::vector<PauliString> terms{ { { 0, 1 }, { PauliX, PauliX } }, { { 0, 1 }, { PauliY, PauliY } },
+        { { 0, 1 }, { PauliZ, PauliZ } }, { { 0 }, { PauliZ } }, { { 2 }, { PauliY } },
+        { { 0, 2 }, { PauliI, PauliX } }, { { 1, 0, 2 }, { PauliX, PauliX, PauliY } }, { {}, {} } };
+    const std::vector<real1_f> expectations = qftReg->ExpectationPauliAll(terms);
+
+    REQUIRE(expectations.size() == terms.size());
+    REQUIRE_FLOAT(expectations[0], ONE_R1_F);
+    REQUIRE_FLOAT(expectations[1], -ONE_R1_F);
+    REQUIRE_FLOAT(expectations[2], ONE_R1_F);
+    REQUIRE_FLOAT(expectations[3], ZERO_R1_F);
+    REQUIRE_FLOAT(expectations[4], ONE_R1_F);
+    REQUIRE_FLOAT(expectations[5], ZERO_R1_F);
+    REQUIRE_FLOAT(expectations[6], ONE_R1_F);
+    REQUIRE_FLOAT(expectations[7], ONE_R1_F);
+
+    // The state is left unchanged.
+    qftReg->IS(2);
+    qftReg->H(2);
+    qftReg->CNOT(0, 1);
+    qftReg->H(0);
+    REQUIRE_THAT(qftReg, HasProbability(0));
+}
+
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_tape_gradient")
+{
+    qftReg = CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 3U, 0U, rng, ONE_CMPLX,
+        enable_normalization, false, false, device_id, !disable_hardware_rng, sparse);
+
+    const complex hMtrx[4U]{ complex(SQRT1_2_R1, ZERO_R1), complex(SQRT1_2_R1, ZERO_R1), complex(SQRT1_2_R1, ZERO_R1),
+        complex(-SQRT1_2_R1, ZERO_R1) };
+    const complex xMtrx[4U]{ ZERO_CMPLX, ONE_CMPLX, ONE_CMPLX, ZERO_CMPLX };
+    QTape tape;
+    tape.Mtrx(hMtrx, 0U);
+    tape.RY(0U, 0U);
+    tape.RX(1U, 1U);
+    tape.Mtrx(xMtrx, 1U, { 0U });
+    tape.R(PauliZ, 2U, 2U, { 0U });
+    tape.Mtrx(hMtrx, 2U);
+    tape.R(PauliY, 3U, 2U, { 0U, 1U });
+    // Shared parameter
+    tape.RX(0U, 2U);
+    REQUIRE(tape.GetParamCount() == 4U);
+
+    const std::vector<PauliString> terms{ { { 0, 1 }, { PauliZ, PauliZ } }, { { 2 }, { PauliX } },
+        { { 1 }, { PauliY } }, { { 0, 2 }, { PauliY, PauliX } } };
+    const std::vector<real1_f> coeffs{ 0.5f, ONE_R1_F, -0.3f, 0.7f };
+    const std::vector<real1_f> params{ 0.3f, -1.1f, 0.8f, 2.0f };
+
+    const auto energy = [&](const std::vector<real1_f>& p) {
+        QInterfacePtr sim = qftReg->Clone();
+        tape.Run(sim, p);
+        const std::vector<real1_f> expectations = sim->ExpectationPauliAll(terms);
+        real1_f e = ZERO_R1_F;
+        for (size_t i = 0U; i < terms.size(); ++i) {
+            e += coeffs[i] * expectations[i];
+        }
+        return e;
+    };
+
+    std::vector<real1_f> gradient;
+    REQUIRE_FLOAT(tape.Gradient(qftReg, params, terms, coeffs, gradient), energy(params));
+    REQUIRE(gradient.size() == params.size());
+    // The simulator is left in its starting state.
+    REQUIRE_THAT(qftReg, HasProbability(0));
+
+    const real1_f h = 0.01f;
+    for (size_t i = 0U; i < params.size(); ++i) {
+        std::vector<real1_f> pPlus(params);
+        std::vector<real1_f> pMinus(params);
+        pPlus[i] += h;
+        pMinus[i] -= h;
+        REQUIRE_FLOAT(gradient[i], (energy(pPlus) - energy(pMinus)) / (2 * h));
+    }
+}
+
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_qcircuit")
+{
+    qftReg = CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 3U, 0U, rng, ONE_CMPLX,
+        enable_normalization, false, false, device_id, !disable_hardware_rng, sparse);
+
+    const complex tMtrx[4U]{ ONE_CMPLX, ZERO_CMPLX, ZERO_CMPLX, complex(SQRT1_2_R1, SQRT1_2_R1) };
+    const complex xMtrx[4U]{ ZERO_CMPLX, ONE_CMPLX, ONE_CMPLX, ZERO_CMPLX };
+
+    QCircuit cancelled;
+    cancelled.H(0U);
+    cancelled.H(0U);
+    REQUIRE(cancelled.GetGates().size() == 0U);
+
+    QCircuit circuit;
+    circuit.H(0U);
+    circuit.CNOT(0U, 1U);
+    circuit.R(PauliZ, 0U, 1U);
+    // Commutes back past the CNOT control and the RZ, to fuse with the H
+    circuit.Z(0U);
+    circuit.Mtrx(tMtrx, 0U);
+    circuit.X(2U);
+    circuit.X(2U);
+    circuit.MCMtrx({ 1U }, xMtrx, 2U);
+    circuit.MACMtrx({ 1U }, xMtrx, 2U);
+    circuit.R(PauliY, 1U, 2U, { 0U });
+    REQUIRE(circuit.GetQubitCount() == 3U);
+    REQUIRE(circuit.GetParamCount() == 2U);
+    REQUIRE(circuit.GetGates().size() == 5U);
+
+    const std::vector<real1_f> params{ 0.7f, -1.3f };
+    QInterfacePtr expected = qftReg->Clone();
+    expected->H(0U);
+    expected->CNOT(0U, 1U);
+    expected->RZ(params[0U], 1U);
+    expected->Z(0U);
+    expected->T(0U);
+    expected->CNOT(1U, 2U);
+    expected->AntiCNOT(1U, 2U);
+    expected->CRY(params[1U], 0U, 2U);
+
+    QInterfacePtr replayed = qftReg->Clone();
+    circuit.Run(replayed, params);
+    REQUIRE(replayed->ApproxCompare(expected));
+
+    QCircuitPtr bound = circuit.Bind(params);
+    REQUIRE(bound->GetParamCount() == 0U);
+    REQUIRE(bound->GetGates().size() <= circuit.GetGates().size());
+    bound->Run(qftReg);
+    REQUIRE(qftReg->ApproxCompare(expected));
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_probparity")
 {
     qftReg->SetPermutation(0x02);
@@ -3256,6 +6607,38 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_multishotmeasuremask")
     }
 }
 
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_multishotmeasuremask_distribution")
+{
+    qftReg = CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 8, 0, rng);
+
+    // P(qubit 5 = |1>) = 1/4, and qubit 1 is uniform, independently.
+    const std::vector<bitCapInt> qPowers{ pow2(5), pow2(1) };
+    qftReg->SetPermutation(0);
+    qftReg->RY((real1_f)(PI_R1 / 3), 5);
+    qftReg->H(1);
+
+    const unsigned shots = 20000U;
+    std::vector<unsigned long long> shotsArray(shots);
+    qftReg->MultiShotMeasureMask(qPowers, shots, &(shotsArray[0U]));
+    unsigned counts[4U] = { 0U, 0U, 0U, 0U };
+    for (unsigned i = 0U; i < shots; ++i) {
+        REQUIRE(shotsArray[i] < 4U);
+        ++(counts[shotsArray[i]]);
+    }
+    REQUIRE(((counts[1U] + counts[3U]) / (real1_f)shots) > 0.22);
+    REQUIRE(((counts[1U] + counts[3U]) / (real1_f)shots) < 0.28);
+    REQUIRE(((counts[2U] + counts[3U]) / (real1_f)shots) > 0.47);
+    REQUIRE(((counts[2U] + counts[3U]) / (real1_f)shots) < 0.53);
+
+    std::map<bitCapInt, int> results = qftReg->MultiShotMeasureMask(qPowers, shots);
+    int total = 0;
+    for (std::map<bitCapInt, int>::iterator it = results.begin(); it != results.end(); ++it) {
+        REQUIRE(it->first < 4U);
+        total += it->second;
+    }
+    REQUIRE(total == (int)shots);
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_forcem")
 {
     qftReg->SetPermutation(0x0);
@@ -3314,6 +6697,33 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_getquantumstate")
     REQUIRE_THAT(qftReg2, HasProbability(1U));
 }
 
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_mapstatevector")
+{
+    complex state[1U << 4U];
+    qftReg = CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 4, 0x0b, rng);
+    qftReg->H(0);
+    qftReg->CNOT(0, 2);
+    qftReg->T(2);
+    qftReg->GetQuantumState(state);
+
+    // Layers without one host-resident array return NULL, and callers fall back to GetQuantumState().
+    // (Up to global phase, which mapping may change.)
+    complex const* mapped = qftReg->MapStateVector();
+    if (mapped) {
+        complex inner = ZERO_CMPLX;
+        for (bitCapIntOcl i = 0; i < 16; i++) {
+            inner += conj(state[i]) * mapped[i];
+        }
+        REQUIRE_FLOAT((real1_f)norm(inner), ONE_R1_F);
+    }
+    qftReg->UnmapStateVector();
+
+    QEngineCPUPtr cpu = std::make_shared<QEngineCPU>(4, 0x0b, rng);
+    REQUIRE(cpu->MapStateVector() != NULL);
+    REQUIRE_FLOAT((real1_f)norm(cpu->MapStateVector()[0x0b]), ONE_R1_F);
+    cpu->UnmapStateVector();
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_getprobs")
 {
     real1 state[1U << 4U];
@@ -3328,6 +6738,58 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_getprobs")
     }
 }
 
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_for_each_chunk")
+{
+    // |0x0a>, |0x0b>, |0x3a>, and |0x3b>, at probability 1/4 each
+    complex state[1U << 6U];
+    real1 probs[1U << 6U];
+    qftReg = CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, 6, 0x0b, rng);
+    qftReg->H(0);
+    qftReg->H(4);
+    qftReg->CNOT(4, 5);
+    qftReg->GetQuantumState(state);
+    qftReg->GetProbs(probs);
+
+    // (Amplitudes agree up to a global phase, which might differ between reads.)
+    bitCapIntOcl next = 8U;
+    complex overlap = ZERO_CMPLX;
+    qftReg->ForEachAmplitudeChunk(
+        8U, 48U,
+        [&](const bitCapInt& offset, const bitCapIntOcl& length, complex const* amps) {
+            REQUIRE((bitCapIntOcl)offset == next);
+            REQUIRE(length <= 16U);
+            for (bitCapIntOcl i = 0U; i < length; ++i) {
+                overlap += conj(state[next + i]) * amps[i];
+            }
+            next += length;
+        },
+        16U);
+    REQUIRE(next == 56U);
+    REQUIRE_FLOAT((real1_f)norm(overlap), 0.25f);
+
+    next = 0U;
+    qftReg->ForEachProbChunk(0U, 64U, [&](const bitCapInt& offset, const bitCapIntOcl& length, real1 const* p) {
+        REQUIRE((bitCapIntOcl)offset == next);
+        for (bitCapIntOcl i = 0U; i < length; ++i) {
+            REQUIRE_FLOAT((real1_f)p[i], (real1_f)probs[next + i]);
+        }
+        next += length;
+    });
+    REQUIRE(next == 64U);
+    REQUIRE_THROWS(qftReg->ForEachProbChunk(60U, 8U, [](const bitCapInt&, const bitCapIntOcl&, real1 const*) {}));
+
+    std::vector<std::pair<bitCapInt, complex>> significant = qftReg->GetSignificantAmplitudes(0.1f);
+    REQUIRE(significant.size() == 4U);
+    significant = qftReg->GetSignificantAmplitudes(0.1f, 3U);
+    REQUIRE(significant.size() == 3U);
+    for (const auto& p : significant) {
+        const bitCapIntOcl perm = (bitCapIntOcl)p.first;
+        REQUIRE(((perm == 0x0aU) || (perm == 0x0bU) || (perm == 0x3aU) || (perm == 0x3bU)));
+        REQUIRE_FLOAT((real1_f)norm(p.second), 0.25f);
+    }
+    REQUIRE(qftReg->GetSignificantAmplitudes(0.5f).empty());
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_normalize")
 {
     qftReg->SetPermutation(0x03);
@@ -4608,6 +8070,46 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_grover_lookup")
     cl_free(toLoad);
 }
 
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_grover_lookup_fused")
+{
+    if (QINTERFACE_GROVER_RESTRICTED) {
+        return;
+    }
+
+    // Grover's search for the key of a value in a classical lookup table, with the oracle read straight from the table.
+    const bitLenInt indexStart = 4;
+    const bitLenInt indexLength = 8;
+    const bitLenInt valueLength = 9;
+    const bitCapInt TARGET_VALUE = 100;
+    const bitCapIntOcl TARGET_KEY = 230;
+
+    unsigned char* toLoad = cl_alloc(2 * (1 << indexLength));
+    for (int i = 0; i < (2 * (1 << indexLength)); i += 2) {
+        toLoad[i] = 1;
+        toLoad[i + 1] = 0;
+    }
+    toLoad[2 * TARGET_KEY] = (unsigned char)TARGET_VALUE;
+
+    // The oracle flips the phase of only the matching key.
+    qftReg->SetPermutation(0);
+    qftReg->H(indexStart, indexLength);
+    qftReg->PhaseFlipIfLookup(indexStart, indexLength, valueLength, toLoad, TARGET_VALUE);
+    const complex marked = qftReg->GetAmplitude((bitCapInt)TARGET_KEY << indexStart);
+    const complex unmarked = qftReg->GetAmplitude((bitCapInt)(TARGET_KEY + 1U) << indexStart);
+    // (The relative phase is all that's observable.)
+    REQUIRE_FLOAT(real(marked * conj(unmarked)), -ONE_R1 / 256);
+
+    qftReg->SetPermutation(0);
+    qftReg->H(indexStart, indexLength);
+    const int optIter = M_PI / (4.0 * asin(1.0 / sqrt(1 << indexLength)));
+    for (int i = 0; i < optIter; i++) {
+        qftReg->GroverLookupIteration(indexStart, indexLength, valueLength, toLoad, TARGET_VALUE);
+    }
+
+    REQUIRE_THAT(qftReg, HasProbability(indexStart, indexLength, TARGET_KEY));
+    cl_free(toLoad);
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_fast_grover")
 {
     if (QINTERFACE_GROVER_RESTRICTED) {
@@ -4869,6 +8371,132 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_timeevolve_uniform")
     REQUIRE_FLOAT((real1_f)abs((ONE_R1 - qftReg->Prob(0)) - cos(aParam * tDiff) * cos(aParam * tDiff)), 0);
 }
 
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_timeevolve_compiled")
+{
+    // A transverse-field Ising chain: Z_i Z_(i + 1) = Z_(i + 1) - 2 * |1><1|_i Z_(i + 1), plus X fields
+    const bitLenInt n = 3U;
+    const real1 field = (real1)0.7f;
+    const real1 t = ONE_R1;
+
+    BitOp xField(new complex[4], std::default_delete<complex[]>());
+    xField.get()[0] = ZERO_CMPLX;
+    xField.get()[1] = complex(field, ZERO_R1);
+    xField.get()[2] = complex(field, ZERO_R1);
+    xField.get()[3] = ZERO_CMPLX;
+    BitOp z(new complex[4], std::default_delete<complex[]>());
+    z.get()[0] = ONE_CMPLX;
+    z.get()[1] = ZERO_CMPLX;
+    z.get()[2] = ZERO_CMPLX;
+    z.get()[3] = -ONE_CMPLX;
+    BitOp cz(new complex[4], std::default_delete<complex[]>());
+    cz.get()[0] = complex((real1)(-2), ZERO_R1);
+    cz.get()[1] = ZERO_CMPLX;
+    cz.get()[2] = ZERO_CMPLX;
+    cz.get()[3] = complex((real1)2, ZERO_R1);
+
+    Hamiltonian h;
+    for (bitLenInt i = 0U; i < n; ++i) {
+        h.push_back(std::make_shared<HamiltonianOp>(i, xField));
+    }
+    for (bitLenInt i = 0U; (i + 1U) < n; ++i) {
+        h.push_back(std::make_shared<HamiltonianOp>(i + 1U, z));
+        h.push_back(std::make_shared<HamiltonianOp>(std::vector<bitLenInt>{ i }, i + 1U, cz));
+    }
+
+    const auto evolve = [&](TrotterOrder order, bool mergeDiagonals, unsigned steps) -> QInterfacePtr {
+        QInterfacePtr qReg =
+            CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, n, 1U, rng);
+        qReg->TimeEvolve(CompiledHamiltonian(h, (real1_f)(t / steps), order, mergeDiagonals), steps);
+        return qReg;
+    };
+    const auto requireClose = [&](QInterfacePtr a, QInterfacePtr b) {
+        for (bitCapInt i = 0U; i < pow2(n); ++i) {
+            REQUIRE_FLOAT(a->ProbAll(i), b->ProbAll(i));
+        }
+    };
+
+    // Fusion and diagonal merging shrink the step without changing it.
+    REQUIRE(CompiledHamiltonian(h, (real1_f)t).GetOps().size() < h.size());
+    REQUIRE(CompiledHamiltonian(h, (real1_f)t, TROTTER_FIRST_ORDER, false).GetOps().size() <= h.size());
+
+    QInterfacePtr legacy =
+        CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, n, 1U, rng);
+    for (unsigned i = 0U; i < 8U; ++i) {
+        legacy->TimeEvolve(h, (real1_f)(t / 8));
+    }
+    requireClose(legacy, evolve(TROTTER_FIRST_ORDER, true, 8U));
+    requireClose(legacy, evolve(TROTTER_FIRST_ORDER, false, 8U));
+
+    // Higher order products converge to the same (well-resolved) evolution in far fewer steps.
+    QInterfacePtr exact = evolve(TROTTER_FOURTH_ORDER, true, 64U);
+    requireClose(exact, evolve(TROTTER_SECOND_ORDER, true, 16U));
+    requireClose(exact, evolve(TROTTER_SECOND_ORDER, false, 16U));
+    requireClose(exact, evolve(TROTTER_FOURTH_ORDER, true, 4U));
+
+    REQUIRE_THROWS(CompiledHamiltonian(h, (real1_f)t, (TrotterOrder)3));
+}
+
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_timeevolve_krylov")
+{
+    // The transverse-field Ising chain of test_timeevolve_compiled, with a toggled anti-controlled field term
+    const bitLenInt n = 4U;
+    const real1 field = (real1)0.7f;
+    const real1 t = (real1)5.0f;
+
+    BitOp xField(new complex[4], std::default_delete<complex[]>());
+    xField.get()[0] = ZERO_CMPLX;
+    xField.get()[1] = complex(field, ZERO_R1);
+    xField.get()[2] = complex(field, ZERO_R1);
+    xField.get()[3] = ZERO_CMPLX;
+    BitOp z(new complex[4], std::default_delete<complex[]>());
+    z.get()[0] = ONE_CMPLX;
+    z.get()[1] = ZERO_CMPLX;
+    z.get()[2] = ZERO_CMPLX;
+    z.get()[3] = -ONE_CMPLX;
+    BitOp cz(new complex[4], std::default_delete<complex[]>());
+    cz.get()[0] = complex((real1)(-2), ZERO_R1);
+    cz.get()[1] = ZERO_CMPLX;
+    cz.get()[2] = ZERO_CMPLX;
+    cz.get()[3] = complex((real1)2, ZERO_R1);
+
+    Hamiltonian h;
+    for (bitLenInt i = 0U; i < n; ++i) {
+        h.push_back(std::make_shared<HamiltonianOp>(i, xField));
+    }
+    for (bitLenInt i = 0U; (i + 1U) < n; ++i) {
+        h.push_back(std::make_shared<HamiltonianOp>(i + 1U, z));
+        h.push_back(std::make_shared<HamiltonianOp>(std::vector<bitLenInt>{ i }, i + 1U, cz));
+    }
+    h.push_back(std::make_shared<HamiltonianOp>(
+        std::vector<bitLenInt>{ 0U, 3U }, 1U, xField, true, std::vector<bool>{ true, false }));
+
+    // A fourth order product of many short steps, as the reference...
+    const unsigned steps = 256U;
+    QInterfacePtr trotter =
+        CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, n, 1U, rng);
+    trotter->TimeEvolve(CompiledHamiltonian(h, (real1_f)(t / steps), TROTTER_FOURTH_ORDER), steps);
+
+    // ...which the Krylov evolution matches, in one call.
+    const KrylovHamiltonian krylov(h);
+    qftReg = CreateQuantumInterface({ testEngineType, testSubEngineType, testSubSubEngineType }, n, 1U, rng);
+    qftReg->TimeEvolve(krylov, (real1_f)t);
+    for (bitCapInt i = 0U; i < pow2(n); ++i) {
+        REQUIRE_FLOAT(qftReg->ProbAll(i), trotter->ProbAll(i));
+    }
+
+    // Backward evolution undoes it.
+    qftReg->TimeEvolve(krylov, (real1_f)(-t));
+    REQUIRE_FLOAT(qftReg->ProbAll(1U), ONE_R1_F);
+
+    // The whole evolution takes far fewer passes of the operator than the product formula takes of its terms.
+    ParallelFor pf;
+    std::unique_ptr<complex[]> state(new complex[pow2Ocl(n)]());
+    state[1U] = ONE_CMPLX;
+    REQUIRE(krylov.Evolve(pf, state.get(), pow2Ocl(n), (real1_f)t) < steps);
+
+    REQUIRE_THROWS(KrylovHamiltonian(h, (real1_f)krylov.GetTolerance(), 0U));
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_qfusion_controlled")
 {
     if (QINTERFACE_RESTRICTED) {
@@ -4937,6 +8565,58 @@ TEST_CASE_METHOD(QInterfaceTestFixture, "test_qneuron")
     }
 }
 
+TEST_CASE_METHOD(QInterfaceTestFixture, "test_qneuron_gradient")
+{
+    const std::vector<bitLenInt> inputIndices{ 0, 1 };
+    const bitLenInt outputIndex = 2;
+    real1 angles[4U]{ 0.3f, -0.7f, 1.1f, 0.2f };
+    const real1_f h = 0.01f;
+
+    qftReg->Dispose(0, qftReg->GetQubitCount() - 3U);
+
+    for (int resetInit = 1; resetInit >= 0; --resetInit) {
+        qftReg->SetPermutation(0);
+        qftReg->H(0);
+        qftReg->RY(0.4f, 1);
+        qftReg->CNOT(0, 1);
+        qftReg->RX(0.9f, outputIndex);
+
+        QNeuron neuron(qftReg->Clone(), inputIndices, outputIndex);
+        neuron.SetAngles(angles);
+        real1 gradient[4U]{ ZERO_R1, ZERO_R1, ZERO_R1, ZERO_R1 };
+        const real1_f prob = neuron.AccumulateGradient(false, gradient, resetInit);
+
+        QNeuron unperturbed(qftReg->Clone(), inputIndices, outputIndex);
+        unperturbed.SetAngles(angles);
+        REQUIRE_FLOAT(prob, unperturbed.Predict(false, resetInit));
+
+        for (size_t i = 0U; i < 4U; ++i) {
+            real1 plus[4U], minus[4U];
+            std::copy(angles, angles + 4U, plus);
+            std::copy(angles, angles + 4U, minus);
+            plus[i] += h;
+            minus[i] -= h;
+            QNeuron plusNeuron(qftReg->Clone(), inputIndices, outputIndex);
+            plusNeuron.SetAngles(plus);
+            QNeuron minusNeuron(qftReg->Clone(), inputIndices, outputIndex);
+            minusNeuron.SetAngles(minus);
+            REQUIRE_FLOAT(gradient[i],
+                (plusNeuron.Predict(false, resetInit) - minusNeuron.Predict(false, resetInit)) / (2 * h));
+        }
+    }
+
+    // One gradient step trains each classical input permutation exactly, as with LearnPermutation().
+    QNeuron xorNeuron(qftReg, inputIndices, outputIndex);
+    for (bitCapInt perm = 0; perm < 4U; perm++) {
+        qftReg->SetPermutation(perm);
+        xorNeuron.LearnGradient((perm & 1U) != (perm >> 1U), 0.5f);
+    }
+    for (bitCapInt perm = 0; perm < 4U; perm++) {
+        qftReg->SetPermutation(perm);
+        REQUIRE(xorNeuron.Predict((perm & 1U) != (perm >> 1U)) > 0.99f);
+    }
+}
+
 TEST_CASE_METHOD(QInterfaceTestFixture, "test_bell_m")
 {
     const std::vector<bitCapInt> qPowers{ 1, 2 };
@@ -18,6 +18,7 @@
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <vector>
 
 /* A quick-and-dirty epsilon for clamping floating point values. */
 #define QRACK_TEST_EPSILON 0.9
@@ -50,6 +51,25 @@ extern std::vector<int64_t> devList;
 extern bool optimal;
 extern bool optimal_single;
 
+/* One benchmark width's timing summary, for machine-readable output and baseline regression gating. */
+struct BenchmarkResult {
+    std::string test;
+    std::string stack;
+    bitLenInt qubits;
+    int samples;
+    int failures;
+    double meanMs;
+    double medianMs;
+    double p99Ms;
+    // Process peak resident memory during this width, (0 if unavailable)
+    size_t peakKb;
+    // State vector width, (2^qubits,) per sample, divided by mean sample time
+    double ampUpdatesPerSec;
+    // Final state overlap, |<reference|state>|^2, with a QEngineCPU reference, (negative if not measured)
+    double fidelity;
+};
+extern std::vector<BenchmarkResult> benchmarkResults;
+
 /* Declare the stream-to-probability prior to including catch.hpp. */
 namespace Qrack {
 